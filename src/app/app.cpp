@@ -14,6 +14,7 @@
 #include "app/app_mod.h"
 #include "app/check_update.h"
 #include "app/cli/app_options.h"
+#include "app/cli/batch_server.h"
 #include "app/cli/cli_processor.h"
 #include "app/cli/default_cli_delegate.h"
 #include "app/cli/preview_cli_delegate.h"
@@ -41,6 +42,7 @@
 #include "app/send_crash.h"
 #include "app/site.h"
 #include "app/tools/active_tool.h"
+#include "app/tools/stroke_recorder.h"
 #include "app/tools/tool_box.h"
 #include "app/ui/backup_indicator.h"
 #include "app/ui/color_bar.h"
@@ -55,6 +57,7 @@
 #include "app/ui/workspace.h"
 #include "app/ui_context.h"
 #include "app/util/clipboard.h"
+#include "base/chrono.h"
 #include "base/exception.h"
 #include "base/fs.h"
 #include "base/split_string.h"
@@ -64,7 +67,9 @@
 #include "os/surface.h"
 #include "os/system.h"
 #include "os/window.h"
+#include "perf/trace.h"
 #include "render/render.h"
+#include "sched/scheduler.h"
 #include "ui/intern.h"
 #include "ui/ui.h"
 #include "updater/user_agent.h"
@@ -116,6 +121,31 @@ private:
 
 #endif // ENABLER_SCRIPTING
 
+namespace {
+
+// Logs the time spent in each phase of the startup (use --verbose to
+// see these messages), the phases are added to the --trace file too.
+class StartupTrace {
+public:
+  void phase(const char* name) {
+    const double t = m_chrono.elapsed();
+    LOG(INFO, "APP: Startup phase \"%s\" took %.2f ms (total %.2f ms)\n",
+        name, (t - m_last) * 1000.0, t * 1000.0);
+    m_last = t;
+
+    const int64_t traceTime = perf::Trace::now();
+    perf::Trace::addZone(name, m_traceTime, traceTime);
+    m_traceTime = traceTime;
+  }
+
+private:
+  base::Chrono m_chrono;
+  double m_last = 0.0;
+  int64_t m_traceTime = perf::Trace::now();
+};
+
+} // anonymous namespace
+
 class App::CoreModules {
 public:
 #ifdef ENABLE_UI
@@ -139,12 +169,15 @@ public:
 class App::Modules {
 public:
   LoggerModule m_loggerModule;
-  FileSystemModule m_file_system_module;
+  // The file system is used only by the file selector (GUI mode)
+  std::unique_ptr<FileSystemModule> m_file_system_module;
   Extensions m_extensions;
   // Load main language (after loading the extensions)
   LoadLanguage m_loadLanguage;
-  tools::ToolBox m_toolbox;
-  tools::ActiveToolManager m_activeToolManager;
+  // Tools are loaded on demand (they are not needed to process most
+  // of the CLI options in batch mode)
+  std::unique_ptr<tools::ToolBox> m_toolbox;
+  std::unique_ptr<tools::ActiveToolManager> m_activeToolManager;
   Commands m_commands;
 #ifdef ENABLE_UI
   RecentFiles m_recent_files;
@@ -162,7 +195,6 @@ public:
           Preferences& pref)
     : m_loggerModule(createLogInDesktop)
     , m_loadLanguage(pref, m_extensions)
-    , m_activeToolManager(&m_toolbox)
 #ifdef ENABLE_UI
     , m_recent_files(pref.general.recentItems())
 #endif
@@ -179,6 +211,25 @@ public:
 #endif
   }
 
+  void createFileSystemModule() {
+    if (!m_file_system_module)
+      m_file_system_module = std::make_unique<FileSystemModule>();
+  }
+
+  tools::ToolBox* toolBox() {
+    if (!m_toolbox) {
+      LOG("APP: Loading tools...\n");
+      m_toolbox = std::make_unique<tools::ToolBox>();
+    }
+    return m_toolbox.get();
+  }
+
+  tools::ActiveToolManager* activeToolManager() {
+    if (!m_activeToolManager)
+      m_activeToolManager = std::make_unique<tools::ActiveToolManager>(toolBox());
+    return m_activeToolManager.get();
+  }
+
   app::crash::DataRecovery* recovery() {
 #ifdef ENABLE_DATA_RECOVERY
     return m_recovery.get();
@@ -248,6 +299,7 @@ App::App(AppMod* mod)
   , m_legacy(nullptr)
   , m_isGui(false)
   , m_isShell(false)
+  , m_isBatchServer(false)
 #ifdef ENABLE_UI
   , m_backupIndicator(nullptr)
 #endif
@@ -263,14 +315,34 @@ int App::initialize(const AppOptions& options)
 {
   os::System* system = os::instance();
 
+  m_traceFilename = options.traceFilename();
+  m_traceSummary = options.traceSummary();
+  if (!m_traceFilename.empty() || m_traceSummary) {
+    perf::Trace::start();
+    perf::Trace::setThreadName("main");
+  }
+  StartupTrace trace;
+
+  if (!options.recordStrokesFilename().empty() &&
+      !tools::StrokeRecorder::start(options.recordStrokesFilename())) {
+    LOG(ERROR, "APP: Cannot create file %s to record strokes\n",
+        options.recordStrokesFilename().c_str());
+  }
+
 #ifdef ENABLE_UI
   m_isGui = options.startUI() && !options.previewCLI();
 #else
   m_isGui = false;
 #endif
   m_isShell = options.startShell();
+  m_isBatchServer = options.startBatchServer();
   m_coreModules = std::make_unique<CoreModules>();
 
+  // Number of threads of the scheduler shared by all background
+  // tasks (0 = number of cores)
+  sched::Scheduler::setDefaultThreads(preferences().general.workerThreads());
+  trace.phase("config");
+
 #if LAF_WINDOWS
 
   if (options.disableWintab() ||
@@ -320,6 +392,7 @@ int App::initialize(const AppOptions& options)
   }
 
   initialize_color_spaces(preferences());
+  trace.phase("system");
 
 #ifdef ENABLE_DRM
   LOG("APP: Initializing DRM...\n");
@@ -328,7 +401,9 @@ int App::initialize(const AppOptions& options)
 
   // Load modules
   m_modules = std::make_unique<Modules>(createLogInDesktop, preferences());
+  trace.phase("modules");
   m_legacy = std::make_unique<LegacyModules>(isGui() ? REQUIRE_INTERFACE: 0);
+  trace.phase("legacy modules");
 #ifdef ENABLE_UI
   m_brushes = std::make_unique<AppBrushes>();
 #endif
@@ -343,12 +418,15 @@ int App::initialize(const AppOptions& options)
   // Load or create the default palette, or migrate the default
   // palette from an old format palette to the new one, etc.
   load_default_palette();
+  trace.phase("default palette");
 
 #ifdef ENABLE_UI
   // Initialize GUI interface
   if (isGui()) {
     LOG("APP: GUI mode\n");
 
+    m_modules->createFileSystemModule();
+
     // Set the ClipboardDelegate impl to copy/paste text in the native
     // clipboard from the ui::Entry control.
     m_uiSystem->setClipboardDelegate(&m_modules->m_clipboard);
@@ -376,6 +454,7 @@ int App::initialize(const AppOptions& options)
 
     // Show the main window (this is not modal, the code continues)
     m_mainWindow->openWindow();
+    trace.phase("main window");
 
 #if LAF_LINUX // TODO check why this is required and we cannot call
               //      updateAllDisplaysWithNewScale() on Linux/X11
@@ -399,6 +478,7 @@ int App::initialize(const AppOptions& options)
   // Call the init() function from all plugins
   LOG("APP: Initializing scripts...\n");
   extensions().executeInitActions();
+  trace.phase("scripts");
 #endif
 
   // Process options
@@ -414,6 +494,7 @@ int App::initialize(const AppOptions& options)
     CliProcessor cli(delegate.get(), options);
     code = cli.process(context());
   }
+  trace.phase("options");
 
   LOG("APP: Finish launching...\n");
   system->finishLaunching();
@@ -561,6 +642,12 @@ void App::run()
   }
 #endif  // ENABLE_SCRIPTING
 
+  // Execute CLI jobs from stdin
+  if (m_isBatchServer) {
+    BatchServer server(context());
+    server.run(std::cin, std::cout);
+  }
+
   // ----------------------------------------------------------------------
 
 #ifdef ENABLE_SCRIPTING
@@ -592,6 +679,17 @@ App::~App()
     LOG("APP: Exit\n");
     ASSERT(m_instance == this);
 
+    tools::StrokeRecorder::stop();
+
+    if (!m_traceFilename.empty() || m_traceSummary) {
+      perf::Trace::stop();
+      if (!m_traceFilename.empty() &&
+          !perf::Trace::saveJson(m_traceFilename))
+        LOG(ERROR, "APP: Error saving trace file %s\n", m_traceFilename.c_str());
+      if (m_traceSummary)
+        perf::Trace::writeSummary(std::cout);
+    }
+
 #ifdef ENABLE_SCRIPTING
     // Destroy scripting engine calling a method (instead of using
     // reset()) because we need to keep the "m_engine" pointer valid
@@ -674,17 +772,17 @@ bool App::isPortable()
 tools::ToolBox* App::toolBox() const
 {
   ASSERT(m_modules != NULL);
-  return &m_modules->m_toolbox;
+  return m_modules->toolBox();
 }
 
 tools::Tool* App::activeTool() const
 {
-  return m_modules->m_activeToolManager.activeTool();
+  return m_modules->activeToolManager()->activeTool();
 }
 
 tools::ActiveToolManager* App::activeToolManager() const
 {
-  return &m_modules->m_activeToolManager;
+  return m_modules->activeToolManager();
 }
 
 RecentFiles* App::recentFiles() const
@@ -0,0 +1,145 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/background_jobs.h"
+
+#include "app/console.h"
+#include "app/job.h"
+#include "ui/manager.h"
+#include "ui/timer.h"
+
+#include <exception>
+
+namespace app {
+
+// Period to check if the running jobs are done
+static const int kCheckPeriodMSecs = 100;
+
+BackgroundJobs::BackgroundJobs()
+{
+}
+
+BackgroundJobs::~BackgroundJobs()
+{
+  ASSERT(m_queues.empty());
+}
+
+void BackgroundJobs::addJob(Doc* doc, CreateJob&& createJob, JobDone&& jobDone)
+{
+  m_queues[doc].pending.push_back(
+    Item{ std::move(createJob), std::move(jobDone) });
+
+  // The job is created in the next tick, so the caller can release
+  // its lock of the document before (e.g. a command that adds a job
+  // while it has the active document locked for reading).
+
+  // Created with the first job as the UI manager doesn't exist when
+  // the context is created
+  if (!m_timer) {
+    ASSERT(ui::Manager::getDefault());
+    m_timer = std::make_unique<ui::Timer>(kCheckPeriodMSecs);
+    m_timer->Tick.connect([this]{ onTick(); });
+  }
+  if (!m_timer->isRunning())
+    m_timer->start();
+}
+
+bool BackgroundJobs::hasJobs(const Doc* doc) const
+{
+  return (m_queues.find(const_cast<Doc*>(doc)) != m_queues.end());
+}
+
+void BackgroundJobs::cancelJobs(Doc* doc)
+{
+  auto it = m_queues.find(doc);
+  if (it == m_queues.end())
+    return;
+
+  Queue& queue = it->second;
+  queue.pending.clear();
+  if (queue.job) {
+    // The document is being closed, we don't need to update it
+    queue.jobDone = nullptr;
+    queue.job->cancelJob();
+    finishJob(queue);
+  }
+  m_queues.erase(it);
+}
+
+void BackgroundJobs::cancelAllJobs()
+{
+  while (!m_queues.empty())
+    cancelJobs(m_queues.begin()->first);
+
+  if (m_timer)
+    m_timer->stop();
+}
+
+void BackgroundJobs::onTick()
+{
+  for (auto it=m_queues.begin(); it!=m_queues.end(); ) {
+    Queue& queue = it->second;
+    if (queue.job && queue.job->isDone())
+      finishJob(queue);
+    if (!queue.job)
+      startNextJob(queue);
+
+    if (!queue.job && queue.pending.empty())
+      it = m_queues.erase(it);
+    else
+      ++it;
+  }
+
+  if (m_queues.empty())
+    m_timer->stop();
+}
+
+void BackgroundJobs::startNextJob(Queue& queue)
+{
+  ASSERT(!queue.job);
+
+  while (!queue.pending.empty()) {
+    Item item = std::move(queue.pending.front());
+    queue.pending.pop_front();
+
+    try {
+      queue.job = item.createJob();
+    }
+    catch (const std::exception& ex) {
+      // E.g. the document cannot be locked
+      Console::showException(ex);
+      continue;
+    }
+
+    if (queue.job) {
+      queue.jobDone = std::move(item.jobDone);
+      queue.job->startJobInBackground();
+      break;
+    }
+  }
+}
+
+void BackgroundJobs::finishJob(Queue& queue)
+{
+  ASSERT(queue.job);
+
+  queue.job->waitJob();
+  // The job is destroyed before calling jobDone() so the document
+  // is unlocked (and the transaction committed) at that point
+  queue.job.reset();
+
+  if (queue.jobDone) {
+    JobDone jobDone = std::move(queue.jobDone);
+    queue.jobDone = nullptr;
+    jobDone();
+  }
+}
+
+} // namespace app
@@ -0,0 +1,76 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_BACKGROUND_JOBS_H_INCLUDED
+#define APP_BACKGROUND_JOBS_H_INCLUDED
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+
+namespace ui {
+  class Timer;
+}
+
+namespace app {
+
+  class Doc;
+  class Job;
+
+  // Queue of long-running jobs (e.g. resizing a big sprite) that are
+  // executed without blocking the UI. Jobs of the same document are
+  // executed one after the other (each job locks its document while
+  // it runs), and jobs of different documents run at the same time,
+  // so the other documents can be used in the meantime.
+  class BackgroundJobs {
+  public:
+    // Creates the job (locking the document for writing), this is
+    // called when the previous job of the same document is finished.
+    typedef std::function<std::unique_ptr<Job>()> CreateJob;
+
+    // Called from the UI thread after the job is finished and
+    // destroyed (i.e. its transaction was committed).
+    typedef std::function<void()> JobDone;
+
+    BackgroundJobs();
+    ~BackgroundJobs();
+
+    void addJob(Doc* doc, CreateJob&& createJob, JobDone&& jobDone);
+
+    // Returns true if there are running or queued jobs for the given
+    // document.
+    bool hasJobs(const Doc* doc) const;
+
+    // Cancels the jobs of the given document (e.g. because it's
+    // being removed from the context) and waits the running one.
+    void cancelJobs(Doc* doc);
+    void cancelAllJobs();
+
+  private:
+    struct Item {
+      CreateJob createJob;
+      JobDone jobDone;
+    };
+
+    struct Queue {
+      std::unique_ptr<Job> job;
+      JobDone jobDone;
+      std::deque<Item> pending;
+    };
+
+    void onTick();
+    void startNextJob(Queue& queue);
+    void finishJob(Queue& queue);
+
+    std::map<Doc*, Queue> m_queues;
+    std::unique_ptr<ui::Timer> m_timer;
+  };
+
+} // namespace app
+
+#endif
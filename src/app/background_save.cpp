@@ -0,0 +1,340 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/background_save.h"
+
+#include "app/app.h"
+#include "app/console.h"
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_undo.h"
+#include "app/file/file.h"
+#include "app/i18n/strings.h"
+#include "app/recent_files.h"
+#include "app/ui/status_bar.h"
+#include "base/fs.h"
+#include "base/string.h"
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/slice.h"
+#include "doc/sprite.h"
+#include "doc/tag.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "fmt/format.h"
+#include "ui/system.h"
+
+#include <algorithm>
+#include <map>
+#include <vector>
+
+namespace app {
+
+using namespace doc;
+
+namespace {
+
+// Pending operations (only accessed from the UI thread)
+std::vector<BackgroundSave*> g_saves;
+
+void copy_layer(const Layer* srcLayer,
+                Sprite* dstSprite,
+                LayerGroup* dstParent,
+                std::map<ObjectId, CelDataRef>& celDatas)
+{
+  std::unique_ptr<Layer> dstLayer;
+  if (srcLayer->isGroup())
+    dstLayer = std::make_unique<LayerGroup>(dstSprite);
+  else if (srcLayer->isTilemap())
+    dstLayer = std::make_unique<LayerTilemap>(
+      dstSprite, static_cast<const LayerTilemap*>(srcLayer)->tilesetIndex());
+  else if (srcLayer->isImage())
+    dstLayer = std::make_unique<LayerImage>(dstSprite);
+  else
+    return;
+
+  dstLayer->setName(srcLayer->name());
+  dstLayer->setFlags(srcLayer->flags());
+  dstLayer->setUserData(srcLayer->userData());
+
+  if (srcLayer->isImage()) {
+    auto src = static_cast<const LayerImage*>(srcLayer);
+    auto dst = static_cast<LayerImage*>(dstLayer.get());
+    dst->setBlendMode(src->blendMode());
+    dst->setOpacity(src->opacity());
+
+    CelConstIterator it = src->getCelBegin();
+    CelConstIterator end = src->getCelEnd();
+    for (; it != end; ++it) {
+      const Cel* srcCel = *it;
+
+      // Linked cels share the same CelData
+      CelDataRef& celData = celDatas[srcCel->data()->id()];
+      if (!celData) {
+        celData.reset(new CelData(*srcCel->data()));
+        celData->setUserData(srcCel->data()->userData());
+        celData->setImage(ImageRef(Image::createCopy(srcCel->image())), dst);
+      }
+
+      auto dstCel = std::make_unique<Cel>(srcCel->frame(), celData);
+      dstCel->setZIndex(srcCel->zIndex());
+      dst->addCel(dstCel.release());
+    }
+  }
+  else if (srcLayer->isGroup()) {
+    for (const Layer* child : static_cast<const LayerGroup*>(srcLayer)->layers())
+      copy_layer(child, dstSprite, static_cast<LayerGroup*>(dstLayer.get()), celDatas);
+  }
+
+  dstParent->addLayer(dstLayer.release());
+}
+
+// Creates a copy of the document with all the information that is
+// saved in .aseprite files. Unlike Doc::duplicate(), tilesets and
+// tilemaps are kept as they are. Images are copied because they are
+// modified in-place by tools.
+std::unique_ptr<Doc> copy_doc_to_save(const Doc* doc)
+{
+  const Sprite* srcSprite = doc->sprite();
+  std::unique_ptr<Sprite> spritePtr(
+    new Sprite(srcSprite->spec(),
+               srcSprite->palette(frame_t(0))->size()));
+  auto copy = std::make_unique<Doc>(spritePtr.get());
+  Sprite* sprite = spritePtr.release();
+
+  sprite->setPixelRatio(srcSprite->pixelRatio());
+  sprite->setGridBounds(srcSprite->gridBounds());
+  sprite->setUserData(srcSprite->userData());
+  sprite->setTileManagementPlugin(srcSprite->tileManagementPlugin());
+
+  sprite->setTotalFrames(srcSprite->totalFrames());
+  for (frame_t i=0; i<srcSprite->totalFrames(); ++i)
+    sprite->setFrameDuration(i, srcSprite->frameDuration(i));
+
+  for (const Palette* pal : srcSprite->getPalettes())
+    sprite->setPalette(pal, true);
+
+  for (const Tag* tag : srcSprite->tags())
+    sprite->tags().add(new Tag(*tag));
+
+  for (const Slice* slice : srcSprite->slices())
+    sprite->slices().add(new Slice(*slice));
+
+  if (srcSprite->hasTilesets()) {
+    for (const Tileset* srcTileset : *srcSprite->tilesets()) {
+      // Keep the empty slots to keep the same tileset indexes
+      if (!srcTileset) {
+        sprite->tilesets()->add(nullptr);
+        continue;
+      }
+
+      auto tileset = std::make_unique<Tileset>(sprite,
+                                               srcTileset->grid(),
+                                               srcTileset->size());
+      tileset->setName(srcTileset->name());
+      tileset->setBaseIndex(srcTileset->baseIndex());
+      tileset->setUserData(srcTileset->userData());
+      tileset->setExternal(srcTileset->externalFilename(),
+                           srcTileset->externalTileset());
+      for (tile_index ti=0; ti<srcTileset->size(); ++ti) {
+        tileset->set(ti, ImageRef(Image::createCopy(srcTileset->get(ti).get())));
+        tileset->setTileData(ti, srcTileset->getTileData(ti));
+      }
+      sprite->tilesets()->add(tileset.release());
+    }
+  }
+
+  std::map<ObjectId, CelDataRef> celDatas;
+  for (const Layer* layer : srcSprite->root()->layers())
+    copy_layer(layer, sprite, sprite->root(), celDatas);
+
+  copy->setFilename(doc->filename());
+  copy->setFormatOptions(doc->formatOptions());
+  return copy;
+}
+
+} // anonymous namespace
+
+BackgroundSave::BackgroundSave(Doc* doc,
+                               std::unique_ptr<Doc>&& copy,
+                               std::unique_ptr<FileOp>&& fop,
+                               const std::string& filename)
+  : m_doc(doc)
+  , m_copy(std::move(copy))
+  , m_fop(std::move(fop))
+  , m_filename(filename)
+  , m_state(doc->undoHistory()->currentState())
+  , m_done(false)
+{
+  m_doc->add_observer(this);
+  m_doc->undoHistory()->add_observer(this);
+
+  m_thread = std::thread([this]{
+    // Warning: This is executed from a worker thread
+    try {
+      m_fop->operate(nullptr);
+    }
+    catch (const std::exception& e) {
+      m_fop->setError("Error saving file:\n%s", e.what());
+    }
+    m_fop->done();
+    m_done = true;
+
+    BackgroundSave* self = this;
+    ui::execute_from_ui_thread([self]{
+      // The operation could be finished with wait()
+      auto it = std::find(g_saves.begin(), g_saves.end(), self);
+      if (it != g_saves.end() && self->m_done)
+        self->finish();
+    });
+  });
+}
+
+BackgroundSave::~BackgroundSave()
+{
+  if (m_thread.joinable())
+    m_thread.join();
+  detach();
+}
+
+// static
+bool BackgroundSave::isSupported(const std::string& filename)
+{
+  const std::string ext =
+    base::string_to_lower(base::get_file_extension(filename));
+  return (ext == "ase" || ext == "aseprite");
+}
+
+// static
+bool BackgroundSave::start(Context* context,
+                           Doc* doc,
+                           const std::string& filename)
+{
+  // Only one operation can write the same file
+  wait(filename);
+
+  static bool atExit = false;
+  if (!atExit) {
+    atExit = true;
+    App::instance()->Exit.connect([]{ BackgroundSave::wait(); });
+  }
+
+  // The copy is created with the document locked (by the caller)
+  std::unique_ptr<Doc> copy = copy_doc_to_save(doc);
+
+  std::unique_ptr<FileOp> fop(
+    FileOp::createSaveDocumentOperation(
+      context,
+      FileOpROI(copy.get(), gfx::Rect(), std::string(), std::string(),
+                doc::SelectedFrames(), false),
+      filename, std::string(), false));
+  if (!fop)
+    return false;
+
+  if (auto statusBar = StatusBar::instance()) {
+    statusBar->setStatusText(
+      0, fmt::format("{} <{}>...", Strings::save_file_saving(),
+                     base::get_file_name(filename)));
+  }
+
+  g_saves.push_back(new BackgroundSave(doc, std::move(copy),
+                                       std::move(fop), filename));
+  return true;
+}
+
+// static
+void BackgroundSave::wait(const std::string& filename)
+{
+  const std::string fn = (filename.empty() ? std::string():
+                                             base::normalize_path(filename));
+  for (size_t i=0; i<g_saves.size(); ) {
+    BackgroundSave* save = g_saves[i];
+    if (fn.empty() || base::normalize_path(save->m_filename) == fn) {
+      save->m_thread.join();
+      save->finish();           // Removes the element from g_saves
+    }
+    else
+      ++i;
+  }
+}
+
+void BackgroundSave::finish()
+{
+  if (m_thread.joinable())
+    m_thread.join();
+
+  auto it = std::find(g_saves.begin(), g_saves.end(), this);
+  ASSERT(it != g_saves.end());
+  if (it != g_saves.end())
+    g_saves.erase(it);
+
+  if (m_fop->hasError()) {
+    Console console;
+    console.printf(m_fop->error().c_str());
+
+    // We don't know if the file was saved correctly or not
+    if (m_doc && !m_doc->isReadOnly())
+      m_doc->impossibleToBackToSavedState();
+  }
+  else {
+    App::instance()->recentFiles()->addRecentFile(m_filename);
+
+    if (m_doc) {
+      // The file on disk matches the state where the copy was
+      // created, if the user went back in the history and modified
+      // the document, that state doesn't exist anymore.
+      if (m_stateDeleted) {
+        m_doc->markAsSaved();
+        m_doc->impossibleToBackToSavedState();
+      }
+      else
+        m_doc->markAsSaved(m_state);
+      m_doc->setFilename(m_filename);
+      m_doc->incrementVersion();
+    }
+
+    if (auto statusBar = StatusBar::instance()) {
+      statusBar->setStatusText(
+        2000, fmt::format(Strings::save_file_saved(),
+                          base::get_file_name(m_filename)));
+    }
+  }
+
+  delete this;
+}
+
+void BackgroundSave::detach()
+{
+  if (m_doc) {
+    m_doc->undoHistory()->remove_observer(this);
+    m_doc->remove_observer(this);
+    m_doc = nullptr;
+  }
+}
+
+void BackgroundSave::onCloseDocument(Doc* doc)
+{
+  // The file is still written, but there is no document to mark as
+  // saved
+  detach();
+}
+
+void BackgroundSave::onDeleteUndoState(DocUndo* history,
+                                       undo::UndoState* state)
+{
+  if (state == m_state)
+    m_stateDeleted = true;
+}
+
+} // namespace app
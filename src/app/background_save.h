@@ -0,0 +1,86 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_BACKGROUND_SAVE_H_INCLUDED
+#define APP_BACKGROUND_SAVE_H_INCLUDED
+#pragma once
+
+#include "app/doc_observer.h"
+#include "app/doc_undo_observer.h"
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+namespace undo {
+  class UndoState;
+}
+
+namespace app {
+  class Context;
+  class Doc;
+  class FileOp;
+
+  // Saves a document in a background thread without blocking the
+  // UI. A copy of the document is taken (with the document locked
+  // for reading) and the copy is encoded and written in the
+  // background, so the user can keep modifying the original
+  // document. When the file is written, the undo state of the copy
+  // is marked as the saved state (or the document is marked as
+  // modified if that state was deleted in the meantime).
+  //
+  // All functions must be called from the UI thread.
+  class BackgroundSave : public DocObserver
+                       , public DocUndoObserver {
+  public:
+    ~BackgroundSave();
+
+    // Returns true if the given file can be saved in background
+    // (only .aseprite files, the format is written from the
+    // document copy without user interaction).
+    static bool isSupported(const std::string& filename);
+
+    // Starts saving the document in the given file. Returns false if
+    // the save operation cannot be created (the error is already
+    // reported to the user).
+    static bool start(Context* context,
+                      Doc* doc,
+                      const std::string& filename);
+
+    // Waits the pending operations that are saving the given file
+    // (or all the pending operations if the filename is empty).
+    static void wait(const std::string& filename = std::string());
+
+  private:
+    BackgroundSave(Doc* doc,
+                   std::unique_ptr<Doc>&& copy,
+                   std::unique_ptr<FileOp>&& fop,
+                   const std::string& filename);
+
+    void finish();
+    void detach();
+
+    // DocObserver impl
+    void onCloseDocument(Doc* doc) override;
+
+    // DocUndoObserver impl
+    void onDeleteUndoState(DocUndo* history,
+                           undo::UndoState* state) override;
+
+    Doc* m_doc;                       // Original document (nullptr if it was closed)
+    std::unique_ptr<Doc> m_copy;      // Document that is being saved
+    std::unique_ptr<FileOp> m_fop;
+    std::string m_filename;
+    const undo::UndoState* m_state;   // Undo state of the copy
+    bool m_stateDeleted = false;
+    std::atomic<bool> m_done;
+    std::thread m_thread;
+  };
+
+} // namespace app
+
+#endif
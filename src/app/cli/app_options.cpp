@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -13,7 +13,9 @@
 
 #include "base/fs.h"
 
+#include <cstdio>
 #include <iostream>
+#include <stdexcept>
 
 namespace app {
 
@@ -21,6 +23,7 @@ AppOptions::AppOptions(int argc, const char* argv[])
   : m_exeName(base::get_file_name(argv[0]))
   , m_startUI(true)
   , m_startShell(false)
+  , m_startBatchServer(false)
   , m_previewCLI(false)
   , m_showHelp(false)
   , m_showVersion(false)
@@ -29,11 +32,12 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_shell(m_po.add("shell").description("Start an interactive console to execute scripts"))
 #endif
   , m_batch(m_po.add("batch").mnemonic('b').description("Do not start the UI"))
+  , m_batchServer(m_po.add("batch-server").description("Do not start the UI and execute the jobs\nreceived from stdin (one JSON per line)"))
   , m_preview(m_po.add("preview").mnemonic('p').description("Do not execute actions, just print what will be\ndone"))
   , m_saveAs(m_po.add("save-as").requiresValue("<filename>").description("Save the last given sprite with other format"))
   , m_palette(m_po.add("palette").requiresValue("<filename>").description("Change the palette of the last given sprite"))
   , m_scale(m_po.add("scale").requiresValue("<factor>").description("Resize all previously opened sprites"))
-  , m_ditheringAlgorithm(m_po.add("dithering-algorithm").requiresValue("<algorithm>").description("Dithering algorithm used in --color-mode\nto convert images from RGB to Indexed\n  none\n  ordered\n  old"))
+  , m_ditheringAlgorithm(m_po.add("dithering-algorithm").requiresValue("<algorithm>").description("Dithering algorithm used in --color-mode\nto convert images from RGB to Indexed\n  none\n  ordered\n  old\n  error-diffusion\n  error-diffusion-parallel"))
   , m_ditheringMatrix(m_po.add("dithering-matrix").requiresValue("<id>").description("Matrix used in ordered dithering algorithm\n  bayer2x2\n  bayer4x4\n  bayer8x8\n  filename.png"))
   , m_colorMode(m_po.add("color-mode").requiresValue("<mode>").description("Change color mode of all previously\nopened sprites:\n  rgb\n  grayscale\n  indexed"))
   , m_shrinkTo(m_po.add("shrink-to").requiresValue("width,height").description("Shrink each sprite if it is\nlarger than width or height"))
@@ -75,10 +79,18 @@ AppOptions::AppOptions(int argc, const char* argv[])
   , m_listLayers(m_po.add("list-layers").description("List layers of the next given sprite\nor include layers in JSON data"))
   , m_listTags(m_po.add("list-tags").description("List tags of the next given sprite\nor include frame tags in JSON data"))
   , m_listSlices(m_po.add("list-slices").description("List slices of the next given sprite\nor include slices in JSON data"))
+  , m_memoryReport(m_po.add("memory-report").description("Print the memory used by the opened\nsprites (images, tilesets, undo history)\nand the caches of the program"))
+  , m_info(m_po.add("info").description("Print the size, frames, layers, tags, and\nslices of the next given sprites in JSON\nformat without loading their pixels"))
   , m_oneFrame(m_po.add("oneframe").description("Load just the first frame"))
   , m_exportTileset(m_po.add("export-tileset").description("Export only tilesets from visible tilemap layers"))
+  , m_cacheDir(m_po.add("cache-dir").requiresValue("<dir>").description("Reuse the output files of a previous\nexecution with the same options and input\nfiles from the given cache directory"))
+  , m_shard(m_po.add("shard").requiresValue("<i/N>").description("Export only the i-th part of N parts\nof the output files (1 <= i <= N) to\nsplit the export in N processes"))
+  , m_mergeSheetData(m_po.add("merge-sheet-data").requiresValue("<filename.json>").description("Merge the JSON data of the next given\nsprite sheet data files (e.g. from\ndifferent --shard) in one file"))
   , m_verbose(m_po.add("verbose").mnemonic('v').description("Explain what is being done"))
   , m_debug(m_po.add("debug").description("Extreme verbose mode and\ncopy log to desktop"))
+  , m_trace(m_po.add("trace").requiresValue("<filename.json>").description("Record a performance trace and save it\nin Chrome trace format when the program ends"))
+  , m_traceSummaryOption(m_po.add("trace-summary").description("Print the number of events and percentiles\nof each traced zone when the program ends"))
+  , m_recordStrokes(m_po.add("record-strokes").requiresValue("<filename.lua>").description("Record the strokes of drawing tools as a\nscript to replay them with --script"))
 #ifdef _WIN32
   , m_disableWintab(m_po.add("disable-wintab").description("Don't load wintab32.dll library"))
 #endif
@@ -93,16 +105,36 @@ AppOptions::AppOptions(int argc, const char* argv[])
     else if (m_po.enabled(m_verbose))
       m_verboseLevel = kVerbose;
 
+    if (m_po.enabled(m_trace))
+      m_traceFilename = m_po.value_of(m_trace);
+    m_traceSummary = m_po.enabled(m_traceSummaryOption);
+    if (m_po.enabled(m_recordStrokes))
+      m_recordStrokesFilename = m_po.value_of(m_recordStrokes);
+    if (m_po.enabled(m_cacheDir))
+      m_cacheDirName = m_po.value_of(m_cacheDir);
+    if (m_po.enabled(m_shard)) {
+      int i = 0, n = 0;
+      if (std::sscanf(m_po.value_of(m_shard).c_str(), "%d/%d", &i, &n) != 2 ||
+          i < 1 || n < 1 || i > n) {
+        throw std::runtime_error("Invalid --shard value, use i/N where 1 <= i <= N");
+      }
+      m_shardIndex = i-1;
+      m_shardCount = n;
+    }
+
 #ifdef ENABLE_SCRIPTING
     m_startShell = m_po.enabled(m_shell);
 #endif
+    m_startBatchServer = m_po.enabled(m_batchServer);
     m_previewCLI = m_po.enabled(m_preview);
     m_showHelp = m_po.enabled(m_help);
     m_showVersion = m_po.enabled(m_version);
 
     if (m_startShell ||
+        m_startBatchServer ||
         m_showHelp ||
         m_showVersion ||
+        m_po.enabled(m_info) ||
         m_po.enabled(m_batch)) {
       m_startUI = false;
     }
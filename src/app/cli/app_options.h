@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -36,10 +36,19 @@ public:
 
   bool startUI() const { return m_startUI; }
   bool startShell() const { return m_startShell; }
+  bool startBatchServer() const { return m_startBatchServer; }
   bool previewCLI() const { return m_previewCLI; }
   bool showHelp() const { return m_showHelp; }
   bool showVersion() const { return m_showVersion; }
   VerboseLevel verboseLevel() const { return m_verboseLevel; }
+  const std::string& traceFilename() const { return m_traceFilename; }
+  bool traceSummary() const { return m_traceSummary; }
+  const std::string& recordStrokesFilename() const { return m_recordStrokesFilename; }
+  const std::string& cacheDir() const { return m_cacheDirName; }
+
+  // --shard i/N (0-based index, and 1 if the option is not used)
+  int shardIndex() const { return m_shardIndex; }
+  int shardCount() const { return m_shardCount; }
 
   const ValueList& values() const {
     return m_po.values();
@@ -91,8 +100,13 @@ public:
   const Option& listLayers() const { return m_listLayers; }
   const Option& listTags() const { return m_listTags; }
   const Option& listSlices() const { return m_listSlices; }
+  const Option& memoryReport() const { return m_memoryReport; }
+  const Option& info() const { return m_info; }
   const Option& oneFrame() const { return m_oneFrame; }
   const Option& exportTileset() const { return m_exportTileset; }
+  const Option& cacheDirOption() const { return m_cacheDir; }
+  const Option& shard() const { return m_shard; }
+  const Option& mergeSheetData() const { return m_mergeSheetData; }
 
   bool hasExporterParams() const;
 #ifdef _WIN32
@@ -106,15 +120,23 @@ private:
   base::ProgramOptions m_po;
   bool m_startUI;
   bool m_startShell;
+  bool m_startBatchServer;
   bool m_previewCLI;
   bool m_showHelp;
   bool m_showVersion;
   VerboseLevel m_verboseLevel;
+  std::string m_traceFilename;
+  bool m_traceSummary = false;
+  std::string m_recordStrokesFilename;
+  std::string m_cacheDirName;
+  int m_shardIndex = 0;
+  int m_shardCount = 1;
 
 #ifdef ENABLE_SCRIPTING
   Option& m_shell;
 #endif
   Option& m_batch;
+  Option& m_batchServer;
   Option& m_preview;
   Option& m_saveAs;
   Option& m_palette;
@@ -161,11 +183,19 @@ private:
   Option& m_listLayers;
   Option& m_listTags;
   Option& m_listSlices;
+  Option& m_memoryReport;
+  Option& m_info;
   Option& m_oneFrame;
   Option& m_exportTileset;
+  Option& m_cacheDir;
+  Option& m_shard;
+  Option& m_mergeSheetData;
 
   Option& m_verbose;
   Option& m_debug;
+  Option& m_trace;
+  Option& m_traceSummaryOption;
+  Option& m_recordStrokes;
 #ifdef _WIN32
   Option& m_disableWintab;
 #endif
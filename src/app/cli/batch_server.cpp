@@ -0,0 +1,109 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/batch_server.h"
+
+#include "app/cli/app_options.h"
+#include "app/cli/cli_processor.h"
+#include "app/cli/default_cli_delegate.h"
+#include "app/context.h"
+#include "app/doc.h"
+
+#include "json11.hpp"
+
+#include <exception>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace app {
+
+BatchServer::BatchServer(Context* ctx)
+  : m_ctx(ctx)
+{
+}
+
+void BatchServer::run(std::istream& in, std::ostream& out)
+{
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty())
+      continue;
+
+    std::string err;
+    const json11::Json job = json11::Json::parse(line, err);
+    json11::Json::object result;
+
+    if (!err.empty() || !job.is_object()) {
+      result["code"] = -1;
+      result["error"] = "invalid job: " + err;
+    }
+    else {
+      if (job["exit"].bool_value())
+        break;
+
+      if (!job["id"].is_null())
+        result["id"] = job["id"];
+
+      std::vector<std::string> args;
+      for (const auto& arg : job["args"].array_items())
+        args.push_back(arg.string_value());
+
+      try {
+        result["code"] = processJob(args);
+      }
+      catch (const std::exception& ex) {
+        result["code"] = -1;
+        result["error"] = ex.what();
+      }
+    }
+
+    out << json11::Json(result).dump() << std::endl;
+  }
+}
+
+int BatchServer::processJob(const std::vector<std::string>& args)
+{
+  // AppOptions needs the program name as the first argument
+  std::vector<const char*> argv;
+  argv.push_back("aseprite");
+  for (const auto& arg : args)
+    argv.push_back(arg.c_str());
+
+  int code = 0;
+  try {
+    AppOptions options(int(argv.size()), argv.data());
+    DefaultCliDelegate delegate;
+    CliProcessor cli(&delegate, options);
+    code = cli.process(m_ctx);
+  }
+  catch (...) {
+    closeAllDocs();
+    throw;
+  }
+  closeAllDocs();
+  return code;
+}
+
+// Closes the documents opened by the last job, so the next job starts
+// with the same state.
+void BatchServer::closeAllDocs()
+{
+  std::vector<Doc*> docs;
+  for (Doc* doc : m_ctx->documents())
+    docs.push_back(doc);
+
+  for (Doc* doc : docs) {
+    doc->close();
+    delete doc;
+  }
+}
+
+} // namespace app
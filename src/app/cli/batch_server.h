@@ -0,0 +1,53 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_BATCH_SERVER_H_INCLUDED
+#define APP_CLI_BATCH_SERVER_H_INCLUDED
+#pragma once
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class Context;
+
+  // Executes CLI jobs in the same process (--batch-server), so the
+  // startup cost (modules, extensions, palettes, script engine, etc.)
+  // is paid just one time for all jobs.
+  //
+  // Each line of the input is a job in JSON format, e.g.:
+  //
+  //   {"id": "a", "args": ["sprite.aseprite", "--save-as", "sprite.png"]}
+  //
+  // and for each job a line is written in the output with the result:
+  //
+  //   {"id": "a", "code": 0}
+  //
+  // Jobs are executed one by one in the given context, and the
+  // documents opened by each job are closed when the job finishes.
+  class BatchServer {
+  public:
+    explicit BatchServer(Context* ctx);
+
+    // Processes jobs until the input is closed or an "exit" job is
+    // received ({"exit": true}).
+    void run(std::istream& in, std::ostream& out);
+
+    // Processes the given CLI arguments (without the program name)
+    // and returns the exit code.
+    int processJob(const std::vector<std::string>& args);
+
+  private:
+    void closeAllDocs();
+
+    Context* m_ctx;
+  };
+
+} // namespace app
+
+#endif
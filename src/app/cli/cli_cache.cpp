@@ -0,0 +1,230 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cli/cli_cache.h"
+
+#include "app/cli/app_options.h"
+#include "base/convert_to.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/log.h"
+#include "base/sha1.h"
+#include "ver/info.h"
+
+#include <fstream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+namespace app {
+
+namespace {
+
+const char* kManifestName = "manifest";
+
+bool read_file(const std::string& filename, std::string& content)
+{
+  std::ifstream in(FSTREAM_PATH(filename), std::ifstream::binary);
+  if (!in)
+    return false;
+
+  std::ostringstream buf;
+  buf << in.rdbuf();
+  content = buf.str();
+  return !in.bad();
+}
+
+std::string file_hash(const std::string& filename)
+{
+  std::string content;
+  if (!read_file(filename, content))
+    return std::string();
+  return base::convert_to<std::string>(
+    base::Sha1::calculateFromString(content));
+}
+
+bool copy_file(const std::string& src, const std::string& dst)
+{
+  std::string content;
+  if (!read_file(src, content))
+    return false;
+
+  const std::string dir = base::get_file_path(dst);
+  if (!dir.empty() && !base::is_directory(dir))
+    base::make_all_directories(dir);
+
+  std::ofstream out(FSTREAM_PATH(dst), std::ofstream::binary);
+  out.write(content.data(), content.size());
+  return bool(out);
+}
+
+} // anonymous namespace
+
+CliCache::CliCache(const std::string& dir,
+                   const AppOptions& options)
+  : m_dir(dir)
+{
+  bool hasData = false;
+  bool listData = false;
+  bool files = false;
+
+  // The key includes each option (in the given order, as the order
+  // changes the result) and the content of each input file.
+  std::string key = get_app_version();
+  for (const auto& value : options.values()) {
+    const AppOptions::Option* opt = value.option();
+    key.push_back('\n');
+
+    if (opt) {
+      if (opt == &options.cacheDirOption())
+        continue;
+
+      if (
+#ifdef ENABLE_SCRIPTING
+          opt == &options.script() ||
+#endif
+          opt == &options.info() ||
+          opt == &options.memoryReport()) {
+        m_cacheable = false;
+      }
+      else if (opt == &options.data())
+        hasData = true;
+      else if (opt == &options.listLayers() ||
+               opt == &options.listTags() ||
+               opt == &options.listSlices())
+        listData = true;
+
+      key += "--" + opt->name() + "=" + value.value();
+
+      // Input palette
+      if (opt == &options.palette())
+        key += " " + file_hash(value.value());
+    }
+    // Input file
+    else {
+      key += value.value() + " " + file_hash(value.value());
+      files = true;
+    }
+  }
+
+  // The JSON data and the lists of layers/tags/slices are printed to
+  // stdout without the --data option
+  if (!hasData && (listData || options.hasExporterParams()))
+    m_cacheable = false;
+  if (!files)
+    m_cacheable = false;
+
+  m_key = base::convert_to<std::string>(
+    base::Sha1::calculateFromString(key));
+}
+
+bool CliCache::restoreOutputs() const
+{
+  if (!m_cacheable)
+    return false;
+
+  const std::string dir = entryDir();
+  std::ifstream manifest(FSTREAM_PATH(base::join_path(dir, kManifestName)));
+  if (!manifest)
+    return false;
+
+  // Check the input files (e.g. other files of a sequence that
+  // aren't specified in the CLI)
+  std::vector<std::pair<std::string, std::string>> outputs;
+  std::string line;
+  while (std::getline(manifest, line)) {
+    // "in <hash> <filename>" or "out <file index> <filename>"
+    const size_t i = line.find(' ');
+    const size_t j = (i != std::string::npos ? line.find(' ', i+1): i);
+    if (j == std::string::npos)
+      return false;
+
+    const std::string type = line.substr(0, i);
+    const std::string arg = line.substr(i+1, j-i-1);
+    const std::string filename = line.substr(j+1);
+
+    if (type == "in") {
+      if (file_hash(filename) != arg)
+        return false;
+    }
+    else if (type == "out")
+      outputs.push_back(std::make_pair(base::join_path(dir, arg), filename));
+  }
+  if (outputs.empty())
+    return false;
+
+  for (const auto& output : outputs) {
+    try {
+      if (!copy_file(output.first, output.second))
+        return false;
+    }
+    catch (const std::exception& ex) {
+      LOG(ERROR, "CLI: Error restoring %s from cache: %s\n",
+          output.second.c_str(), ex.what());
+      return false;
+    }
+  }
+
+  LOG(INFO, "CLI: %d files restored from cache %s\n",
+      int(outputs.size()), m_key.c_str());
+  return true;
+}
+
+void CliCache::storeOutputs(const std::set<std::string>& inputFiles,
+                            const base::paths& outputFiles) const
+{
+  if (!m_cacheable || outputFiles.empty())
+    return;
+
+  const std::string dir = entryDir();
+  try {
+    if (!base::is_directory(dir))
+      base::make_all_directories(dir);
+
+    std::ostringstream manifest;
+    for (const std::string& filename : inputFiles) {
+      const std::string hash = file_hash(filename);
+      if (hash.empty())
+        return;
+      manifest << "in " << hash << ' ' << filename << '\n';
+    }
+
+    int i = 0;
+    for (const std::string& filename : outputFiles) {
+      const std::string name = base::convert_to<std::string>(i++);
+      if (!copy_file(filename, base::join_path(dir, name)))
+        return;
+      manifest << "out " << name << ' ' << filename << '\n';
+    }
+
+    // The manifest is written at the end, so an incomplete entry is
+    // never used
+    const std::string manifestFn = base::join_path(dir, kManifestName);
+    std::ofstream out(FSTREAM_PATH(manifestFn + ".tmp"));
+    out << manifest.str();
+    out.close();
+    if (out) {
+      if (base::is_file(manifestFn))
+        base::delete_file(manifestFn);
+      base::move_file(manifestFn + ".tmp", manifestFn);
+    }
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR, "CLI: Error storing files in cache %s: %s\n",
+        dir.c_str(), ex.what());
+  }
+}
+
+std::string CliCache::entryDir() const
+{
+  return base::join_path(m_dir, m_key);
+}
+
+} // namespace app
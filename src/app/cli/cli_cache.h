@@ -0,0 +1,57 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CLI_CLI_CACHE_H_INCLUDED
+#define APP_CLI_CLI_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/paths.h"
+
+#include <set>
+#include <string>
+
+namespace app {
+
+  class AppOptions;
+
+  // Cache of the output files generated by the CLI (--cache-dir
+  // option). Each entry is identified by a hash of the program
+  // version, the CLI options, and the content of the input files, so
+  // the output files can be copied from the cache without loading
+  // or rendering the sprites again.
+  //
+  // Entries are directories inside the cache directory with a
+  // "manifest" file (the input files with their hashes and the
+  // output files) and a copy of each output file.
+  class CliCache {
+  public:
+    CliCache(const std::string& dir,
+             const AppOptions& options);
+
+    // Returns false if the result of the CLI cannot be cached
+    // (e.g. a script is executed, or something is printed to stdout).
+    bool isCacheable() const { return m_cacheable; }
+
+    // Copies the output files from the cache. Returns false if there
+    // is no entry for the given options or some input file was
+    // modified.
+    bool restoreOutputs() const;
+
+    // Creates an entry with the given output files.
+    void storeOutputs(const std::set<std::string>& inputFiles,
+                      const base::paths& outputFiles) const;
+
+  private:
+    std::string entryDir() const;
+
+    std::string m_dir;
+    std::string m_key;
+    bool m_cacheable = true;
+  };
+
+} // namespace app
+
+#endif
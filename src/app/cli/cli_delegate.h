@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,8 @@
 #define APP_CLI_CLI_DELEGATE_H_INCLUDED
 #pragma once
 
+#include "base/paths.h"
+
 #include <string>
 
 namespace app {
@@ -29,9 +31,14 @@ namespace app {
     virtual void batchMode() { }
     virtual void beforeOpenFile(const CliOpenFile& cof) { }
     virtual void afterOpenFile(const CliOpenFile& cof) { }
+    virtual void printFileInfo(Context* ctx, const CliOpenFile& cof) { }
+    virtual void printMemoryReport(Context* ctx) { }
     virtual void saveFile(Context* ctx, const CliOpenFile& cof) { }
     virtual void loadPalette(Context* ctx, const std::string& filename) { }
     virtual void exportFiles(Context* ctx, DocExporter& exporter) { }
+    virtual void mergeSheetData(Context* ctx,
+                                const std::string& output,
+                                const base::paths& inputs) { }
 #ifdef ENABLE_SCRIPTING
     virtual int execScript(const std::string& filename,
                            const Params& params) {
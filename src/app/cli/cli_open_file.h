@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -39,6 +39,7 @@ namespace app {
     bool listLayers = false;
     bool listTags = false;
     bool listSlices = false;
+    bool info = false;
     bool ignoreEmpty = false;
     bool trim = false;
     bool trimByGrid = false;
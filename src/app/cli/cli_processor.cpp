@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,6 +20,7 @@
 #include "app/doc_exporter.h"
 #include "app/doc_undo.h"
 #include "app/file/file.h"
+#include "app/file/saved_files_recorder.h"
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
 #include "app/ui_context.h"
@@ -178,6 +179,17 @@ CliProcessor::CliProcessor(CliDelegate* delegate,
 {
   if (options.hasExporterParams())
     m_exporter.reset(new DocExporter);
+
+  // The cache is used only in batch mode (in other modes the
+  // documents must be opened)
+  if (!options.cacheDir().empty() &&
+      !options.startUI() &&
+      !options.startShell() &&
+      !options.previewCLI()) {
+    m_cache = std::make_unique<CliCache>(options.cacheDir(), options);
+    if (!m_cache->isCacheable())
+      m_cache.reset();
+  }
 }
 
 int CliProcessor::process(Context* ctx)
@@ -190,8 +202,17 @@ int CliProcessor::process(Context* ctx)
   else if (m_options.showVersion()) {
     m_delegate->showVersion();
   }
+  else if (!m_options.values().empty() &&
+           m_cache && m_cache->restoreOutputs()) {
+    // Output files restored from the cache (--cache-dir), nothing
+    // else to do
+  }
   // Process other options and file names
   else if (!m_options.values().empty()) {
+    std::unique_ptr<SavedFilesRecorder> savedFiles;
+    if (m_cache)
+      savedFiles = std::make_unique<SavedFilesRecorder>();
+
 #ifdef ENABLE_SCRIPTING
     Params scriptParams;
 #endif
@@ -200,7 +221,10 @@ int CliProcessor::process(Context* ctx)
     SpriteSheetType sheetType = SpriteSheetType::None;
     Doc* lastDoc = nullptr;
     render::DitheringAlgorithm ditheringAlgorithm = render::DitheringAlgorithm::None;
+    bool ditheringParallel = false;
     std::string ditheringMatrix;
+    std::string mergeDataFilename;
+    base::paths mergeInputs;
 
     for (const auto& value : m_options.values()) {
       const AppOptions::Option* opt = value.option();
@@ -463,6 +487,7 @@ int CliProcessor::process(Context* ctx)
         }
         // --dithering-algorithm <algorithm>
         else if (opt == &m_options.ditheringAlgorithm()) {
+          ditheringParallel = false;
           if (value.value() == "none")
             ditheringAlgorithm = render::DitheringAlgorithm::None;
           else if (value.value() == "ordered")
@@ -471,10 +496,15 @@ int CliProcessor::process(Context* ctx)
             ditheringAlgorithm = render::DitheringAlgorithm::Old;
           else if (value.value() == "error-diffusion")
             ditheringAlgorithm = render::DitheringAlgorithm::ErrorDiffusion;
+          else if (value.value() == "error-diffusion-parallel") {
+            ditheringAlgorithm = render::DitheringAlgorithm::ErrorDiffusion;
+            ditheringParallel = true;
+          }
           else
             throw std::runtime_error("--dithering-algorithm needs a valid algorithm name\n"
                                      "Usage: --dithering-algorithm <algorithm>\n"
-                                     "Where <algorithm> can be none, ordered, old, or error-diffusion");
+                                     "Where <algorithm> can be none, ordered, old, error-diffusion,\n"
+                                     "or error-diffusion-parallel");
         }
         // --dithering-matrix <id>
         else if (opt == &m_options.ditheringMatrix()) {
@@ -503,7 +533,8 @@ int CliProcessor::process(Context* ctx)
                 params.set("dithering", "old");
                 break;
               case render::DitheringAlgorithm::ErrorDiffusion:
-                params.set("dithering", "error-diffusion");
+                params.set("dithering", (ditheringParallel ? "error-diffusion-parallel":
+                                                             "error-diffusion"));
                 break;
             }
 
@@ -597,6 +628,18 @@ int CliProcessor::process(Context* ctx)
           else
             cof.listSlices = true;
         }
+        // --merge-sheet-data <filename.json>
+        else if (opt == &m_options.mergeSheetData()) {
+          mergeDataFilename = value.value();
+        }
+        // --memory-report
+        else if (opt == &m_options.memoryReport()) {
+          m_delegate->printMemoryReport(ctx);
+        }
+        // --info
+        else if (opt == &m_options.info()) {
+          cof.info = true;
+        }
         // --oneframe
         else if (opt == &m_options.oneFrame()) {
           cof.oneFrame = true;
@@ -611,9 +654,20 @@ int CliProcessor::process(Context* ctx)
         cof.document = nullptr;
         cof.filename = base::normalize_path(value.value());
 
-        if (// Check that the filename wasn't used loading a sequence
+        // Data files to merge after --merge-sheet-data
+        if (!mergeDataFilename.empty()) {
+          mergeInputs.push_back(cof.filename);
+        }
+        // Print only the metadata of the file (the document isn't
+        // opened, so it cannot be used by the next options)
+        else if (cof.info) {
+          m_delegate->printFileInfo(ctx, cof);
+        }
+        else if (// Check that the filename wasn't used loading a sequence
             // of images as one sprite
             m_usedFiles.find(cof.filename) == m_usedFiles.end() &&
+            // Sprite sheets are split in shards by input file
+            (!m_exporter || isNextUnitInShard()) &&
             // Open sprite
             openFile(ctx, cof)) {
           lastDoc = cof.document;
@@ -630,6 +684,12 @@ int CliProcessor::process(Context* ctx)
       m_delegate->exportFiles(ctx, *m_exporter.get());
       m_exporter.reset(nullptr);
     }
+
+    if (!mergeDataFilename.empty())
+      m_delegate->mergeSheetData(ctx, mergeDataFilename, mergeInputs);
+
+    if (m_cache)
+      m_cache->storeOutputs(m_usedFiles, savedFiles->files());
   }
 
   // Running mode
@@ -645,6 +705,12 @@ int CliProcessor::process(Context* ctx)
   return 0;
 }
 
+bool CliProcessor::isNextUnitInShard()
+{
+  const int unit = m_shardUnit++;
+  return (unit % m_options.shardCount() == m_options.shardIndex());
+}
+
 bool CliProcessor::openFile(Context* ctx, CliOpenFile& cof)
 {
   m_delegate->beforeOpenFile(cof);
@@ -840,6 +906,10 @@ void CliProcessor::saveFile(Context* ctx, const CliOpenFile& cof)
           }
         }
 
+        // This file is saved by other process (--shard i/N)
+        if (!isNextUnitInShard())
+          continue;
+
         // TODO --trim --save-as --split-layers doesn't make too much
         // sense as we lost the trim rectangle information (e.g. we
         // don't have sheet .json) Also, we should trim each frame
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,7 @@
 #define APP_APP_CLI_PROCESSOR_H_INCLUDED
 #pragma once
 
+#include "app/cli/cli_cache.h"
 #include "app/cli/cli_delegate.h"
 #include "app/cli/cli_open_file.h"
 #include "app/doc_exporter.h"
@@ -47,6 +48,10 @@ namespace app {
     bool openFile(Context* ctx, CliOpenFile& cof);
     void saveFile(Context* ctx, const CliOpenFile& cof);
 
+    // Returns true if the next output unit (a saved file or an input
+    // file of a sprite sheet) must be processed by this --shard.
+    bool isNextUnitInShard();
+
     void filterLayers(const doc::Sprite* sprite,
                       const CliOpenFile& cof,
                       doc::SelectedLayers& filteredLayers) {
@@ -60,6 +65,11 @@ namespace app {
     CliDelegate* m_delegate;
     const AppOptions& m_options;
     std::unique_ptr<DocExporter> m_exporter;
+    std::unique_ptr<CliCache> m_cache;
+
+    // Output units processed (or skipped) to know which ones belong
+    // to this --shard
+    int m_shardUnit = 0;
 
     // Files already used in the CLI processing (e.g. when used to
     // load a sequence of files) so we don't ask for them again.
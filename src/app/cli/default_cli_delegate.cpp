@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,9 +18,14 @@
 #include "app/console.h"
 #include "app/doc.h"
 #include "app/doc_exporter.h"
+#include "app/file/file.h"
 #include "app/file/palette_file.h"
+#include "app/memory_report.h"
+#include "app/util/merge_sheet_data.h"
 #include "app/ui_context.h"
 #include "base/convert_to.h"
+#include "base/replace_string.h"
+#include "doc/anidir.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/slice.h"
@@ -38,6 +43,29 @@
 
 namespace app {
 
+namespace {
+
+std::string escape_for_json(const std::string& str)
+{
+  std::string res = str;
+  base::replace_string(res, "\\", "\\\\");
+  base::replace_string(res, "\"", "\\\"");
+  return res;
+}
+
+const char* color_mode_to_string(const doc::ColorMode colorMode)
+{
+  switch (colorMode) {
+    case doc::ColorMode::RGB: return "rgb";
+    case doc::ColorMode::GRAYSCALE: return "grayscale";
+    case doc::ColorMode::INDEXED: return "indexed";
+    case doc::ColorMode::TILEMAP: return "tilemap";
+  }
+  return "unknown";
+}
+
+} // anonymous namespace
+
 void DefaultCliDelegate::showHelp(const AppOptions& options)
 {
   std::cout
@@ -78,6 +106,66 @@ void DefaultCliDelegate::afterOpenFile(const CliOpenFile& cof)
   }
 }
 
+void DefaultCliDelegate::printFileInfo(Context* ctx, const CliOpenFile& cof)
+{
+  std::unique_ptr<Doc> doc(load_document_metadata(ctx, cof.filename));
+  if (!doc) {
+    std::cerr << "Error loading file '" << cof.filename << "'\n";
+    return;
+  }
+
+  const doc::Sprite* sprite = doc->sprite();
+  std::cout << "{ \"filename\": \"" << escape_for_json(cof.filename) << "\",\n"
+            << "  \"size\": { \"w\": " << sprite->width()
+            << ", \"h\": " << sprite->height() << " },\n"
+            << "  \"colorMode\": \"" << color_mode_to_string(sprite->colorMode()) << "\",\n"
+            << "  \"frames\": [";
+  for (doc::frame_t frame=0; frame<sprite->totalFrames(); ++frame) {
+    std::cout << (frame > 0 ? ",": "")
+              << "\n   { \"duration\": " << sprite->frameDuration(frame) << " }";
+  }
+  std::cout << "\n  ],\n"
+            << "  \"layers\": [";
+  bool first = true;
+  for (const doc::Layer* layer : sprite->allLayers()) {
+    std::cout << (first ? "": ",")
+              << "\n   { \"name\": \"" << escape_for_json(layer->name()) << "\"";
+    if (layer->parent() != sprite->root())
+      std::cout << ", \"group\": \"" << escape_for_json(layer->parent()->name()) << "\"";
+    std::cout << " }";
+    first = false;
+  }
+  std::cout << "\n  ],\n"
+            << "  \"tags\": [";
+  first = true;
+  for (const doc::Tag* tag : sprite->tags()) {
+    std::cout << (first ? "": ",")
+              << "\n   { \"name\": \"" << escape_for_json(tag->name()) << "\","
+              << " \"from\": " << tag->fromFrame() << ","
+              << " \"to\": " << tag->toFrame() << ","
+              << " \"direction\": \"" << convert_anidir_to_string(tag->aniDir()) << "\" }";
+    first = false;
+  }
+  std::cout << "\n  ],\n"
+            << "  \"slices\": [";
+  first = true;
+  for (const doc::Slice* slice : sprite->slices()) {
+    std::cout << (first ? "": ",")
+              << "\n   { \"name\": \"" << escape_for_json(slice->name()) << "\" }";
+    first = false;
+  }
+  std::cout << "\n  ]\n"
+            << "}\n";
+
+  doc->close();
+}
+
+void DefaultCliDelegate::printMemoryReport(Context* ctx)
+{
+  write_memory_report(std::cout, create_memory_report(ctx));
+  std::cout.flush();
+}
+
 void DefaultCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
 {
   Command* saveAsCommand = Commands::instance()->byId(CommandId::SaveFileCopyAs());
@@ -132,6 +220,20 @@ void DefaultCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
   LOG("APP: Export sprite sheet: Done\n");
 }
 
+void DefaultCliDelegate::mergeSheetData(Context* ctx,
+                                        const std::string& output,
+                                        const base::paths& inputs)
+{
+  try {
+    merge_sheet_data(inputs, output);
+  }
+  catch (const std::exception& ex) {
+    Console console;
+    console.printf("Error merging sprite sheet data in \"%s\":\n%s",
+                   output.c_str(), ex.what());
+  }
+}
+
 #ifdef ENABLE_SCRIPTING
 int DefaultCliDelegate::execScript(const std::string& filename,
                                    const Params& params)
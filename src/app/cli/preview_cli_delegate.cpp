@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -82,6 +82,16 @@ void PreviewCliDelegate::afterOpenFile(const CliOpenFile& cof)
   showLayersFilter(cof);
 }
 
+void PreviewCliDelegate::printFileInfo(Context* ctx, const CliOpenFile& cof)
+{
+  std::cout << "- Print info of file '" << cof.filename << "'\n";
+}
+
+void PreviewCliDelegate::printMemoryReport(Context* ctx)
+{
+  std::cout << "- Print memory usage of the opened sprites\n";
+}
+
 void PreviewCliDelegate::saveFile(Context* ctx, const CliOpenFile& cof)
 {
   ASSERT(cof.document);
@@ -210,6 +220,15 @@ void PreviewCliDelegate::exportFiles(Context* ctx, DocExporter& exporter)
   }
 }
 
+void PreviewCliDelegate::mergeSheetData(Context* ctx,
+                                        const std::string& output,
+                                        const base::paths& inputs)
+{
+  std::cout << "- Merge sprite sheet data in '" << output << "':\n";
+  for (const std::string& input : inputs)
+    std::cout << "  - Data file: '" << input << "'\n";
+}
+
 #ifdef ENABLE_SCRIPTING
 int PreviewCliDelegate::execScript(const std::string& filename,
                                    const Params& params)
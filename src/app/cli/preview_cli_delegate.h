@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -28,9 +28,14 @@ namespace app {
     void batchMode() override;
     void beforeOpenFile(const CliOpenFile& cof) override;
     void afterOpenFile(const CliOpenFile& cof) override;
+    void printFileInfo(Context* ctx, const CliOpenFile& cof) override;
+    void printMemoryReport(Context* ctx) override;
     void saveFile(Context* ctx, const CliOpenFile& cof) override;
     void loadPalette(Context* ctx, const std::string& filename) override;
     void exportFiles(Context* ctx, DocExporter& exporter) override;
+    void mergeSheetData(Context* ctx,
+                        const std::string& output,
+                        const base::paths& inputs) override;
 #ifdef ENABLE_SCRIPTING
     int execScript(const std::string& filename,
                    const Params& params) override;
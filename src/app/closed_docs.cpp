@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -10,10 +10,19 @@
 
 #include "app/closed_docs.h"
 #include "app/doc.h"
+#include "app/doc_undo.h"
+#include "app/memory_report.h"
 #include "app/pref/preferences.h"
+#include "app/util/compact_doc.h"
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/image.h"
+#include "doc/sprite.h"
+#include "doc/tilesets.h"
 
 #include <algorithm>
 #include <limits>
+#include <thread>
 
 #define CLOSEDOC_TRACE(...) // TRACEARGS
 
@@ -35,6 +44,25 @@ ClosedDocs::ClosedDocs(const Preferences& pref)
   CLOSEDOC_TRACE("CLOSEDOC: Init",
                  "dataRecoveryPeriod", m_dataRecoveryPeriodMSecs,
                  "keepClosedDocs", m_keepClosedDocAliveForMSecs);
+
+  // The compacted images are not counted (we don't want to
+  // uncompress them just to know their size)
+  m_memoryReportConn = MemoryReport::Collect.connect(
+    [this](MemoryReport& report){
+      std::unique_lock<std::mutex> lock(m_mutex);
+      size_t bytes = 0;
+      for (const ClosedDoc& closedDoc : m_docs) {
+        const doc::Sprite* sprite = closedDoc.doc->sprite();
+        for (const doc::Cel* cel : sprite->uniqueCels()) {
+          if (cel->data()->isImageLoaded())
+            bytes += size_t(cel->image()->getMemSize());
+        }
+        if (sprite->hasTilesets())
+          bytes += size_t(sprite->tilesets()->getMemSize());
+        bytes += closedDoc.doc->undoHistory()->totalUndoSize();
+      }
+      report.add("Closed documents", bytes);
+    });
 }
 
 ClosedDocs::~ClosedDocs()
@@ -73,7 +101,7 @@ void ClosedDocs::addClosedDoc(Doc* doc)
   ASSERT(doc != nullptr);
   ASSERT(doc->context() == nullptr);
 
-  ClosedDoc closedDoc = { doc, base::current_tick() };
+  ClosedDoc closedDoc = { doc, base::current_tick(), false };
 
   std::unique_lock<std::mutex> lock(m_mutex);
   m_docs.insert(m_docs.begin(), std::move(closedDoc));
@@ -96,6 +124,11 @@ Doc* ClosedDocs::reopenLastClosedDoc()
     CLOSEDOC_TRACE(" -> ", doc);
   }
   CLOSEDOC_TRACE("CLOSEDOC: Reopen last closed doc", doc);
+
+  // Uncompress all the images compacted in the background thread
+  // (the undo history can reference them by ID, so they must exist)
+  if (doc)
+    uncompact_doc(doc);
   return doc;
 }
 
@@ -120,6 +153,26 @@ void ClosedDocs::backgroundThread()
 
   std::unique_lock<std::mutex> lock(m_mutex);
   while (!m_done) {
+    // Compact the documents that are waiting to be deleted (the
+    // newest ones first, as they are at the beginning of the list)
+    while (!m_done) {
+      const base::tick_t now = base::current_tick();
+      auto it = std::find_if(
+        m_docs.begin(), m_docs.end(),
+        [this, now](const ClosedDoc& closedDoc){
+          return (!closedDoc.compacted &&
+                  now - closedDoc.timestamp < m_keepClosedDocAliveForMSecs &&
+                  isBackedUp(closedDoc.doc));
+        });
+      if (it == m_docs.end())
+        break;
+
+      it->compacted = true;
+      compactDoc(lock, it->doc); // Unlocks the mutex several times
+    }
+    if (m_done)
+      break;
+
     base::tick_t now = base::current_tick();
     base::tick_t waitForMSecs = std::numeric_limits<base::tick_t>::max();
 
@@ -129,12 +182,7 @@ void ClosedDocs::backgroundThread()
 
       base::tick_t diff = now - closedDoc.timestamp;
       if (diff >= m_keepClosedDocAliveForMSecs) {
-        if (// If we backup process is disabled
-            m_dataRecoveryPeriodMSecs == 0 ||
-            // Or this document doesn't need a backup (e.g. an unmodified document)
-            !doc->needsBackup() ||
-            // Or the document already has the backup done
-            doc->isFullyBackedUp()) {
+        if (isBackedUp(doc)) {
           // Finally delete the document (this is the place where we
           // delete all documents created/loaded by the user)
           CLOSEDOC_TRACE("CLOSEDOC: [BG] Delete doc", doc);
@@ -169,4 +217,57 @@ void ClosedDocs::backgroundThread()
   CLOSEDOC_TRACE("CLOSEDOC: [BG] Background thread end");
 }
 
+void ClosedDocs::compactDoc(std::unique_lock<std::mutex>& lock, Doc* doc)
+{
+  CLOSEDOC_TRACE("CLOSEDOC: [BG] Compact doc", doc);
+
+  // The compressed payloads are uncompressed when they are needed
+  // again (e.g. to undo)
+  doc->undoHistory()->compact();
+
+  std::vector<doc::CelDataRef> celsData;
+  for (doc::Cel* cel : doc->sprite()->uniqueCels())
+    celsData.push_back(cel->dataRef());
+
+  // Compress one cel each time unlocking the mutex between them, so
+  // reopenLastClosedDoc() doesn't have to wait for the whole
+  // document.
+  for (auto& celData : celsData) {
+    lock.unlock();
+    std::this_thread::yield();
+    lock.lock();
+
+    // The document was reopened (or we are closing the app)
+    if (m_done || !isClosedDoc(doc))
+      return;
+
+    // Skip the cel if the document is being read (e.g. by the data
+    // recovery thread)
+    if (doc->writeLock(0)) {
+      compact_cel_data(celData.get());
+      doc->unlock();
+    }
+  }
+
+  CLOSEDOC_TRACE("CLOSEDOC: [BG] Compact doc done", doc);
+}
+
+bool ClosedDocs::isBackedUp(const Doc* doc) const
+{
+  return (// If we backup process is disabled
+          m_dataRecoveryPeriodMSecs == 0 ||
+          // Or this document doesn't need a backup (e.g. an unmodified document)
+          !doc->needsBackup() ||
+          // Or the document already has the backup done
+          doc->isFullyBackedUp());
+}
+
+bool ClosedDocs::isClosedDoc(const Doc* doc) const
+{
+  return std::any_of(m_docs.begin(), m_docs.end(),
+                     [doc](const ClosedDoc& closedDoc){
+                       return closedDoc.doc == doc;
+                     });
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "base/time.h"
+#include "obs/connection.h"
 
 #include <atomic>
 #include <condition_variable>
@@ -29,6 +30,9 @@ namespace app {
   //   garbage collector).
   // * If the document was not restore, we delete it from memory, if
   //   the document was restore, we remove it from the m_docs.
+  // * While the document is waiting, the same thread compacts it
+  //   (compresses its undo history and cel images in memory), the
+  //   images are uncompressed when the document is reopened.
   class ClosedDocs {
   public:
     ClosedDocs(const Preferences& pref);
@@ -44,10 +48,14 @@ namespace app {
 
   private:
     void backgroundThread();
+    void compactDoc(std::unique_lock<std::mutex>& lock, Doc* doc);
+    bool isBackedUp(const Doc* doc) const;
+    bool isClosedDoc(const Doc* doc) const;
 
     struct ClosedDoc {
       Doc* doc;
       base::tick_t timestamp;
+      bool compacted;
     };
 
     std::atomic<bool> m_done;
@@ -57,6 +65,7 @@ namespace app {
     std::mutex m_mutex;
     std::condition_variable m_cv;
     std::thread m_thread;
+    obs::scoped_connection m_memoryReportConn;
   };
 
 } // namespace app
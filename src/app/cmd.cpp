@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +10,8 @@
 #endif
 
 #include "app/cmd.h"
+
+#include "app/cmd_arena.h"
 #include "base/debug.h"
 #include "base/mem_utils.h"
 
@@ -29,6 +32,18 @@ Cmd::~Cmd()
 {
 }
 
+// static
+void* Cmd::operator new(std::size_t size)
+{
+  return CmdArena::allocate(size);
+}
+
+// static
+void Cmd::operator delete(void* ptr)
+{
+  CmdArena::deallocate(ptr);
+}
+
 void Cmd::execute(Context* ctx)
 {
   CMD_TRACE("CMD: Executing cmd '%s'\n", typeid(*this).name());
@@ -89,6 +104,11 @@ size_t Cmd::memSize() const
   return onMemSize();
 }
 
+void Cmd::undoPayloads(std::vector<UndoPayload*>& payloads)
+{
+  onUndoPayloads(payloads);
+}
+
 void Cmd::onExecute()
 {
   // Do nothing
@@ -119,4 +139,9 @@ size_t Cmd::onMemSize() const {
   return sizeof(*this);
 }
 
+void Cmd::onUndoPayloads(std::vector<UndoPayload*>& payloads)
+{
+  // Do nothing
+}
+
 } // namespace app
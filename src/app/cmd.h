@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,16 +13,23 @@
 #include "undo/undo_command.h"
 
 #include <string>
+#include <vector>
 
 namespace app {
 
   class Context;
+  class UndoPayload;
 
   class Cmd : public undo::UndoCommand {
   public:
     Cmd();
     virtual ~Cmd();
 
+    // Cmds are allocated in the CmdArena of the current transaction
+    // (if there is one).
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr);
+
     void execute(Context* ctx);
 
     // undo::UndoCommand impl
@@ -32,6 +40,10 @@ namespace app {
     std::string label() const;
     size_t memSize() const;
 
+    // Adds the data saved by this Cmd (e.g. pixels) which can be
+    // compressed or moved to disk while the Cmd is not used.
+    void undoPayloads(std::vector<UndoPayload*>& payloads);
+
     Context* context() const { return m_ctx; }
 
   protected:
@@ -41,6 +53,7 @@ namespace app {
     virtual void onFireNotifications();
     virtual std::string onLabel() const;
     virtual size_t onMemSize() const;
+    virtual void onUndoPayloads(std::vector<UndoPayload*>& payloads);
 
   private:
     Context* m_ctx;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -19,57 +19,145 @@
 #include "doc/sprite.h"
 #include "os/color_space.h"
 #include "os/system.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace app {
 namespace cmd {
 
-static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
-                                               const gfx::ColorSpaceRef& newCS,
-                                               os::ColorSpaceConversion* conversion)
+// Converts the rows [y1, y2) of srcImage to dstImage
+static void convert_image_rows_color_space(const doc::Image* srcImage,
+                                           doc::Image* dstImage,
+                                           const int y1, const int y2,
+                                           os::ColorSpaceConversion* conversion)
 {
-  ImageSpec spec = srcImage->spec();
-  spec.setColorSpace(newCS);
-  ImageRef dstImage(Image::create(spec));
-
-  if (!conversion) {
-    dstImage->copy(srcImage, gfx::Clip(0, 0, srcImage->bounds()));
-    return dstImage;
-  }
+  const int w = srcImage->width();
 
-  if (spec.colorMode() == doc::ColorMode::RGB) {
-    for (int y=0; y<spec.height(); ++y) {
+  if (srcImage->colorMode() == doc::ColorMode::RGB) {
+    for (int y=y1; y<y2; ++y) {
       conversion->convertRgba((uint32_t*)dstImage->getPixelAddress(0, y),
                               (const uint32_t*)srcImage->getPixelAddress(0, y),
-                              spec.width());
+                              w);
     }
   }
-  else if (spec.colorMode() == doc::ColorMode::GRAYSCALE) {
+  else if (srcImage->colorMode() == doc::ColorMode::GRAYSCALE) {
     // TODO create a set of functions to create pixel format
     // conversions (this should be available when we add new kind of
     // pixel formats).
-    std::vector<uint8_t> buf(spec.width()*spec.height());
+    std::vector<uint8_t> buf(w*(y2-y1));
 
     auto it = buf.begin();
-    for (int y=0; y<spec.height(); ++y) {
+    for (int y=y1; y<y2; ++y) {
       auto srcPtr = (const uint16_t*)srcImage->getPixelAddress(0, y);
-      for (int x=0; x<spec.width(); ++x, ++srcPtr, ++it)
+      for (int x=0; x<w; ++x, ++srcPtr, ++it)
         *it = doc::graya_getv(*srcPtr);
     }
 
-    conversion->convertGray(&buf[0], &buf[0], spec.width()*spec.height());
+    conversion->convertGray(&buf[0], &buf[0], int(buf.size()));
 
     it = buf.begin();
-    for (int y=0; y<spec.height(); ++y) {
+    for (int y=y1; y<y2; ++y) {
       auto srcPtr = (const uint16_t*)srcImage->getPixelAddress(0, y);
       auto dstPtr = (uint16_t*)dstImage->getPixelAddress(0, y);
-      for (int x=0; x<spec.width(); ++x, ++dstPtr, ++srcPtr, ++it)
+      for (int x=0; x<w; ++x, ++dstPtr, ++srcPtr, ++it)
         *dstPtr = doc::graya(*it, doc::graya_geta(*srcPtr));
     }
   }
+}
+
+static doc::ImageRef convert_image_color_space(const doc::Image* srcImage,
+                                               const gfx::ColorSpaceRef& newCS,
+                                               os::ColorSpaceConversion* conversion)
+{
+  ImageSpec spec = srcImage->spec();
+  spec.setColorSpace(newCS);
+  ImageRef dstImage(Image::create(spec));
+
+  if (!conversion) {
+    dstImage->copy(srcImage, gfx::Clip(0, 0, srcImage->bounds()));
+    return dstImage;
+  }
 
+  convert_image_rows_color_space(srcImage, dstImage.get(),
+                                 0, spec.height(), conversion);
   return dstImage;
 }
 
+// Converts the images of all the unique cels of the sprite (linked
+// cels share the same image, so it's converted just once) using
+// worker threads. Big images are split in bands of rows and small
+// images (e.g. tiles) are grouped in the same task. The same
+// conversion object is used from all threads as it doesn't modify
+// its state to convert pixels.
+static void convert_sprite_images_color_space(doc::Sprite* sprite,
+                                              const gfx::ColorSpaceRef& newCS,
+                                              os::ColorSpaceConversion* conversion,
+                                              std::vector<ImageRef>& oldImages,
+                                              std::vector<ImageRef>& newImages)
+{
+  const int kMinPixelsPerTask = 64*1024;
+
+  for (Cel* cel : sprite->uniqueCels()) {
+    ImageRef oldImage = cel->imageRef();
+    if (oldImage->pixelFormat() != IMAGE_TILEMAP)
+      oldImages.push_back(oldImage);
+  }
+
+  int64_t totalPixels = 0;
+  for (const ImageRef& image : oldImages)
+    totalPixels += int64_t(image->width()) * image->height();
+
+  const int threads = sched::Scheduler::instance().threads();
+  if (!conversion || threads <= 1 || totalPixels < 2*kMinPixelsPerTask) {
+    for (const ImageRef& image : oldImages)
+      newImages.push_back(convert_image_color_space(image.get(), newCS, conversion));
+    return;
+  }
+
+  // Images are created in this thread (so they get their IDs in the
+  // same order) and converted in worker threads
+  for (const ImageRef& image : oldImages) {
+    ImageSpec spec = image->spec();
+    spec.setColorSpace(newCS);
+    newImages.push_back(ImageRef(Image::create(spec)));
+  }
+
+  struct Band {
+    int image, y1, y2;
+  };
+  std::vector<Band> bands;
+  for (int i=0; i<int(oldImages.size()); ++i) {
+    const int w = std::max(1, oldImages[i]->width());
+    const int h = oldImages[i]->height();
+    const int rows = std::max(1, kMinPixelsPerTask / w);
+    for (int y=0; y<h; y+=rows)
+      bands.push_back(Band{ i, y, std::min(h, y+rows) });
+  }
+
+  sched::TaskGroup tasks(sched::Priority::UI);
+  for (std::size_t i=0; i<bands.size(); ) {
+    const std::size_t begin = i;
+    int64_t pixels = 0;
+    while (i < bands.size() && pixels < kMinPixelsPerTask) {
+      pixels += int64_t(oldImages[bands[i].image]->width()) * (bands[i].y2 - bands[i].y1);
+      ++i;
+    }
+    const std::size_t end = i;
+    tasks.run([&oldImages, &newImages, &bands, conversion, begin, end]{
+      for (std::size_t j=begin; j<end; ++j) {
+        const Band& band = bands[j];
+        convert_image_rows_color_space(oldImages[band.image].get(),
+                                       newImages[band.image].get(),
+                                       band.y1, band.y2, conversion);
+      }
+    });
+  }
+  tasks.wait();
+}
+
 void convert_color_profile(doc::Sprite* sprite,
                            const gfx::ColorSpaceRef& newCS)
 {
@@ -86,15 +174,11 @@ void convert_color_profile(doc::Sprite* sprite,
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
-        sprite->replaceImage(old_image->id(), new_image);
-      }
-    }
+    std::vector<ImageRef> oldImages, newImages;
+    convert_sprite_images_color_space(sprite, newCS, conversion.get(),
+                                      oldImages, newImages);
+    for (std::size_t i=0; i<oldImages.size(); ++i)
+      sprite->replaceImage(oldImages[i]->id(), newImages[i]);
   }
 
   if (conversion) {
@@ -181,15 +265,11 @@ ConvertColorProfile::ConvertColorProfile(doc::Sprite* sprite, const gfx::ColorSp
 
   // Convert images
   if (sprite->pixelFormat() != doc::IMAGE_INDEXED) {
-    for (Cel* cel : sprite->uniqueCels()) {
-      ImageRef old_image = cel->imageRef();
-      if (old_image.get()->pixelFormat() != IMAGE_TILEMAP) {
-        ImageRef new_image = convert_image_color_space(
-          old_image.get(), newCS, conversion.get());
-
-        m_seq.add(new cmd::ReplaceImage(sprite, old_image, new_image));
-      }
-    }
+    std::vector<ImageRef> oldImages, newImages;
+    convert_sprite_images_color_space(sprite, newCS, conversion.get(),
+                                      oldImages, newImages);
+    for (std::size_t i=0; i<oldImages.size(); ++i)
+      m_seq.add(new cmd::ReplaceImage(sprite, oldImages[i], newImages[i]));
   }
 
   if (conversion) {
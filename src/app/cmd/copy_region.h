@@ -11,7 +11,7 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_image.h"
-#include "base/buffer.h"
+#include "app/undo_payload.h"
 #include "doc/tile.h"
 #include "gfx/point.h"
 #include "gfx/region.h"
@@ -43,6 +43,9 @@ namespace cmd {
     size_t onMemSize() const override {
       return sizeof(*this) + m_buffer.size();
     }
+    void onUndoPayloads(std::vector<UndoPayload*>& payloads) override {
+      payloads.push_back(&m_buffer);
+    }
 
   private:
     void swap();
@@ -50,7 +53,7 @@ namespace cmd {
 
     bool m_alreadyCopied;
     gfx::Region m_region;
-    base::buffer m_buffer;
+    UndoPayload m_buffer;
   };
 
   class CopyTileRegion : public CopyRegion {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,6 +20,7 @@
 #include "app/cmd/set_layer_name.h"
 #include "app/cmd/unlink_cel.h"
 #include "app/doc.h"
+#include "app/flatten.h"
 #include "app/i18n/strings.h"
 #include "app/restore_visible_layers.h"
 #include "doc/algorithm/shrink_bounds.h"
@@ -28,6 +29,10 @@
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "render/render.h"
+#include "sched/task_group.h"
+
+#include <algorithm>
+#include <vector>
 
 namespace app {
 namespace cmd {
@@ -66,9 +71,6 @@ void FlattenLayers::onExecute()
   if (list.empty())
     return;                     // Do nothing
 
-  // Create a temporary image.
-  ImageRef image(Image::create(sprite->spec()));
-
   LayerImage* flatLayer;  // The layer onto which everything will be flattened.
   color_t bgcolor;        // The background color to use for flatLayer.
   bool newFlatLayer = false;
@@ -87,45 +89,90 @@ void FlattenLayers::onExecute()
     bgcolor = sprite->transparentColor();
   }
 
-  render::Render render;
-  render.setNewBlend(m_newBlendMethod);
-  render.setBgOptions(render::BgOptions::MakeNone());
-
   {
     // Show only the layers to be flattened so other layers are hidden
     // temporarily.
     RestoreVisibleLayers restore;
     restore.showSelectedLayers(sprite, layers);
 
-    // Copy all frames to the background.
-    for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
-      // Clear the image and render this frame.
-      clear_image(image.get(), bgcolor);
-      render.renderSprite(image.get(), sprite, frame);
+    // Each frame is rendered in a worker thread (in batches, so we
+    // don't keep all the rendered frames in memory), and then the
+    // commands are added in frame order in this thread.
+    struct RenderedFrame {
+      ImageRef image;
+      gfx::Rect bounds;         // Bounds of the non-transparent pixels
+      bool empty = true;
+    };
+    const frame_t nframes = sprite->totalFrames();
+    const int batchSize =
+      2 * std::max(1, sched::Scheduler::instance().threads());
+    std::vector<RenderedFrame> rendered(batchSize);
+    const bool newBlend = m_newBlendMethod;
+
+    for (frame_t batch(0); batch<nframes; batch+=batchSize) {
+      const frame_t batchEnd = std::min<frame_t>(nframes, batch+batchSize);
+
+      sched::TaskGroup tasks(sched::Priority::UI);
+      for (frame_t frame=batch; frame<batchEnd; ++frame) {
+        RenderedFrame& rf = rendered[frame-batch];
+        const bool hasCel = (flatLayer->cel(frame) != nullptr);
+
+        // Frames without cels in the flattened layers are completely
+        // transparent (there is nothing to render).
+        rf.empty = (!hasCel && !layer_has_cels(sprite->root(), frame));
+        if (rf.empty)
+          continue;
+
+        if (!rf.image)
+          rf.image.reset(Image::create(sprite->spec()));
+
+        Image* image = rf.image.get();
+        tasks.run([sprite, image, frame, bgcolor, hasCel, newBlend, &rf]{
+          render::Render render;
+          render.setNewBlend(newBlend);
+          render.setBgOptions(render::BgOptions::MakeNone());
+
+          // Clear the image and render this frame.
+          clear_image(image, bgcolor);
+          render.renderSprite(image, sprite, frame);
+
+          if (!hasCel) {
+            rf.bounds = image->bounds();
+            rf.empty = !doc::algorithm::shrink_bounds(
+              image, image->maskColor(), nullptr, rf.bounds);
+          }
+        });
+      }
+      tasks.wait();
+
+      // Copy all frames to the background.
+      for (frame_t frame=batch; frame<batchEnd; ++frame) {
+        const RenderedFrame& rf = rendered[frame-batch];
+        if (rf.empty)
+          continue;
 
-      // TODO Keep cel links when possible
+        Image* image = rf.image.get();
 
-      ImageRef cel_image;
-      Cel* cel = flatLayer->cel(frame);
-      if (cel) {
-        if (cel->links())
-          executeAndAdd(new cmd::UnlinkCel(cel));
+        // TODO Keep cel links when possible
 
-        cel_image = cel->imageRef();
-        ASSERT(cel_image);
+        ImageRef cel_image;
+        Cel* cel = flatLayer->cel(frame);
+        if (cel) {
+          if (cel->links())
+            executeAndAdd(new cmd::UnlinkCel(cel));
 
-        executeAndAdd(
-          new cmd::CopyRect(cel_image.get(), image.get(),
-                            gfx::Clip(0, 0, image->bounds())));
-      }
-      else {
-        gfx::Rect bounds(image->bounds());
-        if (doc::algorithm::shrink_bounds(
-              image.get(), image->maskColor(), nullptr, bounds)) {
+          cel_image = cel->imageRef();
+          ASSERT(cel_image);
+
+          executeAndAdd(
+            new cmd::CopyRect(cel_image.get(), image,
+                              gfx::Clip(0, 0, image->bounds())));
+        }
+        else {
           cel_image.reset(
-            doc::crop_image(image.get(), bounds, image->maskColor()));
+            doc::crop_image(image, rf.bounds, image->maskColor()));
           cel = new Cel(frame, cel_image);
-          cel->setPosition(bounds.origin());
+          cel->setPosition(rf.bounds.origin());
           flatLayer->addCel(cel);
         }
       }
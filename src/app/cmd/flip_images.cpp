@@ -0,0 +1,58 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/flip_images.h"
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/image.h"
+#include "sched/task_group.h"
+
+namespace app {
+namespace cmd {
+
+FlipImages::FlipImages(const std::vector<Image*>& images,
+                       doc::algorithm::FlipType flipType)
+  : m_flipType(flipType)
+{
+  m_imageIds.reserve(images.size());
+  for (const Image* image : images)
+    m_imageIds.push_back(image->id());
+}
+
+void FlipImages::onExecute()
+{
+  swap();
+}
+
+void FlipImages::onUndo()
+{
+  swap();
+}
+
+void FlipImages::swap()
+{
+  sched::TaskGroup tasks(sched::Priority::Interactive);
+  for (const ObjectId id : m_imageIds) {
+    Image* image = get<Image>(id);
+    ASSERT(image);
+    if (!image)
+      continue;
+
+    tasks.run(
+      [image, flipType = m_flipType]{
+        doc::algorithm::flip_image(image, image->bounds(), flipType);
+        image->incrementVersion();
+      });
+  }
+  tasks.wait();
+}
+
+} // namespace cmd
+} // namespace app
@@ -20,6 +20,8 @@
 #include "doc/subobjects_io.h"
 #include "doc/tilesets.h"
 
+#include <algorithm>
+
 namespace app {
 namespace cmd {
 
@@ -30,17 +32,18 @@ ReplaceImage::ReplaceImage(Sprite* sprite, const ImageRef& oldImage, const Image
   , m_oldImageId(oldImage->id())
   , m_newImageId(newImage->id())
   , m_newImage(newImage)
+  , m_copySpec(newImage->spec())
 {
 }
 
 void ReplaceImage::onExecute()
 {
-  // Save old image in m_copy. We cannot keep an ImageRef to this
-  // image, because there are other undo branches that could try to
-  // modify/re-add this same image ID
+  // Save old image pixels in m_copy. We cannot keep an ImageRef to
+  // this image, because there are other undo branches that could try
+  // to modify/re-add this same image ID
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
-  m_copy.reset(Image::createCopy(oldImage.get()));
+  saveCopy(oldImage.get());
 
   replaceImage(m_oldImageId, m_newImage);
   m_newImage.reset();
@@ -51,10 +54,9 @@ void ReplaceImage::onUndo()
   ImageRef newImage = sprite()->getImageRef(m_newImageId);
   ASSERT(newImage);
   ASSERT(!sprite()->getImageRef(m_oldImageId));
-  m_copy->setId(m_oldImageId);
 
-  replaceImage(m_newImageId, m_copy);
-  m_copy.reset(Image::createCopy(newImage.get()));
+  replaceImage(m_newImageId, restoreCopy(m_oldImageId));
+  saveCopy(newImage.get());
 }
 
 void ReplaceImage::onRedo()
@@ -62,10 +64,9 @@ void ReplaceImage::onRedo()
   ImageRef oldImage = sprite()->getImageRef(m_oldImageId);
   ASSERT(oldImage);
   ASSERT(!sprite()->getImageRef(m_newImageId));
-  m_copy->setId(m_newImageId);
 
-  replaceImage(m_oldImageId, m_copy);
-  m_copy.reset(Image::createCopy(oldImage.get()));
+  replaceImage(m_oldImageId, restoreCopy(m_newImageId));
+  saveCopy(oldImage.get());
 }
 
 void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
@@ -93,5 +94,34 @@ void ReplaceImage::replaceImage(ObjectId oldId, const ImageRef& newImage)
   spr->replaceImage(oldId, newImage);
 }
 
+void ReplaceImage::saveCopy(const Image* image)
+{
+  const int rowSize = image->getRowStrideSize();
+  base::buffer& buffer = m_copy.data();
+  buffer.resize(rowSize * image->height());
+
+  uint8_t* dst = buffer.data();
+  for (int y=0; y<image->height(); ++y, dst+=rowSize)
+    std::copy(image->getPixelAddress(0, y),
+              image->getPixelAddress(0, y)+rowSize, dst);
+
+  m_copySpec = image->spec();
+}
+
+ImageRef ReplaceImage::restoreCopy(ObjectId id)
+{
+  ImageRef image(Image::create(m_copySpec));
+  const int rowSize = image->getRowStrideSize();
+  const base::buffer& buffer = m_copy.data();
+  ASSERT(buffer.size() == rowSize * image->height());
+
+  const uint8_t* src = buffer.data();
+  for (int y=0; y<image->height(); ++y, src+=rowSize)
+    std::copy(src, src+rowSize, image->getPixelAddress(0, y));
+
+  image->setId(id);
+  return image;
+}
+
 } // namespace cmd
 } // namespace app
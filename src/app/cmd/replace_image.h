@@ -10,9 +10,9 @@
 
 #include "app/cmd.h"
 #include "app/cmd/with_sprite.h"
+#include "app/undo_payload.h"
 #include "doc/image_ref.h"
-
-#include <sstream>
+#include "doc/image_spec.h"
 
 namespace app {
 namespace cmd {
@@ -28,12 +28,16 @@ namespace cmd {
     void onUndo() override;
     void onRedo() override;
     size_t onMemSize() const override {
-      return sizeof(*this) +
-        (m_copy ? m_copy->getMemSize(): 0);
+      return sizeof(*this) + m_copy.size();
+    }
+    void onUndoPayloads(std::vector<UndoPayload*>& payloads) override {
+      payloads.push_back(&m_copy);
     }
 
   private:
     void replaceImage(ObjectId oldId, const ImageRef& newImage);
+    void saveCopy(const Image* image);
+    ImageRef restoreCopy(ObjectId id);
 
     ObjectId m_oldImageId;
     ObjectId m_newImageId;
@@ -42,7 +46,11 @@ namespace cmd {
     // ReplaceImage() ctor until the ReplaceImage::onExecute() call.
     // Then the reference is not used anymore.
     ImageRef m_newImage;
-    ImageRef m_copy;
+
+    // Pixels of the image that is not in the sprite (the old image
+    // after onExecute/onRedo, or the new image after onUndo).
+    ImageSpec m_copySpec;
+    UndoPayload m_copy;
   };
 
 } // namespace cmd
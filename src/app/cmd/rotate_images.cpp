@@ -0,0 +1,125 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/rotate_images.h"
+
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/cels_range.h"
+#include "doc/image.h"
+#include "doc/image_ref.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "sched/task_group.h"
+
+#include <unordered_map>
+
+namespace app {
+namespace cmd {
+
+using namespace doc;
+
+RotateImages::RotateImages(Sprite* sprite,
+                           const std::vector<Image*>& images,
+                           int angle)
+  : WithSprite(sprite)
+  , m_angle(angle)
+{
+  ASSERT(angle == 180 || angle == 90 || angle == -90);
+
+  m_oldImageIds.reserve(images.size());
+  for (const Image* image : images)
+    m_oldImageIds.push_back(image->id());
+}
+
+void RotateImages::onExecute()
+{
+  m_newImageIds.clear();
+  rotateImages(m_oldImageIds, m_newImageIds, m_angle);
+}
+
+void RotateImages::onUndo()
+{
+  rotateImages(m_newImageIds, m_oldImageIds,
+               (m_angle == 180 ? 180: -m_angle));
+}
+
+void RotateImages::onRedo()
+{
+  rotateImages(m_oldImageIds, m_newImageIds, m_angle);
+}
+
+void RotateImages::rotateImages(const std::vector<ObjectId>& fromIds,
+                                std::vector<ObjectId>& toIds,
+                                int angle)
+{
+  Sprite* spr = sprite();
+  const int n = int(fromIds.size());
+  ASSERT(toIds.empty() || int(toIds.size()) == n);
+
+  // Index of each image in "fromIds" (we use only one iteration
+  // through the cels to find all the images)
+  std::unordered_map<ObjectId, int> indexes;
+  for (int i=0; i<n; ++i)
+    indexes[fromIds[i]] = i;
+
+  std::vector<Cel*> cels;
+  std::vector<int> celIndexes;
+  std::vector<ImageRef> oldImages(n);
+  for (Cel* cel : spr->uniqueCels()) {
+    auto it = indexes.find(cel->image()->id());
+    if (it == indexes.end())
+      continue;
+
+    cels.push_back(cel);
+    celIndexes.push_back(it->second);
+    oldImages[it->second] = cel->imageRef();
+  }
+
+  std::vector<ImageRef> newImages(n);
+  {
+    sched::TaskGroup tasks(sched::Priority::Interactive);
+    for (int i=0; i<n; ++i) {
+      const Image* image = oldImages[i].get();
+      ASSERT(image);
+      if (!image)
+        continue;
+
+      tasks.run(
+        [image, angle, &newImages, i]{
+          ImageRef newImage(
+            Image::create(image->pixelFormat(),
+                          angle == 180 ? image->width(): image->height(),
+                          angle == 180 ? image->height(): image->width()));
+          newImage->setMaskColor(image->maskColor());
+          rotate_image(image, newImage.get(), angle);
+          newImages[i] = newImage;
+        });
+    }
+    tasks.wait();
+  }
+
+  const bool newIds = toIds.empty();
+  for (int i=0; i<n; ++i) {
+    if (newIds)
+      toIds.push_back(newImages[i] ? newImages[i]->id(): NullId);
+    else if (newImages[i])
+      newImages[i]->setId(toIds[i]);
+  }
+
+  for (int i=0; i<int(cels.size()); ++i) {
+    Cel* cel = cels[i];
+    cel->data()->setImage(newImages[celIndexes[i]], cel->layer());
+    cel->data()->incrementVersion();
+  }
+}
+
+} // namespace cmd
+} // namespace app
@@ -0,0 +1,60 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CMD_ROTATE_IMAGES_H_INCLUDED
+#define APP_CMD_ROTATE_IMAGES_H_INCLUDED
+#pragma once
+
+#include "app/cmd.h"
+#include "app/cmd/with_sprite.h"
+#include "doc/object_id.h"
+
+#include <vector>
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+namespace cmd {
+  using namespace doc;
+
+  // Rotates (90, -90 or 180 degrees) several images of the sprite at
+  // the same time (one task per image). As the rotation is lossless,
+  // undo/redo rotate the images again instead of keeping a copy of
+  // the old pixels (only the old/new image IDs are stored).
+  class RotateImages : public Cmd
+                     , public WithSprite {
+  public:
+    RotateImages(Sprite* sprite,
+                 const std::vector<Image*>& images,
+                 int angle);
+
+  protected:
+    void onExecute() override;
+    void onUndo() override;
+    void onRedo() override;
+    size_t onMemSize() const override {
+      return sizeof(*this) +
+        sizeof(ObjectId) * (m_oldImageIds.size() + m_newImageIds.size());
+    }
+
+  private:
+    // Replaces the images with the "fromIds" with their rotated
+    // versions (with the "toIds", or new IDs if "toIds" is empty).
+    void rotateImages(const std::vector<ObjectId>& fromIds,
+                      std::vector<ObjectId>& toIds,
+                      int angle);
+
+    std::vector<ObjectId> m_oldImageIds;
+    std::vector<ObjectId> m_newImageIds;
+    int m_angle;
+  };
+
+} // namespace cmd
+} // namespace app
+
+#endif
@@ -0,0 +1,79 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd/set_cels_frames.h"
+
+#include "app/doc.h"
+#include "doc/cel.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+
+namespace app {
+namespace cmd {
+
+using namespace doc;
+
+SetCelsFrames::SetCelsFrames(Sprite* sprite)
+  : WithSprite(sprite)
+{
+}
+
+void SetCelsFrames::addCel(Cel* cel, frame_t newFrame)
+{
+  ASSERT(cel);
+  ASSERT(cel->layer());
+  ASSERT(newFrame >= 0);
+  m_cels.push_back(Item{ cel->id(), cel->frame(), newFrame });
+}
+
+void SetCelsFrames::onExecute()
+{
+  moveCels(false);
+}
+
+void SetCelsFrames::onUndo()
+{
+  moveCels(true);
+}
+
+void SetCelsFrames::onFireNotifications()
+{
+  static_cast<Doc*>(sprite()->document())->notifyGeneralUpdate();
+}
+
+void SetCelsFrames::moveCels(const bool undo)
+{
+  // Remove all cels from their layers first, so each cel can be
+  // added in a frame that was used by other cel of the list
+  std::vector<std::pair<Cel*, LayerImage*>> cels;
+  cels.reserve(m_cels.size());
+  for (const Item& item : m_cels) {
+    Cel* cel = doc::get<Cel>(item.celId);
+    ASSERT(cel);
+    ASSERT(cel->frame() == (undo ? item.newFrame: item.oldFrame));
+
+    LayerImage* layer = static_cast<LayerImage*>(cel->layer());
+    layer->removeCel(cel);
+    cels.push_back(std::make_pair(cel, layer));
+  }
+
+  for (std::size_t i=0; i<m_cels.size(); ++i) {
+    Cel* cel = cels[i].first;
+    LayerImage* layer = cels[i].second;
+    ASSERT(!layer->cel(undo ? m_cels[i].oldFrame: m_cels[i].newFrame));
+
+    cel->setFrame(undo ? m_cels[i].oldFrame: m_cels[i].newFrame);
+    cel->incrementVersion();
+    layer->addCel(cel);
+  }
+}
+
+} // namespace cmd
+} // namespace app
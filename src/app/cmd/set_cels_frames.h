@@ -0,0 +1,64 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CMD_SET_CELS_FRAMES_H_INCLUDED
+#define APP_CMD_SET_CELS_FRAMES_H_INCLUDED
+#pragma once
+
+#include "app/cmd.h"
+#include "app/cmd/with_sprite.h"
+#include "doc/frame.h"
+#include "doc/object_id.h"
+
+#include <vector>
+
+namespace doc {
+  class Cel;
+}
+
+namespace app {
+namespace cmd {
+  using namespace doc;
+
+  // Moves several cels to other frames (in the same layers) in one
+  // undoable command. It's like several SetCelFrame commands but cels
+  // are moved at the same time (so one cel can be moved to the frame
+  // of other cel that is moved too), and only one general update
+  // notification is generated.
+  class SetCelsFrames : public Cmd
+                      , public WithSprite {
+  public:
+    SetCelsFrames(Sprite* sprite);
+
+    // Adds a cel to be moved to the given frame. The destination
+    // frame must be empty or contain other cel that is moved too.
+    void addCel(Cel* cel, frame_t newFrame);
+    bool empty() const { return m_cels.empty(); }
+
+  protected:
+    void onExecute() override;
+    void onUndo() override;
+    void onFireNotifications() override;
+    size_t onMemSize() const override {
+      return sizeof(*this) + sizeof(Item)*m_cels.capacity();
+    }
+
+  private:
+    struct Item {
+      ObjectId celId;
+      frame_t oldFrame;
+      frame_t newFrame;
+    };
+
+    void moveCels(const bool undo);
+
+    std::vector<Item> m_cels;
+  };
+
+} // namespace cmd
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,6 +27,12 @@
 #include "doc/tilesets.h"
 #include "render/quantization.h"
 #include "render/task_delegate.h"
+#include "sched/task_group.h"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 
 namespace app {
 namespace cmd {
@@ -35,37 +41,136 @@ using namespace doc;
 
 namespace {
 
+// Progress of all images that are converted in parallel. It can be
+// used from several threads at the same time.
 class SuperDelegate : public render::TaskDelegate {
 public:
   SuperDelegate(int nimages, render::TaskDelegate* delegate)
     : m_nimages(nimages)
-    , m_curImage(0)
+    , m_doneImages(0)
+    , m_lastProgress(0.0)
     , m_delegate(delegate) {
   }
 
   void notifyTaskProgress(double progress) override {
     if (m_delegate)
-      m_delegate->notifyTaskProgress(
-        (progress + m_curImage) / m_nimages);
+      notifyProgress((progress + m_doneImages) / m_nimages);
   }
 
   bool continueTask() override {
-    if (m_delegate)
+    if (m_delegate) {
+      std::lock_guard lock(m_mutex);
       return m_delegate->continueTask();
+    }
     else
       return true;
   }
 
   void nextImage() {
-    ++m_curImage;
+    const int done = ++m_doneImages;
+    if (m_delegate)
+      notifyProgress(double(done) / m_nimages);
   }
 
 private:
+  void notifyProgress(const double progress) {
+    // Images are converted in parallel, so we report only the
+    // maximum progress
+    std::lock_guard lock(m_mutex);
+    if (progress > m_lastProgress) {
+      m_lastProgress = progress;
+      m_delegate->notifyTaskProgress(progress);
+    }
+  }
+
   int m_nimages;
-  int m_curImage;
+  std::atomic<int> m_doneImages;
+  double m_lastProgress;
+  std::mutex m_mutex;
   TaskDelegate* m_delegate;
 };
 
+// Number of images converted in each task
+const size_t kImagesPerTask = 4;
+
+struct ImageToConvert {
+  ImageRef oldImage;
+  frame_t frame;
+  bool isBackground;
+  ImageRef newImage;
+};
+
+// Converts all images in parallel (each task converts
+// kImagesPerTask images).
+void convert_images(const Sprite* sprite,
+                    const PixelFormat oldFormat,
+                    const PixelFormat newFormat,
+                    const render::Dithering& dithering,
+                    const RgbMapAlgorithm mapAlgorithm,
+                    rgba_to_graya_func toGray,
+                    std::vector<ImageToConvert>& images,
+                    SuperDelegate* delegate)
+{
+  const RgbMapFor rgbMapFor = sprite->rgbMapForSprite();
+
+  // Converts the images from i to i2 (each call uses its own RgbMap
+  // as the RgbMap caches are modified when colors are mapped)
+  auto convert = [&](const size_t i, const size_t i2) {
+    std::unique_ptr<RgbMap> rgbmap;
+    const Palette* rgbmapPalette = nullptr;
+
+    for (size_t j=i; j<i2; ++j) {
+      if (!delegate->continueTask())
+        break;
+
+      ImageToConvert& image = images[j];
+      ASSERT(image.oldImage);
+      ASSERT(image.oldImage->pixelFormat() != IMAGE_TILEMAP);
+
+      const Palette* palette = sprite->palette(image.frame);
+      int newMaskIndex = (image.isBackground ? -1 : 0);
+
+      // Making the RGBMap for Image->INDEXDED conversion.
+      if (newFormat == IMAGE_INDEXED) {
+        if (!rgbmap || rgbmapPalette != palette) {
+          rgbmap = sprite->createRgbMap(image.frame, rgbMapFor, mapAlgorithm);
+          rgbmapPalette = palette;
+        }
+        if (oldFormat == IMAGE_INDEXED)
+          newMaskIndex = sprite->transparentColor();
+        else
+          newMaskIndex = rgbmap->maskIndex();
+      }
+
+      image.newImage.reset(
+        render::convert_pixel_format
+        (image.oldImage.get(), nullptr, newFormat,
+         dithering,
+         rgbmap.get(),
+         palette,
+         image.isBackground,
+         newMaskIndex,
+         toGray,
+         delegate));
+
+      delegate->nextImage();
+    }
+  };
+
+  const int threads = sched::Scheduler::instance().threads();
+  if (threads > 1 && images.size() > kImagesPerTask) {
+    sched::TaskGroup tasks(sched::Priority::Interactive);
+    for (size_t i=0; i<images.size(); i+=kImagesPerTask) {
+      const size_t i2 = std::min(images.size(), i+kImagesPerTask);
+      tasks.run([&convert, i, i2]{ convert(i, i2); });
+    }
+    tasks.wait();
+  }
+  else {
+    convert(0, images.size());
+  }
+}
+
 } // anonymous namespace
 
 SetPixelFormat::SetPixelFormat(Sprite* sprite,
@@ -81,60 +186,46 @@ SetPixelFormat::SetPixelFormat(Sprite* sprite,
   if (sprite->pixelFormat() == newFormat)
     return;
 
-  // Calculate the number of images to convert just to show a proper
-  // progress bar.
-  tile_index nimages = 0;
-  for (Cel* cel : sprite->uniqueCels())
-    if (!cel->layer()->isTilemap())
-      ++nimages;
-  if (sprite->hasTilesets()) {
-    for (Tileset* tileset : *sprite->tilesets()) {
-      if (tileset)
-        nimages += tileset->size();
-    }
-  }
-
-  SuperDelegate superDel(nimages, delegate);
-
-  // Convert cel images
+  // Images to convert (cels and then tiles)
+  std::vector<ImageToConvert> images;
   for (Cel* cel : sprite->uniqueCels()) {
     if (cel->layer()->isTilemap())
       continue;
 
-    ImageRef oldImage = cel->imageRef();
-    convertImage(sprite, dithering,
-                 oldImage,
-                 cel->frame(),
-                 cel->layer()->isBackground(),
-                 mapAlgorithm,
-                 toGray,
-                 &superDel);
-
-    superDel.nextImage();
+    ImageToConvert image;
+    image.oldImage = cel->imageRef();
+    image.frame = cel->frame();
+    image.isBackground = cel->layer()->isBackground();
+    images.push_back(image);
   }
-
-  // Convert tileset images
   if (sprite->hasTilesets()) {
     for (Tileset* tileset : *sprite->tilesets()) {
       if (!tileset)
         continue;
 
       for (tile_index i=0; i<tileset->size(); ++i) {
-        ImageRef oldImage = tileset->get(i);
-        if (oldImage) {
-          convertImage(sprite, dithering,
-                       oldImage,
-                       0,     // TODO select a frame or generate other tilesets?
-                       false, // TODO is background? it depends of the layer where this tileset is used
-                       mapAlgorithm,
-                       toGray,
-                       &superDel);
-        }
-        superDel.nextImage();
+        ImageToConvert image;
+        image.oldImage = tileset->get(i);
+        image.frame = 0;             // TODO select a frame or generate other tilesets?
+        image.isBackground = false;  // TODO is background? it depends of the layer where this tileset is used
+        if (image.oldImage)
+          images.push_back(image);
       }
     }
   }
 
+  SuperDelegate superDel(int(images.size()), delegate);
+  convert_images(sprite, m_oldFormat, m_newFormat,
+                 dithering, mapAlgorithm, toGray,
+                 images, &superDel);
+
+  // Add the ReplaceImage cmds in the same order of the images (it
+  // doesn't depend on the order the images were converted)
+  for (const ImageToConvert& image : images) {
+    if (image.newImage)
+      m_seq.add(new cmd::ReplaceImage(sprite, image.oldImage, image.newImage));
+  }
+
   // Set all cels opacity to 100% if we are converting to indexed.
   // TODO remove this
   if (newFormat == IMAGE_INDEXED) {
@@ -201,45 +292,5 @@ void SetPixelFormat::setFormat(PixelFormat format)
   doc->notify_observers<DocEvent&>(&DocObserver::onPixelFormatChanged, ev);
 }
 
-void SetPixelFormat::convertImage(doc::Sprite* sprite,
-                                  const render::Dithering& dithering,
-                                  const doc::ImageRef& oldImage,
-                                  const doc::frame_t frame,
-                                  const bool isBackground,
-                                  const doc::RgbMapAlgorithm mapAlgorithm,
-                                  doc::rgba_to_graya_func toGray,
-                                  render::TaskDelegate* delegate)
-{
-  ASSERT(oldImage);
-  ASSERT(oldImage->pixelFormat() != IMAGE_TILEMAP);
-
-  // Making the RGBMap for Image->INDEXDED conversion.
-  // TODO: this is needed only when newImage
-  RgbMap* rgbmap;
-  int newMaskIndex = (isBackground ? -1 : 0);
-  if (m_newFormat == IMAGE_INDEXED) {
-    rgbmap = sprite->rgbMap(frame, sprite->rgbMapForSprite(), mapAlgorithm);
-    if (m_oldFormat == IMAGE_INDEXED)
-      newMaskIndex = sprite->transparentColor();
-    else
-      newMaskIndex = rgbmap->maskIndex();
-  }
-  else {
-    rgbmap = nullptr;
-  }
-  ImageRef newImage(
-    render::convert_pixel_format
-    (oldImage.get(), nullptr, m_newFormat,
-     dithering,
-     rgbmap,
-     sprite->palette(frame),
-     isBackground,
-     newMaskIndex,
-     toGray,
-     delegate));
-
-  m_seq.add(new cmd::ReplaceImage(sprite, oldImage, newImage));
-}
-
 } // namespace cmd
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -12,8 +12,6 @@
 #include "app/cmd/with_sprite.h"
 #include "app/cmd_sequence.h"
 #include "doc/color.h"
-#include "doc/frame.h"
-#include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 #include "doc/rgbmap_algorithm.h"
 
@@ -49,15 +47,6 @@ namespace cmd {
 
   private:
     void setFormat(doc::PixelFormat format);
-    void convertImage(doc::Sprite* sprite,
-                      const render::Dithering& dithering,
-                      const doc::ImageRef& oldImage,
-                      const doc::frame_t frame,
-                      const bool isBackground,
-                      const doc::RgbMapAlgorithm mapAlgorithm,
-                      doc::rgba_to_graya_func toGray,
-                      render::TaskDelegate* delegate);
-
     doc::PixelFormat m_oldFormat;
     doc::PixelFormat m_newFormat;
     CmdSequence m_seq;
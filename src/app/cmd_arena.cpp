@@ -0,0 +1,181 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/cmd_arena.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+#include <new>
+
+namespace app {
+
+namespace {
+
+// Each allocated block starts with a header that indicates the arena
+// where it was allocated (or nullptr if it's in the heap).
+struct alignas(std::max_align_t) Header {
+  CmdArena* arena;
+};
+
+const size_t kMinChunkSize = 4*1024;
+const size_t kMaxChunkSize = 64*1024;
+
+thread_local CmdArena* t_current = nullptr;
+
+size_t align_size(const size_t size)
+{
+  const size_t align = alignof(std::max_align_t);
+  return (size + align - 1) / align * align;
+}
+
+} // anonymous namespace
+
+// static
+CmdArena* CmdArena::create()
+{
+  return new CmdArena;
+}
+
+CmdArena::CmdArena()
+  : m_refs(1)
+  , m_chunkSize(kMinChunkSize)
+{
+}
+
+CmdArena::~CmdArena()
+{
+  ASSERT(m_refs == 0);
+}
+
+void CmdArena::ref()
+{
+  ++m_refs;
+}
+
+void CmdArena::unref()
+{
+  ASSERT(m_refs > 0);
+  if (--m_refs == 0)
+    delete this;
+}
+
+// static
+void* CmdArena::allocate(const std::size_t size)
+{
+  const size_t n = sizeof(Header) + align_size(size);
+  Header* header;
+
+  if (CmdArena* arena = t_current) {
+    header = (Header*)arena->allocateInChunk(n);
+    header->arena = arena;
+    arena->ref();
+  }
+  else {
+    header = (Header*)::operator new(n);
+    header->arena = nullptr;
+  }
+  return header+1;
+}
+
+// static
+void CmdArena::deallocate(void* ptr)
+{
+  if (!ptr)
+    return;
+
+  Header* header = ((Header*)ptr)-1;
+  if (header->arena) {
+    // The memory is released when the last Cmd of the arena is
+    // deleted
+    header->arena->unref();
+  }
+  else
+    ::operator delete(header);
+}
+
+void* CmdArena::allocateInChunk(const std::size_t size)
+{
+  ASSERT(size == align_size(size));
+
+  if (m_pos + size <= m_end) {
+    void* ptr = m_pos;
+    m_pos += size;
+    return ptr;
+  }
+
+  // Big blocks have their own chunk (so we don't waste the rest of
+  // the current chunk)
+  if (size > m_chunkSize/4) {
+    m_chunks.emplace_back(new uint8_t[size]);
+    m_size += size;
+    return m_chunks.back().get();
+  }
+
+  // Each new chunk is bigger than the previous one
+  m_chunks.emplace_back(new uint8_t[m_chunkSize]);
+  m_size += m_chunkSize;
+  m_pos = m_chunks.back().get();
+  m_end = m_pos + m_chunkSize;
+  m_chunkSize = std::min(m_chunkSize*2, kMaxChunkSize);
+
+  void* ptr = m_pos;
+  m_pos += size;
+  return ptr;
+}
+
+CmdArena::Scope::Scope(CmdArena* arena)
+  : m_arena(arena)
+  , m_prev(t_current)
+{
+  // We keep a reference to the previous arena too, in case that it's
+  // deleted before this scope (scopes of transactions that are not
+  // nested).
+  if (m_prev)
+    m_prev->ref();
+  if (m_arena)
+    m_arena->ref();
+  setCurrent(m_arena);
+}
+
+CmdArena::Scope::~Scope()
+{
+  if (t_current == m_arena)
+    setCurrent(m_prev);
+  if (m_arena)
+    m_arena->unref();
+  if (m_prev)
+    m_prev->unref();
+}
+
+void CmdArena::Scope::setArena(CmdArena* arena)
+{
+  if (arena)
+    arena->ref();
+  if (t_current == m_arena)
+    setCurrent(arena);
+  if (m_arena)
+    m_arena->unref();
+  m_arena = arena;
+}
+
+// static
+void CmdArena::setCurrent(CmdArena* arena)
+{
+  // The current arena has a reference too, so it cannot be deleted
+  // while it's the current one
+  if (arena)
+    arena->ref();
+  if (t_current)
+    t_current->unref();
+  t_current = arena;
+}
+
+} // namespace app
@@ -0,0 +1,82 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_CMD_ARENA_H_INCLUDED
+#define APP_CMD_ARENA_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace app {
+
+  // Memory used to allocate the Cmds of one transaction. Each Cmd
+  // created while the arena is the current one of the thread (see
+  // CmdArena::Scope) is allocated in big chunks of memory, and all
+  // chunks are released at once when the transaction and all its
+  // Cmds are deleted (e.g. when the undo state is deleted).
+  //
+  // The arena is reference counted: the CmdTransaction, each
+  // Scope, and each Cmd allocated in the arena keep a reference.
+  class CmdArena {
+  public:
+    // Creates an arena with one reference.
+    static CmdArena* create();
+
+    void ref();
+    void unref();
+
+    // Total bytes of chunks allocated by this arena.
+    size_t size() const { return m_size; }
+
+    // Used by Cmd::operator new/delete. If there is a current arena
+    // in this thread, the memory is allocated from it, in other case
+    // it's allocated from the heap.
+    static void* allocate(const std::size_t size);
+    static void deallocate(void* ptr);
+
+    // Makes an arena the current one in this thread while the scope
+    // is alive.
+    class Scope {
+    public:
+      Scope(CmdArena* arena);
+      ~Scope();
+
+      // Changes the arena of this scope (e.g. when the
+      // CmdTransaction is replaced because it was rolled back).
+      void setArena(CmdArena* arena);
+
+    private:
+      CmdArena* m_arena;
+      CmdArena* m_prev;
+      DISABLE_COPYING(Scope);
+    };
+
+  private:
+    CmdArena();
+    ~CmdArena();
+
+    void* allocateInChunk(const std::size_t size);
+    static void setCurrent(CmdArena* arena);
+
+    std::atomic<int> m_refs;
+    std::vector<std::unique_ptr<uint8_t[]>> m_chunks;
+    uint8_t* m_pos = nullptr;
+    uint8_t* m_end = nullptr;
+    size_t m_chunkSize;
+    size_t m_size = 0;
+
+    DISABLE_COPYING(CmdArena);
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,76 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/cmd.h"
+#include "app/cmd_arena.h"
+
+#include <memory>
+#include <vector>
+
+using namespace app;
+
+namespace {
+
+  class TestCmd : public Cmd {
+  public:
+    TestCmd(int* deleted) : m_deleted(deleted) { }
+    ~TestCmd() { ++(*m_deleted); }
+    int value[64];
+  private:
+    int* m_deleted;
+  };
+
+}
+
+TEST(CmdArena, AllocateInScope)
+{
+  int deleted = 0;
+  std::vector<std::unique_ptr<TestCmd>> cmds;
+
+  CmdArena* arena = CmdArena::create();
+  {
+    CmdArena::Scope scope(arena);
+    for (int i=0; i<1000; ++i) {
+      cmds.emplace_back(new TestCmd(&deleted));
+      cmds.back()->value[0] = i;
+    }
+  }
+  EXPECT_LE(1000*sizeof(TestCmd), arena->size());
+  arena->unref();               // Cmds keep the arena alive
+
+  for (int i=0; i<1000; ++i)
+    EXPECT_EQ(i, cmds[i]->value[0]);
+
+  cmds.clear();
+  EXPECT_EQ(1000, deleted);
+}
+
+TEST(CmdArena, ScopesNotNested)
+{
+  int deleted = 0;
+  CmdArena* a = CmdArena::create();
+  CmdArena* b = CmdArena::create();
+  std::unique_ptr<TestCmd> ca, cb, cc;
+
+  auto scopeA = std::make_unique<CmdArena::Scope>(a);
+  ca.reset(new TestCmd(&deleted));
+  auto scopeB = std::make_unique<CmdArena::Scope>(b);
+  cb.reset(new TestCmd(&deleted));
+  a->unref();
+  b->unref();
+  scopeA.reset();
+  scopeB.reset();
+
+  // Allocated in the heap or in an arena that is still alive
+  cc.reset(new TestCmd(&deleted));
+
+  ca.reset();
+  cb.reset();
+  cc.reset();
+  EXPECT_EQ(3, deleted);
+}
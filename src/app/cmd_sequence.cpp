@@ -80,6 +80,12 @@ size_t CmdSequence::onMemSize() const
   return size;
 }
 
+void CmdSequence::onUndoPayloads(std::vector<UndoPayload*>& payloads)
+{
+  for (auto it = m_cmds.begin(), end=m_cmds.end(); it!=end; ++it)
+    (*it)->undoPayloads(payloads);
+}
+
 void CmdSequence::executeAndAdd(Cmd* cmd)
 {
   addAndExecute(context(), cmd);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -26,9 +26,17 @@ CmdTransaction::CmdTransaction(const std::string& label,
   : m_ranges(nullptr)
   , m_label(label)
   , m_changeSavedState(changeSavedState)
+  , m_arena(CmdArena::create())
 {
 }
 
+CmdTransaction::~CmdTransaction()
+{
+  // The arena is deleted when all its cmds are deleted (in the
+  // ~CmdSequence() dtor)
+  m_arena->unref();
+}
+
 CmdTransaction* CmdTransaction::moveToEmptyCopy()
 {
   CmdTransaction* copy = new CmdTransaction(m_label,
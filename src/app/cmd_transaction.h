@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/cmd_sequence.h"
+#include "app/cmd_arena.h"
 #include "app/doc_range.h"
 #include "app/sprite_position.h"
 
@@ -24,6 +25,10 @@ namespace app {
   public:
     CmdTransaction(const std::string& label,
                    bool changeSavedState);
+    ~CmdTransaction();
+
+    // Arena where the Cmds of this transaction are allocated.
+    CmdArena* arena() const { return m_arena; }
 
     bool doesChangeSavedState() const { return m_changeSavedState; }
 
@@ -63,6 +68,7 @@ namespace app {
     std::unique_ptr<Ranges> m_ranges;
     std::string m_label;
     bool m_changeSavedState;
+    CmdArena* m_arena;
   };
 
 } // namespace app
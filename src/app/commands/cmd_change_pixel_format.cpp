@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,8 +27,10 @@
 #include "app/ui/editor/editor_render.h"
 #include "app/ui/rgbmap_algorithm_selector.h"
 #include "app/ui/skin/skin_theme.h"
+#include "base/thread_pool.h"
 #include "doc/image.h"
 #include "doc/layer.h"
+#include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "fmt/format.h"
 #include "render/dithering.h"
@@ -43,8 +45,13 @@
 
 #include "color_mode.xml.h"
 
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <map>
 #include <string>
 #include <thread>
+#include <tuple>
 
 namespace app {
 
@@ -61,36 +68,46 @@ rgba_to_graya_func get_gray_func(gen::ToGrayAlgorithm toGray) {
   return nullptr;
 }
 
+// Converts the visible area of the sprite for the preview of the
+// ColorModeWindow. The visible area is rendered just one time (in
+// parallel tiles) and then re-used by the conversions with other
+// options.
 class ConvertThread : public render::TaskDelegate {
 public:
-  ConvertThread(const doc::ImageRef& dstImage,
+  ConvertThread(const doc::ImageRef& srcImage,
+                const bool renderSrc,
+                const doc::ImageRef& dstImage,
                 const doc::Sprite* sprite,
                 const doc::frame_t frame,
-                const doc::PixelFormat pixelFormat,
                 const render::Dithering& dithering,
-                const doc::RgbMapAlgorithm rgbMapAlgorithm,
+                const doc::RgbMap* rgbmap,
                 const gen::ToGrayAlgorithm toGray,
                 const gfx::Point& pos,
-                const bool newBlend)
-    : m_image(dstImage)
+                const bool newBlend,
+                base::thread_pool* renderPool)
+    : m_srcImage(srcImage)
+    , m_image(dstImage)
     , m_pos(pos)
     , m_running(true)
     , m_stopFlag(false)
+    , m_canceled(false)
     , m_progress(0.0)
     , m_thread(
       [this,
+       renderSrc,
        sprite, frame,
-       pixelFormat,
        dithering,
-       rgbMapAlgorithm,
+       rgbmap,
        toGray,
-       newBlend]() { // Copy the matrix
-        run(sprite, frame,
-            pixelFormat,
+       newBlend,
+       renderPool]() { // Copy the matrix
+        run(renderSrc,
+            sprite, frame,
             dithering,
-            rgbMapAlgorithm,
+            rgbmap,
             toGray,
-            newBlend);
+            newBlend,
+            renderPool);
       })
   {
   }
@@ -104,46 +121,55 @@ public:
     return m_running;
   }
 
+  // Returns true if the conversion was stopped before it was
+  // completed (the image is incomplete).
+  bool isCanceled() const {
+    return m_canceled;
+  }
+
   double progress() const {
     return m_progress;
   }
 
 private:
-  void run(const Sprite* sprite,
+  void run(const bool renderSrc,
+           const Sprite* sprite,
            const doc::frame_t frame,
-           const doc::PixelFormat pixelFormat,
            const render::Dithering& dithering,
-           const doc::RgbMapAlgorithm rgbMapAlgorithm,
+           const doc::RgbMap* rgbmap,
            const gen::ToGrayAlgorithm toGray,
-           const bool newBlend) {
-    doc::ImageRef tmp(
-      Image::create(sprite->pixelFormat(),
-                    m_image->width(),
-                    m_image->height()));
-
-    render::Render render;
-    render.setNewBlend(newBlend);
-    render.renderSprite(
-      tmp.get(), sprite, frame,
-      gfx::Clip(0, 0,
-                m_pos.x, m_pos.y,
-                m_image->width(),
-                m_image->height()));
+           const bool newBlend,
+           base::thread_pool* renderPool) {
+    if (renderSrc) {
+      render::Render render;
+      render.setNewBlend(newBlend);
+      render.setParallelTiles(renderPool);
+      render.renderSprite(
+        m_srcImage.get(), sprite, frame,
+        gfx::Clip(0, 0,
+                  m_pos.x, m_pos.y,
+                  m_image->width(),
+                  m_image->height()));
+    }
+
+    // Error diffusion processes several rows in parallel (ordered
+    // dithering is always done in parallel)
+    render::Dithering parallelDithering(dithering);
+    parallelDithering.parallel(true);
 
     render::convert_pixel_format(
-      tmp.get(),
+      m_srcImage.get(),
       m_image.get(),
-      pixelFormat,
-      dithering,
-      sprite->rgbMap(frame,
-                     sprite->rgbMapForSprite(),
-                     rgbMapAlgorithm),
+      m_image->pixelFormat(),
+      parallelDithering,
+      rgbmap,
       sprite->palette(frame),
       (sprite->backgroundLayer() != nullptr),
       0,
       get_gray_func(toGray),
       this);
 
+    m_canceled = m_stopFlag.load();
     m_running = false;
   }
 
@@ -157,11 +183,13 @@ private:
     m_progress = progress;
   }
 
+  doc::ImageRef m_srcImage;
   doc::ImageRef m_image;
   gfx::Point m_pos;
-  bool m_running;
-  bool m_stopFlag;
-  double m_progress;
+  std::atomic<bool> m_running;
+  std::atomic<bool> m_stopFlag;
+  std::atomic<bool> m_canceled;
+  std::atomic<double> m_progress;
   std::thread m_thread;
 };
 
@@ -184,17 +212,21 @@ private:
   doc::PixelFormat m_pixelFormat;
 };
 
+// Number of converted previews that we keep to switch between
+// options without converting the image again
+static const int kMaxCachedPreviews = 8;
+
 class ColorModeWindow : public app::gen::ColorMode {
 public:
   ColorModeWindow(Editor* editor)
     : m_timer(100)
     , m_editor(editor)
     , m_image(nullptr)
-    , m_imageBuffer(new doc::ImageBuffer)
+    , m_srcRendered(false)
+    , m_renderPool(std::max(1u, std::thread::hardware_concurrency()))
     , m_selectedItem(nullptr)
     , m_ditheringSelector(nullptr)
     , m_mapAlgorithmSelector(nullptr)
-    , m_imageJustCreated(true)
   {
     const auto& pref = Preferences::instance();
     const doc::PixelFormat from = m_editor->sprite()->pixelFormat();
@@ -338,17 +370,64 @@ public:
 
 private:
 
+  // Options used to convert a preview image
+  struct PreviewKey {
+    doc::PixelFormat pixelFormat;
+    int ditheringItem;
+    int factor;
+    doc::RgbMapAlgorithm rgbMapAlgorithm;
+    gen::ToGrayAlgorithm toGray;
+
+    bool operator<(const PreviewKey& o) const {
+      return std::tie(pixelFormat, ditheringItem, factor, rgbMapAlgorithm, toGray) <
+        std::tie(o.pixelFormat, o.ditheringItem, o.factor, o.rgbMapAlgorithm, o.toGray);
+    }
+  };
+
+  PreviewKey previewKey(const doc::PixelFormat pixelFormat) const {
+    PreviewKey key;
+    key.pixelFormat = pixelFormat;
+    key.ditheringItem = -1;
+    key.factor = 0;
+    key.rgbMapAlgorithm = doc::RgbMapAlgorithm::DEFAULT;
+    key.toGray = gen::ToGrayAlgorithm::DEFAULT;
+    if (pixelFormat == doc::IMAGE_INDEXED) {
+      if (m_ditheringSelector)
+        key.ditheringItem = m_ditheringSelector->getSelectedItemIndex();
+      key.factor = factor()->getValue();
+      key.rgbMapAlgorithm = rgbMapAlgorithm();
+    }
+    else if (pixelFormat == doc::IMAGE_GRAYSCALE) {
+      key.toGray = toGray();
+    }
+    return key;
+  }
+
   void stop() {
     m_editor->renderEngine().removePreviewImage();
     m_editor->invalidate();
 
     m_timer.stop();
     if (m_bgThread) {
+      // Incomplete conversions are not cached, so we can stop the
+      // thread right now
       m_bgThread->stop();
+      m_srcRendered = true;
       m_bgThread.reset(nullptr);
     }
   }
 
+  void addToCache(const PreviewKey& key, const doc::ImageRef& image) {
+    if (m_cache.find(key) == m_cache.end()) {
+      if (int(m_cacheOrder.size()) >= kMaxCachedPreviews) {
+        m_cache.erase(m_cacheOrder.front());
+        m_cacheOrder.pop_front();
+      }
+      m_cacheOrder.push_back(key);
+    }
+    m_cache[key] = image;
+  }
+
   void onChangeColorMode() {
     ConversionItem* item =
       static_cast<ConversionItem*>(colorMode()->getSelectedChild());
@@ -362,6 +441,15 @@ private:
     if (visibleBounds.isEmpty())
       return;
 
+    // Cached images are valid only for the same visible area
+    if (m_srcImage &&
+        m_srcImage->size() != visibleBounds.size()) {
+      m_srcImage.reset();
+      m_srcRendered = false;
+      m_cache.clear();
+      m_cacheOrder.clear();
+    }
+
     doc::PixelFormat dstPixelFormat = item->pixelFormat();
 
     if (m_ditheringSelector) {
@@ -379,14 +467,29 @@ private:
       toGrayCombobox()->setVisible(toGray);
     }
 
-    m_image.reset(
-      Image::create(dstPixelFormat,
-                    visibleBounds.w,
-                    visibleBounds.h,
-                    m_imageBuffer));
-    if (m_imageJustCreated) {
-      m_imageJustCreated = false;
-      m_image->clear(0);
+    // Use the cached preview if we've already converted the image
+    // with these options
+    m_key = previewKey(dstPixelFormat);
+    auto it = m_cache.find(m_key);
+    const bool cached = (it != m_cache.end());
+    if (cached) {
+      m_image = it->second;
+    }
+    else {
+      doc::ImageRef oldImage = m_image;
+      m_image.reset(
+        Image::create(dstPixelFormat,
+                      visibleBounds.w,
+                      visibleBounds.h));
+
+      // Keep the previous preview visible until the new conversion
+      // overwrites it
+      if (oldImage &&
+          oldImage->pixelFormat() == dstPixelFormat &&
+          oldImage->size() == m_image->size())
+        copy_image(m_image.get(), oldImage.get());
+      else
+        m_image->clear(0);
     }
 
     m_editor->renderEngine().setPreviewImage(
@@ -402,17 +505,40 @@ private:
     progress()->setVisible(false);
     layout();
 
+    if (cached)
+      return;
+
+    // The visible area of the sprite is rendered only by the first
+    // conversion (it's the same for all options)
+    const doc::Sprite* sprite = m_editor->sprite();
+    const bool renderSrc = !m_srcRendered;
+    if (!m_srcImage) {
+      m_srcImage.reset(
+        Image::create(sprite->pixelFormat(),
+                      visibleBounds.w,
+                      visibleBounds.h));
+    }
+
+    // The RgbMap is calculated here (in the UI thread) because the
+    // sprite caches it
+    const doc::RgbMap* rgbmap =
+      sprite->rgbMap(m_editor->frame(),
+                     sprite->rgbMapForSprite(),
+                     rgbMapAlgorithm());
+
     m_bgThread.reset(
       new ConvertThread(
+        m_srcImage,
+        renderSrc,
         m_image,
-        m_editor->sprite(),
+        sprite,
         m_editor->frame(),
-        dstPixelFormat,
         dithering(),
-        rgbMapAlgorithm(),
+        rgbmap,
         toGray(),
         visibleBounds.origin(),
-        Preferences::instance().experimental.newBlend()));
+        Preferences::instance().experimental.newBlend(),
+        &m_renderPool));
 
     m_timer.start();
   }
@@ -437,6 +563,9 @@ private:
     if (!m_bgThread->isRunning()) {
       m_timer.stop();
       m_bgThread->stop();
+      if (!m_bgThread->isCanceled())
+        addToCache(m_key, m_image);
+      m_srcRendered = true;
       m_bgThread.reset(nullptr);
 
       progress()->setVisible(false);
@@ -459,12 +588,17 @@ private:
   Timer m_timer;
   Editor* m_editor;
   doc::ImageRef m_image;
-  doc::ImageBufferPtr m_imageBuffer;
+  // Visible area of the sprite (source of all conversions)
+  doc::ImageRef m_srcImage;
+  bool m_srcRendered;
+  base::thread_pool m_renderPool;
   std::unique_ptr<ConvertThread> m_bgThread;
+  PreviewKey m_key;
+  std::map<PreviewKey, doc::ImageRef> m_cache;
+  std::deque<PreviewKey> m_cacheOrder;
   ConversionItem* m_selectedItem;
   DitheringSelector* m_ditheringSelector;
   RgbMapAlgorithmSelector* m_mapAlgorithmSelector;
-  bool m_imageJustCreated;
 };
 
 #endif // ENABLE_UI
@@ -519,6 +653,10 @@ void ChangePixelFormatCommand::onLoadParams(const Params& params)
     m_dithering.algorithm(render::DitheringAlgorithm::Old);
   else if (dithering == "error-diffusion")
     m_dithering.algorithm(render::DitheringAlgorithm::ErrorDiffusion);
+  else if (dithering == "error-diffusion-parallel") {
+    m_dithering.algorithm(render::DitheringAlgorithm::ErrorDiffusion);
+    m_dithering.parallel(true);
+  }
   else
     m_dithering.algorithm(render::DitheringAlgorithm::None);
 
@@ -550,6 +688,8 @@ void ChangePixelFormatCommand::onLoadParams(const Params& params)
     m_rgbmap = doc::RgbMapAlgorithm::OCTREE;
   else if (rgbmap == "rgb5a3")
     m_rgbmap = doc::RgbMapAlgorithm::RGB5A3;
+  else if (rgbmap == "kdtree")
+    m_rgbmap = doc::RgbMapAlgorithm::KDTREE;
   else if (rgbmap == "default")
     m_rgbmap = doc::RgbMapAlgorithm::DEFAULT;
   else {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -35,10 +35,15 @@
 #include "doc/primitives.h"
 #include "doc/sprite.h"
 #include "render/render.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
 #include "ui/ui.h"
 
 #include "import_sprite_sheet.xml.h"
 
+#include <algorithm>
+#include <unordered_map>
+
 namespace app {
 
 using namespace ui;
@@ -49,6 +54,8 @@ struct ImportSpriteSheetParams : public NewParams {
   Param<gfx::Rect> frameBounds { this, gfx::Rect(0, 0, 0, 0), "frameBounds" };
   Param<gfx::Size> padding { this, gfx::Size(0, 0), "padding" };
   Param<bool> partialTiles { this, false, "partialTiles" };
+  Param<bool> ignoreEmpty { this, false, "ignoreEmpty" };
+  Param<bool> mergeDuplicates { this, false, "mergeDuplicates" };
 };
 
 class ImportSpriteSheetWindow : public app::gen::ImportSpriteSheet
@@ -114,6 +121,14 @@ public:
     return paddingEnabled()->isSelected();
   }
 
+  bool ignoreEmptyValue() const {
+    return ignoreEmpty()->isSelected();
+  }
+
+  bool mergeDuplicatesValue() const {
+    return mergeDups()->isSelected();
+  }
+
   bool ok() const {
     return closer() == import();
   }
@@ -138,6 +153,8 @@ public:
     params.type(sheetTypeValue());
     params.frameBounds(frameBounds());
     params.partialTiles(partialTilesValue());
+    params.ignoreEmpty(ignoreEmptyValue());
+    params.mergeDuplicates(mergeDuplicatesValue());
 
     if (paddingEnabledValue())
       params.padding(paddingThickness());
@@ -298,6 +315,8 @@ private:
 
       paddingEnabled()->setSelected(m_docPref->importSpriteSheet.paddingEnabled());
       partialTiles()->setSelected(m_docPref->importSpriteSheet.partialTiles());
+      ignoreEmpty()->setSelected(m_docPref->importSpriteSheet.ignoreEmpty());
+      mergeDups()->setSelected(m_docPref->importSpriteSheet.mergeDuplicates());
       onEntriesChange();
       onPaddingEnabledChange();
     }
@@ -431,6 +450,8 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
     docPref->importSpriteSheet.partialTiles(params.partialTiles());
     docPref->importSpriteSheet.paddingBounds(params.padding());
     docPref->importSpriteSheet.paddingEnabled(window.paddingEnabledValue());
+    docPref->importSpriteSheet.ignoreEmpty(params.ignoreEmpty());
+    docPref->importSpriteSheet.mergeDuplicates(params.mergeDuplicates());
   }
   else // We import the sprite sheet from the active document if there is no UI
 #endif
@@ -443,13 +464,18 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
   // The list of frames imported from the sheet
   std::vector<ImageRef> animation;
 
+  // Index of the first frame with the same image for each frame in
+  // "animation" (to create linked cels when mergeDuplicates is used)
+  std::vector<int> sameAs;
+
   try {
     Sprite* sprite = document->sprite();
     frame_t currentFrame = context->activeSite().frame();
     gfx::Rect frameBounds = params.frameBounds();
     const gfx::Size padding = params.padding();
-    render::Render render;
-    render.setNewBlend(Preferences::instance().experimental.newBlend());
+    const bool newBlend = Preferences::instance().experimental.newBlend();
+    const bool ignoreEmpty = params.ignoreEmpty();
+    const bool mergeDuplicates = params.mergeDuplicates();
 
     if (frameBounds.isEmpty())
       frameBounds = sprite->bounds();
@@ -490,19 +516,85 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
         break;
     }
 
-    // As first step, we cut each tile and add them into "animation" list.
-    for (const auto& tileRect : tileRects) {
-      ImageRef resultImage(
-        Image::create(
-          sprite->pixelFormat(), tileRect.w, tileRect.h));
+    // As first step, we cut each tile in parallel (each task renders
+    // a range of tiles with its own render::Render). Empty tiles are
+    // discarded as soon as they are rendered, and the hash of each
+    // tile is calculated in the same task to find duplicates.
+    struct CutTile {
+      ImageRef image;
+      uint64_t hash = 0;
+    };
+    std::vector<CutTile> cutTiles(tileRects.size());
+    {
+      const int n = int(tileRects.size());
+      const int ntasks =
+        std::min(n, 2 * std::max(1, sched::Scheduler::instance().threads()));
+      sched::TaskGroup tasks(sched::Priority::UI);
+      for (int t=0; t<ntasks; ++t) {
+        const int i0 = n * t / ntasks;
+        const int i1 = n * (t+1) / ntasks;
+        tasks.run([sprite, currentFrame, newBlend,
+                   ignoreEmpty, mergeDuplicates,
+                   &tileRects, &cutTiles, i0, i1]{
+          render::Render render;
+          render.setNewBlend(newBlend);
+
+          for (int i=i0; i<i1; ++i) {
+            const gfx::Rect& tileRect = tileRects[i];
+            ImageSpec spec = sprite->spec();
+            spec.setSize(tileRect.size());
+            ImageRef resultImage(Image::create(spec));
+
+            // Render the portion of sheet.
+            render.renderSprite(
+              resultImage.get(), sprite, currentFrame,
+              gfx::Clip(0, 0, tileRect));
+
+            if (ignoreEmpty && is_empty_image(resultImage.get()))
+              continue;
+
+            if (mergeDuplicates)
+              cutTiles[i].hash = resultImage->hash();
+            cutTiles[i].image = resultImage;
+          }
+        });
+      }
+      tasks.wait();
+    }
 
-      // Render the portion of sheet.
-      render.renderSprite(
-        resultImage.get(), sprite, currentFrame,
-        gfx::Clip(0, 0, tileRect));
+    // Tiles are added in order to the animation, looking for
+    // duplicates with the same hash
+    std::unordered_multimap<uint64_t, int> hashes;
+    for (CutTile& tile : cutTiles) {
+      if (!tile.image)
+        continue;
+
+      int first = -1;
+      if (mergeDuplicates) {
+        auto range = hashes.equal_range(tile.hash);
+        for (auto it=range.first; it!=range.second; ++it) {
+          if (is_same_image(animation[it->second].get(), tile.image.get())) {
+            first = it->second;
+            break;
+          }
+        }
+        if (first < 0)
+          hashes.insert(std::make_pair(tile.hash, int(animation.size())));
+      }
 
-      animation.push_back(resultImage);
+      // The image of a duplicated tile is released (the linked cel
+      // will use the image of the first frame).
+      if (first >= 0) {
+        animation.push_back(animation[first]);
+        sameAs.push_back(first);
+      }
+      else {
+        animation.push_back(tile.image);
+        sameAs.push_back(int(animation.size())-1);
+      }
+      tile.image.reset();
     }
+    cutTiles.clear();
 
     if (animation.size() == 0) {
       Alert::show(Strings::alerts_empty_rect_importing_sprite_sheet());
@@ -522,8 +614,13 @@ void ImportSpriteSheetCommand::onExecute(Context* context)
 
     // Add all frames+cels to the new layer
     for (size_t i=0; i<animation.size(); ++i) {
-      // Create the cel.
-      std::unique_ptr<Cel> resultCel(new Cel(frame_t(i), animation[i]));
+      // Create the cel (or a link to the first cel with the same image).
+      std::unique_ptr<Cel> resultCel;
+      if (sameAs[i] != int(i))
+        resultCel.reset(Cel::MakeLink(frame_t(i),
+                                      resultLayer->cel(frame_t(sameAs[i]))));
+      else
+        resultCel.reset(new Cel(frame_t(i), animation[i]));
 
       // Add the cel in the layer.
       api.addCel(resultLayer, resultCel.get());
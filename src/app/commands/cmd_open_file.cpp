@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -25,53 +25,104 @@
 #include "app/recent_files.h"
 #include "app/ui/status_bar.h"
 #include "app/ui_context.h"
+#include "base/convert_to.h"
 #include "base/fs.h"
+#include "base/split_string.h"
 #include "base/thread.h"
 #include "doc/sprite.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
 #include "ui/ui.h"
 
+#include <algorithm>
 #include <cstdio>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 namespace app {
 
-class OpenFileJob : public Job, public IFileOpProgress {
+// Loads one or several files at the same time (each file is decoded
+// in its own task) showing just one progress window.
+class OpenFileJob : public Job {
 public:
-  OpenFileJob(FileOp* fop)
+  OpenFileJob(const std::vector<FileOp*>& fops)
     : Job(Strings::open_file_loading().c_str())
-    , m_fop(fop)
+    , m_progress(fops.size(), 0.0)
   {
+    for (int i=0; i<int(fops.size()); ++i)
+      m_fops.push_back(std::make_unique<Progress>(this, fops[i], i));
   }
 
   void showProgressWindow() {
     startJob();
 
-    if (isCanceled())
-      m_fop->stop();
+    if (isCanceled()) {
+      for (auto& p : m_fops)
+        p->fop->stop();
+    }
 
     waitJob();
   }
 
 private:
-  // Thread to do the hard work: load the file from the disk.
+  struct Progress : public IFileOpProgress {
+    OpenFileJob* job;
+    FileOp* fop;
+    int index;
+
+    Progress(OpenFileJob* job, FileOp* fop, int index)
+      : job(job), fop(fop), index(index) { }
+
+    void ackFileOpProgress(double progress) override {
+      job->onFileProgress(index, progress);
+    }
+  };
+
+  // Thread to do the hard work: load the files from the disk.
   virtual void onJob() override {
+    if (m_fops.size() == 1) {
+      loadFile(*m_fops[0]);
+      return;
+    }
+
+    sched::TaskGroup tasks(sched::Priority::Interactive);
+    for (auto& p : m_fops)
+      tasks.run([this, &p]{ loadFile(*p); });
+    tasks.wait();
+  }
+
+  void loadFile(Progress& p) {
+    FileOp* fop = p.fop;
     try {
-      m_fop->operate(this);
+      fop->operate(&p);
     }
     catch (const std::exception& e) {
-      m_fop->setError("Error loading file:\n%s", e.what());
+      fop->setError("Error loading file:\n%s", e.what());
     }
 
-    if (m_fop->isStop() && m_fop->document())
-      delete m_fop->releaseDocument();
+    if (fop->isStop() && fop->document())
+      delete fop->releaseDocument();
 
-    m_fop->done();
+    fop->done();
   }
 
-  virtual void ackFileOpProgress(double progress) override {
-    jobProgress(progress);
+  void onFileProgress(const int index, const double progress) {
+    // The progress of the job is the average progress of all files
+    double total = 0.0;
+    {
+      std::lock_guard lock(m_progressMutex);
+      m_progress[index] = progress;
+      for (const double p : m_progress)
+        total += p;
+    }
+    jobProgress(total / m_progress.size());
   }
 
-  FileOp* m_fop;
+  std::vector<std::unique_ptr<Progress>> m_fops;
+  std::mutex m_progressMutex;
+  std::vector<double> m_progress;
 };
 
 OpenFileCommand::OpenFileCommand()
@@ -89,6 +140,32 @@ void OpenFileCommand::onLoadParams(const Params& params)
   m_repeatCheckbox = params.get_as<bool>("repeat_checkbox");
   m_oneFrame = params.get_as<bool>("oneframe");
 
+  // Region of interest to load: "bounds" as "x,y,w,h" in sprite
+  // coordinates, and "fromFrame"/"toFrame" (0-based) to load a range
+  // of frames
+  m_loadBounds = gfx::Rect();
+  {
+    std::vector<std::string> parts;
+    base::split_string(params.get("bounds"), parts, ",");
+    if (parts.size() == 4) {
+      m_loadBounds.x = base::convert_to<int>(parts[0]);
+      m_loadBounds.y = base::convert_to<int>(parts[1]);
+      m_loadBounds.w = base::convert_to<int>(parts[2]);
+      m_loadBounds.h = base::convert_to<int>(parts[3]);
+    }
+  }
+
+  m_loadFrames.clear();
+  if (params.has_param("fromFrame") ||
+      params.has_param("toFrame")) {
+    const doc::frame_t fromFrame = std::max(0, params.get_as<doc::frame_t>("fromFrame"));
+    const doc::frame_t toFrame = (params.has_param("toFrame") ?
+                                  params.get_as<doc::frame_t>("toFrame"):
+                                  std::numeric_limits<doc::frame_t>::max());
+    if (fromFrame <= toFrame)
+      m_loadFrames.insert(fromFrame, toFrame);
+  }
+
   std::string sequence = params.get("sequence");
   if (m_oneFrame ||
       sequence == "skip" ||
@@ -137,7 +214,11 @@ void OpenFileCommand::onExecute(Context* context)
   }
   else
 #endif // ENABLE_UI
-  if (!m_filename.empty()) {
+  if (!m_filenames.empty()) {
+    filenames = std::move(m_filenames);
+    m_filenames.clear();
+  }
+  else if (!m_filename.empty()) {
     filenames.push_back(m_filename);
   }
 
@@ -175,6 +256,10 @@ void OpenFileCommand::onExecute(Context* context)
   if (m_oneFrame)
     flags |= FILE_LOAD_ONE_FRAME;
 
+  // First we create all the FileOps, so the user answers all the
+  // questions to open sequences of files before we start loading
+  // them.
+  std::vector<std::unique_ptr<FileOp>> fops;
   std::string filename;
   while (!filenames.empty()) {
     filename = filenames[0];
@@ -183,15 +268,25 @@ void OpenFileCommand::onExecute(Context* context)
     std::unique_ptr<FileOp> fop(
       FileOp::createLoadDocumentOperation(
         context, filename, flags));
-    bool unrecent = false;
 
-    // Do nothing (the user cancelled or something like that)
+    // Do nothing more (the user cancelled or something like that)
     if (!fop)
-      return;
+      break;
+
+    if (!m_loadBounds.isEmpty() || !m_loadFrames.empty()) {
+      FileOpLoadROI roi;
+      roi.bounds = m_loadBounds;
+      roi.frames = m_loadFrames;
+      fop->setLoadROI(roi);
+    }
 
     if (fop->hasError()) {
       console.printf(fop->error().c_str());
-      unrecent = true;
+
+      // The file was not found, so we can remove it from the
+      // recent-file list
+      if (context->isUIAvailable())
+        App::instance()->recentFiles()->removeRecentFile(filename);
     }
     else {
       if (fop->isSequence()) {
@@ -220,9 +315,23 @@ void OpenFileCommand::onExecute(Context* context)
         m_usedFiles.push_back(fn);
       }
 
-      OpenFileJob task(fop.get());
-      task.showProgressWindow();
+      fops.push_back(std::move(fop));
+    }
+  }
+
+  // Load the files in batches (one file per thread), so we don't
+  // keep too many files in memory at the same time and each batch of
+  // documents is added to the context as soon as it's loaded.
+  const int batchSize = std::max(1, sched::Scheduler::instance().threads());
+  for (int i=0; i<int(fops.size()); i+=batchSize) {
+    std::vector<FileOp*> batch;
+    for (int j=i; j<std::min(int(fops.size()), i+batchSize); ++j)
+      batch.push_back(fops[j].get());
+
+    OpenFileJob task(batch);
+    task.showProgressWindow();
 
+    for (FileOp* fop : batch) {
       // Post-load processing, it is called from the GUI because may require user intervention.
       fop->postLoad();
 
@@ -252,16 +361,17 @@ void OpenFileCommand::onExecute(Context* context)
 
         doc->setContext(context);
       }
-      else if (!fop->isStop())
-        unrecent = true;
+      // The file was loaded with errors, so we can remove it from
+      // the recent-file list
+      else if (!fop->isStop()) {
+        if (context->isUIAvailable())
+          App::instance()->recentFiles()->removeRecentFile(fop->filename());
+      }
     }
 
-    // The file was not found or was loaded loaded with errors,
-    // so we can remove it from the recent-file list
-    if (unrecent) {
-      if (context->isUIAvailable())
-        App::instance()->recentFiles()->removeRecentFile(m_filename);
-    }
+    // Stop loading other files if the user canceled the job
+    if (task.isCanceled())
+      break;
   }
 }
 
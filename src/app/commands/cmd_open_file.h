@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2021  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,8 @@
 #include "app/commands/command.h"
 #include "app/pref/preferences.h"
 #include "base/paths.h"
+#include "doc/selected_frames.h"
+#include "gfx/rect.h"
 
 #include <string>
 
@@ -29,15 +31,24 @@ namespace app {
       return m_seqDecision;
     }
 
+    // Files to be opened in the next execution of the command instead
+    // of the "filename" param (they are loaded concurrently).
+    void setFilenames(const base::paths& filenames) {
+      m_filenames = filenames;
+    }
+
   protected:
     void onLoadParams(const Params& params) override;
     void onExecute(Context* context) override;
 
   private:
     std::string m_filename;
+    base::paths m_filenames;
     std::string m_folder;
     bool m_repeatCheckbox;
     bool m_oneFrame;
+    gfx::Rect m_loadBounds;     // Load only this area of the sprite
+    doc::SelectedFrames m_loadFrames; // Load only these frames
     base::paths m_usedFiles;
     gen::SequenceDecision m_seqDecision;
   };
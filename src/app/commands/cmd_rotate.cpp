@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #endif
 
 #include "app/app.h"
+#include "app/cmd/rotate_images.h"
 #include "app/cmd/set_cel_bounds.h"
 #include "app/commands/cmd_rotate.h"
 #include "app/commands/params.h"
@@ -103,27 +104,22 @@ protected:
       }
     }
 
-    // 2) Rotate images
-    int i = 0;
-    for (Cel* cel : m_cels) {
-      Image* image = cel->image();
-      if (image) {
-        ImageRef new_image(Image::create(image->pixelFormat(),
-            m_angle == 180 ? image->width(): image->height(),
-            m_angle == 180 ? image->height(): image->width()));
-        new_image->setMaskColor(image->maskColor());
-
-        doc::rotate_image(image, new_image.get(), m_angle);
-        api.replaceImage(sprite(), cel->imageRef(), new_image);
-      }
+    jobProgress(0.5f);
+    if (isCanceled())
+      return;        // Tx destructor will undo all operations
 
-      jobProgress((float)i / m_cels.size());
-      ++i;
-
-      // cancel all the operation?
-      if (isCanceled())
-        return;        // Tx destructor will undo all operations
+    // 2) Rotate images (all of them at the same time, and without
+    // keeping a copy of the old images in the undo history)
+    std::vector<Image*> images;
+    images.reserve(m_cels.size());
+    for (Cel* cel : m_cels) {
+      if (Image* image = cel->image())
+        images.push_back(image);
     }
+    if (!images.empty())
+      tx()(new cmd::RotateImages(sprite(), images, m_angle));
+
+    jobProgress(1.0f);
 
     // rotate mask
     if (document()->isMaskVisible()) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,7 @@
 #include "app/commands/cmd_save_file.h"
 
 #include "app/app.h"
+#include "app/background_save.h"
 #include "app/commands/command.h"
 #include "app/commands/commands.h"
 #include "app/commands/params.h"
@@ -210,6 +211,26 @@ void SaveFileBaseCommand::saveDocumentInBackground(
     window.show();
     return;
   }
+
+  // Save the whole document in a background thread (without the
+  // progress window), so the user can keep working
+  if (markAsSaved == MarkAsSaved::On &&
+      resizeOnTheFly == ResizeOnTheFly::Off &&
+      context->isUIAvailable() && params().ui() &&
+      m_selFrames.empty() &&
+      !params().aniDir.isSet() &&
+      !params().bounds.isSet() &&
+      params().slice().empty() &&
+      params().tag().empty() &&
+      Preferences::instance().saveFile.background() &&
+      BackgroundSave::isSupported(filename)) {
+    BackgroundSave::start(const_cast<Context*>(context), document, filename);
+    return;
+  }
+
+  // Wait the background operation that is saving this same file (if
+  // any) before writing it again
+  BackgroundSave::wait(filename);
 #endif // ENABLE_UI
 
   if (params().aniDir.isSet()) {
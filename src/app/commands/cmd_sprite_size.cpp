@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@
 #include "app/modules/gui.h"
 #include "app/modules/palettes.h"
 #include "app/sprite_job.h"
+#include "app/ui_context.h"
 #include "app/util/resize_image.h"
 #include "base/convert_to.h"
 #include "doc/algorithm/resize_image.h"
@@ -34,11 +35,14 @@
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "doc/tilesets.h"
+#include "sched/task_group.h"
 #include "ui/ui.h"
 
 #include "sprite_size.xml.h"
 
 #include <algorithm>
+#include <memory>
+#include <vector>
 
 #define PERC_FORMAT     "%.4g"
 
@@ -87,11 +91,18 @@ public:
     m_resize_method = resize_method;
   }
 
+  SpriteSizeJob(Context* ctx, Doc* doc, int new_width, int new_height, ResizeMethod resize_method)
+    : SpriteJob(ctx, doc, Strings::sprite_size_title().c_str()) {
+    m_new_width = new_width;
+    m_new_height = new_height;
+    m_resize_method = resize_method;
+  }
+
 protected:
 
   // [working thread]
   void onJob() override {
-    DocApi api = writer().document()->getApi(tx());
+    DocApi api = document()->getApi(tx());
     Tilesets* tilesets = sprite()->tilesets();
 
     int img_count = 0;
@@ -155,34 +166,75 @@ protected:
       }
     }
 
-    // For each cel...
-    for (Cel* cel : sprite()->uniqueCels()) {
-      // We need to adjust only the origin/position of tilemap cels
-      // (because tiles are resized automatically when we resize the
-      // tileset).
-      if (cel->layer()->isTilemap()) {
-        Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
-        gfx::Size canvasSize =
-          tileset->grid().tilemapSizeToCanvas(
-            gfx::Size(cel->image()->width(),
-                      cel->image()->height()));
-        gfx::Rect newBounds(cel->x()*scale.w,
-                            cel->y()*scale.h,
-                            canvasSize.w,
-                            canvasSize.h);
-        tx()(new cmd::SetCelBoundsF(cel, newBounds));
-      }
-      else {
-        resize_cel_image(
-          tx(), cel, scale,
-          m_resize_method,
-          cel->layer()->isReference() ?
-          -cel->boundsF().origin():
-          gfx::PointF(-cel->bounds().origin()));
+    // Resize the cel images in batches from several threads (the
+    // RgbMap used by the bilinear method on indexed images cannot be
+    // used from several threads), and then replace the images in the
+    // transaction from this thread.
+    std::vector<Cel*> cels;
+    for (Cel* cel : sprite()->uniqueCels())
+      cels.push_back(cel);
+
+    const bool parallel =
+      !(sprite()->pixelFormat() == IMAGE_INDEXED &&
+        m_resize_method == doc::algorithm::RESIZE_METHOD_BILINEAR);
+    const int batchSize =
+      (parallel ? 2*std::max(1, sched::Scheduler::instance().threads()): 1);
+    std::vector<ImageRef> newImages(batchSize);
+
+    for (size_t i=0; i<cels.size(); i+=batchSize) {
+      const size_t n = std::min(cels.size()-i, size_t(batchSize));
+
+      if (parallel) {
+        sched::TaskGroup tasks(sched::Priority::Interactive);
+        for (size_t j=0; j<n; ++j) {
+          Cel* cel = cels[i+j];
+          newImages[j].reset();
+          if (cel->layer()->isTilemap() ||
+              cel->layer()->isReference() ||
+              cel->link() ||
+              !cel->image())
+            continue;
+
+          const Palette* pal = sprite()->palette(cel->frame());
+          tasks.run([this, cel, pal, scale, &newImage = newImages[j]]{
+            newImage = create_resized_cel_image(
+              cel, scale, m_resize_method, pal, nullptr);
+          });
+        }
+        tasks.wait();
       }
 
-      jobProgress((float)progress / img_count);
-      ++progress;
+      for (size_t j=0; j<n; ++j) {
+        Cel* cel = cels[i+j];
+
+        // We need to adjust only the origin/position of tilemap cels
+        // (because tiles are resized automatically when we resize the
+        // tileset).
+        if (cel->layer()->isTilemap()) {
+          Tileset* tileset = static_cast<LayerTilemap*>(cel->layer())->tileset();
+          gfx::Size canvasSize =
+            tileset->grid().tilemapSizeToCanvas(
+              gfx::Size(cel->image()->width(),
+                        cel->image()->height()));
+          gfx::Rect newBounds(cel->x()*scale.w,
+                              cel->y()*scale.h,
+                              canvasSize.w,
+                              canvasSize.h);
+          tx()(new cmd::SetCelBoundsF(cel, newBounds));
+        }
+        else {
+          resize_cel_image(
+            tx(), cel, scale,
+            m_resize_method,
+            cel->layer()->isReference() ?
+            -cel->boundsF().origin():
+            gfx::PointF(-cel->bounds().origin()),
+            (parallel ? newImages[j]: nullptr));
+        }
+
+        jobProgress((float)progress / img_count);
+        ++progress;
+      }
 
       // Cancel all the operation?
       if (isCanceled())
@@ -460,6 +512,25 @@ void SpriteSizeCommand::onExecute(Context* context)
   new_width = std::clamp(new_width, 1, DOC_SPRITE_MAX_WIDTH);
   new_height = std::clamp(new_height, 1, DOC_SPRITE_MAX_HEIGHT);
 
+#ifdef ENABLE_UI
+  // Resize the sprite in the background when the user uses the
+  // dialog, so other sprites can be used in the meantime (scripts
+  // expect the sprite resized when the command returns).
+  if (ui && !context->isExecutingScript()) {
+    Doc* doc = context->activeDocument();
+    UIContext::instance()->backgroundJobs().addJob(
+      doc,
+      [context, doc, new_width, new_height, resize_method]{
+        return std::make_unique<SpriteSizeJob>(
+          context, doc, new_width, new_height, resize_method);
+      },
+      [doc]{
+        update_screen_for_document(doc);
+      });
+    return;
+  }
+#endif // ENABLE_UI
+
   {
     SpriteSizeJob job(reader, new_width, new_height, resize_method);
     job.startJob();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -83,6 +83,13 @@ void UndoCommand::onExecute(Context* context)
     else
       spritePosition = undo->nextRedoSpritePosition();
 
+    // The position can be from other sprite if the transaction was
+    // done by a background job when other sprite was active.
+    if (spritePosition.layer() &&
+        spritePosition.layer()->sprite() != sprite) {
+      spritePosition = currentPosition;
+    }
+
     if (spritePosition != currentPosition) {
       Layer* selectLayer = spritePosition.layer();
       if (selectLayer)
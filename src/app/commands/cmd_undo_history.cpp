@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -38,6 +38,10 @@
 
 #include "undo_history.xml.h"
 
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+
 namespace app {
 
 using namespace app::skin;
@@ -59,11 +63,50 @@ public:
       m_doc = doc;
       m_undoHistory = history;
 
+      resetStates();
       updateSavedState();
 
       invalidate();
     }
 
+    // Called when a new state is added at the end of the history.
+    void addState(const undo::UndoState* state) {
+      if (!m_statesOk)
+        return;
+
+      if (state->prev() == (m_states.empty() ? nullptr: m_states.back())) {
+        m_statesIndex[state] = m_statesBase + int(m_states.size());
+        m_states.push_back(state);
+      }
+      else
+        resetStates();
+    }
+
+    // Called when a state is deleted from the history, generally the
+    // last states (clearing the redo) or the first ones (undo limit).
+    void removeState(const undo::UndoState* state) {
+      if (!m_statesOk || m_states.empty())
+        return;
+
+      if (m_states.back() == state) {
+        m_statesIndex.erase(state);
+        m_states.pop_back();
+      }
+      else if (m_states.front() == state) {
+        m_statesIndex.erase(state);
+        m_states.pop_front();
+        ++m_statesBase;
+      }
+      else
+        resetStates();
+    }
+
+    // Number of rows including the "Initial State"
+    int rows() {
+      updateStates();
+      return int(m_states.size()) + 1;
+    }
+
     void selectState(const undo::UndoState* state) {
       auto view = ui::View::getView(this);
       if (!view)
@@ -72,22 +115,13 @@ public:
       invalidate();
 
       gfx::Point scroll = view->viewScroll();
-      if (state) {
+      const int row = rowOfState(state);
+      if (state && row >= 0) {
         const gfx::Rect vp = view->viewportBounds();
         const gfx::Rect bounds = this->bounds();
 
-        gfx::Rect itemBounds(bounds.x, bounds.y, bounds.w, m_itemHeight);
-
-        // Jump first "Initial State"
-        itemBounds.y += itemBounds.h;
-
-        const undo::UndoState* s = m_undoHistory->firstState();
-        while (s) {
-          if (s == state)
-            break;
-          itemBounds.y += itemBounds.h;
-          s = s->next();
-        }
+        gfx::Rect itemBounds(bounds.x, bounds.y + row*m_itemHeight,
+                             bounds.w, m_itemHeight);
 
         if (itemBounds.y < vp.y)
           scroll.y = itemBounds.y - bounds.y;
@@ -146,24 +180,14 @@ public:
 
             // Mouse position in client coordinates
             const gfx::Point mousePos = mouseMsg->position();
-            gfx::Rect itemBounds(bounds.x, bounds.y, bounds.w, m_itemHeight);
-
-            // First state
-            if (itemBounds.contains(mousePos)) {
-              Change(nullptr);
+            if (mousePos.x < bounds.x || mousePos.x >= bounds.x2() ||
+                mousePos.y < bounds.y)
               break;
-            }
-            itemBounds.y += itemBounds.h;
 
-            const undo::UndoState* state = m_undoHistory->firstState();
-            while (state) {
-              if (itemBounds.contains(mousePos)) {
-                Change(state);
-                break;
-              }
-              itemBounds.y += itemBounds.h;
-              state = state->next();
-            }
+            // The first row is the "Initial State" (nullptr)
+            const int row = (mousePos.y - bounds.y) / m_itemHeight;
+            if (row < rows())
+              Change(stateAtRow(row));
           }
           break;
 
@@ -258,47 +282,84 @@ public:
       if (!m_undoHistory)
         return;
 
-      const undo::UndoState* currentState = m_undoHistory->currentState();
-      gfx::Rect itemBounds(bounds.x, bounds.y, bounds.w, m_itemHeight);
+      // Paint only the visible rows
+      const gfx::Rect clip = g->getClipBounds() & bounds;
+      if (clip.isEmpty())
+        return;
 
-      // First state
-      {
-        const bool selected = (currentState == nullptr);
-        paintItem(g, theme, nullptr, itemBounds, selected);
-        itemBounds.y += itemBounds.h;
-      }
+      const int nrows = rows();
+      const int firstRow = std::max(0, (clip.y - bounds.y) / m_itemHeight);
+      const int lastRow = std::min(nrows-1, (clip.y2() - 1 - bounds.y) / m_itemHeight);
 
-      const undo::UndoState* state = m_undoHistory->firstState();
-      while (state) {
+      const undo::UndoState* currentState = m_undoHistory->currentState();
+      gfx::Rect itemBounds(bounds.x, bounds.y + firstRow*m_itemHeight,
+                           bounds.w, m_itemHeight);
+
+      for (int row=firstRow; row<=lastRow; ++row) {
+        const undo::UndoState* state = stateAtRow(row);
         const bool selected = (state == currentState);
         paintItem(g, theme, state, itemBounds, selected);
         itemBounds.y += itemBounds.h;
-        state = state->next();
       }
     }
 
     void onSizeHint(ui::SizeHintEvent& ev) override {
-      if (m_window->m_nitems == 0) {
-        int size = 0;
-        if (m_undoHistory) {
-          ++size;
-          const undo::UndoState* state = m_undoHistory->firstState();
-          while (state) {
-            ++size;
-            state = state->next();
-          }
+      ev.setSizeHint(gfx::Size(1, m_itemHeight * (m_undoHistory ? rows(): 0)));
+    }
+
+  private:
+    void resetStates() {
+      m_states.clear();
+      m_statesIndex.clear();
+      m_statesBase = 0;
+      m_statesOk = false;
+    }
+
+    // Creates the list of states to access them by row (it's created
+    // only once for each history, and then it's updated with
+    // addState()/removeState()).
+    void updateStates() {
+      if (m_statesOk)
+        return;
+
+      if (m_undoHistory) {
+        const undo::UndoState* state = m_undoHistory->firstState();
+        while (state) {
+          m_statesIndex[state] = int(m_states.size());
+          m_states.push_back(state);
+          state = state->next();
         }
-        m_window->m_nitems = size;
       }
-      ev.setSizeHint(gfx::Size(1, m_itemHeight * m_window->m_nitems));
+      m_statesOk = true;
+    }
+
+    const undo::UndoState* stateAtRow(const int row) {
+      updateStates();
+      if (row < 1 || row > int(m_states.size()))
+        return nullptr;
+      return m_states[row-1];
+    }
+
+    // Returns -1 if the state isn't in the list
+    int rowOfState(const undo::UndoState* state) {
+      if (!state)
+        return 0;
+
+      updateStates();
+      auto it = m_statesIndex.find(state);
+      if (it == m_statesIndex.end())
+        return -1;
+      return it->second - m_statesBase + 1;
     }
 
-  private:
     void paintItem(ui::Graphics* g,
                    SkinTheme* theme,
                    const undo::UndoState* state,
                    const gfx::Rect& itemBounds,
                    const bool selected) {
+      if ((g->getClipBounds() & itemBounds).isEmpty())
+        return;
+
       const std::string itemText =
         (state ? static_cast<Cmd*>(state->cmd())->label()
 #if _DEBUG
@@ -306,9 +367,6 @@ public:
 #endif
          : std::string("Initial State"));
 
-      if ((g->getClipBounds() & itemBounds).isEmpty())
-        return;
-
       auto style = theme->styles.listItem();
       if (m_isAssociatedToFile && m_savedState == state) {
         style = theme->styles.undoSavedItem();
@@ -326,6 +384,15 @@ public:
     bool m_isAssociatedToFile = false;
     const undo::UndoState* m_savedState = nullptr;
     int m_itemHeight;
+
+    // States of the history indexed by row (the first row is the
+    // "Initial State"). m_statesIndex contains the index of each
+    // state plus m_statesBase, which is incremented when the first
+    // states are deleted.
+    std::deque<const undo::UndoState*> m_states;
+    std::unordered_map<const undo::UndoState*, int> m_statesIndex;
+    int m_statesBase = 0;
+    bool m_statesOk = false;
   };
 
   UndoHistoryWindow(Context* ctx)
@@ -407,8 +474,7 @@ private:
   void onAddUndoState(DocUndo* history) override {
     ASSERT(history->currentState());
 
-    ++m_nitems;
-
+    m_actions.addState(history->lastState());
     m_actions.updateSavedState();
     m_actions.invalidate();
     view()->updateView();
@@ -418,8 +484,8 @@ private:
 
   void onDeleteUndoState(DocUndo* history,
                          undo::UndoState* state) override {
+    m_actions.removeState(state);
     m_actions.updateSavedState();
-    --m_nitems;
   }
 
   void onCurrentUndoStateChange(DocUndo* history) override {
@@ -430,7 +496,11 @@ private:
   }
 
   void onClearRedo(DocUndo* history) override {
-    setUndoHistory(history);
+    // The deleted states were already removed from the list in
+    // onDeleteUndoState()
+    m_actions.invalidate();
+    view()->updateView();
+    selectCurrentState();
   }
 
   void onTotalUndoSizeChange(DocUndo* history) override {
@@ -469,7 +539,6 @@ private:
   }
 
   void setUndoHistory(DocUndo* history) {
-    m_nitems = 0;
     m_actions.setUndoHistory(m_doc, history);
     view()->updateView();
 
@@ -498,7 +567,6 @@ private:
   doc::frame_t m_frame;
   std::string m_title;
   ActionsList m_actions;
-  int m_nitems = 0;
 };
 
 class UndoHistoryCommand : public Command {
@@ -13,6 +13,7 @@ FOR_EACH_COMMAND(CanvasSize)
 FOR_EACH_COMMAND(CelOpacity)
 FOR_EACH_COMMAND(ChangePixelFormat)
 FOR_EACH_COMMAND(ColorCurve)
+FOR_EACH_COMMAND(ColorLut)
 FOR_EACH_COMMAND(ColorQuantization)
 FOR_EACH_COMMAND(ConvertLayer)
 FOR_EACH_COMMAND(ConvolutionMatrix)
@@ -25,6 +26,7 @@ FOR_EACH_COMMAND(Despeckle)
 FOR_EACH_COMMAND(ExportSpriteSheet)
 FOR_EACH_COMMAND(ExportTileset)
 FOR_EACH_COMMAND(Fill)
+FOR_EACH_COMMAND(FilterChain)
 FOR_EACH_COMMAND(FlattenLayers)
 FOR_EACH_COMMAND(Flip)
 FOR_EACH_COMMAND(HueSaturation)
@@ -0,0 +1,104 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/commands/command.h"
+#include "app/commands/filters/filter_manager_impl.h"
+#include "app/commands/filters/filter_worker.h"
+#include "app/commands/new_params.h"
+#include "app/context.h"
+#include "app/file_selector.h"
+#include "app/i18n/strings.h"
+#include "filters/color_lut.h"
+#include "filters/color_lut_filter.h"
+#include "fmt/format.h"
+#include "ui/alert.h"
+
+namespace app {
+
+using namespace filters;
+
+struct ColorLutParams : public NewParams {
+  Param<filters::Target> channels { this, 0, "channels" };
+  Param<std::string> filename { this, std::string(), "filename" };
+  // "tetrahedral" or "trilinear"
+  Param<std::string> interpolation { this, "tetrahedral", "interpolation" };
+};
+
+// Applies a 3D LUT loaded from a .cube file
+class ColorLutCommand : public CommandWithNewParams<ColorLutParams> {
+public:
+  ColorLutCommand();
+
+protected:
+  bool onEnabled(Context* context) override;
+  void onExecute(Context* context) override;
+};
+
+ColorLutCommand::ColorLutCommand()
+  : CommandWithNewParams<ColorLutParams>(CommandId::ColorLut(), CmdRecordableFlag)
+{
+}
+
+bool ColorLutCommand::onEnabled(Context* context)
+{
+  return context->checkFlags(ContextFlags::ActiveDocumentIsWritable |
+                             ContextFlags::HasActiveSprite);
+}
+
+void ColorLutCommand::onExecute(Context* context)
+{
+  std::string filename = params().filename();
+#ifdef ENABLE_UI
+  if (filename.empty() && context->isUIAvailable()) {
+    base::paths exts = { "cube" };
+    base::paths filenames;
+    if (app::show_file_selector(
+          Strings::color_lut_title(), "", exts,
+          FileSelectorType::Open, filenames)) {
+      filename = filenames.front();
+    }
+  }
+#endif // ENABLE_UI
+
+  // Do nothing
+  if (filename.empty())
+    return;
+
+  std::shared_ptr<ColorLut> lut = ColorLut::loadCube(filename);
+  if (!lut) {
+    if (context->isUIAvailable())
+      ui::Alert::show(fmt::format(Strings::alerts_error_loading_file(), filename));
+    return;
+  }
+
+  ColorLutFilter filter;
+  filter.setLut(lut);
+  if (params().interpolation() == "trilinear")
+    filter.setInterpolation(ColorLutFilter::Interpolation::Trilinear);
+
+  FilterManagerImpl filterMgr(context, &filter);
+
+  filters::Target channels =
+    TARGET_RED_CHANNEL |
+    TARGET_GREEN_CHANNEL |
+    TARGET_BLUE_CHANNEL |
+    TARGET_GRAY_CHANNEL;
+  if (params().channels.isSet()) channels = params().channels();
+  filterMgr.setTarget(channels);
+
+  start_filter_worker(&filterMgr);
+}
+
+Command* CommandFactory::createColorLutCommand()
+{
+  return new ColorLutCommand;
+}
+
+} // namespace app
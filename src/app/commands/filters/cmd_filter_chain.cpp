@@ -0,0 +1,174 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/color.h"
+#include "app/color_utils.h"
+#include "app/commands/command.h"
+#include "app/commands/filters/filter_manager_impl.h"
+#include "app/commands/filters/filter_worker.h"
+#include "app/commands/new_params.h"
+#include "app/context.h"
+#include "app/site.h"
+#include "doc/sprite.h"
+#include "filters/brightness_contrast_filter.h"
+#include "filters/color_curve_filter.h"
+#include "filters/color_lut.h"
+#include "filters/color_lut_filter.h"
+#include "filters/filter_chain.h"
+#include "filters/hue_saturation_filter.h"
+#include "filters/invert_color_filter.h"
+#include "filters/replace_color_filter.h"
+
+namespace app {
+
+using namespace filters;
+using Mode = filters::HueSaturationFilter::Mode;
+
+// Parameters of each filter (with the same names used in their
+// commands). A filter is included in the chain only if one of its
+// parameters is specified.
+struct FilterChainParams : public NewParams {
+  Param<filters::Target> channels { this, 0, "channels" };
+  // BrightnessContrast
+  Param<double> brightness { this, 0.0, "brightness" };
+  Param<double> contrast { this, 0.0, "contrast" };
+  // HueSaturation
+  Param<Mode> mode { this, Mode::HSL_MUL, "mode" };
+  Param<double> hue { this, 0.0, "hue" };
+  Param<double> saturation { this, 0.0, "saturation" };
+  Param<double> lightness { this, 0.0, { "lightness", "value" } };
+  Param<double> alpha { this, 0.0, "alpha" };
+  // ColorCurve
+  Param<filters::ColorCurve> curve { this, filters::ColorCurve(), "curve" };
+  // ReplaceColor
+  Param<app::Color> from { this, app::Color(), "from" };
+  Param<app::Color> to { this, app::Color(), "to" };
+  Param<int> tolerance { this, 0, "tolerance" };
+  // InvertColor
+  Param<bool> invert { this, false, "invert" };
+  // Bakes the RGB channels of the chain in a 3D LUT of the given size
+  // to apply it (faster for big images or a lot of frames), and/or
+  // saves the LUT in a .cube file.
+  Param<int> lutSize { this, 0, "lutSize" };
+  Param<std::string> saveLut { this, std::string(), "saveLut" };
+};
+
+// Applies several color filters in just one pass and one undo step
+// (in this order: brightness/contrast, hue/saturation, color curve,
+// replace color, invert color).
+class FilterChainCommand : public CommandWithNewParams<FilterChainParams> {
+public:
+  FilterChainCommand();
+
+protected:
+  bool onEnabled(Context* context) override;
+  void onExecute(Context* context) override;
+};
+
+FilterChainCommand::FilterChainCommand()
+  : CommandWithNewParams<FilterChainParams>(CommandId::FilterChain(), CmdRecordableFlag)
+{
+}
+
+bool FilterChainCommand::onEnabled(Context* context)
+{
+  return context->checkFlags(ContextFlags::ActiveDocumentIsWritable |
+                             ContextFlags::HasActiveSprite);
+}
+
+void FilterChainCommand::onExecute(Context* context)
+{
+  const Site site = context->activeSite();
+  const FilterChainParams& p = params();
+
+  // Default channels of each filter (as in their commands) when the
+  // channels aren't specified
+  const bool channels = p.channels.isSet();
+  auto target = [channels](const Target defaultTarget) -> Target {
+    return (channels ? TARGET_ALL_CHANNELS | TARGET_INDEX_CHANNEL:
+                       defaultTarget);
+  };
+  const Target rgb =
+    TARGET_RED_CHANNEL |
+    TARGET_GREEN_CHANNEL |
+    TARGET_BLUE_CHANNEL |
+    TARGET_GRAY_CHANNEL;
+
+  FilterChain chain;
+
+  BrightnessContrastFilter brightnessContrast;
+  if (p.brightness.isSet() || p.contrast.isSet()) {
+    if (p.brightness.isSet()) brightnessContrast.setBrightness(p.brightness() / 100.0);
+    if (p.contrast.isSet()) brightnessContrast.setContrast(p.contrast() / 100.0);
+    chain.addFilter(&brightnessContrast, target(rgb | TARGET_ALPHA_CHANNEL));
+  }
+
+  HueSaturationFilter hueSaturation;
+  if (p.hue.isSet() || p.saturation.isSet() ||
+      p.lightness.isSet() || p.alpha.isSet()) {
+    if (p.mode.isSet()) hueSaturation.setMode(p.mode());
+    if (p.hue.isSet()) hueSaturation.setHue(p.hue());
+    if (p.saturation.isSet()) hueSaturation.setSaturation(p.saturation() / 100.0);
+    if (p.lightness.isSet()) hueSaturation.setLightness(p.lightness() / 100.0);
+    if (p.alpha.isSet()) hueSaturation.setAlpha(p.alpha() / 100.0);
+    chain.addFilter(&hueSaturation, target(rgb | TARGET_ALPHA_CHANNEL));
+  }
+
+  ColorCurveFilter colorCurve;
+  if (p.curve.isSet()) {
+    colorCurve.setCurve(p.curve());
+    chain.addFilter(&colorCurve, target(rgb));
+  }
+
+  ReplaceColorFilter replaceColor;
+  if (p.from.isSet() || p.to.isSet()) {
+    if (site.layer()) {
+      replaceColor.setFrom(color_utils::color_for_layer(p.from(), site.layer()));
+      replaceColor.setTo(color_utils::color_for_layer(p.to(), site.layer()));
+    }
+    if (p.tolerance.isSet()) replaceColor.setTolerance(p.tolerance());
+    chain.addFilter(&replaceColor,
+                    target(site.sprite()->pixelFormat() == IMAGE_INDEXED ?
+                           TARGET_INDEX_CHANNEL:
+                           rgb | TARGET_ALPHA_CHANNEL));
+  }
+
+  InvertColorFilter invertColor;
+  if (p.invert())
+    chain.addFilter(&invertColor, target(rgb));
+
+  if (chain.empty())
+    return;
+
+  Filter* filter = &chain;
+  ColorLutFilter lutFilter;
+  if (p.lutSize() > 0 || !p.saveLut().empty()) {
+    std::shared_ptr<ColorLut> lut =
+      ColorLut::bake(&chain, (p.lutSize() > 0 ? p.lutSize(): 33));
+    if (!p.saveLut().empty())
+      lut->saveCube(p.saveLut());
+    if (p.lutSize() > 0) {
+      lutFilter.setLut(lut);
+      filter = &lutFilter;
+    }
+  }
+
+  FilterManagerImpl filterMgr(context, filter);
+  filterMgr.setTarget(channels ? p.channels():
+                                 TARGET_ALL_CHANNELS | TARGET_INDEX_CHANNEL);
+  start_filter_worker(&filterMgr);
+}
+
+Command* CommandFactory::createFilterChainCommand()
+{
+  return new FilterChainCommand;
+}
+
+} // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -33,14 +33,19 @@
 #include "doc/cel.h"
 #include "doc/cels_range.h"
 #include "doc/image.h"
+#include "doc/image_buffer_pool.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
 #include "doc/sprite.h"
 #include "filters/filter.h"
+#include "perf/trace.h"
+#include "sched/task_group.h"
 #include "ui/manager.h"
 #include "ui/view.h"
 #include "ui/widget.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
 #include <set>
@@ -50,6 +55,78 @@ namespace app {
 using namespace std;
 using namespace ui;
 
+namespace {
+
+// Rows of a cel processed by each task when the filter is applied in
+// parallel.
+constexpr int kRowsPerBand = 32;
+
+#ifdef ENABLE_UI
+// Rows of the low resolution preview and minimum number of pixels in
+// the preview area to use it.
+constexpr int kPreviewStep = 4;
+constexpr int kPreviewStepMinArea = 256*256;
+#endif
+
+} // anonymous namespace
+
+class FilterManagerImpl::RowBand : public FilterManager {
+public:
+  RowBand(FilterManagerImpl* mgr,
+          const Image* src, Image* dst,
+          const Target target)
+    : m_mgr(mgr)
+    , m_src(src)
+    , m_dst(dst)
+    , m_target(target)
+    , m_row(0) {
+  }
+
+  // Applies the filter to rows [row1, row2)
+  void apply(const int row1, const int row2) {
+    Filter* filter = m_mgr->m_filter;
+    const PixelFormat format = pixelFormat();
+
+    for (m_row=row1; m_row<row2; ++m_row) {
+      if (!m_mgr->calcRowSpans(m_row, m_spans))
+        break;
+
+      switch (format) {
+        case IMAGE_RGB:       filter->applyToRgba(this); break;
+        case IMAGE_GRAYSCALE: filter->applyToGrayscale(this); break;
+        case IMAGE_INDEXED:   filter->applyToIndexed(this); break;
+      }
+    }
+  }
+
+  // FilterManager implementation
+  doc::PixelFormat pixelFormat() const override { return m_mgr->pixelFormat(); }
+  const void* getSourceAddress() override {
+    return m_src->getPixelAddress(m_mgr->m_bounds.x, m_mgr->m_bounds.y+m_row);
+  }
+  void* getDestinationAddress() override {
+    return m_dst->getPixelAddress(m_mgr->m_bounds.x, m_mgr->m_bounds.y+m_row);
+  }
+  int getWidth() override { return m_mgr->m_bounds.w; }
+  Target getTarget() override { return m_target; }
+  FilterIndexedData* getIndexedData() override { return m_mgr; }
+  const Spans& getRowSpans() override { return m_spans; }
+  const doc::Image* getSourceImage() override { return m_src; }
+  int x() const override { return m_mgr->m_bounds.x; }
+  int y() const override { return m_mgr->m_bounds.y+m_row; }
+  bool isFirstRow() const override { return m_row == 0; }
+  bool isMaskActive() const override { return m_mgr->isMaskActive(); }
+  base::task_token& taskToken() const override { return m_mgr->taskToken(); }
+
+private:
+  FilterManagerImpl* m_mgr;
+  const Image* m_src;
+  Image* m_dst;
+  Target m_target;
+  int m_row;
+  Spans m_spans;
+};
+
 FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   : m_reader(context)
   , m_site(*const_cast<Site*>(m_reader.site()))
@@ -58,6 +135,13 @@ FilterManagerImpl::FilterManagerImpl(Context* context, Filter* filter)
   , m_src(nullptr)
   , m_dst(nullptr)
   , m_row(0)
+  , m_previewStep(1)
+  , m_refining(false)
+#ifdef ENABLE_UI
+  , m_dirtyBegin(0)
+  , m_dirtyEnd(0)
+  , m_flushed(false)
+#endif
   , m_mask(nullptr)
   , m_previewMask(nullptr)
   , m_targetOrig(TARGET_ALL_CHANNELS)
@@ -121,6 +205,8 @@ void FilterManagerImpl::begin()
   Doc* document = m_site.document();
 
   m_row = 0;
+  m_previewStep = 1;
+  m_refining = false;
   m_mask = (document->isMaskVisible() ? document->mask(): nullptr);
   m_taskToken = &m_noToken; // Don't use the preview token (which can be canceled)
   updateBounds(m_mask);
@@ -139,7 +225,11 @@ void FilterManagerImpl::beginForPreview()
     m_previewMask->replace(m_site.sprite()->bounds());
   }
 
-  m_row = m_nextRowToFlush = 0;
+  m_row = 0;
+  m_previewStep = 1;
+  m_refining = false;
+  m_dirtyBegin = m_dirtyEnd = 0;
+  m_flushed = false;
   m_mask = m_previewMask.get();
 
   // If we have a tiled mode enabled, we'll apply the filter to the whole areaes
@@ -164,34 +254,37 @@ void FilterManagerImpl::beginForPreview()
     m_row = -1;
     return;
   }
+
+  if (m_bounds.w * m_bounds.h >= kPreviewStepMinArea)
+    m_previewStep = kPreviewStep;
 }
 
 #endif // ENABLE_UI
 
 void FilterManagerImpl::end()
 {
-  m_maskBits.unlock();
+  m_spans.clear();
 }
 
 bool FilterManagerImpl::applyStep()
 {
-  if (m_row < 0 || m_row >= m_bounds.h)
+  if (m_row < 0)
     return false;
 
-  if (m_mask && m_mask->bitmap()) {
-    int x = m_bounds.x - m_mask->bounds().x;
-    int y = m_bounds.y - m_mask->bounds().y + m_row;
-    if ((x >= m_bounds.w) ||
-        (y >= m_bounds.h))
+  if (m_row >= m_bounds.h) {
+    // Start the full quality pass of the preview (the rows of the
+    // first pass are already done)
+    if (m_previewStep > 1 && !m_refining && m_bounds.h > 1) {
+      m_refining = true;
+      m_row = 1;
+    }
+    else
       return false;
-
-    m_maskBits = m_mask->bitmap()
-      ->lockBits<BitmapTraits>(Image::ReadLock,
-        gfx::Rect(x, y, m_bounds.w - x, m_bounds.h - y));
-
-    m_maskIterator = m_maskBits.begin();
   }
 
+  if (!calcRowSpans(m_row, m_spans))
+    return false;
+
   if (m_row == 0) {
     applyToPaletteIfNeeded();
   }
@@ -201,13 +294,56 @@ bool FilterManagerImpl::applyStep()
     case IMAGE_GRAYSCALE: m_filter->applyToGrayscale(this); break;
     case IMAGE_INDEXED:   m_filter->applyToIndexed(this); break;
   }
-  ++m_row;
+
+  int rows = 1;
+  if (m_previewStep > 1 && !m_refining) {
+    rows = std::min(m_previewStep, m_bounds.h - m_row);
+    copyRowToNextRows(rows);
+  }
+
+#ifdef ENABLE_UI
+  if (m_dirtyBegin >= m_dirtyEnd) {
+    m_dirtyBegin = m_row;
+    m_dirtyEnd = m_row + rows;
+  }
+  else {
+    m_dirtyBegin = std::min(m_dirtyBegin, m_row);
+    m_dirtyEnd = std::max(m_dirtyEnd, m_row + rows);
+  }
+#endif
+
+  if (m_refining) {
+    ++m_row;
+    if (m_row % m_previewStep == 0)
+      ++m_row;
+  }
+  else
+    m_row += rows;
 
   return true;
 }
 
+// Copies the destination pixels of the current row to the following
+// "rows"-1 rows (only selected pixels) for the low resolution
+// preview.
+void FilterManagerImpl::copyRowToNextRows(const int rows)
+{
+  const uint8_t* row = (const uint8_t*)getDestinationAddress();
+  const int bpp = m_dst->getRowStrideSize(1);
+
+  Spans spans;
+  for (int i=1; i<rows; ++i) {
+    uint8_t* dst = m_dst->getPixelAddress(m_bounds.x, m_bounds.y+m_row+i);
+    if (!calcRowSpans(m_row+i, spans))
+      break;
+    for (const Span& span : spans)
+      std::memcpy(dst + span.x*bpp, row + span.x*bpp, span.w*bpp);
+  }
+}
+
 void FilterManagerImpl::apply()
 {
+  PERF_ZONE("FilterManagerImpl::apply");
   CommandResult result;
   bool cancelled = false;
 
@@ -223,44 +359,7 @@ void FilterManagerImpl::apply()
   }
 
   if (!cancelled) {
-    gfx::Rect output;
-    if (algorithm::shrink_bounds2(m_src.get(), m_dst.get(),
-                                  m_bounds, output)) {
-      if (m_cel->layer()->isTilemap()) {
-        modify_tilemap_cel_region(
-          *m_tx,
-          m_cel, nullptr,
-          gfx::Region(output),
-          m_site.tilesetMode(),
-          [this](const doc::ImageRef& origTile,
-                 const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
-            return ImageRef(
-              crop_image(m_dst.get(),
-                         tileBoundsInCanvas.x,
-                         tileBoundsInCanvas.y,
-                         tileBoundsInCanvas.w,
-                         tileBoundsInCanvas.h,
-                         m_dst->maskColor()));
-          });
-      }
-      else if (m_cel->layer()->isBackground()) {
-        (*m_tx)(
-          new cmd::CopyRegion(
-            m_cel->image(),
-            m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-      else {
-        // Patch "m_cel"
-        (*m_tx)(
-          new cmd::PatchCel(
-            m_cel, m_dst.get(),
-            gfx::Region(output),
-            position()));
-      }
-    }
-
+    patchCel(m_cel, m_src, m_dst);
     result = CommandResult(CommandResult::kOk);
   }
   else {
@@ -271,6 +370,131 @@ void FilterManagerImpl::apply()
   m_reader.context()->setCommandResult(result);
 }
 
+void FilterManagerImpl::patchCel(Cel* cel,
+                                 const ImageRef& src,
+                                 const ImageRef& dst)
+{
+  gfx::Rect output;
+  if (!algorithm::shrink_bounds2(src.get(), dst.get(),
+                                 m_bounds, output))
+    return;
+
+  if (cel->layer()->isTilemap()) {
+    modify_tilemap_cel_region(
+      *m_tx,
+      cel, nullptr,
+      gfx::Region(output),
+      m_site.tilesetMode(),
+      [dst](const doc::ImageRef& origTile,
+            const gfx::Rect& tileBoundsInCanvas) -> doc::ImageRef {
+        return ImageRef(
+          crop_image(dst.get(),
+                     tileBoundsInCanvas.x,
+                     tileBoundsInCanvas.y,
+                     tileBoundsInCanvas.w,
+                     tileBoundsInCanvas.h,
+                     dst->maskColor()));
+      });
+  }
+  else if (cel->layer()->isBackground()) {
+    (*m_tx)(
+      new cmd::CopyRegion(
+        cel->image(),
+        dst.get(),
+        gfx::Region(output),
+        position()));
+  }
+  else {
+    // Patch "cel"
+    (*m_tx)(
+      new cmd::PatchCel(
+        cel, dst.get(),
+        gfx::Region(output),
+        position()));
+  }
+}
+
+bool FilterManagerImpl::canApplyInParallel() const
+{
+  // Indexed images use the sprite RgbMap, which is regenerated on
+  // demand and cannot be shared between threads.
+  return (m_filter->isParallelizable() &&
+          pixelFormat() != IMAGE_INDEXED &&
+          sched::Scheduler::instance().threads() > 1);
+}
+
+// Applies the filter to bands of rows of several cels at the same
+// time. Cels are processed in batches (to limit the memory used by
+// the source/destination copies), and the patches are added to the
+// transaction in the same order of the list when each batch is
+// finished.
+void FilterManagerImpl::applyToCelsInParallel(const CelList& cels)
+{
+  PERF_ZONE("FilterManagerImpl::applyToCelsInParallel");
+
+  struct CelJob {
+    Cel* cel;
+    ImageRef src;
+    ImageRef dst;
+    Target target;
+  };
+
+  const size_t batchSize =
+    2 * std::max(1, sched::Scheduler::instance().threads());
+  std::atomic<int> rowsDone(0);
+  std::atomic<bool> cancelled(false);
+  int totalRows = 0;
+
+  for (size_t i=0; i<cels.size() && !cancelled; i+=batchSize) {
+    std::vector<CelJob> jobs;
+    for (size_t j=i; j<std::min(i+batchSize, cels.size()); ++j) {
+      init(cels[j]);
+      begin();
+      jobs.push_back(CelJob{ m_cel, m_src, m_dst, m_target });
+    }
+    if (i == 0)
+      totalRows = int(cels.size()) * m_bounds.h;
+
+    // The palette is modified from this thread (as in applyStep()
+    // with the first row) so the tasks can only read it.
+    applyToPaletteIfNeeded();
+
+    {
+      sched::TaskGroup tasks(sched::Priority::Interactive);
+      for (const CelJob& job : jobs) {
+        for (int row=0; row<m_bounds.h; row+=kRowsPerBand) {
+          const int row2 = std::min(row+kRowsPerBand, m_bounds.h);
+          tasks.run([this, &job, &rowsDone, &cancelled, row, row2, totalRows]{
+            if (cancelled)
+              return;
+
+            RowBand band(this, job.src.get(), job.dst.get(), job.target);
+            band.apply(row, row2);
+
+            const int done = (rowsDone += row2 - row);
+            if (m_progressDelegate) {
+              m_progressDelegate->reportProgress(float(done) / totalRows);
+              if (m_progressDelegate->isCancelled())
+                cancelled = true;
+            }
+          });
+        }
+      }
+      tasks.wait();
+    }
+
+    if (!cancelled) {
+      for (const CelJob& job : jobs)
+        patchCel(job.cel, job.src, job.dst);
+    }
+  }
+
+  ASSERT(m_reader.context());
+  m_reader.context()->setCommandResult(
+    CommandResult(cancelled ? CommandResult::kCanceled:
+                              CommandResult::kOk));
+}
+
 void FilterManagerImpl::applyToTarget()
 {
   applyToPaletteIfNeeded();
@@ -316,6 +540,9 @@ void FilterManagerImpl::applyToTarget()
 
   std::set<ObjectId> visited;
 
+  // Deliver the notifications of all cels at the end
+  Doc::NotificationsBatch batch(document());
+
   // Palette change
   if (paletteChange) {
     Palette newPalette = *getNewPalette();
@@ -325,6 +552,18 @@ void FilterManagerImpl::applyToTarget()
                           m_site.frame(), &newPalette));
   }
 
+  if (canApplyInParallel()) {
+    CelList uniqueCels;
+    for (Cel* cel : cels) {
+      // Avoid applying the filter two times to the same image
+      if (visited.insert(cel->image()->id()).second)
+        uniqueCels.push_back(cel);
+    }
+    if (!uniqueCels.empty())
+      applyToCelsInParallel(uniqueCels);
+    cels.clear();
+  }
+
   // For each target image
   for (auto it = cels.begin();
        it != cels.end() && !cancelled;
@@ -376,23 +615,23 @@ void FilterManagerImpl::commitTransaction()
 
 void FilterManagerImpl::flush()
 {
-  int h = m_row - m_nextRowToFlush;
+  int h = m_dirtyEnd - m_dirtyBegin;
 
   if (m_row >= 0 && h > 0) {
     // Redraw the color palette
-    if (m_nextRowToFlush == 0 && paletteHasChanged())
+    if (!m_flushed && paletteHasChanged())
       redrawColorPalette();
 
     for (Editor* editor : UIContext::instance()->getAllEditorsIncludingPreview(document())) {
       // We expand the region one pixel at the top and bottom of the
-      // region [m_row,m_nextRowToFlush) to be updated on the screen to
+      // region [m_dirtyBegin,m_dirtyEnd) to be updated on the screen to
       // avoid screen artifacts when we apply filters like convolution
       // matrices.
       gfx::Rect rect(
         editor->editorToScreen(
           gfx::Point(
             m_bounds.x,
-            m_bounds.y+m_nextRowToFlush-1)),
+            m_bounds.y+m_dirtyBegin-1)),
         gfx::Size(
           editor->projection().applyX(m_bounds.w),
           (editor->projection().scaleY() >= 1 ? editor->projection().applyY(h+2):
@@ -408,7 +647,8 @@ void FilterManagerImpl::flush()
       editor->invalidateRegion(reg1);
     }
 
-    m_nextRowToFlush = m_row+1;
+    m_dirtyBegin = m_dirtyEnd = 0;
+    m_flushed = true;
   }
 }
 
@@ -436,20 +676,6 @@ void* FilterManagerImpl::getDestinationAddress()
   return m_dst->getPixelAddress(m_bounds.x, m_bounds.y+m_row);
 }
 
-bool FilterManagerImpl::skipPixel()
-{
-  bool skip = false;
-
-  if ((m_mask) && (m_mask->bitmap())) {
-    if (!*m_maskIterator)
-      skip = true;
-
-    ++m_maskIterator;
-  }
-
-  return skip;
-}
-
 const Palette* FilterManagerImpl::getPalette() const
 {
   if (m_oldPalette)
@@ -485,7 +711,12 @@ void FilterManagerImpl::init(Cel* cel)
 
   m_cel = cel;
   m_src = crop_cel_image(cel, 0);
-  m_dst.reset(Image::createCopy(m_src.get()));
+  // The destination is a temporary copy (only the modified region is
+  // patched in the cel), so it uses the memory of previous copies
+  // (e.g. from the previous preview or from the previous batch of
+  // cels) when it's possible.
+  m_dst.reset(Image::createCopy(m_src.get(),
+                                get_pooled_image_buffer(m_src->spec())));
 
   m_row = -1;
   m_mask = nullptr;
@@ -518,6 +749,55 @@ bool FilterManagerImpl::updateBounds(doc::Mask* mask)
   return !m_bounds.isEmpty();
 }
 
+// Calculates the runs of selected pixels of the given row reading the
+// mask bitmap 8 pixels at a time in completely empty/selected bytes.
+bool FilterManagerImpl::calcRowSpans(const int row, Spans& spans) const
+{
+  spans.clear();
+
+  if (!m_mask || !m_mask->bitmap()) {
+    spans.push_back(Span{ 0, m_bounds.w });
+    return true;
+  }
+
+  const Image* bitmap = m_mask->bitmap();
+  const int x = m_bounds.x - m_mask->bounds().x;
+  const int y = m_bounds.y - m_mask->bounds().y + row;
+  if ((x >= m_bounds.w) ||
+      (y >= m_bounds.h) ||
+      (y < 0 || y >= bitmap->height()))
+    return false;
+
+  const int x2 = std::min(x + m_bounds.w, bitmap->width());
+  const uint8_t* address = bitmap->getPixelAddress(0, y);
+  int begin = -1;               // First pixel of the current span
+  for (int i=std::max(0, x); i<x2; ) {
+    const uint8_t byte = address[i / 8];
+    if ((i % 8) == 0 && i+8 <= x2 && (byte == 0 || byte == 0xff)) {
+      if (byte == 0 && begin >= 0) {
+        spans.push_back(Span{ begin - x, i - begin });
+        begin = -1;
+      }
+      else if (byte == 0xff && begin < 0)
+        begin = i;
+      i += 8;
+      continue;
+    }
+
+    const bool selected = ((byte & (1 << (i % 8))) != 0);
+    if (selected && begin < 0)
+      begin = i;
+    else if (!selected && begin >= 0) {
+      spans.push_back(Span{ begin - x, i - begin });
+      begin = -1;
+    }
+    ++i;
+  }
+  if (begin >= 0)
+    spans.push_back(Span{ begin - x, x2 - begin });
+  return true;
+}
+
 bool FilterManagerImpl::paletteHasChanged()
 {
   return
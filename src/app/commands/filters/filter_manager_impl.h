@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,7 @@
 #include "app/tx.h"
 #include "base/exception.h"
 #include "base/task.h"
+#include "doc/cel_list.h"
 #include "doc/image_impl.h"
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
@@ -62,7 +63,8 @@ namespace app {
                           , public FilterIndexedData {
   public:
     // Interface to report progress to the user and take input from him
-    // to cancel the whole process.
+    // to cancel the whole process. Both functions can be called from
+    // worker threads when the filter is applied in parallel.
     class IProgressDelegate {   // TODO replace this with base::task_token
     public:
       virtual ~IProgressDelegate() { }
@@ -115,7 +117,7 @@ namespace app {
     int getWidth() override { return m_bounds.w; }
     Target getTarget() override { return m_target; }
     FilterIndexedData* getIndexedData() override { return this; }
-    bool skipPixel() override;
+    const Spans& getRowSpans() override { return m_spans; }
     const doc::Image* getSourceImage() override { return m_src.get(); }
     int x() const override { return m_bounds.x; }
     int y() const override { return m_bounds.y+m_row; }
@@ -130,10 +132,22 @@ namespace app {
     doc::PalettePicks getPalettePicks() override;
 
   private:
+    // FilterManager to apply the filter to a band of rows of one cel
+    // from a worker thread.
+    class RowBand;
+
     void init(doc::Cel* cel);
     void apply();
     void applyToCel(doc::Cel* cel);
     bool updateBounds(doc::Mask* mask);
+    void copyRowToNextRows(int rows);
+    bool calcRowSpans(int row, Spans& spans) const;
+    void patchCel(doc::Cel* cel, const doc::ImageRef& src, const doc::ImageRef& dst);
+
+    // Returns true if the m_filter can be applied to several bands
+    // of rows/cels at the same time (see applyToCelsInParallel()).
+    bool canApplyInParallel() const;
+    void applyToCelsInParallel(const doc::CelList& cels);
 
     // Returns true if the palette was changed (true when the filter
     // modifies the palette).
@@ -153,14 +167,22 @@ namespace app {
     doc::ImageRef m_src;
     doc::ImageRef m_dst;
     int m_row;
+    // The preview is calculated in two passes when m_previewStep > 1:
+    // first each m_previewStep-th row is filtered and copied to the
+    // following rows (a low resolution preview to show something
+    // quickly), and then the rest of rows are filtered (m_refining).
+    int m_previewStep;
+    bool m_refining;
 #ifdef ENABLE_UI
-    int m_nextRowToFlush;
+    // Rows modified since the last flush() [m_dirtyBegin, m_dirtyEnd)
+    int m_dirtyBegin;
+    int m_dirtyEnd;
+    bool m_flushed;
 #endif
     gfx::Rect m_bounds;
     doc::Mask* m_mask;
     std::unique_ptr<doc::Mask> m_previewMask;
-    doc::ImageBits<doc::BitmapTraits> m_maskBits;
-    doc::ImageBits<doc::BitmapTraits>::iterator m_maskIterator;
+    Spans m_spans;              // Selected pixels of the current row
     Target m_targetOrig;          // Original targets
     Target m_target;              // Filtered targets
     CelsTarget m_celsTarget;
@@ -19,13 +19,13 @@
 #include "app/ui/status_bar.h"
 #include "base/thread.h"
 #include "doc/sprite.h"
+#include "sched/task_group.h"
 #include "ui/ui.h"
 
 #include <cstdlib>
 #include <cstring>
 #include <functional>
 #include <mutex>
-#include <thread>
 
 namespace app {
 
@@ -136,11 +136,11 @@ void FilterWorker::run()
   m_filterMgr->initTransaction();
 
 #ifdef ENABLE_UI
-  std::thread thread;
+  sched::TaskGroup task(sched::Priority::Interactive);
   // Open the alert window in foreground (this is modal, locks the main thread)
   if (m_alert) {
-    // Launch the thread to apply the effect in background
-    thread = std::thread([this]{ applyFilterInBackground(); });
+    // Launch the task to apply the effect in background
+    task.run([this]{ applyFilterInBackground(); });
     m_alert->openAndWait();
   }
   else
@@ -159,9 +159,8 @@ void FilterWorker::run()
   }
 
 #ifdef ENABLE_UI
-  // Wait the `effect_bg' thread
-  if (thread.joinable())
-    thread.join();
+  // Wait the `effect_bg' task
+  task.wait();
 
   if (!m_error.empty()) {
     Console console;
@@ -237,6 +237,8 @@ void Param<doc::RgbMapAlgorithm>::fromString(const std::string& value)
     setValue(doc::RgbMapAlgorithm::OCTREE);
   else if (base::utf8_icmp(value, "rgb5a3") == 0)
     setValue(doc::RgbMapAlgorithm::RGB5A3);
+  else if (base::utf8_icmp(value, "kdtree") == 0)
+    setValue(doc::RgbMapAlgorithm::KDTREE);
   else
     setValue(doc::RgbMapAlgorithm::DEFAULT);
 }
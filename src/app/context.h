@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -101,7 +101,18 @@ namespace app {
     virtual bool isUIAvailable() const     { return false; }
     virtual bool isRecordingMacro() const  { return false; }
     virtual bool isExecutingMacro() const  { return false; }
-    virtual bool isExecutingScript() const { return false; }
+    virtual bool isExecutingScript() const { return m_executingScript > 0; }
+
+    // Used by the scripting API to indicate that commands are being
+    // executed from a script (so they cannot be finished later in
+    // the background).
+    class ExecutingScript {
+    public:
+      ExecutingScript(Context* ctx) : m_ctx(ctx) { ++m_ctx->m_executingScript; }
+      ~ExecutingScript() { --m_ctx->m_executingScript; }
+    private:
+      Context* m_ctx;
+    };
 
     bool checkFlags(uint32_t flags) const { return m_flags.check(flags); }
     void updateFlags() { m_flags.update(this); }
@@ -163,6 +174,9 @@ namespace app {
     // Result of the execution of a command.
     CommandResult m_result;
 
+    // Number of nested commands executed from scripts.
+    int m_executingScript = 0;
+
     DISABLE_COPYING(Context);
   };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "app/resource_finder.h"
 #include "base/fs.h"
 #include "base/time.h"
+#include "sched/task_group.h"
 #include "ui/system.h"
 
 #include <algorithm>
@@ -81,7 +82,7 @@ DataRecovery::DataRecovery(Context* ctx)
 DataRecovery::~DataRecovery()
 {
   g_stillAliveFlag = false;
-  m_thread.join();
+  m_task.wait();
 
   m_backup->stop();
   delete m_backup;
@@ -100,14 +101,13 @@ void DataRecovery::launchSearch()
   if (m_searching)
     return;
 
-  // Search current sessions in a background thread
-  if (m_thread.joinable())
-    m_thread.join();
+  // Search current sessions in a background task
+  m_task.wait();
 
   ASSERT(!m_searching);
   m_searching = true;
 
-  m_thread = std::thread(
+  m_task.run(
     [this]{
       searchForSessions();
       m_searching = false;
@@ -171,6 +171,16 @@ void DataRecovery::searchForSessions()
               return a->name() > b->name();
             });
 
+  // Read the information of all backups in this background task (so
+  // the UI thread doesn't have to read them from disk when the list
+  // of sessions is shown)
+  {
+    sched::TaskGroup tasks(sched::Priority::Background);
+    for (auto& session : sessions)
+      tasks.run([session]{ session->backups(); });
+    tasks.wait();
+  }
+
   // Assign m_sessions=sessions
   {
     std::unique_lock<std::mutex> lock(m_sessionsMutex);
@@ -13,10 +13,10 @@
 #include "app/crash/session.h"
 #include "base/disable_copying.h"
 #include "obs/signal.h"
+#include "sched/task_group.h"
 
 #include <atomic>
 #include <mutex>
-#include <thread>
 #include <vector>
 
 namespace app {
@@ -31,7 +31,7 @@ namespace crash {
     DataRecovery(Context* context);
     ~DataRecovery();
 
-    // Launches the thread to search for sessions.
+    // Launches a background task to search for sessions.
     void launchSearch();
 
     bool isSearching() const { return m_searching; }
@@ -45,18 +45,18 @@ namespace crash {
     // Returns a copy of the list of sessions that can be recovered.
     Sessions sessions();
 
-    // Triggered in the UI-thread from the m_thread using an
+    // Triggered in the UI-thread from the m_task using an
     // ui::execute_from_ui_thread() when the list of sessions is ready
     // to be used.
     obs::signal<void()> SessionsListIsReady;
 
   private:
-    // Executed from m_thread to search for the list of sessions.
+    // Executed from m_task to search for the list of sessions.
     void searchForSessions();
 
     std::string m_sessionsDir;
     mutable std::mutex m_sessionsMutex;
-    std::thread m_thread;
+    sched::TaskGroup m_task;
     RecoveryConfig m_config;
     Sessions m_sessions;
     SessionPtr m_inProgress;
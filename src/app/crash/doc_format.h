@@ -11,6 +11,7 @@
 #define DOC_FORMAT_VERSION_0     0  // Old version
 #define DOC_FORMAT_VERSION_1     1  // New version with tilesets
 #define DOC_FORMAT_VERSION_2     2  // Version 2 adds custom properties to user data
-#define DOC_FORMAT_VERSION_LAST  2
+#define DOC_FORMAT_VERSION_3     3  // Version 3 adds image patches ("patch" files)
+#define DOC_FORMAT_VERSION_LAST  3
 
 #endif
@@ -8,11 +8,13 @@
 #define APP_CRASH_INTERNALS_H_INCLUDED
 #pragma once
 
+#include "base/convert_to.h"
 #include "doc/object.h"
 
 #include <algorithm>
 #include <functional>
 #include <map>
+#include <string>
 
 namespace app {
 namespace crash {
@@ -56,6 +58,24 @@ namespace crash {
 
   typedef std::map<doc::ObjectId, ObjVersions> ObjVersionsMap;
 
+  // Images are saved as full checkpoints ("img" files), and then as
+  // patches ("patch" files) with the modified tiles (squares of
+  // IMAGE_PATCH_TILE_SIZE pixels) from the previous version.
+  const int IMAGE_PATCH_TILE_SIZE = 64;
+  const int IMAGE_PATCHES_PER_CHECKPOINT = 16;
+
+  // Returns the file name used to save the given version of an object.
+  inline std::string object_filename(const char* prefix,
+                                     doc::ObjectId id,
+                                     doc::ObjectVersion ver) {
+    std::string fn = prefix;
+    fn.push_back('-');
+    fn += base::convert_to<std::string>(id);
+    fn.push_back('.');
+    fn += base::convert_to<std::string>(ver);
+    return fn;
+  }
+
 } // namespace crash
 } // namespace app
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -32,6 +32,7 @@
 #include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
+#include "doc/primitives.h"
 #include "doc/slice.h"
 #include "doc/slice_io.h"
 #include "doc/sprite.h"
@@ -45,9 +46,14 @@
 #include "doc/user_data_io.h"
 #include "doc/util.h"
 #include "fixmath/fixmath.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
 
+#include <algorithm>
 #include <fstream>
 #include <map>
+#include <set>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -83,9 +89,18 @@ public:
       if (!id || !ver)
         continue;               // Error converting strings to ID/ver
 
+      // Image patches are applied over the "img" versions
+      if (fn.compare(0, 6, "patch-") == 0) {
+        m_imagePatches[id].push_back(ver);
+        continue;
+      }
+
       ObjVersions& versions = m_objVersions[id];
       versions.add(ver);
 
+      if (fn.compare(0, 4, "img-") == 0)
+        m_imageIds.insert(id);
+
       if (fn.compare(0, 3, "doc") == 0) {
         if (!m_docId)
           m_docId = id;
@@ -99,6 +114,8 @@ public:
   }
 
   Doc* loadDocument() {
+    prefetchImages();
+
     Doc* doc = loadObject<Doc*>("doc", m_docId, &Reader::readDocument);
     if (doc)
       fixUndetectedDocumentIssues(doc);
@@ -132,8 +149,77 @@ private:
     if (m_images.find(imageId) != m_images.end())
       return m_images[imageId];
 
-    ImageRef image(loadObject<Image*>("img", imageId, &Reader::readImage));
-    return m_images[imageId] = image;
+    return m_images[imageId] = loadImage(imageId, true);
+  }
+
+  ImageRef loadImage(const ObjectId imageId, const bool showError) {
+    ObjectVersion ver = 0;
+    ImageRef image(loadObject<Image*>("img", imageId, &Reader::readImage,
+                                      &ver, showError));
+    if (image)
+      applyImagePatches(image.get(), imageId, ver);
+    return image;
+  }
+
+  // Decodes all images (the biggest part of the backup) in parallel
+  // before reading the document structure, so getImageRef() just
+  // returns the already loaded images. Images that cannot be loaded
+  // here are loaded again with getImageRef() to report the error.
+  void prefetchImages() {
+    const std::vector<ObjectId> ids(m_imageIds.begin(), m_imageIds.end());
+    const int n = int(ids.size());
+    if (n < 2)
+      return;
+
+    std::vector<ImageRef> images(n);
+    {
+      const int ntasks =
+        std::min(n, 2 * std::max(1, sched::Scheduler::instance().threads()));
+      sched::TaskGroup tasks(sched::Priority::Interactive);
+      for (int t=0; t<ntasks; ++t) {
+        const int i0 = n * t / ntasks;
+        const int i1 = n * (t+1) / ntasks;
+        tasks.run([this, &ids, &images, i0, i1]{
+          for (int i=i0; i<i1 && !canceled(); ++i)
+            images[i] = loadImage(ids[i], false);
+        });
+      }
+      tasks.wait();
+    }
+
+    for (int i=0; i<n; ++i) {
+      if (images[i])
+        m_images[ids[i]] = images[i];
+    }
+  }
+
+  // Applies the chain of patches saved after the given checkpoint
+  // version of the image. If a patch is broken, the image stays in
+  // the previous version.
+  void applyImagePatches(Image* image, ObjectId imageId, ObjectVersion ver) {
+    auto it = m_imagePatches.find(imageId);
+    if (it == m_imagePatches.end())
+      return;
+
+    std::vector<ObjectVersion>& patches = it->second;
+    std::sort(patches.begin(), patches.end());
+
+    for (const ObjectVersion patchVer : patches) {
+      if (patchVer <= ver)
+        continue;
+
+      std::ifstream s(FSTREAM_PATH(base::join_path(m_dir, object_filename("patch", imageId, patchVer))),
+                      std::ifstream::binary);
+      if (read32(s) != MAGIC_NUMBER ||
+          read32(s) != ver ||
+          !readImagePatch(s, image)) {
+        RECO_TRACE("RECO: patch #%d v%d was not applied\n", imageId, patchVer);
+        break;
+      }
+
+      RECO_TRACE("RECO: patch #%d v%d applied successfully\n", imageId, patchVer);
+      ver = patchVer;
+    }
   }
 
   CelDataRef getCelDataRef(ObjectId celdataId) {
@@ -145,8 +231,15 @@ private:
   }
 
   template<typename T>
-  T loadObject(const char* prefix, ObjectId id, T (Reader::*readMember)(std::ifstream&)) {
-    const ObjVersions& versions = m_objVersions[id];
+  T loadObject(const char* prefix, ObjectId id, T (Reader::*readMember)(std::ifstream&),
+               ObjectVersion* loadedVer = nullptr,
+               const bool showError = true) {
+    // find() instead of operator[] as this can be called from
+    // several threads (see prefetchImages())
+    static const ObjVersions kNoVersions;
+    auto versionsIt = m_objVersions.find(id);
+    const ObjVersions& versions =
+      (versionsIt != m_objVersions.end() ? versionsIt->second: kNoVersions);
 
     for (size_t i=0; i<versions.size(); ++i) {
       ObjectVersion ver = versions[i];
@@ -168,6 +261,8 @@ private:
 
       if (obj) {
         RECO_TRACE("RECO: %s #%d v%d restored successfully\n", prefix, id, ver);
+        if (loadedVer)
+          *loadedVer = ver;
         return obj;
       }
       else {
@@ -176,7 +271,7 @@ private:
     }
 
     // Show error only if we've failed to load all versions
-    if (!m_loadInfo)
+    if (!m_loadInfo && showError)
       Console().printf("Error loading object %s #%d\n", prefix, id);
 
     return nullptr;
@@ -504,6 +599,33 @@ private:
     return read_image(s, false);
   }
 
+  // Reads all the tiles of the patch before modifying the image, so
+  // the image is not modified if the patch is broken.
+  bool readImagePatch(std::ifstream& s, Image* image) {
+    const int n = read32(s);
+    if (n < 0 || n > 0xffffff)
+      return false;
+
+    std::vector<std::pair<gfx::Point, ImageRef>> tiles;
+    try {
+      for (int i=0; i<n; ++i) {
+        const int x = read16(s);
+        const int y = read16(s);
+        ImageRef tile(read_image(s, false));
+        if (!s || !tile || tile->pixelFormat() != image->pixelFormat())
+          return false;
+        tiles.push_back(std::make_pair(gfx::Point(x, y), tile));
+      }
+    }
+    catch (const std::exception&) {
+      return false;
+    }
+
+    for (const auto& tile : tiles)
+      copy_image(image, tile.second.get(), tile.first.x, tile.first.y);
+    return true;
+  }
+
   Palette* readPalette(std::ifstream& s) {
     return read_palette(s);
   }
@@ -582,6 +704,8 @@ private:
   DocumentInfo* m_loadInfo;
   std::vector<std::pair<ObjectId, ObjectId> > m_celsToLoad;
   std::map<ObjectId, ImageRef> m_images;
+  std::set<ObjectId> m_imageIds;  // IDs of all "img" objects
+  std::map<ObjectId, std::vector<ObjectVersion>> m_imagePatches;
   std::map<ObjectId, CelDataRef> m_celdatas;
   // Each ObjectId is a tileset ID that didn't contain the empty tile
   // as the first tile (this was an old format used in internal betas)
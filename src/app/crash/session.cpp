@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -31,6 +31,7 @@
 #include "base/time.h"
 #include "doc/cancel_io.h"
 #include "fmt/format.h"
+#include "sched/task_group.h"
 #include "ver/info.h"
 
 namespace app {
@@ -114,12 +115,23 @@ std::string Session::version()
 const Session::Backups& Session::backups()
 {
   if (m_backups.empty()) {
+    std::vector<std::string> docDirs;
     for (auto& item : base::list_files(m_path)) {
       std::string docDir = base::join_path(m_path, item);
-      if (base::is_directory(docDir)) {
-        m_backups.push_back(std::make_shared<Backup>(docDir));
-      }
+      if (base::is_directory(docDir))
+        docDirs.push_back(docDir);
     }
+
+    // Read the information of each backup in parallel
+    Backups backups(docDirs.size());
+    sched::TaskGroup tasks(sched::Priority::Background);
+    for (size_t i=0; i<docDirs.size(); ++i) {
+      tasks.run([&docDirs, &backups, i]{
+        backups[i] = std::make_shared<Backup>(docDirs[i]);
+      });
+    }
+    tasks.wait();
+    m_backups = std::move(backups);
   }
   return m_backups;
 }
@@ -230,13 +242,23 @@ public:
 
 bool Session::saveDocumentChanges(Doc* doc)
 {
-  CustomWeakDocReader reader(doc);
-  if (!reader.isLocked())
-    return false;
+  // Copy the modified objects with the document locked, and then
+  // save them without the lock, so the UI thread can modify the
+  // document meanwhile.
+  std::unique_ptr<DocSnapshot> snapshot;
+  {
+    CustomWeakDocReader reader(doc);
+    if (!reader.isLocked())
+      return false;
+
+    snapshot = take_document_snapshot(doc, &reader);
+    if (!snapshot)
+      return false;
+  }
 
   app::Context ctx;
   std::string dir = base::join_path(m_path,
-    base::convert_to<std::string>(doc->id()));
+    base::convert_to<std::string>(snapshot->docId));
   RECO_TRACE("RECO: Saving document '%s'...\n", dir.c_str());
 
   // Create directory for document
@@ -254,7 +276,7 @@ bool Session::saveDocumentChanges(Doc* doc)
   }
 
   // Save document information
-  return write_document(dir, doc, &reader);
+  return write_document_snapshot(dir, snapshot.get());
 }
 
 void Session::removeDocument(Doc* doc)
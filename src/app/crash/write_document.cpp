@@ -15,7 +15,6 @@
 #include "app/crash/internals.h"
 #include "app/crash/log.h"
 #include "app/doc.h"
-#include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
 #include "base/serialization.h"
@@ -31,6 +30,7 @@
 #include "doc/layer_tilemap.h"
 #include "doc/palette.h"
 #include "doc/palette_io.h"
+#include "doc/primitives.h"
 #include "doc/slice.h"
 #include "doc/slice_io.h"
 #include "doc/sprite.h"
@@ -42,9 +42,13 @@
 #include "doc/tilesets.h"
 #include "doc/user_data_io.h"
 #include "fixmath/fixmath.h"
+#include "perf/trace.h"
 
+#include <cstring>
 #include <fstream>
 #include <map>
+#include <sstream>
+#include <vector>
 
 namespace app {
 namespace crash {
@@ -55,27 +59,112 @@ using namespace doc;
 
 namespace {
 
+// Information about the last backup of an image to save only the
+// modified tiles in the next version.
+struct ImageBackup {
+  ObjectVersion checkpoint = 0;         // Version saved in the "img" file
+  std::vector<ObjectVersion> patches;   // Versions saved in "patch" files
+  PixelFormat pixelFormat = IMAGE_RGB;
+  gfx::Size size;
+  std::vector<uint64_t> tileHashes;
+};
+
+typedef std::map<ObjectId, ImageBackup> ImageBackupsMap;
+
 static std::map<ObjectId, ObjVersionsMap> g_docVersions;
+static std::map<ObjectId, ImageBackupsMap> g_docImages;
 static std::map<ObjectId, base::paths> g_deleteFiles;
 
+uint64_t hash_bytes(uint64_t h, const uint8_t* p, int n)
+{
+  for (; n >= 8; n -= 8, p += 8) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    h = (h ^ v) * 0x9e3779b97f4a7c15ull;
+    h ^= (h >> 29);
+  }
+  for (; n > 0; --n, ++p)
+    h = (h ^ *p) * 0x100000001b3ull;
+  return h;
+}
+
+// Returns a hash for each tile of the image (in row-major order).
+std::vector<uint64_t> hash_image_tiles(const Image* img)
+{
+  const int ts = IMAGE_PATCH_TILE_SIZE;
+  const int tw = (img->width()+ts-1) / ts;
+  const int th = (img->height()+ts-1) / ts;
+  std::vector<uint64_t> hashes(tw*th, 0xcbf29ce484222325ull);
+
+  for (int y=0; y<img->height(); ++y) {
+    const uint8_t* row = img->getPixelAddress(0, y);
+    uint64_t* rowHashes = &hashes[(y / ts) * tw];
+
+    for (int tx=0; tx<tw; ++tx) {
+      const int x1 = tx*ts;
+      const int x2 = std::min(x1+ts, img->width());
+      const int offset = img->getRowStrideSize(x1);
+      rowHashes[tx] = hash_bytes(rowHashes[tx], row+offset,
+                                 img->getRowStrideSize(x2) - offset);
+    }
+  }
+  return hashes;
+}
+
+// Returns the bounds of the modified tiles (contiguous tiles of the
+// same row are joined in one rectangle).
+std::vector<gfx::Rect> modified_tiles(const Image* img,
+                                      const std::vector<uint64_t>& oldHashes,
+                                      const std::vector<uint64_t>& newHashes)
+{
+  ASSERT(oldHashes.size() == newHashes.size());
+
+  const int ts = IMAGE_PATCH_TILE_SIZE;
+  const int tw = (img->width()+ts-1) / ts;
+  const int th = (img->height()+ts-1) / ts;
+  std::vector<gfx::Rect> rects;
+
+  for (int ty=0; ty<th; ++ty) {
+    for (int tx=0; tx<tw; ++tx) {
+      const int i = ty*tw + tx;
+      if (oldHashes[i] == newHashes[i])
+        continue;
+
+      int tx2 = tx+1;
+      while (tx2 < tw && oldHashes[i+tx2-tx] != newHashes[i+tx2-tx])
+        ++tx2;
+
+      rects.push_back(
+        gfx::Rect(tx*ts, ty*ts, (tx2-tx)*ts, ts)
+        .createIntersection(img->bounds()));
+      tx = tx2;
+    }
+  }
+  return rects;
+}
+
 class Writer {
 public:
-  Writer(const std::string& dir, Doc* doc, doc::CancelIO* cancel)
-    : m_dir(dir)
-    , m_doc(doc)
-    , m_objVersions(g_docVersions[doc->id()])
-    , m_deleteFiles(g_deleteFiles[doc->id()])
-    , m_cancel(cancel) {
+  Writer(ObjectId docId, doc::CancelIO* cancel = nullptr)
+    : m_objVersions(g_docVersions[docId])
+    , m_images(g_docImages[docId])
+    , m_deleteFiles(g_deleteFiles[docId])
+    , m_cancel(cancel)
+    , m_snapshot(nullptr) {
   }
 
-  bool saveDocument() {
-    Sprite* spr = m_doc->sprite();
+  // Copies/serializes the modified objects (the document must be
+  // locked).
+  bool takeSnapshot(Doc* doc, DocSnapshot& snapshot) {
+    Sprite* spr = doc->sprite();
+    m_snapshot = &snapshot;
+    m_snapshot->docId = doc->id();
 
     // Save from objects without children (e.g. images), to aggregated
     // objects (e.g. cels, layers, etc.)
 
     for (Palette* pal : spr->getPalettes())
-      if (!saveObject("pal", pal, &Writer::writePalette))
+      if (!snapshotObject("pal", pal, &Writer::writePalette))
         return false;
 
     if (spr->hasTilesets()) {
@@ -83,18 +172,18 @@ public:
         // The tileset can be nullptr if it was erased (as we keep
         // empty spaces in the Tilesets array)
         if (tset) {
-          if (!saveObject("tset", tset, &Writer::writeTileset))
+          if (!snapshotObject("tset", tset, &Writer::writeTileset))
             return false;
         }
       }
     }
 
     for (Tag* frtag : spr->tags())
-      if (!saveObject("frtag", frtag, &Writer::writeFrameTag))
+      if (!snapshotObject("frtag", frtag, &Writer::writeFrameTag))
         return false;
 
     for (Slice* slice : spr->slices())
-      if (!saveObject("slice", slice, &Writer::writeSlice))
+      if (!snapshotObject("slice", slice, &Writer::writeSlice))
         return false;
 
     // Get all layers (visible, hidden, subchildren, etc.)
@@ -109,10 +198,10 @@ public:
         if (cel->link())        // Skip link
           continue;
 
-        if (!saveObject("img", cel->image(), &Writer::writeImage))
+        if (!snapshotImage(cel->image()))
           return false;
 
-        if (!saveObject("celdata", cel->data(), &Writer::writeCelData))
+        if (!snapshotObject("celdata", cel->data(), &Writer::writeCelData))
           return false;
       }
     }
@@ -123,21 +212,39 @@ public:
       lay->getCels(cels);
 
       for (Cel* cel : cels)
-        if (!saveObject("cel", cel, &Writer::writeCel))
+        if (!snapshotObject("cel", cel, &Writer::writeCel))
           return false;
     }
 
     // Save all layers (top level, groups, children, etc.)
     for (Layer* lay : layers)
-      if (!saveObject("lay", lay, &Writer::writeLayerStructure))
+      if (!snapshotObject("lay", lay, &Writer::writeLayerStructure))
         return false;
 
-    if (!saveObject("spr", spr, &Writer::writeSprite))
+    if (!snapshotObject("spr", spr, &Writer::writeSprite))
       return false;
 
-    if (!saveObject("doc", m_doc, &Writer::writeDocumentFile))
+    if (!snapshotObject("doc", doc, &Writer::writeDocumentFile))
       return false;
 
+    return true;
+  }
+
+  // Saves the snapshot files (the document doesn't need to be
+  // locked).
+  bool writeSnapshot(const std::string& dir, const DocSnapshot& snapshot) {
+    m_dir = dir;
+
+    for (const DocSnapshot::Image& image : snapshot.images)
+      if (!saveImage(image))
+        return false;
+
+    // Objects are saved in the same order they were added (e.g. from
+    // cels to the document file)
+    for (const DocSnapshot::Object& obj : snapshot.objects)
+      if (!saveObject(obj))
+        return false;
+
     // Delete old files after all files are correctly saved.
     deleteOldVersions();
     return true;
@@ -149,14 +256,14 @@ private:
     return (m_cancel && m_cancel->isCanceled());
   }
 
-  bool writeDocumentFile(std::ofstream& s, Doc* doc) {
+  bool writeDocumentFile(std::ostream& s, Doc* doc) {
     write32(s, doc->sprite()->id());
     write_string(s, doc->filename());
     write16(s, DOC_FORMAT_VERSION_LAST);
     return true;
   }
 
-  bool writeSprite(std::ofstream& s, Sprite* spr) {
+  bool writeSprite(std::ostream& s, Sprite* spr) {
     // Header
     write8(s, int(spr->colorMode()));
     write16(s, spr->width());
@@ -210,7 +317,7 @@ private:
     return true;
   }
 
-  bool writeGridBounds(std::ofstream& s, const gfx::Rect& grid) {
+  bool writeGridBounds(std::ostream& s, const gfx::Rect& grid) {
     write16(s, (int16_t)grid.x);
     write16(s, (int16_t)grid.y);
     write16(s, grid.w);
@@ -218,7 +325,7 @@ private:
     return true;
   }
 
-  bool writeColorSpace(std::ofstream& s, const gfx::ColorSpaceRef& colorSpace) {
+  bool writeColorSpace(std::ostream& s, const gfx::ColorSpaceRef& colorSpace) {
     write16(s, colorSpace->type());
     write16(s, colorSpace->flags());
     write32(s, fixmath::ftofix(colorSpace->gamma()));
@@ -232,7 +339,7 @@ private:
     return true;
   }
 
-  void writeAllLayersID(std::ofstream& s, ObjectId parentId, const LayerGroup* group) {
+  void writeAllLayersID(std::ostream& s, ObjectId parentId, const LayerGroup* group) {
     for (const Layer* lay : group->layers()) {
       write32(s, lay->id());
       write32(s, parentId);
@@ -242,7 +349,7 @@ private:
     }
   }
 
-  bool writeLayerStructure(std::ofstream& s, Layer* lay) {
+  bool writeLayerStructure(std::ostream& s, Layer* lay) {
     write32(s, static_cast<int>(lay->flags())); // Flags
     write16(s, static_cast<int>(lay->type()));  // Type
     write_string(s, lay->name());
@@ -282,63 +389,183 @@ private:
     return true;
   }
 
-  bool writeCel(std::ofstream& s, Cel* cel) {
+  bool writeCel(std::ostream& s, Cel* cel) {
     write_cel(s, cel);
     return true;
   }
 
-  bool writeCelData(std::ofstream& s, CelData* celdata) {
+  bool writeCelData(std::ostream& s, CelData* celdata) {
     write_celdata(s, celdata);
     return true;
   }
 
-  bool writeImage(std::ofstream& s, Image* img) {
+  bool writeImage(std::ostream& s, const Image* img) {
     return write_image(s, img, m_cancel);
   }
 
-  bool writePalette(std::ofstream& s, Palette* pal) {
+  bool writeImagePatch(std::ostream& s, const Image* img,
+                       const ObjectVersion baseVersion,
+                       const std::vector<gfx::Rect>& rects) {
+    write32(s, baseVersion);
+    write32(s, rects.size());
+    for (const gfx::Rect& rc : rects) {
+      ImageRef tile(crop_image(img, rc, 0));
+      write16(s, rc.x);
+      write16(s, rc.y);
+      if (!write_image(s, tile.get(), m_cancel))
+        return false;
+    }
+    return true;
+  }
+
+  bool writePalette(std::ostream& s, Palette* pal) {
     write_palette(s, pal);
     return true;
   }
 
-  bool writeTileset(std::ofstream& s, Tileset* tileset) {
+  bool writeTileset(std::ostream& s, Tileset* tileset) {
     write_tileset(s, tileset);
     return true;
   }
 
-  bool writeFrameTag(std::ofstream& s, Tag* frameTag) {
+  bool writeFrameTag(std::ostream& s, Tag* frameTag) {
     write_tag(s, frameTag);
     return true;
   }
 
-  bool writeSlice(std::ofstream& s, Slice* slice) {
+  bool writeSlice(std::ostream& s, Slice* slice) {
     write_slice(s, slice);
     return true;
   }
 
   template<typename T>
-  bool saveObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ofstream&, T*)) {
+  bool snapshotObject(const char* prefix, T* obj, bool (Writer::*writeMember)(std::ostream&, T*)) {
     if (isCanceled())
       return false;
 
     if (!obj->version())
       obj->incrementVersion();
 
-    ObjVersions& versions = m_objVersions[obj->id()];
-    if (versions.newer() == obj->version())
+    if (m_objVersions[obj->id()].newer() == obj->version())
+      return true;
+
+    std::ostringstream s;
+    if (!(this->*writeMember)(s, obj)) // Write the object
+      return false;
+
+    m_snapshot->objects.push_back(
+      DocSnapshot::Object{ prefix, obj->id(), obj->version(), s.str() });
+    return true;
+  }
+
+  bool saveObject(const DocSnapshot::Object& obj) {
+    ObjVersions& versions = m_objVersions[obj.id];
+
+    std::string fullfn = base::join_path(m_dir, object_filename(obj.prefix, obj.id, obj.version));
+    std::string oldfn = base::join_path(m_dir, object_filename(obj.prefix, obj.id, versions.older()));
+
+    if (!writeFile(fullfn, [&obj](std::ostream& s){
+                             s.write(obj.data.data(), obj.data.size());
+                             return bool(s);
+                           }))
+      return false;
+
+    // Remove the older version
+    if (versions.older() && base::is_file(oldfn))
+      m_deleteFiles.push_back(oldfn);
+
+    // Rotate versions and add the latest one
+    versions.rotateRevisions(obj.version);
+
+    RECO_TRACE(" - Saved %s #%d v%d\n", obj.prefix, obj.id, obj.version);
+    return true;
+  }
+
+  // Images are copied as they can be modified after the snapshot
+  // (the copy is compressed and saved later).
+  bool snapshotImage(Image* img) {
+    if (isCanceled())
+      return false;
+
+    if (!img->version())
+      img->incrementVersion();
+
+    if (m_objVersions[img->id()].newer() == img->version())
       return true;
 
-    std::string fn = prefix;
-    fn.push_back('-');
-    fn += base::convert_to<std::string>(obj->id());
+    m_snapshot->images.push_back(
+      DocSnapshot::Image{ img->id(), img->version(),
+                          ImageRef(Image::createCopy(img)) });
+    return true;
+  }
+
+  // Saves the image as a full checkpoint ("img" file) or as a patch
+  // with the modified tiles from the previous version ("patch" file).
+  bool saveImage(const DocSnapshot::Image& image) {
+    const Image* img = image.copy.get();
+    const ObjectId id = image.id;
+    const ObjectVersion version = image.version;
+    ObjVersions& versions = m_objVersions[id];
+
+    ImageBackup& backup = m_images[id];
+    std::vector<uint64_t> hashes = hash_image_tiles(img);
+
+    const bool checkpoint =
+      (!backup.checkpoint ||
+       backup.patches.size() >= IMAGE_PATCHES_PER_CHECKPOINT ||
+       backup.pixelFormat != img->pixelFormat() ||
+       backup.size != img->size());
+
+    if (checkpoint) {
+      const std::string fn =
+        base::join_path(m_dir, object_filename("img", id, version));
+      if (!writeFile(fn, [this, img](std::ostream& s){
+                           return writeImage(s, img);
+                         }))
+        return false;
 
-    std::string fullfn = base::join_path(m_dir, fn);
-    std::string oldfn = fullfn + "." + base::convert_to<std::string>(versions.older());
-    fullfn += "." + base::convert_to<std::string>(obj->version());
+      // Remove the previous checkpoint and its patches
+      if (backup.checkpoint) {
+        m_deleteFiles.push_back(
+          base::join_path(m_dir, object_filename("img", id, backup.checkpoint)));
+        for (ObjectVersion ver : backup.patches)
+          m_deleteFiles.push_back(
+            base::join_path(m_dir, object_filename("patch", id, ver)));
+      }
 
-    std::ofstream s(FSTREAM_PATH(fullfn), std::ofstream::binary);
+      backup.checkpoint = version;
+      backup.patches.clear();
+      RECO_TRACE(" - Saved img #%d v%d\n", id, version);
+    }
+    else {
+      const std::vector<gfx::Rect> rects =
+        modified_tiles(img, backup.tileHashes, hashes);
+      const ObjectVersion baseVersion = versions.newer();
+      const std::string fn =
+        base::join_path(m_dir, object_filename("patch", id, version));
+      if (!writeFile(fn, [this, img, baseVersion, &rects](std::ostream& s){
+                           return writeImagePatch(s, img, baseVersion, rects);
+                         }))
+        return false;
+
+      backup.patches.push_back(version);
+      RECO_TRACE(" - Saved patch #%d v%d (%d rects)\n",
+                 id, version, int(rects.size()));
+    }
+
+    backup.pixelFormat = img->pixelFormat();
+    backup.size = img->size();
+    backup.tileHashes = std::move(hashes);
+
+    versions.rotateRevisions(version);
+    return true;
+  }
+
+  template<typename Func>
+  bool writeFile(const std::string& fn, Func writeContent) {
+    std::ofstream s(FSTREAM_PATH(fn), std::ofstream::binary);
     write32(s, 0);                // Leave a room for the magic number
-    if (!(this->*writeMember)(s, obj)) // Write the object
+    if (!writeContent(s))         // Write the object
       return false;
 
     // Flush all data. In this way we ensure that the magic number is
@@ -348,15 +575,6 @@ private:
     // Write the magic number
     s.seekp(0);
     write32(s, MAGIC_NUMBER);
-
-    // Remove the older version
-    if (versions.older() && base::is_file(oldfn))
-      m_deleteFiles.push_back(oldfn);
-
-    // Rotate versions and add the latest one
-    versions.rotateRevisions(obj->version());
-
-    RECO_TRACE(" - Saved %s #%d v%d\n", prefix, obj->id(), obj->version());
     return true;
   }
 
@@ -376,10 +594,11 @@ private:
   }
 
   std::string m_dir;
-  Doc* m_doc;
   ObjVersionsMap& m_objVersions;
+  ImageBackupsMap& m_images;
   base::paths& m_deleteFiles;
   doc::CancelIO* m_cancel;
+  DocSnapshot* m_snapshot;
 };
 
 } // anonymous namespace
@@ -387,12 +606,24 @@ private:
 //////////////////////////////////////////////////////////////////////
 // Public API
 
-bool write_document(const std::string& dir,
-                    Doc* doc,
-                    doc::CancelIO* cancel)
+std::unique_ptr<DocSnapshot> take_document_snapshot(Doc* doc,
+                                                    doc::CancelIO* cancel)
 {
-  Writer writer(dir, doc, cancel);
-  return writer.saveDocument();
+  PERF_ZONE("crash::take_document_snapshot");
+  auto snapshot = std::make_unique<DocSnapshot>();
+  Writer writer(doc->id(), cancel);
+  if (!writer.takeSnapshot(doc, *snapshot))
+    return nullptr;
+  return snapshot;
+}
+
+bool write_document_snapshot(const std::string& dir,
+                             const DocSnapshot* snapshot)
+{
+  PERF_ZONE("crash::write_document_snapshot");
+  ASSERT(snapshot);
+  Writer writer(snapshot->docId);
+  return writer.writeSnapshot(dir, *snapshot);
 }
 
 void delete_document_internals(Doc* doc)
@@ -406,6 +637,11 @@ void delete_document_internals(Doc* doc)
     if (it != g_docVersions.end())
       g_docVersions.erase(it);
   }
+  {
+    auto it = g_docImages.find(doc->id());
+    if (it != g_docImages.end())
+      g_docImages.erase(it);
+  }
   {
     auto it = g_deleteFiles.find(doc->id());
     if (it != g_deleteFiles.end())
@@ -8,7 +8,13 @@
 #define APP_CRASH_WRITE_DOCUMENT_H_INCLUDED
 #pragma once
 
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <memory>
 #include <string>
+#include <vector>
 
 namespace doc {
   class CancelIO;
@@ -19,7 +25,36 @@ namespace app {
 
   namespace crash {
 
-    bool write_document(const std::string& dir, Doc* doc, doc::CancelIO* cancel);
+    // Copy of the objects of a document that were modified since the
+    // last backup, so they can be saved without locking the document.
+    struct DocSnapshot {
+      struct Object {
+        const char* prefix;
+        doc::ObjectId id;
+        doc::ObjectVersion version;
+        std::string data;       // Serialized object
+      };
+      struct Image {
+        doc::ObjectId id;
+        doc::ObjectVersion version;
+        doc::ImageRef copy;
+      };
+      doc::ObjectId docId = 0;
+      std::vector<Image> images;
+      std::vector<Object> objects;
+    };
+
+    // Must be called with the document locked (it should be fast
+    // because it copies only the modified objects). Returns nullptr
+    // if it's canceled.
+    std::unique_ptr<DocSnapshot> take_document_snapshot(Doc* doc,
+                                                        doc::CancelIO* cancel);
+
+    // Saves the snapshot in the given directory (the document doesn't
+    // need to be locked).
+    bool write_document_snapshot(const std::string& dir,
+                                 const DocSnapshot* snapshot);
+
     void delete_document_internals(Doc* doc);
 
   } // namespace crash
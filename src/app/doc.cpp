@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -33,12 +33,17 @@
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "doc/tag.h"
+#include "doc/tileset.h"
+#include "gfx/region.h"
 #include "os/system.h"
 #include "os/window.h"
+#include "perf/trace.h"
 #include "ui/system.h"
 
+#include <algorithm>
 #include <limits>
 #include <map>
+#include <vector>
 
 #define DOC_TRACE(...) // TRACEARGS
 
@@ -47,6 +52,58 @@ namespace app {
 using namespace base;
 using namespace doc;
 
+// Total number of lock contentions (see Doc::lockContentions())
+static std::atomic<int64_t> g_lockContentions(0);
+
+struct Doc::PendingNotifications {
+  struct CelOp {
+    bool copy;
+    ObjectId fromLayer;         // Can be NullId for copied cels
+    frame_t fromFrame;
+    ObjectId toLayer;
+    frame_t toFrame;
+
+    bool operator==(const CelOp& o) const {
+      return (copy == o.copy &&
+              fromLayer == o.fromLayer &&
+              fromFrame == o.fromFrame &&
+              toLayer == o.toLayer &&
+              toFrame == o.toFrame);
+    }
+  };
+
+  bool generalUpdate = false;
+  bool paletteChanged = false;
+  bool selectionChanged = false;
+  bool selectionBoundariesChanged = false;
+  std::vector<ObjectId> tilesets;
+  std::map<frame_t, gfx::Region> modifiedPixels;
+  gfx::Region exposedPixels;
+  std::vector<CelOp> celOps;
+
+  void addCelOp(const CelOp& op) {
+    if (std::find(celOps.begin(), celOps.end(), op) == celOps.end())
+      celOps.push_back(op);
+  }
+};
+
+Doc::NotificationsBatch::NotificationsBatch(Doc* doc)
+  : m_docId(doc->id())
+{
+  ++doc->m_batchLevel;
+}
+
+Doc::NotificationsBatch::~NotificationsBatch()
+{
+  // The document could be deleted while the batch was alive
+  Doc* doc = doc::get<Doc>(m_docId);
+  if (doc) {
+    ASSERT(doc->m_batchLevel > 0);
+    if (--doc->m_batchLevel == 0)
+      doc->flushNotifications();
+  }
+}
+
 Doc::Doc(Sprite* sprite)
   : m_ctx(nullptr)
   , m_flags(kMaskVisible)
@@ -103,12 +160,12 @@ bool Doc::canWriteLockFromRead() const
 
 bool Doc::readLock(int timeout)
 {
-  return m_rwLock.lock(base::RWLock::ReadLock, timeout);
+  return lock(base::RWLock::ReadLock, timeout);
 }
 
 bool Doc::writeLock(int timeout)
 {
-  return m_rwLock.lock(base::RWLock::WriteLock, timeout);
+  return lock(base::RWLock::WriteLock, timeout);
 }
 
 bool Doc::upgradeToWrite(int timeout)
@@ -136,6 +193,27 @@ void Doc::weakUnlock()
   m_rwLock.weakUnlock();
 }
 
+// static
+int64_t Doc::lockContentions()
+{
+  return g_lockContentions;
+}
+
+bool Doc::lock(const base::RWLock::LockType lockType, int timeout)
+{
+  // Fast path: the lock is available
+  if (m_rwLock.lock(lockType, 0))
+    return true;
+
+  perf::Trace::addCounter("Doc lock contentions", ++g_lockContentions);
+  if (timeout == 0)
+    return false;
+
+  PERF_ZONE(lockType == base::RWLock::ReadLock ? "Doc::readLock/wait":
+                                                 "Doc::writeLock/wait");
+  return m_rwLock.lock(lockType, timeout);
+}
+
 void Doc::setTransaction(Transaction* transaction)
 {
   if (transaction) {
@@ -185,6 +263,11 @@ color_t Doc::bgColor(Layer* layer) const
 
 void Doc::notifyGeneralUpdate()
 {
+  if (m_batchLevel > 0) {
+    pendingNotifications()->generalUpdate = true;
+    return;
+  }
+
   DocEvent ev(this);
   notify_observers<DocEvent&>(&DocObserver::onGeneralUpdate, ev);
 }
@@ -200,6 +283,11 @@ void Doc::notifyColorSpaceChanged()
 
 void Doc::notifyPaletteChanged()
 {
+  if (m_batchLevel > 0) {
+    pendingNotifications()->paletteChanged = true;
+    return;
+  }
+
   DocEvent ev(this);
   ev.sprite(sprite());
   notify_observers<DocEvent&>(&DocObserver::onPaletteChanged, ev);
@@ -207,6 +295,11 @@ void Doc::notifyPaletteChanged()
 
 void Doc::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region, frame_t frame)
 {
+  if (m_batchLevel > 0 && sprite == this->sprite()) {
+    pendingNotifications()->modifiedPixels[frame] |= region;
+    return;
+  }
+
   DocEvent ev(this);
   ev.sprite(sprite);
   ev.region(region);
@@ -216,6 +309,11 @@ void Doc::notifySpritePixelsModified(Sprite* sprite, const gfx::Region& region,
 
 void Doc::notifyExposeSpritePixels(Sprite* sprite, const gfx::Region& region)
 {
+  if (m_batchLevel > 0 && sprite == this->sprite()) {
+    pendingNotifications()->exposedPixels |= region;
+    return;
+  }
+
   DocEvent ev(this);
   ev.sprite(sprite);
   ev.region(region);
@@ -233,6 +331,12 @@ void Doc::notifyLayerMergedDown(Layer* srcLayer, Layer* targetLayer)
 
 void Doc::notifyCelMoved(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, frame_t toFrame)
 {
+  if (m_batchLevel > 0) {
+    pendingNotifications()->addCelOp(
+      { false, fromLayer->id(), fromFrame, toLayer->id(), toFrame });
+    return;
+  }
+
   DocEvent ev(this);
   ev.sprite(toLayer->sprite());
   ev.layer(fromLayer);
@@ -244,6 +348,13 @@ void Doc::notifyCelMoved(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, fr
 
 void Doc::notifyCelCopied(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, frame_t toFrame)
 {
+  if (m_batchLevel > 0) {
+    pendingNotifications()->addCelOp(
+      { true, (fromLayer ? fromLayer->id(): NullId), fromFrame,
+        toLayer->id(), toFrame });
+    return;
+  }
+
   DocEvent ev(this);
   ev.sprite(toLayer->sprite());
   ev.layer(fromLayer);          // From layer can be nullptr
@@ -255,18 +366,35 @@ void Doc::notifyCelCopied(Layer* fromLayer, frame_t fromFrame, Layer* toLayer, f
 
 void Doc::notifySelectionChanged()
 {
+  if (m_batchLevel > 0) {
+    pendingNotifications()->selectionChanged = true;
+    return;
+  }
+
   DocEvent ev(this);
   notify_observers<DocEvent&>(&DocObserver::onSelectionChanged, ev);
 }
 
 void Doc::notifySelectionBoundariesChanged()
 {
+  if (m_batchLevel > 0) {
+    pendingNotifications()->selectionBoundariesChanged = true;
+    return;
+  }
+
   DocEvent ev(this);
   notify_observers<DocEvent&>(&DocObserver::onSelectionBoundariesChanged, ev);
 }
 
 void Doc::notifyTilesetChanged(Tileset* tileset)
 {
+  if (m_batchLevel > 0) {
+    auto& tilesets = pendingNotifications()->tilesets;
+    if (std::find(tilesets.begin(), tilesets.end(), tileset->id()) == tilesets.end())
+      tilesets.push_back(tileset->id());
+    return;
+  }
+
   DocEvent ev(this);
   ev.tileset(tileset);
   notify_observers<DocEvent&>(&DocObserver::onTilesetChanged, ev);
@@ -279,6 +407,52 @@ void Doc::notifyLayerGroupCollapseChange(Layer* layer)
   notify_observers<DocEvent&>(&DocObserver::onLayerCollapsedChanged, ev);
 }
 
+Doc::PendingNotifications* Doc::pendingNotifications()
+{
+  if (!m_pending)
+    m_pending = std::make_unique<PendingNotifications>();
+  return m_pending.get();
+}
+
+void Doc::flushNotifications()
+{
+  ASSERT(m_batchLevel == 0);
+  std::unique_ptr<PendingNotifications> pending(std::move(m_pending));
+  if (!pending)
+    return;
+
+  // Objects (layers/tilesets) are referenced by ID as they could be
+  // deleted in the middle of the batch
+  if (pending->selectionChanged)
+    notifySelectionChanged();
+  if (pending->selectionBoundariesChanged)
+    notifySelectionBoundariesChanged();
+  if (pending->paletteChanged)
+    notifyPaletteChanged();
+  for (const ObjectId tilesetId : pending->tilesets) {
+    if (auto tileset = doc::get<Tileset>(tilesetId))
+      notifyTilesetChanged(tileset);
+  }
+  for (const auto& op : pending->celOps) {
+    Layer* fromLayer = doc::get<Layer>(op.fromLayer);
+    Layer* toLayer = doc::get<Layer>(op.toLayer);
+    if (!toLayer || (op.fromLayer && !fromLayer))
+      continue;
+    if (op.copy)
+      notifyCelCopied(fromLayer, op.fromFrame, toLayer, op.toFrame);
+    else
+      notifyCelMoved(fromLayer, op.fromFrame, toLayer, op.toFrame);
+  }
+  if (sprite()) {
+    for (const auto& pair : pending->modifiedPixels)
+      notifySpritePixelsModified(sprite(), pair.second, pair.first);
+    if (!pending->exposedPixels.isEmpty())
+      notifyExposeSpritePixels(sprite(), pending->exposedPixels);
+  }
+  if (pending->generalUpdate)
+    notifyGeneralUpdate();
+}
+
 bool Doc::isModified() const
 {
   return !m_undo->isInSavedStateOrSimilar();
@@ -295,6 +469,12 @@ void Doc::markAsSaved()
   m_undo->markSavedState();
 }
 
+void Doc::markAsSaved(const undo::UndoState* savedState)
+{
+  m_flags |= kAssociatedToFile;
+  m_undo->markSavedState(savedState);
+}
+
 void Doc::impossibleToBackToSavedState()
 {
   m_undo->impossibleToBackToSavedState();
@@ -370,23 +550,24 @@ void Doc::destroyMaskBoundaries()
 
 void Doc::generateMaskBoundaries(const Mask* mask)
 {
-  m_maskBoundaries.reset();
-
   // No mask specified? Use the current one in the document
   if (!mask) {
-    if (!isMaskVisible())       // The mask is hidden
+    if (!isMaskVisible()) {     // The mask is hidden
+      m_maskBoundaries.reset();
       return;                   // Done, without boundaries
+    }
     else
       mask = this->mask();      // Use the document mask
   }
 
   ASSERT(mask);
 
-  if (!mask->isEmpty()) {
-    m_maskBoundaries.regen(mask->bitmap());
-    m_maskBoundaries.offset(mask->bounds().x,
-                            mask->bounds().y);
-  }
+  // Only the segments around the modified pixels of the mask are
+  // regenerated
+  if (!mask->isEmpty())
+    m_maskBoundaries.update(mask->bitmap(), mask->bounds().origin());
+  else
+    m_maskBoundaries.reset();
 
   notifySelectionBoundariesChanged();
 }
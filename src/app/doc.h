@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -41,6 +41,10 @@ namespace gfx {
   class Region;
 }
 
+namespace undo {
+  class UndoState;
+}
+
 namespace app {
 
   class Context;
@@ -84,6 +88,12 @@ namespace app {
     bool weakLock(std::atomic<base::RWLock::WeakLock>* weak_lock_flag);
     void weakUnlock();
 
+    // Number of times a read/write lock couldn't be acquired
+    // immediately (in all documents). The waiting time is recorded
+    // in "Doc::readLock/wait" and "Doc::writeLock/wait" perf zones,
+    // and the total in the "Doc lock contentions" perf counter.
+    static int64_t lockContentions();
+
     // Sets active/running transaction.
     void setTransaction(Transaction* transaction);
     Transaction* transaction() { return m_transaction; }
@@ -120,12 +130,30 @@ namespace app {
     void notifyTilesetChanged(Tileset* tileset);
     void notifyLayerGroupCollapseChange(Layer* layer);
 
+    // Groups the notifications of the document while it's alive
+    // (batches can be nested), and delivers them to the observers
+    // when the last batch is destroyed: one onSpritePixelsModified()
+    // for each modified frame (with the union of all regions), one
+    // onExposeSpritePixels(), cel moved/copied events without
+    // duplicates, and general update/palette/selection/tileset
+    // changes only once. Other notifications are delivered
+    // immediately.
+    class NotificationsBatch {
+    public:
+      NotificationsBatch(Doc* doc);
+      ~NotificationsBatch();
+    private:
+      doc::ObjectId m_docId;
+      DISABLE_COPYING(NotificationsBatch);
+    };
+
     //////////////////////////////////////////////////////////////////////
     // File related properties
 
     bool isModified() const;
     bool isAssociatedToFile() const;
     void markAsSaved();
+    void markAsSaved(const undo::UndoState* savedState);
 
     // You can use this to indicate that we've destroyed (or we cannot
     // trust) the file associated with the document (e.g. when we
@@ -238,8 +266,13 @@ namespace app {
     virtual void onContextChanged();
 
   private:
+    struct PendingNotifications;
+
     void removeFromContext();
+    bool lock(const base::RWLock::LockType lockType, int timeout);
     void updateOSColorSpace(bool appWideSignal);
+    PendingNotifications* pendingNotifications();
+    void flushNotifications();
 
     // The document is in the collection of documents of this context.
     Context* m_ctx;
@@ -277,6 +310,10 @@ namespace app {
     // Last used color space to render a sprite.
     os::ColorSpaceRef m_osColorSpace;
 
+    // Notifications grouped by NotificationsBatch
+    int m_batchLevel = 0;
+    std::unique_ptr<PendingNotifications> m_pending;
+
     DISABLE_COPYING(Doc);
   };
 
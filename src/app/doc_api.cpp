@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -30,6 +30,7 @@
 #include "app/cmd/set_cel_frame.h"
 #include "app/cmd/set_cel_opacity.h"
 #include "app/cmd/set_cel_position.h"
+#include "app/cmd/set_cels_frames.h"
 #include "app/cmd/set_frame_duration.h"
 #include "app/cmd/set_mask.h"
 #include "app/cmd/set_mask_position.h"
@@ -39,6 +40,7 @@
 #include "app/cmd/set_tag_range.h"
 #include "app/cmd/set_total_frames.h"
 #include "app/cmd/set_transparent_color.h"
+#include "app/cmd/unlink_cel.h"
 #include "app/color_target.h"
 #include "app/color_utils.h"
 #include "app/context.h"
@@ -53,13 +55,16 @@
 #include "doc/cel.h"
 #include "doc/mask.h"
 #include "doc/palette.h"
+#include "doc/selected_frames.h"
 #include "doc/slice.h"
 #include "doc/tag.h"
 #include "doc/tags.h"
 #include "render/render.h"
+#include "sched/task_group.h"
 
 #include <algorithm>
 #include <iterator>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -70,6 +75,134 @@
 
 namespace app {
 
+namespace {
+
+// Cel to be cropped by DocApi::cropSprite()
+struct CelCrop {
+  LayerImage* layer = nullptr;
+  Cel* cel = nullptr;
+  color_t bg = 0;
+  gfx::Point newPosition;
+  ImageRef newImage;     // New cel image (nullptr to keep the current one)
+  bool remove = false;   // The cel is completely outside the new canvas
+};
+
+// Returns true if we have to crop the cel image, i.e. background
+// cels when the canvas size changes, or cels that aren't completely
+// inside the new canvas when we want to trim the outside content.
+bool cel_crop_needs_pixels(const CelCrop& crop,
+                           const gfx::Rect& bounds,
+                           const bool trimOutside)
+{
+  const Cel* cel = crop.cel;
+  if (cel->link() || crop.layer->isReference())
+    return false;
+
+  if (crop.layer->isBackground())
+    return (cel->bounds() != bounds);
+
+  return (trimOutside && !bounds.contains(cel->bounds()));
+}
+
+// Crops the cel image to the new canvas bounds. This is called from
+// a background task, so it must not modify the sprite (the
+// CelCrop::newImage/newPosition are used in DocApi::cropSprite()).
+void crop_cel_image(CelCrop& crop,
+                    const gfx::Rect& bounds)
+{
+  LayerImage* layer = crop.layer;
+  Cel* cel = crop.cel;
+  Image* image = cel->image();
+  if (!image)
+    return;
+
+  if (layer->isBackground()) {
+    ASSERT(cel->x() == 0);
+    ASSERT(cel->y() == 0);
+
+    crop.newImage.reset(
+      crop_image(image,
+                 bounds.x, bounds.y,
+                 bounds.w, bounds.h,
+                 crop.bg));
+    return;
+  }
+
+  // We want to crop a transparent cel and remove the content that is
+  // outside the sprite canvas. This might:
+  // 1. Clear the cel if the cel bounds will be totally outside in
+  //    the new canvas size
+  // 2. Replace the cel image if the cel must be cut in some edge
+  //    because it's not totally contained
+  gfx::Rect newCelBounds = (bounds & cel->bounds());
+  if (newCelBounds.isEmpty()) {
+    crop.remove = true;
+    return;
+  }
+
+  gfx::Point newCelPos = crop.newPosition;
+  newCelBounds.offset(-bounds.origin());
+
+  gfx::Point paintPos(newCelBounds.x - newCelPos.x,
+                      newCelBounds.y - newCelPos.y);
+
+  const color_t bg = image->pixelFormat() == IMAGE_TILEMAP ?
+                       notile :
+                       crop.bg;
+  newCelPos = newCelBounds.origin();
+
+  doc::Grid grid;
+  if (layer->isTilemap()) {
+    const Tileset* tileset = static_cast<LayerTilemap*>(layer)->tileset();
+    grid = tileset->grid();
+    grid.origin(cel->position());
+
+    newCelBounds.setOrigin(bounds.origin() + newCelPos);
+    newCelBounds = grid.canvasToTile(newCelBounds);
+    paintPos = newCelBounds.origin();
+    newCelPos = grid.tileToCanvas(paintPos) - bounds.origin();
+  }
+
+  // crop the image
+  ImageRef newImage(
+    crop_image(image,
+               paintPos.x, paintPos.y,
+               newCelBounds.w, newCelBounds.h,
+               bg));
+
+  // Try to shrink the image ignoring transparent borders
+  gfx::Rect frameBounds;
+  if (doc::algorithm::shrink_bounds(newImage.get(),
+                                    newImage->maskColor(),
+                                    layer, frameBounds)) {
+    // In this case the new cel image can be even smaller
+    if (frameBounds != newImage->bounds()) {
+      newImage = ImageRef(
+        crop_image(newImage.get(),
+                   frameBounds.x, frameBounds.y,
+                   frameBounds.w, frameBounds.h,
+                   bg));
+      if (layer->isTilemap())
+        newCelPos += grid.tileToCanvas(frameBounds.origin()) - grid.origin();
+      else
+        newCelPos += frameBounds.origin();
+    }
+  }
+  else {
+    crop.remove = true;
+    return;
+  }
+
+  // If it's the same image, we can re-use the cel image and just
+  // move the cel position.
+  if (!is_same_image(image, newImage.get()))
+    crop.newImage = newImage;
+
+  crop.newPosition = newCelPos;
+}
+
+} // anonymous namespace
+
 DocApi::HandleLinkedCels::HandleLinkedCels(
   DocApi& api,
   doc::LayerImage* srcLayer, const doc::frame_t srcFrame,
@@ -130,14 +263,72 @@ void DocApi::cropSprite(Sprite* sprite,
 
   setSpriteSize(sprite, bounds.w, bounds.h);
 
-  LayerList layers = sprite->allLayers();
-  for (Layer* layer : layers) {
+  // Unique cels of all image layers (linked cels are cropped only
+  // once)
+  std::vector<CelCrop> crops;
+  for (Layer* layer : sprite->allLayers()) {
     if (!layer->isImage())
       continue;
 
-    cropImageLayer(static_cast<LayerImage*>(layer), bounds, trimOutside);
+    auto imageLayer = static_cast<LayerImage*>(layer);
+    const color_t bg = m_document->bgColor(layer);
+    std::set<ObjectId> visited;
+    CelList cels;
+    imageLayer->getCels(cels);
+    for (Cel* cel : cels) {
+      if (!visited.insert(cel->data()->id()).second)
+        continue;
+
+      CelCrop crop;
+      crop.layer = imageLayer;
+      crop.cel = cel;
+      crop.bg = bg;
+      crop.newPosition = cel->position() - bounds.origin();
+      crops.push_back(crop);
+    }
   }
 
+  // Crop the images of the cels that don't fit in the new canvas (or
+  // background cels) in parallel. The other cels are just moved, so
+  // growing the canvas doesn't touch any pixel.
+  {
+    sched::TaskGroup tasks(sched::Priority::Interactive);
+    for (CelCrop& crop : crops) {
+      if (cel_crop_needs_pixels(crop, bounds, trimOutside))
+        tasks.run([&crop, &bounds]{ crop_cel_image(crop, bounds); });
+    }
+    tasks.wait();
+  }
+
+  CelList clearCels;
+  for (const CelCrop& crop : crops) {
+    Cel* cel = crop.cel;
+
+    if (crop.layer->isReference()) {
+      // Update the ref cel's bounds
+      gfx::RectF newBounds = cel->boundsF();
+      newBounds.x -= bounds.x;
+      newBounds.y -= bounds.y;
+      m_transaction.execute(new cmd::SetCelBoundsF(cel, newBounds));
+      continue;
+    }
+
+    // Delete this cel and its links
+    if (crop.remove) {
+      clearCels.push_back(cel);
+      continue;
+    }
+
+    if (crop.newImage)
+      replaceImage(sprite, cel->imageRef(), crop.newImage);
+
+    if (!crop.layer->isBackground())
+      setCelPosition(sprite, cel, crop.newPosition.x, crop.newPosition.y);
+  }
+
+  for (Cel* cel : clearCels)
+    clearCelAndAllLinks(cel);
+
   // Update mask position
   if (!m_document->mask()->isEmpty())
     setMaskPosition(m_document->mask()->bounds().x-bounds.x,
@@ -181,153 +372,6 @@ void DocApi::cropSprite(Sprite* sprite,
   }
 }
 
-void DocApi::cropImageLayer(LayerImage* layer,
-                            const gfx::Rect& bounds,
-                            const bool trimOutside)
-{
-  std::set<ObjectId> visited;
-  CelList cels, clearCels;
-  layer->getCels(cels);
-  for (Cel* cel : cels) {
-    if (visited.find(cel->data()->id()) != visited.end())
-      continue;
-    visited.insert(cel->data()->id());
-
-    if (!cropCel(layer, cel, bounds, trimOutside)) {
-      // Delete this cel and its links
-      clearCels.push_back(cel);
-    }
-  }
-
-  for (Cel* cel : clearCels)
-    clearCelAndAllLinks(cel);
-}
-
-// Returns false if the cel (and its links) must be deleted after this
-bool DocApi::cropCel(LayerImage* layer,
-                     Cel* cel,
-                     const gfx::Rect& bounds,
-                     const bool trimOutside)
-{
-  if (layer->isBackground()) {
-    Image* image = cel->image();
-    if (image && !cel->link()) {
-      ASSERT(cel->x() == 0);
-      ASSERT(cel->y() == 0);
-
-      ImageRef newImage(
-        crop_image(image,
-                   bounds.x, bounds.y,
-                   bounds.w, bounds.h,
-                   m_document->bgColor(layer)));
-
-      replaceImage(cel->sprite(),
-                   cel->imageRef(),
-                   newImage);
-    }
-    return true;
-  }
-
-  if (layer->isReference()) {
-    // Update the ref cel's bounds
-    gfx::RectF newBounds = cel->boundsF();
-    newBounds.x -= bounds.x;
-    newBounds.y -= bounds.y;
-    m_transaction.execute(new cmd::SetCelBoundsF(cel, newBounds));
-    return true;
-  }
-
-  gfx::Point newCelPos(cel->position() - bounds.origin());
-
-  // This is the complex case: we want to crop a transparent cel and
-  // remove the content that is outside the sprite canvas. This might
-  // generate one or two of the following Cmd:
-  // 1. Clear the cel ("return false" will generate a "cmd::ClearCel"
-  //    then) if the cel bounds will be totally outside in the new
-  //    canvas size
-  // 2. Replace the cel image if the cel must be cut in
-  //    some edge because it's not totally contained
-  // 3. Just set the cel position (the most common case)
-  //    if the cel image will be completely inside the new
-  //    canvas
-  if (trimOutside) {
-    Image* image = cel->image();
-    if (image && !cel->link()) {
-      gfx::Rect newCelBounds = (bounds & cel->bounds());
-
-      if (newCelBounds.isEmpty())
-        return false;
-
-      newCelBounds.offset(-bounds.origin());
-
-      gfx::Point paintPos(newCelBounds.x - newCelPos.x,
-                          newCelBounds.y - newCelPos.y);
-
-      const color_t bg = image->pixelFormat() == IMAGE_TILEMAP ?
-                           notile :
-                           m_document->bgColor(layer);
-      newCelPos = newCelBounds.origin();
-
-      doc::Grid grid;
-      if (layer->isTilemap()) {
-        const Tileset* tileset = static_cast<LayerTilemap*>(layer)->tileset();
-        grid = tileset->grid();
-        grid.origin(cel->position());
-
-        newCelBounds.setOrigin(bounds.origin() + newCelPos);
-        newCelBounds = grid.canvasToTile(newCelBounds);
-        paintPos = newCelBounds.origin();
-        newCelPos = grid.tileToCanvas(paintPos) - bounds.origin();
-      }
-
-      // crop the image
-      ImageRef newImage(
-        crop_image(image,
-                   paintPos.x, paintPos.y,
-                   newCelBounds.w, newCelBounds.h,
-                   bg));
-
-      // Try to shrink the image ignoring transparent borders
-      gfx::Rect frameBounds;
-      if (doc::algorithm::shrink_bounds(newImage.get(),
-                                        newImage->maskColor(),
-                                        layer, frameBounds)) {
-        // In this case the new cel image can be even smaller
-        if (frameBounds != newImage->bounds()) {
-          newImage = ImageRef(
-            crop_image(newImage.get(),
-                       frameBounds.x, frameBounds.y,
-                       frameBounds.w, frameBounds.h,
-                       bg));
-          if (layer->isTilemap())
-            newCelPos += grid.tileToCanvas(frameBounds.origin()) - grid.origin();
-          else
-            newCelPos += frameBounds.origin();
-        }
-      }
-      else {
-        // Delete this cel and its links
-        return false;
-      }
-
-      // If it's the same image, we can re-use the cel image and just
-      // move the cel position.
-      if (!is_same_image(cel->image(), newImage.get())) {
-        replaceImage(cel->sprite(),
-                     cel->imageRef(),
-                     newImage);
-      }
-    }
-  }
-
-  // Update the cel's position
-  setCelPosition(
-    cel->sprite(), cel,
-    newCelPos.x,
-    newCelPos.y);
-  return true;
-}
-
 void DocApi::trimSprite(Sprite* sprite, const bool byGrid)
 {
   gfx::Rect bounds = get_trimmed_bounds(sprite, byGrid);
@@ -620,6 +664,80 @@ void DocApi::copyCel(
                          dstLayer->isContinuous())));
 }
 
+bool DocApi::moveCels(Sprite* sprite,
+                      const LayerList& layers,
+                      const SelectedFrames& srcFrames,
+                      const SelectedFrames& dstFrames)
+{
+  for (const Layer* layer : layers) {
+    if (layer->isBackground())
+      return false;
+  }
+
+  // Pairs of frames to move (srcFrame -> dstFrame) in the same order
+  // that moveCel() would be called
+  std::vector<std::pair<frame_t, frame_t>> frames;
+  {
+    auto srcFrame = srcFrames.begin();
+    auto dstFrame = dstFrames.begin();
+    for (; srcFrame != srcFrames.end() &&
+           dstFrame != dstFrames.end(); ++srcFrame, ++dstFrame)
+      frames.push_back(std::make_pair(*srcFrame, *dstFrame));
+  }
+
+  // Check that moving all cels at the same time is the same as
+  // moving them one by one: a cel cannot be overwritten before it's
+  // moved, and a cel cannot be moved twice.
+  std::set<frame_t> pending, moved, srcSet;
+  for (const auto& pair : frames) {
+    pending.insert(pair.first);
+    srcSet.insert(pair.first);
+  }
+  frame_t lastDstFrame = 0;
+  for (const auto& pair : frames) {
+    pending.erase(pair.first);
+    if (moved.find(pair.first) != moved.end() ||
+        (pair.first != pair.second &&
+         pending.find(pair.second) != pending.end()))
+      return false;
+    moved.insert(pair.second);
+    lastDstFrame = std::max(lastDstFrame, pair.second);
+  }
+
+  auto setFrames = std::make_unique<cmd::SetCelsFrames>(sprite);
+  for (Layer* layer : layers) {
+    if (!layer->isImage())
+      continue;
+
+    for (const auto& pair : frames) {
+      if (pair.first == pair.second)
+        continue;
+
+      // Clear destination cels that are not moved (they'll be
+      // overriden by the moved cels)
+      if (srcSet.find(pair.second) == srcSet.end()) {
+        if (Cel* dstCel = layer->cel(pair.second)) {
+          if (dstCel->links())
+            m_transaction.execute(new cmd::UnlinkCel(dstCel));
+          clearCel(dstCel);
+        }
+      }
+
+      if (Cel* srcCel = layer->cel(pair.first))
+        setFrames->addCel(srcCel, pair.second);
+    }
+  }
+
+  // Add empty frames until the last destination frame (as
+  // cmd::MoveCel does)
+  while (sprite->totalFrames() <= lastDstFrame)
+    m_transaction.execute(new cmd::AddFrame(sprite, sprite->totalFrames()));
+
+  if (!setFrames->empty())
+    m_transaction.execute(setFrames.release());
+  return true;
+}
+
 void DocApi::swapCel(
   LayerImage* layer, frame_t frame1, frame_t frame2)
 {
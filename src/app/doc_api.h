@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -15,6 +15,7 @@
 #include "doc/color.h"
 #include "doc/frame.h"
 #include "doc/image_ref.h"
+#include "doc/layer_list.h"
 #include "gfx/rect.h"
 
 #include <map>
@@ -28,6 +29,7 @@ namespace doc {
   class LayerImage;
   class Mask;
   class Palette;
+  class SelectedFrames;
   class Sprite;
 }
 
@@ -90,6 +92,17 @@ namespace app {
     void swapCel(
       LayerImage* layer, frame_t frame1, frame_t frame2);
 
+    // Moves the cels of the given layers from srcFrames to dstFrames
+    // (in the same layers) with just one undoable command (instead
+    // of one cmd::MoveCel for each cel). Returns false if the cels
+    // cannot be moved in this way (e.g. there is a background layer,
+    // or a cel would be overwritten before it's moved, which is
+    // handled moving cels one by one with moveCel()).
+    bool moveCels(Sprite* sprite,
+                  const LayerList& layers,
+                  const SelectedFrames& srcFrames,
+                  const SelectedFrames& dstFrames);
+
     // Layers API
     LayerImage* newLayer(LayerGroup* parent, const std::string& name);
     LayerGroup* newGroup(LayerGroup* parent, const std::string& name);
@@ -115,13 +128,6 @@ namespace app {
     void setPalette(Sprite* sprite, frame_t frame, const Palette* newPalette);
 
   private:
-    void cropImageLayer(LayerImage* layer,
-                        const gfx::Rect& bounds,
-                        const bool trimOutside);
-    bool cropCel(LayerImage* layer,
-                 Cel* cel,
-                 const gfx::Rect& bounds,
-                 const bool trimOutside);
     void setCelFramePosition(Cel* cel, frame_t frame);
     void moveFrameLayer(Layer* layer, frame_t frame, frame_t beforeFrame);
     void adjustTags(Sprite* sprite,
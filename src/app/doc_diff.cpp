@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,6 +24,8 @@
 #include "doc/tilesets.h"
 #include "doc/user_data.h"
 
+#include <unordered_map>
+
 #ifdef _DEBUG
 namespace doc {
 
@@ -46,10 +48,16 @@ namespace app {
 #endif
 
 DocDiff compare_docs(const Doc* a,
-                     const Doc* b)
+                     const Doc* b,
+                     const bool stopAtFirstDiff)
 {
   DocDiff diff;
 
+  // Returns true if we can stop comparing the documents
+  auto stop = [&diff, stopAtFirstDiff]{
+    return (stopAtFirstDiff && diff.anything);
+  };
+
   // Don't compare filenames
   //if (a->filename() != b->filename())...
 
@@ -64,6 +72,8 @@ DocDiff compare_docs(const Doc* a,
     TRACEDIFF(a->sprite()->pixelFormat(), b->sprite()->pixelFormat());
     TRACEDIFF(a->sprite()->userData(), b->sprite()->userData());
   }
+  if (stop())
+    return diff;
 
   // Frames layers
   if (a->sprite()->totalFrames() != b->sprite()->totalFrames()) {
@@ -81,6 +91,8 @@ DocDiff compare_docs(const Doc* a,
       }
     }
   }
+  if (stop())
+    return diff;
 
   // Tags
   if (a->sprite()->tags().size() != b->sprite()->tags().size()) {
@@ -110,12 +122,18 @@ DocDiff compare_docs(const Doc* a,
         TRACEDIFF((int)aTag->aniDir(), (int)bTag->aniDir());
         TRACEDIFF(aTag->repeat(), bTag->repeat());
         TRACEDIFF(aTag->userData(), bTag->userData());
+        break;
       }
     }
   }
+  if (stop())
+    return diff;
 
   // Palettes
   if (a->sprite()->getPalettes().size() != b->sprite()->getPalettes().size()) {
+    diff.anything = diff.palettes = true;
+  }
+  else {
     const PalettesList& aPals = a->sprite()->getPalettes();
     const PalettesList& bPals = b->sprite()->getPalettes();
     auto aIt = aPals.begin(), aEnd = aPals.end();
@@ -125,12 +143,15 @@ DocDiff compare_docs(const Doc* a,
       const Palette* aPal = *aIt;
       const Palette* bPal = *bIt;
 
-      if (aPal->countDiff(bPal, nullptr, nullptr)) {
+      if (aPal->frame() != bPal->frame() ||
+          aPal->countDiff(bPal, nullptr, nullptr)) {
         diff.anything = diff.palettes = true;
         break;
       }
     }
   }
+  if (stop())
+    return diff;
 
   // Compare tilesets
   const tile_index aTilesetSize = (a->sprite()->hasTilesets() ? a->sprite()->tilesets()->size(): 0);
@@ -173,6 +194,8 @@ DocDiff compare_docs(const Doc* a,
     }
   done:;
   }
+  if (stop())
+    return diff;
 
   // Compare layers
   if (a->sprite()->allLayersCount() != b->sprite()->allLayersCount()) {
@@ -184,7 +207,7 @@ DocDiff compare_docs(const Doc* a,
     auto aIt = aLayers.begin(), aEnd = aLayers.end();
     auto bIt = bLayers.begin(), bEnd = bLayers.end();
 
-    for (; aIt != aEnd && bIt != bEnd; ++aIt, ++bIt) {
+    for (; aIt != aEnd && bIt != bEnd && !stop(); ++aIt, ++bIt) {
       const Layer* aLay = *aIt;
       const Layer* bLay = *bIt;
 
@@ -202,7 +225,11 @@ DocDiff compare_docs(const Doc* a,
       }
 
       if (!diff.totalFrames) {
-        for (frame_t f=0; f<a->sprite()->totalFrames(); ++f) {
+        // Cel data (of linked cels) that we've already compared,
+        // so their images are compared only once
+        std::unordered_map<const CelData*, const CelData*> comparedData;
+
+        for (frame_t f=0; f<a->sprite()->totalFrames() && !stop(); ++f) {
           const Cel* aCel = aLay->cel(f);
           const Cel* bCel = bLay->cel(f);
 
@@ -222,10 +249,16 @@ DocDiff compare_docs(const Doc* a,
               TRACEDIFF(aCel->opacity(), bCel->opacity());
               TRACEDIFF(aCel->data()->userData(), bCel->data()->userData());
             }
-            if (aCel->image() && bCel->image()) {
+
+            auto it = comparedData.find(aCel->data());
+            if (it != comparedData.end() && it->second == bCel->data()) {
+              // The images of these linked cels were already compared
+            }
+            else if (aCel->image() && bCel->image()) {
               if (aCel->image()->bounds() != bCel->image()->bounds() ||
                   !is_same_image(aCel->image(), bCel->image()))
                 diff.anything = diff.images = true;
+              comparedData[aCel->data()] = bCel->data();
             }
             // In case one is nullptr and the other not
             else if (aCel->image() != bCel->image())
@@ -236,6 +269,9 @@ DocDiff compare_docs(const Doc* a,
     }
   }
 
+  if (stop())
+    return diff;
+
   // Compare color spaces
   if (!a->sprite()->colorSpace()->nearlyEqual(*b->sprite()->colorSpace())) {
     diff.anything = diff.colorProfiles = true;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -43,9 +43,13 @@ namespace app {
   };
 
   // Useful for testing purposes to detect if two documents (after
-  // some kind of operation) are equivalent.
+  // some kind of operation) are equivalent. If stopAtFirstDiff is
+  // true, the comparison finishes as soon as a difference is found
+  // (only DocDiff::anything and the first different field are
+  // valid), useful to know quickly if a document has changed.
   DocDiff compare_docs(const Doc* a,
-                       const Doc* b);
+                       const Doc* b,
+                       const bool stopAtFirstDiff = false);
 
 } // namespace app
 
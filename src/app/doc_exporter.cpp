@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,20 +16,21 @@
 #include "app/context.h"
 #include "app/doc.h"
 #include "app/file/file.h"
+#include "app/file/saved_files_recorder.h"
 #include "app/filename_formatter.h"
 #include "app/restore_visible_layers.h"
 #include "app/snap_to_grid.h"
 #include "app/util/autocrop.h"
+#include "app/util/skyline_packer.h"
 #include "base/convert_to.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
 #include "base/replace_string.h"
 #include "base/string.h"
+#include "base/thread_pool.h"
 #include "doc/algorithm/shrink_bounds.h"
 #include "doc/cel.h"
 #include "doc/image.h"
-#include "doc/images_map.h"
-#include "doc/images_map.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
@@ -38,7 +39,6 @@
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "doc/tag.h"
-#include "gfx/packing_rects.h"
 #include "gfx/rect_io.h"
 #include "gfx/size.h"
 #include "render/dithering.h"
@@ -47,12 +47,19 @@
 #include "ver/info.h"
 
 #include <algorithm>
+#include <charconv>
+#include <condition_variable>
 #include <cstdio>
 #include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <set>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #define DX_TRACE(...) // TRACEARGS
@@ -87,6 +94,101 @@ std::ostream& operator<<(std::ostream& os, const doc::UserData& data)
   return os;
 }
 
+// Buffer to write the JSON data of big sprite sheets (with thousands
+// of frames). Values are appended to a preallocated string (numbers
+// with std::to_chars and strings escaped in place), and the buffer is
+// written to the output stream each time it gets full, so we avoid
+// the formatting overhead of std::ostream for each value and we
+// don't keep the whole JSON in memory.
+class JsonBuffer {
+public:
+  static constexpr size_t kBufferSize = 64*1024;
+
+  JsonBuffer(std::ostream& os) : m_os(os) {
+    m_buf.reserve(kBufferSize + 1024);
+  }
+  ~JsonBuffer() { flush(); }
+
+  JsonBuffer& operator<<(const char* s) {
+    m_buf.append(s);
+    return checkFlush();
+  }
+
+  JsonBuffer& operator<<(const int value) {
+    char tmp[16];
+    auto res = std::to_chars(tmp, tmp+sizeof(tmp), value);
+    m_buf.append(tmp, res.ptr);
+    return checkFlush();
+  }
+
+  // Appends the given string escaping backslashes and quotes (as
+  // escape_for_json())
+  JsonBuffer& escaped(const std::string& s) {
+    for (const char chr : s) {
+      if (chr == '\\' || chr == '"')
+        m_buf.push_back('\\');
+      m_buf.push_back(chr);
+    }
+    return checkFlush();
+  }
+
+  void flush() {
+    if (!m_buf.empty()) {
+      m_os.write(m_buf.data(), m_buf.size());
+      m_buf.clear();
+    }
+  }
+
+private:
+  JsonBuffer& checkFlush() {
+    if (m_buf.size() >= kBufferSize)
+      flush();
+    return *this;
+  }
+
+  std::ostream& m_os;
+  std::string m_buf;
+};
+
+// Executes functions in a thread pool and waits until all of them
+// are finished.
+class TaskGroup {
+public:
+  TaskGroup(base::thread_pool& pool) : m_pool(pool) { }
+  ~TaskGroup() { wait(); }
+
+  void execute(std::function<void()>&& func) {
+    {
+      std::lock_guard lock(m_mutex);
+      ++m_pending;
+    }
+    m_pool.execute(
+      [this, func = std::move(func)]{
+        func();
+
+        std::lock_guard lock(m_mutex);
+        if (--m_pending == 0)
+          m_cv.notify_one();
+      });
+  }
+
+  void wait() {
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this]{ return m_pending == 0; });
+  }
+
+private:
+  base::thread_pool& m_pool;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+  int m_pending = 0;
+};
+
+int render_threads()
+{
+  return std::max(1, int(std::thread::hardware_concurrency()));
+}
+
 } // anonymous namespace
 
 namespace app {
@@ -169,6 +271,8 @@ public:
     m_extrude(extrude),
     m_isLinked(false),
     m_isDuplicated(false),
+    m_hasHash(false),
+    m_hash(0),
     m_originalSize(size),
     m_trimmedBounds(size),
     m_inTextureBounds(std::make_shared<gfx::Rect>(size)) {
@@ -234,7 +338,80 @@ public:
   void setLinked() { m_isLinked = true; }
   void setDuplicated() { m_isDuplicated = true; }
 
-  ImageRef createRender(ImageBufferPtr& imageBuf) {
+  // Content hash of the rendered sample (see
+  // DocExporter::calculateSampleHashes())
+  bool hasHash() const { return m_hasHash; }
+  uint64_t hash() const { return m_hash; }
+  void setHash(const uint64_t hash) {
+    m_hash = hash;
+    m_hasHash = true;
+  }
+
+  // Fills "state" with the values that affect the render of this
+  // sample (cel image versions, layer properties, etc.), so we can
+  // know if the sample would be rendered exactly in the same way
+  // comparing two states. Returns false if the state cannot be
+  // calculated (tilemaps, as their tiles can be modified without
+  // changing the versions of cels/layers).
+  bool renderState(std::vector<uint64_t>& state) const {
+    ASSERT(m_sprite);
+    state.clear();
+    state.push_back(m_trimmedBounds.x);
+    state.push_back(m_trimmedBounds.y);
+    state.push_back(m_trimmedBounds.w);
+    state.push_back(m_trimmedBounds.h);
+
+    if (m_image) {
+      state.push_back(m_image->id());
+      state.push_back(m_image->version());
+      return true;
+    }
+
+    const Palette* palette = m_sprite->palette(m_frame);
+    state.push_back(m_sprite->id());
+    state.push_back(m_sprite->version());
+    state.push_back(m_sprite->pixelFormat());
+    state.push_back(m_sprite->transparentColor());
+    state.push_back(palette->id());
+    state.push_back(palette->version());
+    state.push_back(m_frame);
+
+    if (m_selLayers) {
+      state.push_back(m_selLayers->size());
+      for (const Layer* layer : *m_selLayers)
+        state.push_back(layer->id());
+    }
+    else
+      state.push_back(0);
+
+    for (const Layer* layer : m_sprite->allLayers()) {
+      if (layer->isTilemap())
+        return false;
+
+      state.push_back(layer->id());
+      state.push_back(layer->version());
+      state.push_back(uint64_t(layer->flags()));
+      if (layer->isImage()) {
+        auto layerImage = static_cast<const LayerImage*>(layer);
+        state.push_back(layerImage->opacity());
+        state.push_back(uint64_t(layerImage->blendMode()));
+
+        if (const Cel* cel = layer->cel(m_frame)) {
+          state.push_back(cel->image()->id());
+          state.push_back(cel->image()->version());
+          state.push_back(cel->x());
+          state.push_back(cel->y());
+          state.push_back(cel->opacity());
+          state.push_back(cel->zIndex());
+        }
+        else
+          state.push_back(0);
+      }
+    }
+    return true;
+  }
+
+  ImageRef createRender(ImageBufferPtr& imageBuf) const {
     ASSERT(m_sprite);
 
     // We use the m_image as it is, it doesn't require a special
@@ -242,15 +419,43 @@ public:
     if (m_image)
       return m_image;
 
-    ImageRef render(
+    RestoreVisibleLayers layersVisibility;
+    if (m_selLayers)
+      layersVisibility.showSelectedLayers(m_sprite,
+                                          *m_selLayers);
+
+    render::Render render;
+    return createRender(render, imageBuf);
+  }
+
+  // Same as createRender(imageBuf) but the selected layers must be
+  // already visible (see renderVisibleLayers()).
+  ImageRef createRender(render::Render& render,
+                        ImageBufferPtr& imageBuf) const {
+    ASSERT(m_sprite);
+    if (m_image)
+      return m_image;
+
+    ImageRef image(
       Image::create(m_sprite->pixelFormat(),
                     m_trimmedBounds.w,
                     m_trimmedBounds.h,
                     imageBuf));
-    render->setMaskColor(m_sprite->transparentColor());
-    clear_image(render.get(), m_sprite->transparentColor());
-    renderSample(render.get(), 0, 0, false);
-    return render;
+    image->setMaskColor(m_sprite->transparentColor());
+    clear_image(image.get(), m_sprite->transparentColor());
+    renderVisibleLayers(render, image.get(), 0, 0, false);
+    return image;
+  }
+
+  // Size of the area that renderSample() modifies in the destination
+  // image.
+  gfx::Size renderedSize(bool extrude) const {
+    gfx::Size size = m_trimmedBounds.size();
+    if (extrude) {
+      size.w += 2;
+      size.h += 2;
+    }
+    return size;
   }
 
   void renderSample(doc::Image* dst, int x, int y, bool extrude) const {
@@ -260,7 +465,17 @@ public:
                                           *m_selLayers);
 
     render::Render render;
+    renderVisibleLayers(render, dst, x, y, extrude);
+  }
 
+  // Renders the sample without changing the visibility of the
+  // layers, i.e. the caller must show the selected layers
+  // previously. As this doesn't modify the sprite, several samples
+  // of the same sprite/layers can be rendered from different threads
+  // (each one with its own render::Render instance).
+  void renderVisibleLayers(render::Render& render,
+                           doc::Image* dst, int x, int y,
+                           bool extrude) const {
     // 1) We cannot use the Preferences because this is called from a non-UI thread
     // 2) We should use the new blend mode always when we're saving files
     //render.setNewBlend(Preferences::instance().experimental.newBlend());
@@ -321,6 +536,8 @@ private:
   bool m_extrude;
   bool m_isLinked;
   bool m_isDuplicated;
+  bool m_hasHash;
+  uint64_t m_hash;
   gfx::Size m_originalSize;
   gfx::Rect m_trimmedBounds;
   SharedRectPtr m_inTextureBounds;
@@ -360,6 +577,54 @@ public:
                              int shapePadding,
                              int& width, int& height,
                              base::task_token& token) = 0;
+
+protected:
+  // Finds duplicated samples using the content hash of each sample
+  // (calculated in DocExporter::calculateSampleHashes()). Samples
+  // are rendered and compared pixel by pixel only when their hashes
+  // match.
+  class Duplicates {
+  public:
+    Duplicates(const Samples& samples) : m_samples(samples) { }
+
+    // Returns the index of a previous sample with the same content
+    // as samples[i], or -1 if samples[i] is not a duplicate (in that
+    // case it's added as a candidate for the next samples).
+    int add(const int i) {
+      const Sample& sample = m_samples[i];
+      ASSERT(sample.hasHash());
+
+      auto& candidates = m_candidates[sample.hash()];
+      ImageRef sampleRender;
+      if (!candidates.empty()) {
+        sampleRender = render(sample);
+        for (Candidate& candidate : candidates) {
+          if (!candidate.render)
+            candidate.render = render(m_samples[candidate.index]);
+          if (is_same_image(candidate.render.get(), sampleRender.get()))
+            return candidate.index;
+        }
+      }
+      candidates.push_back(Candidate{ i, sampleRender });
+      return -1;
+    }
+
+  private:
+    struct Candidate {
+      int index;
+      ImageRef render;        // Rendered only on hash collisions
+    };
+
+    static ImageRef render(const Sample& sample) {
+      // We have to use one ImageBuffer for each image because we
+      // may keep several images in the candidates list.
+      ImageBufferPtr sampleBuf = std::make_shared<ImageBuffer>();
+      return sample.createRender(sampleBuf);
+    }
+
+    const Samples& m_samples;
+    std::unordered_map<uint64_t, std::vector<Candidate>> m_candidates;
+  };
 };
 
 class DocExporter::SimpleLayoutSamples : public DocExporter::LayoutSamples {
@@ -391,7 +656,7 @@ public:
     const Layer* oldLayer = nullptr;
     const Tag* oldTag = nullptr;
 
-    doc::ImagesMap duplicates;
+    Duplicates duplicates(samples);
     gfx::Point framePt(borderPadding, borderPadding);
     gfx::Size rowSize(0, 0);
 
@@ -417,20 +682,13 @@ public:
       }
 
       if (m_mergeDups || sample.isLinked()) {
-        doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-        doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-        auto it = duplicates.find(sampleRender);
-        if (it != duplicates.end()) {
-          const uint32_t j = it->second;
-
+        const int j = duplicates.add(i);
+        if (j >= 0) {
           sample.setDuplicated();
           sample.setSharedBounds(samples[j].sharedBounds());
           ++i;
           continue;
         }
-        else {
-          duplicates[sampleRender] = i;
-        }
       }
 
       const Sprite* sprite = sample.sprite();
@@ -532,10 +790,10 @@ public:
                      int shapePadding,
                      int& width, int& height,
                      base::task_token& token) override {
-    gfx::PackingRects pr(borderPadding, shapePadding);
-    doc::ImagesMap duplicates;
+    SkylinePacker pr(borderPadding, shapePadding);
+    Duplicates duplicates(samples);
 
-    uint32_t i = 0;
+    int i = 0;
     for (auto& sample : samples) {
       if (token.canceled())
         return;
@@ -547,19 +805,12 @@ public:
         continue;
       }
 
-      // We have to use one ImageBuffer for each image because we're
-      // going to store all images in the "duplicates" map.
-      doc::ImageBufferPtr sampleBuf = std::make_shared<doc::ImageBuffer>();
-      doc::ImageRef sampleRender(sample.createRender(sampleBuf));
-      auto it = duplicates.find(sampleRender);
-      if (it != duplicates.end()) {
-        const uint32_t j = it->second;
-
+      const int j = duplicates.add(i);
+      if (j >= 0) {
         sample.setDuplicated();
         sample.setSharedBounds(samples[j].sharedBounds());
       }
       else {
-        duplicates[sampleRender] = i;
         pr.add(sample.requiredSize());
       }
       ++i;
@@ -704,8 +955,14 @@ Doc* DocExporter::exportSheet(Context* ctx, base::task_token& token)
   token.set_progress(0.9f);
 
   // Save the metadata.
-  if (osbuf)
+  if (osbuf) {
     createDataFile(samples, os, texture);
+    if (fos.is_open()) {
+      fos.close();
+      if (fos)
+        SavedFilesRecorder::notify(m_dataFilename);
+    }
+  }
   token.set_progress(0.95f);
 
   // Save the image files.
@@ -883,6 +1140,65 @@ void DocExporter::captureSamples(Samples& samples,
 {
   DX_TRACE("DX: Capture samples");
 
+  // Calculates the bounds of the sample that must be kept after
+  // trimming it (returns false if the whole sample is transparent).
+  auto shrinkSample =
+    [this](const Sample& sample,
+           const Image* sampleRender,
+           const gfx::Rect& spriteBounds,
+           gfx::Rect& frameBounds) -> bool {
+      const Sprite* sprite = sample.sprite();
+      const Layer* layer = sample.layer();
+      doc::color_t refColor = 0;
+
+      if (m_trimCels) {
+        if ((layer &&
+             layer->isBackground()) ||
+            (!layer &&
+             sprite->backgroundLayer() &&
+             sprite->backgroundLayer()->isVisible())) {
+          refColor = get_pixel(sampleRender, 0, 0);
+        }
+        else {
+          refColor = sprite->transparentColor();
+        }
+      }
+      else if (m_ignoreEmptyCels)
+        refColor = sprite->transparentColor();
+
+      return algorithm::shrink_bounds(sampleRender,
+                                      refColor,
+                                      nullptr,        // layer
+                                      spriteBounds,   // startBounds
+                                      frameBounds);   // output bounds
+    };
+
+  struct ShrinkResult {
+    bool calculated = false;
+    bool nonEmpty = false;
+    gfx::Rect frameBounds;
+    bool cacheable = false;
+    std::vector<uint64_t> state; // Key for m_trimCache
+  };
+  std::unique_ptr<base::thread_pool> pool;
+
+  // Only the trimmed bounds used in this export are kept in the cache
+  TrimCache usedTrims;
+  auto trimState =
+    [this](const Sample& sample,
+           const gfx::Rect& spriteBounds,
+           ShrinkResult& result) {
+      result.cacheable = sample.renderState(result.state);
+      if (result.cacheable) {
+        result.state.push_back(spriteBounds.x);
+        result.state.push_back(spriteBounds.y);
+        result.state.push_back(spriteBounds.w);
+        result.state.push_back(spriteBounds.h);
+        result.state.push_back(m_trimCels);
+        result.state.push_back(m_ignoreEmptyCels);
+      }
+    };
+
   for (auto& item : m_documents) {
     if (token.canceled())
       return;
@@ -939,6 +1255,90 @@ void DocExporter::captureSamples(Samples& samples,
       }
     }
 
+    const gfx::Size sampleSize =
+      (item.image ? item.image->size():
+       item.splitGrid ? sprite->gridBounds().size():
+                        sprite->size());
+
+    // Render the samples that must be trimmed in parallel (each
+    // worker with its own render::Render), the loop below uses the
+    // calculated bounds in the same order as before. Linked cels are
+    // not pre-rendered as they will probably re-use a previous
+    // sample (if not, the sample is rendered in the loop itself).
+    // Samples that weren't modified since the previous export use
+    // the cached bounds.
+    std::map<frame_t, ShrinkResult> shrinkResults;
+    int pendingResults = 0;
+    if ((m_ignoreEmptyCels || m_trimCels) &&
+        !item.isOneImageOnly()) {
+      for (frame_t frame : item.getSelectedFrames()) {
+        const Cel* cel = (layer && layer->isImage() ? layer->cel(frame): nullptr);
+        if ((cel && cel->link() && m_mergeDuplicates) ||
+            (layer && layer->isImage() && !cel && m_ignoreEmptyCels))
+          continue;
+
+        ShrinkResult& result = shrinkResults[frame];
+        trimState(Sample(sampleSize, doc, sprite, item.image,
+                         item.selLayers.get(), frame, nullptr,
+                         std::string(), m_innerPadding, m_extrude),
+                  spriteBounds, result);
+        if (result.cacheable) {
+          auto it = m_trimCache.find(result.state);
+          if (it != m_trimCache.end()) {
+            result.calculated = true;
+            result.nonEmpty = it->second.nonEmpty;
+            result.frameBounds = it->second.bounds;
+            usedTrims.insert(*it);
+            continue;
+          }
+        }
+        ++pendingResults;
+      }
+    }
+    if (pendingResults > 1) {
+      if (!pool)
+        pool = std::make_unique<base::thread_pool>(render_threads());
+
+      // The visibility of layers is changed only once for all
+      // workers.
+      RestoreVisibleLayers layersVisibility;
+      if (item.selLayers)
+        layersVisibility.showSelectedLayers(sprite, *item.selLayers);
+
+      TaskGroup tasks(*pool);
+      for (auto& pair : shrinkResults) {
+        const frame_t frame = pair.first;
+        ShrinkResult* result = &pair.second;
+        if (result->calculated)
+          continue;
+
+        tasks.execute(
+          [&, frame, result]{
+            if (token.canceled())
+              return;
+
+            Sample sample(sampleSize, doc, sprite, item.image,
+                          item.selLayers.get(), frame, nullptr,
+                          std::string(), m_innerPadding, m_extrude);
+            render::Render render;
+            ImageBufferPtr imageBuf;
+            ImageRef sampleRender(sample.createRender(render, imageBuf));
+            result->nonEmpty = shrinkSample(sample, sampleRender.get(),
+                                            spriteBounds,
+                                            result->frameBounds);
+            result->calculated = true;
+          });
+      }
+      tasks.wait();
+
+      for (const auto& pair : shrinkResults) {
+        const ShrinkResult& result = pair.second;
+        if (result.calculated && result.cacheable)
+          usedTrims[result.state] = TrimResult{ result.nonEmpty,
+                                                result.frameBounds };
+      }
+    }
+
     frame_t outputFrame = 0;
     for (frame_t frame : item.getSelectedFrames()) {
       if (token.canceled())
@@ -962,9 +1362,7 @@ void DocExporter::captureSamples(Samples& samples,
       std::string filename = filename_formatter(format, fnInfo);
 
       Sample sample(
-        (item.image ? item.image->size():
-         item.splitGrid ? sprite->gridBounds().size():
-                          sprite->size()),
+        sampleSize,
         doc, sprite, item.image, item.selLayers.get(),
         frame, innerTag, filename,
         m_innerPadding, m_extrude);
@@ -1010,31 +1408,26 @@ void DocExporter::captureSamples(Samples& samples,
         if (layer && layer->isImage() && !cel && m_ignoreEmptyCels)
           continue;
 
-        ImageRef sampleRender(sample.createRender(m_sampleBuf));
-
         gfx::Rect frameBounds;
-        doc::color_t refColor = 0;
+        bool nonEmpty;
 
-        if (m_trimCels) {
-          if ((layer &&
-               layer->isBackground()) ||
-              (!layer &&
-               sprite->backgroundLayer() &&
-               sprite->backgroundLayer()->isVisible())) {
-            refColor = get_pixel(sampleRender.get(), 0, 0);
-          }
-          else {
-            refColor = sprite->transparentColor();
-          }
+        auto it = shrinkResults.find(frame);
+        if (it != shrinkResults.end() && it->second.calculated) {
+          nonEmpty = it->second.nonEmpty;
+          frameBounds = it->second.frameBounds;
+        }
+        else {
+          ImageRef sampleRender(sample.createRender(m_sampleBuf));
+          nonEmpty = shrinkSample(sample, sampleRender.get(),
+                                  spriteBounds, frameBounds);
+
+          ShrinkResult result;
+          trimState(sample, spriteBounds, result);
+          if (result.cacheable)
+            usedTrims[result.state] = TrimResult{ nonEmpty, frameBounds };
         }
-        else if (m_ignoreEmptyCels)
-          refColor = sprite->transparentColor();
 
-        if (!algorithm::shrink_bounds(sampleRender.get(),
-                                      refColor,
-                                      nullptr,        // layer
-                                      spriteBounds,   // startBounds
-                                      frameBounds)) { // output bounds
+        if (!nonEmpty) {
           // If shrink_bounds() returns false, it's because the whole
           // image is transparent (equal to the mask color).
 
@@ -1103,6 +1496,50 @@ void DocExporter::captureSamples(Samples& samples,
                "InTextureBounds:", sample.inTextureBounds());
     }
   }
+
+  m_trimCache = std::move(usedTrims);
+}
+
+void DocExporter::calculateSampleHashes(Samples& samples,
+                                        base::task_token& token)
+{
+  DX_TRACE("DX: Calculate sample hashes");
+
+  // Packed sheets always merge duplicates
+  const bool allSamples = (m_mergeDuplicates ||
+                           m_sheetType == SpriteSheetType::Packed);
+
+  // Only the hashes used in this export are kept in the cache
+  HashCache usedHashes;
+  std::vector<uint64_t> state;
+
+  for (auto& sample : samples) {
+    if (token.canceled())
+      return;
+
+    if (sample.isEmpty() ||
+        (!allSamples && !sample.isLinked()))
+      continue;
+
+    const bool cacheable = sample.renderState(state);
+    if (cacheable) {
+      auto it = m_hashCache.find(state);
+      if (it != m_hashCache.end()) {
+        sample.setHash(it->second);
+        usedHashes.insert(*it);
+        continue;
+      }
+    }
+
+    ImageRef sampleRender(sample.createRender(m_sampleBuf));
+    const uint64_t hash =
+      calculate_image_hash64(sampleRender.get(), sampleRender->bounds());
+    sample.setHash(hash);
+    if (cacheable)
+      usedHashes[state] = hash;
+  }
+
+  m_hashCache = std::move(usedHashes);
 }
 
 void DocExporter::layoutSamples(Samples& samples,
@@ -1111,6 +1548,10 @@ void DocExporter::layoutSamples(Samples& samples,
   int width = m_textureWidth;
   int height = m_textureHeight;
 
+  calculateSampleHashes(samples, token);
+  if (token.canceled())
+    return;
+
   switch (m_sheetType) {
     case SpriteSheetType::Packed: {
       BestFitLayoutSamples layout;
@@ -1252,24 +1693,41 @@ void DocExporter::renderTexture(Context* ctx,
 {
   textureImage->clear(textureImage->maskColor());
 
-  int i = 0;
-  for (const auto& sample : samples) {
+  // Samples are rendered in parallel, each one in its own image by a
+  // worker with its own render::Render, and then copied to the
+  // texture (the only serialized step). Consecutive samples that
+  // share the same sprite and selected layers are rendered in
+  // group, so the visibility of layers is changed only between
+  // groups.
+  std::unique_ptr<base::thread_pool> pool;
+  std::mutex textureMutex;
+  int rendered = 0;
+
+  const int n = samples.size();
+  for (int i=0; i<n; ) {
     if (token.canceled())
       return;
-    token.set_progress(0.6f + 0.2f * i / int(samples.size()));
 
-    if (sample.isLinked() ||
-        sample.isDuplicated() ||
-        sample.isEmpty()) {
-      ++i;
-      continue;
+    const Sample& first = samples[i];
+    bool renderGroup = false;
+    int j = i;
+    for (; j<n; ++j) {
+      const Sample& sample = samples[j];
+      if (sample.sprite() != first.sprite() ||
+          sample.selectedLayers() != first.selectedLayers())
+        break;
+      if (!sample.isLinked() &&
+          !sample.isDuplicated() &&
+          !sample.isEmpty())
+        renderGroup = true;
     }
 
     // Make the sprite compatible with the texture so the render()
     // works correctly.
-    if (sample.sprite()->pixelFormat() != textureImage->pixelFormat()) {
+    if (renderGroup &&
+        first.sprite()->pixelFormat() != textureImage->pixelFormat()) {
       cmd::SetPixelFormat(
-        sample.sprite(),
+        first.sprite(),
         textureImage->pixelFormat(),
         render::Dithering(),
         Sprite::DefaultRgbMapAlgorithm(), // TODO add rgbmap algorithm preference
@@ -1278,12 +1736,55 @@ void DocExporter::renderTexture(Context* ctx,
         .execute(ctx);
     }
 
-    sample.renderSample(
-      textureImage,
-      sample.inTextureBounds().x+m_innerPadding,
-      sample.inTextureBounds().y+m_innerPadding,
-      m_extrude);
-    ++i;
+    RestoreVisibleLayers layersVisibility;
+    if (first.selectedLayers())
+      layersVisibility.showSelectedLayers(first.sprite(),
+                                          *first.selectedLayers());
+
+    if (!pool && j-i > 1)
+      pool = std::make_unique<base::thread_pool>(render_threads());
+
+    std::unique_ptr<TaskGroup> tasks;
+    if (pool)
+      tasks = std::make_unique<TaskGroup>(*pool);
+
+    for (; i<j; ++i) {
+      const Sample& sample = samples[i];
+      if (sample.isLinked() ||
+          sample.isDuplicated() ||
+          sample.isEmpty()) {
+        std::lock_guard lock(textureMutex);
+        token.set_progress(0.6f + 0.2f * ++rendered / n);
+        continue;
+      }
+
+      auto renderFunc =
+        [this, &sample, &token, &textureMutex, &rendered,
+         textureImage, n]{
+          if (token.canceled())
+            return;
+
+          ImageSpec spec = textureImage->spec();
+          spec.setSize(sample.renderedSize(m_extrude));
+          std::unique_ptr<Image> sampleImage(Image::create(spec));
+          sampleImage->clear(spec.maskColor());
+
+          render::Render render;
+          sample.renderVisibleLayers(render, sampleImage.get(),
+                                     0, 0, m_extrude);
+
+          std::lock_guard lock(textureMutex);
+          copy_image(textureImage, sampleImage.get(),
+                     sample.inTextureBounds().x+m_innerPadding,
+                     sample.inTextureBounds().y+m_innerPadding);
+          token.set_progress(0.6f + 0.2f * ++rendered / n);
+        };
+
+      if (tasks)
+        tasks->execute(std::move(renderFunc));
+      else
+        renderFunc();
+    }
   }
 }
 
@@ -1353,45 +1854,54 @@ void DocExporter::createDataFile(const Samples& samples,
       break;
   }
 
-  os << "{ \"frames\": " << frames_begin << "\n";
-  for (Samples::const_iterator
-         it = samples.begin(),
-         end = samples.end(); it != end; ) {
-    const Sample& sample = *it;
-    gfx::Size srcSize = sample.originalSize();
-    gfx::Rect spriteSourceBounds = sample.trimmedBounds();
-    gfx::Rect frameBounds = sample.inTextureBounds();
-
-    if (filename_as_key)
-      os << "   \"" << escape_for_json(sample.filename()) << "\": {\n";
-    else if (filename_as_attr)
-      os << "   {\n"
-         << "    \"filename\": \"" << escape_for_json(sample.filename()) << "\",\n";
-
-    os << "    \"frame\": { "
-       << "\"x\": " << frameBounds.x + nonExtrudedPosition << ", "
-       << "\"y\": " << frameBounds.y + nonExtrudedPosition << ", "
-       << "\"w\": " << frameBounds.w + nonExtrudedSize << ", "
-       << "\"h\": " << frameBounds.h + nonExtrudedSize << " },\n"
-       << "    \"rotated\": false,\n"
-       << "    \"trimmed\": " << (sample.trimmed() ? "true": "false") << ",\n"
-       << "    \"spriteSourceSize\": { "
-       << "\"x\": " << spriteSourceBounds.x << ", "
-       << "\"y\": " << spriteSourceBounds.y << ", "
-       << "\"w\": " << spriteSourceBounds.w << ", "
-       << "\"h\": " << spriteSourceBounds.h << " },\n"
-       << "    \"sourceSize\": { "
-       << "\"w\": " << srcSize.w << ", "
-       << "\"h\": " << srcSize.h << " },\n"
-       << "    \"duration\": " << sample.sprite()->frameDuration(sample.frame()) << "\n"
-       << "   }";
-
-    if (++it != samples.end())
-      os << ",\n";
-    else
-      os << "\n";
+  // The list of frames is the biggest part of the data file, so it's
+  // written with a JsonBuffer
+  {
+    JsonBuffer buf(os);
+    buf << "{ \"frames\": " << frames_begin.c_str() << "\n";
+    for (Samples::const_iterator
+           it = samples.begin(),
+           end = samples.end(); it != end; ) {
+      const Sample& sample = *it;
+      gfx::Size srcSize = sample.originalSize();
+      gfx::Rect spriteSourceBounds = sample.trimmedBounds();
+      gfx::Rect frameBounds = sample.inTextureBounds();
+
+      if (filename_as_key) {
+        buf << "   \"";
+        buf.escaped(sample.filename()) << "\": {\n";
+      }
+      else if (filename_as_attr) {
+        buf << "   {\n"
+            << "    \"filename\": \"";
+        buf.escaped(sample.filename()) << "\",\n";
+      }
+
+      buf << "    \"frame\": { "
+          << "\"x\": " << frameBounds.x + nonExtrudedPosition << ", "
+          << "\"y\": " << frameBounds.y + nonExtrudedPosition << ", "
+          << "\"w\": " << frameBounds.w + nonExtrudedSize << ", "
+          << "\"h\": " << frameBounds.h + nonExtrudedSize << " },\n"
+          << "    \"rotated\": false,\n"
+          << "    \"trimmed\": " << (sample.trimmed() ? "true": "false") << ",\n"
+          << "    \"spriteSourceSize\": { "
+          << "\"x\": " << spriteSourceBounds.x << ", "
+          << "\"y\": " << spriteSourceBounds.y << ", "
+          << "\"w\": " << spriteSourceBounds.w << ", "
+          << "\"h\": " << spriteSourceBounds.h << " },\n"
+          << "    \"sourceSize\": { "
+          << "\"w\": " << srcSize.w << ", "
+          << "\"h\": " << srcSize.h << " },\n"
+          << "    \"duration\": " << sample.sprite()->frameDuration(sample.frame()) << "\n"
+          << "   }";
+
+      if (++it != samples.end())
+        buf << ",\n";
+      else
+        buf << "\n";
+    }
+    buf << " " << frames_end.c_str();
   }
-  os << " " << frames_end;
 
   // "meta" property
   os << ",\n"
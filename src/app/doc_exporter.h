@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,7 +21,9 @@
 #include "gfx/fwd.h"
 #include "gfx/rect.h"
 
+#include <cstdint>
 #include <iosfwd>
+#include <map>
 #include <memory>
 #include <string>
 #include <utility>
@@ -114,6 +116,8 @@ namespace app {
       const bool splitGrid);
     void captureSamples(Samples& samples,
                         base::task_token& token);
+    void calculateSampleHashes(Samples& samples,
+                               base::task_token& token);
     void layoutSamples(Samples& samples,
                        base::task_token& token);
     gfx::Size calculateSheetSize(const Samples& samples,
@@ -196,6 +200,23 @@ namespace app {
       bool trimmedByGrid;
     } m_cache;
 
+    // Content hashes of rendered samples (to find duplicates) indexed
+    // by the render state of each sample, so they can be re-used in
+    // the next export while the sprites are not modified.
+    typedef std::map<std::vector<uint64_t>, uint64_t> HashCache;
+    HashCache m_hashCache;
+
+    // Trimmed bounds of samples (calculated with shrink_bounds())
+    // indexed by the render state of each sample and the trim
+    // options, so we don't need to render the samples again to trim
+    // them in the next export.
+    struct TrimResult {
+      bool nonEmpty;
+      gfx::Rect bounds;
+    };
+    typedef std::map<std::vector<uint64_t>, TrimResult> TrimCache;
+    TrimCache m_trimCache;
+
     DISABLE_COPYING(DocExporter);
   };
 
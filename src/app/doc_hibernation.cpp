@@ -0,0 +1,146 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/doc_hibernation.h"
+
+#include "app/doc.h"
+#include "app/doc_undo.h"
+#include "app/pref/preferences.h"
+#include "app/ui/doc_view.h"
+#include "app/ui_context.h"
+#include "app/util/compact_doc.h"
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/sprite.h"
+#include "sched/task_group.h"
+#include "ui/manager.h"
+#include "ui/timer.h"
+
+#define HIBERNATION_TRACE(...) // TRACEARGS
+
+namespace app {
+
+// Period to check the inactive documents
+static const int kCheckPeriodMSecs = 30000;
+
+DocHibernation::DocHibernation(const Preferences& pref)
+  : m_pref(pref)
+{
+}
+
+DocHibernation::~DocHibernation()
+{
+  ASSERT(m_docs.empty());
+}
+
+void DocHibernation::addDoc(Doc* doc)
+{
+  m_docs[doc] = DocState{ base::current_tick(), false };
+
+  // The timer is created with the first document as the UI manager
+  // doesn't exist when the context is created
+  if (!m_timer && ui::Manager::getDefault()) {
+    m_timer = std::make_unique<ui::Timer>(kCheckPeriodMSecs);
+    m_timer->Tick.connect([this]{ onTick(); });
+    m_timer->start();
+  }
+}
+
+void DocHibernation::removeDoc(Doc* doc)
+{
+  // The document is not uncompressed here, if it's reopened,
+  // ClosedDocs::reopenLastClosedDoc() uncompresses it
+  m_docs.erase(doc);
+
+  // Destroy the timer with the last document (before the UI manager
+  // is destroyed when we close the app)
+  if (m_docs.empty())
+    m_timer.reset();
+}
+
+void DocHibernation::wakeUp(Doc* doc)
+{
+  auto it = m_docs.find(doc);
+  if (it == m_docs.end())
+    return;
+
+  DocState& state = it->second;
+  state.lastVisible = base::current_tick();
+  if (!state.hibernated)
+    return;
+
+  HIBERNATION_TRACE("HIBERNATION: Wake up doc", doc);
+
+  state.hibernated = false;
+  uncompact_doc(doc);
+}
+
+void DocHibernation::onTick()
+{
+  if (!m_pref.general.hibernateInactiveSprites())
+    return;
+
+  const base::tick_t now = base::current_tick();
+  const base::tick_t hibernateAfterMSecs =
+    base::tick_t(1000.0*60.0*m_pref.general.hibernateInactiveSpritesAfter());
+
+  for (auto& [doc, state] : m_docs) {
+    if (state.hibernated)
+      continue;
+
+    // Documents visible in some view (e.g. the active tab of each
+    // workspace panel) are never hibernated
+    bool visible = false;
+    for (DocView* docView : UIContext::instance()->getAllDocViews(doc)) {
+      if (docView->isVisible()) {
+        visible = true;
+        break;
+      }
+    }
+    if (visible) {
+      state.lastVisible = now;
+      continue;
+    }
+
+    if (now - state.lastVisible < hibernateAfterMSecs)
+      continue;
+
+    // Try again in the next tick if the document is being used
+    // (e.g. the data recovery thread is saving it)
+    if (!doc->writeLock(0))
+      continue;
+
+    hibernate(doc);
+    doc->unlock();
+    state.hibernated = true;
+  }
+}
+
+void DocHibernation::hibernate(Doc* doc)
+{
+  HIBERNATION_TRACE("HIBERNATION: Hibernate doc", doc);
+
+  // The compressed payloads are uncompressed when they are needed
+  // again (e.g. to undo)
+  doc->undoHistory()->compact();
+
+  // Compress all cel images in parallel. We can access the images
+  // from other threads because the document is locked for writing
+  // and the UI thread is waiting the tasks.
+  sched::TaskGroup tasks(sched::Priority::Interactive);
+  for (doc::Cel* cel : doc->sprite()->uniqueCels()) {
+    doc::CelData* celData = cel->data();
+    if (celData->isImageLoaded())
+      tasks.run([celData]{ compact_cel_data(celData); });
+  }
+  tasks.wait();
+}
+
+} // namespace app
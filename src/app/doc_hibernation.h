@@ -0,0 +1,59 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_DOC_HIBERNATION_H_INCLUDED
+#define APP_DOC_HIBERNATION_H_INCLUDED
+#pragma once
+
+#include "base/time.h"
+
+#include <map>
+#include <memory>
+
+namespace ui {
+  class Timer;
+}
+
+namespace app {
+
+  class Doc;
+  class Preferences;
+
+  // Compacts the documents that are not visible in any editor for
+  // some minutes (e.g. sprites opened in inactive tabs), so the
+  // memory used by the cel images and the undo history of all opened
+  // documents is bounded by the ones we are working with. Images are
+  // compressed in memory (as ClosedDocs does with closed documents)
+  // and uncompressed again when the document is shown in a view.
+  class DocHibernation {
+  public:
+    DocHibernation(const Preferences& pref);
+    ~DocHibernation();
+
+    void addDoc(Doc* doc);
+    void removeDoc(Doc* doc);
+
+    // Called when the document is going to be shown in a view, it
+    // uncompresses the document if it was hibernated.
+    void wakeUp(Doc* doc);
+
+  private:
+    void onTick();
+    void hibernate(Doc* doc);
+
+    struct DocState {
+      base::tick_t lastVisible;
+      bool hibernated;
+    };
+
+    const Preferences& m_pref;
+    std::map<Doc*, DocState> m_docs;
+    std::unique_ptr<ui::Timer> m_timer;
+  };
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,7 @@
 
 #include "app/app.h"
 #include "app/context_access.h"
+#include "app/doc.h"
 #include "app/doc_api.h"
 #include "app/doc_range.h"
 #include "app/transaction.h"
@@ -42,6 +43,14 @@ static void move_or_copy_cels(
 {
   ASSERT(srcLayers.size() == dstLayers.size());
 
+  // Cels moved to other frames in the same layers can be moved at
+  // once (instead of one cmd::MoveCel for each cel)
+  if (op == Move && !srcLayers.empty() && srcLayers == dstLayers &&
+      api.moveCels(srcLayers.front()->sprite(),
+                   srcLayers, srcFrames, dstFrames)) {
+    return;
+  }
+
   for (layer_t i=0; i<srcLayers.size(); ++i) {
     auto srcFrame = srcFrames.begin();
     auto dstFrame = dstFrames.begin();
@@ -336,8 +345,9 @@ static DocRange drop_range_op(
     Tx tx(writer.context(), undoLabel, ModifyDocument);
     DocApi api = doc->getApi(tx);
 
-    // TODO Try to add the range with just one call to DocApi
-    // methods, to avoid generating a lot of cmd::SetCelFrame (see
+    // TODO Try to add the range of frames/layers with just one call
+    // to DocApi methods (as we do with DocApi::moveCels() for cels),
+    // to avoid generating a lot of cmd::SetCelFrame (see
     // DocApi::setCelFramePosition() function).
 
     switch (from.type()) {
@@ -471,6 +481,8 @@ DocRange move_range(Doc* doc,
                     const DocRangePlace place,
                     const TagsHandling tagsHandling)
 {
+  // Moving a range can generate one notification for each cel
+  Doc::NotificationsBatch batch(doc);
   return drop_range_op(doc, Move, from, place,
                        tagsHandling, DocRange(to));
 }
@@ -481,6 +493,7 @@ DocRange copy_range(Doc* doc,
                     const DocRangePlace place,
                     const TagsHandling tagsHandling)
 {
+  Doc::NotificationsBatch batch(doc);
   return drop_range_op(doc, Copy, from, place,
                        tagsHandling, DocRange(to));
 }
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -970,6 +971,43 @@ TEST_F(DocRangeOps, MoveCels) {
   EXPECT_CEL(0, 2, 0, 3);
   EXPECT_EMPTY_CEL(0, 0);
   doc->undoHistory()->undo();
+
+  // Moving several layers to the left with overlapping areas
+  move_range(doc.get(),
+             cels_range(1, 2, 2, 5),
+             cels_range(1, 0, 2, 3), ignore);
+  for (layer_t i=1; i<=2; ++i) {
+    EXPECT_CEL(i, 2, i, 0);
+    EXPECT_CEL(i, 3, i, 1);
+    EXPECT_CEL(i, 4, i, 2);
+    EXPECT_CEL(i, 5, i, 3);
+    EXPECT_EMPTY_CEL(i, 4);
+    EXPECT_EMPTY_CEL(i, 5);
+  }
+  EXPECT_CEL(0, 0, 0, 0);
+  EXPECT_CEL(3, 5, 3, 5);
+  doc->undoHistory()->undo();
+  for (layer_t i=1; i<=2; ++i)
+    for (frame_t j=0; j<6; ++j)
+      EXPECT_CEL(i, j, i, j);
+
+  // Moving cels after the last frame
+  move_range(doc.get(),
+             cels_range(1, 3, 2, 5),
+             cels_range(1, 5, 2, 7), ignore);
+  EXPECT_EQ(8, sprite->totalFrames());
+  for (layer_t i=1; i<=2; ++i) {
+    EXPECT_CEL(i, 3, i, 5);
+    EXPECT_CEL(i, 4, i, 6);
+    EXPECT_CEL(i, 5, i, 7);
+    EXPECT_EMPTY_CEL(i, 3);
+    EXPECT_EMPTY_CEL(i, 4);
+  }
+  doc->undoHistory()->undo();
+  EXPECT_EQ(6, sprite->totalFrames());
+  for (layer_t i=1; i<=2; ++i)
+    for (frame_t j=0; j<6; ++j)
+      EXPECT_CEL(i, j, i, j);
 }
 
 TEST_F(DocRangeOps, CopyLayers) {
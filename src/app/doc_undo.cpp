@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,6 +20,7 @@
 #include "app/pref/preferences.h"
 #include "base/mem_utils.h"
 #include "base/scoped_value.h"
+#include "perf/trace.h"
 #include "undo/undo_history.h"
 #include "undo/undo_state.h"
 
@@ -43,6 +44,7 @@ void DocUndo::setContext(Context* ctx)
 
 void DocUndo::add(CmdTransaction* cmd)
 {
+  PERF_ZONE("DocUndo::add");
   ASSERT(cmd);
 
   if (m_undoing) {
@@ -64,10 +66,20 @@ void DocUndo::add(CmdTransaction* cmd)
   m_undoHistory.add(cmd);
   m_totalUndoSize += cmd->memSize();
 
+  {
+    std::vector<UndoPayload*> payloads;
+    cmd->undoPayloads(payloads);
+    m_payloads.add(payloads);
+  }
+
   notify_observers(&DocUndoObserver::onAddUndoState, this);
   notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
 
   if (App::instance()) {
+    m_payloads.setMemoryBudget(
+      size_t(App::instance()->preferences().undo.memoryBudget())
+      * 1024 * 1024);
+
     const size_t undoLimitSize =
       int(App::instance()->preferences().undo.sizeLimit())
       * 1024 * 1024;
@@ -88,6 +100,9 @@ void DocUndo::add(CmdTransaction* cmd)
     }
   }
 
+  // Compress/move to disk the payloads of old states
+  m_payloads.update();
+
   UNDO_TRACE("UNDO: New undo size %s\n",
              base::get_pretty_memory_size(m_totalUndoSize).c_str());
 }
@@ -104,6 +119,7 @@ bool DocUndo::canRedo() const
 
 void DocUndo::undo()
 {
+  PERF_ZONE("DocUndo::undo");
   ASSERT(!m_undoing);
   base::ScopedValue undoing(m_undoing, true);
   const size_t oldSize = m_totalUndoSize;
@@ -115,6 +131,7 @@ void DocUndo::undo()
     m_undoHistory.undo();
     m_totalUndoSize += cmd->memSize();
   }
+  m_payloads.update();
   // This notification could execute a script that modifies the sprite
   // again (e.g. a script that is listening the "change" event, check
   // the SpriteEvents class). If the sprite is modified, the "cmd" is
@@ -126,6 +143,7 @@ void DocUndo::undo()
 
 void DocUndo::redo()
 {
+  PERF_ZONE("DocUndo::redo");
   ASSERT(!m_undoing);
   base::ScopedValue undoing(m_undoing, true);
   const size_t oldSize = m_totalUndoSize;
@@ -137,6 +155,7 @@ void DocUndo::redo()
     m_undoHistory.redo();
     m_totalUndoSize += cmd->memSize();
   }
+  m_payloads.update();
   notify_observers(&DocUndoObserver::onCurrentUndoStateChange, this);
   if (m_totalUndoSize != oldSize)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
@@ -200,7 +219,12 @@ bool DocUndo::isInSavedStateOrSimilar() const
 
 void DocUndo::markSavedState()
 {
-  m_savedState = currentState();
+  markSavedState(currentState());
+}
+
+void DocUndo::markSavedState(const undo::UndoState* state)
+{
+  m_savedState = state;
   m_savedStateIsLost = false;
   notify_observers(&DocUndoObserver::onNewSavedState, this);
 }
@@ -282,6 +306,7 @@ void DocUndo::moveToState(const undo::UndoState* state)
   base::ScopedValue undoing(m_undoing, true);
 
   m_undoHistory.moveTo(state);
+  m_payloads.update();
 
   // After onCurrentUndoStateChange don't use the "state" argument, it
   // might be deleted because some script might have modified the
@@ -300,6 +325,11 @@ void DocUndo::moveToState(const undo::UndoState* state)
     notify_observers(&DocUndoObserver::onTotalUndoSizeChange, this);
 }
 
+void DocUndo::compact()
+{
+  m_payloads.compressAll();
+}
+
 const undo::UndoState* DocUndo::nextUndo() const
 {
   return m_undoHistory.currentState();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -11,6 +11,7 @@
 
 #include "app/doc_range.h"
 #include "app/sprite_position.h"
+#include "app/undo_payload.h"
 #include "base/disable_copying.h"
 #include "base/exception.h"
 #include "obs/observable.h"
@@ -67,6 +68,10 @@ namespace app {
     // Marks current UndoState as the one that matches the sprite on
     // the disk (this is used after saving the file).
     void markSavedState();
+    // Marks the given UndoState (which must be in the history) as the
+    // saved state (e.g. when a copy of the document is saved in
+    // background and the user kept modifying the document).
+    void markSavedState(const undo::UndoState* state);
 
     // Indicates that now it's impossible to back to the version of
     // the sprite that matches the saved version. This can be because
@@ -100,6 +105,10 @@ namespace app {
 
     void moveToState(const undo::UndoState* state);
 
+    // Compresses all the data saved by the Cmds to reduce the memory
+    // used by the undo history (e.g. when the document is closed).
+    void compact();
+
   private:
     const undo::UndoState* nextUndo() const;
     const undo::UndoState* nextRedo() const;
@@ -107,6 +116,10 @@ namespace app {
     // undo::UndoHistoryDelegate impl
     void onDeleteUndoState(undo::UndoState* state) override;
 
+    // Pixels saved by the Cmds (declared before m_undoHistory as it
+    // must be destroyed after all the Cmds)
+    UndoPayloadStore m_payloads;
+
     undo::UndoHistory m_undoHistory;
     const undo::UndoState* m_savedState = nullptr;
     Context* m_ctx = nullptr;
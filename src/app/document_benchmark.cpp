@@ -0,0 +1,312 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+// Benchmarks of common operations with generated documents (several
+// layers, groups, frames, tilemaps, and color modes). Use
+// --benchmark_out=results.json --benchmark_out_format=json to save
+// the results and compare them between versions (e.g. with the
+// compare.py tool of Google Benchmark).
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_api.h"
+#include "app/doc_undo.h"
+#include "app/file/file.h"
+#include "app/test_context.h"
+#include "app/tx.h"
+#include "base/fs.h"
+#include "doc/cel.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tile.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+#include "render/onionskin_options.h"
+#include "render/projection.h"
+#include "render/render.h"
+
+#include <benchmark/benchmark.h>
+
+#include <iterator>
+#include <memory>
+#include <string>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+enum Arg {
+  kColorMode,                   // doc::ColorMode
+  kLayers,                      // Image layers in each group
+  kFrames,
+};
+
+const BlendMode kBlendModes[] = {
+  BlendMode::NORMAL,
+  BlendMode::MULTIPLY,
+  BlendMode::SCREEN,
+  BlendMode::OVERLAY,
+  BlendMode::DIFFERENCE,
+  BlendMode::HSL_HUE,
+};
+
+color_t make_color(const ColorMode colorMode, const int i)
+{
+  switch (colorMode) {
+    case ColorMode::RGB:
+      return rgba((i*67) & 255, (i*131) & 255, (i*37) & 255, 128 + (i*17) % 128);
+    case ColorMode::GRAYSCALE:
+      return graya((i*67) & 255, 128 + (i*17) % 128);
+    default:
+      return 1 + (i*7) % 255;
+  }
+}
+
+// Creates a document with two groups of "nlayers" image layers each
+// one (with different blend modes and opacities), and a tilemap
+// layer, in "nframes" frames.
+Doc* make_document(Context* ctx,
+                   const ColorMode colorMode,
+                   const int w, const int h,
+                   const int nlayers,
+                   const frame_t nframes)
+{
+  Doc* doc = ctx->documents().add(w, h, colorMode, 256);
+  Sprite* spr = doc->sprite();
+  spr->setTotalFrames(nframes);
+
+  LayerGroup* root = spr->root();
+  int i = 0;
+  for (int g=0; g<2; ++g) {
+    auto group = new LayerGroup(spr);
+    root->addLayer(group);
+
+    for (int l=0; l<nlayers; ++l, ++i) {
+      auto layer = new LayerImage(spr);
+      layer->setBlendMode(kBlendModes[i % std::size(kBlendModes)]);
+      layer->setOpacity(255 - (i*32) % 128);
+      group->addLayer(layer);
+
+      for (frame_t f=0; f<nframes; ++f) {
+        const int cw = w/2 + (i*13) % (w/2);
+        const int ch = h/2 + (i*29) % (h/2);
+        ImageRef image(Image::create(spr->pixelFormat(), cw, ch));
+        clear_image(image.get(), image->maskColor());
+        fill_ellipse(image.get(), 0, 0, cw-1, ch-1, 0, 0,
+                     make_color(colorMode, i+f));
+        fill_rect(image.get(), cw/4, ch/4, cw/2, ch/2,
+                  make_color(colorMode, i+f+1));
+
+        Cel* cel = new Cel(f, image);
+        cel->setPosition((i*31 + f*4) % (w/2),
+                         (i*17 + f*2) % (h/2));
+        layer->addCel(cel);
+      }
+    }
+  }
+
+  // Tilemap layer with a 4x4 tiles tileset
+  const int tileSize = 16;
+  auto tileset = new Tileset(spr, Grid(gfx::Size(tileSize, tileSize)), 5);
+  for (tile_index ti=1; ti<tileset->size(); ++ti) {
+    ImageRef tile(Image::create(spr->pixelFormat(), tileSize, tileSize));
+    clear_image(tile.get(), tile->maskColor());
+    fill_rect(tile.get(), 0, 0, tileSize/2+ti, tileSize/2,
+              make_color(colorMode, ti));
+    tileset->set(ti, tile);
+  }
+  const tileset_index tsi = spr->tilesets()->add(tileset);
+
+  auto tilemap = new LayerTilemap(spr, tsi);
+  root->addLayer(tilemap);
+  for (frame_t f=0; f<nframes; ++f) {
+    ImageRef image(Image::create(IMAGE_TILEMAP, w/tileSize, h/tileSize));
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        put_pixel(image.get(), x, y, doc::tile((x+y+f) % tileset->size(), 0));
+    tilemap->addCel(new Cel(f, image));
+  }
+
+  return doc;
+}
+
+std::unique_ptr<Doc> make_benchmark_document(Context* ctx,
+                                             const benchmark::State& state)
+{
+  return std::unique_ptr<Doc>(
+    make_document(ctx, ColorMode(state.range(kColorMode)),
+                  512, 512,
+                  state.range(kLayers),
+                  frame_t(state.range(kFrames))));
+}
+
+void render_frames(render::Render& render,
+                   Image* dst,
+                   const Sprite* spr,
+                   const gfx::ClipF& area)
+{
+  for (frame_t f=0; f<spr->totalFrames(); ++f)
+    render.renderSprite(dst, spr, f, area);
+}
+
+} // anonymous namespace
+
+void BM_RenderDocument(benchmark::State& state) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc = make_benchmark_document(&ctx, state);
+  const Sprite* spr = doc->sprite();
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, spr->width(), spr->height()));
+
+  render::Render render;
+  while (state.KeepRunning()) {
+    render_frames(render, dst.get(), spr,
+                  gfx::Clip(0, 0, spr->bounds()));
+  }
+  doc->close();
+}
+
+void BM_RenderDocumentZoomed(benchmark::State& state) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc = make_benchmark_document(&ctx, state);
+  const Sprite* spr = doc->sprite();
+
+  // A viewport of 800x600 pixels in the center of the sprite with
+  // zoom 400%
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, 800, 600));
+  const render::Projection proj(spr->pixelRatio(), render::Zoom(4, 1));
+  const gfx::Rect zoomedBounds(proj.apply(spr->bounds()));
+
+  render::Render render;
+  render.setProjection(proj);
+  while (state.KeepRunning()) {
+    render_frames(render, dst.get(), spr,
+                  gfx::Clip(0, 0,
+                            zoomedBounds.w/2 - dst->width()/2,
+                            zoomedBounds.h/2 - dst->height()/2,
+                            dst->width(), dst->height()));
+  }
+  doc->close();
+}
+
+void BM_RenderDocumentOnionskin(benchmark::State& state) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc = make_benchmark_document(&ctx, state);
+  const Sprite* spr = doc->sprite();
+  std::unique_ptr<Image> dst(Image::create(IMAGE_RGB, spr->width(), spr->height()));
+
+  render::OnionskinOptions onionskin(render::OnionskinType::MERGE);
+  onionskin.prevFrames(2);
+  onionskin.nextFrames(2);
+  onionskin.opacityBase(68);
+  onionskin.opacityStep(28);
+
+  render::Render render;
+  render.setOnionskin(onionskin);
+  while (state.KeepRunning()) {
+    render_frames(render, dst.get(), spr,
+                  gfx::Clip(0, 0, spr->bounds()));
+  }
+  doc->close();
+}
+
+void BM_SaveLoadDocument(benchmark::State& state) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc = make_benchmark_document(&ctx, state);
+  const std::string fn = "_document_benchmark.aseprite";
+  doc->setFilename(fn);
+
+  while (state.KeepRunning()) {
+    // Save all cels again
+    for (Cel* cel : doc->sprite()->uniqueCels())
+      cel->image()->incrementVersion();
+
+    save_document(&ctx, doc.get());
+
+    std::unique_ptr<Doc> loaded(load_document(&ctx, fn));
+    loaded->close();
+  }
+  doc->close();
+  base::delete_file(fn);
+}
+
+void BM_ExportDocument(benchmark::State& state) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc = make_benchmark_document(&ctx, state);
+
+  // Saves a sequence of flattened .png files (one for each frame)
+  const std::string dir = "_document_benchmark";
+  if (!base::is_directory(dir))
+    base::make_directory(dir);
+  doc->setFilename(base::join_path(dir, "frame.png"));
+
+  while (state.KeepRunning()) {
+    save_document(&ctx, doc.get());
+  }
+  doc->close();
+
+  for (const auto& file : base::list_files(dir))
+    base::delete_file(base::join_path(dir, file));
+  base::remove_directory(dir);
+}
+
+void BM_UndoRedoDocument(benchmark::State& state) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc = make_benchmark_document(&ctx, state);
+  Sprite* spr = doc->sprite();
+
+  // Flip all cels of all layers in one transaction
+  {
+    Tx tx(&ctx, "Flip");
+    DocApi api = doc->getApi(tx);
+    for (Cel* cel : spr->uniqueCels()) {
+      if (!cel->layer()->isTilemap())
+        api.flipImage(cel->image(), cel->image()->bounds(),
+                      doc::algorithm::FlipHorizontal);
+    }
+    tx.commit();
+  }
+
+  DocUndo* undo = doc->undoHistory();
+  while (state.KeepRunning()) {
+    undo->undo();
+    undo->redo();
+  }
+  doc->close();
+}
+
+#define DOCARGS(MODE)                   \
+  ->Args({ int(MODE), 1, 1 })           \
+  ->Args({ int(MODE), 4, 8 })           \
+  ->Args({ int(MODE), 16, 32 })
+
+#define DEFARGS()                       \
+  DOCARGS(ColorMode::RGB)               \
+  DOCARGS(ColorMode::GRAYSCALE)         \
+  DOCARGS(ColorMode::INDEXED)           \
+  ->ArgNames({ "mode", "layers", "frames" }) \
+  ->Unit(benchmark::kMillisecond)
+
+BENCHMARK(BM_RenderDocument) DEFARGS();
+BENCHMARK(BM_RenderDocumentZoomed) DEFARGS();
+BENCHMARK(BM_RenderDocumentOnionskin) DEFARGS();
+BENCHMARK(BM_SaveLoadDocument) DEFARGS()->UseRealTime();
+BENCHMARK(BM_ExportDocument) DEFARGS()->UseRealTime();
+BENCHMARK(BM_UndoRedoDocument) DEFARGS();
+
+int app_main(int argc, char* argv[])
+{
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -25,6 +25,9 @@
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "base/fstream_path.h"
+#include "base/serialization.h"
+#include "base/time.h"
+#include "doc/string_io.h"
 #include "render/dithering_matrix.h"
 #include "ui/widget.h"
 
@@ -46,6 +49,7 @@
 #include <queue>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 
 #include "base/log.h"
 
@@ -56,6 +60,7 @@ namespace {
 const char* kPackageJson = "package.json";
 const char* kInfoJson = "__info.json";
 const char* kPrefLua = "__pref.lua";
+const char* kManifestsCache = "__manifests.cache";
 const char* kAsepriteDefaultThemeExtensionName = "aseprite-theme";
 
 class ReadArchive {
@@ -784,6 +789,225 @@ void Extension::addScript(const std::string& fn)
 
 #endif // ENABLE_SCRIPTING
 
+//////////////////////////////////////////////////////////////////////
+// Extensions::Manifest
+
+// Information of a package.json file used to load an extension (the
+// paths are relative to the extension folder).
+struct Extensions::Manifest {
+  struct Item {
+    std::string id;
+    std::string path;
+    std::string extra;          // Theme variant or dithering matrix name
+  };
+  using Items = std::vector<Item>;
+
+  std::string name;
+  std::string version;
+  std::string displayName;
+  std::string authorUrl;
+  Items keys;
+  Items languages;
+  Items themes;
+  Items palettes;
+  Items ditheringMatrices;
+  std::vector<std::string> scripts;
+
+  void fromJson(const json11::Json& json) {
+    name = json["name"].string_value();
+    version = json["version"].string_value();
+    displayName = json["displayName"].string_value();
+    if (json["author"].is_object())
+      authorUrl = json["author"]["url"].string_value();
+
+    auto contributes = json["contributes"];
+    if (!contributes.is_object())
+      return;
+
+    itemsFromJson(contributes["keys"], nullptr, keys);
+    itemsFromJson(contributes["languages"], nullptr, languages);
+    itemsFromJson(contributes["themes"], "variant", themes);
+    itemsFromJson(contributes["palettes"], nullptr, palettes);
+    itemsFromJson(contributes["ditheringMatrices"], "name", ditheringMatrices);
+
+    auto scriptsJson = contributes["scripts"];
+    if (scriptsJson.is_array()) {
+      for (const auto& script : scriptsJson.array_items()) {
+        std::string scriptPath = script["path"].string_value();
+        if (!scriptPath.empty())
+          scripts.push_back(scriptPath);
+      }
+    }
+    // Simple version of packages.json with {... "scripts": "file.lua" ...}
+    else if (scriptsJson.is_string() &&
+             !scriptsJson.string_value().empty()) {
+      scripts.push_back(scriptsJson.string_value());
+    }
+  }
+
+  void write(std::ostream& os) const {
+    doc::write_string(os, name);
+    doc::write_string(os, version);
+    doc::write_string(os, displayName);
+    doc::write_string(os, authorUrl);
+    for (const Items* items : { &keys, &languages, &themes,
+                                &palettes, &ditheringMatrices }) {
+      base::serialization::little_endian::write16(os, uint16_t(items->size()));
+      for (const Item& item : *items) {
+        doc::write_string(os, item.id);
+        doc::write_string(os, item.path);
+        doc::write_string(os, item.extra);
+      }
+    }
+    base::serialization::little_endian::write16(os, uint16_t(scripts.size()));
+    for (const std::string& script : scripts)
+      doc::write_string(os, script);
+  }
+
+  bool read(std::istream& is) {
+    name = doc::read_string(is);
+    version = doc::read_string(is);
+    displayName = doc::read_string(is);
+    authorUrl = doc::read_string(is);
+    for (Items* items : { &keys, &languages, &themes,
+                          &palettes, &ditheringMatrices }) {
+      items->resize(base::serialization::little_endian::read16(is));
+      for (Item& item : *items) {
+        item.id = doc::read_string(is);
+        item.path = doc::read_string(is);
+        item.extra = doc::read_string(is);
+      }
+    }
+    scripts.resize(base::serialization::little_endian::read16(is));
+    for (std::string& script : scripts)
+      script = doc::read_string(is);
+    return is.good();
+  }
+
+private:
+  static void itemsFromJson(const json11::Json& json,
+                            const char* extraField,
+                            Items& items) {
+    if (!json.is_array())
+      return;
+
+    for (const auto& item : json.array_items()) {
+      items.push_back(Item{ item["id"].string_value(),
+                            item["path"].string_value(),
+                            (extraField ? item[extraField].string_value():
+                                          std::string()) });
+    }
+  }
+};
+
+//////////////////////////////////////////////////////////////////////
+// Extensions::ManifestCache
+
+// Binary file with the manifests of all the extensions loaded in the
+// last execution, so we don't need to parse the package.json files
+// that weren't modified (each entry is identified by the file size
+// and modification time of the package.json file).
+class Extensions::ManifestCache {
+public:
+  // Magic number of the cache file (increase the last number if the
+  // format changes)
+  static constexpr uint32_t kMagic = 0x41454D31; // "AEM1"
+
+  explicit ManifestCache(const std::string& fn) : m_fn(fn) {
+    if (m_fn.empty() || !base::is_file(m_fn))
+      return;
+
+    using namespace base::serialization::little_endian;
+    std::ifstream is(FSTREAM_PATH(m_fn), std::ifstream::binary);
+    if (read32(is) != kMagic)
+      return;
+
+    const uint32_t n = read32(is);
+    for (uint32_t i=0; i<n && is.good(); ++i) {
+      const std::string packageFn = doc::read_string(is);
+      Entry entry;
+      entry.size = read32(is);
+      entry.time.year = read16(is);
+      entry.time.month = read8(is);
+      entry.time.day = read8(is);
+      entry.time.hour = read8(is);
+      entry.time.minute = read8(is);
+      entry.time.second = read8(is);
+      if (!entry.manifest.read(is)) {
+        LOG("EXT: Invalid manifests cache '%s'\n", m_fn.c_str());
+        m_entries.clear();
+        return;
+      }
+      m_entries[packageFn] = std::move(entry);
+    }
+  }
+
+  // Returns the manifest of the given package.json file, parsing it
+  // only if it's not in the cache or it was modified.
+  const Manifest& manifest(const std::string& packageFn) {
+    Entry entry;
+    entry.size = base::file_size(packageFn);
+    entry.time = base::get_modification_time(packageFn);
+
+    auto it = m_entries.find(packageFn);
+    if (it != m_entries.end() &&
+        it->second.size == entry.size &&
+        it->second.time == entry.time) {
+      auto& used = m_used[packageFn];
+      used = std::move(it->second);
+      m_entries.erase(it);
+      return used.manifest;
+    }
+
+    json11::Json json;
+    read_json_file(packageFn, json);
+    entry.manifest.fromJson(json);
+
+    m_modified = true;
+    auto& used = m_used[packageFn];
+    used = std::move(entry);
+    return used.manifest;
+  }
+
+  // Saves the manifests that were used in this execution (if there
+  // are new, modified, or removed extensions)
+  void save() {
+    if (m_fn.empty() ||
+        (!m_modified && m_entries.empty()))
+      return;
+
+    using namespace base::serialization::little_endian;
+    std::ofstream os(FSTREAM_PATH(m_fn), std::ofstream::binary);
+    write32(os, kMagic);
+    write32(os, uint32_t(m_used.size()));
+    for (const auto& it : m_used) {
+      const Entry& entry = it.second;
+      doc::write_string(os, it.first);
+      write32(os, uint32_t(entry.size));
+      write16(os, entry.time.year);
+      write8(os, entry.time.month);
+      write8(os, entry.time.day);
+      write8(os, entry.time.hour);
+      write8(os, entry.time.minute);
+      write8(os, entry.time.second);
+      entry.manifest.write(os);
+    }
+    LOG("EXT: Manifests cache saved in '%s'\n", m_fn.c_str());
+  }
+
+private:
+  struct Entry {
+    size_t size = 0;
+    base::Time time;
+    Manifest manifest;
+  };
+
+  std::string m_fn;
+  std::unordered_map<std::string, Entry> m_entries; // Entries from the file (not used yet)
+  std::unordered_map<std::string, Entry> m_used;    // Entries used in this execution
+  bool m_modified = false;
+};
+
 //////////////////////////////////////////////////////////////////////
 // Extensions
 
@@ -802,6 +1026,10 @@ Extensions::Extensions()
     LOG("EXT: User extensions path '%s'\n", m_userExtensionsPath.c_str());
   }
 
+  ManifestCache cache(
+    m_userExtensionsPath.empty() ? std::string():
+                                   base::join_path(m_userExtensionsPath, kManifestsCache));
+
   ResourceFinder rf;
   rf.includeUserDir("extensions");
   rf.includeDataDir("extensions");
@@ -830,7 +1058,7 @@ Extensions::Extensions()
         }
 
         try {
-          loadExtension(dir, fullFn, isBuiltinExtension);
+          loadExtension(dir, cache.manifest(fullFn), isBuiltinExtension);
         }
         catch (const std::exception& ex) {
           LOG("EXT: Error loading JSON file: %s\n",
@@ -839,6 +1067,13 @@ Extensions::Extensions()
       }
     }
   }
+
+  try {
+    cache.save();
+  }
+  catch (const std::exception& ex) {
+    LOG("EXT: Error saving manifests cache: %s\n", ex.what());
+  }
 }
 
 Extensions::~Extensions()
@@ -1095,18 +1330,26 @@ Extension* Extensions::loadExtension(const std::string& path,
 {
   json11::Json json;
   read_json_file(fullPackageFilename, json);
-  auto name = json["name"].string_value();
-  auto version = json["version"].string_value();
-  auto displayName = json["displayName"].string_value();
+
+  Manifest manifest;
+  manifest.fromJson(json);
+  return loadExtension(path, manifest, isBuiltinExtension);
+}
+
+Extension* Extensions::loadExtension(const std::string& path,
+                                     const Manifest& manifest,
+                                     const bool isBuiltinExtension)
+{
+  const std::string& name = manifest.name;
 
   LOG("EXT: Extension '%s' loaded\n", name.c_str());
 
 #if ENABLE_SENTRY
   if (!isBuiltinExtension) {
     std::map<std::string, std::string> data = { { "name", name },
-                                                { "version", version } };
-    if (json["author"].is_object()) {
-      data["url"] = json["author"]["url"].string_value();
+                                                { "version", manifest.version } };
+    if (!manifest.authorUrl.empty()) {
+      data["url"] = manifest.authorUrl;
     }
     Sentry::addBreadcrumb("Load extension", data);
   }
@@ -1115,140 +1358,87 @@ Extension* Extensions::loadExtension(const std::string& path,
   auto extension = std::make_unique<Extension>(
     path,
     name,
-    version,
-    displayName,
+    manifest.version,
+    manifest.displayName,
     // Extensions are enabled by default
     get_config_bool("extensions", name.c_str(), true),
     isBuiltinExtension);
 
-  auto contributes = json["contributes"];
-  if (contributes.is_object()) {
-    // Keys
-    auto keys = contributes["keys"];
-    if (keys.is_array()) {
-      for (const auto& key : keys.array_items()) {
-        std::string keyId = key["id"].string_value();
-        std::string keyPath = key["path"].string_value();
-
-        // The path must be always relative to the extension
-        keyPath = base::join_path(path, keyPath);
+  // Keys
+  for (const auto& key : manifest.keys) {
+    // The path must be always relative to the extension
+    const std::string keyPath = base::join_path(path, key.path);
 
-        LOG("EXT: New keyboard shortcuts '%s' in '%s'\n",
-            keyId.c_str(),
-            keyPath.c_str());
+    LOG("EXT: New keyboard shortcuts '%s' in '%s'\n",
+        key.id.c_str(),
+        keyPath.c_str());
 
-        extension->addKeys(keyId, keyPath);
-      }
-    }
-
-    // Languages
-    auto languages = contributes["languages"];
-    if (languages.is_array()) {
-      for (const auto& lang : languages.array_items()) {
-        std::string langId = lang["id"].string_value();
-        std::string langPath = lang["path"].string_value();
-
-        // The path must be always relative to the extension
-        langPath = base::join_path(path, langPath);
-
-        LOG("EXT: New language id=%s path=%s\n",
-            langId.c_str(),
-            langPath.c_str());
+    extension->addKeys(key.id, keyPath);
+  }
 
-        extension->addLanguage(langId, langPath);
-      }
-    }
+  // Languages
+  for (const auto& lang : manifest.languages) {
+    // The path must be always relative to the extension
+    const std::string langPath = base::join_path(path, lang.path);
 
-    // Themes
-    auto themes = contributes["themes"];
-    if (themes.is_array()) {
-      for (const auto& theme : themes.array_items()) {
-        std::string themeId = theme["id"].string_value();
-        std::string themePath = theme["path"].string_value();
-        std::string themeVariant = theme["variant"].string_value();
+    LOG("EXT: New language id=%s path=%s\n",
+        lang.id.c_str(),
+        langPath.c_str());
 
-        // The path must be always relative to the extension
-        themePath = base::join_path(path, themePath);
+    extension->addLanguage(lang.id, langPath);
+  }
 
-        LOG("EXT: New theme id=%s path=%s variant=%s\n",
-            themeId.c_str(),
-            themePath.c_str(),
-            themeVariant.c_str());
+  // Themes
+  for (const auto& theme : manifest.themes) {
+    // The path must be always relative to the extension
+    const std::string themePath = base::join_path(path, theme.path);
 
-        extension->addTheme(themeId, themePath, themeVariant);
-      }
-    }
+    LOG("EXT: New theme id=%s path=%s variant=%s\n",
+        theme.id.c_str(),
+        themePath.c_str(),
+        theme.extra.c_str());
 
-    // Palettes
-    auto palettes = contributes["palettes"];
-    if (palettes.is_array()) {
-      for (const auto& palette : palettes.array_items()) {
-        std::string palId = palette["id"].string_value();
-        std::string palPath = palette["path"].string_value();
+    extension->addTheme(theme.id, themePath, theme.extra);
+  }
 
-        // The path must be always relative to the extension
-        palPath = base::join_path(path, palPath);
+  // Palettes
+  for (const auto& palette : manifest.palettes) {
+    // The path must be always relative to the extension
+    const std::string palPath = base::join_path(path, palette.path);
 
-        LOG("EXT: New palette id=%s path=%s\n",
-            palId.c_str(),
-            palPath.c_str());
+    LOG("EXT: New palette id=%s path=%s\n",
+        palette.id.c_str(),
+        palPath.c_str());
 
-        extension->addPalette(palId, palPath);
-      }
-    }
+    extension->addPalette(palette.id, palPath);
+  }
 
-    // Dithering matrices
-    auto ditheringMatrices = contributes["ditheringMatrices"];
-    if (ditheringMatrices.is_array()) {
-      for (const auto& ditheringMatrix : ditheringMatrices.array_items()) {
-        std::string matId = ditheringMatrix["id"].string_value();
-        std::string matPath = ditheringMatrix["path"].string_value();
-        std::string matName = ditheringMatrix["name"].string_value();
-        if (matName.empty())
-          matName = matId;
+  // Dithering matrices
+  for (const auto& ditheringMatrix : manifest.ditheringMatrices) {
+    const std::string& matName = (ditheringMatrix.extra.empty() ? ditheringMatrix.id:
+                                                                  ditheringMatrix.extra);
 
-        // The path must be always relative to the extension
-        matPath = base::join_path(path, matPath);
+    // The path must be always relative to the extension
+    const std::string matPath = base::join_path(path, ditheringMatrix.path);
 
-        LOG("EXT: New dithering matrix id=%s path=%s\n",
-            matId.c_str(),
-            matPath.c_str());
+    LOG("EXT: New dithering matrix id=%s path=%s\n",
+        ditheringMatrix.id.c_str(),
+        matPath.c_str());
 
-        extension->addDitheringMatrix(matId, matPath, matName);
-      }
-    }
+    extension->addDitheringMatrix(ditheringMatrix.id, matPath, matName);
+  }
 
 #ifdef ENABLE_SCRIPTING
-    // Scripts
-    auto scripts = contributes["scripts"];
-    if (scripts.is_array()) {
-      for (const auto& script : scripts.array_items()) {
-        std::string scriptPath = script["path"].string_value();
-        if (scriptPath.empty())
-          continue;
+  // Scripts
+  for (const auto& script : manifest.scripts) {
+    // The path must be always relative to the extension
+    const std::string scriptPath = base::join_path(path, script);
 
-        // The path must be always relative to the extension
-        scriptPath = base::join_path(path, scriptPath);
+    LOG("EXT: New script path=%s\n", scriptPath.c_str());
 
-        LOG("EXT: New script path=%s\n", scriptPath.c_str());
-
-        extension->addScript(scriptPath);
-      }
-    }
-    // Simple version of packages.json with {... "scripts": "file.lua" ...}
-    else if (scripts.is_string() &&
-             !scripts.string_value().empty()) {
-      std::string scriptPath = scripts.string_value();
-
-      // The path must be always relative to the extension
-      scriptPath = base::join_path(path, scriptPath);
-
-      LOG("EXT: New script path=%s\n", scriptPath.c_str());
-
-      extension->addScript(scriptPath);
-    }
-#endif // ENABLE_SCRIPTING
+    extension->addScript(scriptPath);
   }
+#endif // ENABLE_SCRIPTING
 
   if (extension)
     m_extensions.push_back(extension.get());
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -223,9 +223,15 @@ namespace app {
     obs::signal<void(Extension*)> ScriptsChange;
 
   private:
+    struct Manifest;
+    class ManifestCache;
+
     Extension* loadExtension(const std::string& path,
                              const std::string& fullPackageFilename,
                              const bool isBuiltinExtension);
+    Extension* loadExtension(const std::string& path,
+                             const Manifest& manifest,
+                             const bool isBuiltinExtension);
     void generateExtensionSignals(Extension* extension);
 
     List m_extensions;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -19,6 +19,7 @@
 #include "base/file_handle.h"
 #include "base/fs.h"
 #include "base/mem_utils.h"
+#include "base/thread_pool.h"
 #include "dio/aseprite_common.h"
 #include "dio/aseprite_decoder.h"
 #include "dio/decode_delegate.h"
@@ -30,8 +31,14 @@
 #include "ver/info.h"
 #include "zlib.h"
 
+#include <condition_variable>
 #include <cstdio>
 #include <deque>
+#include <exception>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
 #include <variant>
 
 #define ASEFILE_TRACE(...) // TRACE(__VA_ARGS__)
@@ -70,6 +77,14 @@ public:
     return m_fop->isOneFrame();
   }
 
+  bool decodeFrame(const doc::frame_t frame) override {
+    return m_fop->isFrameToLoad(frame);
+  }
+
+  gfx::Rect decodeBounds() override {
+    return m_fop->loadROI().bounds;
+  }
+
   doc::color_t defaultSliceColor() override {
     auto color = m_fop->config().defaultSliceColor;
     return doc::rgba(color.getRed(),
@@ -88,6 +103,16 @@ public:
     return m_fop->config().cacheCompressedTilesets;
   }
 
+  bool cacheCompressedCels() const override {
+    return m_fop->config().cacheCompressedCels;
+  }
+
+  std::string lazyCelsFilename() const override {
+    if (m_fop->config().lazyCelLoading)
+      return m_fop->filename();
+    return std::string();
+  }
+
 private:
   FileOp* m_fop;
   doc::Sprite* m_sprite;
@@ -145,12 +170,19 @@ public:
   }
 };
 
+class CelCompressor;
+
+// Unlinked cels that will be saved as linked cels to a previous cel
+// with the same image (see FileOpConfig::linkDuplicatedCels).
+typedef std::unordered_map<const Cel*, const Cel*> DuplicatedCels;
+
 } // anonymous namespace
 
 static void ase_file_prepare_header(FILE* f, dio::AsepriteHeader* header, const Sprite* sprite,
                                     const frame_t firstFrame, const frame_t totalFrames);
 static void ase_file_write_header(FILE* f, dio::AsepriteHeader* header);
 static void ase_file_write_header_filesize(FILE* f, dio::AsepriteHeader* header);
+static void ase_file_write_header_chunk_index(FILE* f, dio::AsepriteHeader* header);
 
 static void ase_file_prepare_frame_header(FILE* f, dio::AsepriteFrameHeader* frame_header);
 static void ase_file_write_frame_header(FILE* f, dio::AsepriteFrameHeader* frame_header);
@@ -162,6 +194,9 @@ static void ase_file_write_layers(FILE* f, FileOp* fop,
 static layer_t ase_file_write_cels(FILE* f,  FileOp* fop,
                                    dio::AsepriteFrameHeader* frame_header,
                                    const dio::AsepriteExternalFiles& ext_files,
+                                   CelCompressor* compressor,
+                                   const DuplicatedCels& duplicates,
+                                   dio::AsepriteChunkIndex* index,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
                                    const frame_t frame);
@@ -170,13 +205,19 @@ static void ase_file_write_padding(FILE* f, int bytes);
 static void ase_file_write_string(FILE* f, const std::string& string);
 
 static void ase_file_write_start_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, int type, dio::AsepriteChunk* chunk);
+static void ase_file_write_chunk_index(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                       dio::AsepriteHeader* header,
+                                       const dio::AsepriteChunkIndex& index);
 static void ase_file_write_close_chunk(FILE* f, dio::AsepriteChunk* chunk);
 
 static void ase_file_write_color2_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Palette* pal);
 static void ase_file_write_palette_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Palette* pal, int from, int to);
 static void ase_file_write_layer_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Layer* layer, int child_level);
-static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+static void ase_file_write_cel_chunk(FILE* f, FileOp* fop,
+                                     dio::AsepriteFrameHeader* frame_header,
+                                     CelCompressor* compressor,
                                      const Cel* cel,
+                                     const Cel* duplicateOf,
                                      const LayerImage* layer,
                                      const layer_t layer_index,
                                      const Sprite* sprite,
@@ -209,6 +250,7 @@ static void ase_file_write_external_files_chunk(FILE* f, FileOp* fop,
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
+                                          dio::AsepriteChunkIndex* index,
                                           const Tilesets* tilesets);
 static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
                                          dio::AsepriteFrameHeader* frame_header,
@@ -219,6 +261,9 @@ static void ase_file_write_properties_maps(FILE* f, FileOp* fop,
                                            const dio::AsepriteExternalFiles& ext_files,
                                             size_t nmaps,
                                            const doc::UserData::PropertiesMaps& propertiesMaps);
+static void find_duplicated_cels(FileOp* fop,
+                                 const Sprite* sprite,
+                                 DuplicatedCels& duplicates);
 static bool ase_has_groups(LayerGroup* group);
 static void ase_ungroup_all(LayerGroup* group);
 
@@ -346,7 +391,13 @@ bool AseFormat::onPostLoad(FileOp* fop)
 bool AseFormat::onSave(FileOp* fop)
 {
   const Sprite* sprite = fop->document()->sprite();
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+
+  // Cel images that weren't used yet can be loaded lazily from this
+  // same file, so we have to load them before the file is truncated.
+  for (const Cel* cel : sprite->uniqueCels())
+    cel->image();
+
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* f = handle.get();
 
   // Write the header
@@ -364,12 +415,28 @@ bool AseFormat::onSave(FileOp* fop)
     }
   }
 
+  // Cels that are saved as links to other cels (their images are
+  // not compressed/written)
+  DuplicatedCels duplicates;
+  if (fop->config().linkDuplicatedCels)
+    find_duplicated_cels(fop, sprite, duplicates);
+
+  // Compress the cel images in worker threads (the cel chunks are
+  // still written in the same order from this thread)
+  std::unique_ptr<CelCompressor> compressor =
+    CelCompressor::Make(fop, sprite, duplicates);
+
+  // Offsets of frames and chunks to write the chunk index in the last
+  // frame
+  dio::AsepriteChunkIndex index;
+
   // Write frames
   int outputFrame = 0;
   dio::AsepriteExternalFiles ext_files;
   for (frame_t frame : fop->roi().selectedFrames()) {
     // Prepare the frame header
     dio::AsepriteFrameHeader frame_header;
+    index.addFrame(ftell(f));
     ase_file_prepare_frame_header(f, &frame_header);
 
     // Frame duration
@@ -404,12 +471,15 @@ bool AseFormat::onSave(FileOp* fop)
     // Write extra chunks in the first frame
     if (frame == fop->roi().fromFrame()) {
       // Write sprite user data only if needed
-      if (!sprite->userData().isEmpty())
+      if (!sprite->userData().isEmpty()) {
+        index.addEntry(ASE_FILE_CHUNK_USER_DATA, 0,
+                       dio::AsepriteChunkIndex::kNoIndex, ftell(f));
         ase_file_write_user_data_chunk(f, fop, &frame_header, ext_files, &sprite->userData());
+      }
 
       // Write tilesets
       ase_file_write_tileset_chunks(f, fop, &frame_header, ext_files,
-                                    sprite->tilesets());
+                                    &index, sprite->tilesets());
 
       // Writer frame tags
       if (sprite->tags().size() > 0) {
@@ -439,8 +509,13 @@ bool AseFormat::onSave(FileOp* fop)
 
     // Write cel chunks
     ase_file_write_cels(f, fop, &frame_header, ext_files,
-                        sprite, sprite->root(),
-                        0, frame);
+                        compressor.get(), duplicates, &index,
+                        sprite, sprite->root(), 0, frame);
+
+    // Write the chunk index at the end of the last frame (older
+    // versions skip it as an unknown chunk)
+    if (outputFrame == fop->roi().frames()-1)
+      ase_file_write_chunk_index(f, &frame_header, &header, index);
 
     // Write the frame header
     ase_file_write_frame_header(f, &frame_header);
@@ -454,8 +529,10 @@ bool AseFormat::onSave(FileOp* fop)
       break;
   }
 
-  // Write the missing field (filesize) of the header.
+  // Write the missing fields (filesize and chunk index offset) of
+  // the header.
   ase_file_write_header_filesize(f, &header);
+  ase_file_write_header_chunk_index(f, &header);
 
   if (ferror(f)) {
     fop->setError("Error writing file.\n");
@@ -496,6 +573,7 @@ static void ase_file_prepare_header(FILE* f, dio::AsepriteHeader* header, const
   header->grid_y       = sprite->gridBounds().y;
   header->grid_width   = sprite->gridBounds().w;
   header->grid_height  = sprite->gridBounds().h;
+  header->chunk_index  = 0;
 }
 
 static void ase_file_write_header(FILE* f, dio::AsepriteHeader* header)
@@ -523,6 +601,7 @@ static void ase_file_write_header(FILE* f, dio::AsepriteHeader* header)
   fputw(header->grid_y, f);
   fputw(header->grid_width, f);
   fputw(header->grid_height, f);
+  fputl(header->chunk_index, f);
 
   fseek(f, header->pos+128, SEEK_SET);
 }
@@ -537,6 +616,17 @@ static void ase_file_write_header_filesize(FILE* f, dio::AsepriteHeader* header)
   fseek(f, header->pos+header->size, SEEK_SET);
 }
 
+static void ase_file_write_header_chunk_index(FILE* f, dio::AsepriteHeader* header)
+{
+  const long end = ftell(f);
+
+  // Offset of the chunk index field in the header
+  fseek(f, header->pos+44, SEEK_SET);
+  fputl(header->chunk_index, f);
+
+  fseek(f, end, SEEK_SET);
+}
+
 static void ase_file_prepare_frame_header(FILE* f, dio::AsepriteFrameHeader* frame_header)
 {
   int pos = ftell(f);
@@ -586,6 +676,9 @@ static void ase_file_write_layers(FILE* f, FileOp* fop,
 static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
                                    dio::AsepriteFrameHeader* frame_header,
                                    const dio::AsepriteExternalFiles& ext_files,
+                                   CelCompressor* compressor,
+                                   const DuplicatedCels& duplicates,
+                                   dio::AsepriteChunkIndex* index,
                                    const Sprite* sprite, const Layer* layer,
                                    layer_t layer_index,
                                    const frame_t frame)
@@ -593,15 +686,27 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
   if (layer->isImage()) {
     const Cel* cel = layer->cel(frame);
     if (cel) {
-      ase_file_write_cel_chunk(f, frame_header, cel,
+      // The current output frame is the last one added to the index
+      const uint16_t outputFrame = uint16_t(index->frames().size()-1);
+
+      auto it = duplicates.find(cel);
+      const Cel* duplicateOf = (it != duplicates.end() ? it->second: nullptr);
+
+      index->addEntry(ASE_FILE_CHUNK_CEL, outputFrame, uint16_t(layer_index),
+                      ftell(f));
+      ase_file_write_cel_chunk(f, fop, frame_header, compressor,
+                               cel, duplicateOf,
                                static_cast<const LayerImage*>(layer),
                                layer_index, sprite, fop->roi().fromFrame());
 
       if (layer->isReference())
         ase_file_write_cel_extra_chunk(f, frame_header, cel);
 
-      if (!cel->link() &&
+      // Linked cels share the user data of the original cel
+      if (!cel->link() && !duplicateOf &&
           !cel->data()->userData().isEmpty()) {
+        index->addEntry(ASE_FILE_CHUNK_USER_DATA, outputFrame,
+                        uint16_t(layer_index), ftell(f));
         ase_file_write_user_data_chunk(f, fop, frame_header, ext_files,
                                        &cel->data()->userData());
       }
@@ -614,8 +719,9 @@ static layer_t ase_file_write_cels(FILE* f, FileOp* fop,
   if (layer->isGroup()) {
     for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers()) {
       layer_index =
-        ase_file_write_cels(f, fop, frame_header, ext_files, sprite, child,
-                            layer_index, frame);
+        ase_file_write_cels(f, fop, frame_header, ext_files, compressor,
+                            duplicates, index, sprite, child, layer_index,
+                            frame);
     }
   }
 
@@ -670,6 +776,27 @@ static void ase_file_write_close_chunk(FILE* f, dio::AsepriteChunk* chunk)
   fseek(f, chunk_end, SEEK_SET);
 }
 
+static void ase_file_write_chunk_index(FILE* f, dio::AsepriteFrameHeader* frame_header,
+                                       dio::AsepriteHeader* header,
+                                       const dio::AsepriteChunkIndex& index)
+{
+  header->chunk_index = ftell(f) - header->pos;
+
+  ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_INDEX);
+
+  fputl(index.frames().size(), f);
+  for (const uint32_t offset : index.frames())
+    fputl(offset - header->pos, f);
+
+  fputl(index.entries().size(), f);
+  for (const auto& entry : index.entries()) {
+    fputw(entry.type, f);
+    fputw(entry.frame, f);
+    fputw(entry.index, f);
+    fputl(entry.offset - header->pos, f);
+  }
+}
+
 static void ase_file_write_color2_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header, const Palette* pal)
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_FLI_COLOR2);
@@ -906,8 +1033,9 @@ static void write_compressed_image_templ(FILE* f,
 
       int output_bytes = compressed.size() - zstream.avail_out;
       if (output_bytes > 0) {
-        if ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
-            || ferror(f))
+        if (f &&
+            ((fwrite(&compressed[0], 1, output_bytes, f) != (size_t)output_bytes)
+             || ferror(f)))
           throw base::Exception("Error writing compressed image pixels.\n");
 
         // Save the whole compressed buffer to re-use in following
@@ -953,12 +1081,398 @@ static void write_compressed_image(FILE* f,
   }
 }
 
+// Compresses the pixels of one tile as a raw deflate segment ended
+// with a full flush, so the segment ends in a byte boundary and
+// doesn't reference previous data. Segments of different tiles can
+// be concatenated in the same zlib stream.
+template<typename ImageTraits>
+static void compress_tile_templ(const Image* image,
+                                const gfx::Size& tileSize,
+                                Tileset::CompressedTile& tile)
+{
+  PixelIO<ImageTraits> pixel_io;
+  z_stream zstream;
+  int y, err;
+
+  zstream.zalloc = (alloc_func)0;
+  zstream.zfree  = (free_func)0;
+  zstream.opaque = (voidpf)0;
+  err = deflateInit2(&zstream, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                     -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+  if (err != Z_OK)
+    throw base::Exception("ZLib error %d in deflateInit2().", err);
+
+  std::vector<uint8_t> scanline(
+    calculate_rowstride_bytes(image->pixelFormat(), tileSize.w));
+  std::vector<uint8_t> compressed(4096);
+
+  tile.data.clear();
+  tile.checksum = adler32(0, nullptr, 0);
+
+  for (y=0; y<tileSize.h; ++y) {
+    typename ImageTraits::address_t address =
+      (typename ImageTraits::address_t)image->getPixelAddress(0, y);
+
+    pixel_io.write_scanline(address, tileSize.w, &scanline[0]);
+    tile.checksum = adler32(tile.checksum, &scanline[0], scanline.size());
+
+    zstream.next_in = (Bytef*)&scanline[0];
+    zstream.avail_in = scanline.size();
+    int flush = (y == tileSize.h-1 ? Z_FULL_FLUSH: Z_NO_FLUSH);
+
+    do {
+      zstream.next_out = (Bytef*)&compressed[0];
+      zstream.avail_out = compressed.size();
+
+      err = deflate(&zstream, flush);
+      if (err != Z_OK && err != Z_BUF_ERROR) {
+        deflateEnd(&zstream);
+        throw base::Exception("ZLib error %d in deflate().", err);
+      }
+
+      const int output_bytes = compressed.size() - zstream.avail_out;
+      if (output_bytes > 0) {
+        std::size_t n = tile.data.size();
+        tile.data.resize(n + output_bytes);
+        std::copy(compressed.begin(),
+                  compressed.begin() + output_bytes,
+                  tile.data.begin() + n);
+      }
+    } while (zstream.avail_out == 0);
+  }
+
+  // deflateEnd() returns Z_DATA_ERROR because the stream is not
+  // finished (the final block is added by the tileset writer)
+  deflateEnd(&zstream);
+}
+
+static void compress_tile(const Image* image,
+                          const gfx::Size& tileSize,
+                          Tileset::CompressedTile& tile)
+{
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      compress_tile_templ<RgbTraits>(image, tileSize, tile);
+      break;
+
+    case IMAGE_GRAYSCALE:
+      compress_tile_templ<GrayscaleTraits>(image, tileSize, tile);
+      break;
+
+    case IMAGE_INDEXED:
+      compress_tile_templ<IndexedTraits>(image, tileSize, tile);
+      break;
+  }
+}
+
+// Writes the pixels of all tiles as one zlib stream (the same format
+// that write_compressed_image() generates with TilesetScanlines),
+// concatenating the cached compressed data of each tile. Only new or
+// modified tiles are compressed again.
+static void write_compressed_tileset_by_tiles(FILE* f,
+                                              const Tileset* tileset)
+{
+  std::vector<Tileset::CompressedTile>& tiles = tileset->compressedTiles();
+  tiles.resize(tileset->size());
+
+  const gfx::Size tileSize = tileset->grid().tileSize();
+  const z_off_t tileBytes =
+    z_off_t(calculate_rowstride_bytes(tileset->sprite()->pixelFormat(),
+                                      tileSize.w)) * tileSize.h;
+
+  uLong checksum = adler32(0, nullptr, 0);
+  std::size_t size = 0;
+  int recompressed = 0;
+  for (tile_index ti=0; ti<tileset->size(); ++ti) {
+    const ImageRef image = tileset->get(ti);
+    ASSERT(image);
+    if (!image)
+      throw base::Exception("Invalid tile image in tileset.\n");
+
+    Tileset::CompressedTile& tile = tiles[ti];
+    if (tile.data.empty() ||
+        tile.imageId != image->id() ||
+        tile.imageVersion != image->version()) {
+      compress_tile(image.get(), tileSize, tile);
+      tile.imageId = image->id();
+      tile.imageVersion = image->version();
+      ++recompressed;
+    }
+    checksum = adler32_combine(checksum, tile.checksum, tileBytes);
+    size += tile.data.size();
+  }
+
+  ASEFILE_TRACE("[%d] saving tileset recompressing %d/%d tiles\n",
+                tileset->id(), recompressed, tileset->size());
+
+  // Compressed data length: zlib header + all tiles + final block +
+  // Adler-32 checksum
+  fputl(2 + size + 2 + 4, f);
+
+  // zlib header (deflate with a 32K window, default compression)
+  fputc(0x78, f);
+  fputc(0x9c, f);
+
+  for (const Tileset::CompressedTile& tile : tiles) {
+    if (fwrite(&tile.data[0], 1, tile.data.size(), f) != tile.data.size())
+      throw base::Exception("Error writing compressed tileset pixels.\n");
+  }
+
+  // Final empty block (with fixed Huffman codes)
+  fputc(0x03, f);
+  fputc(0x00, f);
+
+  // Adler-32 checksum of the uncompressed data (big-endian)
+  fputc((checksum >> 24) & 0xff, f);
+  fputc((checksum >> 16) & 0xff, f);
+  fputc((checksum >> 8) & 0xff, f);
+  fputc(checksum & 0xff, f);
+
+  if (ferror(f))
+    throw base::Exception("Error writing compressed tileset pixels.\n");
+}
+
+static bool has_cached_compressed_data(const Image* image)
+{
+  return (!image->compressedData().empty() &&
+          image->compressedDataVersion() == image->version());
+}
+
+// Finds the unlinked cels that can be saved as links to a previous
+// cel of the same layer, i.e. the cel data (image, position, opacity
+// and user data) is the same. Image hashes are cached, so this is
+// fast when the file is saved several times.
+static void find_duplicated_cels(FileOp* fop,
+                                 const Sprite* sprite,
+                                 DuplicatedCels& duplicates)
+{
+  for (const Layer* layer : sprite->allLayers()) {
+    // Reference layers can have subpixel bounds
+    if (!layer->isImage() || layer->isReference())
+      continue;
+
+    std::unordered_multimap<uint64_t, const Cel*> originals;
+    for (frame_t frame : fop->roi().selectedFrames()) {
+      const Cel* cel = layer->cel(frame);
+      // Linked cels are already saved as links
+      if (!cel || cel->link() || !cel->image())
+        continue;
+
+      const uint64_t hash = cel->image()->hash();
+      const Cel* duplicateOf = nullptr;
+      auto range = originals.equal_range(hash);
+      for (auto it=range.first; it!=range.second; ++it) {
+        const Cel* original = it->second;
+        if (original->position() == cel->position() &&
+            original->opacity() == cel->opacity() &&
+            original->data()->userData() == cel->data()->userData() &&
+            is_same_image(original->image(), cel->image())) {
+          duplicateOf = original;
+          break;
+        }
+      }
+
+      if (duplicateOf)
+        duplicates[cel] = duplicateOf;
+      else
+        originals.insert(std::make_pair(hash, cel));
+    }
+  }
+}
+
+namespace {
+
+// Compresses cel images in a pool of worker threads (each image in
+// its own buffer) in the same order they are written in the file, so
+// the thread writing the file can take the compressed data of each
+// cel when it's needed. The number of images compressed in advance
+// is limited to avoid keeping in memory the compressed data of the
+// whole sprite.
+class CelCompressor {
+public:
+  static std::unique_ptr<CelCompressor> Make(FileOp* fop,
+                                             const Sprite* sprite,
+                                             const DuplicatedCels& duplicates) {
+    // Unique images to be compressed in the same order they are
+    // written in the file
+    std::vector<const Image*> images;
+    std::set<const Image*> added;
+    for (frame_t frame : fop->roi().selectedFrames()) {
+      for (const Layer* layer : sprite->allLayers()) {
+        if (!layer->isImage())
+          continue;
+        const Cel* cel = layer->cel(frame);
+        if (!cel || !cel->image() || has_cached_compressed_data(cel->image()) ||
+            duplicates.find(cel) != duplicates.end())
+          continue;
+        if (added.insert(cel->image()).second)
+          images.push_back(cel->image());
+      }
+    }
+
+    const int threads = std::thread::hardware_concurrency();
+    if (images.size() < 2 || threads < 2)
+      return nullptr;
+    return std::make_unique<CelCompressor>(std::move(images), threads);
+  }
+
+  CelCompressor(std::vector<const Image*>&& images, const int threads)
+    : m_pool(threads)
+    , m_maxPending(4*threads) {
+    m_entries.resize(images.size());
+    for (int i=0; i<int(images.size()); ++i) {
+      m_entries[i].image = images[i];
+      m_index[images[i]] = i;
+    }
+    std::lock_guard lock(m_mutex);
+    scheduleEntries();
+  }
+
+  ~CelCompressor() {
+    // Wait the running tasks (e.g. if the save operation was
+    // stopped or an error was thrown)
+    std::unique_lock lock(m_mutex);
+    m_nextEntry = int(m_entries.size());
+    m_cv.wait(lock, [this]{ return m_running == 0; });
+  }
+
+  // Returns true if the image was compressed (or is being compressed)
+  // in a worker thread, waiting for it and moving its compressed data
+  // to "output".
+  bool takeCompressedData(const Image* image, base::buffer& output) {
+    auto it = m_index.find(image);
+    if (it == m_index.end())
+      return false;
+
+    Entry& entry = m_entries[it->second];
+    std::unique_lock lock(m_mutex);
+    if (entry.taken)
+      return false;
+
+    entry.taken = true;
+
+    // This image is not scheduled yet (which shouldn't happen if the
+    // images are written in the expected order), the caller will
+    // compress it.
+    if (it->second >= m_nextEntry)
+      return false;
+
+    m_cv.wait(lock, [&entry]{ return entry.ready; });
+    --m_pending;
+    scheduleEntries();
+
+    if (entry.error)
+      std::rethrow_exception(entry.error);
+
+    output = std::move(entry.data);
+    return true;
+  }
+
+private:
+  struct Entry {
+    const Image* image = nullptr;
+    base::buffer data;
+    std::exception_ptr error;
+    bool ready = false;
+    bool taken = false;
+  };
+
+  // Must be called with m_mutex locked
+  void scheduleEntries() {
+    while (m_nextEntry < int(m_entries.size()) &&
+           m_pending < m_maxPending) {
+      Entry* entry = &m_entries[m_nextEntry++];
+      if (entry->taken)
+        continue;
+
+      ++m_pending;
+      ++m_running;
+      m_pool.execute([this, entry]{
+        try {
+          ImageScanlines scan(entry->image);
+          write_compressed_image(nullptr, &scan,
+                                 entry->image->pixelFormat(),
+                                 &entry->data);
+        }
+        catch (...) {
+          entry->error = std::current_exception();
+        }
+
+        std::lock_guard lock(m_mutex);
+        entry->ready = true;
+        --m_running;
+        m_cv.notify_all();
+      });
+    }
+  }
+
+  base::thread_pool m_pool;
+  std::vector<Entry> m_entries;
+  std::unordered_map<const Image*, int> m_index;
+  const int m_maxPending;
+  int m_nextEntry = 0;
+  int m_pending = 0;            // Scheduled entries not taken yet
+  int m_running = 0;
+  std::mutex m_mutex;
+  std::condition_variable m_cv;
+};
+
+} // anonymous namespace
+
+// Writes the compressed pixels of a cel image re-using the
+// compressed data from the last time the image was loaded/saved if
+// the image wasn't modified since then (or the data compressed in a
+// worker thread by the CelCompressor).
+static void write_cached_compressed_image(FILE* f, FileOp* fop,
+                                          CelCompressor* compressor,
+                                          const Image* image)
+{
+  base::buffer compressedData;
+
+  if (has_cached_compressed_data(image)) {
+    const base::buffer& data = image->compressedData();
+
+    ASEFILE_TRACE("[%d] saving compressed image (%s)\n",
+                  image->id(), base::get_pretty_memory_size(data.size()).c_str());
+
+    if ((fwrite(&data[0], 1, data.size(), f) != data.size())
+        || ferror(f))
+      throw base::Exception("Error writing compressed image pixels.\n");
+  }
+  else if (compressor &&
+           compressor->takeCompressedData(image, compressedData)) {
+    if ((fwrite(&compressedData[0], 1, compressedData.size(), f) != compressedData.size())
+        || ferror(f))
+      throw base::Exception("Error writing compressed image pixels.\n");
+
+    if (fop->config().cacheCompressedCels)
+      image->setCompressedData(std::move(compressedData));
+  }
+  else {
+    base::buffer* compressedDataPtr = nullptr;
+    if (fop->config().cacheCompressedCels)
+      compressedDataPtr = &compressedData;
+
+    ImageScanlines scan(image);
+    write_compressed_image(f, &scan, image->pixelFormat(),
+                           compressedDataPtr);
+
+    // Keep the compressed data so the next save doesn't need to
+    // re-compress this same image if it's not modified.
+    if (compressedDataPtr)
+      image->setCompressedData(std::move(compressedData));
+  }
+}
+
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
-static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_header,
+static void ase_file_write_cel_chunk(FILE* f, FileOp* fop,
+                                     dio::AsepriteFrameHeader* frame_header,
+                                     CelCompressor* compressor,
                                      const Cel* cel,
+                                     const Cel* duplicateOf,
                                      const LayerImage* layer,
                                      const layer_t layer_index,
                                      const Sprite* sprite,
@@ -966,7 +1480,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
 {
   ChunkWriter chunk(f, frame_header, ASE_FILE_CHUNK_CEL);
 
-  const Cel* link = cel->link();
+  const Cel* link = (duplicateOf ? duplicateOf: cel->link());
 
   // In case the original link is outside the ROI, we've to find the
   // first linked cel that is inside the ROI.
@@ -1028,8 +1542,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
         fputw(image->width(), f);
         fputw(image->height(), f);
 
-        ImageScanlines scan(image);
-        write_compressed_image(f, &scan, image->pixelFormat());
+        write_cached_compressed_image(f, fop, compressor, image);
       }
       else {
         // Width and height
@@ -1053,8 +1566,7 @@ static void ase_file_write_cel_chunk(FILE* f, dio::AsepriteFrameHeader* frame_he
       fputl(tile_f_90cw, f);
       ase_file_write_padding(f, 10);
 
-      ImageScanlines scan(image);
-      write_compressed_image(f, &scan, IMAGE_TILEMAP);
+      write_cached_compressed_image(f, fop, compressor, image);
     }
   }
 }
@@ -1404,11 +1916,13 @@ static void ase_file_write_external_files_chunk(
 static void ase_file_write_tileset_chunks(FILE* f, FileOp* fop,
                                           dio::AsepriteFrameHeader* frame_header,
                                           const dio::AsepriteExternalFiles& ext_files,
+                                          dio::AsepriteChunkIndex* index,
                                           const Tilesets* tilesets)
 {
   tileset_index si = 0;
   for (const Tileset* tileset : *tilesets) {
     if (tileset) {
+      index->addEntry(ASE_FILE_CHUNK_TILESET, 0, uint16_t(si), ftell(f));
       ase_file_write_tileset_chunk(f, fop, frame_header, ext_files,
                                    tileset, si);
 
@@ -1482,6 +1996,12 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
       fputl(data.size(), f); // Compressed data length
       fwrite(&data[0], 1, data.size(), f);
     }
+    // Compress only the modified tiles and save the tileset (when
+    // the compressed data can be cached)
+    else if (fop->config().cacheCompressedTilesets &&
+             tileset->size() > 0) {
+      write_compressed_tileset_by_tiles(f, tileset);
+    }
     // Compress and save the tileset now
     else {
       fputl(0, f);                  // Field for compressed data length (completed later)
@@ -1489,18 +2009,7 @@ static void ase_file_write_tileset_chunk(FILE* f, FileOp* fop,
 
       ASEFILE_TRACE("[%d] recompressing tileset\n", tileset->id());
 
-      base::buffer compressedData;
-      base::buffer* compressedDataPtr = nullptr;
-      if (fop->config().cacheCompressedTilesets)
-        compressedDataPtr = &compressedData;
-
-      write_compressed_image(f, &gen, tileset->sprite()->pixelFormat(),
-                             compressedDataPtr);
-
-      // As we've just compressed the tileset, we can cache this same
-      // data (so saving the file again will not need recompressing).
-      if (compressedDataPtr)
-        tileset->setCompressedData(compressedData);
+      write_compressed_image(f, &gen, tileset->sprite()->pixelFormat());
 
       size_t end = ftell(f);
       fseek(f, beg, SEEK_SET);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,6 +24,16 @@
 #include "doc/doc.h"
 #include "fmt/format.h"
 
+#include <algorithm>
+#include <vector>
+
+// SSE2 is always available on x64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define BMP_FORMAT_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 namespace app {
 
 // Max supported .bmp size (to filter out invalid image sizes)
@@ -508,177 +518,127 @@ static void read_bmicolors(FileOp* fop, int bytes, FILE *f, bool win_flag)
     fgetc(f);
 }
 
+// Rows of uncompressed images are read with one fread() call and
+// converted directly to the image row address (instead of reading
+// and putting pixel by pixel).
+
 /* read_1bit_line:
  *  Support function for reading the 1 bit bitmap file format.
  */
-static void read_1bit_line(int length, FILE *f, Image *image, int line)
+static void read_1bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[32];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 32;
-    if (j == 0) {
-      n = fgetl(f);
-      n =
-        ((n&0x000000ff)<<24) |
-        ((n&0x0000ff00)<< 8) |
-        ((n&0x00ff0000)>> 8) |
-        ((n&0xff000000)>>24);
-      for (k=0; k<32; k++) {
-        b[31-k] = (char)(n & 1);
-        n = n >> 1;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  auto dst = (IndexedTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; ++i)
+    *(dst++) = (src[i >> 3] >> (7 - (i & 7))) & 1;
 }
 
 /* read_2bit_line (not standard):
  *  Support function for reading the 2 bit bitmap file format.
  */
-static void read_2bit_line(int length, FILE *f, Image *image, int line)
+static void read_2bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[16];
-  unsigned long n;
-  int i, j, k;
-  int temp;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 16;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        temp = n & 255;
-        b[k*4+3] = temp & 3;
-        temp = temp >> 2;
-        b[k*4+2] = temp & 3;
-        temp = temp >> 2;
-        b[k*4+1] = temp & 3;
-        temp = temp >> 2;
-        b[k*4] = temp & 3;
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  auto dst = (IndexedTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; ++i)
+    *(dst++) = (src[i >> 2] >> (6 - 2*(i & 3))) & 3;
 }
 
 /* read_4bit_line:
  *  Support function for reading the 4 bit bitmap file format.
  */
-static void read_4bit_line(int length, FILE *f, Image *image, int line)
+static void read_4bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[8];
-  unsigned long n;
-  int i, j, k;
-  int temp;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 8;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        temp = n & 255;
-        b[k*2+1] = temp & 15;
-        temp = temp >> 4;
-        b[k*2] = temp & 15;
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  auto dst = (IndexedTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; ++i)
+    *(dst++) = (src[i >> 1] >> (4 - 4*(i & 1))) & 15;
 }
 
 /* read_8bit_line:
  *  Support function for reading the 8 bit bitmap file format.
  */
-static void read_8bit_line(int length, FILE *f, Image *image, int line)
+static void read_8bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  unsigned char b[4];
-  unsigned long n;
-  int i, j, k;
-  int pix;
-
-  for (i=0; i<length; i++) {
-    j = i % 4;
-    if (j == 0) {
-      n = fgetl(f);
-      for (k=0; k<4; k++) {
-        b[k] = (char)(n & 255);
-        n = n >> 8;
-      }
-    }
-    pix = b[j];
-    put_pixel(image, i, line, pix);
-  }
+  auto dst = (IndexedTraits::address_t)image->getPixelAddress(0, line);
+  std::copy(src, src+length, dst);
 }
 
-static void read_16bit_line(int length, FILE *f, Image *image, int line, bool& withAlpha)
+static void read_16bit_line(int length, const uint8_t* src, Image *image, int line, bool& withAlpha)
 {
-  int i, r, g, b, a, word;
+  auto dst = (RgbTraits::address_t)image->getPixelAddress(0, line);
+  int r, g, b, a, word;
+  uint32_t alphaMask = 0;
 
-  for (i=0; i<length; i++) {
-    word = fgetw(f);
+  for (int i=0; i<length; ++i, src+=2) {
+    word = src[0] | (src[1] << 8);
 
     r = (word >> 10) & 0x1f;
     g = (word >> 5) & 0x1f;
     b = (word) & 0x1f;
     a = (word & 0x8000 ? 255 : 0);
-    if (a)
-      withAlpha = true;
-    put_pixel(image, i, line,
-              rgba(scale_5bits_to_8bits(r),
-                   scale_5bits_to_8bits(g),
-                   scale_5bits_to_8bits(b), a));
+    alphaMask |= a;
+    *(dst++) = rgba(scale_5bits_to_8bits(r),
+                    scale_5bits_to_8bits(g),
+                    scale_5bits_to_8bits(b), a);
   }
 
-  i = (2*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
+  if (alphaMask)
+    withAlpha = true;
 }
 
-static void read_24bit_line(int length, FILE *f, Image *image, int line)
+static void read_24bit_line(int length, const uint8_t* src, Image *image, int line)
 {
-  int i, r, g, b;
-
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    put_pixel(image, i, line, rgba(r, g, b, 255));
-  }
-
-  i = (3*i) % 4;
-  if (i > 0)
-    while (i++ < 4)
-      fgetc(f);
+  auto dst = (RgbTraits::address_t)image->getPixelAddress(0, line);
+  for (int i=0; i<length; ++i, src+=3)
+    *(dst++) = rgba(src[2], src[1], src[0], 255);
 }
 
-static void read_32bit_line(int length, FILE *f, Image *image, int line,
+static void read_32bit_line(int length, const uint8_t* src, Image *image, int line,
                             bool& withAlpha)
 {
-  int i, r, g, b, a;
+  auto dst = (RgbTraits::address_t)image->getPixelAddress(0, line);
+  int i = 0;
+
+#if BMP_FORMAT_SSE2
+  // Swaps the B and R components of 4 pixels at the same time (BGRA
+  // to RGBA, as rgba() stores the red component in the low byte)
+  const __m128i ga = _mm_set1_epi32(int(0xff00ff00));
+  const __m128i br = _mm_set1_epi32(0x000000ff);
+  __m128i alpha = _mm_setzero_si128();
+  for (; i+4<=length; i+=4, src+=16, dst+=4) {
+    const __m128i bgra = _mm_loadu_si128((const __m128i*)src);
+    const __m128i rgbaPixels =
+      _mm_or_si128(_mm_and_si128(bgra, ga),
+                   _mm_or_si128(_mm_and_si128(_mm_srli_epi32(bgra, 16), br),
+                                _mm_slli_epi32(_mm_and_si128(bgra, br), 16)));
+    _mm_storeu_si128((__m128i*)dst, rgbaPixels);
+    alpha = _mm_or_si128(alpha, _mm_srli_epi32(bgra, 24));
+  }
+  if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, _mm_setzero_si128())) != 0xffff)
+    withAlpha = true;
+#endif
 
-  for (i=0; i<length; i++) {
-    b = fgetc(f);
-    g = fgetc(f);
-    r = fgetc(f);
-    a = fgetc(f);
-    if (a)
+  for (; i<length; ++i, src+=4) {
+    if (src[3])
       withAlpha = true;
-    put_pixel(image, i, line, rgba(r, g, b, a));
+    *(dst++) = rgba(src[2], src[1], src[0], src[3]);
   }
 }
 
+// Bytes of each row in the file (rows are aligned to 4 bytes)
+static size_t bmp_row_bytes(int width, int bits_per_pixel)
+{
+  return size_t((int64_t(width) * bits_per_pixel + 31) / 32) * 4;
+}
+
+// Reads the next row of the file in the given buffer (the bytes that
+// cannot be read are set to zero)
+static const uint8_t* read_row(FILE *f, std::vector<uint8_t>& buf)
+{
+  const size_t n = fread(buf.data(), 1, buf.size(), f);
+  if (n < buf.size())
+    std::fill(buf.begin()+n, buf.end(), 0);
+  return buf.data();
+}
+
 /* read_image:
  *  For reading the noncompressed BMP image format.
  */
@@ -691,15 +651,19 @@ static void read_image(FILE *f, Image *image, const BITMAPINFOHEADER *infoheader
   dir    = height < 0 ? 1: -1;
   height = ABS(height);
 
+  std::vector<uint8_t> buf(bmp_row_bytes(infoheader->biWidth,
+                                         infoheader->biBitCount));
+
   for (i=0; i<height; i++, line+=dir) {
+    const uint8_t* src = read_row(f, buf);
     switch (infoheader->biBitCount) {
-      case 1: read_1bit_line(infoheader->biWidth, f, image, line); break;
-      case 2: read_2bit_line(infoheader->biWidth, f, image, line); break;
-      case 4: read_4bit_line(infoheader->biWidth, f, image, line); break;
-      case 8: read_8bit_line(infoheader->biWidth, f, image, line); break;
-      case 16: read_16bit_line(infoheader->biWidth, f, image, line, withAlpha); break;
-      case 24: read_24bit_line(infoheader->biWidth, f, image, line); break;
-      case 32: read_32bit_line(infoheader->biWidth, f, image, line, withAlpha); break;
+      case 1: read_1bit_line(infoheader->biWidth, src, image, line); break;
+      case 2: read_2bit_line(infoheader->biWidth, src, image, line); break;
+      case 4: read_4bit_line(infoheader->biWidth, src, image, line); break;
+      case 8: read_8bit_line(infoheader->biWidth, src, image, line); break;
+      case 16: read_16bit_line(infoheader->biWidth, src, image, line, withAlpha); break;
+      case 24: read_24bit_line(infoheader->biWidth, src, image, line); break;
+      case 32: read_32bit_line(infoheader->biWidth, src, image, line, withAlpha); break;
     }
 
     fop->setProgress((float)(i+1) / (float)(height));
@@ -925,12 +889,18 @@ static int read_bitfields_image(FILE *f, Image *image, BITMAPINFOHEADER *infohea
   bytes_per_pixel = ((bits_per_pixel / 8) +
                      ((bits_per_pixel % 8) > 0 ? 1: 0));
 
+  std::vector<uint8_t> buf(
+    bmp_row_bytes(infoheader->biWidth, bytes_per_pixel*8));
+
   for (i=0; i<height; i++, line+=dir) {
+    const uint8_t* src = read_row(f, buf);
+    auto dst = (RgbTraits::address_t)image->getPixelAddress(0, line);
+
     for (j=0; j<(int)infoheader->biWidth; j++) {
       /* read the DWORD, WORD or BYTE in little-endian order */
       buffer = 0;
       for (k=0; k<bytes_per_pixel; k++)
-        buffer |= fgetc(f) << (k<<3);
+        buffer |= uint32_t(*(src++)) << (k<<3);
 
       r = (buffer & rmask) >> rshift;
       g = (buffer & gmask) >> gshift;
@@ -944,13 +914,8 @@ static int read_bitfields_image(FILE *f, Image *image, BITMAPINFOHEADER *infohea
 
       if (a)
         withAlpha = true;
-      put_pixel_fast<RgbTraits>(image, j, line, rgba(r, g, b, a));
+      *(dst++) = rgba(r, g, b, a);
     }
-
-    j = (bytes_per_pixel*j) % 4;
-    if (j > 0)
-      while (j++ < 4)
-        fgetc(f);
   }
 
   if (!withAlpha) {
@@ -1222,7 +1187,7 @@ bool BmpFormat::onSave(FileOp *fop)
                OS2FILEHEADERSIZE + biSizeImage;  // header + image data
   }
 
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* f = handle.get();
 
   /* file_header */
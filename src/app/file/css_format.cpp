@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2018-2019  Igara Studio S.A.
+// Copyright (c) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -91,7 +91,7 @@ bool CssFormat::onSave(FileOp* fop)
   const ImageRef image = fop->sequenceImage();
   int x, y, c, r, g, b, a, alpha;
   const auto css_options = std::static_pointer_cast<CssOptions>(fop->formatOptions());
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* f = handle.get();
   auto print_color = [f](int r, int g, int b, int a) {
     if (a == 255) {
@@ -232,7 +232,7 @@ bool CssFormat::onSave(FileOp* fop)
   }
   if (css_options->generateHtml) {
     std::string html_filepath = fop->filename() + ".html";
-    FileHandle handle(open_file_with_exception_sync_on_close(html_filepath, "wb"));
+    FileHandle handle(fop->openOutputFile(html_filepath));
     FILE* h = handle.get();
     fprintf(h,
             "<html><head><link rel=\"stylesheet\" media=\"all\" "
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,7 @@
 #include "app/file/file_format.h"
 #include "app/file/file_formats_manager.h"
 #include "app/file/format_options.h"
+#include "app/file/saved_files_recorder.h"
 #include "app/file/split_filename.h"
 #include "app/filename_formatter.h"
 #include "app/i18n/strings.h"
@@ -37,8 +38,11 @@
 #include "doc/algorithm/resize_image.h"
 #include "doc/doc.h"
 #include "fmt/format.h"
+#include "perf/trace.h"
 #include "render/quantization.h"
 #include "render/render.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
 #include "ui/alert.h"
 #include "ui/listitem.h"
 #include "ui/system.h"
@@ -47,8 +51,19 @@
 #include "ask_for_color_profile.xml.h"
 #include "open_sequence.xml.h"
 
+#include <algorithm>
+#include <cstdio>
 #include <cstring>
 #include <cstdarg>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <sys/stat.h>
+#endif
 
 namespace app {
 
@@ -161,6 +176,39 @@ public:
     }
   }
 
+  bool hasSameRender(const doc::frame_t frame1,
+                     const doc::frame_t frame2,
+                     const doc::ColorMode dstColorMode) const override {
+    if (frame1 == frame2)
+      return true;
+
+    // The palette is used only to render indexed sprites in other
+    // color modes (e.g. in a palette cycling animation all frames
+    // can be rendered once in an indexed image)
+    if (m_sprite->colorMode() == doc::ColorMode::INDEXED &&
+        dstColorMode != doc::ColorMode::INDEXED &&
+        palette(frame1) != palette(frame2))
+      return false;
+
+    for (const doc::Layer* layer : m_sprite->allLayers()) {
+      if (!layer->isImage())
+        continue;
+
+      const doc::Cel* cel1 = layer->cel(frame1);
+      const doc::Cel* cel2 = layer->cel(frame2);
+      if (!cel1 && !cel2)
+        continue;
+      if (!cel1 || !cel2 ||
+          cel1->data() != cel2->data() ||
+          cel1->zIndex() != cel2->zIndex())
+        return false;
+    }
+    return true;
+  }
+
+  const gfx::PointF& scale() const { return m_scale; }
+  bool isScaled() const { return m_scale.x != 1.0 || m_scale.y != 1.0; }
+
   void setScale(const gfx::PointF& scale) {
     m_scale = scale;
     m_spec.setWidth(m_spec.width() * m_scale.x);
@@ -177,6 +225,143 @@ private:
   gfx::PointF m_scale = gfx::PointF(1.0, 1.0);
 };
 
+// One file of a sequence loaded/saved with its own FileOp.
+struct FileOp::SequenceFrame {
+  std::unique_ptr<FileOp> fop;
+  bool loaded = false;
+  bool saved = false;
+
+  SequenceFrame() = default;
+  SequenceFrame(SequenceFrame&&) = default;
+  SequenceFrame& operator=(SequenceFrame&&) = default;
+
+  ~SequenceFrame() {
+    if (!fop)
+      return;
+
+    // The document of a save operation is the one of the sequence
+    if (fop->m_type == FileOpSave) {
+      fop->releaseDocument();
+      return;
+    }
+    delete fop->releaseDocument();
+    delete fop->m_seq.last_cel;
+  }
+
+  // Loads the given file with the same options of the sequence
+  // (called from a worker thread).
+  void load(const FileOp* seqOp, const std::string& filename) {
+    fop.reset(new FileOp(FileOpLoad, seqOp->m_context, &seqOp->m_config));
+    fop->m_format = seqOp->m_format;
+    fop->m_filename = filename;
+    fop->m_oneframe = seqOp->m_oneframe;
+    fop->m_metadataOnly = seqOp->m_metadataOnly;
+    fop->m_loadROI.bounds = seqOp->m_loadROI.bounds;
+    fop->m_loadFitSize = seqOp->m_loadFitSize;
+    fop->m_createPaletteFromRgba = seqOp->m_createPaletteFromRgba;
+    fop->m_ignoreEmpty = seqOp->m_ignoreEmpty;
+    fop->prepareForSequence();
+    fop->m_seq.palette->makeBlack();
+    fop->m_seq.filename_list.push_back(filename);
+    fop->m_seq.flags = seqOp->m_seq.flags;
+
+    try {
+      loaded = fop->m_format->load(fop.get());
+    }
+    catch (const std::exception& ex) {
+      fop->setError("Error loading file: %s\n", ex.what());
+      loaded = false;
+    }
+  }
+
+  // Saves the given image in a file with the same options of the
+  // sequence (called from a worker thread).
+  void save(FileOp* seqOp,
+            const std::string& filename,
+            const ImageRef& image,
+            const Palette* palette,
+            const gfx::Size& boundsSize,
+            std::mutex& dirsMutex) {
+    fop.reset(new FileOp(FileOpSave, seqOp->m_context, &seqOp->m_config));
+    fop->m_format = seqOp->m_format;
+    fop->m_document = seqOp->m_document;
+    fop->m_roi = seqOp->m_roi;
+    fop->m_filename = filename;
+    fop->m_ignoreEmpty = seqOp->m_ignoreEmpty;
+    fop->prepareForSequence();
+    fop->m_formatOptions = seqOp->m_formatOptions;
+    fop->m_seq.filename_list.push_back(filename);
+    fop->m_seq.image = image;
+    palette->copyColorsTo(fop->m_seq.palette);
+
+    if (fop->m_format->support(FILE_ENCODE_ABSTRACT_IMAGE)) {
+      fop->makeAbstractImage();
+      if (seqOp->m_abstractImage)
+        fop->m_abstractImage->setScale(seqOp->m_abstractImage->scale());
+      if (!boundsSize.isEmpty())
+        fop->m_abstractImage->setSpecSize(boundsSize);
+    }
+
+    {
+      std::lock_guard lock(dirsMutex);
+      fop->makeDirectories();
+    }
+
+    try {
+      saved = fop->m_format->save(fop.get());
+    }
+    catch (const std::exception& ex) {
+      fop->setError("Error saving file: %s\n", ex.what());
+      saved = false;
+    }
+
+    if (saved)
+      saved = fop->commitOutputFiles();
+    else
+      fop->discardOutputFiles();
+
+    if (saved)
+      SavedFilesRecorder::notify(filename);
+  }
+
+  // Moves the loaded image/cel/palette to the FileOp of the sequence
+  // (the document is moved only for the first frame).
+  void mergeInto(FileOp* seqOp) {
+    if (fop->hasError())
+      seqOp->setError("%s", fop->error().c_str());
+    if (fop->hasIncompatibilityError())
+      seqOp->setIncompatibilityError(fop->m_incompatibilityError);
+    if (fop->m_embeddedColorProfile)
+      seqOp->m_embeddedColorProfile = true;
+    if (fop->m_formatOptions)
+      seqOp->m_formatOptions = fop->m_formatOptions;
+    if (fop->m_seq.has_alpha)
+      seqOp->m_seq.has_alpha = true;
+
+    if (!seqOp->m_document) {
+      seqOp->m_document = fop->releaseDocument();
+      seqOp->m_seq.layer = fop->m_seq.layer;
+    }
+    else if (fop->m_document) {
+      if (fop->m_document->sprite()->pixelFormat() !=
+          seqOp->m_document->sprite()->pixelFormat()) {
+        seqOp->setError("Error: image does not match color mode\n");
+        loaded = false;
+      }
+      delete fop->releaseDocument();
+    }
+
+    *seqOp->m_seq.palette = *fop->m_seq.palette;
+    seqOp->m_seq.size = fop->m_seq.size;
+    seqOp->m_seq.image = fop->m_seq.image;
+    seqOp->m_seq.last_cel = fop->m_seq.last_cel;
+    fop->m_seq.image.reset();
+    fop->m_seq.last_cel = nullptr;
+    if (seqOp->m_seq.last_cel)
+      seqOp->m_seq.last_cel->setFrame(seqOp->m_seq.frame);
+  }
+};
+
 base::paths get_readable_extensions()
 {
   base::paths paths;
@@ -227,6 +412,22 @@ Doc* load_document(Context* context, const std::string& filename)
   return document;
 }
 
+Doc* load_document_metadata(Context* context, const std::string& filename)
+{
+  std::unique_ptr<FileOp> fop(
+    FileOp::createLoadDocumentOperation(
+      context, filename,
+      FILE_LOAD_METADATA_ONLY |
+      FILE_LOAD_SEQUENCE_NONE));
+  if (!fop || fop->hasError())
+    return nullptr;
+
+  fop->operate();
+  fop->done();
+
+  return fop->releaseDocument();
+}
+
 int save_document(Context* context, Doc* document)
 {
   std::unique_ptr<FileOp> fop(
@@ -458,6 +659,10 @@ FileOp* FileOp::createLoadDocumentOperation(Context* context,
   if (flags & FILE_LOAD_ONE_FRAME)
     fop->m_oneframe = true;
 
+  // Load just the metadata
+  if (flags & FILE_LOAD_METADATA_ONLY)
+    fop->m_metadataOnly = true;
+
   if (flags & FILE_LOAD_CREATE_PALETTE)
     fop->m_createPaletteFromRgba = true;
 
@@ -762,6 +967,174 @@ bool FileOp::checkIfFormatSupportResizeOnTheFly(const std::string& filename)
           fileFormat->support(FILE_ENCODE_ABSTRACT_IMAGE));
 }
 
+// Crops the loaded sprite to the bounds of the load ROI and keeps
+// only its frames. Formats can skip the decoding of the discarded
+// parts, but the result must be the same as if the whole file was
+// loaded and then cropped here.
+static void apply_load_roi(Sprite* sprite, const FileOpLoadROI& roi)
+{
+  // Frames to keep
+  std::vector<frame_t> frames;
+  for (frame_t frame=0; frame<sprite->totalFrames(); ++frame) {
+    if (roi.frames.contains(frame))
+      frames.push_back(frame);
+  }
+  // Nothing to keep, we ignore the list of frames
+  if (frames.empty()) {
+    for (frame_t frame=0; frame<sprite->totalFrames(); ++frame)
+      frames.push_back(frame);
+  }
+  std::vector<frame_t> newFrames(sprite->totalFrames(), -1);
+  for (frame_t i=0; i<frame_t(frames.size()); ++i)
+    newFrames[frames[i]] = i;
+
+  gfx::Rect bounds = sprite->bounds();
+  if (!roi.bounds.isEmpty() && !(roi.bounds & bounds).isEmpty())
+    bounds &= roi.bounds;
+  const gfx::Point delta = -bounds.origin();
+
+  // Cels (frames are moved in ascending order, so the new frame of a
+  // cel is always free)
+  for (Layer* layer : sprite->allLayers()) {
+    if (!layer->isImage())
+      continue;
+
+    auto imageLayer = static_cast<LayerImage*>(layer);
+    CelList cels;
+    imageLayer->getCels(cels);
+    for (Cel* cel : cels) {
+      const frame_t newFrame = newFrames[cel->frame()];
+      if (newFrame < 0) {
+        imageLayer->removeCel(cel);
+        delete cel;
+      }
+      else if (newFrame != cel->frame())
+        imageLayer->moveCel(cel, newFrame);
+    }
+  }
+
+  // Crop the images of the cels (linked cels share the same data)
+  if (bounds != sprite->bounds()) {
+    std::vector<Cel*> emptyCels;
+    for (Cel* cel : sprite->uniqueCels()) {
+      Layer* layer = cel->layer();
+      const gfx::Rect celBounds = cel->bounds();
+      const gfx::Rect area = (celBounds & bounds);
+
+      // Tilemaps and reference layers are only moved
+      if (layer->isTilemap() || layer->isReference() || area == celBounds) {
+        if (layer->isReference()) {
+          gfx::RectF boundsF = cel->boundsF();
+          boundsF.offset(gfx::PointF(delta));
+          cel->setBoundsF(boundsF);
+        }
+        else
+          cel->setPosition(cel->position() + delta);
+      }
+      else if (area.isEmpty()) {
+        emptyCels.push_back(cel);
+      }
+      else {
+        ImageRef image(crop_image(cel->image(),
+                                  area.x - celBounds.x,
+                                  area.y - celBounds.y,
+                                  area.w, area.h,
+                                  cel->image()->maskColor()));
+        cel->data()->setImage(image, layer);
+        cel->setPosition(area.origin() + delta);
+      }
+    }
+
+    // Remove cels outside the bounds (and their links)
+    for (Cel* emptyCel : emptyCels) {
+      auto imageLayer = static_cast<LayerImage*>(emptyCel->layer());
+      CelList cels;
+      imageLayer->getCels(cels);
+      for (Cel* cel : cels) {
+        if (cel->data() == emptyCel->data()) {
+          imageLayer->removeCel(cel);
+          delete cel;
+        }
+      }
+    }
+  }
+
+  // Palettes
+  std::vector<std::unique_ptr<Palette>> palettes;
+  for (frame_t i=0; i<frame_t(frames.size()); ++i) {
+    const Palette* pal = sprite->palette(frames[i]);
+    if (i == 0 || pal != sprite->palette(frames[i-1])) {
+      palettes.push_back(std::make_unique<Palette>(*pal));
+      palettes.back()->setFrame(i);
+    }
+  }
+  sprite->resetPalettes();
+  for (const auto& pal : palettes)
+    sprite->setPalette(pal.get(), true);
+
+  // Frame durations
+  std::vector<int> durations;
+  for (frame_t frame : frames)
+    durations.push_back(sprite->frameDuration(frame));
+  sprite->setTotalFrames(frame_t(frames.size()));
+  for (frame_t i=0; i<frame_t(frames.size()); ++i)
+    sprite->setFrameDuration(i, durations[i]);
+
+  // Tags (only the kept frames of each tag)
+  std::vector<Tag*> tags(sprite->tags().begin(), sprite->tags().end());
+  for (Tag* tag : tags) {
+    frame_t from = -1, to = -1;
+    for (frame_t frame=tag->fromFrame(); frame<=tag->toFrame(); ++frame) {
+      if (frame < frame_t(newFrames.size()) && newFrames[frame] >= 0) {
+        if (from < 0)
+          from = newFrames[frame];
+        to = newFrames[frame];
+      }
+    }
+    if (from < 0) {
+      sprite->tags().remove(tag);
+      delete tag;
+    }
+    else
+      tag->setFrameRange(from, to);
+  }
+
+  // Slices
+  for (Slice* slice : sprite->slices()) {
+    std::vector<std::pair<frame_t, SliceKey>> keys;
+    const SliceKey* prevKey = nullptr;
+    for (frame_t i=0; i<frame_t(frames.size()); ++i) {
+      const SliceKey* key = slice->getByFrame(frames[i]);
+      if (key == prevKey)
+        continue;
+
+      SliceKey newKey = (key ? *key: SliceKey());
+      if (!newKey.isEmpty()) {
+        gfx::Rect rc = newKey.bounds();
+        rc.offset(delta);
+        newKey.setBounds(rc);
+      }
+      keys.emplace_back(i, newKey);
+      prevKey = key;
+    }
+
+    std::vector<frame_t> oldFrames;
+    for (const auto& key : *slice)
+      oldFrames.push_back(key.frame());
+    for (frame_t frame : oldFrames)
+      slice->remove(frame);
+    for (const auto& key : keys)
+      slice->insert(key.first, key.second);
+  }
+
+  if (bounds != sprite->bounds()) {
+    gfx::Rect gridBounds = sprite->gridBounds();
+    gridBounds.offset(delta);
+    sprite->setGridBounds(gridBounds);
+    sprite->setSize(bounds.w, bounds.h);
+  }
+}
+
 // Executes the file operation: loads or saves the sprite.
 //
 // It can be called from a different thread of the one used
@@ -773,6 +1146,7 @@ bool FileOp::checkIfFormatSupportResizeOnTheFly(const std::string& filename)
 // TODO refactor this code
 void FileOp::operate(IFileOpProgress* progress)
 {
+  PERF_ZONE("FileOp::operate");
   ASSERT(!isDone());
 
   m_progressInterface = progress;
@@ -794,7 +1168,9 @@ void FileOp::operate(IFileOpProgress* progress)
 
       // TODO setPalette for each frame???
       auto add_image = [&]() {
-        canvasSize |= m_seq.image->size();
+        // The image can be only a part of the file (see
+        // boundsToLoad()), so we use the size of the file
+        canvasSize |= m_seq.size;
 
         m_seq.last_cel->data()->setImage(m_seq.image,
                                          m_seq.layer);
@@ -815,68 +1191,110 @@ void FileOp::operate(IFileOpProgress* progress)
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)frames;
 
-      auto it = m_seq.filename_list.begin(),
-           end = m_seq.filename_list.end();
-      for (; it != end; ++it) {
-        m_filename = it->c_str();
+      // Frames are decoded in parallel in batches (each frame with
+      // its own FileOp, so formats don't share the decoder state),
+      // and then they are added to the sprite in order.
+      const size_t batchSize =
+        2 * std::max(1, sched::Scheduler::instance().threads());
+      std::vector<SequenceFrame> batch;
+      bool stopLoading = false;
 
-        // Call the "load" procedure to read the first bitmap.
-        bool loadres = m_format->load(this);
-        if (!loadres) {
-          setError("Error loading frame %d from file \"%s\"\n",
-                   frame+1, m_filename.c_str());
+      for (size_t i=0; i<m_seq.filename_list.size() && !stopLoading; i+=batchSize) {
+        if (isStop())
+          break;
+
+        batch.clear();
+        batch.resize(std::min(batchSize, m_seq.filename_list.size()-i));
+        {
+          sched::TaskGroup tasks(sched::Priority::Interactive);
+          for (size_t j=0; j<batch.size(); ++j) {
+            tasks.run([this, &batch, i, j]{
+              if (!isStop())
+                batch[j].load(this, m_seq.filename_list[i+j]);
+            });
+          }
+          tasks.wait();
         }
 
-        // For the first frame...
-        if (!old_image) {
-          // Error reading the first frame
-          if (!loadres || !m_document || !m_seq.last_cel) {
-            m_seq.image.reset();
-            delete m_seq.last_cel;
-            delete m_document;
-            m_document = nullptr;
+        for (SequenceFrame& seqFrame : batch) {
+          // The operation was stopped before loading this frame
+          FileOp* frameOp = seqFrame.fop.get();
+          if (!frameOp) {
+            stopLoading = true;
             break;
           }
-          // Read ok
-          else {
-            // Add the keyframe
-            add_image();
+
+          m_filename = frameOp->m_filename;
+          seqFrame.mergeInto(this);
+          const bool loadres = seqFrame.loaded;
+
+          if (!loadres) {
+            setError("Error loading frame %d from file \"%s\"\n",
+                     frame+1, m_filename.c_str());
           }
-        }
-        // For other frames
-        else {
-          // All done (or maybe not enough memory)
-          if (!loadres || !m_seq.last_cel) {
-            m_seq.image.reset();
-            delete m_seq.last_cel;
-            break;
+
+          // For the first frame...
+          if (!old_image) {
+            // Error reading the first frame
+            if (!loadres || !m_document || !m_seq.last_cel) {
+              m_seq.image.reset();
+              delete m_seq.last_cel;
+              m_seq.last_cel = nullptr;
+              delete m_document;
+              m_document = nullptr;
+              stopLoading = true;
+              break;
+            }
+            // Read ok
+            else {
+              // Add the keyframe
+              add_image();
+            }
           }
+          // For other frames
+          else {
+            // All done (or maybe not enough memory)
+            if (!loadres || !m_seq.last_cel) {
+              m_seq.image.reset();
+              delete m_seq.last_cel;
+              m_seq.last_cel = nullptr;
+              stopLoading = true;
+              break;
+            }
 
-          // Compare the old frame with the new one
+            // Compare the old frame with the new one
 #if USE_LINK // TODO this should be configurable through a check-box
-          if (count_diff_between_images(old_image, m_seq.image)) {
+            if (count_diff_between_images(old_image, m_seq.image)) {
+              add_image();
+            }
+            // We don't need this image
+            else {
+              delete m_seq.image;
+
+              // But add a link frame
+              m_seq.last_cel->image = image_index;
+              layer_add_frame(m_seq.layer, m_seq.last_cel);
+
+              m_seq.last_image = NULL;
+              m_seq.last_cel = NULL;
+            }
+#else
             add_image();
+#endif
           }
-          // We don't need this image
-          else {
-            delete m_seq.image;
 
-            // But add a link frame
-            m_seq.last_cel->image = image_index;
-            layer_add_frame(m_seq.layer, m_seq.last_cel);
+          m_document->sprite()->setFrameDuration(frame, m_seq.duration);
 
-            m_seq.last_image = NULL;
-            m_seq.last_cel = NULL;
+          ++frame;
+          m_seq.frame = frame;
+          m_seq.progress_offset += m_seq.progress_fraction;
+          {
+            std::lock_guard lock(m_mutex);
+            m_progress = m_seq.progress_offset;
+            if (m_progressInterface)
+              m_progressInterface->ackFileOpProgress(m_progress);
           }
-#else
-          add_image();
-#endif
         }
-
-        m_document->sprite()->setFrameDuration(frame, m_seq.duration);
-
-        ++frame;
-        m_seq.progress_offset += m_seq.progress_fraction;
       }
       m_filename = *m_seq.filename_list.begin();
 
@@ -921,6 +1339,13 @@ void FileOp::operate(IFileOpProgress* progress)
         setError("Error loading data file: %s\n", ex.what());
       }
     }
+
+    // Crop the document to the region of interest
+    if (m_document &&
+        m_document->sprite() &&
+        !m_loadROI.isEmpty()) {
+      apply_load_roi(m_document->sprite(), m_loadROI);
+    }
   }
   // Save //////////////////////////////////////////////////////////////////////
   else if (m_type == FileOpSave &&
@@ -947,17 +1372,16 @@ void FileOp::operate(IFileOpProgress* progress)
 
       Sprite* sprite = m_document->sprite();
 
-      // Create a temporary bitmap
-      m_seq.image.reset(Image::create(sprite->pixelFormat(),
-                                      sprite->width(),
-                                      sprite->height()));
-
       m_seq.progress_offset = 0.0f;
       m_seq.progress_fraction = 1.0f / (double)sprite->totalFrames();
 
-      // For each frame in the sprite.
-      render::Render render;
-      render.setNewBlend(m_config.newBlend);
+      // Frames to save with the bounds to render
+      struct FrameToSave {
+        frame_t frame;
+        frame_t outputFrame;
+        gfx::Rect bounds;
+      };
+      std::vector<FrameToSave> framesToSave;
 
       frame_t outputFrame = 0;
       for (frame_t frame : m_roi.selectedFrames()) {
@@ -976,54 +1400,95 @@ void FileOp::operate(IFileOpProgress* progress)
           bounds = m_roi.bounds();
         }
 
-        // Draw the "frame" in "m_seq.image" with the given bounds
-        // (bounds can be the selection bounds or a slice key bounds)
-        if (!bounds.isEmpty()) {
-          if (m_abstractImage)
-            m_abstractImage->setSpecSize(bounds.size());
-
-          m_seq.image.reset(
-            Image::create(sprite->pixelFormat(),
-                          bounds.w,
-                          bounds.h));
-
-          render.renderSprite(
-            m_seq.image.get(), sprite, frame,
-            gfx::Clip(gfx::Point(0, 0), bounds));
-        }
-        else {
-          render.renderSprite(m_seq.image.get(), sprite, frame);
-        }
+        framesToSave.push_back(FrameToSave{ frame, outputFrame, bounds });
+        ++outputFrame;
+      }
 
-        bool save = true;
+      // Frames are rendered and encoded in parallel in batches (to
+      // limit the number of images in memory), each one with its own
+      // FileOp. Resizing on-the-fly uses the sprite RgbMap (which
+      // cannot be used from several threads), so in that case frames
+      // are saved one by one.
+      const bool scaled = (m_abstractImage && m_abstractImage->isScaled());
+      const size_t batchSize =
+        (scaled ? 1: 2 * std::max(1, sched::Scheduler::instance().threads()));
+      std::vector<SequenceFrame> batch;
+      std::mutex dirsMutex;
+      bool failed = false;
+
+      for (size_t i=0; i<framesToSave.size() && !failed; i+=batchSize) {
+        if (isStop())
+          break;
 
-        // Check if we have to ignore empty frames
-        if (m_ignoreEmpty &&
-            !sprite->isOpaque() &&
-            doc::is_empty_image(m_seq.image.get())) {
-          save = false;
+        batch.clear();
+        batch.resize(std::min(batchSize, framesToSave.size()-i));
+        {
+          sched::TaskGroup tasks(sched::Priority::Interactive);
+          for (size_t j=0; j<batch.size(); ++j) {
+            tasks.run([this, sprite, &batch, &framesToSave, &dirsMutex, i, j]{
+              const FrameToSave& f = framesToSave[i+j];
+
+              // Draw the "frame" in a new image with the given bounds
+              // (bounds can be the selection bounds or a slice key
+              // bounds)
+              render::Render render;
+              render.setNewBlend(m_config.newBlend);
+
+              ImageRef image;
+              if (!f.bounds.isEmpty()) {
+                image.reset(Image::create(sprite->pixelFormat(),
+                                          f.bounds.w, f.bounds.h));
+                render.renderSprite(
+                  image.get(), sprite, f.frame,
+                  gfx::Clip(gfx::Point(0, 0), f.bounds));
+              }
+              else {
+                image.reset(Image::create(sprite->pixelFormat(),
+                                          sprite->width(),
+                                          sprite->height()));
+                render.renderSprite(image.get(), sprite, f.frame);
+              }
+
+              // Check if we have to ignore empty frames
+              if (m_ignoreEmpty &&
+                  !sprite->isOpaque() &&
+                  doc::is_empty_image(image.get())) {
+                return;
+              }
+
+              batch[j].save(this, m_seq.filename_list[f.outputFrame],
+                            image, sprite->palette(f.frame),
+                            f.bounds.size(), dirsMutex);
+            });
+          }
+          tasks.wait();
         }
 
-        if (save) {
-          // Setup the palette.
-          sprite->palette(frame)->copyColorsTo(m_seq.palette);
-
-          // Setup the filename to be used.
-          m_filename = m_seq.filename_list[outputFrame];
+        for (size_t j=0; j<batch.size(); ++j) {
+          SequenceFrame& seqFrame = batch[j];
+          if (!seqFrame.fop)          // Empty frame
+            continue;
 
-          // Make directories
-          makeDirectories();
+          if (seqFrame.fop->hasError())
+            setError("%s", seqFrame.fop->error().c_str());
 
-          // Call the "save" procedure... did it fail?
-          if (!m_format->save(this)) {
+          // Did the "save" procedure fail?
+          if (!seqFrame.saved) {
+            m_filename = seqFrame.fop->m_filename;
             setError("Error saving frame %d in the file \"%s\"\n",
-                     outputFrame+1, m_filename.c_str());
+                     framesToSave[i+j].outputFrame+1, m_filename.c_str());
+            failed = true;
             break;
           }
         }
 
-        m_seq.progress_offset += m_seq.progress_fraction;
-        ++outputFrame;
+        m_seq.progress_offset += m_seq.progress_fraction * batch.size();
+        {
+          std::lock_guard lock(m_mutex);
+          m_progress = m_seq.progress_offset;
+          if (m_progressInterface)
+            m_progressInterface->ackFileOpProgress(m_progress);
+        }
       }
 
       m_filename = *m_seq.filename_list.begin();
@@ -1036,10 +1501,13 @@ void FileOp::operate(IFileOpProgress* progress)
       makeDirectories();
 
       // Call the "save" procedure.
-      if (!m_format->save(this)) {
+      if (!m_format->save(this) || !commitOutputFiles()) {
+        discardOutputFiles();
         setError("Error saving the sprite in the file \"%s\"\n",
                  m_filename.c_str());
       }
+      else
+        SavedFilesRecorder::notify(m_filename);
     }
 
     // Save special data from .aseprite-data file
@@ -1049,6 +1517,7 @@ void FileOp::operate(IFileOpProgress* progress)
         !m_dataFilename.empty()) {
       try {
         save_aseprite_data_file(m_dataFilename, m_document);
+        SavedFilesRecorder::notify(m_dataFilename);
       }
       catch (const std::exception& ex) {
         setError("Error loading data file: %s\n", ex.what());
@@ -1083,6 +1552,10 @@ void FileOp::stop()
 
 FileOp::~FileOp()
 {
+  // Remove temporary files of a save operation that has failed
+  // (e.g. the format has thrown an exception)
+  discardOutputFiles();
+
   delete m_seq.palette;
 }
 
@@ -1308,7 +1781,41 @@ void FileOp::sequenceGetAlpha(int index, int* a) const
     *a = 0;
 }
 
+int FileOp::downscaleFactorToLoad(const int w, const int h,
+                                  const int maxFactor) const
+{
+  if (m_loadFitSize.isEmpty() || !m_loadROI.isEmpty() || m_metadataOnly)
+    return 1;
+
+  // The image fitted in m_loadFitSize is scaled by the smallest
+  // factor of both axes, so we can downscale the image until the
+  // biggest ratio
+  const int ratio = std::max(w / m_loadFitSize.w,
+                             h / m_loadFitSize.h);
+  int factor = 1;
+  while (factor*2 <= maxFactor && factor*2 <= ratio)
+    factor *= 2;
+  return factor;
+}
+
+gfx::Rect FileOp::boundsToLoad(const int w, const int h) const
+{
+  if (m_metadataOnly)
+    return gfx::Rect();
+
+  gfx::Rect bounds(0, 0, w, h);
+  if (!m_loadROI.bounds.isEmpty())
+    bounds &= m_loadROI.bounds;
+  return bounds;
+}
+
 ImageRef FileOp::sequenceImage(PixelFormat pixelFormat, int w, int h)
+{
+  return sequenceImage(pixelFormat, w, h, gfx::Rect(0, 0, w, h));
+}
+
+ImageRef FileOp::sequenceImage(PixelFormat pixelFormat, int w, int h,
+                               const gfx::Rect& imageBounds)
 {
   Sprite* sprite;
 
@@ -1344,9 +1851,13 @@ ImageRef FileOp::sequenceImage(PixelFormat pixelFormat, int w, int h)
     return nullptr;
   }
 
-  // Create a bitmap
-  m_seq.image.reset(Image::create(pixelFormat, w, h));
+  // Create a bitmap (an image of 1x1 if there is nothing to load)
+  m_seq.image.reset(Image::create(pixelFormat,
+                                  std::max(1, imageBounds.w),
+                                  std::max(1, imageBounds.h)));
   m_seq.last_cel = new Cel(m_seq.frame++, ImageRef(nullptr));
+  m_seq.last_cel->setPosition(imageBounds.origin());
+  m_seq.size = gfx::Size(w, h);
 
   return m_seq.image;
 }
@@ -1478,6 +1989,7 @@ FileOp::FileOp(FileOpType type,
   , m_done(false)
   , m_stop(false)
   , m_oneframe(false)
+  , m_metadataOnly(false)
   , m_createPaletteFromRgba(false)
   , m_ignoreEmpty(false)
   , m_embeddedColorProfile(false)
@@ -1499,6 +2011,7 @@ FileOp::FileOp(FileOpType type,
   m_seq.layer = nullptr;
   m_seq.last_cel = nullptr;
   m_seq.duration = 100;
+  m_seq.size = gfx::Size(0, 0);
   m_seq.flags = 0;
 }
 
@@ -1522,4 +2035,80 @@ void FileOp::makeDirectories()
   }
 }
 
+base::FileHandle FileOp::openOutputFile(const std::string& filename)
+{
+  OutputFile output{ filename, std::string() };
+
+  // Symbolic links are written directly (renaming the temporary
+  // file would replace the link itself)
+  bool atomic = m_config.atomicSave;
+#ifndef _WIN32
+  struct stat sts;
+  if (atomic &&
+      ::lstat(filename.c_str(), &sts) == 0 &&
+      S_ISLNK(sts.st_mode)) {
+    atomic = false;
+  }
+#endif
+  if (atomic)
+    output.tmpFilename = filename + ".tmp";
+
+  const std::string& fn = (atomic ? output.tmpFilename: filename);
+  base::FileHandle handle =
+    (m_config.syncSavedFiles ? base::open_file_with_exception_sync_on_close(fn, "wb"):
+                               base::open_file_with_exception(fn, "wb"));
+
+  if (m_config.saveBufferSize > 0)
+    std::setvbuf(handle.get(), nullptr, _IOFBF,
+                 std::size_t(m_config.saveBufferSize) * 1024);
+
+  if (atomic)
+    m_outputFiles.push_back(output);
+  return handle;
+}
+
+bool FileOp::commitOutputFiles()
+{
+  bool result = true;
+  for (const OutputFile& output : m_outputFiles) {
+    const std::string& src = output.tmpFilename;
+    const std::string& dst = output.filename;
+
+#ifdef _WIN32
+    result = (::MoveFileExW(base::from_utf8(src).c_str(),
+                            base::from_utf8(dst).c_str(),
+                            MOVEFILE_REPLACE_EXISTING |
+                            MOVEFILE_WRITE_THROUGH) != 0);
+#else
+    // Keep the permissions of the replaced file
+    struct stat sts;
+    if (::stat(dst.c_str(), &sts) == 0)
+      ::chmod(src.c_str(), sts.st_mode & 07777);
+    result = (std::rename(src.c_str(), dst.c_str()) == 0);
+#endif
+
+    if (!result) {
+      setError("Error replacing file \"%s\"\n", dst.c_str());
+      break;
+    }
+  }
+  // Remove the temporary files that were not renamed
+  discardOutputFiles();
+  return result;
+}
+
+void FileOp::discardOutputFiles()
+{
+  for (const OutputFile& output : m_outputFiles) {
+    try {
+      if (base::is_file(output.tmpFilename))
+        base::delete_file(output.tmpFilename);
+    }
+    catch (const std::exception&) {
+      // Ignore errors
+    }
+  }
+  m_outputFiles.clear();
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,17 +14,22 @@
 #include "app/file/file_op_config.h"
 #include "app/file/format_options.h"
 #include "app/pref/preferences.h"
+#include "base/file_handle.h"
 #include "base/paths.h"
+#include "doc/color_mode.h"
 #include "doc/frame.h"
 #include "doc/image_ref.h"
 #include "doc/pixel_format.h"
 #include "doc/selected_frames.h"
+#include "gfx/rect.h"
+#include "gfx/size.h"
 #include "os/color_space.h"
 
 #include <cstdio>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <vector>
 
 // Flags for FileOp::createLoadDocumentOperation()
 #define FILE_LOAD_SEQUENCE_NONE         0x00000001
@@ -34,6 +39,7 @@
 #define FILE_LOAD_ONE_FRAME             0x00000010
 #define FILE_LOAD_DATA_FILE             0x00000020
 #define FILE_LOAD_CREATE_PALETTE        0x00000040
+#define FILE_LOAD_METADATA_ONLY         0x00000080
 
 namespace doc {
   class Tag;
@@ -98,6 +104,20 @@ namespace app {
     doc::SelectedFrames m_selFrames;
   };
 
+  // Region of interest to load from a file (e.g. to extract a small
+  // part of a huge file). The loaded document is cropped to these
+  // bounds and only the given frames are kept (renumbered from 0).
+  // Each format can use this information to avoid decoding pixels
+  // outside the bounds or cels of other frames.
+  struct FileOpLoadROI {
+    gfx::Rect bounds;             // Empty means the whole canvas
+    doc::SelectedFrames frames;   // Empty means all frames
+
+    bool isEmpty() const {
+      return bounds.isEmpty() && frames.empty();
+    }
+  };
+
   // Used by file formats with FILE_ENCODE_ABSTRACT_IMAGE flag, to
   // encode a sprite with an intermediate transformation on-the-fly
   // (e.g. resizing).
@@ -127,6 +147,14 @@ namespace app {
     // In case that the encoder needs full frame renders (or compare
     // between frames), e.g. GIF format.
     virtual void renderFrame(const doc::frame_t frame, doc::Image* dst) const = 0;
+
+    // Returns true if renderFrame() would generate the same image
+    // with the given color mode for both frames (e.g. all their cels
+    // are linked), so the encoder can re-use the render of the
+    // previous frame.
+    virtual bool hasSameRender(const doc::frame_t frame1,
+                               const doc::frame_t frame2,
+                               const doc::ColorMode dstColorMode) const = 0;
   };
 
   // Structure to load & save files.
@@ -154,6 +182,7 @@ namespace app {
 
     bool isSequence() const { return !m_seq.filename_list.empty(); }
     bool isOneFrame() const { return m_oneframe; }
+    bool isMetadataOnly() const { return m_metadataOnly; }
     bool preserveColorProfile() const { return m_config.preserveColorProfile; }
 
     const std::string& filename() const { return m_filename; }
@@ -168,6 +197,39 @@ namespace app {
 
     const FileOpROI& roi() const { return m_roi; }
 
+    // Region of interest to load (it must be set before operate()).
+    const FileOpLoadROI& loadROI() const { return m_loadROI; }
+    void setLoadROI(const FileOpLoadROI& roi) { m_loadROI = roi; }
+
+    // Returns false if the cels of the given frame will be discarded
+    // after loading the file (because of the load ROI).
+    bool isFrameToLoad(const doc::frame_t frame) const {
+      return (!m_metadataOnly &&
+              (m_loadROI.frames.empty() ||
+               m_loadROI.frames.contains(frame)));
+    }
+
+    // Size where the loaded sprite is going to be fitted (e.g. the
+    // size of a thumbnail). Formats that can decode a downscaled
+    // version of the file faster (e.g. JPEG with DCT scaling) can
+    // create a smaller sprite using downscaleFactorToLoad(). An
+    // empty size means that the file is loaded with its original
+    // size.
+    const gfx::Size& loadFitSize() const { return m_loadFitSize; }
+    void setLoadFitSize(const gfx::Size& size) { m_loadFitSize = size; }
+
+    // Returns the biggest power of two factor (up to maxFactor) to
+    // downscale a w x h image and still cover the loadFitSize(). It
+    // returns 1 if the image must be loaded with its original size
+    // (e.g. there is no fit size or there is a load ROI).
+    int downscaleFactorToLoad(const int w, const int h,
+                              const int maxFactor) const;
+
+    // Area of a w x h image that should be decoded (the whole image
+    // if there is no load ROI bounds). It could be empty (e.g. if
+    // we are loading only the metadata).
+    gfx::Rect boundsToLoad(const int w, const int h) const;
+
     // Creates a new document with the given sprite.
     void createDocument(Sprite* spr);
     void operate(IFileOpProgress* progress = nullptr);
@@ -228,6 +290,10 @@ namespace app {
     void sequenceSetAlpha(int index, int a);
     void sequenceGetAlpha(int index, int* a) const;
     ImageRef sequenceImage(PixelFormat pixelFormat, int w, int h);
+    // Creates a sprite of w x h pixels but an image/cel only for the
+    // given bounds (the area returned by boundsToLoad()).
+    ImageRef sequenceImage(PixelFormat pixelFormat, int w, int h,
+                           const gfx::Rect& imageBounds);
     const ImageRef sequenceImage() const { return m_seq.image; }
     const Palette* sequenceGetPalette() const { return m_seq.palette; }
     bool sequenceGetHasAlpha() const {
@@ -265,6 +331,15 @@ namespace app {
     bool newBlend() const { return m_config.newBlend; }
     const FileOpConfig& config() const { return m_config; }
 
+    // Opens a file to write the output of a save operation (formats
+    // must use this function instead of opening the filename
+    // directly). The file is opened with a big buffer to avoid a lot
+    // of small writes (which are slow in network shares and
+    // cloud-synced folders). With atomic saves, the data is written
+    // in a temporary file that replaces the given filename only when
+    // the format finishes without errors.
+    base::FileHandle openOutputFile(const std::string& filename);
+
   private:
     FileOp();                   // Undefined
     FileOp(FileOpType type,
@@ -292,6 +367,9 @@ namespace app {
     bool m_oneframe;            // Load just one frame (in formats
                                 // that support animation like
                                 // GIF/FLI/ASE).
+    bool m_metadataOnly;        // Load only the metadata (sprite
+                                // size, frames, layers, tags,
+                                // slices), not the pixels.
     bool m_createPaletteFromRgba;
     bool m_ignoreEmpty;
 
@@ -303,6 +381,9 @@ namespace app {
 
     FileOpConfig m_config;
 
+    FileOpLoadROI m_loadROI;
+    gfx::Size m_loadFitSize;
+
     // Options
     FormatOptionsPtr m_formatOptions;
 
@@ -320,6 +401,7 @@ namespace app {
       LayerImage* layer;
       Cel* last_cel;
       int duration;
+      gfx::Size size;             // Size of the last loaded file.
       // Flags after the user choose what to do with the sequence.
       int flags;
     } m_seq;
@@ -327,9 +409,20 @@ namespace app {
     class FileAbstractImageImpl;
     std::unique_ptr<FileAbstractImageImpl> m_abstractImage;
 
+    struct SequenceFrame;
+
+    // Files opened with openOutputFile()
+    struct OutputFile {
+      std::string filename;
+      std::string tmpFilename;  // Empty if the file is written directly
+    };
+    std::vector<OutputFile> m_outputFiles;
+
     void prepareForSequence();
     void makeAbstractImage();
     void makeDirectories();
+    bool commitOutputFiles();
+    void discardOutputFiles();
   };
 
   // Available extensions for each load/save operation.
@@ -338,6 +431,12 @@ namespace app {
 
   // High-level routines to load/save documents.
   Doc* load_document(Context* context, const std::string& filename);
+
+  // Loads only the metadata of the file (sprite size, frames, layers,
+  // tags, slices, etc.). Formats that support it skip the decoding of
+  // pixels, so cels can be missing or empty. The returned document
+  // isn't added to the context.
+  Doc* load_document_metadata(Context* context, const std::string& filename);
   int save_document(Context* context, Doc* document);
 
   // Returns true if the given filename contains a file extension that
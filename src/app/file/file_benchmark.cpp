@@ -0,0 +1,225 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+// Load/save throughput of each registered file format with
+// generated sprites of several sizes and color modes. The bytes
+// processed are the raw pixels of all frames (so the MB/s of
+// different formats can be compared), and the "frames" counter is
+// the number of frames loaded/saved per second. Use
+// --benchmark_filter=png to measure only one format.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/file/file.h"
+#include "app/file/file_format.h"
+#include "app/file/file_formats_manager.h"
+#include "app/test_context.h"
+#include "base/fs.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "fmt/format.h"
+
+#include <benchmark/benchmark.h>
+
+#include <memory>
+#include <string>
+
+using namespace app;
+using namespace doc;
+
+namespace {
+
+struct FormatArgs {
+  std::string ext;
+  ColorMode colorMode;
+  int size;
+  frame_t frames;
+};
+
+color_t make_color(const ColorMode colorMode, const int i)
+{
+  switch (colorMode) {
+    case ColorMode::RGB:
+      return rgba((i*67) & 255, (i*131) & 255, (i*37) & 255, 255);
+    case ColorMode::GRAYSCALE:
+      return graya((i*67) & 255, 255);
+    default:
+      return 1 + (i*7) % 255;
+  }
+}
+
+// Creates a sprite with one layer where each frame has some shapes
+// (areas with the same color that can be compressed) and a noisy
+// area (which cannot be compressed).
+Doc* make_document(Context* ctx, const FormatArgs& args)
+{
+  const int w = args.size;
+  const int h = args.size;
+  Doc* doc = ctx->documents().add(w, h, args.colorMode, 256);
+  Sprite* spr = doc->sprite();
+  spr->setTotalFrames(args.frames);
+
+  Layer* layer = spr->root()->firstLayer();
+  for (frame_t f=0; f<args.frames; ++f) {
+    Cel* cel = layer->cel(f);
+    if (!cel) {
+      ImageRef image(Image::create(spr->pixelFormat(), w, h));
+      cel = new Cel(f, image);
+      static_cast<LayerImage*>(layer)->addCel(cel);
+    }
+
+    Image* image = cel->image();
+    clear_image(image, make_color(args.colorMode, f));
+    fill_ellipse(image, f, f, w/2+f, h/2+f, 0, 0,
+                 make_color(args.colorMode, f+1));
+    fill_rect(image, w/4, h/4, w/2, h/2,
+              make_color(args.colorMode, f+2));
+
+    uint32_t seed = 1 + f;
+    for (int y=h/2; y<h; ++y) {
+      for (int x=w/2; x<w; ++x) {
+        seed = seed*1103515245 + 12345;
+        put_pixel(image, x, y, make_color(args.colorMode, seed >> 16));
+      }
+    }
+  }
+  return doc;
+}
+
+std::string get_filename(const FormatArgs& args)
+{
+  return fmt::format("_file_benchmark.{}", args.ext);
+}
+
+void set_counters(benchmark::State& state,
+                  const Sprite* spr)
+{
+  const Image* image = spr->root()->firstLayer()->cel(0)->image();
+  const int64_t frames = state.iterations() * spr->totalFrames();
+  state.SetBytesProcessed(
+    frames * image->getRowStrideSize() * image->height());
+  state.counters["frames"] =
+    benchmark::Counter(double(frames), benchmark::Counter::kIsRate);
+}
+
+void BM_SaveFile(benchmark::State& state, const FormatArgs args) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc(make_document(&ctx, args));
+  const std::string fn = get_filename(args);
+  doc->setFilename(fn);
+
+  while (state.KeepRunning()) {
+    // Don't re-use compressed images cached in the previous save
+    for (Cel* cel : doc->sprite()->uniqueCels())
+      cel->image()->incrementVersion();
+
+    if (save_document(&ctx, doc.get()) != 0) {
+      state.SkipWithError("Error saving the file");
+      break;
+    }
+  }
+
+  set_counters(state, doc->sprite());
+  doc->close();
+  base::delete_file(fn);
+}
+
+void BM_LoadFile(benchmark::State& state, const FormatArgs args) {
+  TestContext ctx;
+  std::unique_ptr<Doc> doc(make_document(&ctx, args));
+  const std::string fn = get_filename(args);
+  doc->setFilename(fn);
+  if (save_document(&ctx, doc.get()) != 0) {
+    state.SkipWithError("Error saving the file");
+    doc->close();
+    return;
+  }
+
+  while (state.KeepRunning()) {
+    std::unique_ptr<Doc> loaded(load_document(&ctx, fn));
+    if (!loaded) {
+      state.SkipWithError("Error loading the file");
+      break;
+    }
+    loaded->close();
+  }
+
+  set_counters(state, doc->sprite());
+  doc->close();
+  base::delete_file(fn);
+}
+
+// Registers the load/save benchmarks of each format with the color
+// modes that it supports
+void register_file_benchmarks()
+{
+  const ColorMode colorModes[] = { ColorMode::RGB,
+                                   ColorMode::GRAYSCALE,
+                                   ColorMode::INDEXED };
+  const int sizes[] = { 64, 256, 1024 };
+
+  for (FileFormat* format : *FileFormatsManager::instance()) {
+    if (!format->support(FILE_SUPPORT_LOAD) ||
+        !format->support(FILE_SUPPORT_SAVE))
+      continue;
+
+    base::paths exts;
+    format->getExtensions(exts);
+    if (exts.empty())
+      continue;
+
+    for (const ColorMode colorMode : colorModes) {
+      if ((colorMode == ColorMode::RGB && !format->support(FILE_SUPPORT_RGB)) ||
+          (colorMode == ColorMode::GRAYSCALE && !format->support(FILE_SUPPORT_GRAY)) ||
+          (colorMode == ColorMode::INDEXED && !format->support(FILE_SUPPORT_INDEXED)))
+        continue;
+
+      for (const int size : sizes) {
+        // .ico files cannot contain images bigger than 256x256
+        if (format->dioFormat() == dio::FileFormat::ICO_IMAGES && size > 256)
+          continue;
+
+        FormatArgs args;
+        args.ext = exts.front();
+        args.colorMode = colorMode;
+        args.size = size;
+        // Only one frame for formats without animation (several
+        // frames would be saved as a sequence of files)
+        args.frames = (format->support(FILE_SUPPORT_FRAMES) ? 8: 1);
+
+        const std::string name =
+          fmt::format("{}/mode:{}/size:{}/frames:{}",
+                      format->name(), int(colorMode), size, args.frames);
+
+        benchmark::RegisterBenchmark(("BM_SaveFile/" + name).c_str(),
+                                     BM_SaveFile, args)
+          ->Unit(benchmark::kMillisecond)
+          ->UseRealTime();
+        benchmark::RegisterBenchmark(("BM_LoadFile/" + name).c_str(),
+                                     BM_LoadFile, args)
+          ->Unit(benchmark::kMillisecond)
+          ->UseRealTime();
+      }
+    }
+  }
+}
+
+} // anonymous namespace
+
+int app_main(int argc, char* argv[])
+{
+  register_file_benchmarks();
+
+  ::benchmark::Initialize(&argc, argv);
+  return ::benchmark::RunSpecifiedBenchmarks();
+}
@@ -12,6 +12,7 @@
 #include "app/drm.h"
 #include "app/file/file_format.h"
 #include "app/file/format_options.h"
+#include "perf/trace.h"
 
 #include <algorithm>
 
@@ -43,6 +44,7 @@ dio::FileFormat FileFormat::dioFormat() const
 bool FileFormat::load(FileOp* fop)
 {
   ASSERT(support(FILE_SUPPORT_LOAD));
+  PERF_ZONE("FileFormat::load");
   return onLoad(fop);
 }
 
@@ -52,6 +54,7 @@ bool FileFormat::save(FileOp* fop)
   DRM_INVALID return false;
 
   ASSERT(support(FILE_SUPPORT_SAVE));
+  PERF_ZONE("FileFormat::save");
   return onSave(fop);
 }
 #endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -42,6 +42,46 @@ namespace app {
     // compressed data that was loaded as-is).
     bool cacheCompressedTilesets = true;
 
+    // Cache compressed cel images. Same as cacheCompressedTilesets
+    // but for cels, so only modified cels are re-compressed when the
+    // .aseprite file is saved.
+    bool cacheCompressedCels = true;
+
+    // Save unlinked cels with the same image, position, opacity and
+    // user data of a previous cel in the same layer as linked cels
+    // in .aseprite files (they will be linked when the file is
+    // loaded again).
+    bool linkDuplicatedCels = false;
+
+    // Decode the compressed cel images of .aseprite files only when
+    // they are used for the first time (instead of decoding all of
+    // them when the file is opened).
+    bool lazyCelLoading = false;
+
+    // Maximum number of threads used to quantize frames when a GIF
+    // file is saved (0 to use all CPU cores).
+    int gifEncoderThreads = 0;
+
+    // Speed/size trade-off to save PNG files (FAST uses a low zlib
+    // level and a fixed filter, MAX tries all filters for each row
+    // with the best zlib level).
+    app::gen::PngCompression pngCompression = app::gen::PngCompression::DEFAULT;
+
+    // Don't load the pixels of hidden layers from .psd files (the
+    // layers are created anyway, hidden and without cels).
+    bool psdSkipHiddenLayers = false;
+
+    // Write saved files in a temporary file and rename it to the
+    // destination filename at the end (so a failed save doesn't
+    // leave a truncated file).
+    bool atomicSave = true;
+
+    // Size of the buffer (in KB) used to write saved files.
+    int saveBufferSize = 1024;
+
+    // Flush saved files to disk (fsync) when they are closed.
+    bool syncSavedFiles = true;
+
     void fillFromPreferences();
   };
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2019  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,11 @@
 #include "app/file/file.h"
 #include "app/file/file_formats_manager.h"
 #include "base/base64.h"
+#include "base/file_handle.h"
+#include "dio/aseprite_common.h"
+#include "dio/aseprite_decoder.h"
+#include "dio/decode_delegate.h"
+#include "dio/file_interface.h"
 #include "doc/doc.h"
 #include "doc/user_data.h"
 
@@ -83,6 +88,176 @@ TEST(File, SeveralSizes)
   }
 }
 
+TEST(File, SaveReusesCompressedCels)
+{
+  app::Context ctx;
+  const char* fn = "test.ase";
+
+  {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(32, 32, doc::ColorMode::RGB, 256));
+    doc->setFilename(fn);
+
+    Sprite* sprite = doc->sprite();
+    LayerImage* layer2 = new LayerImage(sprite);
+    sprite->root()->addLayer(layer2);
+    layer2->addCel(new Cel(frame_t(0), ImageRef(Image::create(IMAGE_RGB, 32, 32))));
+
+    Image* image1 = sprite->root()->firstLayer()->cel(frame_t(0))->image();
+    Image* image2 = layer2->cel(frame_t(0))->image();
+    clear_image(image1, rgba(255, 0, 0, 255));
+    clear_image(image2, rgba(0, 0, 255, 255));
+
+    save_document(&ctx, doc.get());
+    ASSERT_FALSE(image1->compressedData().empty());
+    ASSERT_FALSE(image2->compressedData().empty());
+    const base::buffer data2 = image2->compressedData();
+
+    // Only the modified image is compressed again
+    put_pixel(image1, 3, 4, rgba(0, 255, 0, 255));
+    image1->incrementVersion();
+    EXPECT_NE(image1->version(), image1->compressedDataVersion());
+
+    save_document(&ctx, doc.get());
+    EXPECT_EQ(image1->version(), image1->compressedDataVersion());
+    EXPECT_EQ(image2->version(), image2->compressedDataVersion());
+    EXPECT_EQ(data2, image2->compressedData());
+    doc->close();
+  }
+
+  {
+    std::unique_ptr<Doc> doc(load_document(&ctx, fn));
+    Sprite* sprite = doc->sprite();
+    ASSERT_EQ(2, sprite->allLayersCount());
+
+    const Image* image1 = sprite->root()->firstLayer()->cel(frame_t(0))->image();
+    const Image* image2 = sprite->root()->lastLayer()->cel(frame_t(0))->image();
+    EXPECT_EQ(rgba(0, 255, 0, 255), get_pixel(image1, 3, 4));
+    EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(image1, 4, 4));
+    EXPECT_EQ(rgba(0, 0, 255, 255), get_pixel(image2, 3, 4));
+
+    // The loaded compressed data is kept to save the file again
+    EXPECT_FALSE(image1->compressedData().empty());
+    EXPECT_EQ(image1->version(), image1->compressedDataVersion());
+    doc->close();
+  }
+}
+
+TEST(File, LazyCelLoading)
+{
+  app::Context ctx;
+  const char* fn = "test.ase";
+
+  {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(32, 32, doc::ColorMode::RGB, 256));
+    doc->setFilename(fn);
+
+    Image* image = doc->sprite()->root()->firstLayer()->cel(frame_t(0))->image();
+    clear_image(image, rgba(255, 0, 0, 255));
+    put_pixel(image, 3, 4, rgba(0, 255, 0, 255));
+    save_document(&ctx, doc.get());
+    doc->close();
+  }
+
+  FileOpConfig config;
+  config.lazyCelLoading = true;
+
+  auto loadLazily = [&ctx, &config, fn]() -> Doc* {
+    std::unique_ptr<FileOp> fop(
+      FileOp::createLoadDocumentOperation(
+        &ctx, fn,
+        FILE_LOAD_CREATE_PALETTE |
+        FILE_LOAD_SEQUENCE_NONE, &config));
+    fop->operate();
+    fop->done();
+    fop->postLoad();
+    EXPECT_FALSE(fop->hasError());
+
+    Doc* doc = fop->releaseDocument();
+    doc->setContext(&ctx);
+    return doc;
+  };
+
+  {
+    std::unique_ptr<Doc> doc(loadLazily());
+    const Cel* cel = doc->sprite()->root()->firstLayer()->cel(frame_t(0));
+    EXPECT_FALSE(cel->data()->isImageLoaded());
+    EXPECT_EQ(gfx::Rect(0, 0, 32, 32), cel->bounds());
+
+    EXPECT_EQ(rgba(0, 255, 0, 255), get_pixel(cel->image(), 3, 4));
+    EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(cel->image(), 4, 4));
+    EXPECT_TRUE(cel->data()->isImageLoaded());
+    doc->close();
+  }
+
+  // Save the file over itself without using its cels
+  {
+    std::unique_ptr<Doc> doc(loadLazily());
+    save_document(&ctx, doc.get());
+    doc->close();
+  }
+
+  {
+    std::unique_ptr<Doc> doc(load_document(&ctx, fn));
+    const Image* image = doc->sprite()->root()->firstLayer()->cel(frame_t(0))->image();
+    EXPECT_EQ(rgba(0, 255, 0, 255), get_pixel(image, 3, 4));
+    EXPECT_EQ(rgba(255, 0, 0, 255), get_pixel(image, 4, 4));
+    doc->close();
+  }
+}
+
+TEST(File, ChunkIndex)
+{
+  app::Context ctx;
+  const char* fn = "test.ase";
+
+  {
+    std::unique_ptr<Doc> doc(
+      ctx.documents().add(32, 32, doc::ColorMode::RGB, 256));
+    doc->setFilename(fn);
+
+    Sprite* sprite = doc->sprite();
+    LayerImage* layer2 = new LayerImage(sprite);
+    sprite->root()->addLayer(layer2);
+    sprite->setTotalFrames(3);
+    for (frame_t frame=0; frame<3; ++frame) {
+      ImageRef image(Image::create(IMAGE_RGB, 8, 8));
+      clear_image(image.get(), rgba(255, 0, 0, 255));
+      layer2->addCel(new Cel(frame, image));
+    }
+    save_document(&ctx, doc.get());
+    doc->close();
+  }
+
+  base::FileHandle handle(base::open_file(fn, "rb"));
+  dio::StdioFileInterface fileInterface(handle.get());
+  dio::DecodeDelegate delegate;
+  dio::AsepriteDecoder decoder;
+  decoder.initialize(&delegate, &fileInterface);
+
+  dio::AsepriteChunkIndex index;
+  ASSERT_TRUE(decoder.readChunkIndex(&index));
+  ASSERT_EQ(size_t(3), index.frames().size());
+
+  // The first layer has a cel only in the first frame
+  EXPECT_TRUE(index.find(ASE_FILE_CHUNK_CEL, 0, 0) != nullptr);
+  EXPECT_TRUE(index.find(ASE_FILE_CHUNK_CEL, 1, 0) == nullptr);
+
+  // Each offset points to the chunk of the given type
+  auto read16At = [&fileInterface](const size_t pos) {
+    fileInterface.seek(pos);
+    const int lo = fileInterface.read8();
+    const int hi = fileInterface.read8();
+    return (lo | (hi << 8));
+  };
+  const dio::AsepriteChunkIndex::Entry* entry =
+    index.find(ASE_FILE_CHUNK_CEL, 2, 1);
+  ASSERT_TRUE(entry != nullptr);
+  EXPECT_EQ(ASE_FILE_CHUNK_CEL, read16At(entry->offset + 4));
+  EXPECT_EQ(ASE_FILE_FRAME_MAGIC, read16At(index.frames()[2] + 4));
+}
+
 TEST(File, CustomProperties)
 {
   app::Context ctx;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,10 +18,11 @@
 #include "base/file_handle.h"
 #include "doc/doc.h"
 #include "flic/flic.h"
-#include "render/render.h"
+#include "sched/task_group.h"
 
 #include <algorithm>
 #include <cstdio>
+#include <vector>
 
 namespace app {
 
@@ -209,7 +210,7 @@ bool FliFormat::onSave(FileOp* fop)
   const FileAbstractImage* sprite = fop->abstractImage();
 
   // Open the file to write in binary mode
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* f = handle.get();
   flic::StdioFileInterface finterface(f);
   flic::Encoder encoder(&finterface);
@@ -221,25 +222,46 @@ bool FliFormat::onSave(FileOp* fop)
   header.speed = get_time_precision(sprite, fop->roi().selectedFrames());
   encoder.writeHeader(header);
 
-  // Create the bitmaps
-  ImageRef bmp(Image::create(IMAGE_INDEXED, sprite->width(), sprite->height()));
-  render::Render render;
-  render.setNewBlend(fop->newBlend());
+  // Frames to write, the last one is the ring frame (the first frame
+  // again to loop the animation)
+  std::vector<frame_t> frames;
+  for (frame_t frame : fop->roi().selectedFrames())
+    frames.push_back(frame);
+  frames.push_back(frames.front());
+  const int nframes = int(frames.size())-1;
+
+  // Create the bitmaps (one for the current frame and other for the
+  // next one)
+  ImageRef bmps[2] = {
+    ImageRef(Image::create(IMAGE_INDEXED, sprite->width(), sprite->height())),
+    ImageRef(Image::create(IMAGE_INDEXED, sprite->width(), sprite->height()))
+  };
+  int cur = 0;
+  sprite->renderFrame(frames[0], bmps[cur].get());
 
   // Write frame by frame
   flic::Frame fliFrame;
-  fliFrame.pixels = bmp->getPixelAddress(0, 0);
-  fliFrame.rowstride = IndexedTraits::getRowStrideBytes(bmp->width());
-
-  auto frame_beg = fop->roi().selectedFrames().begin();
-  auto frame_end = fop->roi().selectedFrames().end();
-  auto frame_it = frame_beg;
-  frame_t nframes = fop->roi().frames();
-  for (frame_t f=0; f<=nframes; ++f, ++frame_it) {
-    if (frame_it == frame_end)
-      frame_it = frame_beg;
+  fliFrame.rowstride = IndexedTraits::getRowStrideBytes(sprite->width());
+
+  // The next frame is rendered in background while the encoder
+  // compares the current frame with the previous one and writes it.
+  // Frames rendered in the same way as the previous one (e.g. all
+  // their cels are linked) are not rendered again.
+  sched::TaskGroup renderTask;
+  for (int f=0; f<=nframes; ++f) {
+    const frame_t frame = frames[f];
+
+    bool renderNext = false;
+    if (f < nframes && !sprite->hasSameRender(frame, frames[f+1],
+                                           ColorMode::INDEXED)) {
+      const frame_t nextFrame = frames[f+1];
+      Image* dst = bmps[1-cur].get();
+      renderTask.run([sprite, nextFrame, dst]{
+        sprite->renderFrame(nextFrame, dst);
+      });
+      renderNext = true;
+    }
 
-    frame_t frame = *frame_it;
     const Palette* pal = sprite->palette(frame);
     int size = std::min(256, pal->size());
 
@@ -250,8 +272,7 @@ bool FliFormat::onSave(FileOp* fop)
       fliFrame.colormap[c].b = rgba_getb(color);
     }
 
-    // Render the frame in the bitmap
-    sprite->renderFrame(frame, bmp.get());
+    fliFrame.pixels = bmps[cur]->getPixelAddress(0, 0);
 
     // How many times this frame should be written to get the same
     // time that it has in the sprite
@@ -267,6 +288,11 @@ bool FliFormat::onSave(FileOp* fop)
 
     // Update progress
     fop->setProgress((float)(f+1) / (float)(nframes+1));
+
+    if (renderNext) {
+      renderTask.wait();
+      cur = 1-cur;
+    }
   }
 
   return true;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,6 +23,7 @@
 #include "app/util/autocrop.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/thread_pool.h"
 #include "doc/doc.h"
 #include "doc/octree_map.h"
 #include "gfx/clip.h"
@@ -35,6 +36,13 @@
 #include "gif_options.xml.h"
 
 #include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include <gif_lib.h>
 
@@ -223,6 +231,8 @@ public:
     , m_localTransparentIndex(-1)
     , m_frameDelay(1)
     , m_remap(256)
+    , m_lastCel(nullptr)
+    , m_currentImageChanged(true)
     , m_hasLocalColormaps(false)
     , m_firstLocalColormap(nullptr) {
     GIF_TRACE("GIF: background index=%d\n", (int)m_gifFile->SBackGroundColor);
@@ -251,6 +261,12 @@ public:
       if (m_fop->isOneFrame() && m_frameNum > 0)
         break;
 
+      // GIF frames are composed over the previous ones, so we can
+      // stop only after the last frame of the load ROI
+      const SelectedFrames& roiFrames = m_fop->loadROI().frames;
+      if (!roiFrames.empty() && m_frameNum > roiFrames.lastFrame())
+        break;
+
       if (m_fop->isStop())
         break;
 
@@ -402,9 +418,14 @@ private:
                             m_disposalMethod,
                             frameBounds,
                             m_bgIndex);
+    if (m_disposalMethod == DisposalMethod::RESTORE_BGCOLOR ||
+        m_disposalMethod == DisposalMethod::RESTORE_PREVIOUS)
+      m_currentImageChanged = true;
 
-    // Copy the current image into previous image
-    copy_image(m_previousImage.get(), m_currentImage.get());
+    // Copy the current image into previous image (both images are
+    // equal outside the frame bounds, composition and disposal only
+    // modify pixels inside them)
+    m_previousImage->copy(m_currentImage.get(), gfx::Clip(frameBounds));
 
     // Set frame delay (1/100th seconds to milliseconds)
     if (m_frameDelay >= 0)
@@ -689,7 +710,10 @@ private:
         continue;
 
       i = m_remap[i];
-      *dstIt = i;
+      if (*dstIt != i) {
+        *dstIt = i;
+        m_currentImageChanged = true;
+      }
     }
 
     ASSERT(srcIt == srcEnd);
@@ -725,14 +749,26 @@ private:
         colormap->Colors[i].Green,
         colormap->Colors[i].Blue, 255);
 
-      *dstIt = i;
+      if (*dstIt != i) {
+        *dstIt = i;
+        m_currentImageChanged = true;
+      }
     }
 
     ASSERT(srcIt == srcEnd);
     ASSERT(dstIt == dstEnd);
   }
 
+  // Creates the cel for the current frame. If the composited image
+  // is equal to the previous frame (e.g. the frame only changes the
+  // duration or draws transparent pixels), we create a linked cel
+  // instead of a new copy of the whole canvas.
   void createCel() {
+    if (m_lastCel && !m_currentImageChanged) {
+      m_layer->addCel(Cel::MakeLink(m_frameNum, m_lastCel));
+      return;
+    }
+
     Cel* cel = new Cel(m_frameNum, ImageRef(0));
     try {
       ImageRef celImage(Image::createCopy(m_currentImage.get()));
@@ -748,6 +784,8 @@ private:
       delete cel;
       throw;
     }
+    m_lastCel = cel;
+    m_currentImageChanged = false;
   }
 
   void readExtensionRecord() {
@@ -843,6 +881,10 @@ private:
        m_bgIndex));
 
     m_sprite->setPixelFormat(IMAGE_RGB);
+
+    // The next cel cannot be linked to the last one, its image was
+    // converted with other palette
+    m_currentImageChanged = true;
   }
 
   void remapToGlobalColormap(ColorMapObject* colormap) {
@@ -894,6 +936,8 @@ private:
   ImageRef m_currentImage;
   ImageRef m_previousImage;
   Remap m_remap;
+  Cel* m_lastCel;               // Last cel with its own image (not linked)
+  bool m_currentImageChanged;   // m_currentImage is different from m_lastCel image
   bool m_hasLocalColormaps;     // Indicates that this fila contains local colormaps
 
   // This is a copy of the first local color map. It's used to see if
@@ -1096,14 +1140,26 @@ public:
     }
 
     // Create the 3 temporary images (previous/current/next) to
-    // compare pixels between them.
-    for (int i=0; i<3; ++i)
+    // compare pixels between them, plus one extra image to render the
+    // frame after the next one in background.
+    for (int i=0; i<4; ++i)
       m_images[i].reset(Image::create((m_preservePaletteOrder)? IMAGE_INDEXED : IMAGE_RGB,
                                       m_spriteBounds.w,
                                       m_spriteBounds.h));
   }
 
   ~GifEncoder() {
+    // Wait the background render (e.g. if there was an exception
+    // writing a frame)
+    if (m_renderPool) {
+      std::unique_lock lock(m_renderMutex);
+      m_renderCV.wait(lock, [this]{ return !m_rendering; });
+    }
+    if (m_quantizePool) {
+      std::unique_lock lock(m_quantizeMutex);
+      m_quantizeCV.wait(lock, [this]{ return m_quantizing == 0; });
+    }
+
     if (m_globalColormap)
       GifFreeMapObject(m_globalColormap);
   }
@@ -1119,6 +1175,7 @@ public:
     m_previousImage = m_images[0].get();
     m_currentImage = m_images[1].get();
     m_nextImage = m_images[2].get();
+    m_aheadImage = m_images[3].get();
 
     auto frame_beg = m_fop->roi().selectedFrames().begin();
 #if _DEBUG
@@ -1129,6 +1186,25 @@ public:
     // In this code "gifFrame" will be the GIF frame, and "frame" will
     // be the doc::Sprite frame.
     gifframe_t nframes = totalFrames();
+
+    // The frame after the next one is rendered in a second thread
+    // while the current frame is compared/quantized/encoded.
+    const bool renderAhead = (nframes > 2 &&
+                              std::thread::hardware_concurrency() > 1);
+    if (renderAhead)
+      m_renderPool = std::make_unique<base::thread_pool>(1);
+
+    // Frames are quantized in parallel (when we have to calculate a
+    // palette for each frame this is the most expensive step).
+    int threads = m_fop->config().gifEncoderThreads;
+    if (threads <= 0)
+      threads = std::thread::hardware_concurrency();
+    threads = std::min(threads, int(nframes));
+    if (threads > 1) {
+      m_quantizePool = std::make_unique<base::thread_pool>(threads);
+      m_maxQuantizedFrames = 2*threads;
+    }
+
     for (gifframe_t gifFrame=0; gifFrame<nframes; ++gifFrame) {
       ASSERT(frame_it != frame_end);
       frame_t frame = *frame_it;
@@ -1141,8 +1217,25 @@ public:
 
       // Render next frame
       std::swap(m_currentImage, m_nextImage);
-      if (gifFrame+1 < nframes)
-        renderFrame(*frame_it, m_nextImage);
+      if (gifFrame+1 < nframes) {
+        // The next frame was already rendered in background in the
+        // previous iteration
+        if (renderAhead && gifFrame > 0) {
+          waitBackgroundRender();
+          std::swap(m_nextImage, m_aheadImage);
+        }
+        else
+          renderFrame(*frame_it, m_nextImage);
+      }
+
+      // Start rendering the frame after the next one (m_aheadImage
+      // is not used by the current frame)
+      if (renderAhead && gifFrame+2 < nframes) {
+        auto ahead_it = frame_it;
+        ++ahead_it;
+        ASSERT(ahead_it != frame_end);
+        renderFrameInBackground(*ahead_it, m_aheadImage);
+      }
 
       gfx::Rect frameBounds = m_spriteBounds;
       DisposalMethod disposal = DisposalMethod::DO_NOT_DISPOSE;
@@ -1156,17 +1249,51 @@ public:
 
       calculateDeltaImageFrameBoundsDisposal(gifFrame, frameBounds, disposal);
 
-      writeImage(gifFrame, frame, frameBounds, disposal,
-                 // Only the last frame in the animation needs the fix
-                 (fix_last_frame_duration && gifFrame == nframes-1));
+      auto qf = std::make_unique<QuantizedFrame>();
+      qf->gifFrame = gifFrame;
+      qf->frame = frame;
+      qf->frameBounds = frameBounds;
+      qf->disposal = disposal;
+      // Only the last frame in the animation needs the fix
+      qf->fixDuration = (fix_last_frame_duration && gifFrame == nframes-1);
+      qf->deltaImage = std::move(m_deltaImage);
+
+      if (m_quantizePool)
+        quantizeFrameInBackground(*qf);
+      else
+        quantizeFrame(*qf);
+      m_quantizedFrames.push_back(std::move(qf));
 
-      m_fop->setProgress(double(gifFrame+1) / double(nframes));
+      // Write the quantized frames in order, limiting the number of
+      // frames waiting to be written.
+      writeQuantizedFrames(gifFrame+1 < nframes ? m_maxQuantizedFrames: 0);
     }
     return true;
   }
 
 private:
 
+  // A frame ready to be quantized (deltaImage) or to be written in
+  // the file (frameImage).
+  struct QuantizedFrame {
+    gifframe_t gifFrame = 0;
+    frame_t frame = 0;
+    gfx::Rect frameBounds;
+    DisposalMethod disposal = DisposalMethod::NONE;
+    bool fixDuration = false;
+    std::unique_ptr<Image> deltaImage;
+
+    // Result of quantizeFrame()
+    ImageRef frameImage;
+    Palette localPalette;       // Used when there is no global colormap
+    int localTransparent = -1;
+    Remap remap = Remap(256);
+
+    // Used when the frame is quantized in background
+    bool ready = false;
+    std::exception_ptr error;
+  };
+
   void calculateDeltaImageFrameBoundsDisposal(gifframe_t gifFrame,
                                               gfx::Rect& frameBounds,
                                               DisposalMethod& disposal) {
@@ -1382,36 +1509,81 @@ private:
   }
 
 
-  void writeImage(const gifframe_t gifFrame,
-                  const frame_t frame,
-                  const gfx::Rect& frameBounds,
-                  const DisposalMethod disposal,
-                  const bool fixDuration) {
+  // Quantizes the frame in m_quantizePool.
+  void quantizeFrameInBackground(QuantizedFrame& qf) {
+    ASSERT(m_quantizePool);
+    {
+      std::lock_guard lock(m_quantizeMutex);
+      ++m_quantizing;
+    }
+    m_quantizePool->execute(
+      [this, &qf]{
+        std::exception_ptr error;
+        try {
+          quantizeFrame(qf);
+        }
+        catch (...) {
+          error = std::current_exception();
+        }
+
+        std::lock_guard lock(m_quantizeMutex);
+        qf.error = error;
+        qf.ready = true;
+        --m_quantizing;
+        m_quantizeCV.notify_all();
+      });
+  }
+
+  // Writes the first quantized frames in the queue until there are
+  // only "maxFrames" frames waiting to be written.
+  void writeQuantizedFrames(const size_t maxFrames) {
+    const gifframe_t nframes = totalFrames();
+    while (m_quantizedFrames.size() > maxFrames) {
+      std::unique_ptr<QuantizedFrame> qf = std::move(m_quantizedFrames.front());
+      m_quantizedFrames.pop_front();
+
+      if (m_quantizePool) {
+        std::unique_lock lock(m_quantizeMutex);
+        m_quantizeCV.wait(lock, [&qf]{ return qf->ready; });
+        if (qf->error)
+          std::rethrow_exception(qf->error);
+      }
+
+      writeImage(*qf);
+      m_fop->setProgress(double(qf->gifFrame+1) / double(nframes));
+    }
+  }
+
+  // Quantizes the delta image of the frame to the final indexed
+  // image. It doesn't use the GIF file, so it can be called from
+  // worker threads for several frames at the same time.
+  void quantizeFrame(QuantizedFrame& qf) const {
+    const gfx::Rect& frameBounds = qf.frameBounds;
+    int transparentIndex = m_transparentIndex;
+
     Palette framePalette;
     if (m_globalColormap)
       framePalette = m_globalColormapPalette;
     else
-      framePalette = calculatePalette();
+      framePalette = calculatePalette(qf.deltaImage.get(), transparentIndex);
 
     OctreeMap octree;
-    octree.regenerateMap(&framePalette, m_transparentIndex);
-    ImageRef frameImage(Image::create(IMAGE_INDEXED,
+    octree.regenerateMap(&framePalette, transparentIndex);
+    qf.frameImage.reset(Image::create(IMAGE_INDEXED,
                                       frameBounds.w,
-                                      frameBounds.h,
-                                      m_frameImageBuf));
+                                      frameBounds.h));
 
     // Every frame might use a small portion of the global palette,
     // to optimize the gif file size, we will analize which colors
     // will be used in each processed frame.
     PalettePicks usedColors(framePalette.size());
 
-    int localTransparent = m_transparentIndex;
-    ColorMapObject* colormap = m_globalColormap;
-    Remap remap(256);
+    int localTransparent = transparentIndex;
+    Remap& remap = qf.remap;
 
     if (!m_preservePaletteOrder) {
-      const LockImageBits<RgbTraits> srcBits(m_deltaImage.get());
-      LockImageBits<IndexedTraits> dstBits(frameImage.get());
+      const LockImageBits<RgbTraits> srcBits(qf.deltaImage.get());
+      LockImageBits<IndexedTraits> dstBits(qf.frameImage.get());
 
       auto srcIt = srcBits.begin();
       auto dstIt = dstBits.begin();
@@ -1430,13 +1602,13 @@ private:
               rgba_getg(color),
               rgba_getb(color),
               255,
-              m_transparentIndex);
+              transparentIndex);
             if (i < 0)
               i = octree.mapColor(color | rgba_a_mask); // alpha=255
           }
           else {
-            if (m_transparentIndex >= 0)
-              i = m_transparentIndex;
+            if (transparentIndex >= 0)
+              i = transparentIndex;
             else
               i = m_bgIndex;
           }
@@ -1459,34 +1631,49 @@ private:
       for (int i=0; i<remap.size(); ++i)
         remap.map(i, i);
 
-      if (!colormap) {
-        Palette reducedPalette(0, usedNColors);
+      if (!m_globalColormap) {
+        qf.localPalette = Palette(0, usedNColors);
 
         for (int i=0, j=0; i<framePalette.size(); ++i) {
           if (usedColors[i]) {
-            reducedPalette.setEntry(j, framePalette.getEntry(i));
+            qf.localPalette.setEntry(j, framePalette.getEntry(i));
             remap.map(i, j);
             ++j;
           }
         }
 
-        colormap = createColorMap(&reducedPalette);
         if (localTransparent >= 0)
           localTransparent = remap[localTransparent];
       }
 
-      if (localTransparent >= 0 && m_transparentIndex != localTransparent)
-        remap.map(m_transparentIndex, localTransparent);
+      if (localTransparent >= 0 && transparentIndex != localTransparent)
+        remap.map(transparentIndex, localTransparent);
     }
     else {
-      frameImage.reset(Image::createCopy(m_deltaImage.get()));
-      for (int i=0; i<colormap->ColorCount; ++i)
+      qf.frameImage.reset(Image::createCopy(qf.deltaImage.get()));
+      for (int i=0; i<m_globalColormap->ColorCount; ++i)
         remap.map(i, i);
     }
 
+    qf.localTransparent = localTransparent;
+    qf.deltaImage.reset();
+  }
+
+  // Writes a quantized frame in the GIF file, frames must be written
+  // in order.
+  void writeImage(const QuantizedFrame& qf) {
+    const gifframe_t gifFrame = qf.gifFrame;
+    const gfx::Rect& frameBounds = qf.frameBounds;
+    const Image* frameImage = qf.frameImage.get();
+    const Remap& remap = qf.remap;
+
+    ColorMapObject* colormap = m_globalColormap;
+    if (!colormap)
+      colormap = createColorMap(&qf.localPalette);
+
     // Write extension record.
-    writeExtension(gifFrame, frame, localTransparent,
-                   disposal, fixDuration);
+    writeExtension(gifFrame, qf.frame, qf.localTransparent,
+                   qf.disposal, qf.fixDuration);
 
     // Write the image record.
     if (EGifPutImageDesc(m_gifFile,
@@ -1532,9 +1719,10 @@ private:
       GifFreeMapObject(colormap);
   }
 
-  Palette calculatePalette() {
+  static Palette calculatePalette(const Image* deltaImage,
+                                  int& transparentIndex) {
     OctreeMap octree;
-    const LockImageBits<RgbTraits> imageBits(m_deltaImage.get());
+    const LockImageBits<RgbTraits> imageBits(deltaImage);
     auto it = imageBits.begin(), end = imageBits.end();
     bool maskColorFounded = false;
     for (; it != end; ++it) {
@@ -1550,7 +1738,7 @@ private:
       // If there is a mask color, the OctreeMap::makePalette adds it
       // by default at entry == 0.
       octree.makePalette(&palette, 256, 8);
-      m_transparentIndex = 0;
+      transparentIndex = 0;
       return palette;
     }
     else {
@@ -1560,7 +1748,7 @@ private:
       Palette paletteWithoutMask(0, palette.size() - 1);
       for (int i=0; i < paletteWithoutMask.size(); i++)
         paletteWithoutMask.setEntry(i, palette.entry(i+1));
-      m_transparentIndex = -1;
+      transparentIndex = -1;
       return paletteWithoutMask;
     }
   }
@@ -1573,6 +1761,44 @@ private:
     m_img->renderFrame(frame, dst);
   }
 
+  // Renders the frame in m_renderPool, only one frame can be rendered
+  // in background at the same time.
+  void renderFrameInBackground(frame_t frame, Image* dst) {
+    ASSERT(m_renderPool);
+    {
+      std::lock_guard lock(m_renderMutex);
+      ASSERT(!m_rendering);
+      m_rendering = true;
+    }
+    m_renderPool->execute(
+      [this, frame, dst]{
+        std::exception_ptr error;
+        try {
+          renderFrame(frame, dst);
+        }
+        catch (...) {
+          error = std::current_exception();
+        }
+
+        std::lock_guard lock(m_renderMutex);
+        m_renderError = error;
+        m_rendering = false;
+        m_renderCV.notify_one();
+      });
+  }
+
+  // Waits the frame rendered with renderFrameInBackground(),
+  // re-throwing any exception from the render.
+  void waitBackgroundRender() {
+    std::unique_lock lock(m_renderMutex);
+    m_renderCV.wait(lock, [this]{ return !m_rendering; });
+    if (m_renderError) {
+      std::exception_ptr error = m_renderError;
+      m_renderError = nullptr;
+      std::rethrow_exception(error);
+    }
+  }
+
 private:
 
   ColorMapObject* createColorMap(const Palette* palette) {
@@ -1618,34 +1844,56 @@ private:
   bool m_preservePaletteOrder;
   gfx::Rect m_lastFrameBounds;
   DisposalMethod m_lastDisposal;
-  ImageBufferPtr m_frameImageBuf;
-  ImageRef m_images[3];
+  ImageRef m_images[4];
   Image* m_previousImage;
   Image* m_currentImage;
   Image* m_nextImage;
+  Image* m_aheadImage;
   std::unique_ptr<Image> m_deltaImage;
+
+  // Used to render one frame in background
+  std::mutex m_renderMutex;
+  std::condition_variable m_renderCV;
+  bool m_rendering = false;
+  std::exception_ptr m_renderError;
+  std::unique_ptr<base::thread_pool> m_renderPool;
+
+  // Used to quantize several frames in parallel
+  std::deque<std::unique_ptr<QuantizedFrame>> m_quantizedFrames;
+  size_t m_maxQuantizedFrames = 0;
+  std::mutex m_quantizeMutex;
+  std::condition_variable m_quantizeCV;
+  int m_quantizing = 0;
+  std::unique_ptr<base::thread_pool> m_quantizePool;
 };
 
+static int gif_write_data(GifFileType* gifFile,
+                          const GifByteType* data,
+                          int size)
+{
+  FILE* file = (FILE*)gifFile->UserData;
+  return int(std::fwrite(data, 1, size, file));
+}
+
 bool GifFormat::onSave(FileOp* fop)
 {
 #if GIFLIB_MAJOR >= 5
   int errCode = 0;
 #endif
-  int fd = base::open_file_descriptor_with_exception(fop->filename(), "wb");
-  GifFilePtr gif_file(EGifOpenFileHandle(fd
+  // The GIF data is written through the buffered output file (the
+  // handle must be closed after EGifCloseFile() writes the trailer)
+  base::FileHandle handle(fop->openOutputFile(fop->filename()));
+  GifFilePtr gif_file(EGifOpen(handle.get(), gif_write_data
 #if GIFLIB_MAJOR >= 5
-                                         , &errCode
+                               , &errCode
 #endif
-                                         ), &EGifCloseFile);
+                               ), &EGifCloseFile);
 
   if (!gif_file)
     throw Exception("Error creating GIF file.\n");
 
   GifEncoder encoder(fop, gif_file);
-  bool result = encoder.encode();
-  if (result)
-    base::sync_file_descriptor(fd);
-  return result;
+  return encoder.encode();
 }
 
 #endif  // ENABLE_SAVE
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -174,6 +174,18 @@ bool JpegFormat::onLoad(FileOp* fop)
   else
     dinfo.out_color_space = JCS_RGB;
 
+  // Decode a downscaled version of the file if the sprite is going
+  // to be displayed in a smaller size (e.g. thumbnails). libjpeg can
+  // scale the DCT blocks by 1/2, 1/4 or 1/8 at a fraction of the
+  // cost of the full decoding.
+  const int denom = fop->downscaleFactorToLoad(dinfo.image_width,
+                                               dinfo.image_height, 8);
+  if (denom > 1) {
+    dinfo.scale_num = 1;
+    dinfo.scale_denom = denom;
+    dinfo.dct_method = JDCT_IFAST;
+  }
+
   // Start decompressor.
   jpeg_start_decompress(&dinfo);
 
@@ -367,7 +379,7 @@ bool JpegFormat::onSave(FileOp* fop)
   LOG("JPEG: Saving with options: quality=%d\n", qualityValue);
 
   // Open the file for write in it.
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* file = handle.get();
 
   // Allocate and initialize JPEG compression object.
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -24,6 +24,7 @@
 #include <stdlib.h>
 
 #include "png.h"
+#include "zlib.h"
 
 #define PNG_TRACE(...) // TRACE
 
@@ -91,6 +92,15 @@ PngEncoderOneAlphaPixel::~PngEncoderOneAlphaPixel()
 
 namespace {
 
+// True if the memory layout of doc::rgba()/doc::graya() pixels is the
+// same as 8-bit RGBA/GA samples of PNG files, so the image rows can be
+// given directly to libpng.
+bool is_little_endian()
+{
+  const uint32_t v = 1;
+  return (*(const uint8_t*)&v == 1);
+}
+
 class DestroyReadPng {
   png_structp png;
   png_infop info;
@@ -278,9 +288,15 @@ bool PngFormat::onLoad(FileOp* fop)
 
   int imageWidth = png_get_image_width(png, info);
   int imageHeight = png_get_image_height(png, info);
-  ImageRef image = fop->sequenceImage(pixelFormat, imageWidth, imageHeight);
+
+  // Only the area inside the load ROI is converted to the image
+  const gfx::Rect bounds = fop->boundsToLoad(imageWidth, imageHeight);
+  ImageRef image = fop->sequenceImage(pixelFormat, imageWidth, imageHeight,
+                                      bounds);
   if (!image)
     return false;
+  if (bounds.isEmpty())
+    image->clear(0);
 
   // Transparent color
   png_color_16p png_trans_color = NULL;
@@ -323,17 +339,33 @@ bool PngFormat::onLoad(FileOp* fop)
     png_get_tRNS(png, info, nullptr, nullptr, &png_trans_color);
   }
 
-  // Allocate the memory to hold the image using the fields of info.
+  // Allocate the memory to hold the rows inside the load ROI using
+  // the fields of info, the other rows share one scratch row (they
+  // must be read anyway to decode the next ones).
+  const png_size_t rowbytes = png_get_rowbytes(png, info);
+  png_bytep scratch_row = (png_bytep)png_malloc(png, rowbytes);
   rows_pointer = (png_bytepp)png_malloc(png, sizeof(png_bytep) * height);
-  for (y = 0; y < height; y++)
-    rows_pointer[y] = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
+  for (y = 0; y < height; y++) {
+    if (int(y) >= bounds.y && int(y) < bounds.y2())
+      rows_pointer[y] = (png_bytep)png_malloc(png, rowbytes);
+    else
+      rows_pointer[y] = scratch_row;
+  }
+
+  // Rows after the load ROI are not needed in non-interlaced images
+  // (png_read_end() is not called, so we can stop reading there), and
+  // no row is needed if we are loading only the metadata.
+  const png_uint_32 rows_to_read =
+    (bounds.isEmpty() ? 0:
+     number_passes > 1 ? height:
+                         png_uint_32(bounds.y2()));
 
   for (int pass=0; pass<number_passes; ++pass) {
-    for (y = 0; y < height; y++) {
+    for (y = 0; y < rows_to_read; y++) {
       png_read_rows(png, rows_pointer+y, nullptr, 1);
 
       fop->setProgress(
-        (double)((double)pass + (double)(y+1) / (double)(height))
+        (double)((double)pass + (double)(y+1) / (double)(rows_to_read))
         / (double)number_passes);
 
       if (fop->isStop())
@@ -342,14 +374,16 @@ bool PngFormat::onLoad(FileOp* fop)
   }
 
   // Convert rows_pointer into the doc::Image
-  for (y = 0; y < height; y++) {
+  const int src_offset = bounds.x * png_get_channels(png, info);
+  const png_uint_32 width_to_load = png_uint_32(bounds.w);
+  for (y = bounds.y; int(y) < bounds.y2(); y++) {
     // RGB_ALPHA
     if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB_ALPHA) {
-      uint8_t* src_address = rows_pointer[y];
-      uint32_t* dst_address = (uint32_t*)image->getPixelAddress(0, y);
+      uint8_t* src_address = rows_pointer[y] + src_offset;
+      uint32_t* dst_address = (uint32_t*)image->getPixelAddress(0, y - bounds.y);
       unsigned int x, r, g, b, a;
 
-      for (x=0; x<width; x++) {
+      for (x=0; x<width_to_load; x++) {
         r = *(src_address++);
         g = *(src_address++);
         b = *(src_address++);
@@ -359,11 +393,11 @@ bool PngFormat::onLoad(FileOp* fop)
     }
     // RGB
     else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB) {
-      uint8_t* src_address = rows_pointer[y];
-      uint32_t* dst_address = (uint32_t*)image->getPixelAddress(0, y);
+      uint8_t* src_address = rows_pointer[y] + src_offset;
+      uint32_t* dst_address = (uint32_t*)image->getPixelAddress(0, y - bounds.y);
       unsigned int x, r, g, b, a;
 
-      for (x=0; x<width; x++) {
+      for (x=0; x<width_to_load; x++) {
         r = *(src_address++);
         g = *(src_address++);
         b = *(src_address++);
@@ -385,11 +419,11 @@ bool PngFormat::onLoad(FileOp* fop)
     }
     // GRAY_ALPHA
     else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY_ALPHA) {
-      uint8_t* src_address = rows_pointer[y];
-      uint16_t* dst_address = (uint16_t*)image->getPixelAddress(0, y);
+      uint8_t* src_address = rows_pointer[y] + src_offset;
+      uint16_t* dst_address = (uint16_t*)image->getPixelAddress(0, y - bounds.y);
       unsigned int x, k, a;
 
-      for (x=0; x<width; x++) {
+      for (x=0; x<width_to_load; x++) {
         k = *(src_address++);
         a = *(src_address++);
         *(dst_address++) = graya(k, a);
@@ -397,11 +431,11 @@ bool PngFormat::onLoad(FileOp* fop)
     }
     // GRAY
     else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_GRAY) {
-      uint8_t* src_address = rows_pointer[y];
-      uint16_t* dst_address = (uint16_t*)image->getPixelAddress(0, y);
+      uint8_t* src_address = rows_pointer[y] + src_offset;
+      uint16_t* dst_address = (uint16_t*)image->getPixelAddress(0, y - bounds.y);
       unsigned int x, k, a;
 
-      for (x=0; x<width; x++) {
+      for (x=0; x<width_to_load; x++) {
         k = *(src_address++);
 
         // Transparent color
@@ -419,15 +453,16 @@ bool PngFormat::onLoad(FileOp* fop)
     }
     // PALETTE
     else if (png_get_color_type(png, info) == PNG_COLOR_TYPE_PALETTE) {
-      uint8_t* src_address = rows_pointer[y];
-      uint8_t* dst_address = (uint8_t*)image->getPixelAddress(0, y);
+      uint8_t* src_address = rows_pointer[y] + src_offset;
+      uint8_t* dst_address = (uint8_t*)image->getPixelAddress(0, y - bounds.y);
       unsigned int x;
 
-      for (x=0; x<width; x++)
+      for (x=0; x<width_to_load; x++)
         *(dst_address++) = *(src_address++);
     }
     png_free(png, rows_pointer[y]);
   }
+  png_free(png, scratch_row);
   png_free(png, rows_pointer);
 
   // Setup the color space.
@@ -529,7 +564,7 @@ bool PngFormat::onSave(FileOp* fop)
   png_bytep row_pointer;
   int color_type = 0;
 
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* fp = handle.get();
 
   png_structp png =
@@ -551,6 +586,25 @@ bool PngFormat::onSave(FileOp* fop)
 
   png_init_io(png, fp);
 
+  switch (fop->config().pngCompression) {
+    case gen::PngCompression::DEFAULT:
+      break;
+    case gen::PngCompression::FAST:
+      // Just one filter and RLE matches, which is fast and works well
+      // with flat areas of pixel art
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_FILTER_SUB);
+      png_set_compression_level(png, Z_BEST_SPEED);
+      png_set_compression_strategy(png, Z_RLE);
+      break;
+    case gen::PngCompression::MAX:
+      // libpng tries all filters for each row and keeps the one that
+      // minimizes the sum of absolute differences
+      png_set_filter(png, PNG_FILTER_TYPE_BASE, PNG_ALL_FILTERS);
+      png_set_compression_level(png, Z_BEST_COMPRESSION);
+      png_set_compression_mem_level(png, 9);
+      break;
+  }
+
   const FileAbstractImage* img = fop->abstractImage();
   const ImageSpec spec = img->spec();
 
@@ -664,9 +718,24 @@ bool PngFormat::onSave(FileOp* fop)
 
   row_pointer = (png_bytep)png_malloc(png, png_get_rowbytes(png, info));
 
+  // Rows that can be written without converting pixels
+  const bool directRows =
+    (!fix_one_alpha_pixel &&
+     ((color_type == PNG_COLOR_TYPE_RGB_ALPHA && spec.colorMode() == ColorMode::RGB) ||
+      (color_type == PNG_COLOR_TYPE_GRAY_ALPHA && spec.colorMode() == ColorMode::GRAYSCALE) ||
+      color_type == PNG_COLOR_TYPE_PALETTE) &&
+     (color_type == PNG_COLOR_TYPE_PALETTE || is_little_endian()));
+
   for (png_uint_32 y=0; y<height; ++y) {
     uint8_t* dst_address = row_pointer;
 
+    if (directRows) {
+      png_bytep row = (png_bytep)img->getScanline(y);
+      png_write_rows(png, &row, 1);
+      fop->setProgress((double)(y+1) / (double)(height));
+      continue;
+    }
+
     if (png_get_color_type(png, info) == PNG_COLOR_TYPE_RGB_ALPHA) {
       unsigned int x, c, a;
       bool opaque = true;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,9 +11,15 @@
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/palette.h"
+#include "doc/primitives.h"
 #include "doc/slice.h"
 #include "doc/sprite.h"
 #include "psd/psd.h"
+#include "sched/task_group.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
 
 namespace app {
 
@@ -99,7 +105,7 @@ FileFormat* CreatePsdFormat()
 
 class PsdDecoderDelegate : public psd::DecoderDelegate {
 public:
-  PsdDecoderDelegate()
+  PsdDecoderDelegate(const bool skipHiddenLayers)
     : m_currentImage(nullptr)
     , m_currentLayer(nullptr)
     , m_layerGroup(nullptr)
@@ -107,10 +113,21 @@ public:
     , m_activeFrameIndex(0)
     , m_pixelFormat(PixelFormat::IMAGE_INDEXED)
     , m_layerHasTransparentChannel(false)
+    , m_skipHiddenLayers(skipHiddenLayers)
+    , m_skipCurrentLayer(false)
+    , m_tasks(sched::Priority::Interactive)
   { }
 
   Sprite* getSprite() { return assembleDocument(); }
 
+  // Waits until the channels of all images are interleaved (it
+  // re-throws the exceptions of the worker threads).
+  void waitImages()
+  {
+    interleaveChannelsInBackground();
+    m_tasks.wait();
+  }
+
   void onFileHeader(const psd::FileHeader& header) override
   {
     m_pixelFormat = psd_cmode_to_ase_format(header.colorMode);
@@ -195,8 +212,18 @@ public:
         //m_currentLayer->setVisible(layerRecord.isVisible());
         m_layerHasTransparentChannel =
           hasTransparency(layerRecord.channels.size());
+
+        // The pixels of this layer are not needed (onBeginImage()
+        // will not create its image, so its scanlines are ignored)
+        if (m_skipHiddenLayers && !layerRecord.isVisible()) {
+          m_currentLayer->setVisible(false);
+          m_skipCurrentLayer = true;
+        }
       }
       else {
+        // The image of this layer can be modified by a worker thread
+        m_tasks.wait();
+
         m_currentLayer = *findIter;
         m_currentImage = m_currentLayer->cel(frame_t(0))->imageRef();
       }
@@ -212,6 +239,10 @@ public:
       LayerImage* imageLayer = static_cast<LayerImage*>(m_currentLayer);
       imageLayer->removeCel(layerCel.get());
 
+      // The copies are created before the channels are interleaved,
+      // so the worker thread must copy the final pixels to them too
+      ImageChannels* channels = (m_channels ? m_channels.get(): nullptr);
+
       for (const auto& inFrame : layerRecord.inFrames) {
         if (inFrame.isVisibleInFrame) {
           const auto findIter = std::find_if(
@@ -224,14 +255,19 @@ public:
             const size_t index = std::distance(m_framesInfo.cbegin(), findIter);
             auto newCel = Cel::MakeCopy(index, layerCel.get());
             imageLayer->addCel(newCel);
+            if (channels)
+              channels->copies.push_back(newCel->imageRef());
           }
         }
       }
     }
 
+    interleaveChannelsInBackground();
+
     m_currentImage.reset();
     m_currentLayer = nullptr;
     m_layerHasTransparentChannel = false;
+    m_skipCurrentLayer = false;
   }
 
   // Emitted only if there's a palette in an image
@@ -248,7 +284,7 @@ public:
   // Emitted when an image data is about to be transmitted
   void onBeginImage(const psd::ImageData& imageData) override
   {
-    if (!m_currentImage) {
+    if (!m_currentImage && !m_skipCurrentLayer) {
       // Only occurs where there's an image with no layer
       if (m_layers.empty()) {
         m_layerGroup = m_sprite->root();
@@ -284,6 +320,9 @@ public:
     }
   }
 
+  // The channel values are only normalized and buffered here, they
+  // are interleaved in a worker thread when the whole image is read
+  // (see interleaveChannelsInBackground()).
   void onImageScanline(const psd::ImageData& img,
                        const int y,
                        const psd::ChannelID chanID,
@@ -293,61 +332,34 @@ public:
     if (!m_currentImage || y >= m_currentImage->height())
       return;
 
+    const int w = m_currentImage->width();
+    const int h = m_currentImage->height();
     const int dataCount = bytes / (img.depth >= 8 ? (img.depth / 8) : 1);
-    uint8_t* dstGenericAddress = m_currentImage->getPixelAddress(0, y);
 
-    if (m_pixelFormat == doc::PixelFormat::IMAGE_INDEXED) {
-      IndexedTraits::address_t dstAddress =
-        (IndexedTraits::address_t)dstGenericAddress;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
-        *(dstAddress)++ = getNormalizedPixelValue(data, img.depth);
-      }
+    if (!m_channels) {
+      m_channels = std::make_unique<ImageChannels>();
+      m_channels->image = m_currentImage;
+      m_channels->hasTransparentChannel = m_layerHasTransparentChannel;
     }
-    else if (m_pixelFormat == doc::PixelFormat::IMAGE_GRAYSCALE) {
-      GrayscaleTraits::address_t dstAddress =
-        (GrayscaleTraits::address_t)dstGenericAddress;
-      uint8_t v = 0, a = 0;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
-        const GrayscaleTraits::pixel_t pixel = *dstAddress;
-        const uint8_t newPixelValue = getNormalizedPixelValue(data, img.depth);
-        if (chanID == psd::ChannelID::Red) {
-          v = newPixelValue;
-          a = m_layerHasTransparentChannel ? graya_geta(pixel) : 255;
-        }
-        else if (chanID == psd::ChannelID::Alpha ||
-                 chanID == psd::ChannelID::TransparencyMask) {
-          a = newPixelValue;
-          v = graya_getv(pixel);
-        }
-        *(dstAddress++) = graya(v, a);
-      }
-    }
-    else if (m_pixelFormat == doc::PixelFormat::IMAGE_RGB) {
-      RgbTraits::address_t dstAddress = (RgbTraits::address_t)dstGenericAddress;
-      uint8_t r, g, b, a;
-      for (int x = 0; x < dataCount && x < m_currentImage->width(); ++x) {
-        const uint8_t newPixelValue = getNormalizedPixelValue(data, img.depth);
-        const color_t c = *(dstAddress);
-        r = rgba_getr(c);
-        g = rgba_getg(c);
-        b = rgba_getb(c);
-        a = m_layerHasTransparentChannel ? rgba_geta(c) : 255;
-        if (chanID == psd::ChannelID::Red) {
-          r = newPixelValue;
-        }
-        else if (chanID == psd::ChannelID::Green) {
-          g = newPixelValue;
-        }
-        else if (chanID == psd::ChannelID::Blue) {
-          b = newPixelValue;
-        }
-        else if (chanID == psd::ChannelID::Alpha ||
-                 chanID == psd::ChannelID::TransparencyMask) {
-          a = newPixelValue;
-        }
-        *(dstAddress++) = rgba(r, g, b, a);
-      }
+
+    auto& chans = m_channels->channels;
+    auto it = std::find_if(chans.begin(), chans.end(),
+                           [chanID](const Channel& chan){
+                             return chan.id == chanID;
+                           });
+    if (it == chans.end()) {
+      chans.emplace_back();
+      it = std::prev(chans.end());
+      it->id = chanID;
+      it->values.resize(size_t(w) * h);
+      it->rowLength.resize(h, 0);
     }
+
+    const int n = std::min(dataCount, w);
+    uint8_t* dst = &it->values[size_t(y) * w];
+    for (int x = 0; x < n; ++x)
+      *(dst++) = getNormalizedPixelValue(data, img.depth);
+    it->rowLength[y] = std::max(it->rowLength[y], n);
   }
 
 private:
@@ -374,6 +386,107 @@ private:
     m_currentLayer->setName(layerName);
   }
 
+  // Values of one channel of an image (normalized to 8 bits)
+  struct Channel {
+    psd::ChannelID id;
+    std::vector<uint8_t> values;
+    std::vector<int> rowLength; // Values received in each row
+  };
+
+  // Channels of an image waiting to be interleaved
+  struct ImageChannels {
+    doc::ImageRef image;
+    std::vector<doc::ImageRef> copies; // Cels copied from this image
+    bool hasTransparentChannel = false;
+    std::vector<Channel> channels;
+  };
+
+  // Interleaves the channels of the current image in a worker
+  // thread, so the next layer can be decoded meanwhile (each layer
+  // has its own image, so several of them can be interleaved at the
+  // same time).
+  void interleaveChannelsInBackground()
+  {
+    if (!m_channels)
+      return;
+
+    std::shared_ptr<ImageChannels> channels(std::move(m_channels));
+    m_tasks.run([channels, pixelFormat = m_pixelFormat]{
+      interleaveChannels(*channels, pixelFormat);
+    });
+  }
+
+  static void interleaveChannels(const ImageChannels& channels,
+                                 const PixelFormat pixelFormat)
+  {
+    // Warning: This is executed from a worker thread
+    Image* image = channels.image.get();
+    const int w = image->width();
+
+    for (const Channel& chan : channels.channels) {
+      for (int y = 0; y < image->height(); ++y) {
+        const int n = chan.rowLength[y];
+        const uint8_t* src = &chan.values[size_t(y) * w];
+        uint8_t* dstGenericAddress = image->getPixelAddress(0, y);
+
+        if (pixelFormat == doc::PixelFormat::IMAGE_INDEXED) {
+          IndexedTraits::address_t dstAddress =
+            (IndexedTraits::address_t)dstGenericAddress;
+          std::copy(src, src + n, dstAddress);
+        }
+        else if (pixelFormat == doc::PixelFormat::IMAGE_GRAYSCALE) {
+          GrayscaleTraits::address_t dstAddress =
+            (GrayscaleTraits::address_t)dstGenericAddress;
+          uint8_t v = 0, a = 0;
+          for (int x = 0; x < n; ++x) {
+            const GrayscaleTraits::pixel_t pixel = *dstAddress;
+            const uint8_t newPixelValue = *(src++);
+            if (chan.id == psd::ChannelID::Red) {
+              v = newPixelValue;
+              a = channels.hasTransparentChannel ? graya_geta(pixel) : 255;
+            }
+            else if (chan.id == psd::ChannelID::Alpha ||
+                     chan.id == psd::ChannelID::TransparencyMask) {
+              a = newPixelValue;
+              v = graya_getv(pixel);
+            }
+            *(dstAddress++) = graya(v, a);
+          }
+        }
+        else if (pixelFormat == doc::PixelFormat::IMAGE_RGB) {
+          RgbTraits::address_t dstAddress =
+            (RgbTraits::address_t)dstGenericAddress;
+          uint8_t r, g, b, a;
+          for (int x = 0; x < n; ++x) {
+            const uint8_t newPixelValue = *(src++);
+            const color_t c = *(dstAddress);
+            r = rgba_getr(c);
+            g = rgba_getg(c);
+            b = rgba_getb(c);
+            a = channels.hasTransparentChannel ? rgba_geta(c) : 255;
+            if (chan.id == psd::ChannelID::Red) {
+              r = newPixelValue;
+            }
+            else if (chan.id == psd::ChannelID::Green) {
+              g = newPixelValue;
+            }
+            else if (chan.id == psd::ChannelID::Blue) {
+              b = newPixelValue;
+            }
+            else if (chan.id == psd::ChannelID::Alpha ||
+                     chan.id == psd::ChannelID::TransparencyMask) {
+              a = newPixelValue;
+            }
+            *(dstAddress++) = rgba(r, g, b, a);
+          }
+        }
+      }
+    }
+
+    for (const doc::ImageRef& copy : channels.copies)
+      copy_image(copy.get(), image);
+  }
+
   Sprite* assembleDocument()
   {
     if (m_palette.getModifications() > 1)
@@ -429,6 +542,12 @@ private:
   std::vector<psd::FrameInformation> m_framesInfo;
   Palette m_palette;
   bool m_layerHasTransparentChannel;
+  bool m_skipHiddenLayers;
+  bool m_skipCurrentLayer;
+  std::unique_ptr<ImageChannels> m_channels;
+  // Declared at the end to wait the tasks before the other members
+  // are destroyed
+  sched::TaskGroup m_tasks;
 };
 
 bool PsdFormat::onLoad(FileOp* fop)
@@ -437,7 +556,7 @@ bool PsdFormat::onLoad(FileOp* fop)
     base::open_file_with_exception(fop->filename(), "rb");
   FILE* f = fileHandle.get();
   psd::StdioFileInterface fileInterface(f);
-  PsdDecoderDelegate pDelegate;
+  PsdDecoderDelegate pDelegate(fop->config().psdSkipHiddenLayers);
   psd::Decoder decoder(&fileInterface, &pDelegate);
 
   if (!decoder.readFileHeader()) {
@@ -460,6 +579,7 @@ bool PsdFormat::onLoad(FileOp* fop)
     decoder.readImageResources();
     decoder.readLayersAndMask();
     decoder.readImageData();
+    pDelegate.waitImages();
   }
   catch (const std::runtime_error& e) {
     fop->setError(e.what());
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2023  Igara Studio S.A.
+// Copyright (C) 2023-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -137,7 +137,7 @@ bool QoiFormat::onLoad(FileOp* fop)
 bool QoiFormat::onSave(FileOp* fop)
 {
   const FileAbstractImage* img = fop->abstractImage();
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* f = handle.get();
   doc::ImageRef image = img->getScaledImage();
 
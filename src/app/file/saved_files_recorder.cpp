@@ -0,0 +1,55 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/file/saved_files_recorder.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+
+namespace app {
+
+static std::mutex g_recorderMutex;
+static SavedFilesRecorder* g_recorder = nullptr;
+
+SavedFilesRecorder::SavedFilesRecorder()
+{
+  std::lock_guard lock(g_recorderMutex);
+  ASSERT(!g_recorder);
+  g_recorder = this;
+}
+
+SavedFilesRecorder::~SavedFilesRecorder()
+{
+  std::lock_guard lock(g_recorderMutex);
+  ASSERT(g_recorder == this);
+  g_recorder = nullptr;
+}
+
+base::paths SavedFilesRecorder::files() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_files;
+}
+
+// static
+void SavedFilesRecorder::notify(const std::string& filename)
+{
+  std::lock_guard lock(g_recorderMutex);
+  if (!g_recorder)
+    return;
+
+  std::lock_guard recorderLock(g_recorder->m_mutex);
+  base::paths& files = g_recorder->m_files;
+  if (std::find(files.begin(), files.end(), filename) == files.end())
+    files.push_back(filename);
+}
+
+} // namespace app
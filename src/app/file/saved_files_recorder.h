@@ -0,0 +1,41 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_FILE_SAVED_FILES_RECORDER_H_INCLUDED
+#define APP_FILE_SAVED_FILES_RECORDER_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "base/paths.h"
+
+#include <mutex>
+#include <string>
+
+namespace app {
+
+  // Records the name of the files saved by FileOp and DocExporter
+  // while the recorder is alive (e.g. to cache the output files of
+  // the CLI). Only one recorder can be active at the same time.
+  class SavedFilesRecorder {
+  public:
+    SavedFilesRecorder();
+    ~SavedFilesRecorder();
+
+    base::paths files() const;
+
+    // Called each time a file is saved (from any thread).
+    static void notify(const std::string& filename);
+
+  private:
+    mutable std::mutex m_mutex;
+    base::paths m_files;
+
+    DISABLE_COPYING(SavedFilesRecorder);
+  };
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2018-2022  Igara Studio S.A.
+// Copyright (c) 2018-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -23,6 +23,11 @@
 
 #include "svg_options.xml.h"
 
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
 namespace app {
 
 using namespace base;
@@ -31,8 +36,9 @@ class SvgFormat : public FileFormat {
   // Data for SVG files
   class SvgOptions : public FormatOptions {
   public:
-    SvgOptions() : pixelScale(1) { }
+    SvgOptions() : pixelScale(1), mergeRects(true) { }
     int pixelScale;
+    bool mergeRects;
   };
 
   const char* onGetName() const override {
@@ -79,80 +85,193 @@ bool SvgFormat::onLoad(FileOp* fop)
 
 #ifdef ENABLE_SAVE
 
+namespace {
+
+// A rectangle of pixels with the same color (an RGBA value)
+struct SvgRect {
+  int x, y, w, h;
+  color_t color;
+};
+
+// Writes the SVG elements in a memory buffer which is written to the
+// file in big blocks (instead of several fprintf() calls per pixel).
+class SvgWriter {
+public:
+  SvgWriter(FILE* f, const int pxScale) : m_file(f), m_pxScale(pxScale) {
+    m_buf.reserve(kBufferSize + 256);
+  }
+
+  ~SvgWriter() {
+    flush();
+  }
+
+  void text(const char* str) {
+    m_buf += str;
+  }
+
+  void rect(const SvgRect& rc) {
+    char tmp[256];
+    int n = std::snprintf(
+      tmp, sizeof(tmp),
+      "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%02X%02X%02X\" ",
+      rc.x*m_pxScale, rc.y*m_pxScale, rc.w*m_pxScale, rc.h*m_pxScale,
+      rgba_getr(rc.color), rgba_getg(rc.color), rgba_getb(rc.color));
+    m_buf.append(tmp, n);
+
+    const int a = rgba_geta(rc.color);
+    if (a != 255) {
+      n = std::snprintf(tmp, sizeof(tmp), "opacity=\"%f\" ", (float)a / 255.0);
+      m_buf.append(tmp, n);
+    }
+    m_buf += "/>\n";
+
+    if (m_buf.size() >= kBufferSize)
+      flush();
+  }
+
+  void flush() {
+    if (!m_buf.empty()) {
+      fwrite(m_buf.data(), 1, m_buf.size(), m_file);
+      m_buf.clear();
+    }
+  }
+
+private:
+  static constexpr std::size_t kBufferSize = 64*1024;
+  FILE* m_file;
+  int m_pxScale;
+  std::string m_buf;
+};
+
+// Converts the pixels of each row of the image to RGBA colors
+// (alpha=0 for the pixels that are not saved) and writes them as
+// rectangles. With "mergeRects", each horizontal run of pixels with
+// the same color is one rectangle, and the rectangles with the same
+// x/width/color in consecutive rows are merged in one rectangle
+// (the rendered SVG is the same because rectangles don't overlap).
+class SvgRects {
+public:
+  SvgRects(SvgWriter& writer, const bool mergeRects)
+    : m_writer(writer)
+    , m_mergeRects(mergeRects) {
+  }
+
+  ~SvgRects() {
+    for (const SvgRect& rc : m_open)
+      m_writer.rect(rc);
+  }
+
+  void addRow(const int y, const std::vector<color_t>& row) {
+    const int w = int(row.size());
+    m_next.clear();
+
+    auto open = m_open.begin();
+    for (int x=0; x<w; ) {
+      const color_t c = row[x];
+      if (rgba_geta(c) == 0) {
+        ++x;
+        continue;
+      }
+
+      SvgRect rc = { x, y, 1, 1, c };
+      if (!m_mergeRects) {
+        m_writer.rect(rc);
+        ++x;
+        continue;
+      }
+
+      while (x+rc.w < w && row[x+rc.w] == c)
+        ++rc.w;
+      x += rc.w;
+
+      // Close the rectangles of the previous rows that cannot be
+      // extended (m_open is sorted by x)
+      for (; open != m_open.end() && open->x < rc.x; ++open)
+        m_writer.rect(*open);
+
+      if (open != m_open.end() &&
+          open->x == rc.x &&
+          open->w == rc.w &&
+          open->color == rc.color) {
+        rc = *open;
+        ++rc.h;
+        ++open;
+      }
+      m_next.push_back(rc);
+    }
+    for (; open != m_open.end(); ++open)
+      m_writer.rect(*open);
+
+    std::swap(m_open, m_next);
+  }
+
+private:
+  SvgWriter& m_writer;
+  bool m_mergeRects;
+  std::vector<SvgRect> m_open; // Rectangles that can be extended in the next row
+  std::vector<SvgRect> m_next;
+};
+
+} // anonymous namespace
+
 bool SvgFormat::onSave(FileOp* fop)
 {
   const ImageRef image = fop->sequenceImage();
-  int x, y, c, r, g, b, a, alpha;
+  int x, y, c, r, g, b, a;
   const auto svg_options = std::static_pointer_cast<SvgOptions>(fop->formatOptions());
   const int pixelScaleValue = std::clamp(svg_options->pixelScale, 0, 10000);
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* f = handle.get();
-  auto printcol = [f](int x, int y,int r, int g, int b, int a, int pxScale) {
-    fprintf(f, "<rect x=\"%d\" y=\"%d\" width=\"%d\" height=\"%d\" fill=\"#%02X%02X%02X\" ",
-            x*pxScale, y*pxScale, pxScale, pxScale, r, g, b);
-    if (a != 255)
-      fprintf(f, "opacity=\"%f\" ", (float)a / 255.0);
-    fprintf(f, "/>\n");
-  };
-  fprintf(f, "<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
-  fprintf(f, "<svg version=\"1.1\" width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" shape-rendering=\"crispEdges\">\n",
-          image->width()*pixelScaleValue, image->height()*pixelScaleValue);
-
-  switch (image->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
-          c = get_pixel_fast<RgbTraits>(image.get(), x, y);
-          alpha = rgba_geta(c);
-          if (alpha != 0x00)
-            printcol(x, y, rgba_getr(c), rgba_getg(c), rgba_getb(c), alpha, pixelScaleValue);
-        }
-        fop->setProgress((float)y / (float)(image->height()));
-      }
-      break;
-    }
-    case IMAGE_GRAYSCALE: {
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
-          c = get_pixel_fast<GrayscaleTraits>(image.get(), x, y);
-          auto v = graya_getv(c);
-          alpha = graya_geta(c);
-          if (alpha != 0x00)
-            printcol(x, y, v, v, v, alpha, pixelScaleValue);
-        }
-        fop->setProgress((float)y / (float)(image->height()));
-      }
-      break;
-    }
-    case IMAGE_INDEXED: {
-      unsigned char image_palette[256][4];
-      for (y=0; y<256; y++) {
-        fop->sequenceGetColor(y, &r, &g, &b);
-        image_palette[y][0] = r;
-        image_palette[y][1] = g;
-        image_palette[y][2] = b;
-        fop->sequenceGetAlpha(y, &a);
-        image_palette[y][3] = a;
-      }
+  {
+    SvgWriter writer(f, pixelScaleValue);
+    char header[256];
+    writer.text("<?xml version=\"1.0\" encoding=\"UTF-8\" ?>\n");
+    std::snprintf(header, sizeof(header),
+                  "<svg version=\"1.1\" width=\"%d\" height=\"%d\" xmlns=\"http://www.w3.org/2000/svg\" shape-rendering=\"crispEdges\">\n",
+                  image->width()*pixelScaleValue, image->height()*pixelScaleValue);
+    writer.text(header);
+
+    std::vector<color_t> palette;
+    if (image->pixelFormat() == IMAGE_INDEXED) {
       color_t mask_color = -1;
       if (fop->document()->sprite()->backgroundLayer() == NULL ||
           !fop->document()->sprite()->backgroundLayer()->isVisible()) {
         mask_color = fop->document()->sprite()->transparentColor();
       }
-      for (y=0; y<image->height(); y++) {
-        for (x=0; x<image->width(); x++) {
-          c = get_pixel_fast<IndexedTraits>(image.get(), x, y);
-          if (c != mask_color)
-            printcol(x, y, image_palette[c][0] & 0xff,
-                     image_palette[c][1] & 0xff,
-                     image_palette[c][2] & 0xff,
-                     image_palette[c][3] & 0xff,
-                     pixelScaleValue);
+      palette.resize(256);
+      for (c=0; c<256; c++) {
+        fop->sequenceGetColor(c, &r, &g, &b);
+        fop->sequenceGetAlpha(c, &a);
+        palette[c] = (c == int(mask_color) ? 0: rgba(r & 0xff, g & 0xff, b & 0xff, a & 0xff));
+      }
+    }
+
+    SvgRects rects(writer, svg_options->mergeRects);
+    std::vector<color_t> row(image->width());
+    for (y=0; y<image->height(); y++) {
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB: {
+          auto p = (const RgbTraits::address_t)image->getPixelAddress(0, y);
+          std::copy(p, p+image->width(), row.begin());
+          break;
+        }
+        case IMAGE_GRAYSCALE: {
+          auto p = (const GrayscaleTraits::address_t)image->getPixelAddress(0, y);
+          for (x=0; x<image->width(); x++, p++) {
+            const int v = graya_getv(*p);
+            row[x] = rgba(v, v, v, graya_geta(*p));
+          }
+          break;
+        }
+        case IMAGE_INDEXED: {
+          auto p = (const IndexedTraits::address_t)image->getPixelAddress(0, y);
+          for (x=0; x<image->width(); x++, p++)
+            row[x] = palette[*p];
+          break;
         }
-        fop->setProgress((float)y / (float)(image->height()));
       }
-      break;
+      rects.addRow(y, row);
+      fop->setProgress((float)y / (float)(image->height()));
     }
   }
   fprintf(f, "</svg>");
@@ -177,17 +296,22 @@ FormatOptionsPtr SvgFormat::onAskUserForFormatOptions(FileOp* fop)
 
       if (pref.isSet(pref.svg.pixelScale))
         opts->pixelScale = pref.svg.pixelScale();
+      if (pref.isSet(pref.svg.mergeRects))
+        opts->mergeRects = pref.svg.mergeRects();
 
      if (pref.svg.showAlert()) {
         app::gen::SvgOptions win;
         win.pxsc()->setTextf("%d", opts->pixelScale);
+        win.mergeRects()->setSelected(opts->mergeRects);
         win.openWindowInForeground();
 
         if (win.closer() == win.ok()) {
           pref.svg.pixelScale((int)win.pxsc()->textInt());
+          pref.svg.mergeRects(win.mergeRects()->isSelected());
           pref.svg.showAlert(!win.dontShow()->isSelected());
 
           opts->pixelScale = pref.svg.pixelScale();
+          opts->mergeRects = pref.svg.mergeRects();
         }
         else {
           opts.reset();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -291,7 +291,7 @@ bool TgaFormat::onSave(FileOp* fop)
   const FileAbstractImage* img = fop->abstractImage();
   const Palette* palette = fop->sequenceGetPalette();
 
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   tga::StdioFileInterface finterface(handle.get());
   tga::Encoder encoder(&finterface);
   tga::Header header;
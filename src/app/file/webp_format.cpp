@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 // Copyright (C) 2015  Gabriel Rauter
 //
@@ -22,15 +22,20 @@
 #include "app/pref/preferences.h"
 #include "base/convert_to.h"
 #include "base/file_handle.h"
+#include "doc/algorithm/shrink_bounds.h"
 #include "doc/doc.h"
+#include "sched/task_group.h"
 #include "ui/manager.h"
 
 #include "webp_options.xml.h"
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <algorithm>
 #include <map>
+#include <memory>
+#include <vector>
 
 #include <webp/demux.h>
 #include <webp/mux.h>
@@ -252,9 +257,191 @@ static int progress_report(int percent, const WebPPicture* pic)
     return true;
 }
 
+static int stop_report(int percent, const WebPPicture* pic)
+{
+  auto fop = (FileOp*)pic->user_data;
+  return !fop->isStop();
+}
+
+// Switches R <-> B channels because WebPPicture::argb (and
+// WebPAnimEncoderAssemble()) expects MODE_BGRA pictures.
+static void rgba_to_argb(Image* image)
+{
+  LockImageBits<RgbTraits> bits(image, Image::ReadWriteLock);
+  auto it = bits.begin(), end = bits.end();
+  for (; it != end; ++it) {
+    auto c = *it;
+    *it = rgba(rgba_getb(c), // Use blue in red channel
+               rgba_getg(c),
+               rgba_getr(c), // Use red in blue channel
+               rgba_geta(c));
+  }
+}
+
+// A frame encoded as a still WebP image. Only the area that changed
+// from the previous frame is encoded (a delta frame), or the whole
+// canvas for the first frame (the key frame).
+struct EncodedFrame {
+  ImageRef image;
+  gfx::Rect bounds;             // Empty if it's equal to the previous frame
+  int duration = 0;
+  WebPMemoryWriter writer;
+  bool ok = false;
+
+  EncodedFrame() { WebPMemoryWriterInit(&writer); }
+  ~EncodedFrame() { WebPMemoryWriterClear(&writer); }
+};
+
+// Encodes each frame independently in worker threads and then
+// assembles them in order with the WebPMux API. The WebPAnimEncoder
+// can only encode one frame after the other (as it compares each
+// frame with the previous encoded one), so this is faster for long
+// animations, but the result can be bigger (the anim encoder chooses
+// the best sub-frame/blending for each frame).
+static bool save_frames_in_parallel(FileOp* fop, FILE* fp,
+                                    const WebPConfig& config,
+                                    const WebPOptions& opts)
+{
+  const FileAbstractImage* sprite = fop->abstractImage();
+  const int w = sprite->width();
+  const int h = sprite->height();
+  const auto& selectedFrames = fop->roi().selectedFrames();
+  const int n = int(fop->roi().frames());
+
+  std::vector<std::unique_ptr<EncodedFrame>> frames;
+  frames.reserve(n);
+
+  // Frames are rendered in this thread (in batches, so we don't keep
+  // all the rendered frames in memory) and encoded in worker threads
+  const int batchSize =
+    2 * std::max(1, sched::Scheduler::instance().threads());
+  ImageRef prevImage;
+  auto frameIt = selectedFrames.begin();
+  for (int i=0; i<n && !fop->isStop(); i+=batchSize) {
+    sched::TaskGroup tasks(sched::Priority::Interactive);
+    for (int j=i; j<std::min(n, i+batchSize); ++j, ++frameIt) {
+      const frame_t frame = *frameIt;
+      auto encFrame = std::make_unique<EncodedFrame>();
+      encFrame->image.reset(Image::create(IMAGE_RGB, w, h));
+      encFrame->duration = sprite->frameDuration(frame);
+
+      clear_image(encFrame->image.get(), encFrame->image->maskColor());
+      sprite->renderFrame(frame, encFrame->image.get());
+      rgba_to_argb(encFrame->image.get());
+
+      if (!prevImage) {
+        encFrame->bounds = encFrame->image->bounds();
+      }
+      else if (doc::algorithm::shrink_bounds2(prevImage.get(),
+                                              encFrame->image.get(),
+                                              encFrame->image->bounds(),
+                                              encFrame->bounds)) {
+        // Frame offsets must be even
+        encFrame->bounds.w += (encFrame->bounds.x & 1);
+        encFrame->bounds.h += (encFrame->bounds.y & 1);
+        encFrame->bounds.x &= ~1;
+        encFrame->bounds.y &= ~1;
+      }
+      else {
+        encFrame->bounds = gfx::Rect();
+      }
+      prevImage = encFrame->image;
+
+      EncodedFrame* ptr = encFrame.get();
+      frames.push_back(std::move(encFrame));
+      if (ptr->bounds.isEmpty()) {
+        ptr->image.reset();
+        continue;
+      }
+
+      tasks.run([fop, ptr, w, &config]{
+        const gfx::Rect& rc = ptr->bounds;
+        WebPPicture pic;
+        WebPPictureInit(&pic);
+        pic.width = rc.w;
+        pic.height = rc.h;
+        pic.use_argb = true;
+        pic.argb = (uint32_t*)ptr->image->getPixelAddress(rc.x, rc.y);
+        pic.argb_stride = w;
+        pic.writer = WebPMemoryWrite;
+        pic.custom_ptr = &ptr->writer;
+        pic.user_data = fop;
+        pic.progress_hook = stop_report;
+        ptr->ok = WebPEncode(&config, &pic);
+        WebPPictureFree(&pic);
+        ptr->image.reset();
+      });
+    }
+    tasks.wait();
+
+    for (int j=i; j<std::min(n, i+batchSize); ++j) {
+      if (!frames[j]->bounds.isEmpty() && !frames[j]->ok) {
+        if (!fop->isStop())
+          fop->setError("Error saving frame %d info\n", j);
+        return fop->isStop();
+      }
+    }
+    fop->setProgress(double(std::min(n, i+batchSize)) / double(n));
+  }
+  if (fop->isStop())
+    return true;
+
+  WebPMux* mux = WebPMuxNew();
+  WebPMuxSetCanvasSize(mux, w, h);
+
+  WebPMuxAnimParams animParams;
+  animParams.bgcolor = 0;
+  animParams.loop_count =
+    (opts.loop() ? 0:  // 0 = infinite
+                   1); // 1 = loop once
+  WebPMuxSetAnimationParams(mux, &animParams);
+
+  bool ok = true;
+  for (int i=0; i<n && ok; ) {
+    const EncodedFrame* encFrame = frames[i].get();
+
+    // Frames equal to this one are merged in a longer frame
+    int duration = encFrame->duration;
+    for (++i; i<n && frames[i]->bounds.isEmpty(); ++i)
+      duration += frames[i]->duration;
+
+    WebPMuxFrameInfo info;
+    memset(&info, 0, sizeof(info));
+    info.bitstream.bytes = encFrame->writer.mem;
+    info.bitstream.size = encFrame->writer.size;
+    info.x_offset = encFrame->bounds.x;
+    info.y_offset = encFrame->bounds.y;
+    info.duration = duration;
+    info.id = WEBP_CHUNK_ANMF;
+    info.dispose_method = WEBP_MUX_DISPOSE_NONE;
+    info.blend_method = WEBP_MUX_NO_BLEND;
+    ok = (WebPMuxPushFrame(mux, &info, 0) == WEBP_MUX_OK);
+  }
+
+  WebPData webp_data;
+  WebPDataInit(&webp_data);
+  if (ok)
+    ok = (WebPMuxAssemble(mux, &webp_data) == WEBP_MUX_OK);
+  WebPMuxDelete(mux);
+
+  if (!ok) {
+    fop->setError("Error assembling WebP frames\n");
+    return false;
+  }
+
+  if (fwrite(webp_data.bytes, 1, webp_data.size, fp) != webp_data.size) {
+    WebPDataClear(&webp_data);
+    fop->setError("Error saving content into file\n");
+    return false;
+  }
+
+  WebPDataClear(&webp_data);
+  return true;
+}
+
 bool WebPFormat::onSave(FileOp* fop)
 {
-  FileHandle handle(open_file_with_exception_sync_on_close(fop->filename(), "wb"));
+  FileHandle handle(fop->openOutputFile(fop->filename()));
   FILE* fp = handle.get();
 
   const FileAbstractImage* sprite = fop->abstractImage();
@@ -291,9 +478,16 @@ bool WebPFormat::onSave(FileOp* fop)
         fop->setError("Error in WebP configuration preset\n");
         return false;
       }
+      config.method = opts->method();
       break;
   }
 
+  config.thread_level = (opts->threadLevel() ? 1: 0);
+
+  // Encode frames independently in worker threads
+  if (opts->parallelFrames() && fop->roi().frames() > 1)
+    return save_frames_in_parallel(fop, fp, config, *opts);
+
   WebPAnimEncoderOptions enc_options;
   WebPAnimEncoderOptionsInit(&enc_options);
   enc_options.anim_params.loop_count =
@@ -321,19 +515,7 @@ bool WebPFormat::onSave(FileOp* fop)
     clear_image(image.get(), image->maskColor());
     sprite->renderFrame(frame, image.get());
 
-    // Switch R <-> B channels because WebPAnimEncoderAssemble()
-    // expects MODE_BGRA pictures.
-    {
-      LockImageBits<RgbTraits> bits(image.get(), Image::ReadWriteLock);
-      auto it = bits.begin(), end = bits.end();
-      for (; it != end; ++it) {
-        auto c = *it;
-        *it = rgba(rgba_getb(c), // Use blue in red channel
-                   rgba_getg(c),
-                   rgba_getr(c), // Use red in blue channel
-                   rgba_geta(c));
-      }
-    }
+    rgba_to_argb(image.get());
 
     if (!WebPAnimEncoderAdd(enc, &pic, timestamp_ms, &config)) {
       if (!fop->isStop()) {
@@ -387,10 +569,16 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
           break;
         case WebPOptions::Lossy:
           if (pref.isSet(pref.webp.quality))     opts->setQuality(pref.webp.quality());
+          if (pref.isSet(pref.webp.method))      opts->setMethod(pref.webp.method());
           if (pref.isSet(pref.webp.imagePreset)) opts->setImagePreset(WebPPreset(pref.webp.imagePreset()));
           break;
       }
 
+      if (pref.isSet(pref.webp.threadLevel))
+        opts->setThreadLevel(pref.webp.threadLevel());
+      if (pref.isSet(pref.webp.parallelFrames))
+        opts->setParallelFrames(pref.webp.parallelFrames());
+
       if (pref.webp.showAlert()) {
         app::gen::WebpOptions win;
 
@@ -416,7 +604,10 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
         win.compression()->setValue(opts->compression());
         win.imageHint()->setSelectedItemIndex(opts->imageHint());
         win.quality()->setValue(static_cast<int>(opts->quality()));
+        win.method()->setValue(opts->method());
         win.imagePreset()->setSelectedItemIndex(opts->imagePreset());
+        win.threadLevel()->setSelected(opts->threadLevel());
+        win.parallelFrames()->setSelected(opts->parallelFrames());
 
         updatePanels();
         win.type()->Change.connect(updatePanels);
@@ -429,7 +620,10 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
           pref.webp.compression(win.compression()->getValue());
           pref.webp.imageHint(base::convert_to<int>(win.imageHint()->getValue()));
           pref.webp.quality(win.quality()->getValue());
+          pref.webp.method(win.method()->getValue());
           pref.webp.imagePreset(base::convert_to<int>(win.imagePreset()->getValue()));
+          pref.webp.threadLevel(win.threadLevel()->isSelected());
+          pref.webp.parallelFrames(win.parallelFrames()->isSelected());
 
           opts->setLoop(pref.webp.loop());
           opts->setType(WebPOptions::Type(pref.webp.type()));
@@ -440,9 +634,12 @@ FormatOptionsPtr WebPFormat::onAskUserForFormatOptions(FileOp* fop)
               break;
             case WebPOptions::Lossy:
               opts->setQuality(pref.webp.quality());
+              opts->setMethod(pref.webp.method());
               opts->setImagePreset(WebPPreset(pref.webp.imagePreset()));
               break;
           }
+          opts->setThreadLevel(pref.webp.threadLevel());
+          opts->setParallelFrames(pref.webp.parallelFrames());
         }
         else {
           opts.reset();
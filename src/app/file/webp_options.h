@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2015  Gabriel Rauter
 //
@@ -24,19 +25,28 @@ namespace app {
     // By default we use 6, because 9 is too slow
     const int kDefaultCompression = 6;
 
+    // Same default method used by WebPConfigPreset()
+    const int kDefaultMethod = 4;
+
     WebPOptions() : m_loop(true),
                     m_type(Type::Simple),
                     m_compression(kDefaultCompression),
                     m_imageHint(WEBP_HINT_DEFAULT),
                     m_quality(100),
-                    m_imagePreset(WEBP_PRESET_DEFAULT) { }
+                    m_method(kDefaultMethod),
+                    m_imagePreset(WEBP_PRESET_DEFAULT),
+                    m_threadLevel(true),
+                    m_parallelFrames(false) { }
 
     bool loop() const { return m_loop; }
     Type type() const { return m_type; }
     int compression() const { return m_compression; }
     WebPImageHint imageHint() const { return m_imageHint; }
     int quality() const { return m_quality; }
+    int method() const { return m_method; }
     WebPPreset imagePreset() const { return m_imagePreset; }
+    bool threadLevel() const { return m_threadLevel; }
+    bool parallelFrames() const { return m_parallelFrames; }
 
     void setLoop(const bool loop) {
       m_loop = loop;
@@ -66,11 +76,24 @@ namespace app {
       m_quality = quality;
     }
 
+    void setMethod(const int method) {
+      ASSERT(m_type == Type::Lossy);
+      m_method = method;
+    }
+
     void setImagePreset(const WebPPreset imagePreset) {
       ASSERT(m_type == Type::Lossy);
       m_imagePreset = imagePreset;
     }
 
+    void setThreadLevel(const bool threadLevel) {
+      m_threadLevel = threadLevel;
+    }
+
+    void setParallelFrames(const bool parallelFrames) {
+      m_parallelFrames = parallelFrames;
+    }
+
   private:
     bool m_loop;
     Type m_type;
@@ -79,7 +102,11 @@ namespace app {
     WebPImageHint m_imageHint; // Hint for image type (lossless only for now).
     // Lossy options
     int m_quality;      // Between 0 (smallest file) and 100 (biggest)
+    int m_method;       // Quality/speed trade-off (0=fast, 6=slower-better)
     WebPPreset m_imagePreset;  // Image Preset for lossy webp.
+    // Encoding options
+    bool m_threadLevel;    // Use the multi-threading of libwebp
+    bool m_parallelFrames; // Encode frames independently in worker threads
   };
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -19,6 +19,7 @@
 
 #include "base/fs.h"
 #include "base/string.h"
+#include "base/time.h"
 #include "os/surface.h"
 #include "os/system.h"
 #include "os/window.h"
@@ -64,6 +65,7 @@ using FileItemMap = std::map<std::string, FileItem*>;
 FileItem* rootitem = nullptr;
 FileItemMap* fileitems_map = nullptr;
 unsigned int current_file_system_version = 0;
+unsigned int forced_file_system_version = 0;
 
 #ifdef _WIN32
   base::ComPtr<IMalloc> shl_imalloc;
@@ -80,6 +82,7 @@ public:
   FileItem* m_parent;
   FileItemList m_children;
   unsigned int m_version;
+  base::Time m_listedTime;        // Modification time of the folder when it was listed
   bool m_removed;
   mutable bool m_is_folder;
   std::atomic<double> m_thumbnailProgress;
@@ -94,7 +97,7 @@ public:
   FileItem(FileItem* parent);
   ~FileItem();
 
-  void insertChildSorted(FileItem* child);
+  bool isListUpToDate() const;
   int compare(const FileItem& that) const;
 
   bool operator<(const FileItem& that) const { return compare(that) < 0; }
@@ -237,9 +240,11 @@ FileSystemModule* FileSystemModule::instance()
   return m_instance;
 }
 
-void FileSystemModule::refresh()
+void FileSystemModule::refresh(const bool force)
 {
   ++current_file_system_version;
+  if (force)
+    forced_file_system_version = current_file_system_version;
 }
 
 IFileItem* FileSystemModule::getRootFileItem()
@@ -430,6 +435,14 @@ const FileItemList& FileItem::children()
       // is outdated)...
       (m_children.empty() ||
        current_file_system_version > m_version)) {
+    // The folder wasn't modified since the last time we've listed
+    // it, so we can avoid enumerating all its files again (useful
+    // for big folders in network drives).
+    if (!m_children.empty() && isListUpToDate()) {
+      m_version = current_file_system_version;
+      return m_children;
+    }
+
     FileItemList::iterator it;
     FileItem* child;
 
@@ -440,6 +453,22 @@ const FileItemList& FileItem::children()
       child->m_removed = true;
     }
 
+    // The modification time is taken before the enumeration (so if
+    // it changes in the meantime, we'll list the folder again)
+    const base::Time now = base::current_time();
+    base::Time listedTime;
+    if (this != rootitem && base::is_directory(m_filename))
+      listedTime = base::get_modification_time(m_filename);
+
+    // Found children (sorted after the enumeration, which is faster
+    // than inserting each one in its sorted position)
+    FileItemList newChildren;
+    auto addChild = [&newChildren](FileItem* child) {
+      // this file-item wasn't removed from the last lookup
+      child->m_removed = false;
+      newChildren.push_back(child);
+    };
+
     //LOG("FS: Loading files for %p (%s)\n", fileitem, fileitem->displayname);
 #ifdef _WIN32
     {
@@ -501,7 +530,7 @@ const FileItemList& FileItem::children()
                 free_pidl(itempidl[c]);
               }
 
-              insertChildSorted(child);
+              addChild(child);
             }
           }
         }
@@ -520,22 +549,24 @@ const FileItemList& FileItem::children()
           if (fn == "." || fn == "..")
             continue;
 
-          child = get_fileitem_by_path(fullfn, false);
-          if (!child) {
-            child = new FileItem(this);
-
-            bool is_folder;
-            struct stat fileStat;
-
-            stat(fullfn.c_str(), &fileStat);
-
-            if ((fileStat.st_mode & S_IFMT) == S_IFLNK) {
-              is_folder = base::is_directory(fullfn);
-            }
-            else {
-              is_folder = ((fileStat.st_mode & S_IFMT) == S_IFDIR);
-            }
+          // Use the type of the entry when it's available to avoid
+          // calling stat() for each file (symbolic links are
+          // followed to know if they point to a directory).
+          bool is_folder;
+#ifdef DT_DIR
+          if (entry->d_type == DT_DIR)
+            is_folder = true;
+          else if (entry->d_type == DT_REG)
+            is_folder = false;
+          else
+#endif
+            is_folder = base::is_directory(fullfn);
 
+          // We've just read this entry, so we can skip the
+          // isExistent() check of get_fileitem_by_path()
+          auto itemIt = fileitems_map->find(get_key_for_filename(fullfn));
+          if (itemIt == fileitems_map->end()) {
+            child = new FileItem(this);
             child->m_filename = fullfn;
             child->m_displayname = fn;
             child->m_is_folder = is_folder;
@@ -543,10 +574,12 @@ const FileItemList& FileItem::children()
             put_fileitem(child);
           }
           else {
+            child = itemIt->second;
+            child->m_is_folder = is_folder;
             ASSERT(child->m_parent == this);
           }
 
-          insertChildSorted(child);
+          addChild(child);
         }
         closedir(dir);
       }
@@ -554,22 +587,35 @@ const FileItemList& FileItem::children()
 #endif
 
     // check old file-items (maybe removed directories or file-items)
-    for (it=m_children.begin();
-         it!=m_children.end(); ) {
-      child = static_cast<FileItem*>(*it);
+    FileItemList oldChildren;
+    std::swap(oldChildren, m_children);
+    for (IFileItem* ichild : oldChildren) {
+      child = static_cast<FileItem*>(ichild);
       ASSERT(child);
 
       if (child && child->m_removed) {
-        it = m_children.erase(it);
         child->m_parent = nullptr;
         child->deleteItem();
       }
-      else
-        ++it;
     }
 
+    std::sort(newChildren.begin(), newChildren.end(),
+              [](const IFileItem* a, const IFileItem* b){
+                return (*static_cast<const FileItem*>(a) <
+                        *static_cast<const FileItem*>(b));
+              });
+    m_children = std::move(newChildren);
+
     // now this file-item is updated
     m_version = current_file_system_version;
+
+    // We cannot trust the modification time if the folder was
+    // modified in the same second that we've listed it (the
+    // precision of base::Time is one second).
+    if (listedTime.valid() && listedTime < now)
+      m_listedTime = listedTime;
+    else
+      m_listedTime = base::Time();
   }
 
   return m_children;
@@ -581,6 +627,7 @@ void FileItem::createDirectory(const std::string& dirname)
 
   // Invalidate the children list.
   m_version = 0;
+  m_listedTime = base::Time();
 }
 
 bool FileItem::hasExtension(const base::paths& extensions)
@@ -647,23 +694,13 @@ FileItem::~FileItem()
 #endif
 }
 
-void FileItem::insertChildSorted(FileItem* child)
+bool FileItem::isListUpToDate() const
 {
-  // this file-item wasn't removed from the last lookup
-  child->m_removed = false;
-
-  // if the fileitem is already in the list we can go back
-  if (std::find(m_children.begin(), m_children.end(), child) != m_children.end())
-    return;
-
-  for (auto it=m_children.begin(), end=m_children.end(); it!=end; ++it) {
-    if (*child < *static_cast<FileItem*>(*it)) {
-      m_children.insert(it, child);
-      return;
-    }
-  }
+  if (!m_listedTime.valid() ||
+      m_version < forced_file_system_version)
+    return false;
 
-  m_children.push_back(child);
+  return (base::get_modification_time(m_filename) == m_listedTime);
 }
 
 int FileItem::compare(const FileItem& that) const
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -32,8 +32,10 @@ namespace app {
     static FileSystemModule* instance();
 
     // Marks all FileItems as deprecated to be refresh the next time
-    // they are queried through @ref FileItem::children().
-    void refresh();
+    // they are queried through @ref FileItem::children(). Folders
+    // that weren't modified (same modification time) are not listed
+    // again, except when "force" is true.
+    void refresh(const bool force = false);
 
     IFileItem* getRootFileItem();
 
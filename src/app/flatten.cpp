@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019 Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,8 @@
 #include "config.h"
 #endif
 
+#include "app/flatten.h"
+
 #include "doc/cel.h"
 #include "doc/frame.h"
 #include "doc/image.h"
@@ -16,27 +18,26 @@
 #include "doc/sprite.h"
 #include "gfx/rect.h"
 #include "render/render.h"
+#include "sched/task_group.h"
 
 #include <memory>
+#include <vector>
 
 namespace app {
 
 using namespace doc;
 
-static bool has_cels(const Layer* layer, frame_t frame);
-
 LayerImage* create_flatten_layer_copy(Sprite* dstSprite, const Layer* srcLayer,
                                       const gfx::Rect& bounds,
                                       frame_t frmin, frame_t frmax,
                                       const bool newBlend)
 {
   std::unique_ptr<LayerImage> flatLayer(new LayerImage(dstSprite));
-  render::Render render;
-  render.setNewBlend(newBlend);
+  std::vector<Cel*> cels;
 
   for (frame_t frame=frmin; frame<=frmax; ++frame) {
     // Does this frame have cels to render?
-    if (has_cels(srcLayer, frame)) {
+    if (layer_has_cels(srcLayer, frame)) {
       // Create a new image to render each frame.
       ImageRef image(Image::create(flatLayer->sprite()->pixelFormat(), bounds.w, bounds.h));
 
@@ -44,22 +45,29 @@ LayerImage* create_flatten_layer_copy(Sprite* dstSprite, const Layer* srcLayer,
       std::unique_ptr<Cel> cel(new Cel(frame, image));
       cel->setPosition(bounds.x, bounds.y);
 
-      // Render this frame.
-      render.renderLayer(image.get(), srcLayer, frame,
-        gfx::Clip(0, 0, bounds));
-
       // Add the cel (and release the std::unique_ptr).
       flatLayer->addCel(cel.get());
-      cel.release();
+      cels.push_back(cel.release());
     }
   }
 
+  // Each frame is independent, so they are rendered in parallel
+  // (the cels were already created in this thread in frame order).
+  sched::TaskGroup tasks(sched::Priority::UI);
+  for (Cel* cel : cels) {
+    tasks.run([cel, srcLayer, bounds, newBlend]{
+      render::Render render;
+      render.setNewBlend(newBlend);
+      render.renderLayer(cel->image(), srcLayer, cel->frame(),
+        gfx::Clip(0, 0, bounds));
+    });
+  }
+  tasks.wait();
+
   return flatLayer.release();
 }
 
-// Returns true if the "layer" or its children have any cel to render
-// in the given "frame".
-static bool has_cels(const Layer* layer, frame_t frame)
+bool layer_has_cels(const Layer* layer, frame_t frame)
 {
   if (!layer->isVisible())
     return false;
@@ -67,11 +75,12 @@ static bool has_cels(const Layer* layer, frame_t frame)
   switch (layer->type()) {
 
     case ObjectType::LayerImage:
+    case ObjectType::LayerTilemap:
       return (layer->cel(frame) ? true: false);
 
     case ObjectType::LayerGroup: {
       for (const Layer* child : static_cast<const LayerGroup*>(layer)->layers()) {
-        if (has_cels(child, frame))
+        if (layer_has_cels(child, frame))
           return true;
       }
       break;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019 Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -27,10 +27,16 @@ namespace app {
   // Note: The layer is not added to the given sprite, but is related to
   // it, so you'll be able to add the flatten layer only into the given
   // sprite.
-  LayerImage* create_flatten_layer_copy(Sprite* dstSprite, const Layer* srcLayer,
-                                        const gfx::Rect& bounds,
-                                        frame_t frmin, frame_t frmax,
-                                        const bool newBlend);
+  doc::LayerImage* create_flatten_layer_copy(doc::Sprite* dstSprite,
+                                             const doc::Layer* srcLayer,
+                                             const gfx::Rect& bounds,
+                                             doc::frame_t frmin,
+                                             doc::frame_t frmax,
+                                             const bool newBlend);
+
+  // Returns true if the "layer" or its visible children have any cel
+  // to render in the given "frame".
+  bool layer_has_cels(const doc::Layer* layer, doc::frame_t frame);
 
 } // namespace app
 
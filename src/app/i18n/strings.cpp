@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,13 +18,111 @@
 #include "app/xml_document.h"
 #include "app/xml_exception.h"
 #include "base/fs.h"
-#include "cfg/cfg.h"
+#include "base/fstream_path.h"
+
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <iterator>
 
 namespace app {
 
 static Strings* singleton = nullptr;
 static const char* kDefLanguage = "en";
 
+// A .ini file loaded in memory with the positions of each section.
+struct Strings::File {
+  struct Range {
+    std::size_t begin, end;
+  };
+  std::string data;
+  std::unordered_map<std::string, std::vector<Range>> sections;
+};
+
+namespace {
+
+std::string trim(const std::string& data, std::size_t begin, std::size_t end)
+{
+  while (begin < end && std::isspace((unsigned char)data[begin]))
+    ++begin;
+  while (end > begin && std::isspace((unsigned char)data[end-1]))
+    --end;
+  return data.substr(begin, end-begin);
+}
+
+// Parses the lines of a .ini file in the [pos, end) range with the
+// same syntax supported by cfg::CfgFile: comments (lines starting
+// with ';' or '#'), sections ("[section]"), "key = value" entries,
+// and "key = <<<TAG" multi-line values finished with a "TAG" line.
+//
+// onSection(name, lineBegin, nextLine) is called for each section
+// and onValue(key, value) for each entry.
+template<typename OnSection, typename OnValue>
+void parse_ini(const std::string& data,
+               std::size_t pos,
+               const std::size_t end,
+               OnSection onSection,
+               OnValue onValue)
+{
+  auto nextLine = [&data, end](std::size_t& pos,
+                               std::size_t& lineBegin,
+                               std::size_t& lineEnd) -> bool {
+    if (pos >= end)
+      return false;
+    lineBegin = pos;
+    lineEnd = data.find('\n', pos);
+    if (lineEnd == std::string::npos || lineEnd > end)
+      lineEnd = end;
+    pos = (lineEnd < end ? lineEnd+1: end);
+    if (lineEnd > lineBegin && data[lineEnd-1] == '\r')
+      --lineEnd;
+    return true;
+  };
+
+  std::size_t lineBegin, lineEnd;
+  while (nextLine(pos, lineBegin, lineEnd)) {
+    std::size_t i = lineBegin;
+    while (i < lineEnd && std::isspace((unsigned char)data[i]))
+      ++i;
+    if (i == lineEnd || data[i] == ';' || data[i] == '#')
+      continue;
+
+    if (data[i] == '[') {
+      std::size_t j = data.find(']', i);
+      if (j == std::string::npos || j > lineEnd)
+        j = lineEnd;
+      onSection(trim(data, i+1, j), lineBegin, pos);
+      continue;
+    }
+
+    const std::size_t eq = data.find('=', i);
+    if (eq == std::string::npos || eq > lineEnd)
+      continue;
+
+    const std::string key = trim(data, i, eq);
+    std::string value = trim(data, eq+1, lineEnd);
+
+    // Multi-line value
+    if (value.size() > 3 && value.compare(0, 3, "<<<") == 0) {
+      const std::string tag = value.substr(3);
+      value.clear();
+      bool first = true;
+      while (nextLine(pos, lineBegin, lineEnd)) {
+        if (trim(data, lineBegin, lineEnd) == tag)
+          break;
+        if (!first)
+          value.push_back('\n');
+        value.append(data, lineBegin, lineEnd-lineBegin);
+        first = false;
+      }
+    }
+
+    onValue(key, value);
+  }
+}
+
+} // anonymous namespace
+
 // static
 void Strings::createInstance(Preferences& pref,
                              Extensions& exts)
@@ -95,7 +194,10 @@ void Strings::setCurrentLanguage(const std::string& langId)
 
 void Strings::loadLanguage(const std::string& langId)
 {
+  std::lock_guard lock(m_mutex);
   m_strings.clear();
+  m_files.clear();
+  m_loadedSections.clear();
   loadStringsFromDataDir(kDefLanguage);
   if (langId != kDefLanguage) {
     loadStringsFromDataDir(langId);
@@ -126,36 +228,85 @@ void Strings::loadStringsFromExtension(const std::string& langId)
 
 void Strings::loadStringsFromFile(const std::string& fn)
 {
-  cfg::CfgFile cfg;
-  cfg.load(fn);
+  std::ifstream in(FSTREAM_PATH(fn), std::ifstream::binary);
+  if (!in)
+    return;
+
+  auto file = std::make_unique<File>();
+  file->data.assign(std::istreambuf_iterator<char>(in),
+                    std::istreambuf_iterator<char>());
+
+  // Skip the UTF-8 BOM
+  std::size_t begin = 0;
+  if (file->data.compare(0, 3, "\xEF\xBB\xBF") == 0)
+    begin = 3;
+
+  // Index the sections (only the entries of multi-line values are
+  // parsed to skip their lines)
+  File::Range* range = nullptr;
+  parse_ini(file->data, begin, file->data.size(),
+            [&file, &range](const std::string& section,
+                            std::size_t lineBegin,
+                            std::size_t nextLine) {
+              if (range)
+                range->end = lineBegin;
+              auto& ranges = file->sections[section];
+              ranges.push_back(File::Range{ nextLine, nextLine });
+              range = &ranges.back();
+            },
+            [](const std::string&, const std::string&){ });
+  if (range)
+    range->end = file->data.size();
 
-  std::vector<std::string> sections;
-  std::vector<std::string> keys;
-  cfg.getAllSections(sections);
-  for (const auto& section : sections) {
-    keys.clear();
-    cfg.getAllKeys(section.c_str(), keys);
+  m_files.push_back(std::move(file));
+}
 
-    std::string textId = section;
-    textId.push_back('.');
-    for (auto key : keys) {
-      textId.append(key);
-      m_strings[textId] = cfg.getValue(section.c_str(), key.c_str(), "");
+void Strings::loadSection(const std::string& section) const
+{
+  m_loadedSections.insert(section);
 
-      //TRACE("I18N: Reading string %s -> %s\n", textId.c_str(), m_strings[textId].c_str());
+  std::string textId = section;
+  textId.push_back('.');
 
-      textId.erase(section.size()+1);
+  for (const auto& file : m_files) {
+    auto it = file->sections.find(section);
+    if (it == file->sections.end())
+      continue;
+
+    for (const File::Range& range : it->second) {
+      parse_ini(file->data, range.begin, range.end,
+                [](const std::string&, std::size_t, std::size_t){ },
+                [this, &textId, &section](const std::string& key,
+                                          const std::string& value) {
+                  textId.append(key);
+                  m_strings[textId] = value;
+                  textId.erase(section.size()+1);
+                });
     }
   }
 }
 
 const std::string& Strings::translate(const char* id) const
 {
+  std::lock_guard lock(m_mutex);
+
   auto it = m_strings.find(id);
   if (it != m_strings.end())
     return it->second;
-  else
-    return m_strings[id] = id;
+
+  // Load the section of this string the first time
+  const char* dot = std::strchr(id, '.');
+  if (dot) {
+    std::string section(id, dot);
+    if (m_loadedSections.find(section) == m_loadedSections.end()) {
+      loadSection(section);
+      it = m_strings.find(id);
+      if (it != m_strings.end())
+        return it->second;
+    }
+  }
+
+  return m_strings[id] = id;
 }
 
 } // namespace app
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -8,9 +9,13 @@
 #define APP_I18N_STRINGS_INCLUDED
 #pragma once
 
+#include <memory>
+#include <mutex>
 #include <set>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "obs/signal.h"
 
@@ -22,6 +27,10 @@ namespace app {
   class Extensions;
 
   // Singleton class to load and access "strings/en.ini" file.
+  //
+  // The .ini files are read in memory with an index of their
+  // sections, and each section is parsed the first time one of its
+  // strings is translated.
   class Strings : public app::gen::Strings<app::Strings> {
   public:
     static void createInstance(Preferences& pref,
@@ -44,10 +53,20 @@ namespace app {
     void loadStringsFromDataDir(const std::string& langId);
     void loadStringsFromExtension(const std::string& langId);
     void loadStringsFromFile(const std::string& fn);
+    void loadSection(const std::string& section) const;
+
+    struct File;
 
     Preferences& m_pref;
     Extensions& m_exts;
     mutable std::unordered_map<std::string, std::string> m_strings;
+
+    // Files of the current language (in order of priority, from the
+    // lowest to the highest), and sections already loaded in
+    // m_strings.
+    std::vector<std::unique_ptr<File>> m_files;
+    mutable std::unordered_set<std::string> m_loadedSections;
+    mutable std::mutex m_mutex;
   };
 
 } // namespace app
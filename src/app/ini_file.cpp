@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -27,14 +27,34 @@
 #endif
 
 #include <cstdlib>
+#include <cstring>
 #include <vector>
 
 namespace app {
 
 using namespace gfx;
 
+namespace {
+
+struct ConfigFile {
+  cfg::CfgFile cfg;
+  // True if some value was modified since the file was loaded or
+  // saved, so we don't write the same content again on each flush.
+  bool modified = false;
+};
+
+} // anonymous namespace
+
 static std::string g_configFilename;
-static std::vector<cfg::CfgFile*> g_configs;
+static std::vector<ConfigFile*> g_configs;
+
+// Returns the current configuration file to modify some value
+static cfg::CfgFile& modify_config()
+{
+  ConfigFile* config = g_configs.back();
+  config->modified = true;
+  return config->cfg;
+}
 
 ConfigModule::ConfigModule()
 {
@@ -110,7 +130,7 @@ ConfigModule::~ConfigModule()
 
 void push_config_state()
 {
-  g_configs.push_back(new cfg::CfgFile());
+  g_configs.push_back(new ConfigFile);
 }
 
 void pop_config_state()
@@ -125,15 +145,22 @@ void flush_config_file()
 {
   ASSERT(!g_configs.empty());
 
-  g_configs.back()->save();
+  ConfigFile* config = g_configs.back();
+  if (!config->modified)
+    return;
+
+  config->cfg.save();
+  config->modified = false;
 }
 
 void set_config_file(const char* filename)
 {
   if (g_configs.empty())
-    g_configs.push_back(new cfg::CfgFile());
+    g_configs.push_back(new ConfigFile);
 
-  g_configs.back()->load(filename);
+  ConfigFile* config = g_configs.back();
+  config->cfg.load(filename);
+  config->modified = false;
 }
 
 std::string main_config_filename()
@@ -143,52 +170,72 @@ std::string main_config_filename()
 
 const char* get_config_string(const char* section, const char* name, const char* value)
 {
-  return g_configs.back()->getValue(section, name, value);
+  return g_configs.back()->cfg.getValue(section, name, value);
 }
 
 void set_config_string(const char* section, const char* name, const char* value)
 {
-  g_configs.back()->setValue(section, name, value);
+  const char* oldValue = get_config_string(section, name, nullptr);
+  if (oldValue && value && std::strcmp(oldValue, value) == 0)
+    return;
+
+  modify_config().setValue(section, name, value);
 }
 
 int get_config_int(const char* section, const char* name, int value)
 {
-  return g_configs.back()->getIntValue(section, name, value);
+  return g_configs.back()->cfg.getIntValue(section, name, value);
 }
 
 void set_config_int(const char* section, const char* name, int value)
 {
-  g_configs.back()->setIntValue(section, name, value);
+  if (get_config_string(section, name, nullptr) &&
+      get_config_int(section, name, value) == value)
+    return;
+
+  modify_config().setIntValue(section, name, value);
 }
 
 float get_config_float(const char* section, const char* name, float value)
 {
-  return (float)g_configs.back()->getDoubleValue(section, name, (float)value);
+  return (float)g_configs.back()->cfg.getDoubleValue(section, name, (float)value);
 }
 
 void set_config_float(const char* section, const char* name, float value)
 {
-  g_configs.back()->setDoubleValue(section, name, (float)value);
+  if (get_config_string(section, name, nullptr) &&
+      get_config_float(section, name, value) == value)
+    return;
+
+  modify_config().setDoubleValue(section, name, (float)value);
 }
 
 double get_config_double(const char* section, const char* name, double value)
 {
-  return g_configs.back()->getDoubleValue(section, name, value);
+  return g_configs.back()->cfg.getDoubleValue(section, name, value);
 }
 
 void set_config_double(const char* section, const char* name, double value)
 {
-  g_configs.back()->setDoubleValue(section, name, value);
+  if (get_config_string(section, name, nullptr) &&
+      get_config_double(section, name, value) == value)
+    return;
+
+  modify_config().setDoubleValue(section, name, value);
 }
 
 bool get_config_bool(const char* section, const char* name, bool value)
 {
-  return g_configs.back()->getBoolValue(section, name, value);
+  return g_configs.back()->cfg.getBoolValue(section, name, value);
 }
 
 void set_config_bool(const char* section, const char* name, bool value)
 {
-  g_configs.back()->setBoolValue(section, name, value);
+  if (get_config_string(section, name, nullptr) &&
+      get_config_bool(section, name, value) == value)
+    return;
+
+  modify_config().setBoolValue(section, name, value);
 }
 
 Point get_config_point(const char* section, const char* name, const Point& point)
@@ -271,18 +318,21 @@ void set_config_color(const char* section, const char* name, const app::Color& v
 
 void del_config_value(const char* section, const char* name)
 {
-  g_configs.back()->deleteValue(section, name);
+  if (!get_config_string(section, name, nullptr))
+    return;
+
+  modify_config().deleteValue(section, name);
 }
 
 void del_config_section(const char* section)
 {
-  g_configs.back()->deleteSection(section);
+  modify_config().deleteSection(section);
 }
 
 base::paths enum_config_keys(const char* section)
 {
   base::paths keys;
-  g_configs.back()->getAllKeys(section, keys);
+  g_configs.back()->cfg.getAllKeys(section, keys);
   return keys;
 }
 
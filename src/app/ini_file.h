@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2019  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -25,6 +25,8 @@ namespace app {
 
   void push_config_state();
   void pop_config_state();
+  // Saves the current configuration file only if some value was
+  // modified since it was loaded or saved.
   void flush_config_file();
   void set_config_file(const char* filename);
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -37,6 +37,40 @@ TEST(IniFile, Basic)
   EXPECT_EQ(3, get_config_int("B", "b", 1));
 }
 
+TEST(IniFile, FlushOnlyModified)
+{
+  ConfigModule cm;
+
+  if (base::is_file("_test.ini"))
+    base::delete_file("_test.ini");
+
+  set_config_file("_test.ini");
+  set_config_int("A", "a", 1);
+  set_config_string("A", "b", "text");
+  flush_config_file();
+  EXPECT_TRUE(base::is_file("_test.ini"));
+
+  // Nothing was modified, so the file isn't written again
+  base::delete_file("_test.ini");
+  flush_config_file();
+  EXPECT_FALSE(base::is_file("_test.ini"));
+
+  // Same values
+  set_config_int("A", "a", 1);
+  set_config_string("A", "b", "text");
+  del_config_value("A", "c");
+  flush_config_file();
+  EXPECT_FALSE(base::is_file("_test.ini"));
+
+  set_config_int("A", "a", 2);
+  flush_config_file();
+  EXPECT_TRUE(base::is_file("_test.ini"));
+
+  set_config_file("_test.ini");
+  EXPECT_EQ(2, get_config_int("A", "a", 0));
+  EXPECT_EQ(std::string("text"), get_config_string("A", "b", ""));
+}
+
 TEST(IniFile, PushPop)
 {
   ConfigModule cm;
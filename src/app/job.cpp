@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -34,6 +34,9 @@ int Job::runningJobs()
 }
 
 Job::Job(const char* jobName)
+  : m_task(sched::Priority::Interactive)
+  , m_started(false)
+  , m_background(false)
 {
   m_last_progress = 0.0;
   m_done_flag = false;
@@ -62,7 +65,8 @@ Job::~Job()
 
 void Job::startJob()
 {
-  m_thread = std::thread(&Job::thread_proc, this);
+  m_task.run([this]{ thread_proc(this); });
+  m_started = true;
   ++g_runningJobs;
 
   if (m_alert_window) {
@@ -75,21 +79,27 @@ void Job::startJob()
         m_canceled_flag = true;
     }
 
-    // In case of error, take the "cancel" path (i.e. it's like the
-    // user canceled the operation).
-    if (m_error) {
-      m_canceled_flag = true;
-      try {
-        std::rethrow_exception(m_error);
-      }
-      catch (const std::exception& ex) {
-        Console::showException(ex);
-      }
-      catch (...) {
-        Console console;
-        console.printf("Unknown error performing the task");
-      }
-    }
+    reportError();
+  }
+}
+
+void Job::startJobInBackground()
+{
+  m_background = true;
+  m_task.run([this]{ thread_proc(this); });
+  m_started = true;
+  ++g_runningJobs;
+
+  if (m_alert_window) {
+    // Closing the window (e.g. with the "Cancel" button) before the
+    // job is done cancels it.
+    m_alert_window->Close.connect(
+      [this]{
+        std::unique_lock<std::mutex> hold(m_mutex);
+        if (!m_done_flag)
+          m_canceled_flag = true;
+      });
+    m_alert_window->openWindow();
   }
 }
 
@@ -98,13 +108,31 @@ void Job::waitJob()
   if (m_timer && m_timer->isRunning())
     m_timer->stop();
 
-  if (m_thread.joinable()) {
-    m_thread.join();
+  if (m_started) {
+    m_task.wait();
+    m_started = false;
 
     --g_runningJobs;
+
+    // In background jobs we report the error at this point because
+    // startJobInBackground() returns immediately
+    if (m_background)
+      reportError();
   }
 }
 
+bool Job::isDone()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  return m_done_flag;
+}
+
+void Job::cancelJob()
+{
+  std::unique_lock<std::mutex> hold(m_mutex);
+  m_canceled_flag = true;
+}
+
 void Job::jobProgress(double f)
 {
   m_last_progress = f;
@@ -117,13 +145,17 @@ bool Job::isCanceled()
 
 void Job::onMonitoringTick()
 {
-  std::unique_lock<std::mutex> hold(m_mutex);
-
   // update progress
   m_alert_window->setProgress(m_last_progress);
 
-  // is job done? we can close the monitor
-  if (m_done_flag || m_canceled_flag) {
+  // is job done? we can close the monitor (outside the mutex lock
+  // because the Close signal of a background job locks it too)
+  bool finished;
+  {
+    std::unique_lock<std::mutex> hold(m_mutex);
+    finished = (m_done_flag || m_canceled_flag);
+  }
+  if (finished) {
     m_timer->stop();
     m_alert_window->closeWindow(NULL);
   }
@@ -135,7 +167,26 @@ void Job::done()
   m_done_flag = true;
 }
 
-// Called to start the worker thread.
+void Job::reportError()
+{
+  // In case of error, take the "cancel" path (i.e. it's like the
+  // user canceled the operation).
+  if (m_error) {
+    m_canceled_flag = true;
+    try {
+      std::rethrow_exception(m_error);
+    }
+    catch (const std::exception& ex) {
+      Console::showException(ex);
+    }
+    catch (...) {
+      Console console;
+      console.printf("Unknown error performing the task");
+    }
+  }
+}
+
+// Called from the worker thread.
 void Job::thread_proc(Job* self)
 {
   try {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,13 +9,13 @@
 #define APP_JOB_H_INCLUDED
 #pragma once
 
+#include "sched/task_group.h"
 #include "ui/alert.h"
 #include "ui/timer.h"
 
 #include <atomic>
 #include <exception>
 #include <mutex>
-#include <thread>
 
 namespace app {
 
@@ -26,12 +26,27 @@ namespace app {
     Job(const char* jobName);
     virtual ~Job();
 
-    // Starts the job calling onJob() event in another thread and
-    // monitoring the progress with onMonitorTick() event.
+    // Starts the job calling onJob() event in a worker thread of
+    // the sched::Scheduler and monitoring the progress with
+    // onMonitorTick() event.
     void startJob();
 
+    // Starts the job in the same way as startJob() but without
+    // blocking the UI: the progress window is not modal, and closing
+    // it cancels the job. The job must be finished with waitJob()
+    // once isDone() returns true (or to wait it).
+    void startJobInBackground();
+
     void waitJob();
 
+    // Returns true if the onJob() has finished (from the worker
+    // thread), so waitJob() will not block.
+    bool isDone();
+
+    // Cancels the job, the onJob() member function will see
+    // isCanceled() == true.
+    void cancelJob();
+
     // The onJob() can use this function to report progress of the
     // background job being done. 1.0 is completed.
     void jobProgress(double f);
@@ -43,8 +58,8 @@ namespace app {
 
   protected:
 
-    // This member function is called from another dedicated thread
-    // outside the GUI one, so you can do some image processing here.
+    // This member function is called from a worker thread outside
+    // the GUI one, so you can do some image processing here.
     // Remember that you cannot use any GUI element in this handler.
     virtual void onJob() = 0;
 
@@ -54,12 +69,15 @@ namespace app {
 
   private:
     void done();
+    void reportError();
 
     static void thread_proc(Job* self);
     static void monitor_proc(void* data);
     static void monitor_free(void* data);
 
-    std::thread m_thread;
+    sched::TaskGroup m_task;
+    bool m_started;
+    bool m_background;
     std::unique_ptr<ui::Timer> m_timer;
     std::mutex m_mutex;
     ui::AlertPtr m_alert_window;
@@ -0,0 +1,96 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/memory_report.h"
+
+#include "app/context.h"
+#include "app/doc.h"
+#include "app/doc_undo.h"
+#include "base/mem_utils.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/sprite.h"
+#include "doc/tilesets.h"
+
+#include <ostream>
+
+namespace app {
+
+obs::signal<void(MemoryReport&)> MemoryReport::Collect;
+
+void MemoryReport::add(const std::string& name, const size_t bytes)
+{
+  subsystems.push_back(Subsystem{ name, bytes });
+}
+
+size_t MemoryReport::docsTotal() const
+{
+  size_t total = 0;
+  for (const DocUsage& doc : docs)
+    total += doc.total();
+  return total;
+}
+
+size_t MemoryReport::total() const
+{
+  size_t total = docsTotal();
+  for (const Subsystem& subsystem : subsystems)
+    total += subsystem.bytes;
+  return total;
+}
+
+MemoryReport create_memory_report(const Context* ctx)
+{
+  MemoryReport report;
+
+  if (ctx) {
+    for (const Doc* doc : ctx->documents()) {
+      const doc::Sprite* sprite = doc->sprite();
+      MemoryReport::DocUsage usage;
+      usage.name = doc->name();
+
+      // Linked cels share the same image, so we count unique cels only
+      for (const doc::Cel* cel : sprite->uniqueCels())
+        if (cel->image())
+          usage.images += size_t(cel->image()->getMemSize());
+
+      if (sprite->hasTilesets())
+        usage.tilesets = size_t(sprite->tilesets()->getMemSize());
+
+      if (const DocUndo* undo = doc->undoHistory())
+        usage.undo = undo->totalUndoSize();
+
+      report.docs.push_back(usage);
+    }
+  }
+
+  MemoryReport::Collect(report);
+  return report;
+}
+
+void write_memory_report(std::ostream& os, const MemoryReport& report)
+{
+  auto size = [](const size_t bytes) {
+    return base::get_pretty_memory_size(bytes);
+  };
+
+  os << "Documents: " << size(report.docsTotal()) << "\n";
+  for (const MemoryReport::DocUsage& doc : report.docs) {
+    os << "  " << doc.name << ": " << size(doc.total())
+       << " (images " << size(doc.images)
+       << ", tilesets " << size(doc.tilesets)
+       << ", undo " << size(doc.undo) << ")\n";
+  }
+  for (const MemoryReport::Subsystem& subsystem : report.subsystems)
+    os << subsystem.name << ": " << size(subsystem.bytes) << "\n";
+  os << "Total: " << size(report.total()) << "\n";
+}
+
+} // namespace app
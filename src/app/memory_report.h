@@ -0,0 +1,56 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_MEMORY_REPORT_H_INCLUDED
+#define APP_MEMORY_REPORT_H_INCLUDED
+#pragma once
+
+#include "obs/signal.h"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace app {
+
+  class Context;
+
+  // Memory used (in bytes) by each document and by the caches of the
+  // program, to know where the memory goes and adjust the budgets of
+  // the caches.
+  struct MemoryReport {
+    struct DocUsage {
+      std::string name;
+      size_t images = 0;        // Cel images (and tilemaps)
+      size_t tilesets = 0;
+      size_t undo = 0;          // Undo history
+      size_t total() const { return images + tilesets + undo; }
+    };
+
+    struct Subsystem {
+      std::string name;
+      size_t bytes = 0;
+    };
+
+    std::vector<DocUsage> docs;
+    std::vector<Subsystem> subsystems;
+
+    void add(const std::string& name, const size_t bytes);
+    size_t docsTotal() const;
+    size_t total() const;
+
+    // Each cache connects to this signal to add its memory usage to
+    // the report. It's generated from the UI thread, so the slots
+    // must lock their own data if it's modified from other threads.
+    static obs::signal<void(MemoryReport&)> Collect;
+  };
+
+  MemoryReport create_memory_report(const Context* ctx);
+  void write_memory_report(std::ostream& os, const MemoryReport& report);
+
+} // namespace app
+
+#endif
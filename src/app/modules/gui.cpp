@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -524,8 +524,8 @@ bool CustomizedGuiManager::onProcessMessage(Message* msg)
       // TODO could we send the files to each dialog?
       if (getForegroundWindow() == App::instance()->mainWindow()) {
         base::paths files = static_cast<DropFilesMessage*>(msg)->files();
+        base::paths filesToOpen;
         UIContext* ctx = UIContext::instance();
-        OpenBatchOfFiles batch;
 
         while (!files.empty()) {
           auto fn = files.front();
@@ -556,18 +556,18 @@ bool CustomizedGuiManager::onProcessMessage(Message* msg)
             }
             // Other extensions will be handled as an image/sprite
             else {
-              batch.open(ctx, fn,
-                         false); // Open all frames
-
-              // Remove all used file names from the "dropped files"
-              for (const auto& usedFn : batch.usedFiles()) {
-                auto it = std::find(files.begin(), files.end(), usedFn);
-                if (it != files.end())
-                  files.erase(it);
-              }
+              filesToOpen.push_back(fn);
             }
           }
         }
+
+        // Open all images/sprites at the same time (the files used
+        // in sequences are removed from the list by the command)
+        if (!filesToOpen.empty()) {
+          OpenBatchOfFiles batch;
+          batch.open(ctx, filesToOpen,
+                     false); // Open all frames
+        }
       }
       break;
 
@@ -720,78 +720,76 @@ bool CustomizedGuiManager::processKey(Message* msg)
   };
   int n = (contexts[0] != contexts[1] ? 2: 1);
   for (int i = 0; i < n; ++i) {
-    for (const KeyPtr& key : *keys) {
-      if (key->isPressed(msg, *keys, contexts[i])) {
-        // Cancel menu-bar loops (to close any popup menu)
-        app->mainWindow()->getMenuBar()->cancelMenuLoop();
-
-        switch (key->type()) {
-
-          case KeyType::Tool: {
-            tools::Tool* current_tool = app->activeTool();
-            tools::Tool* select_this_tool = key->tool();
-            tools::ToolBox* toolbox = app->toolBox();
-            std::vector<tools::Tool*> possibles;
-
-            // Collect all tools with the pressed keyboard-shortcut
-            for (tools::Tool* tool : *toolbox) {
-              const KeyPtr key = keys->tool(tool);
-              if (key && key->isPressed(msg, *keys))
-                possibles.push_back(tool);
-            }
+    for (const KeyPtr& key : keys->pressedKeys(msg, contexts[i])) {
+      // Cancel menu-bar loops (to close any popup menu)
+      app->mainWindow()->getMenuBar()->cancelMenuLoop();
+
+      switch (key->type()) {
+
+        case KeyType::Tool: {
+          tools::Tool* current_tool = app->activeTool();
+          tools::Tool* select_this_tool = key->tool();
+          tools::ToolBox* toolbox = app->toolBox();
+          std::vector<tools::Tool*> possibles;
+
+          // Collect all tools with the pressed keyboard-shortcut
+          for (tools::Tool* tool : *toolbox) {
+            const KeyPtr key = keys->tool(tool);
+            if (key && key->isPressed(msg, *keys))
+              possibles.push_back(tool);
+          }
 
-            if (possibles.size() >= 2) {
-              bool done = false;
+          if (possibles.size() >= 2) {
+            bool done = false;
 
-              for (size_t i=0; i<possibles.size(); ++i) {
-                if (possibles[i] != current_tool &&
-                    ToolBar::instance()->isToolVisible(possibles[i])) {
-                  select_this_tool = possibles[i];
-                  done = true;
-                  break;
-                }
+            for (size_t i=0; i<possibles.size(); ++i) {
+              if (possibles[i] != current_tool &&
+                  ToolBar::instance()->isToolVisible(possibles[i])) {
+                select_this_tool = possibles[i];
+                done = true;
+                break;
               }
+            }
 
-              if (!done) {
-                for (size_t i=0; i<possibles.size(); ++i) {
-                  // If one of the possibilities is the current tool
-                  if (possibles[i] == current_tool) {
-                    // We select the next tool in the possibilities
-                    select_this_tool = possibles[(i+1) % possibles.size()];
-                    break;
-                  }
+            if (!done) {
+              for (size_t i=0; i<possibles.size(); ++i) {
+                // If one of the possibilities is the current tool
+                if (possibles[i] == current_tool) {
+                  // We select the next tool in the possibilities
+                  select_this_tool = possibles[(i+1) % possibles.size()];
+                  break;
                 }
               }
             }
-
-            ToolBar::instance()->selectTool(select_this_tool);
-            return true;
           }
 
-          case KeyType::Command: {
-            Command* command = key->command();
-
-            // Commands are executed only when the main window is
-            // the current window running.
-            if (getForegroundWindow() == app->mainWindow()) {
-              // OK, so we can execute the command represented
-              // by the pressed-key in the message...
-              UIContext::instance()->executeCommandFromMenuOrShortcut(
-                command, key->params());
-              return true;
-            }
-            break;
-          }
+          ToolBar::instance()->selectTool(select_this_tool);
+          return true;
+        }
+
+        case KeyType::Command: {
+          Command* command = key->command();
 
-          case KeyType::Quicktool: {
-            // Do nothing, it is used in the editor through the
-            // KeyboardShortcuts::getCurrentQuicktool() function.
-            break;
+          // Commands are executed only when the main window is
+          // the current window running.
+          if (getForegroundWindow() == app->mainWindow()) {
+            // OK, so we can execute the command represented
+            // by the pressed-key in the message...
+            UIContext::instance()->executeCommandFromMenuOrShortcut(
+              command, key->params());
+            return true;
           }
+          break;
+        }
 
+        case KeyType::Quicktool: {
+          // Do nothing, it is used in the editor through the
+          // KeyboardShortcuts::getCurrentQuicktool() function.
+          break;
         }
-        break;
+
       }
+      break;
     }
   }
   return false;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -54,6 +54,7 @@ namespace app {
     // Basic configuration
 
     virtual void setRefLayersVisiblity(const bool visible) = 0;
+    virtual void setRefLayersLowQuality(const bool lowQuality) = 0;
     virtual void setNonactiveLayersOpacity(const int opacity) = 0;
     virtual void setNewBlendMethod(const bool newBlend) = 0;
     virtual void setBgOptions(const render::BgOptions& bg) = 0;
@@ -80,6 +81,19 @@ namespace app {
     virtual void setOnionskin(const render::OnionskinOptions& options) = 0;
     virtual void disableOnionskin() = 0;
 
+    // ----------------------------------------------------------------------
+    // Layer stack cache
+
+    // Caches the already composited layers below the given layer
+    // (e.g. the active layer while the user is painting on it), so
+    // renderSprite() only needs to composite the given layer and the
+    // layers above it. Use nullptr to render all layers again.
+    virtual void setLayerStackCache(const doc::Layer* layer) = 0;
+
+    // Must be called when the layers below the cached layer could be
+    // modified.
+    virtual void invalidateLayerStackCache() = 0;
+
     // ----------------------------------------------------------------------
     // Compositing
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,13 +13,19 @@
 #if SK_ENABLE_SKSL && ENABLE_DEVMODE // TODO remove ENABLE_DEVMODE when the ShaderRenderer is ready
 
 #include "app/color_utils.h"
+#include "app/pref/preferences.h"
 #include "app/util/shader_helpers.h"
 #include "doc/render_plan.h"
 #include "os/skia/skia_surface.h"
 
+#include "include/core/SkBlender.h"
 #include "include/core/SkCanvas.h"
 #include "include/effects/SkRuntimeEffect.h"
 
+#if SK_SUPPORT_GPU
+  #include "include/gpu/GrDirectContext.h"
+#endif
+
 namespace app {
 
 namespace {
@@ -39,8 +45,8 @@ uniform shader iImg;
 uniform shader iPal;
 
 half4 main(vec2 fragcoord) {
- int index = int(255.0 * iImg.eval(fragcoord).a);
- return iPal.eval(half2(index, 0));
+ int index = int(255.0 * iImg.eval(fragcoord).a + 0.5);
+ return iPal.eval(half2(index, 0) + 0.5);
 }
 )";
 
@@ -53,6 +59,91 @@ half4 main(vec2 fragcoord) {
 }
 )";
 
+// Implementation of all doc::BlendMode modes (the same formulas as
+// in doc/blend_funcs.cpp) for the layer blend modes that cannot be
+// mapped to a SkBlendMode, or when the old blend method is used
+// (iNewBlend=0, where the backdrop alpha is ignored to blend colors).
+const char* kBlendShaderCode = R"(
+uniform int iMode;
+uniform int iNewBlend;
+
+half lum(half3 c) { return dot(c, half3(0.3, 0.59, 0.11)); }
+half sat(half3 c) { return max(c.r, max(c.g, c.b)) - min(c.r, min(c.g, c.b)); }
+
+half3 set_lum(half3 c, half l) {
+ c += l - lum(c);
+ l = lum(c);
+ half n = min(c.r, min(c.g, c.b));
+ half x = max(c.r, max(c.g, c.b));
+ if (n < 0.0) c = l + (c - l) * l / (l - n);
+ if (x > 1.0) c = l + (c - l) * (1 - l) / (x - l);
+ return c;
+}
+
+half3 set_sat(half3 c, half s) {
+ half n = min(c.r, min(c.g, c.b));
+ half x = max(c.r, max(c.g, c.b));
+ return (x > n ? (c - n) * s / (x - n): half3(0));
+}
+
+half hard_light(half b, half s) {
+ return (s <= 0.5 ? b * 2*s: b + (2*s-1) - b * (2*s-1));
+}
+
+half color_dodge(half b, half s) {
+ return (b == 0 ? 0: (b >= 1-s ? 1: b / (1-s)));
+}
+
+half color_burn(half b, half s) {
+ return (b == 1 ? 1: (1-b >= s ? 0: 1 - (1-b) / s));
+}
+
+half soft_light(half b, half s) {
+ half d = (b <= 0.25 ? ((16*b-12)*b+4)*b: sqrt(b));
+ return (s <= 0.5 ? b - (1 - 2*s) * b * (1 - b): b + (2*s - 1) * (d - b));
+}
+
+half divide(half b, half s) {
+ return (b == 0 ? 0: (b >= s ? 1: b / s));
+}
+
+half3 blend(half3 b, half3 s) {
+ if (iMode == 1) return b * s;
+ if (iMode == 2) return b + s - b * s;
+ if (iMode == 3) return half3(hard_light(s.r, b.r), hard_light(s.g, b.g), hard_light(s.b, b.b));
+ if (iMode == 4) return min(b, s);
+ if (iMode == 5) return max(b, s);
+ if (iMode == 6) return half3(color_dodge(b.r, s.r), color_dodge(b.g, s.g), color_dodge(b.b, s.b));
+ if (iMode == 7) return half3(color_burn(b.r, s.r), color_burn(b.g, s.g), color_burn(b.b, s.b));
+ if (iMode == 8) return half3(hard_light(b.r, s.r), hard_light(b.g, s.g), hard_light(b.b, s.b));
+ if (iMode == 9) return half3(soft_light(b.r, s.r), soft_light(b.g, s.g), soft_light(b.b, s.b));
+ if (iMode == 10) return abs(b - s);
+ if (iMode == 11) return b + s - 2 * b * s;
+ if (iMode == 12) return set_lum(set_sat(s, sat(b)), lum(b));
+ if (iMode == 13) return set_lum(set_sat(b, sat(s)), lum(b));
+ if (iMode == 14) return set_lum(s, lum(b));
+ if (iMode == 15) return set_lum(b, lum(s));
+ if (iMode == 16) return min(b + s, 1.0);
+ if (iMode == 17) return max(b - s, 0.0);
+ if (iMode == 18) return half3(divide(b.r, s.r), divide(b.g, s.g), divide(b.b, s.b));
+ return s;
+}
+
+half4 main(half4 src, half4 dst) {
+ half3 s = (src.a > 0 ? src.rgb / src.a: half3(0));
+ half3 b = (dst.a > 0 ? dst.rgb / dst.a: half3(0));
+ half3 c = blend(b, s);
+ if (iNewBlend != 0)
+  c = mix(s, c, dst.a);
+ return half4(saturate(c) * src.a, src.a) + dst * (1 - src.a);
+}
+)";
+
+inline bool has_skia_blend_mode(const doc::BlendMode bm) {
+  return (bm != doc::BlendMode::SUBTRACT &&
+          bm != doc::BlendMode::DIVIDE);
+}
+
 inline SkBlendMode to_skia(const doc::BlendMode bm) {
   switch (bm) {
     case doc::BlendMode::NORMAL: return SkBlendMode::kSrcOver;
@@ -98,6 +189,21 @@ ShaderRenderer::ShaderRenderer()
   m_bgEffect = makeShader(kBgShaderCode).effect;
   m_indexedEffect = makeShader(kIndexedShaderCode).effect;
   m_grayscaleEffect = makeShader(kGrayscaleShaderCode).effect;
+
+  auto blendResult = SkRuntimeEffect::MakeForBlender(SkString(kBlendShaderCode));
+  if (!blendResult.errorText.isEmpty()) {
+    LOG(ERROR, "Shader error: %s\n", blendResult.errorText.c_str());
+    std::printf("Shader error: %s\n", blendResult.errorText.c_str());
+    throw std::runtime_error("Cannot compile shaders for ShaderRenderer");
+  }
+  m_blendEffect = blendResult.effect;
+
+  auto& textureBudget = Preferences::instance().experimental.textureBudget;
+  m_textures.setBudget(size_t(textureBudget()) * 1024 * 1024);
+  m_textureBudgetConn = textureBudget.AfterChange.connect(
+    [this](const int mb){
+      m_textures.setBudget(size_t(mb) * 1024 * 1024);
+    });
 }
 
 ShaderRenderer::~ShaderRenderer() = default;
@@ -107,6 +213,11 @@ void ShaderRenderer::setRefLayersVisiblity(const bool visible)
   // TODO impl
 }
 
+void ShaderRenderer::setRefLayersLowQuality(const bool lowQuality)
+{
+  // TODO impl
+}
+
 void ShaderRenderer::setNonactiveLayersOpacity(const int opacity)
 {
   // TODO impl
@@ -114,7 +225,7 @@ void ShaderRenderer::setNonactiveLayersOpacity(const int opacity)
 
 void ShaderRenderer::setNewBlendMethod(const bool newBlend)
 {
-  // TODO impl
+  m_newBlend = newBlend;
 }
 
 void ShaderRenderer::setBgOptions(const render::BgOptions& bg)
@@ -178,6 +289,16 @@ void ShaderRenderer::disableOnionskin()
   // TODO impl
 }
 
+void ShaderRenderer::setLayerStackCache(const doc::Layer* layer)
+{
+  // TODO impl
+}
+
+void ShaderRenderer::invalidateLayerStackCache()
+{
+  // TODO impl
+}
+
 void ShaderRenderer::renderSprite(os::Surface* dstSurface,
                                   const doc::Sprite* sprite,
                                   const doc::frame_t frame,
@@ -192,6 +313,7 @@ void ShaderRenderer::renderSprite(os::Surface* dstSurface,
     m_palette.resize(256, 0);
     for (int i=0; i<srcPal->size(); ++i)
       m_palette.setEntry(i, srcPal->entry(i));
+    m_paletteImage.reset();
 
     m_bgLayer = sprite->backgroundLayer();
     if (!m_bgLayer || !m_bgLayer->isVisible()) {
@@ -216,9 +338,8 @@ void ShaderRenderer::renderSprite(os::Surface* dstSurface,
                       area.dst.y - area.src.y);
     canvas->scale(m_proj.scaleX(), m_proj.scaleY());
 
-    RenderPlan plan;
-    plan.addLayer(sprite->root(), frame);
-    renderPlan(canvas, sprite, plan, frame, area);
+    const auto plan = m_planCache.plan(sprite->root(), frame);
+    renderPlan(canvas, sprite, *plan, frame, area);
   }
   canvas->restore();
 }
@@ -241,6 +362,7 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
         if (cel) {
           const doc::Image* celImage = nullptr;
           gfx::RectF celBounds;
+          bool cacheable = false;
 
           // Is the 'm_previewImage' set to be used with this layer?
           if (m_previewImage &&
@@ -254,6 +376,7 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
           // If not, we use the original cel-image from the images' stock
           else {
             celImage = cel->image();
+            cacheable = true;
             if (layer->isReference())
               celBounds = cel->boundsF();
             else
@@ -269,7 +392,8 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
                     celBounds.x,
                     celBounds.y,
                     opacity,
-                    imgLayer->blendMode());
+                    imgLayer->blendMode(),
+                    cacheable);
         }
         break;
       }
@@ -341,7 +465,8 @@ void ShaderRenderer::renderPlan(SkCanvas* canvas,
                         tileBoundsOnCanvas.x,
                         tileBoundsOnCanvas.y,
                         opacity,
-                        tilemapLayer->blendMode());
+                        tilemapLayer->blendMode(),
+                        tileset != m_previewTileset);
             }
           }
         }
@@ -412,26 +537,20 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
                                const int x,
                                const int y,
                                const int opacity,
-                               const doc::BlendMode blendMode)
+                               const doc::BlendMode blendMode,
+                               const bool cacheable)
 {
-  auto skData = SkData::MakeWithoutCopy(
-    (const void*)srcImage->getPixelAddress(0, 0),
-    srcImage->getMemSize());
-
   switch (srcImage->colorMode()) {
 
     case doc::ColorMode::RGB: {
-      auto skImg = SkImage::MakeRasterData(
-        SkImageInfo::Make(srcImage->width(),
-                          srcImage->height(),
-                          kRGBA_8888_SkColorType,
-                          kUnpremul_SkAlphaType),
-        skData,
-        srcImage->getRowStrideSize());
+      auto skImg = makeImage(canvas, srcImage,
+                             kRGBA_8888_SkColorType,
+                             kUnpremul_SkAlphaType,
+                             cacheable);
 
       SkPaint p;
       p.setAlpha(opacity);
-      p.setBlendMode(to_skia(blendMode));
+      setPaintBlendMode(p, blendMode);
       canvas->drawImage(skImg.get(),
                         SkIntToScalar(x),
                         SkIntToScalar(y),
@@ -442,20 +561,17 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
 
     case doc::ColorMode::GRAYSCALE: {
       // We use kR8G8_unorm_SkColorType to access gray and alpha
-      auto skImg = SkImage::MakeRasterData(
-        SkImageInfo::Make(srcImage->width(),
-                          srcImage->height(),
-                          kR8G8_unorm_SkColorType,
-                          kOpaque_SkAlphaType),
-        skData,
-        srcImage->getRowStrideSize());
+      auto skImg = makeImage(canvas, srcImage,
+                             kR8G8_unorm_SkColorType,
+                             kOpaque_SkAlphaType,
+                             cacheable);
 
       SkRuntimeShaderBuilder builder(m_grayscaleEffect);
       builder.child("iImg") = skImg->makeRawShader(SkSamplingOptions(SkFilterMode::kNearest));
 
       SkPaint p;
       p.setAlpha(opacity);
-      p.setBlendMode(to_skia(blendMode));
+      setPaintBlendMode(p, blendMode);
       p.setStyle(SkPaint::kFill_Style);
       p.setShader(builder.makeShader());
 
@@ -470,34 +586,18 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
 
     case doc::ColorMode::INDEXED: {
       // We use kAlpha_8_SkColorType to access to the index value through the alpha channel
-      auto skImg = SkImage::MakeRasterData(
-        SkImageInfo::Make(srcImage->width(),
-                          srcImage->height(),
-                          kAlpha_8_SkColorType,
-                          kUnpremul_SkAlphaType),
-        skData,
-        srcImage->getRowStrideSize());
-
-      // Use the palette data as an "width x height" image where
-      // width=number of palette colors, and height=1
-      const size_t palSize = sizeof(color_t) * m_palette.size();
-      auto skPalData = SkData::MakeWithoutCopy(
-        (const void*)m_palette.rawColorsData(),
-        palSize);
-      auto skPal = SkImage::MakeRasterData(
-        SkImageInfo::Make(m_palette.size(), 1,
-                          kRGBA_8888_SkColorType,
-                          kUnpremul_SkAlphaType),
-        skPalData,
-        palSize);
+      auto skImg = makeImage(canvas, srcImage,
+                             kAlpha_8_SkColorType,
+                             kUnpremul_SkAlphaType,
+                             cacheable);
 
       SkRuntimeShaderBuilder builder(m_indexedEffect);
       builder.child("iImg") = skImg->makeRawShader(SkSamplingOptions(SkFilterMode::kNearest));
-      builder.child("iPal") = skPal->makeShader(SkSamplingOptions(SkFilterMode::kNearest));
+      builder.child("iPal") = paletteImage(canvas)->makeShader(SkSamplingOptions(SkFilterMode::kNearest));
 
       SkPaint p;
       p.setAlpha(opacity);
-      p.setBlendMode(to_skia(blendMode));
+      setPaintBlendMode(p, blendMode);
       p.setStyle(SkPaint::kFill_Style);
       p.setShader(builder.makeShader());
 
@@ -513,6 +613,82 @@ void ShaderRenderer::drawImage(SkCanvas* canvas,
   }
 }
 
+void ShaderRenderer::setPaintBlendMode(SkPaint& paint,
+                                       const doc::BlendMode blendMode)
+{
+  // Skia blend modes are equal to the new blend method
+  if (blendMode == doc::BlendMode::NORMAL ||
+      int(blendMode) < 0 ||
+      (m_newBlend && has_skia_blend_mode(blendMode))) {
+    paint.setBlendMode(to_skia(blendMode));
+    return;
+  }
+
+  sk_sp<SkBlender>& blender = m_blenders[m_newBlend ? 1: 0][int(blendMode)];
+  if (!blender) {
+    SkRuntimeBlendBuilder builder(m_blendEffect);
+    builder.uniform("iMode") = int(blendMode);
+    builder.uniform("iNewBlend") = (m_newBlend ? 1: 0);
+    blender = builder.makeBlender();
+  }
+  paint.setBlender(blender);
+}
+
+SkImage* ShaderRenderer::paletteImage(SkCanvas* canvas)
+{
+  if (!m_paletteImage) {
+    // Use the palette data as an "width x height" image where
+    // width=number of palette colors, and height=1
+    const size_t palSize = sizeof(color_t) * m_palette.size();
+    m_paletteImage = SkImage::MakeRasterCopy(
+      SkPixmap(SkImageInfo::Make(m_palette.size(), 1,
+                                 kRGBA_8888_SkColorType,
+                                 kUnpremul_SkAlphaType),
+               m_palette.rawColorsData(),
+               palSize));
+
+#if SK_SUPPORT_GPU
+    // Upload the palette to the GPU just one time for all the cels
+    if (auto context = canvas->recordingContext()) {
+      if (auto directContext = context->asDirectContext()) {
+        if (auto texture = m_paletteImage->makeTextureImage(directContext))
+          m_paletteImage = texture;
+      }
+    }
+#endif
+  }
+  return m_paletteImage.get();
+}
+
+sk_sp<SkImage> ShaderRenderer::makeImage(SkCanvas* canvas,
+                                         const doc::Image* srcImage,
+                                         const SkColorType colorType,
+                                         const SkAlphaType alphaType,
+                                         const bool cacheable)
+{
+  // Images from the sprite are uploaded to the GPU only when they
+  // change (preview images are modified without incrementing the
+  // version, so they are always used directly from memory)
+  if (cacheable) {
+    if (auto context = canvas->recordingContext()) {
+      if (auto skImg = m_textures.get(context, srcImage, colorType, alphaType))
+        return skImg;
+    }
+  }
+
+  auto skData = SkData::MakeWithoutCopy(
+    (const void*)srcImage->getPixelAddress(0, 0),
+    srcImage->getMemSize());
+
+  return SkImage::MakeRasterData(
+    SkImageInfo::Make(srcImage->width(),
+                      srcImage->height(),
+                      colorType,
+                      alphaType),
+    skData,
+    srcImage->getRowStrideSize());
+}
+
 // TODO this is equal to Render::checkIfWeShouldUsePreview(const Cel*),
 //      we might think in a way to merge both functions
 bool ShaderRenderer::checkIfWeShouldUsePreview(const doc::Cel* cel) const
@@ -540,6 +716,7 @@ void ShaderRenderer::afterBackgroundLayerIsPainted()
     // the transparent color for this specific index on transparent
     // layers.
     m_palette.setEntry(m_sprite->transparentColor(), 0);
+    m_paletteImage.reset();
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -11,17 +11,20 @@
 #if SK_ENABLE_SKSL
 
 #include "app/render/renderer.h"
+#include "app/render/texture_cache.h"
 #include "doc/palette.h"
+#include "doc/render_plan.h"
+#include "obs/connection.h"
 
 #include "include/core/SkRefCnt.h"
 
+#include <array>
+
+class SkBlender;
 class SkCanvas;
+class SkPaint;
 class SkRuntimeEffect;
 
-namespace doc {
-  class RenderPlan;
-}
-
 namespace app {
 
   // Use SkSL to compose images with Skia shaders on the CPU (with the
@@ -37,6 +40,7 @@ namespace app {
     const Properties& properties() const override { return m_properties; }
 
     void setRefLayersVisiblity(const bool visible) override;
+    void setRefLayersLowQuality(const bool lowQuality) override;
     void setNonactiveLayersOpacity(const int opacity) override;
     void setNewBlendMethod(const bool newBlend) override;
     void setBgOptions(const render::BgOptions& bg) override;
@@ -60,6 +64,9 @@ namespace app {
     void setOnionskin(const render::OnionskinOptions& options) override;
     void disableOnionskin() override;
 
+    void setLayerStackCache(const doc::Layer* layer) override;
+    void invalidateLayerStackCache() override;
+
     void renderSprite(os::Surface* dstSurface,
                       const doc::Sprite* sprite,
                       const doc::frame_t frame,
@@ -86,7 +93,16 @@ namespace app {
                    const int x,
                    const int y,
                    const int opacity,
-                   const doc::BlendMode blendMode);
+                   const doc::BlendMode blendMode,
+                   const bool cacheable);
+    void setPaintBlendMode(SkPaint& paint,
+                           const doc::BlendMode blendMode);
+    SkImage* paletteImage(SkCanvas* canvas);
+    sk_sp<SkImage> makeImage(SkCanvas* canvas,
+                             const doc::Image* srcImage,
+                             const SkColorType colorType,
+                             const SkAlphaType alphaType,
+                             const bool cacheable);
 
     bool checkIfWeShouldUsePreview(const doc::Cel* cel) const;
     void afterBackgroundLayerIsPainted();
@@ -97,6 +113,10 @@ namespace app {
     sk_sp<SkRuntimeEffect> m_bgEffect;
     sk_sp<SkRuntimeEffect> m_indexedEffect;
     sk_sp<SkRuntimeEffect> m_grayscaleEffect;
+    sk_sp<SkRuntimeEffect> m_blendEffect;
+    // Blenders for each doc::BlendMode with the old/new blend method
+    std::array<std::array<sk_sp<SkBlender>, 19>, 2> m_blenders;
+    bool m_newBlend = true;
     const doc::Sprite* m_sprite = nullptr;
     const doc::LayerImage* m_bgLayer = nullptr;
     // TODO these members are the same as in render::Render, we should
@@ -112,6 +132,14 @@ namespace app {
     // Palette of 256 colors (useful for the indexed shader to set all
     // colors outside the valid range as transparent RGBA=0 values)
     doc::Palette m_palette;
+    sk_sp<SkImage> m_paletteImage;
+
+    // Textures of the cel/tile images when we are using a GPU canvas
+    TextureCache m_textures;
+    obs::scoped_connection m_textureBudgetConn;
+
+    // Plans of the last rendered frames
+    doc::RenderPlanCache m_planCache;
   };
 
 } // namespace app
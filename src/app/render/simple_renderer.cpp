@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -12,11 +12,42 @@
 
 #include "app/ui/editor/editor_render.h"
 #include "app/util/conversion_to_surface.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/sprite.h"
+#include "doc/tag.h"
+
+#include <algorithm>
 
 namespace app {
 
 using namespace doc;
 
+namespace {
+
+bool same_onionskin_behind(const render::OnionskinOptions& a,
+                           const render::OnionskinOptions& b)
+{
+  const bool aBehind = (a.type() != render::OnionskinType::NONE &&
+                        a.position() == render::OnionskinPosition::BEHIND);
+  const bool bBehind = (b.type() != render::OnionskinType::NONE &&
+                        b.position() == render::OnionskinPosition::BEHIND);
+  if (!aBehind && !bBehind)
+    return true;
+
+  return (aBehind == bBehind &&
+          a.type() == b.type() &&
+          a.prevFrames() == b.prevFrames() &&
+          a.nextFrames() == b.nextFrames() &&
+          a.opacityBase() == b.opacityBase() &&
+          a.opacityStep() == b.opacityStep() &&
+          a.loopTag() == b.loopTag() &&
+          a.layer() == b.layer());
+}
+
+} // anonymous namespace
+
 SimpleRenderer::SimpleRenderer()
 {
   m_properties.outputsUnpremultiplied = true;
@@ -24,16 +55,37 @@ SimpleRenderer::SimpleRenderer()
 
 void SimpleRenderer::setRefLayersVisiblity(const bool visible)
 {
+  if (m_refLayersVisible != visible) {
+    m_refLayersVisible = visible;
+    invalidateLayerStackCache();
+  }
   m_render.setRefLayersVisiblity(visible);
 }
 
+void SimpleRenderer::setRefLayersLowQuality(const bool lowQuality)
+{
+  if (m_refLayersLowQuality != lowQuality) {
+    m_refLayersLowQuality = lowQuality;
+    invalidateLayerStackCache();
+  }
+  m_render.setRefLayersLowQuality(lowQuality);
+}
+
 void SimpleRenderer::setNonactiveLayersOpacity(const int opacity)
 {
+  if (m_nonactiveLayersOpacity != opacity) {
+    m_nonactiveLayersOpacity = opacity;
+    invalidateLayerStackCache();
+  }
   m_render.setNonactiveLayersOpacity(opacity);
 }
 
 void SimpleRenderer::setNewBlendMethod(const bool newBlend)
 {
+  if (m_newBlend != newBlend) {
+    m_newBlend = newBlend;
+    invalidateLayerStackCache();
+  }
   m_render.setNewBlend(newBlend);
 }
 
@@ -49,6 +101,13 @@ void SimpleRenderer::setProjection(const render::Projection& projection)
 
 void SimpleRenderer::setSelectedLayer(const doc::Layer* layer)
 {
+  // The selected layer modifies the cached layers only when the
+  // non-active layers opacity is used.
+  if (m_selectedLayer != layer) {
+    m_selectedLayer = layer;
+    if (m_nonactiveLayersOpacity != 255)
+      invalidateLayerStackCache();
+  }
   m_render.setSelectedLayer(layer);
 }
 
@@ -86,12 +145,33 @@ void SimpleRenderer::removeExtraImage()
 
 void SimpleRenderer::setOnionskin(const render::OnionskinOptions& options)
 {
+  // Compared with the options used to render the layer stack cache
+  // in updateLayerStackCache() (other editors can render the sprite
+  // with different options meanwhile).
+  m_onionskin = options;
   m_render.setOnionskin(options);
 }
 
 void SimpleRenderer::disableOnionskin()
 {
-  m_render.disableOnionskin();
+  setOnionskin(render::OnionskinOptions(render::OnionskinType::NONE));
+}
+
+void SimpleRenderer::setLayerStackCache(const doc::Layer* layer)
+{
+  // We keep the cached image when the layer is nullptr, so other
+  // editors rendering the sprite don't discard the cache of the
+  // editor where the user is painting.
+  m_stackLayer = layer;
+}
+
+void SimpleRenderer::invalidateLayerStackCache()
+{
+  m_render.removeLayersBelowCache();
+  m_stackLayer = nullptr;
+  m_stackCacheLayer = nullptr;
+  m_stackCacheFrame = -1;
+  m_stackCache.reset();
 }
 
 void SimpleRenderer::renderSprite(os::Surface* dstSurface,
@@ -102,6 +182,11 @@ void SimpleRenderer::renderSprite(os::Surface* dstSurface,
   ImageRef dstImage(Image::create(
                       IMAGE_RGB, area.size.w, area.size.h,
                       EditorRender::getRenderImageBuffer()));
+  if (m_stackLayer && m_stackLayer->sprite() == sprite)
+    updateLayerStackCache(sprite, frame);
+  else
+    m_render.removeLayersBelowCache();
+
   m_render.renderSprite(dstImage.get(), sprite, frame, area);
 
   convert_image_to_surface(dstImage.get(), sprite->palette(frame),
@@ -134,4 +219,71 @@ void SimpleRenderer::renderImage(doc::Image* dstImage,
                        x, y, opacity, blendMode);
 }
 
+void SimpleRenderer::updateLayerStackCache(const doc::Sprite* sprite,
+                                           const doc::frame_t frame)
+{
+  if (!m_stackCache ||
+      m_stackCache->size() != sprite->size()) {
+    m_stackCache.reset(Image::create(
+                         IMAGE_RGB, sprite->width(), sprite->height()));
+    m_stackCacheLayer = nullptr;
+  }
+
+  const size_t onionskinVersion = onionskinCelsVersion(sprite, frame);
+  if (m_stackCacheLayer != m_stackLayer ||
+      m_stackCacheFrame != frame ||
+      !same_onionskin_behind(m_stackCacheOnionskin, m_onionskin) ||
+      m_stackCacheOnionskinVersion != onionskinVersion) {
+    m_render.renderLayersBelow(m_stackCache.get(), sprite, frame,
+                               m_stackLayer);
+    m_stackCacheLayer = m_stackLayer;
+    m_stackCacheFrame = frame;
+    m_stackCacheOnionskin = m_onionskin;
+    m_stackCacheOnionskinVersion = onionskinVersion;
+  }
+
+  m_render.setLayersBelowCache(m_stackCacheLayer, m_stackCacheFrame,
+                               m_stackCache.get());
+}
+
+size_t SimpleRenderer::onionskinCelsVersion(const doc::Sprite* sprite,
+                                            const doc::frame_t frame) const
+{
+  if (m_onionskin.type() == render::OnionskinType::NONE ||
+      m_onionskin.position() != render::OnionskinPosition::BEHIND)
+    return 0;
+
+  // Frames that can be displayed as onion skin (the whole loop tag
+  // if the onion skin wraps around it)
+  frame_t fromFrame = frame - m_onionskin.prevFrames();
+  frame_t toFrame = frame + m_onionskin.nextFrames();
+  if (const Tag* tag = m_onionskin.loopTag()) {
+    fromFrame = std::min(fromFrame, tag->fromFrame());
+    toFrame = std::max(toFrame, tag->toFrame());
+  }
+  fromFrame = std::max(fromFrame, frame_t(0));
+  toFrame = std::min(toFrame, sprite->lastFrame());
+
+  size_t version = 0;
+  for (const Layer* layer : sprite->allLayers()) {
+    if (!layer->isImage())
+      continue;
+
+    for (frame_t f=fromFrame; f<=toFrame; ++f) {
+      if (f == frame)
+        continue;
+
+      // Only the image version is used, other changes (cels
+      // added/moved, layer properties, etc.) invalidate the cache
+      // from the Editor
+      if (const Cel* cel = layer->cel(f)) {
+        const Image* image = cel->image();
+        version ^= (size_t(image->id()) << 16) + image->version()
+          + 0x9e3779b9 + (version << 6) + (version >> 2);
+      }
+    }
+  }
+  return version;
+}
+
 } // namespace app
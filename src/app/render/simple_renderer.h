@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022-2023  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "app/render/renderer.h"
+#include "doc/image_ref.h"
 
 namespace app {
 
@@ -22,6 +23,7 @@ namespace app {
     const Properties& properties() const override { return m_properties; }
 
     void setRefLayersVisiblity(const bool visible) override;
+    void setRefLayersLowQuality(const bool lowQuality) override;
     void setNonactiveLayersOpacity(const int opacity) override;
     void setNewBlendMethod(const bool newBlend) override;
     void setBgOptions(const render::BgOptions& bg) override;
@@ -45,6 +47,9 @@ namespace app {
     void setOnionskin(const render::OnionskinOptions& options) override;
     void disableOnionskin() override;
 
+    void setLayerStackCache(const doc::Layer* layer) override;
+    void invalidateLayerStackCache() override;
+
     void renderSprite(os::Surface* dstSurface,
                       const doc::Sprite* sprite,
                       const doc::frame_t frame,
@@ -60,8 +65,35 @@ namespace app {
                      const int opacity,
                      const doc::BlendMode blendMode) override;
   private:
+    void updateLayerStackCache(const doc::Sprite* sprite,
+                               const doc::frame_t frame);
+    size_t onionskinCelsVersion(const doc::Sprite* sprite,
+                                const doc::frame_t frame) const;
+
     Properties m_properties;
     render::Render m_render;
+
+    // Settings that modify the rendered layers below the cached layer
+    bool m_refLayersVisible = false;
+    bool m_refLayersLowQuality = false;
+    int m_nonactiveLayersOpacity = 255;
+    bool m_newBlend = true;
+    const doc::Layer* m_selectedLayer = nullptr;
+    render::OnionskinOptions m_onionskin = render::OnionskinOptions(render::OnionskinType::NONE);
+
+    // Layer stack cache (layers below m_stackCacheLayer in the
+    // m_stackCacheFrame)
+    const doc::Layer* m_stackLayer = nullptr;
+    const doc::Layer* m_stackCacheLayer = nullptr;
+    doc::frame_t m_stackCacheFrame = -1;
+    doc::ImageRef m_stackCache;
+
+    // The cache includes the onion skin behind the sprite, so we have
+    // to render it again if its options change or a cel of the
+    // neighbor frames is modified (e.g. a linked cel of the active
+    // one).
+    render::OnionskinOptions m_stackCacheOnionskin = render::OnionskinOptions(render::OnionskinType::NONE);
+    size_t m_stackCacheOnionskinVersion = 0;
   };
 
 } // namespace app
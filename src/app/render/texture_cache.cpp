@@ -0,0 +1,233 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/render/texture_cache.h"
+
+#if SK_ENABLE_SKSL
+
+#include "app/memory_report.h"
+#include "doc/image.h"
+
+#include "include/core/SkPixmap.h"
+
+#if SK_SUPPORT_GPU
+  #include "include/gpu/GrRecordingContext.h"
+#endif
+
+#include <algorithm>
+#include <cstring>
+
+namespace app {
+
+namespace {
+
+// FNV-1a of the given rows of pixels (8 bytes at a time)
+uint64_t hash_rows(const uint8_t* p,
+                   const size_t rowBytes,
+                   const size_t lineSize,
+                   const int rows)
+{
+  uint64_t h = 0xcbf29ce484222325ull;
+  for (int y=0; y<rows; ++y, p+=rowBytes) {
+    size_t i = 0;
+    for (; i+8<=lineSize; i+=8) {
+      uint64_t v;
+      std::memcpy(&v, p+i, 8);
+      h = (h ^ v) * 0x100000001b3ull;
+    }
+    for (; i<lineSize; ++i)
+      h = (h ^ p[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+} // anonymous namespace
+
+TextureCache::TextureCache()
+{
+  m_memoryReportConn = MemoryReport::Collect.connect(
+    [this](MemoryReport& report){
+      report.add("GPU textures", m_memSize);
+    });
+}
+
+TextureCache::~TextureCache()
+{
+  clear();
+}
+
+void TextureCache::setBudget(const size_t bytes)
+{
+  m_budget = bytes;
+  shrink();
+}
+
+sk_sp<SkImage> TextureCache::get(GrRecordingContext* context,
+                                 const doc::Image* image,
+                                 const SkColorType colorType,
+                                 const SkAlphaType alphaType)
+{
+#if SK_SUPPORT_GPU
+  if (!context || !image)
+    return nullptr;
+
+  // Textures of other contexts cannot be used
+  if (context != m_context) {
+    clear();
+    m_context = context;
+  }
+
+  auto it = m_entries.find(image->id());
+  if (it != m_entries.end()) {
+    Entry& entry = it->second;
+
+    // Move to the front as the most recently used
+    m_lru.splice(m_lru.begin(), m_lru, entry.lruIt);
+
+    if (entry.width == image->width() &&
+        entry.height == image->height() &&
+        entry.colorType == colorType) {
+      if (entry.version != image->version()) {
+        upload(entry, image, alphaType, false);
+        entry.version = image->version();
+      }
+      return entry.surface->makeImageSnapshot();
+    }
+
+    // The image was resized/converted, the texture is re-created
+    m_memSize -= entry.memSize;
+    m_lru.erase(entry.lruIt);
+    m_entries.erase(it);
+  }
+
+  // Render targets are always premultiplied (unpremultiplied pixels
+  // are converted in writePixels())
+  const SkImageInfo info =
+    SkImageInfo::Make(image->width(), image->height(),
+                      colorType,
+                      (alphaType == kUnpremul_SkAlphaType ? kPremul_SkAlphaType:
+                                                            alphaType));
+  sk_sp<SkSurface> surface =
+    SkSurface::MakeRenderTarget(context, SkBudgeted::kYes, info);
+  if (!surface)
+    return nullptr;
+
+  m_lru.push_front(image->id());
+
+  Entry& entry = m_entries[image->id()];
+  entry.version = image->version();
+  entry.width = image->width();
+  entry.height = image->height();
+  entry.colorType = colorType;
+  entry.surface = std::move(surface);
+  entry.memSize = info.computeMinByteSize();
+  entry.lruIt = m_lru.begin();
+  upload(entry, image, alphaType, true);
+
+  m_memSize += entry.memSize;
+  shrink();
+
+  // The new texture could be deleted if it's bigger than the budget
+  it = m_entries.find(image->id());
+  if (it == m_entries.end())
+    return nullptr;
+  return it->second.surface->makeImageSnapshot();
+#else
+  return nullptr;
+#endif
+}
+
+void TextureCache::clear()
+{
+  m_entries.clear();
+  m_lru.clear();
+  m_memSize = 0;
+  m_context = nullptr;
+}
+
+void TextureCache::upload(Entry& entry,
+                          const doc::Image* image,
+                          const SkAlphaType alphaType,
+                          const bool all)
+{
+  const int w = image->width();
+  const int h = image->height();
+  const int cols = (w + kTileSize - 1) / kTileSize;
+  const int rows = (h + kTileSize - 1) / kTileSize;
+  const size_t bpp = image->getRowStrideSize(1);
+  const size_t rowBytes = image->getRowStrideSize();
+
+  if (all)
+    entry.tileHashes.resize(cols * rows);
+
+  auto writePixels = [&](const int x, const int y, const int tw, const int th) {
+    SkPixmap pixmap(
+      SkImageInfo::Make(tw, th, entry.colorType, alphaType),
+      image->getPixelAddress(x, y),
+      rowBytes);
+    entry.surface->writePixels(pixmap, x, y);
+  };
+
+  if (all)
+    writePixels(0, 0, w, h);
+
+  // Compare the hash of each tile with the previous version to
+  // upload only the modified tiles (consecutive modified tiles of
+  // the same row are uploaded at once).
+  for (int v=0; v<rows; ++v) {
+    const int y = v*kTileSize;
+    const int th = std::min(kTileSize, h-y);
+    int dirtyBegin = -1;
+
+    for (int u=0; u<=cols; ++u) {
+      bool dirty = false;
+      if (u < cols) {
+        const int x = u*kTileSize;
+        const int tw = std::min(kTileSize, w-x);
+        const uint64_t hash =
+          hash_rows((const uint8_t*)image->getPixelAddress(x, y),
+                    rowBytes, bpp*tw, th);
+        uint64_t& oldHash = entry.tileHashes[v*cols+u];
+        dirty = (oldHash != hash);
+        oldHash = hash;
+      }
+
+      if (all)
+        continue;
+
+      if (dirty) {
+        if (dirtyBegin < 0)
+          dirtyBegin = u;
+      }
+      else if (dirtyBegin >= 0) {
+        const int x = dirtyBegin*kTileSize;
+        writePixels(x, y, std::min(u*kTileSize, w) - x, th);
+        dirtyBegin = -1;
+      }
+    }
+  }
+}
+
+void TextureCache::shrink()
+{
+  while (m_budget > 0 &&
+         m_memSize > m_budget &&
+         !m_lru.empty()) {
+    auto it = m_entries.find(m_lru.back());
+    ASSERT(it != m_entries.end());
+    m_memSize -= it->second.memSize;
+    m_entries.erase(it);
+    m_lru.pop_back();
+  }
+}
+
+} // namespace app
+
+#endif // SK_ENABLE_SKSL
@@ -0,0 +1,97 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_RENDER_TEXTURE_CACHE_H_INCLUDED
+#define APP_RENDER_TEXTURE_CACHE_H_INCLUDED
+#pragma once
+
+#if SK_ENABLE_SKSL
+
+#include "base/disable_copying.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+#include "obs/connection.h"
+
+#include "include/core/SkImage.h"
+#include "include/core/SkRefCnt.h"
+#include "include/core/SkSurface.h"
+
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <vector>
+
+class GrRecordingContext;
+
+namespace doc {
+  class Image;
+}
+
+namespace app {
+
+  // GPU textures with the pixels of doc::Images used by the
+  // ShaderRenderer, so the cel images are not uploaded to the GPU
+  // each time the sprite is painted. A texture is updated when the
+  // image version changes, uploading only the tiles which pixels
+  // were modified. The least recently used textures are deleted
+  // when the budget is exceeded.
+  class TextureCache {
+  public:
+    // Size of the tiles to detect the modified regions of an image.
+    static constexpr int kTileSize = 64;
+
+    TextureCache();
+    ~TextureCache();
+
+    // Maximum number of bytes of all textures (0 = no limit).
+    void setBudget(size_t bytes);
+
+    // Returns a GPU texture with the pixels of the image, or nullptr
+    // if the texture cannot be created (e.g. raster context or
+    // unsupported color type). The image must be the one from the
+    // sprite (with the version incremented after each change), not a
+    // temporary preview image.
+    sk_sp<SkImage> get(GrRecordingContext* context,
+                       const doc::Image* image,
+                       SkColorType colorType,
+                       SkAlphaType alphaType);
+
+    void clear();
+    size_t memSize() const { return m_memSize; }
+    int size() const { return int(m_entries.size()); }
+
+  private:
+    struct Entry {
+      doc::ObjectVersion version = 0;
+      int width = 0;
+      int height = 0;
+      SkColorType colorType = kUnknown_SkColorType;
+      sk_sp<SkSurface> surface;
+      std::vector<uint64_t> tileHashes;
+      size_t memSize = 0;
+      std::list<doc::ObjectId>::iterator lruIt;
+    };
+
+    void upload(Entry& entry, const doc::Image* image,
+                SkAlphaType alphaType, bool all);
+    void shrink();
+
+    GrRecordingContext* m_context = nullptr;
+    std::unordered_map<doc::ObjectId, Entry> m_entries;
+    // From the most recently used to the least one
+    std::list<doc::ObjectId> m_lru;
+    size_t m_budget = 0;
+    size_t m_memSize = 0;
+    obs::scoped_connection m_memoryReportConn;
+
+    DISABLE_COPYING(TextureCache);
+  };
+
+} // namespace app
+
+#endif // SK_ENABLE_SKSL
+
+#endif
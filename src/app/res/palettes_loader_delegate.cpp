@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -19,11 +19,31 @@
 #include "app/resource_finder.h"
 #include "base/fs.h"
 #include "base/scoped_value.h"
+#include "base/time.h"
 #include "doc/palette.h"
 #include "ui/system.h"
 
+#include <map>
+#include <mutex>
+
 namespace app {
 
+namespace {
+
+// Palettes already loaded (e.g. the previous time the palettes
+// popup was opened), so they are parsed again only if the file was
+// modified.
+struct CachedPalette {
+  base::Time time;
+  std::size_t size;
+  std::unique_ptr<doc::Palette> palette;
+};
+
+std::mutex g_cacheMutex;
+std::map<std::string, CachedPalette> g_cache;
+
+} // anonymous namespace
+
 PalettesLoaderDelegate::PalettesLoaderDelegate()
 {
   // Necessary to load preferences in the UI-thread which will be used
@@ -63,11 +83,29 @@ void PalettesLoaderDelegate::getResourcesPaths(std::map<std::string, std::string
 Resource* PalettesLoaderDelegate::loadResource(const std::string& id,
                                                const std::string& path)
 {
+  const base::Time time = base::get_modification_time(path);
+  const std::size_t size = base::file_size(path);
+  {
+    std::lock_guard lock(g_cacheMutex);
+    auto it = g_cache.find(path);
+    if (it != g_cache.end() &&
+        it->second.time == time &&
+        it->second.size == size) {
+      return new PaletteResource(
+        id, path, std::make_unique<doc::Palette>(*it->second.palette));
+    }
+  }
+
   auto palette = load_palette(path.c_str(), &m_config);
-  if (palette)
-    return new PaletteResource(id, path, std::move(palette));
-  else
+  if (!palette)
     return nullptr;
+
+  {
+    std::lock_guard lock(g_cacheMutex);
+    g_cache[path] =
+      CachedPalette{ time, size, std::make_unique<doc::Palette>(*palette) };
+  }
+  return new PaletteResource(id, path, std::move(palette));
 }
 
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,8 +18,15 @@
 #include "base/fs.h"
 #include "base/scoped_value.h"
 
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
 namespace app {
 
+// Maximum number of threads to load resources in parallel
+static const int kMaxLoadingThreads = 4;
+
 ResourcesLoader::ResourcesLoader(std::unique_ptr<ResourcesLoaderDelegate>&& delegate)
   : m_delegate(std::move(delegate))
   , m_done(false)
@@ -67,20 +74,44 @@ void ResourcesLoader::threadLoadResources()
   // Load resources from extensions
   std::map<std::string, std::string> idAndPaths;
   m_delegate->getResourcesPaths(idAndPaths);
-  for (const auto& idAndPath : idAndPaths) {
-    if (m_cancel)
-      break;
-
-    TRACE("RESLOAD: Loading resource '%s' from '%s'...\n",
-          idAndPath.first.c_str(),
-          idAndPath.second.c_str());
-
-    Resource* resource =
-      m_delegate->loadResource(idAndPath.first,
-                               idAndPath.second);
-    if (resource)
-      m_queue.push(resource);
-  }
+
+  std::vector<const std::pair<const std::string, std::string>*> items;
+  items.reserve(idAndPaths.size());
+  for (const auto& idAndPath : idAndPaths)
+    items.push_back(&idAndPath);
+
+  // Each thread loads the next resource of the list (resources are
+  // sorted by the ResourcesListBox, so the order doesn't matter)
+  std::atomic<std::size_t> nextItem(0);
+  auto loadItems = [this, &items, &nextItem]{
+    while (!m_cancel) {
+      const std::size_t i = nextItem++;
+      if (i >= items.size())
+        break;
+
+      const auto& idAndPath = *items[i];
+      TRACE("RESLOAD: Loading resource '%s' from '%s'...\n",
+            idAndPath.first.c_str(),
+            idAndPath.second.c_str());
+
+      Resource* resource =
+        m_delegate->loadResource(idAndPath.first,
+                                 idAndPath.second);
+      if (resource)
+        m_queue.push(resource);
+    }
+  };
+
+  const int nthreads =
+    std::clamp(std::min(int(std::thread::hardware_concurrency()),
+                        int(items.size())),
+               1, kMaxLoadingThreads);
+  std::vector<std::thread> threads;
+  for (int i=1; i<nthreads; ++i)
+    threads.emplace_back(loadItems);
+  loadItems();
+  for (auto& thread : threads)
+    thread.join();
 }
 
 std::thread* ResourcesLoader::createThread()
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -19,6 +20,9 @@ namespace app {
   public:
     virtual ~ResourcesLoaderDelegate() { }
     virtual void getResourcesPaths(std::map<std::string, std::string>& idAndPath) const = 0;
+
+    // Called from several threads at the same time (each resource is
+    // loaded in a background thread).
     virtual Resource* loadResource(const std::string& id,
                                    const std::string& path) = 0;
   };
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -51,7 +51,10 @@ int Command_call(lua_State* L)
     }
   }
 
-  ctx->executeCommand(command, params);
+  {
+    app::Context::ExecutingScript executingScript(ctx);
+    ctx->executeCommand(command, params);
+  }
 
   if (ctx->commandResult().type() == CommandResult::kOk) {
     lua_pushboolean(L, true);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -9,10 +9,18 @@
 #endif
 
 #include "app/app.h"
+#include "app/doc.h"
+#include "app/file/file.h"
 #include "app/resource_finder.h"
 #include "app/script/luacpp.h"
 #include "app/script/security.h"
 #include "base/fs.h"
+#include "doc/layer.h"
+#include "doc/slice.h"
+#include "doc/sprite.h"
+#include "doc/tag.h"
+
+#include <memory>
 
 namespace app {
 namespace script {
@@ -118,6 +126,63 @@ int AppFS_listFiles(lua_State* L)
   return 1;
 }
 
+// Returns a table with the metadata of the given file (size, color
+// mode, frames, layers, tags, and slices) without decoding its
+// pixels, or nil if the file cannot be loaded.
+int AppFS_probe(lua_State* L)
+{
+  const char* fn = luaL_checkstring(L, 1);
+  const std::string absFn = base::get_absolute_path(fn);
+  if (!ask_access(L, absFn.c_str(), FileAccessMode::Read, ResourceType::File))
+    return luaL_error(L, "the script doesn't have access to read the file '%s'", fn);
+
+  std::unique_ptr<Doc> doc(
+    load_document_metadata(App::instance()->context(), absFn));
+  if (!doc) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  const doc::Sprite* sprite = doc->sprite();
+  lua_newtable(L);
+  setfield_integer(L, "width", sprite->width());
+  setfield_integer(L, "height", sprite->height());
+  setfield_integer(L, "colorMode", sprite->colorMode());
+  setfield_integer(L, "frames", sprite->totalFrames());
+
+  int i = 0;
+  lua_newtable(L);
+  for (const doc::Layer* layer : sprite->allLayers()) {
+    lua_pushstring(L, layer->name().c_str());
+    lua_seti(L, -2, ++i);
+  }
+  lua_setfield(L, -2, "layers");
+
+  i = 0;
+  lua_newtable(L);
+  for (const doc::Tag* tag : sprite->tags()) {
+    lua_newtable(L);
+    lua_pushstring(L, tag->name().c_str());
+    lua_setfield(L, -2, "name");
+    setfield_integer(L, "fromFrame", tag->fromFrame()+1);
+    setfield_integer(L, "toFrame", tag->toFrame()+1);
+    setfield_integer(L, "aniDir", tag->aniDir());
+    lua_seti(L, -2, ++i);
+  }
+  lua_setfield(L, -2, "tags");
+
+  i = 0;
+  lua_newtable(L);
+  for (const doc::Slice* slice : sprite->slices()) {
+    lua_pushstring(L, slice->name().c_str());
+    lua_seti(L, -2, ++i);
+  }
+  lua_setfield(L, -2, "slices");
+
+  doc->close();
+  return 1;
+}
+
 int AppFS_makeDirectory(lua_State* L)
 {
   const char* path = luaL_checkstring(L, 1);
@@ -208,6 +273,7 @@ const luaL_Reg AppFS_methods[] = {
   { "isDirectory", AppFS_isDirectory },
   { "fileSize", AppFS_fileSize },
   { "listFiles", AppFS_listFiles },
+  { "probe", AppFS_probe },
   // Manipulate directories
   { "makeDirectory", AppFS_makeDirectory },
   { "makeAllDirectories", AppFS_makeAllDirectories },
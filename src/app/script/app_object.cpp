@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "app/i18n/strings.h"
 #include "app/inline_command_execution.h"
 #include "app/loop_tag.h"
+#include "app/memory_report.h"
 #include "app/modules/palettes.h"
 #include "app/pref/preferences.h"
 #include "app/script/api_version.h"
@@ -44,6 +45,7 @@
 #include "doc/layer.h"
 #include "doc/primitives.h"
 #include "doc/tag.h"
+#include "fmt/format.h"
 #include "render/render.h"
 #include "ui/alert.h"
 #include "ui/scale.h"
@@ -51,12 +53,14 @@
 
 #include <cstring>
 #include <iostream>
+#include <optional>
 
 namespace app {
 namespace script {
 
 int load_sprite_from_file(lua_State* L, const char* filename,
-                          const LoadSpriteFromFileParam param)
+                          const LoadSpriteFromFileParam param,
+                          const Params& extraParams)
 {
   std::string absFn = base::get_absolute_path(filename);
   if (!ask_access(L, absFn.c_str(), FileAccessMode::Read, ResourceType::File))
@@ -68,7 +72,7 @@ int load_sprite_from_file(lua_State* L, const char* filename,
 
   Command* openCommand =
     Commands::instance()->byId(CommandId::OpenFile());
-  Params params;
+  Params params = extraParams;
   params.set("filename", absFn.c_str());
   if (param == LoadSpriteFromFileParam::OneFrameAsSprite ||
       param == LoadSpriteFromFileParam::OneFrameAsImage)
@@ -115,8 +119,34 @@ namespace {
 
 int App_open(lua_State* L)
 {
+  const char* filename = luaL_checkstring(L, 1);
+
+  // app.open(filename, { bounds=Rectangle, fromFrame=1, toFrame=n })
+  // to load only a region of interest of the file
+  Params params;
+  if (lua_istable(L, 2)) {
+    int type = lua_getfield(L, 2, "bounds");
+    if (VALID_LUATYPE(type)) {
+      const gfx::Rect rc = convert_args_into_rect(L, -1);
+      if (!rc.isEmpty())
+        params.set("bounds", fmt::format("{},{},{},{}",
+                                         rc.x, rc.y, rc.w, rc.h).c_str());
+    }
+    lua_pop(L, 1);
+
+    type = lua_getfield(L, 2, "fromFrame");
+    if (type != LUA_TNIL)
+      params.set("fromFrame", fmt::format("{}", get_frame_number_from_arg(L, -1)).c_str());
+    lua_pop(L, 1);
+
+    type = lua_getfield(L, 2, "toFrame");
+    if (type != LUA_TNIL)
+      params.set("toFrame", fmt::format("{}", get_frame_number_from_arg(L, -1)).c_str());
+    lua_pop(L, 1);
+  }
+
   return load_sprite_from_file(
-    L, luaL_checkstring(L, 1), LoadSpriteFromFileParam::FullAniAsSprite);
+    L, filename, LoadSpriteFromFileParam::FullAniAsSprite, params);
 }
 
 int App_exit(lua_State* L)
@@ -151,6 +181,14 @@ int App_transaction(lua_State* L)
   }
 
   if (lua_isfunction(L, index)) {
+    // Notifications of the active document are delivered when the
+    // transaction ends (e.g. to redraw the editors only once after a
+    // loop that modifies all cels).
+    std::optional<Doc::NotificationsBatch> batch;
+    app::Context* ctx = App::instance()->context();
+    if (Doc* doc = (ctx ? ctx->activeDocument(): nullptr))
+      batch.emplace(doc);
+
     Tx tx(label); // Create a new transaction so it exists in the whole
                   // duration of the argument function call.
 
@@ -465,13 +503,23 @@ int App_useTool(lua_State* L)
     while (lua_next(L, -2) != 0) {
       gfx::Point pt = convert_args_into_point(L, -1);
 
+      // Optional pressure of each point (e.g. from strokes recorded
+      // with --record-strokes)
+      float pressure = 0.0f;
+      if (lua_istable(L, -1)) {
+        if (lua_getfield(L, -1, "pressure") != LUA_TNIL)
+          pressure = float(lua_tonumber(L, -1));
+        lua_pop(L, 1);
+      }
+
       tools::Pointer pointer(
         pt,
         // TODO configurable params
         tools::Vec2(0.0f, 0.0f),
         tools::Pointer::Button::Left,
-        tools::Pointer::Type::Unknown,
-        0.0f);
+        (pressure > 0.0f ? tools::Pointer::Type::Pen:
+                           tools::Pointer::Type::Unknown),
+        pressure);
       if (first) {
         first = false;
         manager.prepareLoop(pointer);
@@ -700,6 +748,41 @@ int App_get_defaultPalette(lua_State* L)
   return 1;
 }
 
+int App_get_memory(lua_State* L)
+{
+  const MemoryReport report =
+    create_memory_report(App::instance()->context());
+
+  // setfield_integer() uses int, and sizes can be bigger than 2GB
+  auto setfield_size = [L](const char* key, const size_t bytes) {
+    lua_pushinteger(L, lua_Integer(bytes));
+    lua_setfield(L, -2, key);
+  };
+
+  lua_newtable(L);
+  setfield_size("total", report.total());
+
+  lua_newtable(L);
+  int i = 0;
+  for (const MemoryReport::DocUsage& doc : report.docs) {
+    lua_newtable(L);
+    lua_pushstring(L, doc.name.c_str());
+    lua_setfield(L, -2, "name");
+    setfield_size("images", doc.images);
+    setfield_size("tilesets", doc.tilesets);
+    setfield_size("undo", doc.undo);
+    setfield_size("total", doc.total());
+    lua_seti(L, -2, ++i);
+  }
+  lua_setfield(L, -2, "documents");
+
+  lua_newtable(L);
+  for (const MemoryReport::Subsystem& subsystem : report.subsystems)
+    setfield_size(subsystem.name.c_str(), subsystem.bytes);
+  lua_setfield(L, -2, "subsystems");
+  return 1;
+}
+
 int App_set_sprite(lua_State* L)
 {
   auto sprite = may_get_docobj<Sprite>(L, 2);
@@ -818,6 +901,7 @@ const Property App_properties[] = {
   { "theme",          App_get_theme,          nullptr },
   { "uiScale",        App_get_uiScale,        nullptr },
   { "editor",         App_get_editor,         nullptr },
+  { "memory",         App_get_memory,         nullptr },
   { nullptr,          nullptr,                nullptr }
 };
 
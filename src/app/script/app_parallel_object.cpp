@@ -0,0 +1,194 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/docobj.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "sched/task_group.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// Rows of an image processed by each task
+constexpr int kRowsPerTask = 64;
+
+typedef std::unordered_map<doc::color_t, doc::color_t> ColorMap;
+
+struct AppParallel { };
+
+// Returns the list of images from a table of Image or Cel objects
+// (each image is included just one time).
+std::vector<doc::Image*> get_images_from_table(lua_State* L, const int index)
+{
+  luaL_checktype(L, index, LUA_TTABLE);
+
+  std::vector<doc::Image*> images;
+  const int n = int(luaL_len(L, index));
+  for (int i=1; i<=n; ++i) {
+    lua_geti(L, index, i);
+
+    doc::Image* image = may_get_image_from_arg(L, -1);
+    if (!image) {
+      if (auto cel = may_get_docobj<doc::Cel>(L, -1))
+        image = cel->image();
+    }
+    if (!image)
+      luaL_error(L, "element %d is not an Image or a Cel", i);
+    lua_pop(L, 1);
+
+    if (std::find(images.begin(), images.end(), image) == images.end())
+      images.push_back(image);
+  }
+  return images;
+}
+
+// Converts a Lua table { [oldPixel]=newPixel, ... } to a ColorMap
+ColorMap get_color_map_from_table(lua_State* L, const int index)
+{
+  luaL_checktype(L, index, LUA_TTABLE);
+
+  ColorMap map;
+  lua_pushnil(L);
+  while (lua_next(L, index) != 0) {
+    if (lua_isinteger(L, -2) && lua_isinteger(L, -1)) {
+      map[doc::color_t(lua_tointeger(L, -2))] =
+        doc::color_t(lua_tointeger(L, -1));
+    }
+    lua_pop(L, 1);               // Pop the value, keep the key
+  }
+  return map;
+}
+
+template<typename T>
+void remap_rows(doc::Image* image, const int y1, const int y2,
+                const ColorMap& map)
+{
+  const int w = image->width();
+  for (int y=y1; y<y2; ++y) {
+    T* p = (T*)image->getPixelAddress(0, y);
+    for (int x=0; x<w; ++x, ++p) {
+      auto it = map.find(*p);
+      if (it != map.end())
+        *p = T(it->second);
+    }
+  }
+}
+
+// Specialization for 8-bit images with a 256 entries table
+template<>
+void remap_rows<uint8_t>(doc::Image* image, const int y1, const int y2,
+                         const ColorMap& map)
+{
+  std::array<uint8_t, 256> lut;
+  for (int i=0; i<256; ++i) {
+    auto it = map.find(i);
+    lut[i] = uint8_t(it != map.end() ? it->second: i);
+  }
+
+  const int w = image->width();
+  for (int y=y1; y<y2; ++y) {
+    uint8_t* p = image->getPixelAddress(0, y);
+    for (int x=0; x<w; ++x, ++p)
+      *p = lut[*p];
+  }
+}
+
+// Remaps the pixels of all images using worker threads (the Lua
+// state is not accessed from the tasks).
+void remap_images(lua_State* L,
+                  const std::vector<doc::Image*>& images,
+                  const ColorMap& map)
+{
+  if (map.empty())
+    return;
+
+  typedef void (*RemapFunc)(doc::Image*, int, int, const ColorMap&);
+  std::vector<RemapFunc> funcs(images.size(), nullptr);
+  for (size_t i=0; i<images.size(); ++i) {
+    switch (images[i]->getRowStrideSize(1)) {
+      case 1: funcs[i] = remap_rows<uint8_t>; break;
+      case 2: funcs[i] = remap_rows<uint16_t>; break;
+      case 4: funcs[i] = remap_rows<uint32_t>; break;
+      default:
+        luaL_error(L, "unsupported image format");
+        return;
+    }
+  }
+
+  sched::TaskGroup tasks(sched::Priority::Interactive);
+  for (size_t i=0; i<images.size(); ++i) {
+    doc::Image* image = images[i];
+    RemapFunc func = funcs[i];
+    for (int y=0; y<image->height(); y+=kRowsPerTask) {
+      const int y2 = std::min(y+kRowsPerTask, image->height());
+      tasks.run([func, image, y, y2, &map]{
+        func(image, y, y2, map);
+      });
+    }
+  }
+  tasks.wait();
+
+  for (doc::Image* image : images)
+    image->incrementVersion();
+}
+
+// app.parallel.remap({ images or cels... }, { [oldPixel]=newPixel, ... })
+int AppParallel_remap(lua_State* L)
+{
+  const std::vector<doc::Image*> images = get_images_from_table(L, 1);
+  const ColorMap map = get_color_map_from_table(L, 2);
+  remap_images(L, images, map);
+  return 0;
+}
+
+// app.parallel.replaceColor({ images or cels... }, oldPixel, newPixel)
+int AppParallel_replaceColor(lua_State* L)
+{
+  const std::vector<doc::Image*> images = get_images_from_table(L, 1);
+  ColorMap map;
+  map[doc::color_t(luaL_checkinteger(L, 2))] =
+    doc::color_t(luaL_checkinteger(L, 3));
+  remap_images(L, images, map);
+  return 0;
+}
+
+const luaL_Reg AppParallel_methods[] = {
+  { "remap", AppParallel_remap },
+  { "replaceColor", AppParallel_replaceColor },
+  { nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(AppParallel);
+
+void register_app_parallel_object(lua_State* L)
+{
+  REG_CLASS(L, AppParallel);
+
+  lua_getglobal(L, "app");
+  lua_pushstring(L, "parallel");
+  push_new<AppParallel>(L);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+} // namespace script
+} // namespace app
@@ -0,0 +1,104 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/app.h"
+#include "app/script/engine.h"
+#include "app/script/luacpp.h"
+#include "app/script/profiler.h"
+
+#include <sstream>
+
+namespace app {
+namespace script {
+
+namespace {
+
+struct AppProfiler { };
+
+Profiler* get_profiler()
+{
+  return App::instance()->scriptEngine()->profiler();
+}
+
+void push_report(lua_State* L, const Profiler* profiler)
+{
+  std::ostringstream os;
+  profiler->writeReport(os);
+  lua_pushstring(L, os.str().c_str());
+}
+
+// app.profiler.start()
+int AppProfiler_start(lua_State* L)
+{
+  get_profiler()->start();
+  return 0;
+}
+
+// app.profiler.stop() returns the report as a string, so it can be
+// printed in the developer console
+int AppProfiler_stop(lua_State* L)
+{
+  Profiler* profiler = get_profiler();
+  profiler->stop();
+  push_report(L, profiler);
+  return 1;
+}
+
+// app.profiler.clear()
+int AppProfiler_clear(lua_State* L)
+{
+  get_profiler()->clear();
+  return 0;
+}
+
+// app.profiler.report()
+int AppProfiler_report(lua_State* L)
+{
+  push_report(L, get_profiler());
+  return 1;
+}
+
+int AppProfiler_get_isRunning(lua_State* L)
+{
+  lua_pushboolean(L, get_profiler()->isRunning());
+  return 1;
+}
+
+const luaL_Reg AppProfiler_methods[] = {
+  { "start", AppProfiler_start },
+  { "stop", AppProfiler_stop },
+  { "clear", AppProfiler_clear },
+  { "report", AppProfiler_report },
+  { nullptr, nullptr }
+};
+
+const Property AppProfiler_properties[] = {
+  { "isRunning", AppProfiler_get_isRunning, nullptr },
+  { nullptr, nullptr, nullptr }
+};
+
+} // anonymous namespace
+
+DEF_MTNAME(AppProfiler);
+
+void register_app_profiler_object(lua_State* L)
+{
+  REG_CLASS(L, AppProfiler);
+  REG_CLASS_PROPERTIES(L, AppProfiler);
+
+  lua_getglobal(L, "app");
+  lua_pushstring(L, "profiler");
+  push_new<AppProfiler>(L);
+  lua_rawset(L, -3);
+  lua_pop(L, 1);
+}
+
+} // namespace script
+} // namespace app
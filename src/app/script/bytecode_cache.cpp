@@ -0,0 +1,161 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/bytecode_cache.h"
+
+#include "app/resource_finder.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+#include "base/log.h"
+#include "base/serialization.h"
+#include "base/time.h"
+#include "doc/string_io.h"
+
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <vector>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// Magic number of each cached chunk (increase the last number if the
+// format changes)
+constexpr uint32_t kMagic = 0x41454C31; // "AEL1"
+
+std::string cache_filename(const std::string& absFilename)
+{
+  static std::string dir;
+  if (dir.empty()) {
+    ResourceFinder rf;
+    rf.includeUserDir(base::join_path(base::join_path("cache", "scripts"), ".").c_str());
+    dir = base::get_file_path(rf.getFirstOrCreateDefault());
+  }
+
+  char buf[32];
+  std::snprintf(buf, sizeof(buf), "%016llx.luac",
+                (unsigned long long)std::hash<std::string>()(absFilename));
+  return base::join_path(dir, buf);
+}
+
+// Header of a cached chunk, the chunk is valid only if the whole
+// header matches the script file
+struct Header {
+  std::string filename;
+  uint32_t luaVersion = 0;
+  uint32_t size = 0;
+  base::Time time;
+
+  void write(std::ostream& os) const {
+    using namespace base::serialization::little_endian;
+    write32(os, kMagic);
+    write32(os, luaVersion);
+    doc::write_string(os, filename);
+    write32(os, size);
+    write16(os, time.year);
+    write8(os, time.month);
+    write8(os, time.day);
+    write8(os, time.hour);
+    write8(os, time.minute);
+    write8(os, time.second);
+  }
+
+  bool read(std::istream& is) {
+    using namespace base::serialization::little_endian;
+    if (read32(is) != kMagic)
+      return false;
+    luaVersion = read32(is);
+    filename = doc::read_string(is);
+    size = read32(is);
+    time.year = read16(is);
+    time.month = read8(is);
+    time.day = read8(is);
+    time.hour = read8(is);
+    time.minute = read8(is);
+    time.second = read8(is);
+    return is.good();
+  }
+
+  bool operator==(const Header& other) const {
+    return (filename == other.filename &&
+            luaVersion == other.luaVersion &&
+            size == other.size &&
+            time == other.time);
+  }
+};
+
+} // anonymous namespace
+
+int load_script_with_cache(lua_State* L,
+                           const std::string& absFilename,
+                           const std::string& code)
+{
+  const std::string chunkname = "@" + absFilename;
+
+  Header header;
+  header.filename = absFilename;
+  header.luaVersion = LUA_VERSION_NUM;
+  header.size = uint32_t(code.size());
+  header.time = base::get_modification_time(absFilename);
+
+  std::string cacheFn;
+  try {
+    cacheFn = cache_filename(absFilename);
+  }
+  catch (const std::exception& ex) {
+    LOG(ERROR, "SCRIPT: Cannot create bytecode cache folder: %s\n", ex.what());
+    return luaL_loadbuffer(L, code.c_str(), code.size(), chunkname.c_str());
+  }
+
+  // Load the precompiled chunk (only binary chunks are accepted)
+  if (base::is_file(cacheFn)) {
+    std::ifstream is(FSTREAM_PATH(cacheFn), std::ifstream::binary);
+    Header cached;
+    if (cached.read(is) && cached == header) {
+      const std::vector<char> bytecode((std::istreambuf_iterator<char>(is)),
+                                       std::istreambuf_iterator<char>());
+      if (!bytecode.empty() &&
+          luaL_loadbufferx(L, bytecode.data(), bytecode.size(),
+                           chunkname.c_str(), "b") == LUA_OK) {
+        return LUA_OK;
+      }
+      lua_pop(L, 1);  // Pop the error (the chunk is compiled again)
+    }
+  }
+
+  const int result = luaL_loadbuffer(L, code.c_str(), code.size(),
+                                     chunkname.c_str());
+  if (result != LUA_OK)
+    return result;
+
+  // Save the compiled chunk (with debug info, so error messages keep
+  // the same file names and line numbers)
+  std::ofstream os(FSTREAM_PATH(cacheFn), std::ofstream::binary);
+  if (os) {
+    header.write(os);
+    lua_dump(L,
+             [](lua_State*, const void* p, size_t sz, void* ud) -> int {
+               auto os = static_cast<std::ofstream*>(ud);
+               os->write(static_cast<const char*>(p), sz);
+               return (os->good() ? 0: 1);
+             }, &os, 0);
+    if (!os.good()) {
+      os.close();
+      base::delete_file(cacheFn);
+    }
+  }
+  return LUA_OK;
+}
+
+} // namespace script
+} // namespace app
@@ -0,0 +1,30 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SCRIPT_BYTECODE_CACHE_H_INCLUDED
+#define APP_SCRIPT_BYTECODE_CACHE_H_INCLUDED
+#pragma once
+
+#include "app/script/luacpp.h"
+
+#include <string>
+
+namespace app {
+namespace script {
+
+// Loads the given script file (its source code is in "code") as a
+// Lua chunk on the top of the stack. The precompiled chunk is saved
+// in the user folder (cache/scripts/) and reused in the next
+// executions while the file isn't modified. Returns the same values
+// as luaL_loadbuffer().
+int load_script_with_cache(lua_State* L,
+                           const std::string& absFilename,
+                           const std::string& code);
+
+} // namespace script
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,7 +17,9 @@
 #include "app/doc_range.h"
 #include "app/pref/preferences.h"
 #include "app/script/blend_mode.h"
+#include "app/script/bytecode_cache.h"
 #include "app/script/luacpp.h"
+#include "app/script/profiler.h"
 #include "app/script/require.h"
 #include "app/script/security.h"
 #include "app/sprite_sheet_type.h"
@@ -152,6 +154,8 @@ int unsupported(lua_State* L)
 void register_app_object(lua_State* L);
 void register_app_pixel_color_object(lua_State* L);
 void register_app_fs_object(lua_State* L);
+void register_app_parallel_object(lua_State* L);
+void register_app_profiler_object(lua_State* L);
 void register_app_command_object(lua_State* L);
 void register_app_preferences_object(lua_State* L);
 
@@ -259,6 +263,8 @@ Engine::Engine()
   register_app_object(L);
   register_app_pixel_color_object(L);
   register_app_fs_object(L);
+  register_app_parallel_object(L);
+  register_app_profiler_object(L);
   register_app_command_object(L);
   register_app_preferences_object(L);
 
@@ -520,6 +526,7 @@ void Engine::destroy()
 #ifdef ENABLE_UI
   close_all_dialogs();
 #endif
+  m_profiler.reset();
   lua_close(L);
   L = nullptr;
 }
@@ -531,10 +538,16 @@ void Engine::printLastResult()
 
 bool Engine::evalCode(const std::string& code,
                       const std::string& filename)
+{
+  return evalChunk(
+    luaL_loadbuffer(L, code.c_str(), code.size(), filename.c_str()));
+}
+
+bool Engine::evalChunk(const int loadResult)
 {
   bool ok = true;
   try {
-    if (luaL_loadbuffer(L, code.c_str(), code.size(), filename.c_str()) ||
+    if (loadResult != LUA_OK ||
         lua_pcall(L, 0, 1, 0)) {
       const char* s = lua_tostring(L, -1);
       if (s)
@@ -590,7 +603,12 @@ bool Engine::evalFile(const std::string& filename,
   if (g_debuggerDelegate)
     g_debuggerDelegate->startFile(absFilename, buf.str());
 
-  bool result = evalCode(buf.str(), "@" + absFilename);
+  bool result;
+  // The debugger needs the source code of each line
+  if (g_debuggerDelegate)
+    result = evalCode(buf.str(), "@" + absFilename);
+  else
+    result = evalChunk(load_script_with_cache(L, absFilename, buf.str()));
 
   if (g_debuggerDelegate)
     g_debuggerDelegate->endFile(absFilename);
@@ -612,6 +630,10 @@ bool Engine::evalUserFile(const std::string& filename,
 
 void Engine::startDebugger(DebuggerDelegate* debuggerDelegate)
 {
+  // The profiler uses the same Lua hook
+  if (m_profiler)
+    m_profiler->stop();
+
   g_debuggerDelegate = debuggerDelegate;
 
   lua_Hook hook = [](lua_State* L, lua_Debug* ar) {
@@ -630,6 +652,13 @@ void Engine::stopDebugger()
   lua_sethook(L, nullptr, 0, 0);
 }
 
+Profiler* Engine::profiler()
+{
+  if (!m_profiler)
+    m_profiler = std::make_unique<Profiler>(L);
+  return m_profiler.get();
+}
+
 void Engine::onConsoleError(const char* text)
 {
   if (text && m_delegate)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,6 +27,7 @@
 #include <cstdio>
 #include <functional>
 #include <map>
+#include <memory>
 #include <string>
 
 struct lua_State;
@@ -65,6 +66,8 @@ namespace app {
 
   namespace script {
 
+  class Profiler;
+
   class EngineDelegate {
   public:
     virtual ~EngineDelegate() { }
@@ -114,7 +117,14 @@ namespace app {
     void startDebugger(DebuggerDelegate* debuggerDelegate);
     void stopDebugger();
 
+    // Profiler of the Lua code executed by this engine (created the
+    // first time it's requested).
+    Profiler* profiler();
+
   private:
+    // Runs the chunk loaded on the top of the stack (or prints the
+    // error if loadResult isn't LUA_OK)
+    bool evalChunk(const int loadResult);
     void onConsoleError(const char* text);
     void onConsolePrint(const char* text);
 
@@ -122,6 +132,7 @@ namespace app {
     EngineDelegate* m_delegate;
     bool m_printLastResult;
     int m_returnCode;
+    std::unique_ptr<Profiler> m_profiler;
   };
 
   class ScopedEngineDelegate {
@@ -142,6 +153,7 @@ namespace app {
   void push_app_events(lua_State* L);
   void push_app_theme(lua_State* L, int uiscale = 1);
   int push_image_iterator_function(lua_State* L, const doc::Image* image, int extraArgIndex);
+  int push_image_rows_function(lua_State* L, const doc::Image* image, int extraArgIndex);
   void push_brush(lua_State* L, const doc::BrushRef& brush);
   void push_cel_image(lua_State* L, doc::Cel* cel);
   void push_cel_images(lua_State* L, const doc::ObjectIds& cels);
@@ -199,7 +211,8 @@ namespace app {
                                        OneFrameAsSprite,
                                        OneFrameAsImage };
   int load_sprite_from_file(lua_State* L, const char* filename,
-                            const LoadSpriteFromFileParam param);
+                            const LoadSpriteFromFileParam param,
+                            const Params& extraParams = Params());
 
 #ifdef ENABLE_UI
   // close all opened Dialogs before closing the UI
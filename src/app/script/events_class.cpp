@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021-2023  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -25,12 +25,18 @@
 #include "doc/document.h"
 #include "doc/sprite.h"
 #include "ui/app_state.h"
+#include "ui/manager.h"
+#include "ui/timer.h"
 
+#include <algorithm>
 #include <any>
 #include <cstring>
 #include <initializer_list>
 #include <map>
 #include <memory>
+#include <string>
+#include <utility>
+#include <vector>
 
 // This event was disabled because it can be triggered in a background thread
 // when any effect (e.g. like Replace Color or Convolution Matrix) is running.
@@ -51,9 +57,23 @@ class SpriteEvents;
 static std::unique_ptr<AppEvents> g_appEvents;
 static std::map<doc::ObjectId, std::unique_ptr<SpriteEvents>> g_spriteEvents;
 
+// Options given to Events:on() in its third argument
+struct ListenerOptions {
+  // Merge several events in just one call (delivered when the UI is
+  // idle) with the arguments of the last event and the number of
+  // merged events in "ev.count"
+  bool coalesce = false;
+  // Max number of calls per second (0 = unlimited), the events that
+  // are generated in the meantime are merged
+  int maxRate = 0;
+
+  bool isDeferred() const { return coalesce || maxRate > 0; }
+};
+
 class Events {
 public:
   using EventType = int;
+  using EventArgs = std::initializer_list<std::pair<const std::string, std::any>>;
 
   Events() { }
   virtual ~Events() { }
@@ -62,6 +82,11 @@ public:
 
   virtual EventType eventType(const char* eventName) const = 0;
 
+  // Returns true if the given event can be delivered later to
+  // listeners that use ListenerOptions (i.e. C++ code doesn't expect
+  // the listener to be called immediately, e.g. to cancel a command)
+  virtual bool canDefer(EventType eventType) const { return true; }
+
   bool hasListener(EventListener callbackRef) const {
     for (auto& listeners : m_listeners) {
       for (EventListener listener : listeners) {
@@ -72,10 +97,21 @@ public:
     return false;
   }
 
-  void add(EventType eventType, EventListener callbackRef) {
+  void add(EventType eventType, EventListener callbackRef,
+           const ListenerOptions& options = ListenerOptions()) {
     if (eventType >= m_listeners.size())
       m_listeners.resize(eventType+1);
 
+    // Deferred listeners need the UI loop (timers), in other case
+    // (e.g. running a script from the CLI) events are delivered
+    // immediately
+    if (options.isDeferred() &&
+        canDefer(eventType) &&
+        ui::Manager::getDefault()) {
+      auto& deferred = m_deferred[callbackRef];
+      deferred.options = options;
+    }
+
     auto& listeners = m_listeners[eventType];
     listeners.push_back(callbackRef);
     if (listeners.size() == 1)
@@ -83,6 +119,8 @@ public:
   }
 
   void remove(EventListener callbackRef) {
+    m_deferred.erase(callbackRef);
+
     for (int i=0; i<int(m_listeners.size()); ++i) {
       EventListeners& listeners = m_listeners[i];
       auto it = listeners.begin();
@@ -103,8 +141,7 @@ public:
   }
 
 protected:
-  void call(EventType eventType,
-            const std::initializer_list<std::pair<const std::string, std::any>>& args = {}) {
+  void call(EventType eventType, const EventArgs& args = {}) {
     if (eventType >= m_listeners.size())
       return;
 
@@ -113,23 +150,13 @@ protected:
 
     try {
       for (EventListener callbackRef : m_listeners[eventType]) {
-        // Get user-defined callback function
-        lua_rawgeti(L, LUA_REGISTRYINDEX, callbackRef);
-
-        int callbackArgs = 0;
-        if (args.size() > 0) {
-          ++callbackArgs;
-          lua_newtable(L);       // Create "ev" argument with fields about the event
-          for (const auto& kv : args) {
-            push_value_to_lua(L, kv.second);
-            lua_setfield(L, -2, kv.first.c_str());
-          }
+        auto it = m_deferred.find(callbackRef);
+        if (it != m_deferred.end()) {
+          defer(it->second, args);
+          continue;
         }
 
-        if (lua_pcall(L, callbackArgs, 0, 0)) {
-          if (const char* s = lua_tostring(L, -1))
-            engine->consolePrint(s);
-        }
+        callListener(L, engine, callbackRef, args.begin(), args.end());
       }
     }
     catch (const std::exception& ex) {
@@ -141,8 +168,117 @@ private:
   virtual void onAddFirstListener(EventType eventType) = 0;
   virtual void onRemoveLastListener(EventType eventType) = 0;
 
+  // Events received by a listener with ListenerOptions that weren't
+  // delivered yet
+  struct Deferred {
+    ListenerOptions options;
+    std::vector<std::pair<std::string, std::any>> args; // Arguments of the last event
+    int count = 0;                                        // Number of merged events
+    base::tick_t lastCall = 0;
+
+    base::tick_t minInterval() const {
+      return (options.maxRate > 0 ? 1000 / options.maxRate: 0);
+    }
+  };
+
+  template<typename It>
+  static void callListener(lua_State* L,
+                           script::Engine* engine,
+                           const EventListener callbackRef,
+                           It argsBegin, It argsEnd,
+                           const int count = 0) {
+    // Get user-defined callback function
+    lua_rawgeti(L, LUA_REGISTRYINDEX, callbackRef);
+
+    int callbackArgs = 0;
+    if (argsBegin != argsEnd || count > 0) {
+      ++callbackArgs;
+      lua_newtable(L);       // Create "ev" argument with fields about the event
+      for (It it=argsBegin; it != argsEnd; ++it) {
+        push_value_to_lua(L, it->second);
+        lua_setfield(L, -2, it->first.c_str());
+      }
+      if (count > 0) {
+        lua_pushinteger(L, count);
+        lua_setfield(L, -2, "count");
+      }
+    }
+
+    if (lua_pcall(L, callbackArgs, 0, 0)) {
+      if (const char* s = lua_tostring(L, -1))
+        engine->consolePrint(s);
+    }
+  }
+
+  void defer(Deferred& deferred, const EventArgs& args) {
+    deferred.args.assign(args.begin(), args.end());
+    ++deferred.count;
+
+    if (!m_timer) {
+      m_timer = std::make_unique<ui::Timer>(kDeferredInterval);
+      m_timer->Tick.connect([this]{ onDeliverDeferred(); });
+    }
+    if (!m_timer->isRunning())
+      m_timer->start();
+  }
+
+  // Called from the UI loop to deliver the merged events
+  void onDeliverDeferred() {
+    script::Engine* engine = App::instance()->scriptEngine();
+    lua_State* L = engine->luaState();
+    const base::tick_t now = base::current_tick();
+
+    // Listeners can be removed from the callbacks, so we work with a
+    // list of references and look for each one before calling it
+    std::vector<EventListener> refs;
+    for (const auto& pair : m_deferred) {
+      if (pair.second.count > 0)
+        refs.push_back(pair.first);
+    }
+
+    bool pending = false;
+    for (const EventListener callbackRef : refs) {
+      auto it = m_deferred.find(callbackRef);
+      if (it == m_deferred.end())
+        continue;
+
+      Deferred& deferred = it->second;
+      if (now - deferred.lastCall < deferred.minInterval()) {
+        pending = true;
+        continue;
+      }
+
+      const auto args = std::move(deferred.args);
+      const int count = deferred.count;
+      deferred.args.clear();
+      deferred.count = 0;
+      deferred.lastCall = now;
+
+      try {
+        callListener(L, engine, callbackRef, args.begin(), args.end(), count);
+      }
+      catch (const std::exception& ex) {
+        engine->consolePrint(ex.what());
+      }
+    }
+
+    // Events generated from the callbacks
+    for (const auto& pair : m_deferred) {
+      if (pair.second.count > 0)
+        pending = true;
+    }
+
+    if (!pending && m_timer)
+      m_timer->stop();
+  }
+
+  // Interval to check deferred events (the UI loop is idle)
+  static constexpr int kDeferredInterval = 1;
+
   using EventListeners = std::vector<EventListener>;
   std::vector<EventListeners> m_listeners;
+  std::map<EventListener, Deferred> m_deferred;
+  std::unique_ptr<ui::Timer> m_timer;
 };
 
 // Used in BeforeCommand
@@ -181,6 +317,13 @@ public:
       return Unknown;
   }
 
+  bool canDefer(EventType eventType) const override {
+    // These events must be handled before continuing (e.g. to stop
+    // the command propagation or to paint the tilemap)
+    return (eventType != BeforeCommand &&
+            eventType != BeforePaintEmptyTilemap);
+  }
+
 private:
 
   void onAddFirstListener(EventType eventType) override {
@@ -412,10 +555,22 @@ int Events_on(lua_State* L)
   if (!lua_isfunction(L, 3))
     return luaL_error(L, "second argument must be a function");
 
+  // Options to coalesce/throttle events, e.g. { coalesce=true, maxRate=30 }
+  ListenerOptions options;
+  if (lua_istable(L, 4)) {
+    if (lua_getfield(L, 4, "coalesce") != LUA_TNIL)
+      options.coalesce = lua_toboolean(L, -1);
+    lua_pop(L, 1);
+
+    if (lua_getfield(L, 4, "maxRate") != LUA_TNIL)
+      options.maxRate = std::max<int>(0, lua_tointeger(L, -1));
+    lua_pop(L, 1);
+  }
+
   // Copy the callback function to add it to the global registry
   lua_pushvalue(L, 3);
   int callbackRef = luaL_ref(L, LUA_REGISTRYINDEX);
-  evs->add(type, callbackRef);
+  evs->add(type, callbackRef, options);
 
   // Return the callback ref (this is an EventListener easier to use
   // in Events_off())
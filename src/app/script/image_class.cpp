@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -39,6 +39,8 @@
 #include <algorithm>
 #include <cstring>
 #include <memory>
+#include <string>
+#include <unordered_map>
 
 namespace app {
 namespace script {
@@ -70,7 +72,8 @@ struct ImageObj {
   }
 
   void gc(lua_State* L) {
-    if (!celId && !tilesetId)
+    // The image could be already released with Image:release()
+    if (imageId && !celId && !tilesetId)
       delete this->image(L);
     imageId = 0;
   }
@@ -102,6 +105,17 @@ void render_sprite(Image* dst,
               sprite->height()));
 }
 
+// Lua GC only sees the size of the ImageObj userdata, so we run a GC
+// step proportional to the pixels of each new image owned by the
+// script. In this way temporary images created in a loop are
+// collected before they use gigabytes of memory.
+void add_image_gc_pressure(lua_State* L, const doc::Image* image)
+{
+  const int kb = image->getMemSize() / 1024;
+  if (kb > 0)
+    lua_gc(L, LUA_GCSTEP, kb);
+}
+
 int Image_clone(lua_State* L);
 
 int Image_new(lua_State* L)
@@ -123,7 +137,7 @@ int Image_new(lua_State* L)
         // Do nothing (will return nil)
       }
       if (crop) {
-        push_new<ImageObj>(L, crop);
+        push_image(L, crop);
         return 1;
       }
       else {
@@ -190,18 +204,67 @@ int Image_new(lua_State* L)
     }
     doc::clear_image(image, spec.maskColor());
   }
-  push_new<ImageObj>(L, image);
+  push_image(L, image);
   return 1;
 }
 
+// Returns the rectangle of the image specified in the argument "i"
+// (or the whole image if the argument is not specified). Throws a Lua
+// error if the rectangle is outside the image bounds.
+gfx::Rect get_image_rect_arg(lua_State* L, const int i, const Image* img)
+{
+  gfx::Rect rc = img->bounds();
+  if (!lua_isnone(L, i) && !lua_isnil(L, i)) {
+    rc = convert_args_into_rect(L, i);
+    if (!img->bounds().contains(rc)) {
+      luaL_error(L, "rectangle (%d, %d, %d, %d) is outside the image bounds",
+                 rc.x, rc.y, rc.w, rc.h);
+    }
+  }
+  return rc;
+}
+
+template<typename T>
+void remap_pixels(lua_State* L, const int tableIndex,
+                  Image* img, const gfx::Rect& rc)
+{
+  // Each different pixel value is searched only one time in the Lua
+  // table
+  std::unordered_map<T, T> lut;
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    T* p = (T*)img->getPixelAddress(rc.x, y);
+    for (int x=0; x<rc.w; ++x, ++p) {
+      auto it = lut.find(*p);
+      if (it == lut.end()) {
+        T value = *p;
+        if (lua_rawgeti(L, tableIndex, lua_Integer(*p)) != LUA_TNIL)
+          value = T(lua_tointeger(L, -1));
+        lua_pop(L, 1);
+        it = lut.emplace(*p, value).first;
+      }
+      *p = it->second;
+    }
+  }
+}
+
 int Image_clone(lua_State* L)
 {
   auto obj = get_obj<ImageObj>(L, 1);
   doc::Image* cloned = doc::Image::createCopy(obj->image(L));
-  push_new<ImageObj>(L, cloned);
+  push_image(L, cloned);
   return 1;
 }
 
+// Deletes the pixels of an image created by the script without
+// waiting the garbage collector. The image cannot be used anymore
+// (cel and tileset images are not deleted, just this reference).
+int Image_release(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  obj->gc(L);
+  return 0;
+}
+
 int Image_gc(lua_State* L)
 {
   auto obj = get_obj<ImageObj>(L, 1);
@@ -242,6 +305,7 @@ int Image_clear(lua_State* L)
     color = convert_args_into_pixel_color(L, i, img->pixelFormat());
 
   doc::fill_rect(img, rc, color); // Clips the rectangle to the image bounds
+  img->incrementVersion();
   return 0;
 }
 
@@ -257,6 +321,7 @@ int Image_drawPixel(lua_State* L)
   else
     color = convert_args_into_pixel_color(L, 4, img->pixelFormat());
   doc::put_pixel(img, x, y, color);
+  img->incrementVersion();
   return 0;
 }
 
@@ -298,6 +363,7 @@ int Image_drawImage(lua_State* L)
     doc::blend_image(dst, src,
                      pos.x, pos.y,
                      opacity, blendMode);
+    dst->incrementVersion();
   }
   else {
     gfx::Rect bounds(0, 0, src->size().w, src->size().h);
@@ -334,6 +400,7 @@ int Image_drawSprite(lua_State* L)
   // the source image without undo information.
   if (obj->cel(L) == nullptr) {
     render_sprite(dst, sprite, frame, pos.x, pos.y);
+    dst->incrementVersion();
   }
   else {
     Tx tx;
@@ -360,6 +427,13 @@ int Image_pixels(lua_State* L)
   return 1;
 }
 
+int Image_rows(lua_State* L)
+{
+  auto obj = get_obj<ImageObj>(L, 1);
+  push_image_rows_function(L, obj->image(L), 2);
+  return 1;
+}
+
 int Image_getPixel(lua_State* L)
 {
   const auto obj = get_obj<ImageObj>(L, 1);
@@ -555,7 +629,7 @@ int Image_resize(lua_State* L)
     newImg->setId(obj->imageId);
     // Release the image from the smart pointer because now it's owned
     // by the ImageObj userdata.
-    newImg.release();
+    add_image_gc_pressure(L, newImg.release());
   }
   return 0;
 }
@@ -636,6 +710,7 @@ int Image_set_bytes(lua_State* L)
 
   if (bytes_size == bytes_needed) {
     std::memcpy(img->getPixelAddress(0, 0), bytes, bytes_size);
+    img->incrementVersion();
   }
   else {
     lua_pushfstring(L, "Data size does not match: given %d, needed %d.", bytes_size, bytes_needed);
@@ -645,6 +720,68 @@ int Image_set_bytes(lua_State* L)
   return 0;
 }
 
+int Image_getBytes(lua_State* L)
+{
+  const auto img = get_obj<ImageObj>(L, 1)->image(L);
+  const gfx::Rect rc = get_image_rect_arg(L, 2, img);
+  if (rc == img->bounds())
+    return Image_get_bytes(L);
+
+  // Copy the rows of the rectangle without padding
+  const size_t rowSize = img->getRowStrideSize(rc.w);
+  std::string bytes(rowSize * rc.h, '\0');
+  char* dst = bytes.data();
+  for (int y=rc.y; y<rc.y2(); ++y, dst+=rowSize)
+    std::memcpy(dst, img->getPixelAddress(rc.x, y), rowSize);
+
+  lua_pushlstring(L, bytes.data(), bytes.size());
+  return 1;
+}
+
+int Image_setBytes(lua_State* L)
+{
+  const auto img = get_obj<ImageObj>(L, 1)->image(L);
+  const gfx::Rect rc = get_image_rect_arg(L, 3, img);
+  if (rc == img->bounds())
+    return Image_set_bytes(L);
+
+  const size_t rowSize = img->getRowStrideSize(rc.w);
+  size_t bytes_size, bytes_needed = rowSize * rc.h;
+  const char* bytes = luaL_checklstring(L, 2, &bytes_size);
+  if (bytes_size != bytes_needed) {
+    return luaL_error(L, "Data size does not match: given %d, needed %d.",
+                      int(bytes_size), int(bytes_needed));
+  }
+
+  for (int y=rc.y; y<rc.y2(); ++y, bytes+=rowSize)
+    std::memcpy(img->getPixelAddress(rc.x, y), bytes, rowSize);
+
+  img->incrementVersion();
+  return 0;
+}
+
+// Replaces each pixel value with the value in the given table (pixel
+// values that are not in the table are kept as they are).
+int Image_remap(lua_State* L)
+{
+  const auto img = get_obj<ImageObj>(L, 1)->image(L);
+  luaL_checktype(L, 2, LUA_TTABLE);
+  const gfx::Rect rc = get_image_rect_arg(L, 3, img);
+  if (rc.isEmpty())
+    return 0;
+
+  switch (img->getRowStrideSize(1)) {
+    case 1: remap_pixels<uint8_t>(L, 2, img, rc); break;
+    case 2: remap_pixels<uint16_t>(L, 2, img, rc); break;
+    case 4: remap_pixels<uint32_t>(L, 2, img, rc); break;
+    default:
+      return luaL_error(L, "unsupported image format");
+  }
+
+  img->incrementVersion();
+  return 0;
+}
+
 int Image_get_width(lua_State* L)
 {
   const auto obj = get_obj<ImageObj>(L, 1);
@@ -695,6 +832,10 @@ const luaL_Reg Image_methods[] = {
   { "drawImage", Image_drawImage }, { "putImage", Image_drawImage }, // TODO putImage is deprecated
   { "drawSprite", Image_drawSprite }, { "putSprite", Image_drawSprite }, // TODO putSprite is deprecated
   { "pixels", Image_pixels },
+  { "rows", Image_rows },
+  { "getBytes", Image_getBytes },
+  { "setBytes", Image_setBytes },
+  { "remap", Image_remap },
   { "isEqual", Image_isEqual },
   { "isEmpty", Image_isEmpty },
   { "isPlain", Image_isPlain },
@@ -702,6 +843,7 @@ const luaL_Reg Image_methods[] = {
   { "resize", Image_resize },
   { "shrinkBounds", Image_shrinkBounds },
   { "flip", Image_flip },
+  { "release", Image_release },
   { "__gc", Image_gc },
   { "__eq", Image_eq },
   { nullptr, nullptr }
@@ -742,6 +884,7 @@ void push_cel_image(lua_State* L, doc::Cel* cel)
 void push_image(lua_State* L, doc::Image* image)
 {
   push_new<ImageObj>(L, image);
+  add_image_gc_pressure(L, image);
 }
 
 void push_tileset_image(lua_State* L, doc::Tileset* tileset, doc::Image* image)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -63,6 +63,9 @@ int ImageIterator_call(lua_State* L)
   // Set value
   else {
     *obj->begin = lua_tointeger(L, 2);
+    // Modified pixels must invalidate cached information of the image
+    // (e.g. Image::occupancy())
+    obj->bits.image()->incrementVersion();
     return 1;
   }
 }
@@ -85,6 +88,71 @@ int ImageIterator_index(lua_State* L)
   return 0;
 }
 
+// View of one row of pixels returned by Image:rows(), the same
+// object is reused for each row, and pixels are accessed with the x
+// coordinate of the image (row[x] and row[x] = value)
+template<typename ImageTraits>
+struct ImageRowObj {
+  doc::Image* image;
+  gfx::Rect bounds;                      // Area to iterate
+  int y;                                 // Current row
+  typename ImageTraits::address_t row;   // Address of x=0 in the current row
+  ImageRowObj(const doc::Image* image, const gfx::Rect& bounds)
+    : image(const_cast<doc::Image*>(image)),
+      bounds(bounds),
+      y(bounds.y-1),
+      row(nullptr) {
+  }
+  ImageRowObj(const ImageRowObj&) = delete;
+  ImageRowObj& operator=(const ImageRowObj&) = delete;
+};
+
+using RgbImageRow = ImageRowObj<RgbTraits>;
+using GrayscaleImageRow = ImageRowObj<GrayscaleTraits>;
+using IndexedImageRow = ImageRowObj<IndexedTraits>;
+using TilemapImageRow = ImageRowObj<TilemapTraits>;
+
+// These metamethods are called for each pixel, so we use
+// lua_touserdata() instead of get_obj() (they can be called only
+// with an ImageRowObj as first argument)
+template<typename ImageTraits>
+int ImageRow_index(lua_State* L)
+{
+  auto obj = static_cast<ImageRowObj<ImageTraits>*>(lua_touserdata(L, 1));
+  int isnum;
+  const lua_Integer x = lua_tointegerx(L, 2, &isnum);
+  if (!isnum || !obj->row ||
+      x < obj->bounds.x || x >= obj->bounds.x2())
+    return 0;
+
+  lua_pushinteger(L, obj->row[x]);
+  return 1;
+}
+
+template<typename ImageTraits>
+int ImageRow_newindex(lua_State* L)
+{
+  auto obj = static_cast<ImageRowObj<ImageTraits>*>(lua_touserdata(L, 1));
+  int isnum;
+  const lua_Integer x = lua_tointegerx(L, 2, &isnum);
+  if (!isnum || !obj->row ||
+      x < obj->bounds.x || x >= obj->bounds.x2())
+    return luaL_error(L, "invalid pixel index in image row");
+
+  obj->row[x] = lua_tointeger(L, 3);
+  // Modified pixels must invalidate cached information of the image
+  obj->image->incrementVersion();
+  return 0;
+}
+
+template<typename ImageTraits>
+int ImageRow_len(lua_State* L)
+{
+  auto obj = static_cast<ImageRowObj<ImageTraits>*>(lua_touserdata(L, 1));
+  lua_pushinteger(L, obj->bounds.w);
+  return 1;
+}
+
 #define DEFINE_METHODS(Prefix)                          \
   const luaL_Reg Prefix##ImageIterator_methods[] = {    \
     { "__index", ImageIterator_index<Prefix##Traits> }, \
@@ -98,12 +166,29 @@ DEFINE_METHODS(Grayscale);
 DEFINE_METHODS(Indexed);
 DEFINE_METHODS(Tilemap);
 
+#define DEFINE_ROW_METHODS(Prefix)                          \
+  const luaL_Reg Prefix##ImageRow_methods[] = {             \
+    { "__index", ImageRow_index<Prefix##Traits> },          \
+    { "__newindex", ImageRow_newindex<Prefix##Traits> },    \
+    { "__len", ImageRow_len<Prefix##Traits> },              \
+    { nullptr, nullptr }                                    \
+  }
+
+DEFINE_ROW_METHODS(Rgb);
+DEFINE_ROW_METHODS(Grayscale);
+DEFINE_ROW_METHODS(Indexed);
+DEFINE_ROW_METHODS(Tilemap);
+
 } // anonymous namespace
 
 DEF_MTNAME(ImageIteratorObj<RgbTraits>);
 DEF_MTNAME(ImageIteratorObj<GrayscaleTraits>);
 DEF_MTNAME(ImageIteratorObj<IndexedTraits>);
 DEF_MTNAME(ImageIteratorObj<TilemapTraits>);
+DEF_MTNAME(ImageRowObj<RgbTraits>);
+DEF_MTNAME(ImageRowObj<GrayscaleTraits>);
+DEF_MTNAME(ImageRowObj<IndexedTraits>);
+DEF_MTNAME(ImageRowObj<TilemapTraits>);
 
 void register_image_iterator_class(lua_State* L)
 {
@@ -111,6 +196,10 @@ void register_image_iterator_class(lua_State* L)
   REG_CLASS(L, GrayscaleImageIterator);
   REG_CLASS(L, IndexedImageIterator);
   REG_CLASS(L, TilemapImageIterator);
+  REG_CLASS(L, RgbImageRow);
+  REG_CLASS(L, GrayscaleImageRow);
+  REG_CLASS(L, IndexedImageRow);
+  REG_CLASS(L, TilemapImageRow);
 }
 
 template<typename ImageTrais>
@@ -174,5 +263,61 @@ int push_image_iterator_function(lua_State* L, const doc::Image* image, int extr
   }
 }
 
+template<typename ImageTraits>
+static int image_rows_step_closure(lua_State* L)
+{
+  int idx = lua_upvalueindex(1);
+  auto obj = static_cast<ImageRowObj<ImageTraits>*>(lua_touserdata(L, idx));
+  if (++obj->y < obj->bounds.y2()) {
+    obj->row = (typename ImageTraits::address_t)
+      obj->image->getPixelAddress(0, obj->y);
+    lua_pushinteger(L, obj->y);
+    lua_pushvalue(L, idx);
+    return 2;
+  }
+  else {
+    obj->row = nullptr;
+    lua_pushnil(L);
+    return 1;
+  }
+}
+
+int push_image_rows_function(lua_State* L, const doc::Image* image, int extraArgIndex)
+{
+  gfx::Rect bounds = image->bounds();
+
+  if (!lua_isnone(L, extraArgIndex)) {
+    auto specificBounds = convert_args_into_rect(L, extraArgIndex);
+    if (!specificBounds.isEmpty())
+      bounds &= specificBounds;
+  }
+
+  if (bounds.isEmpty()) {
+    lua_pushcclosure(L, image_iterator_do_nothing, 0);
+    return 1;
+  }
+
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      push_new<RgbImageRow>(L, image, bounds);
+      lua_pushcclosure(L, image_rows_step_closure<doc::RgbTraits>, 1);
+      return 1;
+    case IMAGE_GRAYSCALE:
+      push_new<GrayscaleImageRow>(L, image, bounds);
+      lua_pushcclosure(L, image_rows_step_closure<doc::GrayscaleTraits>, 1);
+      return 1;
+    case IMAGE_INDEXED:
+      push_new<IndexedImageRow>(L, image, bounds);
+      lua_pushcclosure(L, image_rows_step_closure<doc::IndexedTraits>, 1);
+      return 1;
+    case IMAGE_TILEMAP:
+      push_new<TilemapImageRow>(L, image, bounds);
+      lua_pushcclosure(L, image_rows_step_closure<doc::TilemapTraits>, 1);
+      return 1;
+    default:
+      return 0;
+  }
+}
+
 } // namespace script
 } // namespace app
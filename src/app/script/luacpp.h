@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2019  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -102,6 +102,11 @@ inline void setfield_integer(lua_State* L, const char* key, const T& value) {
   lua_setfield(L, -2, key);
 }
 
+inline void setfield_boolean(lua_State* L, const char* key, const bool value) {
+  lua_pushboolean(L, value);
+  lua_setfield(L, -2, key);
+}
+
 #define REG_CLASS(L, T) {                        \
     luaL_newmetatable(L, get_mtname<T>());       \
     lua_getglobal(L, "__generic_mt_index");      \
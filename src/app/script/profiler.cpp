@@ -0,0 +1,309 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/script/profiler.h"
+
+#include "app/script/luacpp.h"
+#include "base/debug.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iomanip>
+#include <ostream>
+
+namespace app {
+namespace script {
+
+namespace {
+
+// Lua hooks don't have a user data pointer
+Profiler* g_profiler = nullptr;
+
+double to_ms(const Profiler::Clock::duration d)
+{
+  return std::chrono::duration<double, std::milli>(d).count();
+}
+
+} // anonymous namespace
+
+Profiler::Profiler(lua_State* L)
+  : L(L)
+{
+}
+
+Profiler::~Profiler()
+{
+  stop();
+}
+
+void Profiler::start()
+{
+  if (m_running)
+    return;
+
+  ASSERT(!g_profiler);
+  g_profiler = this;
+  m_running = true;
+  lua_sethook(L, &Profiler::hook, LUA_MASKCALL | LUA_MASKRET, 0);
+}
+
+void Profiler::stop()
+{
+  if (!m_running)
+    return;
+
+  lua_sethook(L, nullptr, 0, 0);
+  m_running = false;
+  g_profiler = nullptr;
+
+  // Functions that are still running (e.g. the script that called
+  // app.profiler.stop()) are measured until now
+  const Clock::time_point now = Clock::now();
+  for (auto& it : m_stacks) {
+    while (!it.second.empty())
+      finishFrame(it.second, now);
+  }
+  m_stacks.clear();
+}
+
+void Profiler::clear()
+{
+  m_stacks.clear();
+  m_entriesByKey.clear();
+  m_filesByName.clear();
+  m_entries.clear();
+  m_files.clear();
+}
+
+void Profiler::writeReport(std::ostream& os, const int maxFunctions) const
+{
+  Clock::duration total = Clock::duration::zero();
+  int64_t calls = 0;
+  for (const Entry& entry : m_entries) {
+    total += entry.self;
+    calls += entry.calls;
+  }
+
+  const std::ios_base::fmtflags flags = os.flags();
+  os << std::fixed << std::setprecision(2)
+     << "Lua profiler: " << calls << " calls in " << to_ms(total) << " ms\n";
+
+  std::vector<const Entry*> entries;
+  for (const Entry& entry : m_entries)
+    entries.push_back(&entry);
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry* a, const Entry* b){
+              return a->self > b->self;
+            });
+  if (int(entries.size()) > maxFunctions)
+    entries.resize(maxFunctions);
+
+  os << std::right
+     << std::setw(10) << "self(ms)"
+     << std::setw(11) << "total(ms)"
+     << std::setw(10) << "calls" << "  function\n";
+  for (const Entry* entry : entries) {
+    os << std::setw(10) << to_ms(entry->self)
+       << std::setw(11) << to_ms(entry->total)
+       << std::setw(10) << entry->calls
+       << "  " << entry->name;
+    if (!entry->where.empty())
+      os << " (" << entry->where << ")";
+    os << '\n';
+  }
+
+  // Time of each file including the C++ API calls from that file
+  std::vector<const File*> files;
+  for (const File& file : m_files)
+    files.push_back(&file);
+  std::sort(files.begin(), files.end(),
+            [](const File* a, const File* b){
+              return a->self > b->self;
+            });
+
+  os << std::setw(10) << "self(ms)" << "  file\n";
+  for (const File* file : files)
+    os << std::setw(10) << to_ms(file->self) << "  " << file->name << '\n';
+  os.flags(flags);
+}
+
+// static
+void Profiler::hook(lua_State* L, lua_Debug* ar)
+{
+  if (!g_profiler)
+    return;
+
+  switch (ar->event) {
+    case LUA_HOOKCALL:
+      g_profiler->onCall(L, ar, false);
+      break;
+    case LUA_HOOKTAILCALL:
+      g_profiler->onCall(L, ar, true);
+      break;
+    case LUA_HOOKRET:
+      g_profiler->onReturn(L, ar);
+      break;
+  }
+}
+
+void Profiler::onCall(lua_State* L, lua_Debug* ar, const bool tailCall)
+{
+  const Clock::time_point now = Clock::now();
+  Stack& stack = m_stacks[L];
+
+  // The caller of a tail call is replaced by the called function
+  // (we don't receive its return event)
+  if (tailCall && !stack.empty())
+    finishFrame(stack, now);
+
+  if (!lua_getinfo(L, "Snf", ar))
+    return;
+  const void* func = lua_topointer(L, -1);
+
+  int file = -1;
+  const int entry = getEntry(L, ar, file);
+  lua_pop(L, 1);
+
+  // The C++ API calls are attributed to the file of the caller
+  if (file < 0)
+    file = (stack.empty() ? getFile("[C]"): stack.back().file);
+
+  Entry& e = m_entries[entry];
+  ++e.calls;
+  ++e.active;
+
+  // The time to get the function information isn't counted
+  stack.push_back(Frame{ func, entry, file, Clock::now(),
+                         Clock::duration::zero() });
+}
+
+void Profiler::onReturn(lua_State* L, lua_Debug* ar)
+{
+  const Clock::time_point now = Clock::now();
+  auto it = m_stacks.find(L);
+  if (it == m_stacks.end() || it->second.empty())
+    return;
+
+  if (!lua_getinfo(L, "f", ar))
+    return;
+  const void* func = lua_topointer(L, -1);
+  lua_pop(L, 1);
+
+  // Functions called before the profiler was started don't have a
+  // frame. Frames over the returning one weren't finished because
+  // of an error (longjmp), so we finish them now.
+  Stack& stack = it->second;
+  auto frameIt = std::find_if(stack.rbegin(), stack.rend(),
+                              [func](const Frame& frame){
+                                return frame.func == func;
+                              });
+  if (frameIt == stack.rend())
+    return;
+
+  const size_t n = std::distance(stack.rbegin(), frameIt) + 1;
+  for (size_t i=0; i<n; ++i)
+    finishFrame(stack, now);
+}
+
+void Profiler::finishFrame(Stack& stack, const Clock::time_point now)
+{
+  ASSERT(!stack.empty());
+  const Frame frame = stack.back();
+  stack.pop_back();
+
+  const Clock::duration elapsed = now - frame.start;
+  const Clock::duration self = elapsed - frame.children;
+
+  Entry& entry = m_entries[frame.entry];
+  entry.self += self;
+  // The total time of recursive functions is counted one time
+  if (--entry.active == 0)
+    entry.total += elapsed;
+
+  m_files[frame.file].self += self;
+
+  if (!stack.empty())
+    stack.back().children += elapsed;
+}
+
+// Returns the index of the entry for the function of the given
+// activation record (with the function pushed on the stack). The
+// file is the index of the file where the function is defined, or
+// -1 for C functions.
+int Profiler::getEntry(lua_State* L, lua_Debug* ar, int& file)
+{
+  std::string key;
+  const bool isC = (std::strcmp(ar->what, "C") == 0);
+  if (isC) {
+    // C functions don't change, so we can use their address
+    key = std::to_string(
+      reinterpret_cast<uintptr_t>(lua_tocfunction(L, -1)));
+  }
+  else {
+    key = ar->short_src;
+    key += ':';
+    key += std::to_string(ar->linedefined);
+    file = getFile(ar->short_src);
+  }
+
+  auto it = m_entriesByKey.find(key);
+  if (it != m_entriesByKey.end())
+    return it->second;
+
+  Entry entry;
+  if (isC) {
+    const char* name = (ar->name ? ar->name: "?");
+    entry.name = name;
+
+    // For methods (e.g. img:getPixel()) we use the class name of
+    // "self" (the __name field of the metatable)
+    if (ar->namewhat && std::strcmp(ar->namewhat, "method") == 0 &&
+        lua_getlocal(L, ar, 1)) {
+      const int type = luaL_getmetafield(L, -1, "__name");
+      if (type != LUA_TNIL) {
+        if (type == LUA_TSTRING) {
+          entry.name = lua_tostring(L, -1);
+          entry.name += ':';
+          entry.name += name;
+        }
+        lua_pop(L, 1);
+      }
+      lua_pop(L, 1);
+    }
+  }
+  else {
+    if (std::strcmp(ar->what, "main") == 0)
+      entry.name = "main chunk";
+    else
+      entry.name = (ar->name ? ar->name: "?");
+    entry.where = key;
+  }
+
+  const int index = int(m_entries.size());
+  m_entries.push_back(entry);
+  m_entriesByKey[key] = index;
+  return index;
+}
+
+int Profiler::getFile(const std::string& name)
+{
+  auto it = m_filesByName.find(name);
+  if (it != m_filesByName.end())
+    return it->second;
+
+  const int index = int(m_files.size());
+  m_files.push_back(File{ name });
+  m_filesByName[name] = index;
+  return index;
+}
+
+} // namespace script
+} // namespace app
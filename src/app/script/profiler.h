@@ -0,0 +1,96 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_SCRIPT_PROFILER_H_INCLUDED
+#define APP_SCRIPT_PROFILER_H_INCLUDED
+#pragma once
+
+#ifndef ENABLE_SCRIPTING
+  #error ENABLE_SCRIPTING must be defined
+#endif
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct lua_State;
+struct lua_Debug;
+
+namespace app {
+namespace script {
+
+  // Measures the time spent in each Lua function and in each call to
+  // the C++ API (e.g. Image:getPixel or app.transaction) using the
+  // call/return hooks of Lua. The self time of the C++ API calls is
+  // attributed to the script file that calls them too, so we can
+  // know which script/extension is slow.
+  //
+  // It uses the same Lua hook used by the debugger, so both cannot
+  // be used at the same time.
+  class Profiler {
+  public:
+    typedef std::chrono::steady_clock Clock;
+
+    Profiler(lua_State* L);
+    ~Profiler();
+
+    bool isRunning() const { return m_running; }
+    void start();
+    void stop();
+    void clear();
+
+    // Writes the functions with the biggest self time and the time
+    // of each script file.
+    void writeReport(std::ostream& os, const int maxFunctions = 30) const;
+
+  private:
+    struct Entry {
+      std::string name;       // Function name ("Image:getPixel")
+      std::string where;      // Where it's defined ("file.lua:10")
+      int64_t calls = 0;
+      Clock::duration total = Clock::duration::zero();
+      Clock::duration self = Clock::duration::zero();
+      int active = 0;         // Recursive calls in the stack
+    };
+
+    struct File {
+      std::string name;
+      Clock::duration self = Clock::duration::zero();
+    };
+
+    struct Frame {
+      const void* func;
+      int entry;
+      int file;
+      Clock::time_point start;
+      Clock::duration children;
+    };
+
+    typedef std::vector<Frame> Stack;
+
+    static void hook(lua_State* L, lua_Debug* ar);
+    void onCall(lua_State* L, lua_Debug* ar, const bool tailCall);
+    void onReturn(lua_State* L, lua_Debug* ar);
+    void finishFrame(Stack& stack, const Clock::time_point now);
+    int getEntry(lua_State* L, lua_Debug* ar, int& file);
+    int getFile(const std::string& name);
+
+    lua_State* L;
+    bool m_running = false;
+    std::unordered_map<lua_State*, Stack> m_stacks;
+    std::unordered_map<std::string, int> m_entriesByKey;
+    std::unordered_map<std::string, int> m_filesByName;
+    std::vector<Entry> m_entries;
+    std::vector<File> m_files;
+  };
+
+} // namespace script
+} // namespace app
+
+#endif
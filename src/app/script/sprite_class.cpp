@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2015-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -39,6 +39,7 @@
 #include "app/doc.h"
 #include "app/doc_access.h"
 #include "app/doc_api.h"
+#include "app/doc_diff.h"
 #include "app/doc_range.h"
 #include "app/doc_undo.h"
 #include "app/doc_undo_observer.h"
@@ -272,6 +273,36 @@ int Sprite_close(lua_State* L)
   }
 }
 
+// Returns a table with the differences between two sprites, e.g.
+// { anything=true, images=true, ... }. If the third argument is true
+// the comparison stops in the first difference, so we can check
+// quickly if the sprite must be exported again.
+int Sprite_diff(lua_State* L)
+{
+  const auto a = get_docobj<Sprite>(L, 1);
+  const auto b = get_docobj<Sprite>(L, 2);
+  const bool stopAtFirstDiff = lua2bool(L, 3);
+  const DocDiff diff =
+    compare_docs(static_cast<const Doc*>(a->document()),
+                 static_cast<const Doc*>(b->document()),
+                 stopAtFirstDiff);
+
+  lua_newtable(L);
+  setfield_boolean(L, "anything", diff.anything);
+  setfield_boolean(L, "canvas", diff.canvas);
+  setfield_boolean(L, "totalFrames", diff.totalFrames);
+  setfield_boolean(L, "frameDuration", diff.frameDuration);
+  setfield_boolean(L, "tags", diff.tags);
+  setfield_boolean(L, "palettes", diff.palettes);
+  setfield_boolean(L, "tilesets", diff.tilesets);
+  setfield_boolean(L, "layers", diff.layers);
+  setfield_boolean(L, "cels", diff.cels);
+  setfield_boolean(L, "images", diff.images);
+  setfield_boolean(L, "colorProfiles", diff.colorProfiles);
+  setfield_boolean(L, "gridBounds", diff.gridBounds);
+  return 1;
+}
+
 int Sprite_loadPalette(lua_State* L)
 {
   auto sprite = get_docobj<Sprite>(L, 1);
@@ -1011,6 +1042,7 @@ const luaL_Reg Sprite_methods[] = {
   { "saveAs", Sprite_saveAs },
   { "saveCopyAs", Sprite_saveCopyAs },
   { "close", Sprite_close },
+  { "diff", Sprite_diff },
   { "loadPalette", Sprite_loadPalette },
   { "setPalette", Sprite_setPalette },
   { "assignColorSpace", Sprite_assignColorSpace },
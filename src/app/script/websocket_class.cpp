@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2021  Igara Studio S.A.
+// Copyright (C) 2021-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -13,14 +13,15 @@
 #include "app/script/engine.h"
 #include "app/script/luacpp.h"
 #include "app/script/security.h"
+#include "doc/image.h"
 #include "ui/timer.h"
 #include "ui/manager.h"
 #include "ui/system.h"
 
 #include <ixwebsocket/IXNetSystem.h>
 #include <ixwebsocket/IXWebSocket.h>
-#include <sstream>
 #include <set>
+#include <string>
 
 namespace app {
 namespace script {
@@ -33,6 +34,46 @@ namespace {
 static std::unique_ptr<ui::Timer> g_timer;
 static std::set<ix::WebSocket*> g_connections;
 
+// Joins all the function arguments from "firstArg" in one message.
+// Images (only if "withImages" is true) are added as raw pixels
+// (the same bytes as Image.bytes) without an intermediate Lua string.
+static bool join_args(lua_State* L, const int firstArg,
+                      const bool withImages, std::string& data)
+{
+  const int argc = lua_gettop(L);
+
+  // Calculate the size of the whole message to allocate it once
+  size_t size = 0;
+  for (int i=firstArg; i<=argc; ++i) {
+    if (withImages) {
+      if (const doc::Image* img = may_get_image_from_arg(L, i)) {
+        size += size_t(img->getRowStrideSize()) * img->height();
+        continue;
+      }
+    }
+    size_t bufLen;
+    if (!lua_tolstring(L, i, &bufLen))
+      return false;
+    size += bufLen;
+  }
+
+  data.clear();
+  data.reserve(size);
+  for (int i=firstArg; i<=argc; ++i) {
+    if (withImages) {
+      if (const doc::Image* img = may_get_image_from_arg(L, i)) {
+        data.append((const char*)img->getPixelAddress(0, 0),
+                    size_t(img->getRowStrideSize()) * img->height());
+        continue;
+      }
+    }
+    size_t bufLen;
+    const char* buf = lua_tolstring(L, i, &bufLen);
+    data.append(buf, bufLen);
+  }
+  return true;
+}
+
 static void close_ws(ix::WebSocket* ws)
 {
   ws->stop();
@@ -92,7 +133,10 @@ int WebSocket_new(lua_State* L)
             (msg->binary ? MESSAGE_TYPE_BINARY : static_cast<int>(msg->type));
           std::string msgData = msg->str;
 
-          ui::execute_from_ui_thread([=]() {
+          // Move the data to the UI thread (without copying it again)
+          ui::execute_from_ui_thread(
+            [L, ws, onreceiveRef, msgType,
+             msgData = std::move(msgData)]() {
             lua_rawgeti(L, LUA_REGISTRYINDEX, onreceiveRef);
             lua_pushinteger(L, msgType);
             lua_pushlstring(L, msgData.c_str(), msgData.length());
@@ -132,16 +176,11 @@ int WebSocket_sendText(lua_State* L)
     return luaL_error(L, "WebSocket is not connected, can't send text");
   }
 
-  std::stringstream data;
-  int argc = lua_gettop(L);
-
-  for (int i = 2; i <= argc; i++) {
-    size_t bufLen;
-    const char* buf = lua_tolstring(L, i, &bufLen);
-    data.write(buf, bufLen);
-  }
+  std::string data;
+  if (!join_args(L, 2, false, data))
+    return luaL_error(L, "WebSocket text must be a string");
 
-  if (!ws->sendText(data.str()).success) {
+  if (!ws->sendText(data).success) {
     return luaL_error(L, "WebSocket failed to send text");
   }
   return 0;
@@ -155,16 +194,11 @@ int WebSocket_sendBinary(lua_State* L)
     return luaL_error(L, "WebSocket is not connected, can't send data");
   }
 
-  std::stringstream data;
-  int argc = lua_gettop(L);
-
-  for (int i = 2; i <= argc; i++) {
-    size_t bufLen;
-    const char* buf = lua_tolstring(L, i, &bufLen);
-    data.write(buf, bufLen);
-  }
+  std::string data;
+  if (!join_args(L, 2, true, data))
+    return luaL_error(L, "WebSocket data must be a string or an Image");
 
-  if (!ws->sendBinary(data.str()).success) {
+  if (!ws->sendBinary(data).success) {
     return luaL_error(L, "WebSocket failed to send data");
   }
   return 0;
@@ -220,6 +254,16 @@ int WebSocket_get_url(lua_State* L)
   return 1;
 }
 
+// Bytes waiting to be sent, scripts sending a continuous stream of
+// data (e.g. frames) can check it to skip messages when the
+// connection cannot keep up
+int WebSocket_get_bufferedAmount(lua_State* L)
+{
+  auto ws = get_ptr<ix::WebSocket>(L, 1);
+  lua_pushinteger(L, ws->bufferedAmount());
+  return 1;
+}
+
 const luaL_Reg WebSocket_methods[] = {
   { "__gc", WebSocket_gc },
   { "close", WebSocket_close },
@@ -232,6 +276,7 @@ const luaL_Reg WebSocket_methods[] = {
 
 const Property WebSocket_properties[] = {
   { "url", WebSocket_get_url, nullptr },
+  { "bufferedAmount", WebSocket_get_bufferedAmount, nullptr },
   { nullptr, nullptr, nullptr }
 };
 
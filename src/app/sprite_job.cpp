@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2017  David Capello
 //
 // This program is distributed under the terms of
@@ -10,14 +11,27 @@
 
 #include "app/sprite_job.h"
 
+#include "app/doc.h"
+
 namespace app {
 
 SpriteJob::SpriteJob(const ContextReader& reader, const char* jobName)
   : Job(jobName)
-  , m_writer(reader, 500)
-  , m_document(m_writer.document())
-  , m_sprite(m_writer.sprite())
-  , m_tx(m_writer.context(), jobName, ModifyDocument)
+  , m_context(const_cast<Context*>(reader.context()))
+  , m_writer(reader.document(), 500)
+  , m_document(m_writer)
+  , m_sprite(m_document->sprite())
+  , m_tx(m_context, m_document, jobName, ModifyDocument)
+{
+}
+
+SpriteJob::SpriteJob(Context* ctx, Doc* doc, const char* jobName)
+  : Job(jobName)
+  , m_context(ctx)
+  , m_writer(doc, 500)
+  , m_document(m_writer)
+  , m_sprite(m_document->sprite())
+  , m_tx(m_context, m_document, jobName, ModifyDocument)
 {
 }
 
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2017-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +11,7 @@
 
 #include "app/context.h"
 #include "app/context_access.h"
+#include "app/doc_access.h"
 #include "app/job.h"
 #include "app/tx.h"
 #include "render/task_delegate.h"
@@ -22,9 +24,13 @@ class SpriteJob : public Job,
                   public render::TaskDelegate {
 public:
   SpriteJob(const ContextReader& reader, const char* jobName);
+
+  // Locks the given document (it doesn't need to be the active
+  // one), useful for jobs that are executed with BackgroundJobs.
+  SpriteJob(Context* ctx, Doc* doc, const char* jobName);
   ~SpriteJob();
 
-  ContextWriter& writer() { return m_writer; }
+  Context* context() const { return m_context; }
   Doc* document() const { return m_document; }
   Sprite* sprite() const { return m_sprite; }
   Tx& tx() { return m_tx; }
@@ -44,7 +50,8 @@ private:
   bool continueTask() override;
   void notifyTaskProgress(double progress) override;
 
-  ContextWriter m_writer;
+  Context* m_context;
+  DocWriter m_writer;
   Doc* m_document;
   Sprite* m_sprite;
   Tx m_tx;
@@ -11,35 +11,51 @@
 #include "app/task.h"
 
 #include "base/task.h"
-#include "base/thread.h"
-#include "base/thread_pool.h"
 
 namespace app {
 
-static base::thread_pool tasks_pool(4);
-
 Task::Task()
-  : m_token(nullptr)
+  : m_task(sched::Priority::Interactive)
+  , m_running(false)
+  , m_completed(false)
 {
 }
 
 Task::~Task()
 {
+  wait();
 }
 
 void Task::run(base::task::func_t&& func)
 {
-  std::lock_guard lock(m_token_mutex);
-  m_task.on_execute(std::move(func));
-  m_token = &m_task.start(tasks_pool);
+  // Wait the previous execution as it uses the current token
+  m_task.wait();
+
+  base::task_token* token;
+  {
+    std::lock_guard lock(m_token_mutex);
+    m_token = std::make_unique<base::task_token>();
+    token = m_token.get();
+  }
+
+  m_completed = false;
+  m_running = true;
+  m_task.run(
+    [this, token, func = std::move(func)]{
+      try {
+        func(*token);
+      }
+      catch (...) {
+        // Task functions must handle their own errors
+      }
+      m_running = false;
+      m_completed = true;
+    });
 }
 
 void Task::wait()
 {
-  // TODO wait a condition variable
-  while (!m_task.completed()) {
-    base::this_thread::sleep_for(0.1);
-  }
+  m_task.wait();
 }
 
 } // namespace app
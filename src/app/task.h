@@ -9,8 +9,11 @@
 #pragma once
 
 #include "base/task.h"
+#include "sched/task_group.h"
 
+#include <atomic>
 #include <functional>
+#include <memory>
 #include <mutex>
 
 namespace app {
@@ -26,11 +29,11 @@ namespace app {
     // Returns true when the task is completed (whether it was
     // canceled or not)
     bool completed() const {
-      return m_task.completed();
+      return m_completed;
     }
 
     bool running() const {
-      return m_task.running();
+      return m_running;
     }
 
     bool canceled() const {
@@ -62,9 +65,11 @@ namespace app {
     }
 
   private:
-    base::task m_task;
+    sched::TaskGroup m_task;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_completed;
     mutable std::mutex m_token_mutex;
-    base::task_token* m_token;
+    std::unique_ptr<base::task_token> m_token;
   };
 
 } // namespace app
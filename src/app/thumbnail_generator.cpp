@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,35 +16,140 @@
 #include "app/doc.h"
 #include "app/file/file.h"
 #include "app/file_system.h"
+#include "app/resource_finder.h"
 #include "app/util/conversion_to_surface.h"
+#include "base/cfile.h"
+#include "base/convert_to.h"
+#include "base/file_handle.h"
+#include "base/fs.h"
+#include "base/sha1.h"
 #include "base/thread.h"
+#include "base/time.h"
 #include "doc/algorithm/rotate.h"
 #include "doc/image.h"
-#include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/sprite.h"
+#include "fmt/format.h"
 #include "os/system.h"
 #include "render/projection.h"
 #include "render/render.h"
+#include "sched/task_group.h"
 #include "ui/system.h"
 
+#include "zlib.h"
+
 #include <algorithm>
 #include <atomic>
 #include <memory>
-#include <thread>
 
 #define MAX_THUMBNAIL_SIZE   128
 #define THUMB_TRACE(...)
 
 namespace app {
 
+namespace {
+
+// Magic number of cached thumbnail files (increase the last number
+// if the format changes)
+const uint32_t kCachedThumbnailMagic = 0x41544831; // "ATH1"
+
+// Each thumbnail is cached in its own file, identified by the file
+// name, size, and modification time of the original file (so the
+// thumbnail is generated again if the file is modified).
+std::string get_cached_thumbnail_filename(const std::string& cacheDir,
+                                          const std::string& filename)
+{
+  if (cacheDir.empty())
+    return std::string();
+
+  const base::Time time = base::get_modification_time(filename);
+  if (!time.valid())
+    return std::string();
+
+  const std::string key =
+    fmt::format("{}\n{}\n{:04d}{:02d}{:02d}{:02d}{:02d}{:02d}",
+                filename, base::file_size(filename),
+                time.year, time.month, time.day,
+                time.hour, time.minute, time.second);
+
+  return base::join_path(
+    cacheDir,
+    base::convert_to<std::string>(base::Sha1::calculateFromString(key)));
+}
+
+// Returns the cached RGB image of the thumbnail or nullptr if the
+// thumbnail is not in the cache.
+Image* load_cached_thumbnail(const std::string& fn)
+{
+  if (fn.empty() || !base::is_file(fn))
+    return nullptr;
+
+  base::FileHandle handle(base::open_file(fn, "rb"));
+  FILE* f = handle.get();
+  if (!f || base::fgetl(f) != kCachedThumbnailMagic)
+    return nullptr;
+
+  const int w = base::fgetw(f);
+  const int h = base::fgetw(f);
+  const long compressedSize = base::fgetl(f);
+  if (w < 1 || w > MAX_THUMBNAIL_SIZE ||
+      h < 1 || h > MAX_THUMBNAIL_SIZE ||
+      compressedSize <= 0 ||
+      compressedSize > long(compressBound(4*w*h)) ||
+      ferror(f))
+    return nullptr;
+
+  std::vector<uint8_t> compressed(compressedSize);
+  if (fread(compressed.data(), 1, compressedSize, f) != compressedSize)
+    return nullptr;
+
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, w, h));
+  const uLong size = image->getRowStrideSize() * h;
+  uLongf len = size;
+  if (uncompress(image->getPixelAddress(0, 0), &len,
+                 compressed.data(), compressedSize) != Z_OK ||
+      len != size)
+    return nullptr;
+
+  return image.release();
+}
+
+void save_cached_thumbnail(const std::string& fn, const Image* image)
+{
+  ASSERT(image->pixelFormat() == IMAGE_RGB);
+
+  const uLong size = image->getRowStrideSize() * image->height();
+  uLongf len = compressBound(size);
+  std::vector<uint8_t> compressed(len);
+  if (compress2(compressed.data(), &len,
+                image->getPixelAddress(0, 0), size,
+                Z_BEST_SPEED) != Z_OK)
+    return;
+
+  base::FileHandle handle(base::open_file(fn, "wb"));
+  FILE* f = handle.get();
+  if (!f)
+    return;
+
+  base::fputl(kCachedThumbnailMagic, f);
+  base::fputw(image->width(), f);
+  base::fputw(image->height(), f);
+  base::fputl(len, f);
+  fwrite(compressed.data(), 1, len, f);
+}
+
+} // anonymous namespace
+
 class ThumbnailGenerator::Worker {
 public:
-  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue)
+  Worker(base::concurrent_queue<ThumbnailGenerator::Item>& queue,
+         const std::string& cacheDir)
     : m_queue(queue)
+    , m_cacheDir(cacheDir)
     , m_fop(nullptr)
     , m_isDone(false)
-    , m_thread([this]{ loadBgThread(); }) {
+    , m_task(sched::Priority::Background) {
+    m_task.run([this]{ loadBgThread(); });
   }
 
   ~Worker() {
@@ -53,7 +158,7 @@ public:
       if (m_fop)
         m_fop->stop();
     }
-    m_thread.join();
+    m_task.wait();
   }
 
   void stop() const {
@@ -85,75 +190,29 @@ private:
         ASSERT(m_fop);
       }
 
-      THUMB_TRACE("FOP loading thumbnail: %s\n",
-                  m_item.fileitem->fileName().c_str());
-
-      // Load the file
-      m_fop->operate(nullptr);
-
-      // Don't call post-load because postLoad() needs user interaction.
-      //m_fop->postLoad();
-
-      // Convert the loaded document into the os::Surface.
-      const Sprite* sprite =
-        (m_fop->document() &&
-         m_fop->document()->sprite() ?
-         m_fop->document()->sprite(): nullptr);
-
-      std::unique_ptr<Image> thumbnailImage;
-      std::unique_ptr<Palette> palette;
-      if (!m_fop->isStop() && sprite) {
-        // The palette to convert the Image
-        palette.reset(new Palette(*sprite->palette(frame_t(0))));
-
-        // Special case for indexed images:
-        // If the sprite is transparent -> set the transparent color index alpha = 0
-        if (sprite->colorMode() == ColorMode::INDEXED &&
-            !sprite->backgroundLayer()) {
-          int i = sprite->transparentColor();
-          if (i >= 0 && i < int(palette->size()))
-            palette->setEntry(i, doc::rgba(0, 0, 0, 0));
-        }
+      // Use the cached thumbnail if the file wasn't modified
+      const std::string cacheFn =
+        get_cached_thumbnail_filename(m_cacheDir,
+                                      m_item.fileitem->fileName());
+      std::unique_ptr<Image> thumbnailImage(load_cached_thumbnail(cacheFn));
+      if (!thumbnailImage) {
+        THUMB_TRACE("FOP loading thumbnail: %s\n",
+                    m_item.fileitem->fileName().c_str());
 
-        const int w = sprite->width()*sprite->pixelRatio().w;
-        const int h = sprite->height()*sprite->pixelRatio().h;
+        // Load the file
+        m_fop->operate(nullptr);
 
-        // Calculate the thumbnail size
-        int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
-        int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
-        if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
-          thumb_w = w;
-          thumb_h = h;
-        }
-        thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
-        thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
-
-        // Stretch the 'image'
-        thumbnailImage.reset(
-          Image::create(
-            sprite->pixelFormat(), thumb_w, thumb_h));
-
-        render::Projection proj(sprite->pixelRatio(),
-                                render::Zoom(thumb_w, w));
-        render::Render render;
-        render.setBgOptions(render::BgOptions::MakeTransparent());
-        render.setProjection(proj);
-        render.renderSprite(
-          thumbnailImage.get(), sprite, frame_t(0),
-          gfx::Clip(0, 0, 0, 0, w, h));
-
-        // Convert the image to sRGB color space
-        auto cs = sprite->colorSpace();
-        if (m_fop->preserveColorProfile() &&
-            cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
-          app::cmd::convert_color_profile(
-            thumbnailImage.get(), palette.get(),
-            cs, gfx::ColorSpace::MakeSRGB());
-        }
-      }
+        // Don't call post-load because postLoad() needs user interaction.
+        //m_fop->postLoad();
+
+        thumbnailImage.reset(renderThumbnail());
 
-      // Close file
-      delete m_fop->releaseDocument();
+        // Close file
+        delete m_fop->releaseDocument();
+
+        if (thumbnailImage && !m_fop->isStop() && !cacheFn.empty())
+          save_cached_thumbnail(cacheFn, thumbnailImage.get());
+      }
 
       // Set the thumbnail of the file-item.
       if (thumbnailImage) {
@@ -163,7 +222,7 @@ private:
             thumbnailImage->height());
 
         convert_image_to_surface(
-          thumbnailImage.get(), palette.get(), thumbnail.get(),
+          thumbnailImage.get(), nullptr, thumbnail.get(),
           0, 0, 0, 0, thumbnailImage->width(), thumbnailImage->height());
 
         {
@@ -205,6 +264,54 @@ private:
     ASSERT(!m_fop);
   }
 
+  // Converts the loaded document into a RGB image (in sRGB color
+  // space) of the thumbnail size.
+  Image* renderThumbnail() {
+    const Sprite* sprite =
+      (m_fop->document() &&
+       m_fop->document()->sprite() ?
+       m_fop->document()->sprite(): nullptr);
+    if (m_fop->isStop() || !sprite)
+      return nullptr;
+
+    const int w = sprite->width()*sprite->pixelRatio().w;
+    const int h = sprite->height()*sprite->pixelRatio().h;
+
+    // Calculate the thumbnail size
+    int thumb_w = MAX_THUMBNAIL_SIZE * w / std::max(w, h);
+    int thumb_h = MAX_THUMBNAIL_SIZE * h / std::max(w, h);
+    if (std::max(thumb_w, thumb_h) > std::max(w, h)) {
+      thumb_w = w;
+      thumb_h = h;
+    }
+    thumb_w = std::clamp(thumb_w, 1, MAX_THUMBNAIL_SIZE);
+    thumb_h = std::clamp(thumb_h, 1, MAX_THUMBNAIL_SIZE);
+
+    // Stretch the sprite (the transparent color of indexed sprites
+    // is rendered as transparent pixels)
+    std::unique_ptr<Image> thumbnailImage(
+      Image::create(IMAGE_RGB, thumb_w, thumb_h));
+
+    render::Projection proj(sprite->pixelRatio(),
+                            render::Zoom(thumb_w, w));
+    render::Render render;
+    render.setBgOptions(render::BgOptions::MakeTransparent());
+    render.setProjection(proj);
+    render.renderSprite(
+      thumbnailImage.get(), sprite, frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w, h));
+
+    // Convert the image to sRGB color space
+    auto cs = sprite->colorSpace();
+    if (m_fop->preserveColorProfile() &&
+        cs && !cs->nearlyEqual(*gfx::ColorSpace::MakeSRGB())) {
+      app::cmd::convert_color_profile(
+        thumbnailImage.get(), nullptr,
+        cs, gfx::ColorSpace::MakeSRGB());
+    }
+    return thumbnailImage.release();
+  }
+
   void loadBgThread() {
     while (!m_queue.empty()) {
       bool success = true;
@@ -222,11 +329,12 @@ private:
   }
 
   base::concurrent_queue<Item>& m_queue;
+  const std::string m_cacheDir;
   app::ThumbnailGenerator::Item m_item;
   FileOp* m_fop;
   mutable std::mutex m_mutex;
   std::atomic<bool> m_isDone;
-  std::thread m_thread;
+  sched::TaskGroup m_task;
 };
 
 ThumbnailGenerator* ThumbnailGenerator::instance()
@@ -244,9 +352,18 @@ ThumbnailGenerator* ThumbnailGenerator::instance()
 
 ThumbnailGenerator::ThumbnailGenerator()
 {
-  int n = std::thread::hardware_concurrency()-1;
+  int n = sched::Scheduler::instance().threads()-1;
   if (n < 1) n = 1;
   m_maxWorkers = n;
+
+  ResourceFinder rf;
+  rf.includeUserDir(base::join_path("thumbnails", ".").c_str());
+  try {
+    m_cacheDir = rf.getFirstOrCreateDefault();
+  }
+  catch (const std::exception&) {
+    // Thumbnails will not be cached
+  }
 }
 
 bool ThumbnailGenerator::checkWorkers()
@@ -316,6 +433,10 @@ void ThumbnailGenerator::generateThumbnail(IFileItem* fileitem)
     return;
   }
 
+  // Formats can decode a smaller version of the file (the thumbnail
+  // is rendered with the sprite size anyway)
+  fop->setLoadFitSize(gfx::Size(MAX_THUMBNAIL_SIZE, MAX_THUMBNAIL_SIZE));
+
   m_remainingItems.push(Item(fileitem, fop.get()));
   fop.release();
 
@@ -346,7 +467,8 @@ void ThumbnailGenerator::startWorker()
 {
   std::lock_guard lock(m_workersAccess);
   if (m_workers.size() < m_maxWorkers) {
-    m_workers.push_back(std::make_unique<Worker>(m_remainingItems));
+    m_workers.push_back(std::make_unique<Worker>(m_remainingItems,
+                                                 m_cacheDir));
   }
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 
 #include <memory>
 #include <mutex>
+#include <string>
 #include <vector>
 
 namespace base {
@@ -61,6 +62,8 @@ namespace app {
     };
 
     int m_maxWorkers;
+    // Folder where thumbnails are cached between sessions
+    std::string m_cacheDir;
     WorkerList m_workers;
     std::mutex m_workersAccess;
     base::concurrent_queue<Item> m_remainingItems;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 // Copyright (C) 2016  Carlo Caputo
 //
@@ -10,6 +10,11 @@
 #include "config.h"
 #endif
 
+#include "app/thumbnails.h"
+
+#include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/memory_report.h"
 #include "app/util/conversion_to_surface.h"
 #include "doc/blend_mode.h"
 #include "doc/cel.h"
@@ -18,6 +23,7 @@
 #include "os/surface.h"
 #include "os/system.h"
 #include "render/render.h"
+#include "ui/system.h"
 
 namespace app {
 namespace thumb {
@@ -70,5 +76,160 @@ os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
     return nullptr;
 }
 
+CelThumbnailCache::CelThumbnailCache()
+  : m_alive(std::make_shared<bool>(true))
+  , m_tasks(sched::Priority::Background)
+{
+  m_memoryReportConn = MemoryReport::Collect.connect(
+    [this](MemoryReport& report){
+      std::lock_guard lock(m_mutex);
+      size_t bytes = 0;
+      for (const auto& it : m_thumbnails) {
+        if (const os::SurfaceRef& surface = it.second.surface)
+          bytes += size_t(surface->width()) * surface->height() * 4;
+      }
+      report.add("Cel thumbnails", bytes);
+    });
+}
+
+CelThumbnailCache::~CelThumbnailCache()
+{
+  clear();
+}
+
+os::SurfaceRef CelThumbnailCache::get(Doc* doc,
+                                      const doc::Cel* cel,
+                                      const gfx::Size& fitInSize)
+{
+  const doc::Image* image = cel->image();
+  if (!image)
+    return nullptr;
+
+  const Key key(image->id(), fitInSize.w, fitInSize.h);
+  std::lock_guard lock(m_mutex);
+
+  auto it = m_thumbnails.find(key);
+  if (it == m_thumbnails.end()) {
+    m_lru.push_front(key);
+    it = m_thumbnails.emplace(key, Thumbnail()).first;
+    it->second.lruIt = m_lru.begin();
+    shrink();
+  }
+  else {
+    // Move to the front as the most recently used
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+  }
+
+  Thumbnail& thumb = it->second;
+  if ((thumb.version != image->version() ||
+       thumb.generation != m_generation) &&
+      !thumb.pending) {
+    thumb.pending = true;
+    m_tasks.run([this, doc, celId=cel->id(), key,
+                 version=image->version(),
+                 generation=m_generation]{
+      generate(doc, celId, key, version, generation);
+    });
+  }
+
+  // Old thumbnail (or nullptr) until the new one is ready
+  return thumb.surface;
+}
+
+void CelThumbnailCache::invalidate()
+{
+  std::lock_guard lock(m_mutex);
+  ++m_generation;
+}
+
+void CelThumbnailCache::wait()
+{
+  m_tasks.wait();
+}
+
+void CelThumbnailCache::clear()
+{
+  wait();
+
+  std::lock_guard lock(m_mutex);
+  m_thumbnails.clear();
+  m_lru.clear();
+}
+
+void CelThumbnailCache::generate(Doc* doc,
+                                 const doc::ObjectId celId,
+                                 const Key& key,
+                                 const doc::ObjectVersion version,
+                                 const int generation)
+{
+  // Warning: This is executed from a worker thread
+  os::SurfaceRef surface;
+  bool done = false;
+  try {
+    const DocReader reader(doc, 100);
+
+    // The cel could be deleted or its image modified before this
+    // task was executed (the thumbnail will be requested again)
+    const doc::Cel* cel = doc::get<doc::Cel>(celId);
+    if (cel &&
+        cel->image() &&
+        cel->image()->id() == std::get<0>(key) &&
+        cel->image()->version() == version) {
+      surface = get_cel_thumbnail(cel, gfx::Size(std::get<1>(key),
+                                                 std::get<2>(key)));
+      done = true;
+    }
+  }
+  catch (const LockedDocException&) {
+    // The document is locked by other thread, the thumbnail will be
+    // requested again in the next paint
+  }
+
+  {
+    std::lock_guard lock(m_mutex);
+    auto it = m_thumbnails.find(key);
+    if (it == m_thumbnails.end())
+      return;
+
+    Thumbnail& thumb = it->second;
+    thumb.pending = false;
+    if (!done)
+      return;
+
+    thumb.surface = surface;
+    thumb.version = version;
+    thumb.generation = generation;
+  }
+
+  // Just one notification for several thumbnails
+  if (!m_notifying.exchange(true)) {
+    ui::execute_from_ui_thread(
+      [this, alive=std::weak_ptr<bool>(m_alive)]{
+        if (!alive.lock())
+          return;
+        m_notifying = false;
+        ThumbnailReady();
+      });
+  }
+}
+
+void CelThumbnailCache::shrink()
+{
+  // Delete the least recently used thumbnails (except the ones being
+  // generated right now)
+  auto it = m_lru.end();
+  while (int(m_thumbnails.size()) > kMaxThumbnails &&
+         it != m_lru.begin()) {
+    --it;
+    auto thumbIt = m_thumbnails.find(*it);
+    ASSERT(thumbIt != m_thumbnails.end());
+    if (thumbIt->second.pending)
+      continue;
+
+    m_thumbnails.erase(thumbIt);
+    it = m_lru.erase(it);
+  }
+}
+
 } // thumb
 } // app
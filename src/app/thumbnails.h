@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2020  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2016  Carlo Caputo
 //
 // This program is distributed under the terms of
@@ -9,8 +9,20 @@
 #define APP_THUMBNAILS_H_INCLUDED
 #pragma once
 
+#include "doc/object_id.h"
+#include "doc/object_version.h"
 #include "gfx/size.h"
+#include "obs/connection.h"
+#include "obs/signal.h"
 #include "os/surface.h"
+#include "sched/task_group.h"
+
+#include <atomic>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
 
 namespace doc {
   class Cel;
@@ -21,11 +33,75 @@ namespace os {
 }
 
 namespace app {
+  class Doc;
+
 namespace thumb {
 
   os::SurfaceRef get_cel_thumbnail(const doc::Cel* cel,
                                    const gfx::Size& fitInSize);
 
+  // Cache of cel thumbnails (e.g. for the Timeline) identified by the
+  // cel image ID/version and the thumbnail size. Thumbnails are
+  // generated in a background thread, and meanwhile the previous
+  // thumbnail of the image (or nullptr) is returned, so only the
+  // thumbnails of the modified cels are regenerated.
+  class CelThumbnailCache {
+  public:
+    static constexpr int kMaxThumbnails = 1024;
+
+    CelThumbnailCache();
+    ~CelThumbnailCache();
+
+    // Returns the thumbnail of the given cel of the document. If the
+    // thumbnail is not ready, it's generated in background and
+    // ThumbnailReady is generated (from the UI thread) when it's done.
+    os::SurfaceRef get(Doc* doc,
+                       const doc::Cel* cel,
+                       const gfx::Size& fitInSize);
+
+    // Regenerates all thumbnails (e.g. when the palette changes).
+    void invalidate();
+
+    // Waits the background tasks. It must be called before the
+    // document is deleted.
+    void wait();
+
+    // Waits the background tasks and deletes all thumbnails.
+    void clear();
+
+    obs::signal<void()> ThumbnailReady;
+
+  private:
+    typedef std::tuple<doc::ObjectId, int, int> Key;
+
+    struct Thumbnail {
+      os::SurfaceRef surface;
+      doc::ObjectVersion version = 0;
+      int generation = -1;
+      bool pending = false;
+      std::list<Key>::iterator lruIt;
+    };
+
+    void generate(Doc* doc,
+                  doc::ObjectId celId,
+                  const Key& key,
+                  doc::ObjectVersion version,
+                  int generation);
+    void shrink();
+
+    std::mutex m_mutex;
+    std::map<Key, Thumbnail> m_thumbnails;
+    // From the most recently used to the least one
+    std::list<Key> m_lru;
+    int m_generation = 0;
+    std::atomic<bool> m_notifying = false;
+
+    // Used to know if the cache still exists from UI thread callbacks
+    std::shared_ptr<bool> m_alive;
+    sched::TaskGroup m_tasks;
+    obs::scoped_connection m_memoryReportConn;
+  };
+
 } // thumb
 } // app
 
@@ -0,0 +1,126 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/tools/brush_stamp_cache.h"
+
+#include "doc/algorithm/flip_image.h"
+#include "doc/image.h"
+
+namespace app {
+namespace tools {
+
+using namespace doc;
+
+// static
+BrushStampCache& BrushStampCache::instance()
+{
+  static BrushStampCache cache;
+  return cache;
+}
+
+BrushRef BrushStampCache::getBrush(const BrushType type,
+                                   const int size,
+                                   const int angle,
+                                   const BrushPattern pattern)
+{
+  std::lock_guard lock(m_mutex);
+
+  for (auto it=m_stamps.begin(); it!=m_stamps.end(); ++it) {
+    if (it->type == type &&
+        it->size == size &&
+        it->angle == angle &&
+        it->pattern == pattern) {
+      // Move to the front as the most recently used
+      m_stamps.splice(m_stamps.begin(), m_stamps, it);
+      return m_stamps.front().brush;
+    }
+  }
+
+  auto brush = std::make_shared<Brush>(type, size, angle);
+  brush->setPattern(pattern);
+
+  m_stamps.push_front(Stamp{ type, size, angle, pattern, brush, {} });
+  if (int(m_stamps.size()) > kMaxStamps)
+    m_stamps.pop_back();
+
+  return brush;
+}
+
+BrushStampCache::CompressedImagePtr
+BrushStampCache::getCompressedImage(const Brush* brush,
+                                    const gen::SymmetryMode symmetryMode)
+{
+  {
+    std::lock_guard lock(m_mutex);
+    for (Stamp& stamp : m_stamps) {
+      if (stamp.brush.get() == brush) {
+        auto& compressPtr = stamp.compressedImages[int(symmetryMode)];
+        if (!compressPtr)
+          compressPtr = createCompressedImage(brush, symmetryMode);
+        return compressPtr;
+      }
+    }
+  }
+  return createCompressedImage(brush, symmetryMode);
+}
+
+void BrushStampCache::clear()
+{
+  std::lock_guard lock(m_mutex);
+  m_stamps.clear();
+}
+
+int BrushStampCache::size() const
+{
+  std::lock_guard lock(m_mutex);
+  return int(m_stamps.size());
+}
+
+// static
+BrushStampCache::CompressedImagePtr
+BrushStampCache::createCompressedImage(const Brush* brush,
+                                       const gen::SymmetryMode symmetryMode)
+{
+  if (symmetryMode == gen::SymmetryMode::NONE) {
+    return std::make_shared<CompressedImage>(brush->image(),
+                                             brush->maskBitmap(),
+                                             false);
+  }
+
+  std::unique_ptr<Image> tempImage(Image::createCopy(brush->image()));
+  switch (symmetryMode) {
+    case gen::SymmetryMode::HORIZONTAL:
+      algorithm::flip_image(tempImage.get(),
+                            tempImage->bounds(),
+                            algorithm::FlipType::FlipHorizontal);
+      break;
+    case gen::SymmetryMode::VERTICAL:
+      algorithm::flip_image(tempImage.get(),
+                            tempImage->bounds(),
+                            algorithm::FlipType::FlipVertical);
+      break;
+    case gen::SymmetryMode::BOTH:
+      algorithm::flip_image(tempImage.get(),
+                            tempImage->bounds(),
+                            algorithm::FlipType::FlipVertical);
+      algorithm::flip_image(tempImage.get(),
+                            tempImage->bounds(),
+                            algorithm::FlipType::FlipHorizontal);
+      break;
+    default:
+      break;
+  }
+  return std::make_shared<CompressedImage>(tempImage.get(),
+                                           brush->maskBitmap(),
+                                           false);
+}
+
+} // namespace tools
+} // namespace app
@@ -0,0 +1,70 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_TOOLS_BRUSH_STAMP_CACHE_H_INCLUDED
+#define APP_TOOLS_BRUSH_STAMP_CACHE_H_INCLUDED
+#pragma once
+
+#include "app/pref/preferences.h"
+#include "doc/brush.h"
+#include "doc/compressed_image.h"
+
+#include <array>
+#include <list>
+#include <memory>
+#include <mutex>
+
+namespace app {
+namespace tools {
+
+// Cache of brushes rasterized for dynamics (size/angle changing with
+// the pressure/velocity) and their scanlines, shared between all
+// strokes, so a pressure-varying stroke doesn't regenerate the same
+// brush images for each sample. Cached brushes must not be modified.
+class BrushStampCache {
+public:
+  typedef std::shared_ptr<doc::CompressedImage> CompressedImagePtr;
+
+  static constexpr int kMaxStamps = 64;
+
+  static BrushStampCache& instance();
+
+  // Returns a brush with the given parameters (the most recently used
+  // brushes are kept in the cache).
+  doc::BrushRef getBrush(doc::BrushType type, int size, int angle,
+                         doc::BrushPattern pattern);
+
+  // Returns the scanlines of the brush flipped by the given symmetry
+  // mode. If the brush is not in the cache, the scanlines are
+  // created each time.
+  CompressedImagePtr getCompressedImage(const doc::Brush* brush,
+                                        gen::SymmetryMode symmetryMode);
+
+  void clear();
+  int size() const;
+
+  static CompressedImagePtr createCompressedImage(const doc::Brush* brush,
+                                                  gen::SymmetryMode symmetryMode);
+
+private:
+  struct Stamp {
+    doc::BrushType type;
+    int size;
+    int angle;
+    doc::BrushPattern pattern;
+    doc::BrushRef brush;
+    std::array<CompressedImagePtr, 4> compressedImages;
+  };
+
+  // From the most recently used to the least one
+  std::list<Stamp> m_stamps;
+  mutable std::mutex m_mutex;
+};
+
+} // namespace tools
+} // namespace app
+
+#endif
@@ -0,0 +1,48 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/tools/brush_stamp_cache.h"
+
+using namespace app;
+using namespace app::tools;
+using namespace doc;
+
+TEST(BrushStampCache, ShareBrushes)
+{
+  BrushStampCache cache;
+
+  BrushRef a = cache.getBrush(kCircleBrushType, 16, 0, BrushPattern::DEFAULT);
+  BrushRef b = cache.getBrush(kCircleBrushType, 16, 0, BrushPattern::DEFAULT);
+  BrushRef c = cache.getBrush(kSquareBrushType, 16, 45, BrushPattern::DEFAULT);
+  EXPECT_EQ(a, b);
+  EXPECT_NE(a, c);
+  EXPECT_EQ(16, c->size());
+  EXPECT_EQ(45, c->angle());
+  EXPECT_EQ(2, cache.size());
+
+  auto ca = cache.getCompressedImage(a.get(), gen::SymmetryMode::NONE);
+  EXPECT_EQ(ca, cache.getCompressedImage(b.get(), gen::SymmetryMode::NONE));
+  EXPECT_NE(ca, cache.getCompressedImage(a.get(), gen::SymmetryMode::VERTICAL));
+}
+
+TEST(BrushStampCache, RemoveLeastRecentlyUsed)
+{
+  BrushStampCache cache;
+
+  BrushRef first = cache.getBrush(kCircleBrushType, 1, 0, BrushPattern::DEFAULT);
+  for (int size=2; size<=BrushStampCache::kMaxStamps; ++size)
+    cache.getBrush(kCircleBrushType, size, 0, BrushPattern::DEFAULT);
+  EXPECT_EQ(BrushStampCache::kMaxStamps, cache.size());
+
+  // Use the first brush again so the second one is removed
+  EXPECT_EQ(first, cache.getBrush(kCircleBrushType, 1, 0, BrushPattern::DEFAULT));
+  cache.getBrush(kCircleBrushType, BrushStampCache::kMaxStamps+1, 0, BrushPattern::DEFAULT);
+
+  EXPECT_EQ(BrushStampCache::kMaxStamps, cache.size());
+  EXPECT_EQ(first, cache.getBrush(kCircleBrushType, 1, 0, BrushPattern::DEFAULT));
+}
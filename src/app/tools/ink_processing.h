@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -22,6 +22,17 @@
 #include "render/dithering.h"
 #include "render/gradient.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+// SSE2 is always available on x64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define APP_INK_PROCESSING_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 namespace app {
 namespace tools {
 
@@ -73,20 +84,38 @@ public:
         x2 = maskOrigin.x+maskBounds.w-1;
 
       if (Image* bitmap = loop->getMask()->bitmap()) {
-        static_cast<Derived*>(this)->initIterators(loop, x1, y);
+        // Process each run of pixels inside the mask
+        const uint8_t* bits = bitmap->getPixelAddress(0, y-maskOrigin.y);
+        auto inside = [bits, &maskOrigin](int u) {
+          u -= maskOrigin.x;
+          return ((bits[u >> 3] & (1 << (u & 7))) != 0);
+        };
 
         for (x=x1; x<=x2; ++x) {
-          if (bitmap->getPixel(x-maskOrigin.x, y-maskOrigin.y))
-            static_cast<Derived*>(this)->processPixel(x, y);
+          if (!inside(x))
+            continue;
+
+          int runX2 = x;
+          while (runX2 < x2 && inside(runX2+1))
+            ++runX2;
 
-          static_cast<Derived*>(this)->moveIterators();
+          static_cast<Derived*>(this)->initIterators(loop, x, y);
+          static_cast<Derived*>(this)->processSpan(x, y, runX2);
+          x = runX2;
         }
         return;
       }
     }
 
     static_cast<Derived*>(this)->initIterators(loop, x1, y);
-    for (x=x1; x<=x2; ++x) {
+    static_cast<Derived*>(this)->processSpan(x1, y, x2);
+  }
+
+  // Processes the pixels in [x1, x2] of the row y (with the iterators
+  // in x1). Inks can hide this member function to process the whole
+  // span at once (e.g. with a specialized RGBA kernel).
+  void processSpan(int x1, int y, int x2) {
+    for (int x=x1; x<=x2; ++x) {
       static_cast<Derived*>(this)->processPixel(x, y);
       static_cast<Derived*>(this)->moveIterators();
     }
@@ -126,6 +155,45 @@ protected:
   typename ImageTraits::address_t m_dstAddress;
 };
 
+//////////////////////////////////////////////////////////////////////
+// RGBA span kernels
+//////////////////////////////////////////////////////////////////////
+
+// Blends each source pixel with "func", reusing the last result for
+// runs of equal source pixels (which are common in flat areas).
+template<typename Func>
+void blend_rgba_span(const uint32_t* src, uint32_t* dst, int n, Func func)
+{
+  color_t prevSrc = *src;
+  color_t prevDst = func(prevSrc);
+  for (int i=0; i<n; ++i) {
+    const color_t c = src[i];
+    if (c != prevSrc) {
+      prevSrc = c;
+      prevDst = func(c);
+    }
+    dst[i] = prevDst;
+  }
+}
+
+// dst = (color & rgb) | (src & alpha)
+void lock_alpha_rgba_span(const uint32_t* src, uint32_t* dst, int n, color_t color)
+{
+  color &= rgba_rgb_mask;
+  int i = 0;
+#if APP_INK_PROCESSING_SSE2
+  const __m128i rgb = _mm_set1_epi32(int(color));
+  const __m128i alpha = _mm_set1_epi32(int(rgba_a_mask));
+  for (; i+4<=n; i+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(src+i));
+    _mm_storeu_si128((__m128i*)(dst+i),
+                     _mm_or_si128(rgb, _mm_and_si128(c, alpha)));
+  }
+#endif
+  for (; i<n; ++i)
+    dst[i] = color | (src[i] & rgba_a_mask);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Copy Ink
 //////////////////////////////////////////////////////////////////////
@@ -151,6 +219,13 @@ public:
     *this->m_dstAddress = m_color;
   }
 
+  void processSpan(int x1, int y, int x2) {
+    const int n = x2-x1+1;
+    std::fill_n(this->m_dstAddress, n,
+                typename ImageTraits::pixel_t(m_color));
+    this->m_dstAddress += n;
+  }
+
 private:
   color_t m_color;
 };
@@ -174,6 +249,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x1, int y, int x2) {
+    this->InkProcessing<LockAlphaInkProcessing<ImageTraits>>::processSpan(x1, y, x2);
+  }
+
 private:
   color_t m_color;
   const int m_opacity;
@@ -189,6 +268,28 @@ void LockAlphaInkProcessing<RgbTraits>::processPixel(int x, int y) {
     rgba_geta(*m_srcAddress));
 }
 
+template<>
+void LockAlphaInkProcessing<RgbTraits>::processSpan(int x1, int y, int x2) {
+  const int n = x2-x1+1;
+  int t;
+  if (MUL_UN8(rgba_geta(m_color), m_opacity, t) == 255) {
+    lock_alpha_rgba_span(m_srcAddress, m_dstAddress, n, m_color);
+  }
+  else {
+    blend_rgba_span(
+      m_srcAddress, m_dstAddress, n,
+      [this](color_t c) -> color_t {
+        color_t result = rgba_blender_normal(c, m_color, m_opacity);
+        return doc::rgba(rgba_getr(result),
+                         rgba_getg(result),
+                         rgba_getb(result),
+                         rgba_geta(c));
+      });
+  }
+  m_srcAddress += n;
+  m_dstAddress += n;
+}
+
 template<>
 void LockAlphaInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   color_t result = graya_blender_normal(*m_srcAddress, m_color, m_opacity);
@@ -254,6 +355,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x1, int y, int x2) {
+    this->InkProcessing<TransparentInkProcessing<ImageTraits>>::processSpan(x1, y, x2);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -264,6 +369,25 @@ void TransparentInkProcessing<RgbTraits>::processPixel(int x, int y) {
   *m_dstAddress = rgba_blender_normal(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void TransparentInkProcessing<RgbTraits>::processSpan(int x1, int y, int x2) {
+  const int n = x2-x1+1;
+  int t;
+  if (MUL_UN8(rgba_geta(m_color), m_opacity, t) == 255) {
+    // An opaque color replaces all pixels
+    std::fill_n(m_dstAddress, n, m_color);
+  }
+  else {
+    blend_rgba_span(
+      m_srcAddress, m_dstAddress, n,
+      [this](color_t c) -> color_t {
+        return rgba_blender_normal(c, m_color, m_opacity);
+      });
+  }
+  m_srcAddress += n;
+  m_dstAddress += n;
+}
+
 template<>
 void TransparentInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_normal(*m_srcAddress, m_color, m_opacity);
@@ -326,6 +450,10 @@ public:
     // Do nothing
   }
 
+  void processSpan(int x1, int y, int x2) {
+    this->InkProcessing<MergeInkProcessing<ImageTraits>>::processSpan(x1, y, x2);
+  }
+
 private:
   color_t m_color;
   int m_opacity;
@@ -336,6 +464,25 @@ void MergeInkProcessing<RgbTraits>::processPixel(int x, int y) {
   *m_dstAddress = rgba_blender_merge(*m_srcAddress, m_color, m_opacity);
 }
 
+template<>
+void MergeInkProcessing<RgbTraits>::processSpan(int x1, int y, int x2) {
+  const int n = x2-x1+1;
+  if (m_opacity == 255) {
+    // With full opacity the result is the color (or 0 if the color
+    // is transparent)
+    std::fill_n(m_dstAddress, n, (m_color & rgba_a_mask) ? m_color: 0);
+  }
+  else {
+    blend_rgba_span(
+      m_srcAddress, m_dstAddress, n,
+      [this](color_t c) -> color_t {
+        return rgba_blender_merge(c, m_color, m_opacity);
+      });
+  }
+  m_srcAddress += n;
+  m_dstAddress += n;
+}
+
 template<>
 void MergeInkProcessing<GrayscaleTraits>::processPixel(int x, int y) {
   *m_dstAddress = graya_blender_merge(*m_srcAddress, m_color, m_opacity);
@@ -380,6 +527,56 @@ private:
 // Blur Ink
 //////////////////////////////////////////////////////////////////////
 
+// Calls func(sums) for each pixel in [x1,x2] of the row y with the
+// "sums" of its 3x3 neighboring pixels (the same pixels visited by
+// get_neighboring_pixels()). The 3 rows of each column are added
+// only once, and the window is moved to the right adding one column
+// and subtracting other one (instead of adding 9 pixels for each
+// pixel). "Sums" is a delegate of get_neighboring_pixels() with += and
+// -= operators, and "zero" is a reset instance of it.
+template<typename ImageTraits, typename Sums, typename Func>
+void for_each_blur_window(const Image* srcImage,
+                          const TiledMode tiledMode,
+                          const int x1, const int y, const int x2,
+                          const Sums& zero,
+                          std::vector<Sums>& columns,
+                          Func func)
+{
+  using const_address_t = typename ImageTraits::const_address_t;
+
+  const int w = srcImage->width();
+  const int h = srcImage->height();
+  const bool tiledX = (int(tiledMode) & int(TiledMode::X_AXIS));
+  const bool tiledY = (int(tiledMode) & int(TiledMode::Y_AXIS));
+
+  const_address_t rows[3];
+  for (int i=0; i<3; ++i)
+    rows[i] = (const_address_t)srcImage->getPixelAddress(
+      0, get_neighboring_coord(y-1+i, h, tiledY));
+
+  // Columns from x1-1 to x2+1
+  const int n = x2-x1+3;
+  columns.assign(n, zero);
+  for (int i=0; i<n; ++i) {
+    const int u = get_neighboring_coord(x1-1+i, w, tiledX);
+    Sums& s = columns[i];
+    s(rows[0][u]);
+    s(rows[1][u]);
+    s(rows[2][u]);
+  }
+
+  Sums window = columns[0];
+  window += columns[1];
+  window += columns[2];
+  for (int i=0; ; ++i) {
+    func(window);
+    if (i == n-3)
+      break;
+    window -= columns[i];
+    window += columns[i+3];
+  }
+}
+
 template<typename ImageTraits>
 class BlurInkProcessing : public DoubleInkProcessing<BlurInkProcessing<ImageTraits>, ImageTraits> {
 public:
@@ -397,48 +594,110 @@ public:
     m_opacity(loop->getOpacity()),
     m_tiledMode(loop->getTiledMode()),
     m_srcImage(loop->getSrcImage()) {
+    m_area.reset();
   }
 
   void processPixel(int x, int y) {
-    m_area.reset();
-    get_neighboring_pixels<RgbTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, m_area);
+    GetPixelsDelegate area = m_area;
+    get_neighboring_pixels<RgbTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, area);
+    blurPixel(area);
+  }
 
-    if (m_area.count > 0) {
-      m_area.r /= m_area.count;
-      m_area.g /= m_area.count;
-      m_area.b /= m_area.count;
-      m_area.a /= 9;
-      *m_dstAddress =
-        rgba_blender_merge(*m_srcAddress,
-                           doc::rgba(m_area.r, m_area.g, m_area.b, m_area.a),
-                           m_opacity);
-    }
-    else {
-      *m_dstAddress = *m_srcAddress;
-    }
+  void processSpan(int x1, int y, int x2) {
+    for_each_blur_window<RgbTraits>(
+      m_srcImage, m_tiledMode, x1, y, x2, m_area, m_columns,
+      [this](const GetPixelsDelegate& area){
+        blurPixel(area);
+        moveIterators();
+      });
   }
 
 private:
+  // Sums of the RGBA components of the non-transparent pixels (with
+  // SSE2 the 4 components are added at the same time in each lane)
   struct GetPixelsDelegate {
-    int count, r, g, b, a;
-
-    void reset() { count = r = g = b = a = 0; }
+#if APP_INK_PROCESSING_SSE2
+    __m128i rgba;
+#else
+    int r, g, b, a;
+#endif
+    int count;
+
+    void reset() {
+#if APP_INK_PROCESSING_SSE2
+      rgba = _mm_setzero_si128();
+#else
+      r = g = b = a = 0;
+#endif
+      count = 0;
+    }
 
     void operator()(RgbTraits::pixel_t color) {
       if (rgba_geta(color) != 0) {
+#if APP_INK_PROCESSING_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        rgba = _mm_add_epi32(
+          rgba,
+          _mm_unpacklo_epi16(
+            _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(color)), zero), zero));
+#else
         r += rgba_getr(color);
         g += rgba_getg(color);
         b += rgba_getb(color);
         a += rgba_geta(color);
+#endif
         ++count;
       }
     }
+
+    GetPixelsDelegate& operator+=(const GetPixelsDelegate& o) {
+#if APP_INK_PROCESSING_SSE2
+      rgba = _mm_add_epi32(rgba, o.rgba);
+#else
+      r += o.r; g += o.g; b += o.b; a += o.a;
+#endif
+      count += o.count;
+      return *this;
+    }
+
+    GetPixelsDelegate& operator-=(const GetPixelsDelegate& o) {
+#if APP_INK_PROCESSING_SSE2
+      rgba = _mm_sub_epi32(rgba, o.rgba);
+#else
+      r -= o.r; g -= o.g; b -= o.b; a -= o.a;
+#endif
+      count -= o.count;
+      return *this;
+    }
   };
 
+  void blurPixel(const GetPixelsDelegate& area) {
+    if (area.count > 0) {
+#if APP_INK_PROCESSING_SSE2
+      alignas(16) int v[4];
+      _mm_store_si128((__m128i*)v, area.rgba);
+      const int r = v[0], g = v[1], b = v[2], a = v[3];
+#else
+      const int r = area.r, g = area.g, b = area.b, a = area.a;
+#endif
+      *m_dstAddress =
+        rgba_blender_merge(*m_srcAddress,
+                           doc::rgba(r / area.count,
+                                     g / area.count,
+                                     b / area.count,
+                                     a / 9),
+                           m_opacity);
+    }
+    else {
+      *m_dstAddress = *m_srcAddress;
+    }
+  }
+
   int m_opacity;
   TiledMode m_tiledMode;
   const Image* m_srcImage;
   GetPixelsDelegate m_area;
+  std::vector<GetPixelsDelegate> m_columns;
 };
 
 template<>
@@ -448,23 +707,22 @@ public:
     m_opacity(loop->getOpacity()),
     m_tiledMode(loop->getTiledMode()),
     m_srcImage(loop->getSrcImage()) {
+    m_area.reset();
   }
 
   void processPixel(int x, int y) {
-    m_area.reset();
-    get_neighboring_pixels<GrayscaleTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, m_area);
+    GetPixelsDelegate area = m_area;
+    get_neighboring_pixels<GrayscaleTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, area);
+    blurPixel(area);
+  }
 
-    if (m_area.count > 0) {
-      m_area.v /= m_area.count;
-      m_area.a /= 9;
-      *m_dstAddress =
-        graya_blender_merge(*m_srcAddress,
-                            graya(m_area.v, m_area.a),
-                            m_opacity);
-    }
-    else {
-      *m_dstAddress = *m_srcAddress;
-    }
+  void processSpan(int x1, int y, int x2) {
+    for_each_blur_window<GrayscaleTraits>(
+      m_srcImage, m_tiledMode, x1, y, x2, m_area, m_columns,
+      [this](const GetPixelsDelegate& area){
+        blurPixel(area);
+        moveIterators();
+      });
   }
 
 private:
@@ -481,12 +739,35 @@ private:
         ++count;
       }
     }
+
+    GetPixelsDelegate& operator+=(const GetPixelsDelegate& o) {
+      count += o.count; v += o.v; a += o.a;
+      return *this;
+    }
+
+    GetPixelsDelegate& operator-=(const GetPixelsDelegate& o) {
+      count -= o.count; v -= o.v; a -= o.a;
+      return *this;
+    }
   };
 
+  void blurPixel(const GetPixelsDelegate& area) {
+    if (area.count > 0) {
+      *m_dstAddress =
+        graya_blender_merge(*m_srcAddress,
+                            graya(area.v / area.count, area.a / 9),
+                            m_opacity);
+    }
+    else {
+      *m_dstAddress = *m_srcAddress;
+    }
+  }
+
   int m_opacity;
   TiledMode m_tiledMode;
   const Image* m_srcImage;
   GetPixelsDelegate m_area;
+  std::vector<GetPixelsDelegate> m_columns;
 };
 
 template<>
@@ -500,28 +781,22 @@ public:
     m_srcImage(loop->getSrcImage()),
     m_area(loop->getPalette(),
            loop->getLayer()->isBackground() ? -1: loop->sprite()->transparentColor()) {
+    m_area.reset();
   }
 
   void processPixel(int x, int y) {
-    m_area.reset();
-    get_neighboring_pixels<IndexedTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, m_area);
-
-    if (m_area.count > 0) {
-      m_area.r /= m_area.count;
-      m_area.g /= m_area.count;
-      m_area.b /= m_area.count;
-      m_area.a /= 9;
-
-      const color_t c =
-        rgba_blender_merge(m_palette->getEntry(*m_srcAddress),
-                           doc::rgba(m_area.r, m_area.g, m_area.b, m_area.a),
-                           m_opacity);
+    GetPixelsDelegate area = m_area;
+    get_neighboring_pixels<IndexedTraits>(m_srcImage, x, y, 3, 3, 1, 1, m_tiledMode, area);
+    blurPixel(area);
+  }
 
-      *m_dstAddress = m_rgbmap->mapColor(c);
-    }
-    else {
-      *m_dstAddress = *m_srcAddress;
-    }
+  void processSpan(int x1, int y, int x2) {
+    for_each_blur_window<IndexedTraits>(
+      m_srcImage, m_tiledMode, x1, y, x2, m_area, m_columns,
+      [this](const GetPixelsDelegate& area){
+        blurPixel(area);
+        moveIterators();
+      });
   }
 
 private:
@@ -550,14 +825,42 @@ private:
         ++count;
       }
     }
+
+    GetPixelsDelegate& operator+=(const GetPixelsDelegate& o) {
+      count += o.count; r += o.r; g += o.g; b += o.b; a += o.a;
+      return *this;
+    }
+
+    GetPixelsDelegate& operator-=(const GetPixelsDelegate& o) {
+      count -= o.count; r -= o.r; g -= o.g; b -= o.b; a -= o.a;
+      return *this;
+    }
   };
 
+  void blurPixel(const GetPixelsDelegate& area) {
+    if (area.count > 0) {
+      const color_t c =
+        rgba_blender_merge(m_palette->getEntry(*m_srcAddress),
+                           doc::rgba(area.r / area.count,
+                                     area.g / area.count,
+                                     area.b / area.count,
+                                     area.a / 9),
+                           m_opacity);
+
+      *m_dstAddress = m_rgbmap->mapColor(c);
+    }
+    else {
+      *m_dstAddress = *m_srcAddress;
+    }
+  }
+
   const Palette* m_palette;
   const RgbMap* m_rgbmap;
   int m_opacity;
   TiledMode m_tiledMode;
   const Image* m_srcImage;
   GetPixelsDelegate m_area;
+  std::vector<GetPixelsDelegate> m_columns;
 };
 
 //////////////////////////////////////////////////////////////////////
@@ -663,7 +966,9 @@ public:
     m_tiledMode(loop->getTiledMode()),
     m_srcImage(loop->getSrcImage()),
     m_srcImageWidth(m_srcImage->width()),
-    m_srcImageHeight(m_srcImage->height()) {
+    m_srcImageHeight(m_srcImage->height()),
+    m_random(uint32_t(std::rand()) | 1),
+    m_randomDigits(0) {
   }
 
   void processPixel(int x, int y) {
@@ -671,9 +976,28 @@ public:
   }
 
 private:
+  // Returns a random offset in the [-1,+1] range for each axis. Each
+  // random number (from a xorshift generator instead of rand()) is
+  // used for 10 pixels, taking a random digit in base 9 for each
+  // pixel (9^10 < 2^32).
+  gfx::Point nextOffset() {
+    if (m_randomDigits == 0) {
+      m_random ^= m_random << 13;
+      m_random ^= m_random >> 17;
+      m_random ^= m_random << 5;
+      m_randomValue = m_random;
+      m_randomDigits = 10;
+    }
+    const int v = int(m_randomValue % 9);
+    m_randomValue /= 9;
+    --m_randomDigits;
+    return gfx::Point(v % 3 - 1, v / 3 - 1);
+  }
+
   void pickColorFromArea(int x, int y) {
-    gfx::Point pt(x + (rand() % 3)-1 - m_speed.x,
-                  y + (rand() % 3)-1 - m_speed.y);
+    const gfx::Point offset = nextOffset();
+    gfx::Point pt(x + offset.x - m_speed.x,
+                  y + offset.y - m_speed.y);
 
     pt = wrap_point(m_tiledMode,
                     gfx::Size(m_srcImageWidth,
@@ -695,6 +1019,9 @@ private:
   int m_srcImageWidth;
   int m_srcImageHeight;
   color_t m_color;
+  uint32_t m_random;
+  uint32_t m_randomValue;
+  int m_randomDigits;
 };
 
 template<>
@@ -764,27 +1091,41 @@ public:
   }
 
   pixel_t operator()(const pixel_t src) const {
+    // Brush strokes visit runs of pixels with the same color, so we
+    // reuse the last result instead of looking for the color in the
+    // shade palette again.
+    if (m_hasLast && src == m_lastSrc)
+      return m_lastDst;
+
     int i = findIndex(rgba_getr(src),
                       rgba_getg(src),
                       rgba_getb(src),
                       rgba_geta(src));
-    if (i < 0)
-      return src;
-
-    if (m_left) {
-      if (i > 0)
-        --i;
-    }
-    else {
-      if (i < m_shadePalette.size()-1)
-        ++i;
+    pixel_t dst = src;
+    if (i >= 0) {
+      if (m_left) {
+        if (i > 0)
+          --i;
+      }
+      else {
+        if (i < m_shadePalette.size()-1)
+          ++i;
+      }
+      dst = m_shadePalette.getEntry(i);
     }
-    return m_shadePalette.getEntry(i);
+
+    m_hasLast = true;
+    m_lastSrc = src;
+    m_lastDst = dst;
+    return dst;
   }
 
 private:
   Palette m_shadePalette;
   bool m_left;
+  mutable bool m_hasLast = false;
+  mutable pixel_t m_lastSrc = 0;
+  mutable pixel_t m_lastDst = 0;
 };
 
 template<>
@@ -818,29 +1159,41 @@ public:
   }
 
   pixel_t operator()(const pixel_t src) const {
+    // Reuse the last result for runs of pixels with the same color
+    if (m_hasLast && src == m_lastSrc)
+      return m_lastDst;
+
     int i = findIndex(graya_getv(src),
                       graya_getv(src),
                       graya_getv(src),
                       graya_geta(src));
-    if (i < 0)
-      return src;
+    pixel_t dst = src;
+    if (i >= 0) {
+      if (m_left) {
+        if (i > 0)
+          --i;
+      }
+      else {
+        if (i < m_shadePalette.size()-1)
+          ++i;
+      }
 
-    if (m_left) {
-      if (i > 0)
-        --i;
-    }
-    else {
-      if (i < m_shadePalette.size()-1)
-        ++i;
+      color_t rgba = m_shadePalette.getEntry(i);
+      dst = graya(rgba_getr(rgba), rgba_geta(rgba));
     }
 
-    color_t rgba = m_shadePalette.getEntry(i);
-    return graya(rgba_getr(rgba), rgba_geta(rgba));
+    m_hasLast = true;
+    m_lastSrc = src;
+    m_lastDst = dst;
+    return dst;
   }
 
 private:
   Palette m_shadePalette;
   bool m_left;
+  mutable bool m_hasLast = false;
+  mutable pixel_t m_lastSrc = 0;
+  mutable pixel_t m_lastDst = 0;
 };
 
 template<>
@@ -849,9 +1202,28 @@ public:
   using pixel_t = IndexedTraits::pixel_t;
 
   PixelShadingInkHelper(ToolLoop* loop) :
-    m_palette(loop->getPalette()),
-    m_remap(loop->getShadingRemap()),
-    m_left(loop->getMouseButton() == ToolLoop::Left) {
+    m_palette(loop->getPalette()) {
+    // Table with the new index of each possible index for this shade
+    // (the remap of the shade, or the previous/next palette entry)
+    const Remap* remap = loop->getShadingRemap();
+    const bool left = (loop->getMouseButton() == ToolLoop::Left);
+    for (int i=0; i<256; ++i) {
+      int j = i;
+      if (remap) {
+        j = (*remap)[i];
+      }
+      else {
+        if (left) {
+          if (j > 0)
+            --j;
+        }
+        else {
+          if (j < m_palette->size()-1)
+            ++j;
+        }
+      }
+      m_table[i] = pixel_t(j);
+    }
   }
 
   int findIndex(uint8_t r, uint8_t g, uint8_t b, uint8_t a) const {
@@ -859,26 +1231,12 @@ public:
   }
 
   pixel_t operator()(pixel_t i) const {
-    if (m_remap) {
-      i = (*m_remap)[i];
-    }
-    else {
-      if (m_left) {
-        if (i > 0)
-          --i;
-      }
-      else {
-        if (i < m_palette->size()-1)
-          ++i;
-      }
-    }
-    return i;
+    return m_table[i];
   }
 
 private:
   const Palette* m_palette;
-  const Remap* m_remap;
-  bool m_left;
+  pixel_t m_table[256];
 };
 
 //////////////////////////////////////////////////////////////////////
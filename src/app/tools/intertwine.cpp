@@ -68,18 +68,13 @@ void Intertwine::doPointshapeStrokePt(const Stroke::Pt& pt, ToolLoop* loop)
 {
   Symmetry* symmetry = loop->getSymmetry();
   if (symmetry) {
-    // Convert the point to the sprite position so we can apply the
-    // symmetry transformation.
-    Stroke main_stroke;
-    main_stroke.addPoint(pt);
-
-    Strokes strokes;
-    symmetry->generateStrokes(main_stroke, strokes, loop);
-    for (const auto& stroke : strokes) {
-      // We call transformPoint() moving back each point to the cel
-      // origin.
-      doTransformPoint(stroke[0], loop);
-    }
+    // Generate all the symmetrical points in one batch (this is
+    // called for each point of the stroke, so we avoid creating
+    // temporary strokes).
+    Stroke::Pt points[Symmetry::kMaxCopies];
+    const int n = symmetry->generatePoints(pt, points, loop);
+    for (int i=0; i<n; ++i)
+      doTransformPoint(points[i], loop);
   }
   else {
     doTransformPoint(pt, loop);
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -92,12 +92,17 @@ class IntertwineAsLines : public Intertwine {
   // first pixel of the line algorithm)
   bool m_firstStroke = true;
 
+  // Polygon to fill the stroke, it's reused to avoid calculating the
+  // border pixels of the previous stroke points again.
+  doc::algorithm::Polygon m_polygon;
+
 public:
   bool snapByAngle() override { return true; }
 
   void prepareIntertwine(ToolLoop* loop) override {
     m_retainedTracePolicyLast = false;
     m_firstStroke = true;
+    m_polygon.clear();
   }
 
   void joinStroke(ToolLoop* loop, const Stroke& stroke) override {
@@ -171,9 +176,8 @@ public:
 
     // Fill content
     auto v = stroke.toXYInts();
-    doc::algorithm::polygon(
-      v.size()/2, &v[0],
-      loop, (AlgoHLine)doPointshapeHline);
+    m_polygon.setVertices(v.size()/2, v.data());
+    m_polygon.rasterize(loop, (AlgoHLine)doPointshapeHline);
   }
 
 };
@@ -431,6 +435,7 @@ class IntertwineAsPixelPerfect : public Intertwine {
   bool m_retainedTracePolicyLast = false;
   Stroke m_pts;
   bool m_saveStrokeArea = false;
+  doc::algorithm::Polygon m_polygon;
 
   // Helper struct to store an image's area that will be affected by the stroke
   // point at the specified position of the original image.
@@ -464,6 +469,7 @@ public:
 
   void prepareIntertwine(ToolLoop* loop) override {
     m_pts.reset();
+    m_polygon.clear();
     m_retainedTracePolicyLast = false;
     m_grid = m_dstGrid = m_celGrid = loop->getGrid();
     m_restoredRegion.clear();
@@ -579,9 +585,8 @@ public:
 
     // Fill content
     auto v = m_pts.toXYInts();
-    doc::algorithm::polygon(
-      v.size()/2, &v[0],
-      loop, (AlgoHLine)doPointshapeHline);
+    m_polygon.setVertices(v.size()/2, v.data());
+    m_polygon.rasterize(loop, (AlgoHLine)doPointshapeHline);
   }
 
   gfx::Region forceTilemapRegionToValidate() override {
@@ -7,8 +7,8 @@
 
 #include "app/util/wrap_point.h"
 
+#include "app/tools/brush_stamp_cache.h"
 #include "app/tools/ink.h"
-#include "doc/algorithm/flip_image.h"
 #include "render/gradient.h"
 
 #include <array>
@@ -177,15 +177,16 @@ public:
       if ((brush->size() != size) ||
           (brush->angle() != angle && m_origBrushType != kCircleBrushType) ||
           (m_hasDynamicGradient && pt.gradient != m_lastGradientValue)) {
-        // TODO cache brushes
-        BrushRef newBrush = std::make_shared<Brush>(
-          m_origBrushType, size, angle);
+        BrushRef newBrush;
 
         // Dynamic gradient with dithering
         bool prepareInk = false;
         if (m_hasDynamicGradient && !ink->isEraser() &&
             (m_dynamics.ditheringMatrix.rows() > 1 ||
              m_dynamics.ditheringMatrix.cols() > 1)) {
+          // The brush image depends on the gradient value, so it
+          // cannot be shared with other points
+          newBrush = std::make_shared<Brush>(m_origBrushType, size, angle);
           convert_bitmap_brush_to_dithering_brush(
             newBrush.get(),
             loop->sprite()->pixelFormat(),
@@ -195,6 +196,10 @@ public:
             m_primaryColor);
           prepareInk = true;
         }
+        else {
+          newBrush = BrushStampCache::instance().getBrush(
+            m_origBrushType, size, angle, brush->pattern());
+        }
         m_lastGradientValue = pt.gradient;
 
         loop->setBrush(newBrush);
@@ -207,7 +212,8 @@ public:
       }
     }
 
-    // TODO cache compressed images (or remove them completelly)
+    // The compressed images of cached brushes are shared between
+    // strokes (see BrushStampCache)
     if (m_lastBrush != brush) {
       m_lastBrush = brush;
       m_compressedImages.fill(nullptr);
@@ -261,40 +267,8 @@ private:
   CompressedImage& getCompressedImage(gen::SymmetryMode symmetryMode) {
     auto& compressPtr = m_compressedImages[int(symmetryMode)];
     if (!compressPtr) {
-      switch (symmetryMode) {
-        case gen::SymmetryMode::NONE: {
-          compressPtr.reset(new CompressedImage(m_lastBrush->image(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
-          break;
-        }
-        case gen::SymmetryMode::HORIZONTAL:
-        case gen::SymmetryMode::VERTICAL: {
-          std::unique_ptr<Image> tempImage(Image::createCopy(m_lastBrush->image()));
-          doc::algorithm::FlipType flip =
-            (symmetryMode == gen::SymmetryMode::HORIZONTAL)?
-              doc::algorithm::FlipType::FlipHorizontal:
-              doc::algorithm::FlipType::FlipVertical;
-          doc::algorithm::flip_image(tempImage.get(), tempImage->bounds(), flip);
-          compressPtr.reset(new CompressedImage(tempImage.get(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
-          break;
-        }
-        case gen::SymmetryMode::BOTH: {
-          std::unique_ptr<Image> tempImage(Image::createCopy(m_lastBrush->image()));
-          doc::algorithm::flip_image(tempImage.get(),
-                                     tempImage->bounds(),
-                                     doc::algorithm::FlipType::FlipVertical);
-          doc::algorithm::flip_image(tempImage.get(),
-                                     tempImage->bounds(),
-                                     doc::algorithm::FlipType::FlipHorizontal);
-          compressPtr.reset(new CompressedImage(tempImage.get(),
-                                                m_lastBrush->maskBitmap(),
-                                                false));
-          break;
-        }
-      }
+      compressPtr = BrushStampCache::instance()
+        .getCompressedImage(m_lastBrush, symmetryMode);
     }
     return *compressPtr;
   }
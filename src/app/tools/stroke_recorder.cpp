@@ -0,0 +1,118 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/tools/stroke_recorder.h"
+
+#include "app/pref/preferences.h"
+#include "app/tools/ink_type.h"
+#include "app/tools/tool.h"
+#include "app/tools/tool_loop.h"
+#include "base/fstream_path.h"
+#include "doc/brush.h"
+#include "fmt/format.h"
+
+#include <memory>
+
+namespace app {
+namespace tools {
+
+static std::unique_ptr<StrokeRecorder> g_recorder;
+
+// static
+StrokeRecorder* StrokeRecorder::instance()
+{
+  return g_recorder.get();
+}
+
+// static
+bool StrokeRecorder::start(const std::string& filename)
+{
+  g_recorder.reset(new StrokeRecorder(filename));
+  if (!g_recorder->m_file) {
+    g_recorder.reset();
+    return false;
+  }
+  return true;
+}
+
+// static
+void StrokeRecorder::stop()
+{
+  g_recorder.reset();
+}
+
+StrokeRecorder::StrokeRecorder(const std::string& filename)
+  : m_file(FSTREAM_PATH(filename), std::ios::binary)
+{
+  m_file << "-- Strokes recorded with --record-strokes, they are drawn\n"
+            "-- in the active layer/frame of the active sprite\n";
+}
+
+void StrokeRecorder::beginStroke(ToolLoop* toolLoop)
+{
+  Tool* tool = toolLoop->getTool();
+  const doc::Brush* brush = toolLoop->getBrush();
+  const InkType inkType = Preferences::instance().tool(tool).ink();
+
+  // Image brushes cannot be recorded, we use a circle brush of the
+  // same size.
+  const doc::BrushType brushType =
+    (brush->type() == doc::kImageBrushType ? doc::kCircleBrushType:
+                                             brush->type());
+
+  m_params = fmt::format(
+    "  tool=\"{}\",\n"
+    "  ink=\"{}\",\n"
+    "  color={},\n"
+    "  bgColor={},\n"
+    "  brush={{ type={}, size={}, angle={} }},\n"
+    "  opacity={},\n"
+    "  button={},\n",
+    tool->getId(),
+    ink_type_to_string_id(inkType),
+    toolLoop->getFgColor(),
+    toolLoop->getBgColor(),
+    int(brushType), brush->size(), brush->angle(),
+    toolLoop->getOpacity(),
+    (toolLoop->getMouseButton() == ToolLoop::Left ? "MouseButton.LEFT":
+                                                    "MouseButton.RIGHT"));
+  m_pts.clear();
+  m_startTime = base::current_tick();
+}
+
+void StrokeRecorder::addPointer(const Pointer& pointer)
+{
+  m_pts.push_back(Pt{ pointer.point(),
+                      pointer.pressure(),
+                      base::current_tick() - m_startTime });
+}
+
+void StrokeRecorder::endStroke(const bool canceled)
+{
+  if (canceled || m_pts.empty())
+    return;
+
+  m_file << fmt::format("\n-- Stroke {} ({} points in {} ms)\n",
+                        ++m_strokes, m_pts.size(), m_pts.back().time)
+         << "app.useTool{\n"
+         << m_params
+         << "  points={\n";
+  for (const Pt& pt : m_pts) {
+    m_file << fmt::format("    {{ x={}, y={}, pressure={}, time={} }},\n",
+                          pt.point.x, pt.point.y, pt.pressure, pt.time);
+  }
+  m_file << "  }\n"
+         << "}\n";
+  m_file.flush();
+  m_pts.clear();
+}
+
+} // namespace tools
+} // namespace app
@@ -0,0 +1,65 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_TOOLS_STROKE_RECORDER_H_INCLUDED
+#define APP_TOOLS_STROKE_RECORDER_H_INCLUDED
+#pragma once
+
+#include "app/tools/pointer.h"
+#include "base/time.h"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace app {
+namespace tools {
+
+class ToolLoop;
+
+// Records the tool, brush, ink, colors and the pointer events
+// (position, pressure, and time) of each stroke in a .lua file with
+// one app.useTool() call per stroke. The file can be replayed in
+// batch mode to measure the cost of each tool loop step, e.g.:
+//
+//   aseprite -b sprite.aseprite --trace-summary --script strokes.lua
+//
+class StrokeRecorder {
+public:
+  // Returns the active recorder, or nullptr if we are not recording
+  // strokes (the default).
+  static StrokeRecorder* instance();
+
+  // Starts/stops recording strokes in the given file. Returns false
+  // if the file cannot be created.
+  static bool start(const std::string& filename);
+  static void stop();
+
+  // Called by ToolLoopManager for each stroke.
+  void beginStroke(ToolLoop* toolLoop);
+  void addPointer(const Pointer& pointer);
+  void endStroke(bool canceled);
+
+private:
+  struct Pt {
+    gfx::Point point;
+    float pressure;
+    base::tick_t time;
+  };
+
+  StrokeRecorder(const std::string& filename);
+
+  std::ofstream m_file;
+  int m_strokes = 0;
+  std::string m_params;           // app.useTool() params of the stroke
+  std::vector<Pt> m_pts;
+  base::tick_t m_startTime = 0;
+};
+
+} // namespace tools
+} // namespace app
+
+#endif
@@ -49,42 +49,91 @@ void Symmetry::generateStrokes(const Stroke& stroke, Strokes& strokes,
   }
 }
 
+int Symmetry::generatePoints(const Stroke::Pt& pt, Stroke::Pt* points,
+                             ToolLoop* loop)
+{
+  const bool isDynamic = loop->getDynamics().isDynamic();
+  int n = 0;
+  points[n++] = pt;
+
+  gen::SymmetryMode symmetryMode = loop->getSymmetry()->mode();
+  switch (symmetryMode) {
+    case gen::SymmetryMode::NONE:
+      ASSERT(false);
+      break;
+
+    case gen::SymmetryMode::HORIZONTAL:
+    case gen::SymmetryMode::VERTICAL:
+      points[n++] = calculateSymmetricalPoint(
+        pt, getBrushAxis(loop, symmetryMode), isDynamic, symmetryMode);
+      break;
+
+    case gen::SymmetryMode::BOTH: {
+      const BrushAxis hAxis = getBrushAxis(loop, gen::SymmetryMode::HORIZONTAL);
+      const BrushAxis vAxis = getBrushAxis(loop, gen::SymmetryMode::VERTICAL);
+      points[n++] = calculateSymmetricalPoint(
+        pt, hAxis, isDynamic, gen::SymmetryMode::HORIZONTAL);
+      points[n] = calculateSymmetricalPoint(
+        pt, vAxis, isDynamic, gen::SymmetryMode::VERTICAL);
+      points[n+1] = calculateSymmetricalPoint(
+        points[n], hAxis, isDynamic, gen::SymmetryMode::BOTH);
+      n += 2;
+      break;
+    }
+  }
+  ASSERT(n <= kMaxCopies);
+  return n;
+}
+
 void Symmetry::calculateSymmetricalStroke(const Stroke& refStroke, Stroke& stroke,
                                           ToolLoop* loop, gen::SymmetryMode symmetryMode)
 {
-  int brushSize, brushCenter;
+  const BrushAxis axis = getBrushAxis(loop, symmetryMode);
+  const bool isDynamic = loop->getDynamics().isDynamic();
+  for (const auto& pt : refStroke)
+    stroke.addPoint(calculateSymmetricalPoint(pt, axis, isDynamic, symmetryMode));
+}
+
+Symmetry::BrushAxis Symmetry::getBrushAxis(ToolLoop* loop,
+                                           gen::SymmetryMode symmetryMode) const
+{
+  BrushAxis axis;
   if (loop->getPointShape()->isFloodFill()) {
-    brushSize = 1;
-    brushCenter = 0;
+    axis.size = 1;
+    axis.center = 0;
   }
   else {
     // TODO we should flip the brush center+image+bitmap or just do
     //      the symmetry of all pixels
     auto brush = loop->getBrush();
     if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH) {
-      brushSize = brush->bounds().w;
-      brushCenter = brush->center().x;
+      axis.size = brush->bounds().w;
+      axis.center = brush->center().x;
     }
     else {
-      brushSize = brush->bounds().h;
-      brushCenter = brush->center().y;
+      axis.size = brush->bounds().h;
+      axis.center = brush->center().y;
     }
   }
+  return axis;
+}
 
-  const bool isDynamic = loop->getDynamics().isDynamic();
-  for (const auto& pt : refStroke) {
-    if (isDynamic) {
-      brushSize = pt.size;
-      brushCenter = (brushSize - brushSize % 2) / 2;
-    }
-    Stroke::Pt pt2 = pt;
-    pt2.symmetry = symmetryMode;
-    if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH)
-      pt2.x = 2 * (m_x + brushCenter) - pt2.x - brushSize;
-    else
-      pt2.y = 2 * (m_y + brushCenter) - pt2.y - brushSize;
-    stroke.addPoint(pt2);
+Stroke::Pt Symmetry::calculateSymmetricalPoint(const Stroke::Pt& pt,
+                                               BrushAxis axis,
+                                               const bool isDynamic,
+                                               gen::SymmetryMode symmetryMode) const
+{
+  if (isDynamic) {
+    axis.size = pt.size;
+    axis.center = (axis.size - axis.size % 2) / 2;
   }
+  Stroke::Pt pt2 = pt;
+  pt2.symmetry = symmetryMode;
+  if (symmetryMode == gen::SymmetryMode::HORIZONTAL || symmetryMode == gen::SymmetryMode::BOTH)
+    pt2.x = 2 * (m_x + axis.center) - pt2.x - axis.size;
+  else
+    pt2.y = 2 * (m_y + axis.center) - pt2.y - axis.size;
+  return pt2;
 }
 
 } // namespace tools
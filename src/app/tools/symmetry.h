@@ -25,13 +25,31 @@ public:
     , m_y(y) {
   }
 
+  // Max number of points/strokes generated from one point/stroke.
+  static constexpr int kMaxCopies = 4;
+
   void generateStrokes(const Stroke& stroke, Strokes& strokes, ToolLoop* loop);
 
+  // Same as generateStrokes() but for just one point and without
+  // allocating memory (it's called for each point of the
+  // intertwined strokes). Returns the number of points in "points",
+  // where the first one is "pt".
+  int generatePoints(const Stroke::Pt& pt, Stroke::Pt* points, ToolLoop* loop);
+
   gen::SymmetryMode mode() const { return m_symmetryMode; }
 
 private:
+  struct BrushAxis {
+    int size;
+    int center;
+  };
+
   void calculateSymmetricalStroke(const Stroke& refStroke, Stroke& stroke,
                                   ToolLoop* loop, gen::SymmetryMode symmetryMode);
+  BrushAxis getBrushAxis(ToolLoop* loop, gen::SymmetryMode symmetryMode) const;
+  Stroke::Pt calculateSymmetricalPoint(const Stroke::Pt& pt, BrushAxis axis,
+                                       bool isDynamic,
+                                       gen::SymmetryMode symmetryMode) const;
 
   gen::SymmetryMode m_symmetryMode;
   double m_x, m_y;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,6 +17,7 @@
 #include "app/tools/ink.h"
 #include "app/tools/intertwine.h"
 #include "app/tools/point_shape.h"
+#include "app/tools/stroke_recorder.h"
 #include "app/tools/symmetry.h"
 #include "app/tools/tool_loop.h"
 #include "app/tools/velocity.h"
@@ -27,6 +28,7 @@
 #include "gfx/point_io.h"
 #include "gfx/rect_io.h"
 #include "gfx/region.h"
+#include "perf/trace.h"
 
 #include <algorithm>
 #include <climits>
@@ -65,6 +67,9 @@ void ToolLoopManager::cancel()
 
 void ToolLoopManager::end()
 {
+  if (auto recorder = StrokeRecorder::instance())
+    recorder->endStroke(m_canceled);
+
   if (m_canceled)
     m_toolLoop->rollback();
   else
@@ -81,6 +86,9 @@ void ToolLoopManager::prepareLoop(const Pointer& pointer)
   m_toolLoop->getController()->prepareController(m_toolLoop);
   m_toolLoop->getIntertwine()->prepareIntertwine(m_toolLoop);
   m_toolLoop->getPointShape()->preparePointShape(m_toolLoop);
+
+  if (auto recorder = StrokeRecorder::instance())
+    recorder->beginStroke(m_toolLoop);
 }
 
 void ToolLoopManager::notifyToolLoopModifiersChange()
@@ -96,6 +104,9 @@ void ToolLoopManager::pressButton(const Pointer& pointer)
 {
   TOOL_TRACE("ToolLoopManager::pressButton", pointer.point());
 
+  if (auto recorder = StrokeRecorder::instance())
+    recorder->addPointer(pointer);
+
   // A little patch to memorize initial Trace Policy in the
   // current function execution.
   // When the initial trace policy is "Last" and then
@@ -146,6 +157,9 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 {
   TOOL_TRACE("ToolLoopManager::releaseButton", pointer.point());
 
+  if (auto recorder = StrokeRecorder::instance())
+    recorder->addPointer(pointer);
+
   m_lastPointer = pointer;
 
   if (isCanceled())
@@ -168,26 +182,10 @@ bool ToolLoopManager::releaseButton(const Pointer& pointer)
 
 void ToolLoopManager::movement(Pointer pointer)
 {
-  // Filter points with the stabilizer
-  if (m_dynamics.stabilizerFactor > 0) {
-    const double f = m_dynamics.stabilizerFactor;
-    const gfx::Point delta = (pointer.point() - m_stabilizerCenter);
-    const double distance = std::sqrt(delta.x*delta.x + delta.y*delta.y);
-
-    const double angle = std::atan2(delta.y, delta.x);
-    const gfx::PointF newPoint(m_stabilizerCenter.x + distance/f*std::cos(angle),
-                               m_stabilizerCenter.y + distance/f*std::sin(angle));
-
-    m_stabilizerCenter = newPoint;
-
-    pointer = Pointer(gfx::Point(newPoint),
-                      pointer.velocity(),
-                      pointer.button(),
-                      pointer.type(),
-                      pointer.pressure());
-  }
+  if (auto recorder = StrokeRecorder::instance())
+    recorder->addPointer(pointer);
 
-  m_lastPointer = pointer;
+  m_lastPointer = pointer = stabilizePointer(pointer);
 
   if (isCanceled())
     return;
@@ -202,12 +200,111 @@ void ToolLoopManager::movement(Pointer pointer)
   doLoopStep(false);
 }
 
-void ToolLoopManager::doLoopStep(bool lastStep)
+void ToolLoopManager::movement(const std::vector<Pointer>& pointers)
+{
+  if (pointers.empty())
+    return;
+
+  // Only freehand tools that accumulate the previous points can
+  // join all the new points in one step, the other ones must
+  // process each point (e.g. to preview the last trace only, or
+  // to copy the destination to the source in each step).
+  Controller* controller = m_toolLoop->getController();
+  if (pointers.size() == 1 ||
+      !controller->isFreehand() ||
+      controller->handleTracePolicy() ||
+      m_toolLoop->getTracePolicy() != TracePolicy::Accumulate) {
+    for (const Pointer& pointer : pointers)
+      movement(pointer);
+    return;
+  }
+
+  Stroke batch;
+  for (const Pointer& p : pointers) {
+    if (auto recorder = StrokeRecorder::instance())
+      recorder->addPointer(p);
+
+    const Pointer pointer = stabilizePointer(p);
+    m_lastPointer = pointer;
+
+    if (isCanceled())
+      return;
+
+    Stroke::Pt spritePoint = getSpriteStrokePt(pointer);
+    controller->movement(m_toolLoop, m_stroke, spritePoint);
+
+    Stroke piece;
+    controller->getStrokeToInterwine(m_stroke, piece);
+    if (piece.empty())
+      continue;
+
+    if (batch.empty()) {
+      batch = piece;
+      continue;
+    }
+
+    for (int i=0; i<piece.size(); ++i) {
+      const Stroke::Pt& pt = piece[i];
+      if (pt == batch.lastPoint())
+        continue;
+
+      // Intertwiners ignore strokes that finish in its first point
+      // (e.g. pixel-perfect), so we join the current batch before
+      // closing the loop.
+      if (pt == batch.firstPoint()) {
+        const Stroke::Pt last = batch.lastPoint();
+        doLoopStep(false, &batch);
+        batch.reset();
+        batch.addPoint(last);
+      }
+      batch.addPoint(pt);
+    }
+  }
+
+  if (batch.empty())
+    return;
+
+  std::string statusText;
+  controller->getStatusBarText(m_toolLoop, m_stroke, statusText);
+  m_toolLoop->updateStatusBar(statusText.c_str());
+
+  doLoopStep(false, &batch);
+}
+
+Pointer ToolLoopManager::stabilizePointer(const Pointer& pointer)
+{
+  // Filter points with the stabilizer
+  if (m_dynamics.stabilizerFactor > 0) {
+    const double f = m_dynamics.stabilizerFactor;
+    const gfx::Point delta = (pointer.point() - m_stabilizerCenter);
+    const double distance = std::sqrt(delta.x*delta.x + delta.y*delta.y);
+
+    const double angle = std::atan2(delta.y, delta.x);
+    const gfx::PointF newPoint(m_stabilizerCenter.x + distance/f*std::cos(angle),
+                               m_stabilizerCenter.y + distance/f*std::sin(angle));
+
+    m_stabilizerCenter = newPoint;
+
+    return Pointer(gfx::Point(newPoint),
+                   pointer.velocity(),
+                   pointer.button(),
+                   pointer.type(),
+                   pointer.pressure());
+  }
+  return pointer;
+}
+
+void ToolLoopManager::doLoopStep(bool lastStep,
+                                 const Stroke* mainStroke)
 {
+  PERF_ZONE("ToolLoopManager::doLoopStep");
+
   // Original set of points to interwine (original user stroke,
   // relative to sprite origin).
   Stroke main_stroke;
-  if (!lastStep)
+  if (mainStroke)
+    main_stroke = *mainStroke;
+  else if (!lastStep)
     m_toolLoop->getController()->getStrokeToInterwine(m_stroke, main_stroke);
   else
     main_stroke = m_stroke;
@@ -240,13 +337,16 @@ void ToolLoopManager::doLoopStep(bool lastStep)
   }
 
   // Validate source image area.
-  if (m_toolLoop->getInk()->needsSpecialSourceArea()) {
-    gfx::Region srcArea;
-    m_toolLoop->getInk()->createSpecialSourceArea(m_dirtyArea, srcArea);
-    m_toolLoop->validateSrcImage(srcArea);
-  }
-  else {
-    m_toolLoop->validateSrcImage(m_dirtyArea);
+  {
+    PERF_ZONE("ToolLoop::validateSrcImage");
+    if (m_toolLoop->getInk()->needsSpecialSourceArea()) {
+      gfx::Region srcArea;
+      m_toolLoop->getInk()->createSpecialSourceArea(m_dirtyArea, srcArea);
+      m_toolLoop->validateSrcImage(srcArea);
+    }
+    else {
+      m_toolLoop->validateSrcImage(m_dirtyArea);
+    }
   }
 
   m_toolLoop->getInk()->prepareForStrokes(m_toolLoop, strokes);
@@ -266,13 +366,20 @@ void ToolLoopManager::doLoopStep(bool lastStep)
     m_toolLoop->invalidateDstImage();
   }
 
-  m_toolLoop->validateDstImage(m_dirtyArea);
+  {
+    PERF_ZONE("ToolLoop::validateDstImage");
+    m_toolLoop->validateDstImage(m_dirtyArea);
+  }
 
-  // Join or fill user points
-  if (fillStrokes)
-    m_toolLoop->getIntertwine()->fillStroke(m_toolLoop, main_stroke);
-  else
-    m_toolLoop->getIntertwine()->joinStroke(m_toolLoop, main_stroke);
+  // Join or fill user points (the intertwiner calls the point shape
+  // and the ink for each point)
+  {
+    PERF_ZONE("Intertwine::joinStroke (with ink)");
+    if (fillStrokes)
+      m_toolLoop->getIntertwine()->fillStroke(m_toolLoop, main_stroke);
+    else
+      m_toolLoop->getIntertwine()->joinStroke(m_toolLoop, main_stroke);
+  }
 
   if (m_toolLoop->getTracePolicy() == TracePolicy::Overlap) {
     // Copy destination to source (yes, destination to source). In
@@ -281,6 +388,7 @@ void ToolLoopManager::doLoopStep(bool lastStep)
   }
 
   if (!m_dirtyArea.isEmpty()) {
+    PERF_ZONE("ToolLoop::updateDirtyArea");
     m_toolLoop->validateDstTileset(m_dirtyArea);
     m_toolLoop->updateDirtyArea(m_dirtyArea);
   }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -78,10 +78,18 @@ public:
   // Should be called each time the user moves the mouse inside the editor.
   void movement(Pointer pointer);
 
+  // Same as movement() for several pointers received at the same
+  // time (e.g. coalesced mouse movements). In freehand tools all the
+  // points are joined in just one loop step (one update of the dirty
+  // area).
+  void movement(const std::vector<Pointer>& pointers);
+
   const Pointer& lastPointer() const { return m_lastPointer; }
 
 private:
-  void doLoopStep(bool lastStep);
+  void doLoopStep(bool lastStep,
+                  const Stroke* mainStroke = nullptr);
+  Pointer stabilizePointer(const Pointer& pointer);
   void snapToGrid(Stroke::Pt& pt);
   Stroke::Pt getSpriteStrokePt(const Pointer& pointer);
   bool useDynamics() const;
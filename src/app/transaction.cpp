@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -41,6 +41,7 @@ Transaction::Transaction(
   , m_doc(doc)
   , m_undo(nullptr)
   , m_cmds(nullptr)
+  , m_arenaScope(nullptr)
   , m_changes(Changes::kNone)
 {
   TX_TRACE("TX: Start <%s> (%s)\n",
@@ -54,6 +55,9 @@ Transaction::Transaction(
   m_cmds = new CmdTransaction(label,
                               modification == Modification::ModifyDocument);
 
+  // New cmds will be allocated in the arena of this transaction
+  m_arenaScope.setArena(m_cmds->arena());
+
   // Here we are executing an empty CmdTransaction, just to save the
   // SpritePosition. Sub-cmds are executed then one by one, in
   // Transaction::execute()
@@ -101,6 +105,7 @@ void Transaction::commit()
 
   m_undo->add(m_cmds);
   m_cmds = nullptr;
+  m_arenaScope.setArena(nullptr);
 
   // Process changes
   if (int(m_changes) & int(Changes::kSelection)) {
@@ -128,6 +133,9 @@ void Transaction::commit()
 
 void Transaction::rollbackAndStartAgain()
 {
+  // The new CmdTransaction is not allocated in the arena of the
+  // CmdTransaction that is going to be deleted
+  m_arenaScope.setArena(nullptr);
   auto newCmds = m_cmds->moveToEmptyCopy();
   rollback(newCmds);
   newCmds->execute(m_ctx);
@@ -140,6 +148,7 @@ void Transaction::rollback(CmdTransaction* newCmds)
 
   m_cmds->undo();
 
+  m_arenaScope.setArena(newCmds ? newCmds->arena(): nullptr);
   delete m_cmds;
   m_cmds = newCmds;
 }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -122,6 +122,7 @@ namespace app {
     Doc* m_doc;
     DocUndo* m_undo;
     CmdTransaction* m_cmds;
+    CmdArena::Scope m_arenaScope;
     Changes m_changes;
   };
 
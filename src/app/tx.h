@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -27,8 +27,17 @@ namespace app {
     Tx(Context* ctx,
        const std::string& label = kDefaultTransactionName,
        const Modification mod = ModifyDocument)
+      : Tx(ctx, ctx->activeDocument(), label, mod) {
+    }
+
+    // Creates the transaction in the given document (which might not
+    // be the active one, e.g. for background jobs).
+    Tx(Context* ctx,
+       Doc* doc,
+       const std::string& label = kDefaultTransactionName,
+       const Modification mod = ModifyDocument)
     {
-      m_doc = ctx->activeDocument();
+      m_doc = doc;
       if (!m_doc)
         throw std::runtime_error("No active document to execute a transaction");
 
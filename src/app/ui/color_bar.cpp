@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -898,12 +898,14 @@ void ColorBar::onRemapPalButtonClick()
 
       // Special remap saving original images in undo history
       if (remapPixels) {
-        for (ImageRef& image : images) {
-          ImageRef newImage(Image::createCopy(image.get()));
-          doc::remap_image(newImage.get(), remap);
-
-          tx(new cmd::ReplaceImage(sprite, image, newImage));
-        }
+        std::vector<ImageRef> newImages;
+        newImages.reserve(images.size());
+        for (const ImageRef& image : images)
+          newImages.emplace_back(Image::createCopy(image.get()));
+        doc::remap_images(newImages, remap);
+
+        for (std::size_t i=0; i<images.size(); ++i)
+          tx(new cmd::ReplaceImage(sprite, images[i], newImages[i]));
       }
 
       color_t oldTransparent = sprite->transparentColor();
@@ -985,13 +987,15 @@ void ColorBar::onRemapTilesButtonClick()
       tx(new cmd::RemapTilemaps(tileset, remap));
     }
     else {
-      for (const ImageRef& tilemap : tilemaps) {
-        ImageRef newTilemap(Image::createCopy(tilemap.get()));
-        doc::remap_image(newTilemap.get(), remap);
-
-        // TODO improve this with a cmd::CopyRegion()
-        tx(new cmd::ReplaceImage(sprite, tilemap, newTilemap));
-      }
+      std::vector<ImageRef> newTilemaps;
+      newTilemaps.reserve(tilemaps.size());
+      for (const ImageRef& tilemap : tilemaps)
+        newTilemaps.emplace_back(Image::createCopy(tilemap.get()));
+      doc::remap_images(newTilemaps, remap);
+
+      // TODO improve this with a cmd::CopyRegion()
+      for (std::size_t i=0; i<tilemaps.size(); ++i)
+        tx(new cmd::ReplaceImage(sprite, tilemaps[i], newTilemaps[i]));
     }
     tx.commit();
 
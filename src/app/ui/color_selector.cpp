@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -52,24 +52,18 @@ namespace app {
 using namespace app::skin;
 using namespace ui;
 
-// TODO This logic could be used to redraw any widget:
+// Paints the color selector surface in a background thread:
 // 1. We send a onPaintSurfaceInBgThread() to paint the widget on a
 //    offscreen buffer
 // 2. When the painting is done, we flip the buffer onto the screen
 // 3. If we receive another onPaint() we can cancel the background
 //    painting and start another onPaintSurfaceInBgThread()
 //
-// An alternative (better) way:
-// 1. Create an alternative ui::Graphics implementation that generates
-//    a list commands for the render thread
-// 2. Widgets can still use the same onPaint()
-// 3. The background threads consume the list of commands and render
-//    the screen.
-//
-// The bad side is that is harder to invalidate the commands that will
-// render an old state of the widget. So the render thread should
-// start caring about invalidating old commands (outdated regions) or
-// cleaning the queue if it gets too big.
+// Other widgets can use ui::Widget::setPaintInRenderThread() to
+// record their onPaint() in a ui::DisplayList that is rasterized in
+// the ui::RenderThread. The color selector cannot use it because it
+// paints its gradients with Skia shaders directly in the internal
+// surface of the ui::Graphics.
 //
 class ColorSelector::Painter {
 public:
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,7 +14,10 @@
 #include "app/color_utils.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
+#include "app/util/conversion_to_surface.h"
 #include "app/util/shader_helpers.h"
+#include "gfx/hsl.h"
+#include "gfx/rgb.h"
 #include "os/surface.h"
 #include "ui/graphics.h"
 #include "ui/message.h"
@@ -24,6 +27,7 @@
 #include "ui/system.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace app {
 
@@ -137,19 +141,18 @@ void ColorSpectrum::onPaintSurfaceInBgThread(
     int umax = std::max(1, main.w-1);
     int vmax = std::max(1, main.h-1);
 
+    // Each row is converted from HSL to RGB once per pixel (instead
+    // of once per RGB component with app::Color) and then copied to
+    // the surface.
+    std::vector<gfx::Color> row(main.w);
     for (int y=0; y<main.h && !stop; ++y) {
-      for (int x=0; x<main.w && !stop; ++x) {
-        double hue = 360.0 * double(x) / double(umax);
-        double lit = 1.0 - double(y) / double(vmax);
-
-        gfx::Color color = color_utils::color_for_ui(
-          app::Color::fromHsl(
-            std::clamp(hue, 0.0, 360.0),
-            sat,
-            std::clamp(lit, 0.0, 1.0)));
-
-        s->putPixel(color, main.x+x, main.y+y);
+      const double lit = std::clamp(1.0 - double(y) / double(vmax), 0.0, 1.0);
+      for (int x=0; x<main.w; ++x) {
+        const double hue = 360.0 * double(x) / double(umax);
+        const gfx::Rgb rgb(gfx::Hsl(std::clamp(hue, 0.0, 360.0), sat, lit));
+        row[x] = gfx::rgba(rgb.red(), rgb.green(), rgb.blue());
       }
+      convert_color_row_to_surface(row.data(), s, main.x, main.y+y, main.w);
     }
     if (stop)
       return;
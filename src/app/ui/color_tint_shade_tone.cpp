@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -14,10 +14,14 @@
 #include "app/color_utils.h"
 #include "app/pref/preferences.h"
 #include "app/ui/skin/skin_theme.h"
+#include "app/util/conversion_to_surface.h"
 #include "app/util/shader_helpers.h"
+#include "gfx/hsv.h"
+#include "gfx/rgb.h"
 #include "ui/graphics.h"
 
 #include <algorithm>
+#include <vector>
 
 namespace app {
 
@@ -162,19 +166,18 @@ void ColorTintShadeTone::onPaintSurfaceInBgThread(
   int vmax = std::max(1, main.h-1);
 
   if (m_paintFlags & MainAreaFlag) {
+    // Each row is converted from HSV to RGB once per pixel (instead
+    // of once per RGB component with app::Color) and then copied to
+    // the surface.
+    std::vector<gfx::Color> row(main.w);
     for (int y=0; y<main.h && !stop; ++y) {
-      for (int x=0; x<main.w && !stop; ++x) {
-        double sat = double(x) / double(umax);
-        double val = 1.0 - double(y) / double(vmax);
-
-        gfx::Color color = color_utils::color_for_ui(
-          app::Color::fromHsv(
-            hue,
-            std::clamp(sat, 0.0, 1.0),
-            std::clamp(val, 0.0, 1.0)));
-
-        s->putPixel(color, main.x+x, main.y+y);
+      const double val = std::clamp(1.0 - double(y) / double(vmax), 0.0, 1.0);
+      for (int x=0; x<main.w; ++x) {
+        const double sat = double(x) / double(umax);
+        const gfx::Rgb rgb(gfx::Hsv(hue, std::clamp(sat, 0.0, 1.0), val));
+        row[x] = gfx::rgba(rgb.red(), rgb.green(), rgb.blue());
       }
+      convert_color_row_to_surface(row.data(), s, main.x, main.y+y, main.w);
     }
     if (stop)
       return;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,7 @@
 #include "app/pref/preferences.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/status_bar.h"
+#include "app/util/conversion_to_surface.h"
 #include "app/util/shader_helpers.h"
 #include "base/pi.h"
 #include "os/surface.h"
@@ -27,6 +28,8 @@
 #include "ui/size_hint_event.h"
 #include "ui/system.h"
 
+#include <vector>
+
 namespace app {
 
 using namespace app::skin;
@@ -417,23 +420,23 @@ void ColorWheel::onPaintSurfaceInBgThread(os::Surface* s,
     int umax = std::max(1, main.w-1);
     int vmax = std::max(1, main.h-1);
 
+    // Colors are calculated row by row and then copied to the surface
+    std::vector<gfx::Color> row(main.w);
     for (int y=0; y<main.h && !stop; ++y) {
-      for (int x=0; x<main.w && !stop; ++x) {
+      for (int x=0; x<main.w; ++x) {
         app::Color appColor =
           getMainAreaColor(x, umax,
                            y, vmax);
 
-        gfx::Color color;
         if (appColor.getType() != app::Color::MaskType) {
           appColor.setAlpha(255);
-          color = color_utils::color_for_ui(appColor);
+          row[x] = color_utils::color_for_ui(appColor);
         }
         else {
-          color = m_bgColor;
+          row[x] = m_bgColor;
         }
-
-        s->putPixel(color, main.x+x, main.y+y);
       }
+      convert_color_row_to_surface(row.data(), s, main.x, main.y+y, main.w);
     }
     if (stop)
       return;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -1069,17 +1069,24 @@ public:
   void update(const Transformation& t) {
     auto rc = t.bounds();
 
-    m_x.setText(formatDec(rc.x));
-    m_y.setText(formatDec(rc.y));
-    m_w.setText(formatDec(rc.w));
-    m_h.setText(formatDec(rc.h));
-    m_angle.setText(formatDec(180.0 * t.angle() / PI));
-    m_skew.setText(formatDec(180.0 * t.skew() / PI));
+    updateField(m_x, formatDec(rc.x));
+    updateField(m_y, formatDec(rc.y));
+    updateField(m_w, formatDec(rc.w));
+    updateField(m_h, formatDec(rc.h));
+    updateField(m_angle, formatDec(180.0 * t.angle() / PI));
+    updateField(m_skew, formatDec(180.0 * t.skew() / PI));
 
     m_t = t;
   }
 
 private:
+  // Avoids invalidating the fields that didn't change (e.g. only the
+  // position changes when the pixels are moved)
+  static void updateField(Widget& field, const std::string& text) {
+    if (field.text() != text)
+      field.setText(text);
+  }
+
   static std::string formatDec(const double x) {
     std::string s = fmt::format("{:0.1f}", x);
     if (s.size() > 2 &&
@@ -2159,6 +2166,16 @@ void ContextBar::updateForTool(tools::Tool* tool)
 
 void ContextBar::updateForMovingPixels(const Transformation& t)
 {
+  // This is called on each mouse movement while the pixels are
+  // dragged, so if the bar is already showing the transformation
+  // fields we just update them (without a relayout).
+  if (m_transformation->isVisible() &&
+      m_dropPixels->isVisible()) {
+    m_dropPixels->deselectItems();
+    m_transformation->update(t);
+    return;
+  }
+
   tools::Tool* tool = App::instance()->toolBox()->getToolById(
     tools::WellKnownTools::RectangularMarquee);
   if (tool)
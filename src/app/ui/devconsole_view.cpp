@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -17,8 +17,10 @@
 
 #include "app/app.h"
 #include "app/app_menus.h"
+#include "app/memory_report.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui/workspace.h"
+#include "base/mem_utils.h"
 #include "fmt/format.h"
 #include "ui/entry.h"
 #include "ui/message.h"
@@ -67,6 +69,8 @@ protected:
 
 DevConsoleView::DevConsoleView()
   : Box(VERTICAL)
+  , m_memoryLabel("")
+  , m_memoryTimer(1000)
   , m_textBox(fmt::format("Welcome to {} v{} Console\n(Experimental)",
                           get_app_name(), get_app_version()), LEFT)
   , m_label(">")
@@ -75,6 +79,7 @@ DevConsoleView::DevConsoleView()
 {
   m_engine->setDelegate(this);
 
+  addChild(&m_memoryLabel);
   addChild(&m_view);
   addChild(&m_bottomBox);
 
@@ -87,6 +92,10 @@ DevConsoleView::DevConsoleView()
   m_entry->setExpansive(true);
   m_entry->ExecuteCommand.connect(&DevConsoleView::onExecuteCommand, this);
 
+  m_memoryTimer.Tick.connect([this]{ updateMemoryLabel(); });
+  m_memoryTimer.start();
+  updateMemoryLabel();
+
   InitTheme.connect(
     [this]{
       auto theme = SkinTheme::get(this);
@@ -97,6 +106,7 @@ DevConsoleView::DevConsoleView()
 
 DevConsoleView::~DevConsoleView()
 {
+  m_memoryTimer.stop();
   m_engine->setDelegate(nullptr);
 
   // m_document->remove_observer(this);
@@ -154,6 +164,23 @@ void DevConsoleView::onExecuteCommand(const std::string& cmd)
   m_engine->evalCode(cmd);
 }
 
+void DevConsoleView::updateMemoryLabel()
+{
+  if (!isVisible())
+    return;
+
+  const MemoryReport report = create_memory_report(App::instance()->context());
+  std::string text = fmt::format(
+    "Memory: {} - Documents: {}",
+    base::get_pretty_memory_size(report.total()),
+    base::get_pretty_memory_size(report.docsTotal()));
+  for (const MemoryReport::Subsystem& subsystem : report.subsystems) {
+    text += fmt::format(" - {}: {}", subsystem.name,
+                        base::get_pretty_memory_size(subsystem.bytes));
+  }
+  m_memoryLabel.setText(text);
+}
+
 void DevConsoleView::onConsoleError(const char* text)
 {
   onConsolePrint(text);
@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +19,7 @@
 #include "ui/box.h"
 #include "ui/label.h"
 #include "ui/textbox.h"
+#include "ui/timer.h"
 #include "ui/view.h"
 
 namespace app {
@@ -49,10 +51,14 @@ namespace app {
   protected:
     bool onProcessMessage(ui::Message* msg) override;
     void onExecuteCommand(const std::string& cmd);
+    void updateMemoryLabel();
 
   private:
     class CommmandEntry;
 
+    // Memory used by the documents and caches (updated each second)
+    ui::Label m_memoryLabel;
+    ui::Timer m_memoryTimer;
     ui::View m_view;
     ui::TextBox m_textBox;
     ui::HBox m_bottomBox;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -189,7 +189,11 @@ class PreviewEditor : public Editor,
 public:
   PreviewEditor(Doc* document)
     : Editor(document,
-             Editor::kShowOutside, // Don't show grid/mask in preview preview
+             // Don't show grid/mask in preview preview, and re-use
+             // the frames rendered to play the animation in the main
+             // editor
+             Editor::EditorFlags(Editor::kShowOutside |
+                                 Editor::kUsePlaybackCache),
              std::make_shared<NavigateState>())
   {
     setCustomizationDelegate(this);
@@ -416,7 +420,7 @@ void DocView::onSpritePixelsModified(DocEvent& ev)
 {
   if (m_editor->isVisible() &&
       m_editor->frame() == ev.frame())
-    m_editor->drawSpriteClipped(ev.region());
+    m_editor->scheduleDrawSpriteClipped(ev.region());
 }
 
 void DocView::onLayerMergedDown(DocEvent& ev)
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -47,6 +47,7 @@
 #include "ui/system.h"
 
 #include <array>
+#include <cmath>
 
 namespace app {
 
@@ -755,15 +756,85 @@ void BrushPreview::traceSelectionCrossPixels(
   }
 }
 
+// Calculates the screen pixels of the brush boundaries (relative to
+// the brush position) if the current zoom level allows us to re-use
+// them in any position. Returns false if they cannot be cached.
+bool BrushPreview::updateBoundariesPixels()
+{
+  const render::Projection& proj = m_editor->projection();
+  const double sx = proj.scaleX();
+  const double sy = proj.scaleY();
+  // With scales < 1 or fractional ones, the rounding of each
+  // transformed point depends on the brush position
+  if (sx < 1.0 || sy < 1.0 ||
+      sx != std::floor(sx) || sy != std::floor(sy))
+    return false;
+
+  BoundariesPixels& cache = m_boundariesPixels;
+  if (cache.version == m_brushBoundaries.version() &&
+      cache.scaleX == sx &&
+      cache.scaleY == sy)
+    return true;
+
+  cache.version = m_brushBoundaries.version();
+  cache.scaleX = sx;
+  cache.scaleY = sy;
+  cache.points.clear();
+  cache.bounds = gfx::Rect();
+
+  const gfx::Point origin = m_editor->editorToScreen(gfx::Point(0, 0));
+  for (const auto& seg : m_brushBoundaries) {
+    gfx::Rect bounds = seg.bounds();
+    bounds.offset(m_brushBoundaries.origin());
+    bounds = m_editor->editorToScreen(bounds);
+    bounds.offset(-origin);
+
+    if (seg.open()) {
+      if (seg.vertical()) --bounds.x;
+      else --bounds.y;
+    }
+
+    gfx::Point pt(bounds.x, bounds.y);
+    if (seg.vertical()) {
+      for (; pt.y<bounds.y+bounds.h; ++pt.y)
+        cache.points.push_back(pt);
+      cache.bounds |= gfx::Rect(bounds.x, bounds.y, 1, bounds.h);
+    }
+    else {
+      for (; pt.x<bounds.x+bounds.w; ++pt.x)
+        cache.points.push_back(pt);
+      cache.bounds |= gfx::Rect(bounds.x, bounds.y, bounds.w, 1);
+    }
+  }
+  return true;
+}
+
 // Current brush edges
 void BrushPreview::traceBrushBoundaries(ui::Graphics* g,
                                         gfx::Point pos,
                                         gfx::Color color,
                                         PixelDelegate pixelDelegate)
 {
+  if (updateBoundariesPixels()) {
+    const gfx::Point origin = m_editor->editorToScreen(pos);
+    gfx::Rect bounds = m_boundariesPixels.bounds;
+    bounds.offset(origin);
+    m_insideClippingRegion =
+      (m_clippingRegion.contains(bounds) == gfx::Region::In);
+    m_insideOldClippingRegion =
+      (m_oldClippingRegion.contains(bounds) == gfx::Region::In);
+
+    for (const gfx::Point& pt : m_boundariesPixels.points)
+      (this->*pixelDelegate)(g, origin + pt, color);
+
+    m_insideClippingRegion = false;
+    m_insideOldClippingRegion = false;
+    return;
+  }
+
   for (const auto& seg : m_brushBoundaries) {
     gfx::Rect bounds = seg.bounds();
-    bounds.offset(pos);
+    bounds.offset(pos + m_brushBoundaries.origin());
     bounds = m_editor->editorToScreen(bounds);
 
     if (seg.open()) {
@@ -788,7 +859,7 @@ void BrushPreview::traceBrushBoundaries(ui::Graphics* g,
 
 void BrushPreview::savePixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color)
 {
-  if (m_clippingRegion.contains(pt)) {
+  if (m_insideClippingRegion || m_clippingRegion.contains(pt)) {
     color_t c = g->getPixel(pt.x, pt.y);
 
     if (m_savedPixelsIterator < (int)m_savedPixels.size())
@@ -803,7 +874,7 @@ void BrushPreview::savePixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx:
 void BrushPreview::drawPixelDelegate(ui::Graphics* gfx, const gfx::Point& pt, gfx::Color color)
 {
   if (m_savedPixelsIterator < (int)m_savedPixels.size() &&
-      m_clippingRegion.contains(pt)) {
+      (m_insideClippingRegion || m_clippingRegion.contains(pt))) {
     if (m_blackAndWhiteNegative) {
       int c = m_savedPixels[m_savedPixelsIterator];
       int r = gfx::getr(c);
@@ -822,8 +893,8 @@ void BrushPreview::drawPixelDelegate(ui::Graphics* gfx, const gfx::Point& pt, gf
 void BrushPreview::clearPixelDelegate(ui::Graphics* g, const gfx::Point& pt, gfx::Color color)
 {
   if (m_savedPixelsIterator < (int)m_savedPixels.size()) {
-    if (m_oldClippingRegion.contains(pt)) {
-      if (m_clippingRegion.contains(pt))
+    if (m_insideOldClippingRegion || m_oldClippingRegion.contains(pt)) {
+      if (m_insideClippingRegion || m_clippingRegion.contains(pt))
         g->putPixel(m_savedPixels[m_savedPixelsIterator], pt.x, pt.y);
       ++m_savedPixelsIterator;
     }
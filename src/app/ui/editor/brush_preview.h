@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -91,6 +91,7 @@ namespace app {
     static doc::color_t getBrushColor(doc::Sprite* sprite, doc::Layer* layer);
 
     void generateBoundaries();
+    bool updateBoundariesPixels();
 
     // Creates a little native cursor to draw the CROSSHAIR
     void createCrosshairCursor(ui::Graphics* g, const gfx::Color cursorColor);
@@ -126,6 +127,24 @@ namespace app {
     doc::MaskBoundaries m_brushBoundaries;
     int m_brushGen;
 
+    // Screen pixels of the brush boundaries relative to the screen
+    // position of the sprite point where the brush is. They are
+    // calculated once for each brush and zoom level (only for
+    // integer scales), so each mouse movement just offsets them.
+    struct BoundariesPixels {
+      uint32_t version = 0;     // Version of m_brushBoundaries
+      double scaleX = 0.0;
+      double scaleY = 0.0;
+      std::vector<gfx::Point> points;
+      gfx::Rect bounds;
+    } m_boundariesPixels;
+
+    // True if all the pixels that we are going to trace are inside
+    // m_clippingRegion/m_oldClippingRegion (so the pixel delegates
+    // don't have to check each pixel).
+    bool m_insideClippingRegion = false;
+    bool m_insideOldClippingRegion = false;
+
     // True if we've modified pixels in the display surface
     // (e.g. drawing the selection crosshair or the brush edges).
     bool m_withModifiedPixels = false;
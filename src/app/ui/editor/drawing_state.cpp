@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -75,6 +75,10 @@ DrawingState::DrawingState(Editor* editor,
   m_beforeCmdConn =
     UIContext::instance()->BeforeCommandExecution.connect(
       &DrawingState::onBeforeCommandExecution, this);
+
+  // Layers below the active layer could be modified since the last
+  // tool loop.
+  m_editor->renderEngine().invalidateLayerStackCache();
 }
 
 DrawingState::~DrawingState()
@@ -82,6 +86,16 @@ DrawingState::~DrawingState()
   destroyLoop(nullptr);
 }
 
+bool DrawingState::modifiesOnlyActiveLayer() const
+{
+  // Tilemap layers can modify a tileset that is shared with other
+  // layers.
+  Layer* layer = (m_toolLoop ? m_toolLoop->getLayer(): nullptr);
+  return (layer &&
+          layer == m_editor->layer() &&
+          !layer->isTilemap());
+}
+
 void DrawingState::initToolLoop(Editor* editor,
                                 const ui::MouseMessage* msg,
                                 const tools::Pointer& pointer)
@@ -203,6 +217,15 @@ bool DrawingState::onMouseUp(Editor* editor, MouseMessage* msg)
   m_lastPointer = pointer_from_msg(editor, msg, m_velocity.velocity());
   m_delayedMouseMove.onMouseUp(msg);
 
+  // Paint the intermediate points that weren't committed yet (e.g. if
+  // the last mouse movement was in the same sprite position).
+  if (!m_pendingPointers.empty() &&
+      m_toolLoopManager &&
+      !m_toolLoopManager->isCanceled()) {
+    m_toolLoopManager->movement(m_pendingPointers);
+  }
+  m_pendingPointers.clear();
+
   // Selection tools with Replace mode are cancelled with a simple click.
   // ("one point" controller selection tool i.e. the magic wand, and
   // selection tools with Add or Subtract mode aren't cancelled with
@@ -254,6 +277,21 @@ bool DrawingState::onMouseMove(Editor* editor, MouseMessage* msg)
   // the scroll.
   base::ScopedValue disableScroll(m_processScrollChange, false);
 
+  // Freehand tools use all the intermediate positions of coalesced
+  // mouse movements (e.g. from a high-rate mouse or pen), so they can
+  // be painted in one step (see ToolLoopManager::movement()).
+  if (m_toolLoop && m_toolLoop->getController()->isFreehand()) {
+    for (const auto& sample : msg->coalescedSamples()) {
+      m_velocity.updateWithDisplayPoint(sample.pos);
+      m_pendingPointers.push_back(
+        tools::Pointer(gfx::Point(editor->screenToEditorF(sample.pos)),
+                       m_velocity.velocity(),
+                       button_from_msg(msg),
+                       msg->pointerType(),
+                       sample.pressure));
+    }
+  }
+
   // Update velocity sensor.
   m_velocity.updateWithDisplayPoint(msg->position());
 
@@ -385,7 +423,13 @@ void DrawingState::handleMouseMovement()
 {
   // Notify mouse movement to the tool
   ASSERT(m_toolLoopManager);
-  m_toolLoopManager->movement(m_lastPointer);
+  if (!m_pendingPointers.empty()) {
+    m_pendingPointers.push_back(m_lastPointer);
+    m_toolLoopManager->movement(m_pendingPointers);
+    m_pendingPointers.clear();
+  }
+  else
+    m_toolLoopManager->movement(m_lastPointer);
 }
 
 bool DrawingState::canInterpretMouseMovementAsJustOneClick()
@@ -446,8 +490,10 @@ void DrawingState::destroyLoopIfCanceled(Editor* editor)
 
 void DrawingState::destroyLoop(Editor* editor)
 {
-  if (editor)
+  if (editor) {
     editor->renderEngine().removePreviewImage();
+    editor->renderEngine().invalidateLayerStackCache();
+  }
 
   if (m_toolLoopManager)
     m_toolLoopManager->end();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -15,7 +15,9 @@
 #include "app/ui/editor/standby_state.h"
 #include "base/time.h"
 #include "obs/connection.h"
+
 #include <memory>
+#include <vector>
 
 namespace app {
   namespace tools {
@@ -47,6 +49,8 @@ namespace app {
     // already drawing (viewing the real trace).
     virtual bool requireBrushPreview() override { return false; }
 
+    virtual bool modifiesOnlyActiveLayer() const override;
+
     // Don't show layer edges when we're drawing as the cel
     // position/bounds is modified and the feedback is
     // confusing. (This is the original behavior, maybe in the future
@@ -100,6 +104,10 @@ namespace app {
     // button when onScrollChange() event is received.
     tools::Pointer m_lastPointer;
 
+    // Intermediate pointers (previous to m_lastPointer) of coalesced
+    // mouse movements that weren't sent to the tool loop yet.
+    std::vector<tools::Pointer> m_pendingPointers;
+
     // Used to calculate the velocity of the mouse (whch is a sensor
     // to generate dynamic parameters).
     tools::VelocitySensor m_velocity;
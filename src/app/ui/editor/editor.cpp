@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -53,6 +53,7 @@
 #include "app/ui/timeline/timeline.h"
 #include "app/ui/toolbar.h"
 #include "app/ui_context.h"
+#include "app/util/conversion_to_surface.h"
 #include "app/util/layer_utils.h"
 #include "base/chrono.h"
 #include "base/convert_to.h"
@@ -84,6 +85,10 @@ using namespace render;
 static base::Chrono renderChrono;
 static double renderElapsed = 0.0;
 
+// Maximum size of a grid cell (in screen pixels) to draw the grid
+// with a pattern (bigger cells have a few lines to draw anyway)
+static const int kMaxGridPatternSize = 512;
+
 class EditorPostRenderImpl : public EditorPostRender {
 public:
   EditorPostRenderImpl(Editor* editor, Graphics* g)
@@ -154,6 +159,7 @@ Editor::Editor(Doc* document, EditorFlags flags, EditorStatePtr state)
   , m_padding(0, 0)
   , m_antsTimer(100, this)
   , m_antsOffset(0)
+  , m_paintScheduler([this](const gfx::Region& rgn){ return onPaintSchedulerFlush(rgn); }, this)
   , m_customizationDelegate(NULL)
   , m_docView(NULL)
   , m_flags(flags)
@@ -208,6 +214,9 @@ Editor::Editor(Doc* document, EditorFlags flags, EditorStatePtr state)
   m_bgConn = m_docPref.bg.AfterChange.connect([this]{ invalidate(); });
   m_onionskinConn = m_docPref.onionskin.AfterChange.connect([this]{ invalidate(); });
   m_symmetryModeConn = Preferences::instance().symmetryMode.enabled.AfterChange.connect([this]{ invalidateIfActive(); });
+  m_paintRateConn = Preferences::instance().perf.paintRate.AfterChange.connect(
+    [this]{ m_paintScheduler.setRate(Preferences::instance().perf.paintRate()); });
+  m_paintScheduler.setRate(Preferences::instance().perf.paintRate());
   m_showExtrasConn =
     m_docPref.show.AfterChange.connect(
       [this]{ onShowExtrasChange(); });
@@ -227,6 +236,9 @@ Editor::~Editor()
     m_docPref.site.layer(layerIndex);
   }
 
+  // The PlaybackCache could be rendering frames of this document
+  PlaybackCache::instance()->cancel(m_document);
+
   m_observers.notifyDestroyEditor(this);
   m_document->remove_observer(this);
   App::instance()->activeToolManager()->remove_observer(this);
@@ -234,11 +246,13 @@ Editor::~Editor()
   setCustomizationDelegate(NULL);
 
   m_antsTimer.stop();
+  m_paintScheduler.discard();
 }
 
 void Editor::destroyEditorSharedInternals()
 {
   BrushPreview::destroyInternals();
+  PlaybackCache::destroyInstance();
   if (m_renderEngine)
     m_renderEngine.reset();
 }
@@ -581,14 +595,19 @@ void Editor::updateEditor(const bool restoreScrollPos)
   View::getView(this)->updateView(restoreScrollPos);
 }
 
-void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+bool Editor::calcSpriteRectToRender(ui::Graphics* g,
+                                    const gfx::Rect& spriteRectToDraw,
+                                    int dx, int dy,
+                                    gfx::Rect& rc2,
+                                    gfx::Rect& expose,
+                                    gfx::Rect& dest)
 {
   // Clip from sprite and apply zoom
   gfx::Rect rc = m_sprite->bounds().createIntersection(spriteRectToDraw);
   rc = m_proj.apply(rc);
 
-  gfx::Rect dest(dx + m_padding.x + rc.x,
-                 dy + m_padding.y + rc.y, 0, 0);
+  dest = gfx::Rect(dx + m_padding.x + rc.x,
+                   dy + m_padding.y + rc.y, 0, 0);
 
   // Clip from graphics/screen
   const gfx::Rect& clip = g->getClipBounds();
@@ -610,11 +629,11 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   }
 
   if (rc.isEmpty())
-    return;
+    return false;
 
   // Bounds of pixels from the sprite canvas that will be exposed in
   // this render cycle.
-  gfx::Rect expose = m_proj.remove(rc);
+  expose = m_proj.remove(rc);
 
   // If the zoom level is less than 100%, we add extra pixels to
   // the exposed area. Those pixels could be shown in the
@@ -641,13 +660,10 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
   expose.w = std::clamp(expose.w, 0, maxw);
   expose.h = std::clamp(expose.h, 0, maxh);
   if (expose.isEmpty())
-    return;
+    return false;
 
   // rc2 is the rectangle used to create a temporal rendered image of the sprite
-  const auto& pref = Preferences::instance();
-  const bool newEngine = isUsingNewRenderEngine();
-  gfx::Rect rc2;
-  if (newEngine) {
+  if (isUsingNewRenderEngine()) {
     rc2 = expose;               // New engine, exposed rectangle (without zoom)
     dest.x = dx + m_padding.x + m_proj.applyX(rc2.x);
     dest.y = dy + m_padding.y + m_proj.applyY(rc2.y);
@@ -659,6 +675,25 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     dest.w = rc.w;
     dest.h = rc.h;
   }
+  return true;
+}
+
+void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& spriteRectToDraw, int dx, int dy)
+{
+  gfx::Rect rc2, expose, dest;
+  if (!calcSpriteRectToRender(g, spriteRectToDraw, dx, dy, rc2, expose, dest))
+    return;
+
+  const auto& pref = Preferences::instance();
+  const bool newEngine = isUsingNewRenderEngine();
+
+  // In tiled mode we render the area needed by all the copies of the
+  // sprite once (see drawSpriteUnclippedRect()), and each copy is
+  // drawn from its own part of the rendered area.
+  const bool tiledRender = !m_tiledRender.area.isEmpty();
+  const gfx::Rect renderArea = (tiledRender ? m_tiledRender.area: rc2);
+  const bool needsRender = (!tiledRender || !m_tiledRender.rendered);
+  ASSERT(renderArea.contains(rc2));
 
   // Convert the render to a os::Surface
   static os::SurfaceRef rendered = nullptr; // TODO move this to other centralized place
@@ -667,11 +702,21 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     // Generate a "expose sprite pixels" notification. This is used by
     // tool managers that need to validate this region (copy pixels from
     // the original cel) before it can be used by the RenderEngine.
-    m_document->notifyExposeSpritePixels(m_sprite, gfx::Region(expose));
+    if (needsRender) {
+      m_document->notifyExposeSpritePixels(
+        m_sprite, gfx::Region(tiledRender ? m_tiledRender.expose: expose));
+    }
 
     m_renderEngine->setNewBlendMethod(pref.experimental.newBlend());
     m_renderEngine->setRefLayersVisiblity(true);
     m_renderEngine->setSelectedLayer(m_layer);
+    // While the active layer is the only one being modified (e.g. we
+    // are painting on it), the layers below it can be cached, and
+    // reference layers can be displayed with less quality.
+    const bool painting = (m_state && m_state->modifiesOnlyActiveLayer());
+    m_renderEngine->setLayerStackCache(painting ? m_layer: nullptr);
+    m_renderEngine->setRefLayersLowQuality(
+      painting && pref.experimental.lowQualityRefLayersWhilePainting());
     if (m_flags & Editor::kUseNonactiveLayersOpacityWhenEnabled)
       m_renderEngine->setNonactiveLayersOpacity(pref.experimental.nonactiveLayersOpacity());
     else
@@ -679,22 +724,9 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     m_renderEngine->setupBackground(m_document, IMAGE_RGB);
     m_renderEngine->disableOnionskin();
 
-    if ((m_flags & kShowOnionskin) == kShowOnionskin) {
-      if (m_docPref.onionskin.active()) {
-        OnionskinOptions opts(
-          (m_docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
-           render::OnionskinType::MERGE:
-           (m_docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
-            render::OnionskinType::RED_BLUE_TINT:
-            render::OnionskinType::NONE)));
-
-        opts.position(m_docPref.onionskin.position());
-        opts.prevFrames(m_docPref.onionskin.prevFrames());
-        opts.nextFrames(m_docPref.onionskin.nextFrames());
-        opts.opacityBase(m_docPref.onionskin.opacityBase());
-        opts.opacityStep(m_docPref.onionskin.opacityStep());
-        opts.layer(m_docPref.onionskin.currentLayer() ? m_layer: nullptr);
-
+    {
+      OnionskinOptions opts(render::OnionskinType::NONE);
+      if (getOnionskinOptions(opts)) {
         Tag* tag = nullptr;
         if (m_docPref.onionskin.loopTag())
           tag = m_sprite->tags().innerTag(m_frame);
@@ -705,7 +737,8 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
     }
 
     ExtraCelRef extraCel = m_document->extraCel();
-    if (extraCel &&
+    if (needsRender &&
+        extraCel &&
         extraCel->type() != render::ExtraType::NONE) {
       m_renderEngine->setExtraImage(
         extraCel->type(),
@@ -728,23 +761,44 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
                   m_proj.apply(rc2)));
     }
 
-    // Create a temporary surface to draw the sprite on it
-    if (!rendered ||
-        rendered->width() < rc2.w ||
-        rendered->height() < rc2.h ||
-        rendered->colorSpace() != m_document->osColorSpace()) {
-      const int maxw = std::max(rc2.w, rendered ? rendered->width(): 0);
-      const int maxh = std::max(rc2.h, rendered ? rendered->height(): 0);
-      rendered = os::instance()->makeRgbaSurface(
-        maxw, maxh, m_document->osColorSpace());
-    }
+    if (needsRender) {
+      // Create a temporary surface to draw the sprite on it
+      if (!rendered ||
+          rendered->width() < renderArea.w ||
+          rendered->height() < renderArea.h ||
+          rendered->colorSpace() != m_document->osColorSpace()) {
+        const int maxw = std::max(renderArea.w, rendered ? rendered->width(): 0);
+        const int maxh = std::max(renderArea.h, rendered ? rendered->height(): 0);
+        rendered = os::instance()->makeRgbaSurface(
+          maxw, maxh, m_document->osColorSpace());
+      }
 
-    m_renderEngine->setProjection(
-      newEngine ? render::Projection(): m_proj);
-    m_renderEngine->renderSprite(
-      rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, rc2));
+      // While the animation is played (by this editor, or by other
+      // editor if this one uses kUsePlaybackCache), use the frame
+      // rendered in background by the PlaybackCache if it's ready
+      doc::ImageRef cachedFrame;
+      PlaybackCache::Options playbackOpts;
+      if ((m_isPlaying || (m_flags & kUsePlaybackCache)) &&
+          newEngine && getPlaybackCacheOptions(playbackOpts))
+        cachedFrame = PlaybackCache::instance()->getFrame(m_document, m_frame, playbackOpts);
+
+      if (cachedFrame) {
+        convert_image_to_surface(cachedFrame.get(), m_sprite->palette(m_frame),
+                                 rendered.get(), renderArea.x, renderArea.y,
+                                 0, 0, renderArea.w, renderArea.h);
+      }
+      else {
+        m_renderEngine->setProjection(
+          newEngine ? render::Projection(): m_proj);
+        m_renderEngine->renderSprite(
+          rendered.get(), m_sprite, m_frame, gfx::Clip(0, 0, renderArea));
+      }
+
+      m_renderEngine->removeExtraImage();
 
-    m_renderEngine->removeExtraImage();
+      if (tiledRender)
+        m_tiledRender.rendered = true;
+    }
 
     // If the checkered background is visible in this sprite, we save
     // all settings of the background for this document.
@@ -784,13 +838,18 @@ void Editor::drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& sprite
         p.blendMode(os::BlendMode::Src);
 
       g->drawSurface(rendered.get(),
-                     gfx::Rect(0, 0, rc2.w, rc2.h),
+                     gfx::Rect(rc2.x - renderArea.x,
+                               rc2.y - renderArea.y,
+                               rc2.w, rc2.h),
                      dest,
                      sampling,
                      &p);
     }
     else {
-      g->blit(rendered.get(), 0, 0, dest.x, dest.y, dest.w, dest.h);
+      g->blit(rendered.get(),
+              rc2.x - renderArea.x,
+              rc2.y - renderArea.y,
+              dest.x, dest.y, dest.w, dest.h);
     }
   }
 
@@ -892,30 +951,52 @@ void Editor::drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& _rc)
     m_proj.applyY(m_sprite->height()));
   gfx::Rect enclosingRect = spriteRect;
 
-  // Draw the main sprite at the center.
-  drawOneSpriteUnclippedRect(g, rc, 0, 0);
-
-  // Document preferences
+  // Offsets of the copies of the sprite that we have to draw
+  std::vector<gfx::Point> offsets;
+  offsets.push_back(gfx::Point(0, 0));
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::X_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w, 0);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, 0);
-
-    enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w*3, spriteRect.h);
+    offsets.push_back(gfx::Point(spriteRect.w, 0));
+    offsets.push_back(gfx::Point(spriteRect.w*2, 0));
   }
-
   if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::Y_AXIS)) {
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, 0, spriteRect.h*2);
+    offsets.push_back(gfx::Point(0, spriteRect.h));
+    offsets.push_back(gfx::Point(0, spriteRect.h*2));
+  }
+  if (m_docPref.tiled.mode() == filters::TiledMode::BOTH) {
+    offsets.push_back(gfx::Point(spriteRect.w,   spriteRect.h));
+    offsets.push_back(gfx::Point(spriteRect.w*2, spriteRect.h));
+    offsets.push_back(gfx::Point(spriteRect.w,   spriteRect.h*2));
+    offsets.push_back(gfx::Point(spriteRect.w*2, spriteRect.h*2));
+  }
+
+  // In tiled mode each copy needs a different part of the sprite
+  // (depending on the visible area), so we render the union of
+  // those parts just once and then each copy is drawn from it.
+  m_tiledRender = TiledRender();
+  if (offsets.size() > 1) {
+    for (const gfx::Point& offset : offsets) {
+      gfx::Rect rc2, expose, dest;
+      if (calcSpriteRectToRender(g, rc, offset.x, offset.y, rc2, expose, dest)) {
+        m_tiledRender.area |= rc2;
+        m_tiledRender.expose |= expose;
+      }
+    }
+  }
 
+  // Draw the main sprite at the center and its copies around it.
+  for (const gfx::Point& offset : offsets)
+    drawOneSpriteUnclippedRect(g, rc, offset.x, offset.y);
+
+  m_tiledRender = TiledRender();
+
+  // Document preferences
+  if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::X_AXIS))
+    enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w*3, spriteRect.h);
+
+  if (int(m_docPref.tiled.mode()) & int(filters::TiledMode::Y_AXIS))
     enclosingRect = gfx::Rect(spriteRect.x, spriteRect.y, spriteRect.w, spriteRect.h*3);
-  }
 
   if (m_docPref.tiled.mode() == filters::TiledMode::BOTH) {
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w,   spriteRect.h*2);
-    drawOneSpriteUnclippedRect(g, rc, spriteRect.w*2, spriteRect.h*2);
-
     enclosingRect = gfx::Rect(
       spriteRect.x, spriteRect.y,
       spriteRect.w*3, spriteRect.h*3);
@@ -1004,6 +1085,85 @@ void Editor::drawSpriteClipped(const gfx::Region& updateRegion)
   }
 }
 
+void Editor::scheduleDrawSpriteClipped(const gfx::Region& updateRegion)
+{
+  // The scheduler uses a ui::Timer, so regions modified from other
+  // threads are drawn immediately
+  if (!ui::is_ui_thread()) {
+    drawSpriteClipped(updateRegion);
+    return;
+  }
+  m_paintScheduler.invalidate(updateRegion);
+}
+
+bool Editor::getOnionskinOptions(render::OnionskinOptions& opts) const
+{
+  if ((m_flags & kShowOnionskin) != kShowOnionskin ||
+      !m_docPref.onionskin.active())
+    return false;
+
+  opts.type(
+    m_docPref.onionskin.type() == app::gen::OnionskinType::MERGE ?
+    render::OnionskinType::MERGE:
+    (m_docPref.onionskin.type() == app::gen::OnionskinType::RED_BLUE_TINT ?
+     render::OnionskinType::RED_BLUE_TINT:
+     render::OnionskinType::NONE));
+  opts.position(m_docPref.onionskin.position());
+  opts.prevFrames(m_docPref.onionskin.prevFrames());
+  opts.nextFrames(m_docPref.onionskin.nextFrames());
+  opts.opacityBase(m_docPref.onionskin.opacityBase());
+  opts.opacityStep(m_docPref.onionskin.opacityStep());
+  opts.layer(m_docPref.onionskin.currentLayer() ? m_layer: nullptr);
+  return true;
+}
+
+bool Editor::getPlaybackCacheOptions(PlaybackCache::Options& opts) const
+{
+  // The frames are rendered with the same options of the
+  // SimpleRenderer (see drawOneSpriteUnclippedRect())
+  if (m_renderEngine->type() != EditorRender::Type::kSimpleRenderer)
+    return false;
+
+  ExtraCelRef extraCel = m_document->extraCel();
+  if (extraCel && extraCel->type() != render::ExtraType::NONE)
+    return false;
+
+  const auto& pref = Preferences::instance();
+  opts.bg = EditorRender::makeBgOptions(m_document, IMAGE_RGB);
+  if (getOnionskinOptions(opts.onionskin)) {
+    opts.onionskinLoopTag = m_docPref.onionskin.loopTag();
+    opts.onionskinCurrentLayer = m_docPref.onionskin.currentLayer();
+  }
+  opts.onionskin.layer(nullptr);
+  opts.selectedLayerId = (m_layer ? m_layer->id(): doc::NullId);
+  opts.nonactiveLayersOpacity =
+    ((m_flags & Editor::kUseNonactiveLayersOpacityWhenEnabled) ?
+     pref.experimental.nonactiveLayersOpacity(): 255);
+  opts.newBlend = pref.experimental.newBlend();
+  return true;
+}
+
+bool Editor::onPaintSchedulerFlush(const gfx::Region& updateRegion)
+{
+  if (!isVisible())
+    return true;
+
+  // The document could be locked by a background task (e.g. a filter
+  // being applied), in that case we try again in the next refresh.
+  try {
+    DocReader documentReader(m_document, 0);
+
+    // Hide the brush preview so the painted pixels are saved
+    // correctly when the preview is shown again
+    HideBrushPreview hide(m_brushPreview);
+    drawSpriteClipped(updateRegion);
+  }
+  catch (const LockedDocException&) {
+    return false;
+  }
+  return true;
+}
+
 /**
  * Draws the boundaries, really this routine doesn't use the "mask"
  * field of the sprite, only the "bound" field (so you can have other
@@ -1019,13 +1179,7 @@ void Editor::drawMask(Graphics* g)
 
   ASSERT(m_document->hasMaskBoundaries());
 
-  gfx::Point pt = mainTilePosition();
-  pt.x = m_padding.x + m_proj.applyX(pt.x);
-  pt.y = m_padding.y + m_proj.applyY(pt.y);
-
-  // Create the mask boundaries path
-  auto& segs = m_document->maskBoundaries();
-  segs.createPathIfNeeeded();
+  updateMaskPath();
 
   ui::Paint paint;
   paint.style(ui::Paint::Stroke);
@@ -1033,12 +1187,50 @@ void Editor::drawMask(Graphics* g)
                            gfx::rgba(0, 0, 0, 255),
                            gfx::rgba(255, 255, 255, 255));
 
+  g->drawPath(m_maskPath.path, paint);
+}
+
+void Editor::updateMaskPath()
+{
+  auto& segs = m_document->maskBoundaries();
+
+  gfx::Point pt = mainTilePosition();
+  pt.x = m_padding.x + m_proj.applyX(pt.x) + m_proj.applyX(segs.origin().x);
+  pt.y = m_padding.y + m_proj.applyY(pt.y) + m_proj.applyY(segs.origin().y);
+
+  if (m_maskPath.docId == m_document->id() &&
+      m_maskPath.version == segs.version() &&
+      m_maskPath.scaleX == m_proj.scaleX() &&
+      m_maskPath.scaleY == m_proj.scaleY() &&
+      m_maskPath.offset == pt) {
+    return;
+  }
+
+  m_maskPath.docId = m_document->id();
+  m_maskPath.version = segs.version();
+  m_maskPath.scaleX = m_proj.scaleX();
+  m_maskPath.scaleY = m_proj.scaleY();
+  m_maskPath.offset = pt;
+
+  // Create the mask boundaries path
+  segs.createPathIfNeeeded();
+
   // We translate the path instead of applying a matrix to the
   // ui::Graphics so the "checkered" pattern is not scaled too.
-  gfx::Path path;
-  segs.path().transform(m_proj.scaleMatrix(), &path);
-  path.offset(pt.x, pt.y);
-  g->drawPath(path, paint);
+  m_maskPath.path.rewind();
+  segs.path().transform(m_proj.scaleMatrix(), &m_maskPath.path);
+  m_maskPath.path.offset(pt.x, pt.y);
+
+  gfx::Rect bounds;
+  for (const auto& seg : segs)
+    bounds |= seg.bounds();
+  m_maskPath.bounds = gfx::Rect(
+    pt.x + int(std::floor(bounds.x * m_proj.scaleX())),
+    pt.y + int(std::floor(bounds.y * m_proj.scaleY())),
+    int(std::ceil(bounds.w * m_proj.scaleX())),
+    int(std::ceil(bounds.h * m_proj.scaleY())));
+  // Include the stroke around the boundaries
+  m_maskPath.bounds.enlarge(1);
 }
 
 void Editor::drawMaskSafe()
@@ -1053,6 +1245,12 @@ void Editor::drawMaskSafe()
     getDrawableRegion(region, kCutTopWindows);
     region.offset(-bounds().origin());
 
+    // Only the area around the boundaries is painted
+    updateMaskPath();
+    region.createIntersection(region, gfx::Region(m_maskPath.bounds));
+    if (region.isEmpty())
+      return;
+
     HideBrushPreview hide(m_brushPreview);
     GraphicsPtr g = getGraphics(clientBounds());
 
@@ -1104,6 +1302,23 @@ void Editor::drawGrid(Graphics* g, const gfx::Rect& spriteBounds, const Rect& gr
     gfx::getg(grid_color),
     gfx::getb(grid_color), alpha);
 
+  // If the cells have an integer size in screen coordinates (e.g. the
+  // pixel grid with integer zoom levels), the whole grid is filled
+  // with one rectangle using a pattern of one cell
+  const gfx::Size cellSize(int(gridF.w), int(gridF.h));
+  if (cellSize.w == gridF.w && cellSize.h == gridF.h &&
+      cellSize.w <= kMaxGridPatternSize &&
+      cellSize.h <= kMaxGridPatternSize) {
+    const gfx::Point origin(int(gridF.x) + g->getInternalDeltaX(),
+                            int(gridF.y) + g->getInternalDeltaY());
+    if (const ui::Paint* paint = gridPaint(cellSize, origin, grid_color)) {
+      // +1 to include the last lines (as the drawHLine/drawVLine loops)
+      g->drawRect(gfx::Rect(spriteBounds.x, spriteBounds.y,
+                            spriteBounds.w+1, spriteBounds.h+1), *paint);
+      return;
+    }
+  }
+
   // Draw horizontal lines
   int x1 = spriteBounds.x;
   int y1 = gridF.y;
@@ -1121,6 +1336,39 @@ void Editor::drawGrid(Graphics* g, const gfx::Rect& spriteBounds, const Rect& gr
     g->drawVLine(grid_color, c, y1, spriteBounds.h);
 }
 
+const ui::Paint* Editor::gridPaint(const gfx::Size& cellSize,
+                                   gfx::Point origin,
+                                   const gfx::Color color)
+{
+  // The pattern is the same for all origins in the same cell
+  origin.x %= cellSize.w;
+  origin.y %= cellSize.h;
+  if (origin.x < 0) origin.x += cellSize.w;
+  if (origin.y < 0) origin.y += cellSize.h;
+
+  for (const GridPaint& entry : m_gridPaints) {
+    if (entry.cellSize == cellSize &&
+        entry.origin == origin &&
+        entry.color == color) {
+      return &entry.paint;
+    }
+  }
+
+  GridPaint entry;
+  entry.cellSize = cellSize;
+  entry.origin = origin;
+  entry.color = color;
+  entry.paint.style(ui::Paint::Fill);
+  if (!ui::set_grid_paint_mode(entry.paint, cellSize, origin, color))
+    return nullptr;
+
+  // Keep the paints of the pixel grid and the tile grid
+  if (m_gridPaints.size() >= 2)
+    m_gridPaints.erase(m_gridPaints.begin());
+  m_gridPaints.push_back(std::move(entry));
+  return &m_gridPaints.back().paint;
+}
+
 void Editor::drawSlices(ui::Graphics* g)
 {
   if ((m_flags & kShowSlices) == 0)
@@ -1132,20 +1380,28 @@ void Editor::drawSlices(ui::Graphics* g)
   auto theme = SkinTheme::get(this);
   gfx::Point mainOffset(mainTilePosition());
 
+  // Only the slices that intersect the invalidated area are drawn
+  // (the selected slice border can be drawn a little outside the
+  // slice bounds).
+  const gfx::Rect clip = gfx::Rect(g->getClipBounds()).enlarge(2*guiscale());
+
   for (auto slice : m_sprite->slices()) {
     auto key = slice->getByFrame(m_frame);
     if (!key)
       continue;
 
+    gfx::Rect out = key->bounds();
+    out.offset(mainOffset);
+    out = editorToScreen(out);
+    out.offset(-bounds().origin());
+    if (!out.intersects(clip))
+      continue;
+
     doc::color_t docColor = slice->userData().color();
     gfx::Color color = gfx::rgba(doc::rgba_getr(docColor),
                                  doc::rgba_getg(docColor),
                                  doc::rgba_getb(docColor),
                                  doc::rgba_geta(docColor));
-    gfx::Rect out = key->bounds();
-    out.offset(mainOffset);
-    out = editorToScreen(out);
-    out.offset(-bounds().origin());
 
     // Center slices
     if (key->hasCenter()) {
@@ -1208,10 +1464,20 @@ void Editor::drawTileNumbers(ui::Graphics* g, const Cel* cel)
     int ti_offset =
       static_cast<LayerTilemap*>(cel->layer())->tileset()->baseIndex() - 1;
 
+    // Only the tiles in the invalidated area are drawn (with an
+    // extra tile around it as the text can be wider than the tile)
     const doc::Image* image = cel->image();
+    gfx::Rect tiles =
+      grid.canvasToTile(
+        screenToEditor(
+          gfx::Rect(g->getClipBounds()).offset(bounds().origin()))
+        .offset(-mainTilePosition()));
+    tiles.enlarge(1);
+    tiles &= image->bounds();
+
     std::string text;
-    for (int y=0; y<image->height(); ++y) {
-      for (int x=0; x<image->width(); ++x) {
+    for (int y=tiles.y; y<tiles.y2(); ++y) {
+      for (int x=tiles.x; x<tiles.x2(); ++x) {
         doc::tile_t t = image->getPixel(x, y);
         if (t != doc::notile) {
           gfx::Point pt = editorToScreen(grid.tileToCanvas(gfx::Point(x, y)));
@@ -2238,10 +2504,12 @@ void Editor::onPaint(ui::PaintEvent& ev)
       if (Preferences::instance().perf.showRenderTime()) {
         View* view = View::getView(this);
         gfx::Rect vp = view->viewportBounds();
+        const PaintScheduler::Stats& stats = m_paintScheduler.stats();
         char buf[128];
-        sprintf(buf, "%c %.4gs",
+        sprintf(buf, "%c %.4gs paints %d/%d",
                 Preferences::instance().experimental.newRenderEngine() ? 'N': 'O',
-                renderElapsed);
+                renderElapsed,
+                stats.flushes, stats.requests);
         g->drawText(
           buf,
           gfx::rgba(255, 255, 255, 255),
@@ -2253,8 +2521,11 @@ void Editor::onPaint(ui::PaintEvent& ev)
       }
 #endif // ENABLE_DEVMODE
 
-      // Draw the mask boundaries
-      if (m_document->hasMaskBoundaries()) {
+      // Draw the mask boundaries (the marching ants are animated
+      // only if the selection edges are visible)
+      if (m_document->hasMaskBoundaries() &&
+          (m_flags & kShowMask) &&
+          m_docPref.show.selectionEdges()) {
         drawMask(g);
         m_antsTimer.start();
       }
@@ -2341,6 +2612,11 @@ void Editor::onShowExtrasChange()
   invalidate();
 }
 
+void Editor::onGeneralUpdate(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
 void Editor::onColorSpaceChanged(DocEvent& ev)
 {
   // As the document has a new color space, we've to redraw the
@@ -2360,10 +2636,21 @@ void Editor::onSpritePixelRatioChanged(DocEvent& ev)
   invalidate();
 }
 
+void Editor::onAddLayer(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
+void Editor::onAddCel(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
 // TODO similar to ActiveSiteHandler::onBeforeRemoveLayer() and Timeline::onBeforeRemoveLayer()
 void Editor::onBeforeRemoveLayer(DocEvent& ev)
 {
   m_showGuidesThisCel = nullptr;
+  m_renderEngine->invalidateLayerStackCache();
 
   // If the layer that was removed is the selected one in the editor,
   // or is an ancestor of the selected one.
@@ -2375,6 +2662,40 @@ void Editor::onBeforeRemoveLayer(DocEvent& ev)
 void Editor::onBeforeRemoveCel(DocEvent& ev)
 {
   m_showGuidesThisCel = nullptr;
+  m_renderEngine->invalidateLayerStackCache();
+}
+
+// The following events modify how the layers are composited, so the
+// cached layers below the active layer are not valid anymore.
+
+void Editor::onLayerOpacityChange(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
+void Editor::onLayerBlendModeChange(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
+void Editor::onLayerRestacked(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
+void Editor::onCelPositionChanged(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
+void Editor::onCelOpacityChange(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
+}
+
+void Editor::onCelZIndexChange(DocEvent& ev)
+{
+  m_renderEngine->invalidateLayerStackCache();
 }
 
 void Editor::onAddTag(DocEvent& ev)
@@ -2804,6 +3125,13 @@ void Editor::play(const bool playOnce,
                                         playSubtags)));
 }
 
+void Editor::prefetchPlaybackFrames(const std::vector<doc::frame_t>& frames)
+{
+  PlaybackCache::Options opts;
+  if (isUsingNewRenderEngine() && getPlaybackCacheOptions(opts))
+    PlaybackCache::instance()->prefetch(m_document, frames, opts);
+}
+
 void Editor::stop()
 {
   ASSERT(m_state);
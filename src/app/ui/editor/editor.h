@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,6 +21,8 @@
 #include "app/ui/editor/editor_observers.h"
 #include "app/ui/editor/editor_state.h"
 #include "app/ui/editor/editor_states_history.h"
+#include "app/ui/editor/paint_scheduler.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/tile_source.h"
 #include "app/util/tiled_mode.h"
 #include "doc/algorithm/flip_type.h"
@@ -29,12 +31,14 @@
 #include "doc/selected_objects.h"
 #include "filters/tiled_mode.h"
 #include "gfx/fwd.h"
+#include "gfx/path.h"
 #include "obs/connection.h"
 #include "os/color_space.h"
 #include "render/projection.h"
 #include "render/zoom.h"
 #include "ui/base.h"
 #include "ui/cursor_type.h"
+#include "ui/paint.h"
 #include "ui/pointer_type.h"
 #include "ui/timer.h"
 #include "ui/widget.h"
@@ -91,6 +95,10 @@ namespace app {
       kShowSymmetryLine = 32,
       kShowSlices = 64,
       kUseNonactiveLayersOpacityWhenEnabled = 128,
+      // Uses the frames of the PlaybackCache even when this editor
+      // isn't playing the animation (e.g. the preview editor showing
+      // the frames played by the main editor).
+      kUsePlaybackCache = 256,
       kDefaultEditorFlags = (kShowGrid |
                              kShowMask |
                              kShowOnionskin |
@@ -177,6 +185,11 @@ namespace app {
     // Draws the sprite taking care of the whole clipping region.
     void drawSpriteClipped(const gfx::Region& updateRegion);
 
+    // Accumulates the given sprite region to be drawn with
+    // drawSpriteClipped() in the next display refresh.
+    void scheduleDrawSpriteClipped(const gfx::Region& updateRegion);
+    const PaintScheduler& paintScheduler() const { return m_paintScheduler; }
+
     void flashCurrentLayer();
 
     // Convert ui::Display coordinates (pixel relative to the top-left
@@ -281,6 +294,11 @@ namespace app {
     void stop();
     bool isPlaying() const;
 
+    // Renders the given frames in background (in the PlaybackCache)
+    // with the current render options of the editor, so they are
+    // ready when the animation reaches them.
+    void prefetchPlaybackFrames(const std::vector<doc::frame_t>& frames);
+
     // Shows a popup menu to change the editor animation speed.
     void showAnimationSpeedMultiplierPopup();
     double getAnimationSpeedMultiplier() const;
@@ -340,11 +358,20 @@ namespace app {
     void onShowExtrasChange();
 
     // DocObserver impl
+    void onGeneralUpdate(DocEvent& ev) override;
     void onColorSpaceChanged(DocEvent& ev) override;
     void onExposeSpritePixels(DocEvent& ev) override;
     void onSpritePixelRatioChanged(DocEvent& ev) override;
+    void onAddLayer(DocEvent& ev) override;
+    void onAddCel(DocEvent& ev) override;
     void onBeforeRemoveLayer(DocEvent& ev) override;
     void onBeforeRemoveCel(DocEvent& ev) override;
+    void onLayerOpacityChange(DocEvent& ev) override;
+    void onLayerBlendModeChange(DocEvent& ev) override;
+    void onLayerRestacked(DocEvent& ev) override;
+    void onCelPositionChanged(DocEvent& ev) override;
+    void onCelOpacityChange(DocEvent& ev) override;
+    void onCelZIndexChange(DocEvent& ev) override;
     void onAddTag(DocEvent& ev) override;
     void onRemoveTag(DocEvent& ev) override;
     void onRemoveSlice(DocEvent& ev) override;
@@ -367,8 +394,12 @@ namespace app {
     void drawSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc);
     void drawMaskSafe();
     void drawMask(ui::Graphics* g);
+    void updateMaskPath();
     void drawGrid(ui::Graphics* g, const gfx::Rect& spriteBounds, const gfx::Rect& gridBounds,
                   const app::Color& color, int alpha);
+    const ui::Paint* gridPaint(const gfx::Size& cellSize,
+                               gfx::Point origin,
+                               const gfx::Color color);
     void drawSlices(ui::Graphics* g);
     void drawTileNumbers(ui::Graphics* g, const Cel* cel);
     void drawCelBounds(ui::Graphics* g, const Cel* cel, const gfx::Color color);
@@ -392,6 +423,25 @@ namespace app {
     // routine.
     void drawOneSpriteUnclippedRect(ui::Graphics* g, const gfx::Rect& rc, int dx, int dy);
 
+    // Calculates the rectangle "rc2" of the sprite that must be
+    // rendered to draw the given portion of the sprite with the dx/dy
+    // offset (in zoomed coordinates for the old render engine), the
+    // exposed sprite pixels, and where it's drawn. Returns false if
+    // there is nothing to draw.
+    bool calcSpriteRectToRender(ui::Graphics* g, const gfx::Rect& spriteRectToDraw,
+                                int dx, int dy,
+                                gfx::Rect& rc2, gfx::Rect& expose, gfx::Rect& dest);
+
+    // Returns true if the onionskin is visible in this editor (the
+    // loop tag of the options is not set).
+    bool getOnionskinOptions(render::OnionskinOptions& opts) const;
+
+    // Returns false if the frames rendered by the PlaybackCache
+    // cannot be used in this editor (e.g. the ShaderRenderer or an
+    // extra cel is used).
+    bool getPlaybackCacheOptions(PlaybackCache::Options& opts) const;
+    bool onPaintSchedulerFlush(const gfx::Region& updateRegion);
+
     gfx::Point calcExtraPadding(const render::Projection& proj);
 
     void invalidateCanvas();
@@ -430,6 +480,42 @@ namespace app {
     ui::Timer m_antsTimer;
     int m_antsOffset;
 
+    // Mask boundaries path transformed to editor coordinates. It's
+    // re-used in each tick of the marching ants (only the
+    // "checkered" pattern changes) until the boundaries, the zoom, or
+    // the scroll change.
+    struct MaskPath {
+      doc::ObjectId docId = doc::NullId;
+      uint32_t version = 0;
+      double scaleX = 0.0;
+      double scaleY = 0.0;
+      gfx::Point offset;
+      gfx::Path path;
+      gfx::Rect bounds;         // Area painted by the path
+    } m_maskPath;
+
+    // Paints with the pattern of the last used grids (the pixel grid
+    // and the tile grid) for the current zoom level.
+    struct GridPaint {
+      gfx::Size cellSize;
+      gfx::Point origin;
+      gfx::Color color;
+      ui::Paint paint;
+    };
+    std::vector<GridPaint> m_gridPaints;
+
+    // In tiled mode the sprite is rendered just once in the
+    // temporary surface for all its copies, this is the area of the
+    // sprite rendered in the current paint (in "rc2" coordinates).
+    struct TiledRender {
+      gfx::Rect area;
+      gfx::Rect expose;
+      bool rendered = false;
+    } m_tiledRender;
+
+    // Groups the regions modified by tools in one paint per refresh
+    PaintScheduler m_paintScheduler;
+
     obs::scoped_connection m_samplingChangeConn;
     obs::scoped_connection m_fgColorChangeConn;
     obs::scoped_connection m_contextBarBrushChangeConn;
@@ -443,6 +529,7 @@ namespace app {
     obs::scoped_connection m_bgConn;
     obs::scoped_connection m_onionskinConn;
     obs::scoped_connection m_symmetryModeConn;
+    obs::scoped_connection m_paintRateConn;
 
     EditorObservers m_observers;
 
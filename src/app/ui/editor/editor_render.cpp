@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -62,6 +62,11 @@ void EditorRender::setRefLayersVisiblity(const bool visible)
   m_renderer->setRefLayersVisiblity(visible);
 }
 
+void EditorRender::setRefLayersLowQuality(const bool lowQuality)
+{
+  m_renderer->setRefLayersLowQuality(lowQuality);
+}
+
 void EditorRender::setNonactiveLayersOpacity(const int opacity)
 {
   m_renderer->setNonactiveLayersOpacity(opacity);
@@ -78,6 +83,12 @@ void EditorRender::setProjection(const render::Projection& projection)
 }
 
 void EditorRender::setupBackground(Doc* doc, doc::PixelFormat pixelFormat)
+{
+  m_renderer->setBgOptions(makeBgOptions(doc, pixelFormat));
+}
+
+// static
+render::BgOptions EditorRender::makeBgOptions(Doc* doc, doc::PixelFormat pixelFormat)
 {
   DocumentPreferences& docPref = Preferences::instance().document(doc);
   render::BgType bgType;
@@ -120,7 +131,7 @@ void EditorRender::setupBackground(Doc* doc, doc::PixelFormat pixelFormat)
   bg.color1 = color_utils::color_for_image_without_alpha(docPref.bg.color1(), pixelFormat);
   bg.color2 = color_utils::color_for_image_without_alpha(docPref.bg.color2(), pixelFormat);
   bg.stripeSize = tile;
-  m_renderer->setBgOptions(bg);
+  return bg;
 }
 
 void EditorRender::setTransparentBackground()
@@ -176,6 +187,16 @@ void EditorRender::disableOnionskin()
   m_renderer->disableOnionskin();
 }
 
+void EditorRender::setLayerStackCache(const doc::Layer* layer)
+{
+  m_renderer->setLayerStackCache(layer);
+}
+
+void EditorRender::invalidateLayerStackCache()
+{
+  m_renderer->invalidateLayerStackCache();
+}
+
 void EditorRender::renderSprite(
   os::Surface* dstSurface,
   const doc::Sprite* sprite,
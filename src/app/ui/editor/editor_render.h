@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -55,12 +55,14 @@ namespace app {
     }
 
     void setRefLayersVisiblity(const bool visible);
+    void setRefLayersLowQuality(const bool lowQuality);
     void setNonactiveLayersOpacity(const int opacity);
     void setNewBlendMethod(const bool newBlend);
 
     void setProjection(const render::Projection& projection);
 
     void setupBackground(Doc* doc, doc::PixelFormat pixelFormat);
+    static render::BgOptions makeBgOptions(Doc* doc, doc::PixelFormat pixelFormat);
     void setTransparentBackground();
 
     void setSelectedLayer(const doc::Layer* layer);
@@ -85,6 +87,9 @@ namespace app {
     void setOnionskin(const render::OnionskinOptions& options);
     void disableOnionskin();
 
+    void setLayerStackCache(const doc::Layer* layer);
+    void invalidateLayerStackCache();
+
     void renderSprite(
       os::Surface* dstSurface,
       const doc::Sprite* sprite,
@@ -124,6 +124,10 @@ namespace app {
     // drawing cursor.
     virtual bool requireBrushPreview() { return false; }
 
+    // Returns true if this state modifies only the pixels of the
+    // active layer (so the editor can cache the layers below it).
+    virtual bool modifiesOnlyActiveLayer() const { return false; }
+
     // Returns true if this state allow layer edges and cel guides
     virtual bool allowLayerEdges() { return false; }
 
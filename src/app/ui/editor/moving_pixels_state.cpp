@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -405,7 +405,7 @@ void MovingPixelsState::onCommitMouseMove(Editor* editor,
   if (!m_pixelsMovement->isDragging())
     return;
 
-  m_pixelsMovement->setFastMode(true);
+  m_pixelsMovement->setFastMode(true, editor->getVisibleSpriteBounds());
 
   // Get the customization for the pixels movement (snap to grid, angle snap, etc.).
   KeyContext keyContext = KeyContext::Normal;
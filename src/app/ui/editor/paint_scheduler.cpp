@@ -0,0 +1,108 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/paint_scheduler.h"
+
+#include <algorithm>
+
+namespace app {
+
+namespace {
+
+// Maximum number of rectangles to paint separately, several small
+// rectangles are more expensive to paint than their bounds.
+const int kMaxRects = 16;
+
+int64_t region_area(const gfx::Region& region)
+{
+  int64_t area = 0;
+  for (const gfx::Rect& rc : region)
+    area += int64_t(rc.w) * rc.h;
+  return area;
+}
+
+int64_t rect_area(const gfx::Rect& rc)
+{
+  return int64_t(rc.w) * rc.h;
+}
+
+} // anonymous namespace
+
+PaintScheduler::PaintScheduler(const PaintFunc& paint, ui::Widget* owner)
+  : m_paint(paint)
+  , m_timer(0, owner)
+{
+  m_timer.Tick.connect([this]{ onTick(); });
+}
+
+void PaintScheduler::setRate(const int fps)
+{
+  m_timer.setInterval(fps > 0 ? std::max(1, 1000 / fps): 0);
+}
+
+void PaintScheduler::invalidate(const gfx::Region& region)
+{
+  if (region.isEmpty())
+    return;
+
+  ++m_stats.requests;
+  m_stats.requestedArea += region_area(region);
+  m_region |= region;
+
+  // The first region is painted immediately (so the first point of a
+  // stroke doesn't wait) and the next ones are accumulated until the
+  // next timer tick.
+  if (!m_timer.isRunning()) {
+    flush();
+    if (m_timer.interval() > 0)
+      m_timer.start();
+  }
+}
+
+void PaintScheduler::flush()
+{
+  if (m_region.isEmpty())
+    return;
+
+  // Coalesce several small rectangles or rectangles that cover
+  // most of their bounds into one rectangle
+  const gfx::Rect bounds = m_region.bounds();
+  const int64_t area = region_area(m_region);
+  if (int(m_region.size()) > kMaxRects ||
+      rect_area(bounds) <= area + area/2) {
+    m_region = gfx::Region(bounds);
+  }
+
+  if (!m_paint(m_region))
+    return;
+
+  ++m_stats.flushes;
+  m_stats.paintedArea += region_area(m_region);
+  m_region.clear();
+}
+
+void PaintScheduler::discard()
+{
+  m_region.clear();
+  m_timer.stop();
+}
+
+void PaintScheduler::onTick()
+{
+  // Stop the timer when there is nothing more to paint, so the next
+  // invalidated region is painted immediately
+  if (m_region.isEmpty()) {
+    m_timer.stop();
+    return;
+  }
+  flush();
+}
+
+} // namespace app
@@ -0,0 +1,67 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_PAINT_SCHEDULER_H_INCLUDED
+#define APP_UI_EDITOR_PAINT_SCHEDULER_H_INCLUDED
+#pragma once
+
+#include "gfx/region.h"
+#include "ui/timer.h"
+
+#include <cstdint>
+#include <functional>
+
+namespace app {
+
+  // Accumulates the regions of the sprite that must be repainted
+  // (e.g. each point of a freehand stroke) and paints them at most
+  // one time per display refresh. With high-rate input devices
+  // (tablets reporting 240 events per second or more) this avoids
+  // repainting the same pixels several times in the same frame.
+  class PaintScheduler {
+  public:
+    typedef std::function<bool(const gfx::Region&)> PaintFunc;
+
+    struct Stats {
+      int requests = 0;             // Calls to invalidate()
+      int flushes = 0;              // Calls to the paint function
+      int64_t requestedArea = 0;    // Sum of all invalidated areas
+      int64_t paintedArea = 0;      // Sum of all painted areas
+    };
+
+    // The paint function returns false if the region cannot be
+    // painted right now (e.g. the document is locked) and must be
+    // retried in the next refresh.
+    PaintScheduler(const PaintFunc& paint, ui::Widget* owner = nullptr);
+
+    // Number of flushes per second (0 to paint immediately each
+    // invalidated region).
+    void setRate(int fps);
+
+    void invalidate(const gfx::Region& region);
+
+    // Paints the pending region right now (if any).
+    void flush();
+
+    // Discards the pending region (e.g. when the whole editor is
+    // going to be repainted).
+    void discard();
+
+    const Stats& stats() const { return m_stats; }
+    void resetStats() { m_stats = Stats(); }
+
+  private:
+    void onTick();
+
+    PaintFunc m_paint;
+    gfx::Region m_region;
+    ui::Timer m_timer;
+    Stats m_stats;
+  };
+
+} // namespace app
+
+#endif
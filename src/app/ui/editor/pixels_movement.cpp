@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -128,7 +128,7 @@ PixelsMovement::PixelsMovement(
   , m_maskColor(m_site.sprite()->transparentColor())
   , m_canHandleFrameChange(false)
   , m_fastMode(false)
-  , m_needsRotSpriteRedraw(false)
+  , m_needsRedraw(false)
 {
   double cornerThick = (m_site.tilemapMode() == TilemapMode::Tiles) ?
                           CORNER_THICK_FOR_TILEMAP_MODE :
@@ -184,14 +184,16 @@ void PixelsMovement::setDelegate(PixelsMovementDelegate* delegate)
   m_delegate = delegate;
 }
 
-void PixelsMovement::setFastMode(const bool fastMode)
+void PixelsMovement::setFastMode(const bool fastMode,
+                                 const gfx::Rect& visibleBounds)
 {
   bool redraw = (m_fastMode && !fastMode);
   m_fastMode = fastMode;
-  if (m_needsRotSpriteRedraw && redraw) {
+  m_fastModeBounds = visibleBounds;
+  if (m_needsRedraw && redraw) {
     redrawExtraImage();
     update_screen_for_document(m_document);
-    m_needsRotSpriteRedraw = false;
+    m_needsRedraw = false;
   }
 }
 
@@ -773,6 +775,10 @@ void PixelsMovement::stampImage(bool finalStamp)
   ContextWriter writer(m_reader, 1000);
   Cel* currentCel = m_site.cel();
 
+  // Stamp the final image, not the preview of the fast mode
+  m_fastMode = false;
+  m_needsRedraw = false;
+
   CelList cels;
   if (finalStamp) {
     cels = getEditableCels();
@@ -1086,7 +1092,8 @@ void PixelsMovement::drawImage(
     drawParallelogram(
       transformation,
       dst, m_originalImage.get(),
-      m_initialMask.get(), corners, pt);
+      m_initialMask.get(), corners, pt,
+      renderOriginalLayer);
   }
 }
 
@@ -1118,8 +1125,32 @@ void PixelsMovement::drawParallelogram(
   const Transformation& transformation,
   doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
   const Transformation::Corners& corners,
-  const gfx::PointF& leftTop)
+  const gfx::PointF& leftTop,
+  const bool preview)
 {
+  // Fast preview of the extra cel while the user is dragging the
+  // handles, it's re-drawn with the selected algorithm when the
+  // fast mode is disabled.
+  if (m_fastMode && preview) {
+    gfx::Rect clip = dst->bounds();
+    if (!m_fastModeBounds.isEmpty())
+      clip &= gfx::Rect(m_fastModeBounds).offset(-int(leftTop.x), -int(leftTop.y));
+
+    doc::algorithm::parallelogram_fast(
+      dst, src, (mask ? mask->bitmap(): nullptr),
+      int(corners.leftTop().x-leftTop.x),
+      int(corners.leftTop().y-leftTop.y),
+      int(corners.rightTop().x-leftTop.x),
+      int(corners.rightTop().y-leftTop.y),
+      int(corners.rightBottom().x-leftTop.x),
+      int(corners.rightBottom().y-leftTop.y),
+      int(corners.leftBottom().x-leftTop.x),
+      int(corners.leftBottom().y-leftTop.y),
+      clip);
+    m_needsRedraw = true;
+    return;
+  }
+
   tools::RotationAlgorithm rotAlgo = Preferences::instance().selection.rotationAlgorithm();
 
   // When the scale isn't modified and we have no rotation or a
@@ -1135,7 +1166,7 @@ void PixelsMovement::drawParallelogram(
 
   // Don't use RotSprite if we are in "fast mode"
   if (rotAlgo == tools::RotationAlgorithm::ROTSPRITE && m_fastMode) {
-    m_needsRotSpriteRedraw = true;
+    m_needsRedraw = true;
     rotAlgo = tools::RotationAlgorithm::FAST;
   }
 
@@ -1168,9 +1199,11 @@ retry:;      // In case that we don't have enough memory for RotSprite
           int(corners.rightBottom().x-leftTop.x),
           int(corners.rightBottom().y-leftTop.y),
           int(corners.leftBottom().x-leftTop.x),
-          int(corners.leftBottom().y-leftTop.y));
+          int(corners.leftBottom().y-leftTop.y),
+          &m_rotSpriteCache);
       }
       catch (const std::bad_alloc&) {
+        m_rotSpriteCache.clear();
         StatusBar::instance()->showTip(
           1000,
           Strings::statusbar_tips_not_enough_rotsprite_memory());
@@ -1282,6 +1315,8 @@ void PixelsMovement::flipOriginalImage(const doc::algorithm::FlipType flipType)
     m_initialMask->bitmap(),
     gfx::Rect(gfx::Point(0, 0), m_initialMask->bounds().size()),
     flipType);
+
+  m_rotSpriteCache.clear();
 }
 
 void PixelsMovement::shiftOriginalImage(const int dx, const int dy,
@@ -1289,6 +1324,8 @@ void PixelsMovement::shiftOriginalImage(const int dx, const int dy,
 {
   doc::algorithm::shift_image(
     m_originalImage.get(), dx, dy, angle);
+
+  m_rotSpriteCache.clear();
 }
 
 // Returns the list of cels that will be transformed (the first item
@@ -1403,6 +1440,7 @@ void PixelsMovement::reproduceAllTransformationsWithInnerCmds()
 
   m_document->setMask(m_initialMask0.get());
   m_initialMask->copyFrom(m_initialMask0.get());
+  m_rotSpriteCache.clear();
   m_originalImage.reset(
     new_image_from_mask(
       m_site, m_initialMask.get(),
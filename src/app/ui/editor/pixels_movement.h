@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -16,6 +16,7 @@
 #include "app/tx.h"
 #include "app/ui/editor/handle_type.h"
 #include "doc/algorithm/flip_type.h"
+#include "doc/algorithm/rotsprite.h"
 #include "doc/frame.h"
 #include "doc/image_ref.h"
 #include "gfx/size.h"
@@ -79,7 +80,11 @@ namespace app {
     bool canHandleFrameChange() const { return m_canHandleFrameChange; }
 
     void setDelegate(PixelsMovementDelegate* delegate);
-    void setFastMode(const bool fastMode);
+    // In fast mode the image is drawn with a faster (lower quality)
+    // algorithm, and only the visibleBounds (in sprite coordinates)
+    // are drawn if they are specified.
+    void setFastMode(const bool fastMode,
+                     const gfx::Rect& visibleBounds = gfx::Rect());
 
     void trim();
     void cutMask();
@@ -147,7 +152,8 @@ namespace app {
       const Transformation& transformation,
       doc::Image* dst, const doc::Image* src, const doc::Mask* mask,
       const Transformation::Corners& corners,
-      const gfx::PointF& leftTop);
+      const gfx::PointF& leftTop,
+      const bool preview = false);
     void drawTransformedTilemap(
       const Transformation& transformation,
       doc::Image* dst, const doc::Image* src, const doc::Mask* mask);
@@ -186,9 +192,15 @@ namespace app {
     bool m_canHandleFrameChange;
 
     // Fast mode is used to give a faster feedback to the user
-    // avoiding RotSprite on each mouse movement.
+    // avoiding RotSprite on each mouse movement, and drawing the
+    // preview with parallelogram_fast() in the visible area only.
     bool m_fastMode;
-    bool m_needsRotSpriteRedraw;
+    bool m_needsRedraw;
+    gfx::Rect m_fastModeBounds;
+
+    // The original image/mask scaled for RotSprite, so they are not
+    // scaled again on each rotation change.
+    doc::algorithm::RotSpriteCache m_rotSpriteCache;
 
     // Commands used in the interaction with the transformed pixels.
     // This is used to re-create the whole interaction on each
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -18,6 +18,7 @@
 #include "app/tools/ink.h"
 #include "app/ui/editor/editor.h"
 #include "app/ui/editor/editor_customization_delegate.h"
+#include "app/ui/editor/playback_cache.h"
 #include "app/ui/editor/scrolling_state.h"
 #include "app/ui/skin/skin_theme.h"
 #include "app/ui_context.h"
@@ -26,10 +27,16 @@
 #include "ui/message.h"
 #include "ui/system.h"
 
+#include <algorithm>
+#include <vector>
+
 namespace app {
 
 using namespace ui;
 
+// Maximum number of frames to render in advance
+static constexpr int kMaxPrefetchFrames = 16;
+
 PlayState::PlayState(const bool playOnce,
                      const bool playAll,
                      const bool playSubtags)
@@ -114,6 +121,8 @@ void PlayState::onEnterState(Editor* editor)
   // running.
   if (!m_playTimer.isRunning())
     m_playTimer.start();
+
+  prefetchFrames();
 }
 
 EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* newState)
@@ -123,6 +132,9 @@ EditorState::LeaveAction PlayState::onLeaveState(Editor* editor, EditorState* ne
   if (!m_toScroll) {
     m_playTimer.stop();
 
+    // Pending frames are not needed anymore
+    PlaybackCache::instance()->cancel(m_editor->document());
+
     if (m_playOnce || Preferences::instance().general.rewindOnStop())
       m_editor->setFrame(m_refFrame);
   }
@@ -217,6 +229,7 @@ void PlayState::onPlaybackTick()
 
   m_nextFrameTime -= (base::current_tick() - m_curFrameTick);
 
+  const doc::frame_t oldFrame = m_editor->frame();
   while (m_nextFrameTime <= 0) {
     doc::frame_t frame = m_playback.nextFrame();
     if (m_playback.isStopped() ||
@@ -232,6 +245,56 @@ void PlayState::onPlaybackTick()
   }
 
   m_curFrameTick = base::current_tick();
+
+  if (m_editor->isPlaying() &&
+      m_editor->frame() != oldFrame)
+    prefetchFrames();
+}
+
+void PlayState::prefetchFrames()
+{
+  const Sprite* sprite = m_editor->sprite();
+  const int n = std::min(PlaybackCache::instance()->maxFrames(sprite),
+                         kMaxPrefetchFrames);
+  if (n <= 0)
+    return;
+
+  // doc::Playback cannot be copied to simulate the next frames, so we
+  // predict the next ones in the range of the played tag (or the
+  // whole sprite) using its animation direction. A ping-pong
+  // animation gets the frames in both directions.
+  frame_t from = 0;
+  frame_t to = sprite->lastFrame();
+  int step = +1;
+  bool pingPong = false;
+  if (const Tag* tag = (m_playback.tag() ? m_playback.tag(): m_tag)) {
+    from = tag->fromFrame();
+    to = tag->toFrame();
+    switch (tag->aniDir()) {
+      case AniDir::REVERSE:
+        step = -1;
+        break;
+      case AniDir::PING_PONG:
+      case AniDir::PING_PONG_REVERSE:
+        pingPong = true;
+        break;
+      default:
+        break;
+    }
+  }
+
+  const frame_t frame = std::clamp(m_editor->frame(), from, to);
+  const frame_t len = to - from + 1;
+  std::vector<frame_t> frames;
+  frames.reserve(n);
+  frames.push_back(frame);
+  for (frame_t i=1; i<len && int(frames.size()) < n; ++i) {
+    frames.push_back(from + (frame - from + len + step*i) % len);
+    if (pingPong && int(frames.size()) < n && i < len-i)
+      frames.push_back(from + (frame - from + len - step*i) % len);
+  }
+
+  m_editor->prefetchPlaybackFrames(frames);
 }
 
 // Before executing any command, we stop the animation
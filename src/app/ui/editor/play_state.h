@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -46,6 +46,10 @@ namespace app {
   private:
     void onPlaybackTick();
 
+    // Asks the editor to render in background the next frames that
+    // will be played.
+    void prefetchFrames();
+
     // ContextObserver
     void onBeforeCommandExecution(CommandExecutionEvent& ev);
 
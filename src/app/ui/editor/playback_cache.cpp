@@ -0,0 +1,361 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/ui/editor/playback_cache.h"
+
+#include "app/doc.h"
+#include "app/doc_access.h"
+#include "app/memory_report.h"
+#include "app/pref/preferences.h"
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/sprite.h"
+#include "doc/tag.h"
+#include "doc/tileset.h"
+#include "render/render.h"
+
+#include <algorithm>
+#include <memory>
+
+namespace app {
+
+namespace {
+
+std::unique_ptr<PlaybackCache> g_instance;
+
+class Fingerprint {
+public:
+  template<typename T>
+  void add(const T value) {
+    m_hash ^= uint64_t(value) + 0x9e3779b97f4a7c15ull + (m_hash << 6) + (m_hash >> 2);
+  }
+  uint64_t value() const { return m_hash; }
+private:
+  uint64_t m_hash = 0;
+};
+
+doc::Tag* get_onionskin_loop_tag(const doc::Sprite* sprite,
+                                 const doc::frame_t frame,
+                                 const PlaybackCache::Options& options)
+{
+  if (options.onionskinLoopTag)
+    return sprite->tags().innerTag(frame);
+  return nullptr;
+}
+
+// Hashes everything that is used to render the given frame (with
+// the onionskin frames). It must be called with the document locked
+// (or from the UI thread).
+uint64_t calc_fingerprint(const Doc* doc,
+                          const doc::frame_t frame,
+                          const PlaybackCache::Options& options)
+{
+  const doc::Sprite* sprite = doc->sprite();
+  Fingerprint h;
+
+  // Render options
+  h.add(int(options.bg.type));
+  h.add(options.bg.zoom);
+  h.add(int(options.bg.colorPixelFormat));
+  h.add(options.bg.color1);
+  h.add(options.bg.color2);
+  h.add(options.bg.stripeSize.w);
+  h.add(options.bg.stripeSize.h);
+  h.add(int(options.onionskin.type()));
+  h.add(int(options.onionskin.position()));
+  h.add(options.onionskin.prevFrames());
+  h.add(options.onionskin.nextFrames());
+  h.add(options.onionskin.opacityBase());
+  h.add(options.onionskin.opacityStep());
+  h.add(options.onionskinLoopTag);
+  h.add(options.onionskinCurrentLayer);
+  h.add(options.selectedLayerId);
+  h.add(options.nonactiveLayersOpacity);
+  h.add(options.newBlend);
+
+  // Sprite and palette
+  h.add(sprite->width());
+  h.add(sprite->height());
+  h.add(int(sprite->pixelFormat()));
+  h.add(sprite->transparentColor());
+  const doc::Palette* palette = sprite->palette(frame);
+  h.add(palette->size());
+  for (int i=0; i<palette->size(); ++i)
+    h.add(palette->getEntry(i));
+
+  // Frames that can be rendered
+  doc::frame_t fromFrame = frame;
+  doc::frame_t toFrame = frame;
+  if (options.onionskin.type() != render::OnionskinType::NONE) {
+    fromFrame = frame - options.onionskin.prevFrames();
+    toFrame = frame + options.onionskin.nextFrames();
+    // The onionskin can wrap around the loop tag
+    if (const doc::Tag* tag = get_onionskin_loop_tag(sprite, frame, options)) {
+      h.add(tag->fromFrame());
+      h.add(tag->toFrame());
+      h.add(int(tag->aniDir()));
+      if (fromFrame < tag->fromFrame() || toFrame > tag->toFrame()) {
+        fromFrame = std::min(fromFrame, tag->fromFrame());
+        toFrame = std::max(toFrame, tag->toFrame());
+      }
+    }
+    fromFrame = std::max(fromFrame, doc::frame_t(0));
+    toFrame = std::min(toFrame, sprite->lastFrame());
+  }
+
+  // Layers and cels
+  for (const doc::Layer* layer : sprite->allLayers()) {
+    h.add(layer->id());
+    h.add(int(layer->flags()));
+    if (!layer->isImage())
+      continue;
+
+    auto imageLayer = static_cast<const doc::LayerImage*>(layer);
+    h.add(imageLayer->opacity());
+    h.add(int(imageLayer->blendMode()));
+
+    if (layer->isTilemap()) {
+      const doc::Tileset* tileset = static_cast<const doc::LayerTilemap*>(layer)->tileset();
+      h.add(tileset->id());
+      h.add(tileset->version());
+      h.add(tileset->size());
+    }
+
+    for (doc::frame_t f=fromFrame; f<=toFrame; ++f) {
+      const doc::Cel* cel = layer->cel(f);
+      if (!cel)
+        continue;
+
+      const doc::Image* image = cel->image();
+      h.add(f);
+      h.add(cel->id());
+      h.add(image->id());
+      h.add(image->version());
+      h.add(cel->bounds().x);
+      h.add(cel->bounds().y);
+      h.add(cel->bounds().w);
+      h.add(cel->bounds().h);
+      h.add(cel->opacity());
+      h.add(cel->zIndex());
+    }
+  }
+
+  return h.value();
+}
+
+} // anonymous namespace
+
+// static
+PlaybackCache* PlaybackCache::instance()
+{
+  if (!g_instance)
+    g_instance = std::make_unique<PlaybackCache>();
+  return g_instance.get();
+}
+
+// static
+void PlaybackCache::destroyInstance()
+{
+  g_instance.reset();
+}
+
+PlaybackCache::PlaybackCache()
+  : m_tasks(sched::Priority::Background)
+{
+  m_memoryReportConn = MemoryReport::Collect.connect(
+    [this](MemoryReport& report){
+      std::lock_guard lock(m_mutex);
+      report.add("Playback cache", m_memSize);
+    });
+}
+
+PlaybackCache::~PlaybackCache()
+{
+  m_tasks.wait();
+}
+
+doc::ImageRef PlaybackCache::getFrame(Doc* doc,
+                                      const doc::frame_t frame,
+                                      const Options& options)
+{
+  const Key key(doc->id(), frame, calc_fingerprint(doc, frame, options));
+  std::lock_guard lock(m_mutex);
+
+  auto it = m_frames.find(key);
+  if (it == m_frames.end() || !it->second.image)
+    return nullptr;
+
+  // Move to the front as the most recently used
+  m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+  return it->second.image;
+}
+
+void PlaybackCache::prefetch(Doc* doc,
+                             const std::vector<doc::frame_t>& frames,
+                             const Options& options)
+{
+  if (frames.empty())
+    return;
+
+  // Calculate the fingerprints in this thread (the UI thread) as the
+  // document cannot be modified right now
+  std::vector<Key> keys;
+  keys.reserve(frames.size());
+  for (const doc::frame_t frame : frames)
+    keys.emplace_back(doc->id(), frame, calc_fingerprint(doc, frame, options));
+
+  std::lock_guard lock(m_mutex);
+  m_budget = budget();
+  m_canceled.erase(std::remove(m_canceled.begin(), m_canceled.end(), doc),
+                   m_canceled.end());
+
+  for (const Key& key : keys) {
+    if (m_frames.find(key) != m_frames.end())
+      continue;
+
+    m_lru.push_back(key);
+    m_frames[key] = Frame{ nullptr, doc, std::prev(m_lru.end()) };
+
+    m_tasks.run([this, doc, key, options]{
+      render(doc, key, options);
+    });
+  }
+}
+
+int PlaybackCache::maxFrames(const doc::Sprite* sprite) const
+{
+  const size_t frameSize = size_t(sprite->width()) * sprite->height() * 4;
+  return int(std::min<size_t>(budget() / std::max<size_t>(1, frameSize),
+                              sprite->totalFrames()));
+}
+
+void PlaybackCache::cancel(Doc* doc)
+{
+  {
+    std::lock_guard lock(m_mutex);
+    auto it = std::find_if(m_frames.begin(), m_frames.end(),
+                           [doc](const auto& pair){
+                             return (pair.second.doc == doc &&
+                                     !pair.second.image);
+                           });
+    // Nothing pending for this document
+    if (it == m_frames.end())
+      return;
+
+    m_canceled.push_back(doc);
+  }
+
+  m_tasks.wait();
+
+  std::lock_guard lock(m_mutex);
+  m_canceled.erase(std::remove(m_canceled.begin(), m_canceled.end(), doc),
+                   m_canceled.end());
+}
+
+void PlaybackCache::render(Doc* doc, const Key& key, const Options& options)
+{
+  // Warning: This is executed from a worker thread
+  doc::ImageRef image;
+  {
+    std::lock_guard lock(m_mutex);
+    auto it = m_frames.find(key);
+    if (it == m_frames.end())
+      return;
+    if (std::find(m_canceled.begin(), m_canceled.end(), doc) != m_canceled.end()) {
+      m_lru.erase(it->second.lruIt);
+      m_frames.erase(it);
+      return;
+    }
+  }
+
+  try {
+    const DocReader reader(doc, 100);
+    const doc::Sprite* sprite = doc->sprite();
+    const doc::frame_t frame = std::get<1>(key);
+
+    // The document could be modified before this task was executed
+    // (the frame will be requested again with the new fingerprint)
+    if (frame <= sprite->lastFrame() &&
+        calc_fingerprint(doc, frame, options) == std::get<2>(key)) {
+      auto selectedLayer = doc::get<doc::Layer>(options.selectedLayerId);
+
+      render::OnionskinOptions onionskin = options.onionskin;
+      onionskin.loopTag(get_onionskin_loop_tag(sprite, frame, options));
+      onionskin.layer(options.onionskinCurrentLayer ? selectedLayer: nullptr);
+
+      // Same configuration of the SimpleRenderer used by the Editor
+      render::Render render;
+      render.setRefLayersVisiblity(true);
+      render.setNonactiveLayersOpacity(options.nonactiveLayersOpacity);
+      render.setNewBlend(options.newBlend);
+      render.setBgOptions(options.bg);
+      render.setSelectedLayer(selectedLayer);
+      render.setOnionskin(onionskin);
+
+      image.reset(doc::Image::create(doc::IMAGE_RGB,
+                                     sprite->width(),
+                                     sprite->height()));
+      render.renderSprite(image.get(), sprite, frame,
+                          gfx::Clip(sprite->bounds()));
+    }
+  }
+  catch (const LockedDocException&) {
+    // The document is locked by other thread, the frame will be
+    // rendered by the Editor or requested again
+  }
+  catch (const std::exception&) {
+    image.reset();
+  }
+
+  std::lock_guard lock(m_mutex);
+  auto it = m_frames.find(key);
+  if (it == m_frames.end())
+    return;
+
+  if (!image) {
+    m_lru.erase(it->second.lruIt);
+    m_frames.erase(it);
+    return;
+  }
+
+  it->second.image = image;
+  m_memSize += size_t(image->getMemSize());
+  shrink();
+}
+
+void PlaybackCache::shrink()
+{
+  // Remove the least recently used frames (the pending ones are
+  // kept, they will be counted when they are rendered)
+  auto lruIt = m_lru.end();
+  while (m_memSize > m_budget && lruIt != m_lru.begin()) {
+    --lruIt;
+    auto it = m_frames.find(*lruIt);
+    ASSERT(it != m_frames.end());
+    if (!it->second.image)
+      continue;
+
+    m_memSize -= size_t(it->second.image->getMemSize());
+    m_frames.erase(it);
+    lruIt = m_lru.erase(lruIt);
+  }
+}
+
+// static
+size_t PlaybackCache::budget()
+{
+  return size_t(std::max(0, Preferences::instance().editor.playbackCacheSize()))
+    * 1024 * 1024;
+}
+
+} // namespace app
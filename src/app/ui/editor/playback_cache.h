@@ -0,0 +1,119 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#define APP_UI_EDITOR_PLAYBACK_CACHE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/frame.h"
+#include "doc/image_ref.h"
+#include "doc/object_id.h"
+#include "obs/connection.h"
+#include "render/bg_options.h"
+#include "render/onionskin_options.h"
+#include "sched/task_group.h"
+
+#include <cstdint>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace doc {
+  class Sprite;
+}
+
+namespace app {
+
+  class Doc;
+
+  // Frames of a document rendered ahead in background threads while
+  // the animation is played in an Editor. Frames are rendered in
+  // sprite pixels (without zoom, as the new render engine does), so
+  // they can be used with any zoom level and scroll position, and by
+  // several editors at the same time (e.g. the preview window).
+  //
+  // A cached frame is used only if its fingerprint (render options,
+  // layers, cels, image versions, palette, etc.) doesn't change, so
+  // any modification to the document invalidates the frames that
+  // depend on it.
+  class PlaybackCache {
+  public:
+    // Same options used by the Editor to configure the renderer.
+    struct Options {
+      render::BgOptions bg;
+      render::OnionskinOptions onionskin = render::OnionskinOptions(render::OnionskinType::NONE);
+      bool onionskinLoopTag = false;      // Use the inner tag of each frame as the onionskin loop
+      bool onionskinCurrentLayer = false; // Onionskin only for the selected layer
+      doc::ObjectId selectedLayerId = doc::NullId;
+      int nonactiveLayersOpacity = 255;
+      bool newBlend = true;
+    };
+
+    static PlaybackCache* instance();
+    static void destroyInstance();
+
+    PlaybackCache();
+    ~PlaybackCache();
+
+    // Returns the rendered frame (an RGB image of the sprite size),
+    // or nullptr if it's not ready yet.
+    doc::ImageRef getFrame(Doc* doc,
+                           const doc::frame_t frame,
+                           const Options& options);
+
+    // Renders in background the given frames that are not in the
+    // cache yet.
+    void prefetch(Doc* doc,
+                  const std::vector<doc::frame_t>& frames,
+                  const Options& options);
+
+    // Maximum number of frames of the given sprite that fit in the
+    // memory budget (0 if the cache is disabled).
+    int maxFrames(const doc::Sprite* sprite) const;
+
+    // Cancels the pending frames of the given document and waits the
+    // ones that are being rendered (it must be called before the
+    // document is deleted).
+    void cancel(Doc* doc);
+
+  private:
+    // Document ID, frame, and fingerprint
+    typedef std::tuple<doc::ObjectId, doc::frame_t, uint64_t> Key;
+
+    struct Frame {
+      doc::ImageRef image;      // nullptr if it's pending
+      Doc* doc;
+      std::list<Key>::iterator lruIt;
+    };
+
+    void render(Doc* doc, const Key& key, const Options& options);
+    void shrink();
+
+    // Memory budget from the preferences (it can be called only from
+    // the UI thread).
+    static size_t budget();
+
+    mutable std::mutex m_mutex;
+    std::map<Key, Frame> m_frames;
+    std::list<Key> m_lru;       // Most recently used first
+    size_t m_memSize = 0;
+    size_t m_budget = 0;        // Last budget() value
+
+    // Documents with pending frames that were canceled
+    std::vector<Doc*> m_canceled;
+
+    sched::TaskGroup m_tasks;
+    obs::scoped_connection m_memoryReportConn;
+
+    DISABLE_COPYING(PlaybackCache);
+  };
+
+} // namespace app
+
+#endif
@@ -880,7 +880,8 @@ bool StandbyState::overSelectionEdges(Editor* editor,
       editor->document()->hasMaskBoundaries() &&
       // TODO improve this check, how we can know that we aren't in the MovingPixelsState
       !dynamic_cast<MovingPixelsState*>(editor->getState().get())) {
-    gfx::Point mainOffset(editor->mainTilePosition());
+    gfx::Point mainOffset(editor->mainTilePosition() +
+                          editor->document()->maskBoundaries().origin());
 
     // For each selection edge
     for (const auto& seg : editor->document()->maskBoundaries()) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -47,6 +47,7 @@
 #include "app/util/layer_utils.h"
 #include "doc/cel.h"
 #include "doc/image.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
 #include "doc/palette.h"
@@ -56,6 +57,7 @@
 #include "doc/sprite.h"
 #include "fmt/format.h"
 #include "render/dithering.h"
+#include "render/frame_fingerprint.h"
 #include "render/rasterize.h"
 #include "render/render.h"
 #include "ui/ui.h"
@@ -452,6 +454,52 @@ protected:
 //////////////////////////////////////////////////////////////////////
 // For drawing
 
+// Returns the sprite rendered with all visible layers to be used as
+// the source image of the floodfill (magic wand, paint bucket,
+// etc.). The last rendered frame is cached, so clicking several
+// times in the same frame doesn't render the whole sprite again.
+static ImageRef get_all_layers_floodfill_image(const Sprite* sprite,
+                                               const frame_t frame)
+{
+  static struct {
+    ObjectId spriteId = NullId;
+    frame_t frame = 0;
+    uint64_t fingerprint = 0;
+    ImageRef image;
+  } cache;
+
+  const bool newBlend = Preferences::instance().experimental.newBlend();
+  const uint64_t fingerprint = render::frame_fingerprint(sprite, frame, newBlend);
+  if (cache.image &&
+      cache.spriteId == sprite->id() &&
+      cache.frame == frame &&
+      cache.fingerprint == fingerprint) {
+    return cache.image;
+  }
+
+  // Release the old image before creating the new one
+  cache.image.reset();
+
+  ImageRef image(Image::create(sprite->pixelFormat(),
+                               sprite->width(),
+                               sprite->height()));
+  image->clear(sprite->transparentColor());
+
+  render::Render render;
+  render.setNewBlend(newBlend);
+  render.renderSprite(
+    image.get(),
+    sprite,
+    frame,
+    gfx::Clip(sprite->bounds()));
+
+  cache.spriteId = sprite->id();
+  cache.frame = frame;
+  cache.fingerprint = fingerprint;
+  cache.image = image;
+  return image;
+}
+
 class ToolLoopImpl : public ToolLoopBase,
                      public EditorObserver {
   Context* m_context;
@@ -466,6 +514,7 @@ class ToolLoopImpl : public ToolLoopBase,
   Tx m_tx;
   std::unique_ptr<ExpandCelCanvas> m_expandCelCanvas;
   Image* m_floodfillSrcImage;
+  ImageRef m_floodfillSrcImageRef; // Owner of m_floodfillSrcImage (if it isn't getSrcImage())
   bool m_saveLastPoint;
 
 public:
@@ -496,22 +545,12 @@ public:
       // Prepare a special image for floodfill when it's configured to
       // stop using all visible layers.
       else if (m_toolPref.floodfill.referTo() == gen::FillReferTo::ALL_LAYERS) {
-        m_floodfillSrcImage = Image::create(m_sprite->pixelFormat(),
-                                            m_sprite->width(),
-                                            m_sprite->height());
-
-        m_floodfillSrcImage->clear(m_sprite->transparentColor());
-
-        render::Render render;
-        render.setNewBlend(Preferences::instance().experimental.newBlend());
-        render.renderSprite(
-          m_floodfillSrcImage,
-          m_sprite,
-          m_frame,
-          gfx::Clip(m_sprite->bounds()));
+        m_floodfillSrcImageRef = get_all_layers_floodfill_image(m_sprite, m_frame);
+        m_floodfillSrcImage = m_floodfillSrcImageRef.get();
       }
       else if (Cel* cel = m_layer->cel(m_frame)) {
-        m_floodfillSrcImage = render::rasterize_with_sprite_bounds(cel);
+        m_floodfillSrcImageRef.reset(render::rasterize_with_sprite_bounds(cel));
+        m_floodfillSrcImage = m_floodfillSrcImageRef.get();
       }
     }
 
@@ -589,9 +628,6 @@ public:
     if (m_editor)
       m_editor->remove_observer(this);
 #endif
-
-    if (m_floodfillSrcImage != getSrcImage())
-      delete m_floodfillSrcImage;
   }
 
   // IToolLoop interface
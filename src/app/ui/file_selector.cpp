@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -892,7 +892,7 @@ void FileSelector::onGoUp()
 void FileSelector::onRefreshFolder()
 {
   auto fs = FileSystemModule::instance();
-  fs->refresh();
+  fs->refresh(true);
 
   m_fileList->setCurrentFolder(m_fileList->currentFolder());
 }
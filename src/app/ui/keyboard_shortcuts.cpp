@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -50,6 +50,10 @@ namespace {
 
   static std::vector<KeyShortcutAction> g_actions;
 
+  // Incremented each time the accelerators of some key or the list of
+  // keys is modified (to re-create the KeyboardShortcuts index).
+  static int g_keysVersion = 0;
+
   static const std::vector<KeyShortcutAction>& actions() {
     if (g_actions.empty()) {
       g_actions = std::vector<KeyShortcutAction> {
@@ -424,6 +428,7 @@ void Key::add(const ui::Accelerator& accel,
 {
   m_adds.emplace_back(source, accel);
   m_accels.reset();
+  ++g_keysVersion;
 
   // Remove the accelerator from other commands
   if (source == KeySource::ExtensionDefined ||
@@ -516,6 +521,7 @@ void Key::disableAccel(const ui::Accelerator& accel,
 
   m_dels.emplace_back(source, accel);
   m_accels.reset();
+  ++g_keysVersion;
 }
 
 void Key::reset()
@@ -523,6 +529,7 @@ void Key::reset()
   erase_accels(m_adds, KeySource::UserDefined);
   erase_accels(m_dels, KeySource::UserDefined);
   m_accels.reset();
+  ++g_keysVersion;
 }
 
 void Key::copyOriginalToUser()
@@ -536,6 +543,7 @@ void Key::copyOriginalToUser()
   for (const auto& kv : copy)
     m_adds.emplace_back(KeySource::UserDefined, kv.second);
   m_accels.reset();
+  ++g_keysVersion;
 }
 
 std::string Key::triggerString() const
@@ -605,12 +613,14 @@ void KeyboardShortcuts::setKeys(const KeyboardShortcuts& keys,
   else {
     m_keys = keys.m_keys;
   }
+  ++g_keysVersion;
   UserChange();
 }
 
 void KeyboardShortcuts::clear()
 {
   m_keys.clear();
+  ++g_keysVersion;
 }
 
 void KeyboardShortcuts::importFile(TiXmlElement* rootElement, KeySource source)
@@ -1078,6 +1088,70 @@ void KeyboardShortcuts::disableAccel(const ui::Accelerator& accel,
   }
 }
 
+Keys KeyboardShortcuts::pressedKeys(const Message* msg,
+                                    const KeyContext keyContext) const
+{
+  Keys result;
+
+  auto keyMsg = dynamic_cast<const KeyMessage*>(msg);
+  if (!keyMsg) {
+    for (const KeyPtr& key : m_keys) {
+      if (key->isPressed(msg, *this, keyContext))
+        result.push_back(key);
+    }
+    return result;
+  }
+
+  // Same accelerators compared in Accelerator::isPressed()
+  const KeysIndex& index = keysIndex();
+  std::vector<int> candidates;
+  auto addCandidates = [&index, &candidates](const Accelerator& accel) {
+    auto it = index.byAccel.find(accel.toString());
+    if (it != index.byAccel.end())
+      candidates.insert(candidates.end(), it->second.begin(), it->second.end());
+  };
+  if (keyMsg->scancode())
+    addCandidates(Accelerator(keyMsg->modifiers(), keyMsg->scancode(), 0));
+  if (keyMsg->unicodeChar())
+    addCandidates(Accelerator(keyMsg->modifiers(), kKeyNil, keyMsg->unicodeChar()));
+
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+
+  for (const int i : candidates) {
+    const KeyPtr& key = m_keys[i];
+    if (key->isPressed(msg, *this, keyContext))
+      result.push_back(key);
+  }
+  return result;
+}
+
+const KeyboardShortcuts::KeysIndex& KeyboardShortcuts::keysIndex() const
+{
+  if (m_index.version == g_keysVersion &&
+      m_index.nkeys == m_keys.size())
+    return m_index;
+
+  m_index.byAccel.clear();
+  m_index.actionsByContext.clear();
+  for (int i=0; i<int(m_keys.size()); ++i) {
+    const KeyPtr& key = m_keys[i];
+    if (key->type() == KeyType::Action)
+      m_index.actionsByContext[key->keycontext()].push_back(i);
+
+    for (const Accelerator& accel : key->accels()) {
+      std::vector<int>& keys = m_index.byAccel[accel.toString()];
+      // A key could have the same accelerator two times
+      if (keys.empty() || keys.back() != i)
+        keys.push_back(i);
+    }
+  }
+  m_index.version = g_keysVersion;
+  m_index.nkeys = m_keys.size();
+  return m_index;
+}
+
 KeyContext KeyboardShortcuts::getCurrentKeyContext() const
 {
   Doc* doc = UIContext::instance()->activeDocument();
@@ -1117,9 +1191,8 @@ bool KeyboardShortcuts::getCommandFromKeyMessage(const Message* msg, Command** c
   };
   int n = (contexts[0] != contexts[1] ? 2: 1);
   for (int i = 0; i < n; ++i) {
-    for (KeyPtr& key : m_keys) {
-      if (key->type() == KeyType::Command &&
-          key->isPressed(msg, *this, contexts[i])) {
+    for (const KeyPtr& key : pressedKeys(msg, contexts[i])) {
+      if (key->type() == KeyType::Command) {
         if (command) *command = key->command();
         if (params) *params = key->params();
         return true;
@@ -1156,12 +1229,16 @@ KeyAction KeyboardShortcuts::getCurrentActionModifiers(KeyContext context)
 {
   KeyAction flags = KeyAction::None;
 
-  for (const KeyPtr& key : m_keys) {
-    if (key->type() == KeyType::Action &&
-        key->keycontext() == context &&
-        key->isLooselyPressed()) {
+  // Only action keys of the given context
+  const KeysIndex& index = keysIndex();
+  auto it = index.actionsByContext.find(context);
+  if (it == index.actionsByContext.end())
+    return flags;
+
+  for (const int i : it->second) {
+    const KeyPtr& key = m_keys[i];
+    if (key->isLooselyPressed())
       flags = static_cast<KeyAction>(int(flags) | int(key->action()));
-    }
   }
 
   return flags;
@@ -1220,6 +1297,7 @@ void KeyboardShortcuts::clearMouseWheelKeys()
     else
       ++it;
   }
+  ++g_keysVersion;
 }
 
 void KeyboardShortcuts::addMissingMouseWheelKeys()
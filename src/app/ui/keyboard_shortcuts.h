@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,10 @@
 #include "app/ui/key.h"
 #include "obs/signal.h"
 
+#include <string>
+#include <unordered_map>
+#include <vector>
+
 class TiXmlElement;
 
 namespace app {
@@ -58,6 +62,13 @@ namespace app {
                       const KeyContext keyContext,
                       const Key* newKey);
 
+    // Returns the keys with an accelerator pressed in the given
+    // message for the given context (in the same order of the list
+    // of keys). Key messages are matched with an index of
+    // accelerators instead of comparing all keys.
+    Keys pressedKeys(const ui::Message* msg,
+                     const KeyContext keyContext) const;
+
     KeyContext getCurrentKeyContext() const;
     bool getCommandFromKeyMessage(const ui::Message* msg, Command** command, Params* params);
     tools::Tool* getCurrentQuicktool(tools::Tool* currentTool);
@@ -81,7 +92,20 @@ namespace app {
     void exportKeys(TiXmlElement& parent, KeyType type);
     void exportAccel(TiXmlElement& parent, const Key* key, const ui::Accelerator& accel, bool removed);
 
+    // Index of m_keys by accelerator (Accelerator::toString(), which
+    // is used to compare accelerators), and of action keys by
+    // context. It's re-created when the keys (or their accelerators)
+    // are modified.
+    struct KeysIndex {
+      int version = -1;
+      std::size_t nkeys = 0;
+      std::unordered_map<std::string, std::vector<int>> byAccel;
+      std::unordered_map<KeyContext, std::vector<int>> actionsByContext;
+    };
+    const KeysIndex& keysIndex() const;
+
     mutable Keys m_keys;
+    mutable KeysIndex m_index;
   };
 
   std::string key_tooltip(const char* str, const Key* key);
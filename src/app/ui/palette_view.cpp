@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -51,6 +51,7 @@
 #include "ui/widget.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdlib>
 #include <cstring>
 #include <set>
@@ -359,6 +360,10 @@ PaletteView::PaletteView(bool editable, PaletteViewStyle style, PaletteViewDeleg
 {
   setFocusStop(true);
   setDoubleBuffered(true);
+  // All the changes call invalidate(), so we can keep the painted
+  // entries while the palette doesn't change (and repaint them in
+  // the render thread, big palettes with tiles are expensive)
+  setPaintInRenderThread(true);
 
   m_palConn = App::instance()->PaletteChange.connect(&PaletteView::onAppPaletteChange, this);
   m_csConn = App::instance()->ColorSpaceChange.connect(
@@ -406,13 +411,14 @@ void PaletteView::setColumns(int columns)
 
 void PaletteView::deselect()
 {
-  bool invalidate = (m_selectedEntries.picks() > 0);
+  const int firstPick = m_selectedEntries.firstPick();
+  const int lastPick = m_selectedEntries.lastPick();
 
   m_selectedEntries.resize(m_adapter->size());
   m_selectedEntries.clear();
 
-  if (invalidate)
-    this->invalidate();
+  if (firstPick >= 0)
+    invalidateEntries(firstPick, lastPick);
 }
 
 void PaletteView::selectColor(int index)
@@ -421,11 +427,18 @@ void PaletteView::selectColor(int index)
     return;
 
   if (m_currentEntry != index || !m_selectedEntries[index]) {
+    // Invalidate only the entries that can change (the previous
+    // selected entry and fg/bg indicators, and the new one)
+    for (const int i : { m_currentEntry, m_paintedFgIndex, m_paintedBgIndex }) {
+      if (i >= 0)
+        invalidateEntries(i, i);
+    }
+    invalidateEntries(index, index);
+
     m_currentEntry = index;
     m_rangeAnchor = index;
 
     update_scroll(m_currentEntry);
-    invalidate();
   }
 }
 
@@ -445,7 +458,7 @@ void PaletteView::selectRange(int index1, int index2)
             m_selectedEntries.begin()+std::max(index1, index2)+1, true);
 
   update_scroll(index2);
-  invalidate();
+  invalidateEntries(index1, index2);
 }
 
 int PaletteView::getSelectedEntry() const
@@ -510,25 +523,31 @@ doc::Tileset* PaletteView::tileset() const
 
 app::Color PaletteView::getColorByPosition(const gfx::Point& pos)
 {
-  gfx::Point relPos = pos - bounds().origin();
-  for (int i=0; i<m_adapter->size(); ++i) {
-    auto box = getPaletteEntryBounds(i);
-    box.inflate(childSpacing());
-    if (box.contains(relPos))
-      return app::Color::fromIndex(i);
+  const gfx::Point relPos = pos - bounds().origin();
+  const gfx::Point cell = getEntryCellAt(relPos);
+  const int size = m_adapter->size();
+
+  // Only the entries around the cell can contain the position
+  for (int row=std::max(0, cell.y-1); row<=cell.y+1; ++row) {
+    for (int col=std::max(0, cell.x-1); col<=cell.x+1 && col<m_columns; ++col) {
+      const int i = col + row*m_columns;
+      if (i >= size)
+        return app::Color::fromMask();
+
+      auto box = getPaletteEntryBounds(i);
+      box.inflate(childSpacing());
+      if (box.contains(relPos))
+        return app::Color::fromIndex(i);
+    }
   }
   return app::Color::fromMask();
 }
 
 doc::tile_t PaletteView::getTileByPosition(const gfx::Point& pos)
 {
-  gfx::Point relPos = pos - bounds().origin();
-  for (int i=0; i<m_adapter->size(); ++i) {
-    auto box = getPaletteEntryBounds(i);
-    box.inflate(childSpacing());
-    if (box.contains(relPos))
-      return doc::tile(i, 0);
-  }
+  const app::Color color = getColorByPosition(pos);
+  if (color.getType() == app::Color::IndexType)
+    return doc::tile(color.getIndex(), 0);
   return doc::notile;
 }
 
@@ -831,8 +850,19 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
     }
   }
 
+  m_paintedFgIndex = fgIndex;
+  m_paintedBgIndex = bgIndex;
+
   g->fillRect(theme->colors.editorFace(), bounds);
 
+  // Only the entries inside the clip bounds are painted (big
+  // palettes can have thousands of entries and we see a few rows
+  // only). When we are dragging entries the indexes/boxes are
+  // displaced, so we iterate all of them.
+  const gfx::Rect clipBounds = g->getClipBounds();
+  int visibleFrom, visibleTo;
+  getVisibleEntries(clipBounds, visibleFrom, visibleTo);
+
   // Draw palette/tileset entries
   int picksCount = m_selectedEntries.picks();
   int idxOffset = 0;
@@ -841,7 +871,9 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
   if (dragging && !m_copy) palSize -= picksCount;
   if (resizing) palSize = m_hot.color;
 
-  for (int i=0; i<palSize; ++i) {
+  const int entriesFrom = (dragging ? 0: std::min(visibleFrom, palSize));
+  const int entriesTo = (dragging ? palSize: std::min(visibleTo, palSize));
+  for (int i=entriesFrom; i<entriesTo; ++i) {
     if (dragging) {
       if (!m_copy) {
         while (i+idxOffset < m_selectedEntries.size() &&
@@ -854,6 +886,9 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
     }
 
     gfx::Rect box = getPaletteEntryBounds(i + boxOffset);
+    if (!gfx::Rect(box).enlarge(childSpacing()).intersects(clipBounds))
+      continue;
+
     gfx::Color negColor;
     m_adapter->drawEntry(g, theme, i + idxOffset, i + boxOffset,
                          childSpacing(), box, negColor);
@@ -918,7 +953,9 @@ void PaletteView::onPaint(ui::PaintEvent& ev)
   PalettePicks& picks = (dragging ? dragPicks: m_selectedEntries);
 
   const int size = m_adapter->size();
-  for (int i=0; i<size; ++i) {
+  const int selectedFrom = (dragging ? 0: std::min(visibleFrom, size));
+  const int selectedTo = (dragging ? size: std::min(visibleTo, size));
+  for (int i=selectedFrom; i<selectedTo; ++i) {
     // TODO why does this fail?
     //ASSERT(i >= 0 && i < m_selectedEntries.size());
     if (i >= 0 && i < m_selectedEntries.size() &&
@@ -1085,31 +1122,81 @@ gfx::Rect PaletteView::getPaletteEntryBounds(int index) const
     boxsize, boxsize);
 }
 
+// Returns the column/row of the cell (entry + spacing) in the given
+// position (in client coordinates). It can be outside the palette.
+gfx::Point PaletteView::getEntryCellAt(const gfx::Point& pos) const
+{
+  const gfx::Rect box = getPaletteEntryBounds(0);
+  const double cellSize = boxSizePx() + childSpacing();
+  return gfx::Point(int(std::floor((pos.x - box.x) / cellSize)),
+                    int(std::floor((pos.y - box.y) / cellSize)));
+}
+
+// Range of entries [from, to) in the rows that intersect the given
+// clip bounds (plus one row above/below for the selection outline).
+void PaletteView::getVisibleEntries(const gfx::Rect& clip, int& from, int& to) const
+{
+  from = std::max(0, getEntryCellAt(clip.origin()).y - 1) * m_columns;
+  to = std::max(0, getEntryCellAt(clip.point2()).y + 2) * m_columns;
+}
+
+// Invalidates the rows from index1 to index2 (or just the entries
+// between them if they are in the same row), including the
+// selection outline.
+void PaletteView::invalidateEntries(int index1, int index2)
+{
+  if (index1 > index2)
+    std::swap(index1, index2);
+
+  gfx::Rect rc = getPaletteEntryBounds(index1);
+  rc |= getPaletteEntryBounds(index2);
+  if (index1 / m_columns != index2 / m_columns) {
+    rc.x = 0;
+    rc.w = clientBounds().w;
+  }
+
+  auto theme = SkinTheme::get(this);
+  rc.enlarge(theme->dimensions.paletteOutlineWidth() + childSpacing());
+  invalidateRect(rc.offset(origin()));
+}
+
 PaletteView::Hit PaletteView::hitTest(const gfx::Point& pos)
 {
   auto theme = SkinTheme::get(this);
   const int outlineWidth = theme->dimensions.paletteOutlineWidth();
   const int size = m_adapter->size();
 
+  // Only the entries around this cell can contain the position (the
+  // bounds of the entries with their outline/spacing are a little
+  // bigger than one cell)
+  const gfx::Point cell = getEntryCellAt(pos);
+  const int rowFrom = std::max(0, cell.y-1);
+  const int rowTo = cell.y+1;
+  const int colFrom = std::max(0, cell.x-1);
+  const int colTo = std::min(m_columns-1, cell.x+1);
+
   if (m_state == State::WAITING && m_editable) {
     // First check if the mouse is inside the selection outline.
-    for (int i=0; i<size; ++i) {
-      if (!m_selectedEntries[i])
-        continue;
+    for (int row=rowFrom; row<=rowTo; ++row) {
+      for (int col=colFrom; col<=colTo; ++col) {
+        const int i = col + row*m_columns;
+        if (i >= size || !m_selectedEntries[i])
+          continue;
 
-      bool top    = (i >= m_columns             && i-m_columns >= 0   ? m_selectedEntries[i-m_columns]: false);
-      bool bottom = (i < size-m_columns         && i+m_columns < size ? m_selectedEntries[i+m_columns]: false);
-      bool left   = ((i%m_columns)>0            && i-1         >= 0   ? m_selectedEntries[i-1]: false);
-      bool right  = ((i%m_columns)<m_columns-1  && i+1         < size ? m_selectedEntries[i+1]: false);
+        bool top    = (i >= m_columns             && i-m_columns >= 0   ? m_selectedEntries[i-m_columns]: false);
+        bool bottom = (i < size-m_columns         && i+m_columns < size ? m_selectedEntries[i+m_columns]: false);
+        bool left   = ((i%m_columns)>0            && i-1         >= 0   ? m_selectedEntries[i-1]: false);
+        bool right  = ((i%m_columns)<m_columns-1  && i+1         < size ? m_selectedEntries[i+1]: false);
 
-      gfx::Rect box = getPaletteEntryBounds(i);
-      box.enlarge(outlineWidth);
+        gfx::Rect box = getPaletteEntryBounds(i);
+        box.enlarge(outlineWidth);
 
-      if ((!top    && gfx::Rect(box.x, box.y, box.w, outlineWidth).contains(pos)) ||
-          (!bottom && gfx::Rect(box.x, box.y+box.h-outlineWidth, box.w, outlineWidth).contains(pos)) ||
-          (!left   && gfx::Rect(box.x, box.y, outlineWidth, box.h).contains(pos)) ||
-          (!right  && gfx::Rect(box.x+box.w-outlineWidth, box.y, outlineWidth, box.h).contains(pos)))
-        return Hit(Hit::OUTLINE, i);
+        if ((!top    && gfx::Rect(box.x, box.y, box.w, outlineWidth).contains(pos)) ||
+            (!bottom && gfx::Rect(box.x, box.y+box.h-outlineWidth, box.w, outlineWidth).contains(pos)) ||
+            (!left   && gfx::Rect(box.x, box.y, outlineWidth, box.h).contains(pos)) ||
+            (!right  && gfx::Rect(box.x+box.w-outlineWidth, box.y, outlineWidth, box.h).contains(pos)))
+          return Hit(Hit::OUTLINE, i);
+      }
     }
 
     // Check if we are in the resize handle
@@ -1122,15 +1209,20 @@ PaletteView::Hit PaletteView::hitTest(const gfx::Point& pos)
   View* view = View::getView(this);
   ASSERT(view);
   gfx::Rect vp = view->viewportBounds();
-  for (int i=0; ; ++i) {
-    gfx::Rect box = getPaletteEntryBounds(i);
-    if (i >= size && box.y2() > vp.h)
-      break;
+  for (int row=rowFrom; row<=rowTo; ++row) {
+    for (int col=colFrom; col<=colTo; ++col) {
+      const int i = col + row*m_columns;
+      gfx::Rect box = getPaletteEntryBounds(i);
+      // Entries after the palette end are valid until the end of
+      // the viewport (to resize the palette/drop entries there)
+      if (i >= size && box.y2() > vp.h)
+        break;
 
-    box.w += childSpacing();
-    box.h += childSpacing();
-    if (box.contains(pos))
-      return Hit(Hit::COLOR, i);
+      box.w += childSpacing();
+      box.h += childSpacing();
+      if (box.contains(pos))
+        return Hit(Hit::COLOR, i);
+    }
   }
 
   gfx::Rect box = getPaletteEntryBounds(0);
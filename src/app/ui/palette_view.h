@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -169,6 +169,9 @@ namespace app {
     void update_scroll(int color);
     void onAppPaletteChange();
     gfx::Rect getPaletteEntryBounds(int index) const;
+    gfx::Point getEntryCellAt(const gfx::Point& pos) const;
+    void getVisibleEntries(const gfx::Rect& clip, int& from, int& to) const;
+    void invalidateEntries(int index1, int index2);
     Hit hitTest(const gfx::Point& pos);
     void dropColors(int beforeIndex);
     void getEntryBoundsAndClip(int i,
@@ -195,6 +198,10 @@ namespace app {
     double m_boxsize;
     int m_currentEntry;
     int m_rangeAnchor;
+    // Entries with the fg/bg indicators in the last onPaint() (to
+    // invalidate them when the selected color changes)
+    int m_paintedFgIndex = -1;
+    int m_paintedBgIndex = -1;
     doc::PalettePicks m_selectedEntries;
     bool m_isUpdatingColumns;
     obs::scoped_connection m_palConn;
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -197,18 +197,24 @@ void ResourcesListBox::onTick()
 
   std::unique_ptr<Resource> resource;
   std::string name;
+  bool added = false;
 
   while (m_resourcesLoader->next(resource)) {
     std::unique_ptr<ResourceListItem> listItem(onCreateResourceItem(resource.get()));
     insertChild(getItemsCount()-1, listItem.get());
+
+    resource.release();
+    listItem.release();
+    added = true;
+  }
+
+  // Sort and layout all the new items just once
+  if (added) {
     sortItems();
     layout();
 
     if (View* view = View::getView(this))
       view->updateView();
-
-    resource.release();
-    listItem.release();
   }
 
   if (m_resourcesLoader->isDone()) {
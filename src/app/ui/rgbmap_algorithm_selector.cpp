@@ -19,12 +19,14 @@ RgbMapAlgorithmSelector::RgbMapAlgorithmSelector()
   // addItem() must match the RgbMapAlgorithm enum
   static_assert(int(doc::RgbMapAlgorithm::DEFAULT) == 0 &&
                 int(doc::RgbMapAlgorithm::RGB5A3) == 1 &&
-                int(doc::RgbMapAlgorithm::OCTREE) == 2,
+                int(doc::RgbMapAlgorithm::OCTREE) == 2 &&
+                int(doc::RgbMapAlgorithm::KDTREE) == 3,
                 "Unexpected doc::RgbMapAlgorithm values");
 
   addItem(Strings::rgbmap_algorithm_selector_default());
   addItem(Strings::rgbmap_algorithm_selector_rgb5a3());
   addItem(Strings::rgbmap_algorithm_selector_octree());
+  addItem(Strings::rgbmap_algorithm_selector_kdtree());
 
   algorithm(doc::RgbMapAlgorithm::DEFAULT);
 }
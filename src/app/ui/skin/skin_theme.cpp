@@ -290,6 +290,7 @@ SkinTheme::~SkinTheme()
 
   m_unscaledSheet.reset();
   m_sheet.reset();
+  m_cachedSheets.clear();
   m_parts_by_id.clear();
 
   // Delete all styles.
@@ -375,24 +376,43 @@ void SkinTheme::loadAll(const std::string& themeId,
 
 void SkinTheme::loadSheet()
 {
-  // Load the skin sheet
+  // Load the skin sheet (or use the already decoded one if the file
+  // wasn't modified)
   std::string sheet_filename(base::join_path(m_path, "sheet.png"));
-  os::SurfaceRef newSheet;
-  try {
-    newSheet = os::instance()->loadRgbaSurface(sheet_filename.c_str());
+  const base::Time time = base::get_modification_time(sheet_filename);
+  CachedSheet& cached = m_cachedSheets[sheet_filename];
+  if (!cached.sheet || !time.valid() || !(cached.time == time)) {
+    cached.sheet.reset();
+    try {
+      cached.sheet = os::instance()->loadRgbaSurface(sheet_filename.c_str());
+    }
+    catch (...) {
+      // Ignore the error, the sheet is nullptr and we will throw our
+      // own exception.
+    }
+    if (!cached.sheet) {
+      m_cachedSheets.erase(sheet_filename);
+      throw base::Exception("Error loading %s file", sheet_filename.c_str());
+    }
+    cached.sheet->setImmutable();
+    cached.time = time;
   }
-  catch (...) {
-    // Ignore the error, newSheet is nullptr and we will throw our own
-    // exception.
+
+  // The unscaled sheet is shared with the cache (it's never
+  // modified), and the scaled one is a copy (applyScale() modifies
+  // the surface).
+  m_unscaledSheet = cached.sheet;
+
+  os::SurfaceRef newSheet =
+    os::instance()->makeRgbaSurface(m_unscaledSheet->width(),
+                                    m_unscaledSheet->height());
+  {
+    os::SurfaceLock lockSrc(m_unscaledSheet.get());
+    os::SurfaceLock lockDst(newSheet.get());
+    m_unscaledSheet->blitTo(newSheet.get(), 0, 0, 0, 0,
+                            m_unscaledSheet->width(),
+                            m_unscaledSheet->height());
   }
-  if (!newSheet)
-    throw base::Exception("Error loading %s file", sheet_filename.c_str());
-
-  // TODO Change os::Surface::applyScale() to return a new surface,
-  //      avoid loading two times the same file (even more, if there
-  //      is no scale to apply, m_unscaledSheet must reference the
-  //      same m_sheet).
-  m_unscaledSheet = os::instance()->loadRgbaSurface(sheet_filename.c_str());
 
   // Replace the sprite sheet
   if (m_sheet)
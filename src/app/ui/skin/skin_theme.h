@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2023  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -10,6 +10,7 @@
 #pragma once
 
 #include "app/ui/skin/skin_part.h"
+#include "base/time.h"
 #include "gfx/color.h"
 #include "gfx/fwd.h"
 #include "ui/cursor.h"
@@ -184,6 +185,14 @@ namespace app {
       os::SurfaceRef m_sheet;
       // Contains the sheet surface as is, without any scale.
       os::SurfaceRef m_unscaledSheet;
+      // Decoded sheet.png files (unscaled) of the loaded themes, so
+      // they are not decoded again when the theme is regenerated
+      // (e.g. when the UI scale changes). The key is the file path.
+      struct CachedSheet {
+        base::Time time;
+        os::SurfaceRef sheet;
+      };
+      std::map<std::string, CachedSheet> m_cachedSheets;
       std::map<std::string, SkinPartPtr> m_parts_by_id;
       // Stores the same SkinParts as m_parts_by_id but unscaled, using the same keys.
       std::map<std::string, SkinPartPtr> m_unscaledParts_by_id;
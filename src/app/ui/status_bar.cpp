@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -107,6 +107,18 @@ class StatusBar::Indicators : public HBox {
     };
     Indicator(IndicatorType type) : m_type(type) { }
     IndicatorType indicatorType() const { return m_type; }
+  protected:
+    // Changes the minimum size of the indicator, returns true if the
+    // Indicators box must be re-layouted (the size changed),
+    // in other case just the indicator is invalidated.
+    bool updateMinSize(const gfx::Size& sz) {
+      if (minSize() == sz) {
+        invalidate();
+        return false;
+      }
+      setMinSize(sz);
+      return true;
+    }
   private:
     IndicatorType m_type;
   };
@@ -124,10 +136,9 @@ class StatusBar::Indicators : public HBox {
       setText(text);
 
       if (minSize().w > textSize().w*2)
-        setMinSize(textSize());
+        return updateMinSize(textSize());
       else
-        setMinSize(minSize().createUnion(textSize()));
-      return true;
+        return updateMinSize(minSize().createUnion(textSize()));
     }
 
   private:
@@ -166,13 +177,12 @@ class StatusBar::Indicators : public HBox {
       ASSERT(part);
       m_part = part;
       m_colored = colored;
-      updateIndicator();
-      return true;
+      return updateIndicator();
     }
 
   private:
-    void updateIndicator() {
-      setMinSize(
+    bool updateIndicator() {
+      return updateMinSize(
         minSize().createUnion(Size(m_part->bitmap(0)->width(),
                                    m_part->bitmap(0)->height())));
     }
@@ -211,8 +221,7 @@ class StatusBar::Indicators : public HBox {
         return false;
 
       m_color = color;
-      setMinSize(minSize().createUnion(Size(32*guiscale(), 1)));
-      return true;
+      return updateMinSize(minSize().createUnion(Size(32*guiscale(), 1)));
     }
 
   private:
@@ -243,8 +252,7 @@ class StatusBar::Indicators : public HBox {
         return false;
 
       m_tile = tile;
-      setMinSize(minSize().createUnion(Size(32*guiscale(), 1)));
-      return true;
+      return updateMinSize(minSize().createUnion(Size(32*guiscale(), 1)));
     }
 
   private:
@@ -56,10 +56,12 @@
 #include "os/font.h"
 #include "os/surface.h"
 #include "os/system.h"
+#include "ui/move_region.h"
 #include "ui/ui.h"
 
 #include <algorithm>
 #include <cstdio>
+#include <cstdlib>
 #include <vector>
 
 namespace app {
@@ -161,6 +163,12 @@ namespace {
       return SelectLayerBoundariesOp::REPLACE;
   }
 
+  // Division rounding to negative infinity (for coordinates above/at
+  // the left of the first row/column)
+  int floor_div(const int a, const int b) {
+    return (a >= 0 ? a / b: -((-a + b - 1) / b));
+  }
+
 } // anonymous namespace
 
 Timeline::Hit::Hit(int part,
@@ -262,6 +270,8 @@ Timeline::Timeline(TooltipManager* tooltipManager)
     &Timeline::onBeforeCommandExecution, this);
   m_ctxConn2 = m_context->AfterCommandExecution.connect(
     &Timeline::onAfterCommandExecution, this);
+  m_celThumbnailsConn = m_celThumbnails.ThumbnailReady.connect(
+    [this]{ invalidate(); });
   m_context->documents().add_observer(this);
   m_context->add_observer(this);
 
@@ -406,6 +416,7 @@ void Timeline::detachDocument()
 
   if (m_document) {
     m_thumbnailsPrefConn.disconnect();
+    m_celThumbnails.wait();
     m_document->remove_observer(this);
     m_document = nullptr;
   }
@@ -1648,6 +1659,15 @@ void Timeline::onPaint(ui::PaintEvent& ev)
     getDrawableLayers(&firstLayer, &lastLayer);
     getDrawableFrames(&firstFrame, &lastFrame);
 
+    // Draw only the rows/columns inside the invalid region (the
+    // clipping region of the paint event), so with big sprites a
+    // small change doesn't redraw all visible cels
+    {
+      const gfx::Rect clip = g->getClipBounds();
+      clipDrawableLayers(clip, &firstLayer, &lastLayer);
+      clipDrawableFrames(clip, &firstFrame, &lastFrame);
+    }
+
     drawTop(g);
 
     // Draw the header for layers.
@@ -1906,6 +1926,13 @@ void Timeline::onAfterRemoveCel(DocEvent& ev)
   invalidateLayer(ev.layer());
 }
 
+void Timeline::onPaletteChanged(DocEvent& ev)
+{
+  // Thumbnails of indexed images depend on the palette
+  m_celThumbnails.invalidate();
+  invalidate();
+}
+
 void Timeline::onLayerNameChange(DocEvent& ev)
 {
   invalidate();
@@ -2046,6 +2073,41 @@ void Timeline::getDrawableFrames(frame_t* firstFrame, frame_t* lastFrame)
       + getCelsBounds().w) / frameBoxWidth());
 }
 
+void Timeline::clipDrawableLayers(const gfx::Rect& clip,
+                                  layer_t* firstDrawableLayer,
+                                  layer_t* lastDrawableLayer)
+{
+  const int y = topHeight() + headerBoxHeight() - viewScroll().y;
+  const int h = layerBoxHeight();
+  if (h <= 0 || clip.isEmpty())
+    return;
+
+  // Layers are drawn from the last one (at the top) to the first one
+  *firstDrawableLayer = std::max(
+    *firstDrawableLayer,
+    layer_t(lastLayer() - floor_div(clip.y2() - 1 - y, h)));
+  *lastDrawableLayer = std::min(
+    *lastDrawableLayer,
+    layer_t(lastLayer() - floor_div(clip.y - y, h)));
+}
+
+void Timeline::clipDrawableFrames(const gfx::Rect& clip,
+                                  frame_t* firstDrawableFrame,
+                                  frame_t* lastDrawableFrame)
+{
+  const int x = separatorX() + m_separator_w - viewScroll().x;
+  const int w = frameBoxWidth();
+  if (w <= 0 || clip.isEmpty())
+    return;
+
+  *firstDrawableFrame = std::max(
+    *firstDrawableFrame,
+    frame_t(floor_div(clip.x - x, w)));
+  *lastDrawableFrame = std::min(
+    *lastDrawableFrame,
+    frame_t(floor_div(clip.x2() - 1 - x, w)));
+}
+
 void Timeline::drawPart(ui::Graphics* g, const gfx::Rect& bounds,
                         const std::string* text, ui::Style* style,
                         const bool is_active,
@@ -2390,7 +2452,7 @@ void Timeline::drawCel(ui::Graphics* g,
         skinTheme()->calcBorder(this, style));
 
     if (!thumb_bounds.isEmpty()) {
-      if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, thumb_bounds.size())) {
+      if (os::SurfaceRef surface = m_celThumbnails.get(m_document, cel, thumb_bounds.size())) {
         const int t = std::clamp(thumb_bounds.w/8, 4, 16);
         draw_checkered_grid(g, thumb_bounds, gfx::Size(t, t), docPref());
 
@@ -2484,7 +2546,7 @@ void Timeline::drawCelOverlay(ui::Graphics* g)
 
   gfx::Rect rc = m_sprite->bounds().fitIn(
     gfx::Rect(m_thumbnailsOverlayBounds).shrink(1));
-  if (os::SurfaceRef surface = thumb::get_cel_thumbnail(cel, rc.size())) {
+  if (os::SurfaceRef surface = m_celThumbnails.get(m_document, cel, rc.size())) {
     draw_checkered_grid(g, rc, gfx::Size(8, 8)*ui::guiscale(), docPref());
 
     g->drawRgbaSurface(surface.get(),
@@ -4032,27 +4094,108 @@ void Timeline::setViewScroll(const gfx::Point& pt)
   newScroll.x = std::clamp(newScroll.x, 0, maxPos.x);
   newScroll.y = std::clamp(newScroll.y, 0, maxPos.y);
 
+  if (newScroll == oldScroll)
+    return;
+
+  // The range outline can be painted outside the cels bounds, so it's
+  // repainted in its old position and in the new one.
+  gfx::Rect rangeBounds;
+  if (m_range.enabled()) {
+    rangeBounds = getRangeBounds(m_range).enlarge(outlineWidth());
+    invalidateRect(gfx::Rect(rangeBounds).offset(origin()));
+  }
+
+  // Move the already painted pixels of the scrolled areas and
+  // invalidate only the new visible parts (this is not possible when
+  // other elements are painted over the cels, like the thumbnail
+  // overlay or the marching ants of the clipboard range)
+  const gfx::Point delta = oldScroll - newScroll;
+  const bool canMovePixels =
+    (!m_thumbnailsOverlayVisible &&
+     !m_clipboard_timer.isRunning());
+
   if (newScroll.y != oldScroll.y) {
-    gfx::Rect rc;
-    rc = getLayerHeadersBounds();
-    rc.offset(origin());
-    invalidateRect(rc);
+    gfx::Rect rc = getLayerHeadersBounds();
+    if (!canMovePixels ||
+        !scrollValidRegion(rc, gfx::Point(0, delta.y))) {
+      invalidateRect(rc.offset(origin()));
+    }
   }
 
-  if (newScroll != oldScroll) {
+  {
     gfx::Rect rc;
     if (m_tagBands > 0)
       rc |= getPartBounds(Hit(PART_TAG_BAND));
-    if (m_range.enabled())
-      rc |= getRangeBounds(m_range).enlarge(outlineWidth());
     rc |= getFrameHeadersBounds();
-    rc |= getCelsBounds();
-    rc.offset(origin());
-    invalidateRect(rc);
+    if (!canMovePixels ||
+        !scrollValidRegion(rc, gfx::Point(delta.x, 0))) {
+      invalidateRect(rc.offset(origin()));
+    }
+
+    rc = getCelsBounds();
+    if (!canMovePixels ||
+        !scrollValidRegion(rc, delta)) {
+      invalidateRect(rc.offset(origin()));
+    }
   }
 
   m_hbar.setPos(newScroll.x);
   m_vbar.setPos(newScroll.y);
+
+  if (m_range.enabled()) {
+    rangeBounds = getRangeBounds(m_range).enlarge(outlineWidth());
+    invalidateRect(rangeBounds.offset(origin()));
+  }
+}
+
+// Moves the pixels of the given area (in client coordinates) that are
+// already painted on the screen, and invalidates the rest of the
+// area (similar to ui::View::onSetViewScroll()). Returns false if the
+// pixels cannot be moved.
+bool Timeline::scrollValidRegion(const gfx::Rect& rc,
+                                 const gfx::Point& delta)
+{
+  Display* display = this->display();
+  if (!display || !isVisible() || rc.isEmpty())
+    return false;
+
+  const gfx::Rect bounds = gfx::Rect(rc).offset(origin());
+  if (delta == gfx::Point(0, 0))
+    return true;
+
+  // If the area is scrolled more than its size, all is invalid
+  if (std::abs(delta.x) >= bounds.w ||
+      std::abs(delta.y) >= bounds.h)
+    return false;
+
+  // Visible region that is not overlapped by windows
+  gfx::Region drawableRegion;
+  getDrawableRegion(drawableRegion, kCutTopWindows);
+
+  // Remove the invalid regions (areas that weren't painted yet)
+  gfx::Region validRegion(bounds);
+  validRegion &= drawableRegion;
+  validRegion -= getUpdateRegion();
+  validRegion -= display->getInvalidRegion();
+
+  // Children (e.g. the transparent scroll bars) are not scrolled
+  for (const Widget* child : children()) {
+    if (child->isVisible())
+      validRegion -= gfx::Region(child->bounds());
+  }
+
+  gfx::Region invalidRegion(bounds);
+  invalidRegion &= drawableRegion;
+
+  gfx::Region movable = validRegion;
+  movable.offset(delta);
+  movable &= validRegion;
+  invalidRegion -= movable;
+  movable.offset(-delta);
+
+  ui::move_region(display, movable, delta.x, delta.y);
+  invalidateRegion(invalidRegion);
+  return true;
 }
 
 
@@ -14,6 +14,7 @@
 #include "app/docs_observer.h"
 #include "app/loop_tag.h"
 #include "app/pref/preferences.h"
+#include "app/thumbnails.h"
 #include "app/ui/editor/editor_observer.h"
 #include "app/ui/input_chain_element.h"
 #include "app/ui/timeline/ani_controls.h"
@@ -163,6 +164,7 @@ namespace app {
     void onTagChange(DocEvent& ev) override;
     void onTagRename(DocEvent& ev) override;
     void onLayerCollapsedChanged(DocEvent& ev) override;
+    void onPaletteChanged(DocEvent& ev) override;
 
     // app::Context slots.
     void onBeforeCommandExecution(CommandExecutionEvent& ev);
@@ -271,6 +273,11 @@ namespace app {
     void setCursor(ui::Message* msg, const Hit& hit);
     void getDrawableLayers(layer_t* firstLayer, layer_t* lastLayer);
     void getDrawableFrames(frame_t* firstFrame, frame_t* lastFrame);
+    void clipDrawableLayers(const gfx::Rect& clip,
+                            layer_t* firstLayer, layer_t* lastLayer);
+    void clipDrawableFrames(const gfx::Rect& clip,
+                            frame_t* firstFrame, frame_t* lastFrame);
+    bool scrollValidRegion(const gfx::Rect& rc, const gfx::Point& delta);
     void drawPart(ui::Graphics* g, const gfx::Rect& bounds,
                   const std::string* text,
                   ui::Style* style,
@@ -444,6 +451,8 @@ namespace app {
     Hit m_thumbnailsOverlayHit;
     gfx::Point m_thumbnailsOverlayDirection;
     obs::connection m_thumbnailsPrefConn;
+    thumb::CelThumbnailCache m_celThumbnails;
+    obs::scoped_connection m_celThumbnailsConn;
 
     // Temporal data used to move the range.
     struct MoveRange {
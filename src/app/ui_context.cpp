@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -35,6 +35,7 @@ UIContext* UIContext::m_instance = nullptr;
 
 UIContext::UIContext()
   : m_closedDocs(preferences())
+  , m_hibernation(preferences())
 {
   ASSERT(m_instance == nullptr);
   m_instance = this;
@@ -102,6 +103,9 @@ void UIContext::setActiveView(DocView* docView)
 
   Editor* editor = nullptr;
   if (docView) {
+    // Uncompress the document before the editor uses it
+    m_hibernation.wakeUp(docView->document());
+
     editor = docView->editor();
     mainWin->getTabsBar()->selectTab(docView);
 
@@ -304,6 +308,8 @@ void UIContext::onAddDocument(Doc* doc)
   if (!App::instance()->isGui())
     return;
 
+  m_hibernation.addDoc(doc);
+
   // Add a new view for this document
   DocView* view = new DocView(
     lastSelectedDoc(),
@@ -321,6 +327,9 @@ void UIContext::onRemoveDocument(Doc* doc)
 {
   app::Context::onRemoveDocument(doc);
 
+  m_hibernation.removeDoc(doc);
+  m_backgroundJobs.cancelJobs(doc);
+
   // We don't destroy views in batch mode.
   if (isUIAvailable()) {
     Workspace* workspace = App::instance()->workspace();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,8 +9,10 @@
 #define APP_UI_CONTEXT_H_INCLUDED
 #pragma once
 
+#include "app/background_jobs.h"
 #include "app/closed_docs.h"
 #include "app/context.h"
+#include "app/doc_hibernation.h"
 #include "app/docs_observer.h"
 
 #include <vector>
@@ -45,6 +47,8 @@ namespace app {
     // new one if it's necessary.
     Editor* getEditorFor(Doc* document);
 
+    BackgroundJobs& backgroundJobs() { return m_backgroundJobs; }
+
     bool hasClosedDocs();
     void reopenLastClosedDoc();
     std::vector<Doc*> getAndRemoveAllClosedDocs();
@@ -87,6 +91,8 @@ namespace app {
     DocView* m_targetView = nullptr;
 
     ClosedDocs m_closedDocs;
+    DocHibernation m_hibernation;
+    BackgroundJobs m_backgroundJobs;
 
     static UIContext* m_instance;
   };
@@ -0,0 +1,309 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/undo_payload.h"
+
+#include "base/debug.h"
+#include "base/exception.h"
+
+#include "zlib.h"
+
+#include <algorithm>
+
+namespace app {
+
+namespace {
+
+bool seek_file(std::FILE* file, const uint64_t pos)
+{
+#if LAF_WINDOWS
+  return (_fseeki64(file, __int64(pos), SEEK_SET) == 0);
+#else
+  return (fseeko(file, off_t(pos), SEEK_SET) == 0);
+#endif
+}
+
+} // anonymous namespace
+
+// static
+void UndoPayloadStore::compressData(Data& data)
+{
+  ASSERT(data.state == UndoPayload::State::Raw);
+
+  data.size = data.buffer.size();
+  data.compressedSize = data.size;
+
+  if (data.size > 0) {
+    uLongf len = compressBound(uLong(data.size));
+    base::buffer compressed(len);
+    if (compress2(compressed.data(), &len,
+                  data.buffer.data(), uLong(data.size),
+                  Z_BEST_SPEED) == Z_OK &&
+        len < data.size) {
+      compressed.resize(len);
+      compressed.shrink_to_fit();
+      data.buffer = std::move(compressed);
+      data.compressedSize = len;
+    }
+  }
+
+  data.state = UndoPayload::State::Compressed;
+}
+
+// static
+void UndoPayloadStore::uncompressData(Data& data)
+{
+  ASSERT(data.state == UndoPayload::State::Compressed);
+
+  if (data.compressedSize < data.size) {
+    base::buffer raw(data.size);
+    uLongf len = uLongf(data.size);
+    if (uncompress(raw.data(), &len,
+                   data.buffer.data(), uLong(data.compressedSize)) != Z_OK ||
+        len != data.size) {
+      throw base::Exception("Error uncompressing undo data");
+    }
+    data.buffer = std::move(raw);
+  }
+
+  data.state = UndoPayload::State::Raw;
+}
+
+UndoPayload::UndoPayload()
+  : m_data(std::make_shared<Data>())
+{
+}
+
+UndoPayload::~UndoPayload()
+{
+  // The store keeps a weak reference to m_data, so there is nothing
+  // to unregister here (if the data is being compressed in the
+  // background, it will be deleted when the task finishes)
+}
+
+base::buffer& UndoPayload::data()
+{
+  Data& data = *m_data;
+  std::lock_guard lock(data.mutex);
+
+  if (data.state == State::Spilled) {
+    ASSERT(data.store);
+    data.store->readSpilled(data);
+  }
+  if (data.state == State::Compressed)
+    UndoPayloadStore::uncompressData(data);
+
+  if (data.store)
+    data.tick = data.store->m_tick;
+  return data.buffer;
+}
+
+size_t UndoPayload::size() const
+{
+  std::lock_guard lock(m_data->mutex);
+  return (m_data->state == State::Raw ? m_data->buffer.size():
+                                        m_data->size);
+}
+
+size_t UndoPayload::memSize() const
+{
+  std::lock_guard lock(m_data->mutex);
+  return (m_data->state == State::Spilled ? 0: m_data->buffer.size());
+}
+
+UndoPayloadStore::UndoPayloadStore()
+  : m_task(sched::Priority::Background)
+{
+}
+
+UndoPayloadStore::~UndoPayloadStore()
+{
+  wait();
+
+  if (m_file)
+    std::fclose(m_file);
+}
+
+void UndoPayloadStore::setMemoryBudget(const size_t bytes)
+{
+  std::lock_guard lock(m_mutex);
+  m_budget = bytes;
+}
+
+void UndoPayloadStore::add(const std::vector<UndoPayload*>& payloads)
+{
+  std::lock_guard lock(m_mutex);
+  for (UndoPayload* payload : payloads) {
+    Data& data = *payload->m_data;
+    {
+      std::lock_guard dataLock(data.mutex);
+      ASSERT(!data.store);
+      data.store = this;
+      data.tick = m_tick;
+    }
+    m_payloads.push_back(payload->m_data);
+  }
+}
+
+void UndoPayloadStore::update()
+{
+  std::lock_guard lock(m_mutex);
+  ++m_tick;
+
+  // Just one background task per document
+  if (m_processing) {
+    m_pendingPass = true;
+    return;
+  }
+  m_processing = true;
+
+  m_task.run([this]{
+    while (true) {
+      try {
+        processPayloads();
+      }
+      catch (...) {
+        // Ignore errors (e.g. out of memory), the data will remain
+        // uncompressed in memory
+      }
+
+      std::lock_guard lock(m_mutex);
+      if (!m_pendingPass) {
+        m_processing = false;
+        break;
+      }
+      m_pendingPass = false;
+    }
+  });
+}
+
+void UndoPayloadStore::wait()
+{
+  m_task.wait();
+}
+
+void UndoPayloadStore::compressAll()
+{
+  wait();
+  try {
+    processPayloads(0);
+  }
+  catch (...) {
+    // Ignore errors as in the background task
+  }
+}
+
+size_t UndoPayloadStore::memSize() const
+{
+  std::lock_guard lock(m_mutex);
+  return m_memSize;
+}
+
+void UndoPayloadStore::processPayloads(const int hotStates)
+{
+  std::vector<std::shared_ptr<Data>> payloads;
+  size_t budget;
+  int tick;
+  {
+    std::lock_guard lock(m_mutex);
+
+    // Forget payloads that were deleted with their Cmds
+    m_payloads.erase(
+      std::remove_if(m_payloads.begin(), m_payloads.end(),
+                     [](const std::weak_ptr<Data>& data){
+                       return data.expired();
+                     }),
+      m_payloads.end());
+
+    payloads.reserve(m_payloads.size());
+    for (const auto& data : m_payloads) {
+      if (auto ptr = data.lock())
+        payloads.push_back(std::move(ptr));
+    }
+    budget = m_budget;
+    tick = m_tick;
+  }
+
+  // Compress the payloads of old states
+  size_t memSize = 0;
+  for (auto& data : payloads) {
+    std::lock_guard lock(data->mutex);
+    if (data->state == UndoPayload::State::Raw &&
+        data->tick <= tick - hotStates) {
+      compressData(*data);
+    }
+    if (data->state != UndoPayload::State::Spilled)
+      memSize += data->buffer.size();
+  }
+
+  // Move the oldest payloads to disk until we are inside the budget
+  bool anySpilled = false;
+  for (auto& data : payloads) {
+    std::lock_guard lock(data->mutex);
+    if (budget > 0 &&
+        memSize > budget &&
+        data->state == UndoPayload::State::Compressed) {
+      const size_t size = data->buffer.size();
+      if (spill(*data))
+        memSize -= size;
+    }
+    if (data->state == UndoPayload::State::Spilled)
+      anySpilled = true;
+  }
+
+  // Reuse the whole file when there is no payload on it
+  if (!anySpilled) {
+    std::lock_guard lock(m_fileMutex);
+    m_fileEnd = 0;
+  }
+
+  std::lock_guard lock(m_mutex);
+  m_memSize = memSize;
+}
+
+bool UndoPayloadStore::spill(Data& data)
+{
+  ASSERT(data.state == UndoPayload::State::Compressed);
+  std::lock_guard lock(m_fileMutex);
+
+  if (!m_file) {
+    m_file = std::tmpfile();
+    if (!m_file)
+      return false;
+  }
+
+  const size_t n = data.compressedSize;
+  if (!seek_file(m_file, m_fileEnd) ||
+      std::fwrite(data.buffer.data(), 1, n, m_file) != n) {
+    return false;
+  }
+
+  data.fileOffset = m_fileEnd;
+  data.buffer = base::buffer();
+  data.state = UndoPayload::State::Spilled;
+  m_fileEnd += n;
+  return true;
+}
+
+void UndoPayloadStore::readSpilled(Data& data)
+{
+  ASSERT(data.state == UndoPayload::State::Spilled);
+  std::lock_guard lock(m_fileMutex);
+
+  const size_t n = data.compressedSize;
+  data.buffer.resize(n);
+  if (!seek_file(m_file, data.fileOffset) ||
+      std::fread(data.buffer.data(), 1, n, m_file) != n) {
+    throw base::Exception("Error reading undo data from disk");
+  }
+  data.state = UndoPayload::State::Compressed;
+}
+
+} // namespace app
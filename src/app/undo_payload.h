@@ -0,0 +1,135 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UNDO_PAYLOAD_H_INCLUDED
+#define APP_UNDO_PAYLOAD_H_INCLUDED
+#pragma once
+
+#include "base/buffer.h"
+#include "base/disable_copying.h"
+#include "sched/task_group.h"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace app {
+
+  class UndoPayloadStore;
+
+  // Data saved by a Cmd to undo/redo it (e.g. pixels of the modified
+  // region). When the payload is registered in the UndoPayloadStore
+  // of the document, the data can be compressed or moved to disk in
+  // a background thread, and it's restored when the Cmd needs it.
+  class UndoPayload {
+  public:
+    UndoPayload();
+    ~UndoPayload();
+
+    // Returns the uncompressed data. It's uncompressed/read from disk
+    // if needed, so it must be called only from the UI thread when
+    // the Cmd is executed/undone/redone.
+    base::buffer& data();
+
+    // Size of the uncompressed data.
+    size_t size() const;
+
+    // Bytes of the data that are in memory right now.
+    size_t memSize() const;
+
+  private:
+    friend class UndoPayloadStore;
+
+    enum class State { Raw, Compressed, Spilled };
+
+    struct Data {
+      std::mutex mutex;
+      State state = State::Raw;
+      base::buffer buffer;      // Raw or compressed data
+      size_t size = 0;          // Size of the raw data
+      size_t compressedSize = 0;
+      uint64_t fileOffset = 0;
+      UndoPayloadStore* store = nullptr;
+      int tick = 0;             // Last state that used the data
+    };
+
+    std::shared_ptr<Data> m_data;
+
+    DISABLE_COPYING(UndoPayload);
+  };
+
+  // Keeps a reference to all the undo payloads of a document. The
+  // payloads of old undo states are compressed in background, and
+  // if the memory used by them is greater than the budget, the
+  // oldest ones are moved to a temporary file.
+  class UndoPayloadStore {
+  public:
+    // Number of recent undo states which payloads are kept
+    // uncompressed.
+    static constexpr int kHotStates = 4;
+
+    UndoPayloadStore();
+    ~UndoPayloadStore();
+
+    // Maximum number of bytes in memory (0 = no limit).
+    void setMemoryBudget(size_t bytes);
+
+    void add(const std::vector<UndoPayload*>& payloads);
+
+    // Must be called each time the undo state changes (a new state is
+    // added, or we undo/redo) to process the old payloads in a
+    // background thread.
+    void update();
+
+    // Waits the background task.
+    void wait();
+
+    // Compresses the payloads of all states (even the recent ones)
+    // in the calling thread (e.g. for closed documents).
+    void compressAll();
+
+    // Bytes used by the payloads in memory (computed in the last
+    // background pass).
+    size_t memSize() const;
+
+  private:
+    typedef UndoPayload::Data Data;
+
+    // Compresses the raw data. If the compressed data is not
+    // smaller, the raw data is kept as it is (compressedSize == size).
+    static void compressData(Data& data);
+    static void uncompressData(Data& data);
+
+    void processPayloads(const int hotStates = kHotStates);
+    bool spill(Data& data);
+    void readSpilled(Data& data);
+
+    mutable std::mutex m_mutex;
+    std::vector<std::weak_ptr<Data>> m_payloads; // From oldest to newest
+    size_t m_budget = 0;
+    size_t m_memSize = 0;
+    std::atomic<int> m_tick = 0;
+    bool m_processing = false;
+    bool m_pendingPass = false;
+
+    // Temporary file where payloads are moved (it's deleted
+    // automatically when it's closed).
+    std::mutex m_fileMutex;
+    std::FILE* m_file = nullptr;
+    uint64_t m_fileEnd = 0;
+
+    sched::TaskGroup m_task;
+
+    friend class UndoPayload;
+    DISABLE_COPYING(UndoPayloadStore);
+  };
+
+} // namespace app
+
+#endif
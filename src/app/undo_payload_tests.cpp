@@ -0,0 +1,89 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/undo_payload.h"
+
+#include <memory>
+#include <vector>
+
+using namespace app;
+
+static void fill(UndoPayload& payload, int n, int seed)
+{
+  base::buffer& buffer = payload.data();
+  buffer.resize(n);
+  for (int i=0; i<n; ++i)
+    buffer[i] = uint8_t((i / 64) + seed);
+}
+
+static bool check(UndoPayload& payload, int n, int seed)
+{
+  const base::buffer& buffer = payload.data();
+  if (int(buffer.size()) != n)
+    return false;
+  for (int i=0; i<n; ++i)
+    if (buffer[i] != uint8_t((i / 64) + seed))
+      return false;
+  return true;
+}
+
+TEST(UndoPayload, CompressOldStates)
+{
+  UndoPayloadStore store;
+  std::vector<std::unique_ptr<UndoPayload>> payloads;
+
+  for (int i=0; i<10; ++i) {
+    payloads.push_back(std::make_unique<UndoPayload>());
+    fill(*payloads.back(), 4096, i);
+    store.add({ payloads.back().get() });
+    store.update();
+  }
+  store.wait();
+
+  // Old payloads are compressed, recent ones are not
+  EXPECT_LT(payloads[0]->memSize(), 4096);
+  EXPECT_EQ(4096, payloads[9]->memSize());
+  for (int i=0; i<10; ++i) {
+    EXPECT_EQ(4096, payloads[i]->size());
+    EXPECT_TRUE(check(*payloads[i], 4096, i));
+  }
+}
+
+TEST(UndoPayload, SpillToDisk)
+{
+  UndoPayloadStore store;
+  store.setMemoryBudget(1);
+
+  std::vector<std::unique_ptr<UndoPayload>> payloads;
+  for (int i=0; i<10; ++i) {
+    payloads.push_back(std::make_unique<UndoPayload>());
+    fill(*payloads.back(), 4096, i);
+    store.add({ payloads.back().get() });
+    store.update();
+  }
+  store.wait();
+
+  // Old payloads are on disk
+  EXPECT_EQ(0, payloads[0]->memSize());
+  EXPECT_EQ(4096, payloads[9]->memSize());
+
+  // Delete some payloads and read the other ones from disk
+  payloads[2].reset();
+  payloads[3].reset();
+  for (int i=0; i<10; ++i) {
+    if (payloads[i])
+      EXPECT_TRUE(check(*payloads[i], 4096, i));
+  }
+
+  // Move the data to disk again
+  for (int i=0; i<UndoPayloadStore::kHotStates+1; ++i)
+    store.update();
+  store.wait();
+  EXPECT_EQ(0, payloads[0]->memSize());
+  EXPECT_TRUE(check(*payloads[0], 4096, 0));
+}
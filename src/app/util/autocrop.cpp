@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -17,9 +17,14 @@
 #include "doc/mask.h"
 #include "doc/sprite.h"
 #include "render/render.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
 
 #include <algorithm>
+#include <cstring>
+#include <iterator>
 #include <memory>
+#include <vector>
 
 namespace app {
 
@@ -87,6 +92,49 @@ bool analize_if_image_has_solid_borders(const Image* image,
   return true;
 }
 
+// Bounds of the pixels that are different between two images with
+// the same pixel format and size. Each row is compared with memcmp()
+// (which is vectorized by the C library), and only the different
+// rows are scanned to find the first/last different pixels.
+bool get_diff_bounds(const Image* image,
+                     const Image* refimage,
+                     int* x1, int* y1, int* x2, int* y2)
+{
+  ASSERT(image->pixelFormat() != IMAGE_BITMAP);
+
+  const int w = image->width();
+  const int h = image->height();
+  const int bpp = image->getRowStrideSize(1);
+  const int rowBytes = bpp*w;
+
+  *x1 = w;
+  *y1 = h;
+  *x2 = -1;
+  *y2 = -1;
+
+  for (int y=0; y<h; ++y) {
+    const uint8_t* a = image->getPixelAddress(0, y);
+    const uint8_t* b = refimage->getPixelAddress(0, y);
+    if (std::memcmp(a, b, rowBytes) == 0)
+      continue;
+
+    const int first = int(std::mismatch(a, a+rowBytes, b).first - a);
+    const int last = rowBytes - 1 - int(
+      std::mismatch(std::make_reverse_iterator(a+rowBytes),
+                    std::make_reverse_iterator(a),
+                    std::make_reverse_iterator(b+rowBytes)).first -
+      std::make_reverse_iterator(a+rowBytes));
+
+    *x1 = std::min(*x1, first / bpp);
+    *x2 = std::max(*x2, last / bpp);
+    if (*y1 == h)
+      *y1 = y;
+    *y2 = y;
+  }
+
+  return (*x1 <= *x2 && *y1 <= *y2);
+}
+
 } // anonymous namespace
 
 bool get_shrink_rect(int *x1, int *y1, int *x2, int *y2,
@@ -137,6 +185,12 @@ bool get_shrink_rect(int *x1, int *y1, int *x2, int *y2,
 bool get_shrink_rect2(int *x1, int *y1, int *x2, int *y2,
                       Image *image, Image *refimage)
 {
+  if (image->pixelFormat() == refimage->pixelFormat() &&
+      image->pixelFormat() != IMAGE_BITMAP &&
+      image->size() == refimage->size()) {
+    return get_diff_bounds(image, refimage, x1, y1, x2, y2);
+  }
+
 #define SHRINK_SIDE(u_begin, u_op, u_final, u_add,              \
                     v_begin, v_op, v_final, v_add, U, V, var)   \
   do {                                                          \
@@ -263,36 +317,58 @@ gfx::Rect get_trimmed_bounds(
   const doc::Sprite* sprite,
   const bool byGrid)
 {
-  gfx::Rect bounds;
-
-  std::unique_ptr<Image> image_wrap(Image::create(sprite->spec()));
-  Image* image = image_wrap.get();
-
-  render::Render render;
-
-  for (frame_t frame(0); frame<sprite->totalFrames(); ++frame) {
-    render.renderSprite(image, sprite, frame);
-
-    gfx::Rect frameBounds;
-    doc::color_t refColor;
-    if (get_best_refcolor_for_trimming(image, refColor) &&
-        doc::algorithm::shrink_bounds(image, refColor, nullptr, frameBounds)) {
-      bounds = bounds.createUnion(frameBounds);
-    }
+  // Each frame is rendered and trimmed independently, so ranges of
+  // frames are processed in parallel (each task with its own
+  // render::Render and image), and then we create the union of the
+  // bounds of each range.
+  const int nframes = sprite->totalFrames();
+  const int ntasks =
+    std::min(nframes,
+             2*std::max(1, sched::Scheduler::instance().threads()));
+  std::vector<gfx::Rect> tasksBounds(ntasks);
+
+  sched::TaskGroup tasks(sched::Priority::Interactive);
+  for (int t=0; t<ntasks; ++t) {
+    tasks.run([sprite, nframes, ntasks, t, &tasksBounds]{
+      const frame_t frame0 = frame_t(nframes * t / ntasks);
+      const frame_t frame1 = frame_t(nframes * (t+1) / ntasks);
+
+      std::unique_ptr<Image> image(Image::create(sprite->spec()));
+      render::Render render;
+      gfx::Rect& bounds = tasksBounds[t];
+
+      for (frame_t frame=frame0; frame<frame1; ++frame) {
+        render.renderSprite(image.get(), sprite, frame);
+
+        gfx::Rect frameBounds;
+        doc::color_t refColor;
+        if (get_best_refcolor_for_trimming(image.get(), refColor) &&
+            doc::algorithm::shrink_bounds(image.get(), refColor, nullptr, frameBounds)) {
+          bounds = bounds.createUnion(frameBounds);
+        }
+      }
+    });
+  }
+  tasks.wait();
 
-    // TODO merge this code with the code in DocExporter::captureSamples()
-    if (byGrid) {
-      const gfx::Rect& gridBounds = sprite->gridBounds();
-      gfx::Point posTopLeft =
-        snap_to_grid(gridBounds,
-                     bounds.origin(),
-                     PreferSnapTo::FloorGrid);
-      gfx::Point posBottomRight =
-        snap_to_grid(gridBounds,
-                     bounds.point2(),
-                     PreferSnapTo::CeilGrid);
-      bounds = gfx::Rect(posTopLeft, posBottomRight);
-    }
+  gfx::Rect bounds;
+  for (const gfx::Rect& rc : tasksBounds)
+    bounds = bounds.createUnion(rc);
+
+  // Snapping the union of all frames is the same as snapping the
+  // union after each frame.
+  // TODO merge this code with the code in DocExporter::captureSamples()
+  if (byGrid) {
+    const gfx::Rect& gridBounds = sprite->gridBounds();
+    gfx::Point posTopLeft =
+      snap_to_grid(gridBounds,
+                   bounds.origin(),
+                   PreferSnapTo::FloorGrid);
+    gfx::Point posBottomRight =
+      snap_to_grid(gridBounds,
+                   bounds.point2(),
+                   PreferSnapTo::CeilGrid);
+    bounds = gfx::Rect(posTopLeft, posBottomRight);
   }
   return bounds;
 }
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -41,9 +41,11 @@
 #include "render/ordered_dither.h"
 #include "render/quantization.h"
 #include "render/render.h"
+#include "sched/task_group.h"
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
 #include <memory>
 #include <vector>
 
@@ -82,22 +84,124 @@ void mask_image(Image* image, Image* bitmap)
   }
 }
 
+// Minimum number of pixels to compare the rows of the images in
+// several tasks
+constexpr int kMinPixelsForParallelDiff = 512*512;
+
+// Adds to "rects" the spans of different pixels of each row inside
+// the given bounds. Identical blocks of 64 bytes are skipped with
+// memcmp() (which is vectorized), and consecutive rows with the same
+// spans are merged in taller rectangles.
+template<typename ImageTraits>
+void collect_differences_templ(const Image* a,
+                               const Image* b,
+                               const gfx::Rect& bounds,
+                               std::vector<gfx::Rect>& rects)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  constexpr int kBlockPixels = 64 / sizeof(pixel_t);
+
+  // Rectangles of the previous rows that can still grow down
+  std::vector<gfx::Rect> open, row;
+
+  const int w = bounds.w;
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    const auto pa = (const pixel_t*)a->getPixelAddress(bounds.x, y);
+    const auto pb = (const pixel_t*)b->getPixelAddress(bounds.x, y);
+
+    row.clear();
+    for (int x=0; x<w; ) {
+      const int n = std::min(kBlockPixels, w-x);
+      if (std::memcmp(pa+x, pb+x, n*sizeof(pixel_t)) == 0) {
+        x += n;
+        continue;
+      }
+
+      while (x < w && pa[x] == pb[x])
+        ++x;
+      const int x0 = x;
+      while (x < w && pa[x] != pb[x])
+        ++x;
+      row.push_back(gfx::Rect(bounds.x+x0, y, x-x0, 1));
+    }
+
+    // Same spans as the previous row
+    if (!row.empty() &&
+        row.size() == open.size() &&
+        std::equal(row.begin(), row.end(), open.begin(),
+                   [](const gfx::Rect& r, const gfx::Rect& o){
+                     return (r.x == o.x && r.w == o.w);
+                   })) {
+      for (gfx::Rect& rc : open)
+        ++rc.h;
+    }
+    else {
+      rects.insert(rects.end(), open.begin(), open.end());
+      std::swap(open, row);
+    }
+  }
+  rects.insert(rects.end(), open.begin(), open.end());
+}
+
+// Joins the given rectangles in a region. Rectangles are joined in
+// pairs (instead of adding one rectangle each time to the same
+// region) to avoid a quadratic number of operations.
+gfx::Region create_region_from_rects(const gfx::Rect* rects,
+                                     const std::size_t n)
+{
+  if (n == 0)
+    return gfx::Region();
+  if (n == 1)
+    return gfx::Region(rects[0]);
+
+  const std::size_t half = n/2;
+  gfx::Region rgn;
+  rgn.createUnion(create_region_from_rects(rects, half),
+                  create_region_from_rects(rects+half, n-half));
+  return rgn;
+}
+
 template<typename ImageTraits>
 void create_region_with_differences_templ(const Image* a,
                                           const Image* b,
                                           const gfx::Rect& bounds,
                                           gfx::Region& output)
 {
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    for (int x=bounds.x; x<bounds.x2(); ++x) {
-      if (get_pixel_fast<ImageTraits>(a, x, y) !=
-          get_pixel_fast<ImageTraits>(b, x, y)) {
-        output.createUnion(output, gfx::Region(gfx::Rect(x, y, 1, 1)));
-      }
+  std::vector<gfx::Rect> rects;
+
+  // Compare groups of rows in parallel for big areas
+  if (bounds.w*bounds.h >= kMinPixelsForParallelDiff) {
+    const int ntasks = std::clamp(bounds.w*bounds.h / kMinPixelsForParallelDiff, 2, 16);
+    const int rowsPerTask = (bounds.h + ntasks - 1) / ntasks;
+    std::vector<std::vector<gfx::Rect>> tasksRects(ntasks);
+
+    sched::TaskGroup tasks(sched::Priority::Interactive);
+    for (int t=0; t<ntasks; ++t) {
+      const int y = bounds.y + t*rowsPerTask;
+      const gfx::Rect taskBounds =
+        (gfx::Rect(bounds.x, y, bounds.w, rowsPerTask) & bounds);
+      if (taskBounds.isEmpty())
+        continue;
+
+      tasks.run([a, b, taskBounds, &taskRects = tasksRects[t]]{
+        collect_differences_templ<ImageTraits>(a, b, taskBounds, taskRects);
+      });
     }
+    tasks.wait();
+
+    for (const auto& taskRects : tasksRects)
+      rects.insert(rects.end(), taskRects.begin(), taskRects.end());
+  }
+  else {
+    collect_differences_templ<ImageTraits>(a, b, bounds, rects);
   }
+
+  if (!rects.empty())
+    output.createUnion(output,
+                       create_region_from_rects(rects.data(), rects.size()));
 }
 
+#ifdef _DEBUG
 // TODO merge this with Sprite::getTilemapsByTileset()
 template<typename UnaryFunction>
 void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
@@ -111,6 +215,7 @@ void for_each_tile_using_tileset(Tileset* tileset, UnaryFunction f)
     for_each_pixel<TilemapTraits>(tilemapImage, f);
   }
 }
+#endif
 
 struct Mod {
   tile_index tileIndex;
@@ -127,10 +232,14 @@ void create_region_with_differences(const Image* a,
                                     gfx::Region& output)
 {
   ASSERT(a->pixelFormat() == b->pixelFormat());
+  const gfx::Rect rc = (bounds & a->bounds() & b->bounds());
+  if (rc.isEmpty())
+    return;
+
   switch (a->pixelFormat()) {
-    case IMAGE_RGB: create_region_with_differences_templ<RgbTraits>(a, b, bounds, output); break;
-    case IMAGE_GRAYSCALE: create_region_with_differences_templ<GrayscaleTraits>(a, b, bounds, output); break;
-    case IMAGE_INDEXED: create_region_with_differences_templ<IndexedTraits>(a, b, bounds, output); break;
+    case IMAGE_RGB: create_region_with_differences_templ<RgbTraits>(a, b, rc, output); break;
+    case IMAGE_GRAYSCALE: create_region_with_differences_templ<GrayscaleTraits>(a, b, rc, output); break;
+    case IMAGE_INDEXED: create_region_with_differences_templ<IndexedTraits>(a, b, rc, output); break;
   }
 }
 
@@ -324,13 +433,13 @@ Cel* create_cel_copy(CmdSequence* cmds,
       srcCel->layer()->isBackground(),
       dstSprite->transparentColor());
   }
-  // Simple case, where we copy both images
+  // Simple case, where we copy both images (Image::createCopy() is
+  // faster than compositing the image, and the copy re-uses the
+  // cached data of the source image)
   else {
-    render::composite_image(
-      dstCel->image(),
-      srcImage,
-      srcCel->sprite()->palette(srcCel->frame()),
-      0, 0, 255, BlendMode::SRC);
+    ImageRef dstImage(Image::createCopy(srcImage));
+    dstImage->setMaskColor(dstCel->image()->maskColor());
+    dstCel->data()->setImage(dstImage, dstLayer);
   }
 
   // Resize a referece cel to a non-reference layer
@@ -395,45 +504,83 @@ void draw_image_into_new_tilemap_cel(
     ASSERT(tilemapBounds.h == newTilemap->height());
   }
 
-  for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(gfx::Region(canvasBounds))) {
-    const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePt);
-    doc::ImageRef tileImage(
-      doc::crop_image(srcImage,
-                      tilePtInCanvas.x-srcImagePos.x,
-                      tilePtInCanvas.y-srcImagePos.y,
-                      tileSize.w, tileSize.h,
-                      srcImage->maskColor()));
-    if (grid.hasMask())
-      mask_image(tileImage.get(), grid.mask().get());
+  // Tiles are cropped and hashed from several threads in blocks (so
+  // we don't keep all the tiles of a big image in memory), and then
+  // they are added to the tileset in the same order of the grid.
+  const std::vector<gfx::Point> tilePts =
+    grid.tilesInCanvasRegion(gfx::Region(canvasBounds));
+  const size_t kTilesPerTask = 256;
+  const int threads = std::max(1, sched::Scheduler::instance().threads());
+  const size_t blockSize = kTilesPerTask * 2*threads;
+  std::vector<doc::ImageRef> tileImages;
+
+  auto cropTiles = [&](const size_t block, const size_t i1, const size_t i2) {
+    for (size_t i=i1; i<i2; ++i) {
+      const gfx::Point tilePtInCanvas = grid.tileToCanvas(tilePts[i]);
+      doc::ImageRef tileImage(
+        doc::crop_image(srcImage,
+                        tilePtInCanvas.x-srcImagePos.x,
+                        tilePtInCanvas.y-srcImagePos.y,
+                        tileSize.w, tileSize.h,
+                        srcImage->maskColor()));
+      if (grid.hasMask())
+        mask_image(tileImage.get(), grid.mask().get());
 
-    preprocess_transparent_pixels(tileImage.get());
+      preprocess_transparent_pixels(tileImage.get());
 
-    doc::tile_index tileIndex;
-    if (!tileset->findTileIndex(tileImage, tileIndex)) {
-      auto addTile = new cmd::AddTile(tileset, tileImage);
+      // The hash is cached in the image for findTileIndex()
+      tileImage->hash();
+      tileImages[i-block] = tileImage;
+    }
+  };
 
-      if (cmds)
-        cmds->executeAndAdd(addTile);
-      else {
-        // TODO a little hacky
-        addTile->execute(
-          static_cast<Doc*>(dstLayer->sprite()->document())->context());
+  for (size_t block=0; block<tilePts.size(); block+=blockSize) {
+    const size_t blockEnd = std::min(tilePts.size(), block+blockSize);
+    tileImages.resize(blockEnd-block);
+
+    if (threads > 1 && blockEnd-block > kTilesPerTask) {
+      sched::TaskGroup tasks(sched::Priority::Interactive);
+      for (size_t i=block; i<blockEnd; i+=kTilesPerTask) {
+        const size_t i2 = std::min(blockEnd, i+kTilesPerTask);
+        tasks.run([&cropTiles, block, i, i2]{ cropTiles(block, i, i2); });
       }
+      tasks.wait();
+    }
+    else {
+      cropTiles(block, block, blockEnd);
+    }
 
-      tileIndex = addTile->tileIndex();
+    for (size_t i=block; i<blockEnd; ++i) {
+      const gfx::Point& tilePt = tilePts[i];
+      doc::ImageRef tileImage = std::move(tileImages[i-block]);
 
-      if (!cmds)
-        delete addTile;
-    }
+      doc::tile_index tileIndex;
+      if (!tileset->findTileIndex(tileImage, tileIndex)) {
+        auto addTile = new cmd::AddTile(tileset, tileImage);
+
+        if (cmds)
+          cmds->executeAndAdd(addTile);
+        else {
+          // TODO a little hacky
+          addTile->execute(
+            static_cast<Doc*>(dstLayer->sprite()->document())->context());
+        }
+
+        tileIndex = addTile->tileIndex();
+
+        if (!cmds)
+          delete addTile;
+      }
 
-    // We were using newTilemap->putPixel() directly but received a
-    // crash report about an "access violation". So now we've added
-    // some checks to the operation.
-    {
-      const int u = tilePt.x-tilemapBounds.x;
-      const int v = tilePt.y-tilemapBounds.y;
-      ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
-      doc::put_pixel(newTilemap.get(), u, v, tileIndex);
+      // We were using newTilemap->putPixel() directly but received a
+      // crash report about an "access violation". So now we've added
+      // some checks to the operation.
+      {
+        const int u = tilePt.x-tilemapBounds.x;
+        const int v = tilePt.y-tilemapBounds.y;
+        ASSERT((u >= 0) && (v >= 0) && (u < newTilemap->width()) && (v < newTilemap->height()));
+        doc::put_pixel(newTilemap.get(), u, v, tileIndex);
+      }
     }
   }
 
@@ -520,36 +667,83 @@ void modify_tilemap_cel_region(
     regionToPatch |= region;
 
     std::vector<bool> modifiedTileIndexes(tileset->size(), false);
-    std::vector<size_t> tilesHistogram(tileset->size(), 0);
-    if (tilesetMode == TilesetMode::Auto) {
-      for_each_tile_using_tileset(
-        tileset, [tileset, &tilesHistogram](const doc::tile_t t){
-                   if (t != doc::notile) {
-                     doc::tile_index ti = doc::tile_geti(t);
-                     if (ti >= 0 && ti < tileset->size())
-                       ++tilesHistogram[ti];
-                   }
-                 });
-    }
+    std::vector<size_t> tilesHistogram;
+    if (tilesetMode == TilesetMode::Auto)
+      tileset->getTilesUsage(tilesHistogram);
+    // Ignore references to tiles outside the valid range
+    tilesHistogram.resize(tileset->size(), 0);
 
+    std::vector<gfx::Point> tilePts;
     for (const gfx::Point& tilePt : grid.tilesInCanvasRegion(regionToPatch)) {
       const int u = tilePt.x-newTilemapBounds.x;
       const int v = tilePt.y-newTilemapBounds.y;
-      OPS_TRACE(" - modify tile xy=%d %d uv=%d %d\n", tilePt.x, tilePt.y, u, v);
-      if (!newTilemap->bounds().contains(u, v))
+      if (newTilemap->bounds().contains(u, v))
+        tilePts.push_back(tilePt);
+    }
+
+    // Tiles are extracted and hashed from several threads, and the
+    // ones with the same content of their current tile are skipped
+    // (e.g. tiles in the region of a big brush that weren't really
+    // painted). The tileset is modified later in the same order of
+    // the grid. (We can get the existent tiles before modifying the
+    // tileset because each tile of the tilemap is visited once, and
+    // the tiles modified in-place are used only by that tile.)
+    const size_t kTilesPerTask = 64;
+    const int threads = std::max(1, sched::Scheduler::instance().threads());
+    std::vector<doc::ImageRef> tileImages(tilePts.size());
+
+    auto extractTiles = [&](const size_t i1, const size_t i2) {
+      for (size_t i=i1; i<i2; ++i) {
+        const gfx::Point& tilePt = tilePts[i];
+        const doc::tile_t t = newTilemap->getPixel(tilePt.x-newTilemapBounds.x,
+                                                   tilePt.y-newTilemapBounds.y);
+        const doc::tile_index ti = (t != doc::notile ? doc::tile_geti(t): doc::notile);
+        const doc::ImageRef existentTileImage = tileset->get(ti);
+
+        const gfx::Rect tileInCanvasRc(grid.tileToCanvas(tilePt), tileSize);
+        ImageRef tileImage(getTileImage(existentTileImage, tileInCanvasRc));
+        if (grid.hasMask())
+          mask_image(tileImage.get(), grid.mask().get());
+
+        preprocess_transparent_pixels(tileImage.get());
+
+        // Unmodified tile (the hash is cached in the image for
+        // findTileIndex())
+        if (existentTileImage &&
+            existentTileImage->hash() == tileImage->hash() &&
+            is_same_image(existentTileImage.get(), tileImage.get()))
+          continue;
+
+        tileImages[i] = tileImage;
+      }
+    };
+
+    if (threads > 1 && tilePts.size() > kTilesPerTask) {
+      sched::TaskGroup tasks(sched::Priority::Interactive);
+      for (size_t i=0; i<tilePts.size(); i+=kTilesPerTask) {
+        const size_t i2 = std::min(tilePts.size(), i+kTilesPerTask);
+        tasks.run([&extractTiles, i, i2]{ extractTiles(i, i2); });
+      }
+      tasks.wait();
+    }
+    else {
+      extractTiles(0, tilePts.size());
+    }
+
+    for (size_t i=0; i<tilePts.size(); ++i) {
+      const ImageRef& tileImage = tileImages[i];
+      if (!tileImage)
         continue;
 
+      const gfx::Point& tilePt = tilePts[i];
+      const int u = tilePt.x-newTilemapBounds.x;
+      const int v = tilePt.y-newTilemapBounds.y;
+      OPS_TRACE(" - modify tile xy=%d %d uv=%d %d\n", tilePt.x, tilePt.y, u, v);
+
       const doc::tile_t t = newTilemap->getPixel(u, v);
       const doc::tile_index ti = (t != doc::notile ? doc::tile_geti(t): doc::notile);
       const doc::ImageRef existentTileImage = tileset->get(ti);
 
-      const gfx::Rect tileInCanvasRc(grid.tileToCanvas(tilePt), tileSize);
-      ImageRef tileImage(getTileImage(existentTileImage, tileInCanvasRc));
-      if (grid.hasMask())
-        mask_image(tileImage.get(), grid.mask().get());
-
-      preprocess_transparent_pixels(tileImage.get());
-
       tile_index tileIndex;
       if (tileset->findTileIndex(tileImage, tileIndex)) {
         // We can re-use an existent tile (tileIndex) from the tileset
@@ -780,37 +974,33 @@ static void remove_unused_tiles_from_tileset(
 {
   OPS_TRACE("remove_unused_tiles_from_tileset\n");
 
-  int n = tileset->size();
+  // Only the modified tilemaps are scanned again to get the current
+  // usage of each tile.
+  std::vector<size_t> tilesUsage;
+  tileset->getTilesUsage(tilesUsage);
+  const int n = std::max<int>(tileset->size(), tilesUsage.size());
+
 #ifdef _DEBUG
   // Histogram just to check that we've a correct tilesHistogram
+  // (and a correct cached tiles usage)
   std::vector<size_t> tilesHistogram2(n, 0);
-#endif
-
   for_each_tile_using_tileset(
     tileset,
-    [&n
-#ifdef _DEBUG
-     , &tilesHistogram2
-#endif
-     ](const doc::tile_t t){
+    [&tilesHistogram2](const doc::tile_t t){
       if (t != doc::notile) {
         const doc::tile_index ti = doc::tile_geti(t);
-        n = std::max<int>(n, ti+1);
-#ifdef _DEBUG
-        // This check is necessary in case the tilemap has a reference
-        // to a tile outside the valid range (e.g. when we resize the
-        // tileset deleting tiles that will not be present anymore)
         if (ti >= 0 && ti < tilesHistogram2.size())
           ++tilesHistogram2[ti];
-#endif
       }
     });
 
-#ifdef _DEBUG
   for (int k=0; k<tilesHistogram.size(); ++k) {
     OPS_TRACE("comparing [%d] -> %d vs %d\n", k, tilesHistogram[k], tilesHistogram2[k]);
     ASSERT(tilesHistogram[k] == tilesHistogram2[k]);
   }
+  for (int k=0; k<tilesUsage.size(); ++k) {
+    ASSERT(tilesUsage[k] == tilesHistogram2[k]);
+  }
 #endif
 
   doc::Remap remap(n);
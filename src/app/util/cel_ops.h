@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This program is distributed under the terms of
@@ -32,6 +32,8 @@ namespace doc {
 namespace app {
   class CmdSequence;
 
+  // Returns the new content of a tile. In the Auto/Stack tileset
+  // modes it can be called from several threads at the same time.
   typedef std::function<doc::ImageRef(const doc::ImageRef& origTile,
                                       const gfx::Rect& tileBoundsInCanvas)> GetTileImageFunc;
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -20,6 +20,7 @@
 #include "app/doc_api.h"
 #include "app/doc_range.h"
 #include "app/doc_range_ops.h"
+#include "app/memory_report.h"
 #include "app/modules/gfx.h"
 #include "app/modules/gui.h"
 #include "app/pref/preferences.h"
@@ -180,6 +181,20 @@ Clipboard::Clipboard()
   g_instance = this;
 
   registerNativeFormats();
+
+  m_memoryReportConn = MemoryReport::Collect.connect(
+    [this](MemoryReport& report){
+      size_t bytes = 0;
+      if (m_data->image)
+        bytes += size_t(m_data->image->getMemSize());
+      if (m_data->tilemap)
+        bytes += size_t(m_data->tilemap->getMemSize());
+      if (m_data->tileset)
+        bytes += size_t(m_data->tileset->getMemSize());
+      if (m_data->mask)
+        bytes += size_t(m_data->mask->getMemSize());
+      report.add("Clipboard", bytes);
+    });
 }
 
 Clipboard::~Clipboard()
@@ -773,8 +788,11 @@ void Clipboard::paste(Context* ctx,
 
 ImageRef Clipboard::getImage(Palette* palette)
 {
-  // Get the image from the native clipboard.
-  if (use_native_clipboard()) {
+  // Get the image from the native clipboard (if the native content
+  // was set by us, we already have the same image in m_data, so we
+  // can avoid decoding it again).
+  if (use_native_clipboard() &&
+      !(m_data->image && isNativeContentFromThisProcess())) {
     Image* native_image = nullptr;
     Mask* native_mask = nullptr;
     Palette* native_palette = nullptr;
@@ -798,7 +816,9 @@ ImageRef Clipboard::getImage(Palette* palette)
 
 bool Clipboard::getImageSize(gfx::Size& size)
 {
-  if (use_native_clipboard() && getNativeBitmapSize(&size))
+  if (use_native_clipboard() &&
+      !(m_data->image && isNativeContentFromThisProcess()) &&
+      getNativeBitmapSize(&size))
     return true;
 
   if (m_data->image) {
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -13,6 +13,7 @@
 #include "doc/image_ref.h"
 #include "gfx/point.h"
 #include "gfx/size.h"
+#include "obs/connection.h"
 #include "ui/base.h"
 #include "ui/clipboard_delegate.h"
 
@@ -103,6 +104,7 @@ namespace app {
     void clearNativeContent();
     void registerNativeFormats();
     bool hasNativeBitmap() const;
+    bool isNativeContentFromThisProcess() const;
     bool setNativeBitmap(const doc::Image* image,
                          const doc::Mask* mask,
                          const doc::Palette* palette,
@@ -115,6 +117,7 @@ namespace app {
 
     struct Data;
     std::unique_ptr<Data> m_data;
+    obs::scoped_connection m_memoryReportConn;
   };
 
 } // namespace app
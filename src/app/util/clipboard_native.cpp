@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2022  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2016-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -12,6 +12,7 @@
 #include "app/util/clipboard.h"
 
 #include "app/i18n/strings.h"
+#include "base/process.h"
 #include "base/serialization.h"
 #include "clip/clip.h"
 #include "doc/color_scales.h"
@@ -38,6 +39,24 @@ namespace {
   clip::format custom_image_format = 0;
   bool show_clip_errors = true;
 
+  // Identifies the native clipboard content that was set by this
+  // process (the process ID and a counter incremented each time we
+  // set the native clipboard). If the clipboard still contains the
+  // same owner data, we can use the image that we have in memory
+  // instead of decoding the native clipboard content.
+  clip::format owner_format = 0;
+  uint32_t owner_counter = 0;
+
+  struct OwnerData {
+    uint32_t pid;
+    uint32_t counter;
+  };
+
+  OwnerData current_owner_data() {
+    return OwnerData{ uint32_t(base::get_current_process_id()),
+                      owner_counter };
+  }
+
   class InhibitClipErrors {
     bool m_saved;
   public:
@@ -80,6 +99,7 @@ void Clipboard::registerNativeFormats()
 {
   clip::set_error_handler(custom_error_handler);
   custom_image_format = clip::register_format("org.aseprite.Image");
+  owner_format = clip::register_format("org.aseprite.ClipboardOwner");
 }
 
 bool Clipboard::hasNativeBitmap() const
@@ -87,6 +107,27 @@ bool Clipboard::hasNativeBitmap() const
   return clip::has(clip::image_format());
 }
 
+bool Clipboard::isNativeContentFromThisProcess() const
+{
+  if (!owner_format || !owner_counter)
+    return false;
+
+  InhibitClipErrors inhibitErrors;
+  clip::lock l(native_window_handle());
+  if (!l.locked() ||
+      !l.is_convertible(owner_format) ||
+      l.get_data_length(owner_format) != sizeof(OwnerData))
+    return false;
+
+  OwnerData data;
+  if (!l.get_data(owner_format, (char*)&data, sizeof(OwnerData)))
+    return false;
+
+  const OwnerData current = current_owner_data();
+  return (data.pid == current.pid &&
+          data.counter == current.counter);
+}
+
 bool Clipboard::setNativeBitmap(const doc::Image* image,
                                 const doc::Mask* mask,
                                 const doc::Palette* palette,
@@ -115,17 +156,18 @@ bool Clipboard::setNativeBitmap(const doc::Image* image,
     if (tileset) doc::write_tileset(os, tileset);
 
     if (os.good()) {
-      size_t size = (size_t)os.tellp();
-      if (size > 0) {
-        std::vector<char> data(size);
-        os.seekp(0);
-        os.read(&data[0], size);
-
-        l.set_data(custom_image_format, &data[0], size);
-      }
+      const std::string data = os.str();
+      if (!data.empty())
+        l.set_data(custom_image_format, data.data(), data.size());
     }
   }
 
+  if (owner_format) {
+    ++owner_counter;
+    const OwnerData data = current_owner_data();
+    l.set_data(owner_format, (const char*)&data, sizeof(OwnerData));
+  }
+
   clip::image_spec spec;
   spec.width = image->width();
   spec.height = image->height();
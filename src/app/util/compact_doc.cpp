@@ -0,0 +1,140 @@
+// Aseprite
+// Copyright (C) 2019-2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/compact_doc.h"
+
+#include "app/doc.h"
+#include "base/buffer.h"
+#include "doc/cel.h"
+#include "doc/cel_data.h"
+#include "doc/image.h"
+#include "doc/image_loader.h"
+#include "doc/sprite.h"
+#include "sched/task_group.h"
+
+#include "zlib.h"
+
+namespace app {
+
+namespace {
+
+// Creates again a cel image compacted by compact_cel_data() from its
+// compressed pixels, with the same ID and version of the original
+// image (so the undo history can still reference it).
+class CompressedImageLoader : public doc::ImageLoader {
+public:
+  CompressedImageLoader(const doc::ImageSpec& spec,
+                        const doc::ObjectId id,
+                        const doc::ObjectVersion version,
+                        base::buffer&& data)
+    : m_spec(spec)
+    , m_id(id)
+    , m_version(version)
+    , m_data(std::move(data)) {
+  }
+
+  doc::ImageRef loadImage() override {
+    doc::ImageRef image(doc::Image::create(m_spec));
+    const int rowBytes = image->getRowStrideSize();
+
+    z_stream zstream = {};
+    bool ok = (inflateInit(&zstream) == Z_OK);
+    if (ok) {
+      zstream.next_in = (Bytef*)m_data.data();
+      zstream.avail_in = uInt(m_data.size());
+      for (int y=0; ok && y<image->height(); ++y) {
+        zstream.next_out = (Bytef*)image->getPixelAddress(0, y);
+        zstream.avail_out = uInt(rowBytes);
+        const int err = inflate(&zstream, Z_SYNC_FLUSH);
+        ok = ((err == Z_OK || err == Z_STREAM_END) &&
+              zstream.avail_out == 0);
+      }
+      inflateEnd(&zstream);
+    }
+    // This should never happen (the data is compressed by us)
+    ASSERT(ok);
+    if (!ok)
+      image->clear(image->maskColor());
+
+    image->setId(m_id);
+    image->setVersion(m_version);
+    m_data.clear();
+    return image;
+  }
+
+private:
+  doc::ImageSpec m_spec;
+  doc::ObjectId m_id;
+  doc::ObjectVersion m_version;
+  base::buffer m_data;
+};
+
+} // anonymous namespace
+
+bool compact_cel_data(doc::CelData* celData)
+{
+  if (!celData->isImageLoaded())
+    return false;
+
+  doc::ImageRef image = celData->imageRef();
+  // Two references: the CelData and this function
+  if (image->isTilemap() || image.use_count() > 2)
+    return false;
+
+  const int rowBytes = image->getRowStrideSize();
+  const size_t rawSize = size_t(rowBytes) * image->height();
+  base::buffer data(compressBound(uLong(rawSize)));
+
+  z_stream zstream = {};
+  if (deflateInit(&zstream, Z_BEST_SPEED) != Z_OK)
+    return false;
+
+  zstream.next_out = (Bytef*)data.data();
+  zstream.avail_out = uInt(data.size());
+  bool ok = true;
+  for (int y=0; ok && y<image->height(); ++y) {
+    zstream.next_in = (Bytef*)image->getPixelAddress(0, y);
+    zstream.avail_in = uInt(rowBytes);
+    const bool last = (y == image->height()-1);
+    const int err = deflate(&zstream, last ? Z_FINISH: Z_NO_FLUSH);
+    ok = (last ? err == Z_STREAM_END: err == Z_OK);
+  }
+  const size_t compressedSize = zstream.total_out;
+  deflateEnd(&zstream);
+
+  // Keep the image as it is if the pixels cannot be compressed
+  if (!ok || compressedSize >= rawSize)
+    return false;
+
+  data.resize(compressedSize);
+  data.shrink_to_fit();
+
+  celData->unloadImage(
+    std::make_shared<CompressedImageLoader>(
+      image->spec(), image->id(), image->version(), std::move(data)));
+
+  // Release the image before the loader can create it again with
+  // the same ID
+  image.reset();
+  return true;
+}
+
+void uncompact_doc(Doc* doc)
+{
+  sched::TaskGroup tasks(sched::Priority::UI);
+  for (doc::Cel* cel : doc->sprite()->uniqueCels()) {
+    doc::CelData* celData = cel->data();
+    if (!celData->isImageLoaded())
+      tasks.run([celData]{ celData->image(); });
+  }
+  tasks.wait();
+}
+
+} // namespace app
@@ -0,0 +1,31 @@
+// Aseprite
+// Copyright (C) 2019-2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_COMPACT_DOC_H_INCLUDED
+#define APP_UTIL_COMPACT_DOC_H_INCLUDED
+#pragma once
+
+namespace doc {
+  class CelData;
+}
+
+namespace app {
+  class Doc;
+
+  // Compresses the cel image in memory, it's uncompressed again (with
+  // the same ID and version) when it's accessed. Returns false if the
+  // image is not compacted (e.g. it's referenced from other places,
+  // so its memory wouldn't be released).
+  bool compact_cel_data(doc::CelData* celData);
+
+  // Uncompresses all the cel images of the document compacted with
+  // compact_cel_data() (the undo history can reference them by ID,
+  // so they must exist before we can undo/redo).
+  void uncompact_doc(Doc* doc);
+
+} // namespace app
+
+#endif
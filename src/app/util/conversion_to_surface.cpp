@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This program is distributed under the terms of
@@ -21,8 +21,19 @@
 #include "os/surface_format.h"
 
 #include <algorithm>
+#include <array>
 #include <stdexcept>
 
+// SSE2 and NEON are always available on x64 and ARM64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define APP_CONVERSION_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define APP_CONVERSION_NEON 1
+  #include <arm_neon.h>
+#endif
+
 namespace app {
 
 using namespace doc;
@@ -107,6 +118,146 @@ struct Address24bpp
   }
 };
 
+// Row converters for 32bpp surfaces, they convert 4 pixels at the
+// same time moving each channel to its position in the surface
+// format (which can be any order of RGBA components).
+
+static_assert(rgba_r_shift == 0 && rgba_g_shift == 8 &&
+              rgba_b_shift == 16 && rgba_a_shift == 24 &&
+              graya_v_shift == 0 && graya_a_shift == 8,
+              "Row converters expect the doc::rgba/graya layout");
+
+void convert_rgb_row_to_surface32(const uint32_t* src, uint32_t* dst, const int w,
+                                  const os::SurfaceFormatData* fd)
+{
+  int x = 0;
+#if APP_CONVERSION_SSE2
+  const __m128i mask = _mm_set1_epi32(0xff);
+  const __m128i rMask = _mm_set1_epi32(fd->redMask);
+  const __m128i gMask = _mm_set1_epi32(fd->greenMask);
+  const __m128i bMask = _mm_set1_epi32(fd->blueMask);
+  const __m128i aMask = _mm_set1_epi32(fd->alphaMask);
+  const __m128i rShift = _mm_cvtsi32_si128(fd->redShift);
+  const __m128i gShift = _mm_cvtsi32_si128(fd->greenShift);
+  const __m128i bShift = _mm_cvtsi32_si128(fd->blueShift);
+  const __m128i aShift = _mm_cvtsi32_si128(fd->alphaShift);
+  for (; x+4<=w; x+=4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(src+x));
+    const __m128i r = _mm_and_si128(c, mask);
+    const __m128i g = _mm_and_si128(_mm_srli_epi32(c, 8), mask);
+    const __m128i b = _mm_and_si128(_mm_srli_epi32(c, 16), mask);
+    const __m128i a = _mm_srli_epi32(c, 24);
+    _mm_storeu_si128(
+      (__m128i*)(dst+x),
+      _mm_or_si128(
+        _mm_or_si128(_mm_and_si128(_mm_sll_epi32(r, rShift), rMask),
+                     _mm_and_si128(_mm_sll_epi32(g, gShift), gMask)),
+        _mm_or_si128(_mm_and_si128(_mm_sll_epi32(b, bShift), bMask),
+                     _mm_and_si128(_mm_sll_epi32(a, aShift), aMask))));
+  }
+#elif APP_CONVERSION_NEON
+  const uint32x4_t mask = vdupq_n_u32(0xff);
+  const uint32x4_t rMask = vdupq_n_u32(fd->redMask);
+  const uint32x4_t gMask = vdupq_n_u32(fd->greenMask);
+  const uint32x4_t bMask = vdupq_n_u32(fd->blueMask);
+  const uint32x4_t aMask = vdupq_n_u32(fd->alphaMask);
+  const int32x4_t rShift = vdupq_n_s32(fd->redShift);
+  const int32x4_t gShift = vdupq_n_s32(fd->greenShift);
+  const int32x4_t bShift = vdupq_n_s32(fd->blueShift);
+  const int32x4_t aShift = vdupq_n_s32(fd->alphaShift);
+  for (; x+4<=w; x+=4) {
+    const uint32x4_t c = vld1q_u32(src+x);
+    const uint32x4_t r = vandq_u32(c, mask);
+    const uint32x4_t g = vandq_u32(vshrq_n_u32(c, 8), mask);
+    const uint32x4_t b = vandq_u32(vshrq_n_u32(c, 16), mask);
+    const uint32x4_t a = vshrq_n_u32(c, 24);
+    vst1q_u32(
+      dst+x,
+      vorrq_u32(
+        vorrq_u32(vandq_u32(vshlq_u32(r, rShift), rMask),
+                  vandq_u32(vshlq_u32(g, gShift), gMask)),
+        vorrq_u32(vandq_u32(vshlq_u32(b, bShift), bMask),
+                  vandq_u32(vshlq_u32(a, aShift), aMask))));
+  }
+#endif
+  for (; x<w; ++x)
+    dst[x] = convert_color_to_surface<RgbTraits, os::kRgbaSurfaceFormat>(src[x], nullptr, fd);
+}
+
+void convert_gray_row_to_surface32(const uint16_t* src, uint32_t* dst, const int w,
+                                   const os::SurfaceFormatData* fd)
+{
+  int x = 0;
+#if APP_CONVERSION_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask = _mm_set1_epi32(0xff);
+  const __m128i rgbMask = _mm_set1_epi32(fd->redMask | fd->greenMask | fd->blueMask);
+  const __m128i aMask = _mm_set1_epi32(fd->alphaMask);
+  const __m128i rShift = _mm_cvtsi32_si128(fd->redShift);
+  const __m128i gShift = _mm_cvtsi32_si128(fd->greenShift);
+  const __m128i bShift = _mm_cvtsi32_si128(fd->blueShift);
+  const __m128i aShift = _mm_cvtsi32_si128(fd->alphaShift);
+  auto convert4 = [&](const __m128i c) {
+    const __m128i v = _mm_and_si128(c, mask);
+    const __m128i a = _mm_srli_epi32(c, 8);
+    return _mm_or_si128(
+      _mm_and_si128(
+        _mm_or_si128(_mm_sll_epi32(v, rShift),
+                     _mm_or_si128(_mm_sll_epi32(v, gShift),
+                                  _mm_sll_epi32(v, bShift))),
+        rgbMask),
+      _mm_and_si128(_mm_sll_epi32(a, aShift), aMask));
+  };
+  for (; x+8<=w; x+=8) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)(src+x));
+    _mm_storeu_si128((__m128i*)(dst+x), convert4(_mm_unpacklo_epi16(c, zero)));
+    _mm_storeu_si128((__m128i*)(dst+x+4), convert4(_mm_unpackhi_epi16(c, zero)));
+  }
+#elif APP_CONVERSION_NEON
+  const uint32x4_t mask = vdupq_n_u32(0xff);
+  const uint32x4_t rgbMask = vdupq_n_u32(fd->redMask | fd->greenMask | fd->blueMask);
+  const uint32x4_t aMask = vdupq_n_u32(fd->alphaMask);
+  const int32x4_t rShift = vdupq_n_s32(fd->redShift);
+  const int32x4_t gShift = vdupq_n_s32(fd->greenShift);
+  const int32x4_t bShift = vdupq_n_s32(fd->blueShift);
+  const int32x4_t aShift = vdupq_n_s32(fd->alphaShift);
+  auto convert4 = [&](const uint32x4_t c) {
+    const uint32x4_t v = vandq_u32(c, mask);
+    const uint32x4_t a = vshrq_n_u32(c, 8);
+    return vorrq_u32(
+      vandq_u32(
+        vorrq_u32(vshlq_u32(v, rShift),
+                  vorrq_u32(vshlq_u32(v, gShift),
+                            vshlq_u32(v, bShift))),
+        rgbMask),
+      vandq_u32(vshlq_u32(a, aShift), aMask));
+  };
+  for (; x+8<=w; x+=8) {
+    const uint16x8_t c = vld1q_u16(src+x);
+    vst1q_u32(dst+x, convert4(vmovl_u16(vget_low_u16(c))));
+    vst1q_u32(dst+x+4, convert4(vmovl_u16(vget_high_u16(c))));
+  }
+#endif
+  for (; x<w; ++x)
+    dst[x] = convert_color_to_surface<GrayscaleTraits, os::kRgbaSurfaceFormat>(src[x], nullptr, fd);
+}
+
+// Indexed images use a table with the 256 possible colors already
+// converted to the surface format.
+void convert_indexed_row_to_surface32(const uint8_t* src, uint32_t* dst, const int w,
+                                      const std::array<uint32_t, 256>& table)
+{
+  int x = 0;
+  for (; x+4<=w; x+=4) {
+    dst[x  ] = table[src[x  ]];
+    dst[x+1] = table[src[x+1]];
+    dst[x+2] = table[src[x+2]];
+    dst[x+3] = table[src[x+3]];
+  }
+  for (; x<w; ++x)
+    dst[x] = table[src[x]];
+}
+
 template<typename ImageTraits>
 void convert_image_to_surface_selector(const Image* image, os::Surface* surface,
   int src_x, int src_y, int dst_x, int dst_y, int w, int h, const Palette* palette, const os::SurfaceFormatData* fd)
@@ -186,14 +337,42 @@ void convert_image_to_surface(
         }
         return;
       }
+      if (fd.bitsPerPixel == 32) {
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          convert_rgb_row_to_surface32(
+            (const uint32_t*)image->getPixelAddress(src_x, src_y),
+            (uint32_t*)surface->getData(dst_x, dst_y), w, &fd);
+        }
+        return;
+      }
       convert_image_to_surface_selector<RgbTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
 
     case IMAGE_GRAYSCALE:
+      if (fd.bitsPerPixel == 32) {
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          convert_gray_row_to_surface32(
+            (const uint16_t*)image->getPixelAddress(src_x, src_y),
+            (uint32_t*)surface->getData(dst_x, dst_y), w, &fd);
+        }
+        return;
+      }
       convert_image_to_surface_selector<GrayscaleTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
 
     case IMAGE_INDEXED:
+      if (fd.bitsPerPixel == 32) {
+        std::array<uint32_t, 256> table;
+        for (int i=0; i<256; ++i)
+          table[i] = convert_color_to_surface<IndexedTraits, os::kRgbaSurfaceFormat>(i, palette, &fd);
+
+        for (int v=0; v<h; ++v, ++src_y, ++dst_y) {
+          convert_indexed_row_to_surface32(
+            image->getPixelAddress(src_x, src_y),
+            (uint32_t*)surface->getData(dst_x, dst_y), w, table);
+        }
+        return;
+      }
       convert_image_to_surface_selector<IndexedTraits>(image, surface, src_x, src_y, dst_x, dst_y, w, h, palette, &fd);
       break;
 
@@ -207,4 +386,42 @@ void convert_image_to_surface(
   }
 }
 
+void convert_color_row_to_surface(
+  const gfx::Color* colors,
+  os::Surface* surface,
+  int dst_x, int dst_y,
+  int w)
+{
+  const gfx::Rect dstBounds =
+    gfx::Rect(dst_x, dst_y, w, 1).createIntersection(surface->getClipBounds());
+  if (dstBounds.isEmpty())
+    return;
+
+  colors += dstBounds.x - dst_x;
+  dst_x = dstBounds.x;
+  w = dstBounds.w;
+
+  os::SurfaceLock lockDst(surface);
+  os::SurfaceFormatData fd;
+  surface->getFormat(&fd);
+
+  // gfx::Color uses the same layout as doc::rgba()
+  if (fd.bitsPerPixel == 32) {
+    uint32_t* dst = (uint32_t*)surface->getData(dst_x, dst_y);
+    if (gfx::ColorRShift == fd.redShift &&
+        gfx::ColorGShift == fd.greenShift &&
+        gfx::ColorBShift == fd.blueShift &&
+        gfx::ColorAShift == fd.alphaShift) {
+      std::copy(colors, colors+w, dst);
+    }
+    else {
+      convert_rgb_row_to_surface32(colors, dst, w, &fd);
+    }
+  }
+  else {
+    for (int x=0; x<w; ++x)
+      surface->putPixel(colors[x], dst_x+x, dst_y);
+  }
+}
+
 } // namespace app
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This program is distributed under the terms of
@@ -9,6 +9,8 @@
 #define APP_UTIL_CONVERSION_TO_SURFACE_H_INCLUDED
 #pragma once
 
+#include "gfx/color.h"
+
 namespace doc {
   class Image;
   class Palette;
@@ -28,6 +30,16 @@ namespace app {
     int dst_x, int dst_y,
     int w, int h);
 
+  // Writes a row of w colors in the given position of the surface
+  // (converting them to the surface format). Used to paint gradients
+  // computed row by row without an os::Surface::putPixel() call for
+  // each pixel.
+  void convert_color_row_to_surface(
+    const gfx::Color* colors,
+    os::Surface* surface,
+    int dst_x, int dst_y,
+    int w);
+
 } // namespace app
 
 #endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This program is distributed under the terms of
@@ -21,21 +21,94 @@
 #include "ft/hb_shaper.h"
 #include "ft/lib.h"
 
+#include <list>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
+#include <tuple>
 
 namespace app {
 
+namespace {
+
+// The same text is usually rendered several times (e.g. each time
+// the text is pasted or the font is previewed), so we keep the last
+// used font faces open and the last rendered texts.
+class TextCache {
+public:
+  using Key = std::tuple<std::string, int, std::string, doc::color_t, bool>;
+
+  static TextCache& instance() {
+    static TextCache cache;
+    return cache;
+  }
+
+  std::mutex& mutex() { return m_mutex; }
+
+  // Returns the face of the given font file (or nullptr if the file
+  // cannot be loaded).
+  ft::Face* face(const std::string& fontfile) {
+    for (auto it=m_faces.begin(); it!=m_faces.end(); ++it) {
+      if (it->first == fontfile) {
+        m_faces.splice(m_faces.begin(), m_faces, it);
+        return m_faces.front().second.get();
+      }
+    }
+
+    auto face = std::make_unique<ft::Face>(m_lib.open(fontfile));
+    if (!face->isValid())
+      return nullptr;
+
+    m_faces.emplace_front(fontfile, std::move(face));
+    if (m_faces.size() > kMaxFaces)
+      m_faces.pop_back();
+    return m_faces.front().second.get();
+  }
+
+  const doc::Image* text(const Key& key) {
+    for (auto it=m_texts.begin(); it!=m_texts.end(); ++it) {
+      if (it->first == key) {
+        m_texts.splice(m_texts.begin(), m_texts, it);
+        return m_texts.front().second.get();
+      }
+    }
+    return nullptr;
+  }
+
+  void addText(const Key& key, const doc::Image* image) {
+    m_texts.emplace_front(key, std::unique_ptr<doc::Image>(doc::Image::createCopy(image)));
+    if (m_texts.size() > kMaxTexts)
+      m_texts.pop_back();
+  }
+
+private:
+  static constexpr std::size_t kMaxFaces = 4;
+  static constexpr std::size_t kMaxTexts = 32;
+
+  std::mutex m_mutex;
+  ft::Lib m_lib;                // Must be destroyed after the faces
+  std::list<std::pair<std::string, std::unique_ptr<ft::Face>>> m_faces;
+  std::list<std::pair<Key, std::unique_ptr<doc::Image>>> m_texts;
+};
+
+} // anonymous namespace
+
 doc::Image* render_text(const std::string& fontfile, int fontsize,
                         const std::string& text,
                         doc::color_t color,
                         bool antialias)
 {
   std::unique_ptr<doc::Image> image(nullptr);
-  ft::Lib ft;
+  TextCache& cache = TextCache::instance();
+  const std::lock_guard lock(cache.mutex());
+
+  const TextCache::Key key(fontfile, fontsize, text, color, antialias);
+  if (const doc::Image* cached = cache.text(key))
+    return doc::Image::createCopy(cached);
 
-  ft::Face face(ft.open(fontfile));
-  if (face.isValid()) {
+  ft::Face* facePtr = cache.face(fontfile);
+  if (facePtr) {
+    ft::Face& face = *facePtr;
     // Set font size
     face.setSize(fontsize);
     face.setAntialias(antialias);
@@ -101,6 +174,8 @@ doc::Image* render_text(const std::string& fontfile, int fontsize,
     throw std::runtime_error("Error loading font face");
   }
 
+  if (image)
+    cache.addText(key, image.get());
   return (image ? image.release(): nullptr);
 }
 
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -23,83 +23,175 @@
 #include "doc/image_impl.h"
 #include "doc/layer.h"
 #include "doc/mask.h"
+#include "sched/task_group.h"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 using namespace doc;
 
 namespace app {
 
-void select_layer_boundaries(Layer* layer,
-                             const frame_t frame,
-                             const SelectLayerBoundariesOp op)
-{
-  Mask newMask;
+namespace {
 
-  const Cel* cel = layer->cel(frame);
-  if (cel) {
-    const Image* image = cel->image();
-    if (image) {
-      newMask.replace(cel->bounds());
-      newMask.freeze();
-      {
-        LockImageBits<BitmapTraits> maskBits(newMask.bitmap());
-        auto maskIt = maskBits.begin();
-        auto maskEnd = maskBits.end();
-
-        switch (image->pixelFormat()) {
-
-          case IMAGE_RGB: {
-            LockImageBits<RgbTraits> rgbBits(image);
-            auto rgbIt = rgbBits.begin();
+// Masks of the last cel images used in get_layer_boundaries()
+struct CachedMask {
+  ObjectId imageId;
+  ObjectVersion version;
+  gfx::Rect bounds;
+  color_t maskColor;
+  std::shared_ptr<const Mask> mask;
+};
+
+const std::size_t kMaxCachedMasks = 16;
+std::mutex g_cacheMutex;
+std::deque<CachedMask> g_cache;    // The most recent used is the first one
+
+void create_cel_mask(const Cel* cel, const Image* image, Mask& mask)
+{
+  mask.replace(cel->bounds());
+  mask.freeze();
+  {
+    LockImageBits<BitmapTraits> maskBits(mask.bitmap());
+    auto maskIt = maskBits.begin();
+    auto maskEnd = maskBits.end();
+
+    switch (image->pixelFormat()) {
+
+      case IMAGE_RGB: {
+        LockImageBits<RgbTraits> rgbBits(image);
+        auto rgbIt = rgbBits.begin();
 #if _DEBUG
-            auto rgbEnd = rgbBits.end();
+        auto rgbEnd = rgbBits.end();
 #endif
-            for (; maskIt != maskEnd; ++maskIt, ++rgbIt) {
-              ASSERT(rgbIt != rgbEnd);
-              color_t c = *rgbIt;
-              *maskIt = (rgba_geta(c) >= 128); // TODO configurable threshold
-            }
-            break;
-          }
-
-          case IMAGE_GRAYSCALE: {
-            LockImageBits<GrayscaleTraits> grayBits(image);
-            auto grayIt = grayBits.begin();
+        for (; maskIt != maskEnd; ++maskIt, ++rgbIt) {
+          ASSERT(rgbIt != rgbEnd);
+          color_t c = *rgbIt;
+          *maskIt = (rgba_geta(c) >= 128); // TODO configurable threshold
+        }
+        break;
+      }
+
+      case IMAGE_GRAYSCALE: {
+        LockImageBits<GrayscaleTraits> grayBits(image);
+        auto grayIt = grayBits.begin();
 #if _DEBUG
-            auto grayEnd = grayBits.end();
+        auto grayEnd = grayBits.end();
 #endif
-            for (; maskIt != maskEnd; ++maskIt, ++grayIt) {
-              ASSERT(grayIt != grayEnd);
-              color_t c = *grayIt;
-              *maskIt = (graya_geta(c) >= 128); // TODO configurable threshold
-            }
-            break;
-          }
-
-          case IMAGE_INDEXED: {
-            const doc::color_t maskColor = image->maskColor();
-            LockImageBits<IndexedTraits> idxBits(image);
-            auto idxIt = idxBits.begin();
+        for (; maskIt != maskEnd; ++maskIt, ++grayIt) {
+          ASSERT(grayIt != grayEnd);
+          color_t c = *grayIt;
+          *maskIt = (graya_geta(c) >= 128); // TODO configurable threshold
+        }
+        break;
+      }
+
+      case IMAGE_INDEXED: {
+        const doc::color_t maskColor = image->maskColor();
+        LockImageBits<IndexedTraits> idxBits(image);
+        auto idxIt = idxBits.begin();
 #if _DEBUG
-            auto idxEnd = idxBits.end();
+        auto idxEnd = idxBits.end();
 #endif
-            for (; maskIt != maskEnd; ++maskIt, ++idxIt) {
-              ASSERT(idxIt != idxEnd);
-              color_t c = *idxIt;
-              *maskIt = (c != maskColor);
-            }
-            break;
-          }
+        for (; maskIt != maskEnd; ++maskIt, ++idxIt) {
+          ASSERT(idxIt != idxEnd);
+          color_t c = *idxIt;
+          *maskIt = (c != maskColor);
+        }
+        break;
+      }
+
+    }
+  }
+  mask.unfreeze();
+}
 
+} // anonymous namespace
+
+void get_layer_boundaries(const Layer* layer,
+                          const frame_t frame,
+                          Mask& mask)
+{
+  mask.clear();
+
+  const Cel* cel = layer->cel(frame);
+  if (!cel)
+    return;
+
+  const Image* image = cel->image();
+  if (!image)
+    return;
+
+  const gfx::Rect bounds = cel->bounds();
+  {
+    std::lock_guard lock(g_cacheMutex);
+    for (auto it=g_cache.begin(); it!=g_cache.end(); ++it) {
+      if (it->imageId == image->id() &&
+          it->version == image->version() &&
+          it->bounds == bounds &&
+          it->maskColor == image->maskColor()) {
+        mask.copyFrom(it->mask.get());
+        if (it != g_cache.begin()) {
+          CachedMask entry = *it;
+          g_cache.erase(it);
+          g_cache.push_front(entry);
         }
+        return;
+      }
+    }
+  }
+
+  create_cel_mask(cel, image, mask);
+
+  std::lock_guard lock(g_cacheMutex);
+  g_cache.push_front(CachedMask{ image->id(), image->version(),
+                                 bounds, image->maskColor(),
+                                 std::make_shared<Mask>(mask) });
+  if (g_cache.size() > kMaxCachedMasks)
+    g_cache.pop_back();
+}
+
+void select_layer_boundaries(Layer* layer,
+                             const frame_t frame,
+                             const SelectLayerBoundariesOp op)
+{
+  select_layers_boundaries(LayerList{ layer }, frame, op);
+}
+
+void select_layers_boundaries(const LayerList& layers,
+                              const frame_t frame,
+                              const SelectLayerBoundariesOp op)
+{
+  if (layers.empty())
+    return;
+
+  Mask newMask;
+  if (layers.size() == 1) {
+    get_layer_boundaries(layers.front(), frame, newMask);
+  }
+  else {
+    std::vector<Mask> masks(layers.size());
+    {
+      sched::TaskGroup tasks(sched::Priority::Interactive);
+      for (std::size_t i=0; i<layers.size(); ++i) {
+        tasks.run([&layers, &masks, frame, i]{
+          get_layer_boundaries(layers[i], frame, masks[i]);
+        });
       }
-      newMask.unfreeze();
+      tasks.wait();
+    }
+    for (const Mask& mask : masks) {
+      if (!mask.isEmpty())
+        newMask.add(mask);
     }
   }
 
   try {
     ContextWriter writer(UIContext::instance());
     Doc* doc = writer.document();
-    ASSERT(doc == layer->sprite()->document());
+    ASSERT(doc == layers.front()->sprite()->document());
 
     if (doc->isMaskVisible()) {
       switch (op) {
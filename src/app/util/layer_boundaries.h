@@ -1,4 +1,5 @@
 // Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
 // Copyright (C) 2018  David Capello
 //
 // This program is distributed under the terms of
@@ -9,9 +10,11 @@
 #pragma once
 
 #include "doc/frame.h"
+#include "doc/layer_list.h"
 
 namespace doc {
   class Layer;
+  class Mask;
 }
 
 namespace app {
@@ -20,10 +23,27 @@ namespace app {
     REPLACE, ADD, SUBTRACT, INTERSECT
   };
 
+  // Returns in "mask" the opaque pixels of the cel in the given
+  // layer/frame (pixels with alpha >= 128, or different from the
+  // mask color in indexed images). The masks are cached by image
+  // version, so calling this function again for a cel that wasn't
+  // modified is cheap.
+  void get_layer_boundaries(const doc::Layer* layer,
+                            const doc::frame_t frame,
+                            doc::Mask& mask);
+
   void select_layer_boundaries(doc::Layer* layer,
                                const doc::frame_t frame,
                                const SelectLayerBoundariesOp op);
 
+  // Selects the union of the boundaries of all the given layers
+  // (combined with the current selection using the given "op") in
+  // just one transaction. The mask of each layer is calculated in
+  // parallel.
+  void select_layers_boundaries(const doc::LayerList& layers,
+                                const doc::frame_t frame,
+                                const SelectLayerBoundariesOp op);
+
 } // namespace app
 
 #endif
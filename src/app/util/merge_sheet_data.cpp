@@ -0,0 +1,172 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/merge_sheet_data.h"
+
+#include "base/exception.h"
+#include "base/fs.h"
+#include "base/fstream_path.h"
+
+#include "json11.hpp"
+
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <vector>
+
+namespace app {
+
+using json11::Json;
+
+namespace {
+
+Json read_sheet_data(const std::string& filename)
+{
+  std::ifstream in(FSTREAM_PATH(filename), std::ifstream::binary);
+  if (!in)
+    throw base::Exception("Cannot open file \"%s\"\n", filename.c_str());
+
+  std::ostringstream buf;
+  buf << in.rdbuf();
+
+  std::string err;
+  Json json = Json::parse(buf.str(), err);
+  if (!err.empty())
+    throw base::Exception("Error parsing JSON file \"%s\": %s\n",
+                          filename.c_str(), err.c_str());
+  if (!json["frames"].is_object() && !json["frames"].is_array())
+    throw base::Exception("File \"%s\" is not a sprite sheet data file\n",
+                          filename.c_str());
+  return json;
+}
+
+// Adds the items of the given "meta" field (an array) that aren't
+// already in the "result" list (by name).
+void merge_named_items(const Json& meta,
+                       const char* field,
+                       std::set<std::string>& names,
+                       Json::array& result)
+{
+  for (const Json& item : meta[field].array_items()) {
+    const std::string& name = item["name"].string_value();
+    if (names.insert(name).second)
+      result.push_back(item);
+  }
+}
+
+} // anonymous namespace
+
+void merge_sheet_data(const base::paths& inputs,
+                      const std::string& output)
+{
+  std::vector<Json> sheets;
+  std::set<std::string> images;
+  for (const std::string& filename : inputs) {
+    sheets.push_back(read_sheet_data(filename));
+    images.insert(sheets.back()["meta"]["image"].string_value());
+  }
+  if (sheets.empty())
+    throw base::Exception("No sprite sheet data files to merge\n");
+
+  const bool arrayFormat = sheets.front()["frames"].is_array();
+  const bool addImage = (images.size() > 1);
+
+  Json::array framesArray;
+  Json::object framesHash;
+  Json::array tags, layers, slices;
+  std::set<std::string> layerNames, sliceNames;
+  bool hasTags = false, hasLayers = false, hasSlices = false;
+  int frameOffset = 0;
+
+  for (const Json& sheet : sheets) {
+    const Json& meta = sheet["meta"];
+    const Json image(meta["image"].string_value());
+
+    auto addFrame = [&](const std::string& key, const Json& frame) {
+      Json::object f = frame.object_items();
+      if (addImage)
+        f["image"] = image;
+      if (arrayFormat) {
+        if (!key.empty())
+          f["filename"] = Json(key);
+        framesArray.push_back(Json(f));
+      }
+      else {
+        if (key.empty())
+          framesHash[frame["filename"].string_value()] = Json(f);
+        else
+          framesHash[key] = Json(f);
+      }
+    };
+
+    int frames = 0;
+    if (sheet["frames"].is_array()) {
+      for (const Json& frame : sheet["frames"].array_items()) {
+        addFrame(std::string(), frame);
+        ++frames;
+      }
+    }
+    else {
+      for (const auto& it : sheet["frames"].object_items()) {
+        addFrame(it.first, it.second);
+        ++frames;
+      }
+    }
+
+    // Tags reference frames by index in the sheet
+    if (meta["frameTags"].is_array()) {
+      hasTags = true;
+      for (const Json& tag : meta["frameTags"].array_items()) {
+        Json::object t = tag.object_items();
+        t["from"] = Json(tag["from"].int_value() + frameOffset);
+        t["to"] = Json(tag["to"].int_value() + frameOffset);
+        tags.push_back(Json(t));
+      }
+    }
+    if (meta["layers"].is_array()) {
+      hasLayers = true;
+      merge_named_items(meta, "layers", layerNames, layers);
+    }
+    if (meta["slices"].is_array()) {
+      hasSlices = true;
+      merge_named_items(meta, "slices", sliceNames, slices);
+    }
+
+    frameOffset += frames;
+  }
+
+  Json::object meta = sheets.front()["meta"].object_items();
+  if (hasTags)
+    meta["frameTags"] = Json(tags);
+  if (hasLayers)
+    meta["layers"] = Json(layers);
+  if (hasSlices)
+    meta["slices"] = Json(slices);
+
+  Json::object result;
+  if (arrayFormat)
+    result["frames"] = Json(framesArray);
+  else
+    result["frames"] = Json(framesHash);
+  result["meta"] = Json(meta);
+
+  const std::string dir = base::get_file_path(output);
+  if (!dir.empty() && !base::is_directory(dir))
+    base::make_all_directories(dir);
+
+  std::string text;
+  Json(result).dump(text);
+  std::ofstream out(FSTREAM_PATH(output), std::ofstream::binary);
+  out.write(text.c_str(), text.size());
+  if (!out)
+    throw base::Exception("Error writing file \"%s\"\n", output.c_str());
+}
+
+} // namespace app
@@ -0,0 +1,31 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_MERGE_SHEET_DATA_H_INCLUDED
+#define APP_UTIL_MERGE_SHEET_DATA_H_INCLUDED
+#pragma once
+
+#include "base/paths.h"
+
+#include <string>
+
+namespace app {
+
+  // Merges the JSON data of several sprite sheets (e.g. exported by
+  // different --shard i/N processes) in one JSON file. Frames are
+  // concatenated in the given order, the "from"/"to" indexes of the
+  // tags are moved to the position of their frames in the merged
+  // list, and layers/slices are included one time (by name). If the
+  // sheets use different textures, each frame includes the "image"
+  // field with the name of its texture.
+  //
+  // Throws an exception if some file cannot be read or parsed.
+  void merge_sheet_data(const base::paths& inputs,
+                        const std::string& output);
+
+} // namespace app
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2020-2021  Igara Studio S.A.
+// Copyright (C) 2020-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -22,8 +22,21 @@ namespace app {
     void open(Context* ctx,
               const std::string& fn,
               const bool oneFrame) {
+      open(ctx, base::paths{ fn }, oneFrame);
+    }
+
+    // Opens several files at the same time (the questions to open
+    // sequences are asked before loading the files)
+    void open(Context* ctx,
+              const base::paths& fns,
+              const bool oneFrame) {
+      if (fns.empty())
+        return;
+
       Params params;
-      params.set("filename", fn.c_str());
+      params.set("filename", fns.front().c_str());
+      if (fns.size() > 1)
+        m_cmd.setFilenames(fns);
 
       if (oneFrame)
         params.set("oneframe", "true");
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -50,11 +50,35 @@ doc::Image* resize_image(
   return newImage.release();
 }
 
+doc::ImageRef create_resized_cel_image(
+  const doc::Cel* cel,
+  const gfx::SizeF& scale,
+  const doc::algorithm::ResizeMethod method,
+  const doc::Palette* pal,
+  const doc::RgbMap* rgbmap)
+{
+  doc::Image* image = cel->image();
+  const int w = std::max(1, int(scale.w*image->width()));
+  const int h = std::max(1, int(scale.h*image->height()));
+  doc::ImageRef newImage(
+    doc::Image::create(image->pixelFormat(), w, h));
+  newImage->setMaskColor(image->maskColor());
+
+  doc::algorithm::fixup_image_transparent_colors(image);
+  doc::algorithm::resize_image(
+    image, newImage.get(),
+    method, pal, rgbmap,
+    (cel->layer()->isBackground() ? -1: cel->sprite()->transparentColor()));
+
+  return newImage;
+}
+
 void resize_cel_image(
   Tx& tx, doc::Cel* cel,
   const gfx::SizeF& scale,
   const doc::algorithm::ResizeMethod method,
-  const gfx::PointF& pivot)
+  const gfx::PointF& pivot,
+  const doc::ImageRef& newImage)
 {
   // Get cel's image
   doc::Image* image = cel->image();
@@ -77,22 +101,15 @@ void resize_cel_image(
         tx(new cmd::SetCelPosition(cel, x, y));
 
       // Resize the image
-      const int w = std::max(1, int(scale.w*image->width()));
-      const int h = std::max(1, int(scale.h*image->height()));
-      doc::ImageRef newImage(
-        doc::Image::create(
-          image->pixelFormat(), std::max(1, w), std::max(1, h)));
-      newImage->setMaskColor(image->maskColor());
-
-      doc::algorithm::fixup_image_transparent_colors(image);
-      doc::algorithm::resize_image(
-        image, newImage.get(),
-        method,
-        sprite->palette(cel->frame()),
-        sprite->rgbMap(cel->frame()),
-        (cel->layer()->isBackground() ? -1: sprite->transparentColor()));
-
-      tx(new cmd::ReplaceImage(sprite, cel->imageRef(), newImage));
+      doc::ImageRef resized = newImage;
+      if (!resized) {
+        resized = create_resized_cel_image(
+          cel, scale, method,
+          sprite->palette(cel->frame()),
+          sprite->rgbMap(cel->frame()));
+      }
+
+      tx(new cmd::ReplaceImage(sprite, cel->imageRef(), resized));
     }
   }
 }
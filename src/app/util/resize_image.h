@@ -10,6 +10,7 @@
 
 #include "doc/algorithm/resize_image.h"
 #include "doc/color.h"
+#include "doc/image_ref.h"
 #include "gfx/point.h"
 #include "gfx/size.h"
 
@@ -30,11 +31,27 @@ namespace app {
     const doc::Palette* pal,
     const doc::RgbMap* rgbmap);
 
+  // Returns the resized image of the cel to be used in
+  // resize_cel_image(). It doesn't modify the document (only the
+  // transparent colors of the original image are fixed), so it can
+  // be called for different cels from several threads. The rgbmap
+  // can be nullptr if the image is not indexed or the method is not
+  // bilinear.
+  doc::ImageRef create_resized_cel_image(
+    const doc::Cel* cel,
+    const gfx::SizeF& scale,
+    const doc::algorithm::ResizeMethod method,
+    const doc::Palette* pal,
+    const doc::RgbMap* rgbmap);
+
+  // Resizes the cel image (using the given newImage if it was
+  // already created with create_resized_cel_image()).
   void resize_cel_image(
     Tx& tx, doc::Cel* cel,
     const gfx::SizeF& scale,
     const doc::algorithm::ResizeMethod method,
-    const gfx::PointF& pivot);
+    const gfx::PointF& pivot,
+    const doc::ImageRef& newImage = nullptr);
 
 } // namespace app
 
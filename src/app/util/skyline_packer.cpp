@@ -0,0 +1,274 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "app/util/skyline_packer.h"
+
+#include "base/task.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+namespace app {
+
+// Height used to pack rectangles without a height limit (it's
+// divided by 2 to avoid overflows adding the padding)
+static const int kUnlimitedHeight = std::numeric_limits<int>::max() / 2;
+
+SkylinePacker::SkylinePacker(const int borderPadding,
+                             const int shapePadding)
+  : m_borderPadding(std::max(0, borderPadding))
+  , m_shapePadding(std::max(0, shapePadding))
+{
+}
+
+void SkylinePacker::add(const gfx::Size& size)
+{
+  m_sizes.push_back(size);
+  m_rects.push_back(gfx::Rect(size));
+  m_sorted.clear();
+}
+
+gfx::Size SkylinePacker::bestFit(base::task_token& token,
+                                 const int fixedWidth,
+                                 const int fixedHeight)
+{
+  if (m_sizes.empty())
+    return gfx::Size(0, 0);
+
+  sortRects();
+
+  if (fixedWidth > 0) {
+    const gfx::Size used =
+      packInWidth(fixedWidth,
+                  (fixedHeight > 0 ? fixedHeight: kUnlimitedHeight),
+                  token);
+    return gfx::Size(fixedWidth,
+                     (fixedHeight > 0 ? fixedHeight: used.h));
+  }
+
+  // Area and widest rectangle (with padding) to calculate the
+  // widths that we are going to try
+  double area = 0.0;
+  int maxWidth = 0;
+  int sumWidth = 0;
+  for (const gfx::Size& size : m_sizes) {
+    const int w = size.w + m_shapePadding;
+    area += double(w) * (size.h + m_shapePadding);
+    maxWidth = std::max(maxWidth, w);
+    sumWidth += w;
+  }
+  const int minWidth = maxWidth + 2*m_borderPadding - m_shapePadding;
+  const int maxWidthToTry = sumWidth + 2*m_borderPadding - m_shapePadding;
+
+  // With a fixed height we look for the first width (from the
+  // narrowest possible one) where all rectangles fit
+  if (fixedHeight > 0) {
+    const int h = std::max(1, fixedHeight - 2*m_borderPadding);
+    int w = std::clamp(int(area / h), minWidth, maxWidthToTry);
+    for (;;) {
+      if (token.canceled())
+        return gfx::Size(0, 0);
+
+      const gfx::Size used = packInWidth(w, fixedHeight, token);
+      if (!used.isEmpty())
+        return gfx::Size(used.w, fixedHeight);
+
+      // Increase the width ~12% each time
+      if (w >= maxWidthToTry)
+        break;
+      w = std::min(maxWidthToTry, w + std::max(1, w/8));
+    }
+    // All rectangles in one row (some of them don't fit in the
+    // given height)
+    const gfx::Size used = packInWidth(maxWidthToTry, kUnlimitedHeight, token);
+    return gfx::Size(used.w, fixedHeight);
+  }
+
+  // Try widths around the side of a square with the total area and
+  // keep the one that uses the smallest area (or the most squared
+  // one if two widths use the same area).
+  const int squareWidth = int(std::ceil(std::sqrt(area))) + 2*m_borderPadding;
+  const int fromWidth = std::clamp(squareWidth*3/4, minWidth, maxWidthToTry);
+  const int toWidth = std::clamp(squareWidth*3/2, minWidth, maxWidthToTry);
+
+  int bestWidth = fromWidth;
+  gfx::Size bestUsed;
+  double bestArea = std::numeric_limits<double>::max();
+  const int steps = int(std::ceil(std::log(double(toWidth) / fromWidth) /
+                                  std::log(1.125))) + 1;
+  int step = 0;
+  for (int w=fromWidth; ; w=std::min(toWidth, w + std::max(1, w/8)), ++step) {
+    if (token.canceled())
+      return gfx::Size(0, 0);
+    token.set_progress(float(step) / steps);
+
+    const gfx::Size used = packInWidth(w, kUnlimitedHeight, token);
+    const double usedArea = double(used.w) * used.h;
+    if (usedArea < bestArea ||
+        (usedArea == bestArea &&
+         std::abs(used.w - used.h) < std::abs(bestUsed.w - bestUsed.h))) {
+      bestWidth = w;
+      bestUsed = used;
+      bestArea = usedArea;
+    }
+    if (w >= toWidth)
+      break;
+  }
+
+  // Pack the rectangles again with the best width
+  return packInWidth(bestWidth, kUnlimitedHeight, token);
+}
+
+bool SkylinePacker::pack(const gfx::Size& size,
+                         base::task_token& token)
+{
+  sortRects();
+  return !packInWidth(size.w, size.h, token).isEmpty();
+}
+
+gfx::Size SkylinePacker::packInWidth(const int width,
+                                     const int maxHeight,
+                                     base::task_token& token)
+{
+  // The shape padding is added to the right/bottom side of each
+  // rectangle, so the available area is extended with the shape
+  // padding (the last rectangle of a row/column doesn't need it).
+  const int right = width - m_borderPadding + m_shapePadding;
+  const int bottom = maxHeight - m_borderPadding + m_shapePadding;
+
+  m_skyline.clear();
+  if (right - m_borderPadding > 0)
+    m_skyline.push_back(Node{ m_borderPadding, m_borderPadding,
+                              right - m_borderPadding });
+
+  gfx::Size used(0, 0);
+  bool fit = !m_skyline.empty();
+  for (const int i : m_sorted) {
+    if (!fit || token.canceled()) {
+      m_rects[i] = gfx::Rect();
+      fit = false;
+      continue;
+    }
+
+    const gfx::Size size(m_sizes[i].w + m_shapePadding,
+                         m_sizes[i].h + m_shapePadding);
+    int node;
+    gfx::Point pos;
+    if (!findPosition(size, right, bottom, node, pos)) {
+      m_rects[i] = gfx::Rect();
+      fit = false;
+      continue;
+    }
+
+    m_rects[i] = gfx::Rect(pos, m_sizes[i]);
+    addLevel(node, gfx::Rect(pos, size));
+
+    used.w = std::max(used.w, m_rects[i].x2());
+    used.h = std::max(used.h, m_rects[i].y2());
+  }
+
+  if (!fit)
+    return gfx::Size(0, 0);
+
+  return gfx::Size(used.w + m_borderPadding,
+                   used.h + m_borderPadding);
+}
+
+bool SkylinePacker::findPosition(const gfx::Size& size,
+                                 const int right,
+                                 const int bottom,
+                                 int& bestNode,
+                                 gfx::Point& bestPos) const
+{
+  int bestY2 = std::numeric_limits<int>::max();
+  bool found = false;
+
+  const int n = int(m_skyline.size());
+  for (int i=0; i<n; ++i) {
+    const int x = m_skyline[i].x;
+    // Nodes are sorted by x, so the next ones are more to the right
+    if (x + size.w > right)
+      break;
+
+    // The rectangle is placed over the highest node that it covers
+    int y = 0;
+    int widthLeft = size.w;
+    for (int j=i; j<n && widthLeft > 0; ++j) {
+      y = std::max(y, m_skyline[j].y);
+      widthLeft -= m_skyline[j].w;
+    }
+
+    // Nodes are sorted from left to right, so we keep the first
+    // (leftmost) position with the lowest top side
+    const int y2 = y + size.h;
+    if (y2 <= bottom && y2 < bestY2) {
+      bestY2 = y2;
+      bestNode = i;
+      bestPos = gfx::Point(x, y);
+      found = true;
+    }
+  }
+  return found;
+}
+
+void SkylinePacker::addLevel(const int nodeIndex,
+                             const gfx::Rect& rc)
+{
+  m_skyline.insert(m_skyline.begin()+nodeIndex,
+                   Node{ rc.x, rc.y2(), rc.w });
+
+  // Remove the parts of the next nodes that are below the new one
+  for (int i=nodeIndex+1; i<int(m_skyline.size()); ) {
+    const Node& prev = m_skyline[i-1];
+    Node& node = m_skyline[i];
+    const int shrink = prev.x + prev.w - node.x;
+    if (shrink <= 0)
+      break;
+
+    node.x += shrink;
+    node.w -= shrink;
+    if (node.w > 0)
+      break;
+
+    m_skyline.erase(m_skyline.begin()+i);
+  }
+
+  // Merge nodes at the same level
+  for (int i=0; i+1<int(m_skyline.size()); ) {
+    if (m_skyline[i].y == m_skyline[i+1].y) {
+      m_skyline[i].w += m_skyline[i+1].w;
+      m_skyline.erase(m_skyline.begin()+i+1);
+    }
+    else
+      ++i;
+  }
+}
+
+void SkylinePacker::sortRects()
+{
+  if (m_sorted.size() == m_sizes.size())
+    return;
+
+  // Taller (and then wider) rectangles first
+  m_sorted.resize(m_sizes.size());
+  std::iota(m_sorted.begin(), m_sorted.end(), 0);
+  std::stable_sort(m_sorted.begin(), m_sorted.end(),
+                   [this](const int a, const int b){
+                     const gfx::Size& sa = m_sizes[a];
+                     const gfx::Size& sb = m_sizes[b];
+                     if (sa.h != sb.h)
+                       return (sa.h > sb.h);
+                     return (sa.w > sb.w);
+                   });
+}
+
+} // namespace app
@@ -0,0 +1,89 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef APP_UTIL_SKYLINE_PACKER_H_INCLUDED
+#define APP_UTIL_SKYLINE_PACKER_H_INCLUDED
+#pragma once
+
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <vector>
+
+namespace base {
+  class task_token;
+}
+
+namespace app {
+
+  // Packs rectangles in a texture using the skyline bottom-left
+  // heuristic: rectangles are sorted by height (O(n log n)) and each
+  // one is placed in the position of the skyline (the top edge of
+  // the already placed rectangles) where its top side is lowest.
+  // It's a lot faster than gfx::PackingRects for thousands of
+  // rectangles with a similar density.
+  class SkylinePacker {
+  public:
+    typedef std::vector<gfx::Rect> Rects;
+    typedef Rects::const_iterator const_iterator;
+
+    SkylinePacker(const int borderPadding = 0,
+                  const int shapePadding = 0);
+
+    // Iterates over the packed rectangles (in the same order they
+    // were added).
+    const_iterator begin() const { return m_rects.begin(); }
+    const_iterator end() const { return m_rects.end(); }
+    std::size_t size() const { return m_rects.size(); }
+    const gfx::Rect& operator[](const int i) const { return m_rects[i]; }
+
+    void add(const gfx::Size& size);
+
+    // Packs the rectangles in the smallest texture that we can find
+    // (trying different widths). If fixedWidth or fixedHeight are
+    // specified (non-zero), the texture will have that width or
+    // height. Returns the size of the area used by the packed
+    // rectangles (including the border padding).
+    gfx::Size bestFit(base::task_token& token,
+                      const int fixedWidth = 0,
+                      const int fixedHeight = 0);
+
+    // Packs the rectangles in a texture of the given size. Returns
+    // false if some rectangle doesn't fit (in that case its bounds
+    // are empty).
+    bool pack(const gfx::Size& size,
+              base::task_token& token);
+
+  private:
+    struct Node {
+      int x, y, w;
+    };
+
+    // Packs the rectangles in the given width (and maximum height),
+    // returns the used area, or an empty size if they don't fit.
+    gfx::Size packInWidth(const int width,
+                          const int maxHeight,
+                          base::task_token& token);
+    bool findPosition(const gfx::Size& size,
+                      const int right,
+                      const int bottom,
+                      int& bestNode,
+                      gfx::Point& bestPos) const;
+    void addLevel(const int nodeIndex,
+                  const gfx::Rect& rc);
+    void sortRects();
+
+    int m_borderPadding;
+    int m_shapePadding;
+    std::vector<gfx::Size> m_sizes;
+    Rects m_rects;
+    std::vector<int> m_sorted;  // Indexes of m_sizes sorted by height
+    std::vector<Node> m_skyline;
+  };
+
+} // namespace app
+
+#endif
@@ -0,0 +1,68 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#include "tests/app_test.h"
+
+#include "app/util/skyline_packer.h"
+#include "base/task.h"
+
+#include <vector>
+
+using namespace app;
+
+static bool no_overlaps(const SkylinePacker& pr, const int shapePadding)
+{
+  std::vector<gfx::Rect> rects(pr.begin(), pr.end());
+  for (std::size_t i=0; i<rects.size(); ++i)
+    for (std::size_t j=i+1; j<rects.size(); ++j) {
+      gfx::Rect a = rects[i];
+      a.w += shapePadding;
+      a.h += shapePadding;
+      if (a.intersects(rects[j]))
+        return false;
+    }
+  return true;
+}
+
+TEST(SkylinePacker, BestFit)
+{
+  base::task_token token;
+  SkylinePacker pr(1, 2);
+  for (int i=0; i<100; ++i)
+    pr.add(gfx::Size(4 + (i*7) % 13, 4 + (i*5) % 11));
+
+  const gfx::Size size = pr.bestFit(token);
+  EXPECT_TRUE(no_overlaps(pr, 2));
+  for (const gfx::Rect& rc : pr) {
+    EXPECT_FALSE(rc.isEmpty());
+    EXPECT_GE(rc.x, 1);
+    EXPECT_GE(rc.y, 1);
+    EXPECT_LE(rc.x2()+1, size.w);
+    EXPECT_LE(rc.y2()+1, size.h);
+  }
+}
+
+TEST(SkylinePacker, Pack)
+{
+  base::task_token token;
+  SkylinePacker pr;
+  for (int i=0; i<4; ++i)
+    pr.add(gfx::Size(8, 8));
+
+  EXPECT_TRUE(pr.pack(gfx::Size(16, 16), token));
+  EXPECT_TRUE(no_overlaps(pr, 0));
+  EXPECT_EQ(gfx::Rect(0, 0, 8, 8), pr[0]);
+  EXPECT_EQ(gfx::Rect(8, 0, 8, 8), pr[1]);
+  EXPECT_EQ(gfx::Rect(0, 8, 8, 8), pr[2]);
+  EXPECT_EQ(gfx::Rect(8, 8, 8, 8), pr[3]);
+
+  EXPECT_FALSE(pr.pack(gfx::Size(16, 8), token));
+  EXPECT_TRUE(pr[2].isEmpty());
+  EXPECT_TRUE(pr[3].isEmpty());
+
+  // Fixed width
+  EXPECT_EQ(gfx::Size(8, 32), pr.bestFit(token, 8, 0));
+}
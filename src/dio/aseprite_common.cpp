@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,6 +13,35 @@
 
 namespace dio {
 
+void AsepriteChunkIndex::clear()
+{
+  m_frames.clear();
+  m_entries.clear();
+}
+
+void AsepriteChunkIndex::addFrame(uint32_t offset)
+{
+  m_frames.push_back(offset);
+}
+
+void AsepriteChunkIndex::addEntry(uint16_t type, uint16_t frame, uint16_t index,
+                                  uint32_t offset)
+{
+  m_entries.push_back(Entry{ type, frame, index, offset });
+}
+
+const AsepriteChunkIndex::Entry*
+AsepriteChunkIndex::find(uint16_t type, uint16_t frame, uint16_t index) const
+{
+  for (const Entry& entry : m_entries) {
+    if (entry.type == type &&
+        entry.frame == frame &&
+        entry.index == index)
+      return &entry;
+  }
+  return nullptr;
+}
+
 uint32_t AsepriteExternalFiles::insert(const uint8_t type,
                                        const std::string& filename)
 {
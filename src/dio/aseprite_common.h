@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,8 +9,10 @@
 #define DIO_ASEPRITE_COMMON_H_INCLUDED
 #pragma once
 
+#include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 
 #define ASE_FILE_MAGIC                      0xA5E0
 #define ASE_FILE_FRAME_MAGIC                0xF1FA
@@ -32,6 +34,7 @@
 #define ASE_FILE_CHUNK_SLICES               0x2021 // Deprecated chunk (used on dev versions only between v1.2-beta7 and v1.2-beta8)
 #define ASE_FILE_CHUNK_SLICE                0x2022
 #define ASE_FILE_CHUNK_TILESET              0x2023
+#define ASE_FILE_CHUNK_INDEX                0x2024
 
 #define ASE_FILE_LAYER_IMAGE                0
 #define ASE_FILE_LAYER_GROUP                1
@@ -93,6 +96,7 @@ struct AsepriteHeader {
   int16_t grid_y;
   uint16_t grid_width;
   uint16_t grid_height;
+  uint32_t chunk_index;  // Offset of the ASE_FILE_CHUNK_INDEX chunk (0 if there is no index)
 };
 
 struct AsepriteFrameHeader {
@@ -107,6 +111,41 @@ struct AsepriteChunk {
   int start;
 };
 
+// Offsets (from the beginning of the file) of the frames and the
+// main chunks of a .aseprite file, stored in the optional chunk index
+// at the end of the last frame. It can be used to seek a frame, a
+// cel, or a tileset directly without reading the whole file.
+class AsepriteChunkIndex {
+public:
+  static constexpr uint16_t kNoIndex = 0xFFFF;
+
+  struct Entry {
+    uint16_t type;              // ASE_FILE_CHUNK_CEL/TILESET/USER_DATA
+    uint16_t frame;
+    uint16_t index;             // Layer index for cels (and their user data),
+                                // tileset index for tilesets, kNoIndex otherwise
+    uint32_t offset;
+  };
+
+  bool empty() const { return m_frames.empty(); }
+  void clear();
+
+  const std::vector<uint32_t>& frames() const { return m_frames; }
+  const std::vector<Entry>& entries() const { return m_entries; }
+
+  void addFrame(uint32_t offset);
+  void addEntry(uint16_t type, uint16_t frame, uint16_t index,
+                uint32_t offset);
+
+  // Returns the entry of the given chunk type, frame, and index (or
+  // nullptr if it's not in the index).
+  const Entry* find(uint16_t type, uint16_t frame, uint16_t index) const;
+
+private:
+  std::vector<uint32_t> m_frames; // Offset of each frame header
+  std::vector<Entry> m_entries;
+};
+
 class AsepriteExternalFiles {
 public:
   struct Item {
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,8 @@
 #include "base/exception.h"
 #include "base/file_handle.h"
 #include "base/fs.h"
+#include "base/log.h"
+#include "base/thread_pool.h"
 #include "dio/aseprite_common.h"
 #include "dio/decode_delegate.h"
 #include "dio/file_interface.h"
@@ -26,7 +28,11 @@
 #include "gfx/color_space.h"
 #include "zlib.h"
 
+#include <algorithm>
+#include <condition_variable>
 #include <cstdio>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 namespace dio {
@@ -88,6 +94,19 @@ bool AsepriteDecoder::decode()
   auto tag_end = sprite->tags().end();
 
   m_allLayers.clear();
+  m_skippedCels.clear();
+
+  // Compressed cel images can be decoded later from the file (only
+  // when they are used)
+  m_lazyCelsFilename.clear();
+  m_lazyCelsFileSize = 0;
+  if (!delegate()->decodeOneFrame()) {
+    m_lazyCelsFilename = delegate()->lazyCelsFilename();
+    if (!m_lazyCelsFilename.empty()) {
+      m_lazyCelsFileSize = base::file_size(m_lazyCelsFilename);
+      m_lazyCelsFileTime = base::get_modification_time(m_lazyCelsFilename);
+    }
+  }
 
   int current_level = -1;
   AsepriteExternalFiles extFiles;
@@ -169,6 +188,17 @@ bool AsepriteDecoder::decode()
           }
 
           case ASE_FILE_CHUNK_CEL: {
+            if (!delegate()->decodeFrame(frame)) {
+              // Remember where this cel is in case that a decoded
+              // frame is linked to it
+              const doc::layer_t layer_index = read16();
+              m_skippedCels[std::make_pair(layer_index, frame)] =
+                std::make_pair(chunk_pos, size_t(chunk_size));
+              last_cel = nullptr;
+              last_object_with_user_data = nullptr;
+              break;
+            }
+
             doc::Cel* cel =
               readCelChunk(sprite.get(), frame,
                            sprite->pixelFormat(), &header,
@@ -180,6 +210,11 @@ bool AsepriteDecoder::decode()
             else {
               last_object_with_user_data = nullptr;
             }
+
+            // Limit the memory used by compressed cels waiting to be
+            // decoded
+            if (m_pendingBytes > kMaxPendingBytes)
+              decodePendingCels(&header);
             break;
           }
 
@@ -291,6 +326,10 @@ bool AsepriteDecoder::decode()
             break;
           }
 
+          case ASE_FILE_CHUNK_INDEX:
+            // Only used to seek chunks directly (see readChunkIndex())
+            break;
+
           default:
             delegate()->incompatibilityError(
               fmt::format("Warning: Unsupported chunk type {0} (skipping)", chunk_type));
@@ -309,13 +348,28 @@ bool AsepriteDecoder::decode()
       break;
   }
 
+  // Decompress the remaining cels
+  decodePendingCels(&header);
+
   delegate()->onSprite(sprite.release());
   return true;
 }
 
+bool AsepriteDecoder::readChunkIndex(AsepriteChunkIndex* index)
+{
+  index->clear();
+
+  AsepriteHeader header;
+  if (!readHeader(&header))
+    return false;
+
+  return readChunkIndexChunk(&header, index);
+}
+
 bool AsepriteDecoder::readHeader(AsepriteHeader* header)
 {
   size_t headerPos = f()->tell();
+  header->pos = long(headerPos);
 
   header->size  = read32();
   header->magic = read16();
@@ -345,6 +399,7 @@ bool AsepriteDecoder::readHeader(AsepriteHeader* header)
   header->grid_y       = (int16_t)read16();
   header->grid_width   = read16();
   header->grid_height  = read16();
+  header->chunk_index  = read32();
 
   if (header->depth != 8)       // Transparent index only valid for indexed images
     header->transparent_index = 0;
@@ -371,6 +426,48 @@ bool AsepriteDecoder::readHeader(AsepriteHeader* header)
   return true;
 }
 
+bool AsepriteDecoder::readChunkIndexChunk(const AsepriteHeader* header,
+                                          AsepriteChunkIndex* index)
+{
+  // The chunk index must be inside the file (after the header)
+  if (header->chunk_index < 128 ||
+      header->chunk_index >= header->size)
+    return false;
+
+  const size_t pos = f()->tell();
+  f()->seek(header->pos + header->chunk_index);
+
+  bool result = false;
+  const uint32_t chunk_size = read32();
+  const uint16_t chunk_type = read16();
+  if (chunk_type == ASE_FILE_CHUNK_INDEX &&
+      chunk_size <= header->size - header->chunk_index) {
+    const size_t chunk_end = header->pos + header->chunk_index + chunk_size;
+
+    uint32_t nframes = read32();
+    for (uint32_t i=0; i<nframes && f()->tell()+4 <= chunk_end; ++i)
+      index->addFrame(read32());
+
+    uint32_t nentries = read32();
+    for (uint32_t i=0; i<nentries && f()->tell()+10 <= chunk_end; ++i) {
+      const uint16_t type = read16();
+      const uint16_t frame = read16();
+      const uint16_t idx = read16();
+      const uint32_t offset = read32();
+      index->addEntry(type, frame, idx, offset);
+    }
+
+    result = (index->frames().size() == nframes &&
+              index->entries().size() == nentries &&
+              nframes == header->frames);
+    if (!result)
+      index->clear();
+  }
+
+  f()->seek(pos);
+  return result;
+}
+
 void AsepriteDecoder::readFrameHeader(AsepriteFrameHeader* frame_header)
 {
   frame_header->size = read32();
@@ -838,12 +935,192 @@ void read_compressed_image(FileInterface* f,
   }
 }
 
+// Used to decode compressed data that was previously read into
+// memory.
+class BufferFileInterface : public FileInterface {
+public:
+  BufferFileInterface(const base::buffer& buffer)
+    : m_buffer(buffer) { }
+  bool ok() const override { return m_ok; }
+  size_t tell() override { return m_pos; }
+  void seek(size_t absPos) override { m_pos = std::min(absPos, m_buffer.size()); }
+  uint8_t read8() override {
+    if (m_pos < m_buffer.size())
+      return m_buffer[m_pos++];
+    m_ok = false;
+    return 0;
+  }
+  size_t readBytes(uint8_t* buf, size_t n) override {
+    const size_t n2 = std::min(n, m_buffer.size() - m_pos);
+    std::copy(m_buffer.begin()+m_pos, m_buffer.begin()+m_pos+n2, buf);
+    m_pos += n2;
+    if (n2 != n)
+      m_ok = false;
+    return n2;
+  }
+  void write8(uint8_t value) override {
+    ASSERT(false);              // Read-only
+  }
+private:
+  const base::buffer& m_buffer;
+  size_t m_pos = 0;
+  bool m_ok = true;
+};
+
+// Collects the errors found decoding a cel in a worker thread (so
+// they can be reported later to the real delegate from the decoder
+// thread).
+class CelDecodeDelegate : public DecodeDelegate {
+public:
+  void error(const std::string& msg) override {
+    m_errors.push_back(msg);
+  }
+  const std::vector<std::string>& errors() const { return m_errors; }
+private:
+  std::vector<std::string> m_errors;
+};
+
+// Decodes a compressed cel image from the original file when the
+// image is used for the first time.
+class LazyCelLoader : public doc::ImageLoader {
+public:
+  LazyCelLoader(const std::string& filename,
+                const size_t fileSize,
+                const base::Time& fileTime,
+                const size_t dataPos,
+                const size_t dataSize,
+                const doc::ImageSpec& spec,
+                const AsepriteHeader* header,
+                const bool cache)
+    : m_filename(filename)
+    , m_fileSize(fileSize)
+    , m_fileTime(fileTime)
+    , m_dataPos(dataPos)
+    , m_dataSize(dataSize)
+    , m_spec(spec)
+    , m_header(*header)
+    , m_cache(cache) {
+    ASSERT(dataSize > 0);
+  }
+
+  doc::ImageRef loadImage() override {
+    doc::ImageRef image(doc::Image::create(m_spec));
+    base::buffer data(m_dataSize);
+    bool ok = false;
+
+    // The file could be modified after it was opened, in that case
+    // we cannot trust the position of the compressed data.
+    try {
+      if (base::file_size(m_filename) == m_fileSize &&
+          base::get_modification_time(m_filename) == m_fileTime) {
+        base::FileHandle handle(base::open_file_with_exception(m_filename, "rb"));
+        StdioFileInterface file(handle.get());
+        file.seek(m_dataPos);
+        ok = (file.readBytes(&data[0], data.size()) == data.size());
+      }
+    }
+    catch (const std::exception& ex) {
+      LOG(ERROR, "ASE: %s\n", ex.what());
+    }
+
+    if (!ok) {
+      LOG(ERROR, "ASE: Error reading cel image from \"%s\" (the file was modified?)\n",
+          m_filename.c_str());
+      image->clear(image->maskColor());
+      return image;
+    }
+
+    CelDecodeDelegate celDelegate;
+    BufferFileInterface file(data);
+    read_compressed_image(&file, &celDelegate, image.get(),
+                          &m_header, data.size());
+    for (const std::string& msg : celDelegate.errors())
+      LOG(ERROR, "ASE: %s\n", msg.c_str());
+
+    if (m_cache && celDelegate.errors().empty())
+      image->setCompressedData(std::move(data));
+    return image;
+  }
+
+private:
+  std::string m_filename;
+  size_t m_fileSize;
+  base::Time m_fileTime;
+  size_t m_dataPos;
+  size_t m_dataSize;
+  doc::ImageSpec m_spec;
+  AsepriteHeader m_header;
+  bool m_cache;
+};
+
 } // anonymous namespace
 
 //////////////////////////////////////////////////////////////////////
 // Cel Chunk
 //////////////////////////////////////////////////////////////////////
 
+void AsepriteDecoder::decodePendingCels(const AsepriteHeader* header)
+{
+  if (m_pendingCels.empty())
+    return;
+
+  // Decompress one pending cel, the compressed data is kept in the
+  // image (cacheCompressedCels() option) only if it was completely
+  // read from the file.
+  const bool cache = delegate()->cacheCompressedCels();
+  auto decodeCel =
+    [header, cache](PendingCel& pending, CelDecodeDelegate& celDelegate) {
+      BufferFileInterface file(pending.data);
+      read_compressed_image(&file, &celDelegate, pending.image.get(),
+                            header, pending.data.size());
+      if (cache && pending.complete && celDelegate.errors().empty())
+        pending.image->setCompressedData(std::move(pending.data));
+    };
+
+  std::vector<CelDecodeDelegate> celDelegates(m_pendingCels.size());
+  const int threads =
+    std::min<int>(std::thread::hardware_concurrency(), m_pendingCels.size());
+  if (threads > 1) {
+    base::thread_pool pool(threads);
+    std::mutex mutex;
+    std::condition_variable cv;
+    int pending = int(m_pendingCels.size());
+
+    for (int i=0; i<int(m_pendingCels.size()); ++i) {
+      pool.execute(
+        [this, i, &decodeCel, &celDelegates, &mutex, &cv, &pending]{
+          decodeCel(m_pendingCels[i], celDelegates[i]);
+
+          std::lock_guard lock(mutex);
+          if (--pending == 0)
+            cv.notify_one();
+        });
+    }
+
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&pending]{ return pending == 0; });
+  }
+  else {
+    for (int i=0; i<int(m_pendingCels.size()); ++i)
+      decodeCel(m_pendingCels[i], celDelegates[i]);
+  }
+
+  // Report errors in the same order as the cels were read
+  for (const CelDecodeDelegate& celDelegate : celDelegates)
+    for (const std::string& msg : celDelegate.errors())
+      delegate()->error(msg);
+
+  m_pendingCels.clear();
+  m_pendingBytes = 0;
+}
+
+bool AsepriteDecoder::isCelInDecodeBounds(int x, int y, int w, int h)
+{
+  const gfx::Rect bounds = delegate()->decodeBounds();
+  return (bounds.isEmpty() ||
+          bounds.intersects(gfx::Rect(x, y, w, h)));
+}
+
 doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
                                         doc::frame_t frame,
                                         doc::PixelFormat pixelFormat,
@@ -886,6 +1163,9 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       int w = read16();
       int h = read16();
 
+      if (!isCelInDecodeBounds(x, y, w, h))
+        break;
+
       if (w > 0 && h > 0) {
         // Read pixel data
         doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
@@ -904,6 +1184,23 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       doc::frame_t link_frame = doc::frame_t(read16());
       doc::Cel* link = layer->cel(link_frame);
 
+      // The linked cel is in a frame that was skipped, so we read it
+      // now from its chunk
+      if (!link) {
+        auto it = m_skippedCels.find(std::make_pair(layer_index, link_frame));
+        if (it != m_skippedCels.end()) {
+          const size_t pos = it->second.first;
+          const size_t size = it->second.second;
+          m_skippedCels.erase(it);
+
+          const size_t cur = f()->tell();
+          f()->seek(pos+6);     // Skip chunk size and type
+          link = readCelChunk(sprite, link_frame, pixelFormat,
+                              header, pos+size);
+          f()->seek(cur);
+        }
+      }
+
       if (link) {
         // There were a beta version that allow to the user specify
         // different X, Y, or opacity per link, in that case we must
@@ -930,9 +1227,49 @@ doc::Cel* AsepriteDecoder::readCelChunk(doc::Sprite* sprite,
       int w = read16();
       int h = read16();
 
-      if (w > 0 && h > 0) {
+      if (!isCelInDecodeBounds(x, y, w, h))
+        break;
+
+      const size_t dataBeg = f()->tell();
+      if (w > 0 && h > 0 &&
+          !m_lazyCelsFilename.empty() &&
+          chunk_end > dataBeg &&
+          chunk_end <= m_lazyCelsFileSize) {
+        // The image will be decoded when it's used for the first
+        // time, the chunk data is skipped when we go to chunk_end.
+        doc::ImageSpec spec((doc::ColorMode)pixelFormat, w, h,
+                            sprite->transparentColor());
+        auto loader = std::make_shared<LazyCelLoader>(
+          m_lazyCelsFilename, m_lazyCelsFileSize, m_lazyCelsFileTime,
+          dataBeg, chunk_end - dataBeg, spec, header,
+          delegate()->cacheCompressedCels());
+
+        cel = std::make_unique<doc::Cel>(
+          frame, std::make_shared<doc::CelData>(gfx::Size(w, h), loader));
+        cel->setPosition(x, y);
+        cel->setOpacity(opacity);
+        cel->setZIndex(zIndex);
+      }
+      else if (w > 0 && h > 0) {
         doc::ImageRef image(doc::Image::create(pixelFormat, w, h));
-        read_compressed_image(f(), delegate(), image.get(), header, chunk_end);
+
+        // Read the compressed data in memory, it will be decompressed
+        // later (in parallel with other cels) in decodePendingCels().
+        PendingCel pending;
+        pending.image = image;
+        if (chunk_end > dataBeg) {
+          pending.data.resize(chunk_end - dataBeg);
+          const size_t n = f()->readBytes(&pending.data[0], pending.data.size());
+          if (n != pending.data.size()) {
+            delegate()->error(
+              fmt::format("Error reading {} bytes of compressed data",
+                          pending.data.size() - n));
+            pending.data.resize(n);
+            pending.complete = false;
+          }
+        }
+        m_pendingBytes += pending.data.size();
+        m_pendingCels.push_back(std::move(pending));
 
         cel = std::make_unique<doc::Cel>(frame, image);
         cel->setPosition(x, y);
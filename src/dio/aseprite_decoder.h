@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,8 +9,11 @@
 #define DIO_ASEPRITE_DECODER_H_INCLUDED
 #pragma once
 
+#include "base/buffer.h"
+#include "base/time.h"
 #include "dio/decoder.h"
 #include "doc/frame.h"
+#include "doc/image_ref.h"
 #include "doc/layer_list.h"
 #include "doc/pixel_format.h"
 #include "doc/slices.h"
@@ -18,7 +21,9 @@
 #include "doc/tileset.h"
 #include "doc/user_data.h"
 
+#include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace doc {
@@ -35,14 +40,22 @@ namespace dio {
 
 struct AsepriteHeader;
 struct AsepriteFrameHeader;
+class AsepriteChunkIndex;
 class AsepriteExternalFiles;
 
 class AsepriteDecoder : public Decoder {
 public:
   bool decode() override;
 
+  // Reads only the header and the chunk index of the file (without
+  // decoding the sprite). Returns false if the file doesn't contain
+  // a chunk index (e.g. files saved with older versions).
+  bool readChunkIndex(AsepriteChunkIndex* index);
+
 private:
   bool readHeader(AsepriteHeader* header);
+  bool readChunkIndexChunk(const AsepriteHeader* header,
+                           AsepriteChunkIndex* index);
   void readFrameHeader(AsepriteFrameHeader* frame_header);
   void readPadding(const int bytes);
   std::string readString();
@@ -57,6 +70,7 @@ private:
                          doc::PixelFormat pixelFormat,
                          const AsepriteHeader* header,
                          const size_t chunk_end);
+  bool isCelInDecodeBounds(int x, int y, int w, int h);
   void readCelExtraChunk(doc::Cel* cel);
   void readColorProfile(doc::Sprite* sprite);
   void readExternalFiles(AsepriteExternalFiles& extFiles);
@@ -73,9 +87,34 @@ private:
                           const AsepriteExternalFiles& extFiles);
   const doc::UserData::Variant readPropertyValue(uint16_t type);
   void readTilesData(doc::Tileset* tileset, const AsepriteExternalFiles& extFiles);
+  void decodePendingCels(const AsepriteHeader* header);
+
+  // Compressed cel images are decoded in parallel in groups of
+  // kMaxPendingBytes of compressed data.
+  struct PendingCel {
+    doc::ImageRef image;
+    base::buffer data;
+    bool complete = true;       // All compressed data was read
+  };
+  static constexpr size_t kMaxPendingBytes = 64*1024*1024;
 
   doc::LayerList m_allLayers;
   std::vector<uint32_t> m_tilesetFlags;
+  std::vector<PendingCel> m_pendingCels;
+  size_t m_pendingBytes = 0;
+
+  // Position and size of the cel chunks of the frames that were not
+  // decoded (DecodeDelegate::decodeFrame() returned false) by layer
+  // index and frame, so we can read them if a decoded frame is linked
+  // to one of them.
+  std::map<std::pair<doc::layer_t, doc::frame_t>,
+           std::pair<size_t, size_t>> m_skippedCels;
+
+  // File used to load compressed cel images lazily (empty if all
+  // cels are decoded in decode()).
+  std::string m_lazyCelsFilename;
+  size_t m_lazyCelsFileSize = 0;
+  base::Time m_lazyCelsFileTime;
 };
 
 } // namespace dio
@@ -1,5 +1,5 @@
 // Aseprite Document IO Library
-// Copyright (c) 2023 Igara Studio S.A.
+// Copyright (c) 2023-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,7 @@
 #include "doc/color.h"
 #include "doc/frame.h"
 #include "doc/sprite.h"
+#include "gfx/rect.h"
 
 #include <string>
 
@@ -38,6 +39,16 @@ public:
   // to generate a thumbnail)
   virtual bool decodeOneFrame() { return false; }
 
+  // Return false if the cel images of the given frame are not needed
+  // (they are skipped, but they can be decoded anyway if other
+  // frames are linked to them).
+  virtual bool decodeFrame(const doc::frame_t frame) { return true; }
+
+  // Region of the sprite that we want to decode, cel images outside
+  // this region can be skipped (an empty rectangle means the whole
+  // sprite).
+  virtual gfx::Rect decodeBounds() { return gfx::Rect(); }
+
   // Default color for slices without user data
   virtual doc::color_t defaultSliceColor() {
     return doc::rgba(0, 0, 255, 255);
@@ -56,6 +67,20 @@ public:
   virtual bool cacheCompressedTilesets() const {
     return false;
   }
+
+  // Same as cacheCompressedTilesets() but for the compressed data of
+  // cel images.
+  virtual bool cacheCompressedCels() const {
+    return false;
+  }
+
+  // Returns the name of the file that is being decoded if the
+  // compressed cel images can be decoded lazily from it (only when
+  // each image is accessed for the first time). An empty string
+  // means that all cels are decoded before onSprite().
+  virtual std::string lazyCelsFilename() const {
+    return std::string();
+  }
 };
 
 } // namespace dio
@@ -1,383 +1,411 @@
-// The floodfill routine.
-// By Shawn Hargreaves.
-//
-// Changes by David Capello:
-// - Adapted to Aseprite
-// - Added non-contiguous mode
-// - Added mask parameter
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+// Copyright (C) 2001-2017  David Capello
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
-//
-// TODO rewrite this algorithm from scratch
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
 
-#include "base/base.h"
-#include "doc/algo.h"
-#include "doc/image.h"
+#include "doc/algorithm/floodfill.h"
+
+#include "doc/image_impl.h"
 #include "doc/mask.h"
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
+#include "sched/task_group.h"
 
-#include <climits>
-#include <cmath>
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
 #include <vector>
 
+// SSE2 and NEON are always available on x64 and ARM64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_FLOODFILL_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define DOC_FLOODFILL_NEON 1
+  #include <arm_neon.h>
+#endif
+
 namespace doc {
 namespace algorithm {
 
-struct FLOODED_LINE {   // store segments which have been flooded
-  short flags;          // status of the segment
-  short lpos, rpos;     // left and right ends of segment
-  short y;              // y coordinate of the segment
-  int next;             // linked list if several per line
-};
-
-/* Note: a 'short' is not sufficient for 'next' above in some corner cases. */
-
-
-static std::vector<FLOODED_LINE> flood_buf;
-static int flood_count;          /* number of flooded segments */
-
-#define FLOOD_IN_USE             1
-#define FLOOD_TODO_ABOVE         2
-#define FLOOD_TODO_BELOW         4
+namespace {
 
-#define FLOOD_LINE(c)            (&flood_buf[c])
-
-static inline bool color_equal_32_raw(color_t c1, color_t c2)
-{
-  return (c1 == c2);
-}
-
-static inline bool color_equal_32(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (rgba_geta(c1) == 0 && rgba_geta(c2) == 0);
-  else {
-    int r1 = rgba_getr(c1);
-    int g1 = rgba_getg(c1);
-    int b1 = rgba_getb(c1);
-    int a1 = rgba_geta(c1);
-    int r2 = rgba_getr(c2);
-    int g2 = rgba_getg(c2);
-    int b2 = rgba_getb(c2);
-    int a2 = rgba_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
-      return true;
+// Horizontal segment of pixels [x1, x2] in the row y.
+struct Span {
+  int x1, y, x2;
+};
 
-    return ((ABS(r1-r2) <= tolerance) &&
-            (ABS(g1-g2) <= tolerance) &&
-            (ABS(b1-b2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+// Compares pixels of an image with the color of the pixel where the
+// fill started. Pixels match if each byte of the pixel (channel) is
+// within the tolerance, or if they are both transparent (RGB and
+// grayscale only). Tilemaps are compared without tolerance.
+template<typename ImageTraits>
+class ColorMatcher {
+public:
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  ColorMatcher(const color_t srcColor, const int tolerance)
+    : m_src(pixel_t(srcColor))
+    , m_tolerance(ImageTraits::pixel_format == IMAGE_TILEMAP ? 0:
+                  std::clamp(tolerance, 0, 255))
+    , m_alphaMask(ImageTraits::pixel_format == IMAGE_RGB ? pixel_t(rgba_a_mask):
+                  ImageTraits::pixel_format == IMAGE_GRAYSCALE ? pixel_t(graya_a_mask): 0)
+    , m_transparent(m_alphaMask && (m_src & m_alphaMask) == 0) {
   }
-}
 
-static inline bool color_equal_16(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2) || (graya_geta(c1) == 0 && graya_geta(c2) == 0);
-  else {
-    int k1 = graya_getv(c1);
-    int a1 = graya_geta(c1);
-    int k2 = graya_getv(c2);
-    int a2 = graya_geta(c2);
-
-    if (a1 == 0 && a2 == 0)
+  bool operator()(const pixel_t c) const {
+    if (m_transparent && (c & m_alphaMask) == 0)
       return true;
-
-    return ((ABS(k1-k2) <= tolerance) &&
-            (ABS(a1-a2) <= tolerance));
+    if (m_tolerance == 0)
+      return (c == m_src);
+    for (int i=0; i<int(sizeof(pixel_t)); ++i) {
+      if (std::abs(int((c >> (8*i)) & 0xff) -
+                   int((m_src >> (8*i)) & 0xff)) > m_tolerance)
+        return false;
+    }
+    return true;
   }
-}
-
-static inline bool color_equal_8(color_t c1, color_t c2, int tolerance)
-{
-  if (tolerance == 0)
-    return (c1 == c2);
-  else
-    return ABS((int)c1 - (int)c2) <= tolerance;
-}
 
-template<typename ImageTraits>
-static inline bool color_equal(color_t c1, color_t c2, int tolerance)
-{
-  static_assert(false && sizeof(ImageTraits), "Invalid color comparison");
-  return false;
-}
-
-template<>
-inline bool color_equal<RgbTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_32(c1, c2, tolerance);
-}
-
-template<>
-inline bool color_equal<GrayscaleTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_16(c1, c2, tolerance);
-}
-
-template<>
-inline bool color_equal<IndexedTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_8(c1, c2, tolerance);
-}
+  // Returns the first index in [0, n) of a pixel that matches (or
+  // doesn't match when "match" is false), or n if there is none.
+  int find(const pixel_t* p, const int n, const bool match) const {
+    int i = 0;
+#if DOC_FLOODFILL_SSE2 || DOC_FLOODFILL_NEON
+    const int kPixels = 16 / sizeof(pixel_t);
+    for (; i+kPixels <= n; i += kPixels) {
+      if (!vectorMatches(p+i, match))
+        break;
+    }
+#endif
+    // Remaining pixels, or the block that contains the result
+    for (; i<n; ++i)
+      if ((*this)(p[i]) == match)
+        break;
+    return i;
+  }
 
-template<>
-inline bool color_equal<TilemapTraits>(color_t c1, color_t c2, int tolerance)
-{
-  return color_equal_32_raw(c1, c2);
-}
+private:
+#if DOC_FLOODFILL_SSE2
+  // Returns true if none of the 16 bytes in "p" contains the result
+  // of find().
+  bool vectorMatches(const pixel_t* p, const bool match) const {
+    const __m128i src = broadcast(m_src);
+    const __m128i v = _mm_loadu_si128((const __m128i*)p);
+    const __m128i diff = _mm_or_si128(_mm_subs_epu8(v, src),
+                                      _mm_subs_epu8(src, v));
+    __m128i ok = _mm_cmpeq_epi8(
+      _mm_min_epu8(diff, _mm_set1_epi8(char(m_tolerance))), diff);
+    if (sizeof(pixel_t) == 4)
+      ok = _mm_cmpeq_epi32(ok, _mm_set1_epi32(-1));
+    else if (sizeof(pixel_t) == 2)
+      ok = _mm_cmpeq_epi16(ok, _mm_set1_epi16(-1));
+    if (m_transparent) {
+      const __m128i alpha = _mm_and_si128(v, broadcast(m_alphaMask));
+      ok = _mm_or_si128(ok, (sizeof(pixel_t) == 4 ?
+                             _mm_cmpeq_epi32(alpha, _mm_setzero_si128()):
+                             _mm_cmpeq_epi16(alpha, _mm_setzero_si128())));
+    }
+    return (_mm_movemask_epi8(ok) == (match ? 0: 0xffff));
+  }
 
+  static __m128i broadcast(const pixel_t c) {
+    if (sizeof(pixel_t) == 4)
+      return _mm_set1_epi32(int(c));
+    else if (sizeof(pixel_t) == 2)
+      return _mm_set1_epi16(short(c));
+    else
+      return _mm_set1_epi8(char(c));
+  }
+#elif DOC_FLOODFILL_NEON
+  bool vectorMatches(const pixel_t* p, const bool match) const {
+    const uint8x16_t src = broadcast(m_src);
+    const uint8x16_t v = vld1q_u8((const uint8_t*)p);
+    uint8x16_t ok = vcleq_u8(vabdq_u8(v, src), vdupq_n_u8(m_tolerance));
+    if (sizeof(pixel_t) == 4)
+      ok = vreinterpretq_u8_u32(
+        vceqq_u32(vreinterpretq_u32_u8(ok), vdupq_n_u32(0xffffffff)));
+    else if (sizeof(pixel_t) == 2)
+      ok = vreinterpretq_u8_u16(
+        vceqq_u16(vreinterpretq_u16_u8(ok), vdupq_n_u16(0xffff)));
+    if (m_transparent) {
+      const uint8x16_t alpha = vandq_u8(v, broadcast(m_alphaMask));
+      ok = vorrq_u8(ok, (sizeof(pixel_t) == 4 ?
+                         vreinterpretq_u8_u32(vceqzq_u32(vreinterpretq_u32_u8(alpha))):
+                         vreinterpretq_u8_u16(vceqzq_u16(vreinterpretq_u16_u8(alpha)))));
+    }
+    return (match ? vmaxvq_u8(ok) == 0: vminvq_u8(ok) == 0xff);
+  }
 
+  static uint8x16_t broadcast(const pixel_t c) {
+    if (sizeof(pixel_t) == 4)
+      return vreinterpretq_u8_u32(vdupq_n_u32(uint32_t(c)));
+    else if (sizeof(pixel_t) == 2)
+      return vreinterpretq_u8_u16(vdupq_n_u16(uint16_t(c)));
+    else
+      return vdupq_n_u8(uint8_t(c));
+  }
+#endif
 
-/* flooder:
- *  Fills a horizontal line around the specified position, and adds it
- *  to the list of drawn segments. Returns the first x coordinate after
- *  the part of the line which it has dealt with.
- */
-static int flooder(const Image* image,
-                   const Mask* mask,
-                   int x, int y,
-                   const gfx::Rect& bounds,
-                   color_t src_color, int tolerance, void *data, AlgoHLine proc)
-{
-#define MASKED(u, v)                                                    \
-        (mask &&                                                        \
-         (!mask->bounds().contains(u, v) ||                             \
-          (mask->bitmap() &&                                            \
-           !get_pixel_fast<BitmapTraits>(mask->bitmap(),                \
-                                         (u)-mask->bounds().x,          \
-                                         (v)-mask->bounds().y))))
-
-  FLOODED_LINE *p;
-  int left = 0, right = 0;
-  int c;
+  pixel_t m_src;
+  int m_tolerance;
+  pixel_t m_alphaMask;
+  bool m_transparent;
+};
 
-  switch (image->pixelFormat()) {
+// Span-based flood fill: each filled span is the longest run of
+// matching pixels in its row, and it's pushed to a stack to check
+// the pixels above and below it. Filled pixels are marked in a
+// bitmap, so each pixel is painted only once.
+template<typename ImageTraits>
+class SpanFiller {
+public:
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  SpanFiller(const Image* image,
+             const Mask* mask,
+             const gfx::Rect& bounds,
+             const color_t srcColor,
+             const int tolerance,
+             const bool isEightConnected,
+             void* data,
+             AlgoHLine proc)
+    : m_image(image)
+    , m_mask(mask)
+    , m_bounds(bounds)
+    , m_matcher(srcColor, tolerance)
+    , m_eightConnected(isEightConnected)
+    , m_data(data)
+    , m_proc(proc)
+    , m_stride((bounds.w+63) / 64)
+    , m_filled(std::size_t(m_stride) * bounds.h, 0) {
+  }
 
-    case IMAGE_RGB:
-      {
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
+  void fill(const int x, const int y) {
+    if (!m_bounds.contains(gfx::Point(x, y)) ||
+        !canFill(address(y), x, y))
+      return;
 
-        // Check start pixel
-        if (!color_equal_32((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+    fillSpan(x, y);
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+    while (!m_stack.empty()) {
+      const Span span = m_stack.back();
+      m_stack.pop_back();
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
+      int x1 = span.x1;
+      int x2 = span.x2;
+      if (m_eightConnected) {
+        x1 = std::max(m_bounds.x, x1-1);
+        x2 = std::min(m_bounds.x2()-1, x2+1);
       }
-      break;
 
-    case IMAGE_GRAYSCALE:
-      {
-        uint16_t* address = reinterpret_cast<uint16_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_16((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_16((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+      for (const int ny : { span.y-1, span.y+1 }) {
+        if (ny < m_bounds.y || ny >= m_bounds.y2())
+          continue;
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_16((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
+        const pixel_t* row = address(ny);
+        for (int x=nextUnfilled(x1, x2, ny); x<=x2;
+             x=nextUnfilled(x+1, x2, ny)) {
+          if (canFill(row, x, ny))
+            x = fillSpan(x, ny) + 1;
         }
       }
-      break;
+    }
+  }
 
-    case IMAGE_INDEXED:
-      {
-        uint8_t* address = image->getPixelAddress(0, y);
+private:
+  const pixel_t* address(const int y) const {
+    return (const pixel_t*)m_image->getPixelAddress(0, y);
+  }
 
-        // Check start pixel
-        if (!color_equal_8((int)*(address+x), src_color, tolerance) || MASKED(x, y))
-          return x+1;
+  bool isMasked(const int x, const int y) const {
+    return
+      (m_mask &&
+       (!m_mask->bounds().contains(x, y) ||
+        (m_mask->bitmap() &&
+         !get_pixel_fast<BitmapTraits>(m_mask->bitmap(),
+                                       x-m_mask->bounds().x,
+                                       y-m_mask->bounds().y))));
+  }
 
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_8((int)*(address+left), src_color, tolerance) || MASKED(left, y))
-            break;
-        }
+  bool canFill(const pixel_t* row, const int x, const int y) const {
+    return m_matcher(row[x]) && !isMasked(x, y);
+  }
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_8((int)*(address+right), src_color, tolerance) || MASKED(right, y))
-            break;
-        }
+  // Returns the first x in [x, x2] that isn't filled yet, or x2+1.
+  int nextUnfilled(int x, const int x2, const int y) const {
+    const uint64_t* row = &m_filled[std::size_t(y - m_bounds.y)*m_stride];
+    int u = x - m_bounds.x;
+    const int u2 = x2 - m_bounds.x;
+    while (u <= u2) {
+      const uint64_t bits = row[u/64] >> (u & 63);
+      if (bits == (~uint64_t(0) >> (u & 63))) {
+        // All the remaining pixels of this word are filled
+        u = (u & ~63) + 64;
       }
-      break;
-
-    case IMAGE_TILEMAP:
-      {
-        // TODO add support for mask
-
-        uint32_t* address = reinterpret_cast<uint32_t*>(image->getPixelAddress(0, y));
-
-        // Check start pixel
-        if (!color_equal_32_raw((int)*(address+x), src_color))
-          return x+1;
-
-        // Work left from starting point
-        for (left=x-1; left>=bounds.x; left--) {
-          if (!color_equal_32_raw((int)*(address+left), src_color))
-            break;
-        }
+      else if (bits & 1)
+        ++u;
+      else
+        break;
+    }
+    return std::min(u, u2+1) + m_bounds.x;
+  }
 
-        // Work right from starting point
-        for (right=x+1; right<bounds.x2(); right++) {
-          if (!color_equal_32_raw((int)*(address+right), src_color))
-            break;
-        }
-      }
-      break;
+  void setFilled(const int x1, const int x2, const int y) {
+    uint64_t* row = &m_filled[std::size_t(y - m_bounds.y)*m_stride];
+    int u = x1 - m_bounds.x;
+    const int u2 = x2 - m_bounds.x;
+    for (; u <= u2 && (u & 63); ++u)
+      row[u/64] |= (uint64_t(1) << (u & 63));
+    for (; u+63 <= u2; u += 64)
+      row[u/64] = ~uint64_t(0);
+    for (; u <= u2; ++u)
+      row[u/64] |= (uint64_t(1) << (u & 63));
+  }
 
-    default:
-      // Check start pixel
-      if (get_pixel(image, x, y) != src_color || MASKED(x, y))
-        return x+1;
+  // Paints the span of matching pixels that contains (x, y), and
+  // returns its last x coordinate.
+  int fillSpan(const int x, const int y) {
+    const pixel_t* row = address(y);
 
-      // Work left from starting point
-      for (left=x-1; left>=bounds.x; left--) {
-        if (get_pixel(image, left, y) != src_color || MASKED(left, y))
-          break;
-      }
+    int x1 = x;
+    while (x1 > m_bounds.x && canFill(row, x1-1, y))
+      --x1;
 
-      // Work right from starting point
-      for (right=x+1; right<bounds.x2(); right++) {
-        if (get_pixel(image, right, y) != src_color || MASKED(right, y))
+    int x2 = x + m_matcher.find(row+x+1, m_bounds.x2()-x-1, false);
+    if (m_mask) {
+      for (int u=x+1; u<=x2; ++u) {
+        if (isMasked(u, y)) {
+          x2 = u-1;
           break;
+        }
       }
-      break;
-  }
-
-  left++;
-  right--;
-
-  /* draw the line */
-  (*proc)(left, y, right, data);
-
-  /* store it in the list of flooded segments */
-  c = y;
-  p = FLOOD_LINE(c);
-
-  if (p->flags) {
-    while (p->next) {
-      c = p->next;
-      p = FLOOD_LINE(c);
     }
 
-    p->next = c = flood_count++;
-    flood_buf.resize(flood_count);
-    p = FLOOD_LINE(c);
+    setFilled(x1, x2, y);
+    (*m_proc)(x1, y, x2, m_data);
+    m_stack.push_back(Span{ x1, y, x2 });
+    return x2;
   }
 
-  p->flags = FLOOD_IN_USE;
-  p->lpos = left;
-  p->rpos = right;
-  p->y = y;
-  p->next = 0;
-
-  if (y > bounds.y)
-    p->flags |= FLOOD_TODO_ABOVE;
-
-  if (y+1 < bounds.y2())
-    p->flags |= FLOOD_TODO_BELOW;
-
-  return right+2;
-}
-
-
+  const Image* m_image;
+  const Mask* m_mask;
+  gfx::Rect m_bounds;
+  ColorMatcher<ImageTraits> m_matcher;
+  bool m_eightConnected;
+  void* m_data;
+  AlgoHLine m_proc;
+  int m_stride;
+  std::vector<uint64_t> m_filled;
+  std::vector<Span> m_stack;
+};
 
-/* check_flood_line:
- *  Checks a line segment, using the scratch buffer is to store a list of
- *  segments which have already been drawn in order to minimise the required
- *  number of tests.
- */
-static int check_flood_line(const Image* image,
-                            const Mask* mask,
-                            int y, int left, int right,
-                            const gfx::Rect& bounds,
-                            int src_color, int tolerance, void *data, AlgoHLine proc)
+// Calls "emit" for each span of pixels with the given color in the
+// rows [y1, y2) of the bounds.
+template<typename ImageTraits, typename Emit>
+void find_color_spans(const Image* image,
+                      const gfx::Rect& bounds,
+                      const ColorMatcher<ImageTraits>& matcher,
+                      const int y1, const int y2,
+                      Emit emit)
 {
-  int c;
-  FLOODED_LINE *p;
-  int ret = false;
-
-  while (left <= right) {
-    c = y;
-
-    for (;;) {
-      p = FLOOD_LINE(c);
-
-      if ((left >= p->lpos) && (left <= p->rpos)) {
-        left = p->rpos+2;
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  for (int y=y1; y<y2; ++y) {
+    const pixel_t* row = (const pixel_t*)image->getPixelAddress(0, y);
+    const int x2 = bounds.x2();
+    int x = bounds.x;
+    while (x < x2) {
+      x += matcher.find(row+x, x2-x, true);
+      if (x >= x2)
         break;
-      }
 
-      c = p->next;
-
-      if (!c) {
-        left = flooder(image, mask, left, y, bounds, src_color, tolerance, data, proc);
-        ret = true;
-        break;
-      }
+      const int right = x + matcher.find(row+x, x2-x, false);
+      emit(x, y, right-1);
+      x = right;
     }
   }
-
-  return ret;
 }
 
+// Non-contiguous mode. The rows are compared in parallel, but "proc"
+// is always called from this thread and in the same order (rows from
+// top to bottom, spans from left to right).
 template<typename ImageTraits>
-static void replace_color(const Image* image, const gfx::Rect& bounds, int src_color, int tolerance, void* data, AlgoHLine proc)
+void replace_color(const Image* image, const gfx::Rect& bounds, color_t src_color, int tolerance, void* data, AlgoHLine proc)
 {
-  typename ImageTraits::address_t address;
-
-  for (int y=bounds.y; y<bounds.y2(); ++y) {
-    address = reinterpret_cast<typename ImageTraits::address_t>(image->getPixelAddress(bounds.x, y));
-
-    for (int x=bounds.x; x<bounds.x2(); ++x, ++address) {
-      int right = -1;
+  const ColorMatcher<ImageTraits> matcher(src_color, tolerance);
+
+  const int kRowsPerTask = 16;
+  const int kMinParallelPixels = 256*256;
+  const int threads =
+    std::min(sched::Scheduler::instance().threads(),
+             (bounds.h + kRowsPerTask-1) / kRowsPerTask);
+
+  if (threads <= 1 || bounds.w*bounds.h < kMinParallelPixels) {
+    find_color_spans(image, bounds, matcher, bounds.y, bounds.y2(),
+                     [data, proc](int x1, int y, int x2) {
+                       (*proc)(x1, y, x2, data);
+                     });
+    return;
+  }
 
-      if (color_equal<ImageTraits>((int)(*address), src_color, tolerance)) {
-        ++address;
-        for (right=x+1; right<bounds.x2(); ++right, ++address) {
-          if (!color_equal<ImageTraits>((int)(*address), src_color, tolerance))
-            break;
-        }
-        (*proc)(x, y, right-1, data);
-        x = right;
-      }
+  // Process groups of rows (one task for each thread) and then
+  // paint their spans, so only the spans of a group are in memory.
+  std::vector<std::vector<Span>> spans(threads);
+  for (int y=bounds.y; y<bounds.y2(); y+=threads*kRowsPerTask) {
+    sched::TaskGroup tasks(sched::Priority::UI);
+    for (int t=0; t<threads; ++t) {
+      tasks.run(
+        [&, t]{
+          const int y1 = std::min(bounds.y2(), y + t*kRowsPerTask);
+          const int y2 = std::min(bounds.y2(), y1 + kRowsPerTask);
+          std::vector<Span>& out = spans[t];
+          out.clear();
+          find_color_spans(image, bounds, matcher, y1, y2,
+                           [&out](int x1, int y, int x2) {
+                             out.push_back(Span{ x1, y, x2 });
+                           });
+        });
     }
+    tasks.wait();
+
+    for (const std::vector<Span>& out : spans)
+      for (const Span& span : out)
+        (*proc)(span.x1, span.y, span.x2, data);
   }
 }
 
+template<typename ImageTraits>
+void span_floodfill(const Image* image,
+                    const Mask* mask,
+                    const int x, const int y,
+                    const gfx::Rect& bounds,
+                    const color_t src_color,
+                    const int tolerance,
+                    const bool isEightConnected,
+                    void* data,
+                    AlgoHLine proc)
+{
+  SpanFiller<ImageTraits> filler(image, mask, bounds, src_color, tolerance,
+                                 isEightConnected, data, proc);
+  filler.fill(x, y);
+}
+
+} // anonymous namespace
+
 /* floodfill:
  *  Fills an enclosed area (starting at point x, y) with the specified color.
  */
 void floodfill(const Image* image,
                const Mask* mask,
                const int x, const int y,
-               const gfx::Rect& bounds,
+               const gfx::Rect& bounds0,
                const doc::color_t src_color,
                const int tolerance,
                const bool contiguous,
@@ -390,6 +418,10 @@ void floodfill(const Image* image,
       (y < 0) || (y >= image->height()))
     return;
 
+  const gfx::Rect bounds = (bounds0 & image->bounds());
+  if (bounds.isEmpty())
+    return;
+
   // Non-contiguous case, we replace colors in the whole image.
   if (!contiguous) {
     switch (image->pixelFormat()) {
@@ -409,116 +441,25 @@ void floodfill(const Image* image,
     return;
   }
 
-  /* set up the list of flooded segments */
-  flood_buf.resize(image->height());
-  flood_count = image->height();
-  FLOODED_LINE* p = (FLOODED_LINE*)&flood_buf[0];
-  for (int c=0; c<flood_count; c++) {
-    p[c].flags = 0;
-    p[c].lpos = SHRT_MAX;
-    p[c].rpos = SHRT_MIN;
-    p[c].y = y;
-    p[c].next = 0;
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:
+      span_floodfill<RgbTraits>(image, mask, x, y, bounds, src_color,
+                                tolerance, isEightConnected, data, proc);
+      break;
+    case IMAGE_GRAYSCALE:
+      span_floodfill<GrayscaleTraits>(image, mask, x, y, bounds, src_color,
+                                      tolerance, isEightConnected, data, proc);
+      break;
+    case IMAGE_INDEXED:
+      span_floodfill<IndexedTraits>(image, mask, x, y, bounds, src_color,
+                                    tolerance, isEightConnected, data, proc);
+      break;
+    case IMAGE_TILEMAP:
+      // TODO add support for mask
+      span_floodfill<TilemapTraits>(image, nullptr, x, y, bounds, src_color,
+                                    tolerance, isEightConnected, data, proc);
+      break;
   }
-
-  // Start up the flood algorithm
-  flooder(image, mask, x, y, bounds, src_color, tolerance, data, proc);
-
-  // Continue as long as there are some segments still to test
-  bool done;
-  do {
-    done = true;
-
-    // For each line on the screen
-    for (int c=0; c<flood_count; c++) {
-      p = FLOOD_LINE(c);
-
-      // Check below the segment?
-      if (p->flags & FLOOD_TODO_BELOW) {
-        p->flags &= ~FLOOD_TODO_BELOW;
-
-        if (isEightConnected) {
-          if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y+1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-        }
-
-        if (check_flood_line(image, mask, p->y+1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-          p = FLOOD_LINE(c);
-        }
-      }
-
-      // Check above the segment?
-      if (p->flags & FLOOD_TODO_ABOVE) {
-        p->flags &= ~FLOOD_TODO_ABOVE;
-
-        if (isEightConnected) {
-          if (p->lpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos+1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->lpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos-1, p->rpos, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos+1 < bounds.x2() &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos+1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-
-          if (p->rpos-1 >= bounds.x &&
-              check_flood_line(image, mask, p->y-1, p->lpos, p->rpos-1, bounds,
-                               src_color, tolerance, data, proc)) {
-            done = false;
-            p = FLOOD_LINE(c);
-          }
-        }
-
-        if (check_flood_line(image, mask, p->y-1, p->lpos, p->rpos, bounds,
-                             src_color, tolerance, data, proc)) {
-          done = false;
-
-          // Special case shortcut for going backwards
-          if ((c > bounds.y) && (c < bounds.y2()))
-            c -= 2;
-        }
-      }
-    }
-  } while (!done);
 }
 
 } // namespace algorithm
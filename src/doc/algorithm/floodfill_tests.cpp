@@ -0,0 +1,171 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/floodfill.h"
+#include "doc/image_impl.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace doc;
+using namespace gfx;
+
+namespace {
+
+struct Painted {
+  Image* image;
+  int spans = 0;
+};
+
+void paint_hline(int x1, int y, int x2, void* data)
+{
+  auto painted = (Painted*)data;
+  for (int x=x1; x<=x2; ++x) {
+    // Each pixel must be painted only once
+    EXPECT_EQ(0, get_pixel(painted->image, x, y));
+    put_pixel(painted->image, x, y, 1);
+  }
+  ++painted->spans;
+}
+
+// Flood fill pixel by pixel.
+void expected_fill(const Image* image, const Mask* mask,
+                   const int x0, const int y0,
+                   const Rect& bounds, const int tolerance,
+                   const bool contiguous, const bool eight,
+                   Image* result)
+{
+  const color_t src = get_pixel(image, x0, y0);
+  auto matches = [&](int x, int y) -> bool {
+    if (!bounds.contains(x, y))
+      return false;
+    if (contiguous && mask &&
+        (!mask->bounds().contains(x, y) ||
+         !get_pixel(mask->bitmap(), x-mask->bounds().x, y-mask->bounds().y)))
+      return false;
+    const color_t c = get_pixel(image, x, y);
+    if (image->pixelFormat() == IMAGE_RGB) {
+      if (rgba_geta(c) == 0 && rgba_geta(src) == 0)
+        return true;
+      return (std::abs(int(rgba_getr(c)) - int(rgba_getr(src))) <= tolerance &&
+              std::abs(int(rgba_getg(c)) - int(rgba_getg(src))) <= tolerance &&
+              std::abs(int(rgba_getb(c)) - int(rgba_getb(src))) <= tolerance &&
+              std::abs(int(rgba_geta(c)) - int(rgba_geta(src))) <= tolerance);
+    }
+    return std::abs(int(c) - int(src)) <= tolerance;
+  };
+
+  clear_image(result, 0);
+  if (!contiguous) {
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        if (matches(x, y))
+          put_pixel(result, x, y, 1);
+    return;
+  }
+
+  if (!matches(x0, y0))
+    return;
+
+  std::vector<Point> stack = { Point(x0, y0) };
+  put_pixel(result, x0, y0, 1);
+  while (!stack.empty()) {
+    const Point pt = stack.back();
+    stack.pop_back();
+    for (int v=-1; v<=1; ++v)
+      for (int u=-1; u<=1; ++u) {
+        if ((u == 0 && v == 0) || (!eight && u != 0 && v != 0))
+          continue;
+        const int x = pt.x+u, y = pt.y+v;
+        if (matches(x, y) && !get_pixel(result, x, y)) {
+          put_pixel(result, x, y, 1);
+          stack.push_back(Point(x, y));
+        }
+      }
+  }
+}
+
+void test_fill(const Image* image, const Mask* mask,
+               const int x, const int y, const Rect& bounds,
+               const int tolerance, const bool contiguous, const bool eight)
+{
+  std::unique_ptr<Image> expected(Image::create(IMAGE_INDEXED, image->width(), image->height()));
+  std::unique_ptr<Image> result(Image::create(IMAGE_INDEXED, image->width(), image->height()));
+  expected_fill(image, mask, x, y, bounds, tolerance, contiguous, eight,
+                expected.get());
+
+  clear_image(result.get(), 0);
+  Painted painted;
+  painted.image = result.get();
+  algorithm::floodfill(image, mask, x, y, bounds,
+                       get_pixel(image, x, y), tolerance,
+                       contiguous, eight, &painted, paint_hline);
+
+  EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+    << "x=" << x << " y=" << y
+    << " tolerance=" << tolerance
+    << " contiguous=" << contiguous
+    << " eight=" << eight;
+}
+
+} // anonymous namespace
+
+TEST(FloodFill, CompareWithPixelByPixelFill)
+{
+  for (const PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE, IMAGE_INDEXED }) {
+    for (const Size size : { Size(1, 1), Size(7, 5), Size(77, 41), Size(300, 300) }) {
+      // Few colors so there are big regions to fill
+      std::unique_ptr<Image> image(Image::create(format, size.w, size.h));
+      for (int y=0; y<size.h; ++y)
+        for (int x=0; x<size.w; ++x) {
+          const int i = ((x/3 + y/2) % 3) + (std::rand() % 5 == 0 ? 1: 0);
+          color_t c = i;
+          if (format == IMAGE_RGB)
+            c = rgba(i*10, 0, 0, (i == 2 ? 0: 255));
+          else if (format == IMAGE_GRAYSCALE)
+            c = graya(i*10, 255);
+          put_pixel(image.get(), x, y, c);
+        }
+
+      Mask mask;
+      if (size.w > 1) {
+        mask.replace(Rect(1, 1, size.w-1, size.h));
+        put_pixel(mask.bitmap(), 0, 0, 0);
+      }
+
+      for (int t=0; t<10; ++t) {
+        const int x = std::rand() % size.w;
+        const int y = std::rand() % size.h;
+        const Rect bounds = (t < 5 ? image->bounds():
+                             Rect(x-5, y-3, 20, 12) & image->bounds());
+        for (int tolerance : { 0, 15 }) {
+          test_fill(image.get(), nullptr, x, y, bounds, tolerance, true, false);
+          test_fill(image.get(), nullptr, x, y, bounds, tolerance, true, true);
+          test_fill(image.get(), nullptr, x, y, bounds, tolerance, false, false);
+          if (mask.bitmap() &&
+              mask.bounds().contains(x, y) &&
+              get_pixel(mask.bitmap(), x-mask.bounds().x, y-mask.bounds().y))
+            test_fill(image.get(), &mask, x, y, bounds, tolerance, true, false);
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2021 Igara Studio S.A.
+// Copyright (c) 2021-2024 Igara Studio S.A.
 // Copyright (c) 2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,17 +11,101 @@
 
 #include "doc/algorithm/modify_selection.h"
 
+#include "doc/algorithm/row_bands.h"
 #include "doc/image_impl.h"
 #include "doc/mask.h"
 #include "doc/primitives.h"
 
-#include <memory>
+#include <algorithm>
+#include <limits>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
 
-// TODO create morphological operators/functions in "doc" namespace
-// TODO the impl is not optimal, but is good enough as a first version
+namespace {
+
+// Maximum squared distance from the center of a circular brush. The
+// r*r+r circle is the nearest one to the fill_ellipse() shape (which
+// was used to create the brush kernel), except for radius=1, where
+// the brush is a cross (only 4-connected neighbors).
+int circle_threshold(const int radius)
+{
+  return (radius == 1 ? 1: radius*radius + radius);
+}
+
+// Calculates the distance (clamped to maxDist) from each item of
+// dist[] (separated by "step" ints) to the nearest item that is 0.
+void distance_1d(int* dist, const int n, const int step, const int maxDist)
+{
+  int d = maxDist;
+  for (int i=0; i<n; ++i) {
+    int& v = dist[i*step];
+    if (v == 0)
+      d = 0;
+    else
+      v = d = std::min(d+1, maxDist);
+  }
+  d = maxDist;
+  for (int i=n-1; i>=0; --i) {
+    int& v = dist[i*step];
+    if (v == 0)
+      d = 0;
+    else {
+      d = std::min(d+1, maxDist);
+      v = std::min(v, d);
+    }
+  }
+}
+
+// Squared Euclidean distance transform of the sampled function f[]
+// (Felzenszwalb & Huttenlocher) in linear time: d[q] = min over p of
+// (q-p)^2 + f[p] (clamped to maxValue). v[] and z[] are temporary
+// buffers.
+void squared_distance_1d(const int* f, int* d, const int n,
+                         const int maxValue,
+                         std::vector<int>& v,
+                         std::vector<double>& z)
+{
+  v.resize(n);
+  z.resize(n+1);
+
+  int k = 0;
+  v[0] = 0;
+  z[0] = -std::numeric_limits<double>::infinity();
+  z[1] = std::numeric_limits<double>::infinity();
+  for (int q=1; q<n; ++q) {
+    // Intersection of the parabola from q with the rightmost
+    // parabola of the lower envelope (z[0] is -inf, so k >= 0)
+    auto intersection = [f, &v, q](const int k) {
+      const int p = v[k];
+      return (double(f[q]) + double(q)*q - f[p] - double(p)*p) / (2.0*(q-p));
+    };
+    double s = intersection(k);
+    while (s <= z[k])
+      s = intersection(--k);
+    ++k;
+    v[k] = q;
+    z[k] = s;
+    z[k+1] = std::numeric_limits<double>::infinity();
+  }
+
+  k = 0;
+  for (int q=0; q<n; ++q) {
+    while (z[k+1] < q)
+      ++k;
+    const int p = v[k];
+    const double value = double(q-p)*(q-p) + f[p];
+    d[q] = (value < maxValue ? int(value): maxValue);
+  }
+}
+
+} // anonymous namespace
+
+// Expand/contract/border are calculated with a distance transform
+// of the selection (or of the non-selected pixels) in linear time
+// (independent of the radius): a pass in each row and then a pass in
+// each column, both of them from several threads.
 void modify_selection(const SelectionModifier modifier,
                       const Mask* srcMask,
                       Mask* dstMask,
@@ -37,60 +121,107 @@ void modify_selection(const SelectionModifier modifier,
   // Image bounds to clip get/put pixels
   const gfx::Rect srcBounds = srcImage->bounds();
 
-  // Create a kernel
-  const int size = 2*radius+1;
-  std::unique_ptr<doc::Image> kernel(doc::Image::create(IMAGE_BITMAP, size, size));
-  doc::clear_image(kernel.get(), 0);
-  if (brush == doc::kCircleBrushType)
-    doc::fill_ellipse(kernel.get(), 0, 0, size-1, size-1, 0, 0, 1);
-  else
-    doc::fill_rect(kernel.get(), 0, 0, size-1, size-1, 1);
-  doc::put_pixel(kernel.get(), radius, radius, 0);
-
-  int total = 0;                // Number of 1s in the kernel image
-  for (int v=0; v<size; ++v)
-    for (int u=0; u<size; ++u)
-      total += kernel->getPixel(u, v);
-
-  for (int y=-radius; y<srcBounds.h+radius; ++y) {
-    for (int x=-radius; x<srcBounds.w+radius; ++x) {
-      doc::color_t c;
-      if (srcBounds.contains(x, y))
-        c = srcImage->getPixel(x, y);
-      else
-        c = 0;
-
-      int accum = 0;
-      for (int v=0; v<size; ++v) {
-        for (int u=0; u<size; ++u) {
-          if (kernel->getPixel(u, v)) {
-            if (srcBounds.contains(x+u-radius, y+v-radius))
-              accum += srcImage->getPixel(x-radius+u, y-radius+v);
-          }
-        }
+  // Pixels to calculate around the source image. To expand the
+  // selection we need the whole radius, to contract it or get its
+  // border we just need to know that the pixels outside the source
+  // image are not selected.
+  const int r = std::max(0, radius);
+  const int margin = (modifier == SelectionModifier::Expand ? r: 1);
+  const int w = srcBounds.w + 2*margin;
+  const int h = srcBounds.h + 2*margin;
+  const int maxDist = r+1;
+
+  auto isSelected = [srcImage, &srcBounds, margin](const int x, const int y) -> bool {
+    return (srcBounds.contains(x-margin, y-margin) &&
+            srcImage->getPixel(x-margin, y-margin));
+  };
+
+  // We calculate the distance to the selected pixels (to expand it)
+  // or to the non-selected pixels (to contract it/get the border).
+  const bool featureValue = (modifier == SelectionModifier::Expand);
+  std::vector<int> dist(std::size_t(w)*h);
+
+  // Horizontal distance to the nearest feature in each row (pixels
+  // further than the radius are clamped to radius+1 as they cannot
+  // be reached by the brush anyway)
+  for_each_row_band(
+    w, h,
+    [&](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        int* row = &dist[std::size_t(y)*w];
+        for (int x=0; x<w; ++x)
+          row[x] = (isSelected(x, y) == featureValue ? 0: maxDist);
+        distance_1d(row, w, 1, maxDist);
       }
+    });
 
-      switch (modifier) {
-        case SelectionModifier::Border: {
-          c = (c && accum < total) ? 1: 0;
-          break;
+  // Combine the horizontal distances in each column, after this a
+  // pixel is reached by the brush (from a feature) if its value is
+  // <= radius. Bands of columns are processed in parallel.
+  if (brush == doc::kCircleBrushType) {
+    const int threshold = circle_threshold(r);
+    for_each_row_band(
+      h, w,
+      [&](const int x1, const int x2){
+        std::vector<int> f(h), d(h), v;
+        std::vector<double> z;
+        for (int x=x1; x<x2; ++x) {
+          for (int y=0; y<h; ++y) {
+            const int dx = dist[std::size_t(y)*w + x];
+            f[y] = dx*dx;
+          }
+          squared_distance_1d(f.data(), d.data(), h, threshold+1, v, z);
+          for (int y=0; y<h; ++y)
+            dist[std::size_t(y)*w + x] = (d[y] <= threshold ? 0: maxDist);
         }
-        case SelectionModifier::Expand: {
-          c = (c || accum > 0) ? 1: 0;
-          break;
+      });
+  }
+  else {
+    // The square brush is separable: the vertical distance to the
+    // nearest pixel of the row pass inside the radius.
+    for_each_row_band(
+      h, w,
+      [&](const int x1, const int x2){
+        for (int x=x1; x<x2; ++x) {
+          int* col = &dist[x];
+          for (int y=0; y<h; ++y) {
+            int& v = col[std::size_t(y)*w];
+            v = (v <= r ? 0: maxDist);
+          }
+          distance_1d(col, h, w, maxDist);
         }
-        case SelectionModifier::Contract: {
-          c = (c && accum == total) ? 1: 0;
-          break;
+      });
+  }
+
+  for_each_row_band(
+    w, h,
+    [&](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const int* row = &dist[std::size_t(y)*w];
+        for (int x=0; x<w; ++x) {
+          const bool c = isSelected(x, y);
+          const bool reached = (row[x] <= r);
+          bool result = false;
+
+          switch (modifier) {
+            case SelectionModifier::Border:
+              result = (c && reached);
+              break;
+            case SelectionModifier::Expand:
+              result = reached;
+              break;
+            case SelectionModifier::Contract:
+              result = (c && !reached);
+              break;
+          }
+
+          if (result)
+            doc::put_pixel(dstImage,
+                           offset.x+x-margin,
+                           offset.y+y-margin, 1);
         }
       }
-
-      if (c)
-        doc::put_pixel(dstImage,
-                       offset.x+x,
-                       offset.y+y, 1);
-    }
-  }
+    });
 }
 
 } // namespace algorithm
@@ -0,0 +1,59 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#include "gtest/gtest.h"
+
+#include "doc/algorithm/modify_selection.h"
+#include "doc/image.h"
+#include "doc/mask.h"
+
+using namespace doc;
+using namespace doc::algorithm;
+using namespace gfx;
+
+static int count_modified_pixels(const SelectionModifier modifier,
+                                 const Rect& selection,
+                                 const int radius,
+                                 const BrushType brush)
+{
+  Mask src;
+  src.replace(selection);
+
+  Mask dst;
+  dst.reserve(Rect(0, 0, 64, 64));
+  dst.freeze();
+  modify_selection(modifier, &src, &dst, radius, brush);
+
+  int count = 0;
+  const Image* bitmap = dst.bitmap();
+  for (int y=0; y<bitmap->height(); ++y)
+    for (int x=0; x<bitmap->width(); ++x)
+      count += (bitmap->getPixel(x, y) ? 1: 0);
+
+  dst.unfreeze();
+  return count;
+}
+
+TEST(ModifySelection, Expand)
+{
+  EXPECT_EQ(14*14, count_modified_pixels(SelectionModifier::Expand, Rect(10, 10, 10, 10), 2, kSquareBrushType));
+  EXPECT_EQ(5, count_modified_pixels(SelectionModifier::Expand, Rect(10, 10, 1, 1), 1, kCircleBrushType));
+  EXPECT_EQ(21, count_modified_pixels(SelectionModifier::Expand, Rect(10, 10, 1, 1), 2, kCircleBrushType));
+  EXPECT_EQ(1, count_modified_pixels(SelectionModifier::Expand, Rect(10, 10, 1, 1), 0, kCircleBrushType));
+}
+
+TEST(ModifySelection, Contract)
+{
+  EXPECT_EQ(6*6, count_modified_pixels(SelectionModifier::Contract, Rect(10, 10, 10, 10), 2, kSquareBrushType));
+  EXPECT_EQ(0, count_modified_pixels(SelectionModifier::Contract, Rect(10, 10, 10, 10), 5, kCircleBrushType));
+}
+
+TEST(ModifySelection, Border)
+{
+  EXPECT_EQ(100-8*8, count_modified_pixels(SelectionModifier::Border, Rect(10, 10, 10, 10), 1, kCircleBrushType));
+  EXPECT_EQ(100-6*6, count_modified_pixels(SelectionModifier::Border, Rect(10, 10, 10, 10), 2, kSquareBrushType));
+  EXPECT_EQ(0, count_modified_pixels(SelectionModifier::Border, Rect(10, 10, 10, 10), 0, kSquareBrushType));
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,8 +14,10 @@
 #include "doc/algorithm/polygon.h"
 
 #include "gfx/point.h"
+#include "gfx/rect.h"
 
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 namespace doc {
@@ -105,113 +107,198 @@ bool algorithm::createUnion(std::vector<int>& pairs,
   return false;
 }
 
-void algorithm::polygon(int vertices, const int* points, void* data, AlgoHLine proc)
+algorithm::Polygon::Polygon()
 {
-  if (!vertices)
+  clear();
+}
+
+void algorithm::Polygon::clear()
+{
+  m_input.clear();
+  m_verts.clear();
+  m_pts.clear();
+  m_xmin = m_ymin = std::numeric_limits<int>::max();
+  m_xmax = m_ymax = std::numeric_limits<int>::min();
+  clearDirtyRows();
+}
+
+void algorithm::Polygon::setVertices(int vertices, const int* points)
+{
+  const int n = vertices*2;
+  if (int(m_input.size()) > n ||
+      !std::equal(m_input.begin(), m_input.end(), points)) {
+    clear();
+  }
+
+  for (int i=int(m_input.size()); i<n; i+=2) {
+    m_input.push_back(points[i]);
+    m_input.push_back(points[i+1]);
+    addVertex(gfx::Point(points[i], points[i+1]));
+  }
+}
+
+void algorithm::Polygon::addVertex(const gfx::Point& pt)
+{
+  // Remove duplicate points to manage easily the vertices
+  if (!m_verts.empty() && m_verts.back() == pt)
     return;
 
-  // We load locally the points to "verts" and remove the duplicate points
-  // to manage easily the input vector, by the way, we find
-  // "ymin" and "ymax" to use them later like vertical scan limits
-  // on the scan line loop.
-  int ymin = *(points+1);
-  int ymax = *(points+1);
-  std::vector<gfx::Point> verts(1);
-  verts[0].x = *points;
-  verts[0].y = *(points+1);
-  int verticesAux = vertices;
-  for (int i=2; i < vertices*2; i+=2) {
-    int last = verts.size() - 1;
-    if (verts[last].x == *(points+i) && verts[last].y == *(points + (i+1))) {
-      verticesAux--;
-      continue;
-    }
-    verts.push_back(gfx::Point(*(points + i), *(points + (i+1))));
-    ASSERT(last + 1 == verts.size() - 1);
-    if (verts[last+1].y < ymin)
-      ymin = verts[last+1].y;
-    if (verts[last+1].y > ymax)
-      ymax = verts[last+1].y;
+  // The closing edge (from the last vertex to the first one) is
+  // replaced with two edges: last -> pt -> first
+  int y1 = pt.y;
+  int y2 = pt.y;
+  if (!m_verts.empty()) {
+    y1 = std::min({ y1, m_verts.back().y, m_verts.front().y });
+    y2 = std::max({ y2, m_verts.back().y, m_verts.front().y });
+
+    algo_line_continuous(m_verts.back().x,
+                         m_verts.back().y,
+                         pt.x, pt.y,
+                         (void*)&m_pts,
+                         (AlgoPixel)&addPointsWithoutDuplicatingLastOne);
   }
-  vertices = verticesAux;
-
-  std::vector<gfx::Point> pts;
-  for (int c=0; c < verts.size(); ++c) {
-    if (c == verts.size() - 1) {
-      algo_line_continuous(verts[verts.size()-1].x,
-                           verts[verts.size()-1].y,
-                           verts[0].x,
-                           verts[0].y,
-                           (void*)&pts,
-                           (AlgoPixel)&addPointsWithoutDuplicatingLastOne);
-      // Consideration when we want to draw a simple pixel with contour tool
-      // dragging the cursor inside of a pixel (in this case pts contains
-      // just one element, which want to preserve).
-      if (pts.size() > 1)
-        // We remove the last point which is a duplicate point of
-        // the "pts" first element.
-        pts.pop_back();
+  m_verts.push_back(pt);
+
+  // The old ymax row is inside the [y1, y2] range (it's between the
+  // last vertex and the new one)
+  m_xmin = std::min(m_xmin, pt.x);
+  m_ymin = std::min(m_ymin, pt.y);
+  m_xmax = std::max(m_xmax, pt.x);
+  m_ymax = std::max(m_ymax, pt.y);
+
+  m_dirtyY1 = std::min(m_dirtyY1, y1);
+  m_dirtyY2 = std::max(m_dirtyY2, y2);
+}
+
+gfx::Rect algorithm::Polygon::bounds() const
+{
+  if (m_verts.empty())
+    return gfx::Rect();
+  return gfx::Rect(m_xmin, m_ymin, m_xmax-m_xmin+1, m_ymax-m_ymin+1);
+}
+
+bool algorithm::Polygon::dirtyRows(int& y1, int& y2) const
+{
+  if (m_dirtyY1 > m_dirtyY2)
+    return false;
+  y1 = m_dirtyY1;
+  y2 = m_dirtyY2;
+  return true;
+}
+
+void algorithm::Polygon::clearDirtyRows()
+{
+  m_dirtyY1 = std::numeric_limits<int>::max();
+  m_dirtyY2 = std::numeric_limits<int>::min();
+}
+
+void algorithm::Polygon::rasterize(void* data, AlgoHLine proc,
+                                   int y1, int y2)
+{
+  if (m_verts.empty())
+    return;
+
+  y1 = std::max(y1, m_ymin);
+  y2 = std::min(y2, m_ymax);
+  if (y1 > y2)
+    return;
+
+  // Border pixels of all edges (the closing edge is added here)
+  m_allPts = m_pts;
+  algo_line_continuous(m_verts.back().x,
+                       m_verts.back().y,
+                       m_verts.front().x,
+                       m_verts.front().y,
+                       (void*)&m_allPts,
+                       (AlgoPixel)&addPointsWithoutDuplicatingLastOne);
+  // Consideration when we want to draw a simple pixel with contour tool
+  // dragging the cursor inside of a pixel (in this case pts contains
+  // just one element, which want to preserve).
+  if (m_allPts.size() > 1)
+    // We remove the last point which is a duplicate point of
+    // the "pts" first element.
+    m_allPts.pop_back();
+
+  const std::vector<gfx::Point>& pts = m_allPts;
+  const int npts = int(pts.size());
+  const int ymax = m_ymax;
+
+  // Edge table: intersections of each edge with the scanlines that
+  // it crosses, sorted by row (and by x in each row)
+  m_ints.clear();
+  for (int i=0; i<npts; ++i) {
+    const int ind1 = (i == 0 ? npts-1: i-1);
+    const int ind2 = i;
+    int ey1 = pts[ind1].y;
+    int ey2 = pts[ind2].y;
+    int ex1, ex2;
+    if (ey1 < ey2) {
+      ex1 = pts[ind1].x;
+      ex2 = pts[ind2].x;
     }
-    else {
-      algo_line_continuous(verts[c].x,
-                           verts[c].y,
-                           verts[c+1].x,
-                           verts[c+1].y,
-                           (void*)&pts,
-                           (AlgoPixel)&addPointsWithoutDuplicatingLastOne);
+    else if (ey1 > ey2) {
+      std::swap(ey1, ey2);
+      ex1 = pts[ind2].x;
+      ex2 = pts[ind1].x;
     }
+    else
+      continue;
+
+    auto addInt = [&](const int y) {
+      m_ints.emplace_back(
+        y, (int) ((float)((y - ey1)*(ex2 - ex1)) / (float)(ey2 - ey1) + 0.5f + (float)ex1));
+    };
+
+    // The edge crosses the rows [ey1, ey2), and the last row (ymax)
+    // includes the edges that end there
+    for (int y=std::max(ey1, y1); y<ey2 && y<=y2; ++y)
+      addInt(y);
+    if (ey2 == ymax && ymax <= y2)
+      addInt(ymax);
   }
+  std::sort(m_ints.begin(), m_ints.end());
+
+  // Border pixels of each row (in the same order of the border)
+  m_rowPts.clear();
+  for (int i=0; i<npts; ++i) {
+    if (pts[i].y >= y1 && pts[i].y <= y2)
+      m_rowPts.emplace_back(pts[i].y, i);
+  }
+  std::sort(m_rowPts.begin(), m_rowPts.end());
 
   // Scan Line Loop:
-  int y;
-  int x1, y1;
-  int x2, y2;
-  int ind1, ind2;
-  int ints;
-  std::vector<int> polyInts(pts.size());
-  for (y = ymin; y <= ymax; y++) {
-    ints = 0;
-    for (int i=0; i < pts.size(); i++) {
-      if (!i) {
-        ind1 = pts.size() - 1;
-        ind2 = 0;
-      }
-      else {
-        ind1 = i - 1;
-        ind2 = i;
-      }
-      y1 = pts[ind1].y;
-      y2 = pts[ind2].y;
-      if (y1 < y2) {
-        x1 = pts[ind1].x;
-        x2 = pts[ind2].x;
-      }
-      else if (y1 > y2) {
-        y2 = pts[ind1].y;
-        y1 = pts[ind2].y;
-        x2 = pts[ind1].x;
-        x1 = pts[ind2].x;
-      }
-      else
-        continue;
+  m_polyInts.assign(npts, 0);
 
-      if ((y >= y1 && y < y2) ||
-          (y == ymax && y > y1 && y <= y2)) {
-        polyInts[ints] = (int) ((float)((y - y1)*(x2 - x1)) / (float)(y2 - y1) + 0.5f + (float)x1);
-        ints++;
-      }
+  auto intsIt = m_ints.begin();
+  auto ptsIt = m_rowPts.begin();
+  while (intsIt != m_ints.end() || ptsIt != m_rowPts.end()) {
+    const int y = std::min(intsIt != m_ints.end() ? intsIt->first: y2+1,
+                           ptsIt != m_rowPts.end() ? ptsIt->first: y2+1);
+    int ints = 0;
+    for (; intsIt != m_ints.end() && intsIt->first == y; ++intsIt) {
+      if (ints == int(m_polyInts.size()))
+        m_polyInts.push_back(intsIt->second);
+      else
+        m_polyInts[ints] = intsIt->second;
+      ++ints;
     }
 
-    std::sort(polyInts.begin(), polyInts.begin() + ints);
-
-    for (int i=0; i < pts.size(); i++) {
-      if (pts[i].y == y)
-        createUnion(polyInts, pts[i].x, ints);
-    }
+    for (; ptsIt != m_rowPts.end() && ptsIt->first == y; ++ptsIt)
+      createUnion(m_polyInts, pts[ptsIt->second].x, ints);
 
     for (int i=0; i < ints; i+=2)
-      proc(polyInts[i], y, polyInts[i+1], data);
+      proc(m_polyInts[i], y, m_polyInts[i+1], data);
   }
 }
 
+void algorithm::polygon(int vertices, const int* points, void* data, AlgoHLine proc)
+{
+  if (!vertices)
+    return;
+
+  Polygon poly;
+  poly.setVertices(vertices, points);
+  poly.rasterize(data, proc);
+}
+
 } // namespace doc
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2014 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,12 +11,66 @@
 
 #include "doc/algorithm/hline.h"
 #include "gfx/fwd.h"
+#include "gfx/point.h"
 
+#include <limits>
+#include <utility>
 #include <vector>
 
 namespace doc {
   namespace algorithm {
 
+    // Rasterizes a polygon with an edge table: the intersections of
+    // the edges with each scanline are generated once and sorted by
+    // row (instead of checking all edges in each scanline). The
+    // buffers are reused, so the same Polygon can be filled several
+    // times (e.g. in each mouse movement of the contour tool).
+    class Polygon {
+    public:
+      Polygon();
+
+      void clear();
+      bool empty() const { return m_verts.empty(); }
+
+      // Sets the vertices of the polygon (x,y pairs). If the current
+      // vertices are the first ones of the given array, only the new
+      // ones are added (see addVertex()).
+      void setVertices(int vertices, const int* points);
+
+      // Appends a vertex, the border pixels of the new edges are
+      // added to the current ones, and only the rows affected by the
+      // new vertex (the rows of the last/new/first vertices, which
+      // replace the old closing edge) are marked as dirty.
+      void addVertex(const gfx::Point& pt);
+
+      // Bounds of the vertices.
+      gfx::Rect bounds() const;
+
+      // Returns the range of rows [y1, y2] that could be filled in a
+      // different way since the last clearDirtyRows() call.
+      bool dirtyRows(int& y1, int& y2) const;
+      void clearDirtyRows();
+
+      // Calls "proc" for each horizontal segment of the polygon in
+      // the rows [y1, y2].
+      void rasterize(void* data, AlgoHLine proc,
+                     int y1 = std::numeric_limits<int>::min(),
+                     int y2 = std::numeric_limits<int>::max());
+
+    private:
+      std::vector<int> m_input;             // Points given to setVertices()
+      std::vector<gfx::Point> m_verts;      // Vertices without consecutive duplicates
+      std::vector<gfx::Point> m_pts;        // Border pixels of the open edges
+      int m_xmin, m_ymin, m_xmax, m_ymax;
+      int m_dirtyY1, m_dirtyY2;
+
+      // Buffers used in rasterize()
+      std::vector<gfx::Point> m_allPts;     // Border pixels including the closing edge
+      std::vector<std::pair<int, int>> m_ints; // (y, x) intersections with scanlines
+      std::vector<std::pair<int, int>> m_rowPts; // (y, index) of the border pixels
+      std::vector<int> m_polyInts;
+    };
+
     void polygon(int vertices, const int* points, void* data, AlgoHLine proc);
     bool createUnion(std::vector<int>& pairs, const int x, int& ints);
   }
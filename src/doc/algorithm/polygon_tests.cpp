@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -8,6 +8,8 @@
 
 #include "doc/algorithm/polygon.h"
 
+#include <cstdlib>
+
 struct scanSegment {
   int x1;
   int x2;
@@ -822,6 +824,67 @@ TEST(createUnion, testC10)
   EXPECT_EQ(ints, 2);
 }
 
+static bool operator==(const scanSegment& a, const scanSegment& b)
+{
+  return (a.x1 == b.x1 && a.x2 == b.x2 && a.y == b.y);
+}
+
+static std::vector<scanSegment> rows_of(const std::vector<scanSegment>& segs,
+                                        const int y1, const int y2,
+                                        const bool inside)
+{
+  std::vector<scanSegment> result;
+  for (const auto& s : segs)
+    if ((s.y >= y1 && s.y <= y2) == inside)
+      result.push_back(s);
+  return result;
+}
+
+TEST(Polygon, AppendVertices)
+{
+  std::vector<int> points;
+  doc::algorithm::Polygon poly;
+  ScanLineResult prev;
+
+  for (int i=0; i<60; ++i) {
+    int x, y;
+    do {
+      x = std::rand() % 41 - 20;
+      y = std::rand() % 41 - 20;
+    } while (!points.empty() &&
+             x == points[points.size()-2] &&
+             y == points[points.size()-1]);
+    points.push_back(x);
+    points.push_back(y);
+    const int n = int(points.size()/2);
+
+    ScanLineResult expected;
+    doc::algorithm::polygon(n, points.data(), &expected, captureHscanSegment);
+
+    poly.setVertices(n, points.data());
+    int y1, y2;
+    ASSERT_TRUE(poly.dirtyRows(y1, y2));
+    EXPECT_GE(y1, poly.bounds().y);
+    EXPECT_LE(y2, poly.bounds().y2()-1);
+
+    ScanLineResult results;
+    poly.rasterize(&results, captureHscanSegment);
+    EXPECT_TRUE(expected.scanLines == results.scanLines);
+
+    // Only the rows in the dirty range are different
+    EXPECT_TRUE(rows_of(prev.scanLines, y1, y2, false) ==
+                rows_of(results.scanLines, y1, y2, false));
+
+    // Rasterize only the dirty rows
+    ScanLineResult dirty;
+    poly.rasterize(&dirty, captureHscanSegment, y1, y2);
+    EXPECT_TRUE(rows_of(expected.scanLines, y1, y2, true) ==
+                dirty.scanLines);
+
+    poly.clearDirtyRows();
+    prev = results;
+  }
+}
 
 int main(int argc, char** argv)
 {
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,36 +12,213 @@
 #include "doc/algorithm/resize_image.h"
 
 #include "doc/algorithm/rotsprite.h"
+#include "doc/algorithm/row_bands.h"
 #include "doc/image_impl.h"
 #include "doc/palette.h"
 #include "doc/primitives_fast.h"
 #include "doc/rgbmap.h"
 #include "gfx/point.h"
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
+
+// SSE2 is always available on x64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_RESIZE_SSE2 1
+  #include <emmintrin.h>
+#endif
 
 namespace doc {
 namespace algorithm {
 
+namespace {
+
+// Source pixels and weight (from 0 to 128) of the second one to
+// calculate each destination pixel with bilinear interpolation.
+struct BilinearCoord {
+  int i0, i1;
+  int w;
+};
+
+std::vector<BilinearCoord> bilinear_coords(const int src_size,
+                                           const int dst_size)
+{
+  const double d = (dst_size > 1 ? (src_size-1) * 1.0 / (dst_size-1): 0.0);
+
+  std::vector<BilinearCoord> coords(dst_size);
+  for (int i=0; i<dst_size; ++i) {
+    const double u = i * d;
+    BilinearCoord& c = coords[i];
+    c.i0 = (int)std::floor(u);
+    if (c.i0 >= src_size-1)
+      c.i0 = c.i1 = src_size-1;
+    else
+      c.i1 = c.i0+1;
+    c.w = std::clamp(int((u - c.i0) * 128.0 + 0.5), 0, 128);
+  }
+  return coords;
+}
+
+// Interpolates four colors (c0, c1 in the top row, c2, c3 in the
+// bottom row) with the weights of c1/c3 (wx) and c2/c3 (wy) from 0
+// to 128.
+template<typename ImageTraits>
+color_t bilinear(color_t c0, color_t c1, color_t c2, color_t c3, int wx, int wy);
+
+template<>
+inline color_t bilinear<RgbTraits>(const color_t c0, const color_t c1,
+                                   const color_t c2, const color_t c3,
+                                   const int wx, const int wy)
+{
+#if DOC_RESIZE_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  auto unpack = [zero](color_t a, color_t b){
+    return _mm_unpacklo_epi16(
+      _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(a)), zero),
+      _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(b)), zero));
+  };
+  // Horizontal interpolation of each row (r0 r1 g0 g1 b0 b1 a0 a1 *
+  // weights) and then the vertical one (top bottom * weights)
+  const __m128i wxv = _mm_set1_epi32((wx << 16) | (128-wx));
+  const __m128i wyv = _mm_set1_epi32((wy << 16) | (128-wy));
+  const __m128i top = _mm_madd_epi16(unpack(c0, c1), wxv);
+  const __m128i bottom = _mm_madd_epi16(unpack(c2, c3), wxv);
+  __m128i v = _mm_madd_epi16(
+    _mm_unpacklo_epi16(_mm_packs_epi32(top, top),
+                       _mm_packs_epi32(bottom, bottom)), wyv);
+  v = _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(1 << 13)), 14);
+  v = _mm_packs_epi32(v, v);
+  v = _mm_packus_epi16(v, v);
+  return color_t(_mm_cvtsi128_si32(v));
+#else
+  auto channel = [wx, wy](int a, int b, int c, int d) {
+    return (((a*(128-wx) + b*wx) * (128-wy) +
+             (c*(128-wx) + d*wx) * wy) + (1 << 13)) >> 14;
+  };
+  return rgba(channel(rgba_getr(c0), rgba_getr(c1), rgba_getr(c2), rgba_getr(c3)),
+              channel(rgba_getg(c0), rgba_getg(c1), rgba_getg(c2), rgba_getg(c3)),
+              channel(rgba_getb(c0), rgba_getb(c1), rgba_getb(c2), rgba_getb(c3)),
+              channel(rgba_geta(c0), rgba_geta(c1), rgba_geta(c2), rgba_geta(c3)));
+#endif
+}
+
+template<>
+inline color_t bilinear<GrayscaleTraits>(const color_t c0, const color_t c1,
+                                         const color_t c2, const color_t c3,
+                                         const int wx, const int wy)
+{
+  auto channel = [wx, wy](int a, int b, int c, int d) {
+    return (((a*(128-wx) + b*wx) * (128-wy) +
+             (c*(128-wx) + d*wx) * wy) + (1 << 13)) >> 14;
+  };
+  return graya(channel(graya_getv(c0), graya_getv(c1), graya_getv(c2), graya_getv(c3)),
+               channel(graya_geta(c0), graya_geta(c1), graya_geta(c2), graya_geta(c3)));
+}
+
 template<typename ImageTraits>
 void resize_image_nearest(const Image* src, Image* dst)
+{
+  double x_ratio = double(src->width()) / double(dst->width());
+  double y_ratio = double(src->height()) / double(dst->height());
+
+  std::vector<int> xs(dst->width());
+  for (int x=0; x<dst->width(); ++x)
+    xs[x] = int(std::floor(x * x_ratio));
+
+  for_each_row_band(
+    dst->width(), dst->height(),
+    [&](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const int py = int(std::floor(y * y_ratio));
+        auto srcRow = (typename ImageTraits::const_address_t)src->getPixelAddress(0, py);
+        auto dstRow = (typename ImageTraits::address_t)dst->getPixelAddress(0, y);
+        for (int x=0; x<dst->width(); ++x)
+          dstRow[x] = srcRow[xs[x]];
+      }
+    });
+}
+
+template<>
+void resize_image_nearest<BitmapTraits>(const Image* src, Image* dst)
 {
   double x_ratio = double(src->width()) / double(dst->width());
   double y_ratio = double(src->height()) / double(dst->height());
   double px, py;
 
-  LockImageBits<ImageTraits> dstBits(dst);
+  LockImageBits<BitmapTraits> dstBits(dst);
   auto dstIt = dstBits.begin();
 
   for (int y=0; y<dst->height(); ++y) {
     py = std::floor(y * y_ratio);
     for (int x=0; x<dst->width(); ++x, ++dstIt) {
       px = std::floor(x * x_ratio);
-      *dstIt = get_pixel_fast<ImageTraits>(src, int(px), int(py));
+      *dstIt = get_pixel_fast<BitmapTraits>(src, int(px), int(py));
+    }
+  }
+}
+
+template<typename ImageTraits>
+void resize_image_bilinear(const Image* src, Image* dst)
+{
+  const std::vector<BilinearCoord> xs = bilinear_coords(src->width(), dst->width());
+  const std::vector<BilinearCoord> ys = bilinear_coords(src->height(), dst->height());
+
+  for_each_row_band(
+    dst->width(), dst->height(),
+    [&](const int y1, const int y2){
+      for (int y=y1; y<y2; ++y) {
+        const BilinearCoord& cy = ys[y];
+        auto row0 = (typename ImageTraits::const_address_t)src->getPixelAddress(0, cy.i0);
+        auto row1 = (typename ImageTraits::const_address_t)src->getPixelAddress(0, cy.i1);
+        auto dstRow = (typename ImageTraits::address_t)dst->getPixelAddress(0, y);
+        for (int x=0; x<dst->width(); ++x) {
+          const BilinearCoord& cx = xs[x];
+          dstRow[x] = bilinear<ImageTraits>(row0[cx.i0], row0[cx.i1],
+                                            row1[cx.i0], row1[cx.i1],
+                                            cx.w, cy.w);
+        }
+      }
+    });
+}
+
+// The RgbMap cannot be used from several threads, so indexed images
+// are resized in just one thread.
+void resize_indexed_image_bilinear(const Image* src, Image* dst,
+                                   const Palette* pal,
+                                   const RgbMap* rgbmap,
+                                   const color_t maskColor)
+{
+  const std::vector<BilinearCoord> xs = bilinear_coords(src->width(), dst->width());
+  const std::vector<BilinearCoord> ys = bilinear_coords(src->height(), dst->height());
+
+  // Convert index to RGBA values
+  auto entry = [pal, maskColor](color_t i) -> color_t {
+    if (i == maskColor)
+      return pal->getEntry(i) & rgba_rgb_mask; // Set alpha = 0
+    else
+      return pal->getEntry(i);
+  };
+
+  for (int y=0; y<dst->height(); ++y) {
+    const BilinearCoord& cy = ys[y];
+    auto row0 = (IndexedTraits::const_address_t)src->getPixelAddress(0, cy.i0);
+    auto row1 = (IndexedTraits::const_address_t)src->getPixelAddress(0, cy.i1);
+    auto dstRow = (IndexedTraits::address_t)dst->getPixelAddress(0, y);
+    for (int x=0; x<dst->width(); ++x) {
+      const BilinearCoord& cx = xs[x];
+      const color_t c = bilinear<RgbTraits>(entry(row0[cx.i0]), entry(row0[cx.i1]),
+                                             entry(row1[cx.i0]), entry(row1[cx.i1]),
+                                             cx.w, cy.w);
+      dstRow[x] = rgbmap->mapColor(rgba_getr(c), rgba_getg(c),
+                                   rgba_getb(c), rgba_geta(c));
     }
   }
 }
 
+} // anonymous namespace
+
 void resize_image(const Image* src,
                   Image* dst,
                   const ResizeMethod method,
@@ -51,7 +228,6 @@ void resize_image(const Image* src,
 {
   switch (method) {
 
-    // TODO optimize this
     case RESIZE_METHOD_NEAREST_NEIGHBOR: {
       ASSERT(src->pixelFormat() == dst->pixelFormat());
 
@@ -64,14 +240,7 @@ void resize_image(const Image* src,
       break;
     }
 
-    // TODO optimize this
     case RESIZE_METHOD_BILINEAR: {
-      uint32_t color[4], dst_color = 0;
-      double u, v, du, dv;
-      int u_floor, u_floor2;
-      int v_floor, v_floor2;
-      int x, y;
-
       // We cannot do interpolations between RGB values on indexed
       // images without a palette/rgbmap.
       if (dst->pixelFormat() == IMAGE_INDEXED &&
@@ -83,92 +252,19 @@ void resize_image(const Image* src,
         return;
       }
 
-      u = v = 0.0;
-      du = (src->width()-1) * 1.0 / (dst->width()-1);
-      dv = (src->height()-1) * 1.0 / (dst->height()-1);
-      for (y=0; y<dst->height(); ++y) {
-        for (x=0; x<dst->width(); ++x) {
-          u_floor = (int)std::floor(u);
-          v_floor = (int)std::floor(v);
-
-          if (u_floor > src->width()-1) {
-            u_floor = src->width()-1;
-            u_floor2 = src->width()-1;
-          }
-          else if (u_floor == src->width()-1)
-            u_floor2 = u_floor;
-          else
-            u_floor2 = u_floor+1;
-
-          if (v_floor > src->height()-1) {
-            v_floor = src->height()-1;
-            v_floor2 = src->height()-1;
-          }
-          else if (v_floor == src->height()-1)
-            v_floor2 = v_floor;
-          else
-            v_floor2 = v_floor+1;
-
-          // get the four colors
-          color[0] = src->getPixel(u_floor,  v_floor);
-          color[1] = src->getPixel(u_floor2, v_floor);
-          color[2] = src->getPixel(u_floor,  v_floor2);
-          color[3] = src->getPixel(u_floor2, v_floor2);
-
-          // calculate the interpolated color
-          double u1 = u - u_floor;
-          double v1 = v - v_floor;
-          double u2 = 1 - u1;
-          double v2 = 1 - v1;
-
-          switch (dst->pixelFormat()) {
-            case IMAGE_RGB: {
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgba(r, g, b, a);
-              break;
-            }
-            case IMAGE_GRAYSCALE: {
-              int v = int((graya_getv(color[0])*u2 + graya_getv(color[1])*u1)*v2 +
-                          (graya_getv(color[2])*u2 + graya_getv(color[3])*u1)*v1);
-              int a = int((graya_geta(color[0])*u2 + graya_geta(color[1])*u1)*v2 +
-                          (graya_geta(color[2])*u2 + graya_geta(color[3])*u1)*v1);
-              dst_color = graya(v, a);
-              break;
-            }
-            case IMAGE_INDEXED: {
-              // Convert index to RGBA values
-              for (int i=0; i<4; ++i) {
-                if (color[i] == maskColor)
-                  color[i] = pal->getEntry(color[i]) & rgba_rgb_mask; // Set alpha = 0
-                else
-                  color[i] = pal->getEntry(color[i]);
-              }
-
-              int r = int((rgba_getr(color[0])*u2 + rgba_getr(color[1])*u1)*v2 +
-                          (rgba_getr(color[2])*u2 + rgba_getr(color[3])*u1)*v1);
-              int g = int((rgba_getg(color[0])*u2 + rgba_getg(color[1])*u1)*v2 +
-                          (rgba_getg(color[2])*u2 + rgba_getg(color[3])*u1)*v1);
-              int b = int((rgba_getb(color[0])*u2 + rgba_getb(color[1])*u1)*v2 +
-                          (rgba_getb(color[2])*u2 + rgba_getb(color[3])*u1)*v1);
-              int a = int((rgba_geta(color[0])*u2 + rgba_geta(color[1])*u1)*v2 +
-                          (rgba_geta(color[2])*u2 + rgba_geta(color[3])*u1)*v1);
-              dst_color = rgbmap->mapColor(r, g, b, a);
-              break;
-            }
-          }
-
-          dst->putPixel(x, y, dst_color);
-          u += du;
-        }
-        u = 0.0;
-        v += dv;
+      switch (dst->pixelFormat()) {
+        case IMAGE_RGB:
+          resize_image_bilinear<RgbTraits>(src, dst);
+          break;
+        case IMAGE_GRAYSCALE:
+          resize_image_bilinear<GrayscaleTraits>(src, dst);
+          break;
+        case IMAGE_INDEXED:
+          resize_indexed_image_bilinear(src, dst, pal, rgbmap, maskColor);
+          break;
+        case IMAGE_BITMAP:
+          resize_image_nearest<BitmapTraits>(src, dst);
+          break;
       }
       break;
     }
@@ -12,6 +12,7 @@
 #endif
 
 #include "base/pi.h"
+#include "doc/algorithm/row_bands.h"
 #include "doc/blend_funcs.h"
 #include "doc/image_impl.h"
 #include "doc/mask.h"
@@ -19,7 +20,9 @@
 #include "doc/primitives_fast.h"
 #include "fixmath/fixmath.h"
 
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 
 namespace doc {
 namespace algorithm {
@@ -28,7 +31,8 @@ using namespace fixmath;
 
 static void ase_parallelogram_map_standard(
   Image* bmp, const Image* sprite, const Image* mask,
-  fixed xs[4], fixed ys[4]);
+  fixed xs[4], fixed ys[4],
+  int clip_top, int clip_bottom);
 
 static void ase_rotate_scale_flip_coordinates(
   fixed w, fixed h,
@@ -163,7 +167,8 @@ void rotate_image(Image* dst, const Image* src, int x, int y, int w, int h,
                                     fixdiv(itofix(h), itofix(src->height())),
                                     false, false, xs, ys);
 
-  ase_parallelogram_map_standard(dst, src, nullptr, xs, ys);
+  ase_parallelogram_map_standard(dst, src, nullptr, xs, ys,
+                                 0, dst->height());
 }
 
 /*    1-----2
@@ -185,7 +190,29 @@ void parallelogram(Image* bmp, const Image* sprite, const Image* mask,
   xs[3] = itofix(x4);
   ys[3] = itofix(y4);
 
-  ase_parallelogram_map_standard(bmp, sprite, mask, xs, ys);
+  ase_parallelogram_map_standard(bmp, sprite, mask, xs, ys,
+                                 0, bmp->height());
+}
+
+void parallelogram_rows(Image* bmp, const Image* sprite, const Image* mask,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4,
+  int bmp_y1, int bmp_y2)
+{
+  fixed xs[4], ys[4];
+
+  xs[0] = itofix(x1);
+  ys[0] = itofix(y1);
+  xs[1] = itofix(x2);
+  ys[1] = itofix(y2);
+  xs[2] = itofix(x3);
+  ys[2] = itofix(y3);
+  xs[3] = itofix(x4);
+  ys[3] = itofix(y4);
+
+  ase_parallelogram_map_standard(bmp, sprite, mask, xs, ys,
+                                 std::max(bmp_y1, 0),
+                                 std::min(bmp_y2, bmp->height()));
 }
 
 // Scanline drawers.
@@ -337,12 +364,14 @@ public:
  *  and last point in which the horizontal line passing through the centre is
  *  at least partly covered by the sprite. This is useful for doing
  *  anti-aliased blending.
+ *  Only the scanlines from clip_top to clip_bottom-1 are drawn.
  */
 template<class Traits, class Delegate>
 static void ase_parallelogram_map(
   Image* bmp, const Image* spr, const Image* mask,
   fixed xs[4], fixed ys[4],
-  int sub_pixel_accuracy, Delegate delegate)
+  int sub_pixel_accuracy, Delegate delegate,
+  int clip_top, int clip_bottom)
 {
   /* Index in xs[] and ys[] to topmost point. */
   int top_index;
@@ -465,8 +494,8 @@ static void ase_parallelogram_map(
   else
     clip_bottom_i = (bottom_bmp_y + 0x8000) >> 16;
 
-  if (clip_bottom_i > bmp->height())
-    clip_bottom_i = bmp->height();
+  if (clip_bottom_i > clip_bottom)
+    clip_bottom_i = clip_bottom;
 
   /* Calculate y coordinate of first scanline. */
   if (sub_pixel_accuracy)
@@ -474,8 +503,8 @@ static void ase_parallelogram_map(
   else
     bmp_y_i = (top_bmp_y + 0x8000) >> 16;
 
-  if (bmp_y_i < 0)
-    bmp_y_i = 0;
+  if (bmp_y_i < clip_top)
+    bmp_y_i = clip_top;
 
   /* Sprite is above or below bottom clipping area. */
   if (bmp_y_i >= clip_bottom_i)
@@ -746,36 +775,213 @@ static void ase_parallelogram_map(
  */
 static void ase_parallelogram_map_standard(
   Image* bmp, const Image* sprite, const Image* mask,
-  fixed xs[4], fixed ys[4])
+  fixed xs[4], fixed ys[4],
+  int clip_top, int clip_bottom)
 {
   switch (bmp->pixelFormat()) {
 
     case IMAGE_RGB: {
       RgbDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<RgbTraits, RgbDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<RgbTraits, RgbDelegate>(bmp, sprite, mask, xs, ys, false, delegate, clip_top, clip_bottom);
       break;
     }
 
     case IMAGE_GRAYSCALE: {
       GrayscaleDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<GrayscaleTraits, GrayscaleDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<GrayscaleTraits, GrayscaleDelegate>(bmp, sprite, mask, xs, ys, false, delegate, clip_top, clip_bottom);
       break;
     }
 
     case IMAGE_INDEXED: {
       IndexedDelegate delegate(sprite->maskColor());
-      ase_parallelogram_map<IndexedTraits, IndexedDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<IndexedTraits, IndexedDelegate>(bmp, sprite, mask, xs, ys, false, delegate, clip_top, clip_bottom);
       break;
     }
 
     case IMAGE_BITMAP: {
       BitmapDelegate delegate;
-      ase_parallelogram_map<BitmapTraits, BitmapDelegate>(bmp, sprite, mask, xs, ys, false, delegate);
+      ase_parallelogram_map<BitmapTraits, BitmapDelegate>(bmp, sprite, mask, xs, ys, false, delegate, clip_top, clip_bottom);
       break;
     }
   }
 }
 
+// Pixel writers for parallelogram_fast(), they use the same rules
+// as the scanline delegates.
+
+class RgbFastWriter {
+public:
+  RgbFastWriter(color_t mask_color) : m_mask_color(mask_color) { }
+  void operator()(uint32_t& dst, const uint32_t c) const {
+    if ((rgba_geta(m_mask_color) == 0) || ((c & rgba_rgb_mask) != (m_mask_color & rgba_rgb_mask)))
+      dst = rgba_blender_normal(dst, c);
+  }
+private:
+  color_t m_mask_color;
+};
+
+class GrayscaleFastWriter {
+public:
+  GrayscaleFastWriter(color_t mask_color) : m_mask_color(mask_color) { }
+  void operator()(uint16_t& dst, const uint16_t c) const {
+    if ((graya_geta(m_mask_color) == 0) || ((c & graya_v_mask) != (m_mask_color & graya_v_mask)))
+      dst = graya_blender_normal(dst, c, 255);
+  }
+private:
+  color_t m_mask_color;
+};
+
+class IndexedFastWriter {
+public:
+  IndexedFastWriter(color_t mask_color) : m_mask_color(mask_color) { }
+  void operator()(uint8_t& dst, const uint8_t c) const {
+    if (c != m_mask_color)
+      dst = c;
+  }
+private:
+  color_t m_mask_color;
+};
+
+static int64_t floor_div(int64_t a, int64_t b)
+{
+  int64_t q = a / b;
+  if ((a % b != 0) && ((a < 0) != (b < 0)))
+    --q;
+  return q;
+}
+
+static int64_t ceil_div(int64_t a, int64_t b)
+{
+  return -floor_div(-a, b);
+}
+
+// Limits the [x1, x2] range to the values of x where
+// 0 <= a + x*d < limit.
+static void clip_fixed_range(int64_t a, int64_t d, int64_t limit,
+                             int64_t& x1, int64_t& x2)
+{
+  if (d > 0) {
+    x1 = std::max(x1, ceil_div(-a, d));
+    x2 = std::min(x2, floor_div(limit-1-a, d));
+  }
+  else if (d < 0) {
+    x1 = std::max(x1, ceil_div(limit-1-a, d));
+    x2 = std::min(x2, floor_div(-a, d));
+  }
+  else if (a < 0 || a >= limit) {
+    x2 = x1-1;
+  }
+}
+
+// Maps each pixel center of the dst rows with the inverse affine
+// transformation of the parallelogram to the src pixel that contains
+// it. The src coordinates are in 16.16 fixed point, and the range of
+// each row is calculated before the loop, so there is no bounds
+// checking per pixel.
+template<class Traits, class Writer>
+static void ase_parallelogram_map_fast(
+  Image* bmp, const Image* spr, const Image* mask,
+  const double xs[4], const double ys[4],
+  const gfx::Rect& clip,
+  const Writer writer)
+{
+  typedef typename Traits::pixel_t pixel_t;
+
+  // Vectors of one src pixel in the x- and y-axis
+  const double ax = (xs[1]-xs[0]) / spr->width();
+  const double ay = (ys[1]-ys[0]) / spr->width();
+  const double bx = (xs[3]-xs[0]) / spr->height();
+  const double by = (ys[3]-ys[0]) / spr->height();
+  const double det = ax*by - bx*ay;
+  if (std::fabs(det) < 1e-9)
+    return;
+
+  // Change of src coordinates for each dst pixel in the x-axis
+  const int64_t du = std::llround(65536.0 * by / det);
+  const int64_t dv = std::llround(65536.0 * -ay / det);
+
+  // Pixels outside the mask are never drawn
+  int64_t sprW = spr->width();
+  int64_t sprH = spr->height();
+  if (mask) {
+    sprW = std::min<int64_t>(sprW, mask->width());
+    sprH = std::min<int64_t>(sprH, mask->height());
+  }
+
+  for_each_row_band(clip.w, clip.h, [&](const int y1, const int y2){
+    for (int y=clip.y+y1; y<clip.y+y2; ++y) {
+      // Src coordinates of the center of the (0, y) pixel
+      const double dx = 0.5 - xs[0];
+      const double dy = y + 0.5 - ys[0];
+      const int64_t u0 = std::llround(65536.0 * (by*dx - bx*dy) / det);
+      const int64_t v0 = std::llround(65536.0 * (ax*dy - ay*dx) / det);
+
+      int64_t x1 = clip.x;
+      int64_t x2 = clip.x2()-1;
+      clip_fixed_range(u0, du, sprW << 16, x1, x2);
+      clip_fixed_range(v0, dv, sprH << 16, x1, x2);
+      if (x1 > x2)
+        continue;
+
+      int64_t u = u0 + x1*du;
+      int64_t v = v0 + x1*dv;
+      pixel_t* dst = (pixel_t*)get_pixel_address_fast<Traits>(bmp, int(x1), y);
+      const pixel_t* dstEnd = dst + (x2-x1+1);
+
+      if (mask) {
+        for (; dst<dstEnd; ++dst, u+=du, v+=dv) {
+          const int su = int(u >> 16);
+          const int sv = int(v >> 16);
+          if (get_pixel_fast<BitmapTraits>(mask, su, sv))
+            writer(*dst, pixel_t(*get_pixel_address_fast<Traits>(spr, su, sv)));
+        }
+      }
+      else {
+        for (; dst<dstEnd; ++dst, u+=du, v+=dv) {
+          writer(*dst, pixel_t(*get_pixel_address_fast<Traits>(spr, int(u >> 16), int(v >> 16))));
+        }
+      }
+    }
+  });
+}
+
+void parallelogram_fast(Image* bmp, const Image* sprite, const Image* mask,
+  int x1, int y1, int x2, int y2,
+  int x3, int y3, int x4, int y4,
+  const gfx::Rect& clip)
+{
+  const gfx::Rect bounds = (clip & bmp->bounds());
+  if (bounds.isEmpty() || sprite->width() < 1 || sprite->height() < 1)
+    return;
+
+  const double xs[4] = { double(x1), double(x2), double(x3), double(x4) };
+  const double ys[4] = { double(y1), double(y2), double(y3), double(y4) };
+
+  switch (bmp->pixelFormat()) {
+
+    case IMAGE_RGB:
+      ase_parallelogram_map_fast<RgbTraits>(
+        bmp, sprite, mask, xs, ys, bounds, RgbFastWriter(sprite->maskColor()));
+      break;
+
+    case IMAGE_GRAYSCALE:
+      ase_parallelogram_map_fast<GrayscaleTraits>(
+        bmp, sprite, mask, xs, ys, bounds, GrayscaleFastWriter(sprite->maskColor()));
+      break;
+
+    case IMAGE_INDEXED:
+      ase_parallelogram_map_fast<IndexedTraits>(
+        bmp, sprite, mask, xs, ys, bounds, IndexedFastWriter(sprite->maskColor()));
+      break;
+
+    default:
+      parallelogram_rows(bmp, sprite, mask,
+                         x1, y1, x2, y2, x3, y3, x4, y4,
+                         bounds.y, bounds.y2());
+      break;
+  }
+}
+
 /* _rotate_scale_flip_coordinates:
  *  Calculates the coordinates for the rotated, scaled and flipped sprite,
  *  and passes them on to the given function.
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -8,6 +9,8 @@
 #define DOC_ALGORITHM_ROTATE_H_INCLUDED
 #pragma once
 
+#include "gfx/fwd.h"
+
 namespace doc {
   class Image;
 
@@ -25,6 +28,26 @@ namespace doc {
       int x1, int y1, int x2, int y2,
       int x3, int y3, int x4, int y4);
 
+    // Like parallelogram() but draws only the dst rows from dst_y1 to
+    // dst_y2-1. Each range of rows is calculated independently, so
+    // different ranges can be drawn from several threads at the same
+    // time.
+    void parallelogram_rows(Image* dst, const Image* src, const Image* mask,
+      int x1, int y1, int x2, int y2,
+      int x3, int y3, int x4, int y4,
+      int dst_y1, int dst_y2);
+
+    // Like parallelogram() but it maps each dst pixel with a fixed
+    // point affine transformation (nearest neighbor). It's faster, but
+    // pixels in the edges of the parallelogram can be different, so
+    // it's used to preview a transformation (e.g. while the user drags
+    // the image). Only the pixels inside the "clip" rectangle of dst
+    // are drawn.
+    void parallelogram_fast(Image* dst, const Image* src, const Image* mask,
+      int x1, int y1, int x2, int y2,
+      int x3, int y3, int x4, int y4,
+      const gfx::Rect& clip);
+
   } // namespace algorithm
 } // namespace doc
 
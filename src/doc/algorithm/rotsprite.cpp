@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2022  Igara Studio S.A.
+// Copyright (c) 2020-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,12 +9,17 @@
 #include "config.h"
 #endif
 
+#include "doc/algorithm/rotsprite.h"
+
 #include "doc/algorithm/rotate.h"
+#include "doc/algorithm/row_bands.h"
 #include "doc/image_impl.h"
 #include "doc/primitives.h"
+#include "fixmath/fixmath.h"
 
 #include <algorithm>
 #include <memory>
+#include <vector>
 
 namespace doc {
 namespace algorithm {
@@ -24,7 +29,8 @@ namespace algorithm {
 // http://scale2x.sourceforge.net/algorithm.html
 // http://scale2x.sourceforge.net/scale2xandepx.html
 template<typename ImageTraits>
-static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h)
+static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h,
+                              int src_y1, int src_y2)
 {
 #if 0      // TODO complete this implementation that should be faster
            // than using a lot of get/put_pixel_fast calls.
@@ -124,12 +130,12 @@ static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h
 #define D c[3]
 #define P c[4]
 
-  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, 0, src_w*2, src_h*2));
+  LockImageBits<ImageTraits> dstBits(dst, gfx::Rect(0, src_y1*2, src_w*2, (src_y2-src_y1)*2));
   auto dstIt = dstBits.begin();
   auto dstIt2 = dstIt;
 
   color_t c[5];
-  for (int y=0; y<src_h; ++y) {
+  for (int y=src_y1; y<src_y2; ++y) {
     dstIt2 += src_w*2;
     for (int x=0; x<src_w; ++x) {
       P = get_pixel_fast<ImageTraits>(src, x, y);
@@ -156,24 +162,91 @@ static void image_scale2x_tpl(Image* dst, const Image* src, int src_w, int src_h
 
 static void image_scale2x(Image* dst, const Image* src, int src_w, int src_h)
 {
-  switch (src->pixelFormat()) {
-    case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h); break;
-    case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h); break;
+  for_each_row_band(
+    src_w, src_h,
+    [dst, src, src_w, src_h](int y1, int y2){
+      switch (src->pixelFormat()) {
+        case IMAGE_RGB:       image_scale2x_tpl<RgbTraits>(dst, src, src_w, src_h, y1, y2); break;
+        case IMAGE_GRAYSCALE: image_scale2x_tpl<GrayscaleTraits>(dst, src, src_w, src_h, y1, y2); break;
+        case IMAGE_INDEXED:   image_scale2x_tpl<IndexedTraits>(dst, src, src_w, src_h, y1, y2); break;
+        case IMAGE_BITMAP:    image_scale2x_tpl<BitmapTraits>(dst, src, src_w, src_h, y1, y2); break;
+      }
+    });
+}
+
+// Scales the image 8x applying Scale2x three times
+static Image* image_scale8x(const Image* src)
+{
+  const int w = src->width();
+  const int h = src->height();
+  std::unique_ptr<Image> a(Image::create(src->pixelFormat(), w*8, h*8));
+  std::unique_ptr<Image> b(Image::create(src->pixelFormat(), w*8, h*8));
+
+  image_scale2x(a.get(), src, w, h);
+  image_scale2x(b.get(), a.get(), w*2, h*2);
+  image_scale2x(a.get(), b.get(), w*4, h*4);
+  return a.release();
+}
+
+RotSpriteCache::RotSpriteCache()
+{
+}
+
+RotSpriteCache::~RotSpriteCache()
+{
+}
+
+Image* RotSpriteCache::getScaledImage(const Image* image, bool isMask)
+{
+  // Source image + mask for the pixels, and the mask itself for the
+  // selection (see PixelsMovement)
+  const size_t kMaxEntries = 3;
+
+  const ObjectId id = image->id();
+  const ObjectVersion version = image->version();
+  auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                         [id, isMask](const Entry& entry){
+                           return (entry.id == id && entry.isMask == isMask);
+                         });
+  if (it != m_entries.end()) {
+    if (it->version == version) {
+      std::rotate(m_entries.begin(), it, it+1);
+      return m_entries.front().image.get();
+    }
+    m_entries.erase(it);
+  }
+
+  Entry entry;
+  entry.id = id;
+  entry.version = version;
+  entry.isMask = isMask;
+  if (isMask) {
+    entry.image.reset(Image::create(IMAGE_BITMAP, image->width()*8, image->height()*8));
+    clear_image(entry.image.get(), 0);
+    scale_image(entry.image.get(), image,
+                0, 0, entry.image->width(), entry.image->height(),
+                0, 0, image->width(), image->height());
+  }
+  else {
+    entry.image.reset(image_scale8x(image));
   }
+
+  m_entries.insert(m_entries.begin(), std::move(entry));
+  if (m_entries.size() > kMaxEntries)
+    m_entries.pop_back();
+  return m_entries.front().image.get();
+}
+
+void RotSpriteCache::clear()
+{
+  m_entries.clear();
 }
 
 void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   int x1, int y1, int x2, int y2,
-  int x3, int y3, int x4, int y4)
+  int x3, int y3, int x4, int y4,
+  RotSpriteCache* cache)
 {
-  static ImageBufferPtr buf[3]; // TODO non-thread safe
-
-  for (int i=0; i<3; ++i)
-    if (!buf[i])
-      buf[i].reset(new ImageBuffer(1));
-
   int xmin = std::min(x1, std::min(x2, std::min(x3, x4)));
   int xmax = std::max(x1, std::max(x2, std::max(x3, x4)));
   int ymin = std::min(y1, std::min(y2, std::min(y3, y4)));
@@ -184,41 +257,48 @@ void rotsprite_image(Image* bmp, const Image* spr, const Image* mask,
   if (rot_width == 0 || rot_height == 0)
     return;
 
-  int scale = 8;
-  std::unique_ptr<Image> bmp_copy(Image::create(bmp->pixelFormat(), rot_width*scale, rot_height*scale, buf[0]));
-  std::unique_ptr<Image> tmp_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[1]));
-  std::unique_ptr<Image> spr_copy(Image::create(spr->pixelFormat(), spr->width()*scale, spr->height()*scale, buf[2]));
-  std::unique_ptr<Image> msk_copy;
+  RotSpriteCache tmpCache;
+  if (!cache)
+    cache = &tmpCache;
 
+  const int scale = 8;
   color_t maskColor = spr->maskColor();
-
-  bmp_copy->setMaskColor(maskColor);
-  tmp_copy->setMaskColor(maskColor);
+  Image* spr_copy = cache->getScaledImage(spr, false);
+  Image* msk_copy = (mask ? cache->getScaledImage(mask, true): nullptr);
   spr_copy->setMaskColor(maskColor);
 
-  spr_copy->clear(maskColor);
-  spr_copy->copy(spr, gfx::Clip(spr->bounds()));
-
-  for (int i=0; i<3; ++i) {
-    // clear_image(tmp_copy, maskColor);
-    image_scale2x(tmp_copy.get(), spr_copy.get(), spr->width()*(1<<i), spr->height()*(1<<i));
-    spr_copy->copy(tmp_copy.get(), gfx::Clip(tmp_copy->bounds()));
-  }
+  // The rotated image is scaled down with nearest-neighbor from 8x,
+  // so we only need one row of each 8x rows (the same rows that
+  // scale_image() picks).
+  std::unique_ptr<Image> bmp_copy(Image::create(bmp->pixelFormat(), rot_width*scale, rot_height));
+  bmp_copy->setMaskColor(maskColor);
+  clear_image(bmp_copy.get(), maskColor);
 
-  if (mask) {
-    // Same ImageBuffer than tmp_copy
-    msk_copy.reset(Image::create(IMAGE_BITMAP, mask->width()*scale, mask->height()*scale, buf[1]));
-    clear_image(msk_copy.get(), 0);
-    scale_image(msk_copy.get(), mask,
-                0, 0, msk_copy->width(), msk_copy->height(),
-                0, 0, mask->width(), mask->height());
+  std::vector<int> rows(rot_height);
+  {
+    using namespace fixmath;
+    fixed y = 0;
+    fixed dy = fixdiv(itofix(rot_height*scale-1), itofix(rot_height-1));
+    for (int v=0; v<rot_height; ++v) {
+      rows[v] = fixtoi(y);
+      y = fixadd(y, dy);
+    }
   }
 
-  clear_image(bmp_copy.get(), maskColor);
-  parallelogram(
-    bmp_copy.get(), spr_copy.get(), msk_copy.get(),
-    (x1-xmin)*scale, (y1-ymin)*scale, (x2-xmin)*scale, (y2-ymin)*scale,
-    (x3-xmin)*scale, (y3-ymin)*scale, (x4-xmin)*scale, (y4-ymin)*scale);
+  // Draw each row of the 8x rotated image moving the parallelogram
+  // vertically to the row of bmp_copy where it's saved.
+  for_each_row_band(
+    rot_width*scale, rot_height,
+    [&](int v1, int v2){
+      for (int v=v1; v<v2; ++v) {
+        const int dy = v - rows[v];
+        parallelogram_rows(
+          bmp_copy.get(), spr_copy, msk_copy,
+          (x1-xmin)*scale, (y1-ymin)*scale+dy, (x2-xmin)*scale, (y2-ymin)*scale+dy,
+          (x3-xmin)*scale, (y3-ymin)*scale+dy, (x4-xmin)*scale, (y4-ymin)*scale+dy,
+          v, v+1);
+      }
+    });
 
   scale_image(bmp, bmp_copy.get(),
               xmin, ymin, rot_width, rot_height,
@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -8,14 +9,52 @@
 #define DOC_ALGORITHM_ROTSPRITE_H_INCLUDED
 #pragma once
 
+#include "base/disable_copying.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <memory>
+#include <vector>
+
 namespace doc {
   class Image;
 
   namespace algorithm {
 
+    // Keeps the source image (and mask) scaled 8x between calls to
+    // rotsprite_image() to rotate the same image several times
+    // (e.g. while the user drags a rotation handle). Images are
+    // identified by ID and version, so a modified image is scaled
+    // again.
+    class RotSpriteCache {
+    public:
+      RotSpriteCache();
+      ~RotSpriteCache();
+
+      // Returns the image scaled 8x, using Scale2x for the source
+      // image, or a nearest-neighbor scale for the mask.
+      Image* getScaledImage(const Image* image, bool isMask);
+
+      void clear();
+
+    private:
+      struct Entry {
+        ObjectId id = NullId;
+        ObjectVersion version = 0;
+        bool isMask = false;
+        std::unique_ptr<Image> image;
+      };
+
+      // From the most recently used to the least one
+      std::vector<Entry> m_entries;
+
+      DISABLE_COPYING(RotSpriteCache);
+    };
+
     void rotsprite_image(Image* dst, const Image* src, const Image* mask,
       int x1, int y1, int x2, int y2,
-      int x3, int y3, int x4, int y4);
+      int x3, int y3, int x4, int y4,
+      RotSpriteCache* cache = nullptr);
 
   } // namespace algorithm
 } // namespace doc
@@ -0,0 +1,76 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/rotsprite.h"
+#include "doc/image_impl.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <memory>
+
+using namespace doc;
+
+namespace {
+
+void fill_random(Image* image, const int ncolors)
+{
+  std::srand(image->width());
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      put_pixel(image, x, y, std::rand() % ncolors);
+}
+
+// Rotates the image around 30 degrees
+void rotate(Image* dst, const Image* src, algorithm::RotSpriteCache* cache)
+{
+  clear_image(dst, 0);
+  dst->setMaskColor(0);
+  algorithm::rotsprite_image(
+    dst, src, nullptr,
+    20,  0, 120, 58,
+    92, 106, -8, 48,
+    cache);
+}
+
+} // anonymous namespace
+
+TEST(RotSprite, CacheGivesSameResult)
+{
+  std::unique_ptr<Image> src(Image::create(IMAGE_INDEXED, 115, 97));
+  std::unique_ptr<Image> a(Image::create(IMAGE_INDEXED, 128, 128));
+  std::unique_ptr<Image> b(Image::create(IMAGE_INDEXED, 128, 128));
+  fill_random(src.get(), 4);
+  src->setMaskColor(0);
+
+  rotate(a.get(), src.get(), nullptr);
+
+  algorithm::RotSpriteCache cache;
+  for (int i=0; i<2; ++i) {
+    rotate(b.get(), src.get(), &cache);
+    EXPECT_EQ(0, count_diff_between_images(a.get(), b.get()));
+  }
+
+  // The cached image is scaled again if the source is modified
+  for (int x=0; x<src->width(); ++x)
+    put_pixel(src.get(), x, src->height()/2, 3);
+  src->incrementVersion();
+
+  rotate(a.get(), src.get(), nullptr);
+  rotate(b.get(), src.get(), &cache);
+  EXPECT_EQ(0, count_diff_between_images(a.get(), b.get()));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,46 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_ALGORITHM_ROW_BANDS_H_INCLUDED
+#define DOC_ALGORITHM_ROW_BANDS_H_INCLUDED
+#pragma once
+
+#include "sched/task_group.h"
+
+#include <algorithm>
+
+namespace doc {
+namespace algorithm {
+
+  // Calls func(y1, y2) for bands of rows from 0 to h (of w pixels
+  // each one) from several threads, or just one time (with the
+  // whole range) if the image is small. Each band must read/write
+  // different pixels of the destination.
+  template<typename Func>
+  void for_each_row_band(const int w, const int h, Func&& func)
+  {
+    const int kRowsPerTask = 16;
+    const int kMinParallelPixels = 128*128;
+
+    if (sched::Scheduler::instance().threads() <= 1 ||
+        h <= kRowsPerTask ||
+        w*h < kMinParallelPixels) {
+      func(0, h);
+      return;
+    }
+
+    sched::TaskGroup tasks(sched::Priority::UI);
+    for (int y=0; y<h; y+=kRowsPerTask) {
+      const int y2 = std::min(h, y+kRowsPerTask);
+      tasks.run([&func, y, y2]{ func(y, y2); });
+    }
+    tasks.wait();
+  }
+
+} // namespace algorithm
+} // namespace doc
+
+#endif
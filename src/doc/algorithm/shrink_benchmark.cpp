@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -31,6 +31,19 @@ void BM_ShrinkBounds(benchmark::State& state) {
   }
 }
 
+void BM_ShrinkBoundsByEdges(benchmark::State& state) {
+  const PixelFormat pixelFormat = (PixelFormat)state.range(0);
+  const int w = state.range(1);
+  const int h = state.range(2);
+
+  std::unique_ptr<Image> img(Image::create(pixelFormat, w, h));
+  img->putPixel(w/2, h/2, rgba(1, 2, 3, 4));
+  gfx::Rect rc;
+  while (state.KeepRunning()) {
+    doc::algorithm::shrink_bounds_by_edges(img.get(), 0, nullptr, img->bounds(), rc);
+  }
+}
+
 #define DEFARGS(MODE)                      \
   ->Args({ MODE, 100, 100 })               \
   ->Args({ MODE, 200, 200 })               \
@@ -44,8 +57,10 @@ void BM_ShrinkBounds(benchmark::State& state) {
   ->Args({ MODE, 800, 800 })               \
   ->Args({ MODE, 900, 900 })               \
   ->Args({ MODE, 1000, 1000 })             \
+  ->Args({ MODE, 1024, 1024 })             \
   ->Args({ MODE, 1500, 1500 })             \
   ->Args({ MODE, 2000, 2000 })             \
+  ->Args({ MODE, 2048, 2048 })             \
   ->Args({ MODE, 4000, 4000 })             \
   ->Args({ MODE, 8000, 8000 })
 
@@ -56,4 +71,11 @@ BENCHMARK(BM_ShrinkBounds)
   ->Unit(benchmark::kMicrosecond)
   ->UseRealTime();
 
+BENCHMARK(BM_ShrinkBoundsByEdges)
+  DEFARGS(IMAGE_RGB)
+  DEFARGS(IMAGE_GRAYSCALE)
+  DEFARGS(IMAGE_INDEXED)
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
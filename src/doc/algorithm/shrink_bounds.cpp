@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -20,8 +20,20 @@
 #include "doc/primitives.h"
 #include "doc/primitives_fast.h"
 #include "doc/tileset.h"
-
-#include <thread>
+#include "sched/task_group.h"
+
+#include <algorithm>
+#include <vector>
+
+// SSE2 and NEON are always available on x64 and ARM64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_SHRINK_BOUNDS_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define DOC_SHRINK_BOUNDS_NEON 1
+  #include <arm_neon.h>
+#endif
 
 namespace doc {
 namespace algorithm {
@@ -130,41 +142,203 @@ bool shrink_bounds_bottom_templ(const Image* image, gfx::Rect& bounds, color_t r
 }
 
 template<typename ImageTraits>
-bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+bool shrink_bounds_by_edges_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
 {
   // Pixels per row
   const int rowSize = image->getRowStrideSize() / image->getRowStrideSize(1);
-  const int canvasSize = image->width()*image->height();
-  if ((std::thread::hardware_concurrency() >= 4) &&
-      ((image->pixelFormat() == IMAGE_RGB && canvasSize >= 800*800) ||
-       (image->pixelFormat() != IMAGE_RGB && canvasSize >= 500*500))) {
-    gfx::Rect
-      leftBounds(bounds), rightBounds(bounds),
-      topBounds(bounds), bottomBounds(bounds);
-
-    // TODO use a base::thread_pool and a base::task for each border
-
-    std::thread left  ([&]{ shrink_bounds_left_templ  <ImageTraits>(image, leftBounds, refpixel, rowSize); });
-    std::thread right ([&]{ shrink_bounds_right_templ <ImageTraits>(image, rightBounds, refpixel, rowSize); });
-    std::thread top   ([&]{ shrink_bounds_top_templ   <ImageTraits>(image, topBounds, refpixel); });
-    std::thread bottom([&]{ shrink_bounds_bottom_templ<ImageTraits>(image, bottomBounds, refpixel); });
-    left.join();
-    right.join();
-    top.join();
-    bottom.join();
-    bounds = leftBounds;
-    bounds &= rightBounds;
-    bounds &= topBounds;
-    bounds &= bottomBounds;
-    return !bounds.isEmpty();
+  return
+    shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowSize) &&
+    shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowSize) &&
+    shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
+    shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+}
+
+// Finds pixels that are different from the reference pixel in a
+// row. A pixel "c" is equal to the reference one if (c & mask) ==
+// value, i.e. the same as is_same_pixel() but comparing 16 bytes at
+// the same time when it's possible.
+template<typename ImageTraits>
+class RowScanner {
+public:
+  typedef typename ImageTraits::pixel_t pixel_t;
+
+  RowScanner(const color_t refpixel) {
+    pixel_t alphaMask =
+      (ImageTraits::pixel_format == IMAGE_RGB ? pixel_t(rgba_a_mask):
+       ImageTraits::pixel_format == IMAGE_GRAYSCALE ? pixel_t(graya_a_mask): 0);
+    if (alphaMask && (pixel_t(refpixel) & alphaMask) == 0) {
+      // All transparent pixels are equal
+      m_mask = alphaMask;
+      m_value = 0;
+    }
+    else {
+      m_mask = pixel_t(~pixel_t(0));
+      m_value = pixel_t(refpixel);
+    }
+  }
+
+  // Returns the index in [0, n) of the first different pixel, or n
+  // if all pixels are equal to the reference pixel.
+  int firstDiff(const pixel_t* p, const int n) const {
+    int i = 0;
+#if DOC_SHRINK_BOUNDS_SSE2 || DOC_SHRINK_BOUNDS_NEON
+    for (; i+kPixels <= n; i += kPixels) {
+      if (!vectorIsSame(p+i))
+        break;
+    }
+#endif
+    // Remaining pixels, or the block that contains the result
+    for (; i<n; ++i)
+      if ((p[i] & m_mask) != m_value)
+        break;
+    return i;
+  }
+
+  // Returns the index in [0, n) of the last different pixel, or -1
+  // if all pixels are equal to the reference pixel.
+  int lastDiff(const pixel_t* p, const int n) const {
+    int i = n;
+#if DOC_SHRINK_BOUNDS_SSE2 || DOC_SHRINK_BOUNDS_NEON
+    for (; i-kPixels >= 0; i -= kPixels) {
+      if (!vectorIsSame(p+i-kPixels))
+        break;
+    }
+#endif
+    while (--i >= 0)
+      if ((p[i] & m_mask) != m_value)
+        break;
+    return i;
+  }
+
+private:
+  static constexpr int kPixels = 16 / sizeof(pixel_t);
+
+#if DOC_SHRINK_BOUNDS_SSE2
+  // Returns true if the 16 bytes in "p" are equal to the reference
+  // pixel.
+  bool vectorIsSame(const pixel_t* p) const {
+    const __m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)p),
+                                    broadcast(m_mask));
+    return (_mm_movemask_epi8(_mm_cmpeq_epi8(v, broadcast(m_value))) == 0xffff);
+  }
+
+  static __m128i broadcast(const pixel_t c) {
+    if (sizeof(pixel_t) == 4)
+      return _mm_set1_epi32(int(c));
+    else if (sizeof(pixel_t) == 2)
+      return _mm_set1_epi16(short(c));
+    else
+      return _mm_set1_epi8(char(c));
+  }
+#elif DOC_SHRINK_BOUNDS_NEON
+  bool vectorIsSame(const pixel_t* p) const {
+    const uint8x16_t v = vandq_u8(vld1q_u8((const uint8_t*)p),
+                                  broadcast(m_mask));
+    return (vminvq_u8(vceqq_u8(v, broadcast(m_value))) == 0xff);
+  }
+
+  static uint8x16_t broadcast(const pixel_t c) {
+    if (sizeof(pixel_t) == 4)
+      return vreinterpretq_u8_u32(vdupq_n_u32(uint32_t(c)));
+    else if (sizeof(pixel_t) == 2)
+      return vreinterpretq_u8_u16(vdupq_n_u16(uint16_t(c)));
+    else
+      return vdupq_n_u8(uint8_t(c));
+  }
+#endif
+
+  pixel_t m_mask;
+  pixel_t m_value;
+};
+
+// Returns the bounds of the different pixels in the rows [y1, y2)
+// of the given bounds. Each pixel is read one time at most: first
+// we look for the top and bottom rows, and then we only check the
+// pixels at the left and right of the current bounds in the
+// remaining rows.
+template<typename ImageTraits>
+gfx::Rect shrink_rows_templ(const Image* image,
+                            const gfx::Rect& bounds,
+                            const RowScanner<ImageTraits>& scanner,
+                            const int y1, const int y2)
+{
+  typedef typename ImageTraits::pixel_t pixel_t;
+  const int w = bounds.w;
+  auto row = [image, &bounds](const int y) -> const pixel_t* {
+    return get_pixel_address_fast<ImageTraits>(image, bounds.x, y);
+  };
+
+  // Left and right are relative to bounds.x (both inclusive)
+  int left = w, right;
+  int top = y1, bottom = y2-1;
+  for (; top<=bottom; ++top) {
+    left = scanner.firstDiff(row(top), w);
+    if (left < w)
+      break;
+  }
+  if (top > bottom)
+    return gfx::Rect();
+  right = left + scanner.lastDiff(row(top)+left, w-left);
+
+  for (; bottom>top; --bottom) {
+    const pixel_t* p = row(bottom);
+    const int last = scanner.lastDiff(p, w);
+    if (last >= 0) {
+      right = std::max(right, last);
+      left = scanner.firstDiff(p, left);
+      break;
+    }
+  }
+
+  for (int y=top+1; y<bottom && (left > 0 || right < w-1); ++y) {
+    const pixel_t* p = row(y);
+    left = scanner.firstDiff(p, left);
+    const int last = scanner.lastDiff(p+right+1, w-right-1);
+    if (last >= 0)
+      right += last+1;
+  }
+
+  return gfx::Rect(bounds.x+left, top, right-left+1, bottom-top+1);
+}
+
+template<typename ImageTraits>
+bool shrink_bounds_templ(const Image* image, gfx::Rect& bounds, color_t refpixel)
+{
+  if (bounds.isEmpty())
+    return false;
+
+  const RowScanner<ImageTraits> scanner(refpixel);
+
+  // Scanning the image is limited by the memory bandwidth, so we use
+  // several threads for really big images only.
+  const int kMinParallelPixels = 2048*2048;
+  const int threads = sched::Scheduler::instance().threads();
+  if (threads > 1 &&
+      bounds.w*bounds.h >= kMinParallelPixels &&
+      bounds.h >= 2*threads) {
+    const int nbands = 2*threads;
+    std::vector<gfx::Rect> results(nbands);
+
+    sched::TaskGroup tasks(sched::Priority::UI);
+    for (int i=0; i<nbands; ++i) {
+      const int y1 = bounds.y + bounds.h*i/nbands;
+      const int y2 = bounds.y + bounds.h*(i+1)/nbands;
+      tasks.run([&, i, y1, y2]{
+        results[i] = shrink_rows_templ<ImageTraits>(image, bounds, scanner, y1, y2);
+      });
+    }
+    tasks.wait();
+
+    gfx::Rect rc;
+    for (const gfx::Rect& result : results)
+      rc |= result;
+    bounds = rc;
   }
   else {
-    return
-      shrink_bounds_left_templ<ImageTraits>(image, bounds, refpixel, rowSize) &&
-      shrink_bounds_right_templ<ImageTraits>(image, bounds, refpixel, rowSize) &&
-      shrink_bounds_top_templ<ImageTraits>(image, bounds, refpixel) &&
-      shrink_bounds_bottom_templ<ImageTraits>(image, bounds, refpixel);
+    bounds = shrink_rows_templ<ImageTraits>(image, bounds, scanner,
+                                            bounds.y, bounds.y2());
   }
+  return !bounds.isEmpty();
 }
 
 template<typename ImageTraits>
@@ -347,7 +521,26 @@ bool shrink_bounds(const Image* image,
     case IMAGE_RGB:       return shrink_bounds_templ<RgbTraits>(image, bounds, refpixel);
     case IMAGE_GRAYSCALE: return shrink_bounds_templ<GrayscaleTraits>(image, bounds, refpixel);
     case IMAGE_INDEXED:   return shrink_bounds_templ<IndexedTraits>(image, bounds, refpixel);
-    case IMAGE_BITMAP:    return shrink_bounds_templ<BitmapTraits>(image, bounds, refpixel);
+    case IMAGE_BITMAP:    return shrink_bounds_by_edges_templ<BitmapTraits>(image, bounds, refpixel);
+    case IMAGE_TILEMAP:   return shrink_bounds_tilemap(image, refpixel, layer, bounds);
+  }
+  ASSERT(false);
+  bounds = startBounds;
+  return true;
+}
+
+bool shrink_bounds_by_edges(const Image* image,
+                            const color_t refpixel,
+                            const Layer* layer,
+                            const gfx::Rect& startBounds,
+                            gfx::Rect& bounds)
+{
+  bounds = (startBounds & image->bounds());
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       return shrink_bounds_by_edges_templ<RgbTraits>(image, bounds, refpixel);
+    case IMAGE_GRAYSCALE: return shrink_bounds_by_edges_templ<GrayscaleTraits>(image, bounds, refpixel);
+    case IMAGE_INDEXED:   return shrink_bounds_by_edges_templ<IndexedTraits>(image, bounds, refpixel);
+    case IMAGE_BITMAP:    return shrink_bounds_by_edges_templ<BitmapTraits>(image, bounds, refpixel);
     case IMAGE_TILEMAP:   return shrink_bounds_tilemap(image, refpixel, layer, bounds);
   }
   ASSERT(false);
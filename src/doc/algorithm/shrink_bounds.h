@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -32,6 +32,15 @@ namespace doc {
                        const Layer* layer,
                        gfx::Rect& bounds);
 
+    // Same as shrink_bounds() but scanning columns/rows from each
+    // edge of the image. shrink_bounds() scans rows in one pass, so
+    // this one is useful to compare results in tests/benchmarks.
+    bool shrink_bounds_by_edges(const Image* image,
+                                const color_t refpixel,
+                                const Layer* layer,
+                                const gfx::Rect& startBounds,
+                                gfx::Rect& bounds);
+
     bool shrink_cel_bounds(const Cel* cel,
                            const color_t refpixel,
                            gfx::Rect& bounds);
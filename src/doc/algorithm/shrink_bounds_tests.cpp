@@ -0,0 +1,72 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/algorithm/shrink_bounds.h"
+#include "doc/image.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <memory>
+
+using namespace doc;
+using namespace gfx;
+
+TEST(ShrinkBounds, Basic)
+{
+  std::unique_ptr<Image> img(Image::create(IMAGE_RGB, 37, 21));
+  clear_image(img.get(), 0);
+
+  Rect bounds;
+  EXPECT_FALSE(algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+
+  put_pixel(img.get(), 4, 3, rgba(255, 0, 0, 255));
+  put_pixel(img.get(), 30, 17, rgba(0, 255, 0, 255));
+  // Transparent pixels are equal to the transparent reference pixel
+  put_pixel(img.get(), 35, 19, rgba(0, 0, 255, 0));
+  EXPECT_TRUE(algorithm::shrink_bounds(img.get(), 0, nullptr, bounds));
+  EXPECT_EQ(Rect(4, 3, 27, 15), bounds);
+
+  EXPECT_TRUE(algorithm::shrink_bounds(img.get(), 0, nullptr,
+                                       Rect(10, 0, 27, 21), bounds));
+  EXPECT_EQ(Rect(30, 17, 1, 1), bounds);
+}
+
+TEST(ShrinkBounds, SameResultAsEdges)
+{
+  std::srand(1);
+  for (PixelFormat pixelFormat : { IMAGE_RGB,
+                                   IMAGE_GRAYSCALE,
+                                   IMAGE_INDEXED }) {
+    for (int i=0; i<200; ++i) {
+      const int w = 1 + std::rand() % 80;
+      const int h = 1 + std::rand() % 80;
+      std::unique_ptr<Image> img(Image::create(pixelFormat, w, h));
+      clear_image(img.get(), 0);
+      for (int j=std::rand() % 4; j>0; --j)
+        put_pixel(img.get(), std::rand() % w, std::rand() % h,
+                  std::rand() % 256);
+
+      const Rect startBounds(std::rand() % w, std::rand() % h, w, h);
+      Rect a, b;
+      EXPECT_EQ(algorithm::shrink_bounds_by_edges(img.get(), 0, nullptr, startBounds, a),
+                algorithm::shrink_bounds(img.get(), 0, nullptr, startBounds, b));
+      if (!a.isEmpty())
+        EXPECT_EQ(a, b);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -12,6 +12,8 @@
 
 #include <benchmark/benchmark.h>
 
+#include <vector>
+
 using namespace doc;
 
 static void CustomArguments(benchmark::internal::Benchmark* b) {
@@ -53,4 +55,63 @@ BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_saturation)->Apply(CustomArguments)
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_color)->Apply(CustomArguments);
 BENCHMARK_TEMPLATE(BM_Rgba, rgba_blender_hsl_luminosity)->Apply(CustomArguments);
 
+// Row-based benchmarks: the per-pixel BlendFunc loop (which is what
+// we had in composite_image_without_scale()) vs BlendRowFunc.
+
+static void fill_row_pixels(std::vector<color_t>& dst,
+                            std::vector<color_t>& src)
+{
+  for (std::size_t i=0; i<dst.size(); ++i) {
+    dst[i] = rgba(i & 0xff, (i*3) & 0xff, (i*7) & 0xff, (i*11) & 0xff);
+    src[i] = rgba((i*5) & 0xff, (i*13) & 0xff, i & 0xff, (i*17) & 0xff);
+  }
+}
+
+template<BlendMode M>
+void BM_RgbaPixelLoop(benchmark::State& state) {
+  std::vector<color_t> dst(state.range(0)), src(state.range(0));
+  fill_row_pixels(dst, src);
+  const int opacity = state.range(1);
+  const BlendFunc func = get_rgba_blender(M, true);
+  while (state.KeepRunning()) {
+    for (std::size_t i=0; i<dst.size(); ++i) {
+      if (src[i] != 0)
+        dst[i] = func(dst[i], src[i], opacity);
+    }
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(state.iterations() * dst.size());
+}
+
+template<BlendMode M, bool newBlend>
+void BM_RgbaRow(benchmark::State& state) {
+  std::vector<color_t> dst(state.range(0)), src(state.range(0));
+  fill_row_pixels(dst, src);
+  const int opacity = state.range(1);
+  const BlendRowFunc func = get_rgba_row_blender(M, newBlend);
+  while (state.KeepRunning()) {
+    func(dst.data(), src.data(), int(dst.size()), opacity, 0);
+    benchmark::DoNotOptimize(dst.data());
+  }
+  state.SetItemsProcessed(state.iterations() * dst.size());
+}
+
+static void RowArguments(benchmark::internal::Benchmark* b) {
+  b ->Args({ 64, 255 })
+    ->Args({ 1024, 255 })
+    ->Args({ 1024, 128 })
+    ->Args({ 4096, 255 });
+}
+
+BENCHMARK_TEMPLATE(BM_RgbaPixelLoop, BlendMode::NORMAL)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::NORMAL, true)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaPixelLoop, BlendMode::MULTIPLY)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::MULTIPLY, true)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::MULTIPLY, false)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::SCREEN, false)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::OVERLAY, false)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::DARKEN, false)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::LIGHTEN, false)->Apply(RowArguments);
+BENCHMARK_TEMPLATE(BM_RgbaRow, BlendMode::DIFFERENCE, false)->Apply(RowArguments);
+
 BENCHMARK_MAIN();
@@ -25,6 +25,23 @@
 #include <algorithm>
 #include <cmath>
 
+// SSE2 and NEON are always available on x64 and ARM64, AVX2 is
+// detected at runtime (only with GCC/Clang, which can compile
+// functions for a specific target).
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_BLEND_SSE2 1
+  #include <emmintrin.h>
+  #if (defined(__GNUC__) || defined(__clang__)) && !defined(_MSC_VER)
+    #define DOC_BLEND_AVX2 1
+    #define DOC_BLEND_AVX2_TARGET __attribute__((target("avx2")))
+    #include <immintrin.h>
+  #endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define DOC_BLEND_NEON 1
+  #include <arm_neon.h>
+#endif
+
 namespace  {
 
 #define blend_multiply(b, s, t)   (MUL_UN8((b), (s), (t)))
@@ -830,4 +847,488 @@ BlendFunc get_indexed_blender(BlendMode blendmode, const bool newBlend)
   return indexed_blender_src;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Row blenders
+//
+// The generic row blender calls the per-pixel blender inline (so we
+// avoid one indirect call per pixel), and the SIMD versions must give
+// exactly the same results as the per-pixel blenders. For the normal
+// blend mode the division "(Sc-Bc)*Sa/Ra" is done with floats: the
+// numerator is exact in a float (|x| < 2^24) and the error of the
+// quotient is always smaller than 1/Ra, so the truncated value is the
+// same as the integer division.
+
+namespace {
+
+// Separable blend modes (the ones that are calculated channel by
+// channel and then blended with rgba_blender_normal()) that have a
+// SIMD implementation.
+enum class RowOp {
+  Normal,
+  Multiply,
+  Screen,
+  Overlay,
+  Darken,
+  Lighten,
+  Difference,
+};
+
+template<BlendFunc blender>
+void rgba_row_blender(color_t* dst, const color_t* src, int n,
+                      int opacity, color_t maskColor)
+{
+  for (; n > 0; --n, ++dst, ++src) {
+    if (*src != maskColor)
+      *dst = blender(*dst, *src, opacity);
+  }
+}
+
+#if DOC_BLEND_SSE2
+
+inline __m128i sse2_select(const __m128i mask, const __m128i a, const __m128i b)
+{
+  return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// MUL_UN8() for each 32-bit lane (a and b must be in [0, 255])
+inline __m128i sse2_mul_un8_epi32(const __m128i a, const __m128i b)
+{
+  const __m128i t = _mm_add_epi32(_mm_mullo_epi16(a, b), _mm_set1_epi32(0x80));
+  return _mm_srli_epi32(_mm_add_epi32(_mm_srli_epi32(t, 8), t), 8);
+}
+
+// MUL_UN8() for each 16-bit lane (a*b must be in [0, 65280])
+inline __m128i sse2_mul_un8_epi16(const __m128i a, const __m128i b)
+{
+  const __m128i t = _mm_add_epi16(_mm_mullo_epi16(a, b), _mm_set1_epi16(0x80));
+  return _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(t, 8), t), 8);
+}
+
+template<int shift>
+inline __m128i sse2_normal_channel(const __m128i b, const __m128i s,
+                                   const __m128 fSa, const __m128 fRa)
+{
+  const __m128i mask8 = _mm_set1_epi32(0xff);
+  const __m128i Bc = _mm_and_si128(_mm_srli_epi32(b, shift), mask8);
+  const __m128i Sc = _mm_and_si128(_mm_srli_epi32(s, shift), mask8);
+  const __m128 d = _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(Sc, Bc)), fSa);
+  const __m128i Rc = _mm_add_epi32(Bc, _mm_cvttps_epi32(_mm_div_ps(d, fRa)));
+  return _mm_slli_epi32(Rc, shift);
+}
+
+// rgba_blender_normal() for 4 pixels
+inline __m128i sse2_blend_normal(const __m128i b, const __m128i s,
+                                 const __m128i opacity)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i Ba = _mm_srli_epi32(b, 24);
+  const __m128i sa = _mm_srli_epi32(s, 24);
+  const __m128i Sa = sse2_mul_un8_epi32(sa, opacity);
+  const __m128i Ra = _mm_sub_epi32(_mm_add_epi32(Sa, Ba),
+                                   sse2_mul_un8_epi32(Ba, Sa));
+  const __m128 fSa = _mm_cvtepi32_ps(Sa);
+  const __m128 fRa = _mm_cvtepi32_ps(Ra);
+
+  __m128i r = _mm_or_si128(
+    _mm_or_si128(sse2_normal_channel<0>(b, s, fSa, fRa),
+                 sse2_normal_channel<8>(b, s, fSa, fRa)),
+    _mm_or_si128(sse2_normal_channel<16>(b, s, fSa, fRa),
+                 _mm_slli_epi32(Ra, 24)));
+
+  // Transparent src: keep the backdrop
+  r = sse2_select(_mm_cmpeq_epi32(sa, zero), b, r);
+
+  // Transparent backdrop: src color with src alpha*opacity
+  r = sse2_select(_mm_cmpeq_epi32(Ba, zero),
+                  _mm_or_si128(_mm_and_si128(s, _mm_set1_epi32(rgba_rgb_mask)),
+                               _mm_slli_epi32(Sa, 24)),
+                  r);
+  return r;
+}
+
+template<RowOp op>
+inline __m128i sse2_blend_op_epi16(const __m128i b, const __m128i s)
+{
+  if constexpr (op == RowOp::Multiply) {
+    return sse2_mul_un8_epi16(b, s);
+  }
+  else if constexpr (op == RowOp::Screen) {
+    return _mm_sub_epi16(_mm_add_epi16(b, s), sse2_mul_un8_epi16(b, s));
+  }
+  else {
+    static_assert(op == RowOp::Overlay);
+    const __m128i b2 = _mm_slli_epi16(b, 1);
+    const __m128i b3 = _mm_sub_epi16(b2, _mm_set1_epi16(255));
+    const __m128i m = sse2_mul_un8_epi16(s, b2);
+    const __m128i sc = _mm_sub_epi16(_mm_add_epi16(s, b3), sse2_mul_un8_epi16(s, b3));
+    return sse2_select(_mm_cmplt_epi16(b, _mm_set1_epi16(128)), m, sc);
+  }
+}
+
+// Returns the src pixels with the RGB channels replaced by the
+// blend_*(b, s) result of the given separable blend mode
+template<RowOp op>
+inline __m128i sse2_blend_channels(const __m128i b, const __m128i s)
+{
+  __m128i c;
+  if constexpr (op == RowOp::Darken) {
+    c = _mm_min_epu8(b, s);
+  }
+  else if constexpr (op == RowOp::Lighten) {
+    c = _mm_max_epu8(b, s);
+  }
+  else if constexpr (op == RowOp::Difference) {
+    c = _mm_or_si128(_mm_subs_epu8(b, s), _mm_subs_epu8(s, b));
+  }
+  else {
+    const __m128i zero = _mm_setzero_si128();
+    c = _mm_packus_epi16(
+      sse2_blend_op_epi16<op>(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(s, zero)),
+      sse2_blend_op_epi16<op>(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(s, zero)));
+  }
+  return sse2_select(_mm_set1_epi32(int(rgba_a_mask)), s, c);
+}
+
+template<RowOp op, BlendFunc blender>
+void rgba_row_blender_sse2(color_t* dst, const color_t* src, int n,
+                           int opacity, color_t maskColor)
+{
+  const __m128i opacityv = _mm_set1_epi32(opacity);
+  const __m128i maskv = _mm_set1_epi32(int(maskColor));
+
+  for (; n >= 4; n -= 4, dst += 4, src += 4) {
+    const __m128i b = _mm_loadu_si128((const __m128i*)dst);
+    const __m128i s = _mm_loadu_si128((const __m128i*)src);
+    __m128i r;
+    if constexpr (op == RowOp::Normal)
+      r = sse2_blend_normal(b, s, opacityv);
+    else
+      r = sse2_blend_normal(b, sse2_blend_channels<op>(b, s), opacityv);
+    r = sse2_select(_mm_cmpeq_epi32(s, maskv), b, r);
+    _mm_storeu_si128((__m128i*)dst, r);
+  }
+
+  rgba_row_blender<blender>(dst, src, n, opacity, maskColor);
+}
+
+#endif // DOC_BLEND_SSE2
+
+#if DOC_BLEND_AVX2
+
+DOC_BLEND_AVX2_TARGET
+inline __m256i avx2_select(const __m256i mask, const __m256i a, const __m256i b)
+{
+  return _mm256_or_si256(_mm256_and_si256(mask, a), _mm256_andnot_si256(mask, b));
+}
+
+DOC_BLEND_AVX2_TARGET
+inline __m256i avx2_mul_un8_epi32(const __m256i a, const __m256i b)
+{
+  const __m256i t = _mm256_add_epi32(_mm256_mullo_epi16(a, b), _mm256_set1_epi32(0x80));
+  return _mm256_srli_epi32(_mm256_add_epi32(_mm256_srli_epi32(t, 8), t), 8);
+}
+
+DOC_BLEND_AVX2_TARGET
+inline __m256i avx2_mul_un8_epi16(const __m256i a, const __m256i b)
+{
+  const __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(a, b), _mm256_set1_epi16(0x80));
+  return _mm256_srli_epi16(_mm256_add_epi16(_mm256_srli_epi16(t, 8), t), 8);
+}
+
+template<int shift>
+DOC_BLEND_AVX2_TARGET
+inline __m256i avx2_normal_channel(const __m256i b, const __m256i s,
+                                   const __m256 fSa, const __m256 fRa)
+{
+  const __m256i mask8 = _mm256_set1_epi32(0xff);
+  const __m256i Bc = _mm256_and_si256(_mm256_srli_epi32(b, shift), mask8);
+  const __m256i Sc = _mm256_and_si256(_mm256_srli_epi32(s, shift), mask8);
+  const __m256 d = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_sub_epi32(Sc, Bc)), fSa);
+  const __m256i Rc = _mm256_add_epi32(Bc, _mm256_cvttps_epi32(_mm256_div_ps(d, fRa)));
+  return _mm256_slli_epi32(Rc, shift);
+}
+
+// rgba_blender_normal() for 8 pixels
+DOC_BLEND_AVX2_TARGET
+inline __m256i avx2_blend_normal(const __m256i b, const __m256i s,
+                                 const __m256i opacity)
+{
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i Ba = _mm256_srli_epi32(b, 24);
+  const __m256i sa = _mm256_srli_epi32(s, 24);
+  const __m256i Sa = avx2_mul_un8_epi32(sa, opacity);
+  const __m256i Ra = _mm256_sub_epi32(_mm256_add_epi32(Sa, Ba),
+                                      avx2_mul_un8_epi32(Ba, Sa));
+  const __m256 fSa = _mm256_cvtepi32_ps(Sa);
+  const __m256 fRa = _mm256_cvtepi32_ps(Ra);
+
+  __m256i r = _mm256_or_si256(
+    _mm256_or_si256(avx2_normal_channel<0>(b, s, fSa, fRa),
+                    avx2_normal_channel<8>(b, s, fSa, fRa)),
+    _mm256_or_si256(avx2_normal_channel<16>(b, s, fSa, fRa),
+                    _mm256_slli_epi32(Ra, 24)));
+
+  r = avx2_select(_mm256_cmpeq_epi32(sa, zero), b, r);
+  r = avx2_select(_mm256_cmpeq_epi32(Ba, zero),
+                  _mm256_or_si256(_mm256_and_si256(s, _mm256_set1_epi32(rgba_rgb_mask)),
+                                  _mm256_slli_epi32(Sa, 24)),
+                  r);
+  return r;
+}
+
+template<RowOp op>
+DOC_BLEND_AVX2_TARGET
+inline __m256i avx2_blend_op_epi16(const __m256i b, const __m256i s)
+{
+  if constexpr (op == RowOp::Multiply) {
+    return avx2_mul_un8_epi16(b, s);
+  }
+  else if constexpr (op == RowOp::Screen) {
+    return _mm256_sub_epi16(_mm256_add_epi16(b, s), avx2_mul_un8_epi16(b, s));
+  }
+  else {
+    static_assert(op == RowOp::Overlay);
+    const __m256i b2 = _mm256_slli_epi16(b, 1);
+    const __m256i b3 = _mm256_sub_epi16(b2, _mm256_set1_epi16(255));
+    const __m256i m = avx2_mul_un8_epi16(s, b2);
+    const __m256i sc = _mm256_sub_epi16(_mm256_add_epi16(s, b3), avx2_mul_un8_epi16(s, b3));
+    return avx2_select(_mm256_cmpgt_epi16(_mm256_set1_epi16(128), b), m, sc);
+  }
+}
+
+template<RowOp op>
+DOC_BLEND_AVX2_TARGET
+inline __m256i avx2_blend_channels(const __m256i b, const __m256i s)
+{
+  __m256i c;
+  if constexpr (op == RowOp::Darken) {
+    c = _mm256_min_epu8(b, s);
+  }
+  else if constexpr (op == RowOp::Lighten) {
+    c = _mm256_max_epu8(b, s);
+  }
+  else if constexpr (op == RowOp::Difference) {
+    c = _mm256_or_si256(_mm256_subs_epu8(b, s), _mm256_subs_epu8(s, b));
+  }
+  else {
+    // unpack/pack work on each 128-bit lane, so the order of pixels
+    // is preserved
+    const __m256i zero = _mm256_setzero_si256();
+    c = _mm256_packus_epi16(
+      avx2_blend_op_epi16<op>(_mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(s, zero)),
+      avx2_blend_op_epi16<op>(_mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(s, zero)));
+  }
+  return avx2_select(_mm256_set1_epi32(int(rgba_a_mask)), s, c);
+}
+
+template<RowOp op, BlendFunc blender>
+DOC_BLEND_AVX2_TARGET
+void rgba_row_blender_avx2(color_t* dst, const color_t* src, int n,
+                           int opacity, color_t maskColor)
+{
+  const __m256i opacityv = _mm256_set1_epi32(opacity);
+  const __m256i maskv = _mm256_set1_epi32(int(maskColor));
+
+  for (; n >= 8; n -= 8, dst += 8, src += 8) {
+    const __m256i b = _mm256_loadu_si256((const __m256i*)dst);
+    const __m256i s = _mm256_loadu_si256((const __m256i*)src);
+    __m256i r;
+    if constexpr (op == RowOp::Normal)
+      r = avx2_blend_normal(b, s, opacityv);
+    else
+      r = avx2_blend_normal(b, avx2_blend_channels<op>(b, s), opacityv);
+    r = avx2_select(_mm256_cmpeq_epi32(s, maskv), b, r);
+    _mm256_storeu_si256((__m256i*)dst, r);
+  }
+
+  rgba_row_blender_sse2<op, blender>(dst, src, n, opacity, maskColor);
+}
+
+bool cpu_supports_avx2()
+{
+  static const bool result = __builtin_cpu_supports("avx2");
+  return result;
+}
+
+#endif // DOC_BLEND_AVX2
+
+#if DOC_BLEND_NEON
+
+template<int shift>
+inline uint32x4_t neon_shr(const uint32x4_t x)
+{
+  if constexpr (shift == 0)
+    return x;
+  else
+    return vshrq_n_u32(x, shift);
+}
+
+inline uint32x4_t neon_mul_un8_u32(const uint32x4_t a, const uint32x4_t b)
+{
+  const uint32x4_t t = vaddq_u32(vmulq_u32(a, b), vdupq_n_u32(0x80));
+  return vshrq_n_u32(vaddq_u32(vshrq_n_u32(t, 8), t), 8);
+}
+
+inline uint16x8_t neon_mul_un8_u16(const uint16x8_t a, const uint16x8_t b)
+{
+  const uint16x8_t t = vaddq_u16(vmulq_u16(a, b), vdupq_n_u16(0x80));
+  return vshrq_n_u16(vaddq_u16(vshrq_n_u16(t, 8), t), 8);
+}
+
+template<int shift>
+inline uint32x4_t neon_normal_channel(const uint32x4_t b, const uint32x4_t s,
+                                      const float32x4_t fSa, const float32x4_t fRa)
+{
+  const uint32x4_t mask8 = vdupq_n_u32(0xff);
+  const int32x4_t Bc = vreinterpretq_s32_u32(vandq_u32(neon_shr<shift>(b), mask8));
+  const int32x4_t Sc = vreinterpretq_s32_u32(vandq_u32(neon_shr<shift>(s), mask8));
+  const float32x4_t d = vmulq_f32(vcvtq_f32_s32(vsubq_s32(Sc, Bc)), fSa);
+  const int32x4_t Rc = vaddq_s32(Bc, vcvtq_s32_f32(vdivq_f32(d, fRa)));
+  return vshlq_n_u32(vreinterpretq_u32_s32(Rc), shift);
+}
+
+// rgba_blender_normal() for 4 pixels
+inline uint32x4_t neon_blend_normal(const uint32x4_t b, const uint32x4_t s,
+                                    const uint32x4_t opacity)
+{
+  const uint32x4_t zero = vdupq_n_u32(0);
+  const uint32x4_t Ba = vshrq_n_u32(b, 24);
+  const uint32x4_t sa = vshrq_n_u32(s, 24);
+  const uint32x4_t Sa = neon_mul_un8_u32(sa, opacity);
+  const uint32x4_t Ra = vsubq_u32(vaddq_u32(Sa, Ba), neon_mul_un8_u32(Ba, Sa));
+  const float32x4_t fSa = vcvtq_f32_u32(Sa);
+  const float32x4_t fRa = vcvtq_f32_u32(Ra);
+
+  uint32x4_t r = vorrq_u32(
+    vorrq_u32(neon_normal_channel<0>(b, s, fSa, fRa),
+              neon_normal_channel<8>(b, s, fSa, fRa)),
+    vorrq_u32(neon_normal_channel<16>(b, s, fSa, fRa),
+              vshlq_n_u32(Ra, 24)));
+
+  r = vbslq_u32(vceqq_u32(sa, zero), b, r);
+  r = vbslq_u32(vceqq_u32(Ba, zero),
+                vorrq_u32(vandq_u32(s, vdupq_n_u32(rgba_rgb_mask)),
+                          vshlq_n_u32(Sa, 24)),
+                r);
+  return r;
+}
+
+template<RowOp op>
+inline uint16x8_t neon_blend_op_u16(const uint16x8_t b, const uint16x8_t s)
+{
+  if constexpr (op == RowOp::Multiply) {
+    return neon_mul_un8_u16(b, s);
+  }
+  else if constexpr (op == RowOp::Screen) {
+    return vsubq_u16(vaddq_u16(b, s), neon_mul_un8_u16(b, s));
+  }
+  else {
+    static_assert(op == RowOp::Overlay);
+    const uint16x8_t b2 = vshlq_n_u16(b, 1);
+    const uint16x8_t b3 = vsubq_u16(b2, vdupq_n_u16(255));
+    const uint16x8_t m = neon_mul_un8_u16(s, b2);
+    const uint16x8_t sc = vsubq_u16(vaddq_u16(s, b3), neon_mul_un8_u16(s, b3));
+    return vbslq_u16(vcltq_u16(b, vdupq_n_u16(128)), m, sc);
+  }
+}
+
+template<RowOp op>
+inline uint32x4_t neon_blend_channels(const uint32x4_t b32, const uint32x4_t s32)
+{
+  const uint8x16_t b = vreinterpretq_u8_u32(b32);
+  const uint8x16_t s = vreinterpretq_u8_u32(s32);
+  uint8x16_t c;
+  if constexpr (op == RowOp::Darken) {
+    c = vminq_u8(b, s);
+  }
+  else if constexpr (op == RowOp::Lighten) {
+    c = vmaxq_u8(b, s);
+  }
+  else if constexpr (op == RowOp::Difference) {
+    c = vabdq_u8(b, s);
+  }
+  else {
+    c = vcombine_u8(
+      vqmovn_u16(neon_blend_op_u16<op>(vmovl_u8(vget_low_u8(b)), vmovl_u8(vget_low_u8(s)))),
+      vqmovn_u16(neon_blend_op_u16<op>(vmovl_u8(vget_high_u8(b)), vmovl_u8(vget_high_u8(s)))));
+  }
+  return vbslq_u32(vdupq_n_u32(rgba_a_mask), s32, vreinterpretq_u32_u8(c));
+}
+
+template<RowOp op, BlendFunc blender>
+void rgba_row_blender_neon(color_t* dst, const color_t* src, int n,
+                           int opacity, color_t maskColor)
+{
+  const uint32x4_t opacityv = vdupq_n_u32(opacity);
+  const uint32x4_t maskv = vdupq_n_u32(maskColor);
+
+  for (; n >= 4; n -= 4, dst += 4, src += 4) {
+    const uint32x4_t b = vld1q_u32(dst);
+    const uint32x4_t s = vld1q_u32(src);
+    uint32x4_t r;
+    if constexpr (op == RowOp::Normal)
+      r = neon_blend_normal(b, s, opacityv);
+    else
+      r = neon_blend_normal(b, neon_blend_channels<op>(b, s), opacityv);
+    r = vbslq_u32(vceqq_u32(s, maskv), b, r);
+    vst1q_u32(dst, r);
+  }
+
+  rgba_row_blender<blender>(dst, src, n, opacity, maskColor);
+}
+
+#endif // DOC_BLEND_NEON
+
+template<RowOp op, BlendFunc blender>
+BlendRowFunc get_simd_row_blender()
+{
+#if DOC_BLEND_AVX2
+  if (cpu_supports_avx2())
+    return rgba_row_blender_avx2<op, blender>;
+#endif
+#if DOC_BLEND_SSE2
+  return rgba_row_blender_sse2<op, blender>;
+#elif DOC_BLEND_NEON
+  return rgba_row_blender_neon<op, blender>;
+#else
+  return rgba_row_blender<blender>;
+#endif
+}
+
+} // anonymous namespace
+
+BlendRowFunc get_rgba_row_blender(BlendMode blendmode, const bool newBlend)
+{
+  switch (blendmode) {
+    case BlendMode::SRC:            return rgba_row_blender<rgba_blender_src>;
+    case BlendMode::MERGE:          return rgba_row_blender<rgba_blender_merge>;
+    case BlendMode::NEG_BW:         return rgba_row_blender<rgba_blender_neg_bw>;
+    case BlendMode::RED_TINT:       return rgba_row_blender<rgba_blender_red_tint>;
+    case BlendMode::BLUE_TINT:      return rgba_row_blender<rgba_blender_blue_tint>;
+    case BlendMode::DST_OVER:       return rgba_row_blender<rgba_blender_normal_dst_over>;
+
+    case BlendMode::NORMAL:         return get_simd_row_blender<RowOp::Normal, rgba_blender_normal>();
+    case BlendMode::MULTIPLY:       return newBlend? rgba_row_blender<rgba_blender_multiply_n>: get_simd_row_blender<RowOp::Multiply, rgba_blender_multiply>();
+    case BlendMode::SCREEN:         return newBlend? rgba_row_blender<rgba_blender_screen_n>: get_simd_row_blender<RowOp::Screen, rgba_blender_screen>();
+    case BlendMode::OVERLAY:        return newBlend? rgba_row_blender<rgba_blender_overlay_n>: get_simd_row_blender<RowOp::Overlay, rgba_blender_overlay>();
+    case BlendMode::DARKEN:         return newBlend? rgba_row_blender<rgba_blender_darken_n>: get_simd_row_blender<RowOp::Darken, rgba_blender_darken>();
+    case BlendMode::LIGHTEN:        return newBlend? rgba_row_blender<rgba_blender_lighten_n>: get_simd_row_blender<RowOp::Lighten, rgba_blender_lighten>();
+    case BlendMode::COLOR_DODGE:    return newBlend? rgba_row_blender<rgba_blender_color_dodge_n>: rgba_row_blender<rgba_blender_color_dodge>;
+    case BlendMode::COLOR_BURN:     return newBlend? rgba_row_blender<rgba_blender_color_burn_n>: rgba_row_blender<rgba_blender_color_burn>;
+    case BlendMode::HARD_LIGHT:     return newBlend? rgba_row_blender<rgba_blender_hard_light_n>: rgba_row_blender<rgba_blender_hard_light>;
+    case BlendMode::SOFT_LIGHT:     return newBlend? rgba_row_blender<rgba_blender_soft_light_n>: rgba_row_blender<rgba_blender_soft_light>;
+    case BlendMode::DIFFERENCE:     return newBlend? rgba_row_blender<rgba_blender_difference_n>: get_simd_row_blender<RowOp::Difference, rgba_blender_difference>();
+    case BlendMode::EXCLUSION:      return newBlend? rgba_row_blender<rgba_blender_exclusion_n>: rgba_row_blender<rgba_blender_exclusion>;
+    case BlendMode::HSL_HUE:        return newBlend? rgba_row_blender<rgba_blender_hsl_hue_n>: rgba_row_blender<rgba_blender_hsl_hue>;
+    case BlendMode::HSL_SATURATION: return newBlend? rgba_row_blender<rgba_blender_hsl_saturation_n>: rgba_row_blender<rgba_blender_hsl_saturation>;
+    case BlendMode::HSL_COLOR:      return newBlend? rgba_row_blender<rgba_blender_hsl_color_n>: rgba_row_blender<rgba_blender_hsl_color>;
+    case BlendMode::HSL_LUMINOSITY: return newBlend? rgba_row_blender<rgba_blender_hsl_luminosity_n>: rgba_row_blender<rgba_blender_hsl_luminosity>;
+    case BlendMode::ADDITION:       return newBlend? rgba_row_blender<rgba_blender_addition_n>: rgba_row_blender<rgba_blender_addition>;
+    case BlendMode::SUBTRACT:       return newBlend? rgba_row_blender<rgba_blender_subtract_n>: rgba_row_blender<rgba_blender_subtract>;
+    case BlendMode::DIVIDE:         return newBlend? rgba_row_blender<rgba_blender_divide_n>: rgba_row_blender<rgba_blender_divide>;
+  }
+  ASSERT(false);
+  return rgba_row_blender<rgba_blender_src>;
+}
+
 } // namespace doc
@@ -68,6 +68,15 @@ namespace doc {
   BlendFunc get_graya_blender(BlendMode blendmode, const bool newBlend);
   BlendFunc get_indexed_blender(BlendMode blendmode, const bool newBlend);
 
+  // Blends a row of "n" RGBA pixels, dst[i] = blend(dst[i], src[i],
+  // opacity), skipping src pixels equal to the given mask color. The
+  // result is the same as calling the BlendFunc returned by
+  // get_rgba_blender() for each pixel.
+  typedef void (*BlendRowFunc)(color_t* dst, const color_t* src, int n,
+                               int opacity, color_t maskColor);
+
+  BlendRowFunc get_rgba_row_blender(BlendMode blendmode, const bool newBlend);
+
 } // namespace doc
 
 #endif
@@ -0,0 +1,83 @@
+// Aseprite Document Library
+// Copyright (c) 2023 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/blend_funcs.h"
+
+#include <random>
+#include <vector>
+
+using namespace doc;
+
+TEST(BlendFuncs, RowBlendersMatchPixelBlenders)
+{
+  const BlendMode modes[] = {
+    BlendMode::NORMAL,
+    BlendMode::MULTIPLY,
+    BlendMode::SCREEN,
+    BlendMode::OVERLAY,
+    BlendMode::DARKEN,
+    BlendMode::LIGHTEN,
+    BlendMode::DIFFERENCE,
+    BlendMode::HSL_HUE,
+  };
+
+  std::mt19937 rng(1);
+  auto randomColor = [&rng]() -> color_t {
+    color_t c = rng();
+    switch (rng() % 4) {
+      case 0: c &= rgba_rgb_mask; break; // Transparent
+      case 1: c |= rgba_a_mask; break;   // Opaque
+      case 2: c = 0; break;
+    }
+    return c;
+  };
+
+  for (const BlendMode mode : modes) {
+    for (const bool newBlend : { false, true }) {
+      const BlendFunc blender = get_rgba_blender(mode, newBlend);
+      const BlendRowFunc rowBlender = get_rgba_row_blender(mode, newBlend);
+
+      for (int i=0; i<1000; ++i) {
+        // Use different lengths to test the non-SIMD tail of each row
+        const int n = 1 + (rng() % 37);
+        std::vector<color_t> dst(n), src(n), expected(n);
+        for (int x=0; x<n; ++x) {
+          dst[x] = randomColor();
+          src[x] = randomColor();
+        }
+
+        const int opacity = (rng() % 2 ? 255: rng() % 256);
+        const color_t maskColor = (rng() % 2 ? 0: src[0]);
+
+        for (int x=0; x<n; ++x) {
+          expected[x] = (src[x] != maskColor ? blender(dst[x], src[x], opacity):
+                                               dst[x]);
+        }
+
+        rowBlender(&dst[0], &src[0], n, opacity, maskColor);
+        for (int x=0; x<n; ++x) {
+          ASSERT_EQ(expected[x], dst[x])
+            << " blendMode=" << int(mode)
+            << " newBlend=" << newBlend
+            << " opacity=" << opacity
+            << " x=" << x;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -99,6 +99,9 @@ void Cel::setOpacity(int opacity)
 void Cel::setZIndex(int zindex)
 {
   m_zIndex = zindex;
+
+  if (m_layer && m_layer->sprite())
+    m_layer->sprite()->incrementStructureVersion();
 }
 
 Document* Cel::document() const
@@ -172,8 +175,13 @@ Grid Cel::grid() const
 
 void Cel::fixupImage()
 {
-  // Change the mask color to the sprite mask color
-  if (m_layer && image()) {
+  // Change the mask color to the sprite mask color (a lazy image is
+  // not loaded here, its loader must create it with the correct mask
+  // color)
+  if (m_layer && m_data && !m_data->isImageLoaded()) {
+    m_data->adjustBounds(m_layer);
+  }
+  else if (m_layer && image()) {
     image()->setMaskColor((image()->pixelFormat() == IMAGE_TILEMAP) ?
                             notile : m_layer->sprite()->transparentColor());
     ASSERT(m_data);
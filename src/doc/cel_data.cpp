@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2022 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -31,9 +31,22 @@ CelData::CelData(const ImageRef& image)
 {
 }
 
+CelData::CelData(const gfx::Size& imageSize, const ImageLoaderRef& loader)
+  : WithUserData(ObjectType::CelData)
+  , m_loader(loader)
+  , m_lazy(true)
+  , m_opacity(255)
+  , m_bounds(0, 0, imageSize.w, imageSize.h)
+  , m_boundsF(nullptr)
+{
+  ASSERT(loader);
+}
+
+// The copy has its own image (we have to load the lazy image from
+// the original cel data).
 CelData::CelData(const CelData& celData)
   : WithUserData(ObjectType::CelData)
-  , m_image(celData.m_image)
+  , m_image(celData.imageRef())
   , m_opacity(celData.m_opacity)
   , m_bounds(celData.m_bounds)
   , m_boundsF(celData.m_boundsF ? std::make_unique<gfx::RectF>(*celData.m_boundsF):
@@ -49,10 +62,31 @@ void CelData::setImage(const ImageRef& image, Layer* layer)
 {
   ASSERT(image.get());
 
-  m_image = image;
+  {
+    std::lock_guard lock(m_loaderMutex);
+    m_image = image;
+    m_loader.reset();
+    m_lazy = false;
+  }
   adjustBounds(layer);
 }
 
+void CelData::unloadImage(const ImageLoaderRef& loader)
+{
+  ASSERT(loader);
+
+  std::lock_guard lock(m_loaderMutex);
+  if (m_lazy)
+    return;
+
+  ASSERT(m_image);
+  ASSERT(!m_image->isTilemap());
+
+  m_image.reset();
+  m_loader = loader;
+  m_lazy = true;
+}
+
 void CelData::setPosition(const gfx::Point& pos)
 {
   m_bounds.setOrigin(pos);
@@ -62,6 +96,11 @@ void CelData::setPosition(const gfx::Point& pos)
 
 void CelData::adjustBounds(Layer* layer)
 {
+  // Lazy images are never tilemaps, the bounds already have the size
+  // of the image that will be loaded.
+  if (m_lazy)
+    return;
+
   ASSERT(m_image);
   if (m_image->pixelFormat() == IMAGE_TILEMAP) {
     Tileset* tileset = nullptr;
@@ -81,4 +120,21 @@ void CelData::adjustBounds(Layer* layer)
   m_bounds.h = m_image->height();
 }
 
+void CelData::loadLazyImage() const
+{
+  // Several threads can try to access the image at the same time
+  // (e.g. rendering tiles in parallel), only the first one loads it.
+  std::lock_guard lock(m_loaderMutex);
+  if (!m_lazy)
+    return;
+
+  ASSERT(m_loader);
+  ImageRef image = m_loader->loadImage();
+  ASSERT(image);
+
+  m_image = image;
+  m_loader.reset();
+  m_lazy = false;
+}
+
 } // namespace doc
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,12 +9,15 @@
 #define DOC_CEL_DATA_H_INCLUDED
 #pragma once
 
+#include "doc/image_loader.h"
 #include "doc/image_ref.h"
 #include "doc/object.h"
 #include "doc/with_user_data.h"
 #include "gfx/rect.h"
 
+#include <atomic>
 #include <memory>
+#include <mutex>
 
 namespace doc {
 
@@ -24,27 +27,49 @@ namespace doc {
   class CelData : public WithUserData {
   public:
     CelData(const ImageRef& image);
+    // Creates a cel data with a lazy image of the given size, the
+    // image will be created with the loader when it's accessed for
+    // the first time.
+    CelData(const gfx::Size& imageSize, const ImageLoaderRef& loader);
     CelData(const CelData& celData);
     ~CelData();
 
     gfx::Point position() const { return m_bounds.origin(); }
     const gfx::Rect& bounds() const { return m_bounds; }
     int opacity() const { return m_opacity; }
-    Image* image() const { return const_cast<Image*>(m_image.get()); };
-    ImageRef imageRef() const { return m_image; }
+    Image* image() const {
+      if (m_lazy)
+        loadLazyImage();
+      return const_cast<Image*>(m_image.get());
+    };
+    ImageRef imageRef() const {
+      if (m_lazy)
+        loadLazyImage();
+      return m_image;
+    }
+
+    // Returns false if the image is still waiting to be loaded by its
+    // ImageLoader.
+    bool isImageLoaded() const { return !m_lazy; }
 
     // Returns a rectangle with the bounds of the image (width/height
     // of the image) in the position of the cel (useful to compare
     // active tilemap bounds when we have to change the tilemap cel
     // bounds).
     gfx::Rect imageBounds() const {
+      const Image* image = this->image();
       return gfx::Rect(m_bounds.x,
                        m_bounds.y,
-                       m_image->width(),
-                       m_image->height());
+                       image->width(),
+                       image->height());
     }
 
     void setImage(const ImageRef& image, Layer* layer);
+
+    // Releases the image, it will be created again with the given
+    // loader when it's accessed (the loader must create an image with
+    // the same spec). Tilemaps cannot be unloaded.
+    void unloadImage(const ImageLoaderRef& loader);
     void setPosition(const gfx::Point& pos);
 
     void setOpacity(int opacity) {
@@ -80,7 +105,10 @@ namespace doc {
       return m_boundsF != nullptr;
     }
 
+    // A lazy image doesn't use memory until it's loaded.
     virtual int getMemSize() const override {
+      if (m_lazy)
+        return sizeof(CelData);
       ASSERT(m_image);
       return sizeof(CelData) + m_image->getMemSize();
     }
@@ -88,7 +116,15 @@ namespace doc {
     void adjustBounds(Layer* layer);
 
   private:
-    ImageRef m_image;
+    void loadLazyImage() const;
+
+    mutable ImageRef m_image;
+
+    // Used to load the image on demand (only if m_lazy is true).
+    mutable ImageLoaderRef m_loader;
+    mutable std::atomic<bool> m_lazy = false;
+    mutable std::mutex m_loaderMutex;
+
     int m_opacity;
     gfx::Rect m_bounds;
 
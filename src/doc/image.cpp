@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -14,6 +14,8 @@
 #include "doc/algo.h"
 #include "doc/brush.h"
 #include "doc/image_impl.h"
+#include "doc/image_mipmaps.h"
+#include "doc/image_occupancy.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/rgbmap.h"
@@ -30,6 +32,61 @@ Image::~Image()
 {
 }
 
+std::shared_ptr<const ImageOccupancy> Image::occupancy() const
+{
+  std::lock_guard lock(m_occupancyMutex);
+  if (!m_occupancy ||
+      m_occupancyVersion != version() ||
+      m_occupancy->maskColor() != maskColor()) {
+    m_occupancy = std::make_shared<ImageOccupancy>(this);
+    m_occupancyVersion = version();
+  }
+  return m_occupancy;
+}
+
+std::shared_ptr<const ImageMipmaps> Image::mipmaps() const
+{
+  std::lock_guard lock(m_mipmapsMutex);
+  if (!m_mipmaps ||
+      m_mipmapsVersion != version()) {
+    m_mipmaps = std::make_shared<ImageMipmaps>(this);
+    m_mipmapsVersion = version();
+  }
+  return m_mipmaps;
+}
+
+uint64_t Image::hash() const
+{
+  std::lock_guard lock(m_hashMutex);
+  if (!m_hashValid ||
+      m_hashVersion != version()) {
+    m_hash = calculate_image_hash64(this, bounds());
+    m_hashVersion = version();
+    m_hashValid = true;
+  }
+  return m_hash;
+}
+
+void Image::discardHash()
+{
+  std::lock_guard lock(m_hashMutex);
+  m_hashValid = false;
+}
+
+void Image::discardCompressedData()
+{
+  m_compressedData.clear();
+  m_compressedDataVersion = 0;
+}
+
+void Image::setCompressedData(base::buffer&& buffer) const
+{
+  if (!buffer.empty()) {
+    m_compressedData = std::move(buffer);
+    m_compressedDataVersion = version();
+  }
+}
+
 int Image::getMemSize() const
 {
   return sizeof(Image) + getRowStrideSize()*height();
@@ -74,8 +131,37 @@ Image* Image::create(const ImageSpec& spec,
 Image* Image::createCopy(const Image* image, const ImageBufferPtr& buffer)
 {
   ASSERT(image);
-  return crop_image(image, 0, 0, image->width(), image->height(),
-                    image->maskColor(), buffer);
+  Image* copy = Image::create(image->pixelFormat(),
+                              image->width(), image->height(), buffer);
+  if (!copy)
+    return nullptr;
+
+  // All pixels are copied, so we don't need to clear the new image
+  // first (as crop_image() does)
+  copy->setMaskColor(image->maskColor());
+  copy->copy(image, gfx::Clip(image->bounds()));
+
+  // The copy has the same pixels, so it can re-use the cached hash
+  // and occupancy of the original image (e.g. when a layer/frame is
+  // duplicated)
+  {
+    std::lock_guard lock(image->m_hashMutex);
+    if (image->m_hashValid &&
+        image->m_hashVersion == image->version()) {
+      copy->m_hash = image->m_hash;
+      copy->m_hashVersion = copy->version();
+      copy->m_hashValid = true;
+    }
+  }
+  {
+    std::lock_guard lock(image->m_occupancyMutex);
+    if (image->m_occupancy &&
+        image->m_occupancyVersion == image->version()) {
+      copy->m_occupancy = image->m_occupancy;
+      copy->m_occupancyVersion = copy->version();
+    }
+  }
+  return copy;
 }
 
 } // namespace doc
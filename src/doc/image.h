@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2020 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,6 +9,7 @@
 #define DOC_IMAGE_H_INCLUDED
 #pragma once
 
+#include "base/buffer.h"
 #include "doc/color.h"
 #include "doc/color_mode.h"
 #include "doc/image_buffer.h"
@@ -19,9 +20,14 @@
 #include "gfx/rect.h"
 #include "gfx/size.h"
 
+#include <memory>
+#include <mutex>
+
 namespace doc {
 
   template<typename ImageTraits> class ImageBits;
+  class ImageMipmaps;
+  class ImageOccupancy;
   class Palette;
   class Pen;
   class RgbMap;
@@ -86,11 +92,59 @@ namespace doc {
     virtual void fillRect(int x1, int y1, int x2, int y2, color_t color) = 0;
     virtual void blendRect(int x1, int y1, int x2, int y2, color_t color, int opacity) = 0;
 
+    // Returns the bitmap of non-empty blocks of this image. It's
+    // calculated the first time it's needed and then cached until
+    // the image version (or the mask color) changes, so it can be
+    // used only with images that are modified through commands
+    // (which increment the version of the modified images).
+    std::shared_ptr<const ImageOccupancy> occupancy() const;
+
+    // Returns the reduced versions of this image. As occupancy(),
+    // they are cached until the image version changes.
+    std::shared_ptr<const ImageMipmaps> mipmaps() const;
+
+    // Returns calculate_image_hash64() of the whole image. It's
+    // cached until the image version changes, so discardHash() must
+    // be called if the pixels are modified without incrementing the
+    // version (e.g. a tile modified before calling
+    // Tileset::notifyTileContentChange()).
+    uint64_t hash() const;
+    void discardHash();
+
+    // Compressed pixels of this image from the last time it was
+    // loaded/saved in an .aseprite file. It can be re-used to save
+    // the image again (without re-compressing it) while the image
+    // version is equal to compressedDataVersion().
+    void discardCompressedData();
+    void setCompressedData(base::buffer&& buffer) const;
+    const base::buffer& compressedData() const { return m_compressedData; }
+    ObjectVersion compressedDataVersion() const { return m_compressedDataVersion; }
+
   protected:
     Image(const ImageSpec& spec);
 
   private:
     ImageSpec m_spec;
+
+    // Cached occupancy() result
+    mutable std::mutex m_occupancyMutex;
+    mutable std::shared_ptr<const ImageOccupancy> m_occupancy;
+    mutable ObjectVersion m_occupancyVersion = 0;
+
+    // Cached mipmaps() result
+    mutable std::mutex m_mipmapsMutex;
+    mutable std::shared_ptr<const ImageMipmaps> m_mipmaps;
+    mutable ObjectVersion m_mipmapsVersion = 0;
+
+    // Cached hash() result
+    mutable std::mutex m_hashMutex;
+    mutable uint64_t m_hash = 0;
+    mutable ObjectVersion m_hashVersion = 0;
+    mutable bool m_hashValid = false;
+
+    // Cached compressed data
+    mutable base::buffer m_compressedData;
+    mutable ObjectVersion m_compressedDataVersion = 0;
   };
 
 } // namespace doc
@@ -0,0 +1,133 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_buffer_pool.h"
+
+#include "doc/image.h"
+#include "doc/image_spec.h"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace doc {
+
+namespace {
+
+// Buffers are grouped in power of two size classes from 64KB (smaller
+// images are cheap to allocate)
+const int kMinClassBits = 16;
+const int kClasses = 48 - kMinClassBits;
+
+// Released buffers that we keep for each size class, and the maximum
+// amount of memory that we keep in the whole pool
+const std::size_t kMaxBuffersPerClass = 4;
+const std::size_t kMaxPoolBytes = 256*1024*1024;
+
+class Pool {
+public:
+  std::unique_ptr<ImageBuffer> pop(const int sizeClass) {
+    std::lock_guard lock(m_mutex);
+    auto& buffers = m_classes[sizeClass];
+    if (buffers.empty())
+      return nullptr;
+
+    std::unique_ptr<ImageBuffer> buffer = std::move(buffers.back());
+    buffers.pop_back();
+    m_bytes -= buffer->size();
+    return buffer;
+  }
+
+  void push(const int sizeClass, std::unique_ptr<ImageBuffer>&& buffer) {
+    std::lock_guard lock(m_mutex);
+    auto& buffers = m_classes[sizeClass];
+    if (buffers.size() < kMaxBuffersPerClass &&
+        m_bytes + buffer->size() <= kMaxPoolBytes) {
+      m_bytes += buffer->size();
+      buffers.push_back(std::move(buffer));
+    }
+  }
+
+  void clear() {
+    std::lock_guard lock(m_mutex);
+    for (auto& buffers : m_classes)
+      buffers.clear();
+    m_bytes = 0;
+  }
+
+private:
+  std::mutex m_mutex;
+  std::array<std::vector<std::unique_ptr<ImageBuffer>>, kClasses> m_classes;
+  std::size_t m_bytes = 0;
+};
+
+// The pool is referenced by a shared_ptr so buffers released after
+// it's destroyed (e.g. from static ImageBufferPtrs at exit) are just
+// deleted.
+const std::shared_ptr<Pool>& get_pool()
+{
+  static std::shared_ptr<Pool> pool = std::make_shared<Pool>();
+  return pool;
+}
+
+int size_class(const std::size_t size)
+{
+  int bits = kMinClassBits;
+  while (bits < kMinClassBits+kClasses-1 &&
+         (std::size_t(1) << bits) < size)
+    ++bits;
+  return bits - kMinClassBits;
+}
+
+} // anonymous namespace
+
+ImageBufferPtr get_pooled_image_buffer(const std::size_t size)
+{
+  const int sizeClass = size_class(size);
+  const std::size_t classSize = (std::size_t(1) << (sizeClass + kMinClassBits));
+  if (classSize < size)            // Too big for the pool
+    return std::make_shared<ImageBuffer>(size);
+
+  std::unique_ptr<ImageBuffer> buffer = get_pool()->pop(sizeClass);
+  if (!buffer)
+    buffer = std::make_unique<ImageBuffer>(classSize);
+
+  std::weak_ptr<Pool> pool = get_pool();
+  return ImageBufferPtr(
+    buffer.release(),
+    [pool, sizeClass](ImageBuffer* ptr){
+      std::unique_ptr<ImageBuffer> buffer(ptr);
+      // If "resizeIfNecessary()" was used with a bigger size, the
+      // buffer doesn't belong to this size class anymore
+      if (buffer->size() != (std::size_t(1) << (sizeClass + kMinClassBits)))
+        return;
+      if (auto p = pool.lock())
+        p->push(sizeClass, std::move(buffer));
+    });
+}
+
+ImageBufferPtr get_pooled_image_buffer(const ImageSpec& spec)
+{
+  // Same size used by ImageImpl (row pointers + pixels)
+  const std::size_t rows = spec.height();
+  const std::size_t size =
+    sizeof(void*) * rows +
+    std::size_t(calculate_rowstride_bytes((PixelFormat)spec.colorMode(),
+                                          spec.width())) * rows;
+  return get_pooled_image_buffer(size);
+}
+
+void clear_image_buffer_pool()
+{
+  get_pool()->clear();
+}
+
+} // namespace doc
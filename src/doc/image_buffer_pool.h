@@ -0,0 +1,37 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#define DOC_IMAGE_BUFFER_POOL_H_INCLUDED
+#pragma once
+
+#include "doc/image_buffer.h"
+
+#include <cstddef>
+
+namespace doc {
+
+  class ImageSpec;
+
+  // Returns an image buffer of at least the given size from a pool
+  // of buffers that were already released (or a new one). The buffer
+  // goes back to the pool when the last ImageBufferPtr that
+  // references it is destroyed, so temporary images created on each
+  // repaint/preview can re-use the memory of the previous ones. It
+  // can be used from any thread (each returned buffer is used only
+  // by the caller).
+  ImageBufferPtr get_pooled_image_buffer(const std::size_t size);
+
+  // Returns a pooled buffer big enough to create an image with the
+  // given spec with Image::create(spec, buffer).
+  ImageBufferPtr get_pooled_image_buffer(const ImageSpec& spec);
+
+  // Releases all the buffers that are not being used.
+  void clear_image_buffer_pool();
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,59 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_buffer_pool.h"
+#include "doc/image_spec.h"
+
+#include <memory>
+
+using namespace doc;
+
+TEST(ImageBufferPool, ReuseReleasedBuffers)
+{
+  clear_image_buffer_pool();
+
+  uint8_t* ptr;
+  {
+    ImageBufferPtr a = get_pooled_image_buffer(100000);
+    EXPECT_GE(a->size(), 100000u);
+    ptr = a->buffer();
+
+    // A buffer in use is not returned again
+    ImageBufferPtr b = get_pooled_image_buffer(100000);
+    EXPECT_NE(ptr, b->buffer());
+  }
+
+  // Same size class ("a" was the last released buffer)
+  ImageBufferPtr c = get_pooled_image_buffer(90000);
+  EXPECT_EQ(ptr, c->buffer());
+}
+
+TEST(ImageBufferPool, CreateImages)
+{
+  clear_image_buffer_pool();
+
+  ImageSpec spec(ColorMode::RGB, 256, 256);
+  ImageBufferPtr buf = get_pooled_image_buffer(spec);
+  const std::size_t size = buf->size();
+
+  std::unique_ptr<Image> image(Image::create(spec, buf));
+  ASSERT_TRUE(image != nullptr);
+  EXPECT_EQ(size, buf->size()); // The buffer is not resized
+  EXPECT_EQ(0, image->getPixel(255, 255));
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,35 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_LOADER_H_INCLUDED
+#define DOC_IMAGE_LOADER_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+
+#include <memory>
+
+namespace doc {
+
+  // Creates the image of a CelData when it's accessed for the first
+  // time (e.g. to decode the pixels of a cel from a file only when it
+  // is needed).
+  class ImageLoader {
+  public:
+    virtual ~ImageLoader() { }
+
+    // Returns the loaded image. It must have the size specified when
+    // the CelData was created, and should never return nullptr (e.g. a
+    // blank image can be returned in case of error). It can be called
+    // from any thread.
+    virtual ImageRef loadImage() = 0;
+  };
+
+  typedef std::shared_ptr<ImageLoader> ImageLoaderRef;
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,80 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_mipmaps.h"
+
+#include "doc/image.h"
+#include "doc/image_traits.h"
+
+namespace doc {
+
+namespace {
+
+template<typename ImageTraits>
+void pick_pixels(const Image* src, Image* dst, const int step)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  for (int y=0; y<dst->height(); ++y) {
+    const pixel_t* s = (const pixel_t*)src->getPixelAddress(0, y*step);
+    pixel_t* d = (pixel_t*)dst->getPixelAddress(0, y);
+    for (int x=0; x<dst->width(); ++x, s+=step)
+      d[x] = *s;
+  }
+}
+
+} // anonymous namespace
+
+ImageMipmaps::ImageMipmaps(const Image* image)
+  : m_image(image)
+{
+  ASSERT(image);
+}
+
+ImageRef ImageMipmaps::level(const int level) const
+{
+  ASSERT(level >= 1 && level <= kMaxLevel);
+  std::lock_guard lock(m_mutex);
+
+  if (!m_levels[level]) {
+    // Create the level from the closest previous level
+    int prev = level-1;
+    while (prev > 0 && !m_levels[prev])
+      --prev;
+
+    const Image* src = (prev > 0 ? m_levels[prev].get(): m_image);
+    m_levels[level].reset(createLevel(src, level-prev));
+  }
+  return m_levels[level];
+}
+
+// static
+Image* ImageMipmaps::createLevel(const Image* image, const int levels)
+{
+  ASSERT(levels > 0);
+
+  const int step = (1 << levels);
+  ImageSpec spec = image->spec();
+  spec.setSize((image->width() + step - 1) / step,
+               (image->height() + step - 1) / step);
+
+  Image* dst = Image::create(spec);
+  switch (image->pixelFormat()) {
+    case IMAGE_RGB:       pick_pixels<RgbTraits>(image, dst, step); break;
+    case IMAGE_GRAYSCALE: pick_pixels<GrayscaleTraits>(image, dst, step); break;
+    case IMAGE_INDEXED:   pick_pixels<IndexedTraits>(image, dst, step); break;
+    case IMAGE_TILEMAP:   pick_pixels<TilemapTraits>(image, dst, step); break;
+    default:
+      ASSERT(false && "Mipmaps of bitmaps are not supported");
+      break;
+  }
+  return dst;
+}
+
+} // namespace doc
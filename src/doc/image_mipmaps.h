@@ -0,0 +1,48 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_MIPMAPS_H_INCLUDED
+#define DOC_IMAGE_MIPMAPS_H_INCLUDED
+#pragma once
+
+#include "doc/image_ref.h"
+
+#include <array>
+#include <mutex>
+
+namespace doc {
+
+  class Image;
+
+  // Reduced versions of an image (1/2, 1/4, 1/8, etc.) where the
+  // pixel (x, y) of the level N is the pixel (x*2^N, y*2^N) of the
+  // original image, i.e. the same pixel that a nearest neighbor
+  // scale down picks from the original image. Levels are created
+  // the first time they are requested.
+  //
+  // Use Image::mipmaps() to get a cached version of this chain.
+  class ImageMipmaps {
+  public:
+    enum { kMaxLevel = 6 };     // 1/64
+
+    explicit ImageMipmaps(const Image* image);
+
+    // Returns the given level (1 to kMaxLevel) of the image.
+    ImageRef level(int level) const;
+
+    // Creates the given level from an image of the previous levels
+    // (i.e. picking one pixel for each 2^levels x 2^levels block).
+    static Image* createLevel(const Image* image, int levels);
+
+  private:
+    const Image* m_image;
+    mutable std::mutex m_mutex;
+    mutable std::array<ImageRef, kMaxLevel+1> m_levels;
+  };
+
+} // namespace doc
+
+#endif
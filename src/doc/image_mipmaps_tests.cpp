@@ -0,0 +1,50 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image.h"
+#include "doc/image_mipmaps.h"
+
+#include <memory>
+
+using namespace doc;
+
+TEST(ImageMipmaps, PickPixels)
+{
+  ImageRef image(Image::create(IMAGE_RGB, 100, 37));
+  for (int y=0; y<image->height(); ++y)
+    for (int x=0; x<image->width(); ++x)
+      image->putPixel(x, y, rgba(x, y, x+y, 255));
+
+  auto mipmaps = image->mipmaps();
+
+  // Create levels in different order (level 3 is created from level 1)
+  for (int level : { 1, 3, 2, 6 }) {
+    const int step = (1 << level);
+    ImageRef mip = mipmaps->level(level);
+    ASSERT_EQ((100 + step - 1) / step, mip->width());
+    ASSERT_EQ((37 + step - 1) / step, mip->height());
+    for (int y=0; y<mip->height(); ++y)
+      for (int x=0; x<mip->width(); ++x)
+        ASSERT_EQ(image->getPixel(x*step, y*step), mip->getPixel(x, y));
+  }
+
+  // Cached until the image version changes
+  EXPECT_EQ(mipmaps, image->mipmaps());
+  image->incrementVersion();
+  EXPECT_NE(mipmaps, image->mipmaps());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,155 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/image_occupancy.h"
+
+#include "doc/image.h"
+#include "doc/image_traits.h"
+
+#include <algorithm>
+
+namespace doc {
+
+namespace {
+
+template<typename ImageTraits>
+bool is_block_occupied(const Image* image,
+                       const gfx::Rect& rc,
+                       const color_t maskColor)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  const pixel_t mask = pixel_t(maskColor);
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    const pixel_t* p = (const pixel_t*)image->getPixelAddress(rc.x, y);
+    if (std::any_of(p, p+rc.w, [mask](const pixel_t c){ return c != mask; }))
+      return true;
+  }
+  return false;
+}
+
+// Returns true if all pixels in the given block are opaque.
+template<typename ImageTraits>
+bool is_block_opaque(const Image* image,
+                     const gfx::Rect& rc,
+                     const typename ImageTraits::pixel_t alphaMask)
+{
+  using pixel_t = typename ImageTraits::pixel_t;
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    const pixel_t* p = (const pixel_t*)image->getPixelAddress(rc.x, y);
+    if (!std::all_of(p, p+rc.w, [alphaMask](const pixel_t c){
+                                  return (c & alphaMask) == alphaMask;
+                                }))
+      return false;
+  }
+  return true;
+}
+
+} // anonymous namespace
+
+ImageOccupancy::ImageOccupancy()
+  : m_width(0)
+  , m_height(0)
+  , m_cols(0)
+  , m_rows(0)
+  , m_occupied(0)
+  , m_opaque(false)
+  , m_maskColor(0)
+{
+}
+
+ImageOccupancy::ImageOccupancy(const Image* image)
+  : m_width(image->width())
+  , m_height(image->height())
+  , m_cols((image->width() + kBlockSize - 1) / kBlockSize)
+  , m_rows((image->height() + kBlockSize - 1) / kBlockSize)
+  , m_occupied(0)
+  , m_opaque(image->pixelFormat() == IMAGE_RGB ||
+             image->pixelFormat() == IMAGE_GRAYSCALE)
+  , m_maskColor(image->maskColor())
+  , m_blocks(m_cols*m_rows, kMixedBlock)
+{
+  const bool canBeOpaque = m_opaque;
+
+  for (int by=0; by<m_rows; ++by) {
+    for (int bx=0; bx<m_cols; ++bx) {
+      const gfx::Rect rc = blockBounds(bx, by);
+
+      // An opaque block is occupied (the mask color is transparent)
+      if (canBeOpaque) {
+        bool opaque = false;
+        switch (image->pixelFormat()) {
+          case IMAGE_RGB:       opaque = is_block_opaque<RgbTraits>(image, rc, rgba_a_mask); break;
+          case IMAGE_GRAYSCALE: opaque = is_block_opaque<GrayscaleTraits>(image, rc, graya_a_mask); break;
+        }
+        if (opaque) {
+          m_blocks[by*m_cols + bx] = kOpaqueBlock;
+          ++m_occupied;
+          continue;
+        }
+        m_opaque = false;
+      }
+
+      bool occupied;
+      switch (image->pixelFormat()) {
+        case IMAGE_RGB:       occupied = is_block_occupied<RgbTraits>(image, rc, m_maskColor); break;
+        case IMAGE_GRAYSCALE: occupied = is_block_occupied<GrayscaleTraits>(image, rc, m_maskColor); break;
+        case IMAGE_INDEXED:   occupied = is_block_occupied<IndexedTraits>(image, rc, m_maskColor); break;
+        case IMAGE_TILEMAP:   occupied = is_block_occupied<TilemapTraits>(image, rc, m_maskColor); break;
+        default:
+          // Bitmaps are not scanned (all blocks are occupied)
+          occupied = true;
+          break;
+      }
+      m_blocks[by*m_cols + bx] = (occupied ? kMixedBlock: kEmptyBlock);
+      if (occupied)
+        ++m_occupied;
+    }
+  }
+}
+
+gfx::Rect ImageOccupancy::blockBounds(const int bx, const int by) const
+{
+  return gfx::Rect(bx*kBlockSize, by*kBlockSize, kBlockSize, kBlockSize)
+    .createIntersection(gfx::Rect(0, 0, m_width, m_height));
+}
+
+void ImageOccupancy::occupiedRects(const gfx::Rect& area,
+                                   std::vector<gfx::Rect>& rects,
+                                   std::vector<gfx::Rect>* opaqueRects) const
+{
+  const gfx::Rect rc = area.createIntersection(gfx::Rect(0, 0, m_width, m_height));
+  if (rc.isEmpty())
+    return;
+
+  const int bx1 = rc.x / kBlockSize;
+  const int by1 = rc.y / kBlockSize;
+  const int bx2 = (rc.x2()-1) / kBlockSize;
+  const int by2 = (rc.y2()-1) / kBlockSize;
+
+  for (int by=by1; by<=by2; ++by) {
+    for (int bx=bx1; bx<=bx2; ++bx) {
+      if (isBlockEmpty(bx, by))
+        continue;
+
+      // Merge this block with the next blocks in the row of the same
+      // kind (non-empty, or opaque if opaqueRects is used)
+      const bool opaque = (opaqueRects && isBlockOpaque(bx, by));
+      gfx::Rect run = blockBounds(bx, by);
+      while (bx < bx2 &&
+             !isBlockEmpty(bx+1, by) &&
+             (!opaqueRects || isBlockOpaque(bx+1, by) == opaque))
+        run |= blockBounds(++bx, by);
+
+      (opaque ? *opaqueRects: rects).push_back(run.createIntersection(rc));
+    }
+  }
+}
+
+} // namespace doc
@@ -0,0 +1,85 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_IMAGE_OCCUPANCY_H_INCLUDED
+#define DOC_IMAGE_OCCUPANCY_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+#include "gfx/rect.h"
+
+#include <vector>
+
+namespace doc {
+
+  class Image;
+
+  // Bitmap of the blocks (kBlockSize x kBlockSize pixels) of an
+  // image that contain at least one pixel different from the image
+  // mask color. Empty blocks can be skipped when we composite the
+  // image (the blenders skip pixels with the mask color anyway).
+  //
+  // Use Image::occupancy() to get a cached version of this bitmap.
+  class ImageOccupancy {
+  public:
+    enum { kBlockSize = 64 };
+
+    ImageOccupancy();
+    explicit ImageOccupancy(const Image* image);
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+    color_t maskColor() const { return m_maskColor; }
+
+    bool isBlockEmpty(const int bx, const int by) const {
+      return m_blocks[by*m_cols + bx] == kEmptyBlock;
+    }
+
+    // True if all pixels of the block have alpha=255 (only for RGB
+    // and grayscale images).
+    bool isBlockOpaque(const int bx, const int by) const {
+      return m_blocks[by*m_cols + bx] == kOpaqueBlock;
+    }
+
+    // True if all pixels of the image are equal to the mask color.
+    bool isEmpty() const { return m_occupied == 0; }
+
+    // True if all blocks are occupied (there is nothing to skip).
+    bool isFull() const { return m_occupied == int(m_blocks.size()); }
+
+    // True if all pixels of a RGB or grayscale image have alpha=255,
+    // so the image can be copied directly (without blending) when it
+    // is composited with normal blend mode and full opacity.
+    bool isOpaque() const { return m_opaque; }
+
+    // Bounds of the given block in image coordinates.
+    gfx::Rect blockBounds(const int bx, const int by) const;
+
+    // Returns the list of rectangles (in image coordinates) that
+    // cover all non-empty blocks intersecting the given area. Adjacent
+    // non-empty blocks of the same row are merged in one rectangle.
+    // If "opaqueRects" is specified, opaque blocks are returned in
+    // that list instead (so they can be copied without blending).
+    void occupiedRects(const gfx::Rect& area,
+                       std::vector<gfx::Rect>& rects,
+                       std::vector<gfx::Rect>* opaqueRects = nullptr) const;
+
+  private:
+    enum : uint8_t { kEmptyBlock, kMixedBlock, kOpaqueBlock };
+
+    int m_width;
+    int m_height;
+    int m_cols;
+    int m_rows;
+    int m_occupied;
+    bool m_opaque;
+    color_t m_maskColor;
+    std::vector<uint8_t> m_blocks;
+  };
+
+} // namespace doc
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,7 @@
 #include <gtest/gtest.h>
 
 #include "doc/image_impl.h"
+#include "doc/image_occupancy.h"
 #include "doc/primitives.h"
 
 #include <memory>
@@ -153,6 +154,90 @@ TEST(Image, DiffRgbImages)
   ASSERT_FALSE(is_same_image(a.get(), b.get()));
 }
 
+TEST(Image, CachedHash)
+{
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 16, 16));
+  std::unique_ptr<Image> b(Image::create(IMAGE_RGB, 16, 16));
+  clear_image(a.get(), rgba(0, 0, 0, 0));
+  clear_image(b.get(), rgba(0, 0, 0, 0));
+  EXPECT_EQ(a->hash(), b->hash());
+  EXPECT_EQ(calculate_image_hash64(a.get(), a->bounds()), a->hash());
+
+  // The hash is cached until the version changes
+  const uint64_t hash0 = a->hash();
+  put_pixel(a.get(), 3, 4, rgba(255, 0, 0, 255));
+  EXPECT_EQ(hash0, a->hash());
+  a->incrementVersion();
+  EXPECT_NE(hash0, a->hash());
+  EXPECT_EQ(calculate_image_hash64(a.get(), a->bounds()), a->hash());
+
+  // Or until it's discarded
+  put_pixel(b.get(), 3, 4, rgba(255, 0, 0, 255));
+  b->discardHash();
+  EXPECT_EQ(a->hash(), b->hash());
+
+  // Hash of a sub-rectangle
+  std::unique_ptr<Image> c(Image::create(IMAGE_RGB, 32, 32));
+  clear_image(c.get(), rgba(0, 0, 0, 0));
+  const uint32_t hash1 = calculate_image_hash(c.get(), gfx::Rect(8, 8, 16, 16));
+  put_pixel(c.get(), 9, 9, rgba(255, 0, 0, 255));
+  EXPECT_NE(hash1, calculate_image_hash(c.get(), gfx::Rect(8, 8, 16, 16)));
+  put_pixel(c.get(), 9, 9, rgba(0, 0, 0, 0));
+  put_pixel(c.get(), 30, 30, rgba(255, 0, 0, 255));
+  EXPECT_EQ(hash1, calculate_image_hash(c.get(), gfx::Rect(8, 8, 16, 16)));
+}
+
+TEST(Image, OccupancyOpaque)
+{
+  // 2x2 blocks
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 100, 100));
+  clear_image(a.get(), rgba(255, 0, 0, 255));
+  EXPECT_TRUE(a->occupancy()->isOpaque());
+  EXPECT_TRUE(a->occupancy()->isFull());
+
+  put_pixel(a.get(), 99, 99, rgba(255, 0, 0, 254));
+  a->incrementVersion();
+  EXPECT_FALSE(a->occupancy()->isOpaque());
+  EXPECT_TRUE(a->occupancy()->isFull());
+
+  put_pixel(a.get(), 99, 99, rgba(0, 0, 0, 0));
+  a->incrementVersion();
+  EXPECT_FALSE(a->occupancy()->isOpaque());
+  EXPECT_TRUE(a->occupancy()->isFull());
+
+  // Indexed images are never opaque (it depends on the palette)
+  std::unique_ptr<Image> b(Image::create(IMAGE_INDEXED, 16, 16));
+  clear_image(b.get(), 1);
+  EXPECT_FALSE(b->occupancy()->isOpaque());
+}
+
+TEST(Image, OccupancyOpaqueBlocks)
+{
+  // 3x1 blocks: opaque, mixed, opaque
+  std::unique_ptr<Image> a(Image::create(IMAGE_RGB, 150, 10));
+  clear_image(a.get(), rgba(255, 0, 0, 255));
+  put_pixel(a.get(), 70, 5, rgba(255, 0, 0, 128));
+  const auto occupancy = a->occupancy();
+  EXPECT_FALSE(occupancy->isOpaque());
+  EXPECT_TRUE(occupancy->isBlockOpaque(0, 0));
+  EXPECT_FALSE(occupancy->isBlockOpaque(1, 0));
+  EXPECT_TRUE(occupancy->isBlockOpaque(2, 0));
+
+  std::vector<gfx::Rect> rects, opaqueRects;
+  occupancy->occupiedRects(a->bounds(), rects, &opaqueRects);
+  ASSERT_EQ(1, rects.size());
+  EXPECT_EQ(gfx::Rect(64, 0, 64, 10), rects[0]);
+  ASSERT_EQ(2, opaqueRects.size());
+  EXPECT_EQ(gfx::Rect(0, 0, 64, 10), opaqueRects[0]);
+  EXPECT_EQ(gfx::Rect(128, 0, 22, 10), opaqueRects[1]);
+
+  // Without opaqueRects all blocks are merged
+  rects.clear();
+  occupancy->occupiedRects(a->bounds(), rects);
+  ASSERT_EQ(1, rects.size());
+  EXPECT_EQ(a->bounds(), rects[0]);
+}
+
 TYPED_TEST(ImageAllTypes, DrawHLine)
 {
   typedef TypeParam ImageTraits;
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,6 +11,7 @@
 
 #include "doc/frame.h"
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -166,20 +167,19 @@ namespace doc {
     std::size_t size() const { return m_keys.size(); }
     bool empty() const { return m_keys.empty(); }
 
+    // Returns the key that is used in the given frame (the last key
+    // with a frame <= the given frame, or the first key if the frame
+    // is before it). It uses a binary search as keys are sorted by
+    // frame.
     iterator getIterator(const frame_t frame) {
-      auto
-        it = m_keys.begin(),
-        end = m_keys.end();
-      auto next = it;
-      for (; it != end; it=next) {
-        ++next;
-        if (((frame >= it->frame()) &&
-             (next == end || frame < next->frame())) ||
-            (frame < it->frame())) {
-          return it;
-        }
-      }
-      return end;
+      auto it = std::upper_bound(
+        m_keys.begin(), m_keys.end(), frame,
+        [](const frame_t frame, const Key& key){
+          return frame < key.frame();
+        });
+      if (it != m_keys.begin())
+        --it;
+      return it;
     }
 
     frame_t fromFrame() const {
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2022 Igara Studio S.A.
+// Copyright (c) 2022-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -139,6 +139,20 @@ TEST(Keyframes, BugEmptyCount)
   EXPECT_EQ(5, **k.range(8, 9).begin());
 }
 
+TEST(Keyframes, ManyKeys)
+{
+  Keyframes<int> k;
+  for (int i=0; i<1000; ++i)
+    k.insert(i*2, std::make_unique<int>(i));
+  EXPECT_EQ(1000, k.size());
+  EXPECT_EQ(nullptr, k[-1]);
+  for (int i=0; i<1000; ++i) {
+    EXPECT_EQ(i, *k[i*2]);
+    EXPECT_EQ(i, *k[i*2+1]);
+  }
+  EXPECT_EQ(999, *k[5000]);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
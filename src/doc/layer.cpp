@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -46,6 +46,28 @@ int Layer::getMemSize() const
   return sizeof(Layer);
 }
 
+void Layer::setFlags(LayerFlags flags)
+{
+  if (m_flags != flags) {
+    m_flags = flags;
+    incrementStructureVersion();
+  }
+}
+
+void Layer::switchFlags(LayerFlags flags, bool state)
+{
+  if (state)
+    setFlags(LayerFlags(int(m_flags) | int(flags)));
+  else
+    setFlags(LayerFlags(int(m_flags) & ~int(flags)));
+}
+
+void Layer::incrementStructureVersion()
+{
+  if (m_sprite)
+    m_sprite->incrementStructureVersion();
+}
+
 Layer* Layer::getPrevious() const
 {
   if (m_parent) {
@@ -270,13 +292,13 @@ void LayerImage::destroyAllCels()
     delete cel;
   }
   m_cels.clear();
+  m_frameCels.clear();
 }
 
 Cel* LayerImage::cel(frame_t frame) const
 {
-  CelConstIterator it = findCelIterator(frame);
-  if (it != getCelEnd())
-    return *it;
+  if (frame >= 0 && frame < frame_t(m_frameCels.size()))
+    return m_frameCels[frame];
   else
     return nullptr;
 }
@@ -342,13 +364,16 @@ void LayerImage::addCel(Cel* cel)
 {
   ASSERT(cel);
   ASSERT(cel->data() && "The cel doesn't contain CelData");
-  ASSERT(cel->image());
   ASSERT(sprite());
-  ASSERT(cel->image()->pixelFormat() == sprite()->pixelFormat() ||
+  // Don't load lazy images just to check them
+  ASSERT(!cel->data()->isImageLoaded() || cel->image());
+  ASSERT(!cel->data()->isImageLoaded() ||
+         cel->image()->pixelFormat() == sprite()->pixelFormat() ||
          cel->image()->pixelFormat() == IMAGE_TILEMAP);
 
   CelIterator it = findFirstCelIteratorAfter(cel->frame());
   m_cels.insert(it, cel);
+  updateFrameCel(cel->frame());
 
   cel->setParentLayer(this);
 }
@@ -366,18 +391,66 @@ void LayerImage::removeCel(Cel* cel)
   ASSERT(it != m_cels.end());
 
   m_cels.erase(it);
+  updateFrameCel(cel->frame());
 
   cel->setParentLayer(NULL);
 }
 
 void LayerImage::moveCel(Cel* cel, frame_t frame)
 {
+  ASSERT(cel);
+  CelIterator it = findCelIterator(cel->frame());
+  ASSERT(it != m_cels.end());
+
+  // If the cel keeps its position in the sorted list (e.g. when
+  // frames are displaced), we can change its frame without
+  // moving the other cels in the list
+  if (it != m_cels.end() && *it == cel &&
+      (it == m_cels.begin() || (*(it-1))->frame() < frame) &&
+      (it+1 == m_cels.end() || (*(it+1))->frame() > frame)) {
+    const frame_t oldFrame = cel->frame();
+    cel->setParentLayer(nullptr);
+    cel->setFrame(frame);
+    cel->incrementVersion();    // TODO this should be in app::cmd module
+    cel->setParentLayer(this);
+    updateFrameCel(oldFrame);
+    updateFrameCel(frame);
+    return;
+  }
+
   removeCel(cel);
   cel->setFrame(frame);
   cel->incrementVersion();      // TODO this should be in app::cmd module
   addCel(cel);
 }
 
+void LayerImage::updateFrameCel(const frame_t frame)
+{
+  ASSERT(frame >= 0);
+  if (frame < 0)
+    return;
+
+  // The cel of this frame could be different (or the cel could be
+  // added in other position of m_cels)
+  incrementStructureVersion();
+
+  // The first cel in the given frame (as findCelIterator())
+  CelIterator it = findCelIterator(frame);
+  Cel* cel = (it != m_cels.end() ? *it: nullptr);
+
+  if (cel) {
+    if (frame >= frame_t(m_frameCels.size()))
+      m_frameCels.resize(frame+1, nullptr);
+    m_frameCels[frame] = cel;
+  }
+  else if (frame < frame_t(m_frameCels.size())) {
+    m_frameCels[frame] = nullptr;
+    // Remove empty frames at the end
+    while (!m_frameCels.empty() && !m_frameCels.back())
+      m_frameCels.pop_back();
+  }
+}
+
 /**
  * Configures some properties of the specified layer to make it as the
  * "Background" of the sprite.
@@ -400,17 +473,25 @@ void LayerImage::displaceFrames(frame_t fromThis, frame_t delta)
 {
   Sprite* sprite = this->sprite();
 
+  // Cels to be moved (instead of checking each frame from
+  // "fromThis" to the last frame)
+  CelList cels;
+  for (auto it=findFirstCelIteratorAfter(fromThis-1); it!=m_cels.end(); ++it) {
+    if ((*it)->frame() > sprite->lastFrame())
+      break;
+    cels.push_back(*it);
+  }
+
+  // Cels are moved from the last one if they are moved to the right
+  // (or from the first one if they are moved to the left), so each
+  // cel can keep its position in m_cels (see moveCel())
   if (delta > 0) {
-    for (frame_t c=sprite->lastFrame(); c>=fromThis; --c) {
-      if (Cel* cel = this->cel(c))
-        moveCel(cel, c+delta);
-    }
+    for (auto it=cels.rbegin(); it!=cels.rend(); ++it)
+      moveCel(*it, (*it)->frame()+delta);
   }
   else {
-    for (frame_t c=fromThis; c<=sprite->lastFrame(); ++c) {
-      if (Cel* cel = this->cel(c))
-        moveCel(cel, c+delta);
-    }
+    for (Cel* cel : cels)
+      moveCel(cel, cel->frame()+delta);
   }
 }
 
@@ -539,6 +620,7 @@ void LayerGroup::addLayer(Layer* layer)
 {
   m_layers.push_back(layer);
   layer->setParent(this);
+  incrementStructureVersion();
 }
 
 void LayerGroup::removeLayer(Layer* layer)
@@ -548,6 +630,7 @@ void LayerGroup::removeLayer(Layer* layer)
   m_layers.erase(it);
 
   layer->setParent(nullptr);
+  incrementStructureVersion();
 }
 
 void LayerGroup::insertLayer(Layer* layer, Layer* after)
@@ -561,6 +644,7 @@ void LayerGroup::insertLayer(Layer* layer, Layer* after)
   m_layers.insert(after_it, layer);
 
   layer->setParent(this);
+  incrementStructureVersion();
 }
 
 void LayerGroup::stackLayer(Layer* layer, Layer* after)
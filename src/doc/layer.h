@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2021  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,6 +17,7 @@
 #include "doc/with_user_data.h"
 
 #include <string>
+#include <vector>
 
 namespace doc {
 
@@ -111,22 +112,17 @@ namespace doc {
       return (int(m_flags) & int(flags)) == int(flags);
     }
 
-    void setFlags(LayerFlags flags) {
-      m_flags = flags;
-    }
-
-    void switchFlags(LayerFlags flags, bool state) {
-      if (state)
-        m_flags = LayerFlags(int(m_flags) | int(flags));
-      else
-        m_flags = LayerFlags(int(m_flags) & ~int(flags));
-    }
+    void setFlags(LayerFlags flags);
+    void switchFlags(LayerFlags flags, bool state);
 
     virtual Grid grid() const;
     virtual Cel* cel(frame_t frame) const;
     virtual void getCels(CelList& cels) const = 0;
     virtual void displaceFrames(frame_t fromThis, frame_t delta) = 0;
 
+  protected:
+    void incrementStructureVersion();
+
   private:
     std::string m_name;           // layer name
     Sprite* m_sprite;             // owner of the layer
@@ -177,10 +173,18 @@ namespace doc {
 
   private:
     void destroyAllCels();
+    void updateFrameCel(frame_t frame);
 
     BlendMode m_blendmode;
     int m_opacity;
     CelList m_cels;   // List of all cels inside this layer used by frames.
+
+    // Cel in each frame (nullptr if the frame is empty) to get the
+    // cel of a frame in O(1) (see cel(frame)). It's updated with
+    // m_cels in addCel()/removeCel()/moveCel(), so it can be used
+    // from several threads at the same time (e.g. to render frames
+    // in background).
+    std::vector<Cel*> m_frameCels;
   };
 
   //////////////////////////////////////////////////////////////////////
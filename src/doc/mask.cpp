@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,6 +12,7 @@
 #include "doc/mask.h"
 
 #include "base/memory.h"
+#include "doc/algorithm/floodfill.h"
 #include "doc/image_impl.h"
 
 #include <cstdlib>
@@ -71,7 +72,48 @@ void Mask::initialize()
 
 int Mask::getMemSize() const
 {
-  return sizeof(Mask) + (m_bitmap ? m_bitmap->getMemSize(): 0);
+  return sizeof(Mask) +
+    (m_bitmap ? m_bitmap->getMemSize(): 0) +
+    (m_spans ? m_spans->getMemSize(): 0);
+}
+
+const MaskSpans& Mask::spans() const
+{
+  ASSERT(!isEmpty());
+
+  if (!m_spans)
+    m_spans = std::make_unique<MaskSpans>(m_bitmap.get());
+  return *m_spans;
+}
+
+void Mask::createBitmapIfNeeded() const
+{
+  if (m_bitmap || !m_spans)
+    return;
+
+  m_bitmap.reset(Image::create(IMAGE_BITMAP, m_bounds.w, m_bounds.h, m_buffer));
+  m_spans->toBitmap(m_bitmap.get());
+}
+
+void Mask::combineSpans(const MaskSpans& spans,
+                        const gfx::Point& origin,
+                        const MaskSpans::Op op)
+{
+  static const MaskSpans empty;
+  gfx::Rect newBounds;
+  MaskSpans result = MaskSpans::combine(
+    (isEmpty() ? empty: this->spans()), m_bounds.origin(),
+    spans, origin, op, newBounds);
+  setSpans(std::move(result), newBounds);
+}
+
+void Mask::setSpans(MaskSpans&& spans, const gfx::Rect& bounds)
+{
+  clear();
+  if (!spans.isEmpty()) {
+    m_bounds = bounds;
+    m_spans = std::make_unique<MaskSpans>(std::move(spans));
+  }
 }
 
 void Mask::setName(const char *name)
@@ -97,6 +139,9 @@ void Mask::unfreeze()
 
 bool Mask::isRectangular() const
 {
+  if (m_spans)
+    return m_spans->isRectangular(m_bounds.w);
+
   if (!m_bitmap)
     return false;
 
@@ -118,14 +163,13 @@ void Mask::copyFrom(const Mask* sourceMask)
   clear();
   setName(sourceMask->name().c_str());
 
-  if (sourceMask->bitmap()) {
-    // Add all the area of "mask"
-    add(sourceMask->bounds());
-
-    // And copy the "mask" bitmap (m_bitmap can be nullptr if this is
-    // frozen, so add() doesn't created the bitmap)
-    if (m_bitmap)
-      copy_image(m_bitmap.get(), sourceMask->m_bitmap.get());
+  if (sourceMask->m_spans) {
+    m_bounds = sourceMask->m_bounds;
+    m_spans = std::make_unique<MaskSpans>(*sourceMask->m_spans);
+  }
+  else if (sourceMask->m_bitmap) {
+    m_bounds = sourceMask->m_bounds;
+    m_bitmap.reset(Image::createCopy(sourceMask->m_bitmap.get(), m_buffer));
   }
 }
 
@@ -137,15 +181,26 @@ void Mask::offsetOrigin(int dx, int dy)
 void Mask::clear()
 {
   m_bitmap.reset();
+  m_spans.reset();
   m_bounds = gfx::Rect(0, 0, 0, 0);
 }
 
 void Mask::invert()
 {
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
-  LockImageBits<BitmapTraits> bits(m_bitmap.get());
+  if (m_freeze_count == 0) {
+    gfx::Rect newBounds;
+    MaskSpans result = MaskSpans::combine(
+      MaskSpans(m_bounds.size()), m_bounds.origin(),
+      spans(), m_bounds.origin(),
+      MaskSpans::Op::Subtract, newBounds);
+    setSpans(std::move(result), newBounds);
+    return;
+  }
+
+  LockImageBits<BitmapTraits> bits(bitmap());
   LockImageBits<BitmapTraits>::iterator it = bits.begin(), end = bits.end();
 
   for (; it != end; ++it)
@@ -161,6 +216,12 @@ void Mask::replace(const gfx::Rect& bounds)
     return;
   }
 
+  if (m_freeze_count == 0) {
+    setSpans(MaskSpans(bounds.size()), bounds);
+    return;
+  }
+
+  m_spans.reset();
   m_bounds = bounds;
 
   m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
@@ -169,6 +230,12 @@ void Mask::replace(const gfx::Rect& bounds)
 
 void Mask::add(const doc::Mask& mask)
 {
+  if (m_freeze_count == 0) {
+    if (!mask.isEmpty())
+      combineSpans(mask.spans(), mask.origin(), MaskSpans::Op::Add);
+    return;
+  }
+
   for_each_mask_pixel(
     *this, mask,
     [](color_t a, color_t b) -> color_t {
@@ -178,6 +245,12 @@ void Mask::add(const doc::Mask& mask)
 
 void Mask::subtract(const doc::Mask& mask)
 {
+  if (m_freeze_count == 0) {
+    if (!isEmpty() && !mask.isEmpty())
+      combineSpans(mask.spans(), mask.origin(), MaskSpans::Op::Subtract);
+    return;
+  }
+
   for_each_mask_pixel(
     *this, mask,
     [](color_t a, color_t b) -> color_t {
@@ -190,6 +263,14 @@ void Mask::subtract(const doc::Mask& mask)
 
 void Mask::intersect(const doc::Mask& mask)
 {
+  if (m_freeze_count == 0) {
+    if (mask.isEmpty())
+      clear();
+    else if (!isEmpty())
+      combineSpans(mask.spans(), mask.origin(), MaskSpans::Op::Intersect);
+    return;
+  }
+
   for_each_mask_pixel(
     *this, mask,
     [](color_t a, color_t b) -> color_t {
@@ -199,11 +280,17 @@ void Mask::intersect(const doc::Mask& mask)
 
 void Mask::add(const gfx::Rect& bounds)
 {
+  if (useSpans()) {
+    if (!bounds.isEmpty())
+      combineSpans(MaskSpans(bounds.size()), bounds.origin(), MaskSpans::Op::Add);
+    return;
+  }
+
   if (m_freeze_count == 0)
     reserve(bounds);
 
-  // m_bitmap can be nullptr if we have m_freeze_count > 0
-  if (!m_bitmap)
+  // The bitmap can be nullptr if we have m_freeze_count > 0
+  if (!bitmap())
     return;
 
   fill_rect(m_bitmap.get(),
@@ -215,10 +302,16 @@ void Mask::add(const gfx::Rect& bounds)
 
 void Mask::subtract(const gfx::Rect& bounds)
 {
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
-  fill_rect(m_bitmap.get(),
+  if (useSpans()) {
+    if (!bounds.isEmpty())
+      combineSpans(MaskSpans(bounds.size()), bounds.origin(), MaskSpans::Op::Subtract);
+    return;
+  }
+
+  fill_rect(bitmap(),
     bounds.x-m_bounds.x,
     bounds.y-m_bounds.y,
     bounds.x-m_bounds.x+bounds.w-1,
@@ -229,16 +322,21 @@ void Mask::subtract(const gfx::Rect& bounds)
 
 void Mask::intersect(const gfx::Rect& bounds)
 {
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
+  if (useSpans()) {
+    combineSpans(MaskSpans(bounds.size()), bounds.origin(), MaskSpans::Op::Intersect);
+    return;
+  }
+
   gfx::Rect newBounds = m_bounds.createIntersection(bounds);
 
   Image* image = NULL;
 
   if (!newBounds.isEmpty()) {
     image = crop_image(
-      m_bitmap.get(),
+      bitmap(),
       newBounds.x-m_bounds.x,
       newBounds.y-m_bounds.y,
       newBounds.w,
@@ -246,114 +344,41 @@ void Mask::intersect(const gfx::Rect& bounds)
   }
 
   m_bitmap.reset(image);
+  m_spans.reset();
   m_bounds = newBounds;
 
   shrink();
 }
 
-void Mask::byColor(const Image *src, int color, int fuzziness)
+void Mask::byColor(const Image* src, int color, int fuzziness)
 {
-  replace(src->bounds());
-
-  Image* dst = m_bitmap.get();
-
-  switch (src->pixelFormat()) {
-
-    case IMAGE_RGB: {
-      const LockImageBits<RgbTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<RgbTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_r, src_g, src_b, src_a;
-      int dst_r, dst_g, dst_b, dst_a;
-      color_t c;
-
-      dst_r = rgba_getr(color);
-      dst_g = rgba_getg(color);
-      dst_b = rgba_getb(color);
-      dst_a = rgba_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_r = rgba_getr(c);
-        src_g = rgba_getg(c);
-        src_b = rgba_getb(c);
-        src_a = rgba_geta(c);
-
-        if (!((src_r >= dst_r-fuzziness) && (src_r <= dst_r+fuzziness) &&
-              (src_g >= dst_g-fuzziness) && (src_g <= dst_g+fuzziness) &&
-              (src_b >= dst_b-fuzziness) && (src_b <= dst_b+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-
-    case IMAGE_GRAYSCALE: {
-      const LockImageBits<GrayscaleTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<GrayscaleTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      int src_k, src_a;
-      int dst_k, dst_a;
-      color_t c;
-
-      dst_k = graya_getv(color);
-      dst_a = graya_geta(color);
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
-
-        src_k = graya_getv(c);
-        src_a = graya_geta(c);
-
-        if (!((src_k >= dst_k-fuzziness) && (src_k <= dst_k+fuzziness) &&
-              (src_a >= dst_a-fuzziness) && (src_a <= dst_a+fuzziness)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-
-    case IMAGE_INDEXED: {
-      const LockImageBits<IndexedTraits> srcBits(src);
-      LockImageBits<BitmapTraits> dstBits(dst, Image::WriteLock);
-      LockImageBits<IndexedTraits>::const_iterator src_it = srcBits.begin(), src_end = srcBits.end();
-      LockImageBits<BitmapTraits>::iterator dst_it = dstBits.begin();
-#ifdef _DEBUG
-      LockImageBits<BitmapTraits>::iterator dst_end = dstBits.end();
-#endif
-      color_t c, min, max;
-
-      for (; src_it != src_end; ++src_it, ++dst_it) {
-        ASSERT(dst_it != dst_end);
-        c = *src_it;
+  clear();
 
-        if (color > fuzziness)
-          min = color-fuzziness;
-        else
-          min = 0;
-        max = color + fuzziness;
+  // The non-contiguous floodfill compares the rows in parallel (and
+  // with SIMD instructions), and it gives us the spans of each row
+  // from top to bottom, so we can store them directly as MaskSpans.
+  MaskSpans spans;
+  algorithm::floodfill(
+    src, nullptr, 0, 0, src->bounds(),
+    color, fuzziness,
+    false,                      // Non-contiguous
+    false,
+    &spans,
+    [](int x1, int y, int x2, void* data) {
+      static_cast<MaskSpans*>(data)->addSpan(y, x1, x2+1);
+    });
 
-        if (!((c >= min) && (c <= max)))
-          *dst_it = 0;
-      }
-      ASSERT(dst_it == dst_end);
-      break;
-    }
-  }
+  if (spans.isEmpty())
+    return;
 
-  shrink();
+  // Shrink the spans to the selected pixels
+  static const MaskSpans empty;
+  gfx::Rect newBounds;
+  MaskSpans result = MaskSpans::combine(
+    empty, gfx::Point(0, 0),
+    spans, gfx::Point(0, 0),
+    MaskSpans::Op::Add, newBounds);
+  setSpans(std::move(result), newBounds);
 }
 
 void Mask::crop(const Image *image)
@@ -383,7 +408,7 @@ void Mask::crop(const Image *image)
   int done;
   color_t old_color;
 
-  if (!m_bitmap)
+  if (isEmpty())
     return;
 
   beg_x1 = m_bounds.x;
@@ -425,6 +450,9 @@ void Mask::reserve(const gfx::Rect& bounds)
 {
   ASSERT(!bounds.isEmpty());
 
+  // The bitmap will be modified
+  bitmap();
+
   if (!m_bitmap) {
     m_bounds = bounds;
     m_bitmap.reset(Image::create(IMAGE_BITMAP, bounds.w, bounds.h, m_buffer));
@@ -452,6 +480,11 @@ void Mask::shrink()
   if (m_freeze_count > 0)
     return;
 
+  // Masks without bitmap are already shrunk (they were created
+  // using the spans)
+  if (!m_bitmap)
+    return;
+
 #define SHRINK_SIDE(u_begin, u_op, u_final, u_add,                      \
                     v_begin, v_op, v_final, v_add, U, V, var)           \
   {                                                                     \
@@ -504,6 +537,7 @@ void Mask::shrink()
       m_bounds.x-u, m_bounds.y-v,
       m_bounds.w, m_bounds.h, 0);
     m_bitmap.reset(image);
+    m_spans.reset();
   }
 
 #undef SHRINK_SIDE
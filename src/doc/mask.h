@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,16 +12,24 @@
 #include "doc/image.h"
 #include "doc/image_buffer.h"
 #include "doc/image_ref.h"
+#include "doc/mask_spans.h"
 #include "doc/object.h"
 #include "doc/primitives.h"
 #include "gfx/rect.h"
 
+#include <memory>
 #include <string>
 
 namespace doc {
 
   // Represents the selection (selected pixels, 0/1, 0=non-selected, 1=selected)
   //
+  // The selected pixels can be stored as a bitmap and/or as spans
+  // (MaskSpans). Boolean operations (add/subtract/intersect/invert)
+  // of a mask that isn't frozen are done with the spans, and the
+  // bitmap is created only when it's needed (e.g. to draw with
+  // inks).
+  //
   // TODO rename Mask -> Selection
   class Mask : public Object {
   public:
@@ -34,21 +42,36 @@ namespace doc {
     void setName(const char *name);
     const std::string& name() const { return m_name; }
 
-    const Image* bitmap() const { return m_bitmap.get(); }
-    Image* bitmap() { return m_bitmap.get(); }
+    const Image* bitmap() const {
+      createBitmapIfNeeded();
+      return m_bitmap.get();
+    }
+
+    // The returned bitmap can be modified, so the spans are discarded.
+    Image* bitmap() {
+      createBitmapIfNeeded();
+      m_spans.reset();
+      return m_bitmap.get();
+    }
+
+    // Returns the selected pixels as spans (relative to the bounds
+    // origin). The mask cannot be empty.
+    const MaskSpans& spans() const;
 
     // Returns true if the mask is completely empty (i.e. nothing
     // selected)
     bool isEmpty() const {
-      return (!m_bitmap ? true: false);
+      return (!m_bitmap && !m_spans ? true: false);
     }
 
     // Returns true if the point is inside the mask
     bool containsPoint(int u, int v) const {
-      return (m_bitmap.get() &&
-              u >= m_bounds.x && u < m_bounds.x+m_bounds.w &&
-              v >= m_bounds.y && v < m_bounds.y+m_bounds.h &&
-              get_pixel(m_bitmap.get(), u-m_bounds.x, v-m_bounds.y));
+      if (u < m_bounds.x || u >= m_bounds.x+m_bounds.w ||
+          v < m_bounds.y || v >= m_bounds.y+m_bounds.h)
+        return false;
+      if (m_bitmap)
+        return (get_pixel(m_bitmap.get(), u-m_bounds.x, v-m_bounds.y) ? true: false);
+      return (m_spans && m_spans->contains(u-m_bounds.x, v-m_bounds.y));
     }
 
     gfx::Point origin() const { return m_bounds.origin(); }
@@ -92,6 +115,9 @@ namespace doc {
     void subtract(const gfx::Rect& bounds);
     void intersect(const gfx::Rect& bounds);
 
+    // Replaces the mask with the pixels of the image that have the
+    // given color (each channel within the given fuzziness, fully
+    // transparent pixels match a transparent color).
     void byColor(const Image* image, int color, int fuzziness);
     void crop(const Image* image);
 
@@ -108,12 +134,24 @@ namespace doc {
 
   private:
     void initialize();
+    void createBitmapIfNeeded() const;
+
+    // Returns true if the rectangle operations should be done with
+    // the spans.
+    bool useSpans() const {
+      return (m_freeze_count == 0 && (m_spans || !m_bitmap));
+    }
+    void combineSpans(const MaskSpans& spans,
+                      const gfx::Point& origin,
+                      const MaskSpans::Op op);
+    void setSpans(MaskSpans&& spans, const gfx::Rect& bounds);
 
     int m_freeze_count;
     std::string m_name;           // Mask name
     gfx::Rect m_bounds;           // Region bounds
-    ImageRef m_bitmap;            // Bitmapped image mask
-    ImageBufferPtr m_buffer;      // Buffer used in m_bitmap
+    mutable ImageRef m_bitmap;    // Bitmapped image mask
+    mutable ImageBufferPtr m_buffer; // Buffer used in m_bitmap
+    mutable std::unique_ptr<MaskSpans> m_spans; // Spans of the selected pixels
 
     Mask& operator=(const Mask& mask);
   };
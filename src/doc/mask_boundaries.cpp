@@ -1,4 +1,5 @@
 // Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,20 +12,295 @@
 #include "doc/mask_boundaries.h"
 
 #include "doc/image_impl.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <map>
 
 namespace doc {
 
+namespace {
+
+// Returns the byte "b" of the row of a bitmap (8 pixels, the pixel
+// 8*b+i is the bit i), pixels outside the bitmap are 0.
+inline uint8_t get_8_pixels(const uint8_t* row, const int w, const int b)
+{
+  if (b < 0 || 8*b >= w)
+    return 0;
+  uint8_t v = row[b];
+  if (8*b+8 > w)
+    v &= (1 << (w - 8*b)) - 1;
+  return v;
+}
+
+// Returns the pixels [x, x+64) of the row "y" of "bitmap" (the pixel
+// x+i is the bit i), pixels outside the bitmap are 0.
+uint64_t get_64_pixels(const Image* bitmap, const int x, const int y)
+{
+  const int w = bitmap->width();
+  if (y < 0 || y >= bitmap->height() || x >= w || x+64 <= 0)
+    return 0;
+
+  const uint8_t* row = bitmap->getPixelAddress(0, y);
+  const int b0 = (x >= 0 ? x/8: -((7-x)/8));
+  const int shift = x - 8*b0;
+  uint64_t result = (get_8_pixels(row, w, b0) >> shift);
+  for (int k=1; k<=8; ++k) {
+    const int bit = 8*k - shift;
+    if (bit < 64)
+      result |= (uint64_t(get_8_pixels(row, w, b0+k)) << bit);
+  }
+  return result;
+}
+
+// Returns the bounds of the pixels that are different in the two
+// bitmaps (placed in the given positions).
+gfx::Rect diff_bounds(const Image* a, const gfx::Point& aPos,
+                      const Image* b, const gfx::Point& bPos)
+{
+  const gfx::Rect bounds =
+    gfx::Rect(aPos, gfx::Size(a->width(), a->height())).createUnion(
+      gfx::Rect(bPos, gfx::Size(b->width(), b->height())));
+
+  int x1 = INT_MAX, y1 = INT_MAX, x2 = INT_MIN, y2 = INT_MIN;
+  for (int y=bounds.y; y<bounds.y2(); ++y) {
+    for (int x=bounds.x; x<bounds.x2(); x+=64) {
+      const uint64_t d = (get_64_pixels(a, x-aPos.x, y-aPos.y) ^
+                          get_64_pixels(b, x-bPos.x, y-bPos.y));
+      if (d) {
+        int first = 0, last = 63;
+        while (!(d & (uint64_t(1) << first))) ++first;
+        while (!(d & (uint64_t(1) << last))) --last;
+        x1 = std::min(x1, x+first);
+        x2 = std::max(x2, x+last+1);
+        y1 = std::min(y1, y);
+        y2 = y+1;
+      }
+    }
+  }
+  if (y1 < y2)
+    return gfx::Rect(x1, y1, x2-x1, y2-y1);
+  else
+    return gfx::Rect();
+}
+
+// Removed segments are marked with empty bounds.
+inline bool is_removed(const MaskBoundaries::Segment& seg)
+{
+  return (seg.bounds().w == 0 && seg.bounds().h == 0);
+}
+
+} // anonymous namespace
+
 void MaskBoundaries::reset()
 {
   m_segs.clear();
   if (!m_path.isEmpty())
     m_path.rewind();
+  m_origin = gfx::Point(0, 0);
+  m_bitmap.reset();
+  ++m_version;
 }
 
 void MaskBoundaries::regen(const Image* bitmap)
 {
   reset();
+  generateSegments(bitmap, m_segs);
+}
+
+void MaskBoundaries::update(const Image* bitmap, const gfx::Point& origin)
+{
+  if (!m_bitmap) {
+    regen(bitmap);
+    m_origin = origin;
+  }
+  else {
+    const gfx::Rect dirty =
+      diff_bounds(m_bitmap.get(), m_bitmapOrigin, bitmap, origin);
 
+    if (!dirty.isEmpty()) {
+      // The same bitmap in other position
+      if (m_bitmap->width() == bitmap->width() &&
+          m_bitmap->height() == bitmap->height() &&
+          diff_bounds(m_bitmap.get(), gfx::Point(0, 0),
+                      bitmap, gfx::Point(0, 0)).isEmpty()) {
+        offset(origin.x - m_bitmapOrigin.x,
+               origin.y - m_bitmapOrigin.y);
+      }
+      // Regenerate the whole bitmap if most of it was modified
+      else if (std::int64_t(dirty.w) * dirty.h * 2 >
+               std::int64_t(bitmap->width()) * bitmap->height()) {
+        regen(bitmap);
+        m_origin = origin;
+      }
+      else {
+        regenBounds(bitmap, origin, dirty);
+      }
+    }
+  }
+
+  m_bitmap.reset(Image::createCopy(bitmap));
+  m_bitmapOrigin = origin;
+}
+
+void MaskBoundaries::regenBounds(const Image* bitmap,
+                                 const gfx::Point& origin,
+                                 const gfx::Rect& dirtyBounds)
+{
+  // Work in the coordinates of the current segments
+  const gfx::Rect d(dirtyBounds.x - m_origin.x,
+                    dirtyBounds.y - m_origin.y,
+                    dirtyBounds.w, dirtyBounds.h);
+
+  // Segments of the edges between pixels where at least one of them
+  // is inside "d" are removed: horizontal edges in rows [d.y, d.y2()]
+  // and vertical edges in columns [d.x, d.x2()]. The parts at the
+  // sides of "d" are kept to join them with the new segments.
+  // Keys are "line*2 + open".
+  std::map<int, int> hLeft, hRight, vTop, vBottom;
+  const int n = int(m_segs.size());
+  for (int i=0; i<n; ++i) {
+    const bool open = m_segs[i].open();
+    const gfx::Rect rc = m_segs[i].bounds();
+
+    if (m_segs[i].horizontal()) {
+      if (rc.y < d.y || rc.y > d.y2())
+        continue;
+      if (rc.x2() == d.x) {
+        hLeft[rc.y*2 + open] = i;
+        continue;
+      }
+      if (rc.x == d.x2()) {
+        hRight[rc.y*2 + open] = i;
+        continue;
+      }
+      if (rc.x2() < d.x || rc.x > d.x2())
+        continue;
+
+      if (rc.x < d.x) {
+        m_segs[i].m_bounds.w = d.x - rc.x;
+        hLeft[rc.y*2 + open] = i;
+      }
+      else
+        m_segs[i].m_bounds = gfx::Rect();
+
+      if (rc.x2() > d.x2()) {
+        m_segs.push_back(Segment(open, gfx::Rect(d.x2(), rc.y, rc.x2()-d.x2(), 0)));
+        hRight[rc.y*2 + open] = int(m_segs.size()-1);
+      }
+    }
+    else {
+      if (rc.x < d.x || rc.x > d.x2())
+        continue;
+      if (rc.y2() == d.y) {
+        vTop[rc.x*2 + open] = i;
+        continue;
+      }
+      if (rc.y == d.y2()) {
+        vBottom[rc.x*2 + open] = i;
+        continue;
+      }
+      if (rc.y2() < d.y || rc.y > d.y2())
+        continue;
+
+      if (rc.y < d.y) {
+        m_segs[i].m_bounds.h = d.y - rc.y;
+        vTop[rc.x*2 + open] = i;
+      }
+      else
+        m_segs[i].m_bounds = gfx::Rect();
+
+      if (rc.y2() > d.y2()) {
+        m_segs.push_back(Segment(open, gfx::Rect(rc.x, d.y2(), 0, rc.y2()-d.y2())));
+        vBottom[rc.x*2 + open] = int(m_segs.size()-1);
+      }
+    }
+  }
+
+  // Generate the segments of "d" (with one extra pixel around it to
+  // know the edges of its borders)
+  const gfx::Rect win = gfx::Rect(d).enlarge(1);
+  ImageRef winBitmap(Image::create(IMAGE_BITMAP, win.w, win.h));
+  clear_image(winBitmap.get(), 0);
+  copy_image(winBitmap.get(), bitmap,
+             origin.x - m_origin.x - win.x,
+             origin.y - m_origin.y - win.y);
+
+  list_type segs;
+  generateSegments(winBitmap.get(), segs);
+
+  // Add the new segments inside "d", joining them with the old ones
+  auto join = [this](std::map<int, int>& sides, const int key) -> Segment* {
+    auto it = sides.find(key);
+    return (it != sides.end() ? &m_segs[it->second]: nullptr);
+  };
+
+  for (const Segment& seg : segs) {
+    const bool open = seg.open();
+    gfx::Rect rc = seg.bounds();
+    rc.offset(win.x, win.y);
+
+    if (seg.horizontal()) {
+      const int x1 = std::max(rc.x, d.x);
+      const int x2 = std::min(rc.x2(), d.x2());
+      if (rc.y < d.y || rc.y > d.y2() || x1 >= x2)
+        continue;
+
+      const int key = rc.y*2 + open;
+      Segment* left = (x1 == d.x ? join(hLeft, key): nullptr);
+      Segment* right = (x2 == d.x2() ? join(hRight, key): nullptr);
+      if (left) {
+        left->m_bounds.w += x2-x1;
+        if (right) {
+          left->m_bounds.w += right->m_bounds.w;
+          right->m_bounds = gfx::Rect();
+        }
+      }
+      else if (right) {
+        right->m_bounds.w += right->m_bounds.x - x1;
+        right->m_bounds.x = x1;
+      }
+      else
+        m_segs.push_back(Segment(open, gfx::Rect(x1, rc.y, x2-x1, 0)));
+    }
+    else {
+      const int y1 = std::max(rc.y, d.y);
+      const int y2 = std::min(rc.y2(), d.y2());
+      if (rc.x < d.x || rc.x > d.x2() || y1 >= y2)
+        continue;
+
+      const int key = rc.x*2 + open;
+      Segment* top = (y1 == d.y ? join(vTop, key): nullptr);
+      Segment* bottom = (y2 == d.y2() ? join(vBottom, key): nullptr);
+      if (top) {
+        top->m_bounds.h += y2-y1;
+        if (bottom) {
+          top->m_bounds.h += bottom->m_bounds.h;
+          bottom->m_bounds = gfx::Rect();
+        }
+      }
+      else if (bottom) {
+        bottom->m_bounds.h += bottom->m_bounds.y - y1;
+        bottom->m_bounds.y = y1;
+      }
+      else
+        m_segs.push_back(Segment(open, gfx::Rect(rc.x, y1, 0, y2-y1)));
+    }
+  }
+
+  m_segs.erase(std::remove_if(m_segs.begin(), m_segs.end(), is_removed),
+               m_segs.end());
+
+  if (!m_path.isEmpty())
+    m_path.rewind();
+  ++m_version;
+}
+
+// static
+void MaskBoundaries::generateSegments(const Image* bitmap, list_type& segs)
+{
   int x, y, w = bitmap->width(), h = bitmap->height();
 
   const LockImageBits<BitmapTraits> bits(bitmap);
@@ -40,12 +316,12 @@ void MaskBoundaries::regen(const Image* bitmap)
   int horzSeg;
 
 #define new_hseg(open) {                                        \
-    m_segs.push_back(Segment(open, gfx::Rect(x, y, 1, 0)));     \
-    horzSeg = int(m_segs.size()-1);                             \
+    segs.push_back(Segment(open, gfx::Rect(x, y, 1, 0)));       \
+    horzSeg = int(segs.size()-1);                               \
   }
 #define new_vseg(open) {                                        \
-    m_segs.push_back(Segment(open, gfx::Rect(x, y, 0, 1)));     \
-    vertSegs[x] = int(m_segs.size()-1);                         \
+    segs.push_back(Segment(open, gfx::Rect(x, y, 0, 1)));       \
+    vertSegs[x] = int(segs.size()-1);                           \
   }
 #define expand_hseg() { \
     ASSERT(hseg);       \
@@ -71,8 +347,8 @@ void MaskBoundaries::regen(const Image* bitmap)
 #if _DEBUG
       bool prevRowColor = (x < w && y > 0 && *prevIt ? true: false);
 #endif
-      Segment* hseg = (horzSeg >= 0 ? &m_segs[horzSeg]: nullptr);
-      Segment* vseg = (vertSegs[x] >= 0 ? &m_segs[vertSegs[x]]: nullptr);
+      Segment* hseg = (horzSeg >= 0 ? &segs[horzSeg]: nullptr);
+      Segment* vseg = (vertSegs[x] >= 0 ? &segs[vertSegs[x]]: nullptr);
 
       //
       // -   -
@@ -341,10 +617,10 @@ void MaskBoundaries::regen(const Image* bitmap)
 
 void MaskBoundaries::offset(int x, int y)
 {
-  for (Segment& seg : m_segs)
-    seg.offset(x, y);
-
-  m_path.offset(x, y);
+  m_origin.x += x;
+  m_origin.y += y;
+  m_bitmapOrigin.x += x;
+  m_bitmapOrigin.y += y;
 }
 
 void MaskBoundaries::createPathIfNeeeded()
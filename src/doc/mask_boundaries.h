@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,14 +9,19 @@
 #define DOC_MASK_BOUNDARIES_H_INCLUDED
 #pragma once
 
+#include "doc/image_ref.h"
 #include "gfx/path.h"
+#include "gfx/point.h"
 #include "gfx/rect.h"
 
+#include <cstdint>
 #include <vector>
 
 namespace doc {
   class Image;
 
+  // Segments of the boundaries of a bitmap (marching ants). The
+  // segments and the path are relative to origin().
   class MaskBoundaries {
   public:
     class Segment {
@@ -45,21 +50,47 @@ namespace doc {
 
     bool isEmpty() const { return m_segs.empty(); }
     void reset();
+
+    // Incremented each time the segments are modified (can be used
+    // to cache data generated from the segments/path).
+    uint32_t version() const { return m_version; }
+
+    // Regenerates all the segments from the given bitmap, with the
+    // origin at (0, 0).
     void regen(const Image* bitmap);
 
+    // Updates the segments to a new version of the bitmap used in
+    // the previous update() call, placed at the given origin. Only
+    // the segments around the modified pixels are regenerated.
+    void update(const Image* bitmap, const gfx::Point& origin);
+
     const_iterator begin() const { return m_segs.begin(); }
     const_iterator end() const { return m_segs.end(); }
     iterator begin() { return m_segs.begin(); }
     iterator end() { return m_segs.end(); }
 
+    // Moves the origin (the segments aren't modified).
     void offset(int x, int y);
+    const gfx::Point& origin() const { return m_origin; }
     gfx::Path& path() { return m_path; }
 
     void createPathIfNeeeded();
 
   private:
+    static void generateSegments(const Image* bitmap, list_type& segs);
+    void regenBounds(const Image* bitmap,
+                     const gfx::Point& origin,
+                     const gfx::Rect& dirtyBounds);
+
     list_type m_segs;
     gfx::Path m_path;
+    gfx::Point m_origin;
+    uint32_t m_version = 0;
+
+    // Copy of the bitmap used in the last update() to know which
+    // pixels were modified in the next update() call.
+    ImageRef m_bitmap;
+    gfx::Point m_bitmapOrigin;
   };
 
 } // namespace doc
@@ -0,0 +1,129 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/mask_boundaries.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <tuple>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+typedef std::tuple<int, int, int, int, bool> SegTuple;
+
+// Segments in absolute coordinates sorted to compare them
+std::vector<SegTuple> absolute_segments(const MaskBoundaries& mb)
+{
+  std::vector<SegTuple> result;
+  for (const auto& seg : mb) {
+    const gfx::Rect& rc = seg.bounds();
+    result.push_back(SegTuple(rc.x + mb.origin().x,
+                              rc.y + mb.origin().y,
+                              rc.w, rc.h, seg.open()));
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+void expect_same_as_regen(const MaskBoundaries& mb,
+                          const Image* bitmap,
+                          const gfx::Point& origin)
+{
+  MaskBoundaries expected;
+  expected.regen(bitmap);
+  expected.offset(origin.x, origin.y);
+  ASSERT_EQ(absolute_segments(expected), absolute_segments(mb));
+}
+
+void random_rect(ImageRef& bitmap)
+{
+  const int w = bitmap->width();
+  const int h = bitmap->height();
+  const int x = (std::rand() % w);
+  const int y = (std::rand() % h);
+  fill_rect(bitmap.get(),
+            x, y,
+            x + (std::rand() % 10),
+            y + (std::rand() % 10),
+            std::rand() & 1);
+}
+
+} // anonymous namespace
+
+TEST(MaskBoundaries, UpdateMatchesRegen)
+{
+  for (int t=0; t<20; ++t) {
+    const int w = 1 + (std::rand() % 150);
+    const int h = 1 + (std::rand() % 50);
+    gfx::Point origin(std::rand() % 20 - 10,
+                      std::rand() % 20 - 10);
+
+    ImageRef bitmap(Image::create(IMAGE_BITMAP, w, h));
+    clear_image(bitmap.get(), 0);
+    for (int i=0; i<20; ++i)
+      random_rect(bitmap);
+
+    MaskBoundaries mb;
+    mb.update(bitmap.get(), origin);
+    expect_same_as_regen(mb, bitmap.get(), origin);
+
+    for (int i=0; i<50; ++i) {
+      switch (std::rand() % 4) {
+        // Move the same bitmap
+        case 0:
+          origin.x += std::rand() % 5 - 2;
+          origin.y += std::rand() % 5 - 2;
+          break;
+        // Modify a few pixels
+        case 1:
+          for (int j=std::rand() % 5; j>=0; --j)
+            put_pixel(bitmap.get(),
+                      std::rand() % bitmap->width(),
+                      std::rand() % bitmap->height(),
+                      std::rand() & 1);
+          break;
+        // Modify a rectangle
+        case 2:
+          random_rect(bitmap);
+          break;
+        // Resize the bitmap keeping its pixels
+        case 3: {
+          const int u = std::rand() % 5 - 2;
+          const int v = std::rand() % 5 - 2;
+          const int w2 = std::max(1, bitmap->width() + std::rand() % 9 - 4);
+          const int h2 = std::max(1, bitmap->height() + std::rand() % 9 - 4);
+          ImageRef bitmap2(Image::create(IMAGE_BITMAP, w2, h2));
+          clear_image(bitmap2.get(), 0);
+          copy_image(bitmap2.get(), bitmap.get(), -u, -v);
+          bitmap = bitmap2;
+          origin.x += u;
+          origin.y += v;
+          break;
+        }
+      }
+
+      mb.update(bitmap.get(), origin);
+      expect_same_as_regen(mb, bitmap.get(), origin);
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,301 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/mask_spans.h"
+
+#include "doc/image_impl.h"
+#include "doc/primitives.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+
+namespace doc {
+
+namespace {
+
+// Joins the spans of a row of "a" and a row of "b" (moved "adx" and
+// "bdx" pixels horizontally) using the given operation.
+template<typename Func>
+void combine_rows(const MaskSpans::Span* a, const MaskSpans::Span* aEnd, const int adx,
+                  const MaskSpans::Span* b, const MaskSpans::Span* bEnd, const int bdx,
+                  Func func, std::vector<MaskSpans::Span>& result)
+{
+  const int rowBegin = int(result.size());
+  bool inA = false, inB = false, in = false;
+  int x1 = 0;
+
+  while (a != aEnd || b != bEnd) {
+    const int xa = (a != aEnd ? (inA ? a->x2: a->x1) + adx: INT_MAX);
+    const int xb = (b != bEnd ? (inB ? b->x2: b->x1) + bdx: INT_MAX);
+    const int x = std::min(xa, xb);
+
+    if (xa == x) {
+      if (inA)
+        ++a;
+      inA = !inA;
+    }
+    if (xb == x) {
+      if (inB)
+        ++b;
+      inB = !inB;
+    }
+
+    const bool value = func(inA, inB);
+    if (value != in) {
+      if (value) {
+        // Join spans that touch each other
+        if (int(result.size()) > rowBegin && result.back().x2 == x)
+          result.pop_back();
+        else
+          x1 = x;
+      }
+      else
+        result.push_back(MaskSpans::Span{ x1, x });
+      in = value;
+    }
+  }
+}
+
+// Selects the pixels [x1, x2) of a row of a bitmap.
+void fill_bits(uint8_t* row, const int x1, const int x2)
+{
+  const int b1 = x1 / 8;
+  const int b2 = (x2-1) / 8;
+  const uint8_t m1 = uint8_t(0xff << (x1 & 7));
+  const uint8_t m2 = uint8_t(0xff >> (7 - ((x2-1) & 7)));
+  if (b1 == b2)
+    row[b1] |= (m1 & m2);
+  else {
+    row[b1] |= m1;
+    std::memset(row+b1+1, 0xff, b2-b1-1);
+    row[b2] |= m2;
+  }
+}
+
+} // anonymous namespace
+
+MaskSpans::MaskSpans()
+  : m_rows(1, 0)
+{
+}
+
+MaskSpans::MaskSpans(const gfx::Size& size)
+  : m_rows(1, 0)
+{
+  if (size.w <= 0 || size.h <= 0)
+    return;
+
+  m_rows.resize(size.h+1);
+  m_spans.resize(size.h, Span{ 0, size.w });
+  for (int y=0; y<=size.h; ++y)
+    m_rows[y] = y;
+}
+
+MaskSpans::MaskSpans(const Image* bitmap)
+  : m_rows(bitmap->height()+1, 0)
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+
+  const int w = bitmap->width();
+  const int h = bitmap->height();
+  for (int y=0; y<h; ++y) {
+    const uint8_t* row = bitmap->getPixelAddress(0, y);
+    bool in = false;
+    int x1 = 0;
+
+    for (int x=0; x<w; ) {
+      const uint8_t byte = row[x / 8];
+
+      // Skip 8 pixels that don't change the current state
+      if ((x & 7) == 0 && x+8 <= w && byte == (in ? 0xff: 0)) {
+        x += 8;
+        continue;
+      }
+
+      const bool bit = ((byte >> (x & 7)) & 1 ? true: false);
+      if (bit != in) {
+        if (bit)
+          x1 = x;
+        else
+          m_spans.push_back(Span{ x1, x });
+        in = bit;
+      }
+      ++x;
+    }
+    if (in)
+      m_spans.push_back(Span{ x1, w });
+
+    m_rows[y+1] = int(m_spans.size());
+  }
+}
+
+int MaskSpans::getMemSize() const
+{
+  return int(sizeof(MaskSpans) +
+             sizeof(int) * m_rows.capacity() +
+             sizeof(Span) * m_spans.capacity());
+}
+
+void MaskSpans::addSpan(const int y, const int x1, const int x2)
+{
+  ASSERT(y >= height()-1);
+  ASSERT(x1 < x2);
+  ASSERT(y >= height() ||
+         rowBegin(y) == rowEnd(y) ||
+         (rowEnd(y)-1)->x2 < x1);
+
+  while (height() <= y)
+    m_rows.push_back(int(m_spans.size()));
+
+  m_spans.push_back(Span{ x1, x2 });
+  m_rows.back() = int(m_spans.size());
+}
+
+bool MaskSpans::contains(int x, int y) const
+{
+  if (y < 0 || y >= height())
+    return false;
+
+  const Span* end = rowEnd(y);
+  const Span* it = std::upper_bound(
+    rowBegin(y), end, x,
+    [](int x, const Span& span) { return x < span.x1; });
+  return (it != rowBegin(y) && x < (it-1)->x2);
+}
+
+bool MaskSpans::isRectangular(int width) const
+{
+  if (int(m_spans.size()) != height())
+    return false;
+
+  for (int y=0; y<height(); ++y) {
+    if (m_rows[y+1] - m_rows[y] != 1 ||
+        m_spans[y].x1 != 0 ||
+        m_spans[y].x2 != width)
+      return false;
+  }
+  return true;
+}
+
+void MaskSpans::toBitmap(Image* bitmap) const
+{
+  ASSERT(bitmap->pixelFormat() == IMAGE_BITMAP);
+  ASSERT(bitmap->height() == height());
+
+  clear_image(bitmap, 0);
+  for (int y=0; y<height(); ++y) {
+    uint8_t* row = bitmap->getPixelAddress(0, y);
+    for (const Span* it=rowBegin(y), *end=rowEnd(y); it!=end; ++it) {
+      ASSERT(it->x1 >= 0 && it->x2 <= bitmap->width());
+      fill_bits(row, it->x1, it->x2);
+    }
+  }
+}
+
+// static
+MaskSpans MaskSpans::combine(const MaskSpans& a, const gfx::Point& aOrigin,
+                             const MaskSpans& b, const gfx::Point& bOrigin,
+                             const Op op, gfx::Rect& bounds)
+{
+  const int aY1 = aOrigin.y, aY2 = aOrigin.y + a.height();
+  const int bY1 = bOrigin.y, bY2 = bOrigin.y + b.height();
+
+  // Rows of the result
+  int y1, y2;
+  switch (op) {
+    case Op::Add:
+      if (a.isEmpty()) { y1 = bY1; y2 = bY2; }
+      else if (b.isEmpty()) { y1 = aY1; y2 = aY2; }
+      else {
+        y1 = std::min(aY1, bY1);
+        y2 = std::max(aY2, bY2);
+      }
+      break;
+    case Op::Subtract:
+      y1 = aY1;
+      y2 = aY2;
+      break;
+    case Op::Intersect:
+      y1 = std::max(aY1, bY1);
+      y2 = std::min(aY2, bY2);
+      break;
+    default:
+      ASSERT(false);
+      y1 = y2 = 0;
+      break;
+  }
+
+  MaskSpans result;
+  result.m_rows.clear();
+
+  for (int y=y1; y<y2; ++y) {
+    result.m_rows.push_back(int(result.m_spans.size()));
+
+    const bool inA = (y >= aY1 && y < aY2);
+    const bool inB = (y >= bY1 && y < bY2);
+    const Span* a1 = (inA ? a.rowBegin(y-aY1): nullptr);
+    const Span* a2 = (inA ? a.rowEnd(y-aY1): nullptr);
+    const Span* b1 = (inB ? b.rowBegin(y-bY1): nullptr);
+    const Span* b2 = (inB ? b.rowEnd(y-bY1): nullptr);
+
+    switch (op) {
+      case Op::Add:
+        combine_rows(a1, a2, aOrigin.x, b1, b2, bOrigin.x,
+                     [](bool a, bool b) { return a || b; },
+                     result.m_spans);
+        break;
+      case Op::Subtract:
+        combine_rows(a1, a2, aOrigin.x, b1, b2, bOrigin.x,
+                     [](bool a, bool b) { return a && !b; },
+                     result.m_spans);
+        break;
+      case Op::Intersect:
+        combine_rows(a1, a2, aOrigin.x, b1, b2, bOrigin.x,
+                     [](bool a, bool b) { return a && b; },
+                     result.m_spans);
+        break;
+    }
+  }
+  result.m_rows.push_back(int(result.m_spans.size()));
+
+  if (result.m_spans.empty()) {
+    bounds = gfx::Rect();
+    return MaskSpans();
+  }
+
+  // Shrink the result to the selected pixels
+  int first = 0, last = result.height()-1;
+  while (result.m_rows[first] == result.m_rows[first+1])
+    ++first;
+  while (result.m_rows[last] == result.m_rows[last+1])
+    --last;
+
+  int x1 = INT_MAX, x2 = INT_MIN;
+  for (int y=first; y<=last; ++y) {
+    if (result.m_rows[y] < result.m_rows[y+1]) {
+      x1 = std::min(x1, result.m_spans[result.m_rows[y]].x1);
+      x2 = std::max(x2, result.m_spans[result.m_rows[y+1]-1].x2);
+    }
+  }
+
+  for (Span& span : result.m_spans) {
+    span.x1 -= x1;
+    span.x2 -= x1;
+  }
+  result.m_rows.erase(result.m_rows.begin()+last+2, result.m_rows.end());
+  result.m_rows.erase(result.m_rows.begin(), result.m_rows.begin()+first);
+
+  bounds = gfx::Rect(x1, y1+first, x2-x1, last-first+1);
+  return result;
+}
+
+} // namespace doc
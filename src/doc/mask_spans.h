@@ -0,0 +1,80 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_MASK_SPANS_H_INCLUDED
+#define DOC_MASK_SPANS_H_INCLUDED
+#pragma once
+
+#include "gfx/point.h"
+#include "gfx/rect.h"
+#include "gfx/size.h"
+
+#include <vector>
+
+namespace doc {
+  class Image;
+
+  // Selected pixels of a mask as a list of horizontal spans in each
+  // row (run-length encoded). Boolean operations are done directly
+  // with the spans, so they depend on the number of edges of the
+  // selection instead of its area.
+  class MaskSpans {
+  public:
+    // Selected pixels [x1, x2) of a row.
+    struct Span {
+      int x1, x2;
+    };
+
+    enum class Op { Add, Subtract, Intersect };
+
+    MaskSpans();
+
+    // All the pixels of a rectangle of the given size.
+    explicit MaskSpans(const gfx::Size& size);
+
+    // The selected pixels of the given IMAGE_BITMAP.
+    explicit MaskSpans(const Image* bitmap);
+
+    bool isEmpty() const { return m_spans.empty(); }
+    int height() const { return int(m_rows.size())-1; }
+    int getMemSize() const;
+
+    // Spans of the given row (sorted from left to right).
+    const Span* rowBegin(int y) const { return m_spans.data() + m_rows[y]; }
+    const Span* rowEnd(int y) const { return m_spans.data() + m_rows[y+1]; }
+
+    bool contains(int x, int y) const;
+
+    // Appends the span [x1, x2) at the end of the row "y". Rows must
+    // be added from top to bottom and spans from left to right
+    // (e.g. the output of the non-contiguous floodfill()).
+    void addSpan(int y, int x1, int x2);
+
+    // Returns true if all the pixels of a rectangle of the given
+    // width are selected.
+    bool isRectangular(int width) const;
+
+    // Draws the spans in the given bitmap (the other pixels are
+    // cleared).
+    void toBitmap(Image* bitmap) const;
+
+    // Returns the result of the "op" between the spans "a" placed
+    // at "aOrigin" and "b" placed at "bOrigin". The result is shrunk
+    // to its selected pixels, "bounds" is the place of the result.
+    static MaskSpans combine(const MaskSpans& a, const gfx::Point& aOrigin,
+                             const MaskSpans& b, const gfx::Point& bOrigin,
+                             const Op op, gfx::Rect& bounds);
+
+  private:
+    // Index of the first span of each row in m_spans (with an
+    // extra element at the end).
+    std::vector<int> m_rows;
+    std::vector<Span> m_spans;
+  };
+
+} // namespace doc
+
+#endif
@@ -0,0 +1,240 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/mask.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// Selected pixels of a 100x100 area to compare with masks
+class Pixels {
+public:
+  static const int kSize = 100;
+
+  Pixels() : m_pixels(kSize*kSize, false) { }
+
+  bool get(int x, int y) const {
+    return (x >= 0 && y >= 0 && x < kSize && y < kSize &&
+            m_pixels[y*kSize+x]);
+  }
+
+  template<typename Func>
+  void apply(Func f) {
+    for (int y=0; y<kSize; ++y)
+      for (int x=0; x<kSize; ++x)
+        m_pixels[y*kSize+x] = f(x, y, m_pixels[y*kSize+x]);
+  }
+
+private:
+  std::vector<bool> m_pixels;
+};
+
+gfx::Rect random_rect()
+{
+  return gfx::Rect(std::rand() % Pixels::kSize,
+                   std::rand() % Pixels::kSize,
+                   1 + std::rand() % 40,
+                   1 + std::rand() % 40) &
+    gfx::Rect(0, 0, Pixels::kSize, Pixels::kSize);
+}
+
+void expect_same_pixels(const Pixels& pixels, const Mask& mask)
+{
+  gfx::Rect bounds;
+  for (int y=0; y<Pixels::kSize; ++y)
+    for (int x=0; x<Pixels::kSize; ++x) {
+      ASSERT_EQ(pixels.get(x, y), mask.containsPoint(x, y))
+        << "x=" << x << " y=" << y;
+      if (pixels.get(x, y))
+        bounds |= gfx::Rect(x, y, 1, 1);
+    }
+
+  // The mask must be shrunk
+  ASSERT_EQ(bounds, mask.bounds());
+  ASSERT_EQ(bounds.isEmpty(), mask.isEmpty());
+  if (mask.isEmpty())
+    return;
+
+  const Image* bitmap = mask.bitmap();
+  ASSERT_TRUE(bitmap != nullptr);
+  ASSERT_EQ(bounds.w, bitmap->width());
+  ASSERT_EQ(bounds.h, bitmap->height());
+  for (int y=0; y<bounds.h; ++y)
+    for (int x=0; x<bounds.w; ++x)
+      ASSERT_EQ(pixels.get(bounds.x+x, bounds.y+y),
+                get_pixel(bitmap, x, y) ? true: false)
+        << "x=" << x << " y=" << y;
+
+  bool rectangular = true;
+  for (int y=bounds.y; y<bounds.y2(); ++y)
+    for (int x=bounds.x; x<bounds.x2(); ++x)
+      if (!pixels.get(x, y))
+        rectangular = false;
+  ASSERT_EQ(rectangular, mask.isRectangular());
+}
+
+} // anonymous namespace
+
+TEST(Mask, BooleanOperations)
+{
+  for (int t=0; t<20; ++t) {
+    Mask mask;
+    Pixels pixels;
+
+    for (int i=0; i<50; ++i) {
+      const gfx::Rect rc = random_rect();
+      // Frozen masks use the bitmap (reserved to draw in any place)
+      const bool frozen = (std::rand() % 4 == 0);
+      if (frozen) {
+        mask.freeze();
+        mask.reserve(gfx::Rect(0, 0, Pixels::kSize, Pixels::kSize));
+      }
+
+      switch (std::rand() % 6) {
+
+        case 0:
+          mask.add(rc);
+          pixels.apply([rc](int x, int y, bool v) {
+            return v || rc.contains(gfx::Point(x, y));
+          });
+          break;
+
+        case 1:
+          mask.subtract(rc);
+          pixels.apply([rc](int x, int y, bool v) {
+            return v && !rc.contains(gfx::Point(x, y));
+          });
+          break;
+
+        case 2:
+          mask.intersect(rc);
+          pixels.apply([rc](int x, int y, bool v) {
+            return v && rc.contains(gfx::Point(x, y));
+          });
+          break;
+
+        case 3:
+          if (!mask.isEmpty()) {
+            const gfx::Rect bounds = mask.bounds();
+            mask.invert();
+            pixels.apply([bounds](int x, int y, bool v) {
+              return (bounds.contains(gfx::Point(x, y)) ? !v: false);
+            });
+          }
+          break;
+
+        // Operations with other mask
+        case 4:
+        case 5: {
+          Mask other;
+          Pixels otherPixels;
+          for (int j=0; j<3; ++j) {
+            const gfx::Rect rc2 = random_rect();
+            other.add(rc2);
+            otherPixels.apply([rc2](int x, int y, bool v) {
+              return v || rc2.contains(gfx::Point(x, y));
+            });
+          }
+          // Use the bitmap of the other mask
+          if (std::rand() & 1)
+            other.bitmap();
+          if (other.isEmpty())
+            break;
+
+          switch (std::rand() % 3) {
+            case 0:
+              mask.add(other);
+              pixels.apply([&otherPixels](int x, int y, bool v) {
+                return v || otherPixels.get(x, y);
+              });
+              break;
+            case 1:
+              if (mask.isEmpty())
+                break;
+              mask.subtract(other);
+              pixels.apply([&otherPixels](int x, int y, bool v) {
+                return v && !otherPixels.get(x, y);
+              });
+              break;
+            case 2:
+              if (mask.isEmpty())
+                break;
+              mask.intersect(other);
+              pixels.apply([&otherPixels](int x, int y, bool v) {
+                return v && otherPixels.get(x, y);
+              });
+              break;
+          }
+          break;
+        }
+      }
+
+      if (frozen)
+        mask.unfreeze();
+
+      // Check a copy of the mask too
+      if (std::rand() & 1) {
+        Mask copy(mask);
+        expect_same_pixels(pixels, copy);
+      }
+      else
+        expect_same_pixels(pixels, mask);
+    }
+  }
+}
+
+TEST(Mask, ByColor)
+{
+  std::srand(2);
+
+  const color_t color = rgba(200, 100, 50, 255);
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, Pixels::kSize, Pixels::kSize));
+  clear_image(image.get(), 0);
+  for (int i=0; i<200; ++i) {
+    const int x = std::rand() % Pixels::kSize;
+    const int y = std::rand() % Pixels::kSize;
+    const int w = std::rand() % 20 + 1;
+    const int h = std::rand() % 20 + 1;
+    fill_rect(image.get(), x, y, x+w-1, y+h-1,
+              rgba(200 + std::rand() % 11 - 5,
+                   100 + std::rand() % 11 - 5,
+                   50, 255));
+  }
+
+  for (const int tolerance : { 0, 2, 5 }) {
+    Pixels pixels;
+    pixels.apply([&](int x, int y, bool) {
+      const color_t c = get_pixel(image.get(), x, y);
+      return (std::abs(int(rgba_getr(c)) - int(rgba_getr(color))) <= tolerance &&
+              std::abs(int(rgba_getg(c)) - int(rgba_getg(color))) <= tolerance &&
+              std::abs(int(rgba_getb(c)) - int(rgba_getb(color))) <= tolerance &&
+              std::abs(int(rgba_geta(c)) - int(rgba_geta(color))) <= tolerance);
+    });
+
+    Mask mask;
+    mask.byColor(image.get(), color, tolerance);
+    expect_same_pixels(pixels, mask);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2016  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,15 +13,104 @@
 
 #include "base/debug.h"
 
-#include <map>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 namespace doc {
 
-static std::mutex g_mutex;
-static ObjectId newId = 0;
-// TODO Profile this and see if an unordered_map is better
-static std::map<ObjectId, Object*> objects;
+namespace {
+
+// Objects are registered in a table indexed by ID, so get_object()
+// can find an object without locking g_mutex (a few atomic loads).
+// The table has two levels: 256 directories of 4096 pages each, and
+// each page has 4096 objects. Directories are never deleted (each
+// one covers 16M IDs), but pages are deleted when all their objects
+// are unregistered (IDs are never re-used, so old pages would be
+// empty forever). g_mutex is still used to register/unregister
+// objects.
+constexpr int kPageBits = 12;
+constexpr int kDirBits = 12;
+constexpr ObjectId kPageSize = (1 << kPageBits);
+constexpr ObjectId kDirSize = (1 << kDirBits);
+constexpr ObjectId kDirs = (1 << (32 - kPageBits - kDirBits));
+
+struct Page {
+  std::atomic<Object*> objects[kPageSize];
+  int count;                    // Number of registered objects
+};
+
+struct Directory {
+  std::atomic<Page*> pages[kDirSize];
+};
+
+std::mutex g_mutex;
+ObjectId newId = 0;
+std::atomic<Directory*> g_dirs[kDirs];
+
+// Number of threads inside get_object(). A deleted page can still be
+// used by a get_object() that started before the page was removed
+// from its directory, so removed pages are deleted only when there
+// are no readers.
+std::atomic<int> g_readers;
+std::vector<Page*> g_removedPages; // Protected by g_mutex
+
+Object* find_object(const ObjectId id)
+{
+  const Directory* dir = g_dirs[id >> (kPageBits + kDirBits)].load();
+  if (!dir)
+    return nullptr;
+
+  const Page* page = dir->pages[(id >> kPageBits) & (kDirSize-1)].load();
+  if (!page)
+    return nullptr;
+
+  return page->objects[id & (kPageSize-1)].load(std::memory_order_acquire);
+}
+
+// Sets the object of the given ID (nullptr to unregister the ID).
+// It must be called with g_mutex locked.
+void set_object(const ObjectId id, Object* obj)
+{
+  std::atomic<Directory*>& dirPtr = g_dirs[id >> (kPageBits + kDirBits)];
+  Directory* dir = dirPtr.load(std::memory_order_relaxed);
+  if (!dir) {
+    if (!obj)
+      return;
+    dir = new Directory();
+    dirPtr.store(dir);
+  }
+
+  std::atomic<Page*>& pagePtr = dir->pages[(id >> kPageBits) & (kDirSize-1)];
+  Page* page = pagePtr.load(std::memory_order_relaxed);
+  if (!page) {
+    if (!obj)
+      return;
+    page = new Page();
+    pagePtr.store(page);
+  }
+
+  std::atomic<Object*>& objPtr = page->objects[id & (kPageSize-1)];
+  const Object* old = objPtr.load(std::memory_order_relaxed);
+  if (old && !obj)
+    --page->count;
+  else if (!old && obj)
+    ++page->count;
+  objPtr.store(obj, std::memory_order_release);
+
+  if (page->count == 0) {
+    pagePtr.store(nullptr);
+    g_removedPages.push_back(page);
+  }
+
+  if (!g_removedPages.empty() && g_readers.load() == 0) {
+    for (Page* removedPage : g_removedPages)
+      delete removedPage;
+    g_removedPages.clear();
+  }
+}
+
+} // anonymous namespace
 
 Object::Object(ObjectType type)
   : m_type(type)
@@ -51,11 +140,11 @@ int Object::getMemSize() const
 const ObjectId Object::id() const
 {
   // The first time the ID is request, we store the object in the
-  // "objects" hash table.
+  // objects table.
   if (!m_id) {
     std::lock_guard lock(g_mutex);
     m_id = ++newId;
-    objects.insert(std::make_pair(m_id, const_cast<Object*>(this)));
+    set_object(m_id, const_cast<Object*>(this));
   }
   return m_id;
 }
@@ -65,32 +154,22 @@ void Object::setId(ObjectId id)
   std::lock_guard lock(g_mutex);
 
   if (m_id) {
-    auto it = objects.find(m_id);
-    ASSERT(it != objects.end());
-    ASSERT(it->second == this);
-    if (it != objects.end())
-      objects.erase(it);
+    ASSERT(find_object(m_id) == this);
+    set_object(m_id, nullptr);
   }
 
   m_id = id;
 
   if (m_id) {
 #ifdef _DEBUG
-    if (objects.find(m_id) != objects.end()) {
-      Object* obj = objects.find(m_id)->second;
-      if (obj) {
-        TRACEARGS("ASSERT FAILED: Object with id", m_id,
-                  "of kind", int(obj->type()),
-                  "version", obj->version(), "should not exist");
-      }
-      else {
-        TRACEARGS("ASSERT FAILED: Object with id", m_id,
-                  "registered as nullptr should not exist");
-      }
+    if (Object* obj = find_object(m_id)) {
+      TRACEARGS("ASSERT FAILED: Object with id", m_id,
+                "of kind", int(obj->type()),
+                "version", obj->version(), "should not exist");
     }
-    ASSERT(objects.find(m_id) == objects.end());
+    ASSERT(find_object(m_id) == nullptr);
 #endif
-    objects.insert(std::make_pair(m_id, this));
+    set_object(m_id, this);
   }
 }
 
@@ -101,12 +180,13 @@ void Object::setVersion(ObjectVersion version)
 
 Object* get_object(ObjectId id)
 {
-  std::lock_guard lock(g_mutex);
-  auto it = objects.find(id);
-  if (it != objects.end())
-    return it->second;
-  else
+  if (!id)
     return nullptr;
+
+  ++g_readers;
+  Object* obj = find_object(id);
+  --g_readers;
+  return obj;
 }
 
 } // namespace doc
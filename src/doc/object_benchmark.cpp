@@ -0,0 +1,81 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/object.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace doc;
+
+namespace {
+
+// IDs of objects shared by all benchmark threads (e.g. the cels and
+// images of the active sprite).
+const std::vector<ObjectId>& shared_ids()
+{
+  static std::vector<std::unique_ptr<Object>> objects;
+  static const std::vector<ObjectId> ids = []{
+    std::vector<ObjectId> result;
+    for (int i=0; i<10000; ++i) {
+      objects.push_back(std::make_unique<Object>(ObjectType::Image));
+      result.push_back(objects.back()->id());
+    }
+    return result;
+  }();
+  return ids;
+}
+
+void resolve_ids(benchmark::State& state,
+                 const std::vector<ObjectId>& ids)
+{
+  std::size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(get_object(ids[i]));
+    if (++i == ids.size())
+      i = 0;
+  }
+}
+
+} // anonymous namespace
+
+// Resolves IDs from several threads at the same time (e.g. the UI
+// thread and the backup thread).
+void BM_GetObject(benchmark::State& state) {
+  resolve_ids(state, shared_ids());
+}
+
+// Resolves IDs while other thread creates and deletes objects
+// (e.g. a script creating images while the backup thread resolves
+// the IDs of the sprite).
+void BM_GetObjectWhileRegistering(benchmark::State& state) {
+  std::atomic<bool> stop(false);
+  std::thread registerThread(
+    [&stop]{
+      while (!stop) {
+        Object obj(ObjectType::Image);
+        benchmark::DoNotOptimize(obj.id());
+      }
+    });
+
+  resolve_ids(state, shared_ids());
+
+  stop = true;
+  registerThread.join();
+}
+
+BENCHMARK(BM_GetObject)->ThreadRange(1, 8)->UseRealTime();
+BENCHMARK(BM_GetObjectWhileRegistering)->UseRealTime();
+
+BENCHMARK_MAIN();
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020-2023 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -20,11 +20,12 @@ namespace doc {
 // OctreeNode
 
 void OctreeNode::addColor(color_t c, int level, OctreeNode* parent,
-                          int paletteIndex, int levelDeep)
+                          int paletteIndex, int levelDeep,
+                          size_t count)
 {
   m_parent = parent;
   if (level >= levelDeep) {
-    m_leafColor.add(c);
+    m_leafColor.add(c, count);
     m_paletteIndex = paletteIndex;
     return;
   }
@@ -32,7 +33,7 @@ void OctreeNode::addColor(color_t c, int level, OctreeNode* parent,
   if (!m_children) {
     m_children.reset(new std::array<OctreeNode, 16>());
   }
-  (*m_children)[index].addColor(c, level + 1, this, paletteIndex, levelDeep);
+  (*m_children)[index].addColor(c, level + 1, this, paletteIndex, levelDeep, count);
 }
 
 int OctreeNode::mapColor(int  r, int g, int b, int a, int mask_index, const Palette* palette, int level) const
@@ -261,6 +262,22 @@ void OctreeMap::feedWithImage(const Image* image,
   m_maskColor = maskColor;
 }
 
+void OctreeMap::feedWithColors(const color_t* colors,
+                               const size_t* counts,
+                               const int n,
+                               const bool withAlpha,
+                               const color_t maskColor,
+                               const int levelDeep)
+{
+  const color_t forceFullOpacity = (withAlpha ? 0 : rgba_a_mask);
+  for (int i=0; i<n; ++i) {
+    if (rgba_geta(colors[i]))
+      m_root.addColor(colors[i] | forceFullOpacity, 0, &m_root, 0,
+                      levelDeep, counts[i]);
+  }
+  m_maskColor = maskColor;
+}
+
 int OctreeMap::mapColor(color_t rgba) const
 {
   return m_root.mapColor(rgba_getr(rgba),
@@ -271,6 +288,24 @@ int OctreeMap::mapColor(color_t rgba) const
                          m_palette, 0);
 }
 
+void OctreeMap::mapColors(const color_t* src, uint8_t* dst, const int n) const
+{
+  // Consecutive pixels use to have the same color, so we can avoid
+  // walking the tree again for them.
+  color_t prevColor = 0;
+  int prevIndex = 0;
+  bool hasPrev = false;
+  for (int i=0; i<n; ++i) {
+    const color_t c = src[i];
+    if (!hasPrev || c != prevColor) {
+      prevColor = c;
+      prevIndex = OctreeMap::mapColor(c);
+      hasPrev = true;
+    }
+    dst[i] = prevIndex;
+  }
+}
+
 void OctreeMap::regenerateMap(const Palette* palette, const int maskIndex)
 {
   ASSERT(palette);
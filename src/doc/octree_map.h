@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (c) 2020-2022 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -48,12 +48,12 @@ private:
       m_pixelCount(pixelCount) {
     }
 
-    void add(color_t c) {
-      m_r += rgba_getr(c);
-      m_g += rgba_getg(c);
-      m_b += rgba_getb(c);
-      m_a += rgba_geta(c);
-      ++m_pixelCount;
+    void add(color_t c, const size_t count = 1) {
+      m_r += double(rgba_getr(c)) * count;
+      m_g += double(rgba_getg(c)) * count;
+      m_b += double(rgba_getb(c)) * count;
+      m_a += double(rgba_geta(c)) * count;
+      m_pixelCount += count;
     }
 
     void add(LeafColor leafColor) {
@@ -91,7 +91,8 @@ public:
   LeafColor leafColor() const { return m_leafColor; }
 
   void addColor(color_t c, int level, OctreeNode* parent,
-                int paletteIndex = 0, int levelDeep = 7);
+                int paletteIndex = 0, int levelDeep = 7,
+                size_t count = 1);
 
   int mapColor(int  r, int g, int b, int a, int mask_index, const Palette* palette, int level) const;
 
@@ -134,9 +135,20 @@ public:
                      const color_t maskColor,
                      const int levelDeep = 7);
 
+  // Same as feedWithImage() with a list of RGBA colors and the
+  // number of pixels of each color (e.g. the colors of an image
+  // calculated previously).
+  void feedWithColors(const color_t* colors,
+                      const size_t* counts,
+                      const int n,
+                      const bool withAlpha,
+                      const color_t maskColor,
+                      const int levelDeep = 7);
+
   // RgbMap impl
   void regenerateMap(const Palette* palette, const int maskIndex) override;
   int mapColor(color_t rgba) const override;
+  void mapColors(const color_t* src, uint8_t* dst, const int n) const override;
   int maskIndex() const override { return m_maskIndex; }
   int mapColor(const int r, const int g,
                const int b, const int a) const
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -19,9 +19,11 @@
 #include "doc/rgbmap.h"
 #include "doc/tile.h"
 #include "gfx/region.h"
+#include "sched/task_group.h"
 
 #include <city.h>
 
+#include <cstring>
 #include <stdexcept>
 
 namespace doc {
@@ -378,8 +380,30 @@ int count_diff_between_images_templ(const Image* i1, const Image* i2)
 }
 
 template<typename ImageTraits>
-int is_same_image_templ(const Image* i1, const Image* i2)
-{
+bool is_same_image_templ(const Image* i1, const Image* i2)
+{
+  // Compare full rows with memcmp() (vectorized by the C library),
+  // and only if the bytes are different we compare each pixel
+  // (e.g. two RGB transparent pixels are the same color even when
+  // their RGB components are different).
+  if constexpr (ImageTraits::pixels_per_byte == 0) {
+    using const_address_t = typename ImageTraits::const_address_t;
+    const int w = i1->width();
+    const std::size_t rowBytes = ImageTraits::getRowStrideBytes(w);
+    for (int y=0; y<i1->height(); ++y) {
+      const auto p1 = (const_address_t)i1->getPixelAddress(0, y);
+      const auto p2 = (const_address_t)i2->getPixelAddress(0, y);
+      if (std::memcmp(p1, p2, rowBytes) == 0)
+        continue;
+
+      for (int x=0; x<w; ++x) {
+        if (!ImageTraits::same_color(p1[x], p2[x]))
+          return false;
+      }
+    }
+    return true;
+  }
+
   const LockImageBits<ImageTraits> bits1(i1);
   const LockImageBits<ImageTraits> bits2(i2);
   typename LockImageBits<ImageTraits>::const_iterator it1, it2, end1, end2;
@@ -442,6 +466,9 @@ bool is_same_image(const Image* i1, const Image* i2)
       (i1->height() != i2->height()))
     return false;
 
+  if (i1 == i2)
+    return true;
+
   switch (i1->pixelFormat()) {
     case IMAGE_RGB:       return is_same_image_templ<RgbTraits>(i1, i2);
     case IMAGE_GRAYSCALE: return is_same_image_templ<GrayscaleTraits>(i1, i2);
@@ -454,22 +481,47 @@ bool is_same_image(const Image* i1, const Image* i2)
   return false;
 }
 
+namespace {
+
+// Remaps a row of indexed pixels with a table of the 256 possible
+// values (instead of checking each pixel with Remap::operator[]).
+void remap_indexed_row(uint8_t* p, const int w, const uint8_t* lut)
+{
+  int x = 0;
+  for (; x+4<=w; x+=4, p+=4) {
+    const uint8_t a = lut[p[0]];
+    const uint8_t b = lut[p[1]];
+    const uint8_t c = lut[p[2]];
+    const uint8_t d = lut[p[3]];
+    p[0] = a;
+    p[1] = b;
+    p[2] = c;
+    p[3] = d;
+  }
+  for (; x<w; ++x, ++p)
+    *p = lut[*p];
+}
+
+} // anonymous namespace
+
 void remap_image(Image* image, const Remap& remap)
 {
   ASSERT(image->pixelFormat() == IMAGE_INDEXED ||
          image->pixelFormat() == IMAGE_TILEMAP);
 
   switch (image->pixelFormat()) {
-    case IMAGE_INDEXED:
-      transform_image<IndexedTraits>(
-        image, [&remap](color_t c) -> color_t {
-          auto to = remap[c];
-          if (to != Remap::kUnused)
-            return to;
-          else
-            return c;
-        });
+    case IMAGE_INDEXED: {
+      uint8_t lut[256];
+      for (int c=0; c<256; ++c) {
+        const int to = remap[c];
+        lut[c] = uint8_t(to != Remap::kUnused ? to: c);
+      }
+      const int w = image->width();
+      const int h = image->height();
+      for (int y=0; y<h; ++y)
+        remap_indexed_row(image->getPixelAddress(0, y), w, lut);
       break;
+    }
     case IMAGE_TILEMAP:
       transform_image<TilemapTraits>(
         image, [&remap](color_t c) -> color_t {
@@ -485,52 +537,85 @@ void remap_image(Image* image, const Remap& remap)
   }
 }
 
-// TODO test this hash routine and find a better alternative
-
-template <typename ImageTraits, uint32_t Mask>
-static uint32_t calculate_image_hash_templ(const Image* image,
-                                           const gfx::Rect& bounds)
+void remap_images(const std::vector<ImageRef>& images, const Remap& remap)
 {
-#if defined(__LP64__) || defined(__x86_64__) || defined(_WIN64)
-  #define CITYHASH(buf, len) (CityHash64(buf, len) & 0xffffffff)
-  static_assert(sizeof(void*) == 8, "This CPU is not 64-bit");
-#else
-  #define CITYHASH(buf, len) CityHash32(buf, len)
-  static_assert(sizeof(void*) == 4, "This CPU is not 32-bit");
-#endif
+  // Small images (e.g. tiles) are grouped in the same task
+  const int kMinPixelsPerTask = 64*1024;
+
+  int64_t totalPixels = 0;
+  for (const ImageRef& image : images)
+    totalPixels += int64_t(image->width()) * image->height();
 
-  const uint32_t rowlen = ImageTraits::getRowStrideBytes(bounds.w);
-  const uint32_t len = rowlen * bounds.h;
-  if (bounds == image->bounds()) {
-    return CITYHASH((const char*)image->getPixelAddress(0, 0), len);
+  const int threads = sched::Scheduler::instance().threads();
+  if (threads <= 1 || totalPixels < 2*kMinPixelsPerTask) {
+    for (const ImageRef& image : images)
+      remap_image(image.get(), remap);
+    return;
   }
-  else {
-    ASSERT(false);              // TODO not used at this moment
-
-    std::vector<uint8_t> buf(len);
-    uint8_t* dst = &buf[0];
-    for (int y=0; y<bounds.h; ++y, dst+=rowlen) {
-      auto src = image->getPixelAddress(bounds.x, bounds.y+y);
-      std::copy(dst, dst+rowlen, src);
+
+  sched::TaskGroup tasks(sched::Priority::UI);
+  for (std::size_t i=0; i<images.size(); ) {
+    const std::size_t begin = i;
+    int64_t pixels = 0;
+    while (i < images.size() && pixels < kMinPixelsPerTask) {
+      pixels += int64_t(images[i]->width()) * images[i]->height();
+      ++i;
     }
-    return CITYHASH((const char*)&buf[0], buf.size());
+    const std::size_t end = i;
+    tasks.run([&images, &remap, begin, end]{
+      for (std::size_t j=begin; j<end; ++j)
+        remap_image(images[j].get(), remap);
+    });
   }
+  tasks.wait();
 }
 
 uint32_t calculate_image_hash(const Image* img, const gfx::Rect& bounds)
 {
-  switch (img->pixelFormat()) {
-    case IMAGE_RGB:       return calculate_image_hash_templ<RgbTraits, rgba_rgb_mask>(img, bounds);
-    case IMAGE_GRAYSCALE: return calculate_image_hash_templ<GrayscaleTraits, graya_v_mask>(img, bounds);
-    case IMAGE_INDEXED:   return calculate_image_hash_templ<IndexedTraits, 0xff>(img, bounds);
-    case IMAGE_BITMAP:    return calculate_image_hash_templ<BitmapTraits, 1>(img, bounds);
+  return uint32_t(calculate_image_hash64(img, bounds));
+}
+
+uint64_t calculate_image_hash64(const Image* img, const gfx::Rect& bounds)
+{
+  const gfx::Rect rc = bounds & img->bounds();
+  uint64_t hash = (uint64_t(rc.w) << 32) | uint64_t(rc.h);
+  const uint64_t seed = uint64_t(img->pixelFormat());
+  if (rc.isEmpty())
+    return hash;
+
+  // Fast path: hash the whole contiguous buffer at once
+  if (rc == img->bounds() &&
+      img->getRowStrideSize() == img->getRowStrideSize(rc.w)) {
+    return CityHash64WithSeeds((const char*)img->getPixelAddress(0, 0),
+                               size_t(img->getRowStrideSize()) * rc.h,
+                               hash, seed);
   }
-  ASSERT(false);
-  return 0;
+
+  // Bitmap rows cannot be hashed by bytes if they don't start in a
+  // byte boundary.
+  if (img->pixelFormat() == IMAGE_BITMAP) {
+    std::vector<uint8_t> row(rc.w);
+    for (int y=rc.y; y<rc.y2(); ++y) {
+      for (int x=0; x<rc.w; ++x)
+        row[x] = uint8_t(img->getPixel(rc.x+x, y));
+      hash = CityHash64WithSeeds((const char*)&row[0], row.size(), hash, seed);
+    }
+    return hash;
+  }
+
+  const int rowlen = img->getRowStrideSize(rc.w);
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    hash = CityHash64WithSeeds((const char*)img->getPixelAddress(rc.x, y),
+                               rowlen, hash, seed);
+  }
+  return hash;
 }
 
 void preprocess_transparent_pixels(Image* image)
 {
+  // Pixels are modified without changing the image version
+  image->discardHash();
+
   switch (image->pixelFormat()) {
 
     case IMAGE_RGB: {
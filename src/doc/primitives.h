@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2018-2023 Igara Studio S.A.
+// Copyright (c) 2018-2024 Igara Studio S.A.
 // Copyright (c) 2001-2016 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,8 +13,11 @@
 #include "doc/blend_mode.h"
 #include "doc/color.h"
 #include "doc/image_buffer.h"
+#include "doc/image_ref.h"
 #include "gfx/fwd.h"
 
+#include <vector>
+
 namespace doc {
   class Brush;
   class Image;
@@ -53,9 +56,23 @@ namespace doc {
 
   void remap_image(Image* image, const Remap& remap);
 
+  // Same as remap_image() for several images using several threads
+  // (the images must be different, they are remapped at the same
+  // time).
+  void remap_images(const std::vector<ImageRef>& images, const Remap& remap);
+
+  // Same as calculate_image_hash64() truncated to 32 bits.
   uint32_t calculate_image_hash(const Image* image,
                                 const gfx::Rect& bounds);
 
+  // 64-bit hash of the pixels inside the given bounds. The size of
+  // the bounds and the pixel format are part of the hash, so it can
+  // be used to find duplicated images with a low probability of
+  // collisions (but images with the same hash must be still compared
+  // with is_same_image()).
+  uint64_t calculate_image_hash64(const Image* image,
+                                  const gfx::Rect& bounds);
+
   // Sets RGB values to 0 when alpha=0 (to match images with alpha=0
   // in tilesets/calculate_image_hash)
   void preprocess_transparent_pixels(Image* image);
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2020-2022 Igara Studio S.A.
+// Copyright (c) 2020-2024 Igara Studio S.A.
 // Copyright (c) 2001-2015 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -12,8 +12,10 @@
 #include <gtest/gtest.h>
 
 #include "doc/remap.h"
+#include "doc/image.h"
 #include "doc/palette.h"
 #include "doc/palette_picks.h"
+#include "doc/primitives.h"
 
 using namespace doc;
 
@@ -193,6 +195,35 @@ TEST(Remap, BetweenPalettesNonInvertible)
   EXPECT_FALSE(map.isInvertible(all));
 }
 
+TEST(Remap, RemapImages)
+{
+  Remap map(4);
+  map.map(0, 3);
+  map.map(1, 2);
+  map.unused(2);
+  map.map(3, 0);
+
+  // Odd widths to test the last pixels of each row
+  std::vector<ImageRef> images;
+  for (int w=1; w<=7; ++w) {
+    ImageRef image(Image::create(IMAGE_INDEXED, w, 3));
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        put_pixel(image.get(), x, y, (x+y) % 6);
+    images.push_back(image);
+  }
+
+  remap_images(images, map);
+
+  // Unused and out of range entries are kept
+  static const color_t expected[] = { 3, 2, 2, 0, 4, 5 };
+  for (const ImageRef& image : images) {
+    for (int y=0; y<image->height(); ++y)
+      for (int x=0; x<image->width(); ++x)
+        EXPECT_EQ(expected[(x+y) % 6], get_pixel(image.get(), x, y));
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
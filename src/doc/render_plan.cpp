@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -12,6 +12,7 @@
 
 #include "doc/cel.h"
 #include "doc/layer.h"
+#include "doc/sprite.h"
 
 #include <algorithm>
 #include <cmath>
@@ -80,4 +81,51 @@ void RenderPlan::processZIndexes() const
             });
 }
 
+static RenderPlanCache::RenderPlanPtr create_plan(const Layer* layer,
+                                                  const frame_t frame)
+{
+  auto plan = std::make_shared<RenderPlan>();
+  plan->addLayer(layer, frame);
+  return plan;
+}
+
+RenderPlanCache::RenderPlanPtr RenderPlanCache::plan(const Layer* layer,
+                                                     const frame_t frame)
+{
+  ASSERT(layer);
+  ASSERT(layer->sprite());
+
+  const ObjectId layerId = layer->id();
+  const ObjectVersion version = layer->sprite()->structureVersion();
+
+  auto it = std::find_if(m_entries.begin(), m_entries.end(),
+                         [layerId, frame](const Entry& entry){
+                           return (entry.layerId == layerId &&
+                                   entry.frame == frame);
+                         });
+  if (it != m_entries.end()) {
+    if (it->version != version) {
+      it->version = version;
+      it->plan = create_plan(layer, frame);
+    }
+  }
+  else {
+    if (int(m_entries.size()) >= kMaxPlans)
+      m_entries.pop_back();
+    m_entries.push_back(Entry{ layerId, frame, version,
+                               create_plan(layer, frame) });
+    it = m_entries.end()-1;
+  }
+
+  // Move the entry to the front
+  if (it != m_entries.begin())
+    std::rotate(m_entries.begin(), it, it+1);
+  return m_entries.front().plan;
+}
+
+void RenderPlanCache::clear()
+{
+  m_entries.clear();
+}
+
 } // namespace doc
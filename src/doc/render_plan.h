@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,11 @@
 #include "doc/cel.h"
 #include "doc/cel_list.h"
 #include "doc/frame.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
+
+#include <memory>
+#include <vector>
 
 namespace doc {
   class Layer;
@@ -51,6 +56,32 @@ namespace doc {
     mutable bool m_processZIndex = true;
   };
 
+  // Keeps the last created RenderPlans (e.g. of the current frame and
+  // the onion skin frames) to avoid creating them (and sorting them by
+  // z-index) each time the same frame is rendered. A plan is valid
+  // until the Sprite::structureVersion() of its layer changes.
+  class RenderPlanCache {
+  public:
+    using RenderPlanPtr = std::shared_ptr<const RenderPlan>;
+
+    // Returns the plan to render the given layer in the given frame.
+    RenderPlanPtr plan(const Layer* layer,
+                       const frame_t frame);
+    void clear();
+
+  private:
+    static constexpr int kMaxPlans = 4;
+
+    struct Entry {
+      ObjectId layerId;
+      frame_t frame;
+      ObjectVersion version;
+      RenderPlanPtr plan;
+    };
+
+    std::vector<Entry> m_entries; // The most recently used first
+  };
+
 } // namespace doc
 
 #endif
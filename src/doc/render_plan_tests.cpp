@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2023  Igara Studio S.A.
+// Copyright (c) 2023-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -134,6 +134,53 @@ TEST(RenderPlan, ZIndexBugWithEmptyCels)
   d->setZIndex(-3); EXPECT_PLAN(d, a, b);
 }
 
+TEST(RenderPlan, Cache)
+{
+  auto doc = std::make_shared<Document>();
+  ImageSpec spec(ColorMode::INDEXED, 2, 2);
+  Sprite* spr;
+  doc->sprites().add(spr = Sprite::MakeStdSprite(spec));
+
+  LayerImage
+    *lay0 = static_cast<LayerImage*>(spr->root()->firstLayer()),
+    *lay1 = new LayerImage(spr);
+  Cel* a = lay0->cel(0), *b;
+  lay1->addCel(b = new Cel(0, ImageRef(Image::create(spec))));
+  spr->root()->insertLayer(lay1, lay0);
+
+  RenderPlanCache cache;
+  auto plan = cache.plan(spr->root(), 0);
+  ASSERT_EQ(2, plan->items().size());
+  EXPECT_EQ(a, plan->items()[0].cel);
+  EXPECT_EQ(b, plan->items()[1].cel);
+
+  // Same plan while the structure doesn't change
+  EXPECT_EQ(plan, cache.plan(spr->root(), 0));
+  EXPECT_NE(plan, cache.plan(spr->root(), 1));
+  EXPECT_EQ(plan, cache.plan(spr->root(), 0));
+
+  // Changing the z-index creates a new plan
+  a->setZIndex(1);
+  plan = cache.plan(spr->root(), 0);
+  EXPECT_EQ(b, plan->items()[0].cel);
+  EXPECT_EQ(a, plan->items()[1].cel);
+
+  // Hiding a layer creates a new plan
+  lay1->setVisible(false);
+  plan = cache.plan(spr->root(), 0);
+  ASSERT_EQ(1, plan->items().size());
+  EXPECT_EQ(a, plan->items()[0].cel);
+
+  // Removing a cel creates a new plan
+  lay1->setVisible(true);
+  a->setZIndex(0);
+  lay1->removeCel(b);
+  delete b;
+  plan = cache.plan(spr->root(), 0);
+  ASSERT_EQ(2, plan->items().size());
+  EXPECT_EQ(nullptr, plan->items()[1].cel);
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
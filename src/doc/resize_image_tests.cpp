@@ -86,6 +86,32 @@ TEST(ResizeImage, NearestNeighborInterp)
   ASSERT_EQ(0, count_diff_between_images(src.get(), dst2.get()));
 }
 
+TEST(ResizeImage, BilinearInterpRows)
+{
+  for (const PixelFormat format : { IMAGE_RGB, IMAGE_GRAYSCALE }) {
+    const color_t black = (format == IMAGE_RGB ? rgba(0, 0, 0, 255): graya(0, 255));
+    const color_t white = (format == IMAGE_RGB ? rgba(255, 255, 255, 255): graya(255, 255));
+    const color_t gray = (format == IMAGE_RGB ? rgba(128, 128, 128, 255): graya(128, 255));
+
+    ImageRef src(Image::create(format, 2, 40));
+    for (int y=0; y<src->height(); ++y) {
+      src->putPixel(0, y, black);
+      src->putPixel(1, y, white);
+    }
+
+    ImageRef dst(Image::create(format, 3, 300));
+    algorithm::resize_image(src.get(), dst.get(),
+                            algorithm::RESIZE_METHOD_BILINEAR,
+                            nullptr, nullptr, -1);
+
+    for (int y=0; y<dst->height(); ++y) {
+      EXPECT_EQ(black, dst->getPixel(0, y));
+      EXPECT_EQ(gray, dst->getPixel(1, y));
+      EXPECT_EQ(white, dst->getPixel(2, y));
+    }
+  }
+}
+
 #if 0                           // TODO complete this test
 TEST(ResizeImage, BilinearInterpRGBType)
 {
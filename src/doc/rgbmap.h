@@ -11,6 +11,8 @@
 #include "base/debug.h"
 #include "doc/color.h"
 
+#include <cstdint>
+
 namespace doc {
 
   class Palette;
@@ -27,6 +29,14 @@ namespace doc {
 
     virtual int maskIndex() const = 0;
 
+    // Maps "n" RGBA values to palette indexes (e.g. a whole row of
+    // an image). It should be faster than calling mapColor() for each
+    // pixel.
+    virtual void mapColors(const color_t* src, uint8_t* dst, const int n) const {
+      for (int i=0; i<n; ++i)
+        dst[i] = mapColor(src[i]);
+    }
+
     int mapColor(const int r,
                  const int g,
                  const int b,
@@ -14,6 +14,7 @@ namespace doc {
     DEFAULT = 0,
     RGB5A3 = 1,
     OCTREE = 2,
+    KDTREE = 3,
   };
 
 } // namespace doc
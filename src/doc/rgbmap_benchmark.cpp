@@ -0,0 +1,58 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/rgbmap_kdtree.h"
+#include "doc/rgbmap_rgb5a3.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+template<typename Map>
+void BM_MapColors(benchmark::State& state) {
+  const int ncolors = state.range(0);
+
+  Palette::initBestfit();
+  std::srand(1);
+  Palette pal(frame_t(0), 256);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() % 256, std::rand() % 256,
+                         std::rand() % 256, 255));
+
+  // A 256x256 image with "ncolors" different colors
+  std::vector<color_t> colors(ncolors);
+  for (color_t& c : colors)
+    c = rgba(std::rand() % 256, std::rand() % 256, std::rand() % 256, 255);
+  std::vector<color_t> src(256*256);
+  for (color_t& c : src)
+    c = colors[std::rand() % ncolors];
+  std::vector<uint8_t> dst(src.size());
+
+  Map map;
+  map.regenerateMap(&pal, -1);
+  while (state.KeepRunning()) {
+    map.mapColors(&src[0], &dst[0], int(src.size()));
+    benchmark::DoNotOptimize(dst[0]);
+  }
+}
+
+BENCHMARK_TEMPLATE(BM_MapColors, RgbMapRGB5A3)
+  ->Arg(16)->Arg(4096)->Arg(65536);
+BENCHMARK_TEMPLATE(BM_MapColors, OctreeMap)
+  ->Arg(16)->Arg(4096)->Arg(65536);
+BENCHMARK_TEMPLATE(BM_MapColors, RgbMapKdTree)
+  ->Arg(16)->Arg(4096)->Arg(65536);
+
+BENCHMARK_MAIN();
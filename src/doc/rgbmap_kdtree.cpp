@@ -0,0 +1,177 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "doc/rgbmap_kdtree.h"
+
+#include "doc/palette.h"
+
+#include <algorithm>
+#include <limits>
+
+namespace doc {
+
+// Same weights used in Palette::findBestfit()
+static const int kWeights[4] = { 30*30, 59*59, 11*11, 8*8 };
+
+static void get_components(const color_t rgba, int c[4])
+{
+  c[0] = rgba_getr(rgba);
+  c[1] = rgba_getg(rgba);
+  c[2] = rgba_getb(rgba);
+  c[3] = rgba_geta(rgba);
+}
+
+RgbMapKdTree::RgbMapKdTree()
+  : m_root(-1)
+  , m_cache(1 << kCacheBits, uint64_t(kInvalid) << 32)
+  , m_palette(nullptr)
+  , m_modifications(0)
+  , m_maskIndex(0)
+{
+}
+
+void RgbMapKdTree::regenerateMap(const Palette* palette, const int maskIndex)
+{
+  ASSERT(palette);
+  if (!palette)
+    return;
+
+  // Skip useless regenerations
+  if (m_palette == palette &&
+      m_modifications == palette->getModifications() &&
+      m_maskIndex == maskIndex)
+    return;
+
+  m_palette = palette;
+  m_modifications = palette->getModifications();
+  m_maskIndex = maskIndex;
+
+  // The mask index is never returned for opaque colors (like in
+  // Palette::findBestfit())
+  std::vector<Node> points;
+  const int size = std::min(256, palette->size());
+  points.reserve(size);
+  for (int i=0; i<size; ++i) {
+    if (i == maskIndex)
+      continue;
+    Node node;
+    get_components(palette->getEntry(i), node.c);
+    node.index = i;
+    node.axis = 0;
+    points.push_back(node);
+  }
+
+  m_nodes.clear();
+  m_nodes.reserve(points.size());
+  m_root = build(points, 0, int(points.size()));
+
+  std::fill(m_cache.begin(), m_cache.end(), uint64_t(kInvalid) << 32);
+}
+
+void RgbMapKdTree::mapColors(const color_t* src, uint8_t* dst, const int n) const
+{
+  for (int i=0; i<n; ++i)
+    dst[i] = RgbMapKdTree::mapColor(src[i]);
+}
+
+int RgbMapKdTree::findNearestUncached(const color_t rgba) const
+{
+  // Transparent colors are mapped to the mask index
+  if (rgba_geta(rgba) == 0 && m_maskIndex >= 0)
+    return m_maskIndex;
+
+  int c[4];
+  get_components(rgba, c);
+
+  int bestIndex = 0;
+  int bestDist = std::numeric_limits<int>::max();
+  search(m_root, c, bestIndex, bestDist);
+  return bestIndex;
+}
+
+int RgbMapKdTree::findNearest(const color_t rgba) const
+{
+  const int index = findNearestUncached(rgba);
+  m_cache[cacheIndex(rgba)] = (uint64_t(index) << 32) | rgba;
+  return index;
+}
+
+// Creates a balanced tree with the points[beg, end) range splitting
+// by the axis with the biggest (weighted) spread. Returns the index
+// of the root node in m_nodes.
+int RgbMapKdTree::build(std::vector<Node>& points, int beg, int end)
+{
+  if (beg >= end)
+    return -1;
+
+  int axis = 0;
+  int maxSpread = -1;
+  for (int k=0; k<4; ++k) {
+    auto minmax = std::minmax_element(
+      points.begin()+beg, points.begin()+end,
+      [k](const Node& a, const Node& b){ return a.c[k] < b.c[k]; });
+    const int d = minmax.second->c[k] - minmax.first->c[k];
+    const int spread = kWeights[k] * d * d;
+    if (spread > maxSpread) {
+      maxSpread = spread;
+      axis = k;
+    }
+  }
+
+  const int mid = (beg + end) / 2;
+  std::nth_element(
+    points.begin()+beg, points.begin()+mid, points.begin()+end,
+    [axis](const Node& a, const Node& b){ return a.c[axis] < b.c[axis]; });
+
+  const int i = int(m_nodes.size());
+  m_nodes.push_back(points[mid]);
+  m_nodes[i].axis = axis;
+
+  const int left = build(points, beg, mid);
+  const int right = build(points, mid+1, end);
+  m_nodes[i].left = left;
+  m_nodes[i].right = right;
+  return i;
+}
+
+void RgbMapKdTree::search(const int i, const int c[4],
+                          int& bestIndex, int& bestDist) const
+{
+  if (i < 0)
+    return;
+
+  const Node& node = m_nodes[i];
+  int dist = 0;
+  for (int k=0; k<4; ++k) {
+    const int d = c[k] - node.c[k];
+    dist += kWeights[k] * d * d;
+  }
+
+  // On ties we prefer the lowest palette index (as a linear search
+  // from the first entry would do)
+  if (dist < bestDist ||
+      (dist == bestDist && node.index < bestIndex)) {
+    bestDist = dist;
+    bestIndex = node.index;
+  }
+
+  const int d = c[node.axis] - node.c[node.axis];
+  const int nearChild = (d < 0 ? node.left: node.right);
+  const int farChild = (d < 0 ? node.right: node.left);
+
+  search(nearChild, c, bestIndex, bestDist);
+
+  // Points on the other side are at least this distance away (we
+  // include the equal distance case to solve ties)
+  if (kWeights[node.axis] * d * d <= bestDist)
+    search(farChild, c, bestIndex, bestDist);
+}
+
+} // namespace doc
@@ -0,0 +1,79 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_RGBMAP_KDTREE_H_INCLUDED
+#define DOC_RGBMAP_KDTREE_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "doc/rgbmap.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace doc {
+
+  class Palette;
+
+  // Exact nearest palette entry for each RGBA value. It uses the same
+  // weighted RGBA distance as Palette::findBestfit() but with 8-bit
+  // components, searching a k-d tree of the palette entries built in
+  // regenerateMap(). The results are cached in a fixed-size table.
+  class RgbMapKdTree : public RgbMap {
+  public:
+    RgbMapKdTree();
+
+    // RgbMap impl
+    void regenerateMap(const Palette* palette, const int maskIndex) override;
+    int mapColor(const color_t rgba) const override {
+      const uint64_t entry = m_cache[cacheIndex(rgba)];
+      if (uint32_t(entry) == rgba && (entry >> 32) != kInvalid)
+        return int(entry >> 32);
+      return findNearest(rgba);
+    }
+    void mapColors(const color_t* src, uint8_t* dst, const int n) const override;
+    int maskIndex() const override { return m_maskIndex; }
+
+    // Searches the nearest entry without using the cache.
+    int findNearestUncached(const color_t rgba) const;
+
+  private:
+    struct Node {
+      int c[4];                 // Components of the palette entry (r, g, b, a)
+      int index;                // Palette index
+      int axis;                 // Split axis
+      int left = -1, right = -1;  // Children in m_nodes
+    };
+
+    static constexpr uint32_t kInvalid = 0xffffffff;
+    static constexpr int kCacheBits = 16;
+
+    static uint32_t cacheIndex(const color_t rgba) {
+      return (rgba * 0x9e3779b1u) >> (32 - kCacheBits);
+    }
+
+    int build(std::vector<Node>& points, int beg, int end);
+    void search(const int node, const int c[4],
+                int& bestIndex, int& bestDist) const;
+    int findNearest(const color_t rgba) const;
+
+    std::vector<Node> m_nodes;
+    int m_root;
+
+    // Each entry is the color (low 32 bits) and its palette index
+    // (high 32 bits) in only one 64-bit value.
+    mutable std::vector<uint64_t> m_cache;
+
+    const Palette* m_palette;
+    int m_modifications;
+    int m_maskIndex;
+
+    DISABLE_COPYING(RgbMapKdTree);
+  };
+
+} // namespace doc
+
+#endif
@@ -14,6 +14,16 @@
 #include "doc/color_scales.h"
 #include "doc/palette.h"
 
+// SSE2 and NEON are always available on x64 and ARM64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define DOC_RGBMAP_SSE2 1
+  #include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  #define DOC_RGBMAP_NEON 1
+  #include <arm_neon.h>
+#endif
+
 namespace doc {
 
 #define RSIZE   32
@@ -57,4 +67,52 @@ int RgbMapRGB5A3::generateEntry(int i, int r, int g, int b, int a) const
       scale_3bits_to_8bits(a>>5), m_maskIndex);
 }
 
+void RgbMapRGB5A3::mapColors(const color_t* src, uint8_t* dst, const int n) const
+{
+  int i = 0;
+
+#if DOC_RGBMAP_SSE2 || DOC_RGBMAP_NEON
+  // Calculate the m_map index of 4 pixels at the same time, it's the
+  // same index calculated in mapColor() but directly from the
+  // packed RGBA value (r=bits 0-7, g=8-15, b=16-23, a=24-31):
+  //   (a>>5) | ((b>>3)<<3) | ((g>>3)<<8) | ((r>>3)<<13)
+  static_assert(rgba_r_shift == 0 &&
+                rgba_g_shift == 8 &&
+                rgba_b_shift == 16 &&
+                rgba_a_shift == 24,
+                "Unexpected RGBA layout");
+
+  alignas(16) uint32_t idx[4];
+  for (; i+4 <= n; i += 4) {
+#if DOC_RGBMAP_SSE2
+    const __m128i c = _mm_loadu_si128((const __m128i*)(src+i));
+    const __m128i v =
+      _mm_or_si128(
+        _mm_or_si128(_mm_srli_epi32(c, 29),
+                     _mm_and_si128(_mm_srli_epi32(c, 16), _mm_set1_epi32(0xF8))),
+        _mm_or_si128(_mm_and_si128(_mm_srli_epi32(c, 3), _mm_set1_epi32(0x1F00)),
+                     _mm_and_si128(_mm_slli_epi32(c, 10), _mm_set1_epi32(0x3E000))));
+    _mm_store_si128((__m128i*)idx, v);
+#else
+    const uint32x4_t c = vld1q_u32((const uint32_t*)(src+i));
+    const uint32x4_t v =
+      vorrq_u32(
+        vorrq_u32(vshrq_n_u32(c, 29),
+                  vandq_u32(vshrq_n_u32(c, 16), vdupq_n_u32(0xF8))),
+        vorrq_u32(vandq_u32(vshrq_n_u32(c, 3), vdupq_n_u32(0x1F00)),
+                  vandq_u32(vshlq_n_u32(c, 10), vdupq_n_u32(0x3E000))));
+    vst1q_u32(idx, v);
+#endif
+
+    for (int j=0; j<4; ++j) {
+      const int v = m_map[idx[j]];
+      dst[i+j] = ((v & INVALID) ? generateEntry(idx[j], src[i+j]): v);
+    }
+  }
+#endif
+
+  for (; i<n; ++i)
+    dst[i] = RgbMapRGB5A3::mapColor(src[i]);
+}
+
 } // namespace doc
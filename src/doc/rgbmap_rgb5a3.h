@@ -41,10 +41,19 @@ namespace doc {
       return (v & INVALID) ? generateEntry(i, r, g, b, a): v;
     }
 
+    void mapColors(const color_t* src, uint8_t* dst, const int n) const override;
+
     int maskIndex() const override { return m_maskIndex; }
 
   private:
     int generateEntry(int i, int r, int g, int b, int a) const;
+    int generateEntry(int i, color_t rgba) const {
+      return generateEntry(i,
+                           rgba_getr(rgba),
+                           rgba_getg(rgba),
+                           rgba_getb(rgba),
+                           rgba_geta(rgba));
+    }
 
     mutable std::vector<uint16_t> m_map;
     const Palette* m_palette;
@@ -0,0 +1,133 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/rgbmap_kdtree.h"
+#include "doc/rgbmap_rgb5a3.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace doc;
+
+static void expect_same_batch_results(RgbMap& a, RgbMap& b,
+                                      const Palette& pal)
+{
+  a.regenerateMap(&pal, 0);
+  b.regenerateMap(&pal, 0);
+
+  // Random colors with some runs of the same color, the length is
+  // not a multiple of 4 to test the remaining pixels
+  std::vector<color_t> src(1003);
+  for (int i=0; i<int(src.size()); ++i) {
+    if (i > 0 && (std::rand() % 3) == 0)
+      src[i] = src[i-1];
+    else
+      src[i] = rgba(std::rand() % 256, std::rand() % 256,
+                    std::rand() % 256, std::rand() % 256);
+  }
+
+  for (int n : { 0, 1, 3, 4, 5, 17, int(src.size()) }) {
+    std::vector<uint8_t> dst(n+1, 255);
+    a.mapColors(&src[0], &dst[0], n);
+    for (int i=0; i<n; ++i)
+      ASSERT_EQ(b.mapColor(src[i]), dst[i]) << "i=" << i << " n=" << n;
+    EXPECT_EQ(255, dst[n]);
+  }
+}
+
+TEST(RgbMap, MapColorsMatchesMapColor)
+{
+  // RgbMapRGB5A3 and OctreeMap use findBestfit()
+  Palette::initBestfit();
+
+  Palette pal(frame_t(0), 32);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() % 256, std::rand() % 256,
+                         std::rand() % 256, std::rand() % 256));
+
+  {
+    RgbMapRGB5A3 a, b;
+    expect_same_batch_results(a, b, pal);
+  }
+  {
+    OctreeMap a, b;
+    expect_same_batch_results(a, b, pal);
+  }
+  {
+    RgbMapKdTree a, b;
+    expect_same_batch_results(a, b, pal);
+  }
+}
+
+TEST(RgbMap, KdTreeFindsTheNearestColor)
+{
+  // Same weights as Palette::findBestfit()
+  static const int w[4] = { 30*30, 59*59, 11*11, 8*8 };
+
+  for (int t=0; t<20; ++t) {
+    Palette pal(frame_t(0), 1 + (std::rand() % 256));
+    for (int i=0; i<pal.size(); ++i) {
+      // Repeat some entries to check that the lowest index is used
+      if (i > 0 && (std::rand() % 8) == 0)
+        pal.setEntry(i, pal.getEntry(i-1));
+      else
+        pal.setEntry(i, rgba(std::rand() % 256, std::rand() % 256,
+                             std::rand() % 256, std::rand() % 256));
+    }
+    const int mask = (t & 1 ? 0: -1);
+
+    RgbMapKdTree map;
+    map.regenerateMap(&pal, mask);
+    EXPECT_EQ(mask, map.maskIndex());
+
+    for (int k=0; k<500; ++k) {
+      const color_t c = rgba(std::rand() % 256, std::rand() % 256,
+                             std::rand() % 256, std::rand() % 256);
+      if (mask >= 0 && rgba_geta(c) == 0) {
+        EXPECT_EQ(mask, map.mapColor(c));
+        continue;
+      }
+
+      const int cc[4] = { int(rgba_getr(c)), int(rgba_getg(c)),
+                          int(rgba_getb(c)), int(rgba_geta(c)) };
+      int best = -1, bestDist = 0;
+      for (int i=0; i<pal.size(); ++i) {
+        if (i == mask)
+          continue;
+        const color_t e = pal.getEntry(i);
+        const int ec[4] = { int(rgba_getr(e)), int(rgba_getg(e)),
+                            int(rgba_getb(e)), int(rgba_geta(e)) };
+        int dist = 0;
+        for (int j=0; j<4; ++j)
+          dist += w[j] * (cc[j]-ec[j]) * (cc[j]-ec[j]);
+        if (best < 0 || dist < bestDist) {
+          best = i;
+          bestDist = dist;
+        }
+      }
+      if (best < 0)             // Only the mask entry in the palette
+        continue;
+
+      ASSERT_EQ(best, map.findNearestUncached(c));
+      ASSERT_EQ(best, map.mapColor(c));
+      ASSERT_EQ(best, map.mapColor(c)); // Cached result
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,59 @@
+// Aseprite Document Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/palette.h"
+#include "doc/remap.h"
+#include "doc/sort_palette.h"
+
+using namespace doc;
+
+static Palette make_palette()
+{
+  Palette pal(0, 5);
+  pal.setEntry(0, rgba(0, 0, 255, 255));     // Blue
+  pal.setEntry(1, rgba(128, 128, 128, 255)); // Gray
+  pal.setEntry(2, rgba(255, 0, 0, 255));     // Red
+  pal.setEntry(3, rgba(255, 255, 0, 0));     // Transparent
+  pal.setEntry(4, rgba(255, 255, 255, 255)); // White
+  return pal;
+}
+
+static void expect_map(const Remap& map, const std::vector<int>& expected)
+{
+  EXPECT_EQ(map.size(), expected.size());
+  for (int i=0; i<int(map.size()); ++i) {
+    EXPECT_EQ(expected[i], map[i]) << " When i=" << i;
+  }
+}
+
+TEST(SortPalette, ByRed)
+{
+  const Palette pal = make_palette();
+  // Equal keys keep their order (red and white)
+  expect_map(sort_palette(&pal, SortPaletteBy::RED, true), { 1, 2, 3, 0, 4 });
+  // Transparent colors are always the first ones
+  expect_map(sort_palette(&pal, SortPaletteBy::RED, false), { 4, 3, 1, 0, 2 });
+}
+
+TEST(SortPalette, ByHue)
+{
+  const Palette pal = make_palette();
+  // Desaturated colors are sorted by value before the other colors
+  expect_map(sort_palette(&pal, SortPaletteBy::HUE, true), { 4, 1, 3, 0, 2 });
+  expect_map(sort_palette(&pal, SortPaletteBy::HUE, false), { 1, 4, 2, 0, 3 });
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
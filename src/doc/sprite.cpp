@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -23,6 +23,7 @@
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/render_plan.h"
+#include "doc/rgbmap_kdtree.h"
 #include "doc/rgbmap_rgb5a3.h"
 #include "doc/tag.h"
 #include "doc/tilesets.h"
@@ -37,6 +38,18 @@ namespace doc {
 static RgbMapAlgorithm g_rgbMapAlgorithm = RgbMapAlgorithm::DEFAULT;
 static gfx::Rect g_defaultGridBounds(0, 0, 16, 16);
 
+static RgbMap* create_rgbmap(const RgbMapAlgorithm mapAlgo)
+{
+  switch (mapAlgo) {
+    case RgbMapAlgorithm::RGB5A3: return new RgbMapRGB5A3;
+    case RgbMapAlgorithm::DEFAULT:
+    case RgbMapAlgorithm::OCTREE: return new OctreeMap;
+    case RgbMapAlgorithm::KDTREE: return new RgbMapKdTree;
+  }
+  ASSERT(false);
+  return nullptr;
+}
+
 // static
 gfx::Rect Sprite::DefaultGridBounds()
 {
@@ -400,28 +413,34 @@ RgbMap* Sprite::rgbMap(const frame_t frame,
 {
   if (!m_rgbMap || m_rgbMapAlgorithm != mapAlgo) {
     m_rgbMapAlgorithm = mapAlgo;
-    switch (m_rgbMapAlgorithm) {
-      case RgbMapAlgorithm::RGB5A3: m_rgbMap.reset(new RgbMapRGB5A3); break;
-      case RgbMapAlgorithm::DEFAULT:
-      case RgbMapAlgorithm::OCTREE: m_rgbMap.reset(new OctreeMap); break;
-      default:
-        m_rgbMap.reset(nullptr);
-        ASSERT(false);
-        return nullptr;
-    }
+    m_rgbMap.reset(create_rgbmap(mapAlgo));
+    if (!m_rgbMap)
+      return nullptr;
   }
-  int maskIndex;
-  if (forLayer == RgbMapFor::OpaqueLayer)
-    maskIndex = -1;
-  else {
-    maskIndex = palette(frame)->findMaskColor();
-    if (maskIndex == -1)
-      maskIndex = 0;
-  }
-  m_rgbMap->regenerateMap(palette(frame), maskIndex);
+  m_rgbMap->regenerateMap(palette(frame), rgbMapMaskIndex(frame, forLayer));
   return m_rgbMap.get();
 }
 
+std::unique_ptr<RgbMap> Sprite::createRgbMap(const frame_t frame,
+                                             const RgbMapFor forLayer,
+                                             RgbMapAlgorithm mapAlgo) const
+{
+  std::unique_ptr<RgbMap> rgbmap(create_rgbmap(mapAlgo));
+  if (rgbmap)
+    rgbmap->regenerateMap(palette(frame), rgbMapMaskIndex(frame, forLayer));
+  return rgbmap;
+}
+
+int Sprite::rgbMapMaskIndex(const frame_t frame,
+                            const RgbMapFor forLayer) const
+{
+  if (forLayer == RgbMapFor::OpaqueLayer)
+    return -1;
+
+  const int maskIndex = palette(frame)->findMaskColor();
+  return (maskIndex == -1 ? 0: maskIndex);
+}
+
 //////////////////////////////////////////////////////////////////////
 // Frames
 
@@ -607,19 +626,15 @@ void Sprite::remapImages(const Remap& remap)
 
   std::vector<ImageRef> images;
   getImages(images);
-  for (ImageRef& image : images)
-    remap_image(image.get(), remap);
+  remap_images(images, remap);
 }
 
 void Sprite::remapTilemaps(const Tileset* tileset,
                            const Remap& remap)
 {
-  for (Cel* cel : uniqueCels()) {
-    if (cel->layer()->isTilemap() &&
-        static_cast<LayerTilemap*>(cel->layer())->tileset() == tileset) {
-      remap_image(cel->image(), remap);
-    }
-  }
+  std::vector<ImageRef> images;
+  getTilemapsByTileset(tileset, images);
+  remap_images(images, remap);
 }
 
 //////////////////////////////////////////////////////////////////////
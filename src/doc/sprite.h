@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -132,6 +132,14 @@ namespace doc {
     layer_t allLayersCount() const;
     bool hasVisibleReferenceLayers() const;
 
+    // Version of the layers structure (order and flags of layers,
+    // cels in each frame, and z-index of cels). It's incremented by
+    // doc::Layer/LayerImage/LayerGroup/Cel member functions that
+    // modify the structure, so a RenderPlan can be cached until this
+    // version changes (see RenderPlanCache).
+    ObjectVersion structureVersion() const { return m_structureVersion; }
+    void incrementStructureVersion() { ++m_structureVersion; }
+
     ////////////////////////////////////////
     // Palettes
 
@@ -153,6 +161,13 @@ namespace doc {
                    const RgbMapFor forLayer,
                    RgbMapAlgorithm mapAlgo) const;
 
+    // Creates a new RgbMap for the palette of the given frame (as
+    // rgbMap() but the returned map is not shared, so it can be used
+    // in other threads, e.g. one map for each thread).
+    std::unique_ptr<RgbMap> createRgbMap(const frame_t frame,
+                                         const RgbMapFor forLayer,
+                                         RgbMapAlgorithm mapAlgo) const;
+
     ////////////////////////////////////////
     // Frames
 
@@ -235,6 +250,9 @@ namespace doc {
     }
 
   private:
+    int rgbMapMaskIndex(const frame_t frame,
+                        const RgbMapFor forLayer) const;
+
     Document* m_document;
     ImageSpec m_spec;
     PixelRatio m_pixelRatio;
@@ -242,6 +260,7 @@ namespace doc {
     std::vector<int> m_frlens;             // duration per frame
     PalettesList m_palettes;               // list of palettes
     LayerGroup* m_root;                    // main group of layers
+    ObjectVersion m_structureVersion = 0;  // see structureVersion()
     gfx::Rect m_gridBounds;                // grid settings
 
     // Current rgb map
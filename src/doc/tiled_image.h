@@ -0,0 +1,427 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef DOC_TILED_IMAGE_H_INCLUDED
+#define DOC_TILED_IMAGE_H_INCLUDED
+#pragma once
+
+#include "base/debug.h"
+#include "doc/image.h"
+#include "doc/image_traits.h"
+#include "gfx/rect.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace doc {
+
+  // Alternative storage for image pixels split in fixed-size tiles of
+  // kTileSize x kTileSize pixels. Tiles are reference counted and
+  // shared between copies of a TiledImage, and a tile is duplicated
+  // only when it's modified (copy-on-write). Tiles that were never
+  // written are not allocated at all (they are read as 0).
+  //
+  // In this way a copy of a TiledImage (e.g. a cel duplication or an
+  // undo snapshot) is O(number of tiles), and modifying it only
+  // allocates the tiles that were touched.
+  template<class Traits>
+  class TiledImage {
+  public:
+    static_assert(Traits::pixels_per_byte == 0,
+                  "TiledImage doesn't support images with sub-byte pixels");
+
+    typedef typename Traits::pixel_t pixel_t;
+
+    enum { kTileSize = 64 };
+
+    struct Tile {
+      pixel_t pixels[kTileSize*kTileSize];
+    };
+    typedef std::shared_ptr<Tile> TilePtr;
+
+    TiledImage(const int width = 0, const int height = 0)
+      : m_width(width)
+      , m_height(height)
+      , m_cols((width + kTileSize - 1) / kTileSize)
+      , m_rows((height + kTileSize - 1) / kTileSize)
+      , m_tiles(m_cols*m_rows) {
+      ASSERT(width >= 0 && height >= 0);
+    }
+
+    // Creates a tiled copy of the given image. Tiles with all pixels
+    // equal to 0 are not allocated.
+    explicit TiledImage(const Image* image)
+      : TiledImage(image->width(), image->height()) {
+      update(image);
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+    gfx::Rect bounds() const { return gfx::Rect(0, 0, m_width, m_height); }
+
+    int cols() const { return m_cols; }
+    int rows() const { return m_rows; }
+
+    gfx::Rect tileBounds(const int tx, const int ty) const {
+      return gfx::Rect(tx*kTileSize, ty*kTileSize, kTileSize, kTileSize)
+        .createIntersection(bounds());
+    }
+
+    // Returns the tile in the given tile position (or nullptr if the
+    // tile is empty).
+    const Tile* tile(const int tx, const int ty) const {
+      ASSERT(tx >= 0 && tx < m_cols);
+      ASSERT(ty >= 0 && ty < m_rows);
+      return m_tiles[ty*m_cols + tx].get();
+    }
+
+    // Returns true if both images use the same memory for the given
+    // tile.
+    bool sharesTile(const TiledImage& other, const int tx, const int ty) const {
+      ASSERT(m_cols == other.m_cols && m_rows == other.m_rows);
+      return (m_tiles[ty*m_cols + tx] == other.m_tiles[ty*m_cols + tx]);
+    }
+
+    // Number of allocated tiles.
+    int allocatedTiles() const {
+      return int(std::count_if(m_tiles.begin(), m_tiles.end(),
+                               [](const TilePtr& t){ return t != nullptr; }));
+    }
+
+    pixel_t getPixel(const int x, const int y) const {
+      ASSERT(x >= 0 && x < m_width);
+      ASSERT(y >= 0 && y < m_height);
+      const Tile* t = m_tiles[(y / kTileSize)*m_cols + (x / kTileSize)].get();
+      if (t)
+        return t->pixels[(y % kTileSize)*kTileSize + (x % kTileSize)];
+      else
+        return 0;
+    }
+
+    void putPixel(const int x, const int y, const pixel_t color) {
+      ASSERT(x >= 0 && x < m_width);
+      ASSERT(y >= 0 && y < m_height);
+      Tile* t = mutableTile(x / kTileSize, y / kTileSize);
+      t->pixels[(y % kTileSize)*kTileSize + (x % kTileSize)] = color;
+    }
+
+    // Returns the address of the pixel (x, y) to read it. The next
+    // pixels in the same row are contiguous until the end of the tile.
+    const pixel_t* address(const int x, const int y) const {
+      ASSERT(x >= 0 && x < m_width);
+      ASSERT(y >= 0 && y < m_height);
+      const Tile* t = m_tiles[(y / kTileSize)*m_cols + (x / kTileSize)].get();
+      if (t)
+        return t->pixels + (y % kTileSize)*kTileSize + (x % kTileSize);
+      else
+        return emptyRow();
+    }
+
+    // Returns the address of the pixel (x, y) to modify it, the tile
+    // is duplicated if it's shared with other images.
+    pixel_t* mutableAddress(const int x, const int y) {
+      ASSERT(x >= 0 && x < m_width);
+      ASSERT(y >= 0 && y < m_height);
+      Tile* t = mutableTile(x / kTileSize, y / kTileSize);
+      return t->pixels + (y % kTileSize)*kTileSize + (x % kTileSize);
+    }
+
+    // Makes sure that all tiles in the given area are owned only by
+    // this image (so they can be modified).
+    void detachTiles(const gfx::Rect& area) {
+      const gfx::Rect rc = area.createIntersection(bounds());
+      if (rc.isEmpty())
+        return;
+      for (int ty=rc.y/kTileSize; ty<=(rc.y2()-1)/kTileSize; ++ty)
+        for (int tx=rc.x/kTileSize; tx<=(rc.x2()-1)/kTileSize; ++tx)
+          mutableTile(tx, ty);
+    }
+
+    // Replaces the content of this image with the pixels from the
+    // given image (which must have the same size). Only tiles with
+    // different pixels are modified (so the other tiles can continue
+    // shared with other copies). Returns the number of modified tiles.
+    int update(const Image* image) {
+      ASSERT(image->pixelFormat() == Traits::pixel_format);
+      ASSERT(image->width() == m_width && image->height() == m_height);
+
+      int modified = 0;
+      for (int ty=0; ty<m_rows; ++ty) {
+        for (int tx=0; tx<m_cols; ++tx) {
+          const gfx::Rect rc = tileBounds(tx, ty);
+          TilePtr& t = m_tiles[ty*m_cols + tx];
+          if (tileEquals(t.get(), image, rc))
+            continue;
+
+          // Empty tiles in the source image are not allocated
+          if (isEmptyArea(image, rc)) {
+            t.reset();
+          }
+          else {
+            if (!t || t.use_count() > 1)
+              t = std::make_shared<Tile>();
+            copyToTile(t.get(), image, rc);
+          }
+          ++modified;
+        }
+      }
+      return modified;
+    }
+
+    // Copies all pixels of this image in the given image (which must
+    // have the same size).
+    void copyTo(Image* image) const {
+      ASSERT(image->pixelFormat() == Traits::pixel_format);
+      ASSERT(image->width() == m_width && image->height() == m_height);
+
+      for (int ty=0; ty<m_rows; ++ty) {
+        for (int tx=0; tx<m_cols; ++tx) {
+          const gfx::Rect rc = tileBounds(tx, ty);
+          const Tile* t = tile(tx, ty);
+          for (int y=0; y<rc.h; ++y) {
+            pixel_t* dst = (pixel_t*)image->getPixelAddress(rc.x, rc.y+y);
+            if (t)
+              std::copy(t->pixels + y*kTileSize,
+                        t->pixels + y*kTileSize + rc.w, dst);
+            else
+              std::fill(dst, dst + rc.w, pixel_t(0));
+          }
+        }
+      }
+    }
+
+  private:
+    Tile* mutableTile(const int tx, const int ty) {
+      ASSERT(tx >= 0 && tx < m_cols);
+      ASSERT(ty >= 0 && ty < m_rows);
+      TilePtr& t = m_tiles[ty*m_cols + tx];
+      if (!t) {
+        t = std::make_shared<Tile>();
+        std::fill(t->pixels, t->pixels + kTileSize*kTileSize, pixel_t(0));
+      }
+      else if (t.use_count() > 1) {
+        t = std::make_shared<Tile>(*t);
+      }
+      return t.get();
+    }
+
+    static bool tileEquals(const Tile* t,
+                           const Image* image,
+                           const gfx::Rect& rc) {
+      if (!t)
+        return isEmptyArea(image, rc);
+      for (int y=0; y<rc.h; ++y) {
+        if (std::memcmp(t->pixels + y*kTileSize,
+                        image->getPixelAddress(rc.x, rc.y+y),
+                        sizeof(pixel_t)*rc.w) != 0)
+          return false;
+      }
+      return true;
+    }
+
+    static bool isEmptyArea(const Image* image,
+                            const gfx::Rect& rc) {
+      for (int y=0; y<rc.h; ++y) {
+        const pixel_t* p = (const pixel_t*)image->getPixelAddress(rc.x, rc.y+y);
+        if (std::any_of(p, p + rc.w, [](const pixel_t c){ return c != 0; }))
+          return false;
+      }
+      return true;
+    }
+
+    static void copyToTile(Tile* t,
+                           const Image* image,
+                           const gfx::Rect& rc) {
+      // Pixels outside the image bounds (in the last column/row of
+      // tiles) are kept as 0
+      if (rc.w < kTileSize || rc.h < kTileSize)
+        std::fill(t->pixels, t->pixels + kTileSize*kTileSize, pixel_t(0));
+
+      for (int y=0; y<rc.h; ++y) {
+        const pixel_t* src = (const pixel_t*)image->getPixelAddress(rc.x, rc.y+y);
+        std::copy(src, src + rc.w, t->pixels + y*kTileSize);
+      }
+    }
+
+    static const pixel_t* emptyRow() {
+      static const pixel_t zeros[kTileSize] = { 0 };
+      return zeros;
+    }
+
+    int m_width;
+    int m_height;
+    int m_cols;
+    int m_rows;
+    std::vector<TilePtr> m_tiles;
+  };
+
+  // Iterator over an area of a TiledImage, it visits pixels in the
+  // same order as ImageIterator (row by row), jumping between tiles
+  // at the end of each tile segment.
+  template<class Traits, class TiledImageType, class Pointer, class Reference>
+  class TiledImageIteratorT {
+  public:
+    typedef std::forward_iterator_tag iterator_category;
+    typedef typename Traits::pixel_t value_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef Pointer pointer;
+    typedef Reference reference;
+
+    enum { kTileSize = TiledImage<Traits>::kTileSize };
+
+    TiledImageIteratorT()
+      : m_image(nullptr)
+      , m_ptr(nullptr)
+      , m_x(0)
+      , m_y(0)
+      , m_segmentEnd(0) {
+    }
+
+    TiledImageIteratorT(TiledImageType* image, const gfx::Rect& bounds,
+                        const int x, const int y)
+      : m_image(image)
+      , m_bounds(bounds)
+      , m_ptr(nullptr)
+      , m_x(x)
+      , m_y(y)
+      , m_segmentEnd(0) {
+      // An empty area begins where it ends
+      if (m_bounds.isEmpty())
+        m_y = m_bounds.y2();
+      else if (m_y < m_bounds.y2())
+        updateSegment();
+    }
+
+    bool operator==(const TiledImageIteratorT& other) const {
+      return (m_x == other.m_x && m_y == other.m_y);
+    }
+
+    bool operator!=(const TiledImageIteratorT& other) const {
+      return !operator==(other);
+    }
+
+    TiledImageIteratorT& operator++() {
+      ASSERT(m_y < m_bounds.y2());
+      ++m_ptr;
+      if (++m_x == m_segmentEnd) {
+        if (m_x == m_bounds.x2()) {
+          m_x = m_bounds.x;
+          if (++m_y == m_bounds.y2())
+            return *this;
+        }
+        updateSegment();
+      }
+      return *this;
+    }
+
+    TiledImageIteratorT operator++(int) {
+      TiledImageIteratorT old(*this);
+      operator++();
+      return old;
+    }
+
+    reference operator*() { return *m_ptr; }
+
+    int x() const { return m_x; }
+    int y() const { return m_y; }
+
+  private:
+    void updateSegment() {
+      m_ptr = getAddress(m_x, m_y);
+      m_segmentEnd = std::min(m_bounds.x2(),
+                              (m_x / kTileSize + 1) * kTileSize);
+    }
+
+    Pointer getAddress(const int x, const int y) const {
+      if constexpr (std::is_const_v<TiledImageType>)
+        return m_image->address(x, y);
+      else
+        return m_image->mutableAddress(x, y);
+    }
+
+    TiledImageType* m_image;
+    gfx::Rect m_bounds;
+    Pointer m_ptr;
+    int m_x, m_y;
+    int m_segmentEnd;
+  };
+
+  // Equivalent to LockImageBits for TiledImage. A write lock makes
+  // sure that all tiles in the given bounds are owned by the image
+  // before iterating them.
+  template<typename ImageTraits>
+  class LockTiledImageBits {
+  public:
+    typedef TiledImage<ImageTraits> TiledImageT;
+    typedef typename ImageTraits::pixel_t pixel_t;
+    typedef TiledImageIteratorT<ImageTraits, TiledImageT,
+                                pixel_t*, pixel_t&> iterator;
+    typedef TiledImageIteratorT<ImageTraits, const TiledImageT,
+                                const pixel_t*, const pixel_t&> const_iterator;
+
+    explicit LockTiledImageBits(const TiledImageT* image)
+      : LockTiledImageBits(image, image->bounds()) {
+    }
+
+    LockTiledImageBits(const TiledImageT* image, const gfx::Rect& bounds)
+      : m_image(const_cast<TiledImageT*>(image))
+      , m_bounds(bounds)
+      , m_writable(false) {
+      ASSERT(image->bounds().contains(bounds));
+    }
+
+    explicit LockTiledImageBits(TiledImageT* image)
+      : LockTiledImageBits(image, image->bounds()) {
+    }
+
+    LockTiledImageBits(TiledImageT* image, const gfx::Rect& bounds)
+      : m_image(image)
+      , m_bounds(bounds)
+      , m_writable(true) {
+      ASSERT(image->bounds().contains(bounds));
+      m_image->detachTiles(bounds);
+    }
+
+    // Iterators.
+    iterator begin() { return begin_area(m_bounds); }
+    iterator end() { return end_area(m_bounds); }
+    const_iterator begin() const { return begin_area(m_bounds); }
+    const_iterator end() const { return end_area(m_bounds); }
+
+    iterator begin_area(const gfx::Rect& area) {
+      ASSERT(m_writable);
+      ASSERT(m_bounds.contains(area));
+      return iterator(m_image, area, area.x, area.y);
+    }
+    iterator end_area(const gfx::Rect& area) {
+      ASSERT(m_bounds.contains(area));
+      return iterator(m_image, area, area.x, area.y2());
+    }
+    const_iterator begin_area(const gfx::Rect& area) const {
+      ASSERT(m_bounds.contains(area));
+      return const_iterator(m_image, area, area.x, area.y);
+    }
+    const_iterator end_area(const gfx::Rect& area) const {
+      ASSERT(m_bounds.contains(area));
+      return const_iterator(m_image, area, area.x, area.y2());
+    }
+
+    const TiledImageT* image() const { return m_image; }
+    const gfx::Rect& bounds() const { return m_bounds; }
+
+  private:
+    TiledImageT* m_image;
+    gfx::Rect m_bounds;
+    bool m_writable;
+  };
+
+} // namespace doc
+
+#endif
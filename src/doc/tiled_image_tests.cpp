@@ -0,0 +1,153 @@
+// Aseprite Document Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/tiled_image.h"
+
+#include "doc/image_impl.h"
+#include "doc/primitives.h"
+
+#include <cstdlib>
+#include <memory>
+
+using namespace doc;
+
+template<typename T>
+class TiledImageAllTypes : public testing::Test {
+protected:
+  TiledImageAllTypes() { }
+};
+
+typedef testing::Types<RgbTraits, GrayscaleTraits, IndexedTraits> TiledImageAllTraits;
+TYPED_TEST_SUITE(TiledImageAllTypes, TiledImageAllTraits);
+
+TYPED_TEST(TiledImageAllTypes, ConvertFromAndToImage)
+{
+  typedef TypeParam ImageTraits;
+
+  for (int w : { 1, 63, 64, 65, 130 }) {
+    for (int h : { 1, 64, 129 }) {
+      std::unique_ptr<Image> image(Image::create(ImageTraits::pixel_format, w, h));
+      clear_image(image.get(), 0);
+      for (int i=0; i<w*h/3; ++i)
+        put_pixel(image.get(), std::rand() % w, std::rand() % h,
+                  1 + (std::rand() % (ImageTraits::max_value-1)));
+
+      TiledImage<ImageTraits> tiled(image.get());
+      for (int y=0; y<h; ++y)
+        for (int x=0; x<w; ++x)
+          ASSERT_EQ(get_pixel(image.get(), x, y), tiled.getPixel(x, y));
+
+      std::unique_ptr<Image> result(Image::create(ImageTraits::pixel_format, w, h));
+      clear_image(result.get(), 1);
+      tiled.copyTo(result.get());
+      EXPECT_EQ(0, count_diff_between_images(image.get(), result.get()));
+    }
+  }
+}
+
+TYPED_TEST(TiledImageAllTypes, Iterators)
+{
+  typedef TypeParam ImageTraits;
+  typedef TiledImage<ImageTraits> TiledImageT;
+
+  const int w = 150, h = 100;
+  TiledImageT tiled(w, h);
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      tiled.putPixel(x, y, (x+y*w) % ImageTraits::max_value);
+
+  for (const gfx::Rect& bounds : { gfx::Rect(0, 0, w, h),
+                                   gfx::Rect(60, 10, 70, 60),
+                                   gfx::Rect(63, 63, 2, 2),
+                                   gfx::Rect(5, 5, 0, 4) }) {
+    const LockTiledImageBits<ImageTraits> bits((const TiledImageT*)&tiled, bounds);
+    auto it = bits.begin(), end = bits.end();
+    for (int y=bounds.y; y<bounds.y2(); ++y) {
+      for (int x=bounds.x; x<bounds.x2(); ++x, ++it) {
+        ASSERT_TRUE(it != end);
+        EXPECT_EQ(tiled.getPixel(x, y), *it);
+      }
+    }
+    EXPECT_TRUE(it == end);
+  }
+
+  // Write iterator
+  {
+    const gfx::Rect bounds(10, 20, 100, 70);
+    LockTiledImageBits<ImageTraits> bits(&tiled, bounds);
+    for (auto it=bits.begin(), end=bits.end(); it != end; ++it)
+      *it = 1;
+  }
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x) {
+      if (gfx::Rect(10, 20, 100, 70).contains(gfx::Point(x, y)))
+        ASSERT_EQ(1, tiled.getPixel(x, y));
+      else
+        ASSERT_EQ((x+y*w) % ImageTraits::max_value, tiled.getPixel(x, y));
+    }
+}
+
+TEST(TiledImage, CopyOnWrite)
+{
+  typedef TiledImage<RgbTraits> TiledImageT;
+
+  TiledImageT a(200, 100);     // 4x2 tiles
+  EXPECT_EQ(4, a.cols());
+  EXPECT_EQ(2, a.rows());
+  EXPECT_EQ(0, a.allocatedTiles());
+
+  a.putPixel(0, 0, rgba(255, 0, 0, 255));
+  a.putPixel(199, 99, rgba(0, 255, 0, 255));
+  EXPECT_EQ(2, a.allocatedTiles());
+
+  TiledImageT b(a);
+  EXPECT_TRUE(b.sharesTile(a, 0, 0));
+  EXPECT_TRUE(b.sharesTile(a, 3, 1));
+
+  // Only the modified tile is duplicated
+  b.putPixel(1, 1, rgba(0, 0, 255, 255));
+  EXPECT_FALSE(b.sharesTile(a, 0, 0));
+  EXPECT_TRUE(b.sharesTile(a, 3, 1));
+  EXPECT_EQ(rgba(255, 0, 0, 255), b.getPixel(0, 0));
+  EXPECT_EQ(rgba(0, 0, 255, 255), b.getPixel(1, 1));
+  EXPECT_EQ(0, a.getPixel(1, 1));
+}
+
+TEST(TiledImage, UpdateOnlyModifiedTiles)
+{
+  std::unique_ptr<Image> image(Image::create(IMAGE_RGB, 256, 128));
+  clear_image(image.get(), rgba(10, 20, 30, 255));
+
+  TiledImage<RgbTraits> a(image.get());
+  TiledImage<RgbTraits> b(a);
+  EXPECT_EQ(8, a.allocatedTiles());
+
+  put_pixel(image.get(), 130, 70, rgba(0, 0, 0, 255));
+  EXPECT_EQ(1, b.update(image.get()));
+  EXPECT_EQ(0, b.update(image.get()));
+
+  for (int ty=0; ty<b.rows(); ++ty)
+    for (int tx=0; tx<b.cols(); ++tx)
+      EXPECT_EQ(tx != 2 || ty != 1, b.sharesTile(a, tx, ty));
+
+  // Empty tiles are released
+  clear_image(image.get(), 0);
+  EXPECT_EQ(8, b.update(image.get()));
+  EXPECT_EQ(0, b.allocatedTiles());
+  EXPECT_EQ(8, a.allocatedTiles());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
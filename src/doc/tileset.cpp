@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -11,6 +11,7 @@
 #include "doc/tileset.h"
 
 #include "base/mem_utils.h"
+#include "doc/image_impl.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
@@ -305,6 +306,8 @@ void Tileset::notifyTileContentChange(const tile_index ti)
 
   (void)ti;                     // unused
 
+  // preprocess_transparent_pixels() discards the cached hash of the
+  // modified tile
   if (ti >= 0 && ti < m_tiles.size() && m_tiles[ti].image)
     preprocess_transparent_pixels(m_tiles[ti].image.get());
 
@@ -319,8 +322,10 @@ void Tileset::notifyRegenerateEmptyTile()
     return;
 
   ImageRef image = get(doc::notile);
-  if (image)
+  if (image) {
     doc::clear_image(image.get(), image->maskColor());
+    image->discardHash();
+  }
   rehash();
 }
 
@@ -377,11 +382,56 @@ void Tileset::assertValidHashTable()
 }
 #endif
 
+void Tileset::getTilesUsage(std::vector<size_t>& usage)
+{
+  usage.clear();
+  if (!m_sprite)
+    return;
+
+  std::vector<ImageRef> tilemaps;
+  m_sprite->getTilemapsByTileset(this, tilemaps);
+
+  std::unordered_map<ObjectId, TilemapUsage> newUsage;
+  for (const ImageRef& tilemap : tilemaps) {
+    const ObjectId id = tilemap->id();
+    auto it = m_tilemapsUsage.find(id);
+    if (it != m_tilemapsUsage.end() &&
+        it->second.version == tilemap->version()) {
+      newUsage[id] = std::move(it->second);
+      continue;
+    }
+
+    TilemapUsage& tilemapUsage = newUsage[id];
+    tilemapUsage.version = tilemap->version();
+    std::vector<size_t>& counts = tilemapUsage.usage;
+    for_each_pixel<TilemapTraits>(
+      tilemap.get(),
+      [&counts](const tile_t t){
+        if (t != notile) {
+          const tile_index ti = tile_geti(t);
+          if (ti >= counts.size())
+            counts.resize(ti+1, 0);
+          ++counts[ti];
+        }
+      });
+  }
+  // Discard the usage of tilemaps that are not in the sprite anymore
+  m_tilemapsUsage = std::move(newUsage);
+
+  for (const auto& it : m_tilemapsUsage) {
+    const std::vector<size_t>& tilemapUsage = it.second.usage;
+    if (tilemapUsage.size() > usage.size())
+      usage.resize(tilemapUsage.size(), 0);
+    for (size_t ti=0; ti<tilemapUsage.size(); ++ti)
+      usage[ti] += tilemapUsage[ti];
+  }
+}
+
 void Tileset::hashImage(const tile_index ti,
                         const ImageRef& tileImage)
 {
-  if (m_hash.find(tileImage) == m_hash.end())
-    m_hash[tileImage] = ti;
+  // Doesn't replace the index of an existent equal tile
+  m_hash.emplace(tileImage, ti);
 }
 
 void Tileset::rehash()
@@ -1,5 +1,5 @@
 // Aseprite Document Library
-// Copyright (c) 2019-2023  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -12,11 +12,14 @@
 #include "doc/grid.h"
 #include "doc/image_ref.h"
 #include "doc/object.h"
+#include "doc/object_id.h"
+#include "doc/object_version.h"
 #include "doc/tile.h"
 #include "doc/tileset_hash_table.h"
 #include "doc/with_user_data.h"
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace doc {
@@ -65,6 +68,17 @@ namespace doc {
     const base::buffer& compressedData() const { return m_compressedData; }
     ObjectVersion compressedDataVersion() const { return m_compressedDataVersion; }
 
+    // Cached compressed data of each tile, used to re-compress only
+    // the modified tiles when the tileset is saved. Each entry is
+    // valid only for the tile image with the given ID/version.
+    struct CompressedTile {
+      ObjectId imageId = NullId;
+      ObjectVersion imageVersion = 0;
+      uint32_t checksum = 0;     // Checksum of the uncompressed data
+      base::buffer data;
+    };
+    std::vector<CompressedTile>& compressedTiles() const { return m_compressedTiles; }
+
     int getMemSize() const override;
 
     iterator begin() { return m_tiles.begin(); }
@@ -131,6 +145,15 @@ namespace doc {
     // have to regenerate the empty tile with that new mask color.
     void notifyRegenerateEmptyTile();
 
+    // Returns in "usage" the number of references to each tile index
+    // from all the tilemaps that use this tileset (the empty tile
+    // notile is not counted). The vector can contain more elements
+    // than the tileset if there are references to tiles outside the
+    // valid range. The usage of each tilemap image is cached by
+    // image ID and version, so only new/modified tilemaps are
+    // scanned again.
+    void getTilesUsage(std::vector<size_t>& usage);
+
 #ifdef _DEBUG
     void assertValidHashTable();
 #endif
@@ -165,6 +188,16 @@ namespace doc {
     // contains several layers with tilesets).
     mutable base::buffer m_compressedData;
     mutable doc::ObjectVersion m_compressedDataVersion;
+
+    // Compressed data of each tile (see compressedTiles()).
+    mutable std::vector<CompressedTile> m_compressedTiles;
+
+    // Cached tiles usage of each tilemap image (see getTilesUsage()).
+    struct TilemapUsage {
+      ObjectVersion version = 0;
+      std::vector<size_t> usage;
+    };
+    std::unordered_map<ObjectId, TilemapUsage> m_tilemapsUsage;
   };
 
 } // namespace doc
@@ -0,0 +1,73 @@
+// Aseprite Document Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/cel.h"
+#include "doc/grid.h"
+#include "doc/image.h"
+#include "doc/layer_tilemap.h"
+#include "doc/primitives.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+#include "doc/tilesets.h"
+
+#include <memory>
+#include <vector>
+
+using namespace doc;
+
+TEST(Tileset, TilesUsage)
+{
+  std::shared_ptr<Sprite> sprPtr(std::make_shared<Sprite>(
+                                   ImageSpec(ColorMode::RGB, 32, 32), 256));
+  Sprite* spr = sprPtr.get();
+
+  auto tileset = new Tileset(spr, Grid(gfx::Size(8, 8)), 4);
+  const tileset_index tsi = spr->tilesets()->add(tileset);
+
+  auto lay = new LayerTilemap(spr, tsi);
+  spr->root()->addLayer(lay);
+  spr->setTotalFrames(2);
+
+  ImageRef a(Image::create(IMAGE_TILEMAP, 4, 4));
+  ImageRef b(Image::create(IMAGE_TILEMAP, 4, 4));
+  clear_image(a.get(), notile);
+  clear_image(b.get(), notile);
+  put_pixel(a.get(), 0, 0, tile(1, 0));
+  put_pixel(a.get(), 1, 0, tile(1, tile_f_flipx));
+  put_pixel(b.get(), 0, 0, tile(2, 0));
+  put_pixel(b.get(), 3, 3, tile(5, 0)); // Outside the tileset
+  lay->addCel(new Cel(0, a));
+  lay->addCel(new Cel(1, b));
+
+  std::vector<size_t> usage;
+  tileset->getTilesUsage(usage);
+  EXPECT_EQ(std::vector<size_t>({ 0, 2, 1, 0, 0, 1 }), usage);
+
+  // Modified tilemaps are counted again
+  put_pixel(b.get(), 3, 3, tile(3, 0));
+  b->incrementVersion();
+  tileset->getTilesUsage(usage);
+  EXPECT_EQ(std::vector<size_t>({ 0, 2, 1, 1 }), usage);
+
+  // Removed tilemaps are not counted
+  Cel* cel = lay->cel(0);
+  lay->removeCel(cel);
+  delete cel;
+  tileset->getTilesUsage(usage);
+  EXPECT_EQ(std::vector<size_t>({ 0, 0, 1, 1 }), usage);
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
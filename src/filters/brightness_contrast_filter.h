@@ -32,6 +32,7 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr) override;
     void applyToGrayscale(FilterManager* filterMgr) override;
     void applyToIndexed(FilterManager* filterMgr) override;
+    bool isRowIndependent() const override { return true; }
 
   private:
     void onApplyToPalette(FilterManager* filterMgr,
@@ -0,0 +1,365 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/color_lut.h"
+
+#include "base/debug.h"
+#include "base/fstream_path.h"
+#include "base/trim_string.h"
+#include "doc/palette.h"
+#include "doc/palette_picks.h"
+#include "filters/filter.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define COLOR_LUT_SSE2 1
+  #include <emmintrin.h>
+#endif
+
+namespace filters {
+
+using namespace doc;
+
+namespace {
+
+  // Fixed point scale of the table components (255*64 fits in a
+  // int16_t, and the products with 9-bit weights fit in 32-bits).
+  constexpr int kTableScale = 255*64;
+  constexpr int kTableShift = 6+8;     // Scale of components + weights
+
+  // Rows of grid points given to the filter in ColorLut::bake()
+  class BakeFilterManager : public FilterManager
+                          , public FilterIndexedData {
+  public:
+    BakeFilterManager(const uint32_t* src, uint32_t* dst, int width, int y)
+      : m_src(src)
+      , m_dst(dst)
+      , m_width(width)
+      , m_y(y)
+      , m_spans{ Span{ 0, width } }
+      , m_palette(frame_t(0), 0)
+      , m_newPalette(frame_t(0), 0) {
+    }
+
+    // FilterManager implementation
+    doc::PixelFormat pixelFormat() const override { return IMAGE_RGB; }
+    const void* getSourceAddress() override { return m_src; }
+    void* getDestinationAddress() override { return m_dst; }
+    int getWidth() override { return m_width; }
+    Target getTarget() override {
+      return TARGET_RED_CHANNEL | TARGET_GREEN_CHANNEL | TARGET_BLUE_CHANNEL;
+    }
+    FilterIndexedData* getIndexedData() override { return this; }
+    const Spans& getRowSpans() override { return m_spans; }
+    const Image* getSourceImage() override { return nullptr; }
+    int x() const override { return 0; }
+    int y() const override { return m_y; }
+    bool isFirstRow() const override { return (m_y == 0); }
+    bool isMaskActive() const override { return false; }
+    base::task_token& taskToken() const override { return m_token; }
+
+    // FilterIndexedData implementation
+    const Palette* getPalette() const override { return &m_palette; }
+    const RgbMap* getRgbMap() const override { return nullptr; }
+    Palette* getNewPalette() override { return &m_newPalette; }
+    PalettePicks getPalettePicks() override { return PalettePicks(); }
+
+  private:
+    const uint32_t* m_src;
+    uint32_t* m_dst;
+    int m_width;
+    int m_y;
+    Spans m_spans;
+    Palette m_palette;
+    Palette m_newPalette;
+    mutable base::task_token m_token;
+  };
+
+  inline int grid_value(const int i, const int size) {
+    return (i*255 + (size-1)/2) / (size-1);
+  }
+
+} // anonymous namespace
+
+ColorLut::ColorLut(int size)
+  : m_size(std::clamp(size, kMinSize, kMaxSize))
+  , m_colors(3*m_size*m_size*m_size)
+  , m_table(4*m_size*m_size*m_size, 0)
+{
+  const int n = m_size-1;
+  for (int v=0; v<256; ++v) {
+    const int pos = (v*n*256 + 127) / 255;
+    m_gridIndex[v] = std::min(pos >> 8, n-1);
+    m_gridFrac[v] = pos - (m_gridIndex[v] << 8);
+  }
+
+  for (int b=0; b<m_size; ++b)
+    for (int g=0; g<m_size; ++g)
+      for (int r=0; r<m_size; ++r) {
+        const float rgb[3] = { float(r)/n, float(g)/n, float(b)/n };
+        setColor(r, g, b, rgb);
+      }
+}
+
+void ColorLut::getColor(int r, int g, int b, float rgb[3]) const
+{
+  const float* p = &m_colors[3*index(r, g, b)];
+  rgb[0] = p[0];
+  rgb[1] = p[1];
+  rgb[2] = p[2];
+}
+
+void ColorLut::setColor(int r, int g, int b, const float rgb[3])
+{
+  const int i = index(r, g, b);
+  float* p = &m_colors[3*i];
+  p[0] = rgb[0];
+  p[1] = rgb[1];
+  p[2] = rgb[2];
+  updateTable(i);
+}
+
+void ColorLut::updateTable(int i)
+{
+  for (int j=0; j<3; ++j) {
+    const float v = std::clamp(m_colors[3*i+j], 0.0f, 1.0f);
+    m_table[4*i+j] = int16_t(std::lround(v * kTableScale));
+  }
+}
+
+color_t ColorLut::map(color_t c, Interpolation interpolation) const
+{
+  switch (interpolation) {
+    case Interpolation::Trilinear:   return mapTrilinear(c);
+    case Interpolation::Tetrahedral: return mapTetrahedral(c);
+  }
+  return c;
+}
+
+color_t ColorLut::mapTrilinear(color_t c) const
+{
+  const int r = rgba_getr(c), g = rgba_getg(c), b = rgba_getb(c);
+  const int fr = m_gridFrac[r], fg = m_gridFrac[g], fb = m_gridFrac[b];
+  const int dr = 4, dg = 4*m_size, db = 4*m_size*m_size;
+  const int16_t* p = &m_table[4*index(m_gridIndex[r], m_gridIndex[g], m_gridIndex[b])];
+
+  auto lerp = [](int a, int b, int f) { return a + (((b-a)*f) >> 8); };
+
+  int out[3];
+  for (int i=0; i<3; ++i, ++p) {
+    const int c00 = lerp(p[0],     p[dr],       fr);
+    const int c10 = lerp(p[dg],    p[dg+dr],    fr);
+    const int c01 = lerp(p[db],    p[db+dr],    fr);
+    const int c11 = lerp(p[db+dg], p[db+dg+dr], fr);
+    const int v = lerp(lerp(c00, c10, fg),
+                       lerp(c01, c11, fg), fb);
+    out[i] = std::clamp((v + 32) >> 6, 0, 255);
+  }
+  return rgba(out[0], out[1], out[2], rgba_geta(c));
+}
+
+// Interpolates the color inside one of the six tetrahedrons of the
+// grid cube, which is faster than the trilinear interpolation (4
+// corners instead of 8) and preserves the neutral axis.
+color_t ColorLut::mapTetrahedral(color_t c) const
+{
+  const int r = rgba_getr(c), g = rgba_getg(c), b = rgba_getb(c);
+  const int fr = m_gridFrac[r], fg = m_gridFrac[g], fb = m_gridFrac[b];
+  const int dr = 4, dg = 4*m_size, db = 4*m_size*m_size;
+  const int16_t* p = &m_table[4*index(m_gridIndex[r], m_gridIndex[g], m_gridIndex[b])];
+
+  // Corners p0=p[0], p1, p2, p3=p[dr+dg+db] and weights (summing 256)
+  int o1, o2, w0, w1, w2, w3;
+  if (fr > fg) {
+    if (fg > fb) {              // r > g > b
+      o1 = dr; o2 = dr+dg;
+      w0 = 256-fr; w1 = fr-fg; w2 = fg-fb; w3 = fb;
+    }
+    else if (fr > fb) {         // r > b >= g
+      o1 = dr; o2 = dr+db;
+      w0 = 256-fr; w1 = fr-fb; w2 = fb-fg; w3 = fg;
+    }
+    else {                      // b >= r > g
+      o1 = db; o2 = dr+db;
+      w0 = 256-fb; w1 = fb-fr; w2 = fr-fg; w3 = fg;
+    }
+  }
+  else {
+    if (fb > fg) {              // b > g >= r
+      o1 = db; o2 = dg+db;
+      w0 = 256-fb; w1 = fb-fg; w2 = fg-fr; w3 = fr;
+    }
+    else if (fb > fr) {         // g >= b > r
+      o1 = dg; o2 = dg+db;
+      w0 = 256-fg; w1 = fg-fb; w2 = fb-fr; w3 = fr;
+    }
+    else {                      // g >= r >= b
+      o1 = dg; o2 = dr+dg;
+      w0 = 256-fg; w1 = fg-fr; w2 = fr-fb; w3 = fb;
+    }
+  }
+  const int16_t* p1 = p + o1;
+  const int16_t* p2 = p + o2;
+  const int16_t* p3 = p + dr+dg+db;
+
+#if COLOR_LUT_SSE2
+  // Interleave the components of two corners (r0 r1 g0 g1 b0 b1 0 0)
+  // to multiply them by their weights and add them with one madd.
+  const __m128i c01 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p),
+                                         _mm_loadl_epi64((const __m128i*)p1));
+  const __m128i c23 = _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)p2),
+                                         _mm_loadl_epi64((const __m128i*)p3));
+  __m128i v = _mm_add_epi32(
+    _mm_madd_epi16(c01, _mm_set1_epi32((w1 << 16) | w0)),
+    _mm_madd_epi16(c23, _mm_set1_epi32((w3 << 16) | w2)));
+  v = _mm_srai_epi32(_mm_add_epi32(v, _mm_set1_epi32(1 << (kTableShift-1))),
+                     kTableShift);
+  v = _mm_packs_epi32(v, v);
+  v = _mm_packus_epi16(v, v);
+  const uint32_t out = uint32_t(_mm_cvtsi128_si32(v));
+  return rgba(out & 0xff, (out >> 8) & 0xff, (out >> 16) & 0xff,
+              rgba_geta(c));
+#else
+  int out[3];
+  for (int i=0; i<3; ++i) {
+    const int v = w0*p[i] + w1*p1[i] + w2*p2[i] + w3*p3[i];
+    out[i] = std::clamp((v + (1 << (kTableShift-1))) >> kTableShift, 0, 255);
+  }
+  return rgba(out[0], out[1], out[2], rgba_geta(c));
+#endif
+}
+
+// static
+std::unique_ptr<ColorLut> ColorLut::loadCube(const std::string& filename)
+{
+  std::ifstream f(FSTREAM_PATH(filename));
+  if (!f)
+    return nullptr;
+
+  std::string title;
+  int size = 0;
+  std::vector<float> colors;
+
+  std::string line;
+  while (std::getline(f, line)) {
+    base::trim_string(line, line);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    std::istringstream s(line);
+    if (std::isalpha(line[0])) {
+      std::string keyword;
+      s >> keyword;
+      if (keyword == "TITLE") {
+        std::getline(s, title);
+        base::trim_string(title, title);
+        if (title.size() >= 2 && title.front() == '"' && title.back() == '"')
+          title = title.substr(1, title.size()-2);
+      }
+      else if (keyword == "LUT_3D_SIZE") {
+        s >> size;
+        if (size < kMinSize || size > kMaxSize)
+          return nullptr;
+        colors.reserve(3*size*size*size);
+      }
+      else if (keyword == "DOMAIN_MIN" || keyword == "DOMAIN_MAX") {
+        // Only the default domain (0.0 to 1.0) is supported
+        const float expected = (keyword == "DOMAIN_MIN" ? 0.0f: 1.0f);
+        float v;
+        for (int i=0; i<3; ++i)
+          if (!(s >> v) || v != expected)
+            return nullptr;
+      }
+      else {
+        // 1D LUTs (LUT_1D_SIZE) or unknown keywords
+        return nullptr;
+      }
+      continue;
+    }
+
+    float rgb[3];
+    if (!(s >> rgb[0] >> rgb[1] >> rgb[2]))
+      return nullptr;
+    colors.insert(colors.end(), rgb, rgb+3);
+  }
+
+  if (size == 0 || colors.size() != 3*size_t(size)*size*size)
+    return nullptr;
+
+  auto lut = std::make_unique<ColorLut>(size);
+  lut->m_title = title;
+  lut->m_colors = std::move(colors);
+  for (int i=0; i<size*size*size; ++i)
+    lut->updateTable(i);
+  return lut;
+}
+
+bool ColorLut::saveCube(const std::string& filename) const
+{
+  std::ofstream f(FSTREAM_PATH(filename));
+  if (!f)
+    return false;
+
+  if (!m_title.empty())
+    f << "TITLE \"" << m_title << "\"\n";
+  f << "LUT_3D_SIZE " << m_size << "\n";
+
+  f << std::fixed << std::setprecision(6);
+  for (size_t i=0; i<m_colors.size(); i+=3)
+    f << m_colors[i] << ' ' << m_colors[i+1] << ' ' << m_colors[i+2] << '\n';
+
+  return bool(f);
+}
+
+// static
+std::unique_ptr<ColorLut> ColorLut::bake(Filter* filter, int size)
+{
+  ASSERT(filter);
+  ASSERT(filter->isRowIndependent());
+
+  auto lut = std::make_unique<ColorLut>(size);
+  size = lut->m_size;
+
+  // Each row contains all the red/green combinations of one blue
+  // value of the grid.
+  const int w = size*size;
+  std::vector<uint32_t> src(w), dst(w);
+  for (int b=0; b<size; ++b) {
+    for (int g=0; g<size; ++g)
+      for (int r=0; r<size; ++r)
+        src[r + g*size] = rgba(grid_value(r, size),
+                               grid_value(g, size),
+                               grid_value(b, size), 255);
+
+    BakeFilterManager mgr(src.data(), dst.data(), w, b);
+    filter->applyToRgba(&mgr);
+
+    for (int g=0; g<size; ++g)
+      for (int r=0; r<size; ++r) {
+        const color_t c = dst[r + g*size];
+        const float rgb[3] = { rgba_getr(c) / 255.0f,
+                               rgba_getg(c) / 255.0f,
+                               rgba_getb(c) / 255.0f };
+        lut->setColor(r, g, b, rgb);
+      }
+  }
+  return lut;
+}
+
+} // namespace filters
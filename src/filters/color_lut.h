@@ -0,0 +1,90 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_COLOR_LUT_H_INCLUDED
+#define FILTERS_COLOR_LUT_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace filters {
+
+  class Filter;
+
+  // 3D color lookup table: a grid of size*size*size RGB colors used
+  // to map each RGB color (the alpha is not modified). Colors between
+  // grid points are interpolated. It can be loaded/saved as a .cube
+  // file, or baked from any point-wise filter (e.g. a FilterChain).
+  class ColorLut {
+  public:
+    enum class Interpolation {
+      Trilinear,
+      Tetrahedral,
+    };
+
+    static constexpr int kMinSize = 2;
+    static constexpr int kMaxSize = 256;
+
+    // Creates an identity LUT
+    explicit ColorLut(int size = 33);
+
+    int size() const { return m_size; }
+    const std::string& title() const { return m_title; }
+    void setTitle(const std::string& title) { m_title = title; }
+
+    // Output color of the grid point (r, g, b) with components from
+    // 0.0 to 1.0.
+    void getColor(int r, int g, int b, float rgb[3]) const;
+    void setColor(int r, int g, int b, const float rgb[3]);
+
+    // Maps a color through the LUT. This can be called from several
+    // threads at the same time.
+    doc::color_t map(doc::color_t c, Interpolation interpolation) const;
+
+    // Returns nullptr if the file cannot be read or it's not a valid
+    // 3D LUT .cube file.
+    static std::unique_ptr<ColorLut> loadCube(const std::string& filename);
+    bool saveCube(const std::string& filename) const;
+
+    // Creates a LUT applying the given filter to the RGB channels of
+    // each grid point. The filter must be row independent.
+    static std::unique_ptr<ColorLut> bake(Filter* filter, int size);
+
+  private:
+    int index(int r, int g, int b) const {
+      return r + (g + b*m_size)*m_size;
+    }
+    void updateTable(int i);
+    doc::color_t mapTrilinear(doc::color_t c) const;
+    doc::color_t mapTetrahedral(doc::color_t c) const;
+
+    int m_size;
+    std::string m_title;
+
+    // RGB colors of the grid (the red index changes faster as in
+    // .cube files).
+    std::vector<float> m_colors;
+
+    // The same grid in fixed point (each component from 0 to
+    // 255*64) with 4 components (r, g, b, 0) per point to evaluate
+    // the LUT with integer/SIMD operations.
+    std::vector<int16_t> m_table;
+
+    // Grid coordinate of each 8-bit component value, and the
+    // fraction (from 0 to 256) between that grid point and the next
+    // one.
+    int m_gridIndex[256];
+    int m_gridFrac[256];
+  };
+
+} // namespace filters
+
+#endif
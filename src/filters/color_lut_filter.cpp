@@ -0,0 +1,157 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/color_lut_filter.h"
+
+#include "doc/image.h"
+#include "doc/palette.h"
+#include "doc/palette_picks.h"
+#include "doc/rgbmap.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+
+namespace filters {
+
+using namespace doc;
+
+ColorLutFilter::ColorLutFilter()
+  : m_interpolation(Interpolation::Tetrahedral)
+{
+}
+
+void ColorLutFilter::setLut(const std::shared_ptr<ColorLut>& lut)
+{
+  m_lut = lut;
+}
+
+void ColorLutFilter::setInterpolation(Interpolation interpolation)
+{
+  m_interpolation = interpolation;
+}
+
+const char* ColorLutFilter::getName()
+{
+  return "Color LUT";
+}
+
+void ColorLutFilter::applyToRgba(FilterManager* filterMgr)
+{
+  if (!m_lut)
+    return;
+
+  FilterIndexedData* fid = filterMgr->getIndexedData();
+  const Palette* pal = fid->getPalette();
+  Palette* newPal = (m_usePaletteOnRGB ? fid->getNewPalette(): nullptr);
+
+  // Consecutive pixels use to have the same color, so we can reuse
+  // the last mapped color.
+  color_t last = 0;
+  color_t lastMapped = applyFilterToRgb(filterMgr->getTarget(), last);
+
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
+    color_t c = *src_address;
+
+    if (newPal) {
+      int i =
+        pal->findExactMatch(rgba_getr(c),
+                            rgba_getg(c),
+                            rgba_getb(c),
+                            rgba_geta(c), -1);
+      if (i >= 0)
+        c = newPal->getEntry(i);
+    }
+    else if (c == last) {
+      c = lastMapped;
+    }
+    else {
+      last = c;
+      c = lastMapped = applyFilterToRgb(target, c);
+    }
+
+    *dst_address = c;
+  }
+  FILTER_LOOP_THROUGH_ROW_END()
+}
+
+void ColorLutFilter::applyToGrayscale(FilterManager* filterMgr)
+{
+  if (!m_lut)
+    return;
+
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
+    color_t c = *src_address;
+    int k = graya_getv(c);
+    int a = graya_geta(c);
+
+    if (target & TARGET_GRAY_CHANNEL)
+      k = rgba_luma(m_lut->map(rgba(k, k, k, 255), m_interpolation));
+
+    *dst_address = graya(k, a);
+  }
+  FILTER_LOOP_THROUGH_ROW_END()
+}
+
+void ColorLutFilter::applyToIndexed(FilterManager* filterMgr)
+{
+  // Apply filter to pixels if there is selection (in other case, the
+  // change is global, so we have already applied the filter to the
+  // palette).
+  if (!m_lut || !filterMgr->isMaskActive())
+    return;
+
+  // Apply filter to color region
+  FilterIndexedData* fid = filterMgr->getIndexedData();
+  const Palette* pal = fid->getPalette();
+  const RgbMap* rgbmap = fid->getRgbMap();
+
+  FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
+    color_t c = pal->getEntry(*src_address);
+    c = applyFilterToRgb(target, c);
+    *dst_address = rgbmap->mapColor(c);
+  }
+  FILTER_LOOP_THROUGH_ROW_END()
+}
+
+void ColorLutFilter::onApplyToPalette(FilterManager* filterMgr,
+                                      const PalettePicks& picks)
+{
+  if (!m_lut)
+    return;
+
+  FilterIndexedData* fid = filterMgr->getIndexedData();
+  const Target target = filterMgr->getTarget();
+  const Palette* pal = fid->getPalette();
+  Palette* newPal = fid->getNewPalette();
+
+  int i = 0;
+  for (bool state : picks) {
+    if (state)
+      newPal->setEntry(i, applyFilterToRgb(target, pal->getEntry(i)));
+    ++i;
+  }
+}
+
+color_t ColorLutFilter::applyFilterToRgb(const Target target, color_t c) const
+{
+  const color_t mapped = m_lut->map(c, m_interpolation);
+  if ((target & (TARGET_RED_CHANNEL |
+                 TARGET_GREEN_CHANNEL |
+                 TARGET_BLUE_CHANNEL)) == (TARGET_RED_CHANNEL |
+                                           TARGET_GREEN_CHANNEL |
+                                           TARGET_BLUE_CHANNEL))
+    return mapped;
+
+  return rgba((target & TARGET_RED_CHANNEL   ? rgba_getr(mapped): rgba_getr(c)),
+              (target & TARGET_GREEN_CHANNEL ? rgba_getg(mapped): rgba_getg(c)),
+              (target & TARGET_BLUE_CHANNEL  ? rgba_getb(mapped): rgba_getb(c)),
+              rgba_geta(c));
+}
+
+} // namespace filters
@@ -0,0 +1,52 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_COLOR_LUT_FILTER_H_INCLUDED
+#define FILTERS_COLOR_LUT_FILTER_H_INCLUDED
+#pragma once
+
+#include "doc/color.h"
+#include "filters/color_lut.h"
+#include "filters/filter.h"
+#include "filters/target.h"
+
+#include <memory>
+
+namespace filters {
+
+  // Maps the RGB channels through a 3D color LUT. Indexed images
+  // are graded modifying only the palette (or the selected pixels
+  // if the mask is active).
+  class ColorLutFilter : public FilterWithPalette {
+  public:
+    using Interpolation = ColorLut::Interpolation;
+
+    ColorLutFilter();
+
+    void setLut(const std::shared_ptr<ColorLut>& lut);
+    const std::shared_ptr<ColorLut>& getLut() const { return m_lut; }
+    void setInterpolation(Interpolation interpolation);
+
+    // Filter implementation
+    const char* getName() override;
+    void applyToRgba(FilterManager* filterMgr) override;
+    void applyToGrayscale(FilterManager* filterMgr) override;
+    void applyToIndexed(FilterManager* filterMgr) override;
+    bool isRowIndependent() const override { return true; }
+
+  private:
+    void onApplyToPalette(FilterManager* filterMgr,
+                          const doc::PalettePicks& picks) override;
+
+    doc::color_t applyFilterToRgb(const Target target, doc::color_t c) const;
+
+    std::shared_ptr<ColorLut> m_lut;
+    Interpolation m_interpolation;
+  };
+
+} // namespace filters
+
+#endif
@@ -19,12 +19,122 @@
 #include "doc/palette.h"
 #include "doc/rgbmap.h"
 
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define FILTERS_CONVOLUTION_SSE2 1
+  #include <emmintrin.h>
+#endif
+
 namespace filters {
 
 using namespace doc;
 
 namespace {
 
+  typedef ConvolutionMatrixFilter::Sums Sums;
+
+  inline void add_pixel(Sums& sums, const RgbTraits::pixel_t color, const int k) {
+    if (rgba_geta(color) == 0)
+      sums.t += k;
+    else {
+      sums.c[0] += rgba_getr(color) * k;
+      sums.c[1] += rgba_getg(color) * k;
+      sums.c[2] += rgba_getb(color) * k;
+      sums.c[3] += rgba_geta(color) * k;
+    }
+  }
+
+  inline void add_pixel(Sums& sums, const GrayscaleTraits::pixel_t color, const int k) {
+    if (graya_geta(color) == 0)
+      sums.t += k;
+    else {
+      sums.c[0] += graya_getv(color) * k;
+      sums.c[1] += graya_geta(color) * k;
+    }
+  }
+
+  // Convolves the pixels [x, x+sums.size()) of the "y" row of the
+  // image with the given kernel.
+  template<typename Traits>
+  void convolve_row(const Image* src, const int x, const int y,
+                    const std::vector<int>& kernel, const int centerX,
+                    const bool tiledX, std::vector<Sums>& sums)
+  {
+    const auto row = (typename Traits::const_address_t)src->getPixelAddress(0, y);
+    const int kw = int(kernel.size());
+    const int w = int(sums.size());
+
+    for (int i=0; i<w; ++i) {
+      Sums& s = sums[i];
+      s = Sums{ { 0, 0, 0, 0 }, 0 };
+
+      // Wrap/clamp the coordinates only in the edges
+      const int sx = x+i-centerX;
+      if (sx >= 0 && sx+kw <= src->width()) {
+        for (int k=0; k<kw; ++k)
+          if (kernel[k])
+            add_pixel(s, row[sx+k], kernel[k]);
+      }
+      else {
+        for (int k=0; k<kw; ++k)
+          if (kernel[k])
+            add_pixel(s, row[get_neighboring_coord(sx+k, src->width(), tiledX)], kernel[k]);
+      }
+    }
+  }
+
+#if FILTERS_CONVOLUTION_SSE2
+
+  // Adds the four channels of the pixel at the same time
+  inline void add_pixel_sse2(__m128i& acc, int& t,
+                             const RgbTraits::pixel_t color, const int k) {
+    if (rgba_geta(color) == 0)
+      t += k;
+    else {
+      const __m128i zero = _mm_setzero_si128();
+      __m128i px = _mm_unpacklo_epi8(_mm_cvtsi32_si128(int(color)), zero);
+      px = _mm_unpacklo_epi16(px, zero);
+      // Kernel values are 16-bit (checked in updateSeparableKernels())
+      acc = _mm_add_epi32(acc, _mm_madd_epi16(px, _mm_set1_epi32(k & 0xffff)));
+    }
+  }
+
+  template<>
+  void convolve_row<RgbTraits>(const Image* src, const int x, const int y,
+                               const std::vector<int>& kernel, const int centerX,
+                               const bool tiledX, std::vector<Sums>& sums)
+  {
+    const auto row = (RgbTraits::const_address_t)src->getPixelAddress(0, y);
+    const int kw = int(kernel.size());
+    const int w = int(sums.size());
+
+    for (int i=0; i<w; ++i) {
+      __m128i acc = _mm_setzero_si128();
+      int t = 0;
+
+      const int sx = x+i-centerX;
+      if (sx >= 0 && sx+kw <= src->width()) {
+        for (int k=0; k<kw; ++k)
+          if (kernel[k])
+            add_pixel_sse2(acc, t, row[sx+k], kernel[k]);
+      }
+      else {
+        for (int k=0; k<kw; ++k)
+          if (kernel[k])
+            add_pixel_sse2(acc, t, row[get_neighboring_coord(sx+k, src->width(), tiledX)], kernel[k]);
+      }
+
+      _mm_storeu_si128((__m128i*)sums[i].c, acc);
+      sums[i].t = t;
+    }
+  }
+
+#endif // FILTERS_CONVOLUTION_SSE2
+
   struct GetPixelsDelegate {
     int div;
     const int* matrixData;
@@ -112,17 +222,135 @@ namespace {
 ConvolutionMatrixFilter::ConvolutionMatrixFilter()
   : m_matrix(NULL)
   , m_tiledMode(TiledMode::NONE)
+  , m_rowsImageId(NullId)
+  , m_rowsX(0)
+  , m_rowsWidth(0)
 {
 }
 
 void ConvolutionMatrixFilter::setMatrix(const std::shared_ptr<ConvolutionMatrix>& matrix)
 {
   m_matrix = matrix;
+  updateSeparableKernels();
 }
 
 void ConvolutionMatrixFilter::setTiledMode(TiledMode tiledMode)
 {
   m_tiledMode = tiledMode;
+  m_rows.clear();
+}
+
+void ConvolutionMatrixFilter::updateSeparableKernels()
+{
+  m_hKernel.clear();
+  m_vKernel.clear();
+  m_rows.clear();
+
+  if (!m_matrix ||
+      m_matrix->getWidth() < 2 ||
+      m_matrix->getHeight() < 2)
+    return;
+
+  const int w = m_matrix->getWidth();
+  const int h = m_matrix->getHeight();
+
+  // Use the first non-zero row (divided by the GCD of its values) as
+  // the horizontal kernel
+  int row = 0;
+  for (; row<h; ++row) {
+    if (std::any_of(&m_matrix->value(0, row),
+                    &m_matrix->value(0, row)+w,
+                    [](int v){ return v != 0; }))
+      break;
+  }
+  if (row == h)
+    return;
+
+  std::vector<int> hKernel(w);
+  int gcd = 0;
+  for (int i=0; i<w; ++i)
+    gcd = std::gcd(gcd, m_matrix->value(i, row));
+  for (int i=0; i<w; ++i) {
+    hKernel[i] = m_matrix->value(i, row) / gcd;
+    // 16-bit values for the SIMD version of convolve_row()
+    if (std::abs(hKernel[i]) > 0x7fff)
+      return;
+  }
+
+  const int col = int(std::find_if(hKernel.begin(), hKernel.end(),
+                                   [](int v){ return v != 0; }) - hKernel.begin());
+
+  // Each row must be a multiple of the horizontal kernel
+  std::vector<int> vKernel(h);
+  for (int j=0; j<h; ++j) {
+    if (m_matrix->value(col, j) % hKernel[col] != 0)
+      return;
+    vKernel[j] = m_matrix->value(col, j) / hKernel[col];
+    for (int i=0; i<w; ++i)
+      if (m_matrix->value(i, j) != vKernel[j] * hKernel[i])
+        return;
+  }
+
+  m_hKernel = std::move(hKernel);
+  m_vKernel = std::move(vKernel);
+}
+
+// Calculates m_sums for each pixel of the row re-using the rows
+// convolved with m_hKernel of previous calls.
+template<typename Traits>
+void ConvolutionMatrixFilter::applySeparable(FilterManager* filterMgr)
+{
+  const Image* src = filterMgr->getSourceImage();
+  const int x = filterMgr->x();
+  const int y = filterMgr->y();
+  const int w = filterMgr->getWidth();
+  const int kh = int(m_vKernel.size());
+  const bool tiledX = (int(m_tiledMode) & int(TiledMode::X_AXIS));
+  const bool tiledY = (int(m_tiledMode) & int(TiledMode::Y_AXIS));
+
+  if (filterMgr->isFirstRow() ||
+      int(m_rows.size()) != kh ||
+      m_rowsImageId != src->id() ||
+      m_rowsX != x ||
+      m_rowsWidth != w) {
+    m_rows.clear();
+    m_rows.resize(kh);
+    m_rowsImageId = src->id();
+    m_rowsX = x;
+    m_rowsWidth = w;
+  }
+
+  m_sums.resize(w);
+  std::fill(m_sums.begin(), m_sums.end(), Sums{ { 0, 0, 0, 0 }, 0 });
+
+  for (int j=0; j<kh; ++j) {
+    const int k = m_vKernel[j];
+    if (!k)
+      continue;
+
+    // Consecutive rows use different entries of the cache
+    const int ry = y - m_matrix->getCenterY() + j;
+    CachedRow& row = m_rows[((ry % kh) + kh) % kh];
+    if (!row.valid || row.y != ry) {
+      row.sums.resize(w);
+      convolve_row<Traits>(src, x,
+                           get_neighboring_coord(ry, src->height(), tiledY),
+                           m_hKernel, m_matrix->getCenterX(),
+                           tiledX, row.sums);
+      row.y = ry;
+      row.valid = true;
+    }
+
+    for (int i=0; i<w; ++i) {
+      Sums& s = m_sums[i];
+      const Sums& r = row.sums[i];
+      s.c[0] += r.c[0] * k;
+      s.c[1] += r.c[1] * k;
+      s.c[2] += r.c[2] * k;
+      s.c[3] += r.c[3] * k;
+      s.t += r.t * k;
+    }
+  }
 }
 
 const char* ConvolutionMatrixFilter::getName()
@@ -139,14 +367,28 @@ void ConvolutionMatrixFilter::applyToRgba(FilterManager* filterMgr)
   uint32_t color;
   GetPixelsDelegateRgba delegate;
 
+  const bool separable = !m_hKernel.empty();
+  if (separable)
+    applySeparable<RgbTraits>(filterMgr);
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<RgbTraits>(src, x, y,
-                                      m_matrix->getWidth(),
-                                      m_matrix->getHeight(),
-                                      m_matrix->getCenterX(),
-                                      m_matrix->getCenterY(),
-                                      m_tiledMode, delegate);
+    if (separable) {
+      const Sums& sums = m_sums[x - filterMgr->x()];
+      delegate.div = m_matrix->getDiv() - sums.t;
+      delegate.r = sums.c[0];
+      delegate.g = sums.c[1];
+      delegate.b = sums.c[2];
+      delegate.a = sums.c[3];
+    }
+    else {
+      delegate.reset(m_matrix.get());
+      get_neighboring_pixels<RgbTraits>(src, x, y,
+                                        m_matrix->getWidth(),
+                                        m_matrix->getHeight(),
+                                        m_matrix->getCenterX(),
+                                        m_matrix->getCenterY(),
+                                        m_tiledMode, delegate);
+    }
 
     color = get_pixel_fast<RgbTraits>(src, x, y);
     if (delegate.div == 0) {
@@ -196,14 +438,26 @@ void ConvolutionMatrixFilter::applyToGrayscale(FilterManager* filterMgr)
   uint16_t color;
   GetPixelsDelegateGrayscale delegate;
 
+  const bool separable = !m_hKernel.empty();
+  if (separable)
+    applySeparable<GrayscaleTraits>(filterMgr);
+
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset(m_matrix.get());
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y,
-                                            m_matrix->getWidth(),
-                                            m_matrix->getHeight(),
-                                            m_matrix->getCenterX(),
-                                            m_matrix->getCenterY(),
-                                            m_tiledMode, delegate);
+    if (separable) {
+      const Sums& sums = m_sums[x - filterMgr->x()];
+      delegate.div = m_matrix->getDiv() - sums.t;
+      delegate.v = sums.c[0];
+      delegate.a = sums.c[1];
+    }
+    else {
+      delegate.reset(m_matrix.get());
+      get_neighboring_pixels<GrayscaleTraits>(src, x, y,
+                                              m_matrix->getWidth(),
+                                              m_matrix->getHeight(),
+                                              m_matrix->getCenterX(),
+                                              m_matrix->getCenterY(),
+                                              m_tiledMode, delegate);
+    }
 
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
     if (delegate.div == 0) {
@@ -9,10 +9,12 @@
 #define FILTERS_CONVOLUTION_MATRIX_FILTER_H_INCLUDED
 #pragma once
 
+#include "doc/object_id.h"
 #include "filters/filter.h"
 #include "filters/tiled_mode.h"
 
 #include <memory>
+#include <vector>
 
 namespace filters {
 
@@ -34,9 +36,39 @@ namespace filters {
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
 
+    // Sums of the pixels of a matrix/row multiplied by the matrix
+    // values.
+    struct Sums {
+      int c[4];                 // Each channel (r, g, b, a or v, a)
+      int t;                    // Matrix values of transparent pixels
+    };
+
   private:
+    // Rows of the source image convolved with m_hKernel.
+    struct CachedRow {
+      int y = 0;                // Y coordinate (not wrapped)
+      bool valid = false;
+      std::vector<Sums> sums;
+    };
+
+    void updateSeparableKernels();
+    template<typename Traits>
+    void applySeparable(FilterManager* filterMgr);
+
     std::shared_ptr<ConvolutionMatrix> m_matrix;
     TiledMode m_tiledMode;
+
+    // If the matrix is separable (a rank-1 matrix equal to
+    // m_vKernel*m_hKernel), each row is convolved with m_hKernel just
+    // one time and then the cached rows are combined with m_vKernel
+    // (m_sums) to apply the filter to each row.
+    std::vector<int> m_hKernel;
+    std::vector<int> m_vKernel;
+    std::vector<CachedRow> m_rows;
+    doc::ObjectId m_rowsImageId;
+    int m_rowsX;
+    int m_rowsWidth;
+    std::vector<Sums> m_sums;
   };
 
 } // namespace filters
@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2015  David Capello
 //
 // This program is distributed under the terms of
@@ -44,6 +44,18 @@ namespace filters {
 
     // Applies the filter to the color palette.
     virtual void applyToPalette(FilterManager* filterMgr) { }
+
+    // Returns true if each pixel is modified using only its own
+    // source color (without accessing other rows or modifying the
+    // filter state in applyTo*() functions), so rows of the image
+    // can be processed in parallel from different threads.
+    virtual bool isRowIndependent() const { return false; }
+
+    // Returns true if rows of the image can be processed in parallel
+    // from different threads, i.e. the filter doesn't modify its
+    // state in applyTo*() functions and it reads other pixels only
+    // from FilterManager::getSourceImage().
+    virtual bool isParallelizable() const { return isRowIndependent(); }
   };
 
   // Filter that support applying it only to palette colors.
@@ -0,0 +1,163 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "filters/filter_chain.h"
+
+#include "base/debug.h"
+#include "doc/palette.h"
+#include "doc/palette_picks.h"
+#include "filters/filter_indexed_data.h"
+#include "filters/filter_manager.h"
+
+namespace filters {
+
+using namespace doc;
+
+namespace {
+
+  // FilterManager given to each filter of the chain. The first
+  // filter reads the source image, and the next ones read the
+  // destination (already modified by the previous filters).
+  class ChainedFilterManager : public FilterManager
+                             , public FilterIndexedData {
+  public:
+    ChainedFilterManager(FilterManager* base,
+                         const Target target,
+                         const bool first,
+                         const Palette* palette)
+      : m_base(base)
+      , m_fid(base->getIndexedData())
+      , m_target(base->getTarget() & target)
+      , m_first(first)
+      , m_palette(palette)
+      , m_paletteModified(false) {
+    }
+
+    bool paletteModified() const { return m_paletteModified; }
+
+    // FilterManager implementation
+    doc::PixelFormat pixelFormat() const override { return m_base->pixelFormat(); }
+    const void* getSourceAddress() override {
+      return (m_first ? m_base->getSourceAddress():
+                        m_base->getDestinationAddress());
+    }
+    void* getDestinationAddress() override { return m_base->getDestinationAddress(); }
+    int getWidth() override { return m_base->getWidth(); }
+    Target getTarget() override { return m_target; }
+    FilterIndexedData* getIndexedData() override { return this; }
+    const Image* getSourceImage() override { return m_base->getSourceImage(); }
+    int x() const override { return m_base->x(); }
+    int y() const override { return m_base->y(); }
+    bool isFirstRow() const override { return m_base->isFirstRow(); }
+    bool isMaskActive() const override { return m_base->isMaskActive(); }
+    base::task_token& taskToken() const override { return m_base->taskToken(); }
+    const Spans& getRowSpans() override { return m_base->getRowSpans(); }
+
+    // FilterIndexedData implementation
+    const Palette* getPalette() const override {
+      return (m_palette ? m_palette: m_fid->getPalette());
+    }
+    const RgbMap* getRgbMap() const override { return m_fid->getRgbMap(); }
+    Palette* getNewPalette() override {
+      m_paletteModified = true;
+      return m_fid->getNewPalette();
+    }
+    PalettePicks getPalettePicks() override { return m_fid->getPalettePicks(); }
+
+  private:
+    FilterManager* m_base;
+    FilterIndexedData* m_fid;
+    Target m_target;
+    bool m_first;
+    const Palette* m_palette;
+    bool m_paletteModified;
+  };
+
+} // anonymous namespace
+
+FilterChain::FilterChain()
+{
+}
+
+FilterChain::~FilterChain()
+{
+}
+
+void FilterChain::addFilter(Filter* filter, const Target target)
+{
+  ASSERT(filter);
+  ASSERT(filter->isRowIndependent());
+  m_filters.push_back(filter);
+  m_targets.push_back(target);
+}
+
+const char* FilterChain::getName()
+{
+  if (m_filters.size() == 1)
+    return m_filters[0]->getName();
+  return "Filter Chain";
+}
+
+// This function can be called from several threads at the same time
+// (for different rows), so it must not modify the FilterChain.
+template<typename ApplyFunc>
+void FilterChain::applyToRow(FilterManager* filterMgr, ApplyFunc applyFunc)
+{
+  for (size_t i=0; i<m_filters.size(); ++i) {
+    ChainedFilterManager mgr(filterMgr, m_targets[i], i == 0,
+                             (i < m_palettes.size() ? m_palettes[i].get(): nullptr));
+    applyFunc(m_filters[i], &mgr);
+  }
+}
+
+void FilterChain::applyToRgba(FilterManager* filterMgr)
+{
+  applyToRow(filterMgr, [](Filter* filter, FilterManager* mgr){
+    filter->applyToRgba(mgr);
+  });
+}
+
+void FilterChain::applyToGrayscale(FilterManager* filterMgr)
+{
+  applyToRow(filterMgr, [](Filter* filter, FilterManager* mgr){
+    filter->applyToGrayscale(mgr);
+  });
+}
+
+void FilterChain::applyToIndexed(FilterManager* filterMgr)
+{
+  applyToRow(filterMgr, [](Filter* filter, FilterManager* mgr){
+    filter->applyToIndexed(mgr);
+  });
+}
+
+// Each filter modifies the palette received from the previous ones.
+// The palettes are saved in m_palettes to be used later when the
+// rows are processed (e.g. to find RGB colors in the palette).
+void FilterChain::applyToPalette(FilterManager* filterMgr)
+{
+  m_palettes.clear();
+  m_palettes.resize(m_filters.size());
+
+  std::unique_ptr<Palette> current;
+  for (size_t i=0; i<m_filters.size(); ++i) {
+    if (current)
+      m_palettes[i] = std::make_unique<Palette>(*current);
+
+    ChainedFilterManager mgr(filterMgr, m_targets[i], true,
+                             m_palettes[i].get());
+    m_filters[i]->applyToPalette(&mgr);
+
+    if (mgr.paletteModified())
+      current = std::make_unique<Palette>(*filterMgr->getIndexedData()->getNewPalette());
+  }
+}
+
+} // namespace filters
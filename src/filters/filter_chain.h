@@ -0,0 +1,61 @@
+// Aseprite
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This program is distributed under the terms of
+// the End-User License Agreement for Aseprite.
+
+#ifndef FILTERS_FILTER_CHAIN_H_INCLUDED
+#define FILTERS_FILTER_CHAIN_H_INCLUDED
+#pragma once
+
+#include "filters/filter.h"
+#include "filters/target.h"
+
+#include <memory>
+#include <vector>
+
+namespace doc {
+  class Palette;
+}
+
+namespace filters {
+
+  // Applies several point-wise filters (Filter::isRowIndependent())
+  // one after the other to each row, so they can be applied with
+  // just one FilterManager pass (one copy of the image and one undo
+  // step). Each filter receives the pixels/palette modified by the
+  // previous one in the chain.
+  class FilterChain : public Filter {
+  public:
+    FilterChain();
+    ~FilterChain();
+
+    // The filter is not owned by the chain. It's applied only to the
+    // given channels of the FilterManager target.
+    void addFilter(Filter* filter,
+                   Target target = (TARGET_ALL_CHANNELS | TARGET_INDEX_CHANNEL));
+    bool empty() const { return m_filters.empty(); }
+
+    // Filter implementation
+    const char* getName() override;
+    void applyToRgba(FilterManager* filterMgr) override;
+    void applyToGrayscale(FilterManager* filterMgr) override;
+    void applyToIndexed(FilterManager* filterMgr) override;
+    void applyToPalette(FilterManager* filterMgr) override;
+    bool isRowIndependent() const override { return true; }
+
+  private:
+    template<typename ApplyFunc>
+    void applyToRow(FilterManager* filterMgr, ApplyFunc applyFunc);
+
+    std::vector<Filter*> m_filters;
+    std::vector<Target> m_targets;
+
+    // Palette modified by the previous filters of the chain for each
+    // filter (nullptr if the palette wasn't modified).
+    std::vector<std::unique_ptr<doc::Palette>> m_palettes;
+  };
+
+} // namespace filters
+
+#endif
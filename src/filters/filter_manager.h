@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2017  David Capello
 //
 // This program is distributed under the terms of
@@ -13,23 +13,31 @@
 #include "doc/pixel_format.h"
 #include "filters/target.h"
 
+#include <vector>
+
 // Creates src_address, dst_address, x, x2, and y variables to iterate
-// through a row of the target. Skips non-selected areas.
+// through a row of the target. Non-selected areas are skipped span by
+// span (see FilterManager::getRowSpans()).
 // Requires the "filterMgr" variable.
 #define FILTER_LOOP_THROUGH_ROW_BEGIN(Type)                             \
   const Target target = filterMgr->getTarget();                         \
-  auto src_address = (const Type*)filterMgr->getSourceAddress();        \
-  auto dst_address = (Type*)filterMgr->getDestinationAddress();         \
-  int x = filterMgr->x();                                               \
-  const int x2 = x + filterMgr->getWidth();                             \
+  const auto src_row = (const Type*)filterMgr->getSourceAddress();      \
+  const auto dst_row = (Type*)filterMgr->getDestinationAddress();       \
+  const int row_x = filterMgr->x();                                     \
   [[maybe_unused]] const int y = filterMgr->y();                        \
   auto& token = filterMgr->taskToken();                                 \
-  for (; x < x2 && !token.canceled();                                   \
-       ++x, ++src_address, ++dst_address) {                             \
-    if (filterMgr->skipPixel())                                         \
-      continue;
+  for (const filters::FilterManager::Span& span :                       \
+         filterMgr->getRowSpans()) {                                    \
+    if (token.canceled())                                               \
+      break;                                                            \
+    auto src_address = src_row + span.x;                                \
+    auto dst_address = dst_row + span.x;                                \
+    int x = row_x + span.x;                                             \
+    const int x2 = x + span.w;                                          \
+    for (; x < x2; ++x, ++src_address, ++dst_address) {
 
 #define FILTER_LOOP_THROUGH_ROW_END()                                   \
+    }                                                                   \
   }
 
 namespace doc {
@@ -47,6 +55,13 @@ namespace filters {
   // This process must be repeated getWidth() times.
   class FilterManager {
   public:
+    // Run of consecutive pixels to apply the filter in the current
+    // row (x is relative to the first pixel of the row).
+    struct Span {
+      int x, w;
+    };
+    typedef std::vector<Span> Spans;
+
     virtual ~FilterManager() { }
 
     virtual doc::PixelFormat pixelFormat() const = 0;
@@ -72,14 +87,11 @@ namespace filters {
     // RgbMap to help the filter to make its job.
     virtual FilterIndexedData* getIndexedData() = 0;
 
-    // Returns true if you should skip the current pixel (do not apply
-    // the filter). You must increment all your internal source and
-    // destination address pointers one pixel without applying the
-    // filter.
-    //
-    // This method is used to skip non-selected pixels (when the
-    // selection is actived).
-    virtual bool skipPixel() = 0;
+    // Returns the runs of selected pixels of the current row (sorted
+    // from left to right). The filter must be applied only to these
+    // pixels. Without selection (or when the whole row is selected)
+    // there is just one span with the whole row (getWidth() pixels).
+    virtual const Spans& getRowSpans() = 0;
 
     //////////////////////////////////////////////////////////////////////
     // Special members for 2D filters like convolution matrices.
@@ -19,6 +19,7 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool isRowIndependent() const override { return true; }
   };
 
 } // namespace filters
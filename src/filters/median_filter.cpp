@@ -27,6 +27,76 @@ namespace filters {
 using namespace doc;
 
 namespace {
+
+  // Minimum number of pixels in the window to use a histogram to
+  // calculate the median (small windows are faster to sort).
+  constexpr int kMinHistogramPixels = 25;
+
+  // Histogram of one channel of the pixels inside the filter window,
+  // the median is updated incrementally when pixels are added/removed
+  // (Huang's algorithm).
+  class MedianHistogram {
+  public:
+    void reset(const int npixels) {
+      std::fill(std::begin(m_bins), std::end(m_bins), 0);
+      m_median = 0;
+      m_below = 0;
+      m_rank = npixels/2;
+    }
+
+    void add(const int v) {
+      ++m_bins[v];
+      if (v < m_median)
+        ++m_below;
+    }
+
+    void remove(const int v) {
+      --m_bins[v];
+      if (v < m_median)
+        --m_below;
+    }
+
+    // Returns the same value as the element "npixels/2" of the sorted
+    // pixels.
+    int median() {
+      while (m_below > m_rank) {
+        --m_median;
+        m_below -= m_bins[m_median];
+      }
+      while (m_below + m_bins[m_median] <= m_rank) {
+        m_below += m_bins[m_median];
+        ++m_median;
+      }
+      return m_median;
+    }
+
+  private:
+    int m_bins[256];
+    int m_median;               // Current median value
+    int m_below;                // Number of pixels < m_median
+    int m_rank;
+  };
+
+  inline void get_channels(const RgbTraits::pixel_t color, int* channels) {
+    channels[0] = rgba_getr(color);
+    channels[1] = rgba_getg(color);
+    channels[2] = rgba_getb(color);
+    channels[3] = rgba_geta(color);
+  }
+
+  inline void get_channels(const GrayscaleTraits::pixel_t color, int* channels) {
+    channels[0] = graya_getv(color);
+    channels[1] = graya_geta(color);
+  }
+
+  inline RgbTraits::pixel_t make_color(RgbTraits::pixel_t, const int* channels) {
+    return rgba(channels[0], channels[1], channels[2], channels[3]);
+  }
+
+  inline GrayscaleTraits::pixel_t make_color(GrayscaleTraits::pixel_t, const int* channels) {
+    return graya(channels[0], channels[1]);
+  }
+
   struct GetPixelsDelegateRgba {
     std::vector<std::vector<uint8_t> >& channel;
     int c;
@@ -87,6 +157,16 @@ namespace {
       c++;
     }
   };
+
+  // Returns the median of the first "n" elements of the channel
+  // (without sorting the whole vector).
+  int median_of(std::vector<uint8_t>& channel, const int n)
+  {
+    auto mid = channel.begin() + n/2;
+    std::nth_element(channel.begin(), mid, channel.begin() + n);
+    return *mid;
+  }
+
 };
 
 MedianFilter::MedianFilter()
@@ -121,8 +201,86 @@ const char* MedianFilter::getName()
   return "Median Blur";
 }
 
+bool MedianFilter::useHistogram() const
+{
+  return (m_ncolors >= kMinHistogramPixels);
+}
+
+// Moves the window through the row adding/removing the columns of
+// pixels that enter/leave the window to the histograms of each
+// channel (N is the number of channels of the Traits pixels).
+template<typename Traits, int N>
+void MedianFilter::applyHistogram(FilterManager* filterMgr)
+{
+  const Image* src = filterMgr->getSourceImage();
+  const bool tiledX = (int(m_tiledMode) & int(TiledMode::X_AXIS));
+  const bool tiledY = (int(m_tiledMode) & int(TiledMode::Y_AXIS));
+  const int cx = m_width/2;
+  const int cy = m_height/2;
+  const Target targets[4] = {
+    (N == 4 ? TARGET_RED_CHANNEL: TARGET_GRAY_CHANNEL),
+    (N == 4 ? TARGET_GREEN_CHANNEL: TARGET_ALPHA_CHANNEL),
+    TARGET_BLUE_CHANNEL,
+    TARGET_ALPHA_CHANNEL
+  };
+  MedianHistogram hist[N];
+  int channels[4];
+
+  // Source rows of the window (wrapped/clamped)
+  std::vector<int> rows(m_height);
+  for (int j=0; j<m_height; ++j)
+    rows[j] = get_neighboring_coord(filterMgr->y()-cy+j, src->height(), tiledY);
+
+  auto addColumn = [&](const int col, const bool add) {
+    const int u = get_neighboring_coord(col, src->width(), tiledX);
+    for (int j=0; j<m_height; ++j) {
+      get_channels(get_pixel_fast<Traits>(src, u, rows[j]), channels);
+      for (int c=0; c<N; ++c) {
+        if (add)
+          hist[c].add(channels[c]);
+        else
+          hist[c].remove(channels[c]);
+      }
+    }
+  };
+
+  // Center of the window in the histograms (-1 if they are empty)
+  int histX = -1;
+
+  FILTER_LOOP_THROUGH_ROW_BEGIN(typename Traits::pixel_t) {
+    // Re-create the histograms if it's faster than moving the
+    // window (e.g. after skipping non-selected pixels).
+    if (histX < 0 || x - histX >= m_width) {
+      for (int c=0; c<N; ++c)
+        hist[c].reset(m_ncolors);
+      for (int i=0; i<m_width; ++i)
+        addColumn(x-cx+i, true);
+    }
+    else {
+      for (; histX < x; ++histX) {
+        addColumn(histX-cx, false);
+        addColumn(histX-cx+m_width, true);
+      }
+    }
+    histX = x;
+
+    get_channels(get_pixel_fast<Traits>(src, x, y), channels);
+    for (int c=0; c<N; ++c) {
+      if (target & targets[c])
+        channels[c] = hist[c].median();
+    }
+    *dst_address = make_color(*dst_address, channels);
+  }
+  FILTER_LOOP_THROUGH_ROW_END()
+}
+
 void MedianFilter::applyToRgba(FilterManager* filterMgr)
 {
+  if (useHistogram()) {
+    applyHistogram<RgbTraits, 4>(filterMgr);
+    return;
+  }
+
   const Image* src = filterMgr->getSourceImage();
   int color, r, g, b, a;
   GetPixelsDelegateRgba delegate(m_channel);
@@ -135,29 +293,25 @@ void MedianFilter::applyToRgba(FilterManager* filterMgr)
     color = get_pixel_fast<RgbTraits>(src, x, y);
 
     if (target & TARGET_RED_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      r = m_channel[0][m_ncolors/2];
+      r = median_of(m_channel[0], m_ncolors);
     }
     else
       r = rgba_getr(color);
 
     if (target & TARGET_GREEN_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      g = m_channel[1][m_ncolors/2];
+      g = median_of(m_channel[1], m_ncolors);
     }
     else
       g = rgba_getg(color);
 
     if (target & TARGET_BLUE_CHANNEL) {
-      std::sort(m_channel[2].begin(), m_channel[2].end());
-      b = m_channel[2][m_ncolors/2];
+      b = median_of(m_channel[2], m_ncolors);
     }
     else
       b = rgba_getb(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[3].begin(), m_channel[3].end());
-      a = m_channel[3][m_ncolors/2];
+      a = median_of(m_channel[3], m_ncolors);
     }
     else
       a = rgba_geta(color);
@@ -169,6 +323,11 @@ void MedianFilter::applyToRgba(FilterManager* filterMgr)
 
 void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
 {
+  if (useHistogram()) {
+    applyHistogram<GrayscaleTraits, 2>(filterMgr);
+    return;
+  }
+
   const Image* src = filterMgr->getSourceImage();
   int color, k, a;
   GetPixelsDelegateGrayscale delegate(m_channel);
@@ -181,15 +340,13 @@ void MedianFilter::applyToGrayscale(FilterManager* filterMgr)
     color = get_pixel_fast<GrayscaleTraits>(src, x, y);
 
     if (target & TARGET_GRAY_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      k = m_channel[0][m_ncolors/2];
+      k = median_of(m_channel[0], m_ncolors);
     }
     else
       k = graya_getv(color);
 
     if (target & TARGET_ALPHA_CHANNEL) {
-      std::sort(m_channel[1].begin(), m_channel[1].end());
-      a = m_channel[1][m_ncolors/2];
+      a = median_of(m_channel[1], m_ncolors);
     }
     else
       a = graya_geta(color);
@@ -213,37 +370,32 @@ void MedianFilter::applyToIndexed(FilterManager* filterMgr)
                                           m_tiledMode, delegate);
 
     if (target & TARGET_INDEX_CHANNEL) {
-      std::sort(m_channel[0].begin(), m_channel[0].end());
-      *dst_address = m_channel[0][m_ncolors/2];
+      *dst_address = median_of(m_channel[0], m_ncolors);
     }
     else {
       color = get_pixel_fast<IndexedTraits>(src, x, y);
       color = pal->getEntry(color);
 
       if (target & TARGET_RED_CHANNEL) {
-        std::sort(m_channel[0].begin(), m_channel[0].end());
-        r = m_channel[0][m_ncolors/2];
+        r = median_of(m_channel[0], m_ncolors);
       }
       else
         r = rgba_getr(color);
 
       if (target & TARGET_GREEN_CHANNEL) {
-        std::sort(m_channel[1].begin(), m_channel[1].end());
-        g = m_channel[1][m_ncolors/2];
+        g = median_of(m_channel[1], m_ncolors);
       }
       else
         g = rgba_getg(pal->getEntry(color));
 
       if (target & TARGET_BLUE_CHANNEL) {
-        std::sort(m_channel[2].begin(), m_channel[2].end());
-        b = m_channel[2][m_ncolors/2];
+        b = median_of(m_channel[2], m_ncolors);
       }
       else
         b = rgba_getb(color);
 
       if (target & TARGET_ALPHA_CHANNEL) {
-        std::sort(m_channel[3].begin(), m_channel[3].end());
-        a = m_channel[3][m_ncolors/2];
+        a = median_of(m_channel[3], m_ncolors);
       }
       else
         a = rgba_geta(color);
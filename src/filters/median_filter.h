@@ -34,6 +34,12 @@ namespace filters {
     void applyToIndexed(FilterManager* filterMgr);
 
   private:
+    // Uses a sliding histogram instead of sorting the pixels of the
+    // window for each pixel (faster for big windows).
+    bool useHistogram() const;
+    template<typename Traits, int N>
+    void applyHistogram(FilterManager* filterMgr);
+
     TiledMode m_tiledMode;
     int m_width;
     int m_height;
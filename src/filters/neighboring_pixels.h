@@ -17,6 +17,25 @@
 namespace filters {
   using namespace doc;
 
+  // Returns the coordinate of the pixel used for the given coordinate
+  // of a neighboring pixel, which can be outside the [0,size) range
+  // (it's wrapped in tiled mode, or clamped to the edge in other
+  // case).
+  inline int get_neighboring_coord(int v, const int size, const bool tiled)
+  {
+    if (v < 0) {
+      if (tiled)
+        return size - (-(v+1) % size) - 1;
+      return 0;
+    }
+    else if (v >= size) {
+      if (tiled)
+        return v % size;
+      return size-1;
+    }
+    return v;
+  }
+
   // Calls the specified "delegate" for all neighboring pixels in a 2D
   // (width*height) matrix located in (x,y) where its center is the
   // (centerX,centerY) element of the matrix.
@@ -27,6 +46,20 @@ namespace filters {
                                      TiledMode tiledMode,
                                      Delegate& delegate)
   {
+    // Fast path when the whole matrix is inside the image (the
+    // wrapping/clamping logic is needed only in the edges).
+    if (x-centerX >= 0 && x-centerX+width <= sourceImage->width() &&
+        y-centerY >= 0 && y-centerY+height <= sourceImage->height()) {
+      for (int dy=0; dy<height; ++dy) {
+        auto srcAddress =
+          reinterpret_cast<typename Traits::const_address_t>(
+            sourceImage->getPixelAddress(x-centerX, y-centerY+dy));
+        for (int dx=0; dx<width; ++dx, ++srcAddress)
+          delegate(*srcAddress);
+      }
+      return;
+    }
+
     // Y position to get pixel.
     int getx, gety = y - centerY;
     int addx, addy = 0;
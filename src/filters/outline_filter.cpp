@@ -1,5 +1,5 @@
 // Aseprite
-// Copyright (C) 2019  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 //
 // This program is distributed under the terms of
 // the End-User License Agreement for Aseprite.
@@ -18,6 +18,8 @@
 #include "filters/neighboring_pixels.h"
 
 #include <algorithm>
+#include <cstdint>
+#include <vector>
 
 namespace filters {
 
@@ -25,58 +27,71 @@ using namespace doc;
 
 namespace {
 
-  struct GetPixelsDelegate {
-    color_t bgColor;
-    int transparent;    // Transparent pixels
-    int opaque;         // Opaque pixels
-    int matrix;
-    int bit;
-
-    void init(const color_t bgColor,
-              const OutlineFilter::Matrix matrix) {
-      this->bgColor = bgColor;
-      this->matrix = (int)matrix;
+  // Calculates which pixels of a row have at least one neighbor (in
+  // the outline matrix) that is opaque (to outline the outside) or
+  // transparent (to outline the inside). Each bit of the masks is a
+  // pixel, so the neighbors of 64 pixels are checked with a couple
+  // of shifts and ORs per matrix element.
+  class RowOutline {
+  public:
+    // Calculates the row of "w" pixels from (x, y). "isOpaque" is
+    // called one time for each pixel in the previous, current, and
+    // next row (and the pixels outside the image are wrapped in
+    // tiled mode or clamped to the edge, as get_neighboring_pixels()
+    // does).
+    template<typename Traits, typename IsOpaque>
+    void calc(const Image* src,
+              const int x, const int y, const int w,
+              const TiledMode tiledMode,
+              const OutlineFilter::Matrix matrix,
+              const bool outside,
+              IsOpaque isOpaque) {
+      const bool tiledX = (int(tiledMode) & int(TiledMode::X_AXIS));
+      const bool tiledY = (int(tiledMode) & int(TiledMode::Y_AXIS));
+      const int n = w+2;        // Pixels from x-1 to x+w
+      m_result.assign((w+63)/64, 0);
+
+      for (int dy=-1; dy<=1; ++dy) {
+        // Matrix elements of this row (one bit for each dx=-1,0,+1)
+        const int rowMatrix = ((int(matrix) >> (3*(dy+1))) & 7);
+        if (!rowMatrix)
+          continue;
+
+        const int py = get_neighboring_coord(y+dy, src->height(), tiledY);
+        auto address = (typename Traits::const_address_t)src->getPixelAddress(0, py);
+
+        m_bits.assign((n+63)/64, 0);
+        for (int j=0; j<n; ++j) {
+          const int px = get_neighboring_coord(x-1+j, src->width(), tiledX);
+          if (isOpaque(address[px]) == outside)
+            m_bits[j/64] |= (uint64_t(1) << (j%64));
+        }
+
+        // The neighbor dx of pixel i is the bit i+dx+1
+        for (int k=0; k<3; ++k) {
+          if (rowMatrix & (1 << k))
+            orShiftedBits(k);
+        }
+      }
     }
 
-    void reset() {
-      transparent = opaque = 0;
-      bit = 1;
+    bool operator[](const int i) const {
+      return ((m_result[i/64] >> (i%64)) & 1);
     }
-  };
 
-  struct GetPixelsDelegateRgba : public GetPixelsDelegate {
-    void operator()(RgbTraits::pixel_t color) {
-      if (rgba_geta(color) == 0 || color == bgColor)
-        transparent += (matrix & bit ? 1: 0);
-      else
-        opaque += (matrix & bit ? 1: 0);
-      bit <<= 1;
+  private:
+    void orShiftedBits(const int k) {
+      const int nwords = int(m_result.size());
+      for (int i=0; i<nwords; ++i) {
+        uint64_t v = (m_bits[i] >> k);
+        if (k > 0 && i+1 < int(m_bits.size()))
+          v |= (m_bits[i+1] << (64-k));
+        m_result[i] |= v;
+      }
     }
-  };
 
-  struct GetPixelsDelegateGrayscale : public GetPixelsDelegate {
-    void operator()(GrayscaleTraits::pixel_t color) {
-      if (graya_geta(color) == 0 || color == bgColor)
-        transparent += (matrix & bit ? 1: 0);
-      else
-        opaque += (matrix & bit ? 1: 0);
-      bit <<= 1;
-    }
-  };
-
-  struct GetPixelsDelegateIndexed : public GetPixelsDelegate {
-    const Palette* pal;
-
-    GetPixelsDelegateIndexed(const Palette* pal) : pal(pal) { }
-
-    void operator()(IndexedTraits::pixel_t color) {
-      color_t rgba = pal->getEntry(color);
-      if (rgba_geta(rgba) == 0 || color == bgColor)
-        transparent += (matrix & bit ? 1: 0);
-      else
-        opaque += (matrix & bit ? 1: 0);
-      bit <<= 1;
-    }
+    std::vector<uint64_t> m_bits;
+    std::vector<uint64_t> m_result;
   };
 
 }
@@ -98,22 +113,24 @@ const char* OutlineFilter::getName()
 void OutlineFilter::applyToRgba(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
-  int r, g, b, a, n;
+  int r, g, b, a;
   color_t c;
   bool isTransparent;
 
-  GetPixelsDelegateRgba delegate;
-  delegate.init(m_bgColor, m_matrix);
+  const int x0 = filterMgr->x();
+  RowOutline outline;
+  outline.calc<RgbTraits>(
+    src, x0, filterMgr->y(), filterMgr->getWidth(),
+    m_tiledMode, m_matrix, m_place == Place::Outside,
+    [this](const color_t c){
+      return !(rgba_geta(c) == 0 || c == m_bgColor);
+    });
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint32_t) {
-    delegate.reset();
-    get_neighboring_pixels<RgbTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
-
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
     isTransparent = (rgba_geta(c) == 0 || c == m_bgColor);
 
-    if ((n >= 1) &&
+    if (outline[x - x0] &&
         ((m_place == Place::Outside && isTransparent) ||
          (m_place == Place::Inside && !isTransparent))) {
       r = (target & TARGET_RED_CHANNEL   ? rgba_getr(m_color): rgba_getr(c));
@@ -131,22 +148,24 @@ void OutlineFilter::applyToRgba(FilterManager* filterMgr)
 void OutlineFilter::applyToGrayscale(FilterManager* filterMgr)
 {
   const Image* src = filterMgr->getSourceImage();
-  int k, a, n;
+  int k, a;
   color_t c;
   bool isTransparent;
 
-  GetPixelsDelegateGrayscale delegate;
-  delegate.init(m_bgColor, m_matrix);
+  const int x0 = filterMgr->x();
+  RowOutline outline;
+  outline.calc<GrayscaleTraits>(
+    src, x0, filterMgr->y(), filterMgr->getWidth(),
+    m_tiledMode, m_matrix, m_place == Place::Outside,
+    [this](const color_t c){
+      return !(graya_geta(c) == 0 || c == m_bgColor);
+    });
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint16_t) {
-    delegate.reset();
-    get_neighboring_pixels<GrayscaleTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
-
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
     isTransparent = (graya_geta(c) == 0 || c == m_bgColor);
 
-    if ((n >= 1) &&
+    if (outline[x - x0] &&
         ((m_place == Place::Outside && isTransparent) ||
          (m_place == Place::Inside && !isTransparent))) {
       k = (target & TARGET_GRAY_CHANNEL  ? graya_getv(m_color): graya_getv(c));
@@ -164,19 +183,21 @@ void OutlineFilter::applyToIndexed(FilterManager* filterMgr)
   const Image* src = filterMgr->getSourceImage();
   const Palette* pal = filterMgr->getIndexedData()->getPalette();
   const RgbMap* rgbmap = filterMgr->getIndexedData()->getRgbMap();
-  int r, g, b, a, n;
+  int r, g, b, a;
   color_t c;
   bool isTransparent;
 
-  GetPixelsDelegateIndexed delegate(pal);
-  delegate.init(m_bgColor, m_matrix);
+  const int x0 = filterMgr->x();
+  RowOutline outline;
+  outline.calc<IndexedTraits>(
+    src, x0, filterMgr->y(), filterMgr->getWidth(),
+    m_tiledMode, m_matrix, m_place == Place::Outside,
+    [this, pal](const color_t c){
+      return !(rgba_geta(pal->getEntry(c)) == 0 || c == m_bgColor);
+    });
 
   FILTER_LOOP_THROUGH_ROW_BEGIN(uint8_t) {
-    delegate.reset();
-    get_neighboring_pixels<IndexedTraits>(src, x, y, 3, 3, 1, 1, m_tiledMode, delegate);
-
     c = *src_address;
-    n = (m_place == Place::Outside ? delegate.opaque: delegate.transparent);
 
     if (target & TARGET_INDEX_CHANNEL) {
       isTransparent = (c == m_bgColor);
@@ -185,7 +206,7 @@ void OutlineFilter::applyToIndexed(FilterManager* filterMgr)
       isTransparent = (rgba_geta(pal->getEntry(c)) == 0 || c == m_bgColor);
     }
 
-    if ((n >= 1) &&
+    if (outline[x - x0] &&
         ((m_place == Place::Outside && isTransparent) ||
          (m_place == Place::Inside && !isTransparent))) {
       if (target & TARGET_INDEX_CHANNEL) {
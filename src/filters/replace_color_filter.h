@@ -31,6 +31,7 @@ namespace filters {
     void applyToRgba(FilterManager* filterMgr);
     void applyToGrayscale(FilterManager* filterMgr);
     void applyToIndexed(FilterManager* filterMgr);
+    bool isRowIndependent() const override { return true; }
 
   private:
     doc::color_t m_from;
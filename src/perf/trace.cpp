@@ -0,0 +1,284 @@
+// Aseprite Performance Tracing Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "perf/trace.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace perf {
+
+namespace {
+
+struct Event {
+  const char* name;
+  int64_t begin;
+  int64_t end;                  // Value of the counter if isCounter
+  bool isCounter;
+};
+
+// Events of one thread. The buffer is owned by the registry (and by
+// the thread), so its events can be written after the thread ends.
+struct ThreadBuffer {
+  std::mutex mutex;
+  std::vector<Event> events;
+  std::string name;
+  size_t discarded = 0;
+  int tid = 0;
+};
+
+std::mutex g_mutex;
+std::vector<std::shared_ptr<ThreadBuffer>> g_buffers;
+std::atomic<int64_t> g_start(0);
+
+thread_local std::shared_ptr<ThreadBuffer> t_buffer;
+
+int64_t steady_microseconds()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ThreadBuffer& thread_buffer()
+{
+  if (!t_buffer) {
+    t_buffer = std::make_shared<ThreadBuffer>();
+
+    std::lock_guard lock(g_mutex);
+    t_buffer->tid = int(g_buffers.size()) + 1;
+    g_buffers.push_back(t_buffer);
+  }
+  return *t_buffer;
+}
+
+std::vector<std::shared_ptr<ThreadBuffer>> all_buffers()
+{
+  std::lock_guard lock(g_mutex);
+  return g_buffers;
+}
+
+void write_json_string(std::ostream& os, const char* s)
+{
+  os << '"';
+  for (; *s; ++s) {
+    const char c = *s;
+    if (c == '"' || c == '\\')
+      os << '\\' << c;
+    else if (uint8_t(c) < 0x20)
+      os << ' ';
+    else
+      os << c;
+  }
+  os << '"';
+}
+
+struct CompareNames {
+  bool operator()(const char* a, const char* b) const {
+    return std::strcmp(a, b) < 0;
+  }
+};
+
+// Returns the value in the given percentile of the sorted durations
+int64_t percentile(const std::vector<int64_t>& sorted, const int p)
+{
+  const size_t i = (sorted.size()-1) * p / 100;
+  return sorted[i];
+}
+
+} // anonymous namespace
+
+std::atomic<bool> Trace::m_recording(false);
+
+// static
+void Trace::start()
+{
+  for (auto& buffer : all_buffers()) {
+    std::lock_guard lock(buffer->mutex);
+    buffer->events.clear();
+    buffer->discarded = 0;
+  }
+  g_start = steady_microseconds();
+  m_recording = true;
+}
+
+// static
+void Trace::stop()
+{
+  m_recording = false;
+}
+
+// static
+int64_t Trace::now()
+{
+  return steady_microseconds() - g_start.load(std::memory_order_relaxed);
+}
+
+// static
+void Trace::addZone(const char* name, int64_t begin, int64_t end)
+{
+  if (!isRecording())
+    return;
+
+  ThreadBuffer& buffer = thread_buffer();
+  std::lock_guard lock(buffer.mutex);
+  if (buffer.events.size() < kMaxEventsPerThread)
+    buffer.events.push_back(Event{ name, begin, end, false });
+  else
+    ++buffer.discarded;
+}
+
+// static
+void Trace::addCounter(const char* name, int64_t value)
+{
+  if (!isRecording())
+    return;
+
+  const int64_t ts = now();
+  ThreadBuffer& buffer = thread_buffer();
+  std::lock_guard lock(buffer.mutex);
+  if (buffer.events.size() < kMaxEventsPerThread)
+    buffer.events.push_back(Event{ name, ts, value, true });
+  else
+    ++buffer.discarded;
+}
+
+// static
+void Trace::setThreadName(const std::string& name)
+{
+  ThreadBuffer& buffer = thread_buffer();
+  std::lock_guard lock(buffer.mutex);
+  buffer.name = name;
+}
+
+// static
+void Trace::writeJson(std::ostream& os)
+{
+  os << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+  bool first = true;
+  auto separator = [&os, &first]{
+    if (first)
+      first = false;
+    else
+      os << ",\n";
+  };
+
+  for (auto& buffer : all_buffers()) {
+    std::lock_guard lock(buffer->mutex);
+
+    if (!buffer->name.empty()) {
+      separator();
+      os << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+         << buffer->tid << ",\"args\":{\"name\":";
+      write_json_string(os, buffer->name.c_str());
+      os << "}}";
+    }
+
+    for (const Event& ev : buffer->events) {
+      separator();
+      if (ev.isCounter) {
+        os << "{\"ph\":\"C\",\"name\":";
+        write_json_string(os, ev.name);
+        os << ",\"pid\":1,\"tid\":" << buffer->tid
+           << ",\"ts\":" << ev.begin
+           << ",\"args\":{\"value\":" << ev.end << "}}";
+        continue;
+      }
+      os << "{\"ph\":\"X\",\"name\":";
+      write_json_string(os, ev.name);
+      os << ",\"pid\":1,\"tid\":" << buffer->tid
+         << ",\"ts\":" << ev.begin
+         << ",\"dur\":" << (ev.end - ev.begin) << "}";
+    }
+  }
+
+  os << "]}\n";
+}
+
+// static
+bool Trace::saveJson(const std::string& filename)
+{
+  std::ofstream f(filename, std::ios::binary);
+  if (!f)
+    return false;
+  writeJson(f);
+  return bool(f);
+}
+
+// static
+void Trace::writeSummary(std::ostream& os)
+{
+  // Durations of the events grouped by zone name
+  std::map<const char*, std::vector<int64_t>, CompareNames> zones;
+  for (auto& buffer : all_buffers()) {
+    std::lock_guard lock(buffer->mutex);
+    for (const Event& ev : buffer->events) {
+      if (!ev.isCounter)
+        zones[ev.name].push_back(ev.end - ev.begin);
+    }
+  }
+
+  const std::ios_base::fmtflags flags = os.flags();
+  os << std::left << std::setw(48) << "zone" << std::right
+     << std::setw(10) << "count"
+     << std::setw(12) << "total(ms)"
+     << std::setw(10) << "p50(us)"
+     << std::setw(10) << "p90(us)"
+     << std::setw(10) << "p99(us)"
+     << std::setw(10) << "max(us)" << '\n';
+
+  for (auto& [name, durations] : zones) {
+    std::sort(durations.begin(), durations.end());
+    int64_t total = 0;
+    for (const int64_t d : durations)
+      total += d;
+
+    os << std::left << std::setw(48) << name << std::right
+       << std::setw(10) << durations.size()
+       << std::setw(12) << std::fixed << std::setprecision(2) << (total / 1000.0)
+       << std::setw(10) << percentile(durations, 50)
+       << std::setw(10) << percentile(durations, 90)
+       << std::setw(10) << percentile(durations, 99)
+       << std::setw(10) << durations.back() << '\n';
+  }
+  os.flags(flags);
+}
+
+// static
+size_t Trace::events()
+{
+  size_t n = 0;
+  for (auto& buffer : all_buffers()) {
+    std::lock_guard lock(buffer->mutex);
+    n += buffer->events.size();
+  }
+  return n;
+}
+
+// static
+size_t Trace::discardedEvents()
+{
+  size_t n = 0;
+  for (auto& buffer : all_buffers()) {
+    std::lock_guard lock(buffer->mutex);
+    n += buffer->discarded;
+  }
+  return n;
+}
+
+} // namespace perf
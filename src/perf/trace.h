@@ -0,0 +1,101 @@
+// Aseprite Performance Tracing Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef PERF_TRACE_H_INCLUDED
+#define PERF_TRACE_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+
+namespace perf {
+
+  // Records the time spent in scoped zones of code from any thread,
+  // and writes them in the Chrome trace event format (JSON) that can
+  // be opened with chrome://tracing or https://ui.perfetto.dev
+  //
+  // When the recording is stopped a zone costs just one atomic load,
+  // when it's running each thread appends its events to its own
+  // buffer (there is no contention between threads).
+  class Trace {
+  public:
+    // Maximum number of events recorded per thread (new events are
+    // discarded when a thread reaches this limit).
+    static constexpr size_t kMaxEventsPerThread = 1 << 20;
+
+    static bool isRecording() {
+      return m_recording.load(std::memory_order_relaxed);
+    }
+
+    // Starts a new recording (discarding the previous events).
+    static void start();
+    static void stop();
+
+    // Microseconds since the recording was started.
+    static int64_t now();
+
+    // Adds a complete event. The name must be a string literal (or a
+    // string that lives until the program ends).
+    static void addZone(const char* name, int64_t begin, int64_t end);
+
+    // Adds a counter event with the current value of the given
+    // counter (e.g. the number of times a thread had to wait a
+    // lock), it's displayed as a graph in the trace viewer. Counter
+    // events are not included in the summary.
+    static void addCounter(const char* name, int64_t value);
+
+    // Names the current thread in the trace.
+    static void setThreadName(const std::string& name);
+
+    // Writes all recorded events up to this moment (the recording
+    // can be running).
+    static void writeJson(std::ostream& os);
+    static bool saveJson(const std::string& filename);
+
+    // Writes a table with the number of events, total time, and
+    // percentiles of the duration of each zone name (e.g. to compare
+    // the latency of each step of a replayed stroke between builds).
+    static void writeSummary(std::ostream& os);
+
+    // Number of recorded/discarded events (mainly for tests).
+    static size_t events();
+    static size_t discardedEvents();
+
+  private:
+    static std::atomic<bool> m_recording;
+  };
+
+  // Records the time from its construction to its destruction.
+  class Zone {
+  public:
+    explicit Zone(const char* name)
+      : m_name(Trace::isRecording() ? name: nullptr)
+      , m_begin(m_name ? Trace::now(): 0) {
+    }
+    ~Zone() {
+      if (m_name)
+        Trace::addZone(m_name, m_begin, Trace::now());
+    }
+    Zone(const Zone&) = delete;
+    Zone& operator=(const Zone&) = delete;
+
+  private:
+    const char* m_name;
+    int64_t m_begin;
+  };
+
+} // namespace perf
+
+#define PERF_ZONE_CONCAT2(a, b) a##b
+#define PERF_ZONE_CONCAT(a, b) PERF_ZONE_CONCAT2(a, b)
+
+// Records the rest of the current scope as a zone with the given name.
+#define PERF_ZONE(name) \
+  perf::Zone PERF_ZONE_CONCAT(perf_zone_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,128 @@
+// Aseprite Performance Tracing Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "perf/trace.h"
+
+#include <sstream>
+#include <thread>
+#include <vector>
+
+using namespace perf;
+
+TEST(Trace, NoEventsWhenStopped)
+{
+  Trace::start();
+  Trace::stop();
+  {
+    PERF_ZONE("stopped");
+  }
+  EXPECT_EQ(0u, Trace::events());
+}
+
+TEST(Trace, ZonesFromThreads)
+{
+  Trace::start();
+  {
+    PERF_ZONE("main");
+    std::vector<std::thread> threads;
+    for (int i=0; i<4; ++i) {
+      threads.emplace_back([]{
+        for (int j=0; j<10; ++j) {
+          PERF_ZONE("worker");
+        }
+      });
+    }
+    for (auto& t : threads)
+      t.join();
+  }
+  Trace::stop();
+  EXPECT_EQ(41u, Trace::events());
+
+  // Events of finished threads are kept
+  std::ostringstream os;
+  Trace::writeJson(os);
+  const std::string json = os.str();
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"main\""));
+  EXPECT_NE(std::string::npos, json.find("\"name\":\"worker\""));
+  EXPECT_EQ('}', json[json.size()-2]);
+
+  // A new recording discards old events
+  Trace::start();
+  Trace::stop();
+  EXPECT_EQ(0u, Trace::events());
+}
+
+TEST(Trace, ThreadName)
+{
+  Trace::start();
+  Trace::setThreadName("main \"thread\"");
+  Trace::stop();
+
+  std::ostringstream os;
+  Trace::writeJson(os);
+  EXPECT_NE(std::string::npos, os.str().find("\"name\":\"main \\\"thread\\\"\""));
+}
+
+TEST(Trace, Summary)
+{
+  Trace::start();
+  for (int i=1; i<=100; ++i)
+    Trace::addZone("step", 0, i);
+  Trace::addZone("other", 0, 5);
+  Trace::stop();
+
+  std::ostringstream os;
+  Trace::writeSummary(os);
+  const std::string summary = os.str();
+
+  // Zones are sorted by name
+  const size_t other = summary.find("other");
+  const size_t step = summary.find("step");
+  ASSERT_NE(std::string::npos, other);
+  ASSERT_NE(std::string::npos, step);
+  EXPECT_LT(other, step);
+
+  // count, total(ms), p50, p90, p99, and max of the "step" zone
+  std::istringstream is(summary.substr(step + 4));
+  int count;
+  double total;
+  int p50, p90, p99, max;
+  is >> count >> total >> p50 >> p90 >> p99 >> max;
+  EXPECT_EQ(100, count);
+  EXPECT_DOUBLE_EQ(5.05, total);
+  EXPECT_EQ(50, p50);
+  EXPECT_EQ(90, p90);
+  EXPECT_EQ(99, p99);
+  EXPECT_EQ(100, max);
+}
+
+TEST(Trace, Counters)
+{
+  Trace::start();
+  Trace::addCounter("waits", 1);
+  Trace::addCounter("waits", 2);
+  Trace::addZone("step", 0, 10);
+  Trace::stop();
+  EXPECT_EQ(3u, Trace::events());
+
+  std::ostringstream os;
+  Trace::writeJson(os);
+  const std::string json = os.str();
+  EXPECT_NE(std::string::npos, json.find("\"ph\":\"C\",\"name\":\"waits\""));
+  EXPECT_NE(std::string::npos, json.find("\"args\":{\"value\":2}"));
+
+  // Counters are not zones
+  std::ostringstream summary;
+  Trace::writeSummary(summary);
+  EXPECT_EQ(std::string::npos, summary.str().find("waits"));
+  EXPECT_NE(std::string::npos, summary.str().find("step"));
+}
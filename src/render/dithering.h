@@ -19,23 +19,32 @@ namespace render {
     Dithering(
       DitheringAlgorithm algorithm = DitheringAlgorithm::None,
       const DitheringMatrix& matrix = DitheringMatrix(),
-      double factor = 1.0)
+      double factor = 1.0,
+      bool parallel = false)
       : m_algorithm(algorithm)
       , m_matrix(matrix)
-      , m_factor(factor){ }
+      , m_factor(factor)
+      , m_parallel(parallel) { }
 
     DitheringAlgorithm algorithm() const { return m_algorithm; }
     DitheringMatrix matrix() const { return m_matrix; }
     double factor() const { return m_factor; }
 
+    // Error diffusion processes several rows at the same time (from
+    // left-to-right instead of zig-zag, the result is the same
+    // independently of the number of threads).
+    bool parallel() const { return m_parallel; }
+
     void algorithm(const DitheringAlgorithm algorithm) { m_algorithm = algorithm; }
     void matrix(const DitheringMatrix& matrix) { m_matrix = matrix; }
     void factor(const double factor) { m_factor = factor; }
+    void parallel(const bool parallel) { m_parallel = parallel; }
 
   private:
     DitheringAlgorithm m_algorithm;
     DitheringMatrix m_matrix;
     double m_factor;
+    bool m_parallel;
   };
 
 } // namespace render
@@ -11,15 +11,111 @@
 
 #include "render/error_diffusion.h"
 
+#include "base/thread_pool.h"
 #include "gfx/hsl.h"
 #include "gfx/rgb.h"
 
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace render {
 
-ErrorDiffusionDither::ErrorDiffusionDither(int transparentIndex)
+namespace {
+
+const int kChannels = 4;
+
+// Adds the quantization error "v" (accumulated from previous pixels)
+// to the "color" and returns the palette index to paint. "v" is
+// replaced with the quantization error of the pixel.
+template<typename MapColor>
+doc::color_t quantize_pixel(const doc::color_t color,
+                            int v[kChannels],
+                            MapColor mapColor,
+                            const doc::Palette* palette,
+                            const int transparentIndex,
+                            const int factor)
+{
+  // Get RGB values + quatization error
+  v[0] += doc::rgba_getr(color);
+  v[1] += doc::rgba_getg(color);
+  v[2] += doc::rgba_getb(color);
+  v[3] += doc::rgba_geta(color);
+  for (int i=0; i<kChannels; ++i)
+    v[i] = std::clamp(v[i], 0, 255);
+
+  const doc::color_t index = mapColor(v);
+
+  doc::color_t palColor = palette->getEntry(index);
+  if (transparentIndex == index || doc::rgba_geta(palColor) == 0) {
+    // "color" without alpha
+    palColor = (color & doc::rgba_rgb_mask);
+  }
+
+  v[0] = (v[0] - doc::rgba_getr(palColor)) * factor / 100;
+  v[1] = (v[1] - doc::rgba_getg(palColor)) * factor / 100;
+  v[2] = (v[2] - doc::rgba_getb(palColor)) * factor / 100;
+  v[3] = (v[3] - doc::rgba_geta(palColor)) * factor / 100;
+  return index;
+}
+
+} // anonymous namespace
+
+// State shared by all threads when rows are processed in parallel.
+// Each row can be dithered until the previous row is two pixels
+// behind, so all the error of the previous row was already received.
+struct ErrorDiffusionDither::Wavefront {
+  const doc::Image* srcImage;
+  doc::Image* dstImage;
+  const doc::RgbMap* rgbmap;
+  const doc::Palette* palette;
+  TaskDelegate* delegate;
+  int width, height;
+
+  // Error received by each pixel from the previous row (with one
+  // extra pixel at each side), only the last "nrows" rows are kept.
+  int nrows;
+  std::vector<int> err;
+
+  // Number of finished pixels in each row.
+  std::vector<std::atomic<int>> done;
+
+  // RgbMap::mapColor() fills its tables lazily, so it's not
+  // thread-safe.
+  std::mutex rgbmapMutex;
+
+  std::atomic<bool> stop;
+  std::mutex errorMutex;
+  std::exception_ptr error;
+
+  Wavefront(const int nrows, const doc::Image* srcImage)
+    : width(srcImage->width())
+    , height(srcImage->height())
+    , nrows(nrows)
+    , err(nrows * (width+2) * kChannels, 0)
+    , done(height)
+    , stop(false) { }
+
+  int* errRow(const int y) {
+    return &err[(y % nrows) * (width+2) * kChannels] + kChannels;
+  }
+
+  void setError(std::exception_ptr ex) {
+    std::lock_guard lock(errorMutex);
+    if (!error)
+      error = ex;
+    stop = true;
+  }
+};
+
+ErrorDiffusionDither::ErrorDiffusionDither(int transparentIndex,
+                                           bool parallel)
   : m_transparentIndex(transparentIndex)
+  , m_parallel(parallel)
 {
 }
 
@@ -59,43 +155,27 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
   doc::color_t color =
     doc::get_pixel_fast<doc::RgbTraits>(m_srcImage, x, y);
 
-  // Get RGB values + quatization error
-  int v[kChannels] = {
-    doc::rgba_getr(color),
-    doc::rgba_getg(color),
-    doc::rgba_getb(color),
-    doc::rgba_geta(color)
-  };
-  for (int i=0; i<kChannels; ++i) {
-    v[i] += m_err[i][x+1];
-    v[i] = std::clamp(v[i], 0, 255);
-  }
+  int q[kChannels];
+  for (int i=0; i<kChannels; ++i)
+    q[i] = m_err[i][x+1];
 
   const doc::color_t index =
-    (rgbmap ? rgbmap->mapColor(v[0], v[1], v[2], v[3]):
-              palette->findBestfit(v[0], v[1], v[2], v[3], m_transparentIndex));
-
-  doc::color_t palColor = palette->getEntry(index);
-  if (m_transparentIndex == index || doc::rgba_geta(palColor) == 0) {
-    // "color" without alpha
-    palColor = (color & doc::rgba_rgb_mask);
-  }
-
-  const int quantError[kChannels] = {
-    v[0] - doc::rgba_getr(palColor),
-    v[1] - doc::rgba_getg(palColor),
-    v[2] - doc::rgba_getb(palColor),
-    v[3] - doc::rgba_geta(palColor)
-  };
+    quantize_pixel(
+      color, q,
+      [this, rgbmap, palette](const int v[kChannels]) -> doc::color_t {
+        return (rgbmap ? rgbmap->mapColor(v[0], v[1], v[2], v[3]):
+                         palette->findBestfit(v[0], v[1], v[2], v[3],
+                                              m_transparentIndex));
+      },
+      palette, m_transparentIndex, m_factor);
 
   // TODO using Floyd-Steinberg matrix here but it should be configurable
   for (int i=0; i<kChannels; ++i) {
     int* err = &m_err[i][x];
-    const int q = quantError[i] * m_factor / 100;
-    const int a = q * 7 / 16;
-    const int b = q * 3 / 16;
-    const int c = q * 5 / 16;
-    const int d = q * 1 / 16;
+    const int a = q[i] * 7 / 16;
+    const int b = q[i] * 3 / 16;
+    const int c = q[i] * 5 / 16;
+    const int d = q[i] * 1 / 16;
 
     if (y & 1) {
       err[0        ] += a;
@@ -114,4 +194,163 @@ doc::color_t ErrorDiffusionDither::ditherRgbToIndex2D(
   return index;
 }
 
+bool ErrorDiffusionDither::ditherRgbImageToIndex2D(
+  const doc::Image* srcImage,
+  doc::Image* dstImage,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette,
+  TaskDelegate* delegate)
+{
+  if (!m_parallel)
+    return false;
+
+  // Row "y" is dithered by the thread "y % threads", so there are at
+  // most "threads" rows in progress.
+  const int threads =
+    std::clamp(int(std::thread::hardware_concurrency()), 1,
+               std::max(1, srcImage->height()));
+
+  Wavefront wf(threads+1, srcImage);
+  wf.srcImage = srcImage;
+  wf.dstImage = dstImage;
+  wf.rgbmap = rgbmap;
+  wf.palette = palette;
+  wf.delegate = delegate;
+
+  auto ditherRowsCatchingErrors =
+    [this, &wf, threads](const int firstRow) {
+      try {
+        ditherRows(wf, firstRow, threads);
+      }
+      catch (...) {
+        wf.setError(std::current_exception());
+      }
+    };
+
+  if (threads > 1) {
+    base::thread_pool pool(threads-1);
+    std::mutex mutex;
+    std::condition_variable cv;
+    int pending = threads-1;
+
+    for (int t=1; t<threads; ++t) {
+      pool.execute(
+        [t, &ditherRowsCatchingErrors, &mutex, &cv, &pending]{
+          ditherRowsCatchingErrors(t);
+
+          std::lock_guard lock(mutex);
+          if (--pending == 0)
+            cv.notify_one();
+        });
+    }
+
+    // The first group of rows is processed in this thread (it's the
+    // only one that uses the TaskDelegate)
+    ditherRowsCatchingErrors(0);
+
+    std::unique_lock lock(mutex);
+    cv.wait(lock, [&pending]{ return pending == 0; });
+  }
+  else {
+    ditherRowsCatchingErrors(0);
+  }
+
+  if (wf.error)
+    std::rethrow_exception(wf.error);
+  return true;
+}
+
+void ErrorDiffusionDither::ditherRows(Wavefront& wf,
+                                      const int firstRow,
+                                      const int rowStep)
+{
+  const int w = wf.width;
+  const int h = wf.height;
+  TaskDelegate* delegate = (firstRow == 0 ? wf.delegate: nullptr);
+
+  // Small cache of the RgbMap results of this thread to avoid
+  // locking the mutex for each pixel.
+  const int kCacheBits = 12;
+  struct CacheEntry {
+    doc::color_t color = 0;
+    int index = -1;
+  };
+  std::vector<CacheEntry> cache(wf.rgbmap ? 1 << kCacheBits: 0);
+
+  auto mapColor =
+    [this, &wf, &cache](const int v[kChannels]) -> doc::color_t {
+      if (!wf.rgbmap)
+        return wf.palette->findBestfit(v[0], v[1], v[2], v[3],
+                                       m_transparentIndex);
+
+      const doc::color_t c = doc::rgba(v[0], v[1], v[2], v[3]);
+      CacheEntry& entry = cache[(c * 0x9e3779b1u) >> (32 - kCacheBits)];
+      if (entry.index < 0 || entry.color != c) {
+        std::lock_guard lock(wf.rgbmapMutex);
+        entry.color = c;
+        entry.index = wf.rgbmap->mapColor(c);
+      }
+      return entry.index;
+    };
+
+  for (int y=firstRow; y<h && !wf.stop; y+=rowStep) {
+    int* cur = wf.errRow(y);
+    int* next = wf.errRow(y+1);
+
+    // The row y+1-nrows (the previous one that used "next") was
+    // dithered by this same thread.
+    std::fill(next - kChannels, next + (w+1)*kChannels, 0);
+
+    const std::atomic<int>* prevDone = (y > 0 ? &wf.done[y-1]: nullptr);
+    int available = (y > 0 ? 0: w);
+    std::atomic<int>& done = wf.done[y];
+
+    const doc::color_t* src =
+      doc::get_pixel_address_fast<doc::RgbTraits>(wf.srcImage, 0, y);
+    uint8_t* dst =
+      doc::get_pixel_address_fast<doc::IndexedTraits>(wf.dstImage, 0, y);
+
+    int carry[kChannels] = { 0, 0, 0, 0 };
+    for (int x=0; x<w; ++x) {
+      // Wait the previous row
+      const int needed = std::min(w, x+2);
+      while (available < needed) {
+        available = prevDone->load(std::memory_order_acquire);
+        if (available < needed) {
+          if (wf.stop)
+            return;
+          std::this_thread::yield();
+        }
+      }
+
+      int q[kChannels];
+      for (int i=0; i<kChannels; ++i)
+        q[i] = carry[i] + cur[x*kChannels+i];
+
+      dst[x] = quantize_pixel(src[x], q, mapColor, wf.palette,
+                              m_transparentIndex, m_factor);
+
+      // Same Floyd-Steinberg matrix as ditherRgbToIndex2D() for
+      // left-to-right rows
+      int* err = next + x*kChannels;
+      for (int i=0; i<kChannels; ++i) {
+        carry[i] = q[i] * 7 / 16;
+        err[i-kChannels] += q[i] * 3 / 16;
+        err[i          ] += q[i] * 5 / 16;
+        err[i+kChannels] += q[i] * 1 / 16;
+      }
+
+      done.store(x+1, std::memory_order_release);
+    }
+
+    if (delegate) {
+      if (!delegate->continueTask()) {
+        wf.stop = true;
+        return;
+      }
+      delegate->notifyTaskProgress(double(y+1) / double(h));
+    }
+  }
+}
+
 } // namespace render
@@ -18,9 +18,10 @@ namespace render {
 
   class ErrorDiffusionDither : public DitheringAlgorithmBase {
   public:
-    ErrorDiffusionDither(int transparentIndex = -1);
+    ErrorDiffusionDither(int transparentIndex = -1,
+                         bool parallel = false);
     int dimensions() const override { return 2; }
-    bool zigZag() const override { return true; }
+    bool zigZag() const override { return !m_parallel; }
     void start(
       const doc::Image* srcImage,
       doc::Image* dstImage,
@@ -30,8 +31,18 @@ namespace render {
       const int x, const int y,
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) override;
+    bool ditherRgbImageToIndex2D(
+      const doc::Image* srcImage,
+      doc::Image* dstImage,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette,
+      TaskDelegate* delegate) override;
   private:
+    struct Wavefront;
+    void ditherRows(Wavefront& wf, const int firstRow, const int rowStep);
+
     int m_transparentIndex;
+    bool m_parallel;
     const doc::Image* m_srcImage;
     int m_width, m_lastY;
     static const int kChannels = 4;
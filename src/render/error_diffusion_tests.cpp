@@ -0,0 +1,113 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "doc/image_impl.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "render/dithering.h"
+#include "render/error_diffusion.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+using namespace doc;
+using namespace render;
+
+// Floyd-Steinberg from left-to-right in all rows
+static void reference_dither(const Image* src, Image* dst,
+                             const RgbMap* rgbmap,
+                             const Palette* palette)
+{
+  const int w = src->width();
+  const int h = src->height();
+  std::vector<int> err((w+2)*(h+1)*4, 0);
+  auto e = [&err, w](int x, int y, int i) -> int& {
+    return err[((y*(w+2)) + x+1)*4 + i];
+  };
+
+  for (int y=0; y<h; ++y) {
+    for (int x=0; x<w; ++x) {
+      const color_t c = get_pixel(src, x, y);
+      int v[4] = { int(rgba_getr(c)), int(rgba_getg(c)),
+                   int(rgba_getb(c)), int(rgba_geta(c)) };
+      for (int i=0; i<4; ++i)
+        v[i] = std::clamp(v[i] + e(x, y, i), 0, 255);
+
+      const int index =
+        (rgbmap ? rgbmap->mapColor(v[0], v[1], v[2], v[3]):
+                  palette->findBestfit(v[0], v[1], v[2], v[3], -1));
+      put_pixel(dst, x, y, index);
+
+      color_t p = palette->getEntry(index);
+      if (rgba_geta(p) == 0)
+        p = (c & rgba_rgb_mask);
+      const int q[4] = { v[0] - int(rgba_getr(p)), v[1] - int(rgba_getg(p)),
+                         v[2] - int(rgba_getb(p)), v[3] - int(rgba_geta(p)) };
+      for (int i=0; i<4; ++i) {
+        e(x+1, y,   i) += q[i] * 7 / 16;
+        e(x-1, y+1, i) += q[i] * 3 / 16;
+        e(x,   y+1, i) += q[i] * 5 / 16;
+        e(x+1, y+1, i) += q[i] * 1 / 16;
+      }
+    }
+  }
+}
+
+TEST(ErrorDiffusion, ParallelRowsAreDeterministic)
+{
+  Palette::initBestfit();
+
+  Palette pal(frame_t(0), 16);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() % 256, std::rand() % 256,
+                         std::rand() % 256, 255));
+
+  for (const gfx::Size size : { gfx::Size(1, 1), gfx::Size(1, 40),
+                                gfx::Size(2, 3), gfx::Size(97, 61) }) {
+    std::unique_ptr<Image> src(Image::create(IMAGE_RGB, size.w, size.h));
+    for (int y=0; y<size.h; ++y)
+      for (int x=0; x<size.w; ++x)
+        put_pixel(src.get(), x, y, rgba(x*255/size.w, y*255/size.h,
+                                        std::rand() % 256, 255));
+
+    std::unique_ptr<Image> expected(Image::create(IMAGE_INDEXED, size.w, size.h));
+    std::unique_ptr<Image> dst(Image::create(IMAGE_INDEXED, size.w, size.h));
+
+    OctreeMap octree;
+    octree.regenerateMap(&pal, -1);
+
+    for (const RgbMap* rgbmap : { (const RgbMap*)nullptr,
+                                  (const RgbMap*)&octree }) {
+      reference_dither(src.get(), expected.get(), rgbmap, &pal);
+
+      // Repeat the conversion as the threads can run in any order
+      for (int t=0; t<4; ++t) {
+        clear_image(dst.get(), 255);
+        ErrorDiffusionDither dither(-1, true);
+        dither_rgb_image_to_indexed(
+          dither, Dithering(DitheringAlgorithm::ErrorDiffusion,
+                            DitheringMatrix(), 1.0, true),
+          src.get(), dst.get(), rgbmap, &pal);
+        ASSERT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+      }
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
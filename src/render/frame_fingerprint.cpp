@@ -0,0 +1,87 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "render/frame_fingerprint.h"
+
+#include "doc/cel.h"
+#include "doc/image.h"
+#include "doc/layer.h"
+#include "doc/layer_tilemap.h"
+#include "doc/palette.h"
+#include "doc/sprite.h"
+#include "doc/tileset.h"
+
+namespace render {
+
+using namespace doc;
+
+namespace {
+
+class Fingerprint {
+public:
+  template<typename T>
+  void add(const T value) {
+    m_hash ^= uint64_t(value) + 0x9e3779b97f4a7c15ull + (m_hash << 6) + (m_hash >> 2);
+  }
+  uint64_t value() const { return m_hash; }
+private:
+  uint64_t m_hash = 0;
+};
+
+} // anonymous namespace
+
+uint64_t frame_fingerprint(const Sprite* sprite,
+                           const frame_t frame,
+                           const bool newBlend)
+{
+  Fingerprint h;
+  h.add(newBlend);
+  h.add(sprite->width());
+  h.add(sprite->height());
+  h.add(int(sprite->pixelFormat()));
+  h.add(sprite->transparentColor());
+
+  const Palette* palette = sprite->palette(frame);
+  h.add(palette->size());
+  for (int i=0; i<palette->size(); ++i)
+    h.add(palette->getEntry(i));
+
+  for (const Layer* layer : sprite->allLayers()) {
+    h.add(layer->id());
+    h.add(int(layer->flags()));
+    if (!layer->isImage())
+      continue;
+
+    auto imageLayer = static_cast<const LayerImage*>(layer);
+    h.add(imageLayer->opacity());
+    h.add(int(imageLayer->blendMode()));
+
+    if (layer->isTilemap()) {
+      const Tileset* tileset = static_cast<const LayerTilemap*>(layer)->tileset();
+      h.add(tileset->id());
+      h.add(tileset->version());
+      h.add(tileset->size());
+    }
+
+    if (const Cel* cel = layer->cel(frame)) {
+      h.add(cel->image()->id());
+      h.add(cel->image()->version());
+      h.add(cel->bounds().x);
+      h.add(cel->bounds().y);
+      h.add(cel->bounds().w);
+      h.add(cel->bounds().h);
+      h.add(cel->opacity());
+      h.add(cel->zIndex());
+    }
+  }
+  return h.value();
+}
+
+} // namespace render
@@ -0,0 +1,32 @@
+// Aseprite Render Library
+// Copyright (c) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef RENDER_FRAME_FINGERPRINT_H_INCLUDED
+#define RENDER_FRAME_FINGERPRINT_H_INCLUDED
+#pragma once
+
+#include "doc/frame.h"
+
+#include <cstdint>
+
+namespace doc {
+  class Sprite;
+}
+
+namespace render {
+
+  // Hashes everything that is used to render the given frame (image
+  // ids and versions, cel bounds/opacity, layer flags/blend modes,
+  // tilesets, palette, etc.), so a rendered frame can be reused if
+  // it wasn't modified (or if other frame looks exactly the same,
+  // e.g. linked cels).
+  uint64_t frame_fingerprint(const doc::Sprite* sprite,
+                             const doc::frame_t frame,
+                             const bool newBlend);
+
+} // namespace render
+
+#endif
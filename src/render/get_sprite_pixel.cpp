@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -9,14 +9,158 @@
 #include "config.h"
 #endif
 
+#include "doc/blend_funcs.h"
+#include "doc/blend_internals.h"
 #include "doc/doc.h"
+#include "doc/render_plan.h"
 #include "gfx/clip.h"
 #include "render/render.h"
 
+#include <cmath>
+
 namespace render {
 
 using namespace doc;
 
+namespace {
+
+// Gets the pixel of the cel image (or of the tile in a tilemap) in
+// the given sprite position. Returns false if the cel doesn't cover
+// the position.
+bool get_cel_image_pixel(const Cel* cel,
+                         const gfx::Point& pos,
+                         PixelFormat& pixelFormat,
+                         color_t& maskColor,
+                         color_t& color)
+{
+  const Image* image = cel->image();
+
+  if (image->pixelFormat() == IMAGE_TILEMAP) {
+    const Tileset* tileset =
+      static_cast<const LayerTilemap*>(cel->layer())->tileset();
+    if (!tileset)
+      return false;
+
+    Grid grid = tileset->grid();
+    grid.origin(grid.origin() + cel->position());
+
+    const gfx::Point tilePos = grid.canvasToTile(pos);
+    if (!image->bounds().contains(tilePos))
+      return false;
+
+    const tile_t t = get_pixel(image, tilePos.x, tilePos.y);
+    if (t == notile)
+      return false;
+
+    const ImageRef tile = tileset->get(tile_geti(t));
+    if (!tile)
+      return false;
+
+    const gfx::Point ipos = pos - grid.tileToCanvas(tilePos);
+    if (!tile->bounds().contains(ipos))
+      return false;
+
+    pixelFormat = tile->pixelFormat();
+    maskColor = tile->maskColor();
+    color = get_pixel(tile.get(), ipos.x, ipos.y);
+    return true;
+  }
+
+  const gfx::Point ipos = pos - cel->position();
+  if (!image->bounds().contains(ipos))
+    return false;
+
+  pixelFormat = image->pixelFormat();
+  maskColor = image->maskColor();
+  color = get_pixel(image, ipos.x, ipos.y);
+  return true;
+}
+
+// Blends the visible cels that cover the given sprite pixel in the
+// same order and with the same blenders used by Render::renderPlan()
+// (background layer first and then the transparent layers). Returns
+// false if the pixel cannot be calculated in this way (e.g. there
+// are reference layers, which can be scaled), so a regular render
+// is needed.
+bool get_plan_pixel(const Sprite* sprite,
+                    const gfx::Point& pos,
+                    const frame_t frame,
+                    const bool newBlend,
+                    color_t& output)
+{
+  const PixelFormat pixelFormat = sprite->pixelFormat();
+  const Palette* pal = sprite->palette(frame);
+
+  RenderPlan plan;
+  plan.addLayer(sprite->root(), frame);
+
+  for (const auto& item : plan.items())
+    if (item.layer->isReference())
+      return false;
+
+  // Same as Render::getBgColor() for an image with the sprite pixel
+  // format
+  color_t color = 0;
+  if (pixelFormat == IMAGE_INDEXED)
+    color = sprite->transparentColor();
+
+  for (int pass=0; pass<2; ++pass) {
+    const bool background = (pass == 0);
+
+    for (const auto& item : plan.items()) {
+      const Layer* layer = item.layer;
+      if (layer->isBackground() != background ||
+          !layer->isImage())
+        continue;
+
+      const Cel* cel = (item.cel ? item.cel: layer->cel(frame));
+      if (!cel)
+        continue;
+
+      PixelFormat srcFormat;
+      color_t maskColor;
+      color_t src;
+      if (!get_cel_image_pixel(cel, pos, srcFormat, maskColor, src))
+        continue;
+      if (srcFormat != pixelFormat)
+        return false;
+
+      const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
+      const BlendMode blendMode = imgLayer->blendMode();
+      int t;
+      const int opacity = MUL_UN8(cel->opacity(), imgLayer->opacity(), t);
+
+      switch (pixelFormat) {
+        case IMAGE_RGB:
+          if (src != maskColor)
+            color = get_rgba_blender(blendMode, newBlend)(color, src, opacity);
+          break;
+        case IMAGE_GRAYSCALE:
+          if (src != maskColor)
+            color = get_graya_blender(blendMode, newBlend)(color, src, opacity);
+          break;
+        case IMAGE_INDEXED:
+          if (blendMode == BlendMode::SRC)
+            color = src;
+          else if (blendMode == BlendMode::DST_OVER) {
+            if (color == maskColor)
+              color = src;
+          }
+          else if (src != maskColor && int(src) < pal->size())
+            color = src;
+          break;
+        default:
+          return false;
+      }
+    }
+  }
+
+  output = color;
+  return true;
+}
+
+} // anonymous namespace
+
 color_t get_sprite_pixel(const Sprite* sprite,
                          const double x,
                          const double y,
@@ -28,6 +172,18 @@ color_t get_sprite_pixel(const Sprite* sprite,
 
   if ((x >= 0.0) && (x < sprite->width()) &&
       (y >= 0.0) && (y < sprite->height())) {
+    // With integer zoom levels the rendered pixel is exactly the
+    // sprite pixel, so we can blend the cels in that point without
+    // rendering a 1x1 image through the whole Render pipeline.
+    const double sx = proj.scaleX();
+    const double sy = proj.scaleY();
+    if (sx >= 1.0 && sy >= 1.0 &&
+        sx == std::floor(sx) && sy == std::floor(sy) &&
+        get_plan_pixel(sprite, gfx::Point(int(x), int(y)),
+                       frame, newBlend, color)) {
+      return color;
+    }
+
     std::unique_ptr<Image> image(Image::create(sprite->pixelFormat(), 1, 1));
 
     render::Render render;
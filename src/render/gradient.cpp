@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2020 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,12 @@
 #include "doc/image.h"
 #include "doc/image_impl.h"
 #include "render/dithering_matrix.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
 
 namespace render {
 
@@ -38,6 +44,109 @@ void render_rgba_gradient(
   }
 }
 
+namespace {
+
+// Images with more pixels are rendered in parallel bands of rows
+const int kMinPixelsPerTask = 64*1024;
+
+// Colors of the two stops of a gradient
+class GradientStops {
+public:
+  GradientStops(doc::color_t c0, doc::color_t c1) {
+    // As we use non-premultiplied RGB values, we need correct RGB
+    // values on each stop. So in case that one color has alpha=0
+    // (complete transparent), use the RGB values of the
+    // non-transparent color in the other stop point.
+    if (doc::rgba_geta(c0) == 0 &&
+        doc::rgba_geta(c1) != 0) {
+      c0 = (c1 & doc::rgba_rgb_mask);
+    }
+    else if (doc::rgba_geta(c0) != 0 &&
+             doc::rgba_geta(c1) == 0) {
+      c1 = (c0 & doc::rgba_rgb_mask);
+    }
+
+    m_c0 = c0;
+    m_c1 = c1;
+
+    m_r0 = double(doc::rgba_getr(c0)) / 255.0;
+    m_g0 = double(doc::rgba_getg(c0)) / 255.0;
+    m_b0 = double(doc::rgba_getb(c0)) / 255.0;
+    m_a0 = double(doc::rgba_geta(c0)) / 255.0;
+
+    m_r1 = double(doc::rgba_getr(c1)) / 255.0;
+    m_g1 = double(doc::rgba_getg(c1)) / 255.0;
+    m_b1 = double(doc::rgba_getb(c1)) / 255.0;
+    m_a1 = double(doc::rgba_geta(c1)) / 255.0;
+  }
+
+  doc::color_t c0() const { return m_c0; }
+  doc::color_t c1() const { return m_c1; }
+
+  // Fills a row of pixels with the gradient colors in the given
+  // positions (f=0 is c0 and f=1 is c1).
+  void fillRow(doc::color_t* dst, const double* f, const int width,
+               const render::DitheringMatrix& matrix, const int y) const {
+    if (matrix.rows() == 1 && matrix.cols() == 1) {
+      for (int x=0; x<width; ++x) {
+        if (f[x] < 0.0) dst[x] = m_c0;
+        else if (f[x] > 1.0) dst[x] = m_c1;
+        else {
+          dst[x] = doc::rgba(int(255.0 * (m_r0 + f[x]*(m_r1-m_r0))),
+                             int(255.0 * (m_g0 + f[x]*(m_g1-m_g0))),
+                             int(255.0 * (m_b0 + f[x]*(m_b1-m_b0))),
+                             int(255.0 * (m_a0 + f[x]*(m_a1-m_a0))));
+        }
+      }
+    }
+    else {
+      const double k = matrix.maxValue()+2;
+      for (int x=0; x<width; ++x)
+        dst[x] = (f[x]*k < matrix(y, x)+1 ? m_c0: m_c1);
+    }
+  }
+
+private:
+  doc::color_t m_c0, m_c1;
+  double m_r0, m_g0, m_b0, m_a0;
+  double m_r1, m_g1, m_b1, m_a1;
+};
+
+// Calls rowFunc(y, f, dst) for each row of the image, where "f" is a
+// buffer to calculate the gradient position of each pixel in the row
+// and "dst" the row address. Big images are split in bands of rows
+// rendered in parallel.
+template<typename RowFunc>
+void for_each_gradient_row(doc::Image* img, RowFunc rowFunc)
+{
+  const int width = img->width();
+  const int height = img->height();
+  if (width <= 0 || height <= 0)
+    return;
+
+  auto renderRows = [img, width, &rowFunc](const int y1, const int y2) {
+    std::vector<double> f(width);
+    for (int y=y1; y<y2; ++y)
+      rowFunc(y, f.data(), (doc::color_t*)img->getPixelAddress(0, y));
+  };
+
+  const int threads = sched::Scheduler::instance().threads();
+  if (threads <= 1 || int64_t(width)*height < 2*kMinPixelsPerTask) {
+    renderRows(0, height);
+    return;
+  }
+
+  const int rows = std::max(1, kMinPixelsPerTask / width);
+  sched::TaskGroup tasks(sched::Priority::UI);
+  for (int y=0; y<height; y+=rows) {
+    const int y2 = std::min(height, y+rows);
+    tasks.run([&renderRows, y, y2]{ renderRows(y, y2); });
+  }
+  tasks.wait();
+}
+
+} // anonymous namespace
+
 void render_rgba_linear_gradient(
   doc::Image* img,
   const gfx::Point imgPos,
@@ -66,68 +175,25 @@ void render_rgba_linear_gradient(
   const double wmag = w.magnitude();
   w = w.normalize();
 
-  // As we use non-premultiplied RGB values, we need correct RGB
-  // values on each stop. So in case that one color has alpha=0
-  // (complete transparent), use the RGB values of the
-  // non-transparent color in the other stop point.
-  if (doc::rgba_geta(c0) == 0 &&
-      doc::rgba_geta(c1) != 0) {
-    c0 = (c1 & doc::rgba_rgb_mask);
-  }
-  else if (doc::rgba_geta(c0) != 0 &&
-           doc::rgba_geta(c1) == 0) {
-    c1 = (c0 & doc::rgba_rgb_mask);
-  }
-
-  const double r0 = double(doc::rgba_getr(c0)) / 255.0;
-  const double g0 = double(doc::rgba_getg(c0)) / 255.0;
-  const double b0 = double(doc::rgba_getb(c0)) / 255.0;
-  const double a0 = double(doc::rgba_geta(c0)) / 255.0;
-
-  const double r1 = double(doc::rgba_getr(c1)) / 255.0;
-  const double g1 = double(doc::rgba_getg(c1)) / 255.0;
-  const double b1 = double(doc::rgba_getb(c1)) / 255.0;
-  const double a1 = double(doc::rgba_geta(c1)) / 255.0;
-
-  doc::LockImageBits<doc::RgbTraits> bits(img);
-  auto it = bits.begin();
+  const GradientStops stops(c0, c1);
   const int width = img->width();
-  const int height = img->height();
 
-  if (matrix.rows() == 1 && matrix.cols() == 1) {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= u;
-        double f = (q * w) / wmag;
-
-        doc::color_t c;
-        if (f < 0.0) c = c0;
-        else if (f > 1.0) c = c1;
-        else {
-          c = doc::rgba(int(255.0 * (r0 + f*(r1-r0))),
-                        int(255.0 * (g0 + f*(g1-g0))),
-                        int(255.0 * (b0 + f*(b1-b0))),
-                        int(255.0 * (a0 + f*(a1-a0))));
-        }
-
-        *it = c;
-      }
-    }
-  }
-  else {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= u;
-        double f = (q * w) / wmag;
-
-        *it = (f*(matrix.maxValue()+2) < matrix(y, x)+1 ? c0: c1);
-      }
-    }
-  }
+  // The position in the gradient is a linear function of x in each
+  // row, so we step it by a constant for each pixel (in a loop that
+  // the compiler can vectorize).
+  const double dfdx = w.x / wmag;
+
+  for_each_gradient_row(
+    img,
+    [&](const int y, double* f, doc::color_t* dst) {
+      base::Vector2d<double> q(imgPos.x, imgPos.y+y);
+      q -= u;
+      const double f0 = (q * w) / wmag;
+      for (int x=0; x<width; ++x)
+        f[x] = f0 + x*dfdx;
+
+      stops.fillRow(dst, f, width, matrix, y);
+    });
 }
 
 void render_rgba_radial_gradient(
@@ -157,72 +223,28 @@ void render_rgba_radial_gradient(
     return;
   }
 
-  // As we use non-premultiplied RGB values, we need correct RGB
-  // values on each stop. So in case that one color has alpha=0
-  // (complete transparent), use the RGB values of the
-  // non-transparent color in the other stop point.
-  if (doc::rgba_geta(c0) == 0 &&
-      doc::rgba_geta(c1) != 0) {
-    c0 = (c1 & doc::rgba_rgb_mask);
-  }
-  else if (doc::rgba_geta(c0) != 0 &&
-           doc::rgba_geta(c1) == 0) {
-    c1 = (c0 & doc::rgba_rgb_mask);
-  }
-
-  const double r0 = double(doc::rgba_getr(c0)) / 255.0;
-  const double g0 = double(doc::rgba_getg(c0)) / 255.0;
-  const double b0 = double(doc::rgba_getb(c0)) / 255.0;
-  const double a0 = double(doc::rgba_geta(c0)) / 255.0;
-
-  const double r1 = double(doc::rgba_getr(c1)) / 255.0;
-  const double g1 = double(doc::rgba_getg(c1)) / 255.0;
-  const double b1 = double(doc::rgba_getb(c1)) / 255.0;
-  const double a1 = double(doc::rgba_geta(c1)) / 255.0;
-
-  doc::LockImageBits<doc::RgbTraits> bits(img);
-  auto it = bits.begin();
+  const GradientStops stops(c0, c1);
   const int width = img->width();
-  const int height = img->height();
-
-  if (matrix.rows() == 1 && matrix.cols() == 1) {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= (u+v)/2;
-        q.x /= std::fabs(w.x);
-        q.y /= std::fabs(w.y);
-        double f = std::sqrt(q.x*q.x + q.y*q.y);
-
-        doc::color_t c;
-        if (f < 0.0) c = c0;
-        else if (f > 1.0) c = c1;
-        else {
-          c = doc::rgba(int(255.0 * (r0 + f*(r1-r0))),
-                        int(255.0 * (g0 + f*(g1-g0))),
-                        int(255.0 * (b0 + f*(b1-b0))),
-                        int(255.0 * (a0 + f*(a1-a0))));
-        }
-
-        *it = c;
-      }
-    }
-  }
-  else {
-    for (int y=0; y<height; ++y) {
-      for (int x=0; x<width; ++x, ++it) {
-        base::Vector2d<double> q(imgPos.x+x,
-                                 imgPos.y+y);
-        q -= (u+v)/2;
-        q.x /= std::fabs(w.x);
-        q.y /= std::fabs(w.y);
-        double f = std::sqrt(q.x*q.x + q.y*q.y);
-
-        *it = (f*(matrix.maxValue()+2) < matrix(y, x)+1 ? c0: c1);
+  const base::Vector2d<double> center = (u+v)/2;
+  const double sx = 1.0 / std::fabs(w.x);
+  const double sy = 1.0 / std::fabs(w.y);
+
+  // The vertical component of the distance to the center is
+  // constant in each row and the horizontal one is stepped by a
+  // constant for each pixel.
+  for_each_gradient_row(
+    img,
+    [&](const int y, double* f, doc::color_t* dst) {
+      const double qy = (imgPos.y+y - center.y) * sy;
+      const double qy2 = qy*qy;
+      const double qx0 = (imgPos.x - center.x) * sx;
+      for (int x=0; x<width; ++x) {
+        const double qx = qx0 + x*sx;
+        f[x] = std::sqrt(qx*qx + qy2);
       }
-    }
-  }
+
+      stops.fillRow(dst, f, width, matrix, y);
+    });
 }
 
 template<typename ImageTraits>
@@ -1,4 +1,5 @@
 // Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -10,21 +11,133 @@
 
 #include "doc/color.h"
 
+#include <algorithm>
 #include <list>
 #include <queue>
+#include <vector>
 
 namespace render {
 
+  // Summed-volume table (a 4D integral histogram) to count the points
+  // of the histogram inside a box in constant time (instead of
+  // visiting all the entries of the box). The table covers only the
+  // bounds of the non-empty entries of the histogram (e.g. just one
+  // alpha plane for opaque images).
+  template<class Histogram>
+  class HistogramSums {
+  public:
+    explicit HistogramSums(const Histogram& histogram) {
+      m_min[0] = Histogram::RElements; m_max[0] = -1;
+      m_min[1] = Histogram::GElements; m_max[1] = -1;
+      m_min[2] = Histogram::BElements; m_max[2] = -1;
+      m_min[3] = Histogram::AElements; m_max[3] = -1;
+
+      for (int l=0; l<Histogram::AElements; ++l)
+        for (int k=0; k<Histogram::BElements; ++k)
+          for (int j=0; j<Histogram::GElements; ++j)
+            for (int i=0; i<Histogram::RElements; ++i) {
+              if (histogram.at(i, j, k, l) > 0) {
+                const int v[4] = { i, j, k, l };
+                for (int n=0; n<4; ++n) {
+                  m_min[n] = std::min(m_min[n], v[n]);
+                  m_max[n] = std::max(m_max[n], v[n]);
+                }
+              }
+            }
+
+      // Empty histogram (count() will always return 0)
+      if (m_max[0] < 0) {
+        m_size[0] = m_size[1] = m_size[2] = m_size[3] = 1;
+        m_sums.resize(1, 0);
+        return;
+      }
+
+      for (int n=0; n<4; ++n)
+        m_size[n] = m_max[n] - m_min[n] + 2;
+      m_sums.resize(std::size_t(m_size[0])*m_size[1]*m_size[2]*m_size[3], 0);
+
+      // m_sums[index(i, j, k, l)] is the number of points in the box
+      // [min,min+i) x [min,min+j) x [min,min+k) x [min,min+l)
+      for (int l=1; l<m_size[3]; ++l)
+        for (int k=1; k<m_size[2]; ++k)
+          for (int j=1; j<m_size[1]; ++j)
+            for (int i=1; i<m_size[0]; ++i)
+              m_sums[index(i, j, k, l)] =
+                histogram.at(m_min[0]+i-1, m_min[1]+j-1,
+                             m_min[2]+k-1, m_min[3]+l-1);
+
+      // Accumulate along each axis
+      std::size_t stride = 1;
+      for (int n=0; n<4; ++n) {
+        accumulate(stride, m_size[n]);
+        stride *= m_size[n];
+      }
+    }
+
+    // Returns the number of points in the given box (both corners
+    // are included). Unsigned arithmetic wraps around, so the result
+    // is the same as adding all the entries of the box.
+    std::size_t count(int r1, int g1, int b1, int a1,
+                      int r2, int g2, int b2, int a2) const {
+      if (!clip(0, r1, r2) || !clip(1, g1, g2) ||
+          !clip(2, b1, b2) || !clip(3, a1, a2))
+        return 0;
+
+      return
+        + m_sums[index(r2, g2, b2, a2)] - m_sums[index(r1, g2, b2, a2)]
+        - m_sums[index(r2, g1, b2, a2)] + m_sums[index(r1, g1, b2, a2)]
+        - m_sums[index(r2, g2, b1, a2)] + m_sums[index(r1, g2, b1, a2)]
+        + m_sums[index(r2, g1, b1, a2)] - m_sums[index(r1, g1, b1, a2)]
+        - m_sums[index(r2, g2, b2, a1)] + m_sums[index(r1, g2, b2, a1)]
+        + m_sums[index(r2, g1, b2, a1)] - m_sums[index(r1, g1, b2, a1)]
+        + m_sums[index(r2, g2, b1, a1)] - m_sums[index(r1, g2, b1, a1)]
+        - m_sums[index(r2, g1, b1, a1)] + m_sums[index(r1, g1, b1, a1)];
+    }
+
+  private:
+    // Converts the [i1,i2] range of the given axis to the [i1,i2)
+    // range of the table. Returns false if there are no points in
+    // that range.
+    bool clip(const int axis, int& i1, int& i2) const {
+      i1 = std::max(i1, m_min[axis]) - m_min[axis];
+      i2 = std::min(i2, m_max[axis]) - m_min[axis] + 1;
+      return (i1 < i2);
+    }
+
+    // The red component is the fastest changing one (as in the
+    // histogram) to fill the table sequentially.
+    std::size_t index(int i, int j, int k, int l) const {
+      return ((std::size_t(l)*m_size[2] + k)*m_size[1] + j)*m_size[0] + i;
+    }
+
+    // Adds to each entry the previous entry in the axis with the
+    // given stride and size (the entries with index 0 in that axis
+    // are zero).
+    void accumulate(const std::size_t stride, const std::size_t size) {
+      const std::size_t block = stride*size;
+      for (std::size_t b=0; b<m_sums.size(); b+=block) {
+        for (std::size_t i=b+stride; i<b+block; ++i)
+          m_sums[i] += m_sums[i-stride];
+      }
+    }
+
+    int m_min[4], m_max[4];     // Bounds of the non-empty entries
+    int m_size[4];              // Size of each axis of the table
+    std::vector<std::size_t> m_sums;
+  };
+
   template<class Histogram>
   class Box {
+    using Sums = HistogramSums<Histogram>;
 
     // These classes are used as parameters for some Box's generic
     // member functions, so we can access to a different axis using
     // the same generic function (i=Red channel in RAxisGetter, etc.).
-    struct RAxisGetter { static std::size_t at(const Histogram& h, int i, int j, int k, int l) { return h.at(i, j, k, l); } };
-    struct GAxisGetter { static std::size_t at(const Histogram& h, int i, int j, int k, int l) { return h.at(j, i, k, l); } };
-    struct BAxisGetter { static std::size_t at(const Histogram& h, int i, int j, int k, int l) { return h.at(j, k, i, l); } };
-    struct AAxisGetter { static std::size_t at(const Histogram& h, int i, int j, int k, int l) { return h.at(j, k, l, i); } };
+    // Each one counts the points in the "i" plane of the box.
+    struct RAxisGetter { static std::size_t plane(const Sums& s, const Box& b, int i) { return s.count(i, b.g1, b.b1, b.a1, i, b.g2, b.b2, b.a2); } };
+    struct GAxisGetter { static std::size_t plane(const Sums& s, const Box& b, int i) { return s.count(b.r1, i, b.b1, b.a1, b.r2, i, b.b2, b.a2); } };
+    struct BAxisGetter { static std::size_t plane(const Sums& s, const Box& b, int i) { return s.count(b.r1, b.g1, i, b.a1, b.r2, b.g2, i, b.a2); } };
+    struct AAxisGetter { static std::size_t plane(const Sums& s, const Box& b, int i) { return s.count(b.r1, b.g1, b.b1, i, b.r2, b.g2, b.b2, i); } };
 
     // These classes are used as template parameter to split a Box
     // along an axis (see splitAlongAxis)
@@ -56,41 +169,41 @@ namespace render {
 
     // Shrinks each plane of the box to a position where there are
     // points in the histogram.
-    void shrink(const Histogram& histogram) {
-      axisShrink<RAxisGetter>(histogram, r1, r2, g1, g2, b1, b2, a1, a2);
-      axisShrink<GAxisGetter>(histogram, g1, g2, r1, r2, b1, b2, a1, a2);
-      axisShrink<BAxisGetter>(histogram, b1, b2, r1, r2, g1, g2, a1, a2);
-      axisShrink<AAxisGetter>(histogram, a1, a2, r1, r2, g1, g2, b1, b2);
+    void shrink(const Sums& sums) {
+      axisShrink<RAxisGetter>(sums, r1, r2);
+      axisShrink<GAxisGetter>(sums, g1, g2);
+      axisShrink<BAxisGetter>(sums, b1, b2);
+      axisShrink<AAxisGetter>(sums, a1, a2);
 
       // Calculate number of points inside the box (this is done by
       // first time here, because the Box ctor didn't calculate it).
-      points = countPoints(histogram);
+      points = sums.count(r1, g1, b1, a1, r2, g2, b2, a2);
 
       // Recalculate the volume (used in operator<).
       volume = calculateVolume();
     }
 
-    bool split(const Histogram& histogram, std::priority_queue<Box>& boxes) const {
+    bool split(const Sums& sums, std::priority_queue<Box>& boxes) const {
       // Split along the largest dimension of the box.
       if ((r2-r1) >= (g2-g1) &&
           (r2-r1) >= (b2-b1) &&
           (r2-r1) >= (a2-a1)) {
-        return splitAlongAxis<RAxisGetter, RAxisSplitter>(histogram, boxes, r1, r2, g1, g2, b1, b2, a1, a2);
+        return splitAlongAxis<RAxisGetter, RAxisSplitter>(sums, boxes, r1, r2);
       }
 
       if ((g2-g1) >= (r2-r1) &&
           (g2-g1) >= (b2-b1) &&
           (g2-g1) >= (a2-a1)) {
-        return splitAlongAxis<GAxisGetter, GAxisSplitter>(histogram, boxes, g1, g2, r1, r2, b1, b2, a1, a2);
+        return splitAlongAxis<GAxisGetter, GAxisSplitter>(sums, boxes, g1, g2);
       }
 
       if ((b2-b1) >= (r2-r1) &&
           (b2-b1) >= (g2-g1) &&
           (b2-b1) >= (a2-a1)) {
-        return splitAlongAxis<BAxisGetter, BAxisSplitter>(histogram, boxes, b1, b2, r1, r2, g1, g2, a1, a2);
+        return splitAlongAxis<BAxisGetter, BAxisSplitter>(sums, boxes, b1, b2);
       }
 
-      return splitAlongAxis<AAxisGetter, AAxisSplitter>(histogram, boxes, a1, a2, r1, r2, g1, g2, b1, b2);
+      return splitAlongAxis<AAxisGetter, AAxisSplitter>(sums, boxes, a1, a2);
     }
 
     // Returns the color enclosed by the box calculating the mean of
@@ -147,58 +260,15 @@ namespace render {
       return (r2-r1+1) * (g2-g1+1) * (b2-b1+1) * (a2-a1+1);
     }
 
-    // Returns the number of histogram's points inside the box bounds.
-    std::size_t countPoints(const Histogram& histogram) const {
-      std::size_t count = 0;
-      int i, j, k, l;
-
-      for (i=r1; i<=r2; ++i)
-        for (j=g1; j<=g2; ++j)
-          for (k=b1; k<=b2; ++k)
-            for (l=a1; l<=a2; ++l)
-              count += histogram.at(i, j, k, l);
-
-      return count;
-    }
-
     // Reduces the specified side of the box (i1/i2) along the
     // specified axis (if AxisGetter is RAxisGetter, then i1=r1,
     // i2=r2; if AxisGetter is GAxisGetter, then i1=g1, i2=g2).
     template<class AxisGetter>
-    static void axisShrink(const Histogram& histogram,
-                           int& i1, int& i2,
-                           const int& j1, const int& j2,
-                           const int& k1, const int& k2,
-                           const int& l1, const int& l2)
-    {
-      int j, k, l;
-
-      // Shrink i1.
-      for (; i1<i2; ++i1) {
-        for (j=j1; j<=j2; ++j) {
-          for (k=k1; k<=k2; ++k) {
-            for (l=l1; l<=l2; ++l) {
-              if (AxisGetter::at(histogram, i1, j, k, l) > 0)
-                goto doneA;
-            }
-          }
-        }
-      }
-
-    doneA:;
-
-      for (; i2>i1; --i2) {
-        for (j=j1; j<=j2; ++j) {
-          for (k=k1; k<=k2; ++k) {
-            for (l=l1; l<=l2; ++l) {
-              if (AxisGetter::at(histogram, i2, j, k, l) > 0)
-                goto doneB;
-            }
-          }
-        }
-      }
-
-    doneB:;
+    void axisShrink(const Sums& sums, int& i1, int& i2) {
+      while (i1 < i2 && AxisGetter::plane(sums, *this, i1) == 0)
+        ++i1;
+      while (i2 > i1 && AxisGetter::plane(sums, *this, i2) == 0)
+        --i2;
     }
 
     // Splits the box in two sub-boxes (if it's possible) along the
@@ -207,31 +277,22 @@ namespace render {
     // queue contains the new two sub-boxes resulting from the split
     // operation.
     template<class AxisGetter, class AxisSplitter>
-    bool splitAlongAxis(const Histogram& histogram,
+    bool splitAlongAxis(const Sums& sums,
                         std::priority_queue<Box>& boxes,
-                        const int& i1, const int& i2,
-                        const int& j1, const int& j2,
-                        const int& k1, const int& k2,
-                        const int& l1, const int& l2) const {
+                        const int i1, const int i2) const {
       // These two variables will be used to count how many points are
       // in each side of the box if we split it in "i" position.
       std::size_t totalPoints1 = 0;
       std::size_t totalPoints2 = this->points;
-      int i, j, k, l;
 
       // We will try to split the box along the "i" axis. Imagine a
       // plane which its normal vector is "i" axis, so we will try to
       // move this plane from "i1" to "i2" to find the median, where
       // the number of points in both sides of the plane are
       // approximated the same.
-      for (i=i1; i<=i2; ++i) {
-        std::size_t planePoints = 0;
-
+      for (int i=i1; i<=i2; ++i) {
         // We count all points in "i" plane.
-        for (j=j1; j<=j2; ++j)
-          for (k=k1; k<=k2; ++k)
-            for (l=l1; l<=l2; ++l)
-              planePoints += AxisGetter::at(histogram, i, j, k, l);
+        const std::size_t planePoints = AxisGetter::plane(sums, *this, i);
 
         // As we move the plane to split through "i" axis One side is getting more points,
         totalPoints1 += planePoints;
@@ -277,6 +338,9 @@ namespace render {
     // We need a priority queue to split bigger boxes first (see Box::operator<).
     std::priority_queue<Box<Histogram> > boxes;
 
+    // Used to count the points inside boxes/planes of the histogram.
+    const HistogramSums<Histogram> sums(histogram);
+
     // First we start with one big box containing all histogram's samples.
     boxes.push(Box<Histogram>(0, 0, 0, 0,
                               Histogram::RElements-1,
@@ -293,10 +357,10 @@ namespace render {
 
       // Shrink the box to the minimum, to enclose the same points in
       // the histogram.
-      box.shrink(histogram);
+      box.shrink(sums);
 
       // Try to split the box along the largest axis.
-      if (!box.split(histogram, boxes)) {
+      if (!box.split(sums, boxes)) {
         // If we were not able to split the box (maybe because it is
         // too small or there are not enough points to split it), then
         // we add the box's color to the "result" vector directly (the
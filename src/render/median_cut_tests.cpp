@@ -0,0 +1,82 @@
+// Aseprite Render Library
+// Copyright (c) 2024 Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "render/median_cut.h"
+
+#include <cstdlib>
+#include <vector>
+
+using namespace render;
+
+namespace {
+
+// Small histogram with 2 bits for each component
+struct TestHistogram {
+  enum { RElements = 4, GElements = 4, BElements = 4, AElements = 4 };
+
+  std::vector<std::size_t> entries = std::vector<std::size_t>(4*4*4*4, 0);
+
+  std::size_t& at(int r, int g, int b, int a) {
+    return entries[r | (g << 2) | (b << 4) | (a << 6)];
+  }
+  std::size_t at(int r, int g, int b, int a) const {
+    return entries[r | (g << 2) | (b << 4) | (a << 6)];
+  }
+
+  std::size_t countPoints(int r1, int g1, int b1, int a1,
+                          int r2, int g2, int b2, int a2) const {
+    std::size_t count = 0;
+    for (int r=r1; r<=r2; ++r)
+      for (int g=g1; g<=g2; ++g)
+        for (int b=b1; b<=b2; ++b)
+          for (int a=a1; a<=a2; ++a)
+            count += at(r, g, b, a);
+    return count;
+  }
+};
+
+} // anonymous namespace
+
+TEST(HistogramSums, Empty)
+{
+  TestHistogram histogram;
+  HistogramSums<TestHistogram> sums(histogram);
+  EXPECT_EQ(0, sums.count(0, 0, 0, 0, 3, 3, 3, 3));
+  EXPECT_EQ(0, sums.count(1, 2, 1, 2, 1, 2, 1, 2));
+}
+
+TEST(HistogramSums, CountPoints)
+{
+  std::srand(1);
+  for (int t=0; t<10; ++t) {
+    TestHistogram histogram;
+    for (int i=0; i<20; ++i)
+      histogram.at(std::rand() % 4, std::rand() % 4,
+                   1 + std::rand() % 2, (t & 1) ? 3: std::rand() % 4) += std::rand() % 10;
+
+    HistogramSums<TestHistogram> sums(histogram);
+    for (int i=0; i<100; ++i) {
+      int r1 = std::rand() % 4, r2 = r1 + std::rand() % (4-r1);
+      int g1 = std::rand() % 4, g2 = g1 + std::rand() % (4-g1);
+      int b1 = std::rand() % 4, b2 = b1 + std::rand() % (4-b1);
+      int a1 = std::rand() % 4, a2 = a1 + std::rand() % (4-a1);
+      EXPECT_EQ(histogram.countPoints(r1, g1, b1, a1, r2, g2, b2, a2),
+                sums.count(r1, g1, b1, a1, r2, g2, b2, a2));
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -13,6 +13,8 @@
 
 #include "render/dithering.h"
 #include "render/dithering_matrix.h"
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
 
 #include <algorithm>
 #include <limits>
@@ -20,6 +22,13 @@
 
 namespace render {
 
+// Images with more pixels are dithered in parallel bands of rows
+static const int kMinPixelsPerTask = 64*1024;
+
+// Number of bits of the cache of mixes of each band of rows (indexed
+// by a hash of the RGBA color)
+static const int kMixCacheBits = 12;
+
 // Base 2x2 dither matrix, called D(2):
 int BayerMatrix::D2[4] = { 0, 2,
                            3, 1 };
@@ -40,12 +49,12 @@ static int colorDistance(int r1, int g1, int b1, int a1,
   return result;
 }
 
-OrderedDither::OrderedDither(int transparentIndex)
+OrderedDitherBase::OrderedDitherBase(int transparentIndex)
   : m_transparentIndex(transparentIndex)
 {
 }
 
-doc::color_t OrderedDither::ditherRgbPixelToIndex(
+doc::color_t OrderedDitherBase::ditherRgbPixelToIndex(
   const DitheringMatrix& matrix,
   const doc::color_t color,
   const int x,
@@ -53,10 +62,45 @@ doc::color_t OrderedDither::ditherRgbPixelToIndex(
   const doc::RgbMap* rgbmap,
   const doc::Palette* palette)
 {
+  const Mix m = mixRgbColor(matrix, color, rgbmap, palette);
+  return (matrix(y, x) < m.mix ? m.index2: m.index1);
+}
+
+int OrderedDitherBase::mapColor(const int r, const int g, const int b, const int a,
+                                const doc::RgbMap* rgbmap,
+                                const doc::Palette* palette,
+                                std::mutex* rgbmapMutex) const
+{
+  if (!rgbmap)
+    return palette->findBestfit(r, g, b, a, m_transparentIndex);
+
+  if (rgbmapMutex) {
+    std::lock_guard lock(*rgbmapMutex);
+    return rgbmap->mapColor(r, g, b, a);
+  }
+  return rgbmap->mapColor(r, g, b, a);
+}
+
+OrderedDither::OrderedDither(int transparentIndex)
+  : OrderedDitherBase(transparentIndex)
+{
+}
+
+OrderedDitherBase::Mix OrderedDither::mixRgbColor(
+  const DitheringMatrix& matrix,
+  const doc::color_t color,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette,
+  std::mutex* rgbmapMutex) const
+{
+  Mix m;
+
   // Alpha=0, output transparent color
   if (m_transparentIndex >= 0 &&
-      doc::rgba_geta(color) == 0)
-    return m_transparentIndex;
+      doc::rgba_geta(color) == 0) {
+    m.index1 = m.index2 = m_transparentIndex;
+    return m;
+  }
 
   // Get the nearest color in the palette with the given RGB
   // values.
@@ -65,8 +109,8 @@ doc::color_t OrderedDither::ditherRgbPixelToIndex(
   int b = doc::rgba_getb(color);
   int a = doc::rgba_geta(color);
   doc::color_t nearest1idx =
-    (rgbmap ? rgbmap->mapColor(r, g, b, a):
-              palette->findBestfit(r, g, b, a, m_transparentIndex));
+    mapColor(r, g, b, a, rgbmap, palette, rgbmapMutex);
+  m.index1 = m.index2 = nearest1idx;
 
   doc::color_t nearest1rgb = palette->getEntry(nearest1idx);
   int r1 = doc::rgba_getr(nearest1rgb);
@@ -87,13 +131,12 @@ doc::color_t OrderedDither::ditherRgbPixelToIndex(
   b2 = std::clamp(b2, 0, 255);
   a2 = std::clamp(a2, 0, 255);
   doc::color_t nearest2idx =
-    (rgbmap ? rgbmap->mapColor(r2, g2, b2, a2):
-              palette->findBestfit(r2, g2, b2, a2, m_transparentIndex));
+    mapColor(r2, g2, b2, a2, rgbmap, palette, rgbmapMutex);
 
   // If both possible RGB colors use the same index, we cannot
   // make any dither with these two colors.
   if (nearest1idx == nearest2idx)
-    return nearest1idx;
+    return m;
 
   doc::color_t nearest2rgb = palette->getEntry(nearest2idx);
   r2 = doc::rgba_getr(nearest2rgb);
@@ -107,20 +150,18 @@ doc::color_t OrderedDither::ditherRgbPixelToIndex(
   int d = colorDistance(r1, g1, b1, a1, r, g, b, a);
   int D = colorDistance(r1, g1, b1, a1, r2, g2, b2, a2);
   if (D == 0)
-    return nearest1idx;
+    return m;
 
   // We convert the d/D factor to the matrix range to compare it
   // with the threshold. If d > threshold, it means that we're
   // closer to 'nearest2rgb' than to 'nearest1rgb'.
-  d = matrix.maxValue() * d / D;
-  int threshold = matrix(y, x);
-
-  return (d > threshold ? nearest2idx:
-                          nearest1idx);
+  m.index2 = nearest2idx;
+  m.mix = matrix.maxValue() * d / D;
+  return m;
 }
 
 OrderedDither2::OrderedDither2(int transparentIndex)
-  : m_transparentIndex(transparentIndex)
+  : OrderedDitherBase(transparentIndex)
 {
 }
 
@@ -128,24 +169,27 @@ OrderedDither2::OrderedDither2(int transparentIndex)
 // indexes to create a mix that can reproduce the original RGB
 // color.
 //
-// TODO it's too slow for big color palettes:
-//      O(W*H*P) where P is the number of palette entries
+// It's O(P) for each color where P is the number of palette
+// entries, dither_rgb_image_to_indexed() caches the result for the
+// colors of each band of rows.
 //
 // Some ideas from:
 // http://bisqwit.iki.fi/story/howto/dither/jy/
 //
-doc::color_t OrderedDither2::ditherRgbPixelToIndex(
+OrderedDitherBase::Mix OrderedDither2::mixRgbColor(
   const DitheringMatrix& matrix,
   const doc::color_t color,
-  const int x,
-  const int y,
   const doc::RgbMap* rgbmap,
-  const doc::Palette* palette)
+  const doc::Palette* palette,
+  std::mutex* rgbmapMutex) const
 {
+  Mix m;
+
   // Alpha=0, output transparent color
   if (m_transparentIndex >= 0 &&
       doc::rgba_geta(color) == 0) {
-    return m_transparentIndex;
+    m.index1 = m.index2 = m_transparentIndex;
+    return m;
   }
 
   // Get RGBA values
@@ -155,9 +199,7 @@ doc::color_t OrderedDither2::ditherRgbPixelToIndex(
   const int a = doc::rgba_geta(color);
 
   // Find the best palette entry for the given color.
-  const int index =
-    (rgbmap ? rgbmap->mapColor(r, g, b, a):
-              palette->findBestfit(r, g, b, a, m_transparentIndex));
+  const int index = mapColor(r, g, b, a, rgbmap, palette, rgbmapMutex);
 
   const doc::color_t color0 = palette->getEntry(index);
   const int r0 = doc::rgba_getr(color0);
@@ -220,11 +262,119 @@ doc::color_t OrderedDither2::ditherRgbPixelToIndex(
   }
 
   // Using the bestMix factor the dithering matrix tells us if we
-  // should paint with altIndex or index in this x,y position.
-  if (altIndex >= 0 && matrix(y, x) < bestMix)
-    return altIndex;
-  else
-    return index;
+  // should paint with altIndex or index in each x,y position.
+  m.index1 = m.index2 = index;
+  if (altIndex >= 0) {
+    m.index2 = altIndex;
+    m.mix = bestMix;
+  }
+  return m;
+}
+
+// Dithers the rows [y1, y2) of the image with an ordered dithering
+// algorithm. Each band of rows has its own cache of mixes by color
+// (most images have a lot less colors than pixels), and the matrix
+// thresholds of each row are copied to a buffer to avoid the
+// modulo operations of DitheringMatrix::operator() for each pixel.
+static void ordered_dither_rows(
+  const OrderedDitherBase& algorithm,
+  const DitheringMatrix& matrix,
+  const doc::Image* srcImage,
+  doc::Image* dstImage,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette,
+  std::mutex* rgbmapMutex,
+  const int y1, const int y2)
+{
+  struct CacheEntry {
+    doc::color_t color = 0;
+    bool used = false;
+    OrderedDitherBase::Mix mix;
+  };
+  std::vector<CacheEntry> cache(1 << kMixCacheBits);
+
+  const int w = srcImage->width();
+  const int cols = matrix.cols();
+  std::vector<int> thresholds(cols);
+
+  for (int y=y1; y<y2; ++y) {
+    for (int j=0; j<cols; ++j)
+      thresholds[j] = matrix(y, j);
+
+    auto srcIt = doc::get_pixel_address_fast<doc::RgbTraits>(srcImage, 0, y);
+    auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, 0, y);
+    for (int x=0, j=0; x<w; ++x, ++srcIt, ++dstIt) {
+      const doc::color_t c = *srcIt;
+      CacheEntry& entry = cache[(c * 0x9e3779b1u) >> (32 - kMixCacheBits)];
+      if (!entry.used || entry.color != c) {
+        entry.color = c;
+        entry.used = true;
+        entry.mix = algorithm.mixRgbColor(matrix, c, rgbmap, palette,
+                                          rgbmapMutex);
+      }
+
+      *dstIt = (thresholds[j] < entry.mix.mix ? entry.mix.index2:
+                                                 entry.mix.index1);
+      if (++j == cols)
+        j = 0;
+    }
+  }
+}
+
+// Converts the image with an ordered dithering algorithm, big images
+// are split in bands of rows dithered in parallel. The TaskDelegate
+// is used only from this thread (between each group of bands).
+static void ordered_dither_rgb_image_to_indexed(
+  const OrderedDitherBase& algorithm,
+  const DitheringMatrix& matrix,
+  const doc::Image* srcImage,
+  doc::Image* dstImage,
+  const doc::RgbMap* rgbmap,
+  const doc::Palette* palette,
+  TaskDelegate* delegate)
+{
+  const int w = srcImage->width();
+  const int h = srcImage->height();
+  if (w <= 0 || h <= 0)
+    return;
+
+  const int threads = sched::Scheduler::instance().threads();
+  const int rows = std::max(1, kMinPixelsPerTask / w);
+  if (threads <= 1 || h <= rows) {
+    for (int y=0; y<h; y+=rows) {
+      const int y2 = std::min(h, y+rows);
+      ordered_dither_rows(algorithm, matrix, srcImage, dstImage,
+                          rgbmap, palette, nullptr, y, y2);
+      if (delegate) {
+        if (!delegate->continueTask())
+          return;
+        delegate->notifyTaskProgress(double(y2) / double(h));
+      }
+    }
+    return;
+  }
+
+  // RgbMap::mapColor() fills its tables lazily, so it's not
+  // thread-safe.
+  std::mutex rgbmapMutex;
+
+  for (int y=0; y<h; ) {
+    sched::TaskGroup tasks(sched::Priority::Interactive);
+    for (int t=0; t<threads && y<h; ++t, y+=rows) {
+      const int y2 = std::min(h, y+rows);
+      tasks.run([&, y, y2]{
+        ordered_dither_rows(algorithm, matrix, srcImage, dstImage,
+                            rgbmap, palette, &rgbmapMutex, y, y2);
+      });
+    }
+    tasks.wait();
+
+    if (delegate) {
+      if (!delegate->continueTask())
+        return;
+      delegate->notifyTaskProgress(double(std::min(h, y)) / double(h));
+    }
+  }
 }
 
 void dither_rgb_image_to_indexed(
@@ -241,7 +391,12 @@ void dither_rgb_image_to_indexed(
 
   algorithm.start(srcImage, dstImage, dithering.factor());
 
-  if (algorithm.dimensions() == 1) {
+  if (auto ordered = dynamic_cast<const OrderedDitherBase*>(&algorithm)) {
+    ordered_dither_rgb_image_to_indexed(
+      *ordered, dithering.matrix(),
+      srcImage, dstImage, rgbmap, palette, delegate);
+  }
+  else if (algorithm.dimensions() == 1) {
     const doc::LockImageBits<doc::RgbTraits> srcBits(srcImage);
     doc::LockImageBits<doc::IndexedTraits> dstBits(dstImage);
     auto srcIt = srcBits.begin();
@@ -266,7 +421,8 @@ void dither_rgb_image_to_indexed(
       }
     }
   }
-  else {
+  else if (!algorithm.ditherRgbImageToIndex2D(srcImage, dstImage,
+                                               rgbmap, palette, delegate)) {
     auto dstIt = doc::get_pixel_address_fast<doc::IndexedTraits>(dstImage, 0, 0);
     const bool zigZag = algorithm.zigZag();
 
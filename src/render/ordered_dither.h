@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,6 +17,8 @@
 #include "gfx/size.h"
 #include "render/task_delegate.h"
 
+#include <mutex>
+
 namespace render {
 
   class Dithering;
@@ -47,11 +49,33 @@ namespace render {
       const int x, const int y,
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) { return 0; }
+
+    // Converts the whole image at once (e.g. using several threads).
+    // Returns false if the image must be converted pixel by pixel
+    // with ditherRgbToIndex2D().
+    virtual bool ditherRgbImageToIndex2D(
+      const doc::Image* srcImage,
+      doc::Image* dstImage,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette,
+      TaskDelegate* delegate) { return false; }
   };
 
-  class OrderedDither : public DitheringAlgorithmBase {
+  // Ordered dithering algorithms choose between two palette indexes
+  // for each RGBA color depending on the matrix threshold in each
+  // pixel position.
+  class OrderedDitherBase : public DitheringAlgorithmBase {
   public:
-    OrderedDither(int transparentIndex = -1);
+    // The pixel is painted with index2 if the matrix threshold is
+    // less than "mix", in other case it's painted with index1.
+    struct Mix {
+      doc::color_t index1 = 0;
+      doc::color_t index2 = 0;
+      int mix = 0;
+    };
+
+    OrderedDitherBase(int transparentIndex);
+
     doc::color_t ditherRgbPixelToIndex(
       const DitheringMatrix& matrix,
       const doc::color_t color,
@@ -59,22 +83,47 @@ namespace render {
       const int y,
       const doc::RgbMap* rgbmap,
       const doc::Palette* palette) override;
-  private:
+
+    // Returns the indexes/mix factor for the given color. It doesn't
+    // depend on the pixel position, so it can be cached by color. If
+    // rgbmapMutex is specified, it's locked to use the RgbMap (which
+    // is filled lazily), so this can be called from several threads.
+    virtual Mix mixRgbColor(
+      const DitheringMatrix& matrix,
+      const doc::color_t color,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette,
+      std::mutex* rgbmapMutex = nullptr) const = 0;
+
+  protected:
+    int mapColor(const int r, const int g, const int b, const int a,
+                 const doc::RgbMap* rgbmap,
+                 const doc::Palette* palette,
+                 std::mutex* rgbmapMutex) const;
+
     int m_transparentIndex;
   };
 
-  class OrderedDither2 : public DitheringAlgorithmBase {
+  class OrderedDither : public OrderedDitherBase {
+  public:
+    OrderedDither(int transparentIndex = -1);
+    Mix mixRgbColor(
+      const DitheringMatrix& matrix,
+      const doc::color_t color,
+      const doc::RgbMap* rgbmap,
+      const doc::Palette* palette,
+      std::mutex* rgbmapMutex = nullptr) const override;
+  };
+
+  class OrderedDither2 : public OrderedDitherBase {
   public:
     OrderedDither2(int transparentIndex = -1);
-    doc::color_t ditherRgbPixelToIndex(
+    Mix mixRgbColor(
       const DitheringMatrix& matrix,
       const doc::color_t color,
-      const int x,
-      const int y,
       const doc::RgbMap* rgbmap,
-      const doc::Palette* palette) override;
-  private:
-    int m_transparentIndex;
+      const doc::Palette* palette,
+      std::mutex* rgbmapMutex = nullptr) const override;
   };
 
   void dither_rgb_image_to_indexed(
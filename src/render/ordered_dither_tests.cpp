@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2017 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,9 +11,17 @@
 
 #include <gtest/gtest.h>
 
+#include "doc/image_impl.h"
+#include "doc/octree_map.h"
+#include "doc/palette.h"
+#include "doc/primitives.h"
+#include "render/dithering.h"
 #include "render/dithering_matrix.h"
 #include "render/ordered_dither.h"
 
+#include <cstdlib>
+#include <memory>
+
 using namespace doc;
 using namespace render;
 
@@ -65,6 +73,52 @@ TEST(BayerMatrix, CheckD8)
       EXPECT_EQ(expected[c++], matrix(i, j));
 }
 
+TEST(OrderedDither, ImageMatchesPixelByPixel)
+{
+  Palette::initBestfit();
+
+  Palette pal(frame_t(0), 32);
+  for (int i=0; i<pal.size(); ++i)
+    pal.setEntry(i, rgba(std::rand() % 256, std::rand() % 256,
+                         std::rand() % 256, (i == 0 ? 0: 255)));
+
+  // Big enough to be dithered in several bands of rows
+  const int w = 301, h = 257;
+  std::unique_ptr<Image> src(Image::create(IMAGE_RGB, w, h));
+  for (int y=0; y<h; ++y)
+    for (int x=0; x<w; ++x)
+      put_pixel(src.get(), x, y, rgba(x*255/w, y*255/h, (x*y) % 256,
+                                      (x % 7 == 0 ? 0: 255)));
+
+  std::unique_ptr<Image> expected(Image::create(IMAGE_INDEXED, w, h));
+  std::unique_ptr<Image> dst(Image::create(IMAGE_INDEXED, w, h));
+  const BayerMatrix matrix(8);
+
+  OctreeMap octree;
+  octree.regenerateMap(&pal, 0);
+
+  OrderedDither dither1(0);
+  OrderedDither2 dither2(0);
+  for (OrderedDitherBase* dither : { (OrderedDitherBase*)&dither1,
+                                     (OrderedDitherBase*)&dither2 }) {
+    for (const RgbMap* rgbmap : { (const RgbMap*)nullptr,
+                                  (const RgbMap*)&octree }) {
+      for (int y=0; y<h; ++y)
+        for (int x=0; x<w; ++x)
+          put_pixel(expected.get(), x, y,
+                    dither->ditherRgbPixelToIndex(
+                      matrix, get_pixel(src.get(), x, y),
+                      x, y, rgbmap, &pal));
+
+      clear_image(dst.get(), 255);
+      dither_rgb_image_to_indexed(
+        *dither, Dithering(DitheringAlgorithm::Ordered, matrix),
+        src.get(), dst.get(), rgbmap, &pal);
+      ASSERT_EQ(0, count_diff_between_images(expected.get(), dst.get()));
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
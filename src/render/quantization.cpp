@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2022  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,23 +11,33 @@
 
 #include "render/quantization.h"
 
+#include "doc/cel.h"
 #include "doc/image_impl.h"
+#include "doc/image_ref.h"
 #include "doc/layer.h"
+#include "doc/layer_tilemap.h"
 #include "doc/octree_map.h"
 #include "doc/palette.h"
 #include "doc/primitives.h"
 #include "doc/remap.h"
 #include "doc/sprite.h"
+#include "doc/tileset.h"
 #include "render/dithering.h"
 #include "render/error_diffusion.h"
+#include "render/frame_fingerprint.h"
 #include "render/ordered_dither.h"
 #include "render/render.h"
 #include "render/task_delegate.h"
+#include "sched/task_group.h"
 
 #include <algorithm>
+#include <functional>
 #include <limits>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include <vector>
 
 namespace render {
@@ -35,6 +45,184 @@ namespace render {
 using namespace doc;
 using namespace gfx;
 
+namespace {
+
+// Colors of a rendered frame in order of appearance (only the
+// non-transparent ones) with the number of pixels of each color.
+struct FrameColors {
+  std::vector<color_t> colors;
+  std::vector<std::size_t> counts;
+
+  std::size_t memSize() const {
+    return sizeof(*this) + colors.size()*(sizeof(color_t) + sizeof(std::size_t));
+  }
+};
+
+using FrameColorsPtr = std::shared_ptr<const FrameColors>;
+
+// Cache of the colors of the last rendered frames, so running the
+// color quantization again (e.g. changing the number of colors) on a
+// big animation doesn't need to render all the frames again.
+class FrameColorsCache {
+public:
+  static FrameColorsCache& instance() {
+    static FrameColorsCache cache;
+    return cache;
+  }
+
+  FrameColorsPtr get(const uint64_t key) {
+    std::lock_guard lock(m_mutex);
+    auto it = m_items.find(key);
+    if (it == m_items.end())
+      return nullptr;
+
+    // Move to the front as the most recently used
+    m_lru.splice(m_lru.begin(), m_lru, it->second.lruIt);
+    return it->second.colors;
+  }
+
+  void add(const uint64_t key, const FrameColorsPtr& colors) {
+    const std::size_t size = colors->memSize();
+    if (size > kBudget / 4)
+      return;
+
+    std::lock_guard lock(m_mutex);
+    if (m_items.find(key) != m_items.end())
+      return;
+
+    m_lru.push_front(key);
+    m_items[key] = Item{ colors, m_lru.begin() };
+    m_memSize += size;
+
+    // Remove the least recently used frames
+    while (m_memSize > kBudget) {
+      auto it = m_items.find(m_lru.back());
+      ASSERT(it != m_items.end());
+      m_memSize -= it->second.colors->memSize();
+      m_items.erase(it);
+      m_lru.pop_back();
+    }
+  }
+
+private:
+  static constexpr std::size_t kBudget = 64*1024*1024;
+
+  struct Item {
+    FrameColorsPtr colors;
+    std::list<uint64_t>::iterator lruIt;
+  };
+
+  std::mutex m_mutex;
+  std::list<uint64_t> m_lru;
+  std::unordered_map<uint64_t, Item> m_items;
+  std::size_t m_memSize = 0;
+};
+
+FrameColorsPtr calc_frame_colors(const Image* image)
+{
+  ASSERT(image->pixelFormat() == IMAGE_RGB);
+
+  auto result = std::make_shared<FrameColors>();
+  std::unordered_map<color_t, int> indexes;
+  color_t prevColor = 0;
+  int prevIndex = -1;
+
+  for (const color_t color : LockImageBits<RgbTraits>(image)) {
+    if (rgba_geta(color) == 0)
+      continue;
+
+    // Consecutive pixels use to have the same color
+    if (prevIndex < 0 || color != prevColor) {
+      auto it = indexes.try_emplace(color, int(result->colors.size())).first;
+      if (it->second == int(result->colors.size())) {
+        result->colors.push_back(color);
+        result->counts.push_back(0);
+      }
+      prevColor = color;
+      prevIndex = it->second;
+    }
+    ++result->counts[prevIndex];
+  }
+  return result;
+}
+
+// Calls "feed" with the colors of each frame in the given range (in
+// order). The frames that are not in the FrameColorsCache are
+// rendered in parallel. Returns false if the task was canceled.
+bool feed_with_frames(const Sprite* sprite,
+                      const frame_t fromFrame,
+                      const frame_t toFrame,
+                      const bool newBlend,
+                      TaskDelegate* delegate,
+                      const std::function<void(const FrameColors&)>& feed)
+{
+  FrameColorsCache& cache = FrameColorsCache::instance();
+  const int threads = std::max(1, sched::Scheduler::instance().threads());
+  std::vector<ImageRef> flatImages;
+
+  frame_t frame = fromFrame;
+  while (frame <= toFrame) {
+    // Get a range of frames with at most "threads" frames to render
+    std::vector<uint64_t> keys;
+    std::vector<FrameColorsPtr> frameColors;
+    std::vector<int> toRender;
+    for (; frame <= toFrame && int(toRender.size()) < threads; ++frame) {
+      const uint64_t key = frame_fingerprint(sprite, frame, newBlend);
+      FrameColorsPtr colors = cache.get(key);
+      if (!colors &&
+          std::find(keys.begin(), keys.end(), key) == keys.end()) {
+        toRender.push_back(int(keys.size()));
+      }
+      keys.push_back(key);
+      frameColors.push_back(colors);
+    }
+
+    if (!toRender.empty()) {
+      while (flatImages.size() < toRender.size())
+        flatImages.emplace_back(Image::create(IMAGE_RGB,
+                                              sprite->width(),
+                                              sprite->height()));
+
+      const frame_t firstFrame = frame - frame_t(keys.size());
+      sched::TaskGroup tasks(sched::Priority::Interactive);
+      for (int i=0; i<int(toRender.size()); ++i) {
+        tasks.run([&, i]{
+          const int j = toRender[i];
+          render::Render render;
+          render.setNewBlend(newBlend);
+          render.renderSprite(flatImages[i].get(), sprite, firstFrame + j);
+          frameColors[j] = calc_frame_colors(flatImages[i].get());
+        });
+      }
+      tasks.wait();
+
+      for (const int j : toRender)
+        cache.add(keys[j], frameColors[j]);
+    }
+
+    for (int j=0; j<int(keys.size()); ++j) {
+      // Frames that look the same as a previous frame of this range
+      if (!frameColors[j]) {
+        const int k = int(std::find(keys.begin(), keys.end(), keys[j]) - keys.begin());
+        ASSERT(k < j);
+        frameColors[j] = frameColors[k];
+      }
+      feed(*frameColors[j]);
+    }
+
+    if (delegate) {
+      if (!delegate->continueTask())
+        return false;
+
+      delegate->notifyTaskProgress(
+        double(frame-fromFrame) / double(toFrame-fromFrame+1));
+    }
+  }
+  return true;
+}
+
+} // anonymous namespace
+
 Palette* create_palette_from_sprite(
   const Sprite* sprite,
   const frame_t fromFrame,
@@ -46,7 +234,10 @@ Palette* create_palette_from_sprite(
   RgbMapAlgorithm mapAlgo,
   const bool calculateWithTransparent)
 {
-   if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT)
+   // The k-d tree is only used to map colors to an existing palette,
+   // to create the palette we use the octree.
+   if (mapAlgo == doc::RgbMapAlgorithm::DEFAULT ||
+       mapAlgo == doc::RgbMapAlgorithm::KDTREE)
      mapAlgo = doc::RgbMapAlgorithm::OCTREE;
 
   PaletteOptimizer optimizer;
@@ -73,37 +264,29 @@ Palette* create_palette_from_sprite(
   if (!palette)
     palette = new Palette(fromFrame, 256);
 
-  // Add a flat image with the current sprite's frame rendered
-  ImageRef flat_image(Image::create(IMAGE_RGB,
-      sprite->width(), sprite->height()));
-
-  render::Render render;
-  render.setNewBlend(newBlend);
-
   // Feed the optimizer with all rendered frames
-  for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-    render.renderSprite(flat_image.get(), sprite, frame);
-
-    switch (mapAlgo) {
-      case RgbMapAlgorithm::RGB5A3:
-        optimizer.feedWithImage(flat_image.get(), withAlpha);
-        break;
-      case RgbMapAlgorithm::OCTREE:
-        octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor);
-        break;
-      default:
-        ASSERT(false);
-        break;
-    }
-
-    if (delegate) {
-      if (!delegate->continueTask())
-        return nullptr;
-
-      delegate->notifyTaskProgress(
-        double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-    }
-  }
+  const bool ok = feed_with_frames(
+    sprite, fromFrame, toFrame, newBlend, delegate,
+    [&](const FrameColors& frameColors){
+      const int n = int(frameColors.colors.size());
+      switch (mapAlgo) {
+        case RgbMapAlgorithm::RGB5A3:
+          optimizer.feedWithColors(frameColors.colors.data(),
+                                   frameColors.counts.data(),
+                                   n, withAlpha);
+          break;
+        case RgbMapAlgorithm::OCTREE:
+          octreemap.feedWithColors(frameColors.colors.data(),
+                                   frameColors.counts.data(),
+                                   n, withAlpha, maskColor);
+          break;
+        default:
+          ASSERT(false);
+          break;
+      }
+    });
+  if (!ok)
+    return nullptr;
 
   switch (mapAlgo) {
 
@@ -120,17 +303,15 @@ Palette* create_palette_from_sprite(
         // We can use an 8-bit deep octree map, instead of 7-bit of the
         // first attempt.
         octreemap = OctreeMap();
-        for (frame_t frame=fromFrame; frame<=toFrame; ++frame) {
-          render.renderSprite(flat_image.get(), sprite, frame);
-          octreemap.feedWithImage(flat_image.get(), withAlpha, maskColor , 8);
-          if (delegate) {
-            if (!delegate->continueTask())
-              return nullptr;
-
-            delegate->notifyTaskProgress(
-              double(frame-fromFrame+1) / double(toFrame-fromFrame+1));
-          }
-        }
+        if (!feed_with_frames(
+              sprite, fromFrame, toFrame, newBlend, delegate,
+              [&](const FrameColors& frameColors){
+                octreemap.feedWithColors(frameColors.colors.data(),
+                                         frameColors.counts.data(),
+                                         int(frameColors.colors.size()),
+                                         withAlpha, maskColor, 8);
+              }))
+          return nullptr;
         octreemap.makePalette(palette, palette->size(), 8);
       }
       break;
@@ -168,7 +349,8 @@ Image* convert_pixel_format(
         dither.reset(new OrderedDither(is_background ? -1: new_mask_color));
         break;
       case DitheringAlgorithm::ErrorDiffusion:
-        dither.reset(new ErrorDiffusionDither(is_background ? -1: new_mask_color));
+        dither.reset(new ErrorDiffusionDither(is_background ? -1: new_mask_color,
+                                              dithering.parallel()));
         break;
     }
     if (dither)
@@ -220,6 +402,23 @@ Image* convert_pixel_format(
 
         // RGB -> Indexed
         case IMAGE_INDEXED: {
+          // Map whole rows with the RgbMap
+          if (rgbmap) {
+            const int w = image->width();
+            const int h = image->height();
+            const uint8_t maskIndex = (new_mask_color == -1? 0 : new_mask_color);
+            for (int y=0; y<h; ++y) {
+              const color_t* srcRow = (const color_t*)image->getPixelAddress(0, y);
+              uint8_t* dstRow = (uint8_t*)new_image->getPixelAddress(0, y);
+              rgbmap->mapColors(srcRow, dstRow, w);
+              for (int x=0; x<w; ++x) {
+                if (rgba_geta(srcRow[x]) == 0)
+                  dstRow[x] = maskIndex;
+              }
+            }
+            break;
+          }
+
           LockImageBits<IndexedTraits> dstBits(new_image, Image::WriteLock);
           auto dst_it = dstBits.begin();
 #ifdef _DEBUG
@@ -465,6 +664,25 @@ void PaletteOptimizer::feedWithImage(const Image* image,
   }
 }
 
+void PaletteOptimizer::feedWithColors(const color_t* colors,
+                                      const std::size_t* counts,
+                                      const int n,
+                                      const bool withAlpha)
+{
+  if (withAlpha)
+    m_withAlpha = true;
+
+  for (int i=0; i<n; ++i) {
+    color_t color = colors[i];
+    if (rgba_geta(color) > 0) {
+      if (!withAlpha)
+        color |= rgba(0, 0, 0, 255);
+
+      m_histogram.addSamples(color, counts[i]);
+    }
+  }
+}
+
 void PaletteOptimizer::feedWithRgbaColor(color_t color)
 {
   m_histogram.addSamples(color, 1);
@@ -1,5 +1,5 @@
 // Aseprite Rener Library
-// Copyright (c) 2019-2021  Igara Studio S.A.
+// Copyright (c) 2019-2024  Igara Studio S.A.
 // Copyright (c) 2001-2017  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -34,6 +34,12 @@ namespace render {
     void feedWithImage(const doc::Image* image,
                        const gfx::Rect& bounds,
                        const bool withAlpha);
+    // Feeds the optimizer with a list of RGBA colors and the number
+    // of pixels of each color.
+    void feedWithColors(const doc::color_t* colors,
+                        const std::size_t* counts,
+                        const int n,
+                        const bool withAlpha);
     void feedWithRgbaColor(doc::color_t color);
     void calculate(doc::Palette* palette, int maskIndex);
     bool isHighPrecision() { return m_histogram.isHighPrecision(); }
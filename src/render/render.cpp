@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (C) 2019-2023  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,10 +11,15 @@
 
 #include "render/render.h"
 
+#include "base/thread_pool.h"
+#include "doc/blend_funcs.h"
 #include "doc/blend_internals.h"
 #include "doc/blend_mode.h"
 #include "doc/doc.h"
+#include "doc/image_buffer_pool.h"
 #include "doc/image_impl.h"
+#include "doc/image_mipmaps.h"
+#include "doc/image_occupancy.h"
 #include "doc/layer_tilemap.h"
 #include "doc/playback.h"
 #include "doc/render_plan.h"
@@ -22,8 +27,23 @@
 #include "doc/tilesets.h"
 #include "gfx/clip.h"
 #include "gfx/region.h"
+#include "perf/trace.h"
 
+#include <algorithm>
 #include <cmath>
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+// SSE2 is always available on x64
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define RENDER_SSE2 1
+  #include <emmintrin.h>
+#endif
 
 #define TRACE_RENDER_CEL(...) // TRACE
 
@@ -31,6 +51,29 @@ namespace render {
 
 namespace {
 
+// Fills n pixels with the same color (e.g. to replicate each source
+// pixel in its block of pixels when we render with zoom).
+template<typename T>
+inline void fill_pixels(T* dst, const T color, const int n)
+{
+  std::fill_n(dst, n, color);
+}
+
+#if RENDER_SSE2
+template<>
+inline void fill_pixels<uint32_t>(uint32_t* dst, const uint32_t color, const int n)
+{
+  int i = 0;
+  if (n >= 4) {
+    const __m128i c = _mm_set1_epi32(int(color));
+    for (; i+4<=n; i+=4)
+      _mm_storeu_si128((__m128i*)(dst+i), c);
+  }
+  for (; i<n; ++i)
+    dst[i] = color;
+}
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // Scaled composite
 
@@ -162,8 +205,6 @@ void composite_image_without_scale(
   ASSERT(DstTraits::pixel_format == dst->pixelFormat());
   ASSERT(SrcTraits::pixel_format == src->pixelFormat());
 
-  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blendMode, newBlend);
-
   gfx::Clip area(areaF);
   if (!area.clip(dst->width(), dst->height(),
                  src->width(), src->height()))
@@ -175,6 +216,22 @@ void composite_image_without_scale(
 
   ASSERT(!srcBounds.isEmpty());
 
+  // RGBA to RGBA can be blended row by row
+  if constexpr (std::is_same_v<DstTraits, RgbTraits> &&
+                std::is_same_v<SrcTraits, RgbTraits>) {
+    const BlendRowFunc blendRow = get_rgba_row_blender(blendMode, newBlend);
+    const color_t maskColor = src->maskColor();
+    for (int y=0; y<srcBounds.h; ++y) {
+      blendRow(
+        (color_t*)get_pixel_address_fast<RgbTraits>(dst, dstBounds.x, dstBounds.y+y),
+        (const color_t*)get_pixel_address_fast<RgbTraits>(src, srcBounds.x, srcBounds.y+y),
+        srcBounds.w, opacity, maskColor);
+    }
+    return;
+  }
+
+  BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blendMode, newBlend);
+
   // Lock all necessary bits
   const LockImageBits<SrcTraits> srcBits(src, srcBounds);
   LockImageBits<DstTraits> dstBits(dst, dstBounds);
@@ -225,7 +282,6 @@ void composite_image_scale_up(
     return;
 
   BlenderHelper<DstTraits, SrcTraits> blender(src, pal, blendMode, newBlend);
-  int px_x, px_y;
   int px_w = int(sx);
   int px_h = int(sy);
 
@@ -253,106 +309,50 @@ void composite_image_scale_up(
   if (srcBounds.isEmpty())
     return;
 
-  gfx::Rect dstBounds = area.dstBounds();
-  int bottom = dstBounds.y2()-1;
-  int line_h;
+  typedef typename DstTraits::pixel_t dst_pixel_t;
 
-  // the scanline variable is used to blend src/dst pixels one time for each pixel
-  typedef std::vector<typename DstTraits::pixel_t> Scanline;
-  Scanline scanline(srcBounds.w);
-  typename Scanline::iterator scanline_it;
-#ifdef _DEBUG
-  typename Scanline::iterator scanline_end = scanline.end();
-#endif
+  const gfx::Rect dstBounds = area.dstBounds();
+  const int bottom = dstBounds.y2();
+  const size_t rowSize = sizeof(dst_pixel_t) * dstBounds.w;
 
-  // Lock all necessary bits
-  const LockImageBits<SrcTraits> srcBits(src, srcBounds);
-  LockImageBits<DstTraits> dstBits(dst, dstBounds);
-  typename LockImageBits<SrcTraits>::const_iterator src_it = srcBits.begin();
-#ifdef _DEBUG
-  typename LockImageBits<SrcTraits>::const_iterator src_end = srcBits.end();
-#endif
-  typename LockImageBits<DstTraits>::iterator dst_it, dst_end;
+  // The scanline is used to blend src/dst pixels one time for each
+  // source pixel (with the first destination pixel of its block)
+  std::vector<dst_pixel_t> scanline(srcBounds.w);
 
   // For each line to draw of the source image...
-  dstBounds.h = 1;
-  for (int y=0; y<srcBounds.h; ++y) {
-    dst_it = dstBits.begin_area(dstBounds);
-    dst_end = dstBits.end_area(dstBounds);
+  int dstY = dstBounds.y;
+  for (int y=0; y<srcBounds.h && dstY<bottom; ++y) {
+    const auto* src_ptr = get_pixel_address_fast<SrcTraits>(
+      src, srcBounds.x, srcBounds.y+y);
+    dst_pixel_t* dst_row = get_pixel_address_fast<DstTraits>(
+      dst, dstBounds.x, dstY);
 
     // Read 'src' and 'dst' and blend them, put the result in `scanline'
-    scanline_it = scanline.begin();
-    for (int x=0; x<srcBounds.w; ++x) {
-      ASSERT(src_it >= srcBits.begin() && src_it < src_end);
-      ASSERT(dst_it >= dstBits.begin() && dst_it < dst_end);
-      ASSERT(scanline_it >= scanline.begin() && scanline_it < scanline_end);
-
-      *scanline_it = blender(*dst_it, *src_it, opacity);
-      ++src_it;
-
-      int delta;
-      if (x == 0)
-        delta = first_px_w;
-      else
-        delta = px_w;
-
-      while (dst_it != dst_end && delta-- > 0)
-        ++dst_it;
-
-      ++scanline_it;
+    for (int x=0, dx=0; x<srcBounds.w; ++x, ++src_ptr) {
+      scanline[x] = blender(dst_row[std::min(dx, dstBounds.w-1)],
+                            *src_ptr, opacity);
+      dx += (x == 0 ? first_px_w: px_w);
     }
 
-    // Get the 'height' of the line to be painted in 'dst'
-    if ((y == 0) && (first_px_h > 0))
-      line_h = first_px_h;
-    else
-      line_h = px_h;
-
-    // Draw the line in 'dst'
-    for (px_y=0; px_y<line_h; ++px_y) {
-      dst_it = dstBits.begin_area(dstBounds);
-      dst_end = dstBits.end_area(dstBounds);
-      scanline_it = scanline.begin();
-
-      int x = 0;
-
-      // first pixel
-      for (px_x=0; px_x<first_px_w; ++px_x) {
-        ASSERT(scanline_it != scanline_end);
-        ASSERT(dst_it != dst_end);
-
-        *dst_it = *scanline_it;
-
-        ++dst_it;
-        if (dst_it == dst_end)
-          goto done_with_line;
-      }
-
-      ++scanline_it;
-      ++x;
-
-      // the rest of the line
-      for (; x<srcBounds.w; ++x) {
-        for (px_x=0; px_x<px_w; ++px_x) {
-          ASSERT(dst_it !=  dst_end);
-
-          *dst_it = *scanline_it;
-
-          ++dst_it;
-          if (dst_it == dst_end)
-            goto done_with_line;
-        }
-
-        ++scanline_it;
-      }
+    // Replicate each blended pixel horizontally in the first row of
+    // the block...
+    dst_pixel_t* dst_ptr = dst_row;
+    int w = dstBounds.w;
+    for (int x=0; x<srcBounds.w && w>0; ++x) {
+      const int n = std::min(w, (x == 0 ? first_px_w: px_w));
+      fill_pixels(dst_ptr, scanline[x], n);
+      dst_ptr += n;
+      w -= n;
+    }
 
-done_with_line:;
-      if (++dstBounds.y > bottom)
-        goto done_with_blit;
+    // ...and copy that row in the rest of rows of the block
+    const int line_h = std::min((y == 0 ? first_px_h: px_h), bottom-dstY);
+    for (int py=1; py<line_h; ++py) {
+      std::memcpy(get_pixel_address_fast<DstTraits>(dst, dstBounds.x, dstY+py),
+                  dst_row, rowSize);
     }
+    dstY += line_h;
   }
-
-done_with_blit:;
 }
 
 template<class DstTraits, class SrcTraits>
@@ -520,6 +520,53 @@ CompositeImageFunc get_fastest_composition_path(const Projection& proj,
   }
 }
 
+// Smaller cel images are composited directly (their mipmaps would
+// not save time and they would use memory for each image).
+const int kMipmapsMinSize = 512;
+
+// The first mipmap level uses 1/4 of the memory of the image, so we
+// start using mipmaps from 1/16 (the scale down already skips half
+// of the rows with 1/2 zoom).
+const int kMipmapsMinLevel = 2;
+
+// Returns the mipmap level (see doc::ImageMipmaps) that can be used
+// to composite an image with composite_image_scale_down() and the
+// given scale, or 0 if the original image must be used.
+int mipmap_level(const double sx, const double sy)
+{
+  // Same steps used in composite_image_scale_down()
+  const int step_w = int(1.0 / sx);
+  const int step_h = int(1.0 / sy);
+  if (step_w < 2 || step_h < 2)
+    return 0;
+
+  int level = 0;
+  while (level < ImageMipmaps::kMaxLevel &&
+         (step_w % (2 << level)) == 0 &&
+         (step_h % (2 << level)) == 0)
+    ++level;
+  return (level >= kMipmapsMinLevel ? level: 0);
+}
+
+// Returns the mipmap level that can be used to composite a
+// reference layer image with the general composition path (where
+// pixels can be picked at any fractional position). Level N is a
+// good approximation while 2^N source pixels are mapped to one
+// destination pixel or less, and one more level is used in low
+// quality mode.
+int ref_mipmap_level(const double sx, const double sy,
+                     const bool lowQuality)
+{
+  const double scale = std::max(sx, sy);
+  int level = 0;
+  while (level < ImageMipmaps::kMaxLevel &&
+         scale * double(2 << level) <= 1.0)
+    ++level;
+  if (lowQuality && level > 0 && level < ImageMipmaps::kMaxLevel)
+    ++level;
+  return (level >= kMipmapsMinLevel ? level: 0);
+}
+
 bool has_visible_reference_layers(const LayerGroup* group)
 {
   for (const Layer* child : group->layers()) {
@@ -556,7 +603,22 @@ Render::Render()
   , m_previewTileset(nullptr)
   , m_previewBlendMode(BlendMode::NORMAL)
   , m_onionskin(OnionskinType::NONE)
+  , m_parallelPool(nullptr)
+  , m_parallelTileSize(256)
+  , m_stackRange(StackRange::All)
+  , m_stackLayer(nullptr)
+  , m_belowCacheLayer(nullptr)
+  , m_belowCache(nullptr)
+  , m_belowCacheFrame(-1)
+  , m_compositeByBlocks(false)
+  , m_useMipmaps(false)
+  , m_refLayersLowQuality(false)
+{
+}
+
+void Render::setRefLayersLowQuality(const bool lowQuality)
 {
+  m_refLayersLowQuality = lowQuality;
 }
 
 void Render::setRefLayersVisiblity(const bool visible)
@@ -643,6 +705,71 @@ void Render::disableOnionskin()
   m_onionskin.type(OnionskinType::NONE);
 }
 
+void Render::setParallelTiles(base::thread_pool* pool,
+                              const int tileSize)
+{
+  ASSERT(tileSize > 0);
+  m_parallelPool = pool;
+  m_parallelTileSize = std::max(1, tileSize);
+}
+
+void Render::renderLayersBelow(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const Layer* layer)
+{
+  ASSERT(dstImage->size() == sprite->size());
+
+  // Use a copy of this Render without zoom, extras, preview images,
+  // or onion skin in front of the sprite. The onion skin behind the
+  // sprite is included as it's rendered before the transparent layers
+  // (and neighbor frames don't change while the user paints).
+  Render render(*this);
+  render.m_sprite = sprite;
+  render.m_proj = Projection();
+  render.m_extraType = ExtraType::NONE;
+  render.m_extraCel = nullptr;
+  render.m_previewImage = nullptr;
+  render.m_previewTileset = nullptr;
+  if (render.m_onionskin.position() != OnionskinPosition::BEHIND)
+    render.m_onionskin.type(OnionskinType::NONE);
+  render.m_parallelPool = nullptr;
+  render.m_belowCache = nullptr;
+  render.m_stackRange = StackRange::BelowLayer;
+  render.m_stackLayer = layer;
+
+  CompositeImageFunc compositeImage =
+    render.getImageComposition(
+      dstImage->pixelFormat(),
+      sprite->pixelFormat(), sprite->root());
+  if (!compositeImage)
+    return;
+
+  render.m_compositeByBlocks = render.canCompositeByBlocks(sprite->root());
+  render.m_useMipmaps = render.canUseMipmaps(sprite->root());
+
+  const gfx::ClipF area(sprite->bounds());
+  fill_rect(dstImage, area.dstBounds(), render.getBgColor(dstImage, frame));
+  render.renderSpriteLayers(dstImage, area, frame, compositeImage);
+}
+
+void Render::setLayersBelowCache(const Layer* layer,
+                                 const frame_t frame,
+                                 const Image* image)
+{
+  m_belowCacheLayer = layer;
+  m_belowCacheFrame = frame;
+  m_belowCache = image;
+}
+
+void Render::removeLayersBelowCache()
+{
+  m_belowCacheLayer = nullptr;
+  m_belowCacheFrame = -1;
+  m_belowCache = nullptr;
+}
+
 void Render::renderSprite(
   Image* dstImage,
   const Sprite* sprite,
@@ -680,11 +807,12 @@ void Render::renderLayer(
     return;
 
   m_globalOpacity = 255;
+  m_compositeByBlocks = canCompositeByBlocks(layer);
+  m_useMipmaps = canUseMipmaps(layer);
 
-  doc::RenderPlan plan;
-  plan.addLayer(layer, frame);
+  const auto plan = m_planCache.plan(layer, frame);
   renderPlan(
-    plan, dstImage, area,
+    *plan, dstImage, area,
     frame, compositeImage,
     true, true, blendMode);
 }
@@ -697,6 +825,12 @@ void Render::renderSprite(
 {
   m_sprite = sprite;
 
+  if (m_parallelPool &&
+      canRenderInParallelTiles(dstImage, area)) {
+    renderSpriteInParallelTiles(dstImage, sprite, frame, gfx::Clip(area));
+    return;
+  }
+
   CompositeImageFunc compositeImage =
     getImageComposition(
       dstImage->pixelFormat(),
@@ -704,30 +838,50 @@ void Render::renderSprite(
   if (!compositeImage)
     return;
 
+  m_compositeByBlocks = canCompositeByBlocks(sprite->root());
+  m_useMipmaps = canUseMipmaps(sprite->root());
+
   const LayerImage* bgLayer = m_sprite->backgroundLayer();
-  color_t bg_color = 0;
-  if (m_sprite->pixelFormat() == IMAGE_INDEXED) {
-    switch (dstImage->pixelFormat()) {
-      case IMAGE_RGB:
-      case IMAGE_GRAYSCALE:
-        if (bgLayer && bgLayer->isVisible())
-          bg_color = m_sprite->palette(frame)->getEntry(m_sprite->transparentColor());
-        break;
-      case IMAGE_INDEXED:
-        bg_color = m_sprite->transparentColor();
-        break;
-    }
-  }
+  const color_t bg_color = getBgColor(dstImage, frame);
 
   // New Blending Method:
   if (m_newBlendMethod) {
-    // Clear dstImage with the bg_color (if the background is not a
-    // special background pattern like the checkered background, this
-    // is enough as a base color).
-    fill_rect(dstImage, area.dstBounds(), bg_color);
+    if (canUseLayersBelowCache(dstImage, frame, area)) {
+      // The SRC blender skips pixels with the mask color, so we clear
+      // the area with that same color to get an exact copy of the
+      // cached layers.
+      fill_rect(dstImage, area.dstBounds(), m_belowCache->maskColor());
+      renderImage(
+        dstImage, m_belowCache, m_sprite->palette(frame),
+        gfx::RectF(m_belowCache->bounds()), area,
+        getImageComposition(dstImage->pixelFormat(),
+                            m_belowCache->pixelFormat(),
+                            sprite->root()),
+        255, BlendMode::SRC);
+
+      // Draw the cached layer and the layers above it
+      const auto plan = m_planCache.plan(m_sprite->root(), frame);
+
+      m_globalOpacity = 255;
+      m_stackRange = StackRange::FromLayer;
+      m_stackLayer = m_belowCacheLayer;
+      renderPlan(*plan, dstImage,
+                 area, frame, compositeImage,
+                 false,
+                 true,
+                 BlendMode::UNSPECIFIED);
+      m_stackRange = StackRange::All;
+      m_stackLayer = nullptr;
+    }
+    else {
+      // Clear dstImage with the bg_color (if the background is not a
+      // special background pattern like the checkered background, this
+      // is enough as a base color).
+      fill_rect(dstImage, area.dstBounds(), bg_color);
 
-    // Draw the Background layer - Onion skin behind the sprite - Transparent Layers
-    renderSpriteLayers(dstImage, area, frame, compositeImage);
+      // Draw the Background layer - Onion skin behind the sprite - Transparent Layers
+      renderSpriteLayers(dstImage, area, frame, compositeImage);
+    }
 
     // In case that we need a special background (e.g. like the
     // checkered pattern), we can draw the background in a temporal
@@ -775,17 +929,165 @@ void Render::renderSprite(
   }
 }
 
+bool Render::canRenderInParallelTiles(const Image* dstImage,
+                                      const gfx::ClipF& area) const
+{
+  // Only integer areas can be split in tiles
+  if (area.dst.x != int(area.dst.x) || area.dst.y != int(area.dst.y) ||
+      area.src.x != int(area.src.x) || area.src.y != int(area.src.y) ||
+      area.size.w != int(area.size.w) || area.size.h != int(area.size.h))
+    return false;
+
+  // It doesn't make sense to split an area smaller than two tiles
+  if (area.size.w * area.size.h <= 2.0 * m_parallelTileSize * m_parallelTileSize)
+    return false;
+
+  // composite_image_general() uses floating point steps that depend
+  // on the origin of the area, so splitting the area in tiles could
+  // give us a different result than rendering the whole area at
+  // once. Here we check the same conditions used in
+  // get_fastest_composition_path() to select the general path.
+  if (!m_proj.zoom().isSimpleZoomLevel() ||
+      needsFinegrainComposition(m_sprite->root()))
+    return false;
+
+  if ((m_proj.scaleX() < 1.0 || m_proj.scaleY() < 1.0) &&
+      (((m_proj.removeX(1) > 1) && (m_proj.removeX(1) & 1)) ||
+       ((m_proj.removeY(1) > 1) && (m_proj.removeY(1) & 1))))
+    return false;
+
+  return true;
+}
+
+void Render::renderSpriteInParallelTiles(
+  Image* dstImage,
+  const Sprite* sprite,
+  frame_t frame,
+  const gfx::Clip& area)
+{
+  const int tileSize = m_parallelTileSize;
+  std::mutex mutex;
+  std::condition_variable cv;
+  int pending = 0;
+
+  for (int y=0; y<area.size.h; y+=tileSize) {
+    for (int x=0; x<area.size.w; x+=tileSize) {
+      const gfx::Clip tileArea(area.dst.x+x, area.dst.y+y,
+                               area.src.x+x, area.src.y+y,
+                               std::min(tileSize, area.size.w-x),
+                               std::min(tileSize, area.size.h-y));
+      {
+        std::lock_guard lock(mutex);
+        ++pending;
+      }
+
+      m_parallelPool->execute(
+        [this, dstImage, sprite, frame, tileArea,
+         &mutex, &cv, &pending]{
+          // Each tile is rendered by its own Render instance (so
+          // temporary buffers are not shared between threads) in an
+          // image of the tile size, then it's copied to its own
+          // region of the destination image.
+          Render render(*this);
+          render.m_tmpBuf.reset();
+          render.m_parallelPool = nullptr;
+
+          ImageSpec spec = dstImage->spec();
+          spec.setSize(tileArea.size);
+          std::unique_ptr<Image> tileImage(
+            Image::create(spec, doc::get_pooled_image_buffer(spec)));
+
+          render.renderSprite(
+            tileImage.get(), sprite, frame,
+            gfx::ClipF(0, 0, tileArea.src.x, tileArea.src.y,
+                       tileArea.size.w, tileArea.size.h));
+
+          copy_image(dstImage, tileImage.get(),
+                     tileArea.dst.x, tileArea.dst.y);
+
+          std::lock_guard lock(mutex);
+          if (--pending == 0)
+            cv.notify_one();
+        });
+    }
+  }
+
+  std::unique_lock lock(mutex);
+  cv.wait(lock, [&pending]{ return pending == 0; });
+}
+
+bool Render::canUseLayersBelowCache(const Image* dstImage,
+                                    frame_t frame,
+                                    const gfx::ClipF& area) const
+{
+  if (!m_belowCache ||
+      !m_newBlendMethod ||
+      m_belowCacheFrame != frame ||
+      m_belowCacheLayer->sprite() != m_sprite ||
+      m_belowCache->pixelFormat() != dstImage->pixelFormat() ||
+      m_belowCache->size() != m_sprite->size())
+    return false;
+
+  // The layer must be a visible transparent layer, in other case it
+  // will not be in the render plan (or it will be rendered in the
+  // background pass).
+  if (m_belowCacheLayer->isBackground() ||
+      !m_belowCacheLayer->isVisibleHierarchy())
+    return false;
+
+  // Extra cels/preview images of other layers are not included in
+  // the cached image. The onion skin behind the sprite is included
+  // (the owner of the cache must discard it when the onion skin
+  // options change), and the onion skin in front of the sprite is
+  // rendered over the cached result.
+  if ((m_extraCel && m_extraType != ExtraType::NONE &&
+       m_currentLayer != m_belowCacheLayer) ||
+      (m_previewImage && m_selectedLayer &&
+       m_selectedLayer != m_belowCacheLayer))
+    return false;
+
+  // The cached image is rendered without zoom, so it can be used only
+  // when each sprite pixel is composited one time and repeated n-times
+  // in the destination.
+  if (!m_proj.zoom().isSimpleZoomLevel() ||
+      m_proj.scaleX() < 1.0 || m_proj.scaleY() < 1.0 ||
+      needsFinegrainComposition(m_sprite->root()))
+    return false;
+
+  return m_proj.apply(gfx::RectF(m_sprite->bounds()))
+    .contains(area.srcBounds());
+}
+
+color_t Render::getBgColor(const Image* dstImage,
+                           frame_t frame) const
+{
+  color_t bg_color = 0;
+  if (m_sprite->pixelFormat() == IMAGE_INDEXED) {
+    const LayerImage* bgLayer = m_sprite->backgroundLayer();
+    switch (dstImage->pixelFormat()) {
+      case IMAGE_RGB:
+      case IMAGE_GRAYSCALE:
+        if (bgLayer && bgLayer->isVisible())
+          bg_color = m_sprite->palette(frame)->getEntry(m_sprite->transparentColor());
+        break;
+      case IMAGE_INDEXED:
+        bg_color = m_sprite->transparentColor();
+        break;
+    }
+  }
+  return bg_color;
+}
+
 void Render::renderSpriteLayers(Image* dstImage,
                                 const gfx::ClipF& area,
                                 frame_t frame,
                                 CompositeImageFunc compositeImage)
 {
-  doc::RenderPlan plan;
-  plan.addLayer(m_sprite->root(), frame);
+  const auto plan = m_planCache.plan(m_sprite->root(), frame);
 
   // Draw the background layer.
   m_globalOpacity = 255;
-  renderPlan(plan, dstImage,
+  renderPlan(*plan, dstImage,
              area, frame, compositeImage,
              true,
              false,
@@ -797,7 +1099,7 @@ void Render::renderSpriteLayers(Image* dstImage,
 
   // Draw the transparent layers.
   m_globalOpacity = 255;
-  renderPlan(plan, dstImage,
+  renderPlan(*plan, dstImage,
              area, frame, compositeImage,
              false,
              true,
@@ -870,6 +1172,11 @@ void Render::renderOnionskin(
                                  std::min(frame, m_onionskin.prevFrames()));
     play.nextFrame(-prevFrames);
 
+    // Neighbor frames are rendered with all their layers (the stack
+    // range is only for the current frame)
+    const StackRange stackRange = m_stackRange;
+    m_stackRange = StackRange::All;
+
     for (frame_t frameOut = frame - prevFrames;
          frameOut <= frame + m_onionskin.nextFrames();
          ++frameOut, play.nextFrame()) {
@@ -896,10 +1203,9 @@ void Render::renderOnionskin(
         else if (m_onionskin.type() == OnionskinType::RED_BLUE_TINT)
           blendMode = (frameOut < frame ? BlendMode::RED_TINT: BlendMode::BLUE_TINT);
 
-        doc::RenderPlan plan;
-        plan.addLayer(onionLayer, frameIn);
+        const auto plan = m_planCache.plan(onionLayer, frameIn);
         renderPlan(
-          plan, dstImage,
+          *plan, dstImage,
           area, frameIn, compositeImage,
           // Render background only for "in-front" onion skinning and
           // when opacity is < 255
@@ -908,6 +1214,8 @@ void Render::renderOnionskin(
           true, blendMode);
       }
     }
+
+    m_stackRange = stackRange;
   }
 }
 
@@ -995,7 +1303,7 @@ void Render::renderImage(
 }
 
 void Render::renderPlan(
-  RenderPlan& plan,
+  const RenderPlan& plan,
   Image* image,
   const gfx::Clip& area,
   const frame_t frame,
@@ -1004,12 +1312,27 @@ void Render::renderPlan(
   const bool render_transparent,
   const BlendMode blendMode)
 {
+  PERF_ZONE("Render::renderPlan");
+  bool skipLayers = (m_stackRange == StackRange::FromLayer);
+
   for (const auto& item : plan.items()) {
     const Cel* cel = item.cel;
     const Layer* layer = item.layer;
 
     ASSERT(layer->isVisible()); // Hidden layers shouldn't be in the plan
 
+    // Render only a part of the layer stack (the background layer is
+    // always below m_stackLayer, so it's not affected)
+    if (m_stackLayer && render_transparent) {
+      if (layer == m_stackLayer) {
+        if (m_stackRange == StackRange::BelowLayer)
+          break;
+        skipLayers = false;
+      }
+      if (skipLayers)
+        continue;
+    }
+
     const bool isSelected = (m_selectedLayerForOpacity == layer);
     gfx::Rect extraArea;
     bool drawExtra = false;
@@ -1090,6 +1413,18 @@ void Render::renderPlan(
               celBounds = cel->bounds();
           }
 
+          // Skip cels that are completely outside the area to render
+          // (e.g. when just a small part of the sprite is
+          // invalidated), using the same projection as the occupied
+          // blocks in renderCel() (enlarged by one pixel to avoid
+          // rounding issues with scales < 1).
+          if (celImage &&
+              !layer->isReference() &&
+              !m_proj.apply(gfx::Rect(celBounds))
+                .enlarge(1).intersects(area.srcBounds())) {
+            celImage = nullptr;
+          }
+
           if (celImage) {
             const LayerImage* imgLayer = static_cast<const LayerImage*>(layer);
             BlendMode layerBlendMode =
@@ -1110,6 +1445,15 @@ void Render::renderPlan(
             if (!isSelected && m_nonactiveLayersOpacity != 255)
               opacity = MUL_UN8(opacity, m_nonactiveLayersOpacity, t);
 
+            // Fully transparent cels don't modify the destination
+            // (RGB/gray blenders multiply the source alpha by the
+            // opacity, but indexed blenders and the SRC/NEG_BW modes
+            // ignore the opacity).
+            if (opacity == 0 &&
+                !drawExtra &&
+                isTransparentWithZeroOpacity(image, celImage, layerBlendMode))
+              break;
+
             // Generally this is just one pass, but if we are using
             // OVER_COMPOSITE extra cel, this will be two passes.
             for (int pass=0; pass<2; ++pass) {
@@ -1197,6 +1541,9 @@ void Render::renderCel(
   if (!compositeImage)
     return;
 
+  m_compositeByBlocks = false;
+  m_useMipmaps = false;
+
   renderCel(
     dst_image,
     cel,
@@ -1274,41 +1621,262 @@ void Render::renderCel(
 
     TRACE_RENDER_CEL("Drawing tilemap (%d %d %d %d)\n",
                      tilesToDraw.x, tilesToDraw.y, tilesToDraw.w, tilesToDraw.h);
+    if (tilesToDraw.isEmpty())
+      return;
+
+    // Empty tiles (transparent tiles different from notile) are
+    // skipped, and opaque tiles are copied directly when there is
+    // nothing to blend/scale.
+    const bool useTilesOccupancy =
+      (dst_image->pixelFormat() != IMAGE_TILEMAP &&
+       canUseTilesOccupancy(cel, cel_image, cel_layer, tileset, blendMode));
+    const bool canCopyOpaqueTiles =
+      (useTilesOccupancy &&
+       blendMode == BlendMode::NORMAL &&
+       opacity == 255 &&
+       m_proj.scaleX() == 1.0 &&
+       m_proj.scaleY() == 1.0);
+    const gfx::Rect dstBounds =
+      gfx::Rect(area.dst, area.size).createIntersection(dst_image->bounds());
 
     for (int v=tilesToDraw.y; v<tilesToDraw.y2(); ++v) {
+      // Tiles of this row (tilesToDraw is inside the tilemap bounds)
+      const tile_t* row =
+        (const tile_t*)cel_image->getPixelAddress(tilesToDraw.x, v);
+
       for (int u=tilesToDraw.x; u<tilesToDraw.x2(); ++u) {
+        const tile_t t = row[u-tilesToDraw.x];
+        if (t == doc::notile)
+          continue;
+
+        if (dst_image->pixelFormat() == IMAGE_TILEMAP) {
+          put_pixel(dst_image, u-area.dst.x, v-area.dst.y, t);
+          continue;
+        }
+
+        const ImageRef tile_image = tileset->get(tile_geti(t));
+        if (!tile_image)
+          continue;
+
         auto tileBoundsOnCanvas = grid.tileToCanvas(gfx::Rect(u, v, 1, 1));
         TRACE_RENDER_CEL(" - tile (%d %d) -> (%d %d %d %d)\n", u, v,
                          tileBoundsOnCanvas.x, tileBoundsOnCanvas.y,
                          tileBoundsOnCanvas.w, tileBoundsOnCanvas.h);
-        if (!cel_image->bounds().contains(u, v))
-          continue;
-
-        const tile_t t = cel_image->getPixel(u, v);
-        if (t != doc::notile) {
-          const tile_index i = tile_geti(t);
-
-          if (dst_image->pixelFormat() == IMAGE_TILEMAP) {
-            put_pixel(dst_image, u-area.dst.x, v-area.dst.y, t);
-          }
-          else {
-            const ImageRef tile_image = tileset->get(i);
-            if (!tile_image)
-              continue;
 
-            renderImage(dst_image, tile_image.get(), pal, tileBoundsOnCanvas,
-                        area, compositeImage, opacity, blendMode);
+        if (useTilesOccupancy) {
+          const auto occupancy = tile_image->occupancy();
+          if (occupancy->isEmpty())
+            continue;
+
+          if (canCopyOpaqueTiles &&
+              occupancy->isOpaque() &&
+              tile_image->pixelFormat() == dst_image->pixelFormat()) {
+            copyOpaqueRect(dst_image, tile_image.get(),
+                           tile_image->bounds(),
+                           gfx::Point(tileBoundsOnCanvas.origin())
+                           - area.src + area.dst,
+                           dstBounds);
+            continue;
           }
         }
+
+        renderImage(dst_image, tile_image.get(), pal, tileBoundsOnCanvas,
+                    area, compositeImage, opacity, blendMode);
       }
     }
   }
+  // Composite only the non-empty blocks of the cel image
+  else if (canSkipEmptyBlocks(cel, cel_image, cel_layer, blendMode)) {
+    const auto occupancy = cel_image->occupancy();
+    if (occupancy->isEmpty())
+      return;
+
+    // Opaque blocks are copied directly when there is nothing to
+    // blend/scale/convert.
+    const bool canCopyOpaqueBlocks =
+      (blendMode == BlendMode::NORMAL &&
+       opacity == 255 &&
+       m_proj.scaleX() == 1.0 &&
+       m_proj.scaleY() == 1.0 &&
+       cel_image->pixelFormat() == dst_image->pixelFormat());
+
+    if (occupancy->isFull() && !canCopyOpaqueBlocks) {
+      renderImage(dst_image, cel_image, pal, celBounds,
+                  area, compositeImage, opacity, blendMode);
+      return;
+    }
+
+    const gfx::Point celPos(int(celBounds.x), int(celBounds.y));
+    std::vector<gfx::Rect> rects;
+    std::vector<gfx::Rect> opaqueRects;
+    occupancy->occupiedRects(cel_image->bounds(), rects,
+                             canCopyOpaqueBlocks ? &opaqueRects: nullptr);
+
+    if (!opaqueRects.empty()) {
+      const gfx::Rect dstBounds =
+        gfx::Rect(area.dst, area.size).createIntersection(dst_image->bounds());
+      for (const gfx::Rect& rect : opaqueRects) {
+        copyOpaqueRect(dst_image, cel_image, rect,
+                       rect.origin() + celPos - area.src + area.dst,
+                       dstBounds);
+      }
+    }
+
+    for (const gfx::Rect& rect : rects) {
+      const gfx::Rect rc =
+        m_proj.apply(gfx::Rect(rect).offset(celPos))
+        .createIntersection(area.srcBounds());
+      if (rc.isEmpty())
+        continue;
+
+      renderImage(dst_image, cel_image, pal, celBounds,
+                  gfx::Clip(area.dst.x+rc.x-area.src.x,
+                            area.dst.y+rc.y-area.src.y, rc),
+                  compositeImage, opacity, blendMode);
+    }
+  }
   else {
     renderImage(dst_image, cel_image, pal, celBounds,
-                area, compositeImage, opacity, blendMode);
+                area, compositeImage, opacity, blendMode,
+                mipmapsForCel(cel, cel_image, cel_layer));
   }
 }
 
+bool Render::canSkipEmptyBlocks(const Cel* cel,
+                                const Image* cel_image,
+                                const Layer* cel_layer,
+                                const BlendMode blendMode) const
+{
+  // The occupancy of an image is cached by image version, so it's
+  // used only for regular cel images of layers that are not being
+  // edited (the active layer, extra cels, or preview images can be
+  // modified without incrementing the image version).
+  return (m_compositeByBlocks &&
+          cel && cel_layer &&
+          cel->image() == cel_image &&
+          !cel_layer->isReference() &&
+          cel_layer != m_selectedLayerForOpacity &&
+          cel_layer != m_currentLayer &&
+          cel_layer != m_selectedLayer &&
+          // The SRC blender doesn't skip mask color pixels
+          blendMode != BlendMode::SRC &&
+          std::max(cel_image->width(),
+                   cel_image->height()) > ImageOccupancy::kBlockSize);
+}
+
+bool Render::canUseTilesOccupancy(const Cel* cel,
+                                  const Image* cel_image,
+                                  const Layer* cel_layer,
+                                  const Tileset* tileset,
+                                  const BlendMode blendMode) const
+{
+  // The tile images of the preview tileset (or the tileset of the
+  // layer that is being edited) can be modified without incrementing
+  // their versions, so their cached occupancy cannot be used (as in
+  // canSkipEmptyBlocks()).
+  return (m_compositeByBlocks &&
+          cel && cel_layer &&
+          cel->image() == cel_image &&
+          tileset != m_previewTileset &&
+          !cel_layer->isReference() &&
+          cel_layer != m_selectedLayerForOpacity &&
+          cel_layer != m_currentLayer &&
+          cel_layer != m_selectedLayer &&
+          // The SRC blender doesn't skip mask color pixels
+          blendMode != BlendMode::SRC);
+}
+
+// static
+bool Render::isTransparentWithZeroOpacity(const Image* dst_image,
+                                          const Image* cel_image,
+                                          const BlendMode blendMode)
+{
+  return ((cel_image->pixelFormat() == IMAGE_RGB ||
+           cel_image->pixelFormat() == IMAGE_GRAYSCALE) &&
+          (dst_image->pixelFormat() == IMAGE_RGB ||
+           dst_image->pixelFormat() == IMAGE_GRAYSCALE) &&
+          blendMode != BlendMode::SRC &&
+          blendMode != BlendMode::NEG_BW);
+}
+
+// static
+void Render::copyOpaqueRect(Image* dst_image,
+                            const Image* src_image,
+                            const gfx::Rect& srcRect,
+                            const gfx::Point& dstPos,
+                            const gfx::Rect& dstBounds)
+{
+  ASSERT(dst_image->pixelFormat() == src_image->pixelFormat());
+  ASSERT(src_image->bounds().contains(srcRect));
+
+  const gfx::Rect rc =
+    gfx::Rect(dstPos, srcRect.size()).createIntersection(dstBounds);
+  if (rc.isEmpty())
+    return;
+
+  const int rowBytes = dst_image->getRowStrideSize(rc.w);
+  for (int y=rc.y; y<rc.y2(); ++y) {
+    const uint8_t* src =
+      src_image->getPixelAddress(srcRect.x + rc.x - dstPos.x,
+                                 srcRect.y + y - dstPos.y);
+    std::copy(src, src+rowBytes, dst_image->getPixelAddress(rc.x, y));
+  }
+}
+
+Render::Mipmaps Render::mipmapsForCel(const Cel* cel,
+                                      const Image* cel_image,
+                                      const Layer* cel_layer) const
+{
+  // The mipmaps are cached by image version, so (as in
+  // canSkipEmptyBlocks()) they are used only for regular cel images
+  // of layers that are not being edited.
+  if (!cel || !cel_layer ||
+      cel->image() != cel_image ||
+      cel_layer == m_selectedLayerForOpacity ||
+      cel_layer == m_currentLayer ||
+      cel_layer == m_selectedLayer ||
+      std::max(cel_image->width(),
+               cel_image->height()) < kMipmapsMinSize)
+    return Mipmaps::None;
+
+  // Reference layers (e.g. big photos) are composited with the
+  // general composition path, so the result cannot be the same, but
+  // they are displayed only in the editor (they are not exported) and
+  // a mipmap level is a lot faster to read than the original image
+  // (the level depends on the zoom and the scale of the cel, see
+  // ref_mipmap_level()).
+  if (cel_layer->isReference())
+    return ((m_flags & Flags::ShowRefLayers) ? Mipmaps::Approximate:
+                                               Mipmaps::None);
+
+  return (m_useMipmaps ? Mipmaps::SameResult: Mipmaps::None);
+}
+
+bool Render::canUseMipmaps(const Layer* layer) const
+{
+  // Mipmaps give the same result only when
+  // composite_image_scale_down() is used (it picks one pixel of each
+  // step_w x step_h block), see get_fastest_composition_path().
+  return (m_proj.zoom().isSimpleZoomLevel() &&
+          m_proj.scaleX() < 1.0 &&
+          m_proj.scaleY() < 1.0 &&
+          !((m_proj.removeX(1) > 1) && (m_proj.removeX(1) & 1)) &&
+          !((m_proj.removeY(1) > 1) && (m_proj.removeY(1) & 1)) &&
+          !needsFinegrainComposition(layer));
+}
+
+bool Render::canCompositeByBlocks(const Layer* layer) const
+{
+  // Compositing a part of the image gives the same result as
+  // compositing the whole image only when each pixel is composited
+  // independently of the origin of the area (i.e. without the
+  // general composition path, see get_fastest_composition_path()).
+  return (m_proj.zoom().isSimpleZoomLevel() &&
+          m_proj.scaleX() >= 1.0 &&
+          m_proj.scaleY() >= 1.0 &&
+          !needsFinegrainComposition(layer));
+}
+
 void Render::renderImage(
   Image* dst_image,
   const Image* cel_image,
@@ -1317,26 +1885,69 @@ void Render::renderImage(
   const gfx::Clip& area,
   const CompositeImageFunc compositeImage,
   const int opacity,
-  const BlendMode blendMode)
+  const BlendMode blendMode,
+  const Mipmaps mipmaps)
 {
   gfx::RectF scaledBounds = m_proj.apply(celBounds);
   gfx::RectF srcBounds = gfx::RectF(area.srcBounds()).createIntersection(scaledBounds);
   if (srcBounds.isEmpty())
     return;
 
+  gfx::ClipF areaF(
+    double(area.dst.x) + srcBounds.x - double(area.src.x),
+    double(area.dst.y) + srcBounds.y - double(area.src.y),
+    srcBounds.x - scaledBounds.x,
+    srcBounds.y - scaledBounds.y,
+    srcBounds.w,
+    srcBounds.h);
+  double sx = m_proj.scaleX() * celBounds.w / double(cel_image->width());
+  double sy = m_proj.scaleY() * celBounds.h / double(cel_image->height());
+
+  // Composite from a mipmap level the same pixels that
+  // composite_image_scale_down() would pick from the image
+  ImageRef mipmap;
+  if (mipmaps == Mipmaps::SameResult) {
+    const int level = mipmap_level(sx, sy);
+    if (level > 0) {
+      // Clip the area with the original image size (the mipmap can
+      // be a little bigger because its size is rounded up)
+      gfx::Clip clip(areaF);
+      if (!clip.clip(dst_image->width(), dst_image->height(),
+                     int(sx*double(cel_image->width())),
+                     int(sy*double(cel_image->height()))))
+        return;
+      areaF = gfx::ClipF(clip.dst.x, clip.dst.y,
+                         clip.src.x, clip.src.y,
+                         clip.size.w, clip.size.h);
+
+      mipmap = cel_image->mipmaps()->level(level);
+      cel_image = mipmap.get();
+
+      // Multiplying by a power of two is exact, so the steps
+      // calculated in composite_image_scale_down() are divided
+      // exactly by 2^level
+      sx *= double(1 << level);
+      sy *= double(1 << level);
+    }
+  }
+  // Composite an approximation from the closest mipmap level (the
+  // area is already clipped to the cel bounds, and the general path
+  // clips it again with the mipmap size)
+  else if (mipmaps == Mipmaps::Approximate) {
+    const int level = ref_mipmap_level(sx, sy, m_refLayersLowQuality);
+    if (level > 0) {
+      mipmap = cel_image->mipmaps()->level(level);
+      cel_image = mipmap.get();
+      sx *= double(1 << level);
+      sy *= double(1 << level);
+    }
+  }
+
   compositeImage(
-    dst_image, cel_image, pal,
-    gfx::ClipF(
-      double(area.dst.x) + srcBounds.x - double(area.src.x),
-      double(area.dst.y) + srcBounds.y - double(area.src.y),
-      srcBounds.x - scaledBounds.x,
-      srcBounds.y - scaledBounds.y,
-      srcBounds.w,
-      srcBounds.h),
+    dst_image, cel_image, pal, areaF,
     opacity,
     blendMode,
-    m_proj.scaleX() * celBounds.w / double(cel_image->width()),
-    m_proj.scaleY() * celBounds.h / double(cel_image->height()),
+    sx, sy,
     m_newBlendMethod);
 }
 
@@ -1345,18 +1956,7 @@ CompositeImageFunc Render::getImageComposition(
   const PixelFormat srcFormat,
   const Layer* layer)
 {
-  // True if we need blending pixel by pixel. If this is false we can
-  // blend src+dst one time and repeat the resulting color in dst
-  // image n-times (where n is the zoom scale).
-  double intpart;
-  const bool finegrain =
-    (!m_bg.zoom && (m_bg.stripeSize.w < m_proj.applyX(1) ||
-                    m_bg.stripeSize.h < m_proj.applyY(1) ||
-                    std::modf(double(m_bg.stripeSize.w) / m_proj.applyX(1.0), &intpart) != 0.0 ||
-                    std::modf(double(m_bg.stripeSize.h) / m_proj.applyY(1.0), &intpart) != 0.0)) ||
-    (layer &&
-     layer->isGroup() &&
-     has_visible_reference_layers(static_cast<const LayerGroup*>(layer)));
+  const bool finegrain = needsFinegrainComposition(layer);
 
   switch (srcFormat) {
 
@@ -1397,6 +1997,22 @@ CompositeImageFunc Render::getImageComposition(
   return nullptr;
 }
 
+bool Render::needsFinegrainComposition(const Layer* layer) const
+{
+  // True if we need blending pixel by pixel. If this is false we can
+  // blend src+dst one time and repeat the resulting color in dst
+  // image n-times (where n is the zoom scale).
+  double intpart;
+  return
+    (!m_bg.zoom && (m_bg.stripeSize.w < m_proj.applyX(1) ||
+                    m_bg.stripeSize.h < m_proj.applyY(1) ||
+                    std::modf(double(m_bg.stripeSize.w) / m_proj.applyX(1.0), &intpart) != 0.0 ||
+                    std::modf(double(m_bg.stripeSize.h) / m_proj.applyY(1.0), &intpart) != 0.0)) ||
+    (layer &&
+     layer->isGroup() &&
+     has_visible_reference_layers(static_cast<const LayerGroup*>(layer)));
+}
+
 bool Render::checkIfWeShouldUsePreview(const Cel* cel) const
 {
   if ((m_selectedLayer == cel->layer())) {
@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -15,6 +15,7 @@
 #include "doc/color.h"
 #include "doc/frame.h"
 #include "doc/pixel_format.h"
+#include "doc/render_plan.h"
 #include "gfx/clip.h"
 #include "gfx/point.h"
 #include "gfx/size.h"
@@ -23,12 +24,15 @@
 #include "render/onionskin_options.h"
 #include "render/projection.h"
 
+namespace base {
+  class thread_pool;
+}
+
 namespace doc {
   class Cel;
   class Image;
   class Layer;
   class Palette;
-  class RenderPlan;
   class Sprite;
   class Tileset;
 }
@@ -52,10 +56,24 @@ namespace render {
       ShowRefLayers = 1,
     };
 
+    // Part of the layer stack that renderPlan() composites (see
+    // m_stackLayer).
+    enum class StackRange {
+      All,         // All layers
+      BelowLayer,  // Only layers below m_stackLayer
+      FromLayer,   // Only m_stackLayer and the layers above it
+    };
+
   public:
     Render();
 
     void setRefLayersVisiblity(const bool visible);
+
+    // Composites reference layers from a mipmap level with half of
+    // the resolution needed for the current zoom (e.g. to repaint
+    // faster while the user is painting).
+    void setRefLayersLowQuality(const bool lowQuality);
+
     void setNonactiveLayersOpacity(const int opacity);
     void setNewBlend(const bool newBlend);
     void setProjection(const Projection& projection);
@@ -84,6 +102,37 @@ namespace render {
     void setOnionskin(const OnionskinOptions& options);
     void disableOnionskin();
 
+    // Enables the tile-parallel mode of renderSprite(): the
+    // destination area is split in square tiles of tileSize pixels
+    // that are rendered concurrently in the given thread pool. The
+    // output is the same as the sequential path. Use a nullptr pool
+    // to render everything in the caller thread (the default).
+    void setParallelTiles(base::thread_pool* pool,
+                          const int tileSize = 256);
+
+    // Renders in dstImage (an image of the sprite size) the partial
+    // result that renderSprite() has just before compositing the
+    // given layer, i.e. the background and all layers below it
+    // without zoom. The onion skin behind the sprite is included, but
+    // extra cels, preview images and onion skin in front of the
+    // sprite are not. This image can be given to setLayersBelowCache().
+    void renderLayersBelow(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const Layer* layer);
+
+    // Uses the given image (created with renderLayersBelow()) in
+    // renderSprite() to avoid compositing all layers below the given
+    // layer again (e.g. while the user is painting on that layer).
+    // The cache is ignored in those cases where the result could be
+    // different from a full render. The image must be kept alive
+    // until removeLayersBelowCache() is called.
+    void setLayersBelowCache(const Layer* layer,
+                             const frame_t frame,
+                             const Image* image);
+    void removeLayersBelowCache();
+
     void renderSprite(
       Image* dstImage,
       const Sprite* sprite,
@@ -137,6 +186,64 @@ namespace render {
       const BlendMode blendMode);
 
   private:
+    bool canRenderInParallelTiles(const Image* dstImage,
+                                  const gfx::ClipF& area) const;
+
+    void renderSpriteInParallelTiles(
+      Image* dstImage,
+      const Sprite* sprite,
+      frame_t frame,
+      const gfx::Clip& area);
+
+    bool needsFinegrainComposition(const Layer* layer) const;
+
+    bool canSkipEmptyBlocks(const Cel* cel,
+                            const Image* cel_image,
+                            const Layer* cel_layer,
+                            const BlendMode blendMode) const;
+
+    bool canCompositeByBlocks(const Layer* layer) const;
+
+    bool canUseTilesOccupancy(const Cel* cel,
+                              const Image* cel_image,
+                              const Layer* cel_layer,
+                              const Tileset* tileset,
+                              const BlendMode blendMode) const;
+
+    // True if a cel image with opacity=0 doesn't modify the
+    // destination image using the given blend mode.
+    static bool isTransparentWithZeroOpacity(const Image* dst_image,
+                                             const Image* cel_image,
+                                             const BlendMode blendMode);
+
+    // Copies the "srcRect" pixels of "src_image" (which must be
+    // opaque) to "dstPos", clipped to "dstBounds".
+    static void copyOpaqueRect(Image* dst_image,
+                               const Image* src_image,
+                               const gfx::Rect& srcRect,
+                               const gfx::Point& dstPos,
+                               const gfx::Rect& dstBounds);
+
+    // How renderImage() can use the mipmaps of a cel image.
+    enum class Mipmaps {
+      None,         // The original image must be used
+      SameResult,   // Only when the result is the same (scale down path)
+      Approximate,  // The nearest level for reference layers
+    };
+
+    Mipmaps mipmapsForCel(const Cel* cel,
+                          const Image* cel_image,
+                          const Layer* cel_layer) const;
+
+    bool canUseMipmaps(const Layer* layer) const;
+
+    bool canUseLayersBelowCache(const Image* dstImage,
+                                frame_t frame,
+                                const gfx::ClipF& area) const;
+
+    color_t getBgColor(const Image* dstImage,
+                       frame_t frame) const;
+
     void renderSpriteLayers(
       Image* dstImage,
       const gfx::ClipF& area,
@@ -160,7 +267,7 @@ namespace render {
       const CompositeImageFunc compositeImage);
 
     void renderPlan(
-      doc::RenderPlan& plan,
+      const doc::RenderPlan& plan,
       Image* image,
       const gfx::Clip& area,
       const frame_t frame,
@@ -189,7 +296,8 @@ namespace render {
       const gfx::Clip& area,
       const CompositeImageFunc compositeImage,
       const int opacity,
-      const BlendMode blendMode);
+      const BlendMode blendMode,
+      const Mipmaps mipmaps = Mipmaps::None);
 
     CompositeImageFunc getImageComposition(
       const PixelFormat dstFormat,
@@ -220,6 +328,26 @@ namespace render {
     BlendMode m_previewBlendMode;
     OnionskinOptions m_onionskin;
     ImageBufferPtr m_tmpBuf;
+    base::thread_pool* m_parallelPool;
+    int m_parallelTileSize;
+    StackRange m_stackRange;
+    const Layer* m_stackLayer;
+    const Layer* m_belowCacheLayer;
+    const Image* m_belowCache;
+    frame_t m_belowCacheFrame;
+    bool m_compositeByBlocks;
+
+    // True if cel images can be composited from their mipmaps (when
+    // the sprite is zoomed out)
+    bool m_useMipmaps;
+
+    // True if reference layers are composited from lower mipmap
+    // levels (see setRefLayersLowQuality())
+    bool m_refLayersLowQuality;
+
+    // Plans of the last rendered frames (to avoid creating them on
+    // each repaint of the same frame)
+    doc::RenderPlanCache m_planCache;
   };
 
   void composite_image(Image* dst,
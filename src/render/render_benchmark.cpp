@@ -10,6 +10,7 @@
 
 #include "render/render.h"
 
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/image.h"
 #include "doc/layer.h"
@@ -19,14 +20,13 @@
 
 #include <benchmark/benchmark.h>
 
+#include <memory>
+
 using namespace doc;
 using namespace render;
 
-static void Bm_Render(benchmark::State& state)
+static Sprite* make_benchmark_sprite(const int w, const int h)
 {
-  const int w = state.range(0);
-  const int h = state.range(1);
-
   Sprite* spr = Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h));
   LayerImage* lay1 = static_cast<LayerImage*>(spr->root()->firstLayer());
   LayerImage* lay2 = new LayerImage(spr);
@@ -50,23 +50,60 @@ static void Bm_Render(benchmark::State& state)
   fill_rect(img1, 32, 32, w-64, h-64, rgba(32, 128, 255, 128));
   fill_rect(img2.get(), 0, 0, w-64, h-64, rgba(255, 100, 32, 128));
   fill_rect(img3.get(), 64, 64, w-64, h-64, rgba(200, 64, 80, 128));
+  return spr;
+}
+
+static BgOptions make_benchmark_bg()
+{
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.color1 = rgba(100, 100, 100, 255);
+  bg.color2 = rgba(200, 200, 200, 255);
+  bg.stripeSize = gfx::Size(16, 16);
+  return bg;
+}
+
+static void Bm_Render(benchmark::State& state)
+{
+  const int w = state.range(0);
+  const int h = state.range(1);
+
+  std::unique_ptr<Sprite> spr(make_benchmark_sprite(w, h));
+  std::unique_ptr<Image> dst(Image::create(spr->pixelFormat(), w, h));
+  clear_image(dst.get(), 0);
+
+  while (state.KeepRunning()) {
+    clear_image(dst.get(), 0);
+
+    Render render;
+    render.setBgOptions(make_benchmark_bg());
+    render.renderSprite(
+      dst.get(), spr.get(), frame_t(0),
+      gfx::Clip(0, 0, 0, 0, w, h));
+  }
+}
+
+static void Bm_RenderParallelTiles(benchmark::State& state)
+{
+  const int w = state.range(0);
+  const int h = state.range(1);
+  const int threads = state.range(2);
 
+  std::unique_ptr<Sprite> spr(make_benchmark_sprite(w, h));
   std::unique_ptr<Image> dst(Image::create(spr->pixelFormat(), w, h));
   clear_image(dst.get(), 0);
 
+  base::thread_pool pool(threads);
+
   while (state.KeepRunning()) {
     clear_image(dst.get(), 0);
 
     Render render;
-    BgOptions bg;
-    bg.type = BgType::CHECKERED;
-    bg.zoom = true;
-    bg.color1 = rgba(100, 100, 100, 255);
-    bg.color2 = rgba(200, 200, 200, 255);
-    bg.stripeSize = gfx::Size(16, 16);
-    render.setBgOptions(bg);
+    render.setBgOptions(make_benchmark_bg());
+    render.setParallelTiles(&pool, 256);
     render.renderSprite(
-      dst.get(), spr, frame_t(0),
+      dst.get(), spr.get(), frame_t(0),
       gfx::Clip(0, 0, 0, 0, w, h));
   }
 }
@@ -79,4 +116,17 @@ BENCHMARK(Bm_Render)
   ->Args({ 4096, 4096 })
   ->Unit(benchmark::kMicrosecond);
 
+BENCHMARK(Bm_RenderParallelTiles)
+  ->Args({ 1024, 1024, 1 })
+  ->Args({ 1024, 1024, 2 })
+  ->Args({ 1024, 1024, 4 })
+  ->Args({ 1024, 1024, 8 })
+  ->Args({ 4096, 4096, 1 })
+  ->Args({ 4096, 4096, 2 })
+  ->Args({ 4096, 4096, 4 })
+  ->Args({ 4096, 4096, 8 })
+  ->Args({ 4096, 4096, 16 })
+  ->Unit(benchmark::kMicrosecond)
+  ->UseRealTime();
+
 BENCHMARK_MAIN();
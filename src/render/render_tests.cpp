@@ -1,5 +1,5 @@
 // Aseprite Render Library
-// Copyright (c) 2019-2023 Igara Studio S.A.
+// Copyright (c) 2019-2024 Igara Studio S.A.
 // Copyright (c) 2001-2018 David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -11,8 +11,10 @@
 
 #include <gtest/gtest.h>
 
+#include "render/get_sprite_pixel.h"
 #include "render/render.h"
 
+#include "base/thread_pool.h"
 #include "doc/cel.h"
 #include "doc/document.h"
 #include "doc/image.h"
@@ -277,6 +279,251 @@ TEST(Render, BugWithMultiplesOf3ZoomFactors)
   }
 }
 
+TEST(Render, ParallelTilesMatchSequentialRender)
+{
+  const int w = 301, h = 203;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  Sprite* spr = doc->sprite();
+  Image* src = spr->root()->firstLayer()->cel(0)->image();
+  clear_image(src, 0);
+  fill_rect(src, 10, 10, w-20, h-20, rgba(255, 0, 0, 128));
+  draw_line(src, 0, 0, w-1, h-1, rgba(0, 0, 255, 255));
+
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(lay2);
+  ImageRef img2(Image::create(IMAGE_RGB, w/2, h/2));
+  clear_image(img2.get(), rgba(0, 255, 0, 64));
+  lay2->addCel(new Cel(frame_t(0), img2));
+  lay2->cel(0)->setPosition(w/3, h/3);
+  lay2->setBlendMode(BlendMode::MULTIPLY);
+
+  BgOptions bg;
+  bg.type = BgType::CHECKERED;
+  bg.zoom = true;
+  bg.colorPixelFormat = IMAGE_RGB;
+  bg.color1 = rgba(128, 128, 128, 255);
+  bg.color2 = rgba(64, 64, 64, 255);
+  bg.stripeSize = gfx::Size(8, 8);
+
+  base::thread_pool pool(4);
+  for (int zoom : { 1, 2, 3 }) {
+    const gfx::Clip area(0, 0, 5, 7, w*zoom-5, h*zoom-7);
+    std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+    std::unique_ptr<Image> result(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+
+    Render render;
+    render.setBgOptions(bg);
+    render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+    render.renderSprite(expected.get(), spr, frame_t(0), area);
+
+    render.setParallelTiles(&pool, 32);
+    render.renderSprite(result.get(), spr, frame_t(0), area);
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " zoom=" << zoom;
+  }
+}
+
+TEST(Render, LayersBelowCacheMatchesFullRender)
+{
+  const int w = 64, h = 48;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  Sprite* spr = doc->sprite();
+  Image* src = spr->root()->firstLayer()->cel(0)->image();
+  clear_image(src, 0);
+  fill_rect(src, 4, 4, w-8, h-8, rgba(255, 0, 0, 128));
+
+  // Three layers: the cached one is in the middle of the stack
+  LayerImage* layers[2];
+  for (int i=0; i<2; ++i) {
+    layers[i] = new LayerImage(spr);
+    spr->root()->addLayer(layers[i]);
+    ImageRef img(Image::create(IMAGE_RGB, w/2, h/2));
+    clear_image(img.get(), rgba(0, 255*i, 255, 96));
+    layers[i]->addCel(new Cel(frame_t(0), img));
+    layers[i]->cel(0)->setPosition(w/4 + i*5, h/4 + i*3);
+  }
+  layers[0]->setBlendMode(BlendMode::SCREEN);
+  layers[1]->setBlendMode(BlendMode::OVERLAY);
+  Image* activeImage = layers[0]->cel(0)->image();
+
+  Render render;
+  std::unique_ptr<Image> cache(Image::create(IMAGE_RGB, w, h));
+  render.renderLayersBelow(cache.get(), spr, frame_t(0), layers[0]);
+  render.setLayersBelowCache(layers[0], frame_t(0), cache.get());
+
+  // Modify the active layer (the cache is still valid)
+  fill_rect(activeImage, 2, 2, 10, 10, rgba(255, 255, 0, 200));
+
+  for (int zoom : { 1, 2, 3 }) {
+    const gfx::Clip area(0, 0, 3, 1, w*zoom-3, h*zoom-1);
+    std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+    std::unique_ptr<Image> result(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+
+    render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+    render.renderSprite(result.get(), spr, frame_t(0), area);
+
+    render.removeLayersBelowCache();
+    render.renderSprite(expected.get(), spr, frame_t(0), area);
+    render.setLayersBelowCache(layers[0], frame_t(0), cache.get());
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " zoom=" << zoom;
+  }
+}
+
+TEST(Render, LayersBelowCacheWithOnionskinBehind)
+{
+  const int w = 32, h = 24;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  Sprite* spr = doc->sprite();
+  spr->setTotalFrames(frame_t(3));
+
+  LayerImage* layers[2] = { static_cast<LayerImage*>(spr->root()->firstLayer()),
+                            new LayerImage(spr) };
+  spr->root()->addLayer(layers[1]);
+  for (int i=0; i<2; ++i) {
+    for (frame_t f=0; f<3; ++f) {
+      if (!layers[i]->cel(f)) {
+        ImageRef img(Image::create(IMAGE_RGB, w, h));
+        layers[i]->addCel(new Cel(f, img));
+      }
+      Image* img = layers[i]->cel(f)->image();
+      clear_image(img, 0);
+      fill_rect(img, f*8, i*6, f*8+12, i*6+10, rgba(255*i, 64*f, 255, 160));
+    }
+  }
+  Image* activeImage = layers[0]->cel(1)->image();
+
+  for (auto type : { OnionskinType::MERGE, OnionskinType::RED_BLUE_TINT }) {
+    OnionskinOptions onionskin(type);
+    onionskin.position(OnionskinPosition::BEHIND);
+    onionskin.prevFrames(1);
+    onionskin.nextFrames(1);
+    onionskin.opacityBase(128);
+
+    Render render;
+    render.setOnionskin(onionskin);
+
+    std::unique_ptr<Image> cache(Image::create(IMAGE_RGB, w, h));
+    render.renderLayersBelow(cache.get(), spr, frame_t(1), layers[0]);
+    render.setLayersBelowCache(layers[0], frame_t(1), cache.get());
+
+    // Modify the active layer (the cache is still valid)
+    fill_rect(activeImage, 2, 2, 10, 10, rgba(255, 255, 0, 200));
+
+    std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, w, h));
+    std::unique_ptr<Image> result(Image::create(IMAGE_RGB, w, h));
+    render.renderSprite(result.get(), spr, frame_t(1));
+
+    render.removeLayersBelowCache();
+    render.renderSprite(expected.get(), spr, frame_t(1));
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " type=" << int(type);
+  }
+}
+
+TEST(Render, SkipEmptyBlocksMatchesFullComposition)
+{
+  const int w = 300, h = 200;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  Sprite* spr = doc->sprite();
+  Layer* lay1 = spr->root()->firstLayer();
+  Image* src = lay1->cel(0)->image();
+  clear_image(src, 0);
+  fill_rect(src, 70, 10, 80, 20, rgba(255, 0, 0, 128));
+  put_pixel(src, w-1, h-1, rgba(0, 0, 255, 255));
+  src->incrementVersion();
+
+  LayerImage* lay2 = new LayerImage(spr);
+  spr->root()->addLayer(lay2);
+  ImageRef img2(Image::create(IMAGE_RGB, w, h));
+  clear_image(img2.get(), rgba(0, 255, 0, 64));
+  lay2->addCel(new Cel(frame_t(0), img2));
+  lay2->cel(0)->setPosition(-3, 5);
+  lay2->setBlendMode(BlendMode::DIFFERENCE);
+  EXPECT_FALSE(src->occupancy()->isFull());
+
+  for (int zoom : { 1, 2, 3 }) {
+    const gfx::Clip area(0, 0, 7, 1, w*zoom-9, h*zoom-2);
+    std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+    std::unique_ptr<Image> result(Image::create(IMAGE_RGB, area.size.w, area.size.h));
+
+    Render render;
+    render.setProjection(Projection(PixelRatio(1, 1), Zoom(zoom, 1)));
+
+    // Empty blocks are not skipped for the selected layer
+    render.setSelectedLayer(lay1);
+    render.renderSprite(expected.get(), spr, frame_t(0), area);
+
+    render.setSelectedLayer(lay2);
+    render.renderSprite(result.get(), spr, frame_t(0), area);
+
+    EXPECT_EQ(0, count_diff_between_images(expected.get(), result.get()))
+      << " zoom=" << zoom;
+  }
+}
+
+TEST(Render, GetSpritePixelMatchesRender)
+{
+  const int w = 16, h = 12;
+  std::shared_ptr<Document> doc = std::make_shared<Document>();
+  doc->sprites().add(Sprite::MakeStdSprite(ImageSpec(ColorMode::RGB, w, h)));
+  Sprite* spr = doc->sprite();
+  Image* src = spr->root()->firstLayer()->cel(0)->image();
+  clear_image(src, 0);
+  fill_rect(src, 2, 2, w-4, h-4, rgba(255, 0, 0, 128));
+
+  // Layers with different blend modes and opacities (one of them
+  // inside a hidden group)
+  LayerGroup* group = new LayerGroup(spr);
+  spr->root()->addLayer(group);
+  for (int i=0; i<3; ++i) {
+    LayerImage* layer = new LayerImage(spr);
+    if (i == 2)
+      group->addLayer(layer);
+    else
+      spr->root()->addLayer(layer);
+    ImageRef img(Image::create(IMAGE_RGB, w/2, h/2));
+    clear_image(img.get(), rgba(0, 100*i, 255, 96));
+    put_pixel(img.get(), 1, 1, 0);
+    layer->addCel(new Cel(frame_t(0), img));
+    layer->cel(0)->setPosition(i*3, i*2);
+    layer->cel(0)->setOpacity(200);
+    layer->setOpacity(180 - i*20);
+    layer->setBlendMode(i == 0 ? BlendMode::SCREEN: BlendMode::MULTIPLY);
+  }
+  group->setVisible(false);
+
+  for (const bool newBlend : { false, true }) {
+    for (int zoom : { 1, 3 }) {
+      const Projection proj(PixelRatio(1, 1), Zoom(zoom, 1));
+      std::unique_ptr<Image> expected(Image::create(IMAGE_RGB, 1, 1));
+      for (int y=0; y<h; ++y) {
+        for (int x=0; x<w; ++x) {
+          Render render;
+          render.setNewBlend(newBlend);
+          render.setRefLayersVisiblity(true);
+          render.setProjection(proj);
+          render.renderSprite(
+            expected.get(), spr, frame_t(0),
+            gfx::ClipF(0, 0, proj.applyX(x+0.5), proj.applyY(y+0.5), 1, 1));
+
+          EXPECT_EQ(get_pixel(expected.get(), 0, 0),
+                    get_sprite_pixel(spr, x+0.5, y+0.5, frame_t(0),
+                                     proj, newBlend))
+            << " x=" << x << " y=" << y << " zoom=" << zoom;
+        }
+      }
+    }
+  }
+}
+
 int main(int argc, char** argv)
 {
   ::testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,178 @@
+// Aseprite Scheduler Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sched/scheduler.h"
+
+#include "base/debug.h"
+
+#include <algorithm>
+
+namespace sched {
+
+static int g_defaultThreads = 0;
+
+// Scheduler and index of the worker running in the current thread.
+static thread_local const Scheduler* t_scheduler = nullptr;
+static thread_local int t_worker = -1;
+
+// static
+Scheduler& Scheduler::instance()
+{
+  static Scheduler scheduler(
+    g_defaultThreads > 0 ? g_defaultThreads:
+                           std::max<int>(1, std::thread::hardware_concurrency()));
+  return scheduler;
+}
+
+// static
+void Scheduler::setDefaultThreads(int threads)
+{
+  g_defaultThreads = threads;
+}
+
+Scheduler::Scheduler(int threads)
+  : m_pending(0)
+  , m_stop(false)
+{
+  ASSERT(threads > 0);
+
+  for (int i=0; i<threads; ++i)
+    m_workers.push_back(std::make_unique<Worker>());
+
+  // Start the threads when all workers are created (as they can
+  // steal tasks from each other)
+  for (int i=0; i<threads; ++i)
+    m_workers[i]->thread = std::thread([this, i]{ workerProc(i); });
+}
+
+Scheduler::~Scheduler()
+{
+  {
+    std::lock_guard lock(m_mutex);
+    m_stop = true;
+  }
+  m_cv.notify_all();
+
+  for (auto& worker : m_workers)
+    worker->thread.join();
+}
+
+void Scheduler::execute(Func&& func, Priority priority)
+{
+  const int p = int(priority);
+  if (isWorkerThread()) {
+    Worker& worker = *m_workers[t_worker];
+    std::lock_guard lock(worker.mutex);
+    worker.queues[p].push_back(std::move(func));
+  }
+  else {
+    std::lock_guard lock(m_mutex);
+    m_queues[p].push_back(std::move(func));
+  }
+
+  {
+    // Increment m_pending with m_mutex locked so a worker that is
+    // going to sleep doesn't miss the notification
+    std::lock_guard lock(m_mutex);
+    ++m_pending;
+  }
+  m_cv.notify_one();
+}
+
+bool Scheduler::runOne(Priority priority)
+{
+  Func func;
+  if (!popTask((isWorkerThread() ? t_worker: -1), int(priority), func))
+    return false;
+
+  func();
+  return true;
+}
+
+bool Scheduler::isWorkerThread() const
+{
+  return (t_scheduler == this);
+}
+
+bool Scheduler::popTask(const int self, const int maxPriority, Func& func)
+{
+  const int n = int(m_workers.size());
+
+  for (int p=0; p<=maxPriority; ++p) {
+    // Newest task from the queue of this worker
+    if (self >= 0) {
+      Worker& worker = *m_workers[self];
+      std::lock_guard lock(worker.mutex);
+      if (!worker.queues[p].empty()) {
+        func = std::move(worker.queues[p].back());
+        worker.queues[p].pop_back();
+        --m_pending;
+        return true;
+      }
+    }
+
+    // Oldest task added from other threads
+    {
+      std::lock_guard lock(m_mutex);
+      if (!m_queues[p].empty()) {
+        func = std::move(m_queues[p].front());
+        m_queues[p].pop_front();
+        --m_pending;
+        return true;
+      }
+    }
+
+    // Steal the oldest task from other worker
+    for (int i=1; i<=n; ++i) {
+      const int victim = (std::max(self, 0) + i) % n;
+      if (victim == self)
+        continue;
+
+      Worker& worker = *m_workers[victim];
+      std::lock_guard lock(worker.mutex);
+      if (!worker.queues[p].empty()) {
+        func = std::move(worker.queues[p].front());
+        worker.queues[p].pop_front();
+        --m_pending;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+void Scheduler::workerProc(const int self)
+{
+  t_scheduler = this;
+  t_worker = self;
+
+  Func func;
+  while (true) {
+    if (popTask(self, kPriorities-1, func)) {
+      try {
+        func();
+      }
+      catch (...) {
+        // Tasks must handle their own exceptions (e.g. using a
+        // TaskGroup)
+        ASSERT(false);
+      }
+      func = nullptr;
+      continue;
+    }
+
+    std::unique_lock lock(m_mutex);
+    m_cv.wait(lock, [this]{ return (m_stop || m_pending > 0); });
+    if (m_stop && m_pending == 0)
+      break;
+  }
+}
+
+} // namespace sched
@@ -0,0 +1,89 @@
+// Aseprite Scheduler Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef SCHED_SCHEDULER_H_INCLUDED
+#define SCHED_SCHEDULER_H_INCLUDED
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace sched {
+
+  // Tasks with higher priority are executed first.
+  enum class Priority {
+    UI,                         // The UI thread is waiting the task
+    Interactive,                // The user is waiting the task (jobs, filters)
+    Background,                 // Thumbnails, data recovery, etc.
+  };
+
+  // Work-stealing thread pool. Each worker thread has its own queue
+  // of tasks (one for each priority), tasks added from a worker are
+  // pushed to its own queue (and executed in LIFO order), and idle
+  // workers steal the oldest tasks from other workers.
+  class Scheduler {
+  public:
+    typedef std::function<void()> Func;
+
+    static constexpr int kPriorities = 3;
+
+    // Returns the scheduler shared by all the program.
+    static Scheduler& instance();
+
+    // Changes the number of threads of the instance() (0 to use the
+    // number of cores). It must be called before the first
+    // instance() call.
+    static void setDefaultThreads(int threads);
+
+    explicit Scheduler(int threads);
+
+    // Waits all the queued tasks.
+    ~Scheduler();
+
+    int threads() const { return int(m_workers.size()); }
+
+    void execute(Func&& func, Priority priority = Priority::Background);
+
+    // Executes one queued task (with the given priority or a higher
+    // one) in the current thread. Returns false if there is no task.
+    bool runOne(Priority priority = Priority::Background);
+
+    // Returns true if the current thread is a worker of this
+    // scheduler.
+    bool isWorkerThread() const;
+
+  private:
+    struct Worker {
+      std::mutex mutex;
+      std::deque<Func> queues[kPriorities];
+      std::thread thread;
+    };
+
+    bool popTask(const int self, const int maxPriority, Func& func);
+    void workerProc(const int self);
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    // Tasks added from threads that aren't workers.
+    std::mutex m_mutex;
+    std::deque<Func> m_queues[kPriorities];
+    std::condition_variable m_cv;
+    std::atomic<int> m_pending;
+    bool m_stop;
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+  };
+
+} // namespace sched
+
+#endif
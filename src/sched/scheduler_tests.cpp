@@ -0,0 +1,105 @@
+// Aseprite Scheduler Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <gtest/gtest.h>
+
+#include "sched/scheduler.h"
+#include "sched/task_group.h"
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using namespace sched;
+
+TEST(Scheduler, RunAllTasks)
+{
+  for (int threads : { 1, 2, 8 }) {
+    Scheduler scheduler(threads);
+    EXPECT_EQ(threads, scheduler.threads());
+
+    std::atomic<int> count(0);
+    TaskGroup group(Priority::Background, scheduler);
+    for (int i=0; i<1000; ++i)
+      group.run([&count]{ ++count; });
+    group.wait();
+    EXPECT_EQ(1000, count);
+    EXPECT_FALSE(group.running());
+  }
+}
+
+TEST(Scheduler, NestedGroups)
+{
+  // Tasks waiting other tasks must not block the only worker thread
+  Scheduler scheduler(1);
+  std::atomic<int> count(0);
+
+  TaskGroup group(Priority::Interactive, scheduler);
+  for (int i=0; i<10; ++i) {
+    group.run([&scheduler, &count]{
+      TaskGroup subgroup(Priority::Interactive, scheduler);
+      for (int j=0; j<10; ++j)
+        subgroup.run([&count]{ ++count; });
+      subgroup.wait();
+    });
+  }
+  group.wait();
+  EXPECT_EQ(100, count);
+}
+
+TEST(Scheduler, Priorities)
+{
+  Scheduler scheduler(1);
+  std::vector<int> order;
+
+  // Block the worker until the UI task is done
+  std::atomic<bool> start(false);
+  TaskGroup group(Priority::Background, scheduler);
+  group.run([&start]{ while (!start) std::this_thread::yield(); });
+
+  TaskGroup ui(Priority::UI, scheduler);
+  TaskGroup interactive(Priority::Interactive, scheduler);
+  std::mutex mutex;
+  auto add = [&](int i){ std::lock_guard lock(mutex); order.push_back(i); };
+  group.run([&]{ add(2); });
+  interactive.run([&]{ add(1); });
+  ui.run([&]{ add(0); });
+
+  // The UI task can be executed by this thread if the worker is
+  // blocked
+  ui.wait();
+  start = true;
+  interactive.wait();
+  group.wait();
+
+  ASSERT_EQ(3, int(order.size()));
+  EXPECT_EQ(0, order[0]);
+  EXPECT_EQ(1, order[1]);
+  EXPECT_EQ(2, order[2]);
+}
+
+TEST(Scheduler, Exceptions)
+{
+  Scheduler scheduler(2);
+  TaskGroup group(Priority::Background, scheduler);
+  group.run([]{ throw std::runtime_error("error"); });
+  group.run([]{ });
+  EXPECT_THROW(group.wait(), std::runtime_error);
+
+  // The error is thrown only one time
+  group.run([]{ });
+  EXPECT_NO_THROW(group.wait());
+}
+
+int main(int argc, char** argv)
+{
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,96 @@
+// Aseprite Scheduler Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "sched/task_group.h"
+
+#include <chrono>
+
+namespace sched {
+
+TaskGroup::TaskGroup(Priority priority, Scheduler& scheduler)
+  : m_scheduler(scheduler)
+  , m_priority(priority)
+  , m_pending(0)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+  try {
+    wait();
+  }
+  catch (...) {
+    // Ignore errors of tasks that were not waited
+  }
+}
+
+void TaskGroup::run(Func&& func)
+{
+  {
+    std::lock_guard lock(m_mutex);
+    ++m_pending;
+  }
+
+  m_scheduler.execute(
+    [this, func = std::move(func)]{
+      try {
+        func();
+      }
+      catch (...) {
+        std::lock_guard lock(m_mutex);
+        if (!m_error)
+          m_error = std::current_exception();
+      }
+
+      // Notify with the mutex locked because the TaskGroup can be
+      // destroyed as soon as wait() sees m_pending == 0.
+      std::lock_guard lock(m_mutex);
+      if (--m_pending == 0)
+        m_cv.notify_all();
+    },
+    m_priority);
+}
+
+void TaskGroup::wait()
+{
+  const bool worker = m_scheduler.isWorkerThread();
+
+  std::unique_lock lock(m_mutex);
+  while (m_pending > 0) {
+    if (worker || m_priority == Priority::UI) {
+      // Execute other task meanwhile
+      lock.unlock();
+      const bool executed = m_scheduler.runOne(
+        worker ? Priority::Background: Priority::UI);
+      lock.lock();
+      if (executed)
+        continue;
+
+      // Check again after a while because other tasks can be added
+      m_cv.wait_for(lock, std::chrono::milliseconds(1));
+    }
+    else
+      m_cv.wait(lock);
+  }
+
+  if (m_error) {
+    std::exception_ptr error = m_error;
+    m_error = nullptr;
+    std::rethrow_exception(error);
+  }
+}
+
+bool TaskGroup::running() const
+{
+  std::lock_guard lock(m_mutex);
+  return (m_pending > 0);
+}
+
+} // namespace sched
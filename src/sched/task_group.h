@@ -0,0 +1,58 @@
+// Aseprite Scheduler Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef SCHED_TASK_GROUP_H_INCLUDED
+#define SCHED_TASK_GROUP_H_INCLUDED
+#pragma once
+
+#include "sched/scheduler.h"
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+
+namespace sched {
+
+  // A set of tasks executed in a Scheduler that can be waited
+  // (e.g. to replace a std::thread + join()).
+  class TaskGroup {
+  public:
+    typedef Scheduler::Func Func;
+
+    explicit TaskGroup(Priority priority = Priority::Background,
+                       Scheduler& scheduler = Scheduler::instance());
+
+    // Waits all the tasks (exceptions are ignored).
+    ~TaskGroup();
+
+    Priority priority() const { return m_priority; }
+
+    void run(Func&& func);
+
+    // Waits all the tasks, and re-throws the first exception thrown
+    // by them. Worker threads execute other tasks meanwhile (so
+    // tasks can wait other tasks), other threads execute only UI
+    // tasks while they wait UI tasks.
+    void wait();
+
+    // Returns true if there are tasks running or waiting to run.
+    bool running() const;
+
+  private:
+    Scheduler& m_scheduler;
+    Priority m_priority;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_cv;
+    int m_pending;
+    std::exception_ptr m_error;
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+  };
+
+} // namespace sched
+
+#endif
@@ -0,0 +1,42 @@
+// Aseprite UI Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ui/display_list.h"
+
+#include "os/surface.h"
+
+namespace ui {
+
+bool DisplayList::rasterize(os::Surface* surface,
+                            const std::atomic<bool>* stop) const
+{
+  os::SurfaceLock lock(surface);
+
+  // The whole list is executed in a save/restore block, so the clip
+  // and matrix of the surface are restored even if the recorded
+  // commands are unbalanced (or the process is stopped).
+  const int saveCount = surface->getSaveCount();
+  surface->save();
+
+  bool completed = true;
+  for (const Command& cmd : m_commands) {
+    if (stop && *stop) {
+      completed = false;
+      break;
+    }
+    cmd(surface);
+  }
+
+  while (surface->getSaveCount() > saveCount)
+    surface->restore();
+  return completed;
+}
+
+} // namespace ui
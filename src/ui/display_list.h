@@ -0,0 +1,66 @@
+// Aseprite UI Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef UI_DISPLAY_LIST_H_INCLUDED
+#define UI_DISPLAY_LIST_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "gfx/size.h"
+
+#include <atomic>
+#include <functional>
+#include <vector>
+
+namespace os {
+  class Surface;
+}
+
+namespace ui {
+
+  // List of drawing commands recorded by a Graphics (created with
+  // the DisplayList constructor) to be rasterized later in a
+  // surface, generally from the RenderThread.
+  //
+  // Commands keep references to everything they need (fonts,
+  // surfaces, etc.), so they can be rasterized after the widget
+  // onPaint() returns.
+  class DisplayList {
+  public:
+    typedef std::function<void(os::Surface* surface)> Command;
+
+    DisplayList(const gfx::Size& size) : m_size(size) { }
+
+    const gfx::Size& size() const { return m_size; }
+    bool empty() const { return m_commands.empty(); }
+
+    // True if some command must be executed in the UI thread (e.g.
+    // text with a FreeType font, which cannot be used from two
+    // threads at the same time).
+    bool requiresUIThread() const { return m_requiresUIThread; }
+    void setRequiresUIThread() { m_requiresUIThread = true; }
+
+    void add(Command&& cmd) {
+      m_commands.push_back(std::move(cmd));
+    }
+
+    // Executes all commands in the given surface. Returns false if
+    // "stop" was set to true in the middle of the process (e.g.
+    // because a newer list will replace this one).
+    bool rasterize(os::Surface* surface,
+                   const std::atomic<bool>* stop = nullptr) const;
+
+  private:
+    gfx::Size m_size;
+    std::vector<Command> m_commands;
+    bool m_requiresUIThread = false;
+
+    DISABLE_COPYING(DisplayList);
+  };
+
+} // namespace ui
+
+#endif
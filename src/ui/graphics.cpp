@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -43,6 +43,15 @@ Graphics::Graphics(Display* display, const os::SurfaceRef& surface, int dx, int
 {
 }
 
+Graphics::Graphics(DisplayList* displayList, int dx, int dy)
+  : m_display(nullptr)
+  , m_dx(dx)
+  , m_dy(dy)
+  , m_displayList(displayList)
+{
+  m_recordingClips.push_back(gfx::Rect(displayList->size()));
+}
+
 Graphics::~Graphics()
 {
   // If we were drawing in the screen surface, we mark these regions
@@ -53,71 +62,126 @@ Graphics::~Graphics()
 
 int Graphics::width() const
 {
+  if (m_displayList)
+    return m_displayList->size().w;
   return m_surface->width();
 }
 
 int Graphics::height() const
 {
+  if (m_displayList)
+    return m_displayList->size().h;
   return m_surface->height();
 }
 
 int Graphics::getSaveCount() const
 {
+  if (m_displayList)
+    return int(m_recordingClips.size());
   return m_surface->getSaveCount();
 }
 
 gfx::Rect Graphics::getClipBounds() const
 {
+  if (m_displayList)
+    return gfx::Rect(m_recordingClips.back()).offset(-m_dx, -m_dy);
   return m_surface->getClipBounds().offset(-m_dx, -m_dy);
 }
 
 void Graphics::saveClip()
 {
-  m_surface->saveClip();
+  if (m_displayList) {
+    m_recordingClips.push_back(m_recordingClips.back());
+    m_displayList->add([](os::Surface* s){ s->saveClip(); });
+  }
+  else
+    m_surface->saveClip();
 }
 
 void Graphics::restoreClip()
 {
-  m_surface->restoreClip();
+  if (m_displayList) {
+    ASSERT(m_recordingClips.size() > 1);
+    if (m_recordingClips.size() > 1)
+      m_recordingClips.pop_back();
+    m_displayList->add([](os::Surface* s){ s->restoreClip(); });
+  }
+  else
+    m_surface->restoreClip();
 }
 
-bool Graphics::clipRect(const gfx::Rect& rc)
+bool Graphics::clipRect(const gfx::Rect& rcOrig)
 {
-  return m_surface->clipRect(gfx::Rect(rc).offset(m_dx, m_dy));
+  const gfx::Rect rc = gfx::Rect(rcOrig).offset(m_dx, m_dy);
+  if (m_displayList) {
+    gfx::Rect& clip = m_recordingClips.back();
+    clip = clip.createIntersection(rc);
+    m_displayList->add([rc](os::Surface* s){ s->clipRect(rc); });
+    return !clip.isEmpty();
+  }
+  return m_surface->clipRect(rc);
 }
 
 void Graphics::save()
 {
-  m_surface->save();
+  if (m_displayList) {
+    m_recordingClips.push_back(m_recordingClips.back());
+    m_displayList->add([](os::Surface* s){ s->save(); });
+  }
+  else
+    m_surface->save();
 }
 
 void Graphics::concat(const gfx::Matrix& matrix)
 {
-  m_surface->concat(matrix);
+  if (m_displayList)
+    m_displayList->add([matrix](os::Surface* s){ s->concat(matrix); });
+  else
+    m_surface->concat(matrix);
 }
 
 void Graphics::setMatrix(const gfx::Matrix& matrix)
 {
-  m_surface->setMatrix(matrix);
+  if (m_displayList)
+    m_displayList->add([matrix](os::Surface* s){ s->setMatrix(matrix); });
+  else
+    m_surface->setMatrix(matrix);
 }
 
 void Graphics::resetMatrix()
 {
-  m_surface->resetMatrix();
+  if (m_displayList)
+    m_displayList->add([](os::Surface* s){ s->resetMatrix(); });
+  else
+    m_surface->resetMatrix();
 }
 
 void Graphics::restore()
 {
-  m_surface->restore();
+  if (m_displayList) {
+    ASSERT(m_recordingClips.size() > 1);
+    if (m_recordingClips.size() > 1)
+      m_recordingClips.pop_back();
+    m_displayList->add([](os::Surface* s){ s->restore(); });
+  }
+  else
+    m_surface->restore();
 }
 
 gfx::Matrix Graphics::matrix() const
 {
+  if (m_displayList)
+    return gfx::Matrix();
   return m_surface->matrix();
 }
 
 gfx::Color Graphics::getPixel(int x, int y)
 {
+  // We cannot read pixels from a display list
+  ASSERT(!m_displayList);
+  if (m_displayList)
+    return gfx::ColorNone;
+
   os::SurfaceLock lock(m_surface.get());
   return m_surface->getPixel(m_dx+x, m_dy+y);
 }
@@ -126,44 +190,54 @@ void Graphics::putPixel(gfx::Color color, int x, int y)
 {
   dirty(gfx::Rect(m_dx+x, m_dy+y, 1, 1));
 
-  os::SurfaceLock lock(m_surface.get());
-  m_surface->putPixel(color, m_dx+x, m_dy+y);
+  const gfx::Point pt(m_dx+x, m_dy+y);
+  draw([color, pt](os::Surface* s){
+    s->putPixel(color, pt.x, pt.y);
+  });
 }
 
 void Graphics::drawHLine(int x, int y, int w, const Paint& paint)
 {
-  dirty(gfx::Rect(m_dx+x, m_dy+y, w, 1));
+  const gfx::Rect rc(m_dx+x, m_dy+y, w, 1);
+  dirty(rc);
 
-  os::SurfaceLock lock(m_surface.get());
-  m_surface->drawRect(gfx::Rect(m_dx+x, m_dy+y, w, 1), paint);
+  draw([rc, paint](os::Surface* s){
+    s->drawRect(rc, paint);
+  });
 }
 
 void Graphics::drawHLine(gfx::Color color, int x, int y, int w)
 {
-  dirty(gfx::Rect(m_dx+x, m_dy+y, w, 1));
+  const gfx::Rect rc(m_dx+x, m_dy+y, w, 1);
+  dirty(rc);
 
-  os::SurfaceLock lock(m_surface.get());
   os::Paint paint;
   paint.color(color);
-  m_surface->drawRect(gfx::Rect(m_dx+x, m_dy+y, w, 1), paint);
+  draw([rc, paint](os::Surface* s){
+    s->drawRect(rc, paint);
+  });
 }
 
 void Graphics::drawVLine(int x, int y, int h, const Paint& paint)
 {
-  dirty(gfx::Rect(m_dx+x, m_dy+y, 1, h));
+  const gfx::Rect rc(m_dx+x, m_dy+y, 1, h);
+  dirty(rc);
 
-  os::SurfaceLock lock(m_surface.get());
-  m_surface->drawRect(gfx::Rect(m_dx+x, m_dy+y, 1, h), paint);
+  draw([rc, paint](os::Surface* s){
+    s->drawRect(rc, paint);
+  });
 }
 
 void Graphics::drawVLine(gfx::Color color, int x, int y, int h)
 {
-  dirty(gfx::Rect(m_dx+x, m_dy+y, 1, h));
+  const gfx::Rect rc(m_dx+x, m_dy+y, 1, h);
+  dirty(rc);
 
-  os::SurfaceLock lock(m_surface.get());
   os::Paint paint;
   paint.color(color);
-  m_surface->drawRect(gfx::Rect(m_dx+x, m_dy+y, 1, h), paint);
+  draw([rc, paint](os::Surface* s){
+    s->drawRect(rc, paint);
+  });
 }
 
 void Graphics::drawLine(gfx::Color color, const gfx::Point& _a, const gfx::Point& _b)
@@ -172,14 +246,28 @@ void Graphics::drawLine(gfx::Color color, const gfx::Point& _a, const gfx::Point
   gfx::Point b(m_dx+_b.x, m_dy+_b.y);
   dirty(gfx::Rect(a, b));
 
-  os::SurfaceLock lock(m_surface.get());
   os::Paint paint;
   paint.color(color);
-  m_surface->drawLine(a, b, paint);
+  draw([a, b, paint](os::Surface* s){
+    s->drawLine(a, b, paint);
+  });
 }
 
 void Graphics::drawPath(gfx::Path& path, const Paint& paint)
 {
+  if (m_displayList) {
+    const int dx = m_dx, dy = m_dy;
+    m_displayList->add([path, paint, dx, dy](os::Surface* s) mutable {
+      auto m = s->matrix();
+      s->save();
+      s->setMatrix(gfx::Matrix::MakeTrans(dx, dy));
+      s->concat(m);
+      s->drawPath(path, paint);
+      s->restore();
+    });
+    return;
+  }
+
   os::SurfaceLock lock(m_surface.get());
 
   auto m = matrix();
@@ -199,8 +287,9 @@ void Graphics::drawRect(const gfx::Rect& rcOrig, const Paint& paint)
   rc.offset(m_dx, m_dy);
   dirty(rc);
 
-  os::SurfaceLock lock(m_surface.get());
-  m_surface->drawRect(rc, paint);
+  draw([rc, paint](os::Surface* s){
+    s->drawRect(rc, paint);
+  });
 }
 
 void Graphics::drawRect(gfx::Color color, const gfx::Rect& rcOrig)
@@ -209,11 +298,12 @@ void Graphics::drawRect(gfx::Color color, const gfx::Rect& rcOrig)
   rc.offset(m_dx, m_dy);
   dirty(rc);
 
-  os::SurfaceLock lock(m_surface.get());
   os::Paint paint;
   paint.color(color);
   paint.style(os::Paint::Stroke);
-  m_surface->drawRect(rc, paint);
+  draw([rc, paint](os::Surface* s){
+    s->drawRect(rc, paint);
+  });
 }
 
 void Graphics::fillRect(gfx::Color color, const gfx::Rect& rcOrig)
@@ -222,11 +312,12 @@ void Graphics::fillRect(gfx::Color color, const gfx::Rect& rcOrig)
   rc.offset(m_dx, m_dy);
   dirty(rc);
 
-  os::SurfaceLock lock(m_surface.get());
   os::Paint paint;
   paint.color(color);
   paint.style(os::Paint::Fill);
-  m_surface->drawRect(rc, paint);
+  draw([rc, paint](os::Surface* s){
+    s->drawRect(rc, paint);
+  });
 }
 
 void Graphics::fillRegion(gfx::Color color, const gfx::Region& rgn)
@@ -251,9 +342,11 @@ void Graphics::drawSurface(os::Surface* surface, int x, int y)
 {
   dirty(gfx::Rect(m_dx+x, m_dy+y, surface->width(), surface->height()));
 
-  os::SurfaceLock lockSrc(surface);
-  os::SurfaceLock lockDst(m_surface.get());
-  m_surface->drawSurface(surface, m_dx+x, m_dy+y);
+  const gfx::Point pt(m_dx+x, m_dy+y);
+  draw([src = base::AddRef(surface), pt](os::Surface* s){
+    os::SurfaceLock lockSrc(src.get());
+    s->drawSurface(src.get(), pt.x, pt.y);
+  });
 }
 
 void Graphics::drawSurface(os::Surface* surface,
@@ -265,42 +358,48 @@ void Graphics::drawSurface(os::Surface* surface,
   dirty(gfx::Rect(m_dx+dstRect.x, m_dy+dstRect.y,
                   dstRect.w, dstRect.h));
 
-  os::SurfaceLock lockSrc(surface);
-  os::SurfaceLock lockDst(m_surface.get());
-  m_surface->drawSurface(
-    surface,
-    srcRect,
-    gfx::Rect(dstRect).offset(m_dx, m_dy),
-    sampling,
-    paint);
+  const gfx::Rect dst = gfx::Rect(dstRect).offset(m_dx, m_dy);
+  const bool hasPaint = (paint != nullptr);
+  const ui::Paint paintCopy = (paint ? *paint: ui::Paint());
+  draw([src = base::AddRef(surface), srcRect, dst, sampling,
+        hasPaint, paintCopy](os::Surface* s){
+    os::SurfaceLock lockSrc(src.get());
+    s->drawSurface(src.get(), srcRect, dst, sampling,
+                   hasPaint ? &paintCopy: nullptr);
+  });
 }
 
 void Graphics::drawRgbaSurface(os::Surface* surface, int x, int y)
 {
   dirty(gfx::Rect(m_dx+x, m_dy+y, surface->width(), surface->height()));
 
-  os::SurfaceLock lockSrc(surface);
-  os::SurfaceLock lockDst(m_surface.get());
-  m_surface->drawRgbaSurface(surface, m_dx+x, m_dy+y);
+  const gfx::Point pt(m_dx+x, m_dy+y);
+  draw([src = base::AddRef(surface), pt](os::Surface* s){
+    os::SurfaceLock lockSrc(src.get());
+    s->drawRgbaSurface(src.get(), pt.x, pt.y);
+  });
 }
 
 void Graphics::drawRgbaSurface(os::Surface* surface, int srcx, int srcy, int dstx, int dsty, int w, int h)
 {
   dirty(gfx::Rect(m_dx+dstx, m_dy+dsty, w, h));
 
-  os::SurfaceLock lockSrc(surface);
-  os::SurfaceLock lockDst(m_surface.get());
-  m_surface->drawRgbaSurface(surface, srcx, srcy, m_dx+dstx, m_dy+dsty, w, h);
+  const gfx::Point pt(m_dx+dstx, m_dy+dsty);
+  draw([src = base::AddRef(surface), srcx, srcy, pt, w, h](os::Surface* s){
+    os::SurfaceLock lockSrc(src.get());
+    s->drawRgbaSurface(src.get(), srcx, srcy, pt.x, pt.y, w, h);
+  });
 }
 
 void Graphics::drawColoredRgbaSurface(os::Surface* surface, gfx::Color color, int x, int y)
 {
   dirty(gfx::Rect(m_dx+x, m_dy+y, surface->width(), surface->height()));
 
-  os::SurfaceLock lockSrc(surface);
-  os::SurfaceLock lockDst(m_surface.get());
-  m_surface->drawColoredRgbaSurface(surface, color, gfx::ColorNone,
-    gfx::Clip(m_dx+x, m_dy+y, 0, 0, surface->width(), surface->height()));
+  const gfx::Clip clip(m_dx+x, m_dy+y, 0, 0, surface->width(), surface->height());
+  draw([src = base::AddRef(surface), color, clip](os::Surface* s){
+    os::SurfaceLock lockSrc(src.get());
+    s->drawColoredRgbaSurface(src.get(), color, gfx::ColorNone, clip);
+  });
 }
 
 void Graphics::drawColoredRgbaSurface(os::Surface* surface, gfx::Color color,
@@ -308,10 +407,11 @@ void Graphics::drawColoredRgbaSurface(os::Surface* surface, gfx::Color color,
 {
   dirty(gfx::Rect(m_dx+dstx, m_dy+dsty, w, h));
 
-  os::SurfaceLock lockSrc(surface);
-  os::SurfaceLock lockDst(m_surface.get());
-  m_surface->drawColoredRgbaSurface(surface, color, gfx::ColorNone,
-    gfx::Clip(m_dx+dstx, m_dy+dsty, srcx, srcy, w, h));
+  const gfx::Clip clip(m_dx+dstx, m_dy+dsty, srcx, srcy, w, h);
+  draw([src = base::AddRef(surface), color, clip](os::Surface* s){
+    os::SurfaceLock lockSrc(src.get());
+    s->drawColoredRgbaSurface(src.get(), color, gfx::ColorNone, clip);
+  });
 }
 
 void Graphics::drawSurfaceNine(os::Surface* surface,
@@ -324,18 +424,25 @@ void Graphics::drawSurfaceNine(os::Surface* surface,
   gfx::Rect displacedDst(m_dx+dst.x, m_dy+dst.y, dst.w, dst.h);
   dirty(displacedDst);
 
-  os::SurfaceLock lockSrc(surface);
-  os::SurfaceLock lockDst(m_surface.get());
-  m_surface->drawSurfaceNine(surface, src, center, displacedDst, drawCenter, paint);
+  const bool hasPaint = (paint != nullptr);
+  const ui::Paint paintCopy = (paint ? *paint: ui::Paint());
+  draw([srcSurface = base::AddRef(surface), src, center, displacedDst,
+        drawCenter, hasPaint, paintCopy](os::Surface* s){
+    os::SurfaceLock lockSrc(srcSurface.get());
+    s->drawSurfaceNine(srcSurface.get(), src, center, displacedDst, drawCenter,
+                       hasPaint ? &paintCopy: nullptr);
+  });
 }
 
 void Graphics::blit(os::Surface* srcSurface, int srcx, int srcy, int dstx, int dsty, int w, int h)
 {
   dirty(gfx::Rect(m_dx+dstx, m_dy+dsty, w, h));
 
-  os::SurfaceLock lockSrc(srcSurface);
-  os::SurfaceLock lockDst(m_surface.get());
-  srcSurface->blitTo(m_surface.get(), srcx, srcy, m_dx+dstx, m_dy+dsty, w, h);
+  const gfx::Point pt(m_dx+dstx, m_dy+dsty);
+  draw([src = base::AddRef(srcSurface), srcx, srcy, pt, w, h](os::Surface* s){
+    os::SurfaceLock lockSrc(src.get());
+    src->blitTo(s, srcx, srcy, pt.x, pt.y, w, h);
+  });
 }
 
 void Graphics::setFont(const os::FontRef& font)
@@ -350,6 +457,16 @@ void Graphics::drawText(const std::string& str,
 {
   gfx::Point pt(m_dx+origPt.x, m_dy+origPt.y);
 
+  if (m_displayList) {
+    // The delegate could be destroyed before the list is rasterized
+    ASSERT(!delegate);
+    recordTextFont();
+    m_displayList->add([str, fg, bg, pt, font = m_font](os::Surface* s){
+      os::draw_text(s, font.get(), str, fg, bg, pt.x, pt.y, nullptr);
+    });
+    return;
+  }
+
   os::SurfaceLock lock(m_surface.get());
   gfx::Rect textBounds =
     os::draw_text(m_surface.get(), m_font.get(), str, fg, bg, pt.x, pt.y, delegate);
@@ -425,10 +542,20 @@ private:
 void Graphics::drawUIText(const std::string& str, gfx::Color fg, gfx::Color bg,
                           const gfx::Point& pt, const int mnemonic)
 {
-  os::SurfaceLock lock(m_surface.get());
   int x = m_dx+pt.x;
   int y = m_dy+pt.y;
 
+  if (m_displayList) {
+    recordTextFont();
+    m_displayList->add([str, fg, bg, x, y, mnemonic, font = m_font](os::Surface* s){
+      DrawUITextDelegate delegate(s, font.get(), mnemonic);
+      os::draw_text(s, font.get(), str, fg, bg, x, y, &delegate);
+    });
+    return;
+  }
+
+  os::SurfaceLock lock(m_surface.get());
+
   DrawUITextDelegate delegate(m_surface.get(), m_font.get(), mnemonic);
   os::draw_text(m_surface.get(), m_font.get(), str,
                 fg, bg, x, y, &delegate);
@@ -594,8 +721,20 @@ void Graphics::invalidate(const gfx::Rect& bounds)
   dirty(gfx::Rect(bounds).offset(m_dx, m_dy));
 }
 
+void Graphics::recordTextFont()
+{
+  // FreeType faces cannot be used from two threads at the same time
+  // (the UI thread keeps using the font to measure/draw text)
+  if (m_font && m_font->type() == os::FontType::FreeType)
+    m_displayList->setRequiresUIThread();
+}
+
 void Graphics::dirty(const gfx::Rect& bounds)
 {
+  // The whole display list area will be used when it's rasterized
+  if (m_displayList)
+    return;
+
   gfx::Rect rc = m_surface->getClipBounds();
   rc = rc.createIntersection(bounds);
   if (!rc.isEmpty())
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,10 +17,12 @@
 #include "gfx/size.h"
 #include "os/font.h"
 #include "os/surface.h"
+#include "ui/display_list.h"
 #include "ui/paint.h"
 
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace gfx {
   class Matrix;
@@ -40,11 +42,20 @@ namespace ui {
   class Graphics {
   public:
     Graphics(Display* display, const os::SurfaceRef& surface, int dx, int dy);
+
+    // Records all drawing commands in the given display list instead
+    // of drawing them in a surface. In this mode getInternalSurface()
+    // returns nullptr, getPixel() cannot be used, text delegates are
+    // ignored, and matrix() returns the identity (the real matrix is
+    // known only when the list is rasterized).
+    Graphics(DisplayList* displayList, int dx, int dy);
     ~Graphics();
 
     int width() const;
     int height() const;
 
+    bool isRecording() const { return m_displayList != nullptr; }
+
     os::Surface* getInternalSurface() { return m_surface.get(); }
     int getInternalDeltaX() { return m_dx; }
     int getInternalDeltaY() { return m_dy; }
@@ -124,6 +135,20 @@ namespace ui {
   private:
     gfx::Size doUIStringAlgorithm(const std::string& str, gfx::Color fg, gfx::Color bg, const gfx::Rect& rc, int align, bool draw);
     void dirty(const gfx::Rect& bounds);
+    void recordTextFont();
+
+    // Executes the given function with the internal surface, or
+    // records it in the display list.
+    template<typename Func>
+    void draw(Func&& func) {
+      if (m_displayList) {
+        m_displayList->add(std::forward<Func>(func));
+      }
+      else {
+        os::SurfaceLock lock(m_surface.get());
+        func(m_surface.get());
+      }
+    }
 
     Display* m_display;
     os::SurfaceRef m_surface;
@@ -132,6 +157,12 @@ namespace ui {
     gfx::Rect m_clipBounds;
     os::FontRef m_font;
     gfx::Rect m_dirtyBounds;
+
+    // Display list in recording mode, and the clip bounds of each
+    // save()/saveClip() level (in surface coordinates) to answer
+    // getClipBounds() without a surface.
+    DisplayList* m_displayList = nullptr;
+    std::vector<gfx::Rect> m_recordingClips;
   };
 
   // Class to draw directly in the screen.
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -28,6 +28,7 @@
 #include "os/system.h"
 #include "os/window.h"
 #include "os/window_spec.h"
+#include "perf/trace.h"
 #include "ui/intern.h"
 #include "ui/ui.h"
 
@@ -619,7 +620,7 @@ void Manager::handleMouseMove(Display* display,
 
   // Send the mouse movement message
   Widget* dst = (capture_widget ? capture_widget: mouse_widget);
-  enqueueMessage(
+  auto msg = static_cast<MouseMessage*>(
     newMouseMessage(
       kMouseMoveMessage,
       display, dst,
@@ -630,6 +631,29 @@ void Manager::handleMouseMove(Display* display,
       gfx::Point(0, 0),
       false,
       pressure));
+
+  // If the last queued message is a mouse movement for the same
+  // widget (with the same buttons/modifiers), we coalesce this new
+  // position into that message, so high-rate mice/pens generate just
+  // one kMouseMoveMessage per batch of OS events (and the widget can
+  // still access the intermediate positions).
+  if (!msg_queue.empty()) {
+    Message* back = msg_queue.back();
+    if (back->type() == kMouseMoveMessage &&
+        back->display() == msg->display() &&
+        back->recipient() == msg->recipient() &&
+        back->modifiers() == msg->modifiers()) {
+      auto backMouseMsg = static_cast<MouseMessage*>(back);
+      if (backMouseMsg->button() == msg->button() &&
+          backMouseMsg->pointerType() == msg->pointerType()) {
+        backMouseMsg->coalesce(msg->position(), msg->pressure());
+        delete msg;
+        return;
+      }
+    }
+  }
+
+  enqueueMessage(msg);
 }
 
 void Manager::handleMouseDown(Display* display,
@@ -850,6 +874,8 @@ void Manager::updateMouseWidgets(const gfx::Point& mousePos,
 
 void Manager::dispatchMessages()
 {
+  PERF_ZONE("Manager::dispatchMessages");
+
   // Send messages in the queue (mouse/key/timer/etc. events) This
   // might change the state of widgets, etc. In case pumpQueue()
   // returns a number greater than 0, it means that we've processed
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2021  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -68,6 +68,18 @@ KeyMessage::KeyMessage(MessageType type,
   setPropagateToParent(true);
 }
 
+void MouseMessage::coalesce(const gfx::Point& pos, const float pressure)
+{
+  ASSERT(type() == kMouseMoveMessage);
+
+  if (int(m_samples.size()) >= kMaxCoalescedSamples)
+    m_samples.erase(m_samples.begin());
+  m_samples.push_back(Sample{ m_pos, m_pressure });
+
+  m_pos = pos;
+  m_pressure = pressure;
+}
+
 gfx::Point MouseMessage::positionForDisplay(Display* anotherDisplay) const
 {
   if (display() == anotherDisplay) {
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2022  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -18,6 +18,8 @@
 #include "ui/mouse_button.h"
 #include "ui/pointer_type.h"
 
+#include <vector>
+
 namespace ui {
 
   class Display;
@@ -120,6 +122,15 @@ namespace ui {
 
   class MouseMessage : public Message {
   public:
+    // Mouse position (and pressure) of a kMouseMoveMessage that was
+    // coalesced with the next one.
+    struct Sample {
+      gfx::Point pos;
+      float pressure;
+    };
+    using Samples = std::vector<Sample>;
+    static constexpr int kMaxCoalescedSamples = 128;
+
     MouseMessage(MessageType type,
                  PointerType pointerType,
                  MouseButton button,
@@ -161,6 +172,19 @@ namespace ui {
 
     const gfx::Point& position() const { return m_pos; }
 
+    // Previous positions of a kMouseMoveMessage (from the oldest to
+    // the newest one, without including position()) that were
+    // received in the same batch of events (e.g. from high-rate mice
+    // or pen tablets). Widgets that need all the points (e.g.
+    // freehand tools) can process them in one step, other widgets
+    // can just use the last position().
+    const Samples& coalescedSamples() const { return m_samples; }
+
+    // Moves the current position to the list of coalesced samples
+    // and uses the given position as the new one. Only the latest
+    // kMaxCoalescedSamples are kept.
+    void coalesce(const gfx::Point& pos, const float pressure);
+
     // Returns the mouse message position relative to the given
     // "anotherDisplay" (the m_pos field is relative to m_display).
     gfx::Point positionForDisplay(Display* anotherDisplay) const;
@@ -175,6 +199,7 @@ namespace ui {
     gfx::Point m_wheelDelta;    // Wheel axis variation
     bool m_preciseWheel;
     float m_pressure;
+    Samples m_samples;          // Previous coalesced positions
   };
 
   class TouchMessage : public Message {
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -50,4 +50,42 @@ void set_checkered_paint_mode(Paint& paint,
 #endif
 }
 
+bool set_grid_paint_mode(Paint& paint,
+                         const gfx::Size& cellSize,
+                         const gfx::Point& origin,
+                         const gfx::Color color)
+{
+#if LAF_SKIA
+  if (cellSize.w < 1 || cellSize.h < 1)
+    return false;
+
+  SkPaint& skPaint = paint.skPaint();
+  skPaint.setBlendMode(SkBlendMode::kSrcOver);
+
+  SkBitmap bitmap;
+  if (!bitmap.tryAllocPixels(
+        SkImageInfo::MakeN32(cellSize.w, cellSize.h, kPremul_SkAlphaType))) {
+    return false;
+  }
+  bitmap.eraseColor(SK_ColorTRANSPARENT);
+
+  const SkPMColor c = SkPreMultiplyARGB(gfx::geta(color), gfx::getr(color),
+                                        gfx::getg(color), gfx::getb(color));
+  for (int x=0; x<cellSize.w; ++x)
+    *bitmap.getAddr32(x, 0) = c;
+  for (int y=1; y<cellSize.h; ++y)
+    *bitmap.getAddr32(0, y) = c;
+
+  const SkMatrix matrix = SkMatrix::Translate(origin.x, origin.y);
+  skPaint.setShader(
+    bitmap.makeShader(SkTileMode::kRepeat,
+                      SkTileMode::kRepeat,
+                      SkSamplingOptions(),
+                      &matrix));
+  return true;
+#else
+  return false;
+#endif
+}
+
 } // namespace ui
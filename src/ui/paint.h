@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2022  Igara Studio S.A.
+// Copyright (C) 2022-2024  Igara Studio S.A.
 //
 // This file is released under the terms of the MIT license.
 // Read LICENSE.txt for more information.
@@ -10,6 +10,8 @@
 
 #include "base/disable_copying.h"
 #include "gfx/color.h"
+#include "gfx/point.h"
+#include "gfx/size.h"
 #include "os/paint.h"
 
 namespace ui {
@@ -22,6 +24,15 @@ namespace ui {
                                 const gfx::Color a,
                                 const gfx::Color b);
 
+  // Sets a shader that repeats a cell of the given size with a 1px
+  // line at its left and top sides (a grid), starting from the given
+  // origin in surface coordinates. Returns false if the grid shader
+  // isn't supported (so the lines must be drawn one by one).
+  bool set_grid_paint_mode(Paint& paint,
+                           const gfx::Size& cellSize,
+                           const gfx::Point& origin,
+                           const gfx::Color color);
+
 } // namespace ui
 
 #endif
@@ -0,0 +1,176 @@
+// Aseprite UI Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "ui/render_thread.h"
+
+#include "base/debug.h"
+#include "ui/display_list.h"
+#include "ui/system.h"
+#include "ui/widget.h"
+
+#include <algorithm>
+
+namespace ui {
+
+// static
+RenderThread* RenderThread::instance()
+{
+  static RenderThread instance;
+  return &instance;
+}
+
+RenderThread::RenderThread()
+  : m_stop(false)
+{
+}
+
+void RenderThread::addRef()
+{
+  assert_ui_thread();
+
+  if (m_ref == 0)
+    m_thread = std::thread([this]{ renderProc(); });
+
+  ++m_ref;
+}
+
+void RenderThread::releaseRef()
+{
+  assert_ui_thread();
+  ASSERT(m_ref > 0);
+
+  --m_ref;
+  if (m_ref == 0) {
+    {
+      std::lock_guard lock(m_mutex);
+      m_killing = true;
+      m_stop = true;
+      m_queueCV.notify_one();
+    }
+
+    m_thread.join();
+
+    std::lock_guard lock(m_mutex);
+    m_killing = false;
+    m_jobs.clear();
+    m_queue.clear();
+  }
+}
+
+void RenderThread::render(Widget* widget,
+                          std::unique_ptr<DisplayList>&& list,
+                          const os::SurfaceRef& surface)
+{
+  assert_ui_thread();
+  ASSERT(m_ref > 0);
+
+  std::lock_guard lock(m_mutex);
+  Job& job = m_jobs[widget];
+  const bool queued = (job.list != nullptr);
+
+  job.list = std::move(list);
+  job.surface = surface;
+  job.generation = ++m_generation;
+  job.done = false;
+
+  // The list that is being rasterized is outdated
+  if (m_rendering == widget)
+    m_stop = true;
+
+  if (!queued)
+    m_queue.push_back(widget);
+  m_queueCV.notify_one();
+}
+
+void RenderThread::cancel(Widget* widget)
+{
+  assert_ui_thread();
+
+  std::unique_lock lock(m_mutex);
+  if (m_rendering == widget) {
+    m_stop = true;
+    m_renderedCV.wait(lock, [this, widget]{ return m_rendering != widget; });
+  }
+
+  m_jobs.erase(widget);
+  m_queue.erase(std::remove(m_queue.begin(), m_queue.end(), widget),
+                m_queue.end());
+}
+
+void RenderThread::renderProc()
+{
+  std::unique_lock lock(m_mutex);
+  while (true) {
+    m_queueCV.wait(lock, [this]{ return m_killing || !m_queue.empty(); });
+    if (m_killing)
+      break;
+
+    Widget* widget = m_queue.front();
+    m_queue.pop_front();
+
+    auto it = m_jobs.find(widget);
+    if (it == m_jobs.end() || !it->second.list)
+      continue;
+
+    // The list and the surface are released in the UI thread (as
+    // they can contain the last reference to fonts and surfaces)
+    std::shared_ptr<DisplayList> list(std::move(it->second.list));
+    os::SurfaceRef surface = it->second.surface;
+    const int generation = it->second.generation;
+    m_rendering = widget;
+    m_stop = false;
+
+    // Do the intensive painting without the lock
+    lock.unlock();
+    const bool completed = list->rasterize(surface.get(), &m_stop);
+    lock.lock();
+
+    m_rendering = nullptr;
+    m_renderedCV.notify_all();
+
+    it = m_jobs.find(widget);
+    if (completed &&
+        it != m_jobs.end() &&
+        it->second.generation == generation) {
+      it->second.done = true;
+    }
+
+    execute_from_ui_thread(
+      [this, widget, generation,
+       list = std::move(list),
+       surface = std::move(surface)]{
+        onRendered(widget, generation);
+      });
+  }
+}
+
+void RenderThread::onRendered(Widget* widget, const int generation)
+{
+  assert_ui_thread();
+
+  os::SurfaceRef surface;
+  {
+    // If the job is still here, the widget wasn't deleted (see
+    // cancel())
+    std::lock_guard lock(m_mutex);
+    auto it = m_jobs.find(widget);
+    if (it == m_jobs.end() ||
+        it->second.generation != generation ||
+        !it->second.done)
+      return;
+
+    surface = it->second.surface;
+    m_jobs.erase(it);
+  }
+
+  widget->setRenderedPaintCache(surface);
+}
+
+} // namespace ui
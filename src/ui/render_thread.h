@@ -0,0 +1,83 @@
+// Aseprite UI Library
+// Copyright (C) 2024  Igara Studio S.A.
+//
+// This file is released under the terms of the MIT license.
+// Read LICENSE.txt for more information.
+
+#ifndef UI_RENDER_THREAD_H_INCLUDED
+#define UI_RENDER_THREAD_H_INCLUDED
+#pragma once
+
+#include "base/disable_copying.h"
+#include "os/surface.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace ui {
+
+  class DisplayList;
+  class Widget;
+
+  // Background thread to rasterize the display lists recorded by the
+  // widgets painted with Widget::setPaintInRenderThread().
+  //
+  // Each widget has at most one list in the queue: a new list
+  // replaces the queued one (or stops the one that is being
+  // rasterized), so it must repaint the areas of the previous one
+  // too. When a list is rasterized, the surface is given back to the
+  // widget from the UI thread.
+  class RenderThread {
+  public:
+    static RenderThread* instance();
+
+    // The thread is running while there is at least one widget using
+    // it.
+    void addRef();
+    void releaseRef();
+
+    // Rasterizes the list in the given surface in the background
+    // thread.
+    void render(Widget* widget,
+                std::unique_ptr<DisplayList>&& list,
+                const os::SurfaceRef& surface);
+
+    // Discards the list of the given widget, waiting for it if it's
+    // being rasterized right now (e.g. before deleting the widget).
+    void cancel(Widget* widget);
+
+  private:
+    struct Job {
+      std::unique_ptr<DisplayList> list; // nullptr if it's not in the queue
+      os::SurfaceRef surface;
+      int generation = 0;
+      bool done = false;
+    };
+
+    RenderThread();
+    void renderProc();
+    void onRendered(Widget* widget, const int generation);
+
+    int m_ref = 0;
+    bool m_killing = false;
+    std::mutex m_mutex;
+    std::condition_variable m_queueCV;
+    std::condition_variable m_renderedCV;
+    std::map<Widget*, Job> m_jobs;
+    std::deque<Widget*> m_queue;
+    int m_generation = 0;
+    Widget* m_rendering = nullptr;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+
+    DISABLE_COPYING(RenderThread);
+  };
+
+} // namespace ui
+
+#endif
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2019-2022  Igara Studio S.A.
+// Copyright (C) 2019-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -21,6 +21,7 @@
 #include "ui/cursor.h"
 #include "ui/cursor_type.h"
 #include "ui/display.h"
+#include "ui/display_list.h"
 #include "ui/entry.h"
 #include "ui/event.h"
 #include "ui/fit_bounds.h"
@@ -51,6 +52,7 @@
 #include "ui/popup_window.h"
 #include "ui/property.h"
 #include "ui/register_message.h"
+#include "ui/render_thread.h"
 #include "ui/resize_event.h"
 #include "ui/save_layout_event.h"
 #include "ui/scale.h"
@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -17,10 +17,12 @@
 #include "base/string.h"
 #include "base/utf8_decode.h"
 #include "os/font.h"
+#include "os/sampling.h"
 #include "os/surface.h"
 #include "os/system.h"
 #include "os/window.h"
 #include "ui/app_state.h"
+#include "ui/display_list.h"
 #include "ui/init_theme_event.h"
 #include "ui/intern.h"
 #include "ui/layout_io.h"
@@ -29,6 +31,7 @@
 #include "ui/message.h"
 #include "ui/move_region.h"
 #include "ui/paint_event.h"
+#include "ui/render_thread.h"
 #include "ui/resize_event.h"
 #include "ui/save_layout_event.h"
 #include "ui/size_hint_event.h"
@@ -43,6 +46,7 @@
 #include <cstdio>
 #include <cstring>
 #include <limits>
+#include <memory>
 #include <queue>
 #include <sstream>
 
@@ -72,6 +76,8 @@ Widget::Widget(WidgetType type)
   , m_maxSize(std::numeric_limits<int>::max(),
               std::numeric_limits<int>::max())
   , m_childSpacing(0)
+  , m_paintCached(false)
+  , m_paintInRenderThread(false)
 {
   details::addWidget(this);
 }
@@ -83,6 +89,10 @@ Widget::~Widget()
   while (!m_children.empty())
     delete m_children.front();
 
+  // The RenderThread cannot use this widget anymore
+  if (m_paintInRenderThread)
+    setPaintInRenderThread(false);
+
   // Break relationship with the manager. This cannot be before
   // deleting children, if we delete children after releasing the
   // parent, a children deletion could generate a kMouseLeaveMessage
@@ -117,6 +127,11 @@ void Widget::deferDelete()
 
 void Widget::initTheme()
 {
+  // The theme or the UI scale can change, the cache will be created
+  // again with the new size in the next paint message.
+  m_paintCache.reset();
+  cancelPaintInRenderThread();
+
   InitThemeEvent ev(this, m_theme);
   onInitTheme(ev);
 }
@@ -786,7 +801,11 @@ void Widget::setBoundsQuietly(const gfx::Rect& rc)
   // TODO Test moving this inside the if (m_bounds != rc) { ... }
   // block, so the widget is invalidted only when the bounds are
   // really changed.
-  invalidate();
+  //
+  // We use invalidateRegion() so the paint cache is kept when the
+  // widget is just moved (e.g. scrolled inside a View), it's
+  // repainted anyway when the size changes.
+  invalidateRegion(gfx::Region(bounds()));
 }
 
 void Widget::setBorder(const Border& br)
@@ -1258,6 +1277,7 @@ void Widget::setTransparent(bool transparent)
 void Widget::invalidate()
 {
   assert_ui_thread();
+  invalidatePaintCache();
   if (!hasFlags(HIDDEN))        // Quick filter for hidden widgets
     onInvalidateRegion(Region(bounds()));
 }
@@ -1265,6 +1285,7 @@ void Widget::invalidate()
 void Widget::invalidateRect(const gfx::Rect& rect)
 {
   assert_ui_thread();
+  invalidatePaintCache(rect);
   if (!hasFlags(HIDDEN))        // Quick filter for hidden widgets
     onInvalidateRegion(Region(rect));
 }
@@ -1276,6 +1297,160 @@ void Widget::invalidateRegion(const Region& region)
     onInvalidateRegion(region);
 }
 
+void Widget::setPaintCached(bool state)
+{
+  if (!state && m_paintInRenderThread)
+    setPaintInRenderThread(false);
+
+  m_paintCached = state;
+  m_paintCache.reset();
+  m_paintCacheDirty.clear();
+  cancelPaintInRenderThread();
+}
+
+void Widget::setPaintInRenderThread(bool state)
+{
+  if (m_paintInRenderThread == state)
+    return;
+
+  if (state) {
+    if (!m_paintCached)
+      setPaintCached(true);
+    RenderThread::instance()->addRef();
+    m_paintInRenderThread = true;
+  }
+  else {
+    cancelPaintInRenderThread();
+    m_paintInRenderThread = false;
+    RenderThread::instance()->releaseRef();
+  }
+}
+
+void Widget::invalidatePaintCache()
+{
+  if (m_paintCache)
+    m_paintCacheDirty = gfx::Region(gfx::Rect(m_bounds.size()));
+}
+
+void Widget::invalidatePaintCache(const gfx::Rect& rect)
+{
+  if (m_paintCache)
+    m_paintCacheDirty |= gfx::Region(gfx::Rect(rect).offset(-m_bounds.origin()));
+}
+
+bool Widget::paintFromCache(const gfx::Rect& clientRect)
+{
+  Display* display = this->display();
+  const gfx::Size size = m_bounds.size();
+
+  // Create the cache (we don't cache widgets bigger than the
+  // display, e.g. a big widget inside a View)
+  if (!m_paintCache ||
+      m_paintCache->width() != size.w ||
+      m_paintCache->height() != size.h) {
+    const os::Surface* displaySurface = display->surface();
+    if (size.w*size.h > displaySurface->width()*displaySurface->height()) {
+      m_paintCache.reset();
+      cancelPaintInRenderThread();
+      return false;
+    }
+
+    m_paintCache = os::instance()->makeSurface(size.w, size.h);
+    m_paintCacheDirty = gfx::Region(gfx::Rect(size));
+    cancelPaintInRenderThread();
+  }
+  // A new cache is painted in this thread (so we don't display an
+  // empty surface), then the dirty areas can be painted in the
+  // RenderThread.
+  else if (m_paintInRenderThread &&
+           !m_paintCacheDirty.isEmpty()) {
+    paintCacheInRenderThread();
+  }
+
+  // Repaint the invalidated areas
+  if (!m_paintCacheDirty.isEmpty()) {
+    Graphics graphics(display, m_paintCache, 0, 0);
+    graphics.setFont(AddRef(font()));
+
+    for (const gfx::Rect& rc : m_paintCacheDirty) {
+      IntersectClip clip(&graphics, rc);
+      if (clip)
+        paintEvent(&graphics, false);
+    }
+    m_paintCacheDirty.clear();
+  }
+
+  GraphicsPtr graphics = getGraphics(clientRect);
+  os::Paint paint;
+  paint.blendMode(os::BlendMode::Src);
+  graphics->drawSurface(m_paintCache.get(), clientRect, clientRect,
+                        os::Sampling(), &paint);
+  return true;
+}
+
+void Widget::paintCacheInRenderThread()
+{
+  const gfx::Size size = m_bounds.size();
+
+  // A previous list could be still pending, this new list replaces it
+  // so it must repaint the pending areas too.
+  gfx::Region rgn(m_paintCacheDirty);
+  rgn |= m_paintCachePending;
+  m_paintCacheDirty.clear();
+
+  auto list = std::make_unique<DisplayList>(size);
+  {
+    Graphics graphics(list.get(), 0, 0);
+    graphics.setFont(AddRef(font()));
+
+    for (const gfx::Rect& rc : rgn) {
+      IntersectClip clip(&graphics, rc);
+      if (clip)
+        paintEvent(&graphics, false);
+    }
+  }
+
+  if (list->requiresUIThread()) {
+    cancelPaintInRenderThread();
+    list->rasterize(m_paintCache.get());
+    return;
+  }
+
+  // The list is rasterized in a copy of the current cache, which is
+  // displayed until the new one is ready.
+  os::SurfaceRef surface = os::instance()->makeSurface(size.w, size.h);
+  {
+    os::SurfaceLock lockSrc(m_paintCache.get());
+    os::SurfaceLock lockDst(surface.get());
+    m_paintCache->blitTo(surface.get(), 0, 0, 0, 0, size.w, size.h);
+  }
+
+  m_paintCachePending = rgn;
+  RenderThread::instance()->render(this, std::move(list), surface);
+}
+
+void Widget::cancelPaintInRenderThread()
+{
+  if (m_paintInRenderThread)
+    RenderThread::instance()->cancel(this);
+  m_paintCachePending.clear();
+}
+
+void Widget::setRenderedPaintCache(const os::SurfaceRef& surface)
+{
+  // The cache could be resized or discarded in the meantime
+  if (!m_paintCache ||
+      m_paintCache->width() != surface->width() ||
+      m_paintCache->height() != surface->height())
+    return;
+
+  m_paintCache = surface;
+  m_paintCachePending.clear();
+
+  // Copy the new cache to the screen (without dirtying it)
+  invalidateRegion(gfx::Region(bounds()));
+}
+
 class DeleteGraphicsAndSurface {
 public:
   DeleteGraphicsAndSurface(const gfx::Rect& clip,
@@ -1573,6 +1748,12 @@ bool Widget::onProcessMessage(Message* msg)
       ASSERT(ptmsg->rect().w > 0);
       ASSERT(ptmsg->rect().h > 0);
 
+      if (m_paintCached &&
+          !isTransparent() &&
+          paintFromCache(toClient(ptmsg->rect()))) {
+        return true;
+      }
+
       GraphicsPtr graphics = getGraphics(toClient(ptmsg->rect()));
       return paintEvent(graphics.get(), false);
     }
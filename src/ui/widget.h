@@ -1,5 +1,5 @@
 // Aseprite UI Library
-// Copyright (C) 2018-2023  Igara Studio S.A.
+// Copyright (C) 2018-2024  Igara Studio S.A.
 // Copyright (C) 2001-2018  David Capello
 //
 // This file is released under the terms of the MIT license.
@@ -309,6 +309,29 @@ namespace ui {
     void invalidateRect(const gfx::Rect& rect);
     void invalidateRegion(const gfx::Region& region);
 
+    // A widget with a paint cache is painted in an offscreen surface,
+    // and exposed areas (e.g. when a window over it is moved/closed)
+    // are copied from that surface without calling onPaint() again.
+    // The cache is repainted in the areas given to invalidate(),
+    // invalidateRect(), and invalidatePaintCache(), or completely
+    // when the widget is resized or its theme changes, but not in
+    // the ones given to invalidateRegion() (used by parents to
+    // propagate exposed areas to their children). It's not used in
+    // transparent widgets.
+    bool isPaintCached() const { return m_paintCached; }
+    void setPaintCached(bool state);
+    void invalidatePaintCache();
+    void invalidatePaintCache(const gfx::Rect& rect);
+
+    // Paints the dirty areas of the paint cache in the RenderThread:
+    // onPaint() is still called from the UI thread, but it records a
+    // DisplayList that is rasterized in other thread. Meanwhile the
+    // previous content of the cache is displayed. It enables the
+    // paint cache, and the widget must not use
+    // Graphics::getInternalSurface() or Graphics::getPixel().
+    bool isPaintInRenderThread() const { return m_paintInRenderThread; }
+    void setPaintInRenderThread(bool state);
+
     // Returns the region to generate PaintMessages. It's cleared
     // after flushRedraw() is called.
     const gfx::Region& getUpdateRegion() const {
@@ -430,6 +453,10 @@ namespace ui {
                const bool isBg);
     bool paintEvent(Graphics* graphics,
                     const bool isBg);
+    bool paintFromCache(const gfx::Rect& clientRect);
+    void paintCacheInRenderThread();
+    void cancelPaintInRenderThread();
+    void setRenderedPaintCache(const os::SurfaceRef& surface);
     void setDirtyFlag();
 
     WidgetType m_type;           // Widget's type
@@ -460,6 +487,18 @@ namespace ui {
 
     gfx::Border m_border;       // Border separation with the parent
     int m_childSpacing;         // Separation between children
+
+    // Paint cache (see setPaintCached()), the dirty region is in
+    // client coordinates
+    bool m_paintCached;
+    os::SurfaceRef m_paintCache;
+    gfx::Region m_paintCacheDirty;
+
+    // Areas of the cache that are being painted in the RenderThread
+    bool m_paintInRenderThread;
+    gfx::Region m_paintCachePending;
+
+    friend class RenderThread;
   };
 
   WidgetType register_widget_type();
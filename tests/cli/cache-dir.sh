@@ -0,0 +1,28 @@
+#! /bin/bash
+# Copyright (C) 2024 Igara Studio S.A.
+
+d=$t/cache-dir
+mkdir -p $d
+cp sprites/1empty3.aseprite $d/input.aseprite
+
+function export_sheet() {
+    $ASEPRITE -b $d/input.aseprite --cache-dir $d/cache \
+              --sheet $d/sheet.png --data $d/sheet.json || exit 1
+}
+
+export_sheet
+[ -f $d/sheet.png ] || fail "sheet.png wasn't created"
+[ -f $d/sheet.json ] || fail "sheet.json wasn't created"
+cp $d/sheet.png $d/expected.png
+cp $d/sheet.json $d/expected.json
+
+# The output files are restored from the cache
+rm $d/sheet.png $d/sheet.json
+export_sheet
+cmp $d/sheet.png $d/expected.png || fail "sheet.png wasn't restored"
+cmp $d/sheet.json $d/expected.json || fail "sheet.json wasn't restored"
+
+# A modified input file generates the files again
+cp sprites/tags3.aseprite $d/input.aseprite
+export_sheet
+! cmp -s $d/sheet.json $d/expected.json || fail "sheet.json wasn't updated"
@@ -0,0 +1,32 @@
+#! /bin/bash
+# Copyright (C) 2024 Igara Studio S.A.
+
+d=$t/shard
+mkdir -p $d
+cp sprites/1empty3.aseprite $d/a.aseprite
+cp sprites/1empty3.aseprite $d/b.aseprite
+
+# Each shard exports one of the input files
+for i in 1 2 ; do
+    $ASEPRITE -b --shard $i/2 $d/a.aseprite $d/b.aseprite \
+              --format json-array \
+              --sheet $d/sheet$i.png --data $d/sheet$i.json || exit 1
+done
+
+$ASEPRITE -b --merge-sheet-data $d/sheet.json \
+          $d/sheet1.json $d/sheet2.json || exit 1
+
+cat >$d/compare.lua <<EOF2
+local json = dofile('third_party/json/json.lua')
+local data1 = json.decode(io.open('$d/sheet1.json'):read('a'))
+local data2 = json.decode(io.open('$d/sheet2.json'):read('a'))
+local data = json.decode(io.open('$d/sheet.json'):read('a'))
+assert(#data1.frames == 3)
+assert(#data2.frames == 3)
+assert(#data.frames == 6)
+assert(data.frames[1].filename == data1.frames[1].filename)
+assert(data.frames[4].filename == data2.frames[1].filename)
+assert(data.frames[1].image == 'sheet1.png')
+assert(data.frames[4].image == 'sheet2.png')
+EOF2
+$ASEPRITE -b -script "$d/compare.lua" || exit 1
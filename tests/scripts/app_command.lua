@@ -320,6 +320,62 @@ do -- BrightnessContrast
                d[3], d[4] })
 end
 
+do -- FilterChain
+  local s = Sprite(2, 2)
+  local i = app.activeCel.image
+  local c = { rgba(255, 128, 64), rgba(250, 225, 110),
+              rgba( 30,  60,  0), rgba(200, 100,  50), }
+  for k,v in ipairs(c) do
+    i:drawPixel((k-1) % 2, (k-1) // 2, v)
+  end
+
+  -- Same result as applying each filter separately
+  app.command.BrightnessContrast{ brightness=50 }
+  app.command.InvertColor()
+  local d = i:clone()
+  app.undo()
+  app.undo()
+  expect_img(i, c)
+
+  app.command.FilterChain{ brightness=50, invert=true }
+  assert(i:isEqual(d))
+
+  -- Just one undo step
+  app.undo()
+  expect_img(i, c)
+end
+
+do -- ColorLut
+  local s = Sprite(2, 2)
+  local i = app.activeCel.image
+  local c = { rgba(255, 128, 64), rgba(250, 225, 110),
+              rgba( 30,  60,  0), rgba(200, 100,  50), }
+  for k,v in ipairs(c) do
+    i:drawPixel((k-1) % 2, (k-1) // 2, v)
+  end
+
+  -- The saved LUT gives the same result as the baked one
+  local fn = app.fs.joinPath(app.fs.tempPath, "_test_color_lut.cube")
+  app.command.FilterChain{ invert=true, lutSize=17, saveLut=fn }
+  local d = i:clone()
+  app.undo()
+  expect_img(i, c)
+
+  app.command.ColorLut{ filename=fn }
+  assert(i:isEqual(d))
+  app.undo()
+
+  -- Inversion is linear so the LUT is almost exact
+  app.command.InvertColor()
+  for k=0,3 do
+    local x, y = k % 2, k // 2
+    local a, b = i:getPixel(x, y), d:getPixel(x, y)
+    assert(math.abs(rgbaR(a) - rgbaR(b)) <= 1)
+    assert(math.abs(rgbaG(a) - rgbaG(b)) <= 1)
+    assert(math.abs(rgbaB(a) - rgbaB(b)) <= 1)
+  end
+end
+
 do -- Despeckle
   local s = Sprite(5, 5)
   local white = Color(255, 255, 255)
@@ -0,0 +1,49 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+local fs = app.fs
+
+do
+  local nsprites = #app.sprites
+  local spr = Sprite(32, 16, ColorMode.INDEXED)
+  spr:newLayer()
+  spr:newEmptyFrame()
+  spr:newEmptyFrame()
+  spr:newTag(2, 3).name = "walk"
+  spr:newSlice(Rectangle(0, 0, 4, 4)).name = "hit"
+  spr:saveAs("_test_probe.aseprite")
+  spr:close()
+
+  local info = fs.probe("_test_probe.aseprite")
+  assert(info.width == 32)
+  assert(info.height == 16)
+  assert(info.colorMode == ColorMode.INDEXED)
+  assert(info.frames == 3)
+  assert(#info.layers == 2)
+  assert(#info.tags == 1)
+  assert(info.tags[1].name == "walk")
+  assert(info.tags[1].fromFrame == 2)
+  assert(info.tags[1].toFrame == 3)
+  assert(#info.slices == 1)
+  assert(info.slices[1] == "hit")
+
+  -- The probed file isn't opened
+  assert(#app.sprites == nsprites)
+end
+
+do
+  local spr = Sprite(24, 8, ColorMode.RGB)
+  spr:saveAs("_test_probe.png")
+  spr:close()
+
+  local info = fs.probe("_test_probe.png")
+  assert(info.width == 24)
+  assert(info.height == 8)
+  assert(info.frames == 1)
+end
+
+assert(fs.probe("_test_probe_missing.png") == nil)
@@ -0,0 +1,30 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+do
+  local base = app.memory
+  assert(base.total >= 0)
+
+  local spr = Sprite(32, 32, ColorMode.RGB)
+  local mem = app.memory
+  assert(#mem.documents == #base.documents + 1)
+
+  local doc = mem.documents[#mem.documents]
+  assert(doc.images >= 32*32*4)
+  assert(doc.total == doc.images + doc.tilesets + doc.undo)
+  assert(mem.total >= doc.total)
+
+  -- The undo history grows with each change
+  local undo = doc.undo
+  app.useTool{ tool='filled_rectangle', color=Color(255, 0, 0),
+               points={ Point(0, 0), Point(31, 31) } }
+  doc = app.memory.documents[#mem.documents]
+  assert(doc.undo > undo)
+
+  spr:close()
+  assert(#app.memory.documents == #base.documents)
+end
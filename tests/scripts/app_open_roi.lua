@@ -0,0 +1,55 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+-- Sprite with 4 frames, each frame with a different cel
+local spr = Sprite(32, 32, ColorMode.RGB)
+local lay = spr.layers[1]
+for i=2,4 do spr:newEmptyFrame() end
+for i=1,4 do
+  local img = Image(8, 8, ColorMode.RGB)
+  img:clear(Color(i*60, 0, 0))
+  spr:newCel(lay, i, img, Point(i*4, i*4))
+end
+spr:saveAs("_test_roi.aseprite")
+spr:close()
+
+-- Load a range of frames
+do
+  local s = app.open("_test_roi.aseprite", { fromFrame=2, toFrame=3 })
+  assert(#s.frames == 2)
+  assert(s.width == 32 and s.height == 32)
+  expect_eq(Point(8, 8), s.layers[1]:cel(1).position)
+  expect_eq(Point(12, 12), s.layers[1]:cel(2).position)
+  s:close()
+end
+
+-- Load a region of the sprite
+do
+  local s = app.open("_test_roi.aseprite", { bounds=Rectangle(12, 12, 16, 16) })
+  assert(#s.frames == 4)
+  assert(s.width == 16 and s.height == 16)
+  assert(s.layers[1]:cel(1) == nil)  -- Cel outside the bounds
+  expect_eq(Rectangle(0, 0, 4, 4), s.layers[1]:cel(2).bounds)
+  expect_eq(Rectangle(0, 0, 8, 8), s.layers[1]:cel(3).bounds)
+  expect_eq(Rectangle(4, 4, 8, 8), s.layers[1]:cel(4).bounds)
+  s:close()
+end
+
+-- Region of a .png file
+do
+  local s = Sprite(32, 32, ColorMode.RGB)
+  s.cels[1].image:drawPixel(16, 16, Color(255, 0, 0))
+  s:saveAs("_test_roi.png")
+  s:close()
+
+  s = app.open("_test_roi.png", { bounds=Rectangle(16, 8, 8, 16) })
+  assert(s.width == 8 and s.height == 16)
+  local cel = s.cels[1]
+  expect_eq(Rectangle(0, 0, 8, 16), cel.bounds)
+  expect_eq(Color(255, 0, 0).rgbaPixel, cel.image:getPixel(0, 8))
+  s:close()
+end
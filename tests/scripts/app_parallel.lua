@@ -0,0 +1,36 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+local rgba = app.pixelColor.rgba
+
+-- Remap images and cels
+do
+  local a = Image(2, 2, ColorMode.INDEXED)
+  local b = Image(2, 2, ColorMode.INDEXED)
+  a.bytes = string.char(1, 2, 3, 4)
+  b.bytes = string.char(4, 3, 2, 1)
+
+  app.parallel.remap({ a, b, a }, { [1]=5, [4]=6 })
+  expect_img(a, { 5, 2,
+                  3, 6 })
+  expect_img(b, { 6, 3,
+                  2, 5 })
+
+  local spr = Sprite(2, 1)
+  local cel = spr.cels[1]
+  cel.image:drawPixel(0, 0, rgba(255, 0, 0))
+  app.parallel.replaceColor({ cel }, rgba(255, 0, 0), rgba(0, 0, 255))
+  expect_img(cel.image, { rgba(0, 0, 255), 0 })
+end
+
+-- Big images are processed in several tasks
+do
+  local img = Image(300, 300)
+  img:clear(rgba(1, 2, 3))
+  app.parallel.replaceColor({ img }, rgba(1, 2, 3), rgba(4, 5, 6))
+  assert(img:isPlain(rgba(4, 5, 6)))
+end
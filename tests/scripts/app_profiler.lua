@@ -0,0 +1,34 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+local function fill(img)
+  for y=0,img.height-1 do
+    for x=0,img.width-1 do
+      img:drawPixel(x, y, img:getPixel(x, y) + 1)
+    end
+  end
+end
+
+do
+  local img = Image(16, 16, ColorMode.RGB)
+
+  assert(not app.profiler.isRunning)
+  app.profiler.start()
+  assert(app.profiler.isRunning)
+  fill(img)
+  local report = app.profiler.stop()
+  assert(not app.profiler.isRunning)
+
+  assert(report:find("Image:getPixel") ~= nil)
+  assert(report:find("Image:drawPixel") ~= nil)
+  assert(report:find("fill") ~= nil)
+  assert(report:find("app_profiler.lua") ~= nil)
+  assert(report == app.profiler.report())
+
+  app.profiler.clear()
+  assert(app.profiler.report():find("Image:getPixel") == nil)
+end
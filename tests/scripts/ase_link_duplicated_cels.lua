@@ -0,0 +1,39 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+-- Sprite with 4 unlinked cels, cels 1, 2 and 4 have the same image
+-- and position, cel 3 has a different opacity
+local spr = Sprite(32, 32, ColorMode.RGB)
+local lay = spr.layers[1]
+for i=2,4 do spr:newEmptyFrame() end
+for i=1,4 do
+  local img = Image(8, 8, ColorMode.RGB)
+  img:clear(Color(255, 0, 0))
+  local cel = spr:newCel(lay, i, img, Point(4, 4))
+  if i == 3 then cel.opacity = 128 end
+end
+
+local oldPref = app.preferences.save_file.link_duplicated_cels
+app.preferences.save_file.link_duplicated_cels = true
+spr:saveAs("_test_link_duplicated_cels.aseprite")
+app.preferences.save_file.link_duplicated_cels = oldPref
+spr:close()
+
+do
+  local s = app.open("_test_link_duplicated_cels.aseprite")
+  local cels = s.layers[1].cels
+  assert(#cels == 4)
+  assert(cels[1].image.id == cels[2].image.id)
+  assert(cels[1].image.id == cels[4].image.id)
+  assert(cels[1].image.id ~= cels[3].image.id)
+  expect_eq(128, cels[3].opacity)
+  for i=1,4 do
+    expect_eq(Point(4, 4), cels[i].position)
+    expect_eq(Color(255, 0, 0).rgbaPixel, cels[i].image:getPixel(0, 0))
+  end
+  s:close()
+end
@@ -1,4 +1,4 @@
--- Copyright (C) 2021  Igara Studio S.A.
+-- Copyright (C) 2021-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -134,3 +134,18 @@ do
   s:close()
   app.events:off(onSiteChange)
 end
+
+-- Listener options (without UI the events are delivered immediately)
+do
+  local spr = Sprite(32, 32)
+  local changes = 0
+  local listener = spr.events:on('change',
+                                 function() changes = changes + 1 end,
+                                 { coalesce=true, maxRate=30 })
+  spr.width = 64
+  spr.height = 64
+  expect_eq(2, changes)
+  spr.events:off(listener)
+  spr.width = 32
+  expect_eq(2, changes)
+end
@@ -1,4 +1,4 @@
--- Copyright (C) 2019-2023  Igara Studio S.A.
+-- Copyright (C) 2019-2024  Igara Studio S.A.
 -- Copyright (C) 2018  David Capello
 --
 -- This file is released under the terms of the MIT license.
@@ -62,6 +62,33 @@ do
                     1, 2 })
 end
 
+-- Get/set bytes of rectangles & remap pixels
+do
+  local img = Image(3, 2, ColorMode.INDEXED)
+  img.bytes = string.char(1, 2, 3,
+                          4, 5, 6)
+
+  assert(img:getBytes() == img.bytes)
+  assert(img:getBytes(Rectangle(1, 0, 2, 2)) == string.char(2, 3, 5, 6))
+
+  img:setBytes(string.char(7, 8), Rectangle(0, 1, 2, 1))
+  expect_img(img, { 1, 2, 3,
+                    7, 8, 6 })
+
+  img:remap({ [1]=0, [8]=9 })
+  expect_img(img, { 0, 2, 3,
+                    7, 9, 6 })
+
+  img:remap({ [2]=1, [6]=1 }, Rectangle(2, 0, 1, 2))
+  expect_img(img, { 0, 2, 3,
+                    7, 9, 1 })
+
+  local rgb = Image(2, 1)
+  rgb:setBytes(string.pack("<I4I4", rgba(255, 0, 0), rgba(0, 0, 255)))
+  rgb:remap({ [rgba(255, 0, 0)]=rgba(0, 255, 0) })
+  expect_img(rgb, { rgba(0, 255, 0), rgba(0, 0, 255) })
+end
+
 -- Clone
 do
   local c = Image(a)
@@ -451,3 +478,18 @@ local spr = Sprite(3, 3)   -- Test with sprite (with transactions & undo/redo)
 test_image_flip(app.image)
 app.sprite = nil           -- Test without sprite (without transactions)
 test_image_flip(Image(3, 3))
+
+-- Image:release()
+do
+  local img = Image(32, 32)
+  expect_eq(32, img.width)
+  img:release()
+  assert(not pcall(function() return img.width end))
+  img:release() -- Releasing twice does nothing
+
+  -- Images in a loop are collected with their pixels size
+  for i=1,100 do
+    local tmp = Image(512, 512)
+    tmp:clear(i)
+  end
+end
@@ -1,3 +1,4 @@
+-- Copyright (C) 2024  Igara Studio S.A.
 -- Copyright (C) 2018  David Capello
 --
 -- This file is released under the terms of the MIT license.
@@ -70,3 +71,36 @@ do
       c = c+1
    end
 end
+
+-- Iterate rows
+do
+   local image = Image(3, 2, ColorMode.INDEXED)
+   local rows = 0
+   for y,row in image:rows() do
+      assert(#row == 3)
+      for x=0,#row-1 do
+         row[x] = y*3 + x
+      end
+      assert(row[-1] == nil)
+      assert(row[3] == nil)
+      rows = rows+1
+   end
+   assert(rows == 2)
+   for y=0,1 do
+      for x=0,2 do
+         assert(image:getPixel(x, y) == y*3 + x)
+      end
+   end
+
+   -- Only a part of the image
+   local n = 0
+   for y,row in image:rows(Rectangle(1, 1, 5, 5)) do
+      assert(y == 1)
+      assert(#row == 2)
+      assert(row[0] == nil)
+      assert(row[1] == 4)
+      assert(row[2] == 5)
+      n = n+1
+   end
+   assert(n == 1)
+end
@@ -1,4 +1,4 @@
--- Copyright (C) 2021  Igara Studio S.A.
+-- Copyright (C) 2021-2024  Igara Studio S.A.
 --
 -- This file is released under the terms of the MIT license.
 -- Read LICENSE.txt for more information.
@@ -73,3 +73,38 @@ do
                3, 2 })
 
 end
+
+-- Ignore empty tiles and link duplicated tiles
+do
+  local s = Sprite(12, 2, ColorMode.INDEXED)
+  array_to_pixels({ 1, 1, 0, 0, 1, 1, 2, 3, 0, 0, 2, 3,
+                    1, 1, 0, 0, 1, 1, 2, 3, 0, 0, 2, 3 }, s.cels[1].image)
+
+  app.command.ImportSpriteSheet{
+    ui=false,
+    type=SpriteSheetType.ROWS,
+    frameBounds=Rectangle(0, 0, 2, 2),
+    ignoreEmpty=true
+  }
+  assert(#s.frames == 4)
+  assert(#s.cels == 4)
+  expect_img(s.cels[1].image, { 1, 1, 1, 1 })
+  expect_img(s.cels[2].image, { 1, 1, 1, 1 })
+  expect_img(s.cels[3].image, { 2, 3, 2, 3 })
+  expect_img(s.cels[4].image, { 2, 3, 2, 3 })
+  assert(s.cels[1].image.id ~= s.cels[2].image.id)
+
+  app.undo()
+  app.command.ImportSpriteSheet{
+    ui=false,
+    type=SpriteSheetType.ROWS,
+    frameBounds=Rectangle(0, 0, 2, 2),
+    ignoreEmpty=true,
+    mergeDuplicates=true
+  }
+  assert(#s.frames == 4)
+  expect_img(s.cels[1].image, { 1, 1, 1, 1 })
+  expect_img(s.cels[3].image, { 2, 3, 2, 3 })
+  assert(s.cels[1].image.id == s.cels[2].image.id)
+  assert(s.cels[3].image.id == s.cels[4].image.id)
+end
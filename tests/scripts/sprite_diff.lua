@@ -0,0 +1,35 @@
+-- Copyright (C) 2024  Igara Studio S.A.
+--
+-- This file is released under the terms of the MIT license.
+-- Read LICENSE.txt for more information.
+
+dofile('./test_utils.lua')
+
+do
+  local a = Sprite(32, 32, ColorMode.RGB)
+  a.cels[1].image:drawPixel(4, 4, Color(255, 0, 0))
+  a:newFrame()
+  a:saveAs("_test_diff.aseprite")
+
+  local b = app.open("_test_diff.aseprite")
+  assert(not a:diff(b).anything)
+  assert(not a:diff(b, true).anything)
+
+  -- Different pixel
+  b.cels[2].image:drawPixel(4, 4, Color(0, 255, 0))
+  local d = a:diff(b)
+  assert(d.anything)
+  assert(d.images)
+  assert(not d.canvas)
+  assert(not d.layers)
+  assert(a:diff(b, true).anything)
+
+  -- Different canvas
+  b:resize(16, 16)
+  d = a:diff(b)
+  assert(d.anything)
+  assert(d.canvas)
+
+  b:close()
+  a:close()
+end